@@ -0,0 +1,68 @@
+//===-- ConstraintsBench.cpp ----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Workload.h"
+
+#include "klee/Internal/Support/IndependentElementSet.h"
+
+#include "benchmark/benchmark.h"
+
+using namespace klee;
+using namespace klee::bench;
+
+namespace {
+
+/// range(0) factors of the constraints over 16 arrays, each made of a few
+/// predicates so that they read several elements of several arrays
+std::vector<IndependentElementSet> makeFactors(Workload &w, unsigned n) {
+  std::vector<IndependentElementSet> factors;
+  for (unsigned i = 0; i < n; ++i) {
+    IndependentElementSet s(w.predicate(2));
+    for (unsigned j = 0; j < 3; ++j)
+      s.add(IndependentElementSet(w.predicate(2)));
+    factors.push_back(s);
+  }
+  return factors;
+}
+
+/// Merges every factor into a copy of another one, as the constraint
+/// manager does when a new constraint joins two factors
+void BM_IndependentSetUnion(benchmark::State &state) {
+  Workload w(16, 64);
+  std::vector<IndependentElementSet> factors = makeFactors(w, state.range(0));
+
+  for (auto _ : state) {
+    for (unsigned i = 0; i + 1 < factors.size(); ++i) {
+      IndependentElementSet merged(factors[i]);
+      benchmark::DoNotOptimize(merged.add(factors[i + 1]));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * (factors.size() - 1));
+}
+BENCHMARK(BM_IndependentSetUnion)->Arg(16)->Arg(256);
+
+/// Tests all pairs of factors for intersection, as the independent solver
+/// does when it looks for the factors of a query
+void BM_IndependentSetIntersects(benchmark::State &state) {
+  Workload w(16, 64);
+  std::vector<IndependentElementSet> factors = makeFactors(w, state.range(0));
+
+  for (auto _ : state) {
+    unsigned hits = 0;
+    for (unsigned i = 0; i < factors.size(); ++i)
+      for (unsigned j = i + 1; j < factors.size(); ++j)
+        hits += factors[i].intersects(factors[j]);
+    benchmark::DoNotOptimize(hits);
+  }
+  state.SetItemsProcessed(state.iterations() * factors.size() *
+                          (factors.size() - 1) / 2);
+}
+BENCHMARK(BM_IndependentSetIntersects)->Arg(16)->Arg(128);
+
+} // namespace
@@ -0,0 +1,103 @@
+//===-- ExprBench.cpp -----------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Workload.h"
+
+#include "klee/Expr/ExprBuilder.h"
+
+#include "benchmark/benchmark.h"
+
+#include <memory>
+
+using namespace klee;
+using namespace klee::bench;
+
+namespace {
+
+/// Rebuilds trees of depth range(0) through the folding and simplifying
+/// builders, with constants on either side so that most levels fold.
+void BM_ExprBuilderFolding(benchmark::State &state) {
+  std::unique_ptr<ExprBuilder> builder(createSimplifyingExprBuilder(
+      createConstantFoldingExprBuilder(createDefaultExprBuilder())));
+  Workload w(4, 16);
+  std::vector<ref<Expr>> leaves;
+  for (unsigned i = 0; i < 256; ++i)
+    leaves.push_back(
+        i % 2 ? ZExtExpr::create(w.byte(), Expr::Int32)
+              : ref<Expr>(ConstantExpr::create(w.next(256), Expr::Int32)));
+  unsigned depth = state.range(0);
+
+  for (auto _ : state) {
+    unsigned leaf = 0;
+    std::vector<ref<Expr>> level(leaves);
+    for (unsigned d = 0; d < depth && level.size() > 1; ++d) {
+      std::vector<ref<Expr>> up;
+      for (unsigned i = 0; i + 1 < level.size(); i += 2) {
+        ref<Expr> l = level[i], r = level[i + 1];
+        switch ((leaf++) % 4) {
+        case 0:
+          up.push_back(builder->Add(l, r));
+          break;
+        case 1:
+          up.push_back(builder->And(l, r));
+          break;
+        case 2:
+          up.push_back(builder->Sub(builder->Add(l, r), r));
+          break;
+        default:
+          up.push_back(builder->Xor(builder->Xor(l, r), l));
+        }
+      }
+      level.swap(up);
+    }
+    benchmark::DoNotOptimize(level.front());
+  }
+  state.SetItemsProcessed(state.iterations() * leaves.size());
+}
+BENCHMARK(BM_ExprBuilderFolding)->Arg(2)->Arg(8);
+
+/// Reads at constant indices through an update list of range(0) constant
+/// writes. The writes are at even and the reads at odd indices, so that no
+/// write matches: short lists are walked, longer ones looked up in their
+/// index of concrete writes (UpdateNode::MinIndexedSize).
+void BM_ReadOverUpdateList(benchmark::State &state) {
+  Workload w(1, 4096);
+  UpdateList ul(w.array(0), 0);
+  for (int64_t i = 0; i < state.range(0); ++i)
+    ul.extend(ConstantExpr::create(w.next(2048) * 2, Expr::Int32),
+              ConstantExpr::create(w.next(256), Expr::Int8));
+  std::vector<ref<Expr>> indices;
+  for (unsigned i = 0; i < 64; ++i)
+    indices.push_back(ConstantExpr::create(w.next(2048) * 2 + 1, Expr::Int32));
+
+  for (auto _ : state)
+    for (const ref<Expr> &index : indices)
+      benchmark::DoNotOptimize(ReadExpr::create(ul, index));
+  state.SetItemsProcessed(state.iterations() * indices.size());
+}
+BENCHMARK(BM_ReadOverUpdateList)->Arg(16)->Arg(256)->Arg(4096);
+
+/// As BM_ReadOverUpdateList, with symbolic writes and a symbolic index
+void BM_ReadSymbolicOverUpdateList(benchmark::State &state) {
+  Workload w(2, 4096);
+  UpdateList ul(w.array(0), 0);
+  for (int64_t i = 0; i < state.range(0); ++i) {
+    ref<Expr> index = ConstantExpr::create(w.next(4096), Expr::Int32);
+    if (i % 4 == 0)
+      index = ZExtExpr::create(w.byte(), Expr::Int32);
+    ul.extend(index, w.byte());
+  }
+  ref<Expr> index = ZExtExpr::create(w.byte(), Expr::Int32);
+
+  for (auto _ : state)
+    benchmark::DoNotOptimize(ReadExpr::create(ul, index));
+}
+BENCHMARK(BM_ReadSymbolicOverUpdateList)->Arg(16)->Arg(256)->Arg(4096);
+
+} // namespace
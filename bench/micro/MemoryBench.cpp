@@ -0,0 +1,80 @@
+//===-- MemoryBench.cpp ---------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Workload.h"
+
+#include "../../lib/Core/AddressSpace.h"
+#include "../../lib/Core/Memory.h"
+
+#include "benchmark/benchmark.h"
+
+using namespace klee;
+using namespace klee::bench;
+
+namespace {
+
+/// Mixed reads and writes of 4096 bytes, range(0) percent of the writes
+/// being symbolic bytes and the others concrete words
+void BM_ObjectStateReadWrite(benchmark::State &state) {
+  Workload w(1, 4096);
+  ref<const MemoryObject> mo(
+      new MemoryObject(0x10000, 4096, false, true, false, false, 0, 0));
+  ObjectState os(mo.get(), w.array(0));
+  for (unsigned i = 0; i < 4096; i += 4)
+    os.write32(i, i, 0, 0);
+  std::vector<unsigned> offsets;
+  std::vector<bool> symbolic;
+  for (unsigned i = 0; i < 256; ++i) {
+    offsets.push_back(w.next(4096 - 4));
+    symbolic.push_back(w.next(100) < state.range(0));
+  }
+  ref<Expr> value = w.byte();
+
+  for (auto _ : state)
+    for (unsigned i = 0; i < offsets.size(); ++i) {
+      if (symbolic[i])
+        os.write(offsets[i], value, 0, 0);
+      else
+        os.write32(offsets[i], offsets[i], 0, 0);
+      benchmark::DoNotOptimize(os.read(offsets[(i * 7) % offsets.size()],
+                                       Expr::Int32));
+    }
+  state.SetItemsProcessed(state.iterations() * offsets.size());
+}
+BENCHMARK(BM_ObjectStateReadWrite)->Arg(0)->Arg(10)->Arg(50);
+
+/// Resolves concrete addresses within range(0) objects of one address space
+void BM_AddressSpaceResolveOne(benchmark::State &state) {
+  Workload w(1, 256);
+  AddressSpace as;
+  std::vector<ref<const MemoryObject>> objects;
+  for (int64_t i = 0; i < state.range(0); ++i) {
+    uint64_t size = 16 + w.next(240);
+    objects.emplace_back(new MemoryObject(0x100000 + i * 0x100, size, false,
+                                          true, false, false, 0, 0));
+    as.bindObject(objects.back().get(), new ObjectState(objects.back().get(),
+                                                        w.array(0)));
+  }
+  std::vector<ref<ConstantExpr>> addresses;
+  for (unsigned i = 0; i < 256; ++i) {
+    const MemoryObject *mo = objects[w.next(objects.size())].get();
+    addresses.push_back(ConstantExpr::create(
+        mo->address + w.next(mo->size), Expr::Int64));
+  }
+
+  for (auto _ : state)
+    for (const ref<ConstantExpr> &address : addresses) {
+      ObjectPair op;
+      benchmark::DoNotOptimize(as.resolveOne(address, op));
+    }
+  state.SetItemsProcessed(state.iterations() * addresses.size());
+}
+BENCHMARK(BM_AddressSpaceResolveOne)->Arg(16)->Arg(1024)->Arg(16384);
+
+} // namespace
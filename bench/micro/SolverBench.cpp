@@ -0,0 +1,78 @@
+//===-- SolverBench.cpp ---------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Workload.h"
+
+#include "klee/Expr/Constraints.h"
+#include "klee/Solver/Solver.h"
+#include "klee/Solver/SolverImpl.h"
+
+#include "benchmark/benchmark.h"
+
+#include <memory>
+
+using namespace klee;
+using namespace klee::bench;
+
+namespace {
+
+/// Answers every query with the all-zero assignment, so that the cache
+/// above it is measured without a core solver
+class ZeroSolverImpl : public SolverImpl {
+public:
+  bool computeTruth(const Query &, bool &isValid) override {
+    isValid = false;
+    return true;
+  }
+  bool computeValue(const Query &query, ref<Expr> &result) override {
+    result = ConstantExpr::create(0, query.expr->getWidth());
+    return true;
+  }
+  bool computeInitialValues(const Query &,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char>> &values,
+                            bool &hasSolution) override {
+    for (const Array *array : objects)
+      values.push_back(std::vector<unsigned char>(array->size, 0));
+    hasSolution = true;
+    return true;
+  }
+  SolverRunStatus getOperationStatusCode() override {
+    return SOLVER_RUN_STATUS_SUCCESS_SOLVABLE;
+  }
+};
+
+/// Repeats range(0) distinct queries, with 4 constraints each, against the
+/// counterexample cache once they are all cached
+void BM_CexCacheLookup(benchmark::State &state) {
+  std::unique_ptr<Solver> solver(
+      createCexCachingSolver(new Solver(new ZeroSolverImpl())));
+  Workload w(8, 16);
+  std::vector<std::unique_ptr<ConstraintManager>> constraints;
+  std::vector<ref<Expr>> exprs;
+  for (int64_t i = 0; i < state.range(0); ++i) {
+    constraints.emplace_back(new ConstraintManager());
+    for (unsigned j = 0; j < 4; ++j)
+      constraints.back()->addConstraint(w.predicate(1));
+    exprs.push_back(w.predicate(1));
+  }
+  bool result;
+  for (unsigned i = 0; i < exprs.size(); ++i)
+    solver->mayBeTrue(Query(*constraints[i], exprs[i]), result);
+
+  for (auto _ : state)
+    for (unsigned i = 0; i < exprs.size(); ++i) {
+      solver->mayBeTrue(Query(*constraints[i], exprs[i]), result);
+      benchmark::DoNotOptimize(result);
+    }
+  state.SetItemsProcessed(state.iterations() * exprs.size());
+}
+BENCHMARK(BM_CexCacheLookup)->Arg(64)->Arg(1024);
+
+} // namespace
@@ -0,0 +1,84 @@
+//===-- Workload.h ----------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_BENCH_WORKLOAD_H
+#define KLEE_BENCH_WORKLOAD_H
+
+#include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/Expr.h"
+#include "klee/Internal/ADT/RNG.h"
+
+#include "llvm/ADT/StringExtras.h"
+
+#include <vector>
+
+namespace klee {
+namespace bench {
+
+/// Generates the inputs of the microbenchmarks from a fixed seed, so that
+/// every run, and every release, measures the same expressions.
+class Workload {
+  RNG rng;
+  ArrayCache cache;
+  std::vector<const Array *> arrays;
+  unsigned arraySize;
+
+public:
+  Workload(unsigned numArrays, unsigned _arraySize, unsigned seed = 1)
+      : rng(seed), arraySize(_arraySize) {
+    for (unsigned i = 0; i < numArrays; ++i)
+      arrays.push_back(cache.CreateArray("a" + llvm::utostr(i), arraySize));
+  }
+
+  /// A number in [0, bound)
+  unsigned next(unsigned bound) { return rng.getInt32() % bound; }
+
+  const Array *array(unsigned i) const { return arrays[i]; }
+  unsigned getNumArrays() const { return arrays.size(); }
+
+  /// A byte of a random array at a constant index
+  ref<Expr> byte() {
+    UpdateList ul(arrays[next(arrays.size())], 0);
+    return ReadExpr::create(ul, ConstantExpr::create(next(arraySize),
+                                                     Expr::Int32));
+  }
+
+  /// A 32-bit arithmetic tree of the given depth over bytes and constants
+  ref<Expr> term(unsigned depth) {
+    if (depth == 0) {
+      if (next(4))
+        return ZExtExpr::create(byte(), Expr::Int32);
+      return ConstantExpr::create(next(256), Expr::Int32);
+    }
+    ref<Expr> l = term(depth - 1), r = term(depth - 1);
+    switch (next(5)) {
+    case 0:
+      return AddExpr::create(l, r);
+    case 1:
+      return SubExpr::create(l, r);
+    case 2:
+      return AndExpr::create(l, r);
+    case 3:
+      return XorExpr::create(l, r);
+    default:
+      return MulExpr::create(l, r);
+    }
+  }
+
+  /// A boolean comparison of two terms
+  ref<Expr> predicate(unsigned depth) {
+    ref<Expr> l = term(depth), r = term(depth);
+    return next(2) ? UltExpr::create(l, r) : EqExpr::create(l, r);
+  }
+};
+
+} // namespace bench
+} // namespace klee
+
+#endif /* KLEE_BENCH_WORKLOAD_H */
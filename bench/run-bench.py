@@ -0,0 +1,287 @@
+#!/usr/bin/env python3
+# -*- encoding: utf-8 -*-
+
+# ===-- run-bench.py ------------------------------------------------------===##
+#
+#                      The KLEE Symbolic Virtual Machine
+#
+#  This file is distributed under the University of Illinois Open Source
+#  License. See LICENSE.TXT for details.
+#
+# ===----------------------------------------------------------------------===##
+
+"""Measure the throughput of klee on the programs of benchmarks.json.
+
+Each benchmark is compiled to bitcode and explored once with -write-paths;
+the longest recorded path becomes its reference trace. Then every mode is
+run --repeat times:
+
+  explore      full symbolic exploration
+  replay-path  -replay-path of the reference .path (and its .path_datarec)
+  replay-ktest -replay-ktest-file of the reference .ktest
+
+The results, one object per benchmark and mode with the median run, are
+written as JSON. With --baseline, a mode whose instructions/sec dropped by
+more than --tolerance against a previous result file fails the run.
+"""
+
+import argparse
+import hashlib
+import json
+import os
+import re
+import shutil
+import sqlite3
+import statistics
+import subprocess
+import sys
+import time
+
+MODES = ['explore', 'replay-path', 'replay-ktest']
+
+
+def sha256(path):
+    with open(path, 'rb') as f:
+        return hashlib.sha256(f.read()).hexdigest()
+
+
+def run_klee(args, cwd, log):
+    """Run klee, return (wall seconds, peak RSS in KiB, exit status)."""
+    start = time.monotonic()
+    with open(log, 'w') as out:
+        proc = subprocess.Popen(args, cwd=cwd, stdout=out,
+                                stderr=subprocess.STDOUT)
+        _, status, usage = os.wait4(proc.pid, 0)
+    proc.returncode = (os.WEXITSTATUS(status) if os.WIFEXITED(status)
+                       else -os.WTERMSIG(status))
+    return time.monotonic() - start, usage.ru_maxrss, proc.returncode
+
+
+def read_results(outDir):
+    """The counters of a klee output directory."""
+    r = {}
+    con = sqlite3.connect(os.path.join(outDir, 'run.stats'))
+    row = con.execute('SELECT Instructions, NumQueries, SolverTime, WallTime '
+                      'FROM stats ORDER BY rowid DESC LIMIT 1').fetchone()
+    con.close()
+    if row:
+        r['instructions'], r['queries'] = row[0], row[1]
+        r['solver_time_s'], r['klee_wall_time_s'] = row[2] / 1e6, row[3] / 1e6
+    with open(os.path.join(outDir, 'info')) as f:
+        m = re.search(r'explored paths = (\d+)', f.read())
+    if m:
+        r['forks'] = int(m.group(1)) - 1
+    return r
+
+
+class Bench:
+    def __init__(self, args, entry):
+        self.args = args
+        self.name = entry['name']
+        self.entry = entry
+        self.workDir = os.path.join(args.work_dir, self.name)
+        self.bitcode = os.path.join(self.workDir, self.name + '.bc')
+        self.traceDir = os.path.join(args.traces, self.name)
+
+    def kleeArgs(self, outDir, extra):
+        args = [self.args.klee, '-output-dir=' + outDir,
+                '-max-time=%ds' % self.args.time_limit]
+        if self.entry.get('posix'):
+            args += ['-libc=uclibc', '-posix-runtime']
+        return args + self.entry.get('klee_args', []) + extra + [self.bitcode]
+
+    def prepare(self):
+        os.makedirs(self.workDir, exist_ok=True)
+        for f in self.entry.get('files', []):
+            shutil.copy(os.path.join(self.args.source_dir, f), self.workDir)
+        subprocess.check_call(
+            self.args.cc.split() +
+            ['-I', os.path.join(self.args.source_dir, 'include'), '-emit-llvm',
+             '-c', '-g', '-O0', '-Xclang', '-disable-O0-optnone'] +
+            self.entry.get('cflags', []) +
+            [os.path.join(self.args.source_dir, self.entry['source']),
+             '-o', self.bitcode])
+
+        # a trace recorded against other bitcode does not replay
+        stamp = os.path.join(self.traceDir, 'bitcode.sha256')
+        digest = sha256(self.bitcode)
+        if os.path.isfile(stamp) and not self.args.rerecord:
+            with open(stamp) as f:
+                if f.read().strip() == digest:
+                    return
+        self.record()
+        with open(stamp, 'w') as f:
+            f.write(digest + '\n')
+
+    def record(self):
+        outDir = os.path.join(self.workDir, 'record.klee-out')
+        shutil.rmtree(outDir, ignore_errors=True)
+        _, _, status = run_klee(self.kleeArgs(outDir, ['-write-paths']),
+                                self.workDir, outDir + '.log')
+        if status != 0:
+            raise RuntimeError('recording exited with %d, see %s.log' %
+                               (status, outDir))
+        paths = [f for f in os.listdir(outDir) if f.endswith('.path')]
+        if not paths:
+            raise RuntimeError('recording wrote no .path file')
+        longest = max(paths,
+                      key=lambda f: os.path.getsize(os.path.join(outDir, f)))
+        test = os.path.join(outDir, longest[:-len('.path')])
+        os.makedirs(self.traceDir, exist_ok=True)
+        for ext in ['path', 'path_datarec', 'ktest']:
+            dst = os.path.join(self.traceDir, 'reference.' + ext)
+            if os.path.exists(test + '.' + ext):
+                shutil.copy(test + '.' + ext, dst)
+            elif os.path.exists(dst):
+                os.remove(dst)
+
+    def modeArgs(self, mode):
+        if mode == 'explore':
+            return []
+        ext = 'path' if mode == 'replay-path' else 'ktest'
+        trace = os.path.join(self.traceDir, 'reference.' + ext)
+        if not os.path.isfile(trace):
+            return None
+        if mode == 'replay-path':
+            return ['-replay-path=' + trace]
+        return ['-replay-ktest-file=' + trace]
+
+    def measure(self, mode):
+        extra = self.modeArgs(mode)
+        if extra is None:
+            return None
+        runs = []
+        for i in range(self.args.repeat):
+            outDir = os.path.join(self.workDir, '%s.%d.klee-out' % (mode, i))
+            shutil.rmtree(outDir, ignore_errors=True)
+            wall, rss, status = run_klee(self.kleeArgs(outDir, extra),
+                                         self.workDir, outDir + '.log')
+            if status != 0:
+                raise RuntimeError('%s exited with %d, see %s.log' %
+                                   (mode, status, outDir))
+            r = read_results(outDir)
+            r['wall_time_s'], r['peak_rss_kib'] = wall, rss
+            runs.append(r)
+
+        median = sorted(runs, key=lambda r: r['wall_time_s'])[len(runs) // 2]
+        result = {'benchmark': self.name, 'mode': mode, 'runs': len(runs)}
+        result.update(median)
+        wall = median['wall_time_s']
+        for key in ['instructions', 'forks', 'queries']:
+            if key in median:
+                result[key + '_per_s'] = median[key] / wall if wall else 0
+        if median.get('klee_wall_time_s'):
+            result['solver_time_share'] = (median['solver_time_s'] /
+                                           median['klee_wall_time_s'])
+        result['peak_rss_kib'] = max(r['peak_rss_kib'] for r in runs)
+        result['wall_time_stdev_s'] = (
+            statistics.stdev(r['wall_time_s'] for r in runs)
+            if len(runs) > 1 else 0)
+        return result
+
+
+def compare(results, baselineFile, tolerance):
+    """Print the modes slower than the baseline, return their number."""
+    with open(baselineFile) as f:
+        baseline = {(r['benchmark'], r['mode']): r
+                    for r in json.load(f)['results']}
+    regressions = 0
+    for r in results:
+        old = baseline.get((r['benchmark'], r['mode']))
+        if not old or not old.get('instructions_per_s'):
+            continue
+        change = r['instructions_per_s'] / old['instructions_per_s'] - 1
+        if change < -tolerance:
+            regressions += 1
+            print('regression: %s %s: %.0f instructions/s, was %.0f (%+.1f%%)'
+                  % (r['benchmark'], r['mode'], r['instructions_per_s'],
+                     old['instructions_per_s'], 100 * change))
+    return regressions
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    parser = argparse.ArgumentParser(
+        description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--klee', required=True, help='klee binary')
+    parser.add_argument('--cc', required=True, help='C bitcode compiler')
+    parser.add_argument('--source-dir', default=os.path.dirname(here),
+                        help='KLEE source tree')
+    parser.add_argument('--manifest',
+                        default=os.path.join(here, 'benchmarks.json'))
+    parser.add_argument('--work-dir', required=True,
+                        help='where bitcode and klee output directories go')
+    parser.add_argument('--traces',
+                        help='reference traces, reused while the bitcode is '
+                        'unchanged (default: <work-dir>/traces)')
+    parser.add_argument('--rerecord', action='store_true',
+                        help='record the reference traces again')
+    parser.add_argument('--output', default='-',
+                        help='JSON result file (default: stdout)')
+    parser.add_argument('--repeat', type=int, default=3,
+                        help='runs per benchmark and mode (default: 3)')
+    parser.add_argument('--time-limit', type=int, default=300,
+                        help='-max-time of each run in seconds')
+    parser.add_argument('--filter', default='',
+                        help='only the benchmarks whose name matches')
+    parser.add_argument('--modes', default=','.join(MODES),
+                        help='comma separated subset of ' + ', '.join(MODES))
+    parser.add_argument('--posix', action='store_true',
+                        help='klee has the POSIX runtime and uclibc; '
+                        'benchmarks needing them are skipped otherwise')
+    parser.add_argument('--baseline', help='a previous result file')
+    parser.add_argument('--tolerance', type=float, default=0.1,
+                        help='allowed drop of instructions/sec against '
+                        '--baseline (default: 0.1)')
+    args = parser.parse_args()
+    args.work_dir = os.path.abspath(args.work_dir)
+    if not args.traces:
+        args.traces = os.path.join(args.work_dir, 'traces')
+    args.traces = os.path.abspath(args.traces)
+    modes = args.modes.split(',')
+    for m in modes:
+        if m not in MODES:
+            parser.error('unknown mode ' + m)
+
+    with open(args.manifest) as f:
+        entries = json.load(f)
+
+    results, skipped, failed = [], [], []
+    for entry in entries:
+        if not re.search(args.filter, entry['name']):
+            continue
+        if entry.get('posix') and not args.posix:
+            skipped.append(entry['name'])
+            continue
+        bench = Bench(args, entry)
+        try:
+            bench.prepare()
+            for mode in modes:
+                print('bench: %s %s' % (bench.name, mode), file=sys.stderr)
+                r = bench.measure(mode)
+                if r:
+                    results.append(r)
+        except (RuntimeError, subprocess.CalledProcessError) as e:
+            print('bench: %s failed: %s' % (bench.name, e), file=sys.stderr)
+            failed.append(bench.name)
+
+    report = {'klee': os.path.abspath(args.klee),
+              'date': time.strftime('%Y-%m-%dT%H:%M:%S%z'),
+              'repeat': args.repeat, 'results': results,
+              'skipped': skipped, 'failed': failed}
+    if args.output == '-':
+        json.dump(report, sys.stdout, indent=2)
+        print()
+    else:
+        with open(args.output, 'w') as f:
+            json.dump(report, f, indent=2)
+            f.write('\n')
+
+    regressions = compare(results, args.baseline, args.tolerance) \
+        if args.baseline else 0
+    return 1 if failed or regressions else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,316 @@
+#!/usr/bin/env python3
+# -*- encoding: utf-8 -*-
+
+# ===-- run-er-pipeline.py ------------------------------------------------===##
+#
+#                      The KLEE Symbolic Virtual Machine
+#
+#  This file is distributed under the University of Illinois Open Source
+#  License. See LICENSE.TXT for details.
+#
+# ===----------------------------------------------------------------------===##
+
+"""Measure the time ER takes to reproduce the failures of pipeline.json.
+
+Each scenario goes through the iterations of examples/*/klee-record.sh and
+klee-replay.sh, with the failing run recorded under klee as in the artifact:
+
+  prepass  instrument the bitcode with the data recording of this iteration
+  record   run the oracle input with -write-paths, the trace of the failure
+  replay   -replay-path of the trace with the inputs symbolic
+  analyze  kleaver -analyze -select-recording of the solver-timeoutNNN.kquery
+           the replay stalled on, the instructions to record next iteration
+
+until a replay finishes without a solver timeout. The test case it generates
+is then validated: run concretely with -replay-ktest-file, it has to take
+the control flow of the recorded trace (pathviewer -dump of both).
+
+Scenarios with a "bitcode" are external applications, e.g. those of the
+bundled memcached_1_5_13 and apache_60324 socket simulators, looked up in
+--bugbase and skipped when missing. The others are compiled from the tree.
+
+The report holds, by scenario, the wall time of every stage of every
+iteration, the bytes traced, the instructions recorded, the number of
+iterations and the total time to reproduction.
+"""
+
+import argparse
+import json
+import os
+import re
+import shutil
+import subprocess
+import sys
+import time
+
+# the options of examples/qsort/klee-record.sh and klee-replay.sh
+KLEE_COMMON = ['-solver-backend=stp', '-output-stats=false',
+               '-output-istats=false', '-use-forked-solver=false',
+               '-output-source=false', '-write-paths', '--libc=uclibc',
+               '--posix-runtime', '-env-file=env_file',
+               '-pathrec-entry-point=__klee_posix_wrapped_main',
+               '-ignore-posix-path=true', '-allocate-determ']
+KLEE_RECORD = ['-call-solver=false', '-use-independent-solver=false',
+               '-oob-check=false']
+KLEE_REPLAY = ['-write-kqueries', '-use-independent-solver=true',
+               '-oob-check=true', '-simplify-sym-indices=true',
+               '-record-solver-timeouts']
+
+
+def run(args, cwd, log):
+    """Run a stage, return (wall seconds, exit status)."""
+    start = time.monotonic()
+    with open(log, 'w') as out:
+        status = subprocess.call(args, cwd=cwd, stdout=out,
+                                 stderr=subprocess.STDOUT)
+    return time.monotonic() - start, status
+
+
+def readCfg(path):
+    if not os.path.isfile(path):
+        return set()
+    with open(path) as f:
+        return set(line.strip() for line in f if line.strip())
+
+
+def fileSize(path):
+    return os.path.getsize(path) if os.path.isfile(path) else 0
+
+
+class Scenario:
+    def __init__(self, args, entry):
+        self.args = args
+        self.name = entry['name']
+        self.entry = entry
+        self.workDir = os.path.join(args.work_dir, self.name)
+        self.base = os.path.join(self.workDir, self.name + '.bc')
+
+    def stage(self, name, cmd, log):
+        """Run a stage of the pipeline, raise if it failed."""
+        wall, status = run(cmd, self.workDir, os.path.join(self.workDir, log))
+        if status != 0:
+            raise RuntimeError('%s exited with %d, see %s' %
+                               (name, status, os.path.join(self.workDir, log)))
+        return wall
+
+    def available(self):
+        bitcode = self.entry.get('bitcode')
+        return not bitcode or (self.args.bugbase and os.path.isfile(
+            os.path.join(self.args.bugbase, bitcode)))
+
+    def prepare(self):
+        shutil.rmtree(self.workDir, ignore_errors=True)
+        os.makedirs(self.workDir)
+        root = self.args.bugbase if 'bitcode' in self.entry \
+            else self.args.source_dir
+        for f in self.entry.get('files', []):
+            shutil.copy(os.path.join(root, f), self.workDir)
+        # record and replay must see the same environment
+        with open(os.path.join(self.workDir, 'env_file'), 'w') as f:
+            f.write('PATH=/usr/bin:/bin\n')
+        if 'bitcode' in self.entry:
+            shutil.copy(os.path.join(self.args.bugbase, self.entry['bitcode']),
+                        self.base)
+            return
+        subprocess.check_call(
+            self.args.cc.split() +
+            ['-I', os.path.join(self.args.source_dir, 'include'), '-emit-llvm',
+             '-c', '-g', '-O0', '-Xclang', '-disable-O0-optnone'] +
+            self.entry.get('cflags', []) +
+            [os.path.join(self.args.source_dir, self.entry['source']),
+             '-o', self.base])
+
+    def klee(self, outDir, extra, bitcode, programArgs):
+        return ([self.args.klee, '-output-dir=' + outDir,
+                 '-max-time=%ds' % self.args.time_limit] + KLEE_COMMON +
+                self.entry.get('klee_args', []) + extra + [bitcode] +
+                programArgs)
+
+    def iterate(self, i):
+        """Run iteration i, return its record and whether it reproduced."""
+        cfg = 'datarec.%d.cfg' % i
+        bitcode = 'prepass.%d.bc' % i
+        recordDir, replayDir = 'record.%d.klee-out' % i, \
+            'replay.%d.klee-out' % i
+        it = {'iteration': i,
+              'recorded_instructions': len(readCfg(
+                  os.path.join(self.workDir, cfg)))}
+
+        it['prepass_s'] = self.stage(
+            'prepass', [self.args.prepass, '-assign-id', '-insert-ptwrite',
+                        '-ptwrite-cfg=' + cfg, self.name + '.bc', bitcode],
+            'prepass.%d.log' % i)
+
+        it['record_s'] = self.stage(
+            'record', self.klee(recordDir, KLEE_RECORD, bitcode,
+                                self.entry.get('record_args', [])),
+            recordDir + '.log')
+        trace = os.path.join(self.workDir, recordDir, 'test000001.path')
+        if not os.path.isfile(trace):
+            raise RuntimeError('the record run wrote no trace')
+        it['control_flow_bytes'] = fileSize(trace)
+        it['data_bytes'] = fileSize(trace + '_datarec')
+
+        it['replay_s'] = self.stage(
+            'replay', self.klee(replayDir,
+                                KLEE_REPLAY + ['-replay-path=' + trace,
+                                               '-max-solver-time=%ds' %
+                                               self.args.solver_timeout],
+                                bitcode, self.entry.get('replay_args', [])),
+            replayDir + '.log')
+        replayPath = os.path.join(self.workDir, replayDir)
+        stalls = sorted(f for f in os.listdir(replayPath)
+                        if re.match(r'solver-timeout\d+\.kquery$', f))
+        it['solver_timeouts'] = len(stalls)
+        ktests = sorted(f for f in os.listdir(replayPath)
+                        if f.endswith('.ktest'))
+        if not stalls and ktests:
+            return it, os.path.join(replayPath, ktests[0])
+
+        # what to record when the failure happens again
+        selected = readCfg(os.path.join(self.workDir, cfg))
+        it['analyze_s'] = 0
+        for q in stalls:
+            it['analyze_s'] += self.stage(
+                'analyze', [self.args.kleaver, '-analyze',
+                            '-select-recording=%d' % self.args.select,
+                            '-bitcode=' + bitcode, os.path.join(replayDir, q)],
+                '%s.analyze.log' % os.path.join(replayDir, q))
+            selected |= readCfg(os.path.join(replayPath, q + '.ptwrite-cfg'))
+        if len(selected) == it['recorded_instructions']:
+            raise RuntimeError('iteration %d selected nothing new to record'
+                               % i)
+        with open(os.path.join(self.workDir, 'datarec.%d.cfg' % (i + 1)),
+                  'w') as f:
+            f.write(''.join(s + '\n' for s in sorted(selected)))
+        return it, None
+
+    def validate(self, i, ktest):
+        """Run ktest concretely, return (wall seconds, same control flow)."""
+        bitcode = 'prepass.%d.bc' % i
+        outDir = 'validate.klee-out'
+        wall = self.stage(
+            'validate', self.klee(outDir, KLEE_RECORD +
+                                  ['-replay-ktest-file=' + ktest], bitcode,
+                                  self.entry.get('replay_args', [])),
+            outDir + '.log')
+
+        def dump(path):
+            return subprocess.check_output(
+                [self.args.pathviewer, '-dump', path], cwd=self.workDir)
+
+        trace = os.path.join(self.workDir, outDir, 'test000001.path')
+        recorded = os.path.join(self.workDir, 'record.%d.klee-out' % i,
+                                'test000001.path')
+        return wall, os.path.isfile(trace) and dump(trace) == dump(recorded)
+
+    def measure(self):
+        self.prepare()
+        open(os.path.join(self.workDir, 'datarec.1.cfg'), 'w').close()
+        result = {'scenario': self.name, 'iterations': [],
+                  'reproduced': False, 'validated': False}
+        for i in range(1, self.args.max_iterations + 1):
+            print('er-pipeline: %s iteration %d' % (self.name, i),
+                  file=sys.stderr)
+            it, ktest = self.iterate(i)
+            result['iterations'].append(it)
+            if ktest:
+                result['reproduced'] = True
+                result['validate_s'], result['validated'] = \
+                    self.validate(i, ktest)
+                break
+
+        its = result['iterations']
+        result['num_iterations'] = len(its)
+        result['bytes_traced'] = sum(it['control_flow_bytes'] +
+                                     it['data_bytes'] for it in its)
+        result['time_to_reproduction_s'] = sum(
+            it[k] for it in its for k in it if k.endswith('_s'))
+        result['time_to_reproduction_s'] += result.get('validate_s', 0)
+        for stage in ['prepass', 'record', 'replay', 'analyze']:
+            result[stage + '_s'] = sum(it.get(stage + '_s', 0) for it in its)
+        return result
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    parser = argparse.ArgumentParser(
+        description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--klee', required=True, help='klee binary')
+    parser.add_argument('--kleaver', required=True, help='kleaver binary')
+    parser.add_argument('--prepass', required=True, help='prepass binary')
+    parser.add_argument('--pathviewer', required=True,
+                        help='pathviewer binary')
+    parser.add_argument('--cc', required=True, help='C bitcode compiler')
+    parser.add_argument('--source-dir', default=os.path.dirname(here),
+                        help='KLEE source tree')
+    parser.add_argument('--manifest',
+                        default=os.path.join(here, 'pipeline.json'))
+    parser.add_argument('--bugbase',
+                        help='where the bitcode of the external scenarios is')
+    parser.add_argument('--work-dir', required=True,
+                        help='where the iterations of each scenario run')
+    parser.add_argument('--output', default='-',
+                        help='JSON result file (default: stdout)')
+    parser.add_argument('--max-iterations', type=int, default=5,
+                        help='failure reoccurrences to give up after '
+                        '(default: 5)')
+    parser.add_argument('--select', type=int, default=4,
+                        help='instructions kleaver selects by stalled query '
+                        '(default: 4)')
+    parser.add_argument('--solver-timeout', type=int, default=10,
+                        help='-max-solver-time of the replay in seconds, a '
+                        'query taking longer stalls it (default: 10)')
+    parser.add_argument('--time-limit', type=int, default=3600,
+                        help='-max-time of each klee run in seconds')
+    parser.add_argument('--filter', default='',
+                        help='only the scenarios whose name matches')
+    args = parser.parse_args()
+    args.work_dir = os.path.abspath(args.work_dir)
+    if args.bugbase:
+        args.bugbase = os.path.abspath(args.bugbase)
+
+    with open(args.manifest) as f:
+        entries = json.load(f)
+
+    results, skipped, failed = [], [], []
+    for entry in entries:
+        if not re.search(args.filter, entry['name']):
+            continue
+        scenario = Scenario(args, entry)
+        if not scenario.available():
+            skipped.append(entry['name'])
+            continue
+        try:
+            r = scenario.measure()
+            results.append(r)
+            print('er-pipeline: %s: %s after %d iterations, %.1fs, %d bytes '
+                  'traced' % (r['scenario'],
+                              'validated' if r['validated'] else
+                              'reproduced' if r['reproduced'] else
+                              'not reproduced', r['num_iterations'],
+                              r['time_to_reproduction_s'],
+                              r['bytes_traced']), file=sys.stderr)
+            if not r['validated']:
+                failed.append(entry['name'])
+        except (RuntimeError, subprocess.CalledProcessError) as e:
+            print('er-pipeline: %s failed: %s' % (entry['name'], e),
+                  file=sys.stderr)
+            failed.append(entry['name'])
+
+    report = {'klee': os.path.abspath(args.klee),
+              'date': time.strftime('%Y-%m-%dT%H:%M:%S%z'),
+              'results': results, 'skipped': skipped, 'failed': failed}
+    if args.output == '-':
+        json.dump(report, sys.stdout, indent=2)
+        print()
+    else:
+        with open(args.output, 'w') as f:
+            json.dump(report, f, indent=2)
+            f.write('\n')
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
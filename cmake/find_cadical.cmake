@@ -0,0 +1,36 @@
+#===------------------------------------------------------------------------===#
+#
+#                     The KLEE Symbolic Virtual Machine
+#
+# This file is distributed under the University of Illinois Open Source
+# License. See LICENSE.TXT for details.
+#
+#===------------------------------------------------------------------------===#
+find_package(CaDiCaL)
+# Set the default so that if the following is true:
+# * CaDiCaL was found
+# * ENABLE_SOLVER_CADICAL is not already set as a cache variable
+#
+# then the default is set to `ON`. Otherwise set the default to `OFF`.
+if (CaDiCaL_FOUND)
+  set(ENABLE_SOLVER_CADICAL_DEFAULT ON)
+else()
+  set(ENABLE_SOLVER_CADICAL_DEFAULT OFF)
+endif()
+option(ENABLE_SOLVER_CADICAL
+  "Enable CaDiCaL support, used by -use-sat-bitblaster"
+  ${ENABLE_SOLVER_CADICAL_DEFAULT})
+
+if (ENABLE_SOLVER_CADICAL)
+  message(STATUS "CaDiCaL support enabled")
+  if (CaDiCaL_FOUND)
+    set(ENABLE_CADICAL 1) # For config.h
+    list(APPEND KLEE_COMPONENT_EXTRA_INCLUDE_DIRS ${CaDiCaL_INCLUDE_DIRS})
+    list(APPEND KLEE_SOLVER_LIBRARIES ${CaDiCaL_LIBRARIES})
+  else()
+    message(FATAL_ERROR "CaDiCaL not found.")
+  endif()
+else()
+  message(STATUS "CaDiCaL support disabled")
+  set(ENABLE_CADICAL 0) # For config.h
+endif()
@@ -0,0 +1,35 @@
+# Tries to find an install of the CaDiCaL library and header files
+#
+# Once done this will define
+#  CaDiCaL_FOUND - BOOL: System has the CaDiCaL library installed
+#  CaDiCaL_INCLUDE_DIRS - LIST:The CaDiCaL include directories
+#  CaDiCaL_LIBRARIES - LIST:The libraries needed to use CaDiCaL
+include(FindPackageHandleStandardArgs)
+
+# Try to find libraries
+find_library(CaDiCaL_LIBRARIES
+  NAMES cadical
+  DOC "CaDiCaL libraries"
+)
+if (CaDiCaL_LIBRARIES)
+  message(STATUS "Found CaDiCaL libraries: \"${CaDiCaL_LIBRARIES}\"")
+else()
+  message(STATUS "Could not find CaDiCaL libraries")
+endif()
+
+# Try to find headers
+find_path(CaDiCaL_INCLUDE_DIRS
+  NAMES cadical.hpp
+  PATH_SUFFIXES cadical
+  DOC "CaDiCaL C++ header"
+)
+if (CaDiCaL_INCLUDE_DIRS)
+  message(STATUS "Found CaDiCaL include path: \"${CaDiCaL_INCLUDE_DIRS}\"")
+else()
+  message(STATUS "Could not find CaDiCaL include path")
+endif()
+
+# Handle QUIET and REQUIRED and check the necessary variables were set and if so
+# set ``CaDiCaL_FOUND``
+find_package_handle_standard_args(CaDiCaL DEFAULT_MSG CaDiCaL_INCLUDE_DIRS
+  CaDiCaL_LIBRARIES)
@@ -12,6 +12,8 @@
 
 #include "klee/Expr/Constraints.h"
 #include "klee/Expr/Expr.h"
+#include "klee/Expr/ExprHashMap.h"
+#include "klee/Internal/ADT/ImmutableSet.h"
 #include "klee/Internal/ADT/TreeStream.h"
 #include "klee/Internal/System/Time.h"
 #include "klee/MergeHandler.h"
@@ -28,16 +30,40 @@
 
 namespace klee {
 class Array;
-class PTreeNode;
 struct InstructionInfo;
 
 llvm::raw_ostream &operator<<(llvm::raw_ostream &os, const MemoryMap &mm);
 
+/// A process of a state, forked with klee_process_fork. Its threads are the
+/// ones of ExecutionState::threads with its pid.
+struct Process {
+  /// The process that forked it. The main process and the orphans are their
+  /// own parent.
+  process_id_t ppid;
+  /// The memory of the process while another one is running, empty while it
+  /// runs itself (its memory is then ExecutionState::addressSpace)
+  AddressSpace addressSpace;
+  /// The waiting list of the threads waiting for a child to exit, 0 until
+  /// one waits
+  wlist_id_t childWaitList;
+
+  explicit Process(process_id_t ppid) : ppid(ppid), childWaitList(0) {}
+  Process(process_id_t ppid, const AddressSpace &addressSpace)
+      : ppid(ppid), addressSpace(addressSpace), childWaitList(0) {}
+};
+
 /// @brief ExecutionState representing a path under exploration
 class ExecutionState {
 public:
   typedef std::map<thread_uid_t, Thread> threads_ty;
-  typedef std::map<wlist_id_t, std::set<thread_uid_t>> wlists_ty;
+  typedef std::map<process_id_t, Process> processes_ty;
+  /// The (parent, exit status) of the exited processes, until their parent
+  /// waits for them
+  typedef std::map<process_id_t, std::pair<process_id_t, int32_t> >
+      zombies_ty;
+  /// The (waiting list, thread) pairs of the sleeping threads, persistent
+  /// so that branching a state shares them.
+  typedef ImmutableSet<std::pair<wlist_id_t, thread_uid_t> > wlists_ty;
   typedef Thread::stack_ty stack_ty;
 
 private:
@@ -46,6 +72,10 @@ private:
   // for initialization
   void setupMain(KFunction *kf);
   void setupTime();
+  // swap in the address space of process to, see scheduleNext
+  void switchProcess(process_id_t from, process_id_t to);
+  // the address space holding the memory of process pid
+  AddressSpace &getAddressSpace(process_id_t pid);
 
 public:
   // Execution - Control Flow specific (include multi-threading)
@@ -54,13 +84,22 @@ public:
   wlists_ty waitingLists;
   // used to allocate new wlist_id
   wlist_id_t wlistCounter;
+  // number of enabled threads in threads, kept by the thread functions below
+  unsigned numEnabledThreads;
   // logical timestamp, each instruction takes one unit time
   uint64_t stateTime;
   threads_ty::iterator crtThreadIt;
+  processes_ty processes;
+  zombies_ty zombies;
+  /// The objects klee_make_shared shares between the processes, their
+  /// binding in the address space of a process follows it to the next
+  /// process that runs
+  std::vector<ref<const MemoryObject> > sharedMemory;
 
   // Overall state of the state - Data specific
 
-  /// @brief Address space used by this state (e.g. Global and Heap)
+  /// @brief Address space used by this state (e.g. Global and Heap), the
+  /// one of the running process
   AddressSpace addressSpace;
 
   /// @brief Constraints collected so far
@@ -74,6 +113,17 @@ public:
   mutable time::Span prev_fork_queryCost;
   mutable time::Span prev_fork_queryCost_single;
 
+  /// An answer of the solver for an expression, kept while the constraints
+  /// the expression depends on have the fingerprint they had then
+  struct MemoizedAnswer {
+    uint64_t fingerprint;
+    ref<Expr> first, second;
+  };
+  /// The values getValue found for expressions
+  mutable ExprHashMap<MemoizedAnswer> valueMemo;
+  /// The ranges getRange found for expressions
+  mutable ExprHashMap<MemoizedAnswer> rangeMemo;
+
   /// Whether Executor executes into __user_main
   /// It influences whether we should record/replay execution path
   /// This is a process level state (not thread level)
@@ -117,24 +167,49 @@ public:
   /// object.
   unsigned replayPosition;
   unsigned replayDataRecEntriesPosition;
+  /// No symbolic data is reachable from registers or memory, so every value
+  /// computed from here on is constant until a symbolic object is bound.
+  /// Only tracked with -replay-concrete-fast-path.
+  bool concreteOnly;
+  /// Concrete forks left before the next hasSymbolicData() probe, and the
+  /// current probe interval
+  unsigned concreteProbeCountdown;
+  unsigned concreteProbeBackoff;
+  /// Times this state disagreed with the trace and went on anyway
+  /// (-replay-continue-after-divergence), the trace position of the first
+  /// disagreement and steppedInstructions at that point
+  unsigned replayDivergences;
+  unsigned replayDivergedAt;
+  std::uint64_t replayDivergedStep;
+  /// Replay branch conditions fixed by the trace but not yet checked by the
+  /// solver (-replay-batch-branches), with their trace positions
+  std::vector<std::pair<ref<Expr>, unsigned>> deferredBranches;
+  /// Constraints before the first deferred branch
+  Constraints_ty deferredBase;
   /// The number of branches recorded
   /// regardless of fork or switch or indirectbr, symbolic or concrete
   ///   should record or not (isInPosix, isInUserMain)
   unsigned nbranches_rec;
 
-  /// @brief Set containing which lines in which files are covered by this state
-  std::map<const std::string *, std::set<unsigned> > coveredLines;
+  /// @brief The instructions first covered by this state, in the order it
+  /// covered them. An instruction is first covered by a single state, so
+  /// there are no duplicates; the lines are only gathered for the .cov files.
+  std::vector<const InstructionInfo *> coveredInstructions;
 
-  /// @brief Pointer to the process tree of the current state
-  PTreeNode *ptreeNode;
+  /// @brief Index of the leaf of the current state in the process tree, 0
+  /// if it is not in one
+  std::uint32_t ptreeNode;
 
   /// @brief Ordered list of symbolics: used to generate test cases.
+  ///
+  /// The objects of a batch share one array and are listed consecutively,
+  /// each taking the bytes of the array after those of the previous one.
   //
   // FIXME: Move to a shared list structure (not critical).
   std::vector<std::pair<ref<const MemoryObject>, const Array *>> symbolics;
 
   /// @brief Set of used array names for this state.  Used to avoid collisions.
-  std::set<std::string> arrayNames;
+  ImmutableSet<std::string> arrayNames;
 
   // The objects handling the klee_open_merge calls this state ran through
   std::vector<ref<MergeHandler> > openMergeStack;
@@ -142,13 +217,17 @@ public:
   // The numbers of times this state has run through Executor::stepInstruction
   std::uint64_t steppedInstructions;
 
+  /// The value of stats::instructions when the searcher last selected this
+  /// state, with which the coldest states are spilled at the memory cap
+  std::uint64_t lastScheduled;
+
   /// A map tracking what function was executed at the N-th instruction.
   /// This is used to extract the list of functions executed during the suffix
   /// of a trace
   std::unordered_map<std::string, unsigned int> func_inst_map;
 
 private:
-  ExecutionState() : replayPosition(0), replayDataRecEntriesPosition(0), nbranches_rec(0), ptreeNode(0) {}
+  ExecutionState() : numEnabledThreads(0), replayPosition(0), replayDataRecEntriesPosition(0), concreteOnly(false), concreteProbeCountdown(0), concreteProbeBackoff(0), replayDivergences(0), replayDivergedAt(0), replayDivergedStep(0), nbranches_rec(0), ptreeNode(0), lastScheduled(0) {}
 
 public:
   ExecutionState(KFunction *kf);
@@ -165,10 +244,18 @@ public:
   ExecutionState *branch();
 
   void addSymbolic(const MemoryObject *mo, const Array *array);
+
+  /// The distinct arrays of symbolics, in order
+  std::vector<const Array *> getSymbolicArrays() const;
   /// return true if e could be True
   bool addConstraint(ref<Expr> e) { return constraints.addConstraint(e); }
 
-  bool merge(const ExecutionState &b);
+  /// Merge b into this state, unless their path constraints differ in more
+  /// than maxDifferingConstraints constraints.
+  bool merge(const ExecutionState &b, unsigned maxDifferingConstraints = ~0u);
+
+  /// Scan all stack frames and objects for non-constant values.
+  bool hasSymbolicData() const;
   void pushFrame(KInstIterator caller, KFunction *kf) {
     pushFrame(crtThread(), caller, kf);
   }
@@ -180,6 +267,8 @@ public:
 
   Thread &createThread(thread_id_t tid, KFunction *kf);
   void terminateThread(threads_ty::iterator it);
+  /// Disable the thread, which is exiting.
+  void disableThread(Thread &t);
   threads_ty::iterator nextThread(threads_ty::iterator it) {
     if (it != threads.end())
       ++it;
@@ -187,14 +276,36 @@ public:
       it = threads.begin();
     return it;
   }
-  void scheduleNext(threads_ty::iterator it) {
-    assert(it != threads.end());
-    crtThreadIt = it;
-  }
+  /// Make it the running thread, switching to the address space of its
+  /// process
+  void scheduleNext(threads_ty::iterator it);
   wlist_id_t getWaitingList() { return wlistCounter++; }
   void sleepThread(wlist_id_t wlist);
   void notifyOne(wlist_id_t wlist, thread_uid_t tid);
   void notifyAll(wlist_id_t wlist);
+  /// Set tuid to the first thread sleeping on wlist.
+  /// \return false if no thread is sleeping on wlist
+  bool getFirstWaiting(wlist_id_t wlist, thread_uid_t &tuid) const;
+
+  /* Multi-processes related function */
+
+  /// Fork the running process into process pid, which starts with a copy of
+  /// the running thread and shares the memory until one of them writes it.
+  /// \return the thread of the new process
+  Thread &forkProcess(process_id_t pid);
+  /// The lowest process id not in use, 0 if there is none left
+  process_id_t getFreeProcessId() const;
+  /// Disable the threads of process pid, which exits with status, and wake
+  /// up its parent if it is waiting
+  void disableProcess(process_id_t pid, int32_t status);
+  /// Remove the threads and the memory of the disabled process pid
+  void terminateProcess(process_id_t pid);
+  /// Reap an exited child of the running process, any of them if pid < 0.
+  /// \return the id of the child, 0 if the matching children are all
+  /// running, -1 if there are none
+  int64_t reapChild(int64_t pid, int32_t &status);
+  /// Share the memory of mo between the processes
+  void shareMemory(const MemoryObject *mo);
 
   /* Debugging helper */
   void dumpConstraints(llvm::raw_ostream &out) const;
@@ -202,6 +313,8 @@ public:
   void dumpStack(llvm::raw_ostream &out) const;
   void dumpStack() const;
   void dumpStackPathOS();
+  /// Write an already rendered stack to stackPathOS
+  void dumpStackPathOS(const std::string &stack);
   void dumpStatsPathOS();
   void dumpConsPathOS(const std::string &cons);
 
@@ -221,6 +334,9 @@ public:
   inline bool shouldRecord() const {
     return isInUserMain && !isInPOSIX();
   }
+  /// True if the body of kf would be on the recorded path if it were called
+  /// now
+  bool shouldRecordCall(KFunction *kf) const;
   inline bool isInTargetProgram() const {
     return isInUserMain && !isInPOSIX() && !isInLIBC();
   }
@@ -5,5 +5,7 @@
 namespace klee {
   extern llvm::cl::opt<std::string> OracleKTest;
   extern llvm::cl::opt<unsigned int> DumpFunctionListSuffixLen;
+  extern llvm::cl::opt<bool> ReplayPathPrefix;
+  extern llvm::cl::opt<unsigned> ExportFrontierStates;
 }
 #endif
@@ -13,6 +13,7 @@
 #include "klee/Expr/Expr.h"
 #include "klee/Expr/ArrayExprHash.h" // For klee::ArrayHashFn
 
+#include <atomic>
 #include <string>
 #include <unordered_set>
 #include <vector>
@@ -66,6 +67,9 @@ private:
   ArrayHashMap cachedSymbolicArrays;
   typedef std::vector<const Array *> ArrayPtrVec;
   ArrayPtrVec concreteArrays;
+
+  /// the id of the next array kept, shared by all caches
+  static std::atomic<unsigned> nextId;
 };
 }
 
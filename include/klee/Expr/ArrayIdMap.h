@@ -0,0 +1,65 @@
+//===-- ArrayIdMap.h --------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_ARRAYIDMAP_H
+#define KLEE_ARRAYIDMAP_H
+
+#include "klee/Expr/Expr.h"
+
+#include <vector>
+
+namespace klee {
+
+/// A map from arrays to T stored as a flat table indexed by Array::getId(),
+/// so that a lookup is an index instead of hashing a pointer. The table grows
+/// to the highest id inserted: meant for maps filled with the arrays of one
+/// query or run, not for long lived maps over arbitrary arrays.
+template <typename T> class ArrayIdMap {
+  std::vector<T> values;
+  std::vector<bool> present;
+  size_t numPresent = 0;
+
+public:
+  /// The value of array, null if there is none.
+  const T *lookup(const Array *array) const {
+    unsigned id = array->getId();
+    return id < present.size() && present[id] ? &values[id] : nullptr;
+  }
+  T *lookup(const Array *array) {
+    unsigned id = array->getId();
+    return id < present.size() && present[id] ? &values[id] : nullptr;
+  }
+  bool count(const Array *array) const { return lookup(array) != nullptr; }
+
+  /// The value of array, default constructed when there was none.
+  T &operator[](const Array *array) {
+    unsigned id = array->getId();
+    if (id >= present.size()) {
+      values.resize(id + 1);
+      present.resize(id + 1);
+    }
+    if (!present[id]) {
+      present[id] = true;
+      ++numPresent;
+    }
+    return values[id];
+  }
+
+  size_t size() const { return numPresent; }
+  bool empty() const { return numPresent == 0; }
+  void clear() {
+    values.clear();
+    present.clear();
+    numPresent = 0;
+  }
+};
+
+} // namespace klee
+
+#endif /* KLEE_ARRAYIDMAP_H */
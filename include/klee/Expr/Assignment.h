@@ -13,14 +13,80 @@
 #include "klee/Expr/Constraints.h"
 #include "klee/Expr/ExprEvaluator.h"
 
-#include <map>
+#include <algorithm>
+#include <utility>
+#include <vector>
 
 namespace klee {
   class Array;
 
+  /// The values of the arrays of an Assignment. They are kept in a vector
+  /// sorted by array, so that a lookup is a binary search over adjacent
+  /// keys instead of a walk through the nodes of a tree. Only the part of
+  /// the interface of std::map the assignments need is provided; unlike
+  /// with a map, an insertion invalidates the iterators.
+  class AssignmentBindings {
+  public:
+    typedef std::pair<const Array *, std::vector<unsigned char> > value_type;
+    typedef std::vector<value_type>::iterator iterator;
+    typedef std::vector<value_type>::const_iterator const_iterator;
+
+  private:
+    std::vector<value_type> entries;
+
+    static bool lessArray(const value_type &entry, const Array *array) {
+      return ArrayIdLess()(entry.first, array);
+    }
+
+  public:
+    AssignmentBindings() = default;
+    /// Bind each of objects to the values at the same position. An array
+    /// that appears more than once keeps its first values.
+    AssignmentBindings(const std::vector<const Array *> &objects,
+                       std::vector<std::vector<unsigned char> > values);
+
+    iterator begin() { return entries.begin(); }
+    iterator end() { return entries.end(); }
+    const_iterator begin() const { return entries.begin(); }
+    const_iterator end() const { return entries.end(); }
+    size_t size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+
+    iterator find(const Array *array) {
+      iterator it = std::lower_bound(begin(), end(), array, lessArray);
+      return it != end() && it->first == array ? it : end();
+    }
+    const_iterator find(const Array *array) const {
+      const_iterator it = std::lower_bound(begin(), end(), array, lessArray);
+      return it != end() && it->first == array ? it : end();
+    }
+    size_t count(const Array *array) const { return find(array) != end(); }
+
+    /// Does not replace the values of an array that is already bound.
+    std::pair<iterator, bool> insert(value_type entry) {
+      iterator it = std::lower_bound(begin(), end(), entry.first, lessArray);
+      if (it != end() && it->first == entry.first)
+        return std::make_pair(it, false);
+      return std::make_pair(entries.insert(it, std::move(entry)), true);
+    }
+    template <typename InputIterator>
+    void insert(InputIterator first, InputIterator last) {
+      for (; first != last; ++first)
+        insert(value_type(first->first, first->second));
+    }
+    std::vector<unsigned char> &operator[](const Array *array) {
+      return insert(value_type(array, std::vector<unsigned char>()))
+          .first->second;
+    }
+
+    bool operator<(const AssignmentBindings &b) const {
+      return entries < b.entries;
+    }
+  };
+
   class Assignment {
   public:
-    typedef std::map<const Array*, std::vector<unsigned char> > bindings_ty;
+    typedef AssignmentBindings bindings_ty;
 
     bool allowFreeValues;
     bindings_ty bindings;
@@ -31,19 +97,17 @@ namespace klee {
     Assignment(const std::vector<const Array*> &objects,
                std::vector< std::vector<unsigned char> > &values,
                bool _allowFreeValues=false) 
-      : allowFreeValues(_allowFreeValues){
-      std::vector< std::vector<unsigned char> >::iterator valIt = 
-        values.begin();
-      for (std::vector<const Array*>::const_iterator it = objects.begin(),
-             ie = objects.end(); it != ie; ++it) {
-        const Array *os = *it;
-        std::vector<unsigned char> &arr = *valIt;
-        bindings.insert(std::make_pair(os, arr));
-        ++valIt;
-      }
-    }
+      : allowFreeValues(_allowFreeValues), bindings(objects, values) {}
+    /// Takes the values over instead of copying them.
+    Assignment(const std::vector<const Array*> &objects,
+               std::vector< std::vector<unsigned char> > &&values,
+               bool _allowFreeValues=false)
+      : allowFreeValues(_allowFreeValues),
+        bindings(objects, std::move(values)) {}
     
     ref<Expr> evaluate(const Array *mo, unsigned index) const;
+    /// The value of a byte the assignment has no value for
+    ref<Expr> evaluateUnbound(const Array *mo, unsigned index) const;
     ref<Expr> evaluate(const ref<Expr> e);
     void createConstraintsFromAssignment(Constraints_ty &out) const;
 
@@ -52,12 +116,26 @@ namespace klee {
     void dump();
   };
   
+  /// Evaluates expressions under an assignment, which must not change while
+  /// the evaluator is used.
   class AssignmentEvaluator : public ExprEvaluator {
     const Assignment &a;
+    /// The array of the last read and its values, null if it is unbound.
+    /// The reads of the bytes of one array usually follow each other, so
+    /// most of them skip the lookup.
+    const Array *lastArray = nullptr;
+    const std::vector<unsigned char> *lastValues = nullptr;
 
   protected:
     ref<Expr> getInitialValue(const Array &mo, unsigned index) {
-      return a.evaluate(&mo, index);
+      if (&mo != lastArray) {
+        Assignment::bindings_ty::const_iterator it = a.bindings.find(&mo);
+        lastArray = &mo;
+        lastValues = it != a.bindings.end() ? &it->second : nullptr;
+      }
+      if (lastValues && index < lastValues->size())
+        return ConstantExpr::alloc((*lastValues)[index], mo.getRange());
+      return a.evaluateUnbound(&mo, index);
     }
     
   public:
@@ -73,12 +151,17 @@ namespace klee {
     if (it!=bindings.end() && index<it->second.size()) {
       return ConstantExpr::alloc(it->second[index], array->getRange());
     } else {
-      if (allowFreeValues) {
-        return ReadExpr::create(UpdateList(array, ref<UpdateNode>(nullptr)),
-                                ConstantExpr::alloc(index, array->getDomain()));
-      } else {
-        return ConstantExpr::alloc(0, array->getRange());
-      }
+      return evaluateUnbound(array, index);
+    }
+  }
+
+  inline ref<Expr> Assignment::evaluateUnbound(const Array *array,
+                                               unsigned index) const {
+    if (allowFreeValues) {
+      return ReadExpr::create(UpdateList(array, ref<UpdateNode>(nullptr)),
+                              ConstantExpr::alloc(index, array->getDomain()));
+    } else {
+      return ConstantExpr::alloc(0, array->getRange());
     }
   }
 
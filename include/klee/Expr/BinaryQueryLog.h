@@ -0,0 +1,100 @@
+//===-- BinaryQueryLog.h ----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_BINARYQUERYLOG_H
+#define KLEE_BINARYQUERYLOG_H
+
+#include "klee/Expr/ExprSerializer.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace klee {
+class ArrayCache;
+
+/// A query and its result, as written to and read from a binary query log.
+struct LoggedQuery {
+  /// the SolverImpl entry point the query went through
+  enum Kind : uint8_t { Truth, Validity, Value, InitialValues };
+
+  Kind kind = Truth;
+  /// the value of the Instructions statistic when the query was issued
+  uint64_t instructions = 0;
+  std::vector<ref<Expr>> constraints;
+  ref<Expr> expr;
+  /// the arrays InitialValues queries ask values for
+  std::vector<const Array *> objects;
+
+  bool success = false;
+  /// a SolverImpl::SolverRunStatus
+  uint32_t status = 0;
+  uint64_t elapsedMicroseconds = 0;
+
+  /// Results, set if success, for Truth, Validity, Value and InitialValues
+  /// queries respectively.
+  bool isValid = false;
+  int validity = 0;
+  ref<Expr> value;
+  bool hasSolution = false;
+  std::vector<std::vector<unsigned char>> values;
+};
+
+/// Serializes queries into a binary log, sharing expressions between all the
+/// queries of a log: an expression, update node or array is written once, the
+/// first time a query uses it, and is referred to by its number afterwards.
+///
+/// A log is BinaryQueryLog::Magic followed by the records of ExprSerializer
+/// and of its own, each a tag byte and LEB128 encoded fields:
+///   'Z' reset:   forget every expression and update node, not the arrays
+///   'Q' query:   LoggedQuery::Kind, instructions, the number of constraints,
+///                each constraint, the expression (0 for none), the number of
+///                objects, each object, then success, status and elapsed
+///                microseconds, then if success the result: isValid,
+///                validity + 1, the value, or hasSolution followed by the
+///                bytes of each object
+class BinaryQueryLogWriter {
+  ExprSerializer serializer;
+  /// once this many expressions and updates are held, the tables are reset
+  size_t maxNodes;
+
+public:
+  BinaryQueryLogWriter(size_t _maxNodes = 1u << 20) : maxNodes(_maxNodes) {}
+
+  /// Append the records of q, and of the expressions it uses that were not
+  /// written yet, to out.
+  void write(const LoggedQuery &q, std::string &out);
+};
+
+class BinaryQueryLogReader {
+  ExprDeserializer records;
+
+  bool readQueryRecord(LoggedQuery &q);
+
+public:
+  /// Read the log in [begin, end), which must outlive the reader. Arrays are
+  /// created in _arrayCache.
+  BinaryQueryLogReader(ArrayCache &_arrayCache, const char *begin,
+                       const char *end);
+
+  /// Read the next query into q.
+  ///
+  /// \return false at the end of the log or on a malformed record, in which
+  /// case getError() is not empty.
+  bool next(LoggedQuery &q);
+
+  const std::string &getError() const { return records.getError(); }
+};
+
+namespace BinaryQueryLog {
+extern const char Magic[8];
+}
+} // namespace klee
+
+#endif /* KLEE_BINARYQUERYLOG_H */
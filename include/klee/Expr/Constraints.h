@@ -13,6 +13,8 @@
 #include "klee/Expr/Expr.h"
 #include "klee/Expr/ExprReplaceVisitor.h"
 #include "klee/Expr/ExprHashMap.h"
+#include "klee/Internal/ADT/ImmutableMap.h"
+#include "klee/Internal/ADT/ImmutableSet.h"
 #include "klee/Internal/Support/IndependentElementSet.h"
 #include <unordered_set>
 
@@ -20,12 +22,41 @@ namespace klee {
 
 class ExprVisitor;
 class ConstraintManager {
+  struct FactorLess {
+    bool operator()(const ref<IndependentElementSet> &a,
+                    const ref<IndependentElementSet> &b) const {
+      return a.get() < b.get();
+    }
+  };
+  typedef ImmutableSet<ref<IndependentElementSet>, FactorLess> Factors_ty;
+  typedef ImmutableSet<ref<Expr>> Occurrences_ty;
+
 public:
   using iterator = Constraints_ty::iterator;
   using const_iterator = Constraints_ty::const_iterator;
 
+  /// Iterates the factors (independent element sets) of the constraints.
+  class factor_iterator {
+    Factors_ty::iterator it;
+
+  public:
+    explicit factor_iterator(const Factors_ty::iterator &_it) : it(_it) {}
+    IndependentElementSet *operator*() { return (*it).get(); }
+    factor_iterator &operator++() {
+      ++it;
+      return *this;
+    }
+    factor_iterator operator++(int) {
+      factor_iterator tmp = *this;
+      ++it;
+      return tmp;
+    }
+    bool operator==(const factor_iterator &b) { return it == b.it; }
+    bool operator!=(const factor_iterator &b) { return it != b.it; }
+  };
+
   ConstraintManager() = default;
-  ConstraintManager &operator=(const ConstraintManager &cs) = default;
+  ConstraintManager &operator=(const ConstraintManager &cs);
   ConstraintManager(ConstraintManager &&cs) = default;
   ConstraintManager &operator=(ConstraintManager &&cs) = default;
 
@@ -38,7 +69,6 @@ public:
   ~ConstraintManager();
 
   typedef Constraints_ty::const_iterator constraint_iterator;
-  typedef IndepElemSetPtrSet_ty::const_iterator factor_iterator;
 
   // given a constraint which is known to be valid, attempt to
   // simplify the existing constraint set
@@ -49,13 +79,28 @@ public:
   // \param[out] if constraint added successfully (if it is valid)
   bool addConstraint(ref<Expr> e);
 
+  /// Replace the constraints with an equivalent and usually smaller set.
+  /// The unsigned bounds on one expression are merged into an interval, an
+  /// interval of one value becomes an equality, and the set is rebuilt with
+  /// the equalities first, so that they rewrite the constraints they
+  /// subsume and the factors are split again.
+  /// \return the number of constraints removed
+  size_t compact();
+
+  /// The number of constraints after the last compact(), 0 before
+  size_t getCompactedSize() const { return compactedSize; }
+
   bool empty() const noexcept { return constraints.empty(); }
   const_iterator begin() const { return constraints.cbegin(); }
   const_iterator end() const { return constraints.cend(); }
   std::size_t size() const noexcept { return constraints.size(); }
-  factor_iterator factor_begin() const { return indep_indexer.factors.begin(); }
-  factor_iterator factor_end() const { return indep_indexer.factors.end(); }
-  size_t factor_size() const { return indep_indexer.factors.size(); }
+  factor_iterator factor_begin() const {
+    return factor_iterator(indep_indexer.factors.begin());
+  }
+  factor_iterator factor_end() const {
+    return factor_iterator(indep_indexer.factors.end());
+  }
+  size_t factor_size() const { return indep_indexer.numFactors; }
 
   bool operator==(const ConstraintManager &other) const {
     return constraints == other.constraints;
@@ -66,6 +111,8 @@ public:
   }
 
   const Constraints_ty& getAllConstraints() const { return constraints; }
+  /// fingerprintConstraints(getAllConstraints()), kept up to date
+  uint64_t getFingerprint() const { return fingerprint; }
   // expose getIntersection to public, should only call it when
   // `UseIndependentSolver` is enabled
   void getIntersection(const IndependentElementSet *indep,
@@ -82,22 +129,37 @@ public:
 
 private:
   Constraints_ty constraints;
+  uint64_t fingerprint = 0;
+  size_t compactedSize = 0;
   // When `UseIndependentSolver` is disabled, representative serves as a set of
   // constraints for deduplication
   // When `UseIndependentSolver` is enabled, representative also track the
   // mapping from a constraint to its IndependentElementSet
-  ExprHashMap<klee::IndependentElementSet*> representative;
+  //
+  // The factor index below and representative are persistent maps, so that
+  // copying a ConstraintManager (forking a state) shares them with the
+  // original. Updates cost O(log n) per changed entry, and factors which may
+  // be shared with another manager are copied before they are modified.
+  ImmutableMap<ref<Expr>, klee::IndependentElementSet *> representative;
 
   class IndepElementSetIndexer {
     friend class ConstraintManager;
-    // A faster index of all IndependentElementSet::elements
-    std::unordered_map<const Array *,
-                       std::vector<klee::IndependentElementSet *>>
-        elements_index;
+    // A faster index of all IndependentElementSet::elements, keyed by
+    // (array, index) so that the entries of one array are adjacent
+    typedef std::pair<const Array *, unsigned> Element_ty;
+    ImmutableMap<Element_ty, klee::IndependentElementSet *> elements_index;
+    bool hasElements(const Array *arr) const;
+    // drop all elements of arr from the index
+    void eraseElements(const Array *arr);
     // A faster index of IndependentElementSet::wholeObjects
-    std::unordered_map<const Array *, klee::IndependentElementSet *>
-        wholeObj_index;
-    IndepElemSetPtrSet_ty factors;
+    ImmutableMap<const Array *, klee::IndependentElementSet *> wholeObj_index;
+    // owns the factors, the maps above point into them
+    Factors_ty factors;
+    size_t numFactors = 0;
+    // factors inserted from now on are tagged with this id, factors tagged
+    // differently may be shared with another manager and must be copied
+    // before they are modified
+    uint64_t owner = newOwner();
     public:
     void insert(IndependentElementSet *indep);
     void erase(IndependentElementSet *indep);
@@ -111,7 +173,9 @@ private:
     void checkExprsSum(size_t NExprs);
   };
 
-  IndepElementSetIndexer indep_indexer;
+  mutable IndepElementSetIndexer indep_indexer;
+
+  static uint64_t newOwner();
 
   // equalities consists of EqExpr in current constraints.
   // For each item <key,value> in this map, ExprReplaceVisitorMulti can find
@@ -126,6 +190,29 @@ private:
   mutable UNMap_ty visitedUN;
   mutable ExprReplaceVisitorMulti *replaceVisitor = nullptr;
 
+  // bumped whenever equalities change, tags the results of simplifyExpr
+  uint64_t equalitiesGeneration = 0;
+  // the generation replaceVisitor last flushed its visited cache at
+  mutable uint64_t visitorGeneration = 0;
+  // simplifyExpr results, valid while their generation is current
+  mutable ExprHashMap<std::pair<uint64_t, ref<Expr>>> simplified;
+
+  // With RewriteEqualities, maps every non-constant subexpression of the
+  // constraints, including the indices and values of the updates they read,
+  // to the constraints it occurs in, so that a new equality only rewrites
+  // the constraints containing its expression. Persistent as representative.
+  ImmutableMap<ref<Expr>, Occurrences_ty> occurrences;
+
+  // add (remove) the subexpressions of constraint e to (from) occurrences
+  void indexOccurrences(const ref<Expr> &e);
+  void unindexOccurrences(const ref<Expr> &e);
+
+  // rewriteConstraints for the constraints occurrences says contain src
+  bool rewriteOccurrences(ExprReplaceVisitorBase &visitor,
+                          const ref<Expr> &src,
+                          std::vector<ref<Expr>> &deleteConstraints,
+                          std::vector<ref<Expr>> &toAddConstraints);
+
   // returns true iff the constraints were modified
   // This function is only called when you want to rewrite existing constraints
   // based on a newly learnt equivalency
@@ -10,6 +10,8 @@
 #ifndef KLEE_EXPR_H
 #define KLEE_EXPR_H
 
+#include "klee/Expr/ExprArena.h"
+#include "klee/Internal/ADT/ImmutableMap.h"
 #include "klee/util/Bits.h"
 #include "klee/util/Ref.h"
 #include "klee/Internal/Module/KInstruction.h"
@@ -22,6 +24,7 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <memory>
 #include <sstream>
 #include <unordered_set>
 #include <vector>
@@ -38,6 +41,7 @@ class Array;
 class ArrayCache;
 class ConstantExpr;
 class ObjectState;
+class UpdateNode;
 
 template<class T> class ref;
 
@@ -97,10 +101,32 @@ std::string getKInstUniqueIDOrNull(const KInstruction *ki);
 std::string getKInstDbgInfoOrNull(const KInstruction *ki);
 std::string getKInstIsPtrTypeOrNull(const KInstruction *ki);
 
+/// Structural facts about an expression (or about the updates of a list
+/// starting at an update node), computed once bottom-up and cached on the
+/// node. Like the hash, they are not updated by rebuildInPlace.
+struct ExprMetadata {
+  /// Number of nodes, counting a shared subexpression once per occurrence
+  /// and the updates of every read. Saturates at UINT64_MAX.
+  uint64_t size = 0;
+  /// Length of the longest path to a leaf, a leaf having depth 1.
+  unsigned depth = 0;
+  /// Highest level IndirectReadDepthCalculator assigns below the node: 0
+  /// without reads, 1 if all reads have read-free indices, and so on.
+  unsigned indirectReadDepth = 0;
+  /// Length of the longest update list read below the node.
+  unsigned maxUpdates = 0;
+  /// Arrays read, sorted by id (ArrayIdLess). Never null, possibly shared with the
+  /// metadata of other nodes.
+  std::shared_ptr<const std::vector<const Array *> > arrays;
+};
+
 class Expr {
 public:
   static unsigned count;
   static const unsigned MAGIC_HASH_CONSTANT = 39;
+  /// When set, every non-constant expression allocated is replaced by the
+  /// structurally equal node of the global unique table (see hashCons).
+  static bool hashConsing;
 
   /// The type of an expression is simply its width, in bits. 
   typedef unsigned Width; 
@@ -202,12 +228,16 @@ public:
     FLAG_INSTRUCTION_ROOT = 1<<0,
     FLAG_OPTIMIZATION = 1<<1,
     FLAG_INTERNAL = 1<<2,
-    FLAG_INITIALIZATION = 1<<3
+    FLAG_INITIALIZATION = 1<<3,
+    FLAG_HASHCONSED = 1<<4
   };
 
 protected:
   uint64_t flags = 0;
 
+  /// Computed by getMetadata on first use.
+  mutable std::unique_ptr<const ExprMetadata> metadata;
+
   /// 1) kinst keeps tracking which IR instruction creates current expression.
   /// It is maintained in "Executor::bindLocal" and "Expr::rebuild"
   /// 2) With the presence of ExprReplaceVisitor (rewrite expressions based on
@@ -246,8 +276,15 @@ protected:
 
 public:
   Expr() { Expr::count++; }
+  /// Nodes are allocated in the innermost live ExprArena, if any.
+  static void *operator new(size_t size) { return ExprArena::allocate(size); }
+  static void operator delete(void *p, size_t size) {
+    ExprArena::deallocate(p, size);
+  }
   virtual ~Expr() {
     Expr::count--;
+    if (flags & FLAG_HASHCONSED)
+      eraseHashConsed();
   }
 
   virtual Kind getKind() const = 0;
@@ -267,6 +304,16 @@ public:
   /// (Re)computes the hash of the current expression.
   /// Returns the hash value. 
   virtual unsigned computeHash();
+
+  /// Returns the size, depth and arrays of the current expression. They are
+  /// computed for every node below it that has not computed them yet.
+  const ExprMetadata &getMetadata() const {
+    if (!metadata)
+      computeMetadata(this, nullptr);
+    return *metadata;
+  }
+  /// Computes the metadata of e or un and of the nodes they depend on.
+  static void computeMetadata(const Expr *e, const UpdateNode *un);
   
   /// Compares `b` to `this` Expr for structural equivalence.
   ///
@@ -318,10 +365,11 @@ public:
   /* Kind utilities */
 
   /* Utility creation functions */
-  static ref<Expr> createSExtToPointerWidth(ref<Expr> e);
-  static ref<Expr> createZExtToPointerWidth(ref<Expr> e);
-  static ref<Expr> createImplies(ref<Expr> hyp, ref<Expr> conc);
-  static ref<Expr> createIsZero(ref<Expr> e);
+  static ref<Expr> createSExtToPointerWidth(const ref<Expr> &e);
+  static ref<Expr> createZExtToPointerWidth(const ref<Expr> &e);
+  static ref<Expr> createImplies(const ref<Expr> &hyp,
+                                 const ref<Expr> &conc);
+  static ref<Expr> createIsZero(const ref<Expr> &e);
 
   /// Create a little endian read of the given type at offset 0 of the
   /// given object.
@@ -337,6 +385,20 @@ public:
 
   static bool classof(const Expr *) { return true; }
   static const char *getKindStr(enum Kind k);
+
+  /// Return the node of the global unique table that is structurally equal
+  /// to e, adding e to the table if there is none. Two hash-consed nodes
+  /// are equal iff they are the same node. Constants are never shared.
+  ///
+  /// The table does not own its nodes, they leave it when they are freed.
+  /// Shared nodes must not be changed with rebuildInPlace.
+  static ref<Expr> hashCons(const ref<Expr> &e);
+  static ref<Expr> maybeHashCons(const ref<Expr> &e) {
+    return hashConsing ? hashCons(e) : e;
+  }
+  bool isHashConsed() const { return flags & FLAG_HASHCONSED; }
+  /// Number of nodes in the global unique table.
+  static size_t getNumHashConsed();
   std::string getKInstUniqueID() const {
     return klee::getKInstUniqueIDOrNull(kinst);
   }
@@ -383,6 +445,7 @@ public:
   static ExprEquivSet equivs;
   friend void CompareCacheSemaphoreDec(); // to clear equivs
   int compare_internal(const Expr &b) const;
+  void eraseHashConsed();
 }; // Expr
 
 struct Expr::CreateArg {
@@ -399,6 +462,8 @@ struct Expr::CreateArg {
 // Comparison operators
 
 inline bool operator==(const Expr &lhs, const Expr &rhs) {
+  if (lhs.isHashConsed() && rhs.isHashConsed())
+    return &lhs == &rhs;
   return lhs.compare(rhs) == 0;
 }
 
@@ -516,10 +581,10 @@ public:
   static ref<Expr> alloc(const ref<Expr> &src) {
     ref<Expr> r(new NotOptimizedExpr(src));
     r->computeHash();
-    return r;
+    return maybeHashCons(r);
   }
   
-  static ref<Expr> create(ref<Expr> src);
+  static ref<Expr> create(const ref<Expr> &src);
   
   Width getWidth() const { return src->getWidth(); }
   Kind getKind() const { return NotOptimized; }
@@ -587,8 +652,28 @@ public:
   KInstruction *kinst;
 
 private:
+  friend class Expr; // for metadata
   /// size of this update sequence, including this update
   unsigned size;
+  /// Metadata of the indices and values of this update sequence, with the
+  /// indirect read depth of a read of it.
+  mutable std::unique_ptr<const ExprMetadata> metadata;
+
+public:
+  /// The writes at concrete indices this update sequence starts with.
+  struct ConcreteWrites {
+    /// the most recent of these writes for every index written
+    ImmutableMap<uint64_t, UpdateNode *> latest;
+    /// the first update with a symbolic index, null if there is none
+    UpdateNode *rest = nullptr;
+  };
+
+  /// Update sequences at least this long are read through
+  /// getConcreteWrites instead of being walked.
+  static const unsigned MinIndexedSize = 16;
+
+private:
+  std::unique_ptr<const ConcreteWrites> concreteWrites;
   
 public:
   UpdateNode(const ref<UpdateNode> &_next, const ref<Expr> &_index,
@@ -597,6 +682,16 @@ public:
 
   unsigned getSize() const { return size; }
 
+  const ExprMetadata &getMetadata() const {
+    if (!metadata)
+      Expr::computeMetadata(nullptr, this);
+    return *metadata;
+  }
+
+  /// Returns the concrete writes at the start of this update sequence,
+  /// built on first use from those of the closest later node that has them.
+  const ConcreteWrites &getConcreteWrites();
+
   int compare(const UpdateNode &b) const;
   unsigned hash() const { return hashValue; }
   std::string getKInstUniqueID() const {
@@ -615,6 +710,11 @@ public:
   UpdateNode() = delete;
   ~UpdateNode() = default;
 
+  static void *operator new(size_t size) { return ExprArena::allocate(size); }
+  static void operator delete(void *p, size_t size) {
+    ExprArena::deallocate(p, size);
+  }
+
   unsigned computeHash();
 };
 
@@ -638,6 +738,10 @@ public:
 private:
   unsigned hashValue;
 
+  /// Dense id, unique among the arrays of the process, assigned by the
+  /// ArrayCache that keeps the array.
+  unsigned id = 0;
+
   // FIXME: Make =delete when we switch to C++11
   Array(const Array& array);
 
@@ -670,9 +774,19 @@ public:
   /// ComputeHash must take into account the name, the size, the domain, and the range
   unsigned computeHash();
   unsigned hash() const { return hashValue; }
+  /// Arrays are numbered in creation order from 0, so the id can index flat
+  /// tables and order arrays the same way in every run.
+  unsigned getId() const { return id; }
   friend class ArrayCache;
 };
 
+/// Orders arrays by id, unlike their addresses stable across runs.
+struct ArrayIdLess {
+  bool operator()(const Array *a, const Array *b) const {
+    return a->getId() < b->getId();
+  }
+};
+
 /// Class representing a complete list of updates into an array.
 class UpdateList { 
   friend class ReadExpr; // for default constructor
@@ -716,10 +830,10 @@ public:
   static ref<Expr> alloc(const UpdateList &updates, const ref<Expr> &index) {
     ref<Expr> r(new ReadExpr(updates, index));
     r->computeHash();
-    return r;
+    return maybeHashCons(r);
   }
   
-  static ref<Expr> create(const UpdateList &updates, ref<Expr> i);
+  static ref<Expr> create(const UpdateList &updates, const ref<Expr> &i);
   
   Width getWidth() const { assert(updates.root); return updates.root->getRange(); }
   Kind getKind() const { return Read; }
@@ -774,10 +888,11 @@ public:
                          const ref<Expr> &f) {
     ref<Expr> r(new SelectExpr(c, t, f));
     r->computeHash();
-    return r;
+    return maybeHashCons(r);
   }
   
-  static ref<Expr> create(ref<Expr> c, ref<Expr> t, ref<Expr> f);
+  static ref<Expr> create(const ref<Expr> &c, const ref<Expr> &t,
+                          const ref<Expr> &f);
 
   Width getWidth() const { return width; }
   Kind getKind() const { return Select; }
@@ -844,7 +959,7 @@ public:
   static ref<Expr> alloc(const ref<Expr> &l, const ref<Expr> &r) {
     ref<Expr> c(new ConcatExpr(l, r));
     c->computeHash();
-    return c;
+    return maybeHashCons(c);
   }
   
   static ref<Expr> create(const ref<Expr> &l, const ref<Expr> &r);
@@ -916,11 +1031,11 @@ public:
   static ref<Expr> alloc(const ref<Expr> &e, unsigned o, Width w) {
     ref<Expr> r(new ExtractExpr(e, o, w));
     r->computeHash();
-    return r;
+    return maybeHashCons(r);
   }
   
   /// Creates an ExtractExpr with the given bit offset and width
-  static ref<Expr> create(ref<Expr> e, unsigned bitOff, Width w);
+  static ref<Expr> create(const ref<Expr> &e, unsigned bitOff, Width w);
 
   Width getWidth() const { return width; }
   Kind getKind() const { return Extract; }
@@ -972,7 +1087,7 @@ public:
   static ref<Expr> alloc(const ref<Expr> &e) {
     ref<Expr> r(new NotExpr(e));
     r->computeHash();
-    return r;
+    return maybeHashCons(r);
   }
   
   static ref<Expr> create(const ref<Expr> &e);
@@ -1058,7 +1173,7 @@ public:                                                          \
     static ref<Expr> alloc(const ref<Expr> &e, Width w) {        \
       ref<Expr> r(new _class_kind ## Expr(e, w));                \
       r->computeHash();                                          \
-      return r;                                                  \
+      return maybeHashCons(r);                                   \
     }                                                            \
     static ref<Expr> create(const ref<Expr> &e, Width w);        \
     Kind getKind() const { return _class_kind; }                 \
@@ -1093,7 +1208,7 @@ CAST_EXPR_CLASS(ZExt)
     static ref<Expr> alloc(const ref<Expr> &l, const ref<Expr> &r) {           \
       ref<Expr> res(new _class_kind##Expr(l, r));                              \
       res->computeHash();                                                      \
-      return res;                                                              \
+      return maybeHashCons(res);                                               \
     }                                                                          \
     static ref<Expr> create(const ref<Expr> &l, const ref<Expr> &r);           \
     Width getWidth() const {                                                   \
@@ -1146,7 +1261,7 @@ ARITHMETIC_EXPR_CLASS(AShr)
     static ref<Expr> alloc(const ref<Expr> &l, const ref<Expr> &r) {           \
       ref<Expr> res(new _class_kind##Expr(l, r));                              \
       res->computeHash();                                                      \
-      return res;                                                              \
+      return maybeHashCons(res);                                               \
     }                                                                          \
     static ref<Expr> create(const ref<Expr> &l, const ref<Expr> &r);           \
     Kind getKind() const { return _class_kind; }                               \
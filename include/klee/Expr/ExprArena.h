@@ -0,0 +1,63 @@
+//===-- ExprArena.h ---------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_EXPRARENA_H
+#define KLEE_EXPRARENA_H
+
+#include <cstddef>
+#include <vector>
+
+namespace klee {
+
+/// A region the expression subsystem allocates from while it is alive.
+///
+/// While an ExprArena exists, every Expr and UpdateNode is bump allocated
+/// from fixed size chunks of the innermost arena instead of the heap.
+/// Freeing such a node only drops the live count of its chunk. When the
+/// arena is destroyed its chunks are released in one go, except for the
+/// chunks still holding nodes referenced from elsewhere (e.g. solver
+/// caches), which are released when their last node is freed.
+///
+/// Arenas nest and must be destroyed in reverse order of creation.
+class ExprArena {
+public:
+  /// Every chunk is ChunkSize bytes and aligned to ChunkSize, so the chunk
+  /// of a node is found by masking its address.
+  static const size_t ChunkSize = 64 * 1024;
+
+private:
+  struct Chunk;
+
+  ExprArena *parent;
+  std::vector<Chunk *> chunks;
+  char *cur = nullptr, *end = nullptr;
+
+  static ExprArena *current;
+
+  void *allocateInArena(size_t size);
+
+public:
+  ExprArena();
+  ~ExprArena();
+
+  ExprArena(const ExprArena &) = delete;
+  ExprArena &operator=(const ExprArena &) = delete;
+
+  /// Allocation functions used by Expr and UpdateNode. The bytes are
+  /// counted as util::MemoryTag::Expr.
+  static void *allocate(size_t size);
+  static void deallocate(void *p, size_t size);
+
+  /// Number of chunks allocated and not yet released, by any arena.
+  static size_t getNumChunks();
+};
+
+} // namespace klee
+
+#endif /* KLEE_EXPRARENA_H */
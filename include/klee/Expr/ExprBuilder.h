@@ -86,6 +86,22 @@ namespace klee {
   ///
   /// Base - The base builder to use when constructing expressions.
   ExprBuilder *createSimplifyingExprBuilder(ExprBuilder *Base);
+
+  /// createHashConsingExprBuilder - Create an expression builder which
+  /// shares structurally equal expressions, so that they compare equal by
+  /// pointer. Hash consing stays on (Expr::hashConsing) until the builder is
+  /// deleted.
+  ///
+  /// Base - The base builder to use when constructing expressions.
+  ExprBuilder *createHashConsingExprBuilder(ExprBuilder *Base);
+
+  /// createAlgebraicExprBuilder - Create an expression builder which rewrites
+  /// shifts, masks, divisions and remainders by constants and bitwise
+  /// operations on disjoint bits into byte-granular Concat and Extract
+  /// expressions.
+  ///
+  /// Base - The base builder to use when constructing expressions.
+  ExprBuilder *createAlgebraicExprBuilder(ExprBuilder *Base);
 }
 
 #endif /* KLEE_EXPRBUILDER_H */
@@ -17,6 +17,25 @@ namespace klee {
   template <typename T> using ExprHashMap = RefHashMap<Expr, T>;
   typedef RefHashSet<Expr> ExprHashSet;
   typedef ExprHashSet Constraints_ty;
+
+  /// The contribution of constraint e to the fingerprint of a set of
+  /// constraints, a mix of its hash spread over 64 bits.
+  inline uint64_t constraintFingerprint(const ref<Expr> &e) {
+    uint64_t h = e->hash() * 0x9e3779b97f4a7c15ULL;
+    h ^= h >> 31;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    return h ^ (h >> 29);
+  }
+
+  /// An order independent fingerprint of a set of constraints, the sum of
+  /// the contributions of its constraints. Sets that keep one up to date as
+  /// constraints come and go do not have to visit them to compute it.
+  inline uint64_t fingerprintConstraints(const Constraints_ty &constraints) {
+    uint64_t fingerprint = 0;
+    for (const ref<Expr> &e : constraints)
+      fingerprint += constraintFingerprint(e);
+    return fingerprint;
+  }
 } // namespace klee
 
 #endif /* KLEE_EXPRHASHMAP_H */
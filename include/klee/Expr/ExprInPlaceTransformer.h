@@ -0,0 +1,95 @@
+//===-- ExprInPlaceTransformer.h --------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_EXPRINPLACETRANSFORMER_H
+#define KLEE_EXPRINPLACETRANSFORMER_H
+
+#include "klee/Expr/Expr.h"
+
+#include <unordered_map>
+#include <vector>
+
+namespace klee {
+
+/// Rewrites expression DAGs bottom-up with an explicit worklist, so deep
+/// expressions do not overflow the stack. Every Expr and UpdateNode is
+/// transformed once however often it is shared, and the transformations of
+/// a node's kids are given to the hooks below, which decide its own.
+///
+/// By default a node whose kids changed is rebuilt in place with
+/// rebuildInPlace, and an update node is only reallocated when its index,
+/// value or tail changed, so unchanged update lists are kept as they are.
+/// Since nodes are changed in place, their hashes and metadata become stale:
+/// only transform expressions nothing else uses, never those of the
+/// executor, which are shared between states and hash consed (use an
+/// ExprVisitor there). A hook may return null to drop a node; the nodes
+/// using it then see a null kid.
+class ExprInPlaceTransformer {
+  struct Entry {
+    bool isUpdate;
+    union {
+      Expr *e;
+      UpdateNode *un;
+    };
+    Entry(Expr *_e) : isUpdate(false), e(_e) {}
+    Entry(UpdateNode *_un) : isUpdate(true), un(_un) {}
+  };
+
+  /// transformed nodes, and those under transformation mapped to themselves
+  std::unordered_map<Expr *, Expr *> visited;
+  std::unordered_map<UpdateNode *, UpdateNode *> visitedUpdates;
+  /// keeps the visited nodes alive, so that their addresses are not reused
+  /// for other nodes while they are keys of visited
+  std::vector<ref<Expr>> retained;
+  std::vector<ref<UpdateNode>> retainedUpdates;
+
+  /// entries to transform, an entry stays below its kids until they are
+  /// done, pending once its kids are pushed
+  std::vector<Entry> worklist;
+  std::vector<bool> pending;
+  /// the transformations of the kids of the entries of the worklist
+  std::vector<Entry> results;
+
+  void visitExpr(Expr *e);
+  void visitUpdate(UpdateNode *un);
+  Expr *popExpr();
+  UpdateNode *popUpdate();
+
+protected:
+  /// The transformation of a constant, by default itself.
+  virtual Expr *transformConstant(ConstantExpr *e) { return e; }
+
+  /// The transformation of a node other than a read or constant, given the
+  /// transformations of its kids. By default e, rebuilt in place if a kid
+  /// changed.
+  virtual Expr *transformNode(Expr *e, ref<Expr> kids[]);
+
+  /// The transformation of a read, given the transformation of its index in
+  /// kids[0] and of the head of its updates. By default re, with its index
+  /// and updates set in place if they changed.
+  virtual Expr *transformRead(ReadExpr *re, ref<Expr> kids[],
+                              UpdateNode *head);
+
+  /// The transformation of an update node, given the transformations of its
+  /// index, value and next node. By default un if none changed, otherwise a
+  /// new node.
+  virtual UpdateNode *transformUpdate(UpdateNode *un, Expr *index,
+                                      Expr *value, UpdateNode *next);
+
+public:
+  virtual ~ExprInPlaceTransformer() = default;
+
+  /// The transformation of e. Transformations are cached for the lifetime
+  /// of the transformer, across calls.
+  Expr *transform(Expr *e);
+};
+
+} // namespace klee
+
+#endif /* KLEE_EXPRINPLACETRANSFORMER_H */
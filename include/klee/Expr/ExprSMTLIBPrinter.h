@@ -13,6 +13,7 @@
 
 #include "klee/Expr/Constraints.h"
 #include "klee/Expr/Expr.h"
+#include "klee/Expr/ExprHashMap.h"
 #include "klee/Solver/Solver.h"
 #include "klee/util/PrintContext.h"
 
@@ -162,6 +163,16 @@ public:
   /// call will be ineffective.
   void generateOutput();
 
+  /// Print (declare-fun) for the arrays read by e which are not in declared,
+  /// followed by (assert e). Unlike generateOutput() no query is needed, this
+  /// is for solvers fed one constraint at a time. setOutput() must be called
+  /// before.
+  ///
+  /// \param[out] newArrays The arrays declared by this call.
+  void printIncrementalAssert(const ref<Expr> &e,
+                              const std::set<const Array *> &declared,
+                              std::vector<const Array *> &newArrays);
+
   /// Set which SMTLIBv2 logic to use.
   /// This only affects what logic is used in the (set-logic <logic>) command.
   /// The rest of the printed SMTLIBv2 commands are the same regardless of the
@@ -215,14 +226,15 @@ protected:
   std::set<const Array *> usedArrays;
 
   /// Set of expressions seen during scan.
-  std::set<ref<Expr> > seenExprs;
+  ExprHashSet seenExprs;
 
   typedef std::map<const ref<Expr>, int> BindingMap;
 
   /// Let expression binding number map. Under the :named abbreviation mode,
   /// negative binding numbers indicate that the abbreviation has already been
-  /// emitted, so it may be used.
-  BindingMap bindings;
+  /// emitted, so it may be used. Hashed, as it is looked up for every node
+  /// printed.
+  ExprHashMap<int> bindings;
 
   /// An ordered list of expression bindings.
   /// Exprs in BindingMap at index i depend on Exprs in BindingMap at i-1.
@@ -288,9 +300,9 @@ protected:
   /// \param abbrMode the abbreviation mode to use for this expression
   void printExpression(const ref<Expr> &e, SMTLIB_SORT expectedSort);
 
-  /// Scan Expression recursively for Arrays in expressions. Found arrays are
-  /// added to
-  /// the usedArrays vector.
+  /// Scan Expression for Arrays in expressions, in the pre-order of a
+  /// recursive traversal but with an explicit stack. Found arrays are added
+  /// to the usedArrays vector.
   void scan(const ref<Expr> &e);
 
   /// Scan bindings for expression intra-dependencies. The result is written
@@ -344,9 +356,6 @@ protected:
 
   void printSeperator();
 
-  /// Helper function for scan() that scans the expressions of an update node
-  void scanUpdates(const UpdateNode *un);
-
   /// Helper printer class
   PrintContext *p;
 
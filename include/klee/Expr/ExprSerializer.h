@@ -0,0 +1,134 @@
+//===-- ExprSerializer.h ----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_EXPRSERIALIZER_H
+#define KLEE_EXPRSERIALIZER_H
+
+#include "klee/Expr/ExprHashMap.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace klee {
+class ArrayCache;
+
+/// Serializes expression DAGs as records, keeping their sharing: an
+/// expression, update node or array is written once, the first time it is
+/// reached, and is referred to by its number afterwards. There are no
+/// strings besides the array names, written once each.
+///
+/// Each record is a tag byte and LEB128 encoded fields:
+///   'A' array:   name length, name, size, domain, range, the number of
+///                constant values, each as a constant of the range width
+///   'E' expr:    its Expr::Kind, then
+///                  Constant           width, ceil(width / 64) words
+///                  Read               array, update node (0 for none), index
+///                  Extract            kid, offset, width
+///                  ZExt, SExt         kid, width
+///                  any other          its kids
+///   'U' update:  the next update node (0 for none), index, value
+/// Arrays, expressions and update nodes are numbered from 1 in the order of
+/// their records, each kind on its own, and always refer to earlier records.
+/// Formats built on these records, like the binary query log, add records
+/// of their own with other tags.
+class ExprSerializer {
+  struct WrittenUpdate {
+    /// keeps the node from being freed and its address reused
+    ref<UpdateNode> node;
+    uint64_t id;
+  };
+
+  ExprHashMap<uint64_t> exprIds;
+  std::unordered_map<const UpdateNode *, WrittenUpdate> updateIds;
+  std::unordered_map<const Array *, uint64_t> arrayIds;
+
+public:
+  static void writeNumber(std::string &out, uint64_t v);
+
+  /// Append the records of array, or of e and of the nodes it reaches, that
+  /// were not written yet to out.
+  /// \return the number of the array or expression
+  uint64_t writeArray(const Array *array, std::string &out);
+  uint64_t writeUpdates(const ref<UpdateNode> &head, std::string &out);
+  uint64_t writeExpr(const ref<Expr> &e, std::string &out);
+
+  /// The expressions and update nodes held to refer to them again
+  size_t getNumNodes() const { return exprIds.size() + updateIds.size(); }
+
+  /// Forget the expressions and update nodes, not the arrays. The reader has
+  /// to be reset at the same point.
+  void reset();
+};
+
+/// Reads the records of ExprSerializer from a range of memory, e.g. a mapped
+/// file, which must outlive the reader. Arrays are created in an ArrayCache,
+/// so an array read back is the one already in the cache if there is one.
+class ExprDeserializer {
+  ArrayCache &arrayCache;
+  const char *cur, *end;
+  std::string error;
+
+  std::vector<const Array *> arrays;
+  std::vector<ref<Expr>> exprs;
+  std::vector<ref<UpdateNode>> updates;
+
+  bool readConstant(unsigned width, ref<ConstantExpr> &e);
+  bool readArrayRecord();
+  bool readExprRecord();
+  bool readUpdateRecord();
+
+public:
+  ExprDeserializer(ArrayCache &_arrayCache, const char *begin,
+                   const char *end);
+
+  /// Stop reading with the given error.
+  /// \return false
+  bool fail(const std::string &message);
+
+  bool atEnd() const { return cur == end; }
+  /// Read the tag byte of the next record.
+  /// \return false at the end
+  bool readTag(char &tag);
+  /// Read the 'A', 'E' or 'U' record after its tag.
+  /// \return false on a malformed record or another tag
+  bool readRecord(char tag);
+
+  bool readNumber(uint64_t &v);
+  /// Read the number of an array, or of an expression, read before.
+  bool readArray(const Array *&array);
+  bool readExpr(ref<Expr> &e, bool allowNull = false);
+  /// Point bytes at the next n bytes and skip them.
+  bool readBytes(size_t n, const char *&bytes);
+
+  /// Forget the expressions and update nodes, see ExprSerializer::reset.
+  void reset();
+
+  const std::string &getError() const { return error; }
+};
+
+/// A self-contained image of expression DAGs: ExprImage::Magic, the records
+/// of ExprSerializer, then an 'R' record with the number of roots and the
+/// number of each root expression. The image holds no pointers and is read
+/// in place, so it can be written to a file and mapped by another process.
+namespace ExprImage {
+extern const char Magic[8];
+
+/// Append the image of roots to out.
+void write(const std::vector<ref<Expr>> &roots, std::string &out);
+
+/// Read the image in [begin, end), creating its arrays in arrayCache.
+/// \return false and set error if the image is malformed
+bool read(ArrayCache &arrayCache, const char *begin, const char *end,
+          std::vector<ref<Expr>> &roots, std::string &error);
+} // namespace ExprImage
+} // namespace klee
+
+#endif /* KLEE_EXPRSERIALIZER_H */
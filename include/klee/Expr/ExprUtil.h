@@ -25,17 +25,17 @@ namespace klee {
   /// is true then this will including those reachable by traversing
   /// update lists. Note that this may be slow and return a large
   /// number of results.
-  void findReads(ref<Expr> e, 
+  void findReads(const ref<Expr> &e, 
                  bool visitUpdates,
                  std::vector< ref<ReadExpr> > &result);
   
   /// Return a list of all unique symbolic objects referenced by the given
-  /// expression.
+  /// expression, ordered by id (ArrayIdLess).
   void findSymbolicObjects(ref<Expr> e,
                            std::vector<const Array*> &results);
 
   /// Return a list of all unique symbolic objects referenced by the
-  /// given expression range.
+  /// given expression range, ordered by id (ArrayIdLess).
   template<typename InputIterator>
   void findSymbolicObjects(InputIterator begin, 
                            InputIterator end,
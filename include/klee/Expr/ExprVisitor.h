@@ -101,7 +101,14 @@ namespace klee {
     // other replacement.
     bool recursive;
 
-    ref<Expr> visitActual(const ref<Expr> &e);
+    /// Run visitExpr and the visit method of the kind of e.
+    /// \return true if the children of e are not to be visited, result is
+    /// then the visit result of e.
+    bool visitPre(const ref<Expr> &e, ref<Expr> &result);
+    /// Run visitExprPost on e_ret, the (possibly rebuilt) visit result of e.
+    ref<Expr> visitPost(const ref<Expr> &e, ref<Expr> e_ret);
+    /// Record the visit result of e.
+    void finish(const ref<Expr> &e, const ref<Expr> &result);
     
   public:
     // apply the visitor to the expression and return a possibly
@@ -28,6 +28,9 @@ namespace klee {
     void remove(T item);
     bool inTree(T item);
     weight_type getWeight(T item);
+    /// Set the weight of every item to weightOf(item) in a single pass,
+    /// rather than in one update() per item.
+    template <class F> void updateAll(F weightOf);
 	
     /* pick a tree element according to its
      * weight. p should be in [0,1).
@@ -43,6 +46,7 @@ namespace klee {
     void rotate(Node *node);
     void lengthen(Node *node);
     void propogateSumsUp(Node *n);
+    template <class F> void updateAll(Node *n, F &weightOf);
   };
 
 }
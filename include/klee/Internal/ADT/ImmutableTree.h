@@ -10,6 +10,8 @@
 #ifndef KLEE_IMMUTABLETREE_H
 #define KLEE_IMMUTABLETREE_H
 
+#include "klee/Internal/ADT/NodePool.h"
+
 #include <cassert>
 #include <vector>
 
@@ -85,6 +87,16 @@ namespace klee {
     Node(Node *_left, Node *_right, const value_type &_value);
     ~Node();
 
+    // Every write path-copies O(log n) nodes, so nodes come from a pool
+    // shared by all trees with nodes of the same size.
+    static void *operator new(size_t size) {
+      assert(size == sizeof(Node) && "unexpected node size");
+      return NodePool<sizeof(Node), alignof(Node)>::allocate();
+    }
+    static void operator delete(void *p) {
+      NodePool<sizeof(Node), alignof(Node)>::deallocate(p);
+    }
+
     void decref();
     Node *incref();
 
@@ -10,6 +10,8 @@
 #ifndef KLEE_KTEST_H
 #define KLEE_KTEST_H
 
+#include <stdio.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -48,12 +50,32 @@ extern "C" {
 
   /* returns 1 on success, 0 on (unspecified) error */
   int   kTest_toFile(KTest *, const char *path);
+
+  /* Read or write a KTest at the position of a stream. A stream of KTests
+     written one after the other, such as a pipe, is read back in order.
+     Same errors as kTest_fromFile and kTest_toFile. */
+  KTest* kTest_fromStream(FILE *f);
+  int   kTest_toStream(KTest *, FILE *f);
   
   /* returns total number of object bytes */
   unsigned kTest_numBytes(KTest *);
 
   void  kTest_free(KTest *);
 
+  /* A .ktest file mapped into memory, whose object bytes are only read
+     when they are accessed */
+  typedef struct KTestMap KTestMap;
+
+  /* returns NULL on (unspecified) error. Files before version 4 have no
+     object directory; one is built by walking their objects. */
+  KTestMap *kTest_map(const char *path);
+
+  /* returns the object called name or NULL. Its bytes point into the
+     mapping, they stay valid until kTest_unmap. */
+  const KTestObject *kTest_mapFind(KTestMap *, const char *name);
+
+  void  kTest_unmap(KTestMap *);
+
 #ifdef __cplusplus
 }
 #endif
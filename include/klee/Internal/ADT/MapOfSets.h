@@ -38,6 +38,9 @@ namespace klee {
 
     void insert(const std::set<K> &set, const V &value);
 
+    /// \return true if the set was in the map.
+    bool erase(const std::set<K> &set);
+
     V *lookup(const std::set<K> &set);
 
     iterator begin();
@@ -194,6 +197,31 @@ namespace klee {
     n->value = value;
   }
 
+  template<class K, class V>
+  bool MapOfSets<K,V>::erase(const std::set<K> &set) {
+    std::vector<Node*> path(1, &root);
+    for (auto const& element : set) {
+      typename Node::children_ty::iterator kit =
+        path.back()->children.find(element);
+      if (kit==path.back()->children.end())
+        return false;
+      path.push_back(&kit->second);
+    }
+    Node *n = path.back();
+    if (!n->isEndOfSet)
+      return false;
+    n->isEndOfSet = false;
+    n->value = V();
+    // drop the nodes which no longer lead to any set
+    typename std::set<K>::const_reverse_iterator it = set.rbegin();
+    for (unsigned i = path.size() - 1; i > 0; --i, ++it) {
+      if (path[i]->isEndOfSet || !path[i]->children.empty())
+        break;
+      path[i-1]->children.erase(*it);
+    }
+    return true;
+  }
+
   template<class K, class V>
   V *MapOfSets<K,V>::lookup(const std::set<K> &set) {
     Node *n = &root;
@@ -0,0 +1,130 @@
+//===-- NodePool.h ----------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_NODEPOOL_H
+#define KLEE_NODEPOOL_H
+
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace klee {
+  /// A pool for the small nodes of one size class, e.g. those of every
+  /// ImmutableTree whose nodes have the same size and alignment.
+  ///
+  /// Nodes are carved from SlabSize byte slabs, so that nodes allocated
+  /// together are close in memory. Each thread keeps its own list of free
+  /// nodes and only takes the shared lock to exchange a batch of BatchSize
+  /// nodes with the shared list, when its list runs empty or grows past
+  /// twice that. A node can be freed by another thread than the one that
+  /// allocated it. The lists of exiting threads go back to the shared list.
+  ///
+  /// Slabs are never returned to the system, the pool keeps the peak number
+  /// of nodes.
+  template <size_t Size, size_t Align> class NodePool {
+    struct FreeNode {
+      FreeNode *next;
+    };
+
+  public:
+    static const size_t SlotSize =
+        ((Size > sizeof(FreeNode) ? Size : sizeof(FreeNode)) + Align - 1) /
+        Align * Align;
+    static const size_t SlabSize = 64 * 1024;
+    static const size_t BatchSize = 256;
+
+  private:
+    struct List {
+      FreeNode *head = nullptr;
+      size_t count = 0;
+
+      void push(FreeNode *n) {
+        n->next = head;
+        head = n;
+        ++count;
+      }
+      FreeNode *pop() {
+        FreeNode *n = head;
+        head = n->next;
+        --count;
+        return n;
+      }
+      /// Move up to n nodes from this list to to.
+      void move(List &to, size_t n) {
+        for (; n && head; --n)
+          to.push(pop());
+      }
+    };
+
+    struct Shared {
+      std::mutex lock;
+      List free;
+      std::vector<void *> slabs;
+    };
+
+    static Shared &shared() {
+      // never destroyed, threads may give their nodes back at exit
+      static Shared *s = new Shared();
+      return *s;
+    }
+
+    struct Cache : List {
+      ~Cache() {
+        Shared &s = shared();
+        std::lock_guard<std::mutex> guard(s.lock);
+        this->move(s.free, this->count);
+      }
+    };
+
+    static Cache &cache() {
+      static thread_local Cache c;
+      return c;
+    }
+
+    static void refill(List &to) {
+      Shared &s = shared();
+      std::lock_guard<std::mutex> guard(s.lock);
+      if (!s.free.head) {
+        char *slab = static_cast<char *>(::operator new(SlabSize));
+        s.slabs.push_back(slab);
+        for (size_t i = 0; i < SlabSize / SlotSize; ++i)
+          s.free.push(reinterpret_cast<FreeNode *>(slab + i * SlotSize));
+      }
+      s.free.move(to, BatchSize);
+    }
+
+  public:
+    static void *allocate() {
+      Cache &c = cache();
+      if (!c.head)
+        refill(c);
+      return c.pop();
+    }
+
+    static void deallocate(void *p) {
+      Cache &c = cache();
+      c.push(static_cast<FreeNode *>(p));
+      if (c.count > 2 * BatchSize) {
+        Shared &s = shared();
+        std::lock_guard<std::mutex> guard(s.lock);
+        c.move(s.free, BatchSize);
+      }
+    }
+
+    /// Number of slabs allocated so far
+    static size_t getNumSlabs() {
+      Shared &s = shared();
+      std::lock_guard<std::mutex> guard(s.lock);
+      return s.slabs.size();
+    }
+  };
+} // namespace klee
+
+#endif /* KLEE_NODEPOOL_H */
@@ -0,0 +1,152 @@
+//===-- PagedArray.h --------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_PAGEDARRAY_H
+#define KLEE_PAGEDARRAY_H
+
+#include "klee/Internal/System/MemoryUsage.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <vector>
+
+namespace klee {
+
+/// A fixed size array split into pages that copies of the array share.
+///
+/// Copying a PagedArray only shares its pages. A page is copied the first
+/// time it is written through an array that shares it, so writing a few
+/// elements of a copy costs one page, not the whole array.
+///
+/// The pages hold the contents of the object states, they are counted as
+/// util::MemoryTag::ObjectState.
+template <class T> class PagedArray {
+public:
+  /// Number of elements in a page (the last page may be shorter).
+  static const unsigned PageBits = 12;
+  static const unsigned PageSize = 1u << PageBits;
+
+private:
+  struct Page {
+    unsigned refCount = 1;
+    std::vector<T> data;
+
+    Page(unsigned n, const T &value) : data(n, value) { track(1); }
+    Page(const Page &p) : data(p.data) { track(1); }
+    ~Page() { track(-1); }
+
+    void track(int sign) {
+      util::TrackMemory(util::MemoryTag::ObjectState,
+                        sign * (int64_t)(sizeof(Page) + data.size() * sizeof(T)));
+    }
+  };
+
+  std::vector<Page *> pages;
+  unsigned size;
+
+  static void release(Page *p) {
+    if (--p->refCount == 0)
+      delete p;
+  }
+
+  Page &getWriteablePage(unsigned index) {
+    Page *&p = pages[index];
+    if (p->refCount > 1) {
+      --p->refCount;
+      p = new Page(*p);
+    }
+    return *p;
+  }
+
+public:
+  PagedArray(unsigned _size, const T &value = T()) : size(_size) {
+    pages.reserve((size + PageSize - 1) / PageSize);
+    for (unsigned i = 0; i < size; i += PageSize) {
+      unsigned length = size - i < PageSize ? size - i : PageSize;
+      pages.push_back(new Page(length, value));
+    }
+  }
+  PagedArray(const PagedArray &b) : pages(b.pages), size(b.size) {
+    for (Page *p : pages)
+      ++p->refCount;
+  }
+  ~PagedArray() {
+    for (Page *p : pages)
+      release(p);
+  }
+
+  PagedArray &operator=(const PagedArray &) = delete;
+
+  unsigned getSize() const { return size; }
+
+  const T &operator[](unsigned i) const {
+    assert(i < size && "index out of range");
+    return pages[i >> PageBits]->data[i & (PageSize - 1)];
+  }
+
+  /// Element i, after copying its page if it is shared.
+  T &getWriteable(unsigned i) {
+    assert(i < size && "index out of range");
+    return getWriteablePage(i >> PageBits).data[i & (PageSize - 1)];
+  }
+
+  void set(unsigned i, const T &value) { getWriteable(i) = value; }
+
+  /// Set every element to value. Shared pages are replaced, not copied.
+  void fill(const T &value) {
+    for (unsigned i = 0, n = pages.size(); i != n; ++i) {
+      Page *&p = pages[i];
+      if (p->refCount > 1) {
+        unsigned length = p->data.size();
+        release(p);
+        p = new Page(length, value);
+      } else {
+        std::fill(p->data.begin(), p->data.end(), value);
+      }
+    }
+  }
+
+  /// Copy the elements to dest, which has room for getSize() elements.
+  void copyTo(T *dest) const {
+    for (const Page *p : pages)
+      dest = std::copy(p->data.begin(), p->data.end(), dest);
+  }
+
+  /// Copy getSize() elements from src. Pages that would not change keep
+  /// being shared.
+  void copyFrom(const T *src) {
+    for (unsigned i = 0, n = pages.size(); i != n; ++i) {
+      const std::vector<T> &data = pages[i]->data;
+      if (!std::equal(data.begin(), data.end(), src))
+        std::copy(src, src + data.size(), getWriteablePage(i).data.begin());
+      src += data.size();
+    }
+  }
+
+  /// True if the elements equal the getSize() elements at src.
+  bool equals(const T *src) const {
+    for (const Page *p : pages) {
+      if (!std::equal(p->data.begin(), p->data.end(), src))
+        return false;
+      src += p->data.size();
+    }
+    return true;
+  }
+
+  /// Number of pages shared with some other array.
+  unsigned getNumSharedPages() const {
+    return std::count_if(pages.begin(), pages.end(),
+                         [](const Page *p) { return p->refCount > 1; });
+  }
+};
+
+} // namespace klee
+
+#endif /* KLEE_PAGEDARRAY_H */
@@ -0,0 +1,104 @@
+//===-- RunArray.h ----------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_RUNARRAY_H
+#define KLEE_RUNARRAY_H
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+namespace klee {
+
+/// A fixed size array stored as runs of equal elements.
+///
+/// The runs are kept sorted by their first index, with no two adjacent runs
+/// holding equal elements, so an array set a range at a time costs a few
+/// runs rather than one element per index. Reading an element is a binary
+/// search over the runs. T has to be default constructible and comparable
+/// with ==.
+template <class T> class RunArray {
+  struct Run {
+    unsigned begin;
+    T value;
+  };
+
+  /// runs[0].begin is 0, a run ends where the next one begins.
+  std::vector<Run> runs;
+  unsigned size;
+
+  /// Index of the run holding element i.
+  unsigned find(unsigned i) const {
+    auto it = std::upper_bound(
+        runs.begin(), runs.end(), i,
+        [](unsigned i, const Run &r) { return i < r.begin; });
+    return it - runs.begin() - 1;
+  }
+
+public:
+  RunArray(unsigned _size, const T &value = T())
+      : runs(1, Run{0, value}), size(_size) {}
+
+  unsigned getSize() const { return size; }
+
+  unsigned getNumRuns() const { return runs.size(); }
+
+  const T &operator[](unsigned i) const {
+    assert(i < size && "index out of range");
+    return runs[find(i)].value;
+  }
+
+  void set(unsigned i, const T &value) { set(i, i + 1, value); }
+
+  /// Set the elements in [begin, end) to value.
+  void set(unsigned begin, unsigned end, const T &value) {
+    assert(begin <= end && end <= size && "range out of bounds");
+    if (begin == end)
+      return;
+    // the runs [first, last) are replaced by the at most five runs of r: the
+    // neighbours on both sides, the parts of the overlapped runs before and
+    // after the range, and the range itself
+    unsigned lo = find(begin), hi = find(end - 1) + 1;
+    unsigned first = lo, last = hi;
+    Run r[5];
+    unsigned n = 0;
+    auto push = [&](unsigned b, const T &v) {
+      if (n == 0 || !(r[n - 1].value == v))
+        r[n++] = Run{b, v};
+    };
+
+    if (lo > 0) {
+      --first;
+      push(runs[first].begin, runs[first].value);
+    }
+    if (runs[lo].begin < begin)
+      push(runs[lo].begin, runs[lo].value);
+    push(begin, value);
+    if (end < (hi < runs.size() ? runs[hi].begin : size))
+      push(end, runs[hi - 1].value);
+    if (hi < runs.size()) {
+      push(runs[hi].begin, runs[hi].value);
+      ++last;
+    }
+
+    unsigned old = last - first;
+    std::copy(r, r + std::min(n, old), runs.begin() + first);
+    if (n < old)
+      runs.erase(runs.begin() + first + n, runs.begin() + last);
+    else
+      runs.insert(runs.begin() + last, r + old, r + n);
+  }
+
+  /// Set every element to value.
+  void fill(const T &value) { runs.assign(1, Run{0, value}); }
+};
+
+} // namespace klee
+
+#endif /* KLEE_RUNARRAY_H */
@@ -0,0 +1,166 @@
+//===-- SignatureSetIndex.h -------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_SIGNATURESETINDEX_H
+#define KLEE_SIGNATURESETINDEX_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <set>
+#include <unordered_map>
+
+namespace klee {
+
+  /// A map of sets to values with the subset/superset queries of MapOfSets.
+  ///
+  /// Every set is summarized by a 64 bit bloom signature built from the
+  /// hashes of its elements. A set can only be a subset of another if its
+  /// signature is, so most candidates are rejected with a single AND before
+  /// the sets themselves are compared. Lookups scan the sets from the most
+  /// recently inserted one and give up after maxProbes signatures (0 for no
+  /// limit), which bounds their cost independently of the index size.
+  ///
+  /// Hash maps an element to a size_t, equal elements must hash equally.
+  template<class K, class V, class Hash>
+  class SignatureSetIndex {
+    struct Entry {
+      uint64_t signature;
+      size_t hash;
+      std::set<K> set;
+      V value;
+    };
+    typedef std::list<Entry> entries_ty;
+
+    /// newest entry at the back
+    entries_ty entries;
+    /// set hash -> entries with that hash
+    std::unordered_multimap<size_t, typename entries_ty::iterator> exact;
+    size_t maxProbes;
+
+    static uint64_t mix(uint64_t h) {
+      h ^= h >> 33;
+      h *= 0xff51afd7ed558ccdULL;
+      h ^= h >> 33;
+      return h;
+    }
+
+    static void summarize(const std::set<K> &set, uint64_t &signature,
+                          size_t &hash) {
+      signature = 0;
+      hash = 0;
+      for (auto const &element : set) {
+        uint64_t h = mix(Hash()(element));
+        signature |= (1ULL << (h & 63)) | (1ULL << ((h >> 6) & 63));
+        hash ^= h;
+      }
+    }
+
+    typename entries_ty::iterator find(const std::set<K> &set, size_t hash) {
+      auto range = exact.equal_range(hash);
+      for (auto it = range.first; it != range.second; ++it)
+        if (it->second->set == set)
+          return it->second;
+      return entries.end();
+    }
+
+  public:
+    explicit SignatureSetIndex(size_t _maxProbes = 0)
+        : maxProbes(_maxProbes) {}
+
+    void setMaxProbes(size_t n) { maxProbes = n; }
+    size_t size() const { return entries.size(); }
+
+    void clear() {
+      exact.clear();
+      entries.clear();
+    }
+
+    void insert(const std::set<K> &set, const V &value) {
+      uint64_t signature;
+      size_t hash;
+      summarize(set, signature, hash);
+      auto it = find(set, hash);
+      if (it != entries.end()) {
+        it->value = value;
+        return;
+      }
+      entries.push_back(Entry{signature, hash, set, value});
+      exact.insert(std::make_pair(hash, std::prev(entries.end())));
+    }
+
+    /// \return true if the set was in the index.
+    bool erase(const std::set<K> &set) {
+      uint64_t signature;
+      size_t hash;
+      summarize(set, signature, hash);
+      auto range = exact.equal_range(hash);
+      for (auto it = range.first; it != range.second; ++it) {
+        if (it->second->set == set) {
+          entries.erase(it->second);
+          exact.erase(it);
+          return true;
+        }
+      }
+      return false;
+    }
+
+    V *lookup(const std::set<K> &set) {
+      uint64_t signature;
+      size_t hash;
+      summarize(set, signature, hash);
+      auto it = find(set, hash);
+      return it == entries.end() ? 0 : &it->value;
+    }
+
+    /// Find a stored superset of set whose value satisfies p.
+    template<class Predicate>
+    V *findSuperset(const std::set<K> &set, const Predicate &p) {
+      uint64_t signature;
+      size_t hash;
+      summarize(set, signature, hash);
+      size_t probes = 0;
+      for (auto it = entries.rbegin(), ie = entries.rend(); it != ie; ++it) {
+        if (maxProbes && probes++ == maxProbes)
+          break;
+        if ((signature & ~it->signature) || it->set.size() < set.size())
+          continue;
+        if (std::includes(it->set.begin(), it->set.end(), set.begin(),
+                          set.end()) &&
+            p(it->value))
+          return &it->value;
+      }
+      return 0;
+    }
+
+    /// Find a stored subset of set whose value satisfies p.
+    template<class Predicate>
+    V *findSubset(const std::set<K> &set, const Predicate &p) {
+      uint64_t signature;
+      size_t hash;
+      summarize(set, signature, hash);
+      size_t probes = 0;
+      for (auto it = entries.rbegin(), ie = entries.rend(); it != ie; ++it) {
+        if (maxProbes && probes++ == maxProbes)
+          break;
+        if ((it->signature & ~signature) || it->set.size() > set.size())
+          continue;
+        if (std::includes(set.begin(), set.end(), it->set.begin(),
+                          it->set.end()) &&
+            p(it->value))
+          return &it->value;
+      }
+      return 0;
+    }
+  };
+
+}
+
+#endif /* KLEE_SIGNATURESETINDEX_H */
@@ -14,9 +14,14 @@
 #include <vector>
 #include <iostream>
 #include <cassert>
+#include <condition_variable>
+#include <deque>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <iomanip>
 #include <fstream>
+#include <thread>
 
 #include "llvm/Support/raw_ostream.h"
 
@@ -28,30 +33,95 @@ namespace klee {
   typedef unsigned TreeStreamID;
   class TreeOStream;
 
+  /// Writes a forest of append-only streams into a single file.
+  ///
+  /// The file is a sequence of records, each starting with two 32-bit words:
+  ///   - (parent id, child id | 1<<31): stream child forks off parent
+  ///   - (id, len): a segment of len entries appended to stream id
+  /// Entries of the open segment are buffered in memory and the segment is
+  /// framed only once it is closed (stream switch, fork, size limit or
+  /// flush), so nothing is ever back-patched. Framed records are collected in
+  /// blocks which a dedicated I/O thread writes out; at most MaxQueuedBlocks
+  /// are in flight, which bounds the memory used for buffering.
+  ///
+  /// The writer also keeps an index of every stream's parent and segment
+  /// offsets, so readStream only touches the segments on the requested
+  /// stream's chain instead of scanning the whole file.
   class TreeStreamWriter {
 
     friend class TreeOStream;
 
+  public:
+    /// Size at which the open segment is closed and a block is handed to
+    /// the I/O thread
+    static const size_t BlockSize = 256 * 1024;
+    static const size_t MaxQueuedBlocks = 8;
+
   private:
+    /// Entries of the segment currently being appended to
+    struct SegmentBuffer {
+      std::string data;
+      void write(const char *p, size_t n) { data.append(p, n); }
+      void put(char c) { data.push_back(c); }
+    };
+
+    /// Where the entries of one stream live in the file
+    struct StreamIndex {
+      unsigned parent;
+      /// number of parent segments preceding the fork
+      size_t parentSegments;
+      /// (file offset of first entry, number of entries)
+      std::vector<std::pair<uint64_t, unsigned>> segments;
+    };
+
     unsigned lastID, lastLen;
-    std::iostream::pos_type lastLen_off;
-    bool isWritten, lastLen_dirty;
+    bool isWritten;
+    SegmentBuffer segment;
+    std::string block;
+    /// bytes handed to the I/O thread so far
+    uint64_t submittedBytes;
+    /// indexed by stream id, entry 0 is the (empty) virtual root
+    std::vector<StreamIndex> index;
 
     std::string path;
     std::ofstream *output;
     unsigned ids;
 
+    struct IOThread {
+      std::thread thread;
+      std::mutex mutex;
+      std::condition_variable cond;
+    };
+    std::unique_ptr<IOThread> io;
+    std::deque<std::string> ioQueue;
+    bool ioBusy, ioStop;
+    /// a write to the file failed, so the streams read back are truncated
+    bool ioFailed;
+
     template<typename T>
     void write(TreeOStream &os, const T &entry);
     void write_metadata(TreeOStream &os);
-    void flush_lastLen();
+    void appendRecord(unsigned id, unsigned tag);
+    void flush_segment();
+    void submit_block();
+    void ioLoop();
+    /// The (file offset, number of entries) segments of streamID, in order
+    void getSegments(TreeStreamID streamID,
+                     std::vector<std::pair<uint64_t, unsigned>> &segments);
 
   public:
     TreeStreamWriter(const std::string &_path);
     ~TreeStreamWriter();
 
+    /// False if the file could not be opened or a write to it failed
     bool good();
 
+    /// In a process forked right after flush(), continue writing to a copy
+    /// of the file at _path instead of to the file shared with the parent.
+    /// The streams opened so far keep their ids.
+    /// \return false if the copy could not be made; the writer is unusable.
+    bool reopenInChild(const std::string &_path);
+
     TreeOStream open();
     TreeOStream open(const TreeOStream &node);
 
@@ -60,6 +130,13 @@ namespace klee {
     // hack, to be replace by proper stream capabilities
     template <typename T>
     void readStream(TreeStreamID streamID, std::vector<T> &out);
+
+    /// Write the entries of streamID to the file descriptor fd without
+    /// decoding them, for entry types that are serialized as entrySize raw
+    /// bytes (like PathEntry). The bytes are copied in the kernel where it
+    /// supports it.
+    /// \return false if reading or writing failed
+    bool copyStream(TreeStreamID streamID, size_t entrySize, int fd);
   };
 
   class TreeOStream {
@@ -97,9 +174,10 @@ namespace klee {
         (isWritten && os.id != lastID)) {
       write_metadata(os);
     }
-    serialize(*output, entry);
+    serialize(segment, entry);
     ++lastLen;
-    lastLen_dirty = true;
+    if (segment.data.size() >= BlockSize)
+      flush_segment();
   }
   template <typename T>
   void TreeStreamWriter::readStream(TreeStreamID streamID,
@@ -107,70 +185,18 @@ namespace klee {
       assert(streamID>0 && streamID<ids);
       flush();
 
+      std::vector<std::pair<uint64_t, unsigned>> segments;
+      getSegments(streamID, segments);
+
       std::ifstream is(path.c_str(),
               std::ios::in | std::ios::binary);
       assert(is.good());
-      KLEE_DEBUG(llvm::errs() << "finding chain for: " << streamID << "\n");
-
-      std::map<unsigned,unsigned> parents;
-      std::vector<unsigned> roots;
-      for (;;) {
-          assert(is.good());
-          unsigned id;
-          unsigned tag;
-          is.read(reinterpret_cast<char*>(&id), sizeof(id));
-          is.read(reinterpret_cast<char*>(&tag), sizeof(tag));
-          if (tag&(1<<31)) { // fork
-              unsigned child = tag ^ (1<<31);
-
-              if (child==streamID) {
-                  roots.push_back(child);
-                  while (id) {
-                      roots.push_back(id);
-                      std::map<unsigned, unsigned>::iterator it = parents.find(id);
-                      assert(it!=parents.end());
-                      id = it->second;
-                  }
-                  break;
-              } else {
-                  parents.insert(std::make_pair(child,id));
-              }
-          } else {
-              unsigned len = tag;
-              for (unsigned i=0; i < len; ++i) {
-                  skip(is, T());
-              }
-          }
-      }
-      KLEE_DEBUG({
-              llvm::errs() << "roots: ";
-              for (size_t i = 0, e = roots.size(); i < e; ++i) {
-              llvm::errs() << roots[i] << " ";
-              }
-              llvm::errs() << "\n";
-              });
-      is.seekg(0, std::ios::beg);
-      for (;;) {
-          unsigned id;
-          unsigned tag;
-          is.read(reinterpret_cast<char*>(&id), 4);
-          is.read(reinterpret_cast<char*>(&tag), 4);
-          if (!is.good()) break;
-          if (tag&(1<<31)) { // fork
-              unsigned child = tag ^ (1<<31);
-              if (id==roots.back() && roots.size()>1 && child==roots[roots.size()-2])
-                  roots.pop_back();
-          } else {
-              unsigned len = tag;
-              T entry;
-              for (unsigned i=0; i < len; ++i) {
-                  if (id==roots.back()) {
-                      deserialize(is, entry);
-                      out.push_back(std::move(entry));
-                  } else {
-                      skip(is, entry);
-                  }
-              }
+      for (const auto &segment : segments) {
+          is.seekg(segment.first, std::ios::beg);
+          T entry;
+          for (unsigned i=0; i < segment.second; ++i) {
+              deserialize(is, entry);
+              out.push_back(std::move(entry));
           }
       }
   }
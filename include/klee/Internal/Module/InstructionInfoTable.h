@@ -10,6 +10,7 @@
 #ifndef KLEE_INSTRUCTIONINFOTABLE_H
 #define KLEE_INSTRUCTIONINFOTABLE_H
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <unordered_map>
@@ -22,6 +23,8 @@ namespace llvm {
 }
 
 namespace klee {
+  class DebugInfoExtractor;
+  class InstructionInfoTable;
 
   /* Stores debug information for a KInstruction */
   struct InstructionInfo {
@@ -29,13 +32,24 @@ namespace klee {
     const std::string &file;
     unsigned line;
     unsigned column;
-    unsigned assemblyLine;
+
+  private:
+    friend class InstructionInfoTable;
+    /// 0 until looked up in a lazy table
+    mutable uint64_t assemblyLine;
+    const llvm::Instruction *inst;
+    const InstructionInfoTable *table;
 
   public:
     InstructionInfo(unsigned _id, const std::string &_file, unsigned _line,
-                    unsigned _column, unsigned _assemblyLine)
+                    unsigned _column, uint64_t _assemblyLine,
+                    const llvm::Instruction *_inst,
+                    const InstructionInfoTable *_table)
         : id(_id), file(_file), line(_line), column(_column),
-          assemblyLine(_assemblyLine) {}
+          assemblyLine(_assemblyLine), inst(_inst), table(_table) {}
+
+    /// Line of the instruction in assembly.ll
+    uint64_t getAssemblyLine() const;
   };
 
   /* Stores debug information for a KInstruction */
@@ -43,35 +57,86 @@ namespace klee {
     unsigned id;
     const std::string &file;
     unsigned line;
-    uint64_t assemblyLine;
+
+  private:
+    friend class InstructionInfoTable;
+    /// 0 until looked up in a lazy table
+    mutable uint64_t assemblyLine;
+    const llvm::Function *function;
+    const InstructionInfoTable *table;
 
   public:
     FunctionInfo(unsigned _id, const std::string &_file, unsigned _line,
-                 uint64_t _assemblyLine)
-        : id(_id), file(_file), line(_line), assemblyLine(_assemblyLine) {}
+                 uint64_t _assemblyLine, const llvm::Function *_function,
+                 const InstructionInfoTable *_table)
+        : id(_id), file(_file), line(_line), assemblyLine(_assemblyLine),
+          function(_function), table(_table) {}
 
     FunctionInfo(const FunctionInfo &) = delete;
     FunctionInfo &operator=(FunctionInfo const &) = delete;
 
     FunctionInfo(FunctionInfo &&) = default;
+
+    /// Line of the function in assembly.ll
+    uint64_t getAssemblyLine() const;
   };
 
+  /// Debug information of the instructions and functions of a module.
+  ///
+  /// A lazy table only counts the instructions when it is built. The
+  /// information of an instruction is extracted the first time it is asked
+  /// for, and the module is only printed to number the lines of assembly.ll
+  /// when the first assembly line is asked for. IDs are handed out in the
+  /// order of the lookups, so they are unique but differ between runs.
   class InstructionInfoTable {
-    std::unordered_map<const llvm::Instruction *,
-                       std::unique_ptr<InstructionInfo>>
+    mutable std::unordered_map<const llvm::Instruction *,
+                               std::unique_ptr<InstructionInfo>>
         infos;
-    std::unordered_map<const llvm::Function *, std::unique_ptr<FunctionInfo>>
+    mutable std::unordered_map<const llvm::Function *,
+                               std::unique_ptr<FunctionInfo>>
         functionInfos;
     std::vector<std::unique_ptr<std::string>> internedStrings;
+    /// Extracts info on demand, only kept by lazy tables
+    std::unique_ptr<DebugInfoExtractor> extractor;
+    unsigned maxID;
+    mutable unsigned nextID = 0;
+
+    friend struct InstructionInfo;
+    friend struct FunctionInfo;
+    uint64_t getAssemblyLine(const void *value) const;
 
   public:
-    InstructionInfoTable(const llvm::Module &m);
+    InstructionInfoTable(const llvm::Module &m, bool lazy = false);
+    ~InstructionInfoTable();
 
     unsigned getMaxID() const;
     const InstructionInfo &getInfo(const llvm::Instruction &) const;
     const FunctionInfo &getFunctionInfo(const llvm::Function &) const;
   };
 
+  /// The InstructionInfo of an instruction, looked up on first use.
+  class LazyInstructionInfo {
+    const InstructionInfoTable *table = nullptr;
+    const llvm::Instruction *inst = nullptr;
+    mutable const InstructionInfo *info = nullptr;
+
+  public:
+    LazyInstructionInfo() = default;
+    LazyInstructionInfo(const InstructionInfoTable &_table,
+                        const llvm::Instruction &_inst)
+        : table(&_table), inst(&_inst) {}
+
+    /// nullptr if the instruction belongs to no table
+    const InstructionInfo *get() const {
+      if (!info && table)
+        info = &table->getInfo(*inst);
+      return info;
+    }
+    operator const InstructionInfo *() const { return get(); }
+    const InstructionInfo *operator->() const { return get(); }
+    const InstructionInfo &operator*() const { return *get(); }
+  };
+
 }
 
 #endif /* KLEE_INSTRUCTIONINFOTABLE_H */
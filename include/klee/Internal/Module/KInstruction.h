@@ -18,23 +18,38 @@
 #include "llvm/Support/DataTypes.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <map>
+#include <unordered_map>
 #include <vector>
 
 namespace llvm {
+  class BasicBlock;
   class Instruction;
 }
 
 namespace klee {
   class Executor;
   struct InstructionInfo;
+  struct KFunction;
   class KModule;
 
 
+  /// Integer instructions decoded when the function is manifested, which
+  /// the executor folds on uint64_t when all their operands are concrete
+  /// (see Executor::executeFastInstruction).
+  enum class KFastOp : uint8_t {
+    None,
+    Add, Sub, Mul, And, Or, Xor, Shl, LShr, AShr,
+    Eq, Ne, Ugt, Uge, Ult, Ule, Sgt, Sge, Slt, Sle,
+    ZExt, SExt, Trunc,
+    Select
+  };
+
   /// KInstruction - Intermediate instruction representation used
   /// during execution.
   struct KInstruction {
     llvm::Instruction *inst;    
-    const InstructionInfo *info;
+    LazyInstructionInfo info;
 
     /// Value numbers for each operand. -1 is an invalid value,
     /// otherwise negative numbers are indices (negated and offset by
@@ -46,6 +61,17 @@ namespace klee {
     /// How many times this Instruction has been executed
     /// Maintained at Executor::executeInstruction
     unsigned int frequency = 0;
+    /// Dense module-wide index assigned at KModule::manifest. Data recording
+    /// stores it instead of getUniqueID() (see KModule::dataRecInstructions)
+    uint32_t dataRecID = 0;
+    /// Whether SymbolicTaintPass found that the operands and the result of
+    /// the instruction are always concrete
+    bool concrete = false;
+    /// The decoded operation, None if the instruction always goes through
+    /// the generic dispatch
+    KFastOp fastOp = KFastOp::None;
+    /// Width of the result of fastOp, at most 64 bits
+    uint8_t fastWidth = 0;
 
   public:
     virtual ~KInstruction();
@@ -81,6 +107,57 @@ namespace klee {
     /// instruction.
     uint64_t offset;
   };
+
+  /// A call or invoke. Calls through a function pointer mostly reach the
+  /// function of the previous call again, so the callee of the last call
+  /// that was not to a declaration is kept to skip the function lookups.
+  struct KCallInstruction : KInstruction {
+    llvm::Function *lastCallee = nullptr;
+    KFunction *lastKCallee = nullptr;
+  };
+
+  /// Dispatch data of a switch, computed once when the function is
+  /// manifested instead of at every execution.
+  struct KSwitchInstruction : KInstruction {
+    /// The distinct successors, in case order with the default destination
+    /// last (unless a case also goes there). SWITCH_BBIDX path entries are
+    /// indices into this list.
+    std::vector<llvm::BasicBlock *> successors;
+
+    /// Index of every successor in successors.
+    std::map<const llvm::BasicBlock *, unsigned> successorIndex;
+
+    /// The successor index (SWITCH_EXPIDX) of the case of every case value.
+    /// Values not in the map take the default case, successor index 0.
+    std::unordered_map<uint64_t, unsigned> caseIndex;
+
+    /// With -switch-type=table, the values of the condition as maximal
+    /// ranges with the same successor, in increasing order. A default
+    /// segment holds no case value.
+    struct Segment {
+      uint64_t low, high;
+      /// Index in successors
+      unsigned successor;
+      bool isDefault;
+    };
+    std::vector<Segment> segments;
+
+    /// With -switch-type=table and dense case values, the successor index
+    /// (SWITCH_EXPIDX) of the value tableBase + i, default cases included.
+    std::vector<unsigned> jumpTable;
+    uint64_t tableBase = 0;
+  };
+
+  /// Dispatch data of an indirectbr, computed once when the function is
+  /// manifested instead of at every execution.
+  struct KIndirectBrInstruction : KInstruction {
+    /// The distinct destinations in label order. INDIRECTBR path entries
+    /// are indices into this list.
+    std::vector<llvm::BasicBlock *> destinations;
+
+    /// Index in destinations of the block at every destination address.
+    std::unordered_map<uint64_t, unsigned> destinationIndex;
+  };
 }
 
 #endif /* KLEE_KINSTRUCTION_H */
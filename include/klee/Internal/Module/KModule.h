@@ -14,10 +14,12 @@
 #include "klee/Interpreter.h"
 
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
 
 #include <map>
 #include <memory>
 #include <set>
+#include <unordered_map>
 #include <vector>
 
 namespace llvm {
@@ -37,8 +39,19 @@ namespace klee {
   class InstructionInfoTable;
   struct KInstruction;
   class KModule;
+  enum class PTWriteMode;
+  struct DebugIRScope;
+  struct PTWriteBudget;
   template<class T> class ref;
 
+  /// A constant operand of an instruction, numbered after its function is
+  /// built.
+  struct KConstantOperand {
+    KInstruction *ki;
+    unsigned index;
+    llvm::Constant *c;
+  };
+
   struct KFunction {
     llvm::Function *function;
 
@@ -49,15 +62,28 @@ namespace klee {
 
     std::map<const llvm::BasicBlock*, unsigned> basicBlockEntry;
 
+    /// Position of each instruction in instructions
+    llvm::DenseMap<const llvm::Instruction *, unsigned> instructionIndex;
+
     /// Whether instructions in this function should count as
     /// "coverable" for statistics and search heuristics.
     bool trackCoverage;
     /// How many times this Function has been called.
     /// Maintained at ExecutionState::pushFrame
     unsigned int frequency = 0;
+    /// Whether calls can run natively on concrete memory, see NativeCallPass
+    bool native;
+    /// Whether the function carries the TAGPOSIX or the TAGLIBC attribute,
+    /// tested at every call and return
+    bool inPOSIX, inLIBC;
 
   public:
     explicit KFunction(llvm::Function*, KModule *);
+    /// Build the function without a module. The constant operands are left
+    /// unnumbered and appended to constantOperands, so that functions can be
+    /// built concurrently.
+    KFunction(llvm::Function *,
+              std::vector<KConstantOperand> &constantOperands);
     KFunction(const KFunction &) = delete;
     KFunction &operator=(const KFunction &) = delete;
 
@@ -65,6 +91,10 @@ namespace klee {
 
     unsigned getArgRegister(unsigned index) { return index; }
     KInstruction *getKInstruction(llvm::Instruction *inst);
+
+  private:
+    KFunction(llvm::Function *, KModule *,
+              std::vector<KConstantOperand> *constantOperands);
   };
 
 
@@ -91,7 +121,7 @@ namespace klee {
 
     // Our shadow versions of LLVM structures.
     std::vector<std::unique_ptr<KFunction>> functions;
-    std::map<llvm::Function*, KFunction*> functionMap;
+    std::unordered_map<llvm::Function*, KFunction*> functionMap;
 
     // Functions which escape (may be called indirectly)
     // XXX change to KFunction
@@ -108,11 +138,14 @@ namespace klee {
     // Functions which are part of KLEE runtime
     std::set<const llvm::Function*> internalFunctions;
 
+    /// All instructions of the module, indexed by KInstruction::dataRecID
+    std::vector<KInstruction *> dataRecInstructions;
+
   private:
     // Mark function with functionName as part of the KLEE runtime
     void addInternalFunction(const char* functionName);
 
-    std::map<llvm::Instruction*, KInstruction*> instructionMapCache;
+    std::map<std::string, KInstruction*> uniqueIDMapCache;
 
   public:
     KModule() = default;
@@ -122,6 +155,9 @@ namespace klee {
     void optimiseAndPrepare(const Interpreter::ModuleOptions &opts,
                             llvm::ArrayRef<const char *>);
 
+    /// Mark the check functions enabled by opts as part of the KLEE runtime
+    void addCheckFunctions(const Interpreter::ModuleOptions &opts);
+
     /// Manifest the generated module (e.g. assembly.ll, output.bc) and
     /// prepares KModule
     ///
@@ -157,6 +193,10 @@ namespace klee {
     /// Get the corresponding KInstruction of a llvm::Instruction.
     KInstruction *getKInstruction(llvm::Instruction *inst);
 
+    /// Find the KInstruction whose getUniqueID() is uniqueID.
+    /// Builds a string index on first use, keep it off hot paths.
+    KInstruction *getKInstructionByUniqueID(const std::string &uniqueID);
+
     /// Remove floating point instructions bacause Klee does not support it
     static void removeFabs(llvm::Module *M);
 
@@ -169,9 +209,15 @@ namespace klee {
 
 
     /// Add PTWrite instruction after specified instructions or inside specific
-    /// functions
+    /// functions. With optimizePlacement, a specified instruction may be
+    /// recorded through a less frequently executed value that determines it.
+    /// The ptwrites of scalar values are guarded as mode says, or sampled
+    /// every samplePeriod-th execution where needed to stay within budget.
     static void addPTWrite(llvm::Module *M, const std::string &instcfg,
-                           const std::string &funccfg);
+                           const std::string &funccfg,
+                           bool optimizePlacement, PTWriteMode mode,
+                           unsigned samplePeriod,
+                           const PTWriteBudget &budget);
 
     /// Add Tag fake instruction after sepecified instructions
     static void addTag(llvm::Module *M, std::string &cfg, bool useDbgInfo);
@@ -179,6 +225,11 @@ namespace klee {
     /// Use IR to replace debug info
     static void assignDebugIR(llvm::Module *M, std::string &directory, std::string &filename);
 
+    /// Use IR to replace debug info in the functions of scope only
+    static void assignDebugIR(llvm::Module *M, const std::string &directory,
+                              const std::string &filename,
+                              const DebugIRScope &scope);
+
     /// Remove the human readable ID from each instruction.
     static void removeID(llvm::Module *M);
 
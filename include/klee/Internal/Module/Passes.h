@@ -246,6 +246,26 @@ public:
   bool runOnModule(llvm::Module &M) override;
 };
 
+/// When an instrumented instruction emits its ptwrite
+enum class PTWriteMode {
+  /// on every execution
+  Always,
+  /// when its value differs from the value it last recorded
+  Changed,
+  /// on every samplePeriod-th execution
+  Sampled
+};
+
+/// The Intel PT bandwidth the ptwrites of PTWritePass may use
+struct PTWriteBudget {
+  /// trace bytes per second, 0 for no limit
+  uint64_t bytesPerSecond = 0;
+  /// length of the profiled run the klee.freq counts come from
+  double profileSeconds = 1;
+  /// whether PT is configured to emit a FUP packet with each PTW packet
+  bool fupOnPTW = false;
+};
+
 class PTWritePass : public llvm::ModulePass {
 private:
   // contains functions whose entire func body waiting be instrumented
@@ -255,6 +275,11 @@ private:
   std::unordered_set<std::string> dataRecFuncSet;
   std::unordered_set<std::string> dataRecBBSet;
   std::unordered_set<std::string> dataRecInstSet;
+  // record a cheaper value that determines each configured instruction
+  bool optimizePlacement;
+  PTWriteMode mode;
+  unsigned samplePeriod;
+  PTWriteBudget budget;
 
   void setupInstCFG(const std::string &instcfg);
   void setupFuncCFG(const std::string &funccfg);
@@ -262,7 +287,47 @@ private:
 public:
   static char ID;
   static const std::string castPrefix;
-  PTWritePass(const std::string &instcfg, const std::string &funccfg);
+  /// Metadata of the i64 parts of a value recorded in several ptwrites,
+  /// !{i32 index, i32 count}
+  static const char *const partMetadata;
+  static unsigned getPartIndex(const llvm::MDNode *part);
+  static unsigned getPartCount(const llvm::MDNode *part);
+  PTWritePass(const std::string &instcfg, const std::string &funccfg,
+              bool optimizePlacement = false,
+              PTWriteMode mode = PTWriteMode::Always,
+              unsigned samplePeriod = 1,
+              const PTWriteBudget &budget = PTWriteBudget());
+  bool runOnModule(llvm::Module &M) override;
+};
+
+/// Runs the scalar optimizations that keep what recorded traces refer to:
+/// the blocks and branches of every function and the instructions recorded
+/// by PTWritePass, with their IDs. Each function is optimized in a copy that
+/// replaces it only if all of these are unchanged.
+class TracePreservingOptimizePass : public llvm::ModulePass {
+public:
+  static char ID;
+  TracePreservingOptimizePass() : llvm::ModulePass(ID) {}
+  bool runOnModule(llvm::Module &M) override;
+};
+
+/// Marks the basic blocks that can only handle concrete values, given where
+/// symbolic data comes from, with concreteMetadata on their terminators.
+class SymbolicTaintPass : public llvm::ModulePass {
+public:
+  static char ID;
+  static const char *const concreteMetadata;
+  SymbolicTaintPass() : llvm::ModulePass(ID) {}
+  bool runOnModule(llvm::Module &M) override;
+};
+
+/// Marks the functions that can run natively on concrete memory with
+/// nativeAttribute.
+class NativeCallPass : public llvm::ModulePass {
+public:
+  static char ID;
+  static const char *const nativeAttribute;
+  NativeCallPass() : llvm::ModulePass(ID) {}
   bool runOnModule(llvm::Module &M) override;
 };
 
@@ -295,10 +360,26 @@ public:
   bool runOnModule(llvm::Module &M) override;
 };
 
+/// The functions DebugIR gives locations to when it prints the module a
+/// function at a time
+struct DebugIRScope {
+  /// names of the functions to give locations to, all of them if empty.
+  /// The others are left without debug locations.
+  std::set<std::string> functions;
+  /// write a line index of the functions and blocks instead of their text
+  bool lineIndexOnly = false;
+  /// threads printing the functions, 0 for one per core
+  unsigned jobs = 0;
+};
+
 class DebugIR : public llvm::ModulePass {
   /// If true, write a source file to disk.
   bool WriteSourceToDisk;
 
+  /// If true, print the functions of Scope one by one instead of the module
+  bool PerFunction;
+  DebugIRScope Scope;
+
   /// Hide certain (non-essential) debug information (only relevant if
   /// createSource is true.
   bool HideDebugIntrinsics;
@@ -334,6 +415,12 @@ public:
       //: ModulePass(ID), WriteSourceToDisk(false), HideDebugIntrinsics(false),
       //  HideDebugMetadata(false), GeneratedPath(false), ParsedPath(false) {}
 
+  /// Give locations to the functions of Scope only, printing them in
+  /// parallel into a file holding just these functions, or into a line
+  /// index of it.
+  DebugIR(llvm::StringRef Directory, llvm::StringRef Filename,
+          const DebugIRScope &Scope);
+
   /// Run pass on M and set Path to the source file path in the output module.
   bool runOnModule(llvm::Module &M, std::string &Path);
   bool runOnModule(llvm::Module &M) override;
@@ -359,6 +446,9 @@ private:
   void createDebugInfo(llvm::Module &M,
                        std::unique_ptr<llvm::Module> &DisplayM);
 
+  /// runOnModule when PerFunction is set
+  bool runPerFunction(llvm::Module &M);
+
   /// Returns true if either Directory or Filename is missing, false otherwise.
   bool isMissingPath();
 
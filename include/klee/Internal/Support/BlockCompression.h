@@ -0,0 +1,118 @@
+//===-- BlockCompression.h --------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Seekable compressed images of files such as .path and .path_datarec. The
+// data is cut into blocks that are compressed with zlib independently, and
+// an index of the blocks follows the header, so that any block can be
+// decompressed without the ones before it:
+//   - the 8-byte magic "KLEEZBLK", uint32 version, uint32 numBlocks and
+//     uint64 size, the size of the uncompressed data
+//   - numBlocks index entries of uint64 offset in the image, uint32
+//     compressed size and uint32 uncompressed size
+//   - the compressed blocks
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_BLOCKCOMPRESSION_H
+#define KLEE_BLOCKCOMPRESSION_H
+
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace klee {
+
+/// Whether data starts like a block compressed image
+bool isBlockCompressed(const char *data, size_t size);
+
+/// Compress data into a block compressed image and append it to out. Only
+/// available with HAVE_ZLIB_H.
+void compressBlocks(const std::string &data, std::string &out);
+
+/// Decompresses an image into memory on a background thread, block by block
+/// from the front, so that a reader of the first bytes does not wait for
+/// the rest.
+///
+/// With a window, the thread stays at most that many bytes ahead of the
+/// furthest waitFor(), and the reader can release() the bytes it is done
+/// with, so that the memory used does not grow with the image.
+class BlockDecompressor {
+  struct Block {
+    uint64_t offset;
+    uint32_t compressedSize;
+    uint32_t size;
+  };
+
+  std::unique_ptr<llvm::MemoryBuffer> image;
+  std::vector<Block> blocks;
+  /// anonymous mapping of bufferSize bytes, so that pages can be released
+  char *buffer;
+  size_t bufferSize;
+  /// the number of bytes of buffer decompressed so far
+  std::atomic<size_t> ready;
+  std::atomic<bool> failed, stop;
+  /// 0 to decompress the whole image at once
+  size_t window;
+  /// the furthest end waited for, guarded by mutex
+  size_t consumed;
+  /// bytes below this one were released, only used by the reader
+  size_t released;
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::thread thread;
+
+  BlockDecompressor()
+      : buffer(nullptr), bufferSize(0), ready(0), failed(false), stop(false),
+        window(0), consumed(0), released(0) {}
+  void run();
+  bool decompress(const Block &block, char *dst) const;
+
+public:
+  /// Start decompressing image, window bytes ahead of the reader or all of
+  /// it when window is 0.
+  /// \return nullptr and set error if the image is malformed
+  static std::unique_ptr<BlockDecompressor>
+  open(std::unique_ptr<llvm::MemoryBuffer> image, std::string &error,
+       size_t window = 0);
+  ~BlockDecompressor();
+
+  BlockDecompressor(const BlockDecompressor &) = delete;
+  BlockDecompressor &operator=(const BlockDecompressor &) = delete;
+
+  /// The decompressed data, of which only the first getReady() bytes may be
+  /// read.
+  const char *data() const { return buffer; }
+  size_t size() const { return bufferSize; }
+  size_t getReady() const { return ready.load(std::memory_order_acquire); }
+
+  /// Wait until at least the first end bytes are decompressed.
+  /// \return false if a block could not be decompressed
+  bool waitFor(size_t end);
+
+  /// Give the memory of the decompressed bytes below end (down to a page
+  /// boundary) back to the system. They read as zeros until reloaded.
+  void release(size_t end);
+  /// The bytes below this offset may have been released
+  size_t getReleased() const { return released; }
+  /// Decompress the released bytes from begin on again. Only available
+  /// with a window, which keeps the compressed image.
+  /// \return false if a block could not be decompressed
+  bool reload(size_t begin);
+};
+
+} // namespace klee
+
+#endif /* KLEE_BLOCKCOMPRESSION_H */
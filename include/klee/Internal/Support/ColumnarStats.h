@@ -0,0 +1,54 @@
+//===-- ColumnarStats.h -----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_COLUMNARSTATS_H
+#define KLEE_COLUMNARSTATS_H
+
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace klee {
+
+/// Writes run.stats.col. After a header with the column names, the file is
+/// a sequence of blocks:
+///   u32 rows, u8 codec (0 raw, 1 zlib), u32 stored size, u32 raw size,
+///   payload
+/// all little endian. The raw payload has each column in turn, as one
+/// zigzag varint per row of the difference to the previous row of the
+/// block (to 0 for the first row). A reader may stop at any block boundary.
+class ColumnarStatsWriter {
+  std::unique_ptr<llvm::raw_fd_ostream> os;
+  std::vector<std::vector<int64_t>> columns;
+
+public:
+  ColumnarStatsWriter(std::unique_ptr<llvm::raw_fd_ostream> _os,
+                      const std::vector<std::string> &names);
+  ~ColumnarStatsWriter() { flush(); }
+
+  void append(const std::vector<int64_t> &row);
+
+  /// Write the rows appended since the last flush as one block.
+  void flush();
+};
+
+/// Read a run.stats.col file written by ColumnarStatsWriter, rows as
+/// appended. A block cut short by a running klee is ignored.
+/// \return false and set error if the file cannot be read.
+bool readColumnarStats(const std::string &path,
+                       std::vector<std::string> &names,
+                       std::vector<std::vector<int64_t>> &rows,
+                       std::string &error);
+
+} // namespace klee
+
+#endif /* KLEE_COLUMNARSTATS_H */
@@ -13,6 +13,7 @@
 #include "llvm/Support/raw_ostream.h"
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace klee {
 std::unique_ptr<llvm::raw_fd_ostream>
@@ -22,6 +23,13 @@ klee_open_output_file(const std::string &path, std::string &error);
 std::unique_ptr<llvm::raw_ostream>
 klee_open_compressed_output_file(const std::string &path, std::string &error);
 #endif
+
+/// Read the inputs of a batch job: if path is a directory, the paths of the
+/// files in it whose names end in suffix, sorted; otherwise, the non-empty
+/// lines of the file path.
+bool klee_read_input_list(const std::string &path, const std::string &suffix,
+                          std::vector<std::string> &inputs,
+                          std::string &error);
 } // namespace klee
 
 #endif /* KLEE_FILEHANDLING_H */
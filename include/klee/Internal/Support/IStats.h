@@ -0,0 +1,69 @@
+//===-- IStats.h ------------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_ISTATS_H
+#define KLEE_ISTATS_H
+
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace klee {
+
+/// The contents of a run.istats file as StatsTracker::writeIStats writes
+/// it, in the callgrind format: a header, then for every instruction of
+/// the module its assembly line, source line and one value per event,
+/// each possibly followed by the calls it made.
+struct IStatsFile {
+  struct Call {
+    /// The cfl= and cfn= lines, cfl empty if there was none
+    std::string file, function;
+    uint64_t count;
+    /// The rest of the calls= line, the position of the callee
+    std::string target;
+    std::vector<uint64_t> values;
+  };
+
+  struct Record {
+    uint64_t instr, line;
+    /// The fl= and fn= lines before the record, verbatim
+    std::string context;
+    std::vector<Call> calls;
+  };
+
+  /// The lines before the ob= one, verbatim
+  std::string header;
+  std::vector<std::string> events;
+  std::string object;
+  std::vector<Record> records;
+  /// events.size() values per record
+  std::vector<uint64_t> values;
+
+  /// Parse the given file, which is mapped rather than read when large.
+  /// \return false and set error if it is malformed.
+  bool read(const std::string &path, std::string &error);
+
+  void write(llvm::raw_ostream &os) const;
+
+  /// Add the statistics of other, which must be of the same module, the
+  /// way IStatsMerge.py does: the coverage events (Icov, Iuncov) of an
+  /// instruction are combined so that it counts as covered if any run
+  /// covered it, the others are summed.
+  /// \return false and set error if the files differ in their structure.
+  bool merge(const IStatsFile &other, std::string &error);
+
+  /// The sum of every event over the instructions
+  std::vector<uint64_t> totals() const;
+};
+
+} // namespace klee
+
+#endif /* KLEE_ISTATS_H */
@@ -3,74 +3,156 @@
 #include "klee/Expr/Expr.h"
 #include "klee/Expr/ExprUtil.h"
 #include "klee/Expr/ExprHashMap.h"
+#include "klee/Internal/System/MemoryUsage.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
 namespace klee {
 // Originally locate at IndependentSolver.cpp
+//
+// Set of array indices stored as a compressed bitmap: a sorted vector of
+// (word index, 64-bit word) pairs holding only non-zero words. Ranges are
+// added a word at a time and union/intersection walk both vectors in step,
+// testing 64 indices per operation, so whole-buffer accesses stay cheap.
 template<class T>
 class DenseSet {
-  typedef std::set<T> set_ty;
-  set_ty s;
+  typedef std::pair<T, uint64_t> word_ty;
+  typedef std::vector<word_ty> words_ty;
+  words_ty words;
+
+  static const unsigned WordBits = 64;
+
+  uint64_t &wordFor(T key) {
+    typename words_ty::iterator it = std::lower_bound(
+        words.begin(), words.end(), key,
+        [](const word_ty &w, T k) { return w.first < k; });
+    if (it == words.end() || it->first != key)
+      it = words.insert(it, word_ty(key, 0));
+    return it->second;
+  }
 
 public:
+  /// Iterates the indices in increasing order.
+  class const_iterator {
+    const word_ty *word, *end;
+    uint64_t rest;
+
+    void skipEmpty() {
+      while (!rest && ++word != end)
+        rest = word->second;
+    }
+
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef T value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const T *pointer;
+    typedef T reference;
+
+    const_iterator(const word_ty *_word, const word_ty *_end)
+        : word(_word), end(_end), rest(_word != _end ? _word->second : 0) {}
+
+    T operator*() const {
+      return word->first * WordBits + __builtin_ctzll(rest);
+    }
+    const_iterator &operator++() {
+      rest &= rest - 1;
+      skipEmpty();
+      return *this;
+    }
+    const_iterator operator++(int) {
+      const_iterator old = *this;
+      ++*this;
+      return old;
+    }
+    bool operator==(const const_iterator &b) const {
+      return word == b.word && rest == b.rest;
+    }
+    bool operator!=(const const_iterator &b) const { return !(*this == b); }
+  };
+  typedef const_iterator iterator;
+
   DenseSet() {}
 
   void add(T x) {
-    s.insert(x);
+    wordFor(x / WordBits) |= uint64_t(1) << (x % WordBits);
   }
   void add(T start, T end) {
-    for (; start<end; start++)
-      s.insert(start);
+    while (start < end) {
+      unsigned bit = start % WordBits;
+      unsigned n = std::min<T>(WordBits - bit, end - start);
+      uint64_t mask = n == WordBits ? ~uint64_t(0)
+                                    : ((uint64_t(1) << n) - 1) << bit;
+      wordFor(start / WordBits) |= mask;
+      start += n;
+    }
   }
 
   // returns true iff set is changed by addition
   bool add(const DenseSet &b) {
+    if (b.words.empty())
+      return false;
+    words_ty merged;
+    merged.reserve(words.size() + b.words.size());
     bool modified = false;
-    for (typename set_ty::const_iterator it = b.s.begin(), ie = b.s.end(); 
-         it != ie; ++it) {
-      if (modified || !s.count(*it)) {
+    typename words_ty::const_iterator i = words.begin(), ie = words.end();
+    typename words_ty::const_iterator j = b.words.begin(), je = b.words.end();
+    while (i != ie || j != je) {
+      if (j == je || (i != ie && i->first < j->first)) {
+        merged.push_back(*i++);
+      } else if (i == ie || j->first < i->first) {
+        merged.push_back(*j++);
         modified = true;
-        s.insert(*it);
+      } else {
+        modified |= (j->second & ~i->second) != 0;
+        merged.push_back(word_ty(i->first, i->second | j->second));
+        ++i, ++j;
       }
     }
+    if (modified)
+      words.swap(merged);
     return modified;
   }
 
   bool intersects(const DenseSet &b) const {
-    // smallter_set.interesects(larger_set) is more efficient
-    if (s.size() > b.s.size()) {
-      return b.intersects(*this);
-    }
-    for (typename set_ty::iterator it = s.begin(), ie = s.end(); 
-         it != ie; ++it)
-      if (b.s.count(*it))
+    typename words_ty::const_iterator i = words.begin(), ie = words.end();
+    typename words_ty::const_iterator j = b.words.begin(), je = b.words.end();
+    while (i != ie && j != je) {
+      if (i->first < j->first)
+        ++i;
+      else if (j->first < i->first)
+        ++j;
+      else if (i->second & j->second)
         return true;
+      else
+        ++i, ++j;
+    }
     return false;
   }
 
-  std::set<unsigned>::iterator begin(){
-    return s.begin();
-  }
-  std::set<unsigned>::const_iterator begin() const {
-    return s.cbegin();
-  }
+  bool empty() const { return words.empty(); }
 
-  std::set<unsigned>::iterator end(){
-    return s.end();
+  const_iterator begin() const {
+    return const_iterator(words.data(), words.data() + words.size());
   }
-  std::set<unsigned>::const_iterator end() const {
-    return s.cend();
+  const_iterator end() const {
+    return const_iterator(words.data() + words.size(),
+                          words.data() + words.size());
   }
 
   void print(llvm::raw_ostream &os) const {
     bool first = true;
     os << "{";
-    for (typename set_ty::iterator it = s.begin(), ie = s.end(); 
-        it != ie; ++it) {
+    for (T x : *this) {
       if (first) {
         first = false;
       } else {
         os << ",";
       }
-      os << *it;
+      os << x;
     }
     os << "}";
   }
@@ -85,25 +167,46 @@ inline llvm::raw_ostream &operator<<(llvm::raw_ostream &os,
 
 class IndependentElementSet {
 public:
-  typedef std::map<const klee::Array*, DenseSet<unsigned> > elements_ty;
+  /// Factors are shared between the ConstraintManagers of forked states.
+  class ReferenceCounter _refCount;
+  /// Id of the ConstraintManager allowed to modify this set in place.
+  uint64_t owner = 0;
+
+  // keyed by array id, so that sets are walked in the same order every run
+  typedef std::map<const klee::Array*, DenseSet<unsigned>, ArrayIdLess>
+      elements_ty;
+  typedef std::set<const klee::Array*, ArrayIdLess> wholeObjects_ty;
   elements_ty elements;                 // Represents individual elements of array accesses (arr[1])
-  std::set<const klee::Array*> wholeObjects;  // Represents symbolically accessed arrays (arr[x])
+  wholeObjects_ty wholeObjects;  // Represents symbolically accessed arrays (arr[x])
   Constraints_ty exprs;        // All expressions that are associated with this factor
                                         // Although order doesn't matter, we use a vector to match
                                         // the ConstraintManager constructor that will eventually
                                         // be invoked.
+  uint64_t fingerprint = 0;    // fingerprintConstraints(exprs)
 
   IndependentElementSet() {}
   IndependentElementSet(ref<klee::Expr> e);
   IndependentElementSet(const IndependentElementSet &ies) : 
     elements(ies.elements),
     wholeObjects(ies.wholeObjects),
-    exprs(ies.exprs) {}
+    exprs(ies.exprs),
+    fingerprint(ies.fingerprint) {}
+
+  /// Counted as util::MemoryTag::Constraints, the object only
+  static void *operator new(size_t size) {
+    util::TrackMemory(util::MemoryTag::Constraints, size);
+    return ::operator new(size);
+  }
+  static void operator delete(void *p, size_t size) {
+    util::TrackMemory(util::MemoryTag::Constraints, -(int64_t)size);
+    ::operator delete(p);
+  }
 
   IndependentElementSet &operator=(const IndependentElementSet &ies) {
     elements = ies.elements;
     wholeObjects = ies.wholeObjects;
     exprs = ies.exprs;
+    fingerprint = ies.fingerprint;
     return *this;
   }
 
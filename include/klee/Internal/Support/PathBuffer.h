@@ -0,0 +1,262 @@
+//===-- PathBuffer.h --------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Read-only views of recorded replay traces (.path and .path_datarec).
+//
+// Traces loaded from disk are memory-mapped and entries are decoded in place,
+// so resident memory only grows with the pages the replay actually touches.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_PATHBUFFER_H
+#define KLEE_PATHBUFFER_H
+
+#include "klee/Internal/Support/SerializableTypes.h"
+
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <ios>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace klee {
+  class BlockDecompressor;
+
+  /// Minimal istream look-alike over a memory range, so that the
+  /// deserialize()/skip() templates in Serialize.h can decode entries
+  /// straight from a mapped file.
+  class MemoryIStream {
+    const char *begin, *cur, *end;
+    bool ok;
+
+  public:
+    MemoryIStream(const char *_begin, const char *_end)
+        : begin(_begin), cur(_begin), end(_end), ok(true) {}
+
+    /// Like std::istream, the stream goes bad once a read or peek runs past
+    /// the end of the range.
+    bool good() const { return ok; }
+    bool fail() const { return !ok; }
+    size_t tellg() const { return cur - begin; }
+    size_t remaining() const { return end - cur; }
+    int peek() {
+      if (cur >= end) {
+        ok = false;
+        return EOF;
+      }
+      return static_cast<unsigned char>(*cur);
+    }
+    MemoryIStream &read(char *dst, size_t n) {
+      if (!ok || (size_t)(end - cur) < n) {
+        ok = false;
+        return *this;
+      }
+      memcpy(dst, cur, n);
+      cur += n;
+      return *this;
+    }
+    MemoryIStream &get(char &c) { return read(&c, 1); }
+    MemoryIStream &seekg(size_t off, std::ios::seekdir dir) {
+      const char *base = (dir == std::ios::beg) ? begin : cur;
+      if (dir == std::ios::end || (size_t)(end - base) < off) {
+        ok = false;
+      } else {
+        cur = base + off;
+      }
+      return *this;
+    }
+  };
+
+  /// On-disk encodings of a .path file.
+  ///
+  /// v1 has no header: it is the raw array of PathEntry.
+  /// v2 starts with the 8-byte magic "KLEEPATH", a uint32 version, then
+  /// uint64 numEntries, uint64 streamBytes and uint64 numDataRec. It is
+  /// followed by the entry stream and the DATAREC column:
+  ///   - stream: one PathEntry_t byte per record.
+  ///     FORK: varint run length n, then ceil(n/8) bytes of branch bits
+  ///     (LSB first) covering n consecutive FORK entries.
+  ///     SWITCH_EXPIDX, SWITCH_BBIDX, INDIRECTBR, SCHEDULE: varint payload.
+  ///     DATAREC: no payload.
+  ///   - column: (IDlen, width) byte pairs, one per DATAREC entry in order.
+  enum PathFileVersion { PathFileV1 = 1, PathFileV2 = 2 };
+
+  /// Encode entries in the given on-disk format and append them to out.
+  void encodePathFile(const std::vector<PathEntry> &entries,
+                      PathFileVersion version, std::string &out);
+
+  /// Decode a complete .path file image of either version.
+  /// \return false and set error if the image is malformed.
+  bool decodePathFile(const char *data, size_t size,
+                      std::vector<PathEntry> &entries, std::string &error);
+
+  /// The sequence of PathEntry a replay follows.
+  ///
+  /// PathEntry is trivially copyable and serialized as its raw bytes, so a
+  /// mapped v1 .path file can be indexed without decoding anything. v2 files
+  /// are decoded once into an owned array when opened. Block compressed v1
+  /// files are decompressed on a background thread, and an access only
+  /// waits for the blocks up to the entry it reads.
+  ///
+  /// Opened with a window, a compressed v1 file keeps only about that many
+  /// bytes decompressed on each side of the last access: entries further
+  /// behind are dropped and decompressed again if they are read later. A
+  /// returned reference is then only valid until the next access.
+  class PathEntryBuffer {
+    std::unique_ptr<llvm::MemoryBuffer> mapped;
+    std::unique_ptr<BlockDecompressor> decompressor;
+    std::vector<PathEntry> owned;
+    const PathEntry *entries;
+    size_t numEntries;
+    /// entries below this one can be read without waiting
+    mutable size_t numReady;
+    /// entries below this one may have been dropped
+    mutable size_t numReleased;
+    size_t window;
+    PathFileVersion version;
+
+    void fetch(size_t i) const;
+
+  public:
+    PathEntryBuffer();
+    explicit PathEntryBuffer(std::vector<PathEntry> &&_owned,
+                             PathFileVersion _version = PathFileV1);
+    ~PathEntryBuffer();
+    PathEntryBuffer(const PathEntryBuffer &) = delete;
+    PathEntryBuffer &operator=(const PathEntryBuffer &) = delete;
+
+    /// Map the given .path file, block compressed or not, keeping about
+    /// window bytes of it decompressed (all of it when window is 0).
+    /// \return nullptr and set error if the file cannot be used.
+    static std::unique_ptr<PathEntryBuffer>
+    open(const std::string &path, std::string &error, size_t window = 0);
+
+    /// Format of the file this buffer was loaded from
+    PathFileVersion getVersion() const { return version; }
+    size_t size() const { return numEntries; }
+    bool empty() const { return numEntries == 0; }
+    const PathEntry &operator[](size_t i) const {
+      if (i >= numReady || i < numReleased)
+        fetch(i);
+      return entries[i];
+    }
+    /// Not available with a window.
+    const PathEntry *begin() const {
+      assert(!window && "cannot iterate over a windowed path file");
+      if (numEntries)
+        fetch(numEntries - 1);
+      return entries;
+    }
+    const PathEntry *end() const { return entries + numEntries; }
+  };
+
+  /// On-disk encodings of a .path_datarec file.
+  ///
+  /// v1 has no header: each entry is the uint64 data followed by the
+  /// instruction unique ID as a length-prefixed string.
+  /// v2 starts with the 8-byte magic "KLEEDREC", a uint32 version, uint32
+  /// numIDs and uint64 numEntries. The instruction ID dictionary follows
+  /// (numIDs length-prefixed strings), then numEntries fixed size records of
+  /// uint64 data and a uint32 index into the dictionary.
+  enum DataRecFileVersion { DataRecFileV1 = 1, DataRecFileV2 = 2 };
+
+  /// Encode entries as a v2 .path_datarec image and append it to out.
+  /// DataRecEntry::instID of the input is a module-wide ID (see
+  /// KInstruction::dataRecID); idName maps it to the instruction unique ID.
+  /// Only the IDs actually referenced end up in the dictionary.
+  void encodeDataRecFile(const std::vector<DataRecEntry> &entries,
+                         const std::function<std::string(uint32_t)> &idName,
+                         std::string &out);
+
+  /// The DataRecEntry stream associated with a .path file.
+  ///
+  /// instID of the returned entries indexes getIDTable(). v2 files are
+  /// mapped and records are decoded on access; legacy v1 files are converted
+  /// once when opened. Block compressed v2 files are decompressed on a
+  /// background thread like the .path files, within a window if one is
+  /// given.
+  class DataRecBuffer {
+    std::unique_ptr<llvm::MemoryBuffer> mapped;
+    std::unique_ptr<BlockDecompressor> decompressor;
+    std::vector<DataRecEntry> owned;
+    std::vector<std::string> idTable;
+    const char *records;
+    size_t numEntries;
+    /// records below this one can be read without waiting
+    mutable size_t numReady;
+    /// records below this one may have been dropped
+    mutable size_t numReleased;
+    size_t window;
+
+    void fetch(size_t i) const;
+
+  public:
+    DataRecBuffer();
+    DataRecBuffer(std::vector<DataRecEntry> &&_owned,
+                  std::vector<std::string> &&_idTable);
+    ~DataRecBuffer();
+    DataRecBuffer(const DataRecBuffer &) = delete;
+    DataRecBuffer &operator=(const DataRecBuffer &) = delete;
+
+    /// Open the given .path_datarec file of either version, block compressed
+    /// or not, keeping about window bytes of it decompressed (all of it when
+    /// window is 0).
+    /// \return nullptr and set error if the file cannot be used.
+    static std::unique_ptr<DataRecBuffer>
+    open(const std::string &path, std::string &error, size_t window = 0);
+
+    size_t size() const { return numEntries; }
+    bool empty() const { return numEntries == 0; }
+    DataRecEntry operator[](size_t i) const;
+
+    /// Instruction unique IDs referenced by DataRecEntry::instID
+    const std::vector<std::string> &getIDTable() const { return idTable; }
+  };
+
+  /// A recorded trace as read for replay
+  struct ReplayTrace {
+    const PathEntryBuffer *path;
+    const DataRecBuffer *dataRec;
+  };
+
+  /// What mergeReplayTraces did with the DATAREC entries
+  struct TraceMergeStats {
+    /// entries of a later trace that the traces before it lacked
+    size_t added = 0;
+    /// entries that an earlier trace recorded too
+    size_t shared = 0;
+    /// shared entries whose recorded values disagree
+    size_t conflicts = 0;
+  };
+
+  /// Merge several traces of the same failure into one trace.
+  ///
+  /// The traces have to follow the same control flow: their non-DATAREC
+  /// entries must be identical. Between two such entries, the k-th DATAREC
+  /// entry of an instruction in one trace is the same dynamic instance as the
+  /// k-th one of that instruction in another trace. The result holds every
+  /// instance recorded by any trace, with the value of the first trace that
+  /// recorded it. Instances only a later trace recorded are placed just
+  /// before the next instance the traces share, in that trace's order.
+  ///
+  /// instID of the resulting DataRecEntry indexes idTable.
+  /// \return false and set error if the traces do not follow the same path.
+  bool mergeReplayTraces(const std::vector<ReplayTrace> &traces,
+                         std::vector<PathEntry> &path,
+                         std::vector<DataRecEntry> &dataRec,
+                         std::vector<std::string> &idTable,
+                         TraceMergeStats &stats, std::string &error);
+} // namespace klee
+
+#endif /* KLEE_PATHBUFFER_H */
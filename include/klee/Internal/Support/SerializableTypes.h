@@ -33,6 +33,8 @@ namespace klee {
     typedef uint16_t switchIndex_t;
     typedef uint8_t indirectbrIndex_t;
     typedef uint8_t numKids_t;
+    // IDlen is kept for the on-disk layout only, instruction IDs now live in
+    // the .path_datarec dictionary
     typedef struct { uint8_t IDlen; uint8_t width; } dataRec_t;
     typedef uint16_t thread_t;
     PathEntry_t t;
@@ -42,14 +44,25 @@ namespace klee {
       switchIndex_t switchIndex;
       indirectbrIndex_t indirectbrIndex;
       dataRec_t drec;
-      // Here assume the max number of thread id won't exceed 2^16
-      // tgtid is the target thread id after a schedule
+      // tgtid is the target thread after a schedule, see scheduleTarget
       thread_t tgtid;
     } body;
+
+    // The target of a schedule keeps the thread id in the low byte and the
+    // process id in the high one, so the traces of a single process (pid 0)
+    // hold plain thread ids
+    static thread_t scheduleTarget(uint64_t tid, uint64_t pid) {
+      return (thread_t)((pid << 8) | (tid & 0xff));
+    }
+    uint64_t scheduleTid() const { return body.tgtid & 0xff; }
+    uint64_t schedulePid() const { return body.tgtid >> 8; }
   };
 
   struct DataRecEntry {
-    std::string instUniqueID;
+    // Interned instruction ID. While executing this is
+    // KInstruction::dataRecID, in a loaded trace it indexes the ID table of
+    // the .path_datarec file (see DataRecBuffer::getIDTable).
+    uint32_t instID;
     uint64_t data;
   };
 }
@@ -62,6 +62,30 @@ namespace klee {
     is.seekg(sizeof(uit), std::ios::cur);
   }
 
+  // LEB128 style variable length unsigned integer
+  template <typename T> // ostream
+  inline static void serializeVarint(T &os, uint64_t v) {
+    while (v >= 0x80) {
+      os.put(static_cast<char>((v & 0x7f) | 0x80));
+      v >>= 7;
+    }
+    os.put(static_cast<char>(v));
+  }
+  template <typename T> // istream
+  inline static bool deserializeVarint(T &is, uint64_t &v) {
+    v = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+      char c;
+      is.get(c);
+      if (!is.good())
+        return false;
+      v |= static_cast<uint64_t>(c & 0x7f) << shift;
+      if (!(c & 0x80))
+        return true;
+    }
+    return false;
+  }
+
   // Execution Statistics related serializer
   template <typename T> // ostream
   inline static void serialize(T &os, const struct ExecutionStats &exstats) {
@@ -120,20 +144,20 @@ namespace klee {
   inline static void skip(T &is, const struct PathEntry &pe) {
     is.seekg(sizeof(pe), std::ios::cur);
   }
-  template <typename T> // oinstUniqueIDeam
+  template <typename T> // ostream
   inline static void serialize(T &os, const struct DataRecEntry &dre) {
     serialize(os, dre.data);
-    serialize(os, dre.instUniqueID);
+    serialize(os, dre.instID);
   }
-  template <typename T> // iinstUniqueIDeam
+  template <typename T> // istream
   inline static void deserialize(T &is, struct DataRecEntry &dre) {
     deserialize(is, dre.data);
-    deserialize(is, dre.instUniqueID);
+    deserialize(is, dre.instID);
   }
-  template <typename T> // iinstUniqueIDeam
+  template <typename T> // istream
   inline static void skip(T &is, const struct DataRecEntry &dre) {
     skip(is, dre.data);
-    skip(is, dre.instUniqueID);
+    skip(is, dre.instID);
   }
 }
 #endif
@@ -0,0 +1,62 @@
+//===-- WorkQueue.h ---------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_WORKQUEUE_H
+#define KLEE_WORKQUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace klee {
+
+/// Runs jobs in submission order on a fixed number of threads. At most
+/// capacity jobs wait to be run: submit blocks while the queue is full, so a
+/// producer that outpaces the threads is slowed down instead of buffering
+/// without bound. Without threads, submit runs the job itself.
+class WorkQueue {
+  struct Pool {
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable cond;
+  };
+  std::unique_ptr<Pool> pool;
+  std::deque<std::function<void()>> jobs;
+  unsigned numThreads, capacity;
+  unsigned running = 0;
+  bool stop = false;
+
+  void start();
+  void work();
+
+public:
+  WorkQueue(unsigned numThreads, unsigned capacity);
+  /// Runs the jobs still queued before joining the threads.
+  ~WorkQueue();
+
+  WorkQueue(const WorkQueue &) = delete;
+  WorkQueue &operator=(const WorkQueue &) = delete;
+
+  void submit(std::function<void()> job);
+
+  /// Wait until all the submitted jobs have finished.
+  void drain();
+
+  /// In a process forked right after drain(), start new threads in place of
+  /// the ones of the parent, which do not exist in this process.
+  void restartInChild();
+};
+
+} // namespace klee
+
+#endif /* KLEE_WORKQUEUE_H */
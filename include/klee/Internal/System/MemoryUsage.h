@@ -10,11 +10,50 @@
 #ifndef KLEE_MEMORYUSAGE_H
 #define KLEE_MEMORYUSAGE_H
 
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <string>
 
 namespace klee {
   namespace util {
     size_t GetTotalMallocUsage();
+
+    /// The subsystems whose memory is counted where they allocate it, to
+    /// tell which of them fills up the total
+    enum class MemoryTag {
+      Expr,        ///< Expr and UpdateNode objects
+      ObjectState, ///< ObjectState objects and their byte pages
+      Constraints, ///< the independent factors of the constraint sets
+      CexCache,    ///< the assignments of the counterexample cache
+      Z3Builder,   ///< the expression translations cached by Z3 builders
+    };
+    const unsigned NumMemoryTags = 5;
+
+    /// Bytes currently held by each tag, indexed by MemoryTag
+    extern std::atomic<int64_t> TaggedMemoryUsage[NumMemoryTags];
+
+    inline void TrackMemory(MemoryTag tag, int64_t bytes) {
+      TaggedMemoryUsage[static_cast<unsigned>(tag)].fetch_add(
+          bytes, std::memory_order_relaxed);
+    }
+
+    inline size_t GetTaggedMemoryUsage(MemoryTag tag) {
+      int64_t bytes = TaggedMemoryUsage[static_cast<unsigned>(tag)].load(
+          std::memory_order_relaxed);
+      return bytes > 0 ? bytes : 0;
+    }
+
+    /// e.g. "ObjectState"
+    const char *GetMemoryTagName(MemoryTag tag);
+
+    /// The number of NUMA nodes of the machine, 1 without NUMA information
+    unsigned GetNumNumaNodes();
+
+    /// Run the calling process on the CPUs of NUMA node node only, so that
+    /// the memory it touches from now on is allocated on that node.
+    /// \return false, with the reason in error, if it could not
+    bool BindToNumaNode(unsigned node, std::string &error);
   }
 }
 
@@ -15,6 +15,7 @@
 #include <string>
 #include <vector>
 #include <ctime>
+#include "klee/Internal/Support/PathBuffer.h"
 #include "klee/Internal/Support/Serialize.h"
 struct KTest;
 
@@ -51,6 +52,31 @@ public:
   /// parsing and other setup process.
   virtual void setStartTime(std::time_t t) = 0;
   virtual void reportInEngineTime() const = 0;
+
+  /// Flush all output before the interpreter forks off a worker process.
+  virtual void prepareWorkerFork() {}
+  /// In a new worker process, direct all further output to a place of its
+  /// own, named after the worker id.
+  virtual void startWorker(unsigned id) {}
+
+  /// Take over the exploration of state as a job for another process: its
+  /// trace so far is replayed there with -replay-path-prefix.
+  /// \return false if there is nowhere to export jobs to.
+  virtual bool exportJob(const ExecutionState &state) { return false; }
+};
+
+/// Seeds that are read one at a time as the interpreter needs them, so that
+/// the seeds already replayed can be freed before the later ones are read.
+class SeedSource {
+public:
+  virtual ~SeedSource() = default;
+
+  /// Start over from the first seed.
+  virtual void rewind() = 0;
+
+  /// The next seed, which the caller frees with kTest_free, or null after
+  /// the last one.
+  virtual struct KTest *next() = 0;
 };
 
 class Interpreter {
@@ -149,18 +175,30 @@ public:
   // supply a list of branch decisions specifying which direction to
   // take on forks. this can be used to drive the interpretation down
   // a user specified path. use null to reset.
-  virtual void setReplayPath(const std::vector<PathEntry> *path) = 0;
-  virtual void setReplayDataRecEntries(const std::vector<DataRecEntry> *datarec) = 0;
+  virtual void setReplayPath(const PathEntryBuffer *path) = 0;
+  virtual void setReplayDataRecEntries(const DataRecBuffer *datarec) = 0;
 
-  // supply a set of symbolic bindings that will be used as "seeds"
-  // for the search. use null to reset.
-  virtual void useSeeds(const std::vector<struct KTest *> *seeds) = 0;
+  // translate an interned instruction ID (DataRecEntry::instID during
+  // execution) back to the unique ID of the instruction
+  virtual std::string getDataRecUniqueID(uint32_t dataRecID) const = 0;
+
+  // supply a source of symbolic bindings that will be used as "seeds"
+  // for the search. every run reads it again from the start. use null to
+  // reset.
+  virtual void useSeeds(SeedSource *seeds) = 0;
 
   virtual void runFunctionAsMain(llvm::Function *f,
                                  int argc,
                                  char **argv,
                                  char **envp) = 0;
 
+  /// Fork off a worker process for a run of its own, e.g. one -replay-serve
+  /// replay, set up like the -parallel-workers processes: with its own
+  /// output directory, solvers and statistics.
+  /// \return as fork: 0 in the worker, its pid in this process and -1 if
+  /// the fork failed.
+  virtual int forkRunWorker() = 0;
+
   /*** Runtime options ***/
 
   virtual void setHaltExecution(bool value) = 0;
@@ -86,6 +86,12 @@ extern llvm::cl::opt<bool> DebugLogMerge;
 
 extern llvm::cl::opt<bool> DebugLogIncompleteMerge;
 
+extern llvm::cl::opt<bool> UseAutoMerge;
+
+extern llvm::cl::opt<unsigned> AutoMergeMaxInstructions;
+
+extern llvm::cl::opt<unsigned> AutoMergeMaxConstraints;
+
 class Executor;
 class ExecutionState;
 
@@ -119,6 +125,12 @@ private:
       reachedCloseMerge;
 
 public:
+  /// @brief For a region merged by -auto-merge: the instruction at which the
+  /// states close the merge, nullptr for klee_open_merge() regions
+  llvm::Instruction *autoClose;
+
+  /// @brief The stack depth at which the states reach autoClose
+  size_t autoCloseDepth;
 
   /// @brief Called when a state runs into a 'klee_close_merge()' call
   void addClosedState(ExecutionState *es, llvm::Instruction *mp);
@@ -147,7 +159,8 @@ public:
   /// @brief Required by klee::ref-managed objects
   class ReferenceCounter _refCount;
 
-  MergeHandler(Executor *_executor, ExecutionState *es);
+  MergeHandler(Executor *_executor, ExecutionState *es,
+               llvm::Instruction *_autoClose = nullptr);
   ~MergeHandler();
 };
 }
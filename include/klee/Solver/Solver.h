@@ -20,6 +20,7 @@
 
 #include <vector>
 #include <string>
+#include <utility>
 
 namespace klee {
   class SolverImpl;
@@ -51,27 +52,45 @@ namespace klee {
     // indep_elemset, which might be unnecessary?
     const IndependentElementSet *indep_elemset = nullptr;
 
+    // fingerprint, when non-zero, is fingerprintConstraints(constraints),
+    // handed down so that the solvers below do not have to compute it.
+    uint64_t fingerprint = 0;
+
     // constructor requires an explicit specification of each component.
     Query(const ConstraintManager &_constraintMgr,
           const Constraints_ty &_constraints, ref<Expr> _expr,
           const IndependentElementSet *_indep_elemset = nullptr)
-        : constraintMgr(_constraintMgr), constraints(_constraints), expr(_expr),
+        : constraintMgr(_constraintMgr), constraints(_constraints),
+          expr(std::move(_expr)),
           indep_elemset(_indep_elemset) {}
     // constructor omits a collection of constraints. Then we use all
     // constraints associated with the ConstraintManager by default.
     Query(const ConstraintManager &_constraintMgr, ref<Expr> _expr)
       : constraintMgr(_constraintMgr),
-        constraints(_constraintMgr.getAllConstraints()), expr(_expr) {}
+        constraints(_constraintMgr.getAllConstraints()),
+        expr(std::move(_expr)) {}
 
     /// withExpr - Return a copy of the query with the given expression.
     Query withExpr(ref<Expr> _expr) const {
-      return Query(constraintMgr, constraints, _expr, indep_elemset);
+      Query query(constraintMgr, constraints, std::move(_expr), indep_elemset);
+      query.fingerprint = fingerprint;
+      return query;
     }
 
     /// withFalse - Return a copy of the query with a false expression.
     Query withFalse() const {
-      return Query(constraintMgr, constraints,
-                   ConstantExpr::alloc(0, Expr::Bool), indep_elemset);
+      return withExpr(ConstantExpr::alloc(0, Expr::Bool));
+    }
+
+    /// getFingerprint - Return fingerprintConstraints(constraints), without
+    /// visiting the constraints if they are all those of constraintMgr or
+    /// the fingerprint was handed down.
+    uint64_t getFingerprint() const {
+      if (fingerprint)
+        return fingerprint;
+      if (&constraints == &constraintMgr.getAllConstraints())
+        return constraintMgr.getFingerprint();
+      return fingerprintConstraints(constraints);
     }
 
     /// negateExpr - Return a copy of the query with the expression negated.
@@ -176,6 +195,25 @@ namespace klee {
     /// \return True on success.
     bool mayBeTrue(const Query&, bool &result);
 
+    /// mustBeTrue - Determine for each of exprs whether it is provably true
+    /// given the constraints of the query, whose expression is ignored. The
+    /// solver sees the constraints once for all the expressions.
+    ///
+    /// \param [out] results - On success, results[i] is the result of
+    /// mustBeTrue for exprs[i]
+    ///
+    /// \return True on success.
+    bool mustBeTrue(const Query &query, const std::vector<ref<Expr> > &exprs,
+                    std::vector<bool> &results);
+
+    /// mayBeTrue - Determine for each of exprs whether it may be true given
+    /// the constraints of the query, whose expression is ignored.
+    ///
+    /// \sa mustBeTrue(const Query&, const std::vector<ref<Expr> >&,
+    /// std::vector<bool>&)
+    bool mayBeTrue(const Query &query, const std::vector<ref<Expr> > &exprs,
+                   std::vector<bool> &results);
+
     /// mayBeFalse - Determine if there is a valid assignment for the given
     /// state in which the expression evaluates to false.
     ///
@@ -271,6 +309,24 @@ namespace klee {
   /// \param s - The underlying solver to use.
   Solver *createCexCachingSolver(Solver *s);
 
+  /// createPersistentCachingSolver - Create a solver which caches query
+  /// results and counterexamples in a file shared across runs. Queries are
+  /// identified by a structural hash, so independent executions of the same
+  /// program reuse each other's results.
+  ///
+  /// \param s - The underlying solver to use.
+  /// \param path - The cache file, created if it does not exist.
+  Solver *createPersistentCachingSolver(Solver *s, const std::string &path);
+
+  /// createWarmStartSolver - Create a solver which first tries the values of
+  /// the given KTests as models of a query, e.g. the inputs of an earlier
+  /// run along a nearby path, before invoking the underlying solver.
+  ///
+  /// \param s - The underlying solver to use.
+  /// \param paths - KTest files, or directories whose KTests are all used.
+  Solver *createWarmStartSolver(Solver *s,
+                                const std::vector<std::string> &paths);
+
   /// createFastCexSolver - Create a "fast counterexample solver", which tries
   /// to quickly compute a satisfying assignment for a constraint set using
   /// value propogation and range analysis.
@@ -278,6 +334,32 @@ namespace klee {
   /// \param s - The underlying solver to use.
   Solver *createFastCexSolver(Solver *s);
 
+  /// createAdaptiveSolver - Create a solver which answers each query with
+  /// one of several chains of the optional layers over s: the one of the
+  /// command line options, and the ones with the counterexample cache, the
+  /// equality simplifier or the fast counterexample solver toggled. It learns
+  /// for each class of queries which chain is fastest; the number of queries
+  /// each chain answered is kept in SolverStats.
+  ///
+  /// \param s - The underlying solver to use, shared by the chains.
+  Solver *createAdaptiveSolver(Solver *s);
+
+  /// createBitBlastingSolver - Create a solver which bit-blasts the queries
+  /// that read arrays only at concrete indices and have no divisions into
+  /// CNF and solves them with CaDiCaL, passing the other queries to the
+  /// underlying solver. Without CaDiCaL support, returns s.
+  ///
+  /// \param s - The underlying solver to use.
+  Solver *createBitBlastingSolver(Solver *s);
+
+  /// createEqualitySimplifyingSolver - Create a solver which rewrites the
+  /// constraints and the expression of a query with the (Eq constant expr)
+  /// constraints of the query, answering it directly if the expression
+  /// becomes constant.
+  ///
+  /// \param s - The underlying solver to use.
+  Solver *createEqualitySimplifyingSolver(Solver *s);
+
   /// createIndependentSolver - Create a solver which will eliminate any
   /// unnecessary constraints before propogating the query to the underlying
   /// solver.
@@ -297,6 +379,12 @@ namespace klee {
                                     time::Span minQueryTimeToLog,
                                     bool logTimedOut);
 
+  /// createBinaryQueryLoggingSolver - Create a solver which will forward all
+  /// queries after writing them to the given path in the binary format of
+  /// BinaryQueryLogWriter (see klee/Expr/BinaryQueryLog.h).
+  Solver *createBinaryQueryLoggingSolver(Solver *s, std::string path,
+                                         time::Span minQueryTimeToLog,
+                                         bool logTimedOut);
 
   /// createDummySolver - Create a dummy solver implementation which always
   /// fails.
@@ -305,6 +393,19 @@ namespace klee {
   // Create a solver based on the supplied ``CoreSolverType``.
   Solver *createCoreSolver(CoreSolverType cst);
 
+  /// createSMTLIBProcessSolver - Create a core solver which sends the queries
+  /// in SMT-LIBv2 to long running solver processes (-smtlib-solver-command),
+  /// keeping the constraints shared between queries asserted.
+  Solver *createSMTLIBProcessSolver();
+
+  /// createPortfolioSolver - Create a solver which runs every query on all
+  /// of the given core solvers, each in a forked process, and returns the
+  /// first answer. Wins and losses are counted per backend.
+  ///
+  /// \param solvers - The backends to race, owned by the new solver.
+  Solver *createPortfolioSolver(
+      const std::vector<std::pair<CoreSolverType, Solver *> > &solvers);
+
 }
 
 #endif /* KLEE_SOLVER_H */
@@ -24,10 +24,20 @@ namespace klee {
 
 extern llvm::cl::opt<bool> UseFastCexSolver;
 
+extern llvm::cl::opt<bool> UseSATBitBlaster;
+
+extern llvm::cl::opt<bool> UseEqualitySimplifier;
+
 extern llvm::cl::opt<bool> UseCexCache;
 
+extern llvm::cl::opt<bool> UseAdaptiveSolverChain;
+
 extern llvm::cl::opt<bool> UseBranchCache;
 
+extern llvm::cl::opt<std::string> SolverCacheFile;
+
+extern llvm::cl::list<std::string> SolverHints;
+
 extern llvm::cl::opt<bool> UseIndependentSolver;
 
 enum class IndependentSolverType { PER_FACTOR, BATCH };
@@ -37,6 +47,12 @@ extern llvm::cl::opt<bool> EnableIndepExprCheckSum;
 
 extern llvm::cl::opt<unsigned int> ExprNumThreshold;
 
+extern llvm::cl::opt<unsigned> IndependentSolverJobs;
+
+extern llvm::cl::opt<unsigned> IndependentSolutionCacheSize;
+
+extern llvm::cl::opt<unsigned> IndependentSlicingThreshold;
+
 extern llvm::cl::opt<bool> DebugValidateSolver;
 
 extern llvm::cl::opt<std::string> MinQueryTimeToLog;
@@ -56,7 +72,9 @@ enum QueryLoggingSolverType {
   ALL_KQUERY,    ///< Log all queries in .kquery (KQuery) format
   ALL_SMTLIB,    ///< Log all queries .smt2 (SMT-LIBv2) format
   SOLVER_KQUERY, ///< Log queries passed to solver in .kquery (KQuery) format
-  SOLVER_SMTLIB  ///< Log queries passed to solver in .smt2 (SMT-LIBv2) format
+  SOLVER_SMTLIB, ///< Log queries passed to solver in .smt2 (SMT-LIBv2) format
+  ALL_KQLOG,     ///< Log all queries in binary .kqlog format
+  SOLVER_KQLOG   ///< Log queries passed to solver in binary .kqlog format
 };
 
 extern llvm::cl::bits<QueryLoggingSolverType> QueryLoggingOptions;
@@ -66,11 +84,15 @@ enum CoreSolverType {
   METASMT_SOLVER,
   DUMMY_SOLVER,
   Z3_SOLVER,
+  SMTLIB_SOLVER,
+  PORTFOLIO_SOLVER,
   NO_SOLVER
 };
 
 extern llvm::cl::opt<CoreSolverType> CoreSolverToUse;
 
+extern llvm::cl::list<CoreSolverType> PortfolioSolvers;
+
 extern llvm::cl::opt<CoreSolverType> DebugCrossCheckCoreSolverWith;
 
 #ifdef ENABLE_METASMT
@@ -79,6 +79,24 @@ namespace klee {
     /// \return True on success
     virtual bool computeTruth(const Query& query, bool &isValid) = 0;
 
+    /// computeTruthBatch - Determine for each of exprs whether it is provably
+    /// true given the constraints of the query, as computeTruth does for
+    /// query.withExpr(expr), in a single call so that an implementation can
+    /// hand the constraints to its solver only once. The query expression
+    /// is ignored.
+    ///
+    /// The expressions are guaranteed to be non-constant and have bool type.
+    ///
+    /// SolverImpl provides a default implementation which uses
+    /// computeTruth for each expression.
+    ///
+    /// \param [out] isValid - On success, isValid[i] is the result of
+    /// computeTruth for exprs[i].
+    /// \return True on success
+    virtual bool computeTruthBatch(const Query &query,
+                                   const std::vector<ref<Expr> > &exprs,
+                                   std::vector<bool> &isValid);
+
     /// computeValue - Compute a feasible value for the expression.
     ///
     /// The query expression is guaranteed to be non-constant.
@@ -22,11 +22,32 @@ namespace stats {
   extern Statistic queryCacheMisses;
   extern Statistic queryCexCacheHits;
   extern Statistic queryCexCacheMisses;
+  extern Statistic queryCexCacheEvictions;
+  extern Statistic queryPersistentCacheHits;
+  extern Statistic queryPersistentCacheMisses;
+  extern Statistic queryWarmStartHits;
   extern Statistic queryConstructTime;
   extern Statistic queryConstructs;
   extern Statistic queryCounterexamples;
+  extern Statistic portfolioSTPWins;
+  extern Statistic portfolioSTPLosses;
+  extern Statistic portfolioMetaSMTWins;
+  extern Statistic portfolioMetaSMTLosses;
+  extern Statistic portfolioZ3Wins;
+  extern Statistic portfolioZ3Losses;
+  extern Statistic queriesBitBlasted;
+  extern Statistic adaptiveDefaultChain;
+  extern Statistic adaptiveCexCacheToggled;
+  extern Statistic adaptiveEqualitySimplifierToggled;
+  extern Statistic adaptiveFastCexToggled;
+  extern Statistic adaptiveExplorations;
+  extern Statistic equalitySimplifiedQueries;
+  extern Statistic equalitySimplifiedConstraints;
   extern Statistic independentConstraints;
   extern Statistic independentAllConstraints;
+  extern Statistic independentSlicedQueries;
+  extern Statistic independentSliceRefinements;
+  extern Statistic independentFactorCacheHits;
   // Solver Time related stats
   extern Statistic independentTime;
   extern Statistic cexCacheTime;
@@ -14,6 +14,8 @@
 
 #include "llvm/Support/raw_ostream.h"
 
+#include <atomic>
+#include <memory>
 #include <vector>
 #include <string>
 #include <string.h>
@@ -39,6 +41,32 @@ namespace klee {
     StatisticRecord &operator +=(const StatisticRecord &sr);
   };
 
+  /// The global counters of the statistics incremented by one thread other
+  /// than the one interpreting. Only that thread writes them, so an increment
+  /// is a plain load and store; readers sum them with the global counters
+  /// without stopping it. The counters are padded by a cache line on each
+  /// side so that two shards never share one.
+  class StatisticShard {
+    friend class StatisticManager;
+
+    std::unique_ptr<std::atomic<uint64_t>[]> storage;
+    std::atomic<uint64_t> *data;
+    StatisticShard *next;
+    std::atomic<bool> inUse;
+
+    explicit StatisticShard(unsigned numStatistics);
+
+  public:
+    void increment(unsigned id, uint64_t addend) {
+      std::atomic<uint64_t> &v = data[id];
+      v.store(v.load(std::memory_order_relaxed) + addend,
+              std::memory_order_relaxed);
+    }
+    uint64_t getValue(unsigned id) const {
+      return data[id].load(std::memory_order_relaxed);
+    }
+  };
+
   class StatisticManager {
   private:
     bool enabled;
@@ -47,8 +75,32 @@ namespace klee {
     uint64_t *indexedStats;
     StatisticRecord *contextStats;
     unsigned index;
+    /// The shards ever attached, pushed at the front and never removed.
+    std::atomic<StatisticShard *> shards;
+
+    static thread_local StatisticShard *threadShard;
+
+    /// The sum of the shards for statistic id.
+    uint64_t getShardTotal(unsigned id) const;
 
   public:
+    /// While alive, the global statistics incremented by this thread go to
+    /// a shard of its own instead of the shared counters, so it can run
+    /// next to the interpreting thread. The indexed and context statistics
+    /// keep following the index and context of the interpreting thread and,
+    /// like setting a statistic, must not be done from inside a scope. Shards are kept when their
+    /// scope ends and reused by later scopes, so a pool of threads needs
+    /// as many shards as it has threads.
+    class ThreadScope {
+      bool attached;
+
+    public:
+      ThreadScope();
+      ~ThreadScope();
+      ThreadScope(const ThreadScope &) = delete;
+      ThreadScope &operator=(const ThreadScope &) = delete;
+    };
+
     StatisticManager();
     ~StatisticManager();
 
@@ -79,6 +131,11 @@ namespace klee {
   inline void StatisticManager::incrementStatistic(Statistic &s, 
                                                    uint64_t addend) {
     if (enabled) {
+      if (shards.load(std::memory_order_relaxed))
+        if (StatisticShard *shard = threadShard) {
+          shard->increment(s.id, addend);
+          return;
+        }
       globalStats[s.id] += addend;
       if (indexedStats) {
         indexedStats[index*stats.size() + s.id] += addend;
@@ -133,10 +190,16 @@ namespace klee {
   }
 
   inline uint64_t StatisticManager::getValue(const Statistic &s) const {
+    if (shards.load(std::memory_order_acquire))
+      return globalStats[s.id] + getShardTotal(s.id);
     return globalStats[s.id];
   }
 
+  /// The shards are only written by their threads: the global counter is
+  /// set to what they lack (modulo 2^64) to give the value.
   inline void StatisticManager::setValue(const Statistic &s, uint64_t value) {
+    if (shards.load(std::memory_order_acquire))
+      value -= getShardTotal(s.id);
     globalStats[s.id] = value;
   }
 
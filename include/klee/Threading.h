@@ -34,14 +34,17 @@
  */
 #ifndef _KLEE_THREADING_H_
 #define _KLEE_THREADING_H_
+#include "klee/Internal/Module/Cell.h"
 #include "klee/Internal/Module/KInstIterator.h"
 #include "klee/Internal/Module/KModule.h"
 
 #include "llvm/Support/raw_ostream.h"
+
+#include <memory>
+
 namespace klee {
 
 class CallPathNode;
-struct Cell;
 class MemoryObject;
 struct StackFrame {
   KInstIterator caller;
@@ -49,7 +52,13 @@ struct StackFrame {
   CallPathNode *callPathNode;
 
   std::vector<const MemoryObject *> allocas;
-  Cell *locals;
+
+private:
+  /// The registers of the frame. Copies of a frame (e.g. in the states a
+  /// branch creates) share them until one of them writes a register.
+  std::shared_ptr<std::vector<Cell> > locals;
+
+public:
 
   /// Minimum distance to an uncovered instruction once the function
   /// returns. This is not a good place for this but is used to
@@ -68,10 +77,20 @@ struct StackFrame {
   StackFrame(KInstIterator caller, KFunction *kf);
   StackFrame(const StackFrame &s);
   ~StackFrame();
+
+  const Cell &getLocal(unsigned index) const { return (*locals)[index]; }
+
+  /// The register at index, after unsharing the registers of the frame
+  /// from its copies.
+  Cell &getWriteableLocal(unsigned index) {
+    if (locals.use_count() > 1)
+      locals = std::make_shared<std::vector<Cell> >(*locals);
+    return (*locals)[index];
+  }
 };
 
-// note that I have not ported multi-processes support, process_id_t is just a
-// place holder.
+// a thread is identified by its thread id and the id of its process, see
+// ExecutionState::processes
 typedef uint64_t thread_id_t;
 typedef uint64_t process_id_t;
 typedef uint64_t wlist_id_t;
@@ -81,6 +100,7 @@ class ExecutionState;
 class Thread {
   friend class ExecutionState;
   friend class Executor;
+  friend class PathDumpTable;
 
 public:
   typedef std::vector<StackFrame> stack_ty;
@@ -106,8 +126,8 @@ private:
   /// @brief If this thread is disabled (sleeping), which waiting list it is
   /// waiting for. valid wlist id > 0
   wlist_id_t waitingList;
-  /// @brief the tuple (tid, pid). Note that we currently do not support multi
-  /// processes, so the pid is always be 0 for now.
+  /// @brief the tuple (tid, pid). The main process has pid 0, the ones
+  /// klee_process_fork creates get the following ids.
   thread_uid_t tuid;
 
   /// When IgnorePOSIXPath is set, isInPOSIX will be true if the latest frame
@@ -36,6 +36,16 @@ extern "C" {
    */
   void klee_make_symbolic(void *addr, size_t nbytes, const char *name);
 
+  /* klee_make_symbolic_batch - Make the \arg count objects starting at
+   * \arg addrs[i] symbolic at once, as klee_make_symbolic(addrs[i],
+   * sizes[i], names[i]) would in turn. The objects share one symbolic array,
+   * so a batch of many small objects costs about as much as a single one;
+   * each still is a separate object of the test cases. The three arrays
+   * have to be concrete.
+   */
+  void klee_make_symbolic_batch(void *const *addrs, const size_t *sizes,
+                                const char *const *names, unsigned count);
+
   /* klee_range - Construct a symbolic value in the signed interval
    * [begin,end).
    *
@@ -161,12 +171,12 @@ extern "C" {
   int klee_get_errno(void);
 
   //////////////////////////////////////////////////////////////////////////////
-  // Shared Memory Management (NOT IMPLEMENTED)
+  // Shared Memory Management
   //////////////////////////////////////////////////////////////////////////////
 
   /*
-   * Mark a private memory object shared between processes (if they know the
-   * address)
+   * Mark the memory object holding addr shared between the processes (if
+   * they know the address), instead of copied by klee_process_fork
    */
   void klee_make_shared(void *addr, size_t nbytes);
 
@@ -178,9 +188,22 @@ extern "C" {
                           void *arg);
   void klee_thread_terminate() __attribute__ ((__noreturn__));
 
+  /*
+   * Fork the running process into process pid (the lowest free id if pid is
+   * negative). Returns the id of the child in the parent, 0 in the child and
+   * -1 if there is no id left.
+   */
   int klee_process_fork(int32_t pid);
   void klee_process_terminate() __attribute__ ((__noreturn__));
 
+  /*
+   * Reap an exited child of the running process (any of them if pid is
+   * negative), writing its exit status to *status. Returns the id of the
+   * child, -1 if there is no such child and 0 if they are all running, once
+   * one of them exits if block is set.
+   */
+  int klee_process_wait(int32_t pid, int32_t *status, int block);
+
   // @param[out] tid, write tid to this address
   // @param[out] pid, write pid to this address
   void klee_get_context(uint64_t *tid, int32_t *pid);
@@ -203,6 +226,22 @@ extern "C" {
   uint64_t klee_get_time(void);
   void klee_set_time(uint64_t time);
 
+  /* klee_copy_memory - Copy nbytes from \arg src to \arg dest in the
+   * executor, as memmove does, if it can. Returns the number of bytes left
+   * for the caller to copy: 0 if it copied them, nbytes if it declined (on
+   * the recorded path, or with symbolic or invalid arguments). Passing the
+   * result to memcpy copies without a branch of the caller's own.
+   */
+  size_t klee_copy_memory(void *dest, const void *src, size_t nbytes);
+
+  /* klee_map_file - Take the \arg nbytes at \arg buf, the whole of a
+   * concrete object, from the host file at \arg path, reading each chunk
+   * the first time the program accesses it. Returns the number of bytes
+   * left for the caller to read: 0 if the file is mapped, nbytes if it
+   * declined (on the recorded path, or with symbolic or invalid arguments).
+   */
+  size_t klee_map_file(void *buf, size_t nbytes, const char *path);
+
 #ifdef __cplusplus
 }
 #endif
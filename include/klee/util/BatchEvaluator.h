@@ -0,0 +1,144 @@
+//===-- BatchEvaluator.h ----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_BATCHEVALUATOR_H
+#define KLEE_BATCHEVALUATOR_H
+
+#include "klee/Expr/ArrayIdMap.h"
+#include "klee/Expr/Assignment.h"
+#include "klee/Expr/Expr.h"
+#include "klee/Internal/ADT/KTest.h"
+
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+namespace klee {
+
+/// Evaluates a set of constraints against many KTests at once, the way
+/// OracleEvaluator evaluates them against one, or against many Assignments,
+/// the way Assignment::evaluate does.
+///
+/// The constraints are compiled once into a linear program over slots, one
+/// per distinct expression, in an order where operands come first. The
+/// program then runs on blocks of BlockSize KTests, every slot holding one
+/// value per KTest of the block (structure of arrays), so each instruction
+/// is a loop over the block the compiler can vectorize.
+///
+/// Constraints with expressions wider than 64 bits are not compiled, they
+/// are evaluated with an ExprEvaluator for every KTest instead.
+class BatchEvaluator {
+public:
+  /// Result of a constraint for a KTest. Unknown if the KTest has no object
+  /// for a symbolic array the constraint reads, or if the constraint divides
+  /// by zero or reads a constant array out of bounds somewhere. Evaluating
+  /// it with OracleEvaluator usually does not give a constant then, though
+  /// it sometimes folds what is left to one. The same goes for Assignments
+  /// that allow free values, which also leave the bytes past the end of a
+  /// binding free.
+  enum Result : uint8_t { Pass, Fail, Unknown };
+
+  static const unsigned BlockSize = 32;
+
+private:
+  struct Instruction {
+    /// an Expr::Kind, never Constant
+    uint8_t kind;
+    uint8_t width;
+    /// width of the first operand
+    uint8_t kidWidth;
+    /// slots of the operands
+    uint32_t a, b, c;
+    /// Extract offset, width of the right operand of a Concat, entry of
+    /// reads for a Read
+    uint32_t aux;
+    uint32_t dest;
+    /// entry of poisons set by divisions and reads out of bounds, or NoId
+    uint32_t poison;
+  };
+
+  struct Read {
+    /// entry of symbolicArrays, or NoId for a constant array
+    uint32_t array;
+    /// (index, value) slots of the updates, the latest first
+    std::vector<std::pair<uint32_t, uint32_t>> updates;
+    /// values of a constant array
+    std::vector<uint64_t> constantValues;
+  };
+
+  /// The bytes of a symbolic array for one lane
+  struct Binding {
+    const unsigned char *bytes;
+    unsigned size;
+    bool bound;
+    /// whether the bytes past size are free rather than 0
+    bool free;
+  };
+
+  struct Constraint {
+    ref<Expr> expr;
+    /// slot of the constraint, or NoId if it is not compiled
+    uint32_t slot;
+    /// the symbolic arrays and the poisons the constraint depends on
+    std::vector<uint32_t> arrays, poisons;
+  };
+
+  static const uint32_t NoId = ~0u;
+
+  std::vector<Instruction> program;
+  /// (slot, value) of the constants
+  std::vector<std::pair<uint32_t, uint64_t>> constants;
+  std::vector<Read> reads;
+  std::vector<const Array *> symbolicArrays;
+  ArrayIdMap<uint32_t> symbolicArrayIds;
+  uint32_t numSlots = 0, numPoisons = 0;
+  std::vector<Constraint> constraints;
+
+  /// expression -> slot, NoId if it cannot be compiled
+  std::unordered_map<const Expr *, uint32_t> slots;
+  /// (array, update list) -> entry of reads, shared by the reads of a list
+  std::map<std::pair<const Array *, const UpdateNode *>, uint32_t> readIds;
+  /// slot -> instruction writing it, NoId for constants
+  std::vector<uint32_t> writers;
+
+  uint32_t compile(const ref<Expr> &e);
+  uint32_t compileNode(const ref<Expr> &e);
+  /// \return the entry of reads for ul, NoId if it cannot be compiled
+  uint32_t compileRead(const UpdateList &ul);
+  void collectDependencies(Constraint &c) const;
+  void run(unsigned lanes, const Binding *bindings,
+           std::vector<uint64_t> &values, std::vector<uint8_t> &poisoned) const;
+  /// Run the program on inputs.size() lanes, block by block, with
+  /// bind(input, array, binding) filling the binding of array for an input.
+  template <class Input, class BindFn>
+  void evaluateCompiled(const std::vector<Input> &inputs, BindFn bind,
+                        std::vector<Result> &results) const;
+
+public:
+  BatchEvaluator(const std::vector<ref<Expr>> &exprs);
+
+  unsigned getNumConstraints() const { return constraints.size(); }
+  /// Number of constraints evaluated one KTest at a time.
+  unsigned getNumUncompiled() const;
+  unsigned getProgramSize() const { return program.size(); }
+
+  /// Evaluate every constraint against every KTest. The result of
+  /// constraint c for ktests[k] is results[k * getNumConstraints() + c].
+  void evaluate(const std::vector<const KTest *> &ktests,
+                std::vector<Result> &results) const;
+
+  /// Evaluate every constraint against every Assignment, with the same
+  /// layout of the results.
+  void evaluate(const std::vector<const Assignment *> &assignments,
+                std::vector<Result> &results) const;
+};
+} // namespace klee
+
+#endif /* KLEE_BATCHEVALUATOR_H */
@@ -10,6 +10,9 @@
 #ifndef KLEE_BITARRAY_H
 #define KLEE_BITARRAY_H
 
+#include <cstdint>
+#include <cstring>
+
 namespace klee {
 
   // XXX would be nice not to have
@@ -35,6 +38,69 @@ public:
   void set(unsigned idx) { bits[idx/32] |= 1<<(idx&0x1F); }
   void unset(unsigned idx) { bits[idx/32] &= ~(1<<(idx&0x1F)); }
   void set(unsigned idx, bool value) { if (value) set(idx); else unset(idx); }
+
+  /// Set every bit in [begin, end), filling whole words at once.
+  void setRange(unsigned begin, unsigned end) { fillRange(begin, end, true); }
+  /// Unset every bit in [begin, end), filling whole words at once.
+  void unsetRange(unsigned begin, unsigned end) {
+    fillRange(begin, end, false);
+  }
+
+  /// The first set bit in [begin, end), end if there is none.
+  unsigned findFirstSet(unsigned begin, unsigned end) const {
+    return find(begin, end, 0);
+  }
+  /// The first unset bit in [begin, end), end if there is none.
+  unsigned findFirstUnset(unsigned begin, unsigned end) const {
+    return find(begin, end, ~0u);
+  }
+
+  /// True if every bit in [begin, end) is set, checked a word at a time.
+  bool isAllSet(unsigned begin, unsigned end) const {
+    return findFirstUnset(begin, end) == end;
+  }
+  /// True if no bit in [begin, end) is set, checked a word at a time.
+  bool isAllUnset(unsigned begin, unsigned end) const {
+    return findFirstSet(begin, end) == end;
+  }
+
+private:
+  /// The bits from the low bit of begin up in its word.
+  static uint32_t lowMask(unsigned begin) { return ~0u << (begin & 0x1F); }
+  /// The bits below end in the word of its last bit.
+  static uint32_t highMask(unsigned end) {
+    return ~0u >> (31 - ((end - 1) & 0x1F));
+  }
+
+  void fillRange(unsigned begin, unsigned end, bool value) {
+    if (begin >= end)
+      return;
+    unsigned first = begin / 32, last = (end - 1) / 32;
+    uint32_t mask = lowMask(begin);
+    if (first != last) {
+      bits[first] = value ? bits[first] | mask : bits[first] & ~mask;
+      memset(bits + first + 1, value ? 0xFF : 0,
+             sizeof(*bits) * (last - first - 1));
+      mask = ~0u;
+    }
+    mask &= highMask(end);
+    bits[last] = value ? bits[last] | mask : bits[last] & ~mask;
+  }
+
+  /// The first bit in [begin, end) different from the bits of flip.
+  unsigned find(unsigned begin, unsigned end, uint32_t flip) const {
+    if (begin >= end)
+      return end;
+    unsigned last = (end - 1) / 32;
+    uint32_t mask = lowMask(begin);
+    for (unsigned word = begin / 32; word <= last; ++word, mask = ~0u) {
+      if (word == last)
+        mask &= highMask(end);
+      if (uint32_t found = (bits[word] ^ flip) & mask)
+        return word * 32 + __builtin_ctz(found);
+    }
+    return end;
+  }
 };
 
 } // End klee namespace
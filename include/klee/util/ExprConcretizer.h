@@ -29,6 +29,16 @@
 using namespace klee;
 
 namespace klee {
+  /// Concretizes constraints incrementally: the rewritten expressions are
+  /// kept between evaluate() calls on the same constraints, and adding a
+  /// concretized input or expression only re-evaluates the expressions that
+  /// may be affected by it, the ones reading the array or containing the
+  /// expression. Evaluating other constraints starts from scratch.
+  ///
+  /// The additional constraints found are kept as well: once an expression
+  /// is concretized, (e == x) stays among the results even if a later
+  /// concretization replaces the part of the constraints containing e. Such
+  /// constraints hold under the ktest.
   class ExprConcretizer : public OracleEvaluator {
   private:
     // concretizedInputs has the symbolic obj name and corresponding index you want to concretize.
@@ -37,7 +47,7 @@ namespace klee {
     // additionalConstraints contains the additional constraints added while performing the
     // evaluation. For example, while replacing an Expr e with a concrete value x, a constraint
     // (e == x) will be added here.
-    std::vector<ref<Expr>> additionalConstraints;
+    ExprHashSet additionalConstraints;
     // concretizedExprs contains the Exprs which need to be concretized, as well as the concrete
     // values to replace them.
     ExprHashMap<uint64_t> concretizedExprs;
@@ -49,8 +59,17 @@ namespace klee {
     // farthestUpdates maps symbolic array names to the longest corresponding
     // update list reconstructed by this evaluator.
     std::unordered_map<std::string, UpdateList *> farthestUpdates;
+    // the constraints the cached rewrites belong to
+    Constraints_ty evaluatedConstraints;
+    // arrays and Exprs concretized since the last evaluation
+    std::set<std::string> newInputArrays;
+    std::vector<ref<Expr>> newExprs;
 
+    // forget every rewrite and additional constraint
     void cleanUp();
+    // forget the rewrites of the parts of constraints affected by
+    // newInputArrays and newExprs
+    void invalidate(const Constraints_ty &constraints);
     Constraints_ty doEvaluate(
             const Constraints_ty::const_iterator ib,
             const Constraints_ty::const_iterator ie);
@@ -66,6 +85,7 @@ namespace klee {
   public:
     ExprConcretizer(std::string KTestPath)
           :OracleEvaluator(KTestPath, true) {}
+    ~ExprConcretizer() { cleanUp(); }
     void addConcretizedInputValue(std::string arrayName, unsigned index);
     /* TODO test addConcretizedExprValue */
     void addConcretizedExprValue(ref<Expr> e, uint64_t val);
@@ -107,40 +127,36 @@ namespace klee {
   private:
     // the set of all last level reads
     std::set<ref<ReadExpr>> lastLevelReads;
-    // map Expr(by their hash) to indirect depth
-    std::unordered_map<const Expr*, int> depthStore;
-    std::unordered_map<const UpdateNode*, int> depthStoreUNode;
+    // dense id of every Expr and UpdateNode below the constraints
+    std::unordered_map<const void *, uint32_t> ids;
+    // indirect depth by id
+    std::vector<int> levels;
     // the maximum indirect depth across all constraints
     int maxLevel;
 
-    // return the indirect depth of a given Expr if found
-    // init not found Expr with default indirect depth -1
-    int getLevel(const ref<Expr> &e);
-    void putLevel(const ref<Expr> &e, int level);
-    /// assert that Expr `e` occurs in a certain constaint with indirect depth `level` 
-    /// \return the maximum indirect depth encountered when recursively analysing the kids of e.
-    ///   Note that this is mostly for recursively get the max indirect depth.
-    ///
-    /// TODO: enrich this framework to analyse more statistics than just maximum.
-    int assignDepth(const ref<Expr> &e, int readLevel);
-    inline void updateMaxLevelfromKid(const ref<Expr> &e, int readLevel, int &max) {
-      if (!e.isNull()) {
-        max = std::max(max, assignDepth(e, readLevel));
-      }
+    /// Number the nodes below roots into a flat graph, then assign the
+    /// indirect depths wave by wave on jobs threads: a node is done once all
+    /// the nodes using it are, so each node and edge is visited once.
+    template <class Range> void calculate(const Range &roots, unsigned jobs);
+    int level(const void *p) const {
+      auto it = ids.find(p);
+      return it == ids.end() ? -1 : levels[it->second];
     }
 
   public:
-    // all calculation is done in the constructor
-    IndirectReadDepthCalculator(const Constraints_ty &constraints);
-    IndirectReadDepthCalculator(const expr::QueryCommand &constraints);
+    // all calculation is done in the constructor, jobs = 0 for one thread
+    // per core
+    IndirectReadDepthCalculator(const Constraints_ty &constraints,
+                                unsigned jobs = 1);
+    IndirectReadDepthCalculator(const expr::QueryCommand &constraints,
+                                unsigned jobs = 1);
     int getMax() const { return maxLevel; }
     std::set<ref<ReadExpr>>& getLastLevelReads() { return lastLevelReads; }
-    int query(const Expr *e) const;
+    int query(const Expr *e) const { return level(e); }
     int query(const ref<Expr> &e) const { return query(e.get()); }
     int query(const UpdateNode *un) const {
-      auto find_it = depthStoreUNode.find(un);
-      assert(find_it != depthStoreUNode.end());
-      return find_it->second;
+      assert(ids.count(un));
+      return level(un);
     }
     // indirect depth of each top-level constraint
     std::vector<unsigned int> depths;
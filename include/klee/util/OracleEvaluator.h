@@ -1,10 +1,12 @@
 #ifndef EXPR_ORACLEEVALUATOR_H
 #define EXPR_ORACLEEVALUATOR_H
 #include "klee/Internal/ADT/KTest.h"
+#include "klee/Expr/ArrayIdMap.h"
 #include "klee/Expr/ExprEvaluator.h"
 
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 using namespace klee;
 
@@ -12,17 +14,66 @@ namespace klee {
   extern llvm::cl::opt<std::string> OracleKTest;
 
   class OracleEvaluator : public ExprEvaluator {
-    // KTest loaded from the given file
-    KTest *ktest;
+    // KTest mapped from the given file
+    KTestMap *ktest;
 
     protected:
     ref<Expr> getInitialValue(const Array &mo, unsigned index);
-    // arrayname2idx maps symbolic objs' name in the ktest to their index in the ktest.
-    typedef std::unordered_map<std::string, unsigned int> arrayname2idx_ty;
-    arrayname2idx_ty arrayname2idx;
+    // the object of the ktest called name, null if there is none
+    const KTestObject *findObject(const std::string &name);
+
+    private:
+    // A concrete value computed by evaluate(), or the fact that there is none
+    // (an expression wider than 64 bits, a division by zero, a read of a
+    // constant array out of bounds or of an array missing from the ktest).
+    struct CachedValue {
+      // keeps the node alive so that its address is not reused
+      ref<Expr> expr;
+      uint64_t value;
+      bool known;
+    };
+    // A node of the expression being evaluated whose kids are not all known.
+    struct EvalFrame {
+      ref<Expr> e;
+      // the next kid to evaluate; for a ReadExpr 0 for the index, 1 while
+      // looking for the update that wrote it and 2 for the value written
+      unsigned next;
+      uint64_t kids[3];
+      UpdateNode *un;
+    };
+    // The cache is keyed by node and kept across evaluate() calls, so the
+    // parts a constraint shares with earlier ones are not evaluated again.
+    std::unordered_map<const Expr *, CachedValue> values;
+    // the ktest object of each symbolic array seen, null if there is none
+    ArrayIdMap<const KTestObject *> objects;
+    std::vector<EvalFrame> stack;
+
+    // once it holds this many nodes, the cache is cleared
+    static const size_t MaxCachedValues = 1u << 20;
+
+    const KTestObject *getObject(const Array *array);
+    // \return 1 if the value of e is known, 0 if it is known not to be
+    // computable and -1 if it has not been evaluated yet
+    int lookup(const ref<Expr> &e, uint64_t &value) const;
+    // Advance the evaluation of f by one kid.
+    // \return true with the result in known and value once f is evaluated,
+    // false with the kid to evaluate first in kid otherwise
+    bool step(EvalFrame &f, ref<Expr> &kid, bool &known, uint64_t &value);
+    bool evaluateConcrete(const ref<Expr> &e, uint64_t &value);
 
     public:
     OracleEvaluator(std::string KTestPath, bool silent = false);
+    ~OracleEvaluator();
+
+    OracleEvaluator(const OracleEvaluator &) = delete;
+    OracleEvaluator &operator=(const OracleEvaluator &) = delete;
+
+    // Evaluate e under the ktest, like visit() but caching the value of every
+    // node in a table keyed by node and computing values on machine words.
+    // Falls back to visit() when e has no concrete value, then the result is
+    // what visit() returns. Only the initial values of the ktest are used,
+    // not those of a getInitialValue overridden by a subclass.
+    ref<Expr> evaluate(const ref<Expr> &e);
   };
 }
 #endif
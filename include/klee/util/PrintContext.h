@@ -12,8 +12,10 @@
 
 #include "klee/Expr/Expr.h"
 
+#include "llvm/ADT/StringRef.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <cstdio>
 #include <sstream>
 #include <string>
 #include <stack>
@@ -82,9 +84,9 @@ public:
 
   /// write - Output a string to the stream and update the
   /// position. The stream should not have any newlines.
-  void write(const std::string &s) {
+  void write(llvm::StringRef s) {
     os << s;
-    pos += s.length();
+    pos += s.size();
   }
 
   template <typename T>
@@ -96,6 +98,26 @@ public:
     return *this;
   }
 
+  // The common cases are written directly, without a temporary stream.
+  PrintContext &operator<<(const char *s) {
+    write(s);
+    return *this;
+  }
+  PrintContext &operator<<(const std::string &s) {
+    write(s);
+    return *this;
+  }
+  PrintContext &operator<<(int v) {
+    char buf[16];
+    write(llvm::StringRef(buf, std::snprintf(buf, sizeof(buf), "%d", v)));
+    return *this;
+  }
+  PrintContext &operator<<(unsigned v) {
+    char buf[16];
+    write(llvm::StringRef(buf, std::snprintf(buf, sizeof(buf), "%u", v)));
+    return *this;
+  }
+
 };
 
 
@@ -0,0 +1,74 @@
+//===-- RecordingSelector.h -------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_RECORDINGSELECTOR_H
+#define KLEE_RECORDINGSELECTOR_H
+
+#include "klee/Expr/Expr.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace klee {
+struct KInstruction;
+
+/// Picks the instructions worth recording (with ptwrite) to simplify a set
+/// of constraints, the way utils/visualize/hase.py does on a drawn graph.
+///
+/// Recording an instruction concretizes every expression it produced, and
+/// every expression whose operands then are all concrete. Reads from a
+/// symbolic array never become concrete that way. A candidate scores
+/// width / 8 * (1 + indirect depth) for each expression it concretizes,
+/// and candidates are ranked by score per recorded byte, a ptwrite
+/// recording at least 8 bytes each time it executes.
+class RecordingSelector {
+public:
+  struct Candidate {
+    const KInstruction *ki;
+    /// expressions concretized, counting those of earlier selections
+    /// only once
+    unsigned nodes;
+    double score;
+    /// bytes recorded over the whole execution
+    uint64_t bytes;
+  };
+
+private:
+  std::vector<const Expr *> nodes;
+  std::unordered_map<const Expr *, unsigned> nodeIndex;
+  /// node -> nodes it is an operand of, once per operand
+  std::vector<std::vector<unsigned>> parents;
+  /// symbolic operands not concrete yet
+  std::vector<unsigned> unknownKids;
+  /// false for nodes that cannot be derived from their operands
+  std::vector<bool> derivable;
+  std::vector<bool> known;
+  std::vector<double> weight;
+  /// candidate instructions, in the order they were found, and their nodes
+  std::vector<const KInstruction *> kinsts;
+  std::unordered_map<const KInstruction *, std::vector<unsigned>> kinstNodes;
+
+  unsigned addNode(const ref<Expr> &e);
+  void addOperand(unsigned node, const ref<Expr> &kid);
+  /// The nodes recording ki would concretize, and their total weight as
+  /// score.
+  std::vector<unsigned> evaluate(const KInstruction *ki, double &score) const;
+
+public:
+  RecordingSelector(const std::vector<ref<Expr>> &exprs);
+
+  /// Pick up to n instructions one after another, each the best given the
+  /// ones picked before it. Pointers are never picked, their values
+  /// differ from run to run.
+  std::vector<Candidate> select(unsigned n);
+};
+} // namespace klee
+
+#endif /* KLEE_RECORDINGSELECTOR_H */
@@ -9,14 +9,29 @@
 
 #include "klee/Internal/ADT/KTest.h"
 
+#include <fcntl.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-#define KTEST_VERSION 3
+#define KTEST_VERSION 4
 #define KTEST_MAGIC_SIZE 5
 #define KTEST_MAGIC "KTEST"
 
+// Version 4 appends an object directory to the version 3 layout, so that
+// the sequential readers only need to accept the version number:
+//   numObjects entries of (uint32 name hash, uint32 numBytes,
+//   uint64 offset of the name, uint64 offset of the bytes), sorted by hash,
+//   then the uint64 offset of the directory and KTEST_INDEX_MAGIC.
+#define KTEST_INDEX_MAGIC_SIZE 8
+#define KTEST_INDEX_MAGIC "KTESTIDX"
+#define KTEST_DIR_ENTRY_SIZE 24
+#define KTEST_TRAILER_SIZE (8 + KTEST_INDEX_MAGIC_SIZE)
+
 // for compatibility reasons
 #define BOUT_MAGIC "BOUT\n"
 
@@ -39,6 +54,10 @@ static int write_uint32(FILE *f, unsigned value) {
   return fwrite(data, 1, 4, f)==4;
 }
 
+static int write_uint64(FILE *f, uint64_t value) {
+  return write_uint32(f, value >> 32) && write_uint32(f, value);
+}
+
 static int read_string(FILE *f, char **value_out) {
   unsigned len;
   if (!read_uint32(f, &len))
@@ -61,6 +80,29 @@ static int write_string(FILE *f, const char *value) {
   return 1;
 }
 
+/* FNV-1a */
+static unsigned hash_name(const char *name, size_t len) {
+  unsigned h = 2166136261u;
+  size_t i;
+  for (i = 0; i < len; i++)
+    h = (h ^ (unsigned char)name[i]) * 16777619u;
+  return h;
+}
+
+typedef struct KTestDirEntry KTestDirEntry;
+struct KTestDirEntry {
+  unsigned hash;
+  unsigned numBytes;
+  uint64_t nameOffset;
+  uint64_t bytesOffset;
+};
+
+static int compare_dir_entries(const void *a, const void *b) {
+  unsigned ha = ((const KTestDirEntry *)a)->hash;
+  unsigned hb = ((const KTestDirEntry *)b)->hash;
+  return ha < hb ? -1 : ha > hb;
+}
+
 /***/
 
 
@@ -93,11 +135,20 @@ int kTest_isKTestFile(const char *path) {
 
 KTest *kTest_fromFile(const char *path) {
   FILE *f = fopen(path, "rb");
+  KTest *res;
+
+  if (!f)
+    return 0;
+  res = kTest_fromStream(f);
+  fclose(f);
+
+  return res;
+}
+
+KTest *kTest_fromStream(FILE *f) {
   KTest *res = 0;
   unsigned i, version;
 
-  if (!f) 
-    goto error;
   if (!kTest_checkHeader(f)) 
     goto error;
 
@@ -146,7 +197,22 @@ KTest *kTest_fromFile(const char *path) {
       goto error;
   }
 
-  fclose(f);
+  // consume the object directory, so that the next KTest of a stream follows
+  if (version >= 4) {
+    uint64_t left = (uint64_t)res->numObjects * KTEST_DIR_ENTRY_SIZE +
+                    KTEST_TRAILER_SIZE;
+    char skip[4096];
+    while (left > KTEST_TRAILER_SIZE) {
+      size_t n = left - KTEST_TRAILER_SIZE < sizeof(skip)
+                     ? left - KTEST_TRAILER_SIZE : sizeof(skip);
+      if (fread(skip, n, 1, f)!=1)
+        goto error;
+      left -= n;
+    }
+    if (fread(skip, KTEST_TRAILER_SIZE, 1, f)!=1 ||
+        memcmp(skip + 8, KTEST_INDEX_MAGIC, KTEST_INDEX_MAGIC_SIZE))
+      goto error;
+  }
 
   return res;
  error:
@@ -170,17 +236,29 @@ KTest *kTest_fromFile(const char *path) {
     free(res);
   }
 
-  if (f) fclose(f);
-
   return 0;
 }
 
 int kTest_toFile(KTest *bo, const char *path) {
   FILE *f = fopen(path, "wb");
+  int res;
+
+  if (!f)
+    return 0;
+  res = kTest_toStream(bo, f);
+  if (fclose(f))
+    return 0;
+
+  return res;
+}
+
+int kTest_toStream(KTest *bo, FILE *f) {
+  KTestDirEntry *dir = 0;
+  // the offsets are relative to the start of this KTest, which need not be
+  // the start of f
+  uint64_t offset, dirOffset;
   unsigned i;
 
-  if (!f) 
-    goto error;
   if (fwrite(KTEST_MAGIC, strlen(KTEST_MAGIC), 1, f)!=1)
     goto error;
   if (!write_uint32(f, KTEST_VERSION))
@@ -200,22 +278,46 @@ int kTest_toFile(KTest *bo, const char *path) {
   
   if (!write_uint32(f, bo->numObjects))
     goto error;
+  dir = (KTestDirEntry*) calloc(bo->numObjects + 1, sizeof(*dir));
+  if (!dir)
+    goto error;
+  offset = KTEST_MAGIC_SIZE + 4 * 5;
+  for (i=0; i<bo->numArgs; i++)
+    offset += 4 + strlen(bo->args[i]);
   for (i=0; i<bo->numObjects; i++) {
     KTestObject *o = &bo->objects[i];
+    size_t nameLen = strlen(o->name);
+    dir[i].hash = hash_name(o->name, nameLen);
+    dir[i].numBytes = o->numBytes;
+    dir[i].nameOffset = offset;
     if (!write_string(f, o->name))
       goto error;
     if (!write_uint32(f, o->numBytes))
       goto error;
+    dir[i].bytesOffset = offset + 4 + nameLen + 4;
     if (fwrite(o->bytes, o->numBytes, 1, f)!=1)
       goto error;
+    offset = dir[i].bytesOffset + o->numBytes;
   }
 
-  fclose(f);
+  dirOffset = offset;
+  qsort(dir, bo->numObjects, sizeof(*dir), compare_dir_entries);
+  for (i=0; i<bo->numObjects; i++) {
+    if (!write_uint32(f, dir[i].hash) ||
+        !write_uint32(f, dir[i].numBytes) ||
+        !write_uint64(f, dir[i].nameOffset) ||
+        !write_uint64(f, dir[i].bytesOffset))
+      goto error;
+  }
+  if (!write_uint64(f, dirOffset))
+    goto error;
+  if (fwrite(KTEST_INDEX_MAGIC, KTEST_INDEX_MAGIC_SIZE, 1, f)!=1)
+    goto error;
 
+  free(dir);
   return 1;
  error:
-  if (f) fclose(f);
-  
+  free(dir);
   return 0;
 }
 
@@ -238,3 +340,191 @@ void kTest_free(KTest *bo) {
   free(bo->objects);
   free(bo);
 }
+
+/***/
+
+struct KTestMap {
+  const unsigned char *data;
+  size_t size;
+  unsigned numObjects;
+  /* sorted by hash */
+  KTestDirEntry *dir;
+  /* the objects found so far, by directory entry */
+  KTestObject *objects;
+};
+
+static unsigned get_uint32(const unsigned char *p) {
+  return (((((p[0]<<8) + p[1])<<8) + p[2])<<8) + p[3];
+}
+
+static uint64_t get_uint64(const unsigned char *p) {
+  return ((uint64_t)get_uint32(p) << 32) | get_uint32(p + 4);
+}
+
+/* Reads a uint32 at *offset and advances it. */
+static int map_uint32(KTestMap *m, uint64_t *offset, unsigned *value_out) {
+  if (*offset + 4 > m->size)
+    return 0;
+  *value_out = get_uint32(m->data + *offset);
+  *offset += 4;
+  return 1;
+}
+
+/* Skips a string at *offset. */
+static int map_skip_string(KTestMap *m, uint64_t *offset) {
+  unsigned len;
+  if (!map_uint32(m, offset, &len) || *offset + len > m->size)
+    return 0;
+  *offset += len;
+  return 1;
+}
+
+/* Builds the directory of a file without one, by walking its objects. */
+static int map_scan_objects(KTestMap *m, uint64_t offset) {
+  unsigned i;
+  for (i = 0; i < m->numObjects; i++) {
+    KTestDirEntry *e = &m->dir[i];
+    unsigned len;
+    e->nameOffset = offset;
+    if (!map_uint32(m, &offset, &len) || offset + len > m->size)
+      return 0;
+    e->hash = hash_name((const char *)m->data + offset, len);
+    offset += len;
+    if (!map_uint32(m, &offset, &e->numBytes))
+      return 0;
+    e->bytesOffset = offset;
+    if (offset + e->numBytes > m->size)
+      return 0;
+    offset += e->numBytes;
+  }
+  qsort(m->dir, m->numObjects, sizeof(*m->dir), compare_dir_entries);
+  return 1;
+}
+
+/* Reads the directory at the end of a version 4 file. */
+static int map_read_directory(KTestMap *m) {
+  uint64_t dirOffset;
+  unsigned i;
+  if (m->size < KTEST_TRAILER_SIZE ||
+      memcmp(m->data + m->size - KTEST_INDEX_MAGIC_SIZE, KTEST_INDEX_MAGIC,
+             KTEST_INDEX_MAGIC_SIZE))
+    return 0;
+  dirOffset = get_uint64(m->data + m->size - KTEST_TRAILER_SIZE);
+  if (dirOffset > m->size - KTEST_TRAILER_SIZE ||
+      (m->size - KTEST_TRAILER_SIZE - dirOffset) / KTEST_DIR_ENTRY_SIZE !=
+          m->numObjects)
+    return 0;
+  for (i = 0; i < m->numObjects; i++) {
+    const unsigned char *p = m->data + dirOffset + i * KTEST_DIR_ENTRY_SIZE;
+    KTestDirEntry *e = &m->dir[i];
+    e->hash = get_uint32(p);
+    e->numBytes = get_uint32(p + 4);
+    e->nameOffset = get_uint64(p + 8);
+    e->bytesOffset = get_uint64(p + 16);
+    if (e->nameOffset >= dirOffset || e->bytesOffset > dirOffset ||
+        e->numBytes > dirOffset - e->bytesOffset)
+      return 0;
+  }
+  return 1;
+}
+
+KTestMap *kTest_map(const char *path) {
+  KTestMap *m = 0;
+  struct stat st;
+  uint64_t offset = KTEST_MAGIC_SIZE;
+  unsigned i, version, numArgs;
+  void *data;
+  int fd = open(path, O_RDONLY);
+
+  if (fd < 0)
+    return 0;
+  if (fstat(fd, &st) < 0 || st.st_size < KTEST_MAGIC_SIZE) {
+    close(fd);
+    return 0;
+  }
+  data = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return 0;
+
+  m = (KTestMap*) calloc(1, sizeof(*m));
+  if (!m)
+    goto error;
+  m->data = (const unsigned char *)data;
+  m->size = st.st_size;
+  if (memcmp(m->data, KTEST_MAGIC, KTEST_MAGIC_SIZE) &&
+      memcmp(m->data, BOUT_MAGIC, KTEST_MAGIC_SIZE))
+    goto error;
+  if (!map_uint32(m, &offset, &version) || version > kTest_getCurrentVersion())
+    goto error;
+  if (!map_uint32(m, &offset, &numArgs))
+    goto error;
+  for (i = 0; i < numArgs; i++)
+    if (!map_skip_string(m, &offset))
+      goto error;
+  if (version >= 2)
+    offset += 8;
+  if (!map_uint32(m, &offset, &m->numObjects))
+    goto error;
+
+  m->dir = (KTestDirEntry*) calloc(m->numObjects + 1, sizeof(*m->dir));
+  m->objects = (KTestObject*) calloc(m->numObjects + 1, sizeof(*m->objects));
+  if (!m->dir || !m->objects)
+    goto error;
+  if (version >= 4 ? !map_read_directory(m) : !map_scan_objects(m, offset))
+    goto error;
+  return m;
+
+ error:
+  if (m) {
+    free(m->dir);
+    free(m->objects);
+    free(m);
+  }
+  munmap(data, st.st_size);
+  return 0;
+}
+
+const KTestObject *kTest_mapFind(KTestMap *m, const char *name) {
+  size_t len = strlen(name);
+  unsigned hash = hash_name(name, len);
+  unsigned lo = 0, hi = m->numObjects;
+
+  while (lo < hi) {
+    unsigned mid = lo + (hi - lo) / 2;
+    if (m->dir[mid].hash < hash)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  for (; lo < m->numObjects && m->dir[lo].hash == hash; lo++) {
+    KTestDirEntry *e = &m->dir[lo];
+    KTestObject *o = &m->objects[lo];
+    uint64_t offset = e->nameOffset;
+    unsigned nameLen;
+    if (!map_uint32(m, &offset, &nameLen) || nameLen != len ||
+        offset + len > m->size ||
+        memcmp(m->data + offset, name, len))
+      continue;
+    if (!o->name) {
+      o->name = (char*) malloc(len + 1);
+      if (!o->name)
+        return 0;
+      memcpy(o->name, name, len + 1);
+      o->numBytes = e->numBytes;
+      o->bytes = (unsigned char *)m->data + e->bytesOffset;
+    }
+    return o;
+  }
+  return 0;
+}
+
+void kTest_unmap(KTestMap *m) {
+  unsigned i;
+  for (i = 0; i < m->numObjects; i++)
+    free(m->objects[i].name);
+  free(m->objects);
+  free(m->dir);
+  munmap((void *)m->data, m->size);
+  free(m);
+}
@@ -20,12 +20,69 @@ StatisticManager::StatisticManager()
     globalStats(0),
     indexedStats(0),
     contextStats(0),
-    index(0) {
+    index(0),
+    shards(nullptr) {
 }
 
 StatisticManager::~StatisticManager() {
   delete[] globalStats;
   delete[] indexedStats;
+  for (StatisticShard *s = shards.load(), *next; s; s = next) {
+    next = s->next;
+    delete s;
+  }
+}
+
+/* *** */
+
+// 8 counters fill a cache line on the usual 64 byte lines
+static const unsigned shardPadding = 8;
+
+StatisticShard::StatisticShard(unsigned numStatistics)
+    : storage(new std::atomic<uint64_t>[numStatistics + 2 * shardPadding]),
+      data(storage.get() + shardPadding), next(nullptr), inUse(true) {
+  for (unsigned i = 0; i < numStatistics; ++i)
+    data[i].store(0, std::memory_order_relaxed);
+}
+
+thread_local StatisticShard *StatisticManager::threadShard = nullptr;
+
+uint64_t StatisticManager::getShardTotal(unsigned id) const {
+  uint64_t total = 0;
+  for (StatisticShard *s = shards.load(std::memory_order_acquire); s;
+       s = s->next)
+    total += s->getValue(id);
+  return total;
+}
+
+StatisticManager::ThreadScope::ThreadScope() : attached(!threadShard) {
+  if (!attached)
+    return;
+  StatisticManager &sm = *theStatisticManager;
+  StatisticShard *head = sm.shards.load(std::memory_order_acquire);
+  for (StatisticShard *s = head; s; s = s->next) {
+    bool free = false;
+    if (!s->inUse.load(std::memory_order_relaxed) &&
+        s->inUse.compare_exchange_strong(free, true,
+                                         std::memory_order_acquire)) {
+      threadShard = s;
+      return;
+    }
+  }
+  StatisticShard *shard = new StatisticShard(sm.stats.size());
+  shard->next = head;
+  while (!sm.shards.compare_exchange_weak(shard->next, shard,
+                                          std::memory_order_release,
+                                          std::memory_order_acquire))
+    ;
+  threadShard = shard;
+}
+
+StatisticManager::ThreadScope::~ThreadScope() {
+  if (!attached)
+    return;
+  threadShard->inUse.store(false, std::memory_order_release);
+  threadShard = nullptr;
 }
 
 void StatisticManager::useIndexedStats(unsigned totalIndices) {  
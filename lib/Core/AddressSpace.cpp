@@ -15,6 +15,9 @@
 #include "klee/Internal/Support/ErrorHandling.h"
 #include "klee/TimerStatIncrementer.h"
 
+#include <algorithm>
+#include <set>
+
 using namespace klee;
 
 ///
@@ -23,17 +26,53 @@ void AddressSpace::bindObject(const MemoryObject *mo, ObjectState *os) {
   assert(os->copyOnWriteOwner==0 && "object already has owner");
   os->copyOnWriteOwner = cowKey;
   objects = objects.replace(std::make_pair(mo, os));
+  if (!sharedObjects.empty())
+    sharedObjects = sharedObjects.remove(mo);
+  updateResolveCache(mo, os);
 }
 
 void AddressSpace::unbindObject(const MemoryObject *mo) {
   objects = objects.remove(mo);
+  if (!sharedObjects.empty())
+    sharedObjects = sharedObjects.remove(mo);
+  updateResolveCache(mo, nullptr);
+}
+
+void AddressSpace::rebindObject(const MemoryObject *mo,
+                                const ObjectState *os) {
+  ref<ObjectState> binding(const_cast<ObjectState *>(os));
+  objects = objects.replace(std::make_pair(mo, binding));
+  if (!sharedObjects.empty())
+    sharedObjects = sharedObjects.remove(mo);
+  updateResolveCache(mo, os);
+}
+
+void AddressSpace::swap(AddressSpace &b) {
+  std::swap(cowKey, b.cowKey);
+  std::swap(objects, b.objects);
+  std::swap(sharedObjects, b.sharedObjects);
+  std::swap_ranges(resolveCache, resolveCache + ResolveCacheSize,
+                   b.resolveCache);
 }
 
 const ObjectState *AddressSpace::findObject(const MemoryObject *mo) const {
-  const auto res = objects.lookup(mo);
+  if (const auto res = objects.lookup(mo))
+    return res->second.get();
+  const auto res = sharedObjects.lookup(mo);
   return res ? res->second.get() : nullptr;
 }
 
+void AddressSpace::shareObject(const MemoryObject *mo) {
+  const auto res = objects.lookup(mo);
+  assert(res && "sharing an unbound object");
+  ref<ObjectState> os = res->second;
+  assert(os->readOnly && "sharing a writeable object");
+  objects = objects.remove(mo);
+  // no address space owns it, so that writes copy it back
+  os->copyOnWriteOwner = 0;
+  sharedObjects = sharedObjects.replace(std::make_pair(mo, os));
+}
+
 ObjectState *AddressSpace::getWriteable(const MemoryObject *mo,
                                         const ObjectState *os, bool force) {
   if (!force && os->readOnly) {
@@ -50,24 +89,71 @@ ObjectState *AddressSpace::getWriteable(const MemoryObject *mo,
   ref<ObjectState> newObjectState(new ObjectState(*os));
   newObjectState->copyOnWriteOwner = cowKey;
   objects = objects.replace(std::make_pair(mo, newObjectState));
+  if (!os->copyOnWriteOwner)
+    sharedObjects = sharedObjects.remove(mo);
+  updateResolveCache(mo, newObjectState.get());
   return newObjectState.get();
 }
 
 /// 
 
+bool AddressSpace::lookupResolveCache(uint64_t address,
+                                      ObjectPair &result) const {
+  for (unsigned i = 0; i != ResolveCacheSize; ++i) {
+    const MemoryObject *mo = resolveCache[i].first;
+    if (!mo)
+      break;
+    if (address - mo->address < mo->size) {
+      result = resolveCache[i];
+      std::copy_backward(resolveCache, resolveCache + i, resolveCache + i + 1);
+      resolveCache[0] = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+void AddressSpace::updateResolveCache(const MemoryObject *mo,
+                                      const ObjectState *os) {
+  ObjectPair *end = resolveCache + ResolveCacheSize;
+  ObjectPair *entry =
+      std::find_if(resolveCache, end,
+                   [mo](const ObjectPair &op) { return op.first == mo; });
+  if (entry == end)
+    return;
+  if (os) {
+    entry->second = os;
+  } else {
+    std::copy(entry + 1, end, entry);
+    end[-1] = ObjectPair(nullptr, nullptr);
+  }
+}
+
 bool AddressSpace::resolveOne(const ref<ConstantExpr> &addr, 
                               ObjectPair &result) const {
-  uint64_t address = addr->getZExtValue();
+  return resolveAddress(addr->getZExtValue(), result);
+}
+
+bool AddressSpace::resolveAddress(uint64_t address, ObjectPair &result) const {
+  if (lookupResolveCache(address, result))
+    return true;
+
   MemoryObject hack(address);
 
-  if (const auto res = objects.lookup_previous(&hack)) {
-    const auto &mo = res->first;
-    // Check if the provided address is between start and end of the object
-    // [mo->address, mo->address + mo->size) or the object is a 0-sized object.
-    if (address - mo->address < mo->size) {
-      result.first = res->first;
-      result.second = res->second.get();
-      return true;
+  for (const MemoryMap *map : {&objects, &sharedObjects}) {
+    if (const auto res = map->lookup_previous(&hack)) {
+      const auto &mo = res->first;
+      // Check if the provided address is between start and end of the object
+      // [mo->address, mo->address + mo->size) or the object is a 0-sized
+      // object.
+      if (address - mo->address < mo->size) {
+        result.first = res->first;
+        result.second = res->second.get();
+        std::copy_backward(resolveCache, resolveCache + ResolveCacheSize - 1,
+                           resolveCache + ResolveCacheSize);
+        resolveCache[0] = result;
+        return true;
+      }
     }
   }
 
@@ -93,81 +179,87 @@ bool AddressSpace::resolveOne(ExecutionState &state,
     timerCheapGetValue.check();
     TimerStatIncrementer timerCheapLookup(stats::resolveTimeCheapLookup);
     uint64_t example = cex->getZExtValue();
-    MemoryObject hack(example);
-    const auto res = objects.lookup_previous(&hack);
-
-    if (res) {
-      const MemoryObject *mo = res->first;
-      if (example - mo->address < mo->size) {
-        result.first = res->first;
-        result.second = res->second.get();
-        success = true;
-        return true;
-      }
+    if (resolveOne(cex, result)) {
+      success = true;
+      return true;
     }
     timerCheapLookup.check();
 
     // didn't work, now we have to search
     TimerStatIncrementer timerSearch(stats::resolveTimeSearch);
-    MemoryMap::iterator oi = objects.upper_bound(&hack);
-    MemoryMap::iterator begin = objects.begin();
-    MemoryMap::iterator end = objects.end();
-      
-    MemoryMap::iterator start = oi;
-    while (oi!=begin) {
-      --oi;
-      const auto &mo = oi->first;
+    if (!resolveOneIn(objects, state, solver, address, example, result,
+                      success))
+      return false;
+    if (!success && !resolveOneIn(sharedObjects, state, solver, address,
+                                  example, result, success))
+      return false;
+    return true;
+  }
+}
 
+bool AddressSpace::resolveOneIn(const MemoryMap &map, ExecutionState &state,
+                                TimingSolver *solver, ref<Expr> address,
+                                uint64_t example, ObjectPair &result,
+                                bool &success) const {
+  MemoryObject hack(example);
+  MemoryMap::iterator oi = map.upper_bound(&hack);
+  MemoryMap::iterator begin = map.begin();
+  MemoryMap::iterator end = map.end();
+
+  MemoryMap::iterator start = oi;
+  while (oi!=begin) {
+    --oi;
+    const auto &mo = oi->first;
+
+    bool mayBeTrue;
+    if (!solver->mayBeTrue(state, 
+                           mo->getBoundsCheckPointer(address), mayBeTrue))
+      return false;
+    if (mayBeTrue) {
+      result.first = oi->first;
+      result.second = oi->second.get();
+      success = true;
+      return true;
+    } else {
+      bool mustBeTrue;
+      if (!solver->mustBeTrue(state, 
+                              UgeExpr::create(address, mo->getBaseExpr()),
+                              mustBeTrue))
+        return false;
+      if (mustBeTrue)
+        break;
+    }
+  }
+
+  // search forwards
+  for (oi=start; oi!=end; ++oi) {
+    const auto &mo = oi->first;
+
+    bool mustBeTrue;
+    if (!solver->mustBeTrue(state, 
+                            UltExpr::create(address, mo->getBaseExpr()),
+                            mustBeTrue))
+      return false;
+    if (mustBeTrue) {
+      break;
+    } else {
       bool mayBeTrue;
+
       if (!solver->mayBeTrue(state, 
-                             mo->getBoundsCheckPointer(address), mayBeTrue))
+                             mo->getBoundsCheckPointer(address),
+                             mayBeTrue))
         return false;
       if (mayBeTrue) {
         result.first = oi->first;
         result.second = oi->second.get();
         success = true;
         return true;
-      } else {
-        bool mustBeTrue;
-        if (!solver->mustBeTrue(state, 
-                                UgeExpr::create(address, mo->getBaseExpr()),
-                                mustBeTrue))
-          return false;
-        if (mustBeTrue)
-          break;
-      }
-    }
-
-    // search forwards
-    for (oi=start; oi!=end; ++oi) {
-      const auto &mo = oi->first;
-
-      bool mustBeTrue;
-      if (!solver->mustBeTrue(state, 
-                              UltExpr::create(address, mo->getBaseExpr()),
-                              mustBeTrue))
-        return false;
-      if (mustBeTrue) {
-        break;
-      } else {
-        bool mayBeTrue;
-
-        if (!solver->mayBeTrue(state, 
-                               mo->getBoundsCheckPointer(address),
-                               mayBeTrue))
-          return false;
-        if (mayBeTrue) {
-          result.first = oi->first;
-          result.second = oi->second.get();
-          success = true;
-          return true;
-        }
       }
     }
-
-    success = false;
-    return true;
   }
+
+  success = false;
+  return true;
 }
 
 int AddressSpace::checkPointerInObject(ExecutionState &state,
@@ -234,59 +326,74 @@ bool AddressSpace::resolve(ExecutionState &state, TimingSolver *solver,
     if (!solver->getValue(state, p, cex))
       return true;
     uint64_t example = cex->getZExtValue();
-    MemoryObject hack(example);
-
-    MemoryMap::iterator oi = objects.upper_bound(&hack);
-    MemoryMap::iterator begin = objects.begin();
-    MemoryMap::iterator end = objects.end();
-
-    MemoryMap::iterator start = oi;
-    // search backwards, start with one minus because this
-    // is the object that p *should* be within, which means we
-    // get write off the end with 4 queries
-    while (oi != begin) {
-      --oi;
-      const MemoryObject *mo = oi->first;
-      if (timeout && timeout < timer.delta())
-        return true;
-
-      auto op = std::make_pair<>(mo, oi->second.get());
-
-      int incomplete =
-          checkPointerInObject(state, solver, p, op, rl, maxResolutions);
+    for (const MemoryMap *map : {&objects, &sharedObjects}) {
+      int incomplete = resolveIn(*map, state, solver, p, example, rl,
+                                 maxResolutions, timeout, timer);
       if (incomplete != 2)
         return incomplete ? true : false;
-
-      bool mustBeTrue;
-      if (!solver->mustBeTrue(state, UgeExpr::create(p, mo->getBaseExpr()),
-                              mustBeTrue))
-        return true;
-      if (mustBeTrue)
-        break;
     }
+  }
 
-    // search forwards
-    for (oi = start; oi != end; ++oi) {
-      const MemoryObject *mo = oi->first;
-      if (timeout && timeout < timer.delta())
-        return true;
+  return false;
+}
 
-      bool mustBeTrue;
-      if (!solver->mustBeTrue(state, UltExpr::create(p, mo->getBaseExpr()),
-                              mustBeTrue))
-        return true;
-      if (mustBeTrue)
-        break;
-      auto op = std::make_pair<>(mo, oi->second.get());
+int AddressSpace::resolveIn(const MemoryMap &map, ExecutionState &state,
+                            TimingSolver *solver, ref<Expr> p,
+                            uint64_t example, ResolutionList &rl,
+                            unsigned maxResolutions, time::Span timeout,
+                            const TimerStatIncrementer &timer) const {
+  MemoryObject hack(example);
+
+  MemoryMap::iterator oi = map.upper_bound(&hack);
+  MemoryMap::iterator begin = map.begin();
+  MemoryMap::iterator end = map.end();
+
+  MemoryMap::iterator start = oi;
+  // search backwards, start with one minus because this
+  // is the object that p *should* be within, which means we
+  // get write off the end with 4 queries
+  while (oi != begin) {
+    --oi;
+    const MemoryObject *mo = oi->first;
+    if (timeout && timeout < timer.delta())
+      return 1;
+
+    auto op = std::make_pair<>(mo, oi->second.get());
+
+    int incomplete =
+        checkPointerInObject(state, solver, p, op, rl, maxResolutions);
+    if (incomplete != 2)
+      return incomplete;
+
+    bool mustBeTrue;
+    if (!solver->mustBeTrue(state, UgeExpr::create(p, mo->getBaseExpr()),
+                            mustBeTrue))
+      return 1;
+    if (mustBeTrue)
+      break;
+  }
 
-      int incomplete =
-          checkPointerInObject(state, solver, p, op, rl, maxResolutions);
-      if (incomplete != 2)
-        return incomplete ? true : false;
-    }
+  // search forwards
+  for (oi = start; oi != end; ++oi) {
+    const MemoryObject *mo = oi->first;
+    if (timeout && timeout < timer.delta())
+      return 1;
+
+    bool mustBeTrue;
+    if (!solver->mustBeTrue(state, UltExpr::create(p, mo->getBaseExpr()),
+                            mustBeTrue))
+      return 1;
+    if (mustBeTrue)
+      break;
+    auto op = std::make_pair<>(mo, oi->second.get());
+
+    int incomplete =
+        checkPointerInObject(state, solver, p, op, rl, maxResolutions);
+    if (incomplete != 2)
+      return incomplete;
   }
 
-  return false;
+  return 2;
 }
 
 // These two are pretty big hack so we can sort of pass memory back
@@ -305,7 +412,7 @@ void AddressSpace::copyOutConcretes() {
       auto address = reinterpret_cast<std::uint8_t*>(mo->address);
 
       if (!os->readOnly)
-        memcpy(address, os->concreteStore, mo->size);
+        os->concreteStore.copyTo(address);
     }
   }
 }
@@ -325,15 +432,69 @@ bool AddressSpace::copyInConcretes() {
   return true;
 }
 
+void AddressSpace::getReachableObjects(const std::vector<uint64_t> &roots,
+                                       std::vector<ObjectPair> &result) const {
+  result.clear();
+  // Words outside of [low, high) cannot point into any object.
+  uint64_t low = UINT64_MAX, high = 0;
+  for (const MemoryMap *map : {&objects, &sharedObjects}) {
+    if (map->empty())
+      continue;
+    low = std::min(low, map->min().first->address);
+    const MemoryObject *last = map->max().first;
+    high = std::max(high, last->address + last->size);
+  }
+  if (low >= high)
+    return;
+  std::set<const MemoryObject *> visited;
+  std::vector<uint64_t> worklist(roots);
+
+  while (!worklist.empty()) {
+    uint64_t address = worklist.back();
+    worklist.pop_back();
+    ObjectPair op;
+    if (address < low || address >= high || !resolveAddress(address, op) ||
+        op.first->isUserSpecified || !visited.insert(op.first).second)
+      continue;
+    result.push_back(op);
+
+    // Follow the pointer-aligned words of the concrete contents; stale
+    // concrete bytes under symbolic ones only add objects to sync.
+    const ObjectState *os = op.second;
+    for (unsigned i = 0; i + sizeof(uint64_t) <= os->size;
+         i += sizeof(uint64_t)) {
+      uint64_t word = 0;
+      for (unsigned b = 0; b != sizeof(uint64_t); ++b)
+        word |= uint64_t(os->concreteStore[i + b]) << (8 * b);
+      if (word >= low && word < high)
+        worklist.push_back(word);
+    }
+  }
+}
+
+void AddressSpace::copyOutConcretes(const std::vector<ObjectPair> &pairs) {
+  for (const ObjectPair &op : pairs)
+    if (!op.second->readOnly)
+      op.second->concreteStore.copyTo(
+          reinterpret_cast<std::uint8_t *>(op.first->address));
+}
+
+bool AddressSpace::copyInConcretes(const std::vector<ObjectPair> &pairs) {
+  for (const ObjectPair &op : pairs)
+    if (!copyInConcrete(op.first, op.second, op.first->address))
+      return false;
+  return true;
+}
+
 bool AddressSpace::copyInConcrete(const MemoryObject *mo, const ObjectState *os,
                                   uint64_t src_address) {
   auto address = reinterpret_cast<std::uint8_t*>(src_address);
-  if (memcmp(address, os->concreteStore, mo->size) != 0) {
+  if (!os->concreteStore.equals(address)) {
     if (os->readOnly) {
       return false;
     } else {
       ObjectState *wos = getWriteable(mo, os);
-      memcpy(wos->concreteStore, address, mo->size);
+      wos->concreteStore.copyFrom(address);
     }
   }
   return true;
@@ -14,6 +14,7 @@
 #include "klee/Expr/Expr.h"
 #include "klee/Internal/ADT/ImmutableMap.h"
 #include "klee/Internal/System/Time.h"
+#include "klee/TimerStatIncrementer.h"
 
 namespace klee {
   class ExecutionState;
@@ -41,9 +42,26 @@ namespace klee {
     /// Epoch counter used to control ownership of objects.
     mutable unsigned cowKey;
 
+    /// Number of entries in resolveCache.
+    static const unsigned ResolveCacheSize = 4;
+
+    /// The objects concrete addresses were last resolved to, most recent
+    /// first. Consecutive accesses mostly hit the same few objects, so this
+    /// is checked before searching objects. Empty entries have a null
+    /// MemoryObject.
+    mutable ObjectPair resolveCache[ResolveCacheSize];
+
     /// Unsupported, use copy constructor
     AddressSpace &operator=(const AddressSpace &);
 
+    /// Look address up in resolveCache, moving the entry found to the
+    /// front.
+    bool lookupResolveCache(uint64_t address, ObjectPair &result) const;
+
+    /// Make resolveCache agree with mo now being bound to os (or unbound
+    /// when os is null).
+    void updateResolveCache(const MemoryObject *mo, const ObjectState *os);
+
     /// Check if pointer `p` can point to the memory object in the
     /// given object pair.  If so, add it to the given resolution list.
     ///
@@ -55,6 +73,20 @@ namespace klee {
                              ref<Expr> p, const ObjectPair &op,
                              ResolutionList &rl, unsigned maxResolutions) const;
 
+    /// The search of resolveOne, among the objects of map.
+    /// \return false iff a query failed.
+    bool resolveOneIn(const MemoryMap &map, ExecutionState &state,
+                      TimingSolver *solver, ref<Expr> address,
+                      uint64_t example, ObjectPair &result,
+                      bool &success) const;
+
+    /// The search of resolve, among the objects of map.
+    /// \return as checkPointerInObject, 2 once map is searched.
+    int resolveIn(const MemoryMap &map, ExecutionState &state,
+                  TimingSolver *solver, ref<Expr> p, uint64_t example,
+                  ResolutionList &rl, unsigned maxResolutions,
+                  time::Span timeout, const TimerStatIncrementer &timer) const;
+
   public:
     /// The MemoryObject -> ObjectState map that constitutes the
     /// address space.
@@ -65,8 +97,24 @@ namespace klee {
     /// \invariant forall o in objects, o->copyOnWriteOwner <= cowKey
     MemoryMap objects;
 
+    /// The read-only objects that no state writes to, such as constant
+    /// globals, as bound when they were shared. They are not owned by any
+    /// address space (their copyOnWriteOwner is 0), so all the states
+    /// forked from the one that shared them refer to the same
+    /// ObjectStates, and updates of \ref objects do not copy their tree
+    /// nodes. They are not synchronized with external calls either, as
+    /// they were copied out when they were shared.
+    ///
+    /// \invariant objects and sharedObjects bind disjoint MemoryObjects
+    MemoryMap sharedObjects;
+
     AddressSpace() : cowKey(1) {}
-    AddressSpace(const AddressSpace &b) : cowKey(++b.cowKey), objects(b.objects) { }
+    AddressSpace(const AddressSpace &b)
+        : cowKey(++b.cowKey), objects(b.objects),
+          sharedObjects(b.sharedObjects) {
+      std::copy(b.resolveCache, b.resolveCache + ResolveCacheSize,
+                resolveCache);
+    }
     ~AddressSpace() {}
 
     /// Resolve address to an ObjectPair in result.
@@ -74,6 +122,9 @@ namespace klee {
     bool resolveOne(const ref<ConstantExpr> &address, 
                     ObjectPair &result) const;
 
+    /// As resolveOne, for a raw address.
+    bool resolveAddress(uint64_t address, ObjectPair &result) const;
+
     /// Resolve address to an ObjectPair in result.
     ///
     /// \param state The state this address space is part of.
@@ -110,9 +161,23 @@ namespace klee {
     /// Remove a binding from the address space.
     void unbindObject(const MemoryObject *mo);
 
+    /// Bind mo to os, the binding of another address space, so that both
+    /// refer to the same ObjectState. Used for the memory the processes of
+    /// a state share, the object is copied on write unless this address
+    /// space owns it.
+    void rebindObject(const MemoryObject *mo, const ObjectState *os);
+
+    /// Exchange the contents of the two address spaces, used to switch
+    /// between the address spaces of processes.
+    void swap(AddressSpace &b);
+
     /// Lookup a binding from a MemoryObject.
     const ObjectState *findObject(const MemoryObject *mo) const;
 
+    /// Move the binding of the read-only object mo to \ref sharedObjects,
+    /// once its concrete contents are in the actual system memory.
+    void shareObject(const MemoryObject *mo);
+
     /// \brief Obtain an ObjectState suitable for writing.
     ///
     /// This returns a writeable object state, creating a new copy of
@@ -124,7 +189,8 @@ namespace klee {
     /// \param os The current binding of the MemoryObject.
     /// \param force Ignore readonly properties (only for internal use, like
     ///     symbolic value concretization from recorded trace
-    /// \return A writeable ObjectState (\a os or a copy).
+    /// \return A writeable ObjectState (\a os or a copy). A shared object
+    ///     is copied back to \ref objects.
     ObjectState *getWriteable(const MemoryObject *mo, const ObjectState *os,
                               bool force = false);
 
@@ -142,6 +208,19 @@ namespace klee {
     /// \retval false The copy failed because a read-only object was modified.
     bool copyInConcretes();
 
+    /// Collect in result the objects that the external code could reach
+    /// from the given addresses: the objects containing them, and in turn
+    /// the objects that the pointer-aligned words of their concrete
+    /// contents point into. Objects specified by the user are left out.
+    void getReachableObjects(const std::vector<uint64_t> &roots,
+                             std::vector<ObjectPair> &result) const;
+
+    /// As copyOutConcretes, for the given objects only.
+    void copyOutConcretes(const std::vector<ObjectPair> &pairs);
+
+    /// As copyInConcretes, for the given objects only.
+    bool copyInConcretes(const std::vector<ObjectPair> &pairs);
+
     /// Updates the memory object with the raw memory from the address
     ///
     /// @param mo The MemoryObject to update
@@ -24,7 +24,8 @@ using namespace klee;
 CallPathNode::CallPathNode(CallPathNode *_parent,
                            const llvm::Instruction *_callSite,
                            const llvm::Function *_function)
-    : parent(_parent), callSite(_callSite), function(_function), count(0) {}
+    : parent(_parent), callSite(_callSite), function(_function), count(0),
+      depth(_parent ? _parent->depth + 1 : 0), index(0) {}
 
 void CallPathNode::print() {
   llvm::errs() << "  (Function: " << this->function->getName() << ", "
@@ -39,22 +40,28 @@ void CallPathNode::print() {
 
 ///
 
-CallPathManager::CallPathManager() : root(nullptr, nullptr, nullptr) {}
+CallPathManager::CallPathManager(unsigned _maxDepth)
+    : root(nullptr, nullptr, nullptr), maxDepth(_maxDepth) {}
 
 void CallPathManager::getSummaryStatistics(CallSiteSummaryTable &results) {
   results.clear();
 
+  // the summaries are only needed here, the nodes do not keep them
+  std::vector<StatisticRecord> summaries;
+  summaries.reserve(paths.size());
   for (auto &path : paths)
-    path->summaryStatistics = path->statistics;
+    summaries.push_back(path->statistics);
 
   // compute summary bottom up, while building result table
   for (auto it = paths.rbegin(), ie = paths.rend(); it != ie; ++it) {
     const auto &cp = (*it);
-    cp->parent->summaryStatistics += cp->summaryStatistics;
+    const StatisticRecord &summary = summaries[cp->index];
+    if (cp->parent != &root)
+      summaries[cp->parent->index] += summary;
 
     CallSiteInfo &csi = results[cp->callSite][cp->function];
     csi.count += cp->count;
-    csi.statistics += cp->summaryStatistics;
+    csi.statistics += summary;
   }
 }
 
@@ -65,8 +72,18 @@ CallPathNode *CallPathManager::computeCallPath(CallPathNode *parent,
     if (cs==p->callSite && f==p->function)
       return p;
 
+  // too deep: collapse into the closest call of f, from any call site, or
+  // else stay in the caller
+  if (maxDepth && parent->depth >= maxDepth) {
+    for (CallPathNode *p = parent; p != &root; p = p->parent)
+      if (f == p->function)
+        return p;
+    return parent;
+  }
+
   auto cp = std::unique_ptr<CallPathNode>(new CallPathNode(parent, cs, f));
   auto newCP = cp.get();
+  newCP->index = paths.size();
   paths.emplace_back(std::move(cp));
   return newCP;
 }
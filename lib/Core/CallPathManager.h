@@ -12,8 +12,10 @@
 
 #include "klee/Statistics.h"
 
+#include <functional>
 #include <map>
 #include <memory>
+#include <unordered_map>
 #include <vector>
 
 namespace llvm {
@@ -40,10 +42,15 @@ namespace klee {
     friend class CallPathManager;
 
   public:
-    typedef std::map<
-        std::pair<const llvm::Instruction *, const llvm::Function *>,
-        CallPathNode *>
-        children_ty;
+    typedef std::pair<const llvm::Instruction *, const llvm::Function *>
+        key_ty;
+    struct KeyHash {
+      size_t operator()(const key_ty &key) const {
+        return std::hash<const void *>()(key.first) * 31 +
+               std::hash<const void *>()(key.second);
+      }
+    };
+    typedef std::unordered_map<key_ty, CallPathNode *, KeyHash> children_ty;
 
     // form list of (callSite,function) path
     CallPathNode *parent;
@@ -52,8 +59,13 @@ namespace klee {
     children_ty children;
 
     StatisticRecord statistics;
-    StatisticRecord summaryStatistics;
     unsigned count;
+    /// Number of calls from the root, 0 for the root
+    unsigned depth;
+
+  private:
+    /// Position in CallPathManager::paths
+    unsigned index;
 
   public:
     CallPathNode(CallPathNode *parent, const llvm::Instruction *callSite,
@@ -64,7 +76,11 @@ namespace klee {
 
   class CallPathManager {
     CallPathNode root;
+    /// The nodes, each after its parent
     std::vector<std::unique_ptr<CallPathNode>> paths;
+    /// Depth past which calls are attributed to an existing path, 0 for
+    /// no limit
+    unsigned maxDepth;
 
   private:
     CallPathNode *computeCallPath(CallPathNode *parent,
@@ -72,7 +88,7 @@ namespace klee {
                                   const llvm::Function *f);
 
   public:
-    CallPathManager();
+    explicit CallPathManager(unsigned maxDepth = 0);
     ~CallPathManager() = default;
 
     void getSummaryStatistics(CallSiteSummaryTable &result);
@@ -17,6 +17,7 @@ Statistic stats::falseBranches("FalseBranches", "Bf");
 Statistic stats::forks("Forks", "Forks");
 Statistic stats::instructionRealTime("InstructionRealTimes", "Ireal");
 Statistic stats::instructionTime("InstructionTimes", "Itime");
+Statistic stats::instructionCycles("InstructionCycles", "Icyc");
 Statistic stats::instructions("Instructions", "I");
 Statistic stats::minDistToReturn("MinDistToReturn", "Rdist");
 Statistic stats::minDistToUncovered("MinDistToUncovered", "UCdist");
@@ -26,6 +27,11 @@ Statistic stats::resolveTimeCheapGetValue("ResolveTime-Cheap-GetValue", "RtimeC"
 Statistic stats::resolveTimeCheapLookup("ResolveTime-Cheap-Lookup", "RtimeC");
 Statistic stats::resolveTimeSearch("ResolveTime-Search", "RtimeS");
 Statistic stats::solverTime("SolverTime", "Stime");
+Statistic stats::solverTimeoutRetries("SolverTimeoutRetries", "STretries");
+Statistic stats::solverTimeoutsRecovered("SolverTimeoutsRecovered", "STrecovered");
+Statistic stats::predictedSolverTimeouts("PredictedSolverTimeouts",
+                                         "STpredicted");
+Statistic stats::solverMemoHits("SolverMemoHits", "SMemoHits");
 Statistic stats::states("States", "States");
 Statistic stats::trueBranches("TrueBranches", "Bt");
 Statistic stats::uncoveredInstructions("UncoveredInstructions", "Iuncov");
@@ -52,6 +58,9 @@ Statistic stats::concreteIndirectBr("ConcreteIndirectBr", "CIBr");
 Statistic stats::concreteSwitch("ConcreteSwitch", "CSwitch");
 Statistic stats::concreteSelect("ConcreteSelect", "CSelect");
 Statistic stats::concreteCall("ConcreteCall", "CCall");
+Statistic stats::concreteMemoryOperations("ConcreteMemoryOperations", "CMemOps");
+Statistic stats::inBoundsMemoryOperations("InBoundsMemoryOperations", "IBMemOps");
+Statistic stats::nativeCalls("NativeCalls", "NCalls");
 Statistic stats::symbolicBr("SymbolicBr", "SBr");
 Statistic stats::symbolicIndirectBr("SymbolicIndirectBr", "SIBr");
 Statistic stats::symbolicSwitch("SymbolicSwitch", "SSwitch");
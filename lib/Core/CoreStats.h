@@ -23,11 +23,20 @@ namespace stats {
   extern Statistic instructions;
   extern Statistic instructionTime;
   extern Statistic instructionRealTime;
+  /// Cycle counter ticks (or steady clock ticks off x86) between
+  /// instructions, with --track-instruction-cycles
+  extern Statistic instructionCycles;
   extern Statistic coveredInstructions;
   extern Statistic uncoveredInstructions;  
   extern Statistic trueBranches;
   extern Statistic falseBranches;
   extern Statistic solverTime;
+  extern Statistic solverTimeoutRetries;
+  extern Statistic solverTimeoutsRecovered;
+  /// Branch queries predicted to time out, see -predict-solver-timeouts
+  extern Statistic predictedSolverTimeouts;
+  /// The getValue and getRange queries answered from the memo of the state
+  extern Statistic solverMemoHits;
 
   // HASE related statistics
   // ** internal function
@@ -44,6 +53,9 @@ namespace stats {
   extern Statistic concreteSwitch;
   extern Statistic concreteSelect;
   extern Statistic concreteCall;
+  extern Statistic concreteMemoryOperations;
+  extern Statistic inBoundsMemoryOperations;
+  extern Statistic nativeCalls;
   extern Statistic symbolicBr;
   extern Statistic symbolicIndirectBr;
   extern Statistic symbolicSwitch;
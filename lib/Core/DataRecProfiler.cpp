@@ -0,0 +1,129 @@
+//===-- DataRecProfiler.cpp -----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "DataRecProfiler.h"
+
+#include "klee/Internal/Module/KInstruction.h"
+#include "klee/Internal/Module/KModule.h"
+#include "klee/Internal/Module/Passes.h"
+
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <set>
+#include <unordered_set>
+#include <vector>
+
+using namespace llvm;
+using namespace klee;
+
+/// The number of distinct nodes of e
+static uint64_t countNodes(const ref<Expr> &e) {
+  std::unordered_set<const Expr *> visited;
+  std::vector<const Expr *> stack{e.get()};
+  while (!stack.empty()) {
+    const Expr *n = stack.back();
+    stack.pop_back();
+    if (!visited.insert(n).second)
+      continue;
+    for (unsigned i = 0, k = n->getNumKids(); i != k; ++i)
+      stack.push_back(n->getKid(i).get());
+  }
+  return visited.size();
+}
+
+const Instruction *
+DataRecProfiler::getConfigInstruction(const Instruction *recorded) {
+  if (isa<CastInst>(recorded) &&
+      recorded->getName().startswith(PTWritePass::castPrefix))
+    if (const Instruction *i = dyn_cast<Instruction>(recorded->getOperand(0)))
+      recorded = i;
+  // a part is (trunc (lshr whole, 64 * index)), or (trunc whole) for the
+  // first one
+  if (MDNode *part = recorded->getMetadata(PTWritePass::partMetadata)) {
+    const Instruction *whole = cast<Instruction>(recorded->getOperand(0));
+    if (PTWritePass::getPartIndex(part) != 0)
+      whole = cast<Instruction>(whole->getOperand(0));
+    recorded = whole;
+  }
+  return recorded;
+}
+
+void DataRecProfiler::recordLoad(const Instruction *recorded,
+                                 const ref<Expr> &replayed) {
+  Usefulness &u = byInstruction[getConfigInstruction(recorded)];
+  if (isa<ConstantExpr>(replayed)) {
+    ++u.redundant;
+  } else {
+    ++u.effective;
+    u.nodes += countNodes(replayed);
+  }
+}
+
+void DataRecProfiler::writeReport(raw_ostream &os) const {
+  std::vector<std::pair<std::pair<uint64_t, uint64_t>, const Instruction *>>
+      order;
+  Usefulness total;
+  for (auto &it : byInstruction) {
+    order.push_back({{it.second.nodes, it.second.effective}, it.first});
+    total.effective += it.second.effective;
+    total.redundant += it.second.redundant;
+    total.nodes += it.second.nodes;
+  }
+  std::sort(order.begin(), order.end());
+
+  os << "effective redundant    nodes  instruction\n";
+  for (auto &it : order) {
+    const Usefulness &u = byInstruction.at(it.second);
+    os << format("%9llu %9llu %8llu  ", (unsigned long long)u.effective,
+                 (unsigned long long)u.redundant, (unsigned long long)u.nodes)
+       << KInstruction::getUniqueID(it.second) << '\n';
+  }
+  os << format("%9llu %9llu %8llu  ", (unsigned long long)total.effective,
+               (unsigned long long)total.redundant,
+               (unsigned long long)total.nodes)
+     << "total\n";
+}
+
+unsigned DataRecProfiler::writePrunedCFG(const KModule &kmodule,
+                                         raw_ostream &os) const {
+  std::vector<const Instruction *> recorded;
+  std::set<const Instruction *> seen;
+  for (const Function &f : *kmodule.module)
+    for (const BasicBlock &b : f)
+      for (const Instruction &i : b) {
+        const CallInst *ci = dyn_cast<CallInst>(&i);
+        if (!ci)
+          continue;
+        const InlineAsm *ia = dyn_cast<InlineAsm>(ci->getCalledValue());
+        if (!ia || ia->getAsmString() != "ptwrite $0")
+          continue;
+        const Instruction *recI = dyn_cast<Instruction>(ci->getArgOperand(0));
+        if (recI && seen.insert(recI = getConfigInstruction(recI)).second)
+          recorded.push_back(recI);
+      }
+
+  unsigned dropped = 0;
+  for (const Instruction *i : recorded) {
+    auto it = byInstruction.find(i);
+    // instructions the replay never reached may matter to other paths
+    if (it != byInstruction.end() && !it->second.effective) {
+      os << "# " << KInstruction::getUniqueID(i) << ": "
+         << it->second.redundant << " redundant loads\n";
+      ++dropped;
+    } else {
+      os << KInstruction::getUniqueID(i) << '\n';
+    }
+  }
+  return dropped;
+}
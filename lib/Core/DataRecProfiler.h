@@ -0,0 +1,65 @@
+//===-- DataRecProfiler.h ---------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_DATARECPROFILER_H
+#define KLEE_DATARECPROFILER_H
+
+#include "klee/Expr/Expr.h"
+
+#include <cstdint>
+#include <map>
+
+namespace llvm {
+  class Instruction;
+  class raw_ostream;
+}
+
+namespace klee {
+  class KModule;
+
+  /// Counts, for every recorded instruction, the data recordings a replay
+  /// loaded into a symbolic register (effective) and into a concrete one
+  /// (redundant), and the expression nodes the effective ones replaced by a
+  /// constant, an estimate of how much smaller they made the constraints.
+  class DataRecProfiler {
+  public:
+    struct Usefulness {
+      uint64_t effective = 0;
+      uint64_t redundant = 0;
+      uint64_t nodes = 0;
+    };
+
+  private:
+    /// keyed by the instruction of the -ptwrite-cfg, ptwritecasts and parts
+    /// are counted for the value they record
+    std::map<const llvm::Instruction *, Usefulness> byInstruction;
+
+  public:
+    /// The instruction of the -ptwrite-cfg whose value recorded is
+    static const llvm::Instruction *
+    getConfigInstruction(const llvm::Instruction *recorded);
+
+    /// A recording of recorded was loaded where the replay computed replayed
+    void recordLoad(const llvm::Instruction *recorded,
+                    const ref<Expr> &replayed);
+
+    /// Writes the usefulness by instruction, the least useful first
+    void writeReport(llvm::raw_ostream &os) const;
+
+    /// Writes the -ptwrite-cfg recording every instruction the module
+    /// records but those only ever loaded redundantly, which are left as
+    /// comments
+    /// \return the number of instructions dropped
+    unsigned writePrunedCFG(const KModule &kmodule,
+                            llvm::raw_ostream &os) const;
+  };
+
+} // namespace klee
+
+#endif /* KLEE_DATARECPROFILER_H */
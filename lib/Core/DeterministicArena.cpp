@@ -0,0 +1,141 @@
+//===-- DeterministicArena.cpp --------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "DeterministicArena.h"
+
+#include "klee/Internal/Support/ErrorHandling.h"
+
+#include "llvm/Support/MathExtras.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstring>
+#include <iterator>
+#include <sys/mman.h>
+
+using namespace klee;
+
+const uint64_t DeterministicArena::MinBlockSize;
+const uint64_t DeterministicArena::SlabSize;
+const uint64_t DeterministicArena::PageSize;
+
+/// The size class of blocks of size bytes with the given alignment, or -1 if
+/// they are large. The blocks of class c are MinBlockSize << c bytes, and as
+/// slabs are aligned to SlabSize, each block is aligned to its size.
+static int getSizeClass(uint64_t size, uint64_t alignment) {
+  uint64_t blockSize = std::max(std::max(size, alignment),
+                                DeterministicArena::MinBlockSize);
+  if (blockSize > DeterministicArena::SlabSize)
+    return -1;
+  return llvm::Log2_64_Ceil(blockSize) -
+         llvm::Log2_64(DeterministicArena::MinBlockSize);
+}
+
+static uint64_t alignTo(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+DeterministicArena::DeterministicArena(uint64_t _base, uint64_t _capacity)
+    : base(_base), capacity(_capacity) {
+  // Without MAP_FIXED the address is only a hint, so that existing mappings
+  // are not replaced.
+  void *mem = mmap(reinterpret_cast<void *>(base), capacity,
+                   PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (mem == MAP_FAILED)
+    klee_error("Could not reserve the deterministic arena at 0x%" PRIx64 ": %s",
+               base, strerror(errno));
+  if (reinterpret_cast<uint64_t>(mem) != base) {
+    munmap(mem, capacity);
+    klee_error("Could not reserve the deterministic arena at 0x%" PRIx64
+               ": address in use",
+               base);
+  }
+  layout.top = base;
+  layout.freeBlocks.resize(getSizeClass(SlabSize, 1) + 1);
+}
+
+DeterministicArena::~DeterministicArena() {
+  munmap(reinterpret_cast<void *>(base), capacity);
+}
+
+bool DeterministicArena::refill(unsigned sizeClass) {
+  uint64_t slab = alignTo(layout.top, SlabSize);
+  if (slab + SlabSize > base + capacity)
+    return false;
+  layout.top = slab + SlabSize;
+  // lowest address first out
+  uint64_t blockSize = MinBlockSize << sizeClass;
+  std::vector<uint64_t> &blocks = layout.freeBlocks[sizeClass];
+  for (uint64_t block = slab + SlabSize; block != slab;) {
+    block -= blockSize;
+    blocks.push_back(block);
+  }
+  return true;
+}
+
+uint64_t DeterministicArena::allocateLarge(uint64_t size, uint64_t alignment) {
+  size = alignTo(size, PageSize);
+  alignment = std::max(alignment, PageSize);
+
+  auto it = layout.freeLargeBlocks.find(size);
+  if (it != layout.freeLargeBlocks.end()) {
+    std::vector<uint64_t> &blocks = it->second;
+    for (auto bi = blocks.rbegin(), be = blocks.rend(); bi != be; ++bi) {
+      if (*bi % alignment)
+        continue;
+      uint64_t address = *bi;
+      blocks.erase(std::next(bi).base());
+      if (blocks.empty())
+        layout.freeLargeBlocks.erase(it);
+      layout.live[address] = size;
+      return address;
+    }
+  }
+
+  uint64_t address = alignTo(layout.top, alignment);
+  if (address + size > base + capacity || address + size < address)
+    return 0;
+  layout.top = address + size;
+  layout.live[address] = size;
+  return address;
+}
+
+uint64_t DeterministicArena::allocate(uint64_t size, uint64_t alignment) {
+  int sizeClass = getSizeClass(size, alignment);
+  uint64_t address;
+  if (sizeClass < 0) {
+    address = allocateLarge(size, alignment);
+    if (!address)
+      return 0;
+  } else {
+    std::vector<uint64_t> &blocks = layout.freeBlocks[sizeClass];
+    if (blocks.empty() && !refill(sizeClass))
+      return 0;
+    address = blocks.back();
+    blocks.pop_back();
+    layout.live[address] = MinBlockSize << sizeClass;
+  }
+  layout.used += layout.live[address];
+  return address;
+}
+
+void DeterministicArena::free(uint64_t address) {
+  auto it = layout.live.find(address);
+  if (it == layout.live.end())
+    return;
+  uint64_t size = it->second;
+  layout.live.erase(it);
+  layout.used -= size;
+  if (size > SlabSize)
+    layout.freeLargeBlocks[size].push_back(address);
+  else
+    layout.freeBlocks[getSizeClass(size, 1)].push_back(address);
+}
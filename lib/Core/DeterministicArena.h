@@ -0,0 +1,86 @@
+//===-- DeterministicArena.h ------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_DETERMINISTICARENA_H
+#define KLEE_DETERMINISTICARENA_H
+
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+namespace klee {
+
+/// A single-threaded allocator over a range of virtual memory at a fixed
+/// address, whose addresses only depend on the sequence of allocations and
+/// frees. Small blocks come in power-of-two size classes, carved from slabs
+/// that are taken from a bump pointer; large blocks are page multiples taken
+/// from the same bump pointer. Freed blocks go to a free list per size and
+/// are reused last-in first-out.
+///
+/// All the bookkeeping lives outside of the managed memory, in a Layout, so
+/// that a copy of the Layout is a snapshot of the allocator: restoring it
+/// makes the following allocations return the same addresses as they did
+/// after the snapshot was taken.
+class DeterministicArena {
+public:
+  /// The smallest size class, and the one of zero-sized requests
+  static const uint64_t MinBlockSize = 16;
+  /// The largest size class, also the size and alignment of slabs
+  static const uint64_t SlabSize = 64 * 1024;
+  static const uint64_t PageSize = 4096;
+
+  struct Layout {
+    /// The start of the memory not yet handed out
+    uint64_t top = 0;
+    /// The free blocks of each size class, the next one to reuse last
+    std::vector<std::vector<uint64_t>> freeBlocks;
+    /// The free large blocks by size
+    std::map<uint64_t, std::vector<uint64_t>> freeLargeBlocks;
+    /// The allocated blocks and their sizes
+    std::unordered_map<uint64_t, uint64_t> live;
+    /// The sum of the sizes of the allocated blocks
+    uint64_t used = 0;
+  };
+
+private:
+  uint64_t base;
+  uint64_t capacity;
+  Layout layout;
+
+  uint64_t allocateLarge(uint64_t size, uint64_t alignment);
+  bool refill(unsigned sizeClass);
+
+public:
+  /// Reserve capacity bytes at base, which has to be page aligned. Fails
+  /// with klee_error if the range cannot be mapped there.
+  DeterministicArena(uint64_t base, uint64_t capacity);
+  ~DeterministicArena();
+
+  DeterministicArena(const DeterministicArena &) = delete;
+  DeterministicArena &operator=(const DeterministicArena &) = delete;
+
+  /// \return the address of a block of at least size bytes with the given
+  /// power-of-two alignment, or 0 if the arena is exhausted.
+  uint64_t allocate(uint64_t size, uint64_t alignment);
+
+  /// Return the block at address to the arena. Addresses that are not
+  /// allocated, e.g. of blocks allocated after the restored snapshot, are
+  /// ignored.
+  void free(uint64_t address);
+
+  uint64_t getUsedSize() const { return layout.used; }
+
+  const Layout &snapshot() const { return layout; }
+  void restore(const Layout &snapshot) { layout = snapshot; }
+};
+
+} // namespace klee
+
+#endif /* KLEE_DETERMINISTICARENA_H */
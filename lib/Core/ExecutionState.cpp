@@ -26,6 +26,7 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
 #include <cassert>
 #include <map>
 #include <set>
@@ -58,20 +59,21 @@ cl::opt<std::string> PathRecordingEntryPoint(
 
 /** Internal Routine **/
 static inline bool isKFunctionInPOSIX(KFunction *kf) {
-  return kf->function->hasFnAttribute(TAGPOSIX);
+  return kf->inPOSIX;
 }
 static inline bool isKFunctionInLIBC(KFunction *kf) {
-  return kf->function->hasFnAttribute(TAGLIBC);
+  return kf->inLIBC;
 }
 
 /***/
 
 void ExecutionState::setupMain(KFunction *kf) {
-  // single process, make its id always be 0
-  // the first thread, set its id to be 0
+  // the main process and its first thread both have id 0
   Thread mainThread = Thread(0, 0, kf);
   threads.insert(std::make_pair(mainThread.tuid, mainThread));
   crtThreadIt = threads.begin();
+  numEnabledThreads = 1;
+  processes.insert(std::make_pair(0, Process(0)));
 }
 
 void ExecutionState::setupTime() {
@@ -80,6 +82,7 @@ void ExecutionState::setupTime() {
 
 ExecutionState::ExecutionState(KFunction *kf) :
     wlistCounter(1),
+    numEnabledThreads(0),
     isInUserMain(false),
     depth(0),
     instsSinceCovNew(0),
@@ -87,9 +90,16 @@ ExecutionState::ExecutionState(KFunction *kf) :
     forkDisabled(false),
     replayPosition(0),
     replayDataRecEntriesPosition(0),
+    concreteOnly(false),
+    concreteProbeCountdown(0),
+    concreteProbeBackoff(0),
+    replayDivergences(0),
+    replayDivergedAt(0),
+    replayDivergedStep(0),
     nbranches_rec(0),
     ptreeNode(0),
-    steppedInstructions(0){
+    steppedInstructions(0),
+    lastScheduled(0){
   if (PathRecordingEntryPoint.empty()) {
     isInUserMain = true;
   }
@@ -98,7 +108,7 @@ ExecutionState::ExecutionState(KFunction *kf) :
 }
 
 ExecutionState::ExecutionState(const Constraints_ty &assumptions)
-    : wlistCounter(1), constraints(assumptions), replayPosition(0), replayDataRecEntriesPosition(0), nbranches_rec(0), ptreeNode(0) {}
+    : wlistCounter(1), numEnabledThreads(0), constraints(assumptions), replayPosition(0), replayDataRecEntriesPosition(0), concreteOnly(false), concreteProbeCountdown(0), concreteProbeBackoff(0), replayDivergences(0), replayDivergedAt(0), replayDivergedStep(0), nbranches_rec(0), ptreeNode(0) {}
 
 ExecutionState::~ExecutionState() {
   for (auto cur_mergehandler: openMergeStack){
@@ -115,7 +125,11 @@ ExecutionState::ExecutionState(const ExecutionState& state):
     threads(state.threads),
     waitingLists(state.waitingLists),
     wlistCounter(state.wlistCounter),
+    numEnabledThreads(state.numEnabledThreads),
     stateTime(state.stateTime),
+    processes(state.processes),
+    zombies(state.zombies),
+    sharedMemory(state.sharedMemory),
     addressSpace(state.addressSpace),
     constraints(state.constraints),
 
@@ -123,6 +137,8 @@ ExecutionState::ExecutionState(const ExecutionState& state):
     fork_queryCost(state.fork_queryCost),
     prev_fork_queryCost(state.prev_fork_queryCost),
     prev_fork_queryCost_single(state.prev_fork_queryCost_single),
+    valueMemo(state.valueMemo),
+    rangeMemo(state.rangeMemo),
     isInUserMain(state.isInUserMain),
     depth(state.depth),
 
@@ -135,14 +151,23 @@ ExecutionState::ExecutionState(const ExecutionState& state):
 
     replayPosition(state.replayPosition),
     replayDataRecEntriesPosition(state.replayDataRecEntriesPosition),
+    concreteOnly(state.concreteOnly),
+    concreteProbeCountdown(state.concreteProbeCountdown),
+    concreteProbeBackoff(state.concreteProbeBackoff),
+    replayDivergences(state.replayDivergences),
+    replayDivergedAt(state.replayDivergedAt),
+    replayDivergedStep(state.replayDivergedStep),
+    deferredBranches(state.deferredBranches),
+    deferredBase(state.deferredBase),
     nbranches_rec(state.nbranches_rec),
 
-    coveredLines(state.coveredLines),
+    coveredInstructions(state.coveredInstructions),
     ptreeNode(state.ptreeNode),
     symbolics(state.symbolics),
     arrayNames(state.arrayNames),
     openMergeStack(state.openMergeStack),
-    steppedInstructions(state.steppedInstructions) {
+    steppedInstructions(state.steppedInstructions),
+    lastScheduled(state.lastScheduled) {
   for (auto cur_mergehandler: openMergeStack)
     cur_mergehandler->addOpenState(this);
   crtThreadIt = threads.find(state.crtThreadIt->first);
@@ -151,9 +176,12 @@ ExecutionState::ExecutionState(const ExecutionState& state):
 ExecutionState *ExecutionState::branch() {
   depth++;
 
+  // the new state starts without covered instructions, do not copy them
+  std::vector<const InstructionInfo *> covered;
+  covered.swap(coveredInstructions);
   ExecutionState *falseState = new ExecutionState(*this);
+  coveredInstructions.swap(covered);
   falseState->coveredNew = false;
-  falseState->coveredLines.clear();
 
   // initialize PathOS based on existence of existing PathOS field
   if (pathOS.isValid()) {
@@ -175,10 +203,34 @@ ExecutionState *ExecutionState::branch() {
   return falseState;
 }
 
+bool ExecutionState::hasSymbolicData() const {
+  for (const threads_ty::value_type &tit : threads) {
+    for (const StackFrame &sf : tit.second.stack) {
+      for (unsigned i = 0; i < sf.kf->numRegisters; ++i) {
+        const ref<Expr> &value = sf.getLocal(i).value;
+        if (!value.isNull() && !isa<ConstantExpr>(value))
+          return true;
+      }
+    }
+  }
+  for (const auto &binding : addressSpace.objects)
+    if (!binding.second->isAllConcrete())
+      return true;
+  return false;
+}
+
 void ExecutionState::addSymbolic(const MemoryObject *mo, const Array *array) {
   symbolics.emplace_back(std::make_pair(ref<const MemoryObject>(mo), array));
 }
 
+std::vector<const Array *> ExecutionState::getSymbolicArrays() const {
+  std::vector<const Array *> arrays;
+  for (const auto &symbolic : symbolics)
+    if (arrays.empty() || arrays.back() != symbolic.second)
+      arrays.push_back(symbolic.second);
+  return arrays;
+}
+
 /**/
 
 llvm::raw_ostream &klee::operator<<(llvm::raw_ostream &os, const MemoryMap &mm) {
@@ -195,13 +247,23 @@ llvm::raw_ostream &klee::operator<<(llvm::raw_ostream &os, const MemoryMap &mm)
 }
 
 // FIXME: incomplete multithreading support
-bool ExecutionState::merge(const ExecutionState &b) {
+bool ExecutionState::merge(const ExecutionState &b,
+                           unsigned maxDifferingConstraints) {
   if (DebugLogStateMerge)
     llvm::errs() << "-- attempting merge of A:" << this << " with B:" << &b
                  << "--\n";
   if (pc() != b.pc())
     return false;
 
+  // only the memory of the running processes is merged
+  if (processes.size() != 1 || b.processes.size() != 1)
+    return false;
+
+  // the merged state could not follow the trace of both
+  if (replayPosition != b.replayPosition ||
+      replayDataRecEntriesPosition != b.replayDataRecEntriesPosition)
+    return false;
+
   // XXX is it even possible for these to differ? does it matter? probably
   // implies difference in object states?
 
@@ -235,6 +297,11 @@ bool ExecutionState::merge(const ExecutionState &b) {
   std::set_difference(bConstraints.begin(), bConstraints.end(),
                       commonConstraints.begin(), commonConstraints.end(),
                       std::inserter(bSuffix, bSuffix.end()));
+  if (aSuffix.size() + bSuffix.size() > maxDifferingConstraints) {
+    if (DebugLogStateMerge)
+      llvm::errs() << "\ttoo many differing constraints\n";
+    return false;
+  }
   if (DebugLogStateMerge) {
     llvm::errs() << "\tconstraint prefix: [";
     for (std::set<ref<Expr> >::iterator it = commonConstraints.begin(),
@@ -298,6 +365,20 @@ bool ExecutionState::merge(const ExecutionState &b) {
       llvm::errs() << "\t\tmappings differ\n";
     return false;
   }
+
+  // shared objects are only unshared by writes
+  MemoryMap::iterator sai = addressSpace.sharedObjects.begin();
+  MemoryMap::iterator sbi = b.addressSpace.sharedObjects.begin();
+  MemoryMap::iterator sae = addressSpace.sharedObjects.end();
+  MemoryMap::iterator sbe = b.addressSpace.sharedObjects.end();
+  for (; sai != sae && sbi != sbe; ++sai, ++sbi)
+    if (sai->first != sbi->first)
+      break;
+  if (sai != sae || sbi != sbe) {
+    if (DebugLogStateMerge)
+      llvm::errs() << "\t\tshared mappings differ\n";
+    return false;
+  }
   
   // merge stack
 
@@ -320,13 +401,13 @@ bool ExecutionState::merge(const ExecutionState &b) {
     StackFrame &af = *itA;
     const StackFrame &bf = *itB;
     for (unsigned i=0; i<af.kf->numRegisters; i++) {
-      ref<Expr> &av = af.locals[i].value;
-      const ref<Expr> &bv = bf.locals[i].value;
+      const ref<Expr> &av = af.getLocal(i).value;
+      const ref<Expr> &bv = bf.getLocal(i).value;
       if (av.isNull() || bv.isNull()) {
         // if one is null then by implication (we are at same pc)
         // we cannot reuse this local, so just ignore
       } else {
-        av = SelectExpr::create(inA, av, bv);
+        af.getWriteableLocal(i).value = SelectExpr::create(inA, av, bv);
       }
     }
   }
@@ -359,6 +440,12 @@ bool ExecutionState::merge(const ExecutionState &b) {
 
   return true;
 }
+bool ExecutionState::shouldRecordCall(KFunction *kf) const {
+  if (!isInUserMain)
+    return kf->function->getName() == PathRecordingEntryPoint;
+  return !isInPOSIX() && !(IgnorePOSIXPath && isKFunctionInPOSIX(kf));
+}
+
 void ExecutionState::pushFrame(Thread &t, KInstIterator caller, KFunction *kf) {
   t.stack.push_back(StackFrame(caller,kf));
   ++kf->frequency;
@@ -391,9 +478,10 @@ void ExecutionState::pushFrame(Thread &t, KInstIterator caller, KFunction *kf) {
 
 void ExecutionState::popFrame(Thread &t) {
   StackFrame &sf = t.stack.back();
+  AddressSpace &space = getAddressSpace(t.getPid());
   for (std::vector<const MemoryObject*>::iterator it = sf.allocas.begin(), 
          ie = sf.allocas.end(); it != ie; ++it)
-    addressSpace.unbindObject(*it);
+    space.unbindObject(*it);
   if (isInUserMain &&
       (sf.kf->function->getName() == PathRecordingEntryPoint)) {
     isInUserMain = false;
@@ -415,8 +503,8 @@ void ExecutionState::popFrame(Thread &t) {
 
 /* Multithreading related function  */
 Thread &ExecutionState::createThread(thread_id_t tid, KFunction *kf) {
-  // we currently assume there is only one process and its id is 0
-  Thread newThread = Thread(tid, 0, kf);
+  // the thread runs in the process that created it
+  Thread newThread = Thread(tid, crtThread().getPid(), kf);
   // I need to determine the "InPOSIX" and "InLIBC" status of the new thread by
   // looking at the start function during thread creation.
   // Following two cases should be taken into consideration
@@ -434,6 +522,7 @@ Thread &ExecutionState::createThread(thread_id_t tid, KFunction *kf) {
   std::pair<threads_ty::iterator, bool> res =
       threads.insert(std::make_pair(newThread.tuid, newThread));
   assert(res.second);
+  ++numEnabledThreads;
   return res.first->second;
 }
 
@@ -446,45 +535,199 @@ void ExecutionState::terminateThread(threads_ty::iterator thrIt) {
   threads.erase(thrIt);
 }
 
+void ExecutionState::scheduleNext(threads_ty::iterator it) {
+  assert(it != threads.end());
+  process_id_t from = crtThread().getPid();
+  crtThreadIt = it;
+  if (crtThread().getPid() != from)
+    switchProcess(from, crtThread().getPid());
+}
+
+void ExecutionState::disableThread(Thread &t) {
+  assert(t.enabled);
+  t.enabled = false;
+  --numEnabledThreads;
+}
+
 void ExecutionState::sleepThread(wlist_id_t wlist) {
   assert(crtThread().enabled);
   assert(wlist > 0);
   crtThread().enabled = false;
+  --numEnabledThreads;
   crtThread().waitingList = wlist;
-  std::set<thread_uid_t> &wl = waitingLists[wlist];
-  wl.insert(crtThread().tuid);
+  waitingLists = waitingLists.insert(std::make_pair(wlist, crtThread().tuid));
 }
 
 void ExecutionState::notifyOne(wlist_id_t wlist, thread_uid_t tuid) {
   assert(wlist > 0);
-  std::set<thread_uid_t> &wl = waitingLists[wlist];
-  if (wl.erase(tuid) != 1) {
-    assert(0 && "thread was not waiting");
-  }
+  assert(waitingLists.count(std::make_pair(wlist, tuid)) &&
+         "thread was not waiting");
+  waitingLists = waitingLists.remove(std::make_pair(wlist, tuid));
   threads_ty::iterator find_it = threads.find(tuid);
   assert(find_it != threads.end());
   Thread &thread = find_it->second;
   assert(!thread.enabled);
   thread.enabled = true;
+  ++numEnabledThreads;
   thread.waitingList = 0;
-  if (wl.size() == 0)
-    waitingLists.erase(wlist);
+}
+
+bool ExecutionState::getFirstWaiting(wlist_id_t wlist,
+                                     thread_uid_t &tuid) const {
+  wlists_ty::iterator it =
+      waitingLists.lower_bound(std::make_pair(wlist, thread_uid_t()));
+  if (it == waitingLists.end() || it->first != wlist)
+    return false;
+  tuid = it->second;
+  return true;
 }
 
 void ExecutionState::notifyAll(wlist_id_t wlist) {
   assert(wlist > 0);
-  std::set<thread_uid_t> &wl = waitingLists[wlist];
-  if (wl.size() > 0) {
-    for (const thread_uid_t &tuid: wl) {
-      threads_ty::iterator find_it = threads.find(tuid);
-      assert(find_it != threads.end());
-      Thread &thread = find_it->second;
-      thread.enabled = true;
-      thread.waitingList = 0;
+  thread_uid_t tuid;
+  while (getFirstWaiting(wlist, tuid)) {
+    threads_ty::iterator find_it = threads.find(tuid);
+    assert(find_it != threads.end());
+    Thread &thread = find_it->second;
+    thread.enabled = true;
+    ++numEnabledThreads;
+    thread.waitingList = 0;
+    waitingLists = waitingLists.remove(std::make_pair(wlist, tuid));
+  }
+}
+
+/* Multi-processes related function */
+AddressSpace &ExecutionState::getAddressSpace(process_id_t pid) {
+  if (pid == crtThread().getPid())
+    return addressSpace;
+  processes_ty::iterator it = processes.find(pid);
+  assert(it != processes.end());
+  return it->second.addressSpace;
+}
+
+void ExecutionState::switchProcess(process_id_t from, process_id_t to) {
+  AddressSpace &parked = processes.find(from)->second.addressSpace;
+  // the running process keeps an empty address space in its Process
+  addressSpace.swap(parked);
+  addressSpace.swap(processes.find(to)->second.addressSpace);
+
+  // the shared memory as the previous process left it, the objects it freed
+  // are gone
+  std::vector<ref<const MemoryObject> >::iterator out = sharedMemory.begin();
+  for (const ref<const MemoryObject> &mo : sharedMemory) {
+    if (const ObjectState *os = parked.findObject(mo.get())) {
+      addressSpace.rebindObject(mo.get(), os);
+      *out++ = mo;
+    } else {
+      addressSpace.unbindObject(mo.get());
     }
-    wl.clear();
   }
-  waitingLists.erase(wlist);
+  sharedMemory.erase(out, sharedMemory.end());
+}
+
+Thread &ExecutionState::forkProcess(process_id_t pid) {
+  assert(!processes.count(pid) && !zombies.count(pid));
+  Thread child = crtThread();
+  child.tuid.second = pid;
+  // the copy makes the memory copy on write in both processes
+  processes.insert(
+      std::make_pair(pid, Process(crtThread().getPid(), addressSpace)));
+  std::pair<threads_ty::iterator, bool> res =
+      threads.insert(std::make_pair(child.tuid, child));
+  assert(res.second);
+  ++numEnabledThreads;
+  return res.first->second;
+}
+
+process_id_t ExecutionState::getFreeProcessId() const {
+  // the process id takes a byte of the SCHEDULE entries
+  for (process_id_t pid = 1; pid <= 0xff; ++pid)
+    if (!processes.count(pid) && !zombies.count(pid))
+      return pid;
+  return 0;
+}
+
+void ExecutionState::disableProcess(process_id_t pid, int32_t status) {
+  for (threads_ty::value_type &tit : threads) {
+    Thread &t = tit.second;
+    if (t.getPid() != pid)
+      continue;
+    if (t.enabled) {
+      disableThread(t);
+    } else if (t.waitingList) {
+      waitingLists = waitingLists.remove(std::make_pair(t.waitingList, t.tuid));
+      t.waitingList = 0;
+    }
+  }
+
+  // nobody waits for the children of pid any more
+  for (zombies_ty::iterator it = zombies.begin(); it != zombies.end();) {
+    if (it->second.first == pid)
+      it = zombies.erase(it);
+    else
+      ++it;
+  }
+  for (processes_ty::value_type &pit : processes)
+    if (pit.second.ppid == pid)
+      pit.second.ppid = pit.first;
+
+  process_id_t ppid = processes.find(pid)->second.ppid;
+  if (ppid == pid)
+    return;
+  zombies[pid] = std::make_pair(ppid, status);
+  wlist_id_t wlist = processes.find(ppid)->second.childWaitList;
+  if (wlist)
+    notifyAll(wlist);
+}
+
+void ExecutionState::terminateProcess(process_id_t pid) {
+  klee_message("Terminating process %lu", pid);
+  // we assume the scheduler found a thread of another process first
+  assert(crtThread().getPid() != pid);
+  for (threads_ty::iterator it = threads.begin(); it != threads.end();) {
+    if (it->second.getPid() == pid) {
+      assert(!it->second.enabled && it->second.waitingList == 0);
+      it = threads.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  processes.erase(pid);
+}
+
+int64_t ExecutionState::reapChild(int64_t pid, int32_t &status) {
+  process_id_t self = crtThread().getPid();
+  for (zombies_ty::iterator it = zombies.begin(); it != zombies.end(); ++it) {
+    if (it->second.first != self || (pid >= 0 && it->first != (uint64_t)pid))
+      continue;
+    int64_t child = it->first;
+    status = it->second.second;
+    zombies.erase(it);
+    return child;
+  }
+  for (const processes_ty::value_type &pit : processes)
+    if (pit.first != self && pit.second.ppid == self &&
+        (pid < 0 || pit.first == (uint64_t)pid))
+      return 0;
+  return -1;
+}
+
+void ExecutionState::shareMemory(const MemoryObject *mo) {
+  for (const ref<const MemoryObject> &shared : sharedMemory)
+    if (shared.get() == mo)
+      return;
+  // drop the objects freed since, switchProcess does it once there are
+  // other processes
+  if (processes.size() == 1 && !sharedMemory.empty() &&
+      sharedMemory.size() % 64 == 0) {
+    sharedMemory.erase(
+        std::remove_if(sharedMemory.begin(), sharedMemory.end(),
+                       [this](const ref<const MemoryObject> &shared) {
+                         return !addressSpace.findObject(shared.get());
+                       }),
+        sharedMemory.end());
+  }
+  sharedMemory.push_back(mo);
 }
 
 /* Debugging helper */
@@ -500,10 +743,15 @@ void ExecutionState::dumpStack() const {
 }
 
 void ExecutionState::dumpStackPathOS() {
-  struct StringInstStats stack;
-  llvm::raw_string_ostream sos(stack.str);
+  std::string stack;
+  llvm::raw_string_ostream sos(stack);
   dumpStack(sos);
-  sos.flush();
+  dumpStackPathOS(sos.str());
+}
+
+void ExecutionState::dumpStackPathOS(const std::string &str) {
+  struct StringInstStats stack;
+  stack.str = str;
   stack.instcnt = stats::instructions;
   stackPathOS << stack;
 }
@@ -12,17 +12,23 @@
 #include "../Expr/ArrayExprOptimizer.h"
 #include "Context.h"
 #include "CoreStats.h"
+#include "DataRecProfiler.h"
 #include "ExternalDispatcher.h"
 #include "ImpliedValue.h"
 #include "Memory.h"
 #include "MemoryManager.h"
+#include "MetricsServer.h"
 #include "PTree.h"
+#include "PathDumpTable.h"
+#include "ReplayDivergence.h"
 #include "Searcher.h"
 #include "SeedInfo.h"
+#include "SolverProfiler.h"
 #include "SpecialFunctionHandler.h"
 #include "StatsTracker.h"
 #include "TimingSolver.h"
 #include "UserSearcher.h"
+#include "Watchdog.h"
 #include "ExecutorDebugHelper.h"
 #include "ExecutorConfig.h"
 
@@ -30,8 +36,10 @@
 #include "klee/Config/Version.h"
 #include "klee/ExecutionState.h"
 #include "klee/ExecutorCmdLine.h"
+#include "klee/MergeHandler.h"
 #include "klee/Expr/Assignment.h"
 #include "klee/Expr/Expr.h"
+#include "klee/Expr/ExprHashMap.h"
 #include "klee/Expr/ExprPPrinter.h"
 #include "klee/Expr/ExprSMTLIBPrinter.h"
 #include "klee/Expr/ExprUtil.h"
@@ -55,6 +63,7 @@
 #include "klee/Solver/SolverStats.h"
 #include "klee/TimerStatIncrementer.h"
 #include "klee/util/GetElementPtrTypeIterator.h"
+#include "klee/util/RecordingSelector.h"
 
 #include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/StringExtras.h"
@@ -86,7 +95,11 @@
 #include <iosfwd>
 #include <sstream>
 #include <string>
+#include <fcntl.h>
+#include <signal.h>
 #include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #include <vector>
 
 using namespace llvm;
@@ -111,6 +124,10 @@ cl::OptionCategory
 cl::OptionCategory TestGenCat("Test generation options",
                               "These options impact test generation.");
 
+cl::OptionCategory
+    ParallelCat("Parallel exploration options",
+                "These options split the exploration between processes.");
+
 cl::opt<std::string> MaxTime(
     "max-time",
     cl::desc("Halt execution after the specified duration.  "
@@ -135,6 +152,16 @@ cl::opt<bool> OnlyOutputStatesCoveringNew(
     cl::desc("Only output test cases covering new code (default=false)"),
     cl::cat(TestGenCat));
 
+cl::opt<bool> SliceTestInputs(
+    "slice-test-inputs", cl::init(false),
+    cl::desc("When generating a test case, only solve for the inputs the "
+             "symbolic registers of the current function depend on, through "
+             "the independent constraint factors, and give the others the "
+             "values of a seed or of the oracle KTest, or zeros. The test "
+             "may then leave the path where it branched on the other inputs "
+             "(default=false)"),
+    cl::cat(TestGenCat));
+
 cl::opt<bool> EmitAllErrors(
     "emit-all-errors", cl::init(false),
     cl::desc("Generate tests cases for all errors "
@@ -164,6 +191,90 @@ cl::opt<bool>
                                   "querying the solver (default=true)"),
                          cl::cat(SolvingCat));
 
+cl::opt<bool> ImpliedValueConcretization(
+    "implied-value-concretization", cl::init(false),
+    cl::desc("Write the values that an added constraint and the bounds and "
+             "masks of the other constraints imply for symbolic bytes back "
+             "into memory (default=false)"),
+    cl::cat(SolvingCat));
+
+cl::opt<unsigned> ImpliedValueMaxConstraints(
+    "implied-value-max-constraints", cl::init(256),
+    cl::desc("Only look for the bounds implied by an added constraint if "
+             "it is related to at most this many constraints (default=256)"),
+    cl::cat(SolvingCat));
+
+cl::opt<unsigned> CompactConstraints(
+    "compact-constraints", cl::init(4096),
+    cl::desc("Merge the bounds of a state's constraints once it has at least "
+             "this many, and again whenever their number doubles "
+             "(default=4096, 0 to disable)"),
+    cl::cat(SolvingCat));
+
+cl::opt<bool> DebugValidateCompaction(
+    "debug-validate-compaction", cl::init(false),
+    cl::desc("Check with the solver that the compacted constraints are "
+             "equivalent to the original ones (default=false)"),
+    cl::cat(SolvingCat));
+
+cl::opt<unsigned> SolverTimeoutRetries(
+    "solver-timeout-retries", cl::init(0),
+    cl::desc("Retry a branch query which exceeded --max-solver-time up to "
+             "this many times before terminating the state (default=0)"),
+    cl::cat(SolvingCat));
+
+cl::opt<unsigned> SolverTimeoutEscalation(
+    "solver-timeout-escalation", cl::init(4),
+    cl::desc("Multiply the solver time budget by this factor on every retry "
+             "(default=4)"),
+    cl::cat(SolvingCat));
+
+cl::opt<CoreSolverType> SolverTimeoutRetryBackend(
+    "solver-timeout-retry-backend",
+    cl::desc("Core solver used for the retries of timed out branch queries"),
+    cl::values(clEnumValN(STP_SOLVER, "stp", "STP"),
+               clEnumValN(METASMT_SOLVER, "metasmt", "metaSMT"),
+               clEnumValN(Z3_SOLVER, "z3", "Z3"),
+               clEnumValN(NO_SOLVER, "same",
+                          "The backend of --solver-backend (default)")
+                   KLEE_LLVM_CL_VAL_END),
+    cl::init(NO_SOLVER), cl::cat(SolvingCat));
+
+cl::opt<bool> RecordSolverTimeouts(
+    "record-solver-timeouts", cl::init(false),
+    cl::desc("Log timed out branch queries to solver-timeouts.txt and dump "
+             "the constraints related to each to solver-timeoutNNN.kquery, "
+             "for kleaver --analyze and --draw (default=false)"),
+    cl::cat(SolvingCat));
+
+cl::opt<unsigned> SelectTimeoutRecording(
+    "select-timeout-recording", cl::init(0),
+    cl::desc("With --record-solver-timeouts, pick up to this many "
+             "instructions whose recorded values would simplify the timed "
+             "out query most per recorded byte, and write them to "
+             "solver-timeoutNNN.ptwrite-cfg for prepass --ptwrite-cfg "
+             "(default=0, off)"),
+    cl::cat(SolvingCat));
+
+cl::opt<bool> PredictSolverTimeouts(
+    "predict-solver-timeouts", cl::init(false),
+    cl::desc("With --max-solver-time, predict the time of every branch query "
+             "from the queries before, and log the ones predicted to take "
+             "more than --predicted-timeout-fraction of the budget with "
+             "--record-solver-timeouts before solving them (default=false)"),
+    cl::cat(SolvingCat));
+
+cl::opt<double> PredictedTimeoutFraction(
+    "predicted-timeout-fraction", cl::init(0.5),
+    cl::desc("The fraction of --max-solver-time above which a predicted "
+             "query time is a predicted timeout (default=0.5)"),
+    cl::cat(SolvingCat));
+
+cl::opt<bool> SkipPredictedTimeouts(
+    "skip-predicted-timeouts", cl::init(false),
+    cl::desc("Terminate a state at a branch query predicted to time out "
+             "instead of solving it (default=false)"),
+    cl::cat(SolvingCat));
 
 /*** External call policy options ***/
 
@@ -192,6 +303,30 @@ cl::opt<ExternalCallPolicy> ExternalCalls(
     cl::init(ExternalCallPolicy::Concrete),
     cl::cat(ExtCallsCat));
 
+cl::opt<bool> ShareConstantGlobals(
+    "share-constant-globals", cl::init(true),
+    cl::desc("Keep the constant globals in a map of read-only objects shared "
+             "by all states, which external calls do not synchronize. A "
+             "state only gets its own copy of one if it is written with "
+             "data of the trace (default=true)"),
+    cl::cat(ExtCallsCat));
+
+cl::opt<bool> ExternalCallsSyncReachable(
+    "external-calls-sync-reachable",
+    cl::init(false),
+    cl::desc("Only copy the objects reachable from the pointer arguments of "
+             "an external call to and from native memory, instead of all "
+             "objects. Externals that access other objects, e.g. through "
+             "globals of their own, see stale contents (default=false)"),
+    cl::cat(ExtCallsCat));
+
+cl::list<std::string> NativeCallFunctions(
+    "native-call",
+    cl::desc("Run the calls of this function natively with "
+             "-native-pure-calls, in addition to those of the allowlist. Can "
+             "be specified multiple times"),
+    cl::value_desc("function name"), cl::cat(ExtCallsCat));
+
 cl::opt<bool> SuppressExternalWarnings(
     "suppress-external-warnings",
     cl::init(false),
@@ -253,6 +388,15 @@ cl::opt<bool> NamedSeedMatching(
     cl::desc("Use names to match symbolic objects to inputs (default=false)."),
     cl::cat(SeedingCat));
 
+cl::opt<unsigned> SeedBatchSize(
+    "seed-batch-size",
+    cl::init(0),
+    cl::desc("Number of seeds to read and replay at a time. Each batch starts "
+             "from a copy of the initial state when the batch before it is "
+             "done, so that only the seeds of one batch are in memory, but "
+             "the batches may explore the same paths (default=0 (all))."),
+    cl::cat(SeedingCat));
+
 cl::opt<std::string>
     SeedTime("seed-time",
              cl::desc("Amount of time to dedicate to seeds, before normal "
@@ -321,6 +465,61 @@ cl::opt<bool> MaxMemoryInhibit(
     cl::init(true),
     cl::cat(TerminationCat));
 
+enum class MemoryLimitAction {
+  Ignore, // Memory usage is not checked
+  Kill,   // Random states are terminated
+  Spill,  // The least recently scheduled states are written out and dropped
+};
+
+cl::opt<MemoryLimitAction> MaxMemoryAction(
+    "max-memory-action",
+    cl::desc("What to do with the states when above -max-memory"),
+    cl::values(
+        clEnumValN(MemoryLimitAction::Ignore, "ignore",
+                   "Do not check the memory usage (default)"),
+        clEnumValN(MemoryLimitAction::Kill, "kill",
+                   "Inhibit forking (see -max-memory-inhibit) and terminate "
+                   "random states"),
+        clEnumValN(MemoryLimitAction::Spill, "spill",
+                   "Inhibit forking (see -max-memory-inhibit) and spill the "
+                   "states the searcher selected least recently to .spill "
+                   "test cases, whether or not they covered new code. Their "
+                   ".ktest files resume them with -seed-file, and their "
+                   ".path files with -replay-path if -write-paths is set")
+            KLEE_LLVM_CL_VAL_END),
+    cl::init(MemoryLimitAction::Ignore),
+    cl::cat(TerminationCat));
+
+cl::opt<unsigned> ParallelWorkers(
+    "parallel-workers",
+    cl::desc("Explore with up to this many processes. Whenever a process "
+             "has -parallel-split-states states and may fork off more "
+             "workers, it forks, and the new worker takes over half of its "
+             "states. Each worker has its own solver, statistics and output "
+             "in the worker<N> subdirectory of the output directory "
+             "(default=1)"),
+    cl::init(1), cl::cat(ParallelCat));
+
+cl::opt<unsigned> ParallelSplitStates(
+    "parallel-split-states",
+    cl::desc("The number of states at which a process shares them with a "
+             "new worker, see -parallel-workers (default=8)"),
+    cl::init(8), cl::cat(ParallelCat));
+
+cl::opt<int> NumaNode(
+    "numa-node",
+    cl::desc("Run on the CPUs of this NUMA node, so that the memory klee "
+             "touches is allocated on it, e.g. to spread the replays of a "
+             "batch over the nodes of a machine. -1 leaves the placement to "
+             "the system (default=-1)"),
+    cl::init(-1), cl::cat(ParallelCat));
+
+cl::opt<bool> NumaSpreadWorkers(
+    "numa-spread-workers",
+    cl::desc("Bind the -parallel-workers processes to the NUMA nodes round "
+             "robin, worker N to node -numa-node + N (default=false)"),
+    cl::init(false), cl::cat(ParallelCat));
+
 cl::opt<unsigned> RuntimeMaxStackFrames(
     "max-stack-frames",
     cl::desc("Terminate a state after this many stack frames.  Set to 0 to "
@@ -362,6 +561,14 @@ cl::opt<std::string> TimerInterval(
     cl::init("1s"),
     cl::cat(TerminationCat));
 
+cl::opt<std::string> WatchdogInterval(
+    "watchdog-interval",
+    cl::desc("How often the watchdog thread samples the memory usage and "
+             "the time, the granularity of -max-memory and of the timers "
+             "(default=100ms)"),
+    cl::init("100ms"),
+    cl::cat(TerminationCat));
+
 
 /*** Debugging options ***/
 
@@ -452,11 +659,136 @@ cl::opt<bool> DebugValueConcretization(
     cl::desc("Print debug info related to value concretization from data "
              "traces (default=false)"),
     cl::cat(HASECat));
+cl::opt<bool> DataRecProfile(
+    "datarec-profile", cl::init(false),
+    cl::desc("Count by recorded instruction the data recordings loaded into "
+             "symbolic and into concrete registers during replay, and the "
+             "expression nodes they made concrete. Writes "
+             "datarec-profile.txt at the end of the run (default=false)"),
+    cl::cat(HASECat));
+cl::opt<bool> DataRecPruneCFG(
+    "datarec-prune-cfg", cl::init(false),
+    cl::desc("With --datarec-profile, also write "
+             "datarec-pruned.ptwrite-cfg, the instructions the module records "
+             "but those whose recordings were only loaded into concrete "
+             "registers, for prepass --ptwrite-cfg (default=false)"),
+    cl::cat(HASECat));
+cl::opt<unsigned> ReplayCheckpointInterval(
+    "replay-checkpoint-interval", cl::init(0),
+    cl::desc("Snapshot the replaying state every N path entries. A later "
+             "replay in the same process (see -replay-serve) whose trace "
+             "shares the prefix resumes from the deepest matching snapshot "
+             "(default=0, i.e. disabled)"),
+    cl::cat(HASECat));
+cl::opt<bool> ReplayBatchInstructions(
+    "replay-batch-instructions", cl::init(true),
+    cl::desc("While a single state replays, count the straight-line "
+             "instructions it executes in batches instead of one at a time. "
+             "Only applies without instruction level statistics "
+             "(default=true)"),
+    cl::cat(HASECat));
+cl::opt<bool> ReplayConcreteFastPath(
+    "replay-concrete-fast-path", cl::init(false),
+    cl::desc("During replay, detect states with no symbolic data reachable "
+             "from registers or memory and take a shortcut at their concrete "
+             "branches: no solver or seed bookkeeping and no stack/cons/stats "
+             "dumps at forks, until a symbolic object is bound "
+             "(default=false)"),
+    cl::cat(HASECat));
+cl::opt<unsigned> ReplayBatchBranches(
+    "replay-batch-branches", cl::init(0),
+    cl::desc("During replay, take symbolic branch directions from the trace "
+             "without a validity query per branch and check them against the "
+             "path constraints in one query every N branches "
+             "(default=0, i.e. query at every branch)"),
+    cl::cat(HASECat));
+cl::opt<bool> ReplayBackgroundChecks(
+    "replay-background-checks", cl::init(false),
+    cl::desc("Check each full batch of -replay-batch-branches in a forked "
+             "process while the replay goes on, and only wait for the answer "
+             "when the next batch is full or the state needs its path to hold "
+             "(default=false)"),
+    cl::cat(HASECat));
+cl::opt<bool> ReplayContinueAfterDivergence(
+    "replay-continue-after-divergence", cl::init(false),
+    cl::desc("When a state disagrees with the trace at a concrete branch, "
+             "follow the runtime decision instead of terminating the state, "
+             "and report how far it went in replay-divergence.jsonl "
+             "(default=false)"),
+    cl::cat(HASECat));
+cl::opt<bool> ReplayBudgetOpt(
+    "replay-budget", cl::init(false),
+    cl::desc("Spread -max-time over the trace of -replay-path. The time of "
+             "each of -replay-budget-segments segments is logged against "
+             "its share of the budget in replay-budget.txt. Each branch "
+             "query gets the time the replay can spare as solver timeout, "
+             "at most -max-solver-time if set. If -max-time halts the "
+             "replay, the furthest state is written as a test case and "
+             "replay-budget-exhausted.txt lists the instructions whose "
+             "recorded values would simplify its constraints most, also in "
+             "replay-budget.ptwrite-cfg (default=false)"),
+    cl::cat(HASECat));
+cl::opt<unsigned> ReplayBudgetSegments(
+    "replay-budget-segments", cl::init(20),
+    cl::desc("Number of segments -replay-budget splits the trace into "
+             "(default=20)"),
+    cl::cat(HASECat));
+cl::opt<unsigned> ReplayBudgetRecording(
+    "replay-budget-recording", cl::init(8),
+    cl::desc("Number of instructions to record that -replay-budget picks "
+             "when the budget is exhausted (default=8)"),
+    cl::cat(HASECat));
+cl::opt<unsigned> ReplayDivergenceHistory(
+    "replay-divergence-history", cl::init(32),
+    cl::desc("Number of path and DATAREC entries before a divergence that "
+             "replay-divergence.jsonl shows (default=32)"),
+    cl::cat(HASECat));
+enum class PathDumpFormat { Text, Interned };
+cl::opt<PathDumpFormat> OutputPathDumpFormat(
+    "path-dump-format", cl::init(PathDumpFormat::Text),
+    cl::desc("Format of the stacks and constraints of --write-stack-paths "
+             "and --write-cons-paths (default=text)"),
+    cl::values(clEnumValN(PathDumpFormat::Text, "text",
+                          "The whole stack or constraint at every branch"),
+               clEnumValN(PathDumpFormat::Interned, "interned",
+                          "S<id> and N<id> references into the shared "
+                          "stack-table.*.txt and expr-table.*.txt")
+                   KLEE_LLVM_CL_VAL_END),
+    cl::cat(HASECat));
+cl::opt<unsigned> PathDumpShardSize(
+    "path-dump-shard-size", cl::init(1000000),
+    cl::desc("Lines per shard of the tables of -path-dump-format=interned "
+             "(default=1000000)"),
+    cl::cat(HASECat));
 cl::opt<unsigned>
     ReportInterval("--report-interval", cl::init(300),
                    cl::desc("How frequent (every n seconds) klee should print "
                             "execution info. (default=300)"),
                    cl::cat(HASECat));
+cl::opt<unsigned> MetricsPort(
+    "metrics-port", cl::init(0),
+    cl::desc("Serve the progress of the run (replay position, DATAREC "
+             "entries, solver queries and time, memory, states) as "
+             "Prometheus text at http://127.0.0.1:<port>/metrics "
+             "(default=0, i.e. disabled)"),
+    cl::cat(HASECat));
+cl::opt<unsigned> MetricsPublishInstructions(
+    "metrics-publish-instructions", cl::init(65536),
+    cl::desc("Publish the values served by --metrics-port every N "
+             "instructions (default=65536)"),
+    cl::cat(HASECat));
+cl::opt<bool> SolverProfile(
+    "solver-profile", cl::init(false),
+    cl::desc("Attribute solver time to call stacks and instructions, arrays "
+             "and independent factors. Writes solver-profile.folded (for "
+             "flamegraph.pl) and solver-profile.txt at the end of the run "
+             "(default=false)"),
+    cl::cat(HASECat));
+cl::opt<unsigned> SolverProfileSample(
+    "solver-profile-sample", cl::init(1),
+    cl::desc("With --solver-profile, only attribute one in N queries, "
+             "scaling their cost by N (default=1, i.e. every query)"),
+    cl::cat(HASECat));
 } // namespace
 
 namespace klee {
@@ -467,6 +799,19 @@ namespace klee {
           "Dump the name of functions executed in the last N instructions "
           "of a replay to \"suffix_func_list.txt\". (default=0, i.e. no dump)"),
       cl::cat(HASECat));
+  cl::opt<bool> ReplayPathPrefix(
+      "replay-path-prefix", cl::init(false),
+      cl::desc("Treat -replay-path as a prefix: a state that has consumed "
+               "the whole trace leaves replay and goes on exploring "
+               "symbolically from there (default=false)"),
+      cl::cat(HASECat));
+  cl::opt<unsigned> ExportFrontierStates(
+      "export-frontier-states", cl::init(0),
+      cl::desc("Keep at most N states that explore past the replayed "
+               "prefix and hand the coldest others to the interpreter "
+               "handler as jobs, e.g. for the -job-dir queue "
+               "(default=0, i.e. keep all states)"),
+      cl::cat(HASECat));
 }
 
 // XXX hack
@@ -492,6 +837,24 @@ const char *Executor::TerminateReasonNames[] = {
 };
 
 
+/// Bind the process of worker workerID as -numa-node and
+/// -numa-spread-workers ask. The memory of the forked workers is copied on
+/// their node when they first write it.
+static void bindToNumaNode(unsigned workerID) {
+  if (NumaNode < 0 && !NumaSpreadWorkers)
+    return;
+  unsigned node = std::max(0, NumaNode.getValue());
+  if (NumaSpreadWorkers)
+    node += workerID;
+  node %= util::GetNumNumaNodes();
+  std::string error;
+  if (util::BindToNumaNode(node, error))
+    klee_message("worker %u: running on NUMA node %u", workerID, node);
+  else
+    klee_warning("cannot bind worker %u to NUMA node %u: %s", workerID, node,
+                 error.c_str());
+}
+
 Executor::Executor(LLVMContext &ctx, const InterpreterOptions &opts,
                    InterpreterHandler *ih)
     : Interpreter(opts), interpreterHandler(ih), searcher(0),
@@ -501,30 +864,26 @@ Executor::Executor(LLVMContext &ctx, const InterpreterOptions &opts,
       specialFunctionHandler(0), timers{time::Span(TimerInterval)},
       replayKTest(0), oracle_eval(0), replayPath(0), usingSeeds(0),
       atMemoryLimit(false), inhibitForking(false), haltExecution(false),
-      ivcEnabled(false), debugLogBuffer(debugBufferString), info_requested(false) {
+      ivcEnabled(ImpliedValueConcretization), debugLogBuffer(debugBufferString),
+      printInstructions(DebugPrintInstructions.getBits() != 0),
+      info_requested(false) {
+
+  if (MetricsPort)
+    metricsServer = std::make_unique<MetricsServer>(MetricsPort);
 
   const time::Span maxTime{MaxTime};
+  maxTimeStart = time::getWallTime();
   if (maxTime) timers.add(
         std::make_unique<Timer>(maxTime, [&]{
         klee_message("HaltTimer invoked");
+        maxTimeReached = true;
         setHaltExecution(true);
       }));
 
   coreSolverTimeout = time::Span{MaxCoreSolverTime};
-  if (coreSolverTimeout) UseForkedCoreSolver = true;
-  Solver *coreSolver = klee::createCoreSolver(CoreSolverToUse);
-  if (!coreSolver) {
-    klee_error("Failed to create core solver\n");
-  }
-
-  Solver *solver = constructSolverChain(
-      coreSolver,
-      interpreterHandler->getOutputFilename(ALL_QUERIES_SMT2_FILE_NAME),
-      interpreterHandler->getOutputFilename(SOLVER_QUERIES_SMT2_FILE_NAME),
-      interpreterHandler->getOutputFilename(ALL_QUERIES_KQUERY_FILE_NAME),
-      interpreterHandler->getOutputFilename(SOLVER_QUERIES_KQUERY_FILE_NAME));
-
-  this->solver = new TimingSolver(solver, EqualitySubstitution);
+  if (coreSolverTimeout || (ReplayBudgetOpt && maxTime))
+    UseForkedCoreSolver = true;
+  createSolvers();
 
   if (OracleKTest != "") {
     oracle_eval = new OracleEvaluator(OracleKTest);
@@ -615,6 +974,8 @@ Executor::setModule(std::vector<std::unique_ptr<llvm::Module>> &modules,
     kmodule->targetData = std::unique_ptr<llvm::DataLayout>(
         new DataLayout(kmodule->module.get()));
     modules.pop_back();
+    // the checks were linked and inserted when the module was prepared
+    kmodule->addCheckFunctions(opts);
   }
 
   kmodule->checkModule();
@@ -640,11 +1001,65 @@ Executor::setModule(std::vector<std::unique_ptr<llvm::Module>> &modules,
 }
 
 Executor::~Executor() {
+  // snapshots still reference memory objects
+  replayCheckpoints.clear();
   delete memory;
   delete externalDispatcher;
   delete specialFunctionHandler;
   delete statsTracker;
   delete solver;
+  delete retrySolver;
+}
+
+void Executor::createSolvers() {
+  Solver *coreSolver = klee::createCoreSolver(CoreSolverToUse);
+  if (!coreSolver) {
+    klee_error("Failed to create core solver\n");
+  }
+
+  Solver *solver = constructSolverChain(
+      coreSolver,
+      interpreterHandler->getOutputFilename(ALL_QUERIES_SMT2_FILE_NAME),
+      interpreterHandler->getOutputFilename(SOLVER_QUERIES_SMT2_FILE_NAME),
+      interpreterHandler->getOutputFilename(ALL_QUERIES_KQUERY_FILE_NAME),
+      interpreterHandler->getOutputFilename(SOLVER_QUERIES_KQUERY_FILE_NAME),
+      interpreterHandler->getOutputFilename(ALL_QUERIES_KQLOG_FILE_NAME),
+      interpreterHandler->getOutputFilename(SOLVER_QUERIES_KQLOG_FILE_NAME));
+
+  this->solver = new TimingSolver(solver, EqualitySubstitution);
+
+  if (SolverTimeoutRetries && SolverTimeoutRetryBackend != NO_SOLVER) {
+    Solver *retryCoreSolver = klee::createCoreSolver(SolverTimeoutRetryBackend);
+    if (!retryCoreSolver)
+      klee_error("Failed to create the solver for timeout retries\n");
+    retrySolver = new TimingSolver(
+        constructSolverChain(
+            retryCoreSolver,
+            interpreterHandler->getOutputFilename(
+                std::string("retry-") + ALL_QUERIES_SMT2_FILE_NAME),
+            interpreterHandler->getOutputFilename(
+                std::string("retry-") + SOLVER_QUERIES_SMT2_FILE_NAME),
+            interpreterHandler->getOutputFilename(
+                std::string("retry-") + ALL_QUERIES_KQUERY_FILE_NAME),
+            interpreterHandler->getOutputFilename(
+                std::string("retry-") + SOLVER_QUERIES_KQUERY_FILE_NAME),
+            interpreterHandler->getOutputFilename(
+                std::string("retry-") + ALL_QUERIES_KQLOG_FILE_NAME),
+            interpreterHandler->getOutputFilename(
+                std::string("retry-") + SOLVER_QUERIES_KQLOG_FILE_NAME)),
+        EqualitySubstitution);
+  }
+
+  if (SolverProfile) {
+    solverProfiler = std::make_unique<SolverProfiler>(SolverProfileSample);
+    this->solver->profiler = solverProfiler.get();
+    if (retrySolver)
+      retrySolver->profiler = solverProfiler.get();
+  }
+  if (DataRecProfile)
+    dataRecProfiler = std::make_unique<DataRecProfiler>();
+  else if (DataRecPruneCFG)
+    klee_warning("--datarec-prune-cfg is ignored without --datarec-profile");
 }
 
 /***/
@@ -873,7 +1288,7 @@ void Executor::initializeGlobals(ExecutionState &state) {
   // once all objects are allocated, do the actual initialization
   // remember constant objects to initialise their counter part for external
   // calls
-  std::vector<ObjectState *> constantObjects;
+  std::vector<std::pair<const MemoryObject *, ObjectState *>> constantObjects;
   for (Module::const_global_iterator i = m->global_begin(),
          e = m->global_end();
        i != e; ++i) {
@@ -886,7 +1301,7 @@ void Executor::initializeGlobals(ExecutionState &state) {
 
       initializeGlobalObject(state, wos, i->getInitializer(), 0);
       if (i->isConstant())
-        constantObjects.emplace_back(wos);
+        constantObjects.emplace_back(mo, wos);
     }
   }
 
@@ -895,9 +1310,13 @@ void Executor::initializeGlobals(ExecutionState &state) {
     // initialise the actual memory with constant values
     state.addressSpace.copyOutConcretes();
 
-    // mark constant objects as read-only
-    for (auto obj : constantObjects)
-      obj->setReadOnly(true);
+    // mark constant objects as read-only, and share them between all the
+    // states to come
+    for (auto obj : constantObjects) {
+      obj.second->setReadOnly(true);
+      if (ShareConstantGlobals)
+        state.addressSpace.shareObject(obj.first);
+    }
   }
 }
 
@@ -949,21 +1368,14 @@ void Executor::branch(ExecutionState &state,
     // Assume each seed only satisfies one condition (necessarily true
     // when conditions are mutually exclusive and their conjunction is
     // a tautology).
-    for (std::vector<SeedInfo>::iterator siit = seeds.begin(),
-           siie = seeds.end(); siit != siie; ++siit) {
+    std::vector<BatchEvaluator::Result> seedResults;
+    evaluateSeeds(seeds, conditions, seedResults);
+    for (unsigned k = 0; k < seeds.size(); ++k) {
+      std::vector<SeedInfo>::iterator siit = seeds.begin() + k;
       unsigned i;
-      for (i=0; i<N; ++i) {
-        ref<ConstantExpr> res;
-        bool success =
-          solver->getValue(state, siit->assignment.evaluate(conditions[i]),
-                           res);
-        if (!success) {
-          exitOnSolverTimeout(state, "solver timeout at " __FILE__
-                                      ":" __LINE_STRING__);
-        }
-        if (res->isTrue())
+      for (i=0; i<N; ++i)
+        if (seedSatisfies(state, *siit, conditions[i], seedResults[k * N + i]))
           break;
-      }
 
       // If we didn't find a satisfying condition randomly pick one
       // (the seed will be patched).
@@ -990,8 +1402,142 @@ void Executor::branch(ExecutionState &state,
       addConstraint(*result[i], conditions[i]);
 }
 
+void Executor::probeConcreteOnly(ExecutionState &state) {
+  if (state.concreteOnly)
+    return;
+  if (state.concreteProbeCountdown) {
+    --state.concreteProbeCountdown;
+    return;
+  }
+  if (!state.hasSymbolicData()) {
+    state.concreteOnly = true;
+    return;
+  }
+  // probing scans the whole address space, back off while it keeps failing
+  state.concreteProbeBackoff =
+      std::min(2 * state.concreteProbeBackoff + 1, 1u << 16);
+  state.concreteProbeCountdown = state.concreteProbeBackoff;
+}
+
+bool Executor::retryTimedOutQuery(ExecutionState &state, ref<Expr> condition,
+                                  time::Span timeout,
+                                  Solver::Validity &result) {
+  TimingSolver *retry = retrySolver ? retrySolver : solver;
+  bool success = false;
+  unsigned attempts = 0;
+  while (!success && attempts < SolverTimeoutRetries) {
+    ++attempts;
+    timeout *= SolverTimeoutEscalation;
+    klee_message("Query timed out (fork), retry %u with %.3fs", attempts,
+                 timeout.toSeconds());
+    ++stats::solverTimeoutRetries;
+    retry->setTimeout(timeout);
+    success = retry->evaluate(state, condition, result);
+    retry->setTimeout(time::Span());
+  }
+  if (success && attempts)
+    ++stats::solverTimeoutsRecovered;
+  if (RecordSolverTimeouts)
+    recordSolverTimeout(state, condition, timeout, attempts, success);
+  return success;
+}
+
+void Executor::recordSolverTimeout(ExecutionState &state, ref<Expr> condition,
+                                   time::Span timeout, unsigned retries,
+                                   bool recovered) {
+  std::string outcome;
+  llvm::raw_string_ostream os(outcome);
+  os << retries << " retries, " << (recovered ? "recovered" : "failed")
+     << " at " << timeout;
+  recordHardQuery(state, condition, "timeout", os.str());
+}
+
+void Executor::recordPredictedTimeout(ExecutionState &state,
+                                      ref<Expr> condition, double predicted,
+                                      time::Span timeout) {
+  if (!predictedTimeouts.insert(condition->getKInst()).second)
+    return;
+  std::string outcome;
+  llvm::raw_string_ostream os(outcome);
+  os << "predicted " << predicted << "s of " << timeout;
+  recordHardQuery(state, condition, "predicted", os.str());
+}
+
+void Executor::recordHardQuery(ExecutionState &state, ref<Expr> condition,
+                               const char *kind, const std::string &outcome) {
+  if (!solverTimeoutsFile) {
+    solverTimeoutsFile = interpreterHandler->openOutputFile("solver-timeouts.txt");
+    if (!solverTimeoutsFile)
+      return;
+  }
+  unsigned id = solverTimeoutCount++;
+
+  // Only the constraints sharing symbolic values with the condition can make
+  // the query hard, with the independent solver those are known already.
+  Constraints_ty related;
+  const ConstraintManager &cm = state.constraints;
+  if (cm.factor_size() || cm.getAllConstraints().empty()) {
+    IndependentElementSet conditionElements(condition);
+    IndepElemSetPtrSet_ty factors;
+    cm.getIntersection(&conditionElements, factors);
+    for (const IndependentElementSet *factor : factors)
+      related.insert(factor->exprs.begin(), factor->exprs.end());
+  } else {
+    related = cm.getAllConstraints();
+  }
+
+  std::vector<ref<Expr>> exprs(related.begin(), related.end());
+  exprs.push_back(condition);
+  std::vector<const Array *> objects;
+  findSymbolicObjects(exprs.begin(), exprs.end(), objects);
+
+  char filename[64];
+  std::snprintf(filename, sizeof(filename), "solver-timeout%03u.kquery", id);
+  debugDumpConstraintsImpl(related, objects, std::vector<ref<Expr>>{condition},
+                           interpreterHandler->getOutputFilename(filename).c_str());
+
+  llvm::raw_fd_ostream &os = *solverTimeoutsFile;
+  os << kind << " " << id << ": condition " << condition->getKInstUniqueID()
+     << ", " << related.size() << " related constraints, " << outcome
+     << ", query " << filename << '\n';
+  // kinsts of the related constraints, the candidates for tracing
+  for (const ref<Expr> &e : related)
+    os << "  constraint " << e->getKInstUniqueID() << '\n';
+
+  if (SelectTimeoutRecording) {
+    RecordingSelector selector(exprs);
+    std::vector<RecordingSelector::Candidate> selected =
+        selector.select(SelectTimeoutRecording);
+    std::snprintf(filename, sizeof(filename), "solver-timeout%03u.ptwrite-cfg",
+                  id);
+    if (auto cfg = interpreterHandler->openOutputFile(filename)) {
+      for (const RecordingSelector::Candidate &c : selected) {
+        *cfg << c.ki->getUniqueID() << '\n';
+        os << "  record " << c.ki->getUniqueID() << ": " << c.nodes
+           << " nodes, score " << c.score << ", " << c.bytes << " bytes\n";
+      }
+    }
+  }
+  os.flush();
+}
+
 Executor::StatePair
 Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
+  // concrete-only replay: the trace bit is all that needs checking
+  if (current.concreteOnly && isReplaying(current) && !isInternal) {
+    if (ConstantExpr *CE = dyn_cast<ConstantExpr>(condition)) {
+      bool br = CE->isTrue();
+      if (current.shouldRecord()) {
+        if (!AssertNextBranchTaken(current, br))
+          return StatePair(0, 0);
+        record1BitAtFork(current, br ? Solver::True : Solver::False);
+        ++current.nbranches_rec;
+      }
+      return br ? StatePair(&current, 0) : StatePair(0, &current);
+    }
+    current.concreteOnly = false;
+  }
+
   TimerStatIncrementer timer(stats::forkTime);
   Solver::Validity res;
   std::map< ExecutionState*, std::vector<SeedInfo> >::iterator it =
@@ -1031,14 +1577,69 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
     }
   }
 
-  if (CallSolver || !current.shouldRecord() || isInternal) {
-    time::Span timeout = coreSolverTimeout;
+  // the trace fixes the direction anyway, leave validation to the batch
+  bool deferBranch = ReplayBatchBranches && isReplaying(current) &&
+                     !isInternal && !isSeeding && current.shouldRecord() &&
+                     !isa<ConstantExpr>(condition);
+  // past a replayed prefix, the batch has to hold before the state forks
+  if (!deferBranch && !isInternal &&
+      (!current.deferredBranches.empty() || backgroundChecks.count(&current)) &&
+      !validateDeferredBranches(current))
+    return StatePair(0, 0);
+  if (deferBranch) {
+    condition = current.constraints.simplifyExpr(condition);
+    if (ConstantExpr *CE = dyn_cast<ConstantExpr>(condition)) {
+      res = CE->isTrue() ? Solver::True : Solver::False;
+      deferBranch = false;
+    } else {
+      res = Solver::Unknown;
+    }
+  } else if (CallSolver || !current.shouldRecord() || isInternal) {
+    time::Span timeout =
+        replayBudget && isReplaying(current)
+            ? replayBudget->getTimeout(current.replayPosition,
+                                       coreSolverTimeout)
+            : coreSolverTimeout;
     time::Span fork_queryCost_begin = current.queryCost;
     if (isSeeding)
       timeout *= static_cast<unsigned>(it->second.size());
+
+    // flag the queries likely to time out before the solver gets stuck, so
+    // that the data to record for them is known after this run
+    bool predict = PredictSolverTimeouts && timeout &&
+                   !isa<ConstantExpr>(condition);
+    QueryCostPredictor::Features features;
+    if (predict) {
+      features = QueryCostPredictor::getFeatures(current.constraints, condition);
+      double predicted;
+      if (queryCostPredictor.predict(features, predicted) &&
+          predicted >= PredictedTimeoutFraction * timeout.toSeconds()) {
+        ++stats::predictedSolverTimeouts;
+        if (RecordSolverTimeouts)
+          recordPredictedTimeout(current, condition, predicted, timeout);
+        if (SkipPredictedTimeouts) {
+          current.pc() = current.prevPC();
+          terminateStateEarly(current, "Query predicted to time out (fork).");
+          return StatePair(0, 0);
+        }
+      }
+    }
+
     solver->setTimeout(timeout);
     bool success = solver->evaluate(current, condition, res);
     solver->setTimeout(time::Span());
+    if (replayBudget) {
+      time::Span cost = current.queryCost - fork_queryCost_begin;
+      replayBudget->observeQuery(success ? cost : std::max(cost, timeout));
+    }
+    if (predict) {
+      // a timed out query took at least its budget
+      double seconds = (current.queryCost - fork_queryCost_begin).toSeconds();
+      queryCostPredictor.observe(
+          features, success ? seconds : std::max(seconds, timeout.toSeconds()));
+    }
+    if (!success && timeout)
+      success = retryTimedOutQuery(current, condition, timeout, res);
     current.fork_queryCost += current.queryCost - fork_queryCost_begin;
     if (!success) {
       current.pc() = current.prevPC();
@@ -1063,21 +1664,32 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
   ref<Expr> new_constraint;
   if (!isSeeding) {
     // replaying, read recorded branch condition
-    if (replayPath && !isInternal) {
+    if (isReplaying(current) && !isInternal) {
       if (res==Solver::True) { // Concrete branch
-        if (current.shouldRecord()) {
-          AssertNextBranchTaken(current, true);
-        }
+        if (current.shouldRecord() &&
+            !AssertNextBranchTaken(current, true))
+          return StatePair(0, 0);
+        if (ReplayConcreteFastPath && isa<ConstantExpr>(condition))
+          probeConcreteOnly(current);
       } else if (res==Solver::False) { // Concrete branch
-        if (current.shouldRecord()) {
-          AssertNextBranchTaken(current, false);
-        }
+        if (current.shouldRecord() &&
+            !AssertNextBranchTaken(current, false))
+          return StatePair(0, 0);
+        if (ReplayConcreteFastPath && isa<ConstantExpr>(condition))
+          probeConcreteOnly(current);
       } else {
         // in replay mode, symbolic branch.
         // add constraints according to recorded replayPath
         assert(current.isInUserMain && "We assumed that during replay, uClibc doesn't need recorded path, wrong!");
         assert(!current.isInPOSIX() && "We assumed that no constraints will be added inside POSIX runtime, wrong!");
-        getNextBranchConstraint(current, condition, new_constraint, res);
+        if (!getNextBranchConstraint(current, condition, new_constraint, res))
+          return StatePair(0, 0);
+        if (deferBranch) {
+          if (current.deferredBranches.empty())
+            current.deferredBase = current.constraints.getAllConstraints();
+          current.deferredBranches.push_back(
+              std::make_pair(new_constraint, current.replayPosition - 1));
+        }
       }
     } else if (res==Solver::Unknown) {
       assert(!replayKTest && "in replay mode, only one branch can be true.");
@@ -1112,16 +1724,11 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
       res == Solver::Unknown) {
     bool trueSeed=false, falseSeed=false;
     // Is seed extension still ok here?
-    for (std::vector<SeedInfo>::iterator siit = it->second.begin(),
-           siie = it->second.end(); siit != siie; ++siit) {
-      ref<ConstantExpr> res;
-      bool success =
-        solver->getValue(current, siit->assignment.evaluate(static_cast<const ref<Expr>>(condition)), res);
-      if (!success) {
-        exitOnSolverTimeout(current,
-                             "solver timeout at " __FILE__ ":" __LINE_STRING__);
-      }
-      if (res->isTrue()) {
+    std::vector<BatchEvaluator::Result> seedResults;
+    evaluateSeeds(it->second, std::vector<ref<Expr>>(1, condition),
+                  seedResults);
+    for (unsigned k = 0; k < it->second.size(); ++k) {
+      if (seedSatisfies(current, it->second[k], condition, seedResults[k])) {
         trueSeed = true;
       } else {
         falseSeed = true;
@@ -1157,6 +1764,12 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
       bool valid_constraint = addConstraint(current, new_constraint);
       if (!valid_constraint) {
         terminateStateOnError(current, "add a invalid constraint", Abort);
+      } else if (current.deferredBranches.size() >= ReplayBatchBranches &&
+                 ReplayBatchBranches) {
+        if (ReplayBackgroundChecks)
+          startBackgroundCheck(current);
+        else
+          validateDeferredBranches(current);
       }
     }
     if (res == Solver::True) {
@@ -1169,7 +1782,7 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
     // res is still Solver::Unknown in this branch, which means current state
     // should fork here.
     ExecutionState *falseState, *trueState = &current;
-    if (replayPath) {
+    if (isReplaying(current)) {
       klee_warning("ExecutionState forks in replay mode:");
       current.dumpStack();
     }
@@ -1184,19 +1797,13 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
       it->second.clear();
       std::vector<SeedInfo> &trueSeeds = seedMap[trueState];
       std::vector<SeedInfo> &falseSeeds = seedMap[falseState];
-      for (std::vector<SeedInfo>::iterator siit = seeds.begin(),
-             siie = seeds.end(); siit != siie; ++siit) {
-        ref<ConstantExpr> res;
-        bool success =
-          solver->getValue(current, siit->assignment.evaluate(static_cast<const ref<Expr>>(condition)), res);
-        if (!success) {
-          exitOnSolverTimeout(current, "solver timeout at " __FILE__
-                                      ":" __LINE_STRING__);
-        }
-        if (res->isTrue()) {
-          trueSeeds.push_back(*siit);
+      std::vector<BatchEvaluator::Result> seedResults;
+      evaluateSeeds(seeds, std::vector<ref<Expr>>(1, condition), seedResults);
+      for (unsigned k = 0; k < seeds.size(); ++k) {
+        if (seedSatisfies(current, seeds[k], condition, seedResults[k])) {
+          trueSeeds.push_back(seeds[k]);
         } else {
-          falseSeeds.push_back(*siit);
+          falseSeeds.push_back(seeds[k]);
         }
       }
 
@@ -1211,7 +1818,8 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
       }
       if (swapInfo) {
         std::swap(trueState->coveredNew, falseState->coveredNew);
-        std::swap(trueState->coveredLines, falseState->coveredLines);
+        std::swap(trueState->coveredInstructions,
+                  falseState->coveredInstructions);
       }
     }
 
@@ -1256,6 +1864,31 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
   }
 }
 
+void Executor::evaluateSeeds(const std::vector<SeedInfo> &seeds,
+                             const std::vector<ref<Expr>> &conditions,
+                             std::vector<BatchEvaluator::Result> &results) {
+  std::vector<const Assignment *> assignments;
+  assignments.reserve(seeds.size());
+  for (const SeedInfo &seed : seeds)
+    assignments.push_back(&seed.assignment);
+  BatchEvaluator(conditions).evaluate(assignments, results);
+}
+
+bool Executor::seedSatisfies(ExecutionState &state, SeedInfo &seed,
+                             ref<Expr> condition,
+                             BatchEvaluator::Result result) {
+  if (result != BatchEvaluator::Unknown)
+    return result == BatchEvaluator::Pass;
+  ref<ConstantExpr> res;
+  bool success =
+    solver->getValue(state, seed.assignment.evaluate(condition), res);
+  if (!success) {
+    exitOnSolverTimeout(state, "solver timeout at " __FILE__
+                                ":" __LINE_STRING__);
+  }
+  return res->isTrue();
+}
+
 bool Executor::addConstraint(ExecutionState &state, ref<Expr> condition) {
   if (ConstantExpr *CE = dyn_cast<ConstantExpr>(condition)) {
     if (!CE->isTrue())
@@ -1268,14 +1901,19 @@ bool Executor::addConstraint(ExecutionState &state, ref<Expr> condition) {
     seedMap.find(&state);
   if (it != seedMap.end()) {
     bool warn = false;
-    for (std::vector<SeedInfo>::iterator siit = it->second.begin(),
-           siie = it->second.end(); siit != siie; ++siit) {
-      bool res;
-      bool success =
-        solver->mustBeFalse(state, siit->assignment.evaluate(condition), res);
-      if (!success) {
-        exitOnSolverTimeout(state,
-                             "solver timeout at " __FILE__ ":" __LINE_STRING__);
+    std::vector<BatchEvaluator::Result> seedResults;
+    evaluateSeeds(it->second, std::vector<ref<Expr>>(1, condition),
+                  seedResults);
+    for (unsigned k = 0; k < it->second.size(); ++k) {
+      std::vector<SeedInfo>::iterator siit = it->second.begin() + k;
+      bool res = seedResults[k] == BatchEvaluator::Fail;
+      if (seedResults[k] == BatchEvaluator::Unknown) {
+        bool success =
+          solver->mustBeFalse(state, siit->assignment.evaluate(condition), res);
+        if (!success) {
+          exitOnSolverTimeout(state,
+                               "solver timeout at " __FILE__ ":" __LINE_STRING__);
+        }
       }
       if (res) {
         siit->patchSeed(state, condition, solver);
@@ -1287,7 +1925,7 @@ bool Executor::addConstraint(ExecutionState &state, ref<Expr> condition) {
   }
 
   if (oracle_eval) {
-    ref<Expr> res = oracle_eval->visit(condition);
+    ref<Expr> res = oracle_eval->evaluate(condition);
     if (ConstantExpr *CE = dyn_cast<ConstantExpr>(res)) {
       if (!CE->isTrue()) {
         klee_warning("Oracle KTest: Adding False Constaint");
@@ -1304,9 +1942,43 @@ bool Executor::addConstraint(ExecutionState &state, ref<Expr> condition) {
   if (ivcEnabled)
     doImpliedValueConcretization(state, condition,
                                  ConstantExpr::alloc(1, Expr::Bool));
+  size_t size = state.constraints.size();
+  if (CompactConstraints && size >= CompactConstraints &&
+      size >= 2 * state.constraints.getCompactedSize())
+    compactConstraints(state);
   return valid;
 }
 
+void Executor::compactConstraints(ExecutionState &state) {
+  ConstraintManager old;
+  if (DebugValidateCompaction)
+    old = state.constraints;
+  if (!state.constraints.compact() || !DebugValidateCompaction)
+    return;
+
+  // every constraint of each side is implied by the other side
+  ExprHashSet before(old.begin(), old.end());
+  ExprHashSet after(state.constraints.begin(), state.constraints.end());
+  auto implied = [&](const ConstraintManager &cm, const ref<Expr> &e) {
+    bool res;
+    if (!solver->solver->mustBeTrue(Query(cm, e), res))
+      return true; // a timeout proves nothing either way
+    return res;
+  };
+  for (const ref<Expr> &e : old) {
+    if (!after.count(e) && !implied(state.constraints, e)) {
+      e->dump();
+      klee_error("compaction dropped the constraint above");
+    }
+  }
+  for (const ref<Expr> &e : state.constraints) {
+    if (!before.count(e) && !implied(old, e)) {
+      e->dump();
+      klee_error("compaction added the constraint above");
+    }
+  }
+}
+
 const Cell& Executor::eval(KInstruction *ki, unsigned index,
                            ExecutionState &state) const {
   assert(index < ki->inst->getNumOperands());
@@ -1322,7 +1994,7 @@ const Cell& Executor::eval(KInstruction *ki, unsigned index,
   } else {
     unsigned index = vnumber;
     StackFrame &sf = state.stack().back();
-    return sf.locals[index];
+    return sf.getLocal(index);
   }
 }
 
@@ -1448,10 +2120,6 @@ void Executor::executeGetValue(ExecutionState &state,
 }
 
 void Executor::printDebugInstructions(ExecutionState &state) {
-  // check do not print
-  if (DebugPrintInstructions.getBits() == 0)
-	  return;
-
   llvm::raw_ostream *stream = 0;
   if (DebugPrintInstructions.isSet(STDERR_ALL) ||
       DebugPrintInstructions.isSet(STDERR_SRC) ||
@@ -1465,7 +2133,7 @@ void Executor::printDebugInstructions(ExecutionState &state) {
     (*stream) << "     " << state.pc()->getSourceLocation() << ":";
   }
 
-  (*stream) << state.pc()->info->assemblyLine;
+  (*stream) << state.pc()->info->getAssemblyLine();
 
   if (DebugPrintInstructions.isSet(STDERR_ALL) ||
       DebugPrintInstructions.isSet(FILE_ALL))
@@ -1481,21 +2149,27 @@ void Executor::printDebugInstructions(ExecutionState &state) {
   }
 }
 
+/// The statistic counting the instructions state executes in its current
+/// function.
+static Statistic &instructionCategory(const ExecutionState &state) {
+  if (!state.isInUserMain)
+    return stats::instInit;
+  if (state.isInPOSIX())
+    return stats::instPosix;
+  if (state.isInLIBC())
+    return stats::instLibc;
+  return stats::instMain;
+}
+
+template <bool PrintInstructions>
 void Executor::stepInstruction(ExecutionState &state) {
-  printDebugInstructions(state);
+  if (PrintInstructions)
+    printDebugInstructions(state);
   if (statsTracker)
     statsTracker->stepInstruction(state);
 
   ++stats::instructions;
-  if (!state.isInUserMain) {
-    ++stats::instInit;
-  } else if (state.isInPOSIX()) {
-    ++stats::instPosix;
-  } else if (state.isInLIBC()) {
-    ++stats::instLibc;
-  } else {
-    ++stats::instMain;
-  }
+  ++instructionCategory(state);
   ++state.steppedInstructions;
   state.prevPC() = state.pc();
   ++state.pc();
@@ -1613,6 +2287,11 @@ void Executor::executeCall(ExecutionState &state,
     if (InvokeInst *ii = dyn_cast<InvokeInst>(I))
       transferToBasicBlock(ii->getNormalDest(), I->getParent(), state);
   } else {
+    if (ki && f && specialFunctionHandler->handleNative(state, f, ki, arguments))
+      return;
+    if (ki && f && callNativeFunction(state, ki, f, arguments))
+      return;
+
     // Check if maximum stack size was reached.
     // We currently only count the number of stack frames
     if (RuntimeMaxStackFrames && state.stack().size() > RuntimeMaxStackFrames) {
@@ -1625,7 +2304,17 @@ void Executor::executeCall(ExecutionState &state,
     // guess. This just done to avoid having to pass KInstIterator everywhere
     // instead of the actual instruction, since we can't make a KInstIterator
     // from just an instruction (unlike LLVM).
-    KFunction *kf = kmodule->functionMap[f];
+    KFunction *kf;
+    if (ki && (isa<CallInst>(ki->inst) || isa<InvokeInst>(ki->inst))) {
+      KCallInstruction *kci = static_cast<KCallInstruction *>(ki);
+      if (kci->lastCallee != f) {
+        kci->lastKCallee = kmodule->functionMap[f];
+        kci->lastCallee = f;
+      }
+      kf = kci->lastKCallee;
+    } else {
+      kf = kmodule->functionMap[f];
+    }
 
     state.pushFrame(state.prevPC(), kf);
     state.pc() = kf->instructions;
@@ -1771,6 +2460,177 @@ void Executor::executeCall(ExecutionState &state,
   }
 }
 
+/// The constraint that the unsigned value of e is in [low, high]
+/// Split a vector value into its n lanes of eltBits bits, least significant
+/// first. The lanes are cut from the leaves of the concatenations the value
+/// is built of, so a lane of a vector built by insertelement is taken as is
+/// instead of being extracted through the whole chain.
+static void getVectorLanes(const ref<Expr> &vec, unsigned eltBits, unsigned n,
+                           llvm::SmallVectorImpl<ref<Expr>> &lanes) {
+  // the leaves, least significant first, kept alive by vec
+  llvm::SmallVector<Expr *, 16> leaves, work(1, vec.get());
+  while (!work.empty()) {
+    Expr *e = work.pop_back_val();
+    if (ConcatExpr *ce = dyn_cast<ConcatExpr>(e)) {
+      work.push_back(ce->getLeft().get());
+      work.push_back(ce->getRight().get());
+    } else {
+      leaves.push_back(e);
+    }
+  }
+
+  unsigned leaf = 0, leafOff = 0;
+  for (unsigned i = 0; i < n; ++i) {
+    ref<Expr> lane;
+    for (unsigned need = eltBits; need;) {
+      Expr *e = leaves[leaf];
+      unsigned take = std::min(need, e->getWidth() - leafOff);
+      ref<Expr> part = ExtractExpr::create(e, leafOff, take);
+      lane = lane.isNull() ? part : ConcatExpr::create(part, lane);
+      need -= take;
+      leafOff += take;
+      if (leafOff == e->getWidth()) {
+        ++leaf;
+        leafOff = 0;
+      }
+    }
+    lanes.push_back(lane);
+  }
+}
+
+static ref<Expr> createInRange(ref<Expr> e, uint64_t low, uint64_t high) {
+  Expr::Width width = e->getWidth();
+  if (low == high)
+    return EqExpr::create(e, klee::ConstantExpr::create(low, width));
+  ref<Expr> aboveLow = UleExpr::create(klee::ConstantExpr::create(low, width), e);
+  ref<Expr> belowHigh = UleExpr::create(e, klee::ConstantExpr::create(high, width));
+  if (low == 0)
+    return belowHigh;
+  if (high == (width == 64 ? UINT64_MAX : (UINT64_C(1) << width) - 1))
+    return aboveLow;
+  return AndExpr::create(aboveLow, belowHigh);
+}
+
+void Executor::executeSwitchOnSegments(ExecutionState &state,
+                                       KSwitchInstruction *ksi,
+                                       ref<Expr> cond) {
+  SwitchInst *si = cast<SwitchInst>(ksi->inst);
+  BasicBlock *parentbb = si->getParent();
+  const std::vector<KSwitchInstruction::Segment> &segments = ksi->segments;
+  std::vector<ref<Expr> > conditions;
+  std::vector<ExecutionState *> branches;
+
+  if (state.shouldRecord() && isReplaying(state)) {
+    PathEntry pe;
+    if (!getNextPathEntry(state, pe))
+      return;
+    PathEntry::switchIndex_t index = pe.body.switchIndex;
+    ref<Expr> constraint = ConstantExpr::alloc(0, Expr::Bool);
+    BasicBlock *target;
+    if (pe.t == PathEntry::SWITCH_EXPIDX) {
+      if (index >= si->getNumSuccessors()) {
+        replayDiverged(state, state.replayPosition - 1,
+                       "invalid recorded EXPIDX",
+                       ReplayDivergenceReport::describe(pe),
+                       std::to_string(si->getNumSuccessors()) + " successors",
+                       false);
+        return;
+      }
+      target = si->getSuccessor(index);
+      if (index == 0) {
+        // the values of no case
+        for (const KSwitchInstruction::Segment &s : segments)
+          if (s.isDefault)
+            constraint = OrExpr::create(
+                constraint, createInRange(cond, s.low, s.high));
+      } else {
+        SwitchInst::CaseIt caseit =
+            SwitchInst::CaseIt::fromSuccessorIndex(si, index);
+        constraint =
+            EqExpr::create(cond, evalConstant(caseit->getCaseValue()));
+      }
+    } else if (pe.t == PathEntry::SWITCH_BBIDX) {
+      if (index >= ksi->successors.size()) {
+        replayDiverged(state, state.replayPosition - 1,
+                       "Invalid recorded BBIDX",
+                       ReplayDivergenceReport::describe(pe),
+                       std::to_string(ksi->successors.size()) +
+                           " basic blocks",
+                       false);
+        return;
+      }
+      target = ksi->successors[index];
+      for (const KSwitchInstruction::Segment &s : segments)
+        if (s.successor == index)
+          constraint =
+              OrExpr::create(constraint, createInRange(cond, s.low, s.high));
+    } else {
+      replayDiverged(state, state.replayPosition - 1,
+                     "When replaying Instruction::Switch symbolic "
+                     "condition, wrong PathEntry type",
+                     ReplayDivergenceReport::describe(pe),
+                     "SWITCH_EXPIDX or SWITCH_BBIDX", false);
+      return;
+    }
+    conditions.push_back(constraint);
+    branch(state, conditions, branches);
+    dumpStateAtBranch(state, pe, conditions[0]);
+    if (branches[0])
+      transferToBasicBlock(target, parentbb, *branches[0]);
+    return;
+  }
+
+  // Find the feasible segments along a binary decision tree: a run of
+  // segments is only split while cond may be in it, so a switch with k
+  // feasible segments out of n takes O(k log n) range queries instead of a
+  // query per case.
+  std::map<const BasicBlock *, ref<Expr> > branchTargets;
+  std::vector<std::pair<size_t, size_t> > runs(
+      1, std::make_pair(size_t(0), segments.size()));
+  while (!runs.empty()) {
+    size_t begin = runs.back().first, end = runs.back().second;
+    runs.pop_back();
+    ref<Expr> inRun =
+        createInRange(cond, segments[begin].low, segments[end - 1].high);
+    // the segments cover all values
+    if (begin != 0 || end != segments.size()) {
+      bool feasible;
+      if (!solver->mayBeTrue(state, inRun, feasible))
+        exitOnSolverTimeout(state, "solver timeout at " __FILE__
+                                   ":" __LINE_STRING__);
+      if (!feasible)
+        continue;
+    }
+    if (end - begin == 1) {
+      const BasicBlock *target = ksi->successors[segments[begin].successor];
+      auto insret = branchTargets.insert(
+          std::make_pair(target, ConstantExpr::alloc(0, Expr::Bool)));
+      insret.first->second = OrExpr::create(insret.first->second, inRun);
+      continue;
+    }
+    size_t mid = begin + (end - begin) / 2;
+    runs.push_back(std::make_pair(mid, end));
+    runs.push_back(std::make_pair(begin, mid));
+  }
+
+  for (auto &t : branchTargets)
+    conditions.push_back(t.second);
+  branch(state, conditions, branches);
+  PathEntry pe;
+  pe.t = PathEntry::SWITCH_BBIDX;
+  auto target = branchTargets.begin();
+  for (auto forked = branches.begin();
+       target != branchTargets.end() && forked != branches.end();
+       ++target, ++forked) {
+    if (*forked) {
+      pe.body.switchIndex = ksi->successorIndex.find(target->first)->second;
+      dumpStateAtBranch(**forked, pe, target->second);
+      transferToBasicBlock(target->first, parentbb, **forked);
+    }
+  }
+  openAutoMerge(parentbb, branches);
+}
+
 void Executor::transferToBasicBlock(const BasicBlock *dst, BasicBlock *src,
                                     ExecutionState &state) {
   // Note that in general phi nodes can reuse phi values from the same
@@ -1825,9 +2685,84 @@ Function* Executor::getTargetFunction(Value *calledVal, ExecutionState &state) {
   }
 }
 
+bool Executor::executeFastInstruction(ExecutionState &state,
+                                      KInstruction *ki) {
+  ConstantExpr *c = dyn_cast<ConstantExpr>(eval(ki, 0, state).value);
+  if (!c)
+    return false;
+
+  if (ki->fastOp == KFastOp::Select) {
+    ++stats::concreteSelect;
+    bindLocal(ki, state, eval(ki, c->isTrue() ? 1 : 2, state).value);
+    return true;
+  }
+
+  unsigned width = c->getWidth();
+  if (width > 64)
+    return false;
+  uint64_t a = c->getZExtValue(width);
+  auto sext = [width](uint64_t v) -> int64_t {
+    return width == 64 ? (int64_t)v : (int64_t)(v << (64 - width)) >>
+                                          (64 - width);
+  };
+
+  auto bindInt = [&](uint64_t v, unsigned w) {
+    uint64_t m = w == 64 ? ~0ULL : (1ULL << w) - 1;
+    bindLocal(ki, state, ConstantExpr::alloc(v & m, w));
+    return true;
+  };
+  auto bindBool = [&](bool v) {
+    bindLocal(ki, state, ConstantExpr::alloc(v, Expr::Bool));
+    return true;
+  };
+
+  switch (ki->fastOp) {
+  case KFastOp::ZExt:
+  case KFastOp::Trunc:
+    return bindInt(a, ki->fastWidth);
+  case KFastOp::SExt:
+    return bindInt((uint64_t)sext(a), ki->fastWidth);
+  default:
+    break;
+  }
+
+  ConstantExpr *d = dyn_cast<ConstantExpr>(eval(ki, 1, state).value);
+  if (!d || d->getWidth() != width)
+    return false;
+  uint64_t b = d->getZExtValue(width);
+
+  switch (ki->fastOp) {
+  case KFastOp::Add: return bindInt(a + b, width);
+  case KFastOp::Sub: return bindInt(a - b, width);
+  case KFastOp::Mul: return bindInt(a * b, width);
+  case KFastOp::And: return bindInt(a & b, width);
+  case KFastOp::Or: return bindInt(a | b, width);
+  case KFastOp::Xor: return bindInt(a ^ b, width);
+  // oversized shifts are left to the generic path and its diagnostics
+  case KFastOp::Shl: return b < width && bindInt(a << b, width);
+  case KFastOp::LShr: return b < width && bindInt(a >> b, width);
+  case KFastOp::AShr:
+    return b < width && bindInt((uint64_t)(sext(a) >> b), width);
+  case KFastOp::Eq: return bindBool(a == b);
+  case KFastOp::Ne: return bindBool(a != b);
+  case KFastOp::Ugt: return bindBool(a > b);
+  case KFastOp::Uge: return bindBool(a >= b);
+  case KFastOp::Ult: return bindBool(a < b);
+  case KFastOp::Ule: return bindBool(a <= b);
+  case KFastOp::Sgt: return bindBool(sext(a) > sext(b));
+  case KFastOp::Sge: return bindBool(sext(a) >= sext(b));
+  case KFastOp::Slt: return bindBool(sext(a) < sext(b));
+  case KFastOp::Sle: return bindBool(sext(a) <= sext(b));
+  default:
+    return false;
+  }
+}
+
 void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   Instruction *i = ki->inst;
   ++ki->frequency;
+  if (ki->fastOp != KFastOp::None && executeFastInstruction(state, ki))
+    return;
   switch (i->getOpcode()) {
     // Control flow
   case Instruction::Ret: {
@@ -1934,6 +2869,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
         transferToBasicBlock(bi->getSuccessor(0), bi->getParent(), *branches.first);
       if (branches.second)
         transferToBasicBlock(bi->getSuccessor(1), bi->getParent(), *branches.second);
+      if (branches.first && branches.second)
+        openAutoMerge(bi->getParent(), {branches.first, branches.second});
     }
     break;
   }
@@ -1941,6 +2878,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     TimerStatIncrementer timer(stats::indirectBrTime);
     // implements indirect branch to a label within the current function
     const auto bi = cast<IndirectBrInst>(i);
+    KIndirectBrInstruction *kbi = static_cast<KIndirectBrInstruction *>(ki);
     BasicBlock *parentbb = bi->getParent();
     auto address = eval(ki, 0, state).value;
 
@@ -1951,100 +2889,121 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
     address = toUnique(state, address);
 
-    // parse the IndirectBr instruction, order unique destination BasicBlocks deterministicly
-    const auto numDestinations = bi->getNumDestinations();
-    // bbindexMap map each feasible succeeding basicblock to a unique index
-    std::map<const BasicBlock*, PathEntry::indirectbrIndex_t> bbindexMap;
-    // BBindex2bb map each possible unique index (not necessarily feasible) to
-    // the corresponding succeeding basicblock pointer (NULL if the successor is unfeasible)
-    std::vector<const BasicBlock *> BBindex2bb;
-    BBindex2bb.reserve(numDestinations);
-    // index2exp map each possible unique index (not necessarily feasible) to
-    // the corresponding constraint expression (NULL if the successor is unfeasible)
-    std::vector<ref<Expr>> index2exp;
-    index2exp.reserve(numDestinations);
-
-    ref<Expr> errorCase = ConstantExpr::alloc(1, Expr::Bool);
-    // FIXME: the 5 here seems like an arbitrary value
-    SmallPtrSet<BasicBlock *, 5> destinations;
-    // collect and check destinations from label list
-    PathEntry::indirectbrIndex_t bbindex = 0;
-    for (unsigned k = 0; k < numDestinations; ++k) {
-      // filter duplicates
-      const auto d = bi->getDestination(k);
-      if (destinations.count(d)) continue;
-      destinations.insert(d);
+    // concrete address
+    if (const auto CE = dyn_cast<ConstantExpr>(address.get())) {
+      auto bbindex_find_it = kbi->destinationIndex.find(
+          CE->getZExtValue(Context::get().getPointerWidth()));
+      if (bbindex_find_it == kbi->destinationIndex.end()) {
+        terminateStateOnExecError(state, "indirectbr: illegal label address");
+        break;
+      }
+      PathEntry::indirectbrIndex_t bbindex = bbindex_find_it->second;
+      if (state.shouldRecord()) { // need to consider record/replay
+        PathEntry pe;
+        if (isReplaying(state)) {
+          // replaying, check
+          if (!getNextPathEntry(state, pe))
+            break;
+          if (pe.t != PathEntry::INDIRECTBR) {
+            replayDiverged(state, state.replayPosition - 1,
+                           "When replaying Instruction::IndirectBr concrete "
+                           "address, wrong PathEntry Type",
+                           ReplayDivergenceReport::describe(pe), "INDIRECTBR",
+                           false);
+            break;
+          }
+          if (pe.body.indirectbrIndex != bbindex) {
+            std::string expected = ReplayDivergenceReport::describe(pe);
+            pe.body.indirectbrIndex = bbindex;
+            if (!replayDiverged(state, state.replayPosition - 1,
+                                "When replaying Instruction::IndirectBr, "
+                                "recorded index mismatch",
+                                expected, ReplayDivergenceReport::describe(pe),
+                                true))
+              break;
+          }
+        }
+        else {
+          pe.t = PathEntry::INDIRECTBR;
+          pe.body.indirectbrIndex = bbindex;
+        }
+        dumpStateAtBranch(state, pe, CE);
+      }
+      transferToBasicBlock(kbi->destinations[bbindex], parentbb, state);
+      break;
+    }
+
+    // the unique destinations, ordered deterministically by KModule
+    const auto numDestinations = kbi->destinations.size();
+    // BBindex2bb map each possible unique index (not necessarily feasible) to
+    // the corresponding succeeding basicblock pointer (NULL if the successor is unfeasible)
+    std::vector<const BasicBlock *> BBindex2bb;
+    BBindex2bb.reserve(numDestinations);
+    // index2exp map each possible unique index (not necessarily feasible) to
+    // the corresponding constraint expression (NULL if the successor is unfeasible)
+    std::vector<ref<Expr>> index2exp;
+    index2exp.reserve(numDestinations);
+    unsigned numFeasible = 0;
 
+    ref<Expr> errorCase = ConstantExpr::alloc(1, Expr::Bool);
+    // the address expressions of the destinations from the label list, then
+    // errorCase, whose feasibility is checked in one batch
+    std::vector<ref<Expr>> conditions;
+    conditions.reserve(numDestinations + 1);
+    for (BasicBlock *d : kbi->destinations) {
       // create address expression
       const auto PE = Expr::createPointer(reinterpret_cast<std::uint64_t>(d));
       ref<Expr> e = EqExpr::create(address, PE);
 
       // exclude address from errorCase
       errorCase = AndExpr::create(errorCase, Expr::createIsZero(e));
-
-      // check feasibility
-      bool result;
-      bool success = solver->mayBeTrue(state, e, result);
-      if (!success) {
-        exitOnSolverTimeout(state,
-                             "solver timeout at " __FILE__ ":" __LINE_STRING__);
-      }
-      if (result) {
-        bbindexMap[d] = bbindex;
-        BBindex2bb.push_back(d);
-        index2exp.push_back(e);
-      }
-      else {
-        BBindex2bb.push_back(NULL);
-        index2exp.push_back(NULL);
-      }
-      ++bbindex;
+      conditions.push_back(e);
     }
-    assert((BBindex2bb.size() == bbindex) && (index2exp.size() == bbindex) && "bb or expr size mismatch");
-    // check errorCase feasibility
-    bool isErrorCaseFeasible;
-    bool success = solver->mayBeTrue(state, errorCase, isErrorCaseFeasible);
+    conditions.push_back(errorCase);
+
+    std::vector<bool> feasible;
+    bool success = solver->mayBeTrue(state, conditions, feasible);
     if (!success) {
       exitOnSolverTimeout(state,
                            "solver timeout at " __FILE__ ":" __LINE_STRING__);
     }
-
-    // concrete address
-    if (const auto CE = dyn_cast<ConstantExpr>(address.get())) {
-      const auto bb_address = (BasicBlock *) CE->getZExtValue(Context::get().getPointerWidth());
-      auto bbindex_find_it = bbindexMap.find(bb_address);
-      assert((bbindex_find_it != bbindexMap.end()) &&
-          "Can't find this concrete basicblock address, it may never exist or it is unfeasible");
-      if (state.shouldRecord()) { // need to consider record/replay
-        PathEntry pe;
-        if (replayPath) {
-          // replaying, check
-          getNextPathEntry(state, pe);
-          assert((pe.t == PathEntry::INDIRECTBR) &&
-              "When replaying Instruction::IndirectBr concrete address, wrong PathEntry Type");
-          assert((pe.body.indirectbrIndex == bbindex_find_it->second) &&
-              "When replaying Instruction::IndirectBr, recorded index mismatch");
-        }
-        else {
-          pe.t = PathEntry::INDIRECTBR;
-          pe.body.indirectbrIndex = bbindex_find_it->second;
-        }
-        dumpStateAtBranch(state, pe, CE);
+    for (unsigned j = 0; j < numDestinations; ++j) {
+      if (feasible[j]) {
+        BBindex2bb.push_back(kbi->destinations[j]);
+        index2exp.push_back(conditions[j]);
+        ++numFeasible;
+      }
+      else {
+        BBindex2bb.push_back(NULL);
+        index2exp.push_back(NULL);
       }
-      transferToBasicBlock(bb_address, parentbb, state);
-      break;
     }
+    bool isErrorCaseFeasible = feasible[numDestinations];
 
     // symbolic address
     std::vector<ExecutionState *> branches;
-    if (state.shouldRecord() && replayPath) {
+    if (state.shouldRecord() && isReplaying(state)) {
       PathEntry pe;
-      getNextPathEntry(state, pe);
-      assert((pe.t == PathEntry::INDIRECTBR) &&
-          "When replaying Instruction::IndirectBr symbolic address, wrong PathEntry Type");
+      if (!getNextPathEntry(state, pe))
+        break;
+      if (pe.t != PathEntry::INDIRECTBR) {
+        replayDiverged(state, state.replayPosition - 1,
+                       "When replaying Instruction::IndirectBr symbolic "
+                       "address, wrong PathEntry Type",
+                       ReplayDivergenceReport::describe(pe), "INDIRECTBR",
+                       false);
+        break;
+      }
       PathEntry::indirectbrIndex_t index = pe.body.indirectbrIndex;
-      assert((index < bbindex) && (BBindex2bb[index]) &&
-          "When replaying Instruction::IndirectBr symbolic address, recorded index is invalid");
+      if (index >= numDestinations || !BBindex2bb[index]) {
+        replayDiverged(state, state.replayPosition - 1,
+                       "When replaying Instruction::IndirectBr symbolic "
+                       "address, recorded index is invalid",
+                       ReplayDivergenceReport::describe(pe),
+                       std::to_string(numDestinations) + " destinations",
+                       false);
+        break;
+      }
       branch(state, std::vector<ref<Expr>>{index2exp[index]}, branches);
       assert((branches.size() > 0) && (branches[0] != NULL));
       dumpStateAtBranch(state, pe, index2exp[index]);
@@ -2068,6 +3027,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
         terminateStateOnExecError(*branches.back(), "indirectbr: illegal label address");
         branches.pop_back();
       }
+      openAutoMerge(parentbb, branches);
       // dump PathEntry
       PathEntry pe;
       pe.t = PathEntry::INDIRECTBR;
@@ -2085,7 +3045,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
       }
       // branch states to resp. target blocks
       state_it = branches.begin();
-      assert(bbindexMap.size() == branches.size());
+      assert(numFeasible == branches.size());
       // iterate all succeeding basicblock again since `branches` is corresponding to feasible successors only.
       for (auto bbp: BBindex2bb) {
         if (bbp) { // BasicBlock * != NULL
@@ -2121,36 +3081,12 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     //   distinct SuccessorIndex (multiple cases are mapped to the same
     //   successive BB).
 
-    // map basicblocks (regardless of feasibility) to corresponding unique index
-    std::map<const BasicBlock*, PathEntry::switchIndex_t> bbindexMap;
-    // map unique index to corresponding basicblocks (regardless of feasibility), no NULL here
-    std::vector<const BasicBlock *> BBindex2bb;
-
-    // Iterate through all non-default cases and order them by expressions
-    PathEntry::switchIndex_t bbindex = 0;
-    for (auto i : si->cases()) {
-      BasicBlock *caseSuccessor = i.getCaseSuccessor();
-      std::pair<std::map<const BasicBlock*, PathEntry::switchIndex_t>::iterator, bool>
-        insert_res = bbindexMap.insert(std::make_pair(
-              caseSuccessor, bbindex));
-      if (insert_res.second) { // first time see a BB
-        ++bbindex;
-        BBindex2bb.push_back(caseSuccessor);
-      }
-    }
-    { // handle default destination separately
-      BasicBlock *defaultDest = si->getDefaultDest();
-      std::pair<std::map<const BasicBlock*, PathEntry::switchIndex_t>::iterator, bool>
-        insert_res = bbindexMap.insert(std::make_pair(
-              defaultDest, bbindex));
-      if (insert_res.second) {
-        ++bbindex;
-        BBindex2bb.push_back(defaultDest);
-      }
-    }
-    assert(BBindex2bb.size() == bbindex);
+    // The distinct successor basicblocks (regardless of feasibility) and
+    // their unique indices are computed by KModule, see KSwitchInstruction
+    KSwitchInstruction *ksi = static_cast<KSwitchInstruction *>(ki);
+    const std::vector<BasicBlock *> &BBindex2bb = ksi->successors;
 
-    if (state.shouldRecord() && replayPath) {
+    if (state.shouldRecord() && isReplaying(state)) {
       ; // replaying, do not try to simplify cond
     }
     else {
@@ -2161,24 +3097,43 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
     // concrete switch condition
     if (ConstantExpr *CE = dyn_cast<ConstantExpr>(cond)) {
-      // Somewhat gross to create these all the time, but fine till we
-      // switch to an internal rep.
-      llvm::IntegerType *Ty = cast<IntegerType>(si->getCondition()->getType());
-      ConstantInt *ci = ConstantInt::get(Ty, CE->getZExtValue());
-#if LLVM_VERSION_CODE >= LLVM_VERSION(5, 0)
-      SwitchInst::CaseIt caseit = si->findCaseValue(ci);
-      BasicBlock* succbb = caseit->getCaseSuccessor();
-      PathEntry::switchIndex_t exp_idx = caseit->getSuccessorIndex();
-#else
-#error "Haven't tried SwitchInst::CaseIt in llvm < 5.0"
-      BasicBlock *succbb = si->findCaseValue(ci).getCaseSuccessor();
-#endif
+      PathEntry::switchIndex_t exp_idx;
+      if (!ksi->jumpTable.empty()) {
+        // wraps around below tableBase
+        uint64_t slot = CE->getZExtValue() - ksi->tableBase;
+        exp_idx = slot < ksi->jumpTable.size() ? ksi->jumpTable[slot] : 0;
+      } else if (CE->getWidth() <= 64) {
+        auto case_it = ksi->caseIndex.find(CE->getZExtValue());
+        // the default case is successor 0
+        exp_idx = case_it != ksi->caseIndex.end() ? case_it->second : 0;
+      } else {
+        ConstantInt *ci = ConstantInt::get(si->getContext(), CE->getAPValue());
+        exp_idx = si->findCaseValue(ci)->getSuccessorIndex();
+      }
+      BasicBlock *succbb = si->getSuccessor(exp_idx);
       if (state.shouldRecord()) { // need to consider record/replay
         PathEntry pe;
-        if (replayPath) { // replaying
-          getNextPathEntry(state, pe);
-          assert((pe.t == PathEntry::SWITCH_EXPIDX) && "When replaying Instruction::Switch concrete condition, wrong PathEntry Type");
-          assert((pe.body.switchIndex == exp_idx) && "When replaying Instruction::Switch concrete condition, recorded index mismatch");
+        if (isReplaying(state)) { // replaying
+          if (!getNextPathEntry(state, pe))
+            break;
+          if (pe.t != PathEntry::SWITCH_EXPIDX) {
+            replayDiverged(state, state.replayPosition - 1,
+                           "When replaying Instruction::Switch concrete "
+                           "condition, wrong PathEntry Type",
+                           ReplayDivergenceReport::describe(pe),
+                           "SWITCH_EXPIDX", false);
+            break;
+          }
+          if (pe.body.switchIndex != exp_idx) {
+            std::string expected = ReplayDivergenceReport::describe(pe);
+            pe.body.switchIndex = exp_idx;
+            if (!replayDiverged(state, state.replayPosition - 1,
+                                "When replaying Instruction::Switch concrete "
+                                "condition, recorded index mismatch",
+                                expected, ReplayDivergenceReport::describe(pe),
+                                true))
+              break;
+          }
         }
         else { // not replaying
           pe.t = PathEntry::SWITCH_EXPIDX;
@@ -2187,6 +3142,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
         dumpStateAtBranch(state, pe, CE);
       }
       transferToBasicBlock(succbb, parentbb, state);
+    } else if (!ksi->segments.empty()) {
+      executeSwitchOnSegments(state, ksi, cond);
     } else {
       // Handle possible different (symbolic) branch targets
 
@@ -2222,15 +3179,24 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
       std::vector<ref<Expr>> conditions;
       // used to store the forked state(s) returned by Executor::branch
       std::vector<ExecutionState*> branches;
-      if (state.shouldRecord() && replayPath) {
+      if (state.shouldRecord() && isReplaying(state)) {
         // replay
         PathEntry pe;
-        getNextPathEntry(state, pe);
+        if (!getNextPathEntry(state, pe))
+          break;
         if (pe.t == PathEntry::SWITCH_EXPIDX) {
           // replay a concrete switch decision, the cond should equal
           //   the corresponding case value
           PathEntry::switchIndex_t index = pe.body.switchIndex;
-          assert(index < si->getNumSuccessors() && "invalid recorded EXPIDX");
+          if (index >= si->getNumSuccessors()) {
+            replayDiverged(state, state.replayPosition - 1,
+                           "invalid recorded EXPIDX",
+                           ReplayDivergenceReport::describe(pe),
+                           std::to_string(si->getNumSuccessors()) +
+                               " successors",
+                           false);
+            break;
+          }
           conditions.push_back(cases_constraints[index]);
           branch(state, conditions, branches);
           dumpStateAtBranch(state, pe, conditions[0]);
@@ -2241,7 +3207,14 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
           //   case value (disjunction of equations)
           //   having the corresponding successor basicblock
           PathEntry::switchIndex_t index = pe.body.switchIndex;
-          assert(index < BBindex2bb.size() &&  "Invalid recorded BBIDX");
+          if (index >= BBindex2bb.size()) {
+            replayDiverged(state, state.replayPosition - 1,
+                           "Invalid recorded BBIDX",
+                           ReplayDivergenceReport::describe(pe),
+                           std::to_string(BBindex2bb.size()) + " basic blocks",
+                           false);
+            break;
+          }
           const BasicBlock *targetBB = BBindex2bb[index];
           // init this disjunction form to false
           ref<Expr> new_constraint = ConstantExpr::alloc(0, Expr::Bool);
@@ -2266,8 +3239,11 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
           transferToBasicBlock(targetBB, parentbb, *(branches[0]));
         }
         else {
-          klee_error("When replaying Instruction::Switch symbolic condition, wrong PathEntry type: %d", pe.t);
-          terminateStateOnError(state, "Wrong PathEntry type", ReplayPath);
+          replayDiverged(state, state.replayPosition - 1,
+                         "When replaying Instruction::Switch symbolic "
+                         "condition, wrong PathEntry type",
+                         ReplayDivergenceReport::describe(pe),
+                         "SWITCH_EXPIDX or SWITCH_BBIDX", false);
           break;
         }
       }
@@ -2276,18 +3252,19 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
         // tracking the constraints expression associated with each feasible basicblock
         std::map<const BasicBlock *, ref<Expr> > branchTargets;
+        // the feasibility of all cases is checked in one batch
+        std::vector<bool> feasible;
+        bool success = solver->mayBeTrue(state, cases_constraints, feasible);
+        if (!success) {
+          exitOnSolverTimeout(state, "solver timeout at " __FILE__
+                                      ":" __LINE_STRING__);
+        }
         for (unsigned int succ_idx = 0;
             succ_idx < si->getNumSuccessors(); ++succ_idx) {
           SwitchInst::CaseIt caseit =
             SwitchInst::CaseIt::fromSuccessorIndex(si, succ_idx);
-          bool result;
           ref<Expr> &match = cases_constraints[caseit->getSuccessorIndex()];
-          bool success = solver->mayBeTrue(state, match, result);
-          if (!success) {
-            exitOnSolverTimeout(state, "solver timeout at " __FILE__
-                                        ":" __LINE_STRING__);
-          }
-          if (result) {
+          if (feasible[caseit->getSuccessorIndex()]) {
             const BasicBlock *caseSuccessor = caseit->getCaseSuccessor();
             // Handle the case that a basic block might be the target of multiple
             // switch cases.
@@ -2315,13 +3292,14 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
         for (; (target != branchTargets.end()) && (forked_state != branches.end())
              ; target++, forked_state++) {
           if (*forked_state) { // Executor::branch returned valid state
-            auto find_it = bbindexMap.find(target->first);
-            assert(find_it != bbindexMap.end() && "invalid target BB*");
+            auto find_it = ksi->successorIndex.find(target->first);
+            assert(find_it != ksi->successorIndex.end() && "invalid target BB*");
             pe.body.switchIndex = find_it->second;
             dumpStateAtBranch(**forked_state, pe, target->second);
             transferToBasicBlock(target->first, parentbb, **forked_state);
           }
         }
+        openAutoMerge(parentbb, branches);
       }
     }
     break;
@@ -2352,7 +3330,10 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
         KInstruction *recKI = kmodule->getKInstruction(recI);
         assert(recKI != nullptr);
 
-        tryLoadDataRecording(state, recKI);
+        if (MDNode *part = recI->getMetadata(PTWritePass::partMetadata))
+          tryLoadDataRecordingPart(state, recKI, part);
+        else
+          tryLoadDataRecording(state, recKI);
         tryStoreDataRecording(state, recKI);
         break;
       }
@@ -2443,10 +3424,20 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     } else {
       ref<Expr> v = eval(ki, 0, state).value;
 
-      if (isa<ConstantExpr>(v))
+      // a concrete pointer resolves to itself, without a query and a fork
+      if (ConstantExpr *CE = dyn_cast<ConstantExpr>(v)) {
         ++stats::concreteCall;
-      else
-        ++stats::symbolicCall;
+        uint64_t addr = CE->getZExtValue();
+        KCallInstruction *kci = static_cast<KCallInstruction *>(ki);
+        if (addr == reinterpret_cast<uint64_t>(kci->lastCallee) ||
+            legalFunctions.count(addr))
+          executeCall(state, ki, reinterpret_cast<Function *>(addr),
+                      arguments);
+        else
+          terminateStateOnExecError(state, "invalid function pointer");
+        break;
+      }
+      ++stats::symbolicCall;
 
       ExecutionState *free = &state;
       bool hasInvalid = false, first = true;
@@ -2730,12 +3721,18 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
   case Instruction::Load: {
     ref<Expr> base = eval(ki, 0, state).value;
+    if (ki->concrete &&
+        executeConcreteMemoryOperation(state, false, base, 0, ki))
+      break;
     executeMemoryOperation(state, false, base, 0, ki);
     break;
   }
   case Instruction::Store: {
     ref<Expr> base = eval(ki, 1, state).value;
     ref<Expr> value = eval(ki, 0, state).value;
+    if (ki->concrete &&
+        executeConcreteMemoryOperation(state, true, base, value, ki))
+      break;
     executeMemoryOperation(state, true, base, value, ki);
     break;
   }
@@ -3138,17 +4135,27 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
       return;
     }
 
+    assert(Context::get().isLittleEndian() && "FIXME:Broken for big endian");
+    ConstantExpr *cVec = dyn_cast<ConstantExpr>(vec);
+    ConstantExpr *cElt = dyn_cast<ConstantExpr>(newElt);
+    if (cVec && cElt) {
+      // a concrete vector stays a single constant
+      unsigned width = cVec->getWidth(), bitOffset = EltBits * iIdx;
+      llvm::APInt value = cVec->getAPValue() &
+                          ~llvm::APInt::getBitsSet(width, bitOffset,
+                                                   bitOffset + EltBits);
+      value |= cElt->getAPValue().zext(width).shl(bitOffset);
+      bindLocal(ki, state, ConstantExpr::alloc(value));
+      break;
+    }
+
     const unsigned elementCount = vt->getNumElements();
     llvm::SmallVector<ref<Expr>, 8> elems;
     elems.reserve(elementCount);
-    for (unsigned i = elementCount; i != 0; --i) {
-      auto of = i - 1;
-      unsigned bitOffset = EltBits * of;
-      elems.push_back(
-          of == iIdx ? newElt : ExtractExpr::create(vec, bitOffset, EltBits));
-    }
-
-    assert(Context::get().isLittleEndian() && "FIXME:Broken for big endian");
+    getVectorLanes(vec, EltBits, elementCount, elems);
+    elems[iIdx] = newElt;
+    // ConcatExpr::createN takes the most significant lane first
+    std::reverse(elems.begin(), elems.end());
     ref<Expr> Result = ConcatExpr::createN(elementCount, elems.data());
     bindLocal(ki, state, Result);
     break;
@@ -3222,6 +4229,8 @@ void Executor::updateStates(ExecutionState *current) {
       seedMap.find(es);
     if (it3 != seedMap.end())
       seedMap.erase(it3);
+    if (!backgroundChecks.empty())
+      cancelBackgroundCheck(*es);
     processTree->remove(es->ptreeNode);
     delete es;
   }
@@ -3304,23 +4313,42 @@ void Executor::bindModuleConstants() {
   }
 }
 
-void Executor::checkMemoryUsage() {
-  if (!MaxMemory)
-    return;
-  if ((stats::instructions & 0xFFFF) == 0) {
-    // We need to avoid calling GetTotalMallocUsage() often because it
-    // is O(elts on freelist). This is really bad since we start
-    // to pummel the freelist once we hit the memory cap.
-    unsigned mbs = (util::GetTotalMallocUsage() >> 20) +
-                   (memory->getUsedDeterministicSize() >> 20);
-
-    if (mbs > MaxMemory) {
-      if (mbs > MaxMemory + 100) {
-        // just guess at how many to kill
-        unsigned numStates = states.size();
-        unsigned toKill = std::max(1U, numStates - numStates * MaxMemory / mbs);
-        klee_warning("killing %d states (over memory cap)", toKill);
-        std::vector<ExecutionState *> arr(states.begin(), states.end());
+void Executor::checkMemoryUsage(uint64_t mallocUsage) {
+  unsigned mbs = (mallocUsage >> 20) +
+                 (memory->getUsedDeterministicSize() >> 20);
+
+  if (mbs > MaxMemory) {
+    if (mbs > MaxMemory + 100) {
+      // just guess at how many to drop
+      unsigned numStates = states.size();
+      unsigned toKill = std::max(1U, numStates - numStates * MaxMemory / mbs);
+      bool spill = MaxMemoryAction == MemoryLimitAction::Spill;
+      klee_warning("%s %d states (over memory cap)",
+                   spill ? "spilling" : "killing", toKill);
+      std::string breakdown;
+      for (unsigned i = 0; i < util::NumMemoryTags; ++i) {
+        util::MemoryTag tag = (util::MemoryTag)i;
+        breakdown += std::string(i ? ", " : "") +
+                     util::GetMemoryTagName(tag) + " " +
+                     std::to_string(util::GetTaggedMemoryUsage(tag) >> 20) +
+                     " MB";
+      }
+      klee_warning("memory by subsystem: %s", breakdown.c_str());
+      std::vector<ExecutionState *> arr(states.begin(), states.end());
+      if (spill) {
+        // coldest first, and the ones that covered new code last among
+        // those scheduled at the same time
+        toKill = std::min<unsigned>(toKill, arr.size());
+        std::partial_sort(arr.begin(), arr.begin() + toKill, arr.end(),
+                          [](const ExecutionState *a,
+                             const ExecutionState *b) {
+                            if (a->lastScheduled != b->lastScheduled)
+                              return a->lastScheduled < b->lastScheduled;
+                            return !a->coveredNew && b->coveredNew;
+                          });
+        for (unsigned i = 0; i < toKill; ++i)
+          spillState(*arr[i]);
+      } else {
         for (unsigned i = 0, N = arr.size(); N && i < toKill; ++i, --N) {
           unsigned idx = rand() % N;
           // Make two pulls to try and not hit a state that
@@ -3332,13 +4360,29 @@ void Executor::checkMemoryUsage() {
           terminateStateEarly(*arr[N - 1], "Memory limit exceeded.");
         }
       }
-      atMemoryLimit = true;
-    } else {
-      atMemoryLimit = false;
     }
+    atMemoryLimit = true;
+  } else {
+    atMemoryLimit = false;
   }
 }
 
+void Executor::startWatchdog() {
+  watchdog = std::make_unique<Watchdog>(
+      time::Span(WatchdogInterval), time::seconds(ReportInterval),
+      MaxMemory && MaxMemoryAction != MemoryLimitAction::Ignore);
+}
+
+void Executor::handleWatchdog() {
+  watchdog->pending.store(false, std::memory_order_relaxed);
+  if (watchdog->timersDue.exchange(false, std::memory_order_acquire))
+    timers.invoke();
+  if (watchdog->memoryDue.exchange(false, std::memory_order_acquire))
+    checkMemoryUsage(watchdog->mallocUsage.load(std::memory_order_relaxed));
+  if (watchdog->reportDue.exchange(false, std::memory_order_acquire))
+    info_requested = true;
+}
+
 void Executor::doDumpStates() {
   if (!DumpStatesOnHalt || states.empty())
     return;
@@ -3350,72 +4394,218 @@ void Executor::doDumpStates() {
   updateStates(nullptr);
 }
 
+template <bool PrintInstructions>
+void Executor::runState(ExecutionState &state) {
+  // While the state is the only one the searcher has nothing to choose,
+  // so keep stepping it until states are added or removed. The report
+  // clock is only read every ReportCheckPeriod instructions meanwhile.
+  const unsigned ReportCheckPeriod = 4096;
+  for (unsigned steps = 1;; ++steps) {
+    if (!state.openMergeStack.empty() && closeAutoMerges(state)) {
+      updateStates(&state);
+      break;
+    }
+    KInstruction *ki = state.pc();
+    stepInstruction<PrintInstructions>(state);
+
+    executeInstruction(state, ki);
+    // Each instruction takes one unit of time
+    state.stateTime++;
+    if (watchdog->pending.load(std::memory_order_acquire))
+      handleWatchdog();
+    if (::dumpStates) dumpStates();
+    if (::dumpPTree) dumpPTree();
+
+    bool changed = !addedStates.empty() || !removedStates.empty() ||
+                   states.size() != 1;
+    if (changed)
+      updateStates(&state);
+
+    if (ReplayCheckpointInterval && states.size() == 1 &&
+        isReplaying(**states.begin()))
+      checkpointReplay(**states.begin());
+
+    if (changed || haltExecution || info_requested ||
+        steps == ReportCheckPeriod)
+      break;
+  }
+}
+
+/// Whether executing inst can neither observe the instruction counters nor
+/// leave the function, fork or switch threads.
+static bool isStraightLine(const Instruction *inst) {
+  return isa<BinaryOperator>(inst) || isa<CmpInst>(inst) ||
+         isa<CastInst>(inst) || isa<GetElementPtrInst>(inst) ||
+         isa<PHINode>(inst) || isa<SelectInst>(inst) ||
+         isa<ExtractValueInst>(inst) || isa<InsertValueInst>(inst) ||
+         isa<ExtractElementInst>(inst) || isa<InsertElementInst>(inst) ||
+         isa<ShuffleVectorInst>(inst);
+}
+
+void Executor::runReplayState(ExecutionState &state) {
+  // Like runState, but the instruction counters are only brought up to
+  // date before an instruction which is not straight-line, so a run of
+  // arithmetic costs one update. The run is in one function and thread,
+  // which is where its first instruction counts.
+  const unsigned ReportCheckPeriod = 4096;
+  uint64_t pending = 0;
+  Statistic *category = nullptr;
+  auto flush = [&]() {
+    if (!pending)
+      return;
+    stats::instructions += pending;
+    *category += pending;
+    pending = 0;
+    if (stats::instructions == MaxInstructions)
+      haltExecution = true;
+  };
+  // flushing when pending reaches this keeps -max-instructions exact
+  uint64_t maxPending = MaxInstructions > stats::instructions
+                            ? MaxInstructions - stats::instructions
+                            : ~0ULL;
+
+  for (unsigned steps = 1;; ++steps) {
+    if (!state.openMergeStack.empty() && closeAutoMerges(state)) {
+      flush();
+      updateStates(&state);
+      break;
+    }
+    KInstruction *ki = state.pc();
+    if (!pending)
+      category = &instructionCategory(state);
+    ++pending;
+    ++state.steppedInstructions;
+    state.prevPC() = state.pc();
+    ++state.pc();
+    if (!isStraightLine(ki->inst) || pending == maxPending) {
+      flush();
+      maxPending = MaxInstructions > stats::instructions
+                       ? MaxInstructions - stats::instructions
+                       : ~0ULL;
+    }
+
+    executeInstruction(state, ki);
+    state.stateTime++;
+    if (watchdog->pending.load(std::memory_order_acquire))
+      handleWatchdog();
+    if (::dumpStates) dumpStates();
+    if (::dumpPTree) dumpPTree();
+
+    bool changed = !addedStates.empty() || !removedStates.empty() ||
+                   states.size() != 1;
+    if (changed || haltExecution || info_requested ||
+        steps == ReportCheckPeriod) {
+      flush();
+      if (changed)
+        updateStates(&state);
+      if (ReplayCheckpointInterval && states.size() == 1 &&
+          isReplaying(**states.begin()))
+        checkpointReplay(**states.begin());
+      break;
+    }
+    // the replay position only moves at the instructions flushed before
+    if (ReplayCheckpointInterval && !pending)
+      checkpointReplay(state);
+  }
+}
+
 void Executor::run(ExecutionState &initialState) {
   bindModuleConstants();
 
   // Delay init till now so that ticks don't accrue during optimization and such.
-  //timers.reset();
+  timers.reset();
+  startWatchdog();
 
   states.insert(&initialState);
 
   if (usingSeeds) {
-    std::vector<SeedInfo> &v = seedMap[&initialState];
-
-    for (std::vector<KTest*>::const_iterator it = usingSeeds->begin(),
-           ie = usingSeeds->end(); it != ie; ++it)
-      v.push_back(SeedInfo(*it));
-
-    int lastNumSeeds = usingSeeds->size()+10;
+    // The seeds are attached in batches to copies of the initial state, the
+    // last batch to the initial state itself. One seed is read ahead to find
+    // the last batch.
+    usingSeeds->rewind();
+    KTest *pending = usingSeeds->next();
     time::Point lastTime, startTime = lastTime = time::getWallTime();
-    ExecutionState *lastState = 0;
-    while (!seedMap.empty()) {
-      if (haltExecution) {
-        doDumpStates();
-        return;
+    bool expired = false;
+    while (pending && !expired) {
+      std::vector<SeedInfo> batch;
+      while (pending && (!SeedBatchSize || batch.size() < SeedBatchSize)) {
+        batch.emplace_back(std::shared_ptr<KTest>(pending, kTest_free));
+        pending = usingSeeds->next();
       }
-
-      std::map<ExecutionState*, std::vector<SeedInfo> >::iterator it =
-        seedMap.upper_bound(lastState);
-      if (it == seedMap.end())
-        it = seedMap.begin();
-      lastState = it->first;
-      ExecutionState &state = *lastState;
-      KInstruction *ki = state.pc();
-      stepInstruction(state);
-
-      executeInstruction(state, ki);
-      //timers.invoke();
-      if (::dumpStates) dumpStates();
-      if (::dumpPTree) dumpPTree();
-      updateStates(&state);
-
-      if ((stats::instructions % 1000) == 0) {
-        int numSeeds = 0, numStates = 0;
-        for (std::map<ExecutionState*, std::vector<SeedInfo> >::iterator
-               it = seedMap.begin(), ie = seedMap.end();
-             it != ie; ++it) {
-          numSeeds += it->second.size();
-          numStates++;
+      ExecutionState *batchState = &initialState;
+      if (pending) {
+        batchState = initialState.branch();
+        processTree->attach(initialState.ptreeNode, batchState, &initialState);
+        states.insert(batchState);
+      }
+      int lastNumSeeds = batch.size() + 10;
+      seedMap[batchState] = std::move(batch);
+
+      ExecutionState *lastState = 0;
+      while (!seedMap.empty()) {
+        if (haltExecution) {
+          if (pending)
+            kTest_free(pending);
+          watchdog.reset();
+          doDumpStates();
+          return;
         }
-        const auto time = time::getWallTime();
-        const time::Span seedTime(SeedTime);
-        if (seedTime && time > startTime + seedTime) {
-          klee_warning("seed time expired, %d seeds remain over %d states",
-                       numSeeds, numStates);
-          break;
-        } else if (numSeeds<=lastNumSeeds-10 ||
-                   time - lastTime >= time::seconds(10)) {
-          lastTime = time;
-          lastNumSeeds = numSeeds;
-          klee_message("%d seeds remaining over: %d states",
-                       numSeeds, numStates);
+
+        std::map<ExecutionState*, std::vector<SeedInfo> >::iterator it =
+          seedMap.upper_bound(lastState);
+        if (it == seedMap.end())
+          it = seedMap.begin();
+        lastState = it->first;
+        ExecutionState &state = *lastState;
+        KInstruction *ki = state.pc();
+        stepInstruction(state);
+
+        executeInstruction(state, ki);
+        if (watchdog->pending.load(std::memory_order_acquire))
+          handleWatchdog();
+        if (::dumpStates) dumpStates();
+        if (::dumpPTree) dumpPTree();
+        updateStates(&state);
+
+        if ((stats::instructions % 1000) == 0) {
+          int numSeeds = 0, numStates = 0;
+          for (std::map<ExecutionState*, std::vector<SeedInfo> >::iterator
+                 it = seedMap.begin(), ie = seedMap.end();
+               it != ie; ++it) {
+            numSeeds += it->second.size();
+            numStates++;
+          }
+          const auto time = time::getWallTime();
+          const time::Span seedTime(SeedTime);
+          if (seedTime && time > startTime + seedTime) {
+            klee_warning("seed time expired, %d seeds remain over %d states",
+                         numSeeds, numStates);
+            expired = true;
+            break;
+          } else if (numSeeds<=lastNumSeeds-10 ||
+                     time - lastTime >= time::seconds(10)) {
+            lastTime = time;
+            lastNumSeeds = numSeeds;
+            klee_message("%d seeds remaining over: %d states",
+                         numSeeds, numStates);
+          }
         }
       }
     }
+    if (pending) {
+      // the seeds after the expired batch are not replayed, so the initial
+      // state is left without seeds
+      kTest_free(pending);
+      if (OnlyReplaySeeds) {
+        terminateState(initialState);
+        updateStates(nullptr);
+      }
+    }
 
     klee_message("seeding done (%d states remain)", (int) states.size());
 
     if (OnlySeed) {
+      watchdog.reset();
       doDumpStates();
       return;
     }
@@ -3431,39 +4621,69 @@ void Executor::run(ExecutionState &initialState) {
   interpreterHandler->getInfoStream()
       << "Executor run started: "
       << std::asctime(std::localtime(&startT_time_t)) << '\n';
-  time::Point lastReportT = time::getWallTime();
+  if (metricsServer) {
+    if (replayPath)
+      ++metricsServer->replays;
+    nextMetricsPublish = 0;
+  }
+  if (!workerID) {
+    workerBudget = std::max(1U, ParallelWorkers.getValue());
+    bindToNumaNode(workerID);
+  }
+  // the -max-time timer runs for the whole process, a replay only gets
+  // what is left of it
+  const time::Span maxTime{MaxTime};
+  replayBudget.reset();
+  if (ReplayBudgetOpt && replayPath && maxTime &&
+      time::getWallTime() - maxTimeStart < maxTime) {
+    if (!replayBudgetFile)
+      replayBudgetFile = interpreterHandler->openOutputFile("replay-budget.txt");
+    replayBudget = std::make_unique<ReplayBudget>(
+        maxTime - (time::getWallTime() - maxTimeStart), replayPath->size(),
+        ReplayBudgetSegments, replayBudgetFile.get());
+  }
   while (!states.empty() && !haltExecution) {
-    // default report interval is 5 mins
-    time::Point nowT = time::getWallTime();
-    time::Span elapsed = nowT - lastReportT;
-    if (elapsed.toSeconds() >= ReportInterval) {
-      lastReportT = nowT;
-      info_requested = true;
-    }
+    if (workerBudget > 1 && states.size() >= ParallelSplitStates)
+      splitStates();
+    if (ExportFrontierStates && states.size() > ExportFrontierStates)
+      exportFrontierStates();
+    if (metricsServer && stats::instructions >= nextMetricsPublish)
+      publishMetrics();
+    // the watchdog requests a report every -report-interval
     if (info_requested) {
       info_requested = false;
       printInfo(llvm::errs());
     }
+    if (replayBudget)
+      if (ExecutionState *es = getFurthestReplayState())
+        replayBudget->advance(es->replayPosition);
     ExecutionState &state = searcher->selectState();
-    KInstruction *ki = state.pc();
-    stepInstruction(state);
-
-    executeInstruction(state, ki);
-    // Each instruction takes one unit of time
-    state.stateTime++;
-    //timers.invoke();
-    if (::dumpStates) dumpStates();
-    if (::dumpPTree) dumpPTree();
-
-    //checkMemoryUsage();
-
-    updateStates(&state);
+    state.lastScheduled = stats::instructions;
+    if (printInstructions)
+      runState<true>(state);
+    else if (ReplayBatchInstructions && states.size() == 1 &&
+             isReplaying(state) &&
+             (!statsTracker || !StatsTracker::stepsEachInstruction()))
+      runReplayState(state);
+    else
+      runState<false>(state);
   }
 
   delete searcher;
   searcher = 0;
+  watchdog.reset();
 
+  if (replayBudget)
+    finishReplayBudget();
   doDumpStates();
+  waitForWorkers();
+
+  if (metricsServer)
+    publishMetrics();
+  if (solverProfiler)
+    writeSolverProfile();
+  if (dataRecProfiler)
+    writeDataRecProfile();
 }
 
 std::string Executor::getAddressInfo(ExecutionState &state,
@@ -3529,6 +4749,8 @@ void Executor::terminateState(ExecutionState &state) {
     klee_warning_once(replayKTest,
                       "replay did not consume all objects in test input.");
   }
+  if (state.replayDivergences && divergenceReport)
+    divergenceReport->reportSuffix(state);
 
   interpreterHandler->incPathsExplored();
 
@@ -3552,6 +4774,9 @@ void Executor::terminateState(ExecutionState &state) {
 
 void Executor::terminateStateEarly(ExecutionState &state,
                                    const Twine &message) {
+  // a path contradicting its deferred branches is reported as a divergence
+  if (!validateDeferredBranches(state))
+    return;
   if (!OnlyOutputStatesCoveringNew || state.coveredNew ||
       (AlwaysOutputSeeds && seedMap.count(&state)))
     interpreterHandler->processTestCase(state, /*getSymbolicSolution*/ true,
@@ -3560,7 +4785,19 @@ void Executor::terminateStateEarly(ExecutionState &state,
   terminateState(state);
 }
 
+void Executor::spillState(ExecutionState &state) {
+  // A spilled state is not lost work: its test case is the way back to it,
+  // so it is written even with -only-output-states-covering-new.
+  interpreterHandler->processTestCase(
+      state, /*getSymbolicSolution*/ true,
+      "Memory limit exceeded (spilled).\n", "spill");
+  terminateState(state);
+}
+
 void Executor::terminateStateOnExit(ExecutionState &state) {
+  // the path has to be checked before reporting it as a normal exit
+  if (!validateDeferredBranches(state))
+    return;
   if (!OnlyOutputStatesCoveringNew || state.coveredNew ||
       (AlwaysOutputSeeds && seedMap.count(&state)))
     interpreterHandler->processTestCase(state, /*getSymbolicSolution*/ true, 0,
@@ -3627,6 +4864,10 @@ void Executor::terminateStateOnError(ExecutionState &state,
                                      enum TerminateReason termReason,
                                      const char *suffix,
                                      const llvm::Twine &info) {
+  // An error is only reported on a path whose deferred branches hold,
+  // otherwise the contradicting branch is reported instead.
+  if (!validateDeferredBranches(state))
+    return;
   std::string message = messaget.str();
   static std::set< std::pair<Instruction*, std::string> > emittedErrors;
   Instruction * lastInst;
@@ -3648,7 +4889,7 @@ void Executor::terminateStateOnError(ExecutionState &state,
     if (ii.file != "") {
       msg << "File: " << ii.file << "\n";
       msg << "Line: " << ii.line << "\n";
-      msg << "assembly.ll line: " << ii.assemblyLine << "\n";
+      msg << "assembly.ll line: " << ii.getAssemblyLine() << "\n";
     }
 
     std::string info_str = info.str();
@@ -3684,6 +4925,122 @@ static std::set<std::string> okExternals(okExternalsList,
                                          okExternalsList +
                                          (sizeof(okExternalsList)/sizeof(okExternalsList[0])));
 
+const Executor::NativeClosure *Executor::getNativeClosure(Function *f) {
+  auto it = nativeClosures.find(f);
+  if (it != nativeClosures.end())
+    return it->second.get();
+
+  std::unique_ptr<NativeClosure> closure(new NativeClosure());
+  std::set<const Function *> visited;
+  std::vector<Function *> worklist(1, f);
+  std::vector<const Constant *> constants;
+  bool addressed = true;
+  while (!worklist.empty()) {
+    Function *g = worklist.back();
+    worklist.pop_back();
+    if (!visited.insert(g).second)
+      continue;
+    closure->functions.push_back(g);
+    for (BasicBlock &bb : *g) {
+      for (Instruction &i : bb) {
+        if (CallInst *ci = dyn_cast<CallInst>(&i)) {
+          Function *callee = ci->getCalledFunction();
+          if (callee && !callee->isIntrinsic())
+            worklist.push_back(callee);
+        }
+        for (Value *op : i.operands())
+          if (isa<Constant>(op) && !isa<Function>(op))
+            constants.push_back(cast<Constant>(op));
+      }
+    }
+  }
+  // NativeCallPass let functions only appear as callees
+  std::set<const Constant *> seen;
+  while (!constants.empty()) {
+    const Constant *c = constants.back();
+    constants.pop_back();
+    if (!seen.insert(c).second)
+      continue;
+    if (const GlobalValue *gv = dyn_cast<GlobalValue>(c)) {
+      auto address = globalAddresses.find(gv);
+      if (address == globalAddresses.end())
+        addressed = false;
+      else
+        closure->addresses[gv] = address->second->getZExtValue();
+      continue;
+    }
+    for (const Use &op : c->operands())
+      constants.push_back(cast<Constant>(op.get()));
+  }
+  if (!addressed)
+    closure.reset();
+  return (nativeClosures[f] = std::move(closure)).get();
+}
+
+bool Executor::callNativeFunction(ExecutionState &state, KInstruction *target,
+                                  Function *function,
+                                  std::vector<ref<Expr> > &arguments) {
+  KFunction *kf = kmodule->functionMap[function];
+  if (!kf || !kf->native || isa<InvokeInst>(target->inst) ||
+      state.shouldRecordCall(kf) ||
+      Context::get().getPointerWidth() != 8 * sizeof(void *))
+    return false;
+  if (!NativeCallWhiteList.count(function->getName()) &&
+      std::find(NativeCallFunctions.begin(), NativeCallFunctions.end(),
+                function->getName().str()) == NativeCallFunctions.end())
+    return false;
+  if (arguments.size() != function->arg_size() ||
+      target->inst->getType() != function->getReturnType())
+    return false;
+  const NativeClosure *closure = getNativeClosure(function);
+  if (!closure)
+    return false;
+
+  // the same argument layout as for external calls
+  uint64_t *args = (uint64_t*) alloca(2*sizeof(*args) * (arguments.size() + 1));
+  memset(args, 0, 2 * sizeof(*args) * (arguments.size() + 1));
+  unsigned wordIndex = 2;
+  std::vector<uint64_t> roots;
+  for (const ref<Expr> &arg : arguments) {
+    ConstantExpr *ce = dyn_cast<ConstantExpr>(arg);
+    if (!ce)
+      return false;
+    ce->toMemory(&args[wordIndex]);
+    if (ce->getWidth() == Context::get().getPointerWidth())
+      roots.push_back(ce->getZExtValue());
+    wordIndex += (ce->getWidth() + 63) / 64;
+  }
+  for (auto &ga : closure->addresses)
+    roots.push_back(ga.second);
+
+  std::vector<ObjectPair> syncedObjects;
+  state.addressSpace.getReachableObjects(roots, syncedObjects);
+  for (const ObjectPair &op : syncedObjects)
+    if (!op.second->isAllConcrete())
+      return false;
+  state.addressSpace.copyOutConcretes(syncedObjects);
+
+  // on a fault the interpreter runs the call again, and reports the error
+  if (!externalDispatcher->executeNativeCall(function, target->inst,
+                                             closure->functions,
+                                             closure->addresses, args))
+    return false;
+
+  if (!state.addressSpace.copyInConcretes(syncedObjects)) {
+    terminateStateOnError(state, "native call modified read-only object",
+                          External);
+    return true;
+  }
+  ++stats::nativeCalls;
+
+  Type *resultType = target->inst->getType();
+  if (!resultType->isVoidTy())
+    bindLocal(target, state,
+              ConstantExpr::fromMemory((void *)args,
+                                       getWidthForLLVMType(resultType)));
+  return true;
+}
+
 void Executor::callExternalFunction(ExecutionState &state,
                                     KInstruction *target,
                                     Function *function,
@@ -3707,6 +5064,8 @@ void Executor::callExternalFunction(ExecutionState &state,
   uint64_t *args = (uint64_t*) alloca(2*sizeof(*args) * (arguments.size() + 1));
   memset(args, 0, 2 * sizeof(*args) * (arguments.size() + 1));
   unsigned wordIndex = 2;
+  // the concrete pointer arguments, to sync the objects they reach
+  std::vector<uint64_t> pointerArgs;
   for (std::vector<ref<Expr> >::iterator ai = arguments.begin(),
        ae = arguments.end(); ai!=ae; ++ai) {
     if (ExternalCalls == ExternalCallPolicy::All) { // don't bother checking uniqueness
@@ -3724,6 +5083,7 @@ void Executor::callExternalFunction(ExecutionState &state,
       if (ce->getWidth() == Context::get().getPointerWidth() &&
           state.addressSpace.resolveOne(ce, op)) {
         op.second->flushToConcreteStore(solver, state);
+        pointerArgs.push_back(ce->getZExtValue());
       }
       wordIndex += (ce->getWidth()+63)/64;
     } else {
@@ -3731,6 +5091,8 @@ void Executor::callExternalFunction(ExecutionState &state,
       if (ConstantExpr *ce = dyn_cast<ConstantExpr>(arg)) {
         // XXX kick toMemory functions from here
         ce->toMemory(&args[wordIndex]);
+        if (ce->getWidth() == Context::get().getPointerWidth())
+          pointerArgs.push_back(ce->getZExtValue());
         wordIndex += (ce->getWidth()+63)/64;
       } else {
         terminateStateOnExecError(state,
@@ -3742,7 +5104,13 @@ void Executor::callExternalFunction(ExecutionState &state,
   }
 
   // Prepare external memory for invoking the function
-  state.addressSpace.copyOutConcretes();
+  std::vector<ObjectPair> syncedObjects;
+  if (ExternalCallsSyncReachable) {
+    state.addressSpace.getReachableObjects(pointerArgs, syncedObjects);
+    state.addressSpace.copyOutConcretes(syncedObjects);
+  } else {
+    state.addressSpace.copyOutConcretes();
+  }
 #ifndef WINDOWS
   // Update external errno state with local state value
   int *errno_addr = getErrnoLocation(state);
@@ -3789,7 +5157,9 @@ void Executor::callExternalFunction(ExecutionState &state,
     return;
   }
 
-  if (!state.addressSpace.copyInConcretes()) {
+  if (!(ExternalCallsSyncReachable
+            ? state.addressSpace.copyInConcretes(syncedObjects)
+            : state.addressSpace.copyInConcretes())) {
     terminateStateOnError(state, "external modified read-only object",
                           External);
     return;
@@ -3815,7 +5185,7 @@ void Executor::callExternalFunction(ExecutionState &state,
 ref<Expr> Executor::replaceReadWithSymbolic(ExecutionState &state,
                                             ref<Expr> e) {
   unsigned n = interpreterOpts.MakeConcreteSymbolic;
-  if (!n || replayKTest || replayPath)
+  if (!n || replayKTest || isReplaying(state))
     return e;
 
   // right now, we don't replace symbolics (is there any reason to?)
@@ -3842,9 +5212,13 @@ ref<Expr> Executor::replaceReadWithSymbolic(ExecutionState &state,
 ObjectState *Executor::bindObjectInState(ExecutionState &state,
                                          const MemoryObject *mo,
                                          bool isLocal,
-                                         const Array *array) {
-  ObjectState *os = array ? new ObjectState(mo, array) : new ObjectState(mo);
+                                         const Array *array,
+                                         unsigned arrayOffset) {
+  ObjectState *os =
+      array ? new ObjectState(mo, array, arrayOffset) : new ObjectState(mo);
   state.addressSpace.bindObject(mo, os);
+  if (array)
+    state.concreteOnly = false;
 
   // Its possible that multiple bindings of the same mo in the state
   // will put multiple copies on this list, but it doesn't really
@@ -4093,6 +5467,55 @@ void Executor::resolveExact(ExecutionState &state,
   }
 }
 
+bool Executor::executeConcreteMemoryOperation(ExecutionState &state,
+                                              bool isWrite, ref<Expr> address,
+                                              ref<Expr> value,
+                                              KInstruction *ki) {
+  // replacing concrete reads by symbolic values defeats the analysis
+  if (interpreterOpts.MakeConcreteSymbolic)
+    return false;
+  ConstantExpr *ca = dyn_cast<ConstantExpr>(address);
+  if (!ca || (isWrite && !isa<ConstantExpr>(value))) {
+    klee_warning_once(ki, "symbolic operand in a block marked concrete: %s",
+                      ki->getUniqueID().c_str());
+    return false;
+  }
+
+  Expr::Width type =
+      isWrite ? value->getWidth() : getWidthForLLVMType(ki->inst->getType());
+  if (!executeInBoundsMemoryOperation(state, isWrite, ca->getZExtValue(),
+                                      value, type, ki, false))
+    return false;
+  ++stats::concreteMemoryOperations;
+  return true;
+}
+
+bool Executor::executeInBoundsMemoryOperation(ExecutionState &state,
+                                              bool isWrite, uint64_t address,
+                                              ref<Expr> value,
+                                              Expr::Width type,
+                                              KInstruction *ki, bool force) {
+  ObjectPair op;
+  if (!state.addressSpace.resolveAddress(address, op))
+    return false;
+  const MemoryObject *mo = op.first;
+  uint64_t bytes = Expr::getMinBytesForWidth(type);
+  uint64_t offset = address - mo->address;
+  // out of bounds or read only accesses are reported by the general path
+  if (offset > mo->size || bytes > mo->size - offset)
+    return false;
+  const ObjectState *os = op.second;
+  if (isWrite) {
+    if (!force && os->readOnly)
+      return false;
+    ObjectState *wos = state.addressSpace.getWriteable(mo, os, true);
+    wos->write(offset, value, Expr::FLAG_INSTRUCTION_ROOT, ki);
+  } else {
+    bindLocal(ki, state, os->read(offset, type));
+  }
+  return true;
+}
+
 void Executor::executeMemoryOperation(ExecutionState &state, bool isWrite,
                                       ref<Expr> address,
                                       ref<Expr> value /* undef if read */,
@@ -4110,6 +5533,17 @@ void Executor::executeMemoryOperation(ExecutionState &state, bool isWrite,
       value = state.constraints.simplifyExpr(value);
   }
 
+  // fast path: a concrete address in bounds of one object, which the
+  // general path below would resolve and check by building constant
+  // expressions
+  if (ConstantExpr *CE = dyn_cast<ConstantExpr>(address))
+    if (!interpreterOpts.MakeConcreteSymbolic &&
+        executeInBoundsMemoryOperation(state, isWrite, CE->getZExtValue(),
+                                       value, type, target, force)) {
+      ++stats::inBoundsMemoryOperations;
+      return;
+    }
+
   address = optimizer.optimizeExpr(address, true);
 
   // fast path: single in-bounds resolution
@@ -4271,84 +5705,102 @@ void Executor::executeMemoryOperation(ExecutionState &state, bool isWrite,
 void Executor::executeMakeSymbolic(ExecutionState &state,
                                    const MemoryObject *mo,
                                    const std::string &name) {
-  // Create a new object state for the memory object (instead of a copy).
+  executeMakeSymbolic(state, std::vector<const MemoryObject *>(1, mo), name);
+}
+
+void Executor::executeMakeSymbolic(
+    ExecutionState &state, const std::vector<const MemoryObject *> &objects,
+    const std::string &name) {
+  // Create new object states for the memory objects (instead of copies).
   if (!replayKTest) {
     // Find a unique name for this array.  First try the original name,
     // or if that fails try adding a unique identifier.
     unsigned id = 0;
     std::string uniqueName = name;
-    while (!state.arrayNames.insert(uniqueName).second) {
+    while (state.arrayNames.count(uniqueName)) {
       uniqueName = name + "_" + llvm::utostr(++id);
     }
-    const Array *array = arrayCache.CreateArray(uniqueName, mo->size);
-    bindObjectInState(state, mo, false, array);
-    state.addSymbolic(mo, array);
-
-    std::map< ExecutionState*, std::vector<SeedInfo> >::iterator it =
-      seedMap.find(&state);
-    if (it!=seedMap.end()) { // In seed mode we need to add this as a
-                             // binding.
-      for (std::vector<SeedInfo>::iterator siit = it->second.begin(),
-             siie = it->second.end(); siit != siie; ++siit) {
-        SeedInfo &si = *siit;
-        KTestObject *obj = si.getNextInput(mo, NamedSeedMatching);
-
-        if (!obj) {
-          if (ZeroSeedExtension) {
-            std::vector<unsigned char> &values = si.assignment.bindings[array];
-            values = std::vector<unsigned char>(mo->size, '\0');
-          } else if (!AllowSeedExtension) {
-            terminateStateOnError(state, "ran out of inputs during seeding",
-                                  User);
-            break;
-          }
-        } else {
-          if (obj->numBytes != mo->size &&
-              ((!(AllowSeedExtension || ZeroSeedExtension)
-                && obj->numBytes < mo->size) ||
-               (!AllowSeedTruncation && obj->numBytes > mo->size))) {
-        	    std::stringstream msg;
-        	    msg << "replace size mismatch: "
-        		<< mo->name << "[" << mo->size << "]"
-        		<< " vs " << obj->name << "[" << obj->numBytes << "]"
-        		<< " in test\n";
-
-            terminateStateOnError(state, msg.str(), User);
-            break;
-          } else {
-            std::vector<unsigned char> &values = si.assignment.bindings[array];
-            values.insert(values.begin(), obj->bytes,
-                          obj->bytes + std::min(obj->numBytes, mo->size));
+    state.arrayNames = state.arrayNames.insert(uniqueName);
+    unsigned size = 0;
+    for (const MemoryObject *mo : objects)
+      size += mo->size;
+    const Array *array = arrayCache.CreateArray(uniqueName, size);
+
+    unsigned offset = 0;
+    for (const MemoryObject *mo : objects) {
+      bindObjectInState(state, mo, false, array, offset);
+      state.addSymbolic(mo, array);
+
+      std::map< ExecutionState*, std::vector<SeedInfo> >::iterator it =
+        seedMap.find(&state);
+      if (it!=seedMap.end()) { // In seed mode we need to add this as a
+                               // binding.
+        for (std::vector<SeedInfo>::iterator siit = it->second.begin(),
+               siie = it->second.end(); siit != siie; ++siit) {
+          SeedInfo &si = *siit;
+          KTestObject *obj = si.getNextInput(mo, NamedSeedMatching);
+          std::vector<unsigned char> &values = si.assignment.bindings[array];
+          // the bytes of a previous object of the batch may be missing
+          values.resize(offset, '\0');
+
+          if (!obj) {
             if (ZeroSeedExtension) {
-              for (unsigned i=obj->numBytes; i<mo->size; ++i)
-                values.push_back('\0');
+              values.insert(values.end(), mo->size, '\0');
+            } else if (!AllowSeedExtension) {
+              terminateStateOnError(state, "ran out of inputs during seeding",
+                                    User);
+              return;
+            }
+          } else {
+            if (obj->numBytes != mo->size &&
+                ((!(AllowSeedExtension || ZeroSeedExtension)
+                  && obj->numBytes < mo->size) ||
+                 (!AllowSeedTruncation && obj->numBytes > mo->size))) {
+              std::stringstream msg;
+              msg << "replace size mismatch: "
+                  << mo->name << "[" << mo->size << "]"
+                  << " vs " << obj->name << "[" << obj->numBytes << "]"
+                  << " in test\n";
+
+              terminateStateOnError(state, msg.str(), User);
+              return;
+            } else {
+              values.insert(values.end(), obj->bytes,
+                            obj->bytes + std::min(obj->numBytes, mo->size));
+              if (ZeroSeedExtension) {
+                for (unsigned i=obj->numBytes; i<mo->size; ++i)
+                  values.push_back('\0');
+              }
             }
           }
         }
       }
+      offset += mo->size;
     }
   } else {
-    ObjectState *os = bindObjectInState(state, mo, false);
-    if (state.replayPosition >= replayKTest->numObjects) {
-      terminateStateOnError(state, "replay count mismatch", User);
-    } else {
+    for (const MemoryObject *mo : objects) {
+      ObjectState *os = bindObjectInState(state, mo, false);
+      if (state.replayPosition >= replayKTest->numObjects) {
+        terminateStateOnError(state, "replay count mismatch", User);
+        return;
+      }
       KTestObject *obj = &replayKTest->objects[state.replayPosition++];
       if (obj->numBytes != mo->size) {
         terminateStateOnError(state, "replay size mismatch", User);
-      } else {
-        for (unsigned i=0; i<mo->size; i++)
-          os->write8(i, obj->bytes[i], Expr::FLAG_INITIALIZATION, nullptr);
+        return;
       }
+      for (unsigned i=0; i<mo->size; i++)
+        os->write8(i, obj->bytes[i], Expr::FLAG_INITIALIZATION, nullptr);
     }
   }
 }
 
 /***/
 
-void Executor::runFunctionAsMain(Function *f,
-				 int argc,
-				 char **argv,
-				 char **envp) {
+ExecutionState *Executor::createMainState(Function *f,
+                                          int argc,
+                                          char **argv,
+                                          char **envp) {
   std::vector<ref<Expr> > arguments;
 
   // force deterministic initialization of memory objects
@@ -4444,17 +5896,198 @@ void Executor::runFunctionAsMain(Function *f,
   }
 
   initializeGlobals(*state);
+  return state;
+}
 
-  processTree = std::make_unique<PTree>(state);
-  run(*state);
-  processTree = nullptr;
-
+void Executor::resetMemory() {
   // hack to clear memory objects
   delete memory;
   memory = new MemoryManager(NULL);
 
   globalObjects.clear();
   globalAddresses.clear();
+}
+
+pid_t Executor::forkWorker(unsigned id) {
+  interpreterHandler->prepareWorkerFork();
+  pid_t pid = ::fork();
+  if (pid < 0)
+    klee_warning("unable to fork off worker %u: %s", id, strerror(errno));
+  if (pid)
+    return pid;
+
+  workerID = id;
+  workerBudget = 1;
+  workerPIDs.clear();
+  interpreterHandler->startWorker(workerID);
+  // The threads of the parent do not exist here: its metrics server is
+  // left to it, the watchdog replaced...
+  metricsServer.release();
+  if (watchdog) {
+    watchdog.release();
+    startWatchdog();
+  }
+  // ... and the solvers are recreated, not to share the memory through
+  // which a forked solver answers.
+  delete solver;
+  delete retrySolver;
+  retrySolver = nullptr;
+  createSolvers();
+  if (statsTracker)
+    statsTracker->startWorker();
+  bindToNumaNode(workerID);
+  return 0;
+}
+
+int Executor::forkRunWorker() {
+  // the ids below -parallel-workers are those of the workers of a run
+  return forkWorker(std::max(1U, ParallelWorkers.getValue()) + runWorkers++);
+}
+
+void Executor::splitStates() {
+  // a background check only answers the process that forked it
+  if (!backgroundChecks.empty()) {
+    for (ExecutionState *es : states)
+      finishBackgroundCheck(*es);
+    updateStates(nullptr);
+  }
+
+  // Both processes have to find the same order of the states, which the
+  // set of pointers has, as the child is a copy of the parent.
+  std::vector<ExecutionState *> arr(states.begin(), states.end());
+  unsigned childBudget = workerBudget / 2;
+  unsigned childID = workerID + workerBudget - childBudget;
+
+  pid_t pid = forkWorker(childID);
+  if (pid < 0) {
+    workerBudget = 1;
+    return;
+  }
+
+  if (pid) {
+    workerPIDs.push_back(pid);
+    workerBudget -= childBudget;
+  } else {
+    workerBudget = childBudget;
+    klee_message("worker %u: exploring %zu of %zu states", workerID,
+                 arr.size() / 2, arr.size());
+  }
+
+  // the child takes the odd states
+  for (unsigned i = pid ? 1 : 0; i < arr.size(); i += 2)
+    removedStates.push_back(arr[i]);
+  updateStates(nullptr);
+}
+
+void Executor::exportFrontierStates() {
+  std::vector<ExecutionState *> frontier;
+  for (ExecutionState *es : states)
+    if (!isReplaying(*es))
+      frontier.push_back(es);
+  if (frontier.size() <= ExportFrontierStates)
+    return;
+  // the states scheduled last are the ones the searcher prefers
+  std::size_t excess = frontier.size() - ExportFrontierStates;
+  std::partial_sort(frontier.begin(), frontier.begin() + excess,
+                    frontier.end(),
+                    [](const ExecutionState *a, const ExecutionState *b) {
+                      return a->lastScheduled < b->lastScheduled;
+                    });
+
+  unsigned exported = 0;
+  for (std::size_t i = 0; i < excess; ++i) {
+    ExecutionState &es = *frontier[i];
+    // the job is replayed without the solver, its trace has to hold
+    if (!validateDeferredBranches(es))
+      continue;
+    if (!interpreterHandler->exportJob(es))
+      break;
+    removedStates.push_back(&es);
+    ++exported;
+  }
+  if (exported)
+    klee_message("exported %u of %zu states as jobs", exported,
+                 states.size());
+  updateStates(nullptr);
+}
+
+void Executor::openAutoMerge(BasicBlock *bb,
+                             const std::vector<ExecutionState *> &branches) {
+  if (!UseAutoMerge ||
+      std::count(branches.begin(), branches.end(), nullptr) + 2 >
+          (std::ptrdiff_t)branches.size())
+    return;
+  Instruction *join = mergeRegions.getJoin(bb);
+  if (!join)
+    return;
+
+  ref<MergeHandler> handler;
+  for (ExecutionState *es : branches) {
+    if (!es)
+      continue;
+    if (handler.isNull())
+      handler = new MergeHandler(this, es, join);
+    else
+      handler->addOpenState(es);
+    es->openMergeStack.push_back(handler);
+  }
+}
+
+bool Executor::closeAutoMerges(ExecutionState &state) {
+  // nested regions may share their join
+  while (!state.openMergeStack.empty()) {
+    MergeHandler &handler = *state.openMergeStack.back();
+    if (handler.autoClose != state.pc()->inst ||
+        handler.autoCloseDepth != state.stack().size())
+      return false;
+    mergingSearcher->inCloseMerge.insert(&state);
+    handler.addClosedState(&state, handler.autoClose);
+    // the last state to close the merge releases the paused ones
+    state.openMergeStack.pop_back();
+    if (mergingSearcher->inCloseMerge.count(&state) ||
+        std::find(removedStates.begin(), removedStates.end(), &state) !=
+            removedStates.end())
+      return true;
+  }
+  return false;
+}
+
+void Executor::waitForWorkers() {
+  for (pid_t pid : workerPIDs) {
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+      if (errno != EINTR) {
+        klee_warning("unable to wait for worker process %d: %s", pid,
+                     strerror(errno));
+        status = 0;
+        break;
+      }
+    }
+    if (WIFEXITED(status) && WEXITSTATUS(status))
+      klee_warning("worker process %d exited with status %d", pid,
+                   WEXITSTATUS(status));
+    else if (WIFSIGNALED(status))
+      klee_warning("worker process %d was killed by signal %d", pid,
+                   WTERMSIG(status));
+  }
+  workerPIDs.clear();
+}
+
+void Executor::runFunctionAsMain(Function *f,
+				 int argc,
+				 char **argv,
+				 char **envp) {
+  ExecutionState *state = resumeFromReplayCheckpoint();
+  if (!state)
+    state = createMainState(f, argc, argv, envp);
+
+  processTree = std::make_unique<PTree>(state);
+  run(*state);
+  processTree = nullptr;
+
+  // checkpoints keep using the memory objects and globals of this run
+  if (replayCheckpoints.empty())
+    resetMemory();
 
   if (statsTracker)
     statsTracker->done();
@@ -4512,9 +6145,7 @@ void Executor::getConstraintLog(const ExecutionState &state, std::string &res,
     const Array* const *evalArraysBegin = 0;
     const Array* const *evalArraysEnd = 0;
     
-    std::vector<const Array*> objects;
-    for (unsigned i = 0; i != state.symbolics.size(); ++i)
-      objects.push_back(state.symbolics[i].second);
+    std::vector<const Array*> objects = state.getSymbolicArrays();
 
     if (!objects.empty()) {
         evalArraysBegin = &(objects[0]);
@@ -4551,6 +6182,9 @@ bool Executor::getSymbolicSolution(const ExecutionState &state,
   solver->setTimeout(coreSolverTimeout);
 
   ExecutionState tmp(state);
+  std::set<const Array *> dropped;
+  if (SliceTestInputs && UseIndependentSolver)
+    sliceTestInputs(tmp, dropped);
 
   // Go through each byte in every test case and attempt to restrict
   // it to the constraints contained in cexPreferences.  (Note:
@@ -4561,6 +6195,8 @@ bool Executor::getSymbolicSolution(const ExecutionState &state,
   // also make understanding individual test cases much easier.
   for (unsigned i = 0; i != state.symbolics.size(); ++i) {
     const auto &mo = state.symbolics[i].first;
+    if (dropped.count(state.symbolics[i].second))
+      continue;
     std::vector< ref<Expr> >::const_iterator pi =
       mo->cexPreferences.begin(), pie = mo->cexPreferences.end();
     for (; pi != pie; ++pi) {
@@ -4581,10 +6217,12 @@ bool Executor::getSymbolicSolution(const ExecutionState &state,
   }
 
   std::vector< std::vector<unsigned char> > values;
-  std::vector<const Array*> objects;
-  for (unsigned i = 0; i != state.symbolics.size(); ++i)
-    objects.push_back(state.symbolics[i].second);
-  bool success = solver->getInitialValues(tmp, objects, values);
+  std::vector<const Array*> objects = state.getSymbolicArrays();
+  std::vector<const Array *> solved;
+  for (const Array *array : objects)
+    if (!dropped.count(array))
+      solved.push_back(array);
+  bool success = solver->getInitialValues(tmp, solved, values);
   solver->setTimeout(time::Span());
   if (!success) {
     klee_warning("unable to compute initial values (invalid constraints?)!");
@@ -4595,47 +6233,175 @@ bool Executor::getSymbolicSolution(const ExecutionState &state,
     }
     return false;
   }
+  if (!dropped.empty()) {
+    std::vector<std::vector<unsigned char>> solvedValues;
+    solvedValues.swap(values);
+    auto next = solvedValues.begin();
+    for (const Array *array : objects)
+      values.push_back(dropped.count(array) ? getDefaultInput(state, array)
+                                            : std::move(*next++));
+  }
 
-  for (unsigned i = 0; i != state.symbolics.size(); ++i)
-    res.push_back(std::make_pair(state.symbolics[i].first->name, values[i]));
+  // Split the values of each array among the objects of its batch.
+  unsigned array = 0, offset = 0;
+  for (unsigned i = 0; i != state.symbolics.size(); ++i) {
+    const auto &mo = state.symbolics[i].first;
+    if (i && state.symbolics[i].second != state.symbolics[i - 1].second) {
+      ++array;
+      offset = 0;
+    }
+    const std::vector<unsigned char> &arrayValues = values[array];
+    res.push_back(std::make_pair(
+        mo->name,
+        std::vector<unsigned char>(arrayValues.begin() + offset,
+                                   arrayValues.begin() + offset + mo->size)));
+    offset += mo->size;
+  }
   return true;
 }
 
+void Executor::sliceTestInputs(ExecutionState &state,
+                               std::set<const Array *> &dropped) {
+  if (state.stack().empty())
+    return;
+  std::vector<ref<Expr>> relevant;
+  const StackFrame &sf = state.stack().back();
+  for (unsigned i = 0; i < sf.kf->numRegisters; ++i) {
+    const ref<Expr> &value = sf.getLocal(i).value;
+    if (!value.isNull() && !isa<ConstantExpr>(value))
+      relevant.push_back(value);
+  }
+  std::vector<const Array *> arrays;
+  findSymbolicObjects(relevant.begin(), relevant.end(), arrays);
+  std::set<const Array *> kept(arrays.begin(), arrays.end());
+
+  // Keep the factors on the arrays kept, until no kept factor brings in
+  // another array: the values of an array are solved for all at once.
+  std::vector<IndependentElementSet *> factors;
+  for (auto it = state.constraints.factor_begin(),
+            ie = state.constraints.factor_end();
+       it != ie; ++it)
+    factors.push_back(*it);
+  std::vector<bool> taken(factors.size());
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (unsigned i = 0; i != factors.size(); ++i) {
+      if (taken[i])
+        continue;
+      std::vector<const Array *> factorArrays(factors[i]->wholeObjects.begin(),
+                                              factors[i]->wholeObjects.end());
+      for (const auto &element : factors[i]->elements)
+        factorArrays.push_back(element.first);
+      if (std::none_of(factorArrays.begin(), factorArrays.end(),
+                       [&](const Array *a) { return kept.count(a); }))
+        continue;
+      taken[i] = changed = true;
+      kept.insert(factorArrays.begin(), factorArrays.end());
+    }
+  }
+
+  Constraints_ty constraints;
+  for (unsigned i = 0; i != factors.size(); ++i)
+    if (taken[i])
+      constraints.insert(factors[i]->exprs.begin(), factors[i]->exprs.end());
+  state.constraints = ConstraintManager(constraints);
+  for (const Array *array : state.getSymbolicArrays())
+    if (!kept.count(array))
+      dropped.insert(array);
+}
+
+std::vector<unsigned char>
+Executor::getDefaultInput(const ExecutionState &state, const Array *array) {
+  std::vector<unsigned char> bytes(array->size, 0);
+  auto seeds = seedMap.find(const_cast<ExecutionState *>(&state));
+  if (seeds != seedMap.end() && !seeds->second.empty()) {
+    const Assignment &assignment = seeds->second.front().assignment;
+    auto it = assignment.bindings.find(array);
+    if (it != assignment.bindings.end()) {
+      std::copy_n(it->second.begin(),
+                  std::min<size_t>(it->second.size(), bytes.size()),
+                  bytes.begin());
+      return bytes;
+    }
+  }
+  if (oracle_eval) {
+    for (unsigned i = 0; i != array->size; ++i) {
+      ref<Expr> value = oracle_eval->evaluate(ReadExpr::create(
+          UpdateList(array, 0), ConstantExpr::alloc(i, array->getDomain())));
+      if (ConstantExpr *CE = dyn_cast<ConstantExpr>(value))
+        bytes[i] = CE->getZExtValue(8);
+    }
+  }
+  return bytes;
+}
+
 void Executor::getCoveredLines(const ExecutionState &state,
                                std::map<const std::string*, std::set<unsigned> > &res) {
-  res = state.coveredLines;
+  res.clear();
+  for (const InstructionInfo *ii : state.coveredInstructions)
+    res[&ii->file].insert(ii->line);
 }
 
 void Executor::doImpliedValueConcretization(ExecutionState &state,
                                             ref<Expr> e,
                                             ref<ConstantExpr> value) {
-  abort(); // FIXME: Broken until we sort out how to do the write back.
-
   if (DebugCheckForImpliedValues)
     ImpliedValue::checkForImpliedValues(solver->solver, e, value);
 
   ImpliedValueList results;
   ImpliedValue::getImpliedValues(e, value, results);
+
+  if (value->isTrue()) {
+    // the bounds on the same terms are among the constraints of e's factor
+    const Constraints_ty *related = &state.constraints.getAllConstraints();
+    Constraints_ty factorConstraints;
+    if (UseIndependentSolver) {
+      IndependentElementSet ies(e);
+      IndepElemSetPtrSet_ty factors;
+      state.constraints.getIntersection(&ies, factors);
+      for (IndependentElementSet *factor : factors)
+        factorConstraints.insert(factor->exprs.begin(), factor->exprs.end());
+      related = &factorConstraints;
+    }
+    ImpliedTermList terms;
+    if (related->size() <= ImpliedValueMaxConstraints)
+      ImpliedValue::getImpliedRangeValues(e, *related, terms);
+    for (const auto &term : terms) {
+      state.addConstraint(EqExpr::create(term.second, term.first));
+      ImpliedValue::getImpliedValues(term.first, term.second, results);
+    }
+  }
+
   for (ImpliedValueList::iterator it = results.begin(), ie = results.end();
        it != ie; ++it) {
     ReadExpr *re = it->first.get();
-
-    if (ConstantExpr *CE = dyn_cast<ConstantExpr>(re->index)) {
-      // FIXME: This is the sole remaining usage of the Array object
-      // variable. Kill me.
-      const MemoryObject *mo = 0; //re->updates.root->object;
+    ConstantExpr *CE = dyn_cast<ConstantExpr>(re->index);
+    // bytes of objects still holding the initial contents of their array
+    if (!CE || re->getWidth() != Expr::Int8 || !re->updates.head.isNull())
+      continue;
+    const Array *array = re->updates.root;
+    uint64_t index = CE->getZExtValue();
+
+    // the objects of a batch take consecutive bytes of its array
+    uint64_t offset = 0;
+    for (unsigned i = 0; i != state.symbolics.size(); ++i) {
+      const MemoryObject *mo = state.symbolics[i].first.get();
+      if (i && state.symbolics[i].second != state.symbolics[i - 1].second)
+        offset = 0;
+      if (state.symbolics[i].second != array ||
+          index < offset || index >= offset + mo->size) {
+        offset += mo->size;
+        continue;
+      }
       const ObjectState *os = state.addressSpace.findObject(mo);
-
-      if (!os) {
-        // object has been free'd, no need to concretize (although as
-        // in other cases we would like to concretize the outstanding
-        // reads, but we have no facility for that yet)
-      } else {
-        assert(!os->readOnly &&
-               "not possible? read only object with static read?");
+      unsigned byte = index - offset;
+      // the object may have been freed or written to since
+      if (os && !os->readOnly && os->read8(byte) == ref<Expr>(re)) {
         ObjectState *wos = state.addressSpace.getWriteable(mo, os);
-        wos->write(CE, it->second, 0, nullptr);
+        wos->write8(byte, it->second->getZExtValue(8), os->getFlags(byte),
+                    os->getKInst(byte));
       }
+      break;
     }
   }
 }
@@ -4760,6 +6526,120 @@ void Executor::printInfo(llvm::raw_ostream &os) {
   ++cnt;
 }
 
+ExecutionState *Executor::getFurthestReplayState() const {
+  ExecutionState *furthest = nullptr;
+  for (ExecutionState *es : states)
+    if (isReplaying(*es) &&
+        (!furthest || es->replayPosition > furthest->replayPosition))
+      furthest = es;
+  return furthest;
+}
+
+void Executor::finishReplayBudget() {
+  ExecutionState *es = getFurthestReplayState();
+  bool exhausted = maxTimeReached && es;
+  replayBudget->finish(es ? es->replayPosition : replayPath->size(),
+                       exhausted);
+  if (!exhausted)
+    return;
+
+  auto os = interpreterHandler->openOutputFile("replay-budget-exhausted.txt");
+  if (!os)
+    return;
+  *os << "replay position: " << es->replayPosition << " / "
+      << replayPath->size() << '\n'
+      << "DATAREC position: " << es->replayDataRecEntriesPosition << " / "
+      << (replayDataRecEntries ? replayDataRecEntries->size() : 0) << '\n'
+      << "target at this position: "
+      << replayBudget->getTarget(es->replayPosition) << " of "
+      << replayBudget->getBudget() << '\n'
+      << "90th percentile of the query times: "
+      << replayBudget->getQueryPercentile90() << '\n'
+      << "constraints: " << es->constraints.size() << '\n';
+
+  // the values that would simplify the constraints met so far are the
+  // candidates to record before the next attempt
+  const Constraints_ty &all = es->constraints.getAllConstraints();
+  std::vector<ref<Expr>> exprs(all.begin(), all.end());
+  if (ReplayBudgetRecording && !exprs.empty()) {
+    RecordingSelector selector(exprs);
+    std::vector<RecordingSelector::Candidate> selected =
+        selector.select(ReplayBudgetRecording);
+    auto cfg = interpreterHandler->openOutputFile("replay-budget.ptwrite-cfg");
+    for (const RecordingSelector::Candidate &c : selected) {
+      if (cfg)
+        *cfg << c.ki->getUniqueID() << '\n';
+      *os << "record " << c.ki->getUniqueID() << ": " << c.nodes
+          << " nodes, score " << c.score << ", " << c.bytes << " bytes\n";
+    }
+  }
+
+  // the checkpoint, written whatever -only-output-states-covering-new says
+  klee_message("replay budget exhausted at %u of %zu path entries, see "
+               "replay-budget-exhausted.txt",
+               es->replayPosition, replayPath->size());
+  interpreterHandler->processTestCase(*es, /*getSymbolicSolution*/ true,
+                                      "Replay budget exhausted.\n", "budget");
+  terminateState(*es);
+  updateStates(nullptr);
+}
+
+void Executor::publishMetrics() {
+  const auto relaxed = std::memory_order_relaxed;
+  MetricsServer &m = *metricsServer;
+
+  uint64_t replayPosition = 0, dataRecPosition = 0;
+  for (const ExecutionState *es : states) {
+    replayPosition = std::max<uint64_t>(replayPosition, es->replayPosition);
+    dataRecPosition = std::max<uint64_t>(dataRecPosition,
+                                         es->replayDataRecEntriesPosition);
+  }
+
+  m.instructions.store(stats::instructions, relaxed);
+  m.states.store(states.size(), relaxed);
+  m.replayPosition.store(replayPosition, relaxed);
+  m.replayPathSize.store(replayPath ? replayPath->size() : 0, relaxed);
+  m.dataRecPosition.store(dataRecPosition, relaxed);
+  m.dataRecSize.store(
+      replayDataRecEntries ? replayDataRecEntries->size() : 0, relaxed);
+  m.queries.store(stats::queries, relaxed);
+  m.solverTime.store(stats::solverTime, relaxed);
+  m.coreSolverTime.store(stats::queryTime, relaxed);
+  m.mallocUsage.store(util::GetTotalMallocUsage() +
+                          memory->getUsedDeterministicSize(),
+                      relaxed);
+  for (unsigned i = 0; i < util::NumMemoryTags; ++i)
+    m.taggedMemory[i].store(
+        util::GetTaggedMemoryUsage((util::MemoryTag)i), relaxed);
+  m.publishTime.store(std::chrono::duration_cast<std::chrono::microseconds>(
+                          std::chrono::system_clock::now().time_since_epoch())
+                          .count(),
+                      relaxed);
+
+  nextMetricsPublish = stats::instructions + MetricsPublishInstructions;
+}
+
+void Executor::writeSolverProfile() {
+  // the profile covers all runs so far (see --replay-serve)
+  if (auto folded = interpreterHandler->openOutputFile("solver-profile.folded"))
+    solverProfiler->writeFoldedStacks(*folded);
+  if (auto report = interpreterHandler->openOutputFile("solver-profile.txt"))
+    solverProfiler->writeReport(*report);
+}
+
+void Executor::writeDataRecProfile() {
+  if (auto report = interpreterHandler->openOutputFile("datarec-profile.txt"))
+    dataRecProfiler->writeReport(*report);
+  if (!DataRecPruneCFG)
+    return;
+  if (auto cfg =
+          interpreterHandler->openOutputFile("datarec-pruned.ptwrite-cfg")) {
+    unsigned dropped = dataRecProfiler->writePrunedCFG(*kmodule, *cfg);
+    klee_message("datarec-pruned.ptwrite-cfg drops %u recorded instructions",
+                 dropped);
+  }
+}
+
 /// Returns the errno location in memory
 int *Executor::getErrnoLocation(const ExecutionState &state) const {
 #if !defined(__APPLE__) && !defined(__FreeBSD__)
@@ -4770,19 +6650,44 @@ int *Executor::getErrnoLocation(const ExecutionState &state) const {
 #endif
 }
 
+PathDumpTable &Executor::getPathDumpTable() {
+  if (!pathDumpTable)
+    pathDumpTable = std::make_unique<PathDumpTable>(*interpreterHandler,
+                                                    PathDumpShardSize);
+  return *pathDumpTable;
+}
+
+void Executor::dumpStackPath(ExecutionState &current) {
+  if (OutputPathDumpFormat == PathDumpFormat::Interned)
+    current.dumpStackPathOS(
+        "S" + std::to_string(getPathDumpTable().internStack(current)));
+  else
+    current.dumpStackPathOS();
+}
+
+void Executor::dumpConsPath(ExecutionState &current,
+                            const ref<Expr> &new_constraint) {
+  if (OutputPathDumpFormat == PathDumpFormat::Interned) {
+    current.dumpConsPathOS(
+        "N" + std::to_string(getPathDumpTable().internExpr(new_constraint)));
+    return;
+  }
+  std::string BufferString;
+  llvm::raw_string_ostream ExprWriter(BufferString);
+  new_constraint.get()->print(ExprWriter);
+  current.dumpConsPathOS(ExprWriter.str());
+}
+
 void Executor::dumpStateAtBranch(ExecutionState &current, PathEntry pe, ref<Expr> new_constraint) {
   ++current.nbranches_rec;
   if (pathWriter) {
     current.pathOS << pe;
   }
   if (stackPathWriter) {
-    current.dumpStackPathOS();
+    dumpStackPath(current);
   }
   if (consPathWriter && !dyn_cast<ConstantExpr>(new_constraint)) {
-    std::string BufferString;
-    llvm::raw_string_ostream ExprWriter(BufferString);
-    new_constraint.get()->print(ExprWriter);
-    current.dumpConsPathOS(ExprWriter.str());
+    dumpConsPath(current, new_constraint);
   }
   if (statsPathWriter) {
     current.dumpStatsPathOS();
@@ -4793,14 +6698,11 @@ void Executor::dumpStateAtBranch(ExecutionState &current, PathEntry pe, ref<Expr
 // \param[in] new_constraint: could be Null but mustn't be ConstantExpr
 void Executor::dumpStateAtFork(ExecutionState &current, ref<Expr> new_constraint) {
   if (stackPathWriter) {
-    current.dumpStackPathOS();
+    dumpStackPath(current);
   }
   if (consPathWriter && !new_constraint.isNull()) {
     assert(!dyn_cast<ConstantExpr>(new_constraint));
-    std::string BufferString;
-    llvm::raw_string_ostream ExprWriter(BufferString);
-    new_constraint.get()->print(ExprWriter);
-    current.dumpConsPathOS(ExprWriter.str());
+    dumpConsPath(current, new_constraint);
   }
   if (statsPathWriter) {
     current.dumpStatsPathOS();
@@ -4888,39 +6790,217 @@ void Executor::writeStackKQueries(std::string& buf) {
   solver->writeStackKQueries(buf);
 };
 */
-void Executor::AssertNextBranchTaken(ExecutionState &state, bool br) {
-  PathEntry pe;
-  getNextPathEntry(state, pe);
-  bool recorded_br;
-  if (pe.t == PathEntry::FORK) {
-    recorded_br = pe.body.br;
+bool Executor::replayDiverged(ExecutionState &state, unsigned position,
+                              const std::string &reason,
+                              const std::string &expected,
+                              const std::string &actual, bool canContinue) {
+  bool continued = canContinue && ReplayContinueAfterDivergence;
+  if (!divergenceReport)
+    divergenceReport = std::make_unique<ReplayDivergenceReport>(
+        interpreterHandler->openOutputFile("replay-divergence.jsonl"),
+        *replayPath, replayDataRecEntries, ReplayDivergenceHistory);
+  divergenceReport->reportDivergence(state, position, reason, expected, actual,
+                                     continued);
+  klee_message("replay: %u/%lu %s, recorded: %s, runtime: %s", position,
+               replayPath->size(), reason.c_str(), expected.c_str(),
+               actual.c_str());
+
+  if (!continued) {
+    terminateStateOnError(state, "hit invalid branch in replay path mode",
+                          ReplayPath);
+    return false;
   }
-  else {
-    klee_error("Wrong PathEntry_t during asserting next branch");
+  if (!state.replayDivergences++) {
+    state.replayDivergedAt = position;
+    state.replayDivergedStep = state.steppedInstructions;
   }
-  if (br != recorded_br) {
+  return true;
+}
+
+bool Executor::AssertNextBranchTaken(ExecutionState &state, bool br) {
+  PathEntry pe;
+  if (!getNextPathEntry(state, pe))
+    return false;
+  if (pe.t != PathEntry::FORK)
+    return replayDiverged(state, state.replayPosition - 1,
+                          "Wrong PathEntry_t during asserting next branch",
+                          ReplayDivergenceReport::describe(pe), "FORK", false);
+  if (br != pe.body.br) {
     std::string constraints;
     getConstraintLog(state, constraints, Interpreter::KQUERY);
     auto f = interpreterHandler->openOutputFile("debugKQuery");
     if (f) {
       *f << constraints;
     }
-    klee_message("replay: %d/%lu runtime: %d recorded: %d, stack:\n", state.replayPosition-1, replayPath->size(), br, recorded_br);
-    state.dumpStack(llvm::errs());
-    terminateStateOnError(state, "hit invalid branch in replay path mode", ReplayPath);
+    std::string expected = ReplayDivergenceReport::describe(pe);
+    pe.body.br = br;
+    return replayDiverged(state, state.replayPosition - 1,
+                          "recorded branch contradicts the concrete condition",
+                          expected, ReplayDivergenceReport::describe(pe),
+                          true);
   }
+  return true;
 }
 
-void Executor::getNextBranchConstraint(ExecutionState &state, ref<Expr> condition,
-    ref<Expr> &new_constraint, Solver::Validity &res) {
-  PathEntry pe;
-  getNextPathEntry(state, pe);
-  if (pe.t == PathEntry::FORK) {
-    getConstraintFromBool(condition, new_constraint, res, pe.body.br);
+bool Executor::validateDeferredBranches(ExecutionState &state) {
+  if (!finishBackgroundCheck(state))
+    return false;
+  std::vector<std::pair<ref<Expr>, unsigned>> batch;
+  batch.swap(state.deferredBranches);
+  if (batch.empty())
+    return true;
+  Constraints_ty constraints;
+  constraints.swap(state.deferredBase);
+  return checkDeferredBranches(state, batch, constraints);
+}
+
+bool Executor::checkDeferredBranches(
+    ExecutionState &state,
+    const std::vector<std::pair<ref<Expr>, unsigned>> &batch,
+    const Constraints_ty &constraints) {
+  ExecutionState base(constraints);
+
+  // whether the first n deferred branches hold under the base constraints
+  auto prefixFeasible = [&](size_t n, bool &result) {
+    ref<Expr> all = ConstantExpr::alloc(1, Expr::Bool);
+    for (size_t i = 0; i < n; ++i)
+      all = AndExpr::create(all, batch[i].first);
+    return solver->mayBeTrue(base, all, result);
+  };
+
+  bool feasible;
+  if (!prefixFeasible(batch.size(), feasible)) {
+    terminateStateEarly(state, "Query timed out (deferred branches).");
+    return false;
   }
-  else {
-    klee_error("Wrong recorded branch type");
+  if (feasible)
+    return true;
+
+  // the prefix of length lo is feasible, the one of length hi is not
+  size_t lo = 0, hi = batch.size();
+  while (hi - lo > 1) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (!prefixFeasible(mid, feasible))
+      break;
+    if (feasible)
+      lo = mid;
+    else
+      hi = mid;
   }
+  const PathEntry &pe = (*replayPath)[batch[hi - 1].second];
+  replayDiverged(state, batch[hi - 1].second,
+                 "recorded branch contradicts the path constraints",
+                 ReplayDivergenceReport::describe(pe), "infeasible", false);
+  return false;
+}
+
+bool Executor::startBackgroundCheck(ExecutionState &state) {
+  if (!finishBackgroundCheck(state))
+    return false;
+  BackgroundCheck check;
+  check.branches.swap(state.deferredBranches);
+  check.base.swap(state.deferredBase);
+  ref<Expr> all = ConstantExpr::alloc(1, Expr::Bool);
+  for (const auto &branch : check.branches)
+    all = AndExpr::create(all, branch.first);
+
+  int fds[2];
+  if (::pipe2(fds, O_CLOEXEC) == 0) {
+    pid_t pid = ::fork();
+    if (pid == 0) {
+      ::close(fds[0]);
+      // Not the solvers of the parent: a forked solver answers through
+      // memory shared with the parent, and the chain writes its query logs.
+      TimingSolver checker(
+          createIndependentSolver(createCoreSolver(CoreSolverToUse)),
+          EqualitySubstitution);
+      ExecutionState base(check.base);
+      bool result;
+      char answer = checker.mayBeTrue(base, all, result) ? result : 2;
+      ssize_t written = ::write(fds[1], &answer, 1);
+      ::_exit(written == 1 ? 0 : 1);
+    }
+    ::close(fds[1]);
+    if (pid > 0) {
+      check.pid = pid;
+      check.fd = fds[0];
+      backgroundChecks.emplace(&state, std::move(check));
+      return true;
+    }
+    ::close(fds[0]);
+  }
+  klee_warning_once(0, "unable to start a background check, checking in "
+                       "place: %s", strerror(errno));
+  return checkDeferredBranches(state, check.branches, check.base);
+}
+
+bool Executor::finishBackgroundCheck(ExecutionState &state) {
+  auto it = backgroundChecks.find(&state);
+  if (it == backgroundChecks.end())
+    return true;
+  BackgroundCheck check = std::move(it->second);
+  backgroundChecks.erase(it);
+
+  char answer = 0;
+  ssize_t n;
+  do {
+    n = ::read(check.fd, &answer, 1);
+  } while (n < 0 && errno == EINTR);
+  ::close(check.fd);
+  while (::waitpid(check.pid, nullptr, 0) < 0 && errno == EINTR)
+    ;
+  if (n == 1 && answer == 1)
+    return true;
+  // The batch does not hold, or the process could not tell: the check is
+  // repeated here, which also finds the contradicting branch.
+  return checkDeferredBranches(state, check.branches, check.base);
+}
+
+void Executor::cancelBackgroundCheck(const ExecutionState &state) {
+  auto it = backgroundChecks.find(&state);
+  if (it == backgroundChecks.end())
+    return;
+  ::kill(it->second.pid, SIGKILL);
+  ::close(it->second.fd);
+  while (::waitpid(it->second.pid, nullptr, 0) < 0 && errno == EINTR)
+    ;
+  backgroundChecks.erase(it);
+}
+
+bool Executor::getNextBranchConstraint(ExecutionState &state, ref<Expr> condition,
+    ref<Expr> &new_constraint, Solver::Validity &res) {
+  PathEntry pe;
+  if (!getNextPathEntry(state, pe))
+    return false;
+  if (pe.t != PathEntry::FORK)
+    return replayDiverged(state, state.replayPosition - 1,
+                          "Wrong recorded branch type",
+                          ReplayDivergenceReport::describe(pe), "FORK", false);
+  getConstraintFromBool(condition, new_constraint, res, pe.body.br);
+  return true;
+}
+
+bool Executor::getNextDataRecording(ExecutionState &state, KInstruction *KI,
+                                    PathEntry &pe, DataRecEntry &dre) {
+  if (!getNextPathEntry(state, pe))
+    return false;
+  if (pe.t != PathEntry::DATAREC)
+    return replayDiverged(state, state.replayPosition - 1,
+                          "When try loading DataRecording, PathEntry Type "
+                          "mismatches",
+                          ReplayDivergenceReport::describe(pe), "DATAREC",
+                          false);
+  if (!getNextDataRecEntry(state, dre))
+    return false;
+  if (dre.instID < replayDataRecIDMap.size() &&
+      replayDataRecIDMap[dre.instID] != UINT32_MAX &&
+      replayDataRecIDMap[dre.instID] != KI->dataRecID)
+    return replayDiverged(state, state.replayPosition - 1,
+                          "When try loading DataRecording, instruction ID "
+                          "mismatches",
+                          replayDataRecEntries->getIDTable()[dre.instID],
+                          KI->getUniqueID(), false);
+  return true;
 }
 
 /*
@@ -4938,16 +7018,15 @@ void Executor::getNextBranchConstraint(ExecutionState &state, ref<Expr> conditio
  *   warning will be display.
  */
 bool Executor::tryLoadDataRecording(ExecutionState &state, KInstruction *KI) {
-  if (replayPath && replayDataRecEntries) {
-    std::string uniqID = KI->getUniqueID();
+  if (isReplaying(state) && replayDataRecEntries) {
     PathEntry pe;
     DataRecEntry dre;
-    getNextPathEntry(state, pe);
-    getNextDataRecEntry(state, dre);
-    assert((pe.t == PathEntry::DATAREC) && "When try loading DataRecording, PathEntry Type mismatches");
-    assert((pe.body.drec.IDlen = uniqID.size()) && "When try loading DataRecording, uniqID length mismatches");
-    ref<Expr> replayedValue = getDestCell(state, KI).value;
+    if (!getNextDataRecording(state, KI, pe, dre))
+      return true;
+    ref<Expr> replayedValue = state.stack().back().getLocal(KI->dest).value;
     ref<ConstantExpr> loadedValue = ConstantExpr::alloc(dre.data, pe.body.drec.width);
+    if (dataRecProfiler)
+      dataRecProfiler->recordLoad(KI->inst, replayedValue);
     if (!isa<ConstantExpr>(replayedValue)) {
       ++stats::dataRecLoadedEffective;
       if (DebugValueConcretization)
@@ -4960,6 +7039,67 @@ bool Executor::tryLoadDataRecording(ExecutionState &state, KInstruction *KI) {
   return false;
 }
 
+/*
+ * PTWritePass records a value wider than 64 bits as parts
+ * (trunc (lshr whole, 64 * index)), one ptwrite each, in increasing index
+ * order. A part only binds its own register. Once the last part is loaded the
+ * parts are combined and the whole value is concretized, so the value costs
+ * one constraint however many packets it took.
+ */
+bool Executor::tryLoadDataRecordingPart(ExecutionState &state,
+                                        KInstruction *KI, MDNode *part) {
+  if (!(isReplaying(state) && replayDataRecEntries))
+    return false;
+  PathEntry pe;
+  DataRecEntry dre;
+  if (!getNextDataRecording(state, KI, pe, dre))
+    return true;
+  Expr::Width partWidth = getWidthForLLVMType(KI->inst->getType());
+  bindLocal(KI, state, ConstantExpr::create(dre.data, partWidth));
+
+  unsigned index = PTWritePass::getPartIndex(part);
+  unsigned count = PTWritePass::getPartCount(part);
+  if (index + 1 != count)
+    return true;
+
+  // the parts are the truncations of whole and of its right shifts
+  Instruction *whole = cast<Instruction>(KI->inst->getOperand(0));
+  if (index != 0)
+    whole = cast<Instruction>(whole->getOperand(0));
+  std::vector<ref<ConstantExpr>> parts(count);
+  for (llvm::User *u : whole->users()) {
+    Instruction *partI = cast<Instruction>(u);
+    if (partI->getOpcode() == Instruction::LShr && partI->hasOneUse())
+      partI = cast<Instruction>(*partI->user_begin());
+    if (MDNode *md = partI->getMetadata(PTWritePass::partMetadata)) {
+      const Cell &c = state.stack().back().getLocal(
+          kmodule->getKInstruction(partI)->dest);
+      parts[PTWritePass::getPartIndex(md)] = dyn_cast<ConstantExpr>(c.value);
+    }
+  }
+  ref<ConstantExpr> value = parts[0];
+  for (unsigned i = 1; i < count; ++i) {
+    assert(!parts[i].isNull() && !value.isNull() &&
+           "ptwrite part was not loaded");
+    value = parts[i]->Concat(value);
+  }
+  value = value->Extract(0, getWidthForLLVMType(whole->getType()));
+
+  KInstruction *wholeKI = kmodule->getKInstruction(whole);
+  ref<Expr> replayedValue =
+      state.stack().back().getLocal(wholeKI->dest).value;
+  if (dataRecProfiler)
+    dataRecProfiler->recordLoad(whole, replayedValue);
+  if (!isa<ConstantExpr>(replayedValue)) {
+    ++stats::dataRecLoadedEffective;
+    if (DebugValueConcretization)
+      klee_message("Effective dataRecLoaded at %u",
+                   state.replayDataRecEntriesPosition - 1);
+  }
+  concretizeKInst(state, wholeKI, value, true);
+  return true;
+}
+
 /*
  * Use a given constant value to concretize the result of a given KInstruction.
  * Will add constraint (Eq loadedValue replayedValue) to the given state
@@ -4976,9 +7116,14 @@ bool Executor::tryLoadDataRecording(ExecutionState &state, KInstruction *KI) {
  */
 void Executor::concretizeKInst(ExecutionState &state, KInstruction *KI,
     ref<ConstantExpr> loadedValue, bool writeMem) {
-  ref<Expr> replayedValue = getDestCell(state, KI).value;
+  ref<Expr> replayedValue = state.stack().back().getLocal(KI->dest).value;
     if (ConstantExpr *CE = dyn_cast<ConstantExpr>(replayedValue)) {
-      if (loadedValue->getZExtValue() != CE->getZExtValue()) {
+      if (CE->getWidth() > 64 || loadedValue->getWidth() > 64) {
+        if (CE->getWidth() != loadedValue->getWidth() ||
+            loadedValue->Ne(CE)->isTrue())
+          klee_warning("Loaded w%u ConstantExpr != Replayed",
+                       loadedValue->getWidth());
+      } else if (loadedValue->getZExtValue() != CE->getZExtValue()) {
         klee_warning("Loaded ConstantExpr %lu != Replayed %lu",
             loadedValue->getZExtValue(), CE->getZExtValue());
       }
@@ -5034,14 +7179,15 @@ void Executor::concretizeKInst(ExecutionState &state, KInstruction *KI,
                           loadedValue->Extract(0, innerExpr->getWidth()),
                           isptwritecast);
           shouldAddConstraint = false;
-        } else if ((ci->getOpcode() == Instruction::PtrToInt) &&
+        } else if ((ci->getOpcode() == Instruction::PtrToInt ||
+                    ci->getOpcode() == Instruction::BitCast) &&
                    isptwritecast) {
           if (DebugValueConcretization)
             klee_message("Further PtrToInt concretization base on %s",
                          ci->getName().str().c_str());
           // This is an ptwritecast instruction instrumented by PTWritePass,
-          // which helps record pointer values.
-          // We should further concretize the underlying pointer value
+          // which helps record pointer (and vector) values.
+          // We should further concretize the underlying value
           assert(getWidthForLLVMType(innerI->getType()) ==
                  loadedValue->getWidth());
           concretizeKInst(state, innerKInst, loadedValue, isptwritecast);
@@ -5064,17 +7210,16 @@ void Executor::concretizeKInst(ExecutionState &state, KInstruction *KI,
  */
 bool Executor::tryStoreDataRecording(ExecutionState &state, KInstruction *KI) {
   if (pathWriter) {
-    std::string uniqID = KI->getUniqueID();
     PathEntry pe;
-    ref<Expr> e = getDestCell(state, KI).value;
+    ref<Expr> e = state.stack().back().getLocal(KI->dest).value;
     ConstantExpr *CE = dyn_cast<ConstantExpr>(e);
     assert(CE && "should only record concrete values");
     pe.t = PathEntry::DATAREC;
-    pe.body.drec.IDlen = uniqID.size();
+    pe.body.drec.IDlen = 0;
     pe.body.drec.width = CE->getWidth();
     state.pathOS << pe;
     DataRecEntry dre;
-    dre.instUniqueID = uniqID;
+    dre.instID = KI->dataRecID;
     dre.data = CE->getZExtValue();
     state.pathDataRecOS << dre;
     return true;
@@ -5082,6 +7227,174 @@ bool Executor::tryStoreDataRecording(ExecutionState &state, KInstruction *KI) {
   return false;
 }
 
+bool Executor::isReplaying(const ExecutionState &state) const {
+  return replayPath &&
+         !(ReplayPathPrefix && state.replayPosition >= replayPath->size());
+}
+
+void Executor::setReplayPath(const PathEntryBuffer *path) {
+  assert(!replayKTest && "cannot replay both buffer and path");
+  replayPath = path;
+  divergenceReport.reset();
+}
+
+void Executor::setReplayDataRecEntries(const DataRecBuffer *datarec) {
+  assert(!replayKTest && "cannot replay both buffer and path");
+  replayDataRecEntries = datarec;
+  replayDataRecIDMap.clear();
+  divergenceReport.reset();
+  if (!datarec)
+    return;
+  assert(kmodule && "setModule has to be called before replaying data");
+  // resolve the trace dictionary once, replay then only compares integers
+  for (const std::string &uniqueID : datarec->getIDTable()) {
+    KInstruction *ki = kmodule->getKInstructionByUniqueID(uniqueID);
+    if (!ki)
+      klee_warning("recorded instruction %s not found in module",
+                   uniqueID.c_str());
+    replayDataRecIDMap.push_back(ki ? ki->dataRecID : UINT32_MAX);
+  }
+}
+
+uint64_t Executor::hashReplayPrefix(uint64_t h, unsigned pathBegin,
+                                    unsigned pathEnd, unsigned dataRecBegin,
+                                    unsigned dataRecEnd) const {
+  // FNV-1a over the decision of each entry, DATAREC entries by value and
+  // instruction name since ID tables differ between traces
+  auto mix = [&h](uint64_t v, unsigned bytes) {
+    for (unsigned i = 0; i < bytes; ++i, v >>= 8) {
+      h ^= v & 0xff;
+      h *= 0x100000001b3ULL;
+    }
+  };
+  for (unsigned i = pathBegin; i < pathEnd; ++i) {
+    const PathEntry &pe = (*replayPath)[i];
+    mix(pe.t, 1);
+    switch (pe.t) {
+    case PathEntry::FORK:
+      mix(pe.body.br, 1);
+      break;
+    case PathEntry::SWITCH_EXPIDX:
+    case PathEntry::SWITCH_BBIDX:
+      mix(pe.body.switchIndex, sizeof(pe.body.switchIndex));
+      break;
+    case PathEntry::INDIRECTBR:
+      mix(pe.body.indirectbrIndex, sizeof(pe.body.indirectbrIndex));
+      break;
+    case PathEntry::DATAREC:
+      mix(pe.body.drec.width, sizeof(pe.body.drec.width));
+      break;
+    case PathEntry::SCHEDULE:
+      mix(pe.body.tgtid, sizeof(pe.body.tgtid));
+      break;
+    default:
+      break;
+    }
+  }
+  for (unsigned i = dataRecBegin; i < dataRecEnd; ++i) {
+    DataRecEntry dre = (*replayDataRecEntries)[i];
+    mix(dre.data, sizeof(dre.data));
+    for (char c : replayDataRecEntries->getIDTable()[dre.instID])
+      mix(c, 1);
+    mix(0, 1);
+  }
+  return h;
+}
+
+void Executor::checkpointReplay(ExecutionState &state) {
+  unsigned last = replayCheckpoints.empty()
+                      ? 0
+                      : replayCheckpoints.back().replayPosition;
+  if (state.replayPosition < last + ReplayCheckpointInterval)
+    return;
+  // merge handlers would wait for the snapshot to reach the close point
+  if (!state.openMergeStack.empty())
+    return;
+
+  uint64_t h = 0xcbf29ce484222325ULL;
+  unsigned lastDataRec = 0;
+  if (!replayCheckpoints.empty()) {
+    h = replayCheckpoints.back().prefixHash;
+    lastDataRec = replayCheckpoints.back().dataRecPosition;
+  }
+
+  ReplayCheckpoint cp;
+  cp.replayPosition = state.replayPosition;
+  cp.dataRecPosition = state.replayDataRecEntriesPosition;
+  cp.prefixHash = hashReplayPrefix(h, last, cp.replayPosition, lastDataRec,
+                                   cp.dataRecPosition);
+  cp.state.reset(new ExecutionState(state));
+  cp.memory = memory->snapshot();
+  ExecutionState *snap = cp.state.get();
+  snap->ptreeNode = 0;
+  // fork the streams here, the live state keeps appending to its own
+  if (pathWriter)
+    snap->pathOS = state.pathOS.branch();
+  if (pathDataRecWriter)
+    snap->pathDataRecOS = state.pathDataRecOS.branch();
+  if (symPathWriter)
+    snap->symPathOS = state.symPathOS.branch();
+  if (stackPathWriter)
+    snap->stackPathOS = state.stackPathOS.branch();
+  if (consPathWriter)
+    snap->consPathOS = state.consPathOS.branch();
+  if (statsPathWriter)
+    snap->statsPathOS = state.statsPathOS.branch();
+  replayCheckpoints.push_back(std::move(cp));
+}
+
+ExecutionState *Executor::resumeFromReplayCheckpoint() {
+  if (!replayPath || replayCheckpoints.empty())
+    return nullptr;
+
+  uint64_t h = 0xcbf29ce484222325ULL;
+  unsigned pos = 0, dataRec = 0;
+  size_t numDataRec = replayDataRecEntries ? replayDataRecEntries->size() : 0;
+  size_t valid = 0;
+  for (const ReplayCheckpoint &cp : replayCheckpoints) {
+    if (cp.replayPosition > replayPath->size() ||
+        cp.dataRecPosition > numDataRec)
+      break;
+    h = hashReplayPrefix(h, pos, cp.replayPosition, dataRec,
+                         cp.dataRecPosition);
+    if (h != cp.prefixHash)
+      break;
+    pos = cp.replayPosition;
+    dataRec = cp.dataRecPosition;
+    ++valid;
+  }
+  // deeper snapshots were taken on a trace that diverged from this one
+  replayCheckpoints.resize(valid);
+  if (!valid) {
+    resetMemory();
+    return nullptr;
+  }
+
+  ExecutionState &snap = *replayCheckpoints.back().state;
+  memory->restore(replayCheckpoints.back().memory);
+  ExecutionState *state = new ExecutionState(snap);
+  if (pathWriter)
+    state->pathOS = snap.pathOS.branch();
+  if (pathDataRecWriter)
+    state->pathDataRecOS = snap.pathDataRecOS.branch();
+  if (symPathWriter)
+    state->symPathOS = snap.symPathOS.branch();
+  if (stackPathWriter)
+    state->stackPathOS = snap.stackPathOS.branch();
+  if (consPathWriter)
+    state->consPathOS = snap.consPathOS.branch();
+  if (statsPathWriter)
+    state->statsPathOS = snap.statsPathOS.branch();
+  klee_message("replay: resuming from checkpoint at %u/%lu", pos,
+               replayPath->size());
+  return state;
+}
+
+std::string Executor::getDataRecUniqueID(uint32_t dataRecID) const {
+  assert(dataRecID < kmodule->dataRecInstructions.size());
+  return kmodule->dataRecInstructions[dataRecID]->getUniqueID();
+}
+
 /* Multi-threading related function */
 void Executor::bindArgumentToPthreadCreate(KFunction *kf, unsigned index,
                                            StackFrame &sf, ref<Expr> value) {
@@ -5090,44 +7403,55 @@ void Executor::bindArgumentToPthreadCreate(KFunction *kf, unsigned index,
 
 bool Executor::schedule(ExecutionState &state, bool yield) {
   thread_uid_t beforeSchedule = state.crtThread().tuid;
-  int enabledCount = 0;
-  for (ExecutionState::threads_ty::value_type &tit: state.threads) {
-    if (tit.second.enabled) {
-      ++enabledCount;
-    }
-  }
-  if (enabledCount == 0) {
+  if (state.numEnabledThreads == 0) {
     terminateStateOnError(state, "******* hang (possible deadlock?)", User);
     return false;
   }
 
-  // non preemption and preemption (yield or not) are currently unified
-  // find the first enabled thread after current thread
-  // TODO: cloud9 emulate all possible scheduling here by forking. But I think
-  // deterministic scheduling is suffice for my use case.
-  ExecutionState::threads_ty::iterator it = state.crtThreadIt;
-  do {
-    it = state.nextThread(it);
-  } while (!it->second.enabled);
+  ExecutionState::threads_ty::iterator it = state.threads.end();
+  if (isReplaying(state)) {
+    // follow the recorded decision
+    PathEntry pe;
+    if (!getNextPathEntry(state, pe))
+      return false;
+    if (pe.t != PathEntry::SCHEDULE)
+      return replayDiverged(state, state.replayPosition - 1,
+                            "Wrong PathEntry_t during schedule",
+                            ReplayDivergenceReport::describe(pe), "SCHEDULE",
+                            false);
+    it = state.threads.find(
+        thread_uid_t(pe.scheduleTid(), pe.schedulePid()));
+    if (it == state.threads.end() || !it->second.enabled) {
+      klee_message("Ambiguous scheduling, recorded thread %lu of process %lu "
+                   "is not enabled",
+                   (unsigned long)pe.scheduleTid(),
+                   (unsigned long)pe.schedulePid());
+      it = state.threads.end();
+    }
+  }
+  if (it == state.threads.end()) {
+    // non preemption and preemption (yield or not) are currently unified
+    // find the first enabled thread after current thread
+    // TODO: cloud9 emulate all possible scheduling here by forking. But I
+    // think deterministic scheduling is suffice for my use case.
+    it = state.crtThreadIt;
+    do {
+      it = state.nextThread(it);
+    } while (!it->second.enabled);
+  }
   state.scheduleNext(it);
   thread_uid_t afterSchedule = state.crtThread().tuid;
   if (pathWriter) {
     PathEntry pe;
     pe.t = PathEntry::SCHEDULE;
-    pe.body.tgtid = afterSchedule.first;
+    pe.body.tgtid =
+        PathEntry::scheduleTarget(afterSchedule.first, afterSchedule.second);
     state.pathOS << pe;
   }
-  if (replayPath) {
-    PathEntry pe;
-    getNextPathEntry(state, pe);
-    assert(pe.t == PathEntry::SCHEDULE && "Wrong PathEntry_t during schedule");
-    if (pe.body.tgtid != afterSchedule.first) {
-      klee_message("Ambiguous scheduling, why?");
-    }
-  }
   if (DebugScheduling) {
-    klee_message("Context Swtich: from %lu to %lu", beforeSchedule.first,
-        afterSchedule.first);
+    klee_message("Context Swtich: from %lu:%lu to %lu:%lu",
+                 beforeSchedule.second, beforeSchedule.first,
+                 afterSchedule.second, afterSchedule.first);
   }
   return true;
 }
@@ -5152,17 +7476,51 @@ void Executor::executeThreadCreate(ExecutionState &state, thread_id_t tid,
       state, "klee_thread_create cannot locate the start_function", User);
 }
 void Executor::executeThreadExit(ExecutionState &state) {
-  if (state.threads.size() == 1) {
-    terminateStateOnExit(state);
+  // the process exits with its last thread
+  process_id_t pid = state.crtThread().getPid();
+  unsigned processThreads = 0;
+  for (const ExecutionState::threads_ty::value_type &tit : state.threads)
+    processThreads += tit.first.second == pid;
+  if (processThreads == 1) {
+    executeProcessExit(state, 0);
     return;
   }
-  assert(state.threads.size() > 1);
   ExecutionState::threads_ty::iterator thrIt = state.crtThreadIt;
-  thrIt->second.enabled = false;
+  state.disableThread(thrIt->second);
 
   if (!schedule(state, false))
     return;
   state.terminateThread(thrIt);
 }
+
+void Executor::executeProcessFork(ExecutionState &state, KInstruction *target,
+                                  int64_t pid) {
+  unsigned width = getWidthForLLVMType(target->inst->getType());
+  if (pid < 0)
+    pid = state.getFreeProcessId();
+  if (pid <= 0 || pid > 0xff || state.processes.count(pid) ||
+      state.zombies.count(pid)) {
+    bindLocal(target, state, ConstantExpr::create(-1, width));
+    return;
+  }
+  klee_message("Forking process %lu", (unsigned long)pid);
+  Thread &child = state.forkProcess(pid);
+  bindLocal(target, state, ConstantExpr::create(pid, width));
+  child.stack.back().getWriteableLocal(target->dest).value =
+      ConstantExpr::create(0, width);
+}
+
+void Executor::executeProcessExit(ExecutionState &state, int32_t status) {
+  if (state.processes.size() == 1) {
+    terminateStateOnExit(state);
+    return;
+  }
+  process_id_t pid = state.crtThread().getPid();
+  state.disableProcess(pid, status);
+
+  if (!schedule(state, false))
+    return;
+  state.terminateProcess(pid);
+}
 /* MISC */
 static void (*dummy_include_debug_helper)(llvm::raw_ostream &) __attribute__((unused)) = printDebugLibVersion;
@@ -22,6 +22,7 @@
 #include "klee/Internal/Module/KModule.h"
 #include "klee/Internal/System/Time.h"
 #include "klee/Interpreter.h"
+#include "klee/util/BatchEvaluator.h"
 #include "klee/util/OracleEvaluator.h"
 
 //#include "../Solver/QueryLoggingSolver.h"
@@ -30,9 +31,14 @@
 #include "llvm/Support/raw_ostream.h"
 
 #include "../Expr/ArrayExprOptimizer.h"
+#include "MemoryManager.h"
+#include "MergeRegions.h"
+#include "QueryCostPredictor.h"
+#include "ReplayBudget.h"
 
 #include <map>
 #include <memory>
+#include <sys/types.h>
 #include <set>
 #include <string>
 #include <unordered_set>
@@ -79,6 +85,12 @@ namespace klee {
   class TreeStreamWriter;
   class MergeHandler;
   class MergingSearcher;
+  class MetricsServer;
+  class Watchdog;
+  class PathDumpTable;
+  class ReplayDivergenceReport;
+  class DataRecProfiler;
+  class SolverProfiler;
   template<class T> class ref;
 
 
@@ -127,6 +139,9 @@ private:
 
   ExternalDispatcher *externalDispatcher;
   TimingSolver *solver;
+  /// Solver chain for the retries of timed out queries, if they use another
+  /// backend (see --solver-timeout-retry-backend)
+  TimingSolver *retrySolver = nullptr;
   MemoryManager *memory;
   std::set<ExecutionState*> states;
   StatsTracker *statsTracker;
@@ -163,6 +178,16 @@ private:
   /// globals that have no representative object (i.e. functions).
   std::map<const llvm::GlobalValue*, ref<ConstantExpr> > globalAddresses;
 
+  /// The functions a native call runs and the addresses of the other
+  /// globals they refer to, see callNativeFunction
+  struct NativeClosure {
+    std::vector<llvm::Function *> functions;
+    std::map<const llvm::GlobalValue *, uint64_t> addresses;
+  };
+  /// By the function called, nullptr if a global has no address
+  std::map<const llvm::Function *, std::unique_ptr<NativeClosure> >
+      nativeClosures;
+
   /// The set of legal function addresses, used to validate function
   /// pointers. We use the actual Function* address as the function address.
   std::set<uint64_t> legalFunctions;
@@ -175,16 +200,36 @@ private:
   OracleEvaluator *oracle_eval;
 
   /// When non-null a list of branch decisions to be used for replay.
-  const std::vector<PathEntry> *replayPath;
-  const std::vector<DataRecEntry> *replayDataRecEntries;
+  const PathEntryBuffer *replayPath;
+  const DataRecBuffer *replayDataRecEntries;
+  /// Maps the ID table of replayDataRecEntries to KInstruction::dataRecID,
+  /// so that replay can check recorded instructions without strings.
+  std::vector<uint32_t> replayDataRecIDMap;
 
   /// The index into the current \ref replayKTest or \ref replayPath
   /// object. (moved inside ExecutionState, since we might replay multiple states at the same time)
   /// unsigned replayPosition;
 
-  /// When non-null a list of "seed" inputs which will be used to
+  /// A snapshot of the single replaying state, taken every
+  /// ReplayCheckpointInterval path entries. A later replay of a trace that
+  /// shares the prefix up to replayPosition resumes from it.
+  struct ReplayCheckpoint {
+    unsigned replayPosition;
+    unsigned dataRecPosition;
+    /// hashReplayPrefix of path entries [0, replayPosition) and DATAREC
+    /// entries [0, dataRecPosition)
+    uint64_t prefixHash;
+    std::unique_ptr<ExecutionState> state;
+    /// The allocator, so that a resumed replay gets the addresses of a
+    /// replay from the start
+    MemoryManager::Snapshot memory;
+  };
+  /// Ordered by replayPosition
+  std::vector<ReplayCheckpoint> replayCheckpoints;
+
+  /// When non-null a source of "seed" inputs which will be used to
   /// drive execution.
-  const std::vector<struct KTest *> *usingSeeds;
+  SeedSource *usingSeeds;
 
   /// Disables forking, instead a random path is chosen. Enabled as
   /// needed to control memory usage. \see fork()
@@ -197,14 +242,32 @@ private:
   /// step.
   bool haltExecution;
 
-  /// Whether implied-value concretization is enabled. Currently
-  /// false, it is buggy (it needs to validate its writes).
+  /// Whether implied-value concretization is enabled, see
+  /// -implied-value-concretization.
   bool ivcEnabled;
 
   /// The maximum time to allow for a single core solver query.
   /// (e.g. for a single STP query)
   time::Span coreSolverTimeout;
 
+  /// Log of the timed out branch queries (solver-timeouts.txt)
+  std::unique_ptr<llvm::raw_fd_ostream> solverTimeoutsFile;
+  unsigned solverTimeoutCount = 0;
+
+  /// Predicts the time of branch queries, see -predict-solver-timeouts
+  QueryCostPredictor queryCostPredictor;
+  /// The instructions of the conditions already logged as predicted
+  /// timeouts
+  std::set<const KInstruction *> predictedTimeouts;
+
+  /// Spreads -max-time over the trace, see -replay-budget
+  std::unique_ptr<ReplayBudget> replayBudget;
+  /// Log of replayBudget (replay-budget.txt)
+  std::unique_ptr<llvm::raw_fd_ostream> replayBudgetFile;
+  /// When the -max-time timer was started, and whether it expired
+  time::Point maxTimeStart;
+  bool maxTimeReached = false;
+
   /// Maximum time to allow for a single instruction.
   time::Span maxInstructionTime;
 
@@ -220,9 +283,33 @@ private:
   // @brief buffer to store logs before flushing to file
   llvm::raw_string_ostream debugLogBuffer;
 
+  /// Whether -debug-print-instructions prints anything
+  const bool printInstructions;
+
   // @brief if printInfo is requested
   bool info_requested;
 
+  /// Serves live progress when --metrics-port is set
+  std::unique_ptr<MetricsServer> metricsServer;
+  /// Value of stats::instructions at which to publish the metrics next
+  uint64_t nextMetricsPublish = 0;
+
+  /// Watches the limits of the run while it runs, see handleWatchdog()
+  std::unique_ptr<Watchdog> watchdog;
+
+  /// Attributes the solver time when --solver-profile is set
+  std::unique_ptr<SolverProfiler> solverProfiler;
+
+  /// Counts the useful data recordings when --datarec-profile is set
+  std::unique_ptr<DataRecProfiler> dataRecProfiler;
+
+  /// Interns the stack and constraint dumps with -path-dump-format=interned
+  std::unique_ptr<PathDumpTable> pathDumpTable;
+
+  /// Writes replay-divergence.jsonl, opened at the first divergence of the
+  /// current replay
+  std::unique_ptr<ReplayDivergenceReport> divergenceReport;
+
   /// Optimizes expressions
   ExprOptimizer optimizer;
 
@@ -230,11 +317,29 @@ private:
   /// `nullptr` if merging is disabled
   MergingSearcher *mergingSearcher = nullptr;
 
+  /// The regions of -auto-merge, analyzed when a state first forks in them
+  MergeRegions mergeRegions;
+
+  /// With -parallel-workers, the id of this process (0 for the first one)
+  /// and the number of ids, its own included, it may still hand out to the
+  /// workers it forks off. Each worker takes over half of the states.
+  unsigned workerID = 0;
+  unsigned workerBudget = 1;
+  /// The number of workers forked off with forkRunWorker
+  unsigned runWorkers = 0;
+  /// The worker processes forked off by this one, waited for after run
+  std::vector<pid_t> workerPIDs;
+
   llvm::Function* getTargetFunction(llvm::Value *calledVal,
                                     ExecutionState &state);
 
   void executeInstruction(ExecutionState &state, KInstruction *ki);
 
+  /// Execute ki through its decoded fast operation. Returns false, without
+  /// changing the state, when an operand is symbolic or the result is not
+  /// well defined on uint64_t, leaving ki to the generic dispatch.
+  bool executeFastInstruction(ExecutionState &state, KInstruction *ki);
+
   void run(ExecutionState &initialState);
 
   // Given a concrete object in our [klee's] address space, add it to
@@ -247,8 +352,122 @@ private:
 			      unsigned offset);
   void initializeGlobals(ExecutionState &state);
 
+  /// Create the initial state for f, including argv/envp and globals.
+  ExecutionState *createMainState(llvm::Function *f, int argc, char **argv,
+                                  char **envp);
+
+  /// Drop all memory objects and global bindings of the previous run.
+  void resetMemory();
+
+  /// Create the solver chains, with their query logs in the current output
+  /// directory.
+  void createSolvers();
+
+  /// Fork off the worker process with the given id and, in the worker, set
+  /// up its output, solvers and statistics. Returns as fork.
+  pid_t forkWorker(unsigned id);
+
+  /// Fork off a worker process that explores half of the states, if the
+  /// -parallel-workers budget allows it and there are enough states to
+  /// share. Either process drops the states the other one explores.
+  void splitStates();
+
+  /// Wait for the worker processes forked off by this one to exit.
+  void waitForWorkers();
+
+  /// Hand the coldest states beyond -export-frontier-states that explore
+  /// past the replayed prefix to InterpreterHandler::exportJob, and drop the
+  /// ones it takes.
+  void exportFrontierStates();
+
+  /// With -auto-merge, open a merge of the states forked at the end of bb
+  /// if they reconverge.
+  void openAutoMerge(llvm::BasicBlock *bb,
+                     const std::vector<ExecutionState *> &branches);
+
+  /// Close the -auto-merge regions whose join state is at.
+  /// \return true if state got paused or merged into another state
+  bool closeAutoMerges(ExecutionState &state);
+
+  /// Whether state follows the -replay-path trace. With -replay-path-prefix,
+  /// a state that has consumed the whole trace explores on its own.
+  bool isReplaying(const ExecutionState &state) const;
+
+  /// Extend hash h over the path entries [pathBegin, pathEnd) and DATAREC
+  /// entries [dataRecBegin, dataRecEnd) of the current replay trace.
+  uint64_t hashReplayPrefix(uint64_t h, unsigned pathBegin, unsigned pathEnd,
+                            unsigned dataRecBegin, unsigned dataRecEnd) const;
+
+  /// Set state.concreteOnly once no symbolic data is reachable; rate limited
+  /// since it scans the whole state.
+  void probeConcreteOnly(ExecutionState &state);
+
+  /// Check the branches deferred by -replay-batch-branches with one query,
+  /// bisecting to the first contradicting one if the batch is infeasible.
+  /// Waits for the background check of state first.
+  /// \return false if state was terminated.
+  bool validateDeferredBranches(ExecutionState &state);
+  /// Check batch under the constraints base, as validateDeferredBranches.
+  /// \return false if state was terminated.
+  bool checkDeferredBranches(
+      ExecutionState &state,
+      const std::vector<std::pair<ref<Expr>, unsigned>> &batch,
+      const Constraints_ty &base);
+
+  /// A batch of deferred branches that a forked process checks while its
+  /// state goes on, see -replay-background-checks
+  struct BackgroundCheck {
+    pid_t pid;
+    /// the process writes its answer here
+    int fd;
+    std::vector<std::pair<ref<Expr>, unsigned>> branches;
+    Constraints_ty base;
+  };
+  /// At most one check per state
+  std::map<const ExecutionState *, BackgroundCheck> backgroundChecks;
+
+  /// Hand the deferred branches of state over to a forked process, after
+  /// the check of its previous batch is done.
+  /// \return false if state was terminated.
+  bool startBackgroundCheck(ExecutionState &state);
+  /// Wait for the background check of state, if there is one, and check
+  /// its batch again in place if it did not hold.
+  /// \return false if state was terminated.
+  bool finishBackgroundCheck(ExecutionState &state);
+  /// Kill the background check of a state that goes away.
+  void cancelBackgroundCheck(const ExecutionState &state);
+
+  /// Snapshot state if it passed the next checkpoint position.
+  void checkpointReplay(ExecutionState &state);
+
+  /// Discard checkpoints whose prefix differs from the current trace.
+  /// \return a copy of the deepest remaining one, or null.
+  ExecutionState *resumeFromReplayCheckpoint();
+
+  /// Count the instruction state is about to execute and move its pc
+  /// past it. Only the PrintInstructions instance has the output of
+  /// -debug-print-instructions compiled in.
+  template <bool PrintInstructions>
   void stepInstruction(ExecutionState &state);
+  void stepInstruction(ExecutionState &state) {
+    if (printInstructions)
+      stepInstruction<true>(state);
+    else
+      stepInstruction<false>(state);
+  }
+  /// Execute the instructions of state, selected by the searcher, until it
+  /// has to select again. run() picks the instance once, so the loop of the
+  /// usual configuration does not test the debug options per instruction.
+  template <bool PrintInstructions> void runState(ExecutionState &state);
+  /// runState for the only state while it replays, when the statistics
+  /// tracker does not need to see each instruction.
+  void runReplayState(ExecutionState &state);
   void updateStates(ExecutionState *current);
+  /// Execute a switch on a symbolic condition with -switch-type=table,
+  /// forking along a decision tree over the segments of ksi.
+  void executeSwitchOnSegments(ExecutionState &state, KSwitchInstruction *ksi,
+                               ref<Expr> cond);
+
   void transferToBasicBlock(const llvm::BasicBlock *dst,
 			    llvm::BasicBlock *src,
 			    ExecutionState &state);
@@ -258,8 +477,20 @@ private:
                             llvm::Function *function,
                             std::vector< ref<Expr> > &arguments);
 
+  const NativeClosure *getNativeClosure(llvm::Function *f);
+
+  /// Run a call of an allowlisted function that NativeCallPass found to
+  /// be bounded natively, if the arguments and the memory they and the
+  /// globals of the function reach are concrete and the call is not on the
+  /// recorded path, whose concrete branches are recorded too.
+  /// \return false if the call has to be interpreted
+  bool callNativeFunction(ExecutionState &state, KInstruction *target,
+                          llvm::Function *function,
+                          std::vector<ref<Expr> > &arguments);
+
   ObjectState *bindObjectInState(ExecutionState &state, const MemoryObject *mo,
-                                 bool isLocal, const Array *array = 0);
+                                 bool isLocal, const Array *array = 0,
+                                 unsigned arrayOffset = 0);
 
   /// Resolve a pointer to the memory objects it could point to the
   /// start of, forking execution when necessary and generating errors
@@ -335,9 +566,32 @@ private:
                          KInstruction *target /* undef if write */,
                          bool force = false /* overwrite read only object */);
 
+  /// The fast path of executeMemoryOperation for an instruction of a block
+  /// that only handles concrete values: a single resolution of a concrete
+  /// address, checked in bounds without the solver.
+  /// \return false if the operation needs the general path
+  bool executeConcreteMemoryOperation(ExecutionState &state, bool isWrite,
+                                      ref<Expr> address, ref<Expr> value,
+                                      KInstruction *ki);
+
+  /// Execute a memory operation of type at a concrete address that falls
+  /// in bounds of a single object, at an integer offset: no expression is
+  /// built for the offset or the bounds check and the solver is not asked.
+  /// \return false, doing nothing, if the operation needs the general path
+  bool executeInBoundsMemoryOperation(ExecutionState &state, bool isWrite,
+                                      uint64_t address, ref<Expr> value,
+                                      Expr::Width type, KInstruction *ki,
+                                      bool force);
+
   void executeMakeSymbolic(ExecutionState &state, const MemoryObject *mo,
                            const std::string &name);
 
+  /// Make the objects symbolic as one batch, backed by a single array of
+  /// the given name that holds their bytes one after the other.
+  void executeMakeSymbolic(ExecutionState &state,
+                           const std::vector<const MemoryObject *> &objects,
+                           const std::string &name);
+
   /// Create a new state where each input condition has been added as
   /// a constraint and return the results. The input state is included
   /// as one of the results. Note that the output vector may included
@@ -351,6 +605,18 @@ private:
   // current state, and one of the states may be null.
   StatePair fork(ExecutionState &current, ref<Expr> condition, bool isInternal);
 
+  /// Evaluate the conditions against all the seeds at once. The result of
+  /// conditions[i] for seeds[k] is results[k * conditions.size() + i]; it
+  /// is Unknown where the seed leaves the condition symbolic, and the
+  /// solver has to decide.
+  void evaluateSeeds(const std::vector<SeedInfo> &seeds,
+                     const std::vector<ref<Expr>> &conditions,
+                     std::vector<BatchEvaluator::Result> &results);
+
+  /// Whether condition holds for seed, given its result from evaluateSeeds.
+  bool seedSatisfies(ExecutionState &state, SeedInfo &seed,
+                     ref<Expr> condition, BatchEvaluator::Result result);
+
   /// Add the given (boolean) condition as a constraint on state. This
   /// function is a wrapper around the state's addConstraint function
   /// which also manages propagation of implied values,
@@ -358,6 +624,10 @@ private:
   /// return: true if condition could be True, otherwise false
   bool addConstraint(ExecutionState &state, ref<Expr> condition);
 
+  /// Replace the constraints of state with their compaction, see
+  /// ConstraintManager::compact.
+  void compactConstraints(ExecutionState &state);
+
   // Called on [for now] concrete reads, replaces constant with a symbolic
   // Used for testing.
   ref<Expr> replaceReadWithSymbolic(ExecutionState &state, ref<Expr> e);
@@ -368,16 +638,16 @@ private:
   Cell& getArgumentCell(ExecutionState &state,
                         KFunction *kf,
                         unsigned index) {
-    return state.stack().back().locals[kf->getArgRegister(index)];
+    return state.stack().back().getWriteableLocal(kf->getArgRegister(index));
   }
 
   Cell& getArgumentCell(StackFrame &sf, KFunction *kf, unsigned index) {
-    return sf.locals[kf->getArgRegister(index)];
+    return sf.getWriteableLocal(kf->getArgRegister(index));
   }
 
   Cell& getDestCell(ExecutionState &state,
                     KInstruction *target) {
-    return state.stack().back().locals[target->dest];
+    return state.stack().back().getWriteableLocal(target->dest);
   }
 
   void bindLocal(KInstruction *target,
@@ -432,6 +702,8 @@ private:
   void terminateState(ExecutionState &state);
   // call exit handler and terminate state
   void terminateStateEarly(ExecutionState &state, const llvm::Twine &message);
+  // write a test case from which state can be resumed and terminate it
+  void spillState(ExecutionState &state);
   // call exit handler and terminate state
   void terminateStateOnExit(ExecutionState &state);
   // call error handler and terminate state
@@ -448,6 +720,27 @@ private:
                                  const llvm::Twine &info="") {
     terminateStateOnError(state, message, Exec, NULL, info);
   }
+  /// Retry a branch query which timed out with timeout, with escalating
+  /// budgets. \return true if a retry produced result.
+  bool retryTimedOutQuery(ExecutionState &state, ref<Expr> condition,
+                          time::Span timeout, Solver::Validity &result);
+
+  /// Append the timed out query to solver-timeouts.txt and dump the
+  /// constraints related to condition as a .kquery file.
+  void recordSolverTimeout(ExecutionState &state, ref<Expr> condition,
+                           time::Span timeout, unsigned retries,
+                           bool recovered);
+
+  /// Log a branch query predicted to take more than the solver timeout as
+  /// recordSolverTimeout does a timed out one.
+  void recordPredictedTimeout(ExecutionState &state, ref<Expr> condition,
+                              double predicted, time::Span timeout);
+
+  /// Append an entry of kind about the query of condition with outcome to
+  /// solver-timeouts.txt, with the data to record for it.
+  void recordHardQuery(ExecutionState &state, ref<Expr> condition,
+                       const char *kind, const std::string &outcome);
+
   void exitOnSolverTimeout(ExecutionState &state, const llvm::Twine &message) {
     terminateStateOnError(state, message, Timeout);
     interpreterHandler->reportInEngineTime();
@@ -464,13 +757,39 @@ private:
   /// constant values.
   void bindInstructionConstants(KInstruction *KI);
 
+  /// Replace the symbolic bytes of the objects of state that e being value
+  /// and the bounds of the other constraints fix to a single value with
+  /// that value, adding the equalities it takes as constraints.
   void doImpliedValueConcretization(ExecutionState &state,
                                     ref<Expr> e,
                                     ref<ConstantExpr> value);
 
-  void checkMemoryUsage();
+  /// Keep only the constraint factors of state on the inputs that the
+  /// symbolic registers of its current function depend on, and return the
+  /// other arrays in dropped.
+  void sliceTestInputs(ExecutionState &state,
+                       std::set<const Array *> &dropped);
+
+  /// The bytes to give an input that was not solved for: those of a seed
+  /// of state, else those of the oracle KTest, else zeros.
+  std::vector<unsigned char> getDefaultInput(const ExecutionState &state,
+                                             const Array *array);
+
+  /// Enforce -max-memory given the malloc usage sampled by the watchdog
+  void checkMemoryUsage(uint64_t mallocUsage);
+
+  /// Start the watchdog of the current process
+  void startWatchdog();
+
+  /// Do what the flags the watchdog raised ask for
+  void handleWatchdog();
   void printDebugInstructions(ExecutionState &state);
   void doDumpStates();
+  PathDumpTable &getPathDumpTable();
+  /// Write the stack, or the constraint, of current to its stackPathOS, or
+  /// consPathOS, in the -path-dump-format
+  void dumpStackPath(ExecutionState &current);
+  void dumpConsPath(ExecutionState &current, const ref<Expr> &new_constraint);
   void dumpStateAtBranch(ExecutionState &state, PathEntry pe, ref<Expr> new_constraint);
   void dumpStateAtFork(ExecutionState &current, ref<Expr> condition);
   /// Record a single bit based on Solver Validity result.
@@ -493,6 +812,25 @@ private:
 
   void printInfo(llvm::raw_ostream &os);
 
+  /// Copy the progress of the run into metricsServer
+  void publishMetrics();
+
+  /// The state furthest into the replayed trace, nullptr if none replays
+  ExecutionState *getFurthestReplayState() const;
+
+  /// Log the last segment of replayBudget. If -max-time halted the replay,
+  /// write replay-budget-exhausted.txt with the instructions worth recording
+  /// next, also in replay-budget.ptwrite-cfg, and the test case of the
+  /// furthest state as the checkpoint.
+  void finishReplayBudget();
+
+  /// Write the solver-profile.* files from solverProfiler
+  void writeSolverProfile();
+
+  /// Write datarec-profile.txt, and datarec-pruned.ptwrite-cfg, from
+  /// dataRecProfiler
+  void writeDataRecProfile();
+
   /// Only for debug purposes; enable via debugger or klee-control
   void dumpStates();
   void dumpPTree();
@@ -521,6 +859,14 @@ private:
   void executeThreadCreate(ExecutionState &state, thread_id_t tid,
                            ref<Expr> start_function, ref<Expr> arg);
   void executeThreadExit(ExecutionState &state);
+  /// Fork the running process into process pid (the lowest free id if pid is
+  /// negative), binding the id of the child to target in the parent and 0 in
+  /// the child, or -1 if there is no id left
+  void executeProcessFork(ExecutionState &state, KInstruction *target,
+                          int64_t pid);
+  /// Exit the running process with status, the state terminates with the
+  /// last process
+  void executeProcessExit(ExecutionState &state, int32_t status);
 
 public:
 
@@ -554,19 +900,24 @@ public:
     replayKTest = out;
   }
 
-  void setReplayPath(const std::vector<PathEntry> *path) override {
-    assert(!replayKTest && "cannot replay both buffer and path");
-    replayPath = path;
-  }
+  void setReplayPath(const PathEntryBuffer *path) override;
 
-  void setReplayDataRecEntries(const std::vector<DataRecEntry> *datarec) override {
-    assert(!replayKTest && "cannot replay both buffer and path");
-    replayDataRecEntries = datarec;
-  }
+  void setReplayDataRecEntries(const DataRecBuffer *datarec) override;
+
+  std::string getDataRecUniqueID(uint32_t dataRecID) const override;
 
+  /// Read the DATAREC path entry and the DataRecEntry recorded for KI
+  /// \return false if they do not match KI and state was terminated
+  bool getNextDataRecording(ExecutionState &state, KInstruction *KI,
+                            PathEntry &pe, DataRecEntry &dre);
   /// Try load the value of a given KInstuction from recorded path file
   /// \param[out] true if given KInst is loaded successfully
   bool tryLoadDataRecording(ExecutionState &state, KInstruction *KI);
+  /// Load one 64-bit part of a value that PTWritePass recorded in several
+  /// ptwrites. The last part concretizes the whole value.
+  /// \param[out] true if given KInst is loaded successfully
+  bool tryLoadDataRecordingPart(ExecutionState &state, KInstruction *KI,
+                                llvm::MDNode *part);
   /// use a given constant value to concretize the result of a given
   /// KInstruction.
   void concretizeKInst(ExecutionState &state, KInstruction *KI,
@@ -575,29 +926,51 @@ public:
   /// \param[out] true if given KInst is recorded successfully
   bool tryStoreDataRecording(ExecutionState &state, KInstruction *KI);
 
-  // Read next PathEntry using (and advancing) the cursor in state
-  void getNextPathEntry(ExecutionState &state, PathEntry &pe) {
+  /// Report that state disagrees with the trace entry at position and
+  /// terminate it, unless the divergence is one the state can go on from
+  /// (canContinue) and -replay-continue-after-divergence is set.
+  /// \return true if state goes on
+  bool replayDiverged(ExecutionState &state, unsigned position,
+                      const std::string &reason, const std::string &expected,
+                      const std::string &actual, bool canContinue);
+
+  /// Read next PathEntry using (and advancing) the cursor in state
+  /// \return false if state ran past the end of the trace and was terminated
+  bool getNextPathEntry(ExecutionState &state, PathEntry &pe) {
     assert(replayPath && "Trying to get next PathEntry without a valud replayPath");
-    assert(state.replayPosition < replayPath->size() && "replayPath exhausts too early");
+    if (state.replayPosition >= replayPath->size())
+      return replayDiverged(state, state.replayPosition,
+                            "replayPath exhausts too early", "end of trace",
+                            "another entry", false);
     pe = (*replayPath)[state.replayPosition++];
+    return true;
   }
 
-  void getNextDataRecEntry(ExecutionState &state, DataRecEntry &dre) {
+  /// \return false if state ran past the end of the DATAREC entries and was
+  /// terminated
+  bool getNextDataRecEntry(ExecutionState &state, DataRecEntry &dre) {
     assert(replayDataRecEntries && "Trying to get next DataRecEntry without a valid replayDataRecEntries");
-    assert(state.replayDataRecEntriesPosition < replayDataRecEntries->size() && "replayDataRecEntries exhausts too early");
+    if (state.replayDataRecEntriesPosition >= replayDataRecEntries->size())
+      return replayDiverged(state, state.replayPosition - 1,
+                            "replayDataRecEntries exhausts too early",
+                            "end of DATAREC entries", "another DATAREC entry",
+                            false);
     dre = (*replayDataRecEntries)[state.replayDataRecEntriesPosition++];
+    return true;
   }
 
   llvm::Module *setModule(std::vector<std::unique_ptr<llvm::Module>> &modules,
                           const ModuleOptions &opts) override;
 
-  void useSeeds(const std::vector<struct KTest *> *seeds) override {
+  void useSeeds(SeedSource *seeds) override {
     usingSeeds = seeds;
   }
 
   void runFunctionAsMain(llvm::Function *f, int argc, char **argv,
                          char **envp) override;
 
+  int forkRunWorker() override;
+
   /*** Runtime options ***/
 
   void setHaltExecution(bool value) override { haltExecution = value; }
@@ -651,7 +1024,8 @@ public:
   ///
   /// \param[in] state The ExecutionState where next branch locates
   /// \param[out] br The branch decision determined by symbolic constraints
-  void AssertNextBranchTaken(ExecutionState &state, bool br);
+  /// \return false if state diverged from the trace and was terminated
+  bool AssertNextBranchTaken(ExecutionState &state, bool br);
 
   /// Get constraints enforced by next recorded branch.
   ///
@@ -665,7 +1039,8 @@ public:
   /// \param[in] condition The symbolic expression bound to this branch
   /// \param[out] new_constraint A single expression consists of conjunctions
   /// \param[out] res Represent if next branch is taken (Solver::True) or not
-  void getNextBranchConstraint(ExecutionState &state, ref<Expr> condition,
+  /// \return false if state diverged from the trace and was terminated
+  bool getNextBranchConstraint(ExecutionState &state, ref<Expr> condition,
       ref<Expr> &new_constraint, Solver::Validity &res);
 
   MergingSearcher *getMergingSearcher() const { return mergingSearcher; };
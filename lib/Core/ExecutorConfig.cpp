@@ -2,3 +2,8 @@
 SymbolicCallWhiteList_t SymbolicPOSIXWhiteList = {
   {"clock_gettime", 0b1}
 };
+NativeCallWhiteList_t NativeCallWhiteList = {
+  "adler32", "crc16", "crc32", "crc32_z", "crc_ccitt", "memchr", "memcmp",
+  "memrchr", "strchr", "strcspn", "strlen", "strncmp", "strnlen", "strrchr",
+  "strspn"
+};
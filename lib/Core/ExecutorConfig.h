@@ -2,6 +2,7 @@
 #define KLEE_EXECUTOR_CONFIG_H
 #include <cstdint>
 #include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringSet.h>
 // SymbolicPOSIXWhiteList whitelists posix functions which accept symbolic
 // arguments.
 // the uint32_t value denotes which argument(s) can be symbolic.
@@ -9,4 +10,9 @@
 typedef uint32_t whitelist_mask_t;
 typedef llvm::StringMap<whitelist_mask_t> SymbolicCallWhiteList_t;
 extern SymbolicCallWhiteList_t SymbolicPOSIXWhiteList;
+// NativeCallWhiteList lists the functions whose calls may run natively once
+// NativeCallPass found that their effects are bounded, e.g. hashes and
+// checksums, which otherwise interpret many instructions per call.
+typedef llvm::StringSet<> NativeCallWhiteList_t;
+extern NativeCallWhiteList_t NativeCallWhiteList;
 #endif // KLEE_EXECUTOR_CONFIG_H
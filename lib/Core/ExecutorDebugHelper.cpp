@@ -31,14 +31,11 @@ void debugDumpLLVMValue(llvm::Value *V) {
 void debugDumpConstraintsEval(ExecutionState &state, ConstraintManager &cm,
                               const std::vector<ref<Expr>> &expr_vec,
                               const char *filename) {
-  std::vector<const Array*> symbolic_objs;
+  std::vector<const Array*> symbolic_objs = state.getSymbolicArrays();
   std::vector<ref<Expr>> simplified_expr_vec;
   for (const ref<Expr> &e: expr_vec) {
     simplified_expr_vec.push_back(cm.simplifyExpr(e));
   }
-  for (auto s: state.symbolics) {
-    symbolic_objs.push_back(s.second);
-  }
   debugDumpConstraintsImpl(cm.getAllConstraints(), symbolic_objs,
                            simplified_expr_vec, filename);
 }
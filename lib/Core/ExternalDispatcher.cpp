@@ -22,6 +22,7 @@
 #include "llvm/Support/DynamicLibrary.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/TargetSelect.h"
+#include "llvm/Transforms/Utils/Cloning.h"
 
 #include <csetjmp>
 #include <csignal>
@@ -46,12 +47,24 @@ class ExternalDispatcherImpl {
 private:
   typedef std::map<const llvm::Instruction *, llvm::Function *> dispatchers_ty;
   dispatchers_ty dispatchers;
+  /// The dispatchers by target and signature of the call, shared among the
+  /// call sites that pass the same argument types
+  typedef std::map<std::pair<const llvm::Function *, llvm::FunctionType *>,
+                   llvm::Function *>
+      stubs_ty;
+  stubs_ty stubs;
+  /// The dispatchers of the functions run natively
+  std::map<const llvm::Function *, llvm::Function *> natives;
+  llvm::FunctionType *getCallSignature(llvm::Function *f,
+                                       llvm::Instruction *i);
   llvm::Function *createDispatcher(llvm::Function *f, llvm::Instruction *i,
                                    llvm::Module *module);
   llvm::ExecutionEngine *executionEngine;
   LLVMContext &ctx;
   std::map<std::string, void *> preboundFunctions;
-  bool runProtectedCall(llvm::Function *f, uint64_t *args);
+  void compileDispatcher(llvm::Function *dispatcher, llvm::Module *module);
+  bool runProtectedCall(llvm::Function *f, uint64_t *args,
+                        bool native = false);
   llvm::Module *singleDispatchModule;
   std::vector<std::string> moduleIDs;
   std::string &getFreshModuleID();
@@ -62,6 +75,11 @@ public:
   ~ExternalDispatcherImpl();
   bool executeCall(llvm::Function *function, llvm::Instruction *i,
                    uint64_t *args);
+  bool executeNativeCall(
+      llvm::Function *function, llvm::Instruction *i,
+      const std::vector<llvm::Function *> &functions,
+      const std::map<const llvm::GlobalValue *, uint64_t> &addresses,
+      uint64_t *args);
   void *resolveSymbol(const std::string &name);
   int getLastErrno();
   void setLastErrno(int newErrno);
@@ -162,6 +180,14 @@ bool ExternalDispatcherImpl::executeCall(Function *f, Instruction *i,
     return runProtectedCall(it->second, args);
   }
 
+  // Another call site may have JIT'ed the same signature already.
+  auto key = std::make_pair(f, getCallSignature(f, i));
+  stubs_ty::iterator stub = stubs.find(key);
+  if (stub != stubs.end()) {
+    dispatchers.insert(std::make_pair(i, stub->second));
+    return runProtectedCall(stub->second, args);
+  }
+
   // Code for this not JIT'ed. Do this now.
   Function *dispatcher;
 #ifdef WINDOWS
@@ -183,17 +209,60 @@ bool ExternalDispatcherImpl::executeCall(Function *f, Instruction *i,
   dispatchModule = new Module(getFreshModuleID(), ctx);
   dispatcher = createDispatcher(f, i, dispatchModule);
   dispatchers.insert(std::make_pair(i, dispatcher));
+  stubs.insert(std::make_pair(key, dispatcher));
+  compileDispatcher(dispatcher, dispatchModule);
+  return runProtectedCall(dispatcher, args);
+}
+
+bool ExternalDispatcherImpl::executeNativeCall(
+    Function *f, Instruction *i, const std::vector<Function *> &functions,
+    const std::map<const GlobalValue *, uint64_t> &addresses,
+    uint64_t *args) {
+  auto it = natives.find(f);
+  if (it != natives.end())
+    return runProtectedCall(it->second, args, true);
+
+  Module *nativeModule = new Module(getFreshModuleID(), ctx);
+  // The copies are internal to their module, so their names do not clash
+  // with those of the functions they are copies of.
+  ValueToValueMapTy VMap;
+  for (Function *g : functions)
+    VMap[g] = Function::Create(g->getFunctionType(),
+                               GlobalValue::InternalLinkage, g->getName(),
+                               nativeModule);
+  for (auto &ga : addresses)
+    VMap[ga.first] = ConstantExpr::getIntToPtr(
+        ConstantInt::get(Type::getInt64Ty(ctx), ga.second),
+        ga.first->getType());
+  for (Function *g : functions) {
+    Function *copy = cast<Function>(VMap[g]);
+    Function::arg_iterator ca = copy->arg_begin();
+    for (Argument &a : g->args())
+      VMap[&a] = &*ca++;
+    SmallVector<ReturnInst *, 8> returns;
+    CloneFunctionInto(copy, g, VMap, /*ModuleLevelChanges=*/true, returns);
+    copy->setLinkage(GlobalValue::InternalLinkage);
+    copy->setVisibility(GlobalValue::DefaultVisibility);
+    copy->setComdat(nullptr);
+  }
+
+  Function *dispatcher =
+      createDispatcher(cast<Function>(VMap[f]), i, nativeModule);
+  natives.insert(std::make_pair(f, dispatcher));
+  compileDispatcher(dispatcher, nativeModule);
+  return runProtectedCall(dispatcher, args, true);
+}
 
+void ExternalDispatcherImpl::compileDispatcher(Function *dispatcher,
+                                               Module *module) {
   // Force the JIT execution engine to go ahead and build the function. This
   // ensures that any errors or assertions in the compilation process will
   // trigger crashes instead of being caught as aborts in the external
   // function.
   if (dispatcher) {
-    // The dispatchModule is now ready so tell MCJIT to generate the code for
-    // it.
-    auto dispatchModuleUniq = std::unique_ptr<Module>(dispatchModule);
-    executionEngine->addModule(
-        std::move(dispatchModuleUniq)); // MCJIT takes ownership
+    // The module is now ready so tell MCJIT to generate the code for it.
+    auto moduleUniq = std::unique_ptr<Module>(module);
+    executionEngine->addModule(std::move(moduleUniq)); // MCJIT takes ownership
     // Force code generation
     uint64_t fnAddr =
         executionEngine->getFunctionAddress(dispatcher->getName());
@@ -202,15 +271,35 @@ bool ExternalDispatcherImpl::executeCall(Function *f, Instruction *i,
     (void)fnAddr;
   } else {
     // MCJIT didn't take ownership of the module so delete it.
-    delete dispatchModule;
+    delete module;
   }
-  return runProtectedCall(dispatcher, args);
+}
+
+/// The type of the target as called from i: the parameter types of the
+/// target, followed by those of the variadic arguments at i. These are the
+/// types the dispatcher loads its arguments as.
+FunctionType *ExternalDispatcherImpl::getCallSignature(Function *f,
+                                                       Instruction *i) {
+  CallSite cs(i);
+  FunctionType *FTy =
+      cast<FunctionType>(cast<PointerType>(f->getType())->getElementType());
+  if (!FTy->isVarArg() && cs.arg_size() == FTy->getNumParams())
+    return FTy;
+
+  std::vector<Type *> types;
+  unsigned n = 0;
+  for (CallSite::arg_iterator ai = cs.arg_begin(), ae = cs.arg_end(); ai != ae;
+       ++ai, ++n)
+    types.push_back(n < FTy->getNumParams() ? FTy->getParamType(n)
+                                            : (*ai)->getType());
+  return FunctionType::get(FTy->getReturnType(), types, FTy->isVarArg());
 }
 
 // FIXME: This is not reentrant.
 static uint64_t *gTheArgsP;
-bool ExternalDispatcherImpl::runProtectedCall(Function *f, uint64_t *args) {
-  struct sigaction segvAction, segvActionOld;
+bool ExternalDispatcherImpl::runProtectedCall(Function *f, uint64_t *args,
+                                              bool native) {
+  struct sigaction segvAction, segvActionOld, fpeActionOld, busActionOld;
   bool res;
 
   if (!f)
@@ -225,6 +314,11 @@ bool ExternalDispatcherImpl::runProtectedCall(Function *f, uint64_t *args) {
   segvAction.sa_flags = SA_SIGINFO;
   segvAction.sa_sigaction = ::sigsegv_handler;
   sigaction(SIGSEGV, &segvAction, &segvActionOld);
+  // the interpreter reports what stops a native call, e.g. a division by zero
+  if (native) {
+    sigaction(SIGFPE, &segvAction, &fpeActionOld);
+    sigaction(SIGBUS, &segvAction, &busActionOld);
+  }
 
   if (sigsetjmp(escapeCallJmpBuf, 1)) {
     res = false;
@@ -237,6 +331,10 @@ bool ExternalDispatcherImpl::runProtectedCall(Function *f, uint64_t *args) {
   }
 
   sigaction(SIGSEGV, &segvActionOld, nullptr);
+  if (native) {
+    sigaction(SIGFPE, &fpeActionOld, nullptr);
+    sigaction(SIGBUS, &busActionOld, nullptr);
+  }
   return res;
 }
 
@@ -253,7 +351,7 @@ bool ExternalDispatcherImpl::runProtectedCall(Function *f, uint64_t *args) {
 Function *ExternalDispatcherImpl::createDispatcher(Function *target,
                                                    Instruction *inst,
                                                    Module *module) {
-  if (!resolveSymbol(target->getName()))
+  if (target->getParent() != module && !resolveSymbol(target->getName()))
     return 0;
 
   CallSite cs;
@@ -342,6 +440,14 @@ bool ExternalDispatcher::executeCall(llvm::Function *function,
   return impl->executeCall(function, i, args);
 }
 
+bool ExternalDispatcher::executeNativeCall(
+    llvm::Function *function, llvm::Instruction *i,
+    const std::vector<llvm::Function *> &functions,
+    const std::map<const llvm::GlobalValue *, uint64_t> &addresses,
+    uint64_t *args) {
+  return impl->executeNativeCall(function, i, functions, addresses, args);
+}
+
 void *ExternalDispatcher::resolveSymbol(const std::string &name) {
   return impl->resolveSymbol(name);
 }
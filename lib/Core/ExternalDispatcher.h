@@ -16,8 +16,10 @@
 #include <memory>
 #include <stdint.h>
 #include <string>
+#include <vector>
 
 namespace llvm {
+class GlobalValue;
 class Instruction;
 class LLVMContext;
 class Function;
@@ -39,6 +41,17 @@ public:
    */
   bool executeCall(llvm::Function *function, llvm::Instruction *i,
                    uint64_t *args);
+  /* Call the given function, defined in the module, natively. Its body and
+   * those of the functions it calls, which are listed in functions, are
+   * JIT'ed with the other globals they refer to replaced by their addresses.
+   * The arguments are passed as by executeCall. Stops the call, returning
+   * false, on a segmentation fault or an arithmetic exception.
+   */
+  bool executeNativeCall(
+      llvm::Function *function, llvm::Instruction *i,
+      const std::vector<llvm::Function *> &functions,
+      const std::map<const llvm::GlobalValue *, uint64_t> &addresses,
+      uint64_t *args);
   void *resolveSymbol(const std::string &name);
 
   int getLastErrno();
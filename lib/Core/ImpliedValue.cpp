@@ -16,6 +16,7 @@
 #include "klee/Expr/ExprUtil.h"
 #include "klee/Internal/Support/IntEvaluation.h" // FIXME: Use APInt
 #include "klee/Solver/Solver.h"
+#include "klee/util/Bits.h"
 
 #include <map>
 #include <set>
@@ -254,3 +255,172 @@ void ImpliedValue::checkForImpliedValues(Solver *S, ref<Expr> e,
 
   assert(found.empty());
 }
+
+namespace {
+/// What the constraints tell of the unsigned value of a term
+struct TermBounds {
+  uint64_t min, max;
+  /// the bits of the value that are known, and their values
+  uint64_t knownMask = 0, knownBits = 0;
+
+  explicit TermBounds(Expr::Width w)
+      : min(0), max(bits64::maxValueOfNBits(w)) {}
+  bool infeasible() const { return min > max; }
+};
+
+/// Collects the bounds of terms compared with constants, from constraints
+/// in the canonical form Expr::create builds.
+class BoundsCollector {
+  std::map<ref<Expr>, TermBounds> &bounds;
+  /// whether terms not seen yet are added
+  bool addTerms;
+
+  TermBounds *lookup(const ref<Expr> &term) {
+    if (isa<ConstantExpr>(term) || term->getWidth() > 64)
+      return nullptr;
+    auto it = bounds.find(term);
+    if (it != bounds.end())
+      return &it->second;
+    if (!addTerms)
+      return nullptr;
+    auto ins = bounds.insert(std::make_pair(term, TermBounds(term->getWidth())));
+    return &ins.first->second;
+  }
+
+  void narrow(const ref<Expr> &term, uint64_t min, uint64_t max) {
+    if (TermBounds *b = lookup(term)) {
+      b->min = std::max(b->min, min);
+      b->max = std::min(b->max, max);
+    }
+  }
+
+  void narrowMask(const ref<Expr> &term, uint64_t mask, uint64_t bits) {
+    TermBounds *b = lookup(term);
+    if (!b)
+      return;
+    if ((bits & ~mask) || ((b->knownBits ^ bits) & b->knownMask & mask)) {
+      b->min = 1;
+      b->max = 0;
+      return;
+    }
+    b->knownMask |= mask;
+    b->knownBits |= bits;
+  }
+
+public:
+  BoundsCollector(std::map<ref<Expr>, TermBounds> &_bounds, bool _addTerms)
+      : bounds(_bounds), addTerms(_addTerms) {}
+
+  /// Collect the bounds implied by e being value.
+  void collect(const ref<Expr> &e, bool value) {
+    switch (e->getKind()) {
+    case Expr::And:
+      if (value) {
+        collect(e->getKid(0), true);
+        collect(e->getKid(1), true);
+      }
+      break;
+    case Expr::Or:
+      if (!value) {
+        collect(e->getKid(0), false);
+        collect(e->getKid(1), false);
+      }
+      break;
+    case Expr::Eq: {
+      const EqExpr *ee = cast<EqExpr>(e);
+      const ConstantExpr *c = dyn_cast<ConstantExpr>(ee->left);
+      if (!c || c->getWidth() > 64)
+        break;
+      // (false == e) is the negation of e
+      if (c->getWidth() == Expr::Bool) {
+        collect(ee->right, value == c->isTrue());
+        break;
+      }
+      // C == M & t
+      if (const AndExpr *ae = dyn_cast<AndExpr>(ee->right))
+        if (value)
+          if (const ConstantExpr *m = dyn_cast<ConstantExpr>(ae->left))
+            narrowMask(ae->right, m->getZExtValue(), c->getZExtValue());
+      break;
+    }
+    case Expr::Ult:
+    case Expr::Ule: {
+      bool strict = e->getKind() == Expr::Ult;
+      ref<Expr> l = e->getKid(0), r = e->getKid(1);
+      if (l->getWidth() > 64)
+        break;
+      uint64_t top = bits64::maxValueOfNBits(l->getWidth());
+      if (const ConstantExpr *c = dyn_cast<ConstantExpr>(l)) {
+        uint64_t v = c->getZExtValue();
+        // C < t, C <= t, or their negations t <= C, t < C
+        if (value && !(strict && v == top))
+          narrow(r, strict ? v + 1 : v, top);
+        else if (!value && !(!strict && v == 0))
+          narrow(r, 0, strict ? v : v - 1);
+      } else if (const ConstantExpr *c = dyn_cast<ConstantExpr>(r)) {
+        uint64_t v = c->getZExtValue();
+        // t < C, t <= C, or their negations C <= t, C < t
+        if (value && !(strict && v == 0))
+          narrow(l, 0, strict ? v - 1 : v);
+        else if (!value && !(!strict && v == top))
+          narrow(l, strict ? v : v + 1, top);
+      }
+      break;
+    }
+    default:
+      break;
+    }
+  }
+};
+} // namespace
+
+void ImpliedValue::getImpliedRangeValues(ref<Expr> condition,
+                                         const Constraints_ty &constraints,
+                                         ImpliedTermList &results) {
+  std::map<ref<Expr>, TermBounds> bounds;
+  BoundsCollector(bounds, true).collect(condition, true);
+  if (bounds.empty())
+    return;
+  BoundsCollector others(bounds, false);
+  for (const ref<Expr> &constraint : constraints)
+    others.collect(constraint, true);
+
+  for (const auto &entry : bounds) {
+    const ref<Expr> &term = entry.first;
+    const TermBounds &b = entry.second;
+    // an infeasible set is left to the solver to report
+    if (b.infeasible())
+      continue;
+    Expr::Width w = term->getWidth();
+    uint64_t value = 0;
+    unsigned candidates = 0;
+    if (b.knownMask == bits64::maxValueOfNBits(w)) {
+      value = b.knownBits;
+      candidates = value >= b.min && value <= b.max;
+    } else if (b.max - b.min < 256) {
+      for (uint64_t v = b.min; candidates < 2; ++v) {
+        if ((v & b.knownMask) == b.knownBits) {
+          value = v;
+          ++candidates;
+        }
+        if (v == b.max)
+          break;
+      }
+    }
+    if (candidates == 1) {
+      results.push_back(std::make_pair(term, ConstantExpr::create(value, w)));
+      continue;
+    }
+    if (w % 8)
+      continue;
+    for (unsigned byte = 0; byte != w / 8; ++byte) {
+      if (((b.knownMask >> (8 * byte)) & 0xff) != 0xff)
+        continue;
+      ref<Expr> part = ExtractExpr::create(term, 8 * byte, Expr::Int8);
+      if (!isa<ConstantExpr>(part))
+        results.push_back(std::make_pair(
+            part, ConstantExpr::create((b.knownBits >> (8 * byte)) & 0xff,
+                                       Expr::Int8)));
+    }
+  }
+}
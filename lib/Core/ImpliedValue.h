@@ -10,6 +10,7 @@
 #ifndef KLEE_IMPLIEDVALUE_H
 #define KLEE_IMPLIEDVALUE_H
 
+#include "klee/Expr/Constraints.h"
 #include "klee/Expr/Expr.h"
 
 #include <vector>
@@ -28,12 +29,21 @@ namespace klee {
 
   typedef std::vector< std::pair<ref<ReadExpr>, 
                                  ref<ConstantExpr> > > ImpliedValueList;
+  typedef std::vector<std::pair<ref<Expr>, ref<ConstantExpr>>> ImpliedTermList;
   
   namespace ImpliedValue {        
     void getImpliedValues(ref<Expr> e, ref<ConstantExpr> cvalue, 
                           ImpliedValueList &result);
     void checkForImpliedValues(Solver *S, ref<Expr> e, 
                                ref<ConstantExpr> cvalue);    
+
+    /// Find the terms that condition bounds or masks, and that together
+    /// with the bounds and masks of constraints have a single possible
+    /// value. Of a term only partly known, the bytes whose bits are all
+    /// known are given instead.
+    void getImpliedRangeValues(ref<Expr> condition,
+                               const Constraints_ty &constraints,
+                               ImpliedTermList &results);
   }
 
 }
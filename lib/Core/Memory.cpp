@@ -25,9 +25,15 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cerrno>
+#include <cstring>
 #include <sstream>
 
+#include <fcntl.h>
+#include <unistd.h>
+
 using namespace llvm;
 using namespace klee;
 
@@ -37,6 +43,13 @@ namespace {
                     cl::desc("Use constant arrays instead of updates when possible (default=true)\n"),
                     cl::init(true),
                     cl::cat(SolvingCat));
+
+  cl::opt<bool>
+  TrackWriteOrigins("track-write-origins",
+                    cl::desc("Keep the flags and instruction of the last write "
+                             "to every byte of memory and attach them to the "
+                             "updates made from it (default=false)"),
+                    cl::init(false));
 }
 
 /***/
@@ -72,16 +85,39 @@ void MemoryObject::getAllocInfo(std::string &result) const {
 
 /***/
 
+MappedFile::~MappedFile() { ::close(fd); }
+
+void MappedFile::read(uint64_t offset, uint8_t *buf, unsigned length) const {
+  unsigned done = 0;
+  while (done < length) {
+    ssize_t n = ::pread(fd, buf + done, length - done, offset + done);
+    if (n <= 0) {
+      if (n < 0)
+        klee_warning_once(this, "cannot read mapped file %s: %s", path.c_str(),
+                          strerror(errno));
+      break;
+    }
+    done += n;
+  }
+  std::fill(buf + done, buf + length, 0);
+}
+
+/***/
+
 ObjectState::ObjectState(const MemoryObject *mo)
   : copyOnWriteOwner(0),
     object(mo),
-    concreteStore(new uint8_t[mo->size]),
-    flagStore(new uint64_t[mo->size]),
-    kinstStore(new KInstruction*[mo->size]),
+    concreteStore(mo->size, 0),
+    origins(TrackWriteOrigins
+                ? new RunArray<WriteOrigin>(mo->size,
+                                            {Expr::FLAG_INTERNAL, nullptr})
+                : 0),
     concreteMask(0),
     flushMask(0),
     knownSymbolics(0),
     updates(0, 0),
+    arrayOffset(0),
+    pending(0),
     size(mo->size),
     readOnly(false) {
   if (!UseConstantArrays) {
@@ -90,65 +126,53 @@ ObjectState::ObjectState(const MemoryObject *mo)
         getArrayCache()->CreateArray("tmp_arr" + llvm::utostr(++id), size);
     updates = UpdateList(array, 0);
   }
-  memset(concreteStore, 0, size);
-  for (unsigned i = 0; i < size; i++) {
-    flagStore[i] = Expr::FLAG_INTERNAL;
-  }
-  memset(kinstStore, 0, size*sizeof(KInstruction*));
 }
 
 
-ObjectState::ObjectState(const MemoryObject *mo, const Array *array)
+ObjectState::ObjectState(const MemoryObject *mo, const Array *array,
+                         unsigned _arrayOffset)
   : copyOnWriteOwner(0),
     object(mo),
-    concreteStore(new uint8_t[mo->size]),
-    flagStore(new uint64_t[mo->size]),
-    kinstStore(new KInstruction*[mo->size]),
+    concreteStore(mo->size, 0),
+    origins(TrackWriteOrigins
+                ? new RunArray<WriteOrigin>(mo->size,
+                                            {Expr::FLAG_INTERNAL, nullptr})
+                : 0),
     concreteMask(0),
     flushMask(0),
     knownSymbolics(0),
     updates(array, 0),
+    arrayOffset(_arrayOffset),
+    pending(0),
     size(mo->size),
     readOnly(false) {
   makeSymbolic();
-  memset(concreteStore, 0, size);
-  for (unsigned i = 0; i < size; i++) {
-    flagStore[i] = Expr::FLAG_INTERNAL;
-  }
-  memset(kinstStore, 0, size*sizeof(KInstruction*));
 }
 
 ObjectState::ObjectState(const ObjectState &os) 
   : copyOnWriteOwner(0),
     object(os.object),
-    concreteStore(new uint8_t[os.size]),
-    flagStore(new uint64_t[os.size]),
-    kinstStore(new KInstruction*[os.size]),
+    concreteStore(os.concreteStore),
+    origins(os.origins ? new RunArray<WriteOrigin>(*os.origins) : 0),
     concreteMask(os.concreteMask ? new BitArray(*os.concreteMask, os.size) : 0),
     flushMask(os.flushMask ? new BitArray(*os.flushMask, os.size) : 0),
-    knownSymbolics(0),
+    knownSymbolics(os.knownSymbolics
+                       ? new PagedArray<ref<Expr> >(*os.knownSymbolics)
+                       : 0),
     updates(os.updates),
+    arrayOffset(os.arrayOffset),
+    pending(os.pending ? new PendingChunks(*os.pending) : 0),
     size(os.size),
     readOnly(false) {
   assert(!os.readOnly && "no need to copy read only object?");
-  if (os.knownSymbolics) {
-    knownSymbolics = new ref<Expr>[size];
-    for (unsigned i=0; i<size; i++)
-      knownSymbolics[i] = os.knownSymbolics[i];
-  }
-
-  memcpy(concreteStore, os.concreteStore, size*sizeof(*concreteStore));
-  memcpy(flagStore, os.flagStore, size*sizeof(*flagStore));
-  memcpy(kinstStore, os.kinstStore, size*sizeof(*kinstStore));
 }
 
 ObjectState::~ObjectState() {
   delete concreteMask;
   delete flushMask;
-  delete[] knownSymbolics;
-  delete[] concreteStore;
-  delete[] flagStore;
-  delete[] kinstStore;
+  delete knownSymbolics;
+  delete origins;
+  delete pending;
 }
 
 ArrayCache *ObjectState::getArrayCache() const {
@@ -199,11 +223,7 @@ const UpdateList &ObjectState::getUpdates() const {
       Contents[Index->getZExtValue()] = Value;
     }
 
-    static unsigned id = 0;
-    const Array *array = getArrayCache()->CreateArray(
-        "const_arr" + llvm::utostr(++id), size, &Contents[0],
-        &Contents[0] + Contents.size());
-    updates = UpdateList(array, 0);
+    updates = UpdateList(createConstantArray(Contents), 0);
 
     // Apply the remaining (non-constant) writes.
     for (; Begin != End; ++Begin)
@@ -214,6 +234,21 @@ const UpdateList &ObjectState::getUpdates() const {
   return updates;
 }
 
+const Array *
+ObjectState::createConstantArray(std::vector<ref<ConstantExpr> > &contents) const {
+  static unsigned id = 0;
+  return getArrayCache()->CreateArray("const_arr" + llvm::utostr(++id), size,
+                                      &contents[0],
+                                      &contents[0] + contents.size());
+}
+
+ref<Expr> ObjectState::arrayIndex(ref<Expr> offset) const {
+  ref<Expr> index = ZExtExpr::create(offset, Expr::Int32);
+  if (!arrayOffset)
+    return index;
+  return AddExpr::create(ConstantExpr::create(arrayOffset, Expr::Int32), index);
+}
+
 void ObjectState::flushToConcreteStore(TimingSolver *solver,
                                        const ExecutionState &state) const {
   for (unsigned i = 0; i < size; i++) {
@@ -225,7 +260,7 @@ void ObjectState::flushToConcreteStore(TimingSolver *solver,
                      "byte %p+%u will have random value",
                      (void *)object->address, i);
       else
-        ce->toMemory(concreteStore + i);
+        concreteStore.set(i, (uint8_t) ce->getZExtValue(8));
     }
   }
 }
@@ -233,7 +268,7 @@ void ObjectState::flushToConcreteStore(TimingSolver *solver,
 void ObjectState::makeConcrete() {
   delete concreteMask;
   delete flushMask;
-  delete[] knownSymbolics;
+  delete knownSymbolics;
   concreteMask = 0;
   flushMask = 0;
   knownSymbolics = 0;
@@ -243,33 +278,75 @@ void ObjectState::makeSymbolic() {
   assert(updates.head.isNull() &&
          "XXX makeSymbolic of objects with symbolic values is unsupported");
 
-  // XXX simplify this, can just delete various arrays I guess
-  for (unsigned i=0; i<size; i++) {
-    markByteSymbolic(i);
-    setKnownSymbolic(i, 0);
-    markByteFlushed(i);
+  markRangeSymbolic(0, size);
+  delete knownSymbolics;
+  knownSymbolics = 0;
+  if (!flushMask)
+    flushMask = new BitArray(size, false);
+  else
+    flushMask->unsetRange(0, size);
+}
+
+const unsigned ObjectState::MappedChunkSize;
+
+bool ObjectState::mapFile(const std::string &path) {
+  assert(isAllConcrete() && updates.head.isNull() && !flushMask &&
+         "mapping a file over symbolic or flushed contents");
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  delete pending;
+  pending = new PendingChunks();
+  pending->file = new MappedFile(fd, path);
+  pending->count = (size + MappedChunkSize - 1) / MappedChunkSize;
+  pending->chunks.assign(pending->count, true);
+  if (!pending->count) {
+    delete pending;
+    pending = 0;
+  }
+  return true;
+}
+
+void ObjectState::loadPendingChunks(unsigned offset, unsigned length) const {
+  uint8_t buf[MappedChunkSize];
+  unsigned last = (offset + length - 1) / MappedChunkSize;
+  for (unsigned c = offset / MappedChunkSize; c <= last; ++c) {
+    if (!pending->chunks[c])
+      continue;
+    unsigned begin = c * MappedChunkSize;
+    unsigned n = std::min(MappedChunkSize, size - begin);
+    pending->file->read(begin, buf, n);
+    for (unsigned i = 0; i != n; ++i)
+      concreteStore.set(begin + i, buf[i]);
+    if (flushMask)
+      flushMask->setRange(begin, begin + n);
+    pending->chunks[c] = false;
+    if (--pending->count == 0) {
+      delete pending;
+      pending = 0;
+      return;
+    }
   }
 }
 
 void ObjectState::initializeToZero() {
+  delete pending;
+  pending = 0;
   makeConcrete();
-  memset(concreteStore, 0, size);
-  for (unsigned i = 0; i < size; i++) {
-    flagStore[i] = Expr::FLAG_INITIALIZATION;
-  }
-  memset(kinstStore, 0, size*sizeof(KInstruction*));
+  concreteStore.fill(0);
+  if (origins)
+    origins->fill({Expr::FLAG_INITIALIZATION, nullptr});
 }
 
 void ObjectState::initializeToRandom() {  
+  delete pending;
+  pending = 0;
   makeConcrete();
-  for (unsigned i=0; i<size; i++) {
-    // randomly selected by 256 sided die
-    concreteStore[i] = 0xAB;
-  }
-  for (unsigned i = 0; i < size; i++) {
-    flagStore[i] = Expr::FLAG_INITIALIZATION;
-  }
-  memset(kinstStore, 0, size*sizeof(KInstruction*));
+  // randomly selected by 256 sided die
+  concreteStore.fill(0xAB);
+  if (origins)
+    origins->fill({Expr::FLAG_INITIALIZATION, nullptr});
 }
 
 /*
@@ -289,72 +366,74 @@ void ObjectState::fastRangeCheckOffset(ref<Expr> offset,
 
 void ObjectState::flushRangeForRead(unsigned rangeBase, 
                                     unsigned rangeSize) const {
+  loadChunks(rangeBase, rangeSize);
   if (!flushMask) flushMask = new BitArray(size, true);
- 
-  for (unsigned offset=rangeBase; offset<rangeBase+rangeSize; offset++) {
-    if (!isByteFlushed(offset)) {
-      if (isByteConcrete(offset)) {
-        updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       ConstantExpr::create(concreteStore[offset], Expr::Int8),
-                       flagStore[offset], kinstStore[offset]);
-      } else {
-        assert(isByteKnownSymbolic(offset) && "invalid bit set in flushMask");
-        updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       knownSymbolics[offset],
-                       flagStore[offset], kinstStore[offset]);
-      }
 
-      flushMask->unset(offset);
-    }
-  } 
+  flushUnflushed(rangeBase, rangeBase + rangeSize);
 }
 
 void ObjectState::flushRangeForWrite(unsigned rangeBase, 
                                      unsigned rangeSize) {
+  loadChunks(rangeBase, rangeSize);
   if (!flushMask) flushMask = new BitArray(size, true);
 
-  for (unsigned offset=rangeBase; offset<rangeBase+rangeSize; offset++) {
-    if (!isByteFlushed(offset)) {
-      if (isByteConcrete(offset)) {
-        updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       ConstantExpr::create(concreteStore[offset], Expr::Int8),
-                       flagStore[offset], kinstStore[offset]);
-        markByteSymbolic(offset);
-        //flagStore[offset] = 0;
-        //kinstStore[offset] = 0;
-      } else {
-        assert(isByteKnownSymbolic(offset) && "invalid bit set in flushMask");
-        updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       knownSymbolics[offset],
-                       flagStore[offset], kinstStore[offset]);
-        setKnownSymbolic(offset, 0);
-        //flagStore[offset] = 0;
-        //kinstStore[offset] = 0;
-      }
+  unsigned rangeEnd = rangeBase + rangeSize;
+  flushUnflushed(rangeBase, rangeEnd);
+  // the written bytes, flushed or not, are neither concrete nor known
+  markRangeSymbolic(rangeBase, rangeEnd);
+  clearKnownSymbolics(rangeBase, rangeEnd);
+}
+
+void ObjectState::flushUnflushed(unsigned begin, unsigned end) const {
+  if (!updates.root && updates.head.isNull())
+    flushConcretesToArray(begin, end);
+  for (unsigned offset = flushMask->findFirstSet(begin, end); offset != end;
+       offset = flushMask->findFirstSet(offset + 1, end)) {
+    if (isByteConcrete(offset)) {
+      updates.extend(arrayIndex(offset),
+                     ConstantExpr::create(concreteStore[offset], Expr::Int8),
+                     getFlags(offset), getKInst(offset));
+    } else {
+      assert(isByteKnownSymbolic(offset) && "invalid bit set in flushMask");
+      updates.extend(arrayIndex(offset),
+                     (*knownSymbolics)[offset],
+                     getFlags(offset), getKInst(offset));
+    }
+  }
+  flushMask->unsetRange(begin, end);
+}
 
+void ObjectState::flushConcretesToArray(unsigned begin, unsigned end) const {
+  std::vector<ref<ConstantExpr> > contents(size,
+                                           ConstantExpr::create(0, Expr::Int8));
+  for (unsigned offset = flushMask->findFirstSet(begin, end); offset != end;
+       offset = flushMask->findFirstSet(offset + 1, end)) {
+    if (isByteConcrete(offset)) {
+      contents[offset] = ConstantExpr::create(concreteStore[offset], Expr::Int8);
       flushMask->unset(offset);
-    } else {
-      // flushed bytes that are written over still need
-      // to be marked out
-      if (isByteConcrete(offset)) {
-        markByteSymbolic(offset);
-      } else if (isByteKnownSymbolic(offset)) {
-        setKnownSymbolic(offset, 0);
-      }
     }
-  } 
+  }
+  updates = UpdateList(createConstantArray(contents), 0);
+}
+
+bool ObjectState::isAllConcrete() const {
+  return !concreteMask || concreteMask->isAllSet(0, size);
 }
 
 bool ObjectState::isByteConcrete(unsigned offset) const {
   return !concreteMask || concreteMask->get(offset);
 }
 
+bool ObjectState::isRangeConcrete(unsigned offset, unsigned length) const {
+  return !concreteMask || concreteMask->isAllSet(offset, offset + length);
+}
+
 bool ObjectState::isByteFlushed(unsigned offset) const {
   return flushMask && !flushMask->get(offset);
 }
 
 bool ObjectState::isByteKnownSymbolic(unsigned offset) const {
-  return knownSymbolics && knownSymbolics[offset].get();
+  return knownSymbolics && (*knownSymbolics)[offset].get();
 }
 
 void ObjectState::markByteConcrete(unsigned offset) {
@@ -368,6 +447,12 @@ void ObjectState::markByteSymbolic(unsigned offset) {
   concreteMask->unset(offset);
 }
 
+void ObjectState::markRangeSymbolic(unsigned begin, unsigned end) {
+  if (!concreteMask)
+    concreteMask = new BitArray(size, true);
+  concreteMask->unsetRange(begin, end);
+}
+
 void ObjectState::markByteUnflushed(unsigned offset) {
   if (flushMask)
     flushMask->set(offset);
@@ -384,27 +469,36 @@ void ObjectState::markByteFlushed(unsigned offset) {
 void ObjectState::setKnownSymbolic(unsigned offset, 
                                    Expr *value /* can be null */) {
   if (knownSymbolics) {
-    knownSymbolics[offset] = value;
+    knownSymbolics->set(offset, value);
   } else {
     if (value) {
-      knownSymbolics = new ref<Expr>[size];
-      knownSymbolics[offset] = value;
+      knownSymbolics = new PagedArray<ref<Expr> >(size);
+      knownSymbolics->set(offset, value);
     }
   }
 }
 
+void ObjectState::clearKnownSymbolics(unsigned begin, unsigned end) {
+  if (!knownSymbolics)
+    return;
+  // only touch the set entries, the pages may be shared
+  for (unsigned i = begin; i != end; ++i)
+    if ((*knownSymbolics)[i].get())
+      knownSymbolics->set(i, 0);
+}
+
 /***/
 
 ref<Expr> ObjectState::read8(unsigned offset) const {
+  loadChunks(offset, 1);
   if (isByteConcrete(offset)) {
     return ConstantExpr::create(concreteStore[offset], Expr::Int8);
   } else if (isByteKnownSymbolic(offset)) {
-    return knownSymbolics[offset];
+    return (*knownSymbolics)[offset];
   } else {
     assert(isByteFlushed(offset) && "unflushed byte without cache value");
     
-    return ReadExpr::create(getUpdates(), 
-                            ConstantExpr::create(offset, Expr::Int32));
+    return ReadExpr::create(getUpdates(), arrayIndex(offset));
   }    
 }
 
@@ -422,17 +516,17 @@ ref<Expr> ObjectState::read8(ref<Expr> offset) const {
                       allocInfo.c_str());
   }
   
-  return ReadExpr::create(getUpdates(), ZExtExpr::create(offset, Expr::Int32));
+  return ReadExpr::create(getUpdates(), arrayIndex(offset));
 }
 
 void ObjectState::write8(unsigned offset, uint8_t value,
             uint64_t flags, KInstruction *kinst) {
   increaseUntaggedWriteCnt(flags, kinst);
+  loadChunks(offset, 1);
 
   //assert(read_only == false && "writing to read-only object!");
-  concreteStore[offset] = value;
-  flagStore[offset] = flags;
-  kinstStore[offset] = kinst;
+  concreteStore.set(offset, value);
+  setOrigin(offset, flags, kinst);
   setKnownSymbolic(offset, 0);
 
   markByteConcrete(offset);
@@ -444,24 +538,36 @@ void ObjectState::increaseUntaggedWriteCnt(uint64_t flags, KInstruction *kinst)
     untaggedWriteCnt++;
 }
 
-void ObjectState::write8(unsigned offset, ref<Expr> value,
+void ObjectState::setOrigin(unsigned offset, uint64_t flags,
+                            KInstruction *kinst) {
+  if (origins)
+    origins->set(offset, {flags, kinst});
+}
+
+void ObjectState::setOrigins(unsigned offset, unsigned length, uint64_t flags,
+                             KInstruction *kinst) {
+  if (origins)
+    origins->set(offset, offset + length, {flags, kinst});
+}
+
+void ObjectState::write8(unsigned offset, const ref<Expr> &value,
             uint64_t flags, KInstruction *kinst) {
   // can happen when ExtractExpr special cases
   if (ConstantExpr *CE = dyn_cast<ConstantExpr>(value)) {
     write8(offset, (uint8_t) CE->getZExtValue(8), flags, kinst);
   } else {
     increaseUntaggedWriteCnt(flags, kinst);
+    loadChunks(offset, 1);
 
     setKnownSymbolic(offset, value.get());
-    flagStore[offset] = flags;
-    kinstStore[offset] = kinst;
+    setOrigin(offset, flags, kinst);
 
     markByteSymbolic(offset);
     markByteUnflushed(offset);
   }
 }
 
-void ObjectState::write8(ref<Expr> offset, ref<Expr> value,
+void ObjectState::write8(const ref<Expr> &offset, const ref<Expr> &value,
             uint64_t flags, KInstruction *kinst) {
   increaseUntaggedWriteCnt(flags, kinst);
 
@@ -478,7 +584,7 @@ void ObjectState::write8(ref<Expr> offset, ref<Expr> value,
                       allocInfo.c_str());
   }
   
-  updates.extend(ZExtExpr::create(offset, Expr::Int32), value, flags, kinst);
+  updates.extend(arrayIndex(offset), value, flags, kinst);
 }
 
 /***/
@@ -515,20 +621,48 @@ ref<Expr> ObjectState::read(unsigned offset, Expr::Width width) const {
   if (width == Expr::Bool)
     return ExtractExpr::create(read8(offset), 0, Expr::Bool);
 
-  // Otherwise, follow the slow general case.
   unsigned NumBytes = width / 8;
   assert(width == NumBytes * 8 && "Invalid width for read size!");
+  bool isLittleEndian = Context::get().isLittleEndian();
+  loadChunks(offset, NumBytes);
+
+  // Concrete values are assembled directly from the concrete store.
+  if (width <= Expr::Int64 && isRangeConcrete(offset, NumBytes)) {
+    uint64_t value = 0;
+    for (unsigned i = 0; i != NumBytes; ++i) {
+      unsigned idx = isLittleEndian ? i : (NumBytes - i - 1);
+      value |= (uint64_t) concreteStore[offset + idx] << (8 * i);
+    }
+    return ConstantExpr::create(value, width);
+  }
+
+  // Otherwise, concatenate the bytes, each run of concrete bytes (of at
+  // most 64 bits) as a single constant.
   ref<Expr> Res(0);
-  for (unsigned i = 0; i != NumBytes; ++i) {
-    unsigned idx = Context::get().isLittleEndian() ? i : (NumBytes - i - 1);
-    ref<Expr> Byte = read8(offset + idx);
-    Res = i ? ConcatExpr::create(Byte, Res) : Byte;
+  for (unsigned i = 0; i != NumBytes;) {
+    unsigned idx = isLittleEndian ? i : (NumBytes - i - 1);
+    ref<Expr> Part;
+    unsigned start = i;
+    if (isByteConcrete(offset + idx)) {
+      uint64_t value = 0;
+      do {
+        value |= (uint64_t) concreteStore[offset + idx] << (8 * (i - start));
+        ++i;
+        idx = isLittleEndian ? i : (NumBytes - i - 1);
+      } while (i != NumBytes && i - start != 8 &&
+               isByteConcrete(offset + idx));
+      Part = ConstantExpr::create(value, 8 * (i - start));
+    } else {
+      Part = read8(offset + idx);
+      ++i;
+    }
+    Res = start ? ConcatExpr::create(Part, Res) : Part;
   }
 
   return Res;
 }
 
-void ObjectState::write(ref<Expr> offset, ref<Expr> value,
+void ObjectState::write(ref<Expr> offset, const ref<Expr> &value,
             uint64_t flags, KInstruction *kinst) {
   // Truncate offset to 32-bits.
   offset = ZExtExpr::create(offset, Expr::Int32);
@@ -556,7 +690,7 @@ void ObjectState::write(ref<Expr> offset, ref<Expr> value,
   }
 }
 
-void ObjectState::write(unsigned offset, ref<Expr> value,
+void ObjectState::write(unsigned offset, const ref<Expr> &value,
             uint64_t flags, KInstruction *kinst) {
   // Check for writes of constant values.
   if (ConstantExpr *CE = dyn_cast<ConstantExpr>(value)) {
@@ -617,7 +751,62 @@ void ObjectState::write64(unsigned offset, uint64_t value,
   }
 }
 
+void ObjectState::copy(unsigned offset, const ObjectState &src,
+                       unsigned srcOffset, unsigned length, uint64_t flags,
+                       KInstruction *kinst) {
+  assert(offset + length <= size && srcOffset + length <= src.size &&
+         "copy out of bounds");
+  // Read the whole source range before writing, so that overlapping ranges
+  // of one object are copied as by memmove.
+  src.loadChunks(srcOffset, length);
+  if (src.isRangeConcrete(srcOffset, length)) {
+    std::vector<uint8_t> bytes(length);
+    for (unsigned i = 0; i != length; ++i)
+      bytes[i] = src.concreteStore[srcOffset + i];
+    writeConcrete(offset, bytes.data(), length, flags, kinst);
+  } else {
+    std::vector<ref<Expr> > bytes(length);
+    for (unsigned i = 0; i != length; ++i)
+      bytes[i] = src.read8(srcOffset + i);
+    for (unsigned i = 0; i != length; ++i)
+      write8(offset + i, bytes[i], flags, kinst);
+  }
+}
+
+void ObjectState::fill(unsigned offset, const ref<Expr> &value, unsigned length,
+                       uint64_t flags, KInstruction *kinst) {
+  assert(value->getWidth() == Expr::Int8 && "fill with a non-byte value");
+  assert(offset + length <= size && "fill out of bounds");
+  if (ConstantExpr *CE = dyn_cast<ConstantExpr>(value)) {
+    std::vector<uint8_t> bytes(length, CE->getZExtValue(8));
+    writeConcrete(offset, bytes.data(), length, flags, kinst);
+  } else {
+    for (unsigned i = 0; i != length; ++i)
+      write8(offset + i, value, flags, kinst);
+  }
+}
+
+void ObjectState::writeConcrete(unsigned offset, const uint8_t *bytes,
+                                unsigned length, uint64_t flags,
+                                KInstruction *kinst) {
+  if (!length)
+    return;
+  // as length calls of write8, with the masks updated a word at a time
+  if ((flags & Expr::FLAG_INITIALIZATION) == 0 && kinst == nullptr)
+    untaggedWriteCnt += length;
+  loadChunks(offset, length);
+  for (unsigned i = 0; i != length; ++i)
+    concreteStore.set(offset + i, bytes[i]);
+  setOrigins(offset, length, flags, kinst);
+  clearKnownSymbolics(offset, offset + length);
+  if (concreteMask)
+    concreteMask->setRange(offset, offset + length);
+  if (flushMask)
+    flushMask->setRange(offset, offset + length);
+}
+
 void ObjectState::print() const {
+  loadChunks(0, size);
   llvm::errs() << "-- ObjectState --\n";
   llvm::errs() << "\tMemoryObject ID: " << object->id << "\n";
   llvm::errs() << "\tRoot Object: " << updates.root << "\n";
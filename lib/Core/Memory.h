@@ -13,6 +13,9 @@
 #include "Context.h"
 #include "TimingSolver.h"
 #include "klee/Expr/Expr.h"
+#include "klee/Internal/ADT/PagedArray.h"
+#include "klee/Internal/ADT/RunArray.h"
+#include "klee/Internal/System/MemoryUsage.h"
 //#include "klee/Internal/Module/KInstruction.h"
 
 #include "llvm/ADT/StringExtras.h"
@@ -122,24 +125,24 @@ public:
   ref<ConstantExpr> getSizeExpr() const { 
     return ConstantExpr::create(size, Context::get().getPointerWidth());
   }
-  ref<Expr> getOffsetExpr(ref<Expr> pointer) const {
+  ref<Expr> getOffsetExpr(const ref<Expr> &pointer) const {
     return SubExpr::create(pointer, getBaseExpr());
   }
-  ref<Expr> getBoundsCheckPointer(ref<Expr> pointer) const {
+  ref<Expr> getBoundsCheckPointer(const ref<Expr> &pointer) const {
     return getBoundsCheckOffset(getOffsetExpr(pointer));
   }
-  ref<Expr> getBoundsCheckPointer(ref<Expr> pointer, unsigned bytes) const {
+  ref<Expr> getBoundsCheckPointer(const ref<Expr> &pointer, unsigned bytes) const {
     return getBoundsCheckOffset(getOffsetExpr(pointer), bytes);
   }
 
-  ref<Expr> getBoundsCheckOffset(ref<Expr> offset) const {
+  ref<Expr> getBoundsCheckOffset(const ref<Expr> &offset) const {
     if (size==0) {
       return ConstantExpr::alloc(0, Expr::Bool);
     } else {
       return UltExpr::create(offset, getSizeExpr());
     }
   }
-  ref<Expr> getBoundsCheckOffset(ref<Expr> offset, unsigned bytes) const {
+  ref<Expr> getBoundsCheckOffset(const ref<Expr> &offset, unsigned bytes) const {
     if (bytes<=size) {
       return UltExpr::create(offset, 
                              ConstantExpr::alloc(size - bytes + 1, 
@@ -169,6 +172,30 @@ public:
   }
 };
 
+/// A host file that object states read their contents from, a chunk at a
+/// time, the first time the chunk is accessed (see ObjectState::mapFile).
+class MappedFile {
+  friend class ref<MappedFile>;
+
+  /// @brief Required by klee::ref-managed objects
+  class ReferenceCounter _refCount;
+
+  int fd;
+
+public:
+  const std::string path;
+
+  MappedFile(int _fd, const std::string &_path) : fd(_fd), path(_path) {}
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  /// Read the length bytes at offset into buf. Bytes past the end of the
+  /// file, or that cannot be read, are zero.
+  void read(uint64_t offset, uint8_t *buf, unsigned length) const;
+};
+
 class ObjectState {
 private:
   friend class AddressSpace;
@@ -181,9 +208,24 @@ private:
 
   ref<const MemoryObject> object;
 
-  uint8_t *concreteStore;
-  uint64_t *flagStore;
-  KInstruction **kinstStore;
+  // The per-byte stores are paged, so that a copy made by
+  // AddressSpace::getWriteable only copies the pages it writes.
+  // mutable because flushToConcreteStore fills it in a const object
+  mutable PagedArray<uint8_t> concreteStore;
+
+  /// The flags and instruction of the last write to a byte.
+  struct WriteOrigin {
+    uint64_t flags;
+    KInstruction *kinst;
+
+    bool operator==(const WriteOrigin &b) const {
+      return flags == b.flags && kinst == b.kinst;
+    }
+  };
+  /// The write origins of every byte, only kept with -track-write-origins.
+  /// The bytes written by one store share a run, so an object costs a few
+  /// runs instead of 16 bytes for every byte.
+  RunArray<WriteOrigin> *origins;
 
   // XXX cleanup name of flushMask (its backwards or something)
   // if an offset is concrete, corresponding bit will be set
@@ -194,11 +236,25 @@ private:
   // if an offset needs flush, corresponding bit will be set
   mutable BitArray *flushMask;
 
-  ref<Expr> *knownSymbolics;
+  PagedArray<ref<Expr> > *knownSymbolics;
 
   // mutable because we may need flush during read of const
   mutable UpdateList updates;
 
+  /// The index of byte 0 in the array of updates, nonzero for all but the
+  /// first of the objects sharing one backing array (a batch of symbolics).
+  unsigned arrayOffset;
+
+  /// The chunks of a mapped file that are still to be read, null once they
+  /// all are. Until it is read, a chunk is concrete and unflushed.
+  struct PendingChunks {
+    ref<MappedFile> file;
+    std::vector<bool> chunks;
+    unsigned count;
+  };
+  // mutable because chunks are read during reads of const
+  mutable PendingChunks *pending;
+
 public:
   unsigned size;
 
@@ -212,14 +268,39 @@ public:
   ObjectState(const MemoryObject *mo);
 
   /// Create a new object state for the given memory object with symbolic
-  /// contents.
-  ObjectState(const MemoryObject *mo, const Array *array);
+  /// contents, the bytes of array from arrayOffset on.
+  ObjectState(const MemoryObject *mo, const Array *array,
+              unsigned arrayOffset = 0);
 
   ObjectState(const ObjectState &os);
   ~ObjectState();
 
+  /// Counted as util::MemoryTag::ObjectState, as the pages of the contents
+  static void *operator new(size_t size) {
+    util::TrackMemory(util::MemoryTag::ObjectState, size);
+    return ::operator new(size);
+  }
+  static void operator delete(void *p, size_t size) {
+    util::TrackMemory(util::MemoryTag::ObjectState, -(int64_t)size);
+    ::operator delete(p);
+  }
+
   const MemoryObject *getObject() const { return object.get(); }
 
+  /// Size of the chunks mapFile reads the file in
+  static const unsigned MappedChunkSize = 4096;
+
+  /// Take the contents of the object from the file at path, reading each
+  /// chunk of MappedChunkSize bytes the first time it is accessed. The
+  /// object has to be all concrete and never flushed; its current contents
+  /// are replaced. Chunks not read yet are zero in native memory during
+  /// external calls.
+  /// \return false, without changes, if the file cannot be opened.
+  bool mapFile(const std::string &path);
+
+  /// True if some chunks of a mapped file are still to be read
+  bool hasPendingChunks() const { return pending; }
+
   void setReadOnly(bool ro) { readOnly = ro; }
 
   // make contents all concrete and zero
@@ -227,12 +308,16 @@ public:
   // make contents all concrete and random
   void initializeToRandom();
 
-  uint64_t getFlags(unsigned offset) {
-      return flagStore[offset];
+  /// Flags of the last write to the byte at offset, FLAG_INTERNAL when
+  /// write origins are not tracked.
+  uint64_t getFlags(unsigned offset) const {
+    return origins ? (*origins)[offset].flags : (uint64_t)Expr::FLAG_INTERNAL;
   }
 
-  KInstruction *getKInst(unsigned offset) {
-      return kinstStore[offset];
+  /// Instruction of the last write to the byte at offset, null when write
+  /// origins are not tracked.
+  KInstruction *getKInst(unsigned offset) const {
+    return origins ? (*origins)[offset].kinst : nullptr;
   }
 
   ref<Expr> read(ref<Expr> offset, Expr::Width width) const;
@@ -240,8 +325,8 @@ public:
   ref<Expr> read8(unsigned offset) const;
 
   // return bytes written.
-  void write(unsigned offset, ref<Expr> value, uint64_t flags, KInstruction *kinst);
-  void write(ref<Expr> offset, ref<Expr> value, uint64_t flags, KInstruction *kinst);
+  void write(unsigned offset, const ref<Expr> &value, uint64_t flags, KInstruction *kinst);
+  void write(ref<Expr> offset, const ref<Expr> &value, uint64_t flags, KInstruction *kinst);
 
   void write8(unsigned offset, uint8_t value, uint64_t flags, KInstruction *kinst);
   void write16(unsigned offset, uint16_t value, uint64_t flags, KInstruction *kinst);
@@ -249,6 +334,17 @@ public:
   void write64(unsigned offset, uint64_t value, uint64_t flags, KInstruction *kinst);
   void print() const;
 
+  /// Copy length bytes at srcOffset of src to offset, with the flags and
+  /// instruction of the write. Concrete source bytes are copied as bytes,
+  /// symbolic ones as their expressions. src may be this object, and the
+  /// ranges may overlap.
+  void copy(unsigned offset, const ObjectState &src, unsigned srcOffset,
+            unsigned length, uint64_t flags, KInstruction *kinst);
+
+  /// Write the byte value to the length bytes at offset.
+  void fill(unsigned offset, const ref<Expr> &value, unsigned length, uint64_t flags,
+            KInstruction *kinst);
+
   /*
     Looks at all the symbolic bytes of this object, gets a value for them
     from the solver and puts them in the concreteStore.
@@ -256,34 +352,70 @@ public:
   void flushToConcreteStore(TimingSolver *solver,
                             const ExecutionState &state) const;
 
+  /// True if every byte is concrete, i.e. reads only yield constants.
+  bool isAllConcrete() const;
+
 private:
   const UpdateList &getUpdates() const;
+  /// A new constant array of size bytes with the given contents.
+  const Array *
+  createConstantArray(std::vector<ref<ConstantExpr> > &contents) const;
+
+  /// The index in the array of updates of the byte at offset
+  ref<Expr> arrayIndex(unsigned offset) const {
+    return ConstantExpr::create(arrayOffset + offset, Expr::Int32);
+  }
+  ref<Expr> arrayIndex(ref<Expr> offset) const;
 
   void makeConcrete();
 
   void makeSymbolic();
 
   ref<Expr> read8(ref<Expr> offset) const;
-  void write8(unsigned offset, ref<Expr> value, uint64_t flags, KInstruction *kinst);
-  void write8(ref<Expr> offset, ref<Expr> value, uint64_t flags, KInstruction *kinst);
+  void write8(unsigned offset, const ref<Expr> &value, uint64_t flags, KInstruction *kinst);
+  void write8(const ref<Expr> &offset, const ref<Expr> &value, uint64_t flags, KInstruction *kinst);
+
+  /// Read the pending chunks of the length bytes at offset
+  void loadChunks(unsigned offset, unsigned length) const {
+    if (pending && length)
+      loadPendingChunks(offset, length);
+  }
+  void loadPendingChunks(unsigned offset, unsigned length) const;
 
   void fastRangeCheckOffset(ref<Expr> offset, unsigned *base_r, 
                             unsigned *size_r) const;
   void flushRangeForRead(unsigned rangeBase, unsigned rangeSize) const;
   void flushRangeForWrite(unsigned rangeBase, unsigned rangeSize);
+  /// Add the unflushed bytes in [begin, end) to the updates, and mark them
+  /// flushed.
+  void flushUnflushed(unsigned begin, unsigned end) const;
+  /// Start the updates, while there are none, with a constant array of the
+  /// unflushed concrete bytes in [begin, end), and mark those bytes flushed.
+  /// Only the symbolic bytes then need an update each.
+  void flushConcretesToArray(unsigned begin, unsigned end) const;
 
   bool isByteConcrete(unsigned offset) const;
+  bool isRangeConcrete(unsigned offset, unsigned length) const;
   bool isByteFlushed(unsigned offset) const;
   bool isByteKnownSymbolic(unsigned offset) const;
 
   void markByteConcrete(unsigned offset);
   void markByteSymbolic(unsigned offset);
+  void markRangeSymbolic(unsigned begin, unsigned end);
   void markByteFlushed(unsigned offset);
   void markByteUnflushed(unsigned offset);
   void setKnownSymbolic(unsigned offset, Expr *value);
+  void clearKnownSymbolics(unsigned begin, unsigned end);
+  void setOrigin(unsigned offset, uint64_t flags, KInstruction *kinst);
+  void setOrigins(unsigned offset, unsigned length, uint64_t flags,
+                  KInstruction *kinst);
 
   void increaseUntaggedWriteCnt(uint64_t flags, KInstruction *kinst);
 
+  /// Write the length concrete bytes to offset, as write8 of every byte.
+  void writeConcrete(unsigned offset, const uint8_t *bytes, unsigned length,
+                     uint64_t flags, KInstruction *kinst);
+
   ArrayCache *getArrayCache() const;
 };
   
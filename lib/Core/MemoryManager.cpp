@@ -18,6 +18,8 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/MathExtras.h"
 
+#include <cerrno>
+#include <cstring>
 #include <inttypes.h>
 #include <sys/mman.h>
 
@@ -56,12 +58,54 @@ llvm::cl::opt<unsigned long long> UnDeterministicStartAddress(
     llvm::cl::desc("Start address for undeterministic allocation. Has to be page "
                    "aligned (default=0x80f30000000)"),
     llvm::cl::init(0x80f30000000), llvm::cl::cat(MemoryCat));
+
+llvm::cl::opt<bool> DeterministicArenaAllocation(
+    "allocate-determ-arena",
+    llvm::cl::desc("Allocate deterministically from size-class arenas "
+                   "instead of dlmalloc spaces. Their layouts are part of "
+                   "replay checkpoints. Addresses differ from those of "
+                   "dlmalloc, so record and replay have to agree on this "
+                   "option (default=false)"),
+    llvm::cl::init(false), llvm::cl::cat(MemoryCat));
+
+llvm::cl::opt<bool> DeterministicHugePages(
+    "allocate-determ-huge-pages",
+    llvm::cl::desc("Back the deterministic allocation spaces with "
+                   "transparent huge pages, so that replays of memory heavy "
+                   "programs miss the TLB less. Takes the kernel to enable "
+                   "transparent huge pages (at least for madvise) and rounds "
+                   "the memory used up to 2MB pages (default=false)"),
+    llvm::cl::init(false), llvm::cl::cat(MemoryCat));
+
+/// The address range of each deterministic space, the one dlmalloc reserves
+/// for an mspace too
+const uint64_t DeterministicArenaCapacity = 1ULL << 36;
+
+void adviseHugePages(uint64_t base) {
+#ifdef MADV_HUGEPAGE
+  // the whole range is reserved, the advice holds for the pages mapped later
+  if (madvise(reinterpret_cast<void *>(base), DeterministicArenaCapacity,
+              MADV_HUGEPAGE) < 0)
+    klee_warning("Could not use huge pages for the deterministic space at "
+                 "0x%" PRIx64 ": %s",
+                 base, strerror(errno));
+#else
+  klee_warning_once(0, "Huge pages are not supported on this platform");
+#endif
+}
 } // namespace
 
 /***/
 MemoryManager::MemoryManager(ArrayCache *_arrayCache)
     : arrayCache(_arrayCache) {
-  if (DeterministicAllocation) {
+  if (DeterministicAllocation && DeterministicArenaAllocation) {
+    determ_msp = NULL;
+    undeterm_msp = NULL;
+    determArena = std::make_unique<DeterministicArena>(
+        DeterministicStartAddress, DeterministicArenaCapacity);
+    undetermArena = std::make_unique<DeterministicArena>(
+        UnDeterministicStartAddress, DeterministicArenaCapacity);
+  } else if (DeterministicAllocation) {
     // Page boundary
     void *determ_expectedAddress = (void *)DeterministicStartAddress.getValue();
     void *undeterm_expectedAddress = (void *)UnDeterministicStartAddress.getValue();
@@ -72,6 +116,10 @@ MemoryManager::MemoryManager(ArrayCache *_arrayCache)
     determ_msp = NULL;
     undeterm_msp = NULL;
   }
+  if (DeterministicAllocation && DeterministicHugePages) {
+    adviseHugePages(DeterministicStartAddress);
+    adviseHugePages(UnDeterministicStartAddress);
+  }
 }
 
 MemoryManager::~MemoryManager() {
@@ -83,7 +131,7 @@ MemoryManager::~MemoryManager() {
     delete mo;
   }
 
-  if (DeterministicAllocation) {
+  if (DeterministicAllocation && !determArena) {
     destroy_mspace(determ_msp);
     destroy_mspace(undeterm_msp);
     determ_msp = NULL;
@@ -124,7 +172,11 @@ MemoryObject *MemoryManager::allocate(uint64_t size, bool isLocal,
     size_t alloc_size = std::max(size, (uint64_t)1);
     // use dlmalloc to allocate in preserved virtual address space.
     int ret;
-    if (!isDeterm) {
+    if (determArena) {
+      DeterministicArena &arena = isDeterm ? *determArena : *undetermArena;
+      address = arena.allocate(alloc_size, alignment);
+      ret = address ? 0 : ENOMEM;
+    } else if (!isDeterm) {
       ret = mspace_posix_memalign(undeterm_msp, (void **)&address, alignment, alloc_size);
     }
     else {
@@ -189,8 +241,10 @@ void MemoryManager::markFreed(MemoryObject *mo) {
   if (objects.find(mo) != objects.end()) {
     if (!mo->isFixed) {
       if (DeterministicAllocation) {
-        // managed by dlmalloc
-        if (mo->isDeterm) {
+        // managed by dlmalloc or the arenas
+        if (determArena) {
+          (mo->isDeterm ? determArena : undetermArena)->free(mo->address);
+        } else if (mo->isDeterm) {
           // was allocated deterministically (e.g. stack/heap inside application)
           mspace_free(determ_msp, (void *)mo->address);
         }
@@ -212,7 +266,9 @@ void MemoryManager::markFreed(MemoryObject *mo) {
 }
 
 size_t MemoryManager::getUsedDeterministicSize() {
-  if (DeterministicAllocation) {
+  if (determArena) {
+    return determArena->getUsedSize() + undetermArena->getUsedSize();
+  } else if (DeterministicAllocation) {
     struct mallinfo determ_mi = mspace_mallinfo(determ_msp);
     struct mallinfo undeterm_mi = mspace_mallinfo(undeterm_msp);
     return (determ_mi.uordblks + determ_mi.hblkhd) +
@@ -222,3 +278,30 @@ size_t MemoryManager::getUsedDeterministicSize() {
     return 0;
   }
 }
+
+MemoryManager::Snapshot MemoryManager::snapshot() const {
+  Snapshot res;
+  if (determArena) {
+    res.valid = true;
+    res.determ = determArena->snapshot();
+    res.undeterm = undetermArena->snapshot();
+  }
+  return res;
+}
+
+void MemoryManager::restore(const Snapshot &snapshot) {
+  if (!snapshot.valid || !determArena)
+    return;
+#ifndef NDEBUG
+  for (const MemoryObject *mo : objects) {
+    if (mo->isFixed)
+      continue;
+    const auto &live = mo->isDeterm ? snapshot.determ.live
+                                    : snapshot.undeterm.live;
+    if (!live.count(mo->address))
+      klee_error("Restoring the allocator under a live object");
+  }
+#endif
+  determArena->restore(snapshot.determ);
+  undetermArena->restore(snapshot.undeterm);
+}
@@ -11,10 +11,12 @@
 #define KLEE_MEMORYMANAGER_H
 
 #include <cstddef>
+#include <memory>
 #include <set>
 #include <cstdint>
 #include <malloc.h>
 
+#include "DeterministicArena.h"
 #include "dlmalloc.h"
 
 namespace llvm {
@@ -47,8 +49,18 @@ private:
   //   be deterministic.
   mspace determ_msp;
   mspace undeterm_msp;
+  // The same two spaces with -allocate-determ-arena, instead of the mspaces
+  std::unique_ptr<DeterministicArena> determArena;
+  std::unique_ptr<DeterministicArena> undetermArena;
 
 public:
+  /// The state of the deterministic allocator, empty unless it is the arena
+  struct Snapshot {
+    bool valid = false;
+    DeterministicArena::Layout determ;
+    DeterministicArena::Layout undeterm;
+  };
+
   MemoryManager(ArrayCache *arrayCache);
   ~MemoryManager();
 
@@ -69,6 +81,13 @@ public:
    * Returns the size used by deterministic allocation in bytes
    */
   size_t getUsedDeterministicSize();
+
+  /// Save the state of the deterministic allocator.
+  Snapshot snapshot() const;
+
+  /// Make the deterministic allocator return the addresses it did after
+  /// snapshot was taken. The objects allocated since then have to be freed.
+  void restore(const Snapshot &snapshot);
 };
 
 } // End klee namespace
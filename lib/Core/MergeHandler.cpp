@@ -42,6 +42,28 @@ llvm::cl::opt<bool> DebugLogIncompleteMerge(
     llvm::cl::desc("Debug information for incomplete path merging (default=false)"),
     llvm::cl::cat(klee::MergeCat));
 
+llvm::cl::opt<bool> UseAutoMerge(
+    "auto-merge", llvm::cl::init(false),
+    llvm::cl::desc("Merge the states forked at a branch at its immediate "
+                   "post-dominator, if the region up to there is acyclic, "
+                   "small and free of calls. Implies -use-merge. The .path "
+                   "files of merged states only follow one of them "
+                   "(default=false)"),
+    llvm::cl::cat(klee::MergeCat));
+
+llvm::cl::opt<unsigned> AutoMergeMaxInstructions(
+    "auto-merge-max-instructions", llvm::cl::init(64),
+    llvm::cl::desc("Only merge the -auto-merge regions of at most N "
+                   "instructions (default=64)"),
+    llvm::cl::cat(klee::MergeCat));
+
+llvm::cl::opt<unsigned> AutoMergeMaxConstraints(
+    "auto-merge-max-constraints", llvm::cl::init(8),
+    llvm::cl::desc("Do not merge -auto-merge states that differ in more than "
+                   "N path constraints, as the solver would have to handle "
+                   "their disjunction in every later query (default=8)"),
+    llvm::cl::cat(klee::MergeCat));
+
 double MergeHandler::getMean() {
   if (closedStateCount == 0)
     return 0;
@@ -104,8 +126,9 @@ void MergeHandler::addClosedState(ExecutionState *es,
     auto &cpv = closePoint->second;
     bool mergedSuccessful = false;
 
+    unsigned maxConstraints = autoClose ? AutoMergeMaxConstraints : ~0u;
     for (auto& mState: cpv) {
-      if (mState->merge(*es)) {
+      if (mState->merge(*es, maxConstraints)) {
         executor->terminateState(*es);
         executor->mergingSearcher->inCloseMerge.erase(es);
         mergedSuccessful = true;
@@ -133,9 +156,11 @@ bool MergeHandler::hasMergedStates() {
   return (!reachedCloseMerge.empty());
 }
 
-MergeHandler::MergeHandler(Executor *_executor, ExecutionState *es)
+MergeHandler::MergeHandler(Executor *_executor, ExecutionState *es,
+                           llvm::Instruction *_autoClose)
     : executor(_executor), openInstruction(es->steppedInstructions),
-      closedMean(0), closedStateCount(0) {
+      closedMean(0), closedStateCount(0), autoClose(_autoClose),
+      autoCloseDepth(es->stack().size()) {
     executor->mergingSearcher->mergeGroups.push_back(this);
   addOpenState(es);
 }
@@ -0,0 +1,106 @@
+//===-- MergeRegions.cpp --------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MergeRegions.h"
+
+#include "klee/Config/Version.h"
+#include "klee/MergeHandler.h"
+
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+
+#include <map>
+
+using namespace klee;
+using namespace llvm;
+
+namespace {
+/// Checks that the region from a branching block to its join is acyclic and
+/// small, with a depth-first search that stops at the join.
+class RegionWalker {
+  const BasicBlock *join;
+  enum Color { Unvisited, Active, Done };
+  std::map<const BasicBlock *, Color> colors;
+  unsigned size = 0;
+
+  bool visit(const BasicBlock *bb) {
+    if (bb == join)
+      return true;
+    Color &color = colors[bb];
+    if (color == Active)
+      return false; // a loop
+    if (color == Done)
+      return true;
+    color = Active;
+
+    size += bb->size();
+    if (size > AutoMergeMaxInstructions)
+      return false;
+    for (const Instruction &i : *bb)
+      if ((isa<CallInst>(i) && !isa<DbgInfoIntrinsic>(i)) ||
+          isa<InvokeInst>(i) || isa<AllocaInst>(i))
+        return false;
+
+    for (const BasicBlock *succ : successors(bb))
+      if (!visit(succ))
+        return false;
+    colors[bb] = Done;
+    return true;
+  }
+
+public:
+  explicit RegionWalker(const BasicBlock *_join) : join(_join) {}
+
+  /// Walk the region of the branch at the end of start, without start
+  /// itself, whose instructions run before the fork.
+  bool walk(const BasicBlock *start) {
+    colors[start] = Active;
+    for (const BasicBlock *succ : successors(start))
+      if (!visit(succ))
+        return false;
+    return true;
+  }
+};
+} // namespace
+
+void MergeRegions::analyze(Function *f) {
+#if LLVM_VERSION_CODE >= LLVM_VERSION(5, 0)
+  PostDomTreeBase<BasicBlock> pdt;
+#else
+  DominatorTreeBase<BasicBlock> pdt(/*isPostDom=*/true);
+#endif
+  pdt.recalculate(*f);
+
+  for (BasicBlock &bb : *f) {
+    if (bb.getTerminator()->getNumSuccessors() < 2)
+      continue;
+    Instruction *&joinInst = joins[&bb];
+    auto *node = pdt.getNode(&bb);
+    // the join of branches to exits is the virtual exit node
+    if (!node || !node->getIDom() || !node->getIDom()->getBlock())
+      continue;
+    BasicBlock *join = node->getIDom()->getBlock();
+
+    // the PHIs of the join differ between the states, they are merged after
+    if (RegionWalker(join).walk(&bb))
+      joinInst = join->getFirstNonPHI();
+  }
+}
+
+Instruction *MergeRegions::getJoin(BasicBlock *bb) {
+  Function *f = bb->getParent();
+  if (analyzed.insert(f).second)
+    analyze(f);
+  auto it = joins.find(bb);
+  return it == joins.end() ? nullptr : it->second;
+}
@@ -0,0 +1,46 @@
+//===-- MergeRegions.h ------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_MERGEREGIONS_H
+#define KLEE_MERGEREGIONS_H
+
+#include <unordered_map>
+#include <unordered_set>
+
+namespace llvm {
+class BasicBlock;
+class Function;
+class Instruction;
+}
+
+namespace klee {
+
+/// The regions in which -auto-merge merges the states forked at a branch.
+/// Such a region starts at a basic block ending in a branch and ends at its
+/// immediate post-dominator, the join, through which all the forked states
+/// pass, unless they terminate. The region must be acyclic, free of calls
+/// and allocas, and at most -auto-merge-max-instructions long, so that the
+/// states reach the join soon and with the same memory objects.
+class MergeRegions {
+  /// The first non-PHI instruction of the join of each branching block, or
+  /// nullptr if its region is not merged
+  std::unordered_map<const llvm::BasicBlock *, llvm::Instruction *> joins;
+  std::unordered_set<const llvm::Function *> analyzed;
+
+  void analyze(llvm::Function *f);
+
+public:
+  /// \return the instruction at which the states forked at the end of bb
+  /// are merged, nullptr if they are not
+  llvm::Instruction *getJoin(llvm::BasicBlock *bb);
+};
+
+} // namespace klee
+
+#endif /* KLEE_MERGEREGIONS_H */
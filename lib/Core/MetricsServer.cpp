@@ -0,0 +1,164 @@
+//===-- MetricsServer.cpp -------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MetricsServer.h"
+
+#include "klee/Internal/Support/ErrorHandling.h"
+
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+using namespace klee;
+
+MetricsServer::MetricsServer(unsigned port) {
+  listenFD = ::socket(AF_INET, SOCK_STREAM, 0);
+  if (listenFD < 0)
+    klee_error("metrics server: cannot create socket: %s", strerror(errno));
+
+  int one = 1;
+  ::setsockopt(listenFD, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  sockaddr_in addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (::bind(listenFD, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) ||
+      ::listen(listenFD, 8))
+    klee_error("metrics server: cannot listen on 127.0.0.1:%u: %s", port,
+               strerror(errno));
+
+  klee_message("serving metrics at http://127.0.0.1:%u/metrics", port);
+  thread = std::thread([this] { serve(); });
+}
+
+MetricsServer::~MetricsServer() {
+  stopping = true;
+  thread.join();
+  ::close(listenFD);
+}
+
+void MetricsServer::serve() {
+  while (!stopping) {
+    // wake up now and then to notice the destructor
+    pollfd pfd = {listenFD, POLLIN, 0};
+    if (::poll(&pfd, 1, 200) <= 0)
+      continue;
+    int fd = ::accept(listenFD, nullptr, nullptr);
+    if (fd < 0)
+      continue;
+    answer(fd);
+    ::close(fd);
+  }
+}
+
+void MetricsServer::answer(int fd) {
+  // a stuck client must not keep the other scrapes waiting for long
+  timeval timeout = {1, 0};
+  ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+  // only the request line matters, the rest of the request is dropped
+  std::string request;
+  char buf[1024];
+  while (request.find("\r\n") == std::string::npos && request.size() < 8192) {
+    ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0)
+      return;
+    request.append(buf, n);
+  }
+
+  std::string status = "200 OK", body;
+  if (request.compare(0, 13, "GET /metrics ") == 0 ||
+      request.compare(0, 6, "GET / ") == 0) {
+    body = render();
+  } else {
+    status = "404 Not Found";
+    body = "not found, try /metrics\n";
+  }
+
+  std::string response;
+  llvm::raw_string_ostream os(response);
+  os << "HTTP/1.0 " << status << "\r\n"
+     << "Content-Type: text/plain; version=0.0.4\r\n"
+     << "Content-Length: " << body.size() << "\r\n"
+     << "Connection: close\r\n\r\n"
+     << body;
+  os.flush();
+
+  for (size_t sent = 0; sent < response.size();) {
+    ssize_t n = ::send(fd, response.data() + sent, response.size() - sent,
+                       MSG_NOSIGNAL);
+    if (n <= 0)
+      return;
+    sent += n;
+  }
+}
+
+std::string MetricsServer::render() const {
+  std::string text;
+  llvm::raw_string_ostream os(text);
+  auto metric = [&os](const char *name, const char *type, const char *help,
+                      uint64_t value, double scale = 1) {
+    os << "# HELP " << name << ' ' << help << '\n'
+       << "# TYPE " << name << ' ' << type << '\n' << name << ' ';
+    if (scale == 1)
+      os << value;
+    else
+      os << llvm::format("%.6f", value * scale);
+    os << '\n';
+  };
+  auto load = [](const std::atomic<uint64_t> &v) {
+    return v.load(std::memory_order_relaxed);
+  };
+
+  metric("klee_instructions_total", "counter", "Instructions executed.",
+         load(instructions));
+  metric("klee_states", "gauge", "Execution states alive.", load(states));
+  metric("klee_replays_total", "counter",
+         "Replays started by this process.", load(replays));
+  metric("klee_replay_position", "gauge",
+         "Path entries consumed by the state furthest into the replay.",
+         load(replayPosition));
+  metric("klee_replay_path_entries", "gauge",
+         "Path entries of the replayed trace.", load(replayPathSize));
+  metric("klee_datarec_position", "gauge",
+         "DATAREC entries consumed by the state furthest into the replay.",
+         load(dataRecPosition));
+  metric("klee_datarec_entries", "gauge",
+         "DATAREC entries of the replayed trace.", load(dataRecSize));
+  metric("klee_solver_queries_total", "counter", "Solver queries.",
+         load(queries));
+  metric("klee_solver_time_seconds_total", "counter",
+         "Time spent in the solver chain.", load(solverTime), 1e-9);
+  metric("klee_core_solver_time_seconds_total", "counter",
+         "Time spent in the core solver.", load(coreSolverTime), 1e-9);
+  metric("klee_memory_bytes", "gauge", "Memory in use by KLEE.",
+         load(mallocUsage));
+  os << "# HELP klee_memory_subsystem_bytes Memory counted per subsystem.\n"
+     << "# TYPE klee_memory_subsystem_bytes gauge\n";
+  for (unsigned i = 0; i < util::NumMemoryTags; ++i)
+    os << "klee_memory_subsystem_bytes{subsystem=\""
+       << util::GetMemoryTagName((util::MemoryTag)i) << "\"} "
+       << load(taggedMemory[i]) << '\n';
+  metric("klee_metrics_publish_time_seconds", "gauge",
+         "When the interpreter last published these values.",
+         load(publishTime), 1e-6);
+  os.flush();
+  return text;
+}
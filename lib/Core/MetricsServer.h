@@ -0,0 +1,71 @@
+//===-- MetricsServer.h -----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_METRICSSERVER_H
+#define KLEE_METRICSSERVER_H
+
+#include "klee/Internal/System/MemoryUsage.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+namespace klee {
+
+  /// Serves the progress of a run as Prometheus text at
+  /// http://127.0.0.1:<port>/metrics.
+  ///
+  /// The interpreter copies its counters into the atomic fields below now and
+  /// then (see Executor::publishMetrics); a thread of the server answers the
+  /// scrapes from them, so a scrape never waits for nor stops the
+  /// interpreter. Rates, such as DATAREC entries or solver seconds per second,
+  /// are left to the scraper (e.g. rate() over the counters).
+  class MetricsServer {
+  public:
+    std::atomic<uint64_t> instructions{0};
+    std::atomic<uint64_t> states{0};
+    /// Of the state furthest into the replay
+    std::atomic<uint64_t> replayPosition{0};
+    std::atomic<uint64_t> replayPathSize{0};
+    std::atomic<uint64_t> dataRecPosition{0};
+    std::atomic<uint64_t> dataRecSize{0};
+    /// Summed over all replays of the process
+    std::atomic<uint64_t> replays{0};
+    std::atomic<uint64_t> queries{0};
+    /// in nanoseconds, as the statistics
+    std::atomic<uint64_t> solverTime{0};
+    std::atomic<uint64_t> coreSolverTime{0};
+    std::atomic<uint64_t> mallocUsage{0};
+    /// Bytes of each util::MemoryTag
+    std::atomic<uint64_t> taggedMemory[util::NumMemoryTags] = {};
+    /// Wall time of the last publication, in microseconds since the epoch
+    std::atomic<uint64_t> publishTime{0};
+
+  private:
+    int listenFD;
+    std::atomic<bool> stopping{false};
+    std::thread thread;
+
+    void serve();
+    void answer(int fd);
+    std::string render() const;
+
+  public:
+    /// Listens on the loopback interface, exits with klee_error on failure
+    explicit MetricsServer(unsigned port);
+    ~MetricsServer();
+
+    MetricsServer(const MetricsServer &) = delete;
+    MetricsServer &operator=(const MetricsServer &) = delete;
+  };
+
+} // namespace klee
+
+#endif /* KLEE_METRICSSERVER_H */
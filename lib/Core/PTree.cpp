@@ -17,32 +17,61 @@
 
 using namespace klee;
 
-PTree::PTree(ExecutionState *initialState) {
-  root = std::make_unique<PTreeNode>(nullptr, initialState);
+PTree::PTree(ExecutionState *initialState) : nodes(1) {
+  root = allocate(0, initialState);
 }
 
-void PTree::attach(PTreeNode *node, ExecutionState *leftState, ExecutionState *rightState) {
-  assert(node && !node->left && !node->right);
+PTree::NodeID PTree::allocate(NodeID parent, ExecutionState *state) {
+  NodeID id;
+  if (freeNodes.empty()) {
+    id = nodes.size();
+    nodes.emplace_back();
+  } else {
+    id = freeNodes.back();
+    freeNodes.pop_back();
+    nodes[id] = Node();
+  }
+  nodes[id].parent = parent;
+  nodes[id].state = state;
+  state->ptreeNode = id;
+  return id;
+}
+
+void PTree::attach(NodeID node, ExecutionState *leftState,
+                   ExecutionState *rightState) {
+  assert(node && nodes[node].state && "attach to a fork");
 
-  node->state = nullptr;
-  node->left = std::make_unique<PTreeNode>(node, leftState);
-  node->right = std::make_unique<PTreeNode>(node, rightState);
+  // allocating may move the nodes
+  NodeID left = allocate(node, leftState);
+  NodeID right = allocate(node, rightState);
+  Node &n = nodes[node];
+  n.state = nullptr;
+  n.left = left;
+  n.right = right;
 }
 
-void PTree::remove(PTreeNode *n) {
-  assert(!n->left && !n->right);
-  do {
-    PTreeNode *p = n->parent;
-    if (p) {
-      if (n == p->left.get()) {
-        p->left = nullptr;
-      } else {
-        assert(n == p->right.get());
-        p->right = nullptr;
-      }
-    }
-    n = p;
-  } while (n && !n->left && !n->right);
+void PTree::remove(NodeID node) {
+  assert(node && nodes[node].state && "remove a fork");
+  NodeID parent = nodes[node].parent;
+  release(node);
+  if (!parent) {
+    root = 0;
+    return;
+  }
+
+  // the sibling takes the place of the fork
+  Node &p = nodes[parent];
+  NodeID sibling = p.left == node ? p.right : p.left;
+  assert(sibling && "fork with a single side");
+  NodeID grandparent = p.parent;
+  nodes[sibling].parent = grandparent;
+  if (!grandparent) {
+    root = sibling;
+  } else {
+    Node &g = nodes[grandparent];
+    (g.left == parent ? g.left : g.right) = sibling;
+  }
+  release(parent);
 }
 
 void PTree::dump(llvm::raw_ostream &os) {
@@ -55,29 +84,26 @@ void PTree::dump(llvm::raw_ostream &os) {
   os << "\tcenter = \"true\";\n";
   os << "\tnode [style=\"filled\",width=.1,height=.1,fontname=\"Terminus\"]\n";
   os << "\tedge [arrowsize=.3]\n";
-  std::vector<const PTreeNode*> stack;
-  stack.push_back(root.get());
+  std::vector<NodeID> stack;
+  if (root)
+    stack.push_back(root);
   while (!stack.empty()) {
-    const PTreeNode *n = stack.back();
+    NodeID id = stack.back();
+    const Node &n = nodes[id];
     stack.pop_back();
-    os << "\tn" << n << " [shape=diamond";
-    if (n->state)
+    os << "\tn" << id << " [shape=diamond";
+    if (n.state)
       os << ",fillcolor=green";
     os << "];\n";
-    if (n->left) {
-      os << "\tn" << n << " -> n" << n->left.get() << ";\n";
-      stack.push_back(n->left.get());
+    if (n.left) {
+      os << "\tn" << id << " -> n" << n.left << ";\n";
+      stack.push_back(n.left);
     }
-    if (n->right) {
-      os << "\tn" << n << " -> n" << n->right.get() << ";\n";
-      stack.push_back(n->right.get());
+    if (n.right) {
+      os << "\tn" << id << " -> n" << n.right << ";\n";
+      stack.push_back(n.right);
     }
   }
   os << "}\n";
   delete pp;
 }
-
-PTreeNode::PTreeNode(PTreeNode *parent, ExecutionState *state) : parent{parent}, state{state} {
-  state->ptreeNode = this;
-}
-
@@ -12,29 +12,53 @@
 
 #include "klee/Expr/Expr.h"
 
+#include <cstdint>
+#include <vector>
+
 namespace klee {
   class ExecutionState;
 
-  class PTreeNode {
+  /// The process tree: its leaves are the states, its inner nodes the forks
+  /// that are still live on both sides. When one side of a fork dies out, the
+  /// fork is spliced out of the tree, so that every inner node has two
+  /// children and a walk from the root only visits branching nodes.
+  ///
+  /// The nodes live in a pool and refer to each other by index, freed nodes
+  /// are reused by the next forks.
+  class PTree {
   public:
-    PTreeNode *parent = nullptr;
-    std::unique_ptr<PTreeNode> left;
-    std::unique_ptr<PTreeNode> right;
-    ExecutionState *state = nullptr;
-
-    PTreeNode(const PTreeNode&) = delete;
-    PTreeNode(PTreeNode *parent, ExecutionState *state);
-    ~PTreeNode() = default;
-  };
+    /// The index of a node, 0 is no node
+    typedef std::uint32_t NodeID;
+
+    struct Node {
+      NodeID parent = 0;
+      NodeID left = 0;
+      NodeID right = 0;
+      /// The state of a leaf, nullptr for forks
+      ExecutionState *state = nullptr;
+    };
+
+  private:
+    std::vector<Node> nodes;
+    std::vector<NodeID> freeNodes;
+    NodeID root;
+
+    NodeID allocate(NodeID parent, ExecutionState *state);
+    void release(NodeID id) { freeNodes.push_back(id); }
 
-  class PTree {
   public:
-    std::unique_ptr<PTreeNode> root;
     explicit PTree(ExecutionState *initialState);
-    ~PTree() = default;
+    PTree(const PTree &) = delete;
+    PTree &operator=(const PTree &) = delete;
+
+    NodeID getRoot() const { return root; }
+    const Node &operator[](NodeID id) const { return nodes[id]; }
 
-    static void attach(PTreeNode *node, ExecutionState *leftState, ExecutionState *rightState);
-    static void remove(PTreeNode *node);
+    /// Turn the leaf node into a fork of leftState and rightState.
+    void attach(NodeID node, ExecutionState *leftState,
+                ExecutionState *rightState);
+    /// Remove the leaf node, and with it the fork it was a side of.
+    void remove(NodeID node);
     void dump(llvm::raw_ostream &os);
   };
 }
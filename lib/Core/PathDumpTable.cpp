@@ -0,0 +1,210 @@
+//===-- PathDumpTable.cpp -------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PathDumpTable.h"
+
+#include "klee/ExecutionState.h"
+#include "klee/Internal/Module/InstructionInfoTable.h"
+#include "klee/Internal/Module/KInstruction.h"
+#include "klee/Internal/Module/KModule.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+#include "klee/Interpreter.h"
+
+#include "llvm/IR/Function.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace klee;
+using namespace llvm;
+
+ShardedTable::ShardedTable(InterpreterHandler &_handler,
+                           const std::string &_name, unsigned _shardSize)
+    : handler(_handler), name(_name), shardSize(std::max(_shardSize, 1u)) {}
+
+ShardedTable::~ShardedTable() = default;
+
+raw_ostream &ShardedTable::define(uint32_t id) {
+  if (!os || lines == shardSize) {
+    std::string file;
+    raw_string_ostream fs(file);
+    fs << name << '.' << format("%04u", shard++) << ".txt";
+    os = handler.openOutputFile(fs.str());
+    if (!os)
+      klee_error("cannot open %s", file.c_str());
+    *os << "# first " << id << '\n';
+    lines = 0;
+  }
+  ++lines;
+  return *os;
+}
+
+bool PathDumpTable::FrameKey::operator<(const FrameKey &b) const {
+  if (target != b.target)
+    return target < b.target;
+  if (args.size() != b.args.size())
+    return args.size() < b.args.size();
+  for (unsigned i = 0; i < args.size(); ++i) {
+    if (args[i].isNull() || b.args[i].isNull()) {
+      if (args[i].isNull() != b.args[i].isNull())
+        return args[i].isNull();
+      continue;
+    }
+    if (int c = args[i].compare(b.args[i]))
+      return c < 0;
+  }
+  return false;
+}
+
+PathDumpTable::PathDumpTable(InterpreterHandler &handler, unsigned shardSize)
+    : stackTable(handler, "stack-table", shardSize),
+      exprTable(handler, "expr-table", shardSize) {}
+
+uint32_t PathDumpTable::internFrame(FrameKey &&key) {
+  auto it = frames.find(key);
+  if (it != frames.end())
+    return it->second;
+  uint32_t id = nextFrame++;
+
+  // the frame line of Thread::dumpStack, without the frame index
+  const KInstruction *target = key.target;
+  Function *f = target->inst->getFunction();
+  raw_ostream &os = stackTable.define(id);
+  os << 'F' << id << ' '
+     << format("%08u", target->info->getAssemblyLine()) << " in "
+     << f->getName() << " (";
+  unsigned index = 0;
+  for (Function::arg_iterator ai = f->arg_begin(), ae = f->arg_end();
+       ai != ae; ++ai, ++index) {
+    if (ai != f->arg_begin())
+      os << ", ";
+    os << ai->getName();
+    if (!key.args[index].isNull())
+      os << "=" << key.args[index];
+  }
+  os << ")";
+  if (target->info->file != "")
+    os << " at " << target->info->file << ":" << target->info->line;
+  os << '\n';
+
+  frames.insert({std::move(key), id});
+  return id;
+}
+
+uint32_t PathDumpTable::internStack(const ExecutionState &state) {
+  std::vector<uint32_t> stack;
+  stack.push_back(state.crtThread().tuid.first);
+  for (auto &it : state.threads) {
+    const Thread &t = it.second;
+    std::vector<uint64_t> header = {t.tuid.first, t.tuid.second, t.enabled};
+    auto hit = threadHeaders.find(header);
+    if (hit == threadHeaders.end()) {
+      uint32_t id = nextFrame++;
+      stackTable.define(id) << 'F' << id << " Thread " << t.tuid.first
+                            << ", Process " << t.tuid.second << ", "
+                            << (t.enabled ? "enabled" : "disabled") << '\n';
+      hit = threadHeaders.insert({header, id}).first;
+    }
+    stack.push_back(hit->second);
+
+    const KInstruction *target = t.prevPC ? t.prevPC : t.pc;
+    for (auto sf = t.stack.rbegin(), se = t.stack.rend(); sf != se; ++sf) {
+      FrameKey key;
+      key.target = target;
+      for (unsigned i = 0, e = sf->kf->numArgs; i != e; ++i) {
+        ref<Expr> value = sf->getLocal(sf->kf->getArgRegister(i)).value;
+        key.args.push_back(value.get() && isa<ConstantExpr>(value)
+                               ? value
+                               : ref<Expr>());
+      }
+      stack.push_back(internFrame(std::move(key)));
+      target = sf->caller;
+    }
+  }
+
+  auto it = stacks.find(stack);
+  if (it != stacks.end())
+    return it->second;
+  uint32_t id = stacks.size();
+  raw_ostream &os = stackTable.define(id);
+  os << 'S' << id << ' ' << stack[0];
+  for (unsigned i = 1; i < stack.size(); ++i)
+    os << " F" << stack[i];
+  os << '\n';
+  stacks.insert({std::move(stack), id});
+  return id;
+}
+
+uint32_t PathDumpTable::internUpdate(const UpdateNode *un) {
+  if (!un)
+    return UINT32_MAX;
+  auto it = updates.find(un);
+  if (it != updates.end())
+    return it->second;
+  // define the older updates first, without recursing along the list
+  std::vector<const UpdateNode *> pending;
+  for (; un && !updates.count(un); un = un->next.get())
+    pending.push_back(un);
+  uint32_t id = 0;
+  for (auto p = pending.rbegin(); p != pending.rend(); ++p) {
+    uint32_t index = internExpr((*p)->index);
+    uint32_t value = internExpr((*p)->value);
+    uint32_t next = (*p)->next.isNull() ? UINT32_MAX
+                                         : updates.at((*p)->next.get());
+    id = updates.size();
+    raw_ostream &os = exprTable.define(id);
+    os << 'U' << id << " N" << index << " N" << value << ' ';
+    if (next == UINT32_MAX)
+      os << '-';
+    else
+      os << 'U' << next;
+    os << '\n';
+    updates.insert({*p, id});
+    keptUpdates.push_back(const_cast<UpdateNode *>(*p));
+  }
+  return id;
+}
+
+uint32_t PathDumpTable::internExpr(const ref<Expr> &e) {
+  auto it = exprs.find(e);
+  if (it != exprs.end())
+    return it->second;
+
+  std::vector<uint32_t> kids;
+  for (unsigned i = 0; i < e->getNumKids(); ++i)
+    kids.push_back(internExpr(e->getKid(i)));
+  uint32_t updateList = UINT32_MAX;
+  const ReadExpr *re = dyn_cast<ReadExpr>(e);
+  if (re)
+    updateList = internUpdate(re->updates.head.get());
+
+  uint32_t id = exprs.size();
+  raw_ostream &os = exprTable.define(id);
+  os << 'N' << id << ' ';
+  Expr::printKind(os, e->getKind());
+  os << " w" << e->getWidth();
+  if (const ExtractExpr *ee = dyn_cast<ExtractExpr>(e))
+    os << ' ' << ee->offset;
+  if (re) {
+    os << ' ' << re->updates.root->name << ' ';
+    if (updateList == UINT32_MAX)
+      os << '-';
+    else
+      os << 'U' << updateList;
+  }
+  for (uint32_t kid : kids)
+    os << " N" << kid;
+  if (const ConstantExpr *ce = dyn_cast<ConstantExpr>(e)) {
+    std::string value;
+    ce->toString(value);
+    os << ' ' << value;
+  }
+  os << '\n';
+  exprs.insert({e, id});
+  return id;
+}
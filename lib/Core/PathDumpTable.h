@@ -0,0 +1,103 @@
+//===-- PathDumpTable.h -----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_PATHDUMPTABLE_H
+#define KLEE_PATHDUMPTABLE_H
+
+#include "klee/Expr/Expr.h"
+#include "klee/Expr/ExprHashMap.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace llvm {
+  class raw_fd_ostream;
+}
+
+namespace klee {
+  class ExecutionState;
+  class InterpreterHandler;
+  struct KInstruction;
+
+  /// A table of lines "<tag><id> ..." written through a series of shard
+  /// files <name>.<shard>.txt, a new one every shardSize lines. Each shard
+  /// starts with "# first <id>", the first ID it defines.
+  class ShardedTable {
+    InterpreterHandler &handler;
+    std::string name;
+    unsigned shardSize;
+    unsigned shard = 0;
+    unsigned lines = 0;
+    std::unique_ptr<llvm::raw_fd_ostream> os;
+
+  public:
+    ShardedTable(InterpreterHandler &handler, const std::string &name,
+                 unsigned shardSize);
+    ~ShardedTable();
+
+    /// The stream to write the definition of the next id to, opening a new
+    /// shard if the current one is full
+    llvm::raw_ostream &define(uint32_t id);
+  };
+
+  /// Interns the stacks of --write-stack-paths and the constraints of
+  /// --write-cons-paths in shared tables, so that the per state streams
+  /// only hold "S<id>" and "N<id>" references (-path-dump-format=interned).
+  ///
+  /// stack-table.*.txt defines frames ("F<id> <frame as in the stack
+  /// dump>"), thread headers ("F<id> Thread ...") and stacks ("S<id>
+  /// <current thread> F<id>..."), innermost frame first. expr-table.*.txt
+  /// defines the expression DAG: "N<id> <kind> w<width> <kids>" where kids
+  /// are "N<id>" references, preceded by the offset of an Extract and by
+  /// the array and the update list ("U<id>" or "-") of a Read, and
+  /// "Constant" nodes end with their value. "U<id> N<index> N<value>
+  /// U<next>" defines an update. Every node is defined before it is
+  /// referenced.
+  class PathDumpTable {
+    ShardedTable stackTable, exprTable;
+
+    /// A frame as Thread::dumpStack prints it: where it is and the values
+    /// of its constant arguments (null for a symbolic one)
+    struct FrameKey {
+      const KInstruction *target;
+      std::vector<ref<Expr>> args;
+      bool operator<(const FrameKey &b) const;
+    };
+    std::map<FrameKey, uint32_t> frames;
+    /// (thread, process, enabled) of thread headers, in the ID space of the
+    /// frames
+    std::map<std::vector<uint64_t>, uint32_t> threadHeaders;
+    uint32_t nextFrame = 0;
+    std::map<std::vector<uint32_t>, uint32_t> stacks;
+
+    ExprHashMap<uint32_t> exprs;
+    std::unordered_map<const UpdateNode *, uint32_t> updates;
+    /// keeps the interned update nodes alive, so that their addresses are
+    /// not reused
+    std::vector<ref<UpdateNode>> keptUpdates;
+
+    uint32_t internFrame(FrameKey &&key);
+    uint32_t internUpdate(const UpdateNode *un);
+
+  public:
+    PathDumpTable(InterpreterHandler &handler, unsigned shardSize);
+
+    /// \return the ID of the stacks of all threads of state
+    uint32_t internStack(const ExecutionState &state);
+    /// \return the ID of the root node of e
+    uint32_t internExpr(const ref<Expr> &e);
+  };
+
+} // namespace klee
+
+#endif /* KLEE_PATHDUMPTABLE_H */
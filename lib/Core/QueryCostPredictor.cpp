@@ -0,0 +1,121 @@
+//===-- QueryCostPredictor.cpp --------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "QueryCostPredictor.h"
+
+#include "klee/Expr/Constraints.h"
+#include "klee/Internal/Support/IndependentElementSet.h"
+
+#include <algorithm>
+#include <cmath>
+#include <set>
+
+using namespace klee;
+
+/// Keeps the fit defined while a feature has not varied yet
+static const double Ridge = 1e-3;
+/// The time of the fastest queries, so that their logarithm stays bounded
+static const double MinSeconds = 1e-6;
+
+QueryCostPredictor::QueryCostPredictor() : samples(0), fitted(false) {
+  for (unsigned i = 0; i < NumFeatures; ++i) {
+    std::fill(xtx[i], xtx[i] + NumFeatures, 0.);
+    xty[i] = 0.;
+  }
+  coefficients.fill(0.);
+}
+
+QueryCostPredictor::Features
+QueryCostPredictor::getFeatures(const ConstraintManager &constraints,
+                                const ref<Expr> &condition) {
+  // only the constraints sharing symbolic values with the condition make the
+  // query hard, with the independent solver those are known already
+  std::vector<ref<Expr> > related;
+  if (constraints.factor_size() || constraints.getAllConstraints().empty()) {
+    IndependentElementSet conditionElements(condition);
+    IndepElemSetPtrSet_ty factors;
+    constraints.getIntersection(&conditionElements, factors);
+    for (const IndependentElementSet *factor : factors)
+      related.insert(related.end(), factor->exprs.begin(),
+                     factor->exprs.end());
+  } else {
+    related.assign(constraints.getAllConstraints().begin(),
+                   constraints.getAllConstraints().end());
+  }
+
+  double nodes = 0;
+  unsigned maxUpdates = 0, readDepth = 0;
+  std::set<const Array *> arrays;
+  auto add = [&](const ref<Expr> &e) {
+    const ExprMetadata &md = e->getMetadata();
+    nodes += md.size;
+    maxUpdates = std::max(maxUpdates, md.maxUpdates);
+    readDepth = std::max(readDepth, md.indirectReadDepth);
+    arrays.insert(md.arrays->begin(), md.arrays->end());
+  };
+  for (const ref<Expr> &e : related)
+    add(e);
+  add(condition);
+
+  return Features{{1., std::log2(1. + nodes), std::log2(1. + related.size()),
+                   std::log2(1. + maxUpdates), double(readDepth),
+                   std::log2(1. + arrays.size())}};
+}
+
+void QueryCostPredictor::observe(const Features &features, double seconds) {
+  double y = std::log2(std::max(seconds, MinSeconds));
+  for (unsigned i = 0; i < NumFeatures; ++i) {
+    for (unsigned j = 0; j < NumFeatures; ++j)
+      xtx[i][j] += features[i] * features[j];
+    xty[i] += features[i] * y;
+  }
+  ++samples;
+  if (samples >= MinSamples && samples % RefitEvery == 0)
+    refit();
+}
+
+void QueryCostPredictor::refit() {
+  // solve (X^T X + Ridge I) c = X^T y by Gaussian elimination
+  double a[NumFeatures][NumFeatures + 1];
+  for (unsigned i = 0; i < NumFeatures; ++i) {
+    std::copy(xtx[i], xtx[i] + NumFeatures, a[i]);
+    a[i][i] += Ridge * samples;
+    a[i][NumFeatures] = xty[i];
+  }
+  for (unsigned col = 0; col < NumFeatures; ++col) {
+    unsigned pivot = col;
+    for (unsigned row = col + 1; row < NumFeatures; ++row)
+      if (std::fabs(a[row][col]) > std::fabs(a[pivot][col]))
+        pivot = row;
+    if (std::fabs(a[pivot][col]) < 1e-12)
+      return;
+    std::swap(a[col], a[pivot]);
+    for (unsigned row = 0; row < NumFeatures; ++row) {
+      if (row == col)
+        continue;
+      double factor = a[row][col] / a[col][col];
+      for (unsigned k = col; k <= NumFeatures; ++k)
+        a[row][k] -= factor * a[col][k];
+    }
+  }
+  for (unsigned i = 0; i < NumFeatures; ++i)
+    coefficients[i] = a[i][NumFeatures] / a[i][i];
+  fitted = true;
+}
+
+bool QueryCostPredictor::predict(const Features &features,
+                                 double &seconds) const {
+  if (!fitted)
+    return false;
+  double y = 0;
+  for (unsigned i = 0; i < NumFeatures; ++i)
+    y += coefficients[i] * features[i];
+  seconds = std::exp2(y);
+  return true;
+}
@@ -0,0 +1,68 @@
+//===-- QueryCostPredictor.h ------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_QUERYCOSTPREDICTOR_H
+#define KLEE_QUERYCOSTPREDICTOR_H
+
+#include "klee/Expr/Expr.h"
+
+#include <array>
+#include <cstdint>
+
+namespace klee {
+  class ConstraintManager;
+
+  /// Predicts the time of a branch query from features of the condition and
+  /// of the constraints it depends on, by a least squares fit of the
+  /// logarithm of the time of the queries seen so far. The features grow
+  /// with the constraints along a path, and the fit extrapolates to sizes
+  /// not seen yet, so a query can be flagged before it is sent.
+  class QueryCostPredictor {
+  public:
+    /// The logarithms of the node count, of the number of constraints, of
+    /// the longest update list and of the number of arrays, and the depth
+    /// of symbolic-index reads, preceded by a constant term
+    static const unsigned NumFeatures = 6;
+    typedef std::array<double, NumFeatures> Features;
+
+  private:
+    /// The normal equations of the fit, X^T X and X^T y
+    double xtx[NumFeatures][NumFeatures];
+    double xty[NumFeatures];
+    uint64_t samples;
+    /// The coefficients, refitted every RefitEvery samples
+    Features coefficients;
+    bool fitted;
+
+    void refit();
+
+  public:
+    /// The samples before the predictor predicts
+    static const unsigned MinSamples = 32;
+    static const unsigned RefitEvery = 16;
+
+    QueryCostPredictor();
+
+    /// The features of a query about condition in a state with constraints
+    static Features getFeatures(const ConstraintManager &constraints,
+                                const ref<Expr> &condition);
+
+    /// Add a query with features which took seconds, a timed out query
+    /// being added with at least its timeout.
+    void observe(const Features &features, double seconds);
+
+    /// Predict the time of a query with features.
+    /// \return false if too few queries were seen
+    bool predict(const Features &features, double &seconds) const;
+
+    uint64_t getSamples() const { return samples; }
+  };
+}
+
+#endif /* KLEE_QUERYCOSTPREDICTOR_H */
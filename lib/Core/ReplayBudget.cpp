@@ -0,0 +1,116 @@
+//===-- ReplayBudget.cpp --------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ReplayBudget.h"
+
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+
+using namespace klee;
+
+static time::Span fromSeconds(double s) {
+  return time::microseconds(s > 0 ? static_cast<uint64_t>(s * 1e6) : 0);
+}
+
+ReplayBudget::ReplayBudget(time::Span _budget, uint64_t _traceSize,
+                           unsigned _segments, llvm::raw_ostream *_log)
+    : queries(0), start(time::getWallTime()), budget(_budget),
+      traceSize(std::max<uint64_t>(_traceSize, 1)),
+      segments(std::max(_segments, 1u)), log(_log), segment(0),
+      segmentStart(start), segmentQueries(0) {
+  histogram.fill(0);
+  if (log)
+    *log << "# segment\tfirst entry\tend entry\ttime\ttarget\tsolver time\t"
+            "queries\telapsed\tstatus\n";
+}
+
+void ReplayBudget::observeQuery(time::Span t) {
+  int64_t us = std::max<int64_t>(t.toMicroseconds(), 0);
+  unsigned bucket = 0;
+  while (us && bucket + 1 < NumBuckets) {
+    us >>= 1;
+    ++bucket;
+  }
+  ++histogram[bucket];
+  ++queries;
+  segmentSolverTime += t;
+  ++segmentQueries;
+}
+
+time::Span ReplayBudget::getQueryPercentile90() const {
+  if (!queries)
+    return time::Span();
+  uint64_t seen = 0, rank = queries - queries / 10;
+  unsigned bucket = 0;
+  for (; bucket + 1 < NumBuckets; ++bucket) {
+    seen += histogram[bucket];
+    if (seen >= rank)
+      break;
+  }
+  // the upper end of the bucket
+  return time::microseconds(uint64_t(1) << bucket);
+}
+
+time::Span ReplayBudget::getTarget(uint64_t position) const {
+  double done = std::min<double>(1., double(position) / traceSize);
+  return fromSeconds(budget.toSeconds() * done);
+}
+
+time::Span ReplayBudget::getTimeout(uint64_t position, time::Span cap) const {
+  double elapsed = (time::getWallTime() - start).toSeconds();
+  double remaining = budget.toSeconds() - elapsed;
+  double done = std::min<double>(1., double(position) / traceSize);
+
+  // what the rest of the trace needs at the pace so far, its target share
+  // of the budget while there is no pace yet
+  double needed = done > 0 ? elapsed * (1 - done) / done
+                           : budget.toSeconds() * (1 - done);
+  double floor = std::max(PercentileFactor *
+                              getQueryPercentile90().toSeconds(),
+                          budget.toSeconds() / (4 * segments));
+  double timeout = std::max(remaining - needed, floor);
+  if (remaining > 0)
+    timeout = std::min(timeout, remaining);
+  if (cap)
+    timeout = std::min(timeout, cap.toSeconds());
+  return fromSeconds(timeout);
+}
+
+void ReplayBudget::logSegment(time::Point now, const char *status) {
+  if (!log)
+    return;
+  uint64_t first = traceSize * segment / segments;
+  uint64_t end = traceSize * (segment + 1) / segments;
+  *log << segment << '\t' << first << '\t' << end << '\t'
+       << (now - segmentStart) << '\t' << getTarget(end) - getTarget(first)
+       << '\t' << segmentSolverTime << '\t' << segmentQueries << '\t'
+       << (now - start) << '\t' << status << '\n';
+  log->flush();
+}
+
+void ReplayBudget::advance(uint64_t position) {
+  unsigned reached = std::min<uint64_t>(position * segments / traceSize,
+                                        segments - 1);
+  if (reached <= segment)
+    return;
+  time::Point now = time::getWallTime();
+  for (; segment < reached; ++segment) {
+    uint64_t end = traceSize * (segment + 1) / segments;
+    logSegment(now, now - start > getTarget(end) ? "behind" : "on time");
+    segmentStart = now;
+    segmentSolverTime = time::Span();
+    segmentQueries = 0;
+  }
+}
+
+void ReplayBudget::finish(uint64_t position, bool exhausted) {
+  advance(position);
+  logSegment(time::getWallTime(), exhausted ? "exhausted" : "done");
+}
@@ -0,0 +1,85 @@
+//===-- ReplayBudget.h ------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_REPLAYBUDGET_H
+#define KLEE_REPLAYBUDGET_H
+
+#include "klee/Internal/System/Time.h"
+
+#include <array>
+#include <cstdint>
+
+namespace llvm {
+  class raw_ostream;
+}
+
+namespace klee {
+
+  /// Spreads the -max-time of a replay over the trace. The trace is split
+  /// into segments of equal length, each targeted at its share of the
+  /// budget, and the time each one took is logged against that target.
+  ///
+  /// The solver timeout of a query is the slack the replay has left: the
+  /// time remaining minus what the rest of the trace needs at the pace seen
+  /// so far. It never drops below a few times the 90th percentile of the
+  /// query times seen, so that ordinary queries are not cut short by a
+  /// replay that is behind.
+  class ReplayBudget {
+    /// query times by bucket, bucket i holding [2^(i-1), 2^i) microseconds
+    static const unsigned NumBuckets = 48;
+    std::array<uint64_t, NumBuckets> histogram;
+    uint64_t queries;
+
+    time::Point start;
+    time::Span budget;
+    uint64_t traceSize;
+    unsigned segments;
+    llvm::raw_ostream *log;
+
+    /// the segment the furthest state is in, and its start
+    unsigned segment;
+    time::Point segmentStart;
+    time::Span segmentSolverTime;
+    uint64_t segmentQueries;
+
+    void logSegment(time::Point now, const char *status);
+
+  public:
+    /// Timeouts never drop below this many 90th percentiles
+    static const unsigned PercentileFactor = 4;
+
+    /// log, if given, receives a line per segment
+    ReplayBudget(time::Span budget, uint64_t traceSize, unsigned segments,
+                 llvm::raw_ostream *log);
+
+    /// A query took t, a timed out one counting with its timeout
+    void observeQuery(time::Span t);
+
+    /// The 90th percentile of the query times seen, zero before any
+    time::Span getQueryPercentile90() const;
+
+    time::Span getBudget() const { return budget; }
+
+    /// The timeout for a query at the given trace position, at most cap
+    /// unless cap is zero, and never beyond the end of the budget
+    time::Span getTimeout(uint64_t position, time::Span cap) const;
+
+    /// The time the replay should have taken up to position
+    time::Span getTarget(uint64_t position) const;
+
+    /// The furthest state reached position, log the segments it completed
+    void advance(uint64_t position);
+
+    /// The replay ended at position, log the segment it ended in
+    void finish(uint64_t position, bool exhausted);
+  };
+
+} // namespace klee
+
+#endif /* KLEE_REPLAYBUDGET_H */
@@ -0,0 +1,179 @@
+//===-- ReplayDivergence.cpp ----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ReplayDivergence.h"
+
+#include "CoreStats.h"
+
+#include "klee/ExecutionState.h"
+#include "klee/Internal/Module/InstructionInfoTable.h"
+#include "klee/Internal/Module/KInstruction.h"
+#include "klee/Internal/Module/KModule.h"
+#include "klee/Internal/Support/PathBuffer.h"
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+
+using namespace klee;
+
+namespace {
+  /// Writes s as a JSON string
+  class Quoted {
+    const std::string &s;
+
+  public:
+    explicit Quoted(const std::string &_s) : s(_s) {}
+
+    friend llvm::raw_ostream &operator<<(llvm::raw_ostream &os,
+                                         const Quoted &q) {
+      os << '"';
+      for (unsigned char c : q.s) {
+        if (c == '"' || c == '\\')
+          os << '\\' << c;
+        else if (c == '\n')
+          os << "\\n";
+        else if (c < 0x20)
+          os << llvm::format("\\u%04x", c);
+        else
+          os << c;
+      }
+      return os << '"';
+    }
+  };
+} // namespace
+
+static std::string getLocation(const KInstruction *ki) {
+  if (!ki)
+    return "??";
+  if (ki->info->file.empty())
+    return "??:" + std::to_string(ki->info->getAssemblyLine());
+  return ki->info->file + ":" + std::to_string(ki->info->line);
+}
+
+ReplayDivergenceReport::ReplayDivergenceReport(
+    std::unique_ptr<llvm::raw_fd_ostream> _os, const PathEntryBuffer &_path,
+    const DataRecBuffer *_dataRec, unsigned _history)
+    : os(std::move(_os)), path(_path), dataRec(_dataRec), history(_history),
+      divergences(0) {}
+
+ReplayDivergenceReport::~ReplayDivergenceReport() = default;
+
+std::string ReplayDivergenceReport::describe(const PathEntry &pe) {
+  switch (pe.t) {
+  case PathEntry::FORK:
+    return std::string("FORK ") + (pe.body.br ? "1" : "0");
+  case PathEntry::SWITCH_EXPIDX:
+    return "SWITCH_EXPIDX " + std::to_string(pe.body.switchIndex);
+  case PathEntry::SWITCH_BBIDX:
+    return "SWITCH_BBIDX " + std::to_string(pe.body.switchIndex);
+  case PathEntry::INDIRECTBR:
+    return "INDIRECTBR " + std::to_string(pe.body.indirectbrIndex);
+  case PathEntry::DATAREC:
+    return "DATAREC width " + std::to_string(pe.body.drec.width);
+  case PathEntry::SCHEDULE:
+    if (pe.schedulePid())
+      return "SCHEDULE " + std::to_string(pe.scheduleTid()) + " of process " +
+             std::to_string(pe.schedulePid());
+    return "SCHEDULE " + std::to_string(pe.scheduleTid());
+  default:
+    return "unknown type " + std::to_string(pe.t);
+  }
+}
+
+void ReplayDivergenceReport::reportDivergence(const ExecutionState &state,
+                                              unsigned position,
+                                              const std::string &reason,
+                                              const std::string &expected,
+                                              const std::string &actual,
+                                              bool continued) {
+  if (!os)
+    return;
+  llvm::raw_ostream &out = *os;
+  const KInstruction *ki = state.prevPC();
+
+  out << "{\"type\":\"divergence\",\"index\":" << divergences++
+      << ",\"reason\":" << Quoted(reason) << ",\"position\":" << position
+      << ",\"path_entries\":" << path.size()
+      << ",\"datarec_position\":" << state.replayDataRecEntriesPosition
+      << ",\"datarec_entries\":" << (dataRec ? dataRec->size() : 0)
+      << ",\"expected\":" << Quoted(expected)
+      << ",\"actual\":" << Quoted(actual)
+      << ",\"instruction\":"
+      << Quoted(ki ? getLocation(ki) + " " + ki->inst->getOpcodeName() : "??")
+      << ",\"instructions\":" << stats::instructions
+      << ",\"continued\":" << (continued ? "true" : "false");
+
+  // innermost frame first, each at the instruction it is executing
+  out << ",\"stack\":[";
+  const KInstruction *pc = ki;
+  const char *sep = "";
+  for (auto it = state.stack().rbegin(), ie = state.stack().rend(); it != ie;
+       ++it) {
+    out << sep << "{\"function\":"
+        << Quoted(it->kf->function->getName().str())
+        << ",\"location\":" << Quoted(getLocation(pc)) << '}';
+    pc = it->caller;
+    sep = ",";
+  }
+  out << ']';
+
+  out << ",\"history\":[";
+  unsigned end = std::min<size_t>(position, path.size());
+  sep = "";
+  for (unsigned i = end - std::min(end, history); i < end; ++i) {
+    out << sep << "{\"position\":" << i
+        << ",\"entry\":" << Quoted(describe(path[i])) << '}';
+    sep = ",";
+  }
+  out << ']';
+
+  if (dataRec) {
+    auto writeEntry = [&](unsigned i) {
+      DataRecEntry dre = (*dataRec)[i];
+      const std::vector<std::string> &ids = dataRec->getIDTable();
+      out << "{\"position\":" << i << ",\"id\":"
+          << Quoted(dre.instID < ids.size() ? ids[dre.instID] : "??")
+          << ",\"data\":" << dre.data << '}';
+    };
+    unsigned drEnd = std::min<size_t>(state.replayDataRecEntriesPosition,
+                                      dataRec->size());
+    out << ",\"datarec\":[";
+    sep = "";
+    for (unsigned i = drEnd - std::min(drEnd, history); i < drEnd; ++i) {
+      out << sep;
+      writeEntry(i);
+      sep = ",";
+    }
+    out << "],\"pending_datarec\":";
+    if (drEnd < dataRec->size())
+      writeEntry(drEnd);
+    else
+      out << "null";
+  }
+  out << "}\n";
+  out.flush();
+}
+
+void ReplayDivergenceReport::reportSuffix(const ExecutionState &state) {
+  if (!os)
+    return;
+  *os << "{\"type\":\"suffix\",\"first_position\":" << state.replayDivergedAt
+      << ",\"divergences\":" << state.replayDivergences
+      << ",\"position\":" << state.replayPosition
+      << ",\"path_entries\":" << path.size() << ",\"entries_after\":"
+      << state.replayPosition - state.replayDivergedAt
+      << ",\"instructions_after\":"
+      << state.steppedInstructions - state.replayDivergedStep
+      << ",\"location\":" << Quoted(getLocation(state.prevPC())) << "}\n";
+  os->flush();
+}
@@ -0,0 +1,65 @@
+//===-- ReplayDivergence.h --------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_REPLAYDIVERGENCE_H
+#define KLEE_REPLAYDIVERGENCE_H
+
+#include "klee/Internal/Support/SerializableTypes.h"
+
+#include <memory>
+#include <string>
+
+namespace llvm {
+  class raw_fd_ostream;
+}
+
+namespace klee {
+  class DataRecBuffer;
+  class ExecutionState;
+  class PathEntryBuffer;
+
+  /// Writes replay-divergence.jsonl, one JSON object per line.
+  ///
+  /// A "divergence" record tells where a state left the trace: the trace
+  /// position, the recorded and the runtime decision, the stack, the path
+  /// entries and the DATAREC entries consumed just before, and the next
+  /// DATAREC entry the trace still expected. A state that keeps running
+  /// past its divergence (-replay-continue-after-divergence) gets a
+  /// "suffix" record when it terminates, to measure how far it went.
+  class ReplayDivergenceReport {
+    std::unique_ptr<llvm::raw_fd_ostream> os;
+    const PathEntryBuffer &path;
+    const DataRecBuffer *dataRec;
+    unsigned history;
+    unsigned divergences;
+
+  public:
+    /// history is the number of path and DATAREC entries shown before the
+    /// divergence
+    ReplayDivergenceReport(std::unique_ptr<llvm::raw_fd_ostream> os,
+                           const PathEntryBuffer &path,
+                           const DataRecBuffer *dataRec, unsigned history);
+    ~ReplayDivergenceReport();
+
+    /// state disagrees with the path entry at position
+    void reportDivergence(const ExecutionState &state, unsigned position,
+                          const std::string &reason,
+                          const std::string &expected,
+                          const std::string &actual, bool continued);
+
+    /// state ran past its first divergence and is terminating
+    void reportSuffix(const ExecutionState &state);
+
+    /// e.g. "FORK 1" or "SWITCH_EXPIDX 3"
+    static std::string describe(const PathEntry &pe);
+  };
+
+} // namespace klee
+
+#endif /* KLEE_REPLAYDIVERGENCE_H */
@@ -165,9 +165,52 @@ RandomSearcher::update(ExecutionState *current,
 
 ///
 
+ReplayProgressSearcher::Key
+ReplayProgressSearcher::getKey(ExecutionState *es, int64_t sequence) {
+  int64_t consumed = (int64_t)es->replayPosition +
+                     es->replayDataRecEntriesPosition;
+  uint64_t md2u = computeMinDistToUncovered(
+      es->pc(), es->stack().back().minDistToUncoveredOnReturn);
+  return Key(es->replayDivergences, -consumed, md2u, -sequence);
+}
+
+ExecutionState &ReplayProgressSearcher::selectState() {
+  return *queue.begin()->second;
+}
+
+void ReplayProgressSearcher::update(
+    ExecutionState *current, const std::vector<ExecutionState *> &addedStates,
+    const std::vector<ExecutionState *> &removedStates) {
+  for (ExecutionState *es : removedStates) {
+    auto it = keys.find(es);
+    assert(it != keys.end() && "invalid state removed");
+    queue.erase(std::make_pair(it->second, es));
+    keys.erase(it);
+  }
+
+  // the current state is the only one that made progress
+  auto it = current ? keys.find(current) : keys.end();
+  if (it != keys.end()) {
+    Key key = getKey(current, -std::get<3>(it->second));
+    if (key != it->second) {
+      queue.erase(std::make_pair(it->second, current));
+      queue.insert(std::make_pair(key, current));
+      it->second = key;
+    }
+  }
+
+  for (ExecutionState *es : addedStates) {
+    Key key = getKey(es, nextSequence++);
+    keys[es] = key;
+    queue.insert(std::make_pair(key, es));
+  }
+}
+
+///
+
 WeightedRandomSearcher::WeightedRandomSearcher(WeightType _type)
   : states(new DiscretePDF<ExecutionState*>()),
-    type(_type) {
+    type(_type), distanceGeneration(getMinDistToUncoveredGeneration()) {
   switch(type) {
   case Depth:
   case RP:
@@ -252,6 +295,14 @@ void WeightedRandomSearcher::update(
        it != ie; ++it) {
     states->remove(*it);
   }
+
+  // Once the distances are recomputed, the weights of all states that
+  // depend on them are stale, not only the one of current.
+  if ((type == MinDistToUncovered || type == CoveringNew) &&
+      distanceGeneration != getMinDistToUncoveredGeneration()) {
+    distanceGeneration = getMinDistToUncoveredGeneration();
+    states->updateAll([this](ExecutionState *es) { return getWeight(es); });
+  }
 }
 
 bool WeightedRandomSearcher::empty() { 
@@ -268,20 +319,16 @@ RandomPathSearcher::~RandomPathSearcher() {
 
 ExecutionState &RandomPathSearcher::selectState() {
   unsigned flips=0, bits=0;
-  PTreeNode *n = executor.processTree->root.get();
+  // the forks of the tree all have two sides
+  const PTree &tree = *executor.processTree;
+  const PTree::Node *n = &tree[tree.getRoot()];
   while (!n->state) {
-    if (!n->left) {
-      n = n->right.get();
-    } else if (!n->right) {
-      n = n->left.get();
-    } else {
-      if (bits==0) {
-        flips = theRNG.getInt32();
-        bits = 32;
-      }
-      --bits;
-      n = (flips&(1<<bits)) ? n->left.get() : n->right.get();
+    if (bits==0) {
+      flips = theRNG.getInt32();
+      bits = 32;
     }
+    --bits;
+    n = &tree[(flips&(1<<bits)) ? n->left : n->right];
   }
 
   return *n->state;
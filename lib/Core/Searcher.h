@@ -18,6 +18,8 @@
 #include <map>
 #include <queue>
 #include <set>
+#include <tuple>
+#include <unordered_map>
 #include <vector>
 
 namespace llvm {
@@ -81,7 +83,8 @@ namespace klee {
       NURS_RP,
       NURS_ICnt,
       NURS_CPICnt,
-      NURS_QC
+      NURS_QC,
+      ReplayProgress
     };
   };
 
@@ -127,6 +130,33 @@ namespace klee {
     }
   };
 
+  /// Prefers the states that followed the replayed trace the farthest: the
+  /// ones with the fewest divergences (see -replay-continue-after-divergence)
+  /// first, then the most path and DATAREC entries consumed, then the
+  /// smallest distance to uncovered code and the most recently added. Only
+  /// the key of the current state is recomputed, the others keep the
+  /// distance they were added with, so that selection and updates take
+  /// O(log n).
+  class ReplayProgressSearcher : public Searcher {
+    // (divergences, -entries consumed, md2u, -sequence number)
+    typedef std::tuple<unsigned, int64_t, uint64_t, int64_t> Key;
+    std::set<std::pair<Key, ExecutionState *>> queue;
+    std::unordered_map<ExecutionState *, Key> keys;
+    int64_t nextSequence = 0;
+
+    Key getKey(ExecutionState *es, int64_t sequence);
+
+  public:
+    ExecutionState &selectState();
+    void update(ExecutionState *current,
+                const std::vector<ExecutionState *> &addedStates,
+                const std::vector<ExecutionState *> &removedStates);
+    bool empty() { return queue.empty(); }
+    void printName(llvm::raw_ostream &os) {
+      os << "ReplayProgressSearcher\n";
+    }
+  };
+
   class WeightedRandomSearcher : public Searcher {
   public:
     enum WeightType {
@@ -143,6 +173,8 @@ namespace klee {
     DiscretePDF<ExecutionState*> *states;
     WeightType type;
     bool updateWeights;
+    /// The getMinDistToUncoveredGeneration() the weights were computed in
+    uint64_t distanceGeneration;
     
     double getWeight(ExecutionState*);
 
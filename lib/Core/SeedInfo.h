@@ -12,6 +12,8 @@
 
 #include "klee/Expr/Assignment.h"
 
+#include <memory>
+
 extern "C" {
   struct KTest;
   struct KTestObject;
@@ -25,15 +27,17 @@ namespace klee {
   class SeedInfo {
   public:
     Assignment assignment;
-    KTest *input;
+    /// Shared by the states the seed was copied to, and freed with the
+    /// last of them
+    std::shared_ptr<KTest> input;
     unsigned inputPosition;
     std::set<struct KTestObject*> used;
     
   public:
     explicit
-    SeedInfo(KTest *_input) : assignment(true),
-                             input(_input),
-                             inputPosition(0) {}
+    SeedInfo(std::shared_ptr<KTest> _input) : assignment(true),
+                                              input(std::move(_input)),
+                                              inputPosition(0) {}
     
     KTestObject *getNextInput(const MemoryObject *mo,
                              bool byName);
@@ -0,0 +1,163 @@
+//===-- SolverProfiler.cpp ------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "SolverProfiler.h"
+
+#include "klee/ExecutionState.h"
+#include "klee/Internal/Module/InstructionInfoTable.h"
+#include "klee/Internal/Module/KInstruction.h"
+#include "klee/Internal/Module/KModule.h"
+#include "klee/Internal/Support/IndependentElementSet.h"
+#include "klee/Solver/SolverCmdLine.h"
+
+#include "llvm/IR/Function.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <set>
+
+using namespace klee;
+
+SolverProfiler::SolverProfiler(unsigned _sampleEvery)
+    : sampleEvery(std::max(_sampleEvery, 1u)), countdown(1) {
+  nodes.push_back({0, nullptr});
+}
+
+unsigned SolverProfiler::getNode(const ExecutionState &state) {
+  unsigned node = 0;
+  for (const StackFrame &sf : state.stack()) {
+    auto it = children.insert({{node, sf.kf}, nodes.size()}).first;
+    if (it->second == nodes.size())
+      nodes.push_back({node, sf.kf});
+    node = it->second;
+  }
+  return node;
+}
+
+std::string SolverProfiler::getFactorName(const ExecutionState &state,
+                                          const ref<Expr> &expr) {
+  IndependentElementSet query(expr);
+  IndepElemSetPtrSet_ty factors;
+  state.constraints.getIntersection(&query, factors);
+  factors.insert(&query);
+
+  std::set<std::string> names;
+  for (const IndependentElementSet *factor : factors) {
+    for (auto &it : factor->elements)
+      names.insert(it.first->name);
+    for (const Array *array : factor->wholeObjects)
+      names.insert(array->name);
+  }
+
+  std::string name;
+  for (const std::string &n : names)
+    name += (name.empty() ? "" : ",") + n;
+  return name;
+}
+
+void SolverProfiler::record(const ExecutionState &state,
+                            const ref<Expr> &expr, time::Span cost) {
+  if (--countdown)
+    return;
+  countdown = sampleEvery;
+
+  const KInstruction *ki = state.prevPC();
+  if (!ki)
+    return;
+  uint64_t time = cost.toNanoseconds() * sampleEvery;
+  leaves[{getNode(state), ki}].add(time, sampleEvery);
+  if (expr.isNull())
+    return;
+
+  for (const Array *array : *expr->getMetadata().arrays)
+    byArray[array].add(time, sampleEvery);
+  if (UseIndependentSolver)
+    byFactor[getFactorName(state, expr)].add(time, sampleEvery);
+}
+
+static std::string getLocation(const KInstruction *ki) {
+  if (ki->info->file.empty())
+    return "??:" + std::to_string(ki->info->getAssemblyLine());
+  return ki->info->file + ":" + std::to_string(ki->info->line);
+}
+
+void SolverProfiler::writeFoldedStacks(llvm::raw_ostream &os) const {
+  std::vector<const KFunction *> stack;
+  for (auto &it : leaves) {
+    stack.clear();
+    for (unsigned node = it.first.first; node; node = nodes[node].parent)
+      stack.push_back(nodes[node].kf);
+    for (auto f = stack.rbegin(); f != stack.rend(); ++f)
+      os << (*f)->function->getName() << ';';
+    os << getLocation(it.first.second) << ' ' << it.second.time / 1000
+       << '\n';
+  }
+}
+
+template <typename Key>
+static void writeTable(llvm::raw_ostream &os, const char *title,
+                       const std::map<Key, SolverProfiler::Cost> &costs,
+                       std::string (*name)(const Key &)) {
+  std::vector<std::pair<uint64_t, const Key *>> order;
+  uint64_t total = 0;
+  for (auto &it : costs) {
+    order.push_back({it.second.time, &it.first});
+    total += it.second.time;
+  }
+  std::sort(order.rbegin(), order.rend());
+
+  os << "=== " << title << " ===\n"
+     << "  time(s)      %  queries  avg(ms)\n";
+  for (auto &it : order) {
+    const SolverProfiler::Cost &c = costs.at(*it.second);
+    os << llvm::format("%9.3f %6.2f %8llu %8.3f  ", c.time / 1e9,
+                       total ? 100.0 * c.time / total : 0.0,
+                       (unsigned long long)c.queries,
+                       c.queries ? c.time / 1e6 / c.queries : 0.0)
+       << name(*it.second) << '\n';
+  }
+  os << '\n';
+}
+
+static std::string instructionName(const KInstruction *const &ki) {
+  return getLocation(ki) + " " + ki->inst->getOpcodeName() + " in " +
+         ki->inst->getFunction()->getName().str();
+}
+
+static std::string functionName(const llvm::Function *const &f) {
+  return f->getName().str();
+}
+
+static std::string arrayName(const Array *const &array) {
+  return array->name;
+}
+
+static std::string factorName(const std::string &name) {
+  return name.empty() ? "(no array)" : name;
+}
+
+void SolverProfiler::writeReport(llvm::raw_ostream &os) const {
+  std::map<const KInstruction *, Cost> byInstruction;
+  std::map<const llvm::Function *, Cost> byFunction;
+  for (auto &it : leaves) {
+    byInstruction[it.first.second].add(it.second.time, it.second.queries);
+    byFunction[it.first.second->inst->getFunction()].add(it.second.time,
+                                                          it.second.queries);
+  }
+
+  if (sampleEvery > 1)
+    os << "Sampled one in " << sampleEvery
+       << " queries, the costs are scaled accordingly.\n\n";
+  writeTable(os, "By instruction", byInstruction, instructionName);
+  writeTable(os, "By function", byFunction, functionName);
+  writeTable(os, "By array", byArray, arrayName);
+  if (UseIndependentSolver)
+    writeTable(os, "By independent factor", byFactor, factorName);
+}
@@ -0,0 +1,91 @@
+//===-- SolverProfiler.h ----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_SOLVERPROFILER_H
+#define KLEE_SOLVERPROFILER_H
+
+#include "klee/Expr/Expr.h"
+#include "klee/Internal/System/Time.h"
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace llvm {
+  class raw_ostream;
+}
+
+namespace klee {
+  class Array;
+  class ExecutionState;
+  struct KFunction;
+  struct KInstruction;
+
+  /// Aggregates the time of solver queries in memory, by call stack and
+  /// issuing instruction, by the arrays the query reads and by the
+  /// independent factors it touches. Only one in sampleEvery queries is
+  /// attributed, with sampleEvery times its cost.
+  class SolverProfiler {
+  public:
+    struct Cost {
+      /// in nanoseconds, as the statistics
+      uint64_t time = 0;
+      uint64_t queries = 0;
+
+      void add(uint64_t t, uint64_t n) {
+        time += t;
+        queries += n;
+      }
+    };
+
+  private:
+    unsigned sampleEvery;
+    unsigned countdown;
+
+    /// The call tree, node 0 being the root. A node is a function called
+    /// from its parent node.
+    struct Node {
+      unsigned parent;
+      const KFunction *kf;
+    };
+    std::vector<Node> nodes;
+    std::map<std::pair<unsigned, const KFunction *>, unsigned> children;
+
+    /// Cost by (call tree node, issuing instruction)
+    std::map<std::pair<unsigned, const KInstruction *>, Cost> leaves;
+    std::map<const Array *, Cost> byArray;
+    /// Keyed by the sorted names of the arrays of the factors
+    std::map<std::string, Cost> byFactor;
+
+    unsigned getNode(const ExecutionState &state);
+    std::string getFactorName(const ExecutionState &state,
+                              const ref<Expr> &expr);
+
+  public:
+    explicit SolverProfiler(unsigned sampleEvery);
+
+    /// Attribute a query of state about expr (null if there is no
+    /// expression, as for getInitialValues) which took cost
+    void record(const ExecutionState &state, const ref<Expr> &expr,
+                time::Span cost);
+
+    /// Writes one "f1;f2;...;file:line microseconds" line per stack, as
+    /// flamegraph.pl expects
+    void writeFoldedStacks(llvm::raw_ostream &os) const;
+
+    /// Writes the costs by instruction, by function, by array and by factor,
+    /// the most expensive first
+    void writeReport(llvm::raw_ostream &os) const;
+  };
+
+} // namespace klee
+
+#endif /* KLEE_SOLVERPROFILER_H */
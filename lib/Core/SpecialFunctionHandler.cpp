@@ -27,8 +27,11 @@
 
 #include "llvm/ADT/Twine.h"
 #include "llvm/IR/DataLayout.h"
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/Instructions.h"
 #include "llvm/IR/Module.h"
 
+#include <algorithm>
 #include <errno.h>
 #include <sstream>
 
@@ -50,6 +53,22 @@ cl::opt<bool>
                               "condition given to klee_assume() rather than "
                               "emitting an error (default=false)"),
                      cl::cat(TerminationCat));
+
+cl::opt<bool> NativeLibcFunctions(
+    "native-libc-functions", cl::init(true),
+    cl::desc("Run memcpy, memmove, memset, strcmp, strlen, "
+             "klee_copy_memory and the uncontended POSIX mutex, condition "
+             "variable and barrier operations natively when called off the "
+             "recorded path, with concrete arguments, instead of "
+             "interpreting them (default=true)"),
+    cl::cat(HASECat));
+
+cl::opt<bool> MapConcreteFiles(
+    "map-concrete-files", cl::init(true),
+    cl::desc("Read the contents of the concrete files of the POSIX runtime "
+             "a chunk at a time, when first accessed, instead of at startup, "
+             "if off the recorded path (default=true)"),
+    cl::cat(HASECat));
 } // namespace
 
 /// \todo Almost all of the demands in this file should be replaced
@@ -103,6 +122,7 @@ static SpecialFunctionHandler::HandlerInfo handlerInfo[] = {
   add("klee_mustnotbe_symbolic", handleMustNotBeSymbolic, false),
   add("klee_mustnotbe_symbolic_str", handleMustNotBeSymbolicStr, false),
   add("klee_make_symbolic", handleMakeSymbolic, false),
+  add("klee_make_symbolic_batch", handleMakeSymbolicBatch, false),
   add("klee_mark_global", handleMarkGlobal, false),
   add("klee_open_merge", handleOpenMerge, false),
   add("klee_close_merge", handleCloseMerge, false),
@@ -152,21 +172,57 @@ static SpecialFunctionHandler::HandlerInfo handlerInfo[] = {
   add("klee_thread_sleep", handleThreadSleep, false),
   add("klee_thread_notify", handleThreadNotify, false),
 
-  /* Process Management Placeholder */
+  /* Process Management */
   add("klee_process_fork", handleProcessFork, true),
   addDNR("klee_process_terminate", handleProcessTerminate),
+  add("klee_process_wait", handleProcessWait, true),
 
-  /* Shared Memory Placeholder */
+  /* Shared Memory */
   add("klee_make_shared", handleMakeShared, false),
 
   /* Misc */
   add("klee_get_time", handleGetTime, true),
   add("klee_set_time", handleSetTime, false),
+  add("klee_copy_memory", handleCopyMemory, true),
+  add("klee_map_file", handleMapFile, true),
 
 #undef addDNR
 #undef add
 };
 
+/// The functions handleNative runs natively. Their bodies are kept, they
+/// are interpreted whenever the native handler declines a call.
+static const struct {
+  const char *name;
+  SpecialFunctionHandler::NativeHandler handler;
+  unsigned numArgs;
+} nativeHandlerInfo[] = {
+  { "memcpy", &SpecialFunctionHandler::nativeMemcpy, 3 },
+  { "memmove", &SpecialFunctionHandler::nativeMemcpy, 3 },
+  { "memset", &SpecialFunctionHandler::nativeMemset, 3 },
+  { "strcmp", &SpecialFunctionHandler::nativeStrcmp, 2 },
+  { "strlen", &SpecialFunctionHandler::nativeStrlen, 1 },
+  // the uncontended cases of the POSIX runtime's synchronization
+  { "pthread_mutex_lock", &SpecialFunctionHandler::nativeMutexLock, 1 },
+  { "pthread_mutex_trylock", &SpecialFunctionHandler::nativeMutexLock, 1 },
+  { "pthread_mutex_unlock", &SpecialFunctionHandler::nativeMutexUnlock, 1 },
+  { "pthread_cond_signal", &SpecialFunctionHandler::nativeCondSignal, 1 },
+  { "pthread_cond_broadcast", &SpecialFunctionHandler::nativeCondBroadcast,
+    1 },
+  { "pthread_barrier_wait", &SpecialFunctionHandler::nativeBarrierWait, 1 },
+};
+
+/// True if f records data with ptwrite, which a replay loads back
+static bool hasPTWrite(const Function &f) {
+  for (const BasicBlock &bb : f)
+    for (const Instruction &i : bb)
+      if (const CallInst *ci = dyn_cast<CallInst>(&i))
+        if (const InlineAsm *ia = dyn_cast<InlineAsm>(ci->getCalledValue()))
+          if (ia->getAsmString() == "ptwrite $0")
+            return true;
+  return false;
+}
+
 SpecialFunctionHandler::const_iterator SpecialFunctionHandler::begin() {
   return SpecialFunctionHandler::const_iterator(handlerInfo);
 }
@@ -230,6 +286,37 @@ void SpecialFunctionHandler::bind() {
     if (f && (!hi.doNotOverride || f->isDeclaration()))
       handlers[f] = std::make_pair(hi.handler, hi.hasReturnValue);
   }
+
+  if (!NativeLibcFunctions)
+    return;
+
+  // mutex_data_t, condvar_data_t and barrier_data_t
+  LLVMContext &ctx = executor.kmodule->module->getContext();
+  const DataLayout &dl = *executor.kmodule->targetData;
+  Type *i8 = Type::getInt8Ty(ctx), *i32 = Type::getInt32Ty(ctx),
+       *i64 = Type::getInt64Ty(ctx), *ptr = Type::getInt8PtrTy(ctx);
+  const StructLayout *mutex =
+      dl.getStructLayout(StructType::get(ctx, {i64, i8, i32, i32, i32, i8}));
+  syncLayout.mutexTaken = mutex->getElementOffset(1);
+  syncLayout.mutexOwner = mutex->getElementOffset(2);
+  syncLayout.mutexCount = mutex->getElementOffset(3);
+  syncLayout.mutexQueued = mutex->getElementOffset(4);
+  syncLayout.condQueued =
+      dl.getStructLayout(StructType::get(ctx, {i64, ptr, i32}))
+          ->getElementOffset(2);
+  const StructLayout *barrier =
+      dl.getStructLayout(StructType::get(ctx, {i64, i32, i32, i32}));
+  syncLayout.barrierCurrEvent = barrier->getElementOffset(1);
+  syncLayout.barrierLeft = barrier->getElementOffset(2);
+  syncLayout.barrierInitCount = barrier->getElementOffset(3);
+
+  for (const auto &ni : nativeHandlerInfo) {
+    Function *f = executor.kmodule->module->getFunction(ni.name);
+    if (!f || f->arg_size() != ni.numArgs || handlers.count(f) ||
+        hasPTWrite(*f))
+      continue;
+    nativeHandlers[f] = ni.handler;
+  }
 }
 
 
@@ -250,10 +337,28 @@ bool SpecialFunctionHandler::handle(ExecutionState &state,
     }
     return true;
   } else {
-    return false;
+    return handleNative(state, f, target, arguments);
   }
 }
 
+bool SpecialFunctionHandler::handleNative(ExecutionState &state,
+                                          Function *f,
+                                          KInstruction *target,
+                                          std::vector< ref<Expr> > &arguments) {
+  native_handlers_ty::iterator it = nativeHandlers.find(f);
+  if (it == nativeHandlers.end())
+    return false;
+  // On the recorded path even the concrete branches of the interpreted
+  // body are recorded and replayed, so it has to run there.
+  auto kf = executor.kmodule->functionMap.find(f);
+  bool recorded = kf != executor.kmodule->functionMap.end()
+                      ? state.shouldRecordCall(kf->second)
+                      : state.shouldRecord();
+  if (recorded || isa<InvokeInst>(target->inst))
+    return false;
+  return (this->*(it->second))(state, target, arguments);
+}
+
 /****/
 
 // reads a concrete string from memory
@@ -302,6 +407,89 @@ SpecialFunctionHandler::readStringAtAddress(ExecutionState &state,
   return result;
 }
 
+bool SpecialFunctionHandler::resolveConstantRange(ExecutionState &state,
+                                                  ref<Expr> address,
+                                                  uint64_t length,
+                                                  ObjectPair &op,
+                                                  unsigned &offset) {
+  ConstantExpr *CE = dyn_cast<ConstantExpr>(address);
+  if (!CE || !state.addressSpace.resolveOne(CE, op))
+    return false;
+  uint64_t base = CE->getZExtValue() - op.first->address;
+  if (base > op.first->size || length > op.first->size - base)
+    return false;
+  offset = base;
+  return true;
+}
+
+bool SpecialFunctionHandler::copyConstantRange(ExecutionState &state,
+                                               KInstruction *target,
+                                               ref<Expr> dest, ref<Expr> src,
+                                               uint64_t length) {
+  ObjectPair dst, source;
+  unsigned dstOffset, srcOffset;
+  if (!resolveConstantRange(state, dest, length, dst, dstOffset) ||
+      !resolveConstantRange(state, src, length, source, srcOffset) ||
+      dst.second->readOnly)
+    return false;
+
+  // Making the destination writeable may replace the source when both are
+  // the same object.
+  ObjectState *wos = state.addressSpace.getWriteable(dst.first, dst.second);
+  const ObjectState *sos = dst.first == source.first ? wos : source.second;
+  wos->copy(dstOffset, *sos, srcOffset, length, Expr::FLAG_INSTRUCTION_ROOT,
+            target);
+  return true;
+}
+
+bool SpecialFunctionHandler::readConstant(ExecutionState &state,
+                                          ref<Expr> address, unsigned width,
+                                          uint64_t &value) {
+  ObjectPair op;
+  unsigned offset;
+  if (!resolveConstantRange(state, address, width / 8, op, offset))
+    return false;
+  ConstantExpr *CE = dyn_cast<ConstantExpr>(op.second->read(offset, width));
+  if (!CE)
+    return false;
+  value = CE->getZExtValue();
+  return true;
+}
+
+bool SpecialFunctionHandler::writeConstant(ExecutionState &state,
+                                           KInstruction *target,
+                                           ref<Expr> address, uint64_t value,
+                                           unsigned width) {
+  ObjectPair op;
+  unsigned offset;
+  if (!resolveConstantRange(state, address, width / 8, op, offset) ||
+      op.second->readOnly)
+    return false;
+  ObjectState *wos = state.addressSpace.getWriteable(op.first, op.second);
+  wos->write(offset, ConstantExpr::create(value, width),
+             Expr::FLAG_INSTRUCTION_ROOT, target);
+  return true;
+}
+
+bool SpecialFunctionHandler::readConcreteString(ExecutionState &state,
+                                                ref<Expr> address,
+                                                std::string &result) {
+  ObjectPair op;
+  unsigned offset;
+  if (!resolveConstantRange(state, address, 0, op, offset))
+    return false;
+  for (unsigned i = offset; i < op.first->size; ++i) {
+    ConstantExpr *c = dyn_cast<ConstantExpr>(op.second->read8(i));
+    if (!c)
+      return false;
+    char ch = c->getZExtValue(8);
+    if (!ch)
+      return true;
+    result.push_back(ch);
+  }
+  return false;
+}
+
 /****/
 
 void SpecialFunctionHandler::handleAbort(ExecutionState &state,
@@ -315,7 +503,11 @@ void SpecialFunctionHandler::handleExit(ExecutionState &state,
                            KInstruction *target,
                            std::vector<ref<Expr> > &arguments) {
   assert(arguments.size()==1 && "invalid number of arguments to exit");
-  executor.terminateStateOnExit(state);
+  // with other processes left only the calling one exits
+  int32_t status = 0;
+  if (ConstantExpr *CE = dyn_cast<ConstantExpr>(arguments[0]))
+    status = CE->getZExtValue(32);
+  executor.executeProcessExit(state, status);
 }
 
 void SpecialFunctionHandler::handleSilentExit(ExecutionState &state,
@@ -958,6 +1150,80 @@ void SpecialFunctionHandler::handleMakeSymbolic(ExecutionState &state,
   }
 }
 
+// void klee_make_symbolic_batch(void *const *addrs, const size_t *sizes,
+//                               const char *const *names, unsigned count);
+void SpecialFunctionHandler::handleMakeSymbolicBatch(
+    ExecutionState &state, KInstruction *target,
+    std::vector<ref<Expr>> &arguments) {
+  if (arguments.size() != 4) {
+    executor.terminateStateOnError(state, "Incorrect number of arguments to klee_make_symbolic_batch(void**, size_t*, char**, unsigned)", Executor::User);
+    return;
+  }
+  ConstantExpr *count = dyn_cast<ConstantExpr>(arguments[3]);
+  if (!count) {
+    executor.terminateStateOnError(
+        state, "klee_make_symbolic_batch requires a constant count",
+        Executor::User);
+    return;
+  }
+
+  Expr::Width width = Context::get().getPointerWidth();
+  unsigned bytes = width / 8;
+  std::vector<const MemoryObject *> objects;
+  std::vector<std::string> names;
+  for (uint64_t i = 0, e = count->getZExtValue(); i != e; ++i) {
+    ref<Expr> index = ConstantExpr::create(i * bytes, width);
+    uint64_t address, size, nameAddress;
+    ObjectPair op;
+    if (!readConstant(state, AddExpr::create(arguments[0], index), width,
+                      address) ||
+        !readConstant(state, AddExpr::create(arguments[1], index), width,
+                      size) ||
+        !readConstant(state, AddExpr::create(arguments[2], index), width,
+                      nameAddress) ||
+        !state.addressSpace.resolveOne(ConstantExpr::create(address, width),
+                                       op) ||
+        op.first->address != address) {
+      executor.terminateStateOnError(
+          state, "klee_make_symbolic_batch requires concrete arrays of the "
+                 "starts of objects, their sizes and names",
+          Executor::User);
+      return;
+    }
+    if (op.second->readOnly) {
+      executor.terminateStateOnError(
+          state, "cannot make readonly object symbolic", Executor::User);
+      return;
+    }
+    // As for klee_make_symbolic, the size may fall short of the usable one.
+    if (size > op.first->size ||
+        std::find(objects.begin(), objects.end(), op.first) != objects.end()) {
+      executor.terminateStateOnError(
+          state, "wrong size given to klee_make_symbolic_batch",
+          Executor::User);
+      return;
+    }
+    std::string name =
+        nameAddress
+            ? readStringAtAddress(state, ConstantExpr::create(nameAddress,
+                                                              width))
+            : "";
+    if (name.length() == 0) {
+      name = "unnamed";
+      klee_warning("klee_make_symbolic_batch: renamed empty name to "
+                   "\"unnamed\"");
+    }
+    objects.push_back(op.first);
+    names.push_back(name);
+  }
+  if (objects.empty())
+    return;
+
+  for (unsigned i = 0; i != objects.size(); ++i)
+    objects[i]->setName(names[i]);
+  executor.executeMakeSymbolic(state, objects, names.front());
+}
+
 void SpecialFunctionHandler::handleMarkGlobal(ExecutionState &state,
                                               KInstruction *target,
                                               std::vector<ref<Expr> > &arguments) {
@@ -1085,13 +1351,9 @@ void SpecialFunctionHandler::handleThreadNotify (
         // head of the given waiting list.
         // Cloud9 handler:
         // executor.executeThreadNotifyOne(state, wlistCE->getZExtValue());
-        std::set<thread_uid_t> &wl = state.waitingLists[wlid];
-        if (wl.size() == 0) {
-          state.waitingLists.erase(wlid);
-        }
-        else {
-          state.notifyOne(wlid, *(wl.begin()));
-        }
+        thread_uid_t tuid;
+        if (state.getFirstWaiting(wlid, tuid))
+          state.notifyOne(wlid, tuid);
       } else {
         // It is simple enough to be handled by the state class itself
         state.notifyAll(wlid);
@@ -1138,19 +1400,76 @@ void SpecialFunctionHandler::handleGetContext (
 void SpecialFunctionHandler::handleProcessFork (
     ExecutionState &state, KInstruction *target,
     std::vector<ref<Expr>> &arguments) {
-  klee_warning("Executing klee_process_fork, do nothing");
+  assert(arguments.size() == 1 &&
+         "invalid number of arguments to klee_process_fork");
+  ref<Expr> pid = executor.toUnique(state, arguments[0]);
+  if (ConstantExpr *CE = dyn_cast<ConstantExpr>(pid)) {
+    executor.executeProcessFork(state, target,
+                                (int32_t)CE->getZExtValue(32));
+  } else {
+    executor.terminateStateOnError(state, "symbolic pid in klee_process_fork",
+                                   Executor::User);
+  }
 }
 // void klee_process_terminate() __attribute__ ((__noreturn__));
 void SpecialFunctionHandler::handleProcessTerminate (
     ExecutionState &state, KInstruction *target,
     std::vector<ref<Expr>> &arguments) {
-  klee_warning("Executing klee_process_terminate, do nothing");
+  assert(arguments.empty() &&
+         "invalid number of arguments to klee_process_terminate");
+  executor.executeProcessExit(state, 0);
+}
+// int klee_process_wait(int32_t pid, int32_t *status, int block);
+void SpecialFunctionHandler::handleProcessWait (
+    ExecutionState &state, KInstruction *target,
+    std::vector<ref<Expr>> &arguments) {
+  assert(arguments.size() == 3 &&
+         "invalid number of arguments to klee_process_wait");
+  ref<Expr> pid = executor.toUnique(state, arguments[0]);
+  ref<Expr> statusAddr = executor.toUnique(state, arguments[1]);
+  ref<Expr> block = executor.toUnique(state, arguments[2]);
+  if (!isa<ConstantExpr>(pid) || !isa<ConstantExpr>(statusAddr) ||
+      !isa<ConstantExpr>(block)) {
+    executor.terminateStateOnError(state, "symbolic args to klee_process_wait",
+                                   Executor::User);
+    return;
+  }
+
+  int32_t status = 0;
+  int64_t child = state.reapChild(
+      (int32_t)cast<ConstantExpr>(pid)->getZExtValue(32), status);
+  executor.bindLocal(target, state,
+                     ConstantExpr::create(child, executor.getWidthForLLVMType(
+                                                     target->inst->getType())));
+  if (child > 0 && !statusAddr->isZero()) {
+    executor.executeMemoryOperation(state, true, statusAddr,
+                                    ConstantExpr::create(status, Expr::Int32),
+                                    nullptr /*target*/);
+  } else if (child == 0 && !block->isZero()) {
+    // the caller asks again once a child exits
+    Process &self = state.processes.find(state.crtThread().getPid())->second;
+    if (!self.childWaitList)
+      self.childWaitList = state.getWaitingList();
+    state.sleepThread(self.childWaitList);
+    executor.schedule(state, false);
+  }
 }
 // void klee_make_shared(void *addr, size_t nbytes);
 void SpecialFunctionHandler::handleMakeShared (
     ExecutionState &state, KInstruction *target,
     std::vector<ref<Expr>> &arguments) {
-  klee_warning_once(0, "Executing klee_make_shared, do nothing");
+  assert(arguments.size() == 2 &&
+         "invalid number of arguments to klee_make_shared");
+  ref<Expr> addr = executor.toUnique(state, arguments[0]);
+  ObjectPair op;
+  if (!isa<ConstantExpr>(addr)) {
+    executor.terminateStateOnError(state, "symbolic address in klee_make_shared",
+                                   Executor::User);
+  } else if (!state.addressSpace.resolveOne(cast<ConstantExpr>(addr), op)) {
+    klee_warning("klee_make_shared of an unbound address, ignoring");
+  } else {
+    state.shareMemory(op.first);
+  }
 }
 
 // uint64_t klee_get_time(void);
@@ -1177,3 +1496,288 @@ void SpecialFunctionHandler::handleSetTime (
         state, "klee_set_time requries a constant argument", Executor::User);
   }
 }
+
+// size_t klee_copy_memory(void *dest, const void *src, size_t nbytes);
+void SpecialFunctionHandler::handleCopyMemory(
+    ExecutionState &state, KInstruction *target,
+    std::vector<ref<Expr>> &arguments) {
+  assert(arguments.size() == 3 &&
+         "invalid number of arguments to klee_copy_memory");
+  // Declined on the recorded path, where the caller's memcpy has to be
+  // interpreted as it was when the path was recorded.
+  ConstantExpr *length = dyn_cast<ConstantExpr>(arguments[2]);
+  bool copied = NativeLibcFunctions && length && !state.shouldRecord() &&
+                copyConstantRange(state, target, arguments[0], arguments[1],
+                                  length->getZExtValue());
+  executor.bindLocal(target, state,
+                     copied ? ref<Expr>(ConstantExpr::create(
+                                  0, arguments[2]->getWidth()))
+                            : arguments[2]);
+}
+
+// size_t klee_map_file(void *buf, size_t nbytes, const char *path);
+void SpecialFunctionHandler::handleMapFile(
+    ExecutionState &state, KInstruction *target,
+    std::vector<ref<Expr>> &arguments) {
+  assert(arguments.size() == 3 && "invalid number of arguments to klee_map_file");
+  // Declined on the recorded path, where the caller reads the file as it
+  // did when the path was recorded.
+  bool mapped = false;
+  ConstantExpr *length = dyn_cast<ConstantExpr>(arguments[1]);
+  ObjectPair op;
+  unsigned offset;
+  std::string path;
+  if (MapConcreteFiles && length && !state.shouldRecord() &&
+      resolveConstantRange(state, arguments[0], length->getZExtValue(), op,
+                           offset) &&
+      offset == 0 && op.first->size == length->getZExtValue() &&
+      !op.second->readOnly && op.second->isAllConcrete() &&
+      !op.second->hasPendingChunks() &&
+      readConcreteString(state, arguments[2], path)) {
+    ObjectState *wos = state.addressSpace.getWriteable(op.first, op.second);
+    mapped = wos->mapFile(path);
+  }
+  executor.bindLocal(target, state,
+                     mapped ? ref<Expr>(ConstantExpr::create(
+                                  0, arguments[1]->getWidth()))
+                            : arguments[1]);
+}
+
+/* Native handlers */
+
+bool SpecialFunctionHandler::nativeMemcpy(ExecutionState &state,
+                                          KInstruction *target,
+                                          std::vector<ref<Expr> > &arguments) {
+  ConstantExpr *length = dyn_cast<ConstantExpr>(arguments[2]);
+  if (!length)
+    return false;
+  if (!copyConstantRange(state, target, arguments[0], arguments[1],
+                         length->getZExtValue()))
+    return false;
+  executor.bindLocal(target, state, arguments[0]);
+  return true;
+}
+
+bool SpecialFunctionHandler::nativeMemset(ExecutionState &state,
+                                          KInstruction *target,
+                                          std::vector<ref<Expr> > &arguments) {
+  ConstantExpr *length = dyn_cast<ConstantExpr>(arguments[2]);
+  if (!length)
+    return false;
+  uint64_t n = length->getZExtValue();
+  ObjectPair dst;
+  unsigned offset;
+  if (!resolveConstantRange(state, arguments[0], n, dst, offset) ||
+      dst.second->readOnly)
+    return false;
+
+  ObjectState *wos = state.addressSpace.getWriteable(dst.first, dst.second);
+  wos->fill(offset, ExtractExpr::create(arguments[1], 0, Expr::Int8), n,
+            Expr::FLAG_INSTRUCTION_ROOT, target);
+  executor.bindLocal(target, state, arguments[0]);
+  return true;
+}
+
+bool SpecialFunctionHandler::nativeStrcmp(ExecutionState &state,
+                                          KInstruction *target,
+                                          std::vector<ref<Expr> > &arguments) {
+  std::string a, b;
+  if (!readConcreteString(state, arguments[0], a) ||
+      !readConcreteString(state, arguments[1], b))
+    return false;
+
+  // As the C library does, the difference of the first differing bytes
+  unsigned i = 0;
+  while (i < a.size() && i < b.size() && a[i] == b[i])
+    ++i;
+  int result = (i < a.size() ? (unsigned char)a[i] : 0) -
+               (i < b.size() ? (unsigned char)b[i] : 0);
+  Expr::Width width = executor.getWidthForLLVMType(target->inst->getType());
+  executor.bindLocal(target, state, ConstantExpr::create(result, width));
+  return true;
+}
+
+bool SpecialFunctionHandler::nativeStrlen(ExecutionState &state,
+                                          KInstruction *target,
+                                          std::vector<ref<Expr> > &arguments) {
+  std::string s;
+  if (!readConcreteString(state, arguments[0], s))
+    return false;
+
+  Expr::Width width = executor.getWidthForLLVMType(target->inst->getType());
+  executor.bindLocal(target, state, ConstantExpr::create(s.size(), width));
+  return true;
+}
+
+/// The address of the field at offset of the runtime data at base
+static ref<Expr> fieldAddress(uint64_t base, unsigned offset) {
+  return klee::ConstantExpr::create(base + offset,
+                                    Context::get().getPointerWidth());
+}
+
+/// Wake one (the first) or all threads of wlist, as klee_thread_notify does
+static void notifyThreads(ExecutionState &state, wlist_id_t wlist, bool all) {
+  thread_uid_t tuid;
+  if (all)
+    state.notifyAll(wlist);
+  else if (state.getFirstWaiting(wlist, tuid))
+    state.notifyOne(wlist, tuid);
+}
+
+// The handlers below follow runtime/POSIX/threadsync.c, including its
+// __thread_preempt(0) after a successful call, so that they schedule (and
+// record or replay SCHEDULE entries) where it does. They decline whenever
+// the interpreted function would wait or fail.
+
+bool SpecialFunctionHandler::nativeMutexLock(
+    ExecutionState &state, KInstruction *target,
+    std::vector<ref<Expr> > &arguments) {
+  Expr::Width ptrWidth = Context::get().getPointerWidth();
+  uint64_t mdata, taken, owner, count, queued;
+  if (!readConstant(state, arguments[0], ptrWidth, mdata) || !mdata ||
+      !readConstant(state, fieldAddress(mdata, syncLayout.mutexTaken),
+                    Expr::Int8, taken) ||
+      !readConstant(state, fieldAddress(mdata, syncLayout.mutexOwner),
+                    Expr::Int32, owner) ||
+      !readConstant(state, fieldAddress(mdata, syncLayout.mutexCount),
+                    Expr::Int32, count) ||
+      !readConstant(state, fieldAddress(mdata, syncLayout.mutexQueued),
+                    Expr::Int32, queued))
+    return false;
+
+  uint32_t self = state.crtThread().getTid();
+  int32_t recursion = count;
+  if (taken && recursion >= 0 && owner == self) {
+    writeConstant(state, target, fieldAddress(mdata, syncLayout.mutexCount),
+                  recursion + 1, Expr::Int32);
+  } else if (queued || taken) {
+    return false;
+  } else {
+    writeConstant(state, target, fieldAddress(mdata, syncLayout.mutexTaken),
+                  1, Expr::Int8);
+    writeConstant(state, target, fieldAddress(mdata, syncLayout.mutexOwner),
+                  self, Expr::Int32);
+    if (recursion != -1)
+      writeConstant(state, target, fieldAddress(mdata, syncLayout.mutexCount),
+                    1, Expr::Int32);
+  }
+
+  executor.bindLocal(
+      target, state,
+      ConstantExpr::create(
+          0, executor.getWidthForLLVMType(target->inst->getType())));
+  executor.schedule(state, false);
+  return true;
+}
+
+bool SpecialFunctionHandler::nativeMutexUnlock(
+    ExecutionState &state, KInstruction *target,
+    std::vector<ref<Expr> > &arguments) {
+  Expr::Width ptrWidth = Context::get().getPointerWidth();
+  uint64_t mdata, wlist, taken, owner, count, queued;
+  if (!readConstant(state, arguments[0], ptrWidth, mdata) || !mdata ||
+      !readConstant(state, fieldAddress(mdata, 0), Expr::Int64, wlist) ||
+      !readConstant(state, fieldAddress(mdata, syncLayout.mutexTaken),
+                    Expr::Int8, taken) ||
+      !readConstant(state, fieldAddress(mdata, syncLayout.mutexOwner),
+                    Expr::Int32, owner) ||
+      !readConstant(state, fieldAddress(mdata, syncLayout.mutexCount),
+                    Expr::Int32, count) ||
+      !readConstant(state, fieldAddress(mdata, syncLayout.mutexQueued),
+                    Expr::Int32, queued))
+    return false;
+
+  uint32_t self = state.crtThread().getTid();
+  int32_t recursion = count;
+  if (!taken || owner != self)
+    return false;
+  bool release = true;
+  if (recursion > 0) {
+    writeConstant(state, target, fieldAddress(mdata, syncLayout.mutexCount),
+                  recursion - 1, Expr::Int32);
+    release = recursion == 1;
+  }
+  if (release) {
+    writeConstant(state, target, fieldAddress(mdata, syncLayout.mutexTaken),
+                  0, Expr::Int8);
+    if (queued)
+      notifyThreads(state, wlist, false);
+  }
+
+  executor.bindLocal(
+      target, state,
+      ConstantExpr::create(
+          0, executor.getWidthForLLVMType(target->inst->getType())));
+  executor.schedule(state, false);
+  return true;
+}
+
+bool SpecialFunctionHandler::condNotify(ExecutionState &state,
+                                        KInstruction *target,
+                                        ref<Expr> cond, bool all) {
+  Expr::Width ptrWidth = Context::get().getPointerWidth();
+  uint64_t cdata, wlist, queued;
+  if (!readConstant(state, cond, ptrWidth, cdata) || !cdata ||
+      !readConstant(state, fieldAddress(cdata, 0), Expr::Int64, wlist) ||
+      !readConstant(state, fieldAddress(cdata, syncLayout.condQueued),
+                    Expr::Int32, queued))
+    return false;
+
+  if (queued)
+    notifyThreads(state, wlist, all);
+
+  executor.bindLocal(
+      target, state,
+      ConstantExpr::create(
+          0, executor.getWidthForLLVMType(target->inst->getType())));
+  executor.schedule(state, false);
+  return true;
+}
+
+bool SpecialFunctionHandler::nativeCondSignal(
+    ExecutionState &state, KInstruction *target,
+    std::vector<ref<Expr> > &arguments) {
+  return condNotify(state, target, arguments[0], false);
+}
+
+bool SpecialFunctionHandler::nativeCondBroadcast(
+    ExecutionState &state, KInstruction *target,
+    std::vector<ref<Expr> > &arguments) {
+  return condNotify(state, target, arguments[0], true);
+}
+
+bool SpecialFunctionHandler::nativeBarrierWait(
+    ExecutionState &state, KInstruction *target,
+    std::vector<ref<Expr> > &arguments) {
+  Expr::Width ptrWidth = Context::get().getPointerWidth();
+  uint64_t bdata, wlist, currEvent, left, initCount;
+  if (!readConstant(state, arguments[0], ptrWidth, bdata) || !bdata ||
+      !readConstant(state, fieldAddress(bdata, 0), Expr::Int64, wlist) ||
+      !readConstant(state, fieldAddress(bdata, syncLayout.barrierCurrEvent),
+                    Expr::Int32, currEvent) ||
+      !readConstant(state, fieldAddress(bdata, syncLayout.barrierLeft),
+                    Expr::Int32, left) ||
+      !readConstant(state, fieldAddress(bdata, syncLayout.barrierInitCount),
+                    Expr::Int32, initCount))
+    return false;
+
+  Expr::Width width = executor.getWidthForLLVMType(target->inst->getType());
+  uint32_t remaining = left - 1;
+  if (remaining == 0) {
+    writeConstant(state, target,
+                  fieldAddress(bdata, syncLayout.barrierCurrEvent),
+                  currEvent + 1, Expr::Int32);
+    writeConstant(state, target, fieldAddress(bdata, syncLayout.barrierLeft),
+                  initCount, Expr::Int32);
+    notifyThreads(state, wlist, true);
+    // PTHREAD_BARRIER_SERIAL_THREAD
+    executor.bindLocal(target, state, ConstantExpr::create(-1, width));
+  } else {
+    writeConstant(state, target, fieldAddress(bdata, syncLayout.barrierLeft),
+                  remaining, Expr::Int32);
+    executor.bindLocal(target, state, ConstantExpr::create(0, width));
+    state.sleepThread(wlist);
+    executor.schedule(state, false);
+  }
+  return true;
+}
@@ -10,6 +10,7 @@
 #ifndef KLEE_SPECIALFUNCTIONHANDLER_H
 #define KLEE_SPECIALFUNCTIONHANDLER_H
 
+#include <cstdint>
 #include <iterator>
 #include <map>
 #include <vector>
@@ -24,7 +25,10 @@ namespace klee {
   class Expr;
   class ExecutionState;
   struct KInstruction;
+  class MemoryObject;
+  class ObjectState;
   template<typename T> class ref;
+  typedef std::pair<const MemoryObject*, const ObjectState*> ObjectPair;
   
   class SpecialFunctionHandler {
   public:
@@ -35,9 +39,27 @@ namespace klee {
     typedef std::map<const llvm::Function*, 
                      std::pair<Handler,bool> > handlers_ty;
 
+    /// A native implementation of a libc function. Returns false, without
+    /// changing the state, if it cannot handle the call, in which case the
+    /// function is called as usual.
+    typedef bool (SpecialFunctionHandler::*NativeHandler)(
+        ExecutionState &state, KInstruction *target,
+        std::vector<ref<Expr> > &arguments);
+    typedef std::map<const llvm::Function*, NativeHandler> native_handlers_ty;
+
     handlers_ty handlers;
+    native_handlers_ty nativeHandlers;
     class Executor &executor;
 
+    /// Byte offsets of the fields of the POSIX runtime's synchronization
+    /// data (runtime/POSIX/multiprocess.h) that the native handlers use.
+    /// The waiting list of each is at offset 0.
+    struct SyncLayout {
+      unsigned mutexTaken, mutexOwner, mutexCount, mutexQueued;
+      unsigned condQueued;
+      unsigned barrierCurrEvent, barrierLeft, barrierInitCount;
+    } syncLayout;
+
     struct HandlerInfo {
       const char *name;
       SpecialFunctionHandler::Handler handler;
@@ -91,9 +113,50 @@ namespace klee {
                 KInstruction *target,
                 std::vector< ref<Expr> > &arguments);
 
+    /// Run f natively on the object states, instead of interpreting its
+    /// body or calling it externally, if it has a native handler and the
+    /// call is off the recorded path, so that recording and replaying see
+    /// the same branches either way.
+    /// \return true iff the call was handled.
+    bool handleNative(ExecutionState &state,
+                      llvm::Function *f,
+                      KInstruction *target,
+                      std::vector< ref<Expr> > &arguments);
+
     /* Convenience routines */
 
     std::string readStringAtAddress(ExecutionState &state, ref<Expr> address);
+
+    /// Resolve the constant range [address, address + length) to the object
+    /// holding all of it and the offset of address in that object.
+    /// \return false if the address is symbolic or the range is not within
+    /// one object.
+    bool resolveConstantRange(ExecutionState &state, ref<Expr> address,
+                              uint64_t length, ObjectPair &op,
+                              unsigned &offset);
+
+    /// Read the concrete NUL-terminated string at address into result.
+    /// \return false if it has symbolic bytes or is not terminated within
+    /// its object.
+    /// Copy length bytes from the constant address src to the constant
+    /// address dest on the object states, as memmove does.
+    /// \return false, without changing the state, if a range is not within
+    /// one object or dest is read-only.
+    bool copyConstantRange(ExecutionState &state, KInstruction *target,
+                           ref<Expr> dest, ref<Expr> src, uint64_t length);
+
+    /// Read the concrete width bits at the constant address into value.
+    /// \return false if they are symbolic or not within one object.
+    bool readConstant(ExecutionState &state, ref<Expr> address,
+                      unsigned width, uint64_t &value);
+
+    /// Write value, width bits wide, to the constant address.
+    /// \return false if it is not within a writeable object.
+    bool writeConstant(ExecutionState &state, KInstruction *target,
+                       ref<Expr> address, uint64_t value, unsigned width);
+
+    bool readConcreteString(ExecutionState &state, ref<Expr> address,
+                            std::string &result);
     
     /* Handlers */
 
@@ -119,6 +182,7 @@ namespace klee {
     HANDLER(handleMustNotBeSymbolic);
     HANDLER(handleMustNotBeSymbolicStr);
     HANDLER(handleMakeSymbolic);
+    HANDLER(handleMakeSymbolicBatch);
     HANDLER(handleMalloc);
     HANDLER(handleMallocUsableSize);
     HANDLER(handleMemalign);
@@ -153,15 +217,37 @@ namespace klee {
     HANDLER(handleThreadPreempt);
     HANDLER(handleThreadSleep);
     HANDLER(handleThreadNotify);
-    /* Process Management Placeholder */
+    /* Process Management */
     HANDLER(handleProcessFork);
     HANDLER(handleProcessTerminate);
-    /* Shared Memory Placeholder */
+    HANDLER(handleProcessWait);
+    /* Shared Memory */
     HANDLER(handleMakeShared);
     /* Misc */
     HANDLER(handleGetTime);
     HANDLER(handleSetTime);
+    HANDLER(handleCopyMemory);
+    HANDLER(handleMapFile);
 #undef HANDLER
+
+    /* Native handlers */
+
+#define NATIVE_HANDLER(name) bool name(ExecutionState &state, \
+                                       KInstruction *target, \
+                                       std::vector< ref<Expr> > &arguments)
+    NATIVE_HANDLER(nativeMemcpy);
+    NATIVE_HANDLER(nativeMemset);
+    NATIVE_HANDLER(nativeStrcmp);
+    NATIVE_HANDLER(nativeStrlen);
+    NATIVE_HANDLER(nativeMutexLock);
+    NATIVE_HANDLER(nativeMutexUnlock);
+    NATIVE_HANDLER(nativeCondSignal);
+    NATIVE_HANDLER(nativeCondBroadcast);
+    NATIVE_HANDLER(nativeBarrierWait);
+#undef NATIVE_HANDLER
+
+    bool condNotify(ExecutionState &state, KInstruction *target,
+                    ref<Expr> cond, bool all);
   };
 } // End klee namespace
 
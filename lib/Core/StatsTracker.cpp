@@ -15,6 +15,7 @@
 #include "klee/Internal/Module/InstructionInfoTable.h"
 #include "klee/Internal/Module/KModule.h"
 #include "klee/Internal/Module/KInstruction.h"
+#include "klee/Internal/Support/ColumnarStats.h"
 #include "klee/Internal/Support/ModuleUtil.h"
 #include "klee/Internal/System/MemoryUsage.h"
 #include "klee/Internal/Support/ErrorHandling.h"
@@ -41,8 +42,12 @@
 #include "llvm/Support/Path.h"
 #include "llvm/Support/Process.h"
 
+#include <chrono>
 #include <fstream>
 #include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 using namespace klee;
 using namespace llvm;
@@ -60,6 +65,14 @@ cl::opt<bool> TrackInstructionTime(
         "Enable tracking of time for individual instructions (default=false)"),
     cl::cat(StatsCat));
 
+cl::opt<bool> TrackInstructionCycles(
+    "track-instruction-cycles", cl::init(false),
+    cl::desc("Count the cycles (the time stamp counter on x86, a steady "
+             "clock elsewhere) spent at each instruction, including its "
+             "solver queries, in the Icyc column of run.istats. Much "
+             "cheaper than --track-instruction-time (default=false)"),
+    cl::cat(StatsCat));
+
 cl::opt<bool>
     OutputStats("output-stats", cl::init(true),
                 cl::desc("Write running stats trace file (default=true)"),
@@ -70,6 +83,20 @@ cl::opt<bool> OutputIStats("output-istats", cl::init(true),
                                     "callgrind format (default=true)"),
                            cl::cat(StatsCat));
 
+enum class StatsFormat { SQLite, Columnar };
+
+cl::opt<StatsFormat> OutputStatsFormat(
+    "stats-format", cl::init(StatsFormat::SQLite),
+    cl::desc("Format of the running stats trace (default=sqlite)"),
+    cl::values(clEnumValN(StatsFormat::SQLite, "sqlite",
+                          "SQLite database run.stats"),
+               clEnumValN(StatsFormat::Columnar, "columnar",
+                          "Append-only run.stats.col, one compressed block "
+                          "of delta-encoded columns every "
+                          "-stats-commit-after rows (see klee-stats)")
+                   KLEE_LLVM_CL_VAL_END),
+    cl::cat(StatsCat));
+
 cl::opt<std::string> StatsWriteInterval(
     "stats-write-interval", cl::init("1s"),
     cl::desc("Approximate time between stats writes (default=1s)"),
@@ -111,10 +138,27 @@ cl::opt<bool> UseCallPaths("use-call-paths", cl::init(true),
                                     "level statistics (default=true)"),
                            cl::cat(StatsCat));
 
+cl::opt<unsigned> CallPathMaxDepth(
+    "call-path-max-depth", cl::init(0),
+    cl::desc("Attribute the calls deeper than this to the closest call "
+             "path of the same function, or else to the caller, instead of "
+             "new call paths. Bounds the memory of --use-call-paths under "
+             "deep mutual recursion (default=0, no limit)"),
+    cl::cat(StatsCat));
+
 } // namespace
 
 ///
 
+/// A cheap, monotonic enough tick count
+static inline uint64_t readCycleCounter() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
 bool StatsTracker::useStatistics() {
   return OutputStats || OutputIStats;
 }
@@ -162,6 +206,7 @@ StatsTracker::StatsTracker(Executor &_executor, std::string _objectFilename,
     numBranches(0),
     fullBranches(0),
     partialBranches(0),
+    callPathManager(CallPathMaxDepth),
     updateMinDistToUncovered(_updateMinDistToUncovered) {
 
   const time::Span statsWriteInterval(StatsWriteInterval);
@@ -219,48 +264,7 @@ StatsTracker::StatsTracker(Executor &_executor, std::string _objectFilename,
   }
 
   if (OutputStats) {
-    sqlite3_config(SQLITE_CONFIG_SINGLETHREAD);
-    sqlite3_enable_shared_cache(0);
-
-    // open database
-    auto db_filename = executor.interpreterHandler->getOutputFilename("run.stats");
-    if (sqlite3_open(db_filename.c_str(), &statsFile) != SQLITE_OK) {
-      std::ostringstream errorstream;
-      errorstream << "Can't open database: " << sqlite3_errmsg(statsFile);
-      sqlite3_close(statsFile);
-      klee_error("%s", errorstream.str().c_str());
-    }
-
-    // prepare statements
-    if (sqlite3_prepare_v2(statsFile, "BEGIN TRANSACTION", -1, &transactionBeginStmt, nullptr) != SQLITE_OK) {
-      klee_error("Cannot create prepared statement: %s", sqlite3_errmsg(statsFile));
-    }
-
-    if (sqlite3_prepare_v2(statsFile, "END TRANSACTION", -1, &transactionEndStmt, nullptr) != SQLITE_OK) {
-      klee_error("Cannot create prepared statement: %s", sqlite3_errmsg(statsFile));
-    }
-
-    // set options
-    char *zErrMsg;
-    if (sqlite3_exec(statsFile, "PRAGMA synchronous = OFF", nullptr, nullptr, &zErrMsg) != SQLITE_OK) {
-      klee_error("%s", sqlite3ErrToStringAndFree("Can't set options for database: ", zErrMsg).c_str());
-    }
-
-    // note: we use WAL here a) for speed and b) to prevent creation of new file descriptors (as with TRUNCATE)
-    if (sqlite3_exec(statsFile, "PRAGMA journal_mode = WAL", nullptr, nullptr, &zErrMsg) != SQLITE_OK) {
-      klee_error("%s", sqlite3ErrToStringAndFree("Can't set options for database: ", zErrMsg).c_str());
-    }
-
-    // create table
-    writeStatsHeader();
-
-    // begin transaction
-    auto rc = sqlite3_step(transactionBeginStmt);
-    if (rc != SQLITE_DONE) {
-      klee_warning("Can't begin transaction: %s", sqlite3_errmsg(statsFile));
-    }
-    sqlite3_reset(transactionBeginStmt);
-
+    openStatsFile();
     writeStatsLine();
 
     if (statsWriteInterval)
@@ -278,16 +282,88 @@ StatsTracker::StatsTracker(Executor &_executor, std::string _objectFilename,
   }
 
   if (OutputIStats) {
-    istatsFile = executor.interpreterHandler->openOutputFile("run.istats");
-    if (istatsFile) {
-      if (iStatsWriteInterval)
-        executor.timers.add(std::make_unique<Timer>(iStatsWriteInterval, [&]{
-          writeIStats();
-        }));
-    } else {
-      klee_error("Unable to open instruction level stats file (run.istats).");
-    }
+    openIStatsFile();
+    if (iStatsWriteInterval)
+      executor.timers.add(std::make_unique<Timer>(iStatsWriteInterval, [&]{
+        writeIStats();
+      }));
+  }
+}
+
+void StatsTracker::openStatsFile() {
+  if (OutputStatsFormat == StatsFormat::Columnar) {
+    auto os = executor.interpreterHandler->openOutputFile("run.stats.col");
+    if (!os)
+      klee_error("Unable to open stats file (run.stats.col).");
+    columnarStats =
+        std::make_unique<ColumnarStatsWriter>(std::move(os), statsColumns());
+    return;
+  }
+
+  sqlite3_config(SQLITE_CONFIG_SINGLETHREAD);
+  sqlite3_enable_shared_cache(0);
+
+  // open database
+  auto db_filename = executor.interpreterHandler->getOutputFilename("run.stats");
+  if (sqlite3_open(db_filename.c_str(), &statsFile) != SQLITE_OK) {
+    std::ostringstream errorstream;
+    errorstream << "Can't open database: " << sqlite3_errmsg(statsFile);
+    sqlite3_close(statsFile);
+    klee_error("%s", errorstream.str().c_str());
+  }
+
+  // prepare statements
+  if (sqlite3_prepare_v2(statsFile, "BEGIN TRANSACTION", -1, &transactionBeginStmt, nullptr) != SQLITE_OK) {
+    klee_error("Cannot create prepared statement: %s", sqlite3_errmsg(statsFile));
+  }
+
+  if (sqlite3_prepare_v2(statsFile, "END TRANSACTION", -1, &transactionEndStmt, nullptr) != SQLITE_OK) {
+    klee_error("Cannot create prepared statement: %s", sqlite3_errmsg(statsFile));
   }
+
+  // set options
+  char *zErrMsg;
+  if (sqlite3_exec(statsFile, "PRAGMA synchronous = OFF", nullptr, nullptr, &zErrMsg) != SQLITE_OK) {
+    klee_error("%s", sqlite3ErrToStringAndFree("Can't set options for database: ", zErrMsg).c_str());
+  }
+
+  // note: we use WAL here a) for speed and b) to prevent creation of new file descriptors (as with TRUNCATE)
+  if (sqlite3_exec(statsFile, "PRAGMA journal_mode = WAL", nullptr, nullptr, &zErrMsg) != SQLITE_OK) {
+    klee_error("%s", sqlite3ErrToStringAndFree("Can't set options for database: ", zErrMsg).c_str());
+  }
+
+  // create table
+  writeStatsHeader();
+
+  // begin transaction
+  auto rc = sqlite3_step(transactionBeginStmt);
+  if (rc != SQLITE_DONE) {
+    klee_warning("Can't begin transaction: %s", sqlite3_errmsg(statsFile));
+  }
+  sqlite3_reset(transactionBeginStmt);
+}
+
+void StatsTracker::openIStatsFile() {
+  istatsFile = executor.interpreterHandler->openOutputFile("run.istats");
+  if (!istatsFile)
+    klee_error("Unable to open instruction level stats file (run.istats).");
+}
+
+void StatsTracker::startWorker() {
+  // The database and files belong to the parent process, which is still
+  // writing them: leave them, and their buffers, alone.
+  statsFile = nullptr;
+  transactionBeginStmt = transactionEndStmt = insertStmt = nullptr;
+  columnarStats.release();
+  istatsFile.release();
+  statsWriteCount = 0;
+
+  if (OutputStats) {
+    openStatsFile();
+    writeStatsLine();
+  }
+  if (OutputIStats)
+    openIStatsFile();
 }
 
 StatsTracker::~StatsTracker() {  
@@ -305,8 +381,10 @@ StatsTracker::~StatsTracker() {
 }
 
 void StatsTracker::done() {
-  if (statsFile)
+  if (statsFile || columnarStats)
     writeStatsLine();
+  if (columnarStats)
+    columnarStats->flush();
 
   if (OutputIStats) {
     if (updateMinDistToUncovered)
@@ -336,6 +414,15 @@ void StatsTracker::stepInstruction(ExecutionState &es) {
       }
     }
 
+    if (TrackInstructionCycles) {
+      // the ticks since the last step go to the instruction stepped then,
+      // whose index is still set
+      const uint64_t now = readCycleCounter();
+      if (lastCycles)
+        stats::instructionCycles += now - lastCycles;
+      lastCycles = now;
+    }
+
     Instruction *inst = es.pc()->inst;
     const InstructionInfo &ii = *es.pc()->info;
     StackFrame &sf = es.stack().back();
@@ -353,16 +440,18 @@ void StatsTracker::stepInstruction(ExecutionState &es) {
         //
         // FIXME: This trick no longer works, we should fix this in the line
         // number propogation.
-          es.coveredLines[&ii.file].insert(ii.line);
+          es.coveredInstructions.push_back(&ii);
 	es.coveredNew = true;
         es.instsSinceCovNew = 1;
 	++stats::coveredInstructions;
 	stats::uncoveredInstructions += (uint64_t)-1;
+        if (updateMinDistToUncovered)
+          coverageChangedFunctions.insert(sf.kf->function);
       }
     }
   }
 
-  if (statsFile && StatsWriteAfterInstructions &&
+  if ((statsFile || columnarStats) && StatsWriteAfterInstructions &&
       stats::instructions % StatsWriteAfterInstructions.getValue() == 0)
     writeStatsLine();
 
@@ -371,6 +460,11 @@ void StatsTracker::stepInstruction(ExecutionState &es) {
     writeIStats();
 }
 
+bool StatsTracker::stepsEachInstruction() {
+  return OutputIStats || StatsWriteAfterInstructions ||
+         IStatsWriteAfterInstructions;
+}
+
 ///
 
 /* Should be called _after_ the es->pushFrame() */
@@ -429,6 +523,11 @@ void StatsTracker::markBranchVisited(ExecutionState *visitedTrue,
   }
 }
 
+/// The column of the bytes of the i-th util::MemoryTag, e.g. ExprMemory
+static std::string memoryColumn(unsigned i) {
+  return std::string(util::GetMemoryTagName((util::MemoryTag)i)) + "Memory";
+}
+
 void StatsTracker::writeStatsHeader() {
   std::ostringstream create, insert;
   create << "CREATE TABLE stats ";
@@ -454,8 +553,10 @@ void StatsTracker::writeStatsHeader() {
 #ifdef KLEE_ARRAY_DEBUG
 	           << "ArrayHashTime INTEGER,"
 #endif
-             << "QueryCexCacheHits INTEGER"
-             << ")";
+             << "QueryCexCacheHits INTEGER";
+  for (unsigned i = 0; i < util::NumMemoryTags; ++i)
+    create << "," << memoryColumn(i) << " INTEGER";
+  create << ")";
   char *zErrMsg = nullptr;
   if(sqlite3_exec(statsFile, create.str().c_str(), nullptr, nullptr, &zErrMsg)) {
     klee_error("%s", sqlite3ErrToStringAndFree("ERROR creating table: ", zErrMsg).c_str());
@@ -490,8 +591,10 @@ void StatsTracker::writeStatsHeader() {
 #ifdef KLEE_ARRAY_DEBUG
              << "ArrayHashTime,"
 #endif
-             << "QueryCexCacheHits "
-             << ") VALUES ( "
+             << "QueryCexCacheHits ";
+  for (unsigned i = 0; i < util::NumMemoryTags; ++i)
+    insert << ", " << memoryColumn(i);
+  insert << ") VALUES ( "
              << "?, "
              << "?, "
              << "?, "
@@ -514,8 +617,10 @@ void StatsTracker::writeStatsHeader() {
 #ifdef KLEE_ARRAY_DEBUG
              << "?, "
 #endif
-             << "? "
-             << ")";
+             << "? ";
+  for (unsigned i = 0; i < util::NumMemoryTags; ++i)
+    insert << ", ?";
+  insert << ")";
 
   if(sqlite3_prepare_v2(statsFile, insert.str().c_str(), -1, &insertStmt, nullptr) != SQLITE_OK) {
     klee_error("Cannot create prepared statement: %s", sqlite3_errmsg(statsFile));
@@ -526,7 +631,79 @@ time::Span StatsTracker::elapsed() {
   return time::getWallTime() - startWallTime;
 }
 
+std::vector<std::string> StatsTracker::statsColumns() {
+  std::vector<std::string> columns = {"Instructions",
+          "FullBranches",
+          "PartialBranches",
+          "NumBranches",
+          "UserTime",
+          "NumStates",
+          "MallocUsage",
+          "NumQueries",
+          "NumQueryConstructs",
+          "NumObjects",
+          "WallTime",
+          "CoveredInstructions",
+          "UncoveredInstructions",
+          "QueryTime",
+          "SolverTime",
+          "CexCacheTime",
+          "ForkTime",
+          "ResolveTime",
+          "QueryCexCacheMisses",
+          "QueryCexCacheHits",
+#ifdef KLEE_ARRAY_DEBUG
+          "ArrayHashTime",
+#endif
+  };
+  for (unsigned i = 0; i < util::NumMemoryTags; ++i)
+    columns.push_back(memoryColumn(i));
+  return columns;
+}
+
+void StatsTracker::writeColumnarStatsLine() {
+  std::vector<int64_t> values = {
+      (int64_t)stats::instructions,
+      fullBranches,
+      partialBranches,
+      numBranches,
+      time::getUserTime().toMicroseconds(),
+      (int64_t)executor.states.size(),
+      (int64_t)(util::GetTotalMallocUsage() +
+                executor.memory->getUsedDeterministicSize()),
+      (int64_t)stats::queries,
+      (int64_t)stats::queryConstructs,
+      0, // was numObjects
+      elapsed().toMicroseconds(),
+      (int64_t)stats::coveredInstructions,
+      (int64_t)stats::uncoveredInstructions,
+      (int64_t)stats::queryTime,
+      (int64_t)stats::solverTime,
+      (int64_t)stats::cexCacheTime,
+      (int64_t)stats::forkTime,
+      (int64_t)stats::resolveTime,
+      (int64_t)stats::queryCexCacheMisses,
+      (int64_t)stats::queryCexCacheHits,
+#ifdef KLEE_ARRAY_DEBUG
+      (int64_t)stats::arrayHashTime,
+#endif
+  };
+  for (unsigned i = 0; i < util::NumMemoryTags; ++i)
+    values.push_back(util::GetTaggedMemoryUsage((util::MemoryTag)i));
+  columnarStats->append(values);
+
+  if (++statsWriteCount == statsCommitEvery) {
+    columnarStats->flush();
+    statsWriteCount = 0;
+  }
+}
+
 void StatsTracker::writeStatsLine() {
+  if (columnarStats) {
+    writeColumnarStatsLine();
+    return;
+  }
+
   sqlite3_bind_int64(insertStmt, 1, stats::instructions);
   sqlite3_bind_int64(insertStmt, 2, fullBranches);
   sqlite3_bind_int64(insertStmt, 3, partialBranches);
@@ -547,9 +724,13 @@ void StatsTracker::writeStatsLine() {
   sqlite3_bind_int64(insertStmt, 18, stats::resolveTime);
   sqlite3_bind_int64(insertStmt, 19, stats::queryCexCacheMisses);
   sqlite3_bind_int64(insertStmt, 20, stats::queryCexCacheHits);
+  int column = 21;
 #ifdef KLEE_ARRAY_DEBUG
-  sqlite3_bind_int64(insertStmt, 21, stats::arrayHashTime);
+  sqlite3_bind_int64(insertStmt, column++, stats::arrayHashTime);
 #endif
+  for (unsigned i = 0; i < util::NumMemoryTags; ++i)
+    sqlite3_bind_int64(insertStmt, column++,
+                       util::GetTaggedMemoryUsage((util::MemoryTag)i));
   int errCode = sqlite3_step(insertStmt);
   if(errCode != SQLITE_DONE) klee_error("Error writing stats data: %s", sqlite3_errmsg(statsFile));
   sqlite3_reset(insertStmt);
@@ -605,6 +786,7 @@ void StatsTracker::writeIStats() {
   istatsMask.set(sm.getStatisticID("Instructions"));
   istatsMask.set(sm.getStatisticID("InstructionTimes"));
   istatsMask.set(sm.getStatisticID("InstructionRealTimes"));
+  istatsMask.set(sm.getStatisticID("InstructionCycles"));
   istatsMask.set(sm.getStatisticID("Forks"));
   istatsMask.set(sm.getStatisticID("CoveredInstructions"));
   istatsMask.set(sm.getStatisticID("UncoveredInstructions"));
@@ -666,7 +848,7 @@ void StatsTracker::writeIStats() {
             of << "fl=" << ii.file << "\n";
             sourceFile = ii.file;
           }
-          of << ii.assemblyLine << " ";
+          of << ii.getAssemblyLine() << " ";
           of << ii.line << " ";
           for (unsigned i=0; i<nStats; i++)
             if (istatsMask.test(i))
@@ -688,10 +870,10 @@ void StatsTracker::writeIStats() {
                   of << "cfl=" << fii.file << "\n";
                 of << "cfn=" << f->getName().str() << "\n";
                 of << "calls=" << csi.count << " ";
-                of << fii.assemblyLine << " ";
+                of << fii.getAssemblyLine() << " ";
                 of << fii.line << "\n";
 
-                of << ii.assemblyLine << " ";
+                of << ii.getAssemblyLine() << " ";
                 of << ii.line << " ";
                 for (unsigned i=0; i<nStats; i++) {
                   if (istatsMask.test(i)) {
@@ -751,6 +933,12 @@ static std::vector<Instruction*> getSuccs(Instruction *i) {
   return res;
 }
 
+static uint64_t minDistToUncoveredGeneration = 0;
+
+uint64_t klee::getMinDistToUncoveredGeneration() {
+  return minDistToUncoveredGeneration;
+}
+
 uint64_t klee::computeMinDistToUncovered(const KInstruction *ki,
                                          uint64_t minDistAtRA) {
   StatisticManager &sm = *theStatisticManager;
@@ -911,10 +1099,38 @@ void StatsTracker::computeReachableUncovered() {
     } while (changed);
   }
 
-  // compute minDistToUncovered, 0 is unreachable
+  // compute minDistToUncovered, 0 is unreachable.
+  //
+  // The distances in a function only depend on its own instructions and on
+  // the entries of its callees, so only the functions whose coverage changed
+  // since the last pass and, transitively, their callers are recomputed. The
+  // other functions call none of them and keep their distances. All the
+  // affected functions start over together, so that no stale distance is
+  // carried around a recursive cycle.
+  std::set<Function *> affected;
+  if (!reachableUncoveredComputed) {
+    reachableUncoveredComputed = true;
+    for (Function &fn : *m)
+      affected.insert(&fn);
+  } else {
+    std::vector<Function *> worklist(coverageChangedFunctions.begin(),
+                                     coverageChangedFunctions.end());
+    while (!worklist.empty()) {
+      Function *f = worklist.back();
+      worklist.pop_back();
+      if (!affected.insert(f).second)
+        continue;
+      for (Instruction *caller : functionCallers[f])
+        worklist.push_back(caller->getParent()->getParent());
+    }
+  }
+  coverageChangedFunctions.clear();
+
   std::vector<Instruction *> instructions;
   for (Module::iterator fnIt = m->begin(), fn_ie = m->end(); 
        fnIt != fn_ie; ++fnIt) {
+    if (!affected.count(&*fnIt))
+      continue;
     // Not sure if I should bother to preorder here.
     for (Function::iterator bbIt = fnIt->begin(), bb_ie = fnIt->end(); 
          bbIt != bb_ie; ++bbIt) {
@@ -1011,4 +1227,5 @@ void StatsTracker::computeReachableUncovered() {
       currentFrameMinDist = computeMinDistToUncovered(kii, currentFrameMinDist);
     }
   }
+  ++minDistToUncoveredGeneration;
 }
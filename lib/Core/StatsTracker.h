@@ -16,6 +16,8 @@
 #include <memory>
 #include <set>
 #include <sqlite3.h>
+#include <string>
+#include <vector>
 
 namespace llvm {
   class BranchInst;
@@ -25,6 +27,7 @@ namespace llvm {
 }
 
 namespace klee {
+  class ColumnarStatsWriter;
   class ExecutionState;
   class Executor;
   class InstructionInfoTable;
@@ -44,6 +47,8 @@ namespace klee {
     ::sqlite3_stmt *transactionBeginStmt = nullptr;
     ::sqlite3_stmt *transactionEndStmt = nullptr;
     ::sqlite3_stmt *insertStmt = nullptr;
+    /// Instead of statsFile with --stats-format=columnar
+    std::unique_ptr<ColumnarStatsWriter> columnarStats;
     std::uint32_t statsCommitEvery;
     std::uint32_t statsWriteCount = 0;
     time::Point startWallTime;
@@ -51,9 +56,17 @@ namespace klee {
     unsigned numBranches;
     unsigned fullBranches, partialBranches;
 
+    /// Cycle counter at the last step, with --track-instruction-cycles
+    uint64_t lastCycles = 0;
+
     CallPathManager callPathManager;
 
     bool updateMinDistToUncovered;
+    /// Whether computeReachableUncovered went over the whole module yet
+    bool reachableUncoveredComputed = false;
+    /// Functions with instructions covered since the last
+    /// computeReachableUncovered
+    std::set<llvm::Function *> coverageChangedFunctions;
 
   public:
     static bool useStatistics();
@@ -63,7 +76,12 @@ namespace klee {
     void updateStateStatistics(uint64_t addend);
     void writeStatsHeader();
     void writeStatsLine();
+    void writeColumnarStatsLine();
+    /// Names of the columns of the running stats, in the order written
+    static std::vector<std::string> statsColumns();
     void writeIStats();
+    void openStatsFile();
+    void openIStatsFile();
 
   public:
     StatsTracker(Executor &_executor, std::string _objectFilename,
@@ -90,10 +108,17 @@ namespace klee {
     // called when execution is done and stats files should be flushed
     void done();
 
+    // called in a new worker process to write its stats files of its own
+    void startWorker();
+
     // process stats for a single instruction step, es is the state
     // about to be stepped
     void stepInstruction(ExecutionState &es);
 
+    /// Whether stepInstruction has to see every instruction. Without
+    /// instruction level statistics or periodic writes it does nothing.
+    static bool stepsEachInstruction();
+
     /// Return duration since execution start.
     time::Span elapsed();
 
@@ -103,6 +128,10 @@ namespace klee {
   uint64_t computeMinDistToUncovered(const KInstruction *ki,
                                      uint64_t minDistAtRA);
 
+  /// The number of times the distances that computeMinDistToUncovered reads
+  /// have been recomputed, for callers that cache its results.
+  uint64_t getMinDistToUncoveredGeneration();
+
 }
 
 #endif /* KLEE_STATSTRACKER_H */
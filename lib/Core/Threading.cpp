@@ -44,22 +44,17 @@ namespace klee {
 /***/
 
 StackFrame::StackFrame(KInstIterator _caller, KFunction *_kf)
-    : caller(_caller), kf(_kf), callPathNode(0), minDistToUncoveredOnReturn(0),
-      varargs(0) {
-  locals = new Cell[kf->numRegisters];
-}
+    : caller(_caller), kf(_kf), callPathNode(0),
+      locals(std::make_shared<std::vector<Cell> >(kf->numRegisters)),
+      minDistToUncoveredOnReturn(0), varargs(0) {}
 
 StackFrame::StackFrame(const StackFrame &s)
     : caller(s.caller), kf(s.kf), callPathNode(s.callPathNode),
-      allocas(s.allocas),
+      allocas(s.allocas), locals(s.locals),
       minDistToUncoveredOnReturn(s.minDistToUncoveredOnReturn),
-      varargs(s.varargs) {
-  locals = new Cell[s.kf->numRegisters];
-  for (unsigned i = 0; i < s.kf->numRegisters; i++)
-    locals[i] = s.locals[i];
-}
+      varargs(s.varargs) {}
 
-StackFrame::~StackFrame() { delete[] locals; }
+StackFrame::~StackFrame() {}
 
 Thread::Thread(thread_id_t tid, process_id_t pid, KFunction *start_function)
     : enabled(true), waitingList(0), isInPOSIX(false),
@@ -91,7 +86,7 @@ void Thread::dumpStack(llvm::raw_ostream &out) const {
     const InstructionInfo &ii = *target->info;
     out << "\t#" << idx++;
     std::stringstream AssStream;
-    AssStream << std::setw(8) << std::setfill('0') << ii.assemblyLine;
+    AssStream << std::setw(8) << std::setfill('0') << ii.getAssemblyLine();
     out << AssStream.str();
     out << " in " << f->getName().str() << " (";
     // Yawn, we could go up and print varargs if we wanted to.
@@ -102,7 +97,7 @@ void Thread::dumpStack(llvm::raw_ostream &out) const {
 
       out << ai->getName().str();
       // XXX should go through function
-      ref<Expr> value = sf.locals[sf.kf->getArgRegister(index++)].value;
+      ref<Expr> value = sf.getLocal(sf.kf->getArgRegister(index++)).value;
       if (value.get() && isa<ConstantExpr>(value))
         out << "=" << value;
     }
@@ -11,17 +11,34 @@
 
 #include "klee/Config/Version.h"
 #include "klee/ExecutionState.h"
+#include "klee/Internal/Support/IndependentElementSet.h"
+#include "klee/OptionCategories.h"
 #include "klee/Solver/Solver.h"
+#include "klee/Solver/SolverCmdLine.h"
 #include "klee/Statistics.h"
 #include "klee/TimerStatIncrementer.h"
 
 #include "CoreStats.h"
+#include "SolverProfiler.h"
 
+#include <algorithm>
 #include <string>
 
 using namespace klee;
 using namespace llvm;
 
+namespace {
+cl::opt<bool> MemoizeSolverAnswers(
+    "memoize-solver-answers", cl::init(true),
+    cl::desc("Answer getValue and getRange queries of a state again without "
+             "the solver while the constraints of the expression do not "
+             "change (default=true)"),
+    cl::cat(klee::SolvingCat));
+
+/// The most answers of each kind a state keeps
+const unsigned MaxMemoizedAnswers = 64;
+} // namespace
+
 /***/
 
 bool TimingSolver::evaluate(const ExecutionState& state, ref<Expr> expr,
@@ -39,7 +56,10 @@ bool TimingSolver::evaluate(const ExecutionState& state, ref<Expr> expr,
 
   bool success = solver->evaluate(Query(state.constraints, expr), result);
 
-  state.queryCost += timer.delta();
+  time::Span cost = timer.delta();
+  state.queryCost += cost;
+  if (profiler)
+    profiler->record(state, expr, cost);
 
   return success;
 }
@@ -59,7 +79,10 @@ bool TimingSolver::mustBeTrue(const ExecutionState& state, ref<Expr> expr,
 
   bool success = solver->mustBeTrue(Query(state.constraints, expr), result);
 
-  state.queryCost += timer.delta();
+  time::Span cost = timer.delta();
+  state.queryCost += cost;
+  if (profiler)
+    profiler->record(state, expr, cost);
 
   return success;
 }
@@ -78,6 +101,38 @@ bool TimingSolver::mayBeTrue(const ExecutionState& state, ref<Expr> expr,
   return true;
 }
 
+bool TimingSolver::mayBeTrue(const ExecutionState &state,
+                             const std::vector<ref<Expr> > &exprs,
+                             std::vector<bool> &results) {
+  // Fast path, to avoid timer and OS overhead.
+  if (std::all_of(exprs.begin(), exprs.end(),
+                  [](const ref<Expr> &e) { return isa<ConstantExpr>(e); })) {
+    results.clear();
+    for (const ref<Expr> &e : exprs)
+      results.push_back(cast<ConstantExpr>(e)->isTrue());
+    return true;
+  }
+
+  TimerStatIncrementer timer(stats::solverTime);
+
+  std::vector<ref<Expr> > simplified;
+  simplified.reserve(exprs.size());
+  for (const ref<Expr> &e : exprs)
+    simplified.push_back(simplifyExprs ? state.constraints.simplifyExpr(e) : e);
+
+  bool success = solver->mayBeTrue(
+      Query(state.constraints, ConstantExpr::alloc(0, Expr::Bool)), simplified,
+      results);
+
+  time::Span cost = timer.delta();
+  state.queryCost += cost;
+  if (profiler)
+    for (const ref<Expr> &e : simplified)
+      profiler->record(state, e, cost / simplified.size());
+
+  return success;
+}
+
 bool TimingSolver::mayBeFalse(const ExecutionState& state, ref<Expr> expr,
                               bool &result) {
   bool res;
@@ -87,6 +142,47 @@ bool TimingSolver::mayBeFalse(const ExecutionState& state, ref<Expr> expr,
   return true;
 }
 
+/// The fingerprint of the constraints of state that expr depends on: those
+/// of the factors it intersects, or all of them without the factors of the
+/// independent solver.
+static uint64_t dependenceFingerprint(const ExecutionState &state,
+                                      const ref<Expr> &expr) {
+  if (!UseIndependentSolver)
+    return state.constraints.getFingerprint();
+  IndependentElementSet elements(expr);
+  IndepElemSetPtrSet_ty factors;
+  state.constraints.getIntersection(&elements, factors);
+  uint64_t fingerprint = 0;
+  for (const IndependentElementSet *factor : factors)
+    fingerprint += factor->fingerprint;
+  return fingerprint;
+}
+
+/// Look expr up in memo, dropping its answer if the constraints it depends
+/// on changed since.
+static const ExecutionState::MemoizedAnswer *
+lookupMemo(ExprHashMap<ExecutionState::MemoizedAnswer> &memo,
+           const ref<Expr> &expr, uint64_t fingerprint) {
+  auto it = memo.find(expr);
+  if (it == memo.end())
+    return nullptr;
+  if (it->second.fingerprint != fingerprint) {
+    memo.erase(it);
+    return nullptr;
+  }
+  ++stats::solverMemoHits;
+  return &it->second;
+}
+
+static void insertMemo(ExprHashMap<ExecutionState::MemoizedAnswer> &memo,
+                       const ref<Expr> &expr,
+                       ExecutionState::MemoizedAnswer answer) {
+  // a state keeps few answers, it copies them when it branches
+  if (memo.size() >= MaxMemoizedAnswers)
+    memo.clear();
+  memo[expr] = std::move(answer);
+}
+
 bool TimingSolver::getValue(const ExecutionState& state, ref<Expr> expr,
                             ref<ConstantExpr> &result) {
   // Fast path, to avoid timer and OS overhead.
@@ -95,6 +191,18 @@ bool TimingSolver::getValue(const ExecutionState& state, ref<Expr> expr,
     return true;
   }
 
+  // a value that satisfied the constraints expr depends on still does while
+  // they do not change
+  uint64_t fingerprint = 0;
+  if (MemoizeSolverAnswers) {
+    fingerprint = dependenceFingerprint(state, expr);
+    if (auto answer = lookupMemo(state.valueMemo, expr, fingerprint)) {
+      result = cast<ConstantExpr>(answer->first);
+      return true;
+    }
+  }
+  ref<Expr> original = expr;
+
   TimerStatIncrementer timer(stats::solverTime);
 
   if (simplifyExprs)
@@ -102,8 +210,13 @@ bool TimingSolver::getValue(const ExecutionState& state, ref<Expr> expr,
 
   bool success = solver->getValue(Query(state.constraints, expr), result);
 
-  state.queryCost += timer.delta();
+  time::Span cost = timer.delta();
+  state.queryCost += cost;
+  if (profiler)
+    profiler->record(state, expr, cost);
 
+  if (success && MemoizeSolverAnswers)
+    insertMemo(state.valueMemo, original, {fingerprint, result, nullptr});
   return success;
 }
 
@@ -122,14 +235,27 @@ TimingSolver::getInitialValues(const ExecutionState& state,
                                                 ConstantExpr::alloc(0, Expr::Bool)),
                                           objects, result);
 
-  state.queryCost += timer.check();
+  time::Span cost = timer.check();
+  state.queryCost += cost;
+  if (profiler)
+    profiler->record(state, ref<Expr>(), cost);
 
   return success;
 }
 
 std::pair< ref<Expr>, ref<Expr> >
 TimingSolver::getRange(const ExecutionState& state, ref<Expr> expr) {
-  return solver->getRange(Query(state.constraints, expr));
+  uint64_t fingerprint = 0;
+  if (MemoizeSolverAnswers && !isa<ConstantExpr>(expr)) {
+    fingerprint = dependenceFingerprint(state, expr);
+    if (auto answer = lookupMemo(state.rangeMemo, expr, fingerprint))
+      return std::make_pair(answer->first, answer->second);
+  }
+  std::pair<ref<Expr>, ref<Expr> > range =
+      solver->getRange(Query(state.constraints, expr));
+  if (MemoizeSolverAnswers && !isa<ConstantExpr>(expr))
+    insertMemo(state.rangeMemo, expr, {fingerprint, range.first, range.second});
+  return range;
 }
 
 /*
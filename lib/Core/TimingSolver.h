@@ -20,6 +20,7 @@
 namespace klee {
   class ExecutionState;
   class Solver;
+  class SolverProfiler;
 
   /// TimingSolver - A simple class which wraps a solver and handles
   /// tracking the statistics that we care about.
@@ -27,6 +28,8 @@ namespace klee {
   public:
     Solver *solver;
     bool simplifyExprs;
+    /// When non-null, the time of every query is attributed there
+    SolverProfiler *profiler = nullptr;
 
   public:
     /// TimingSolver - Construct a new timing solver.
@@ -56,6 +59,11 @@ namespace klee {
 
     bool mayBeTrue(const ExecutionState&, ref<Expr>, bool &result);
 
+    /// Determine for each of exprs whether it may be true in the state, with
+    /// the constraints of the state given to the solver once.
+    bool mayBeTrue(const ExecutionState &, const std::vector<ref<Expr> > &exprs,
+                   std::vector<bool> &results);
+
     bool mayBeFalse(const ExecutionState&, ref<Expr>, bool &result);
 
     bool getValue(const ExecutionState &, ref<Expr> expr,
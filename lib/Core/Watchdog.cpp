@@ -0,0 +1,57 @@
+//===-- Watchdog.cpp ------------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Watchdog.h"
+
+#include "klee/Internal/System/MemoryUsage.h"
+
+#include <chrono>
+
+using namespace klee;
+
+Watchdog::Watchdog(time::Span interval, time::Span reportInterval,
+                   bool sampleMemory)
+    : interval(interval), reportInterval(reportInterval),
+      sampleMemory(sampleMemory) {
+  thread = std::thread([this] { watch(); });
+}
+
+Watchdog::~Watchdog() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  wakeUp.notify_one();
+  thread.join();
+}
+
+void Watchdog::raise(std::atomic<bool> &flag) {
+  flag.store(true, std::memory_order_relaxed);
+  // the interpreter reads the flags after seeing pending
+  pending.store(true, std::memory_order_release);
+}
+
+void Watchdog::watch() {
+  const std::chrono::microseconds period(interval.toMicroseconds());
+  time::Point lastReport = time::getWallTime();
+  std::unique_lock<std::mutex> guard(lock);
+  while (!wakeUp.wait_for(guard, period, [this] { return stopping; })) {
+    if (sampleMemory) {
+      mallocUsage.store(util::GetTotalMallocUsage(),
+                        std::memory_order_relaxed);
+      raise(memoryDue);
+    }
+    time::Point now = time::getWallTime();
+    if (reportInterval && now - lastReport >= reportInterval) {
+      lastReport = now;
+      raise(reportDue);
+    }
+    raise(timersDue);
+  }
+}
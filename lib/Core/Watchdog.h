@@ -0,0 +1,70 @@
+//===-- Watchdog.h ----------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_WATCHDOG_H
+#define KLEE_WATCHDOG_H
+
+#include "klee/Internal/System/Time.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+namespace klee {
+
+  /// Watches the time and memory limits of a run from a thread of its own.
+  ///
+  /// The thread wakes up every interval, samples the malloc usage and the
+  /// wall time and raises the flags below; the interpreter only polls
+  /// `pending` between instructions and does the work the flags ask for
+  /// (see Executor::handleWatchdog). Neither the clock nor the malloc
+  /// statistics, which are O(elements on the freelist), are thus read on
+  /// the interpreter's path.
+  class Watchdog {
+  public:
+    /// Set with any of the flags below, cleared by the interpreter
+    std::atomic<bool> pending{false};
+    /// The timers of the executor are to be invoked
+    std::atomic<bool> timersDue{false};
+    /// A new malloc usage was sampled
+    std::atomic<bool> memoryDue{false};
+    /// The report interval elapsed
+    std::atomic<bool> reportDue{false};
+    /// util::GetTotalMallocUsage() at the last sample
+    std::atomic<uint64_t> mallocUsage{0};
+
+  private:
+    const time::Span interval;
+    const time::Span reportInterval;
+    const bool sampleMemory;
+    bool stopping = false;
+    std::mutex lock;
+    std::condition_variable wakeUp;
+    std::thread thread;
+
+    void watch();
+    void raise(std::atomic<bool> &flag);
+
+  public:
+    /// \param interval How often the thread wakes up
+    /// \param reportInterval When to raise reportDue, zero for never
+    /// \param sampleMemory Whether to sample the malloc usage
+    Watchdog(time::Span interval, time::Span reportInterval,
+             bool sampleMemory);
+    ~Watchdog();
+
+    Watchdog(const Watchdog &) = delete;
+    Watchdog &operator=(const Watchdog &) = delete;
+  };
+
+} // namespace klee
+
+#endif /* KLEE_WATCHDOG_H */
@@ -2,6 +2,8 @@
 
 namespace klee {
 
+std::atomic<unsigned> ArrayCache::nextId(0);
+
 ArrayCache::~ArrayCache() {
   // Free Allocated Array objects
   for (ArrayHashMap::iterator ai = cachedSymbolicArrays.begin(),
@@ -29,6 +31,7 @@ ArrayCache::CreateArray(const std::string &_name, uint64_t _size,
         cachedSymbolicArrays.insert(array);
     if (success.second) {
       // Cache miss
+      const_cast<Array *>(array)->id = nextId++;
       return array;
     }
     // Cache hit
@@ -40,6 +43,7 @@ ArrayCache::CreateArray(const std::string &_name, uint64_t _size,
   } else {
     // Treat every constant array as distinct so we never cache them
     assert(array->isConstantArray());
+    const_cast<Array *>(array)->id = nextId++;
     concreteArrays.push_back(array); // For deletion later
     return array;
   }
@@ -58,6 +58,20 @@ llvm::cl::opt<double> ArrayValueSymbRatio(
                    "the mixed value-based transformations are applied."),
     llvm::cl::init(1.0), llvm::cl::value_desc("Symbolic Values / Array Size"),
     llvm::cl::cat(klee::SolvingCat));
+
+llvm::cl::opt<bool> OptimizeArrayUpdates(
+    "optimize-array-updates",
+    llvm::cl::desc("Drop the writes of update lists that cannot be read once "
+                   "the equalities of a query are propagated "
+                   "(default=true)"),
+    llvm::cl::init(true), llvm::cl::cat(klee::SolvingCat));
+
+llvm::cl::opt<unsigned> ArrayUpdatesSelectLimit(
+    "array-updates-select-limit",
+    llvm::cl::desc("Maximum number of undecided writes over which a read of "
+                   "a pruned update list becomes a chain of selects "
+                   "(default=8)"),
+    llvm::cl::init(8), llvm::cl::cat(klee::SolvingCat));
 }; // namespace klee
 
 ref<Expr> extendRead(const UpdateList &ul, const ref<Expr> index,
@@ -189,6 +203,21 @@ ref<Expr> ExprOptimizer::optimizeExpr(const ref<Expr> &e, bool valueOnly) {
   return result;
 }
 
+ref<Expr> ExprOptimizer::optimizeUpdates(const ref<Expr> &e) {
+  if (!OptimizeArrayUpdates || isa<ConstantExpr>(e) ||
+      !e->getMetadata().maxUpdates)
+    return e;
+
+  auto cached = cacheUpdatesOptimized.find(e);
+  if (cached != cacheUpdatesOptimized.end())
+    return cached->second;
+
+  UpdateListOptimizationVisitor ulov(ArrayUpdatesSelectLimit);
+  ref<Expr> result = ulov.visit(e);
+  cacheUpdatesOptimized[e] = result;
+  return result;
+}
+
 bool ExprOptimizer::computeIndexes(array2idx_ty &arrays, const ref<Expr> &e,
                                    mapIndexOptimizedExpr_ty &idx_valIdx) const {
   bool success = false;
@@ -33,6 +33,7 @@ private:
   ExprHashMap<ref<Expr>> cacheExprOptimized;
   ExprHashSet cacheExprUnapplicable;
   ExprHashMap<ref<Expr>> cacheReadExprOptimized;
+  ExprHashMap<ref<Expr>> cacheUpdatesOptimized;
 
 public:
   /// Returns the optimised version of e.
@@ -41,6 +42,14 @@ public:
   /// @return optimised expression
   ref<Expr> optimizeExpr(const ref<Expr> &e, bool valueOnly);
 
+  /// Returns e with the update lists of its reads pruned of the writes that
+  /// cannot be read, which is most effective once the indices of the writes
+  /// are made concrete, e.g. by propagating equalities into e. Reads with
+  /// few undecided writes left become chains of Selects.
+  /// @param e expression to optimise
+  /// @return optimised expression
+  ref<Expr> optimizeUpdates(const ref<Expr> &e);
+
 private:
   bool computeIndexes(array2idx_ty &arrays, const ref<Expr> &e,
                       mapIndexOptimizedExpr_ty &idx_valIdx) const;
@@ -256,3 +256,60 @@ ExprVisitor::Action ArrayValueOptReplaceVisitor::visitRead(const ReadExpr &re) {
   }
   return Action::doChildren();
 }
+
+//------------------------ UPDATE-LIST OPTIMIZATION--------------------------//
+ExprVisitor::Action
+UpdateListOptimizationVisitor::visitRead(const ReadExpr &re) {
+  ref<Expr> index = visit(re.index);
+  bool changed = index != re.index;
+
+  struct Write {
+    ref<Expr> index, value, cond;
+    const UpdateNode *un;
+  };
+  // the writes that may be read, newest first
+  std::vector<Write> writes;
+  ExprHashSet written;
+  // the value read if none of writes is
+  ref<Expr> base;
+  for (const auto *un = re.updates.head.get(); un; un = un->next.get()) {
+    ref<Expr> wIndex = visit(un->index);
+    ref<Expr> wValue = visit(un->value);
+    changed |= wIndex != un->index || wValue != un->value;
+    if (!written.insert(wIndex).second) {
+      changed = true;
+      continue;
+    }
+    ref<Expr> cond = EqExpr::create(wIndex, index);
+    if (ConstantExpr *ce = dyn_cast<ConstantExpr>(cond)) {
+      if (ce->isFalse()) {
+        changed = true;
+        continue;
+      }
+      // the older writes are shadowed
+      changed |= un->next.get() != nullptr;
+      base = wValue;
+      writes.push_back({wIndex, wValue, cond, un});
+      break;
+    }
+    writes.push_back({wIndex, wValue, cond, un});
+  }
+  if (!changed)
+    return Action::skipChildren();
+
+  unsigned undecided = writes.size() - !base.isNull();
+  if (undecided <= selectLimit) {
+    if (base.isNull()) {
+      base = ReadExpr::create(UpdateList(re.updates.root, nullptr), index);
+    }
+    ref<Expr> result = base;
+    for (unsigned i = undecided; i--;)
+      result = SelectExpr::create(writes[i].cond, writes[i].value, result);
+    return Action::changeTo(result);
+  }
+
+  UpdateList ul(re.updates.root, nullptr);
+  for (auto it = writes.rbegin(), ie = writes.rend(); it != ie; ++it)
+    ul.extend(it->index, it->value, it->un->flags, it->un->kinst);
+  return Action::changeTo(ReadExpr::create(ul, index));
+}
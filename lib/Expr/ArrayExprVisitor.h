@@ -124,6 +124,23 @@ public:
                                        bool recursive = true)
       : ExprVisitor(recursive), optimized(_optimized) {}
 };
+
+//------------------------ UPDATE-LIST OPTIMIZATION--------------------------//
+/// Prunes the update lists of reads: writes shadowed by a newer write to the
+/// same index and writes whose index cannot equal the read index are
+/// dropped. If at most selectLimit writes remain undecided, the read becomes
+/// a chain of Selects over them.
+class UpdateListOptimizationVisitor : public ExprVisitor {
+private:
+  unsigned selectLimit;
+
+protected:
+  Action visitRead(const ReadExpr &) override;
+
+public:
+  explicit UpdateListOptimizationVisitor(unsigned _selectLimit)
+      : selectLimit(_selectLimit) {}
+};
 } // namespace klee
 
 #endif /* KLEE_ARRAYEXPRVISITOR_H */
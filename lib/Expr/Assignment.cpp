@@ -9,8 +9,29 @@
 
 #include "klee/Expr/Assignment.h"
 
+#include <cassert>
+
 namespace klee {
 
+AssignmentBindings::AssignmentBindings(
+    const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > values) {
+  assert(objects.size() <= values.size() && "an object without values");
+  entries.reserve(objects.size());
+  for (size_t i = 0; i < objects.size(); ++i)
+    entries.emplace_back(objects[i], std::move(values[i]));
+  // sorted once instead of an insertion for each object
+  std::stable_sort(entries.begin(), entries.end(),
+                   [](const value_type &a, const value_type &b) {
+                     return a.first->getId() < b.first->getId();
+                   });
+  entries.erase(std::unique(entries.begin(), entries.end(),
+                            [](const value_type &a, const value_type &b) {
+                              return a.first == b.first;
+                            }),
+                entries.end());
+}
+
 void Assignment::dump() {
   if (bindings.size() == 0) {
     llvm::errs() << "No bindings\n";
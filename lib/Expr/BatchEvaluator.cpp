@@ -0,0 +1,471 @@
+//===-- BatchEvaluator.cpp ------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/util/BatchEvaluator.h"
+
+#include "klee/Expr/ExprEvaluator.h"
+
+#include <algorithm>
+#include <string>
+
+using namespace klee;
+
+const unsigned BatchEvaluator::BlockSize;
+const uint32_t BatchEvaluator::NoId;
+
+namespace {
+/// Evaluates the constraints that are not compiled, like OracleEvaluator
+/// but on a loaded KTest.
+class KTestEvaluator : public ExprEvaluator {
+  std::unordered_map<std::string, const KTestObject *> objects;
+
+protected:
+  ref<Expr> getInitialValue(const Array &array, unsigned index) {
+    auto it = objects.find(array.name);
+    if (it == objects.end() || array.getRange() != Expr::Int8)
+      return ReadExpr::create(UpdateList(&array, 0),
+                              ConstantExpr::alloc(index, array.getDomain()));
+    const KTestObject *obj = it->second;
+    return ConstantExpr::alloc(index < obj->numBytes ? obj->bytes[index] : 0,
+                               Expr::Int8);
+  }
+
+public:
+  KTestEvaluator(const KTest *ktest) {
+    for (unsigned i = 0; i < ktest->numObjects; ++i)
+      objects[ktest->objects[i].name] = &ktest->objects[i];
+  }
+};
+
+inline uint64_t widthMask(unsigned w) { return ~0ULL >> (64 - w); }
+
+inline int64_t signExtend(uint64_t v, unsigned w) {
+  return (int64_t)(v << (64 - w)) >> (64 - w);
+}
+} // namespace
+
+BatchEvaluator::BatchEvaluator(const std::vector<ref<Expr>> &exprs) {
+  constraints.reserve(exprs.size());
+  for (const ref<Expr> &e : exprs) {
+    constraints.push_back(Constraint{e, compile(e), {}, {}});
+    collectDependencies(constraints.back());
+  }
+  // only needed while compiling
+  slots.clear();
+}
+
+uint32_t BatchEvaluator::compile(const ref<Expr> &e) {
+  auto it = slots.find(e.get());
+  if (it != slots.end())
+    return it->second;
+  uint32_t slot = compileNode(e);
+  slots[e.get()] = slot;
+  return slot;
+}
+
+uint32_t BatchEvaluator::compileNode(const ref<Expr> &e) {
+  if (e->getWidth() > 64)
+    return NoId;
+
+  if (const ConstantExpr *ce = dyn_cast<ConstantExpr>(e)) {
+    writers.push_back(NoId);
+    constants.push_back(std::make_pair(numSlots, ce->getZExtValue()));
+    return numSlots++;
+  }
+
+  Instruction inst = {(uint8_t)e->getKind(), (uint8_t)e->getWidth(), 0,
+                      NoId, NoId, NoId, 0, NoId, NoId};
+  if (e->getNumKids())
+    inst.kidWidth = e->getKid(0)->getWidth();
+  if (const ReadExpr *re = dyn_cast<ReadExpr>(e)) {
+    inst.a = compile(re->index);
+    inst.aux = compileRead(re->updates);
+    if (inst.a == NoId || inst.aux == NoId)
+      return NoId;
+    inst.poison = numPoisons++;
+  } else {
+    uint32_t *operands[3] = {&inst.a, &inst.b, &inst.c};
+    for (unsigned i = 0, n = e->getNumKids(); i != n; ++i) {
+      assert(i < 3);
+      *operands[i] = compile(e->getKid(i));
+      if (*operands[i] == NoId)
+        return NoId;
+    }
+    switch (e->getKind()) {
+    case Expr::Extract:
+      inst.aux = cast<ExtractExpr>(e)->offset;
+      break;
+    case Expr::Concat:
+      inst.aux = e->getKid(1)->getWidth();
+      break;
+    case Expr::UDiv:
+    case Expr::SDiv:
+    case Expr::URem:
+    case Expr::SRem:
+      inst.poison = numPoisons++;
+      break;
+    default:
+      break;
+    }
+  }
+  inst.dest = numSlots;
+  writers.push_back(program.size());
+  program.push_back(inst);
+  return numSlots++;
+}
+
+uint32_t BatchEvaluator::compileRead(const UpdateList &ul) {
+  const Array *root = ul.root;
+  if (root->isSymbolicArray() && root->getRange() != Expr::Int8)
+    return NoId;
+  auto key = std::make_pair(root, (const UpdateNode *)ul.head.get());
+  auto known = readIds.find(key);
+  if (known != readIds.end())
+    return known->second;
+
+  Read read;
+  read.array = NoId;
+  if (root->isSymbolicArray()) {
+    if (const uint32_t *id = symbolicArrayIds.lookup(root)) {
+      read.array = *id;
+    } else {
+      read.array = symbolicArrayIds[root] = symbolicArrays.size();
+      symbolicArrays.push_back(root);
+    }
+  } else {
+    for (const ref<ConstantExpr> &v : root->constantValues)
+      read.constantValues.push_back(v->getZExtValue());
+  }
+  for (const UpdateNode *un = ul.head.get(); un; un = un->next.get()) {
+    uint32_t index = compile(un->index), value = compile(un->value);
+    if (index == NoId || value == NoId)
+      return readIds[key] = NoId;
+    read.updates.push_back(std::make_pair(index, value));
+  }
+  // compiling the updates may have added other reads
+  uint32_t id = reads.size();
+  reads.push_back(std::move(read));
+  return readIds[key] = id;
+}
+
+void BatchEvaluator::collectDependencies(Constraint &c) const {
+  if (c.slot == NoId)
+    return;
+  std::vector<bool> seen(numSlots);
+  std::vector<uint32_t> stack(1, c.slot);
+  seen[c.slot] = true;
+  auto push = [&](uint32_t s) {
+    if (s != NoId && !seen[s]) {
+      seen[s] = true;
+      stack.push_back(s);
+    }
+  };
+  while (!stack.empty()) {
+    uint32_t s = stack.back();
+    stack.pop_back();
+    if (writers[s] == NoId)
+      continue;
+    const Instruction &inst = program[writers[s]];
+    if (inst.poison != NoId)
+      c.poisons.push_back(inst.poison);
+    push(inst.a);
+    push(inst.b);
+    push(inst.c);
+    if (inst.kind == Expr::Read) {
+      const Read &read = reads[inst.aux];
+      if (read.array != NoId)
+        c.arrays.push_back(read.array);
+      for (const auto &u : read.updates) {
+        push(u.first);
+        push(u.second);
+      }
+    }
+  }
+  std::sort(c.arrays.begin(), c.arrays.end());
+  c.arrays.erase(std::unique(c.arrays.begin(), c.arrays.end()),
+                 c.arrays.end());
+}
+
+unsigned BatchEvaluator::getNumUncompiled() const {
+  return std::count_if(constraints.begin(), constraints.end(),
+                       [](const Constraint &c) { return c.slot == NoId; });
+}
+
+void BatchEvaluator::run(unsigned lanes, const Binding *bindings,
+                         std::vector<uint64_t> &values,
+                         std::vector<uint8_t> &poisoned) const {
+  const unsigned L = lanes;
+  for (const auto &c : constants)
+    std::fill_n(&values[c.first * BlockSize], L, c.second);
+
+  for (const Instruction &inst : program) {
+    const unsigned w = inst.width;
+    const uint64_t mask = widthMask(w);
+    uint64_t *d = &values[inst.dest * BlockSize];
+    const uint64_t *x = inst.a == NoId ? nullptr : &values[inst.a * BlockSize];
+    const uint64_t *y = inst.b == NoId ? nullptr : &values[inst.b * BlockSize];
+    const uint64_t *z = inst.c == NoId ? nullptr : &values[inst.c * BlockSize];
+    uint8_t *p = inst.poison == NoId ? nullptr
+                                     : &poisoned[inst.poison * BlockSize];
+    const unsigned kw = inst.kidWidth;
+
+    switch (inst.kind) {
+    case Expr::NotOptimized:
+    case Expr::ZExt:
+      std::copy_n(x, L, d);
+      break;
+    case Expr::Read: {
+      const Read &read = reads[inst.aux];
+      for (unsigned l = 0; l < L; ++l) {
+        uint64_t index = (unsigned)x[l];
+        bool found = false;
+        p[l] = 0;
+        for (const auto &u : read.updates) {
+          if (values[u.first * BlockSize + l] == index) {
+            d[l] = values[u.second * BlockSize + l];
+            found = true;
+            break;
+          }
+        }
+        if (found)
+          continue;
+        if (read.array != NoId) {
+          const Binding &binding = bindings[read.array * BlockSize + l];
+          if (index < binding.size) {
+            d[l] = binding.bytes[index];
+          } else {
+            d[l] = 0;
+            p[l] = binding.free;
+          }
+        } else if (index < read.constantValues.size()) {
+          d[l] = read.constantValues[index];
+        } else {
+          d[l] = 0;
+          p[l] = 1;
+        }
+      }
+      break;
+    }
+    case Expr::Select:
+      for (unsigned l = 0; l < L; ++l)
+        d[l] = x[l] ? y[l] : z[l];
+      break;
+    case Expr::Concat:
+      for (unsigned l = 0; l < L; ++l)
+        d[l] = ((x[l] << inst.aux) | y[l]) & mask;
+      break;
+    case Expr::Extract:
+      for (unsigned l = 0; l < L; ++l)
+        d[l] = (x[l] >> inst.aux) & mask;
+      break;
+    case Expr::SExt:
+      for (unsigned l = 0; l < L; ++l)
+        d[l] = (uint64_t)signExtend(x[l], kw) & mask;
+      break;
+    case Expr::Not:
+      for (unsigned l = 0; l < L; ++l)
+        d[l] = ~x[l] & mask;
+      break;
+    case Expr::Add:
+      for (unsigned l = 0; l < L; ++l)
+        d[l] = (x[l] + y[l]) & mask;
+      break;
+    case Expr::Sub:
+      for (unsigned l = 0; l < L; ++l)
+        d[l] = (x[l] - y[l]) & mask;
+      break;
+    case Expr::Mul:
+      for (unsigned l = 0; l < L; ++l)
+        d[l] = (x[l] * y[l]) & mask;
+      break;
+    case Expr::UDiv:
+      for (unsigned l = 0; l < L; ++l) {
+        p[l] = y[l] == 0;
+        d[l] = y[l] ? x[l] / y[l] : 0;
+      }
+      break;
+    case Expr::URem:
+      for (unsigned l = 0; l < L; ++l) {
+        p[l] = y[l] == 0;
+        d[l] = y[l] ? x[l] % y[l] : 0;
+      }
+      break;
+    case Expr::SDiv:
+      for (unsigned l = 0; l < L; ++l) {
+        int64_t a = signExtend(x[l], w), b = signExtend(y[l], w);
+        p[l] = b == 0;
+        // INT64_MIN / -1 wraps around like APInt::sdiv
+        d[l] = (b == 0 ? 0 : b == -1 ? 0 - (uint64_t)a : (uint64_t)(a / b)) &
+               mask;
+      }
+      break;
+    case Expr::SRem:
+      for (unsigned l = 0; l < L; ++l) {
+        int64_t a = signExtend(x[l], w), b = signExtend(y[l], w);
+        p[l] = b == 0;
+        d[l] = (b == 0 || b == -1 ? 0 : (uint64_t)(a % b)) & mask;
+      }
+      break;
+    case Expr::And:
+      for (unsigned l = 0; l < L; ++l)
+        d[l] = x[l] & y[l];
+      break;
+    case Expr::Or:
+      for (unsigned l = 0; l < L; ++l)
+        d[l] = x[l] | y[l];
+      break;
+    case Expr::Xor:
+      for (unsigned l = 0; l < L; ++l)
+        d[l] = x[l] ^ y[l];
+      break;
+    case Expr::Shl:
+      for (unsigned l = 0; l < L; ++l)
+        d[l] = y[l] >= w ? 0 : (x[l] << y[l]) & mask;
+      break;
+    case Expr::LShr:
+      for (unsigned l = 0; l < L; ++l)
+        d[l] = y[l] >= w ? 0 : x[l] >> y[l];
+      break;
+    case Expr::AShr:
+      for (unsigned l = 0; l < L; ++l) {
+        int64_t a = signExtend(x[l], w);
+        d[l] = (uint64_t)(a >> std::min<uint64_t>(y[l], 63)) & mask;
+      }
+      break;
+
+#define COMPARE_CASE(K, OP, V)                                                 \
+  case Expr::K:                                                                \
+    for (unsigned l = 0; l < L; ++l)                                           \
+      d[l] = V(x[l]) OP V(y[l]);                                               \
+    break;
+#define UNSIGNED(v) (v)
+#define SIGNED(v) signExtend(v, kw)
+      COMPARE_CASE(Eq, ==, UNSIGNED)
+      COMPARE_CASE(Ne, !=, UNSIGNED)
+      COMPARE_CASE(Ult, <, UNSIGNED)
+      COMPARE_CASE(Ule, <=, UNSIGNED)
+      COMPARE_CASE(Ugt, >, UNSIGNED)
+      COMPARE_CASE(Uge, >=, UNSIGNED)
+      COMPARE_CASE(Slt, <, SIGNED)
+      COMPARE_CASE(Sle, <=, SIGNED)
+      COMPARE_CASE(Sgt, >, SIGNED)
+      COMPARE_CASE(Sge, >=, SIGNED)
+#undef COMPARE_CASE
+#undef UNSIGNED
+#undef SIGNED
+    default:
+      assert(0 && "unknown expression kind");
+    }
+  }
+}
+
+template <class Input, class BindFn>
+void BatchEvaluator::evaluateCompiled(const std::vector<Input> &inputs,
+                                      BindFn bind,
+                                      std::vector<Result> &results) const {
+  const size_t n = constraints.size();
+  results.assign(inputs.size() * n, Unknown);
+  std::vector<uint64_t> values(numSlots * BlockSize);
+  std::vector<uint8_t> poisoned(numPoisons * BlockSize);
+  std::vector<Binding> bindings(symbolicArrays.size() * BlockSize);
+
+  for (size_t first = 0; first < inputs.size(); first += BlockSize) {
+    unsigned lanes = std::min<size_t>(BlockSize, inputs.size() - first);
+    for (unsigned a = 0; a < symbolicArrays.size(); ++a)
+      for (unsigned l = 0; l < lanes; ++l)
+        bind(inputs[first + l], symbolicArrays[a],
+             bindings[a * BlockSize + l]);
+    run(lanes, bindings.data(), values, poisoned);
+
+    for (size_t c = 0; c < n; ++c) {
+      const Constraint &constraint = constraints[c];
+      if (constraint.slot == NoId)
+        continue;
+      const uint64_t *v = &values[constraint.slot * BlockSize];
+      for (unsigned l = 0; l < lanes; ++l) {
+        Result r = v[l] ? Pass : Fail;
+        for (uint32_t a : constraint.arrays)
+          if (!bindings[a * BlockSize + l].bound)
+            r = Unknown;
+        for (uint32_t p : constraint.poisons)
+          if (poisoned[p * BlockSize + l])
+            r = Unknown;
+        results[(first + l) * n + c] = r;
+      }
+    }
+  }
+}
+
+void BatchEvaluator::evaluate(const std::vector<const KTest *> &ktests,
+                              std::vector<Result> &results) const {
+  std::vector<std::map<std::string, const KTestObject *>> byName(
+      ktests.size());
+  for (size_t k = 0; k < ktests.size(); ++k)
+    for (unsigned i = 0; i < ktests[k]->numObjects; ++i)
+      byName[k][ktests[k]->objects[i].name] = &ktests[k]->objects[i];
+  std::vector<size_t> indices(ktests.size());
+  for (size_t k = 0; k < ktests.size(); ++k)
+    indices[k] = k;
+  evaluateCompiled(
+      indices,
+      [&](size_t k, const Array *array, Binding &binding) {
+        auto it = byName[k].find(array->name);
+        binding.bound = it != byName[k].end();
+        binding.bytes = binding.bound ? it->second->bytes : nullptr;
+        binding.size = binding.bound ? it->second->numBytes : 0;
+        binding.free = false;
+      },
+      results);
+
+  // the rest, one KTest at a time
+  if (!getNumUncompiled())
+    return;
+  const size_t n = constraints.size();
+  for (size_t k = 0; k < ktests.size(); ++k) {
+    KTestEvaluator evaluator(ktests[k]);
+    for (size_t c = 0; c < n; ++c) {
+      if (constraints[c].slot != NoId)
+        continue;
+      ref<Expr> r = evaluator.visit(constraints[c].expr);
+      if (const ConstantExpr *ce = dyn_cast<ConstantExpr>(r))
+        results[k * n + c] = ce->isTrue() ? Pass : Fail;
+    }
+  }
+}
+
+void BatchEvaluator::evaluate(const std::vector<const Assignment *> &assignments,
+                              std::vector<Result> &results) const {
+  evaluateCompiled(
+      assignments,
+      [](const Assignment *assignment, const Array *array, Binding &binding) {
+        auto it = assignment->bindings.find(array);
+        // without free values, unbound arrays read as 0
+        binding.bound =
+            it != assignment->bindings.end() || !assignment->allowFreeValues;
+        bool found = it != assignment->bindings.end();
+        binding.bytes = found ? it->second.data() : nullptr;
+        binding.size = found ? it->second.size() : 0;
+        binding.free = assignment->allowFreeValues;
+      },
+      results);
+
+  if (!getNumUncompiled())
+    return;
+  const size_t n = constraints.size();
+  for (size_t k = 0; k < assignments.size(); ++k) {
+    AssignmentEvaluator evaluator(*assignments[k]);
+    for (size_t c = 0; c < n; ++c) {
+      if (constraints[c].slot != NoId)
+        continue;
+      ref<Expr> r = evaluator.visit(constraints[c].expr);
+      if (const ConstantExpr *ce = dyn_cast<ConstantExpr>(r))
+        results[k * n + c] = ce->isTrue() ? Pass : Fail;
+    }
+  }
+}
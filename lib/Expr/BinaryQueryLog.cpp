@@ -0,0 +1,161 @@
+//===-- BinaryQueryLog.cpp ------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Expr/BinaryQueryLog.h"
+
+#include <cstring>
+
+using namespace klee;
+
+const char BinaryQueryLog::Magic[8] = {'K', 'L', 'E', 'E', 'Q', 'L', '0', '1'};
+
+static bool hasMagic(const char *begin, const char *end) {
+  return (size_t)(end - begin) >= sizeof(BinaryQueryLog::Magic) &&
+         !memcmp(begin, BinaryQueryLog::Magic, sizeof(BinaryQueryLog::Magic));
+}
+
+void BinaryQueryLogWriter::write(const LoggedQuery &q, std::string &out) {
+  if (serializer.getNumNodes() > maxNodes) {
+    out += 'Z';
+    serializer.reset();
+  }
+
+  std::vector<uint64_t> constraints;
+  constraints.reserve(q.constraints.size());
+  for (const ref<Expr> &c : q.constraints)
+    constraints.push_back(serializer.writeExpr(c, out));
+  uint64_t expr = q.expr.isNull() ? 0 : serializer.writeExpr(q.expr, out);
+  std::vector<uint64_t> objects;
+  objects.reserve(q.objects.size());
+  for (const Array *array : q.objects)
+    objects.push_back(serializer.writeArray(array, out));
+  uint64_t value = 0;
+  if (q.success && q.kind == LoggedQuery::Value)
+    value = serializer.writeExpr(q.value, out);
+
+  out += 'Q';
+  ExprSerializer::writeNumber(out, q.kind);
+  ExprSerializer::writeNumber(out, q.instructions);
+  ExprSerializer::writeNumber(out, constraints.size());
+  for (uint64_t c : constraints)
+    ExprSerializer::writeNumber(out, c);
+  ExprSerializer::writeNumber(out, expr);
+  ExprSerializer::writeNumber(out, objects.size());
+  for (uint64_t o : objects)
+    ExprSerializer::writeNumber(out, o);
+  ExprSerializer::writeNumber(out, q.success);
+  ExprSerializer::writeNumber(out, q.status);
+  ExprSerializer::writeNumber(out, q.elapsedMicroseconds);
+  if (!q.success)
+    return;
+  switch (q.kind) {
+  case LoggedQuery::Truth:
+    ExprSerializer::writeNumber(out, q.isValid);
+    break;
+  case LoggedQuery::Validity:
+    ExprSerializer::writeNumber(out, q.validity + 1);
+    break;
+  case LoggedQuery::Value:
+    ExprSerializer::writeNumber(out, value);
+    break;
+  case LoggedQuery::InitialValues:
+    ExprSerializer::writeNumber(out, q.hasSolution);
+    if (q.hasSolution)
+      for (const std::vector<unsigned char> &v : q.values)
+        out.append((const char *)v.data(), v.size());
+    break;
+  }
+}
+
+BinaryQueryLogReader::BinaryQueryLogReader(ArrayCache &_arrayCache,
+                                           const char *begin, const char *end)
+    : records(_arrayCache,
+              hasMagic(begin, end) ? begin + sizeof(BinaryQueryLog::Magic)
+                                   : end,
+              end) {
+  if (!hasMagic(begin, end))
+    records.fail("not a binary query log");
+}
+
+bool BinaryQueryLogReader::readQueryRecord(LoggedQuery &q) {
+  q = LoggedQuery();
+  uint64_t kind, number;
+  if (!records.readNumber(kind) || !records.readNumber(q.instructions) || !records.readNumber(number))
+    return false;
+  if (kind > LoggedQuery::InitialValues)
+    return records.fail("unknown query kind " + std::to_string(kind));
+  q.kind = (LoggedQuery::Kind)kind;
+  q.constraints.resize(number);
+  for (ref<Expr> &c : q.constraints)
+    if (!records.readExpr(c))
+      return false;
+  if (!records.readExpr(q.expr, true) || !records.readNumber(number))
+    return false;
+  q.objects.resize(number);
+  for (const Array *&o : q.objects)
+    if (!records.readArray(o))
+      return false;
+
+  uint64_t success, status;
+  if (!records.readNumber(success) || !records.readNumber(status) ||
+      !records.readNumber(q.elapsedMicroseconds))
+    return false;
+  q.success = success;
+  q.status = status;
+  if (!q.success)
+    return true;
+  switch (q.kind) {
+  case LoggedQuery::Truth:
+    if (!records.readNumber(number))
+      return false;
+    q.isValid = number;
+    break;
+  case LoggedQuery::Validity:
+    if (!records.readNumber(number))
+      return false;
+    q.validity = (int)number - 1;
+    break;
+  case LoggedQuery::Value:
+    if (!records.readExpr(q.value))
+      return false;
+    break;
+  case LoggedQuery::InitialValues:
+    if (!records.readNumber(number))
+      return false;
+    q.hasSolution = number;
+    if (!q.hasSolution)
+      break;
+    for (const Array *o : q.objects) {
+      const char *bytes;
+      if (!records.readBytes(o->size, bytes))
+        return false;
+      q.values.emplace_back(bytes, bytes + o->size);
+    }
+    break;
+  }
+  return true;
+}
+
+bool BinaryQueryLogReader::next(LoggedQuery &q) {
+  char tag;
+  while (records.readTag(tag)) {
+    switch (tag) {
+    case 'Z':
+      records.reset();
+      break;
+    case 'Q':
+      return readQueryRecord(q);
+    default:
+      if (!records.readRecord(tag))
+        return false;
+      break;
+    }
+  }
+  return false;
+}
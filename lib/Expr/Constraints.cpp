@@ -22,6 +22,7 @@
 #include <unordered_map>
 #include <unordered_set>
 #include "klee/Expr/ExprHashMap.h"
+#include "klee/util/Bits.h"
 #include "klee/util/RefHashMap.h"
 
 #include <fstream>
@@ -35,6 +36,155 @@ llvm::cl::opt<bool> RewriteEqualities(
                    "constant is added (default=true)"),
     llvm::cl::init(true),
     llvm::cl::cat(SolvingCat));
+
+llvm::cl::opt<bool> RewriteEqualitiesIndex(
+    "rewrite-equalities-index",
+    llvm::cl::desc("With --rewrite-equalities, index the subexpressions of "
+                   "the constraints so that an equality only rewrites the "
+                   "constraints containing its expression, instead of all "
+                   "the constraints of its independent sets (default=true)"),
+    llvm::cl::init(true),
+    llvm::cl::cat(SolvingCat));
+
+llvm::cl::opt<bool> SimplifyExprCache(
+    "simplify-expr-cache",
+    llvm::cl::desc("Memoize the expressions simplified with the equalities "
+                   "of the constraints until the equalities change "
+                   "(default=true)"),
+    llvm::cl::init(true),
+    llvm::cl::cat(SolvingCat));
+
+// bounds the memoized simplifications of one constraint manager
+const size_t MaxSimplified = 1 << 16;
+
+bool useOccurrenceIndex() { return RewriteEqualities && RewriteEqualitiesIndex; }
+
+/// The distinct non-constant subexpressions of e, e included, as the
+/// ExprReplaceVisitorBase visits them
+void collectSubexpressions(const ref<Expr> &e, std::vector<ref<Expr>> &out) {
+  std::unordered_set<const Expr *> visited;
+  std::unordered_set<const UpdateNode *> visitedUN;
+  std::vector<ref<Expr>> stack{e};
+  while (!stack.empty()) {
+    ref<Expr> n = stack.back();
+    stack.pop_back();
+    if (isa<ConstantExpr>(n) || !visited.insert(n.get()).second)
+      continue;
+    out.push_back(n);
+    if (const ReadExpr *re = dyn_cast<ReadExpr>(n)) {
+      for (const UpdateNode *un = re->updates.head.get();
+           un && visitedUN.insert(un).second; un = un->next.get()) {
+        stack.push_back(un->index);
+        stack.push_back(un->value);
+      }
+    }
+    for (unsigned i = 0, k = n->getNumKids(); i != k; ++i)
+      stack.push_back(n->getKid(i));
+  }
+}
+
+/// If constraint e bounds a non-constant expression of at most 64 bits
+/// from one side, set x to it and [lo, hi] to the values e allows. Only
+/// the unsigned comparisons and their negations are bounds.
+bool getBound(const ref<Expr> &e, ref<Expr> &x, uint64_t &lo, uint64_t &hi) {
+  ref<Expr> cmp = e;
+  bool negated = false;
+  if (const EqExpr *ee = dyn_cast<EqExpr>(e)) {
+    if (!ee->left->isFalse())
+      return false;
+    cmp = ee->right;
+    negated = true;
+  }
+  if (cmp->getKind() != Expr::Ult && cmp->getKind() != Expr::Ule)
+    return false;
+  // a < b or a <= b, !(a < b) is b <= a and !(a <= b) is b < a
+  ref<Expr> a = cmp->getKid(0), b = cmp->getKid(1);
+  bool strict = cmp->getKind() == Expr::Ult;
+  if (negated) {
+    std::swap(a, b);
+    strict = !strict;
+  }
+  Expr::Width width = a->getWidth();
+  if (width == Expr::Bool || width > 64)
+    return false;
+  uint64_t max = bits64::maxValueOfNBits(width);
+  lo = 0;
+  hi = max;
+  if (const ConstantExpr *c = dyn_cast<ConstantExpr>(a)) {
+    if (isa<ConstantExpr>(b))
+      return false;
+    lo = c->getZExtValue();
+    if (strict && lo++ == max)
+      return false;
+    x = b;
+  } else if (const ConstantExpr *c = dyn_cast<ConstantExpr>(b)) {
+    hi = c->getZExtValue();
+    if (strict && hi-- == 0)
+      return false;
+    x = a;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool isConstantEquality(const ref<Expr> &e) {
+  const EqExpr *ee = dyn_cast<EqExpr>(e);
+  return ee && isa<ConstantExpr>(ee->left);
+}
+}
+
+void ConstraintManager::indexOccurrences(const ref<Expr> &e) {
+  if (!useOccurrenceIndex())
+    return;
+  std::vector<ref<Expr>> subexprs;
+  collectSubexpressions(e, subexprs);
+  for (const ref<Expr> &s : subexprs) {
+    auto p = occurrences.lookup(s);
+    Occurrences_ty in = p ? p->second : Occurrences_ty();
+    occurrences = occurrences.replace(std::make_pair(s, in.insert(e)));
+  }
+}
+
+void ConstraintManager::unindexOccurrences(const ref<Expr> &e) {
+  if (!useOccurrenceIndex())
+    return;
+  std::vector<ref<Expr>> subexprs;
+  collectSubexpressions(e, subexprs);
+  for (const ref<Expr> &s : subexprs) {
+    auto p = occurrences.lookup(s);
+    if (!p)
+      continue;
+    Occurrences_ty in = p->second.remove(e);
+    occurrences = in.empty() ? occurrences.remove(s)
+                             : occurrences.replace(std::make_pair(s, in));
+  }
+}
+
+bool ConstraintManager::rewriteOccurrences(
+    ExprReplaceVisitorBase &visitor, const ref<Expr> &src,
+    std::vector<ref<Expr>> &deleteConstraints,
+    std::vector<ref<Expr>> &toAddConstraints) {
+  auto p = occurrences.lookup(src);
+  if (!p)
+    return false;
+  // the index changes below
+  std::vector<ref<Expr>> affected;
+  for (const ref<Expr> &e : p->second)
+    affected.push_back(e);
+  bool changed = false;
+  for (const ref<Expr> &e : affected) {
+    ref<Expr> new_e = visitor.replace(e);
+    if (new_e != e) {
+      deleteConstraints.push_back(e);
+      toAddConstraints.push_back(new_e);
+      if (constraints.erase(e))
+        fingerprint -= constraintFingerprint(e);
+      unindexOccurrences(e);
+      changed = true;
+    }
+  }
+  return changed;
 }
 
 // Non-null `to_replace` implies `UseIndependentSolver`
@@ -69,7 +219,8 @@ bool ConstraintManager::rewriteConstraints(
         if (new_e != e) {
           deleteConstraints.push_back(e);
           toAddConstraints.push_back(new_e);
-          constraints.erase(e);
+          if (constraints.erase(e))
+            fingerprint -= constraintFingerprint(e);
           changed = true;
         }
       }
@@ -86,6 +237,7 @@ bool ConstraintManager::rewriteConstraints(
         // IndependentSet as previous one.
         deleteConstraints.push_back(e);
         toAddConstraints.push_back(new_e);
+        fingerprint -= constraintFingerprint(e);
         constraints.erase(it++);
         changed = true;
       } else {
@@ -104,10 +256,25 @@ void ConstraintManager::simplifyForValidConstraint(ref<Expr> e) {
 ref<Expr> ConstraintManager::simplifyExpr(ref<Expr> e) const {
   if (isa<ConstantExpr>(e))
     return e;
+  if (SimplifyExprCache) {
+    auto it = simplified.find(e);
+    if (it != simplified.end() && it->second.first == equalitiesGeneration)
+      return it->second.second;
+  }
   if (!replaceVisitor) {
     replaceVisitor = new klee::ExprReplaceVisitorMulti(replacedUN, visitedUN, equalities);
+    visitorGeneration = equalitiesGeneration;
+  } else if (visitorGeneration != equalitiesGeneration) {
+    // the visited results predate the current equalities
+    replaceVisitor->resetVisited();
+    visitorGeneration = equalitiesGeneration;
   }
   ref<Expr> res = replaceVisitor->replace(e);
+  if (SimplifyExprCache) {
+    if (simplified.size() >= MaxSimplified)
+      simplified.clear();
+    simplified[e] = std::make_pair(equalitiesGeneration, res);
+  }
   return res;
 }
 
@@ -119,7 +286,7 @@ ref<Expr> ConstraintManager::simplifyExpr(ref<Expr> e) const {
 // `rewiteConstraints`
 bool ConstraintManager::addConstraintInternal(
     ref<Expr> e, std::vector<ref<Expr>> &toAddConstraints) {
-  if (representative.find(e) != representative.end()) {
+  if (representative.count(e)) {
     // found a duplicated constraint, nothing changed, directly return
     return false;
   }
@@ -156,7 +323,10 @@ bool ConstraintManager::addConstraintInternal(
           visitedUN.clear();
           if (replaceVisitor)
             replaceVisitor->resetVisited();
-          if (UseIndependentSolver) {
+          if (useOccurrenceIndex()) {
+            changed |= rewriteOccurrences(visitor, be->right,
+                                          deleteConstraints, toAddConstraints);
+          } else if (UseIndependentSolver) {
             // create a new IndependentElementSet of the expr to be replaced
             IndependentElementSet to_replace(be->right);
             changed |= rewriteConstraints(visitor, &to_replace,
@@ -168,7 +338,10 @@ bool ConstraintManager::addConstraintInternal(
         }
       }
     }
-    constraints.insert(e);
+    if (constraints.insert(e).second) {
+      fingerprint += constraintFingerprint(e);
+      indexOccurrences(e);
+    }
     updateEqualities(e, deleteConstraints);
     if (UseIndependentSolver) {
       // should first process deleted constraints then newly added
@@ -182,7 +355,10 @@ bool ConstraintManager::addConstraintInternal(
 
   default:
     // deleteConstraints should be empty here.
-    constraints.insert(e);
+    if (constraints.insert(e).second) {
+      fingerprint += constraintFingerprint(e);
+      indexOccurrences(e);
+    }
     updateEqualities(e, deleteConstraints);
     if (UseIndependentSolver) {
       // should first process deleted constraints then newly added
@@ -211,18 +387,20 @@ void ConstraintManager::updateIndependentSetDelete(
   // value: set of constraints (expressions) to delete in the corresponding factor
   std::unordered_map<IndependentElementSet*, ExprHashSet > updateList;
   for (auto it = deleteConstraints.begin(); it != deleteConstraints.end(); it++) {
-    auto find_it = representative.find(*it);
-    assert(find_it != representative.end());
+    auto find_it = representative.lookup(*it);
+    assert(find_it && "Seems like representative out of sync");
     IndependentElementSet *indep = find_it->second;
     assert(indep);
     updateList[indep].insert(*it);
     // Update representative.
-    assert(representative.erase(*it) &&
-           "Seems like representative out of sync");
+    representative = representative.remove(*it);
   }
 
-  // Update factors.
+  // Update factors. The erased factors may be destroyed with the last
+  // reference, keep them until they are rebuilt.
+  std::vector<ref<IndependentElementSet>> erased;
   for (auto it = updateList.begin(); it != updateList.end(); it++) {
+    erased.push_back(it->first);
     indep_indexer.erase(it->first);
   }
 
@@ -264,7 +442,7 @@ void ConstraintManager::updateIndependentSetDelete(
     for (auto r = result.begin(); r != result.end(); r++) {
       indep_indexer.insert(*r);
       for (auto e = (*r)->exprs.begin(); e != (*r)->exprs.end(); e++) {
-          representative[*e] = *r;
+        representative = representative.replace(std::make_pair(*e, *r));
       }
     }
   }
@@ -287,29 +465,31 @@ void ConstraintManager::updateIndependentSetAdd(const ref<Expr> &e) {
     assert(indep_elemsets == intersection_slowcheck && "Indexer BUG");
   }
 
-  if (indep_elemsets.size() == 1) {
+  if (indep_elemsets.size() == 1 &&
+      (*indep_elemsets.begin())->owner == indep_indexer.owner) {
     // lucky and cheap case: newly added constraint falls exactly in one
     // existing factor we can reuse the existing factor
     IndependentElementSet *singleIntersect = *(indep_elemsets.begin());
     singleIntersect->add(*current);
     indep_indexer.redirect(current, singleIntersect);
     for (auto &it : current->exprs) {
-      representative[it] = singleIntersect;
+      representative = representative.replace(std::make_pair(it, singleIntersect));
     }
     delete current;
   } else {
-    // expensive case: need to merge multiple intersected independent sets
+    // expensive case: need to merge multiple intersected independent sets,
+    // or a single one also used by another ConstraintManager, which must
+    // stay unchanged
     for (IndependentElementSet *indepSet : indep_elemsets) {
       current->add(*indepSet);
     }
     // Update representative and factors.
     for (auto it = current->exprs.begin(); it != current->exprs.end(); it++) {
-      representative[*it] = current;
+      representative = representative.replace(std::make_pair(*it, current));
     }
 
     for (IndependentElementSet *victim : indep_elemsets) {
       indep_indexer.erase(victim);
-      delete victim;
     }
 
     indep_indexer.insert(current);
@@ -319,13 +499,16 @@ void ConstraintManager::updateIndependentSetAdd(const ref<Expr> &e) {
 void ConstraintManager::updateDeleteAdd(
     const ref<Expr> &e, const std::vector<ref<Expr>> &deleteConstraints) {
   for (const ref<Expr> &e : deleteConstraints) {
-    assert(representative.erase(e) && "Seems like representative out of sync");
+    assert(representative.count(e) && "Seems like representative out of sync");
+    representative = representative.remove(e);
   }
-  representative[e] = nullptr;
+  representative = representative.replace(
+      std::make_pair(e, (IndependentElementSet *)nullptr));
 }
 
 void ConstraintManager::updateEqualities(
     const ref<Expr> &e, const std::vector<ref<Expr>> &deleteConstraints) {
+  ++equalitiesGeneration;
   { // add one new constraint e
     bool isConstantEq = false;
     if (const EqExpr *EE = dyn_cast<EqExpr>(e)) {
@@ -354,7 +537,7 @@ void ConstraintManager::updateEqualities(
 
 bool ConstraintManager::addConstraint(ref<Expr> e) {
   CompareCacheSemaphoreHolder CCSH;
-  if (representative.find(e) != representative.end()) {
+  if (representative.count(e)) {
     // found a duplicated constraint
     return true;
   }
@@ -385,12 +568,94 @@ bool ConstraintManager::addConstraint(ref<Expr> e) {
   return true;
 }
 
+size_t ConstraintManager::compact() {
+  struct Interval {
+    uint64_t lo, hi;
+    std::vector<ref<Expr>> bounds;
+  };
+  ExprHashMap<Interval> intervals;
+  for (const ref<Expr> &e : constraints) {
+    ref<Expr> x;
+    uint64_t lo, hi;
+    if (!getBound(e, x, lo, hi))
+      continue;
+    auto it = intervals.find(x);
+    if (it == intervals.end()) {
+      uint64_t max = bits64::maxValueOfNBits(x->getWidth());
+      it = intervals.insert(std::make_pair(x, Interval{0, max, {}})).first;
+    }
+    Interval &interval = it->second;
+    interval.lo = std::max(interval.lo, lo);
+    interval.hi = std::min(interval.hi, hi);
+    interval.bounds.push_back(e);
+  }
+
+  ExprHashSet removed;
+  std::vector<ref<Expr>> added;
+  for (auto &it : intervals) {
+    const ref<Expr> &x = it.first;
+    const Interval &interval = it.second;
+    // an empty interval is left for the solver to find
+    if (interval.lo > interval.hi)
+      continue;
+    Expr::Width width = x->getWidth();
+    std::vector<ref<Expr>> merged;
+    if (interval.lo == interval.hi) {
+      merged.push_back(
+          EqExpr::create(ConstantExpr::create(interval.lo, width), x));
+    } else {
+      if (interval.lo)
+        merged.push_back(
+            UleExpr::create(ConstantExpr::create(interval.lo, width), x));
+      if (interval.hi != bits64::maxValueOfNBits(width))
+        merged.push_back(
+            UleExpr::create(x, ConstantExpr::create(interval.hi, width)));
+      if (merged.size() >= interval.bounds.size())
+        continue;
+    }
+    removed.insert(interval.bounds.begin(), interval.bounds.end());
+    added.insert(added.end(), merged.begin(), merged.end());
+  }
+  if (removed.empty()) {
+    compactedSize = constraints.size();
+    return 0;
+  }
+
+  // the equalities first, which rewrite the constraints added after them
+  std::vector<ref<Expr>> ordered;
+  for (const ref<Expr> &e : added)
+    if (isConstantEquality(e))
+      ordered.push_back(e);
+  for (const ref<Expr> &e : constraints)
+    if (!removed.count(e) && isConstantEquality(e))
+      ordered.push_back(e);
+  for (const ref<Expr> &e : added)
+    if (!isConstantEquality(e))
+      ordered.push_back(e);
+  for (const ref<Expr> &e : constraints)
+    if (!removed.count(e) && !isConstantEquality(e))
+      ordered.push_back(e);
+
+  ConstraintManager rebuilt;
+  // keeps the update lists rewritten so far shared with the rewrites to come
+  rebuilt.replacedUN = replacedUN;
+  for (const ref<Expr> &e : ordered) {
+    bool valid = rebuilt.addConstraint(e);
+    assert(valid && "compaction made the constraints unsatisfiable");
+    (void)valid;
+  }
+  size_t before = constraints.size();
+  *this = rebuilt;
+  compactedSize = constraints.size();
+  return before > compactedSize ? before - compactedSize : 0;
+}
+
 void ConstraintManager::getRelatedIndependentElementSets(
     const Constraints_ty &constraints,
     IndepElemSetPtrSet_ty &out_elemsets) const {
   for (const ref<Expr> &e : constraints) {
-    auto find_it = representative.find(e);
-    assert(find_it != representative.end() &&
+    auto find_it = representative.lookup(e);
+    assert(find_it &&
            "Input constriants are not a subset of what are managed by this "
            "ConstraintManager");
     out_elemsets.insert(find_it->second);
@@ -398,7 +663,10 @@ void ConstraintManager::getRelatedIndependentElementSets(
 }
 
 ConstraintManager::ConstraintManager(const Constraints_ty &_constraints)
-    : constraints(_constraints) {
+    : constraints(_constraints),
+      fingerprint(fingerprintConstraints(_constraints)) {
+  for (const ref<Expr> &e : _constraints)
+    indexOccurrences(e);
   std::vector<IndependentElementSet *> init_indep;
   for (const ref<Expr> &e : _constraints) {
     init_indep.push_back(new IndependentElementSet(e));
@@ -420,36 +688,55 @@ ConstraintManager::ConstraintManager(const Constraints_ty &_constraints)
       for (IndependentElementSet *intersect : intersected) {
         indep->add(*intersect);
         indep_indexer.erase(intersect);
-        delete intersect;
       }
       indep_indexer.insert(indep);
     }
   }
   for (auto it = factor_begin(); it != factor_end(); ++it) {
     for (const ref<Expr> &e : (*it)->exprs) {
-      representative[e] = *it;
+      representative = representative.replace(std::make_pair(e, *it));
     }
   }
 }
 
-ConstraintManager::ConstraintManager(const ConstraintManager &cs) : constraints(cs.constraints) {
-  // Copy constructor needs to make deep copy of factors and representative
-  // Here we assume every IndependentElementSet point in representative also exist in factors.
-  for (auto it = cs.factor_begin(); it != cs.factor_end(); it++) {
-    IndependentElementSet* candidate = new IndependentElementSet(*(*it));
-    indep_indexer.insert(candidate);
-    for (auto e = candidate->exprs.begin(); e != candidate->exprs.end(); e++) {
-      representative[*e] = candidate;
-    }
-  }
+uint64_t ConstraintManager::newOwner() {
+  static uint64_t next = 0;
+  return ++next;
+}
+
+ConstraintManager::ConstraintManager(const ConstraintManager &cs)
+    : constraints(cs.constraints), fingerprint(cs.fingerprint),
+      compactedSize(cs.compactedSize), representative(cs.representative),
+      indep_indexer(cs.indep_indexer), occurrences(cs.occurrences) {
+  // Factors and representative are persistent and shared with `cs`, factors
+  // are copied when either side modifies them.
+  indep_indexer.owner = newOwner();
+  cs.indep_indexer.owner = newOwner();
+}
+
+ConstraintManager &ConstraintManager::operator=(const ConstraintManager &cs) {
+  if (this == &cs)
+    return *this;
+  constraints = cs.constraints;
+  fingerprint = cs.fingerprint;
+  compactedSize = cs.compactedSize;
+  representative = cs.representative;
+  indep_indexer = cs.indep_indexer;
+  occurrences = cs.occurrences;
+  equalities = cs.equalities;
+  ++equalitiesGeneration;
+  replacedUN = cs.replacedUN;
+  visitedUN = cs.visitedUN;
+  // the visitor refers to the maps of its own manager
+  delete replaceVisitor;
+  replaceVisitor = nullptr;
+  indep_indexer.owner = newOwner();
+  cs.indep_indexer.owner = newOwner();
+  return *this;
 }
 
 // Destructor
 ConstraintManager::~ConstraintManager() {
-  // Here we assume every IndependentElementSet point in representative also exist in factors.
-  for (auto it = factor_begin(); it != factor_end(); it++) {
-    delete(*it);
-  }
   if (replaceVisitor) {
     delete replaceVisitor;
   }
@@ -458,16 +745,18 @@ ConstraintManager::~ConstraintManager() {
 
 void ConstraintManager::IndepElementSetIndexer::insert(
     IndependentElementSet *indep) {
+  indep->owner = owner;
   redirect(indep, indep);
-  factors.insert(indep);
+  factors = factors.insert(indep);
+  ++numFactors;
 }
 
 void ConstraintManager::IndepElementSetIndexer::erase(IndependentElementSet *indep) {
   for (const Array *arr : indep->wholeObjects) {
-    assert(elements_index.count(arr) == 0 &&
+    assert(!hasElements(arr) &&
            "Removing invalid indep elemset: sparse elements is conflict with "
            "existing whole object");
-    wholeObj_index.erase(arr);
+    wholeObj_index = wholeObj_index.remove(arr);
   }
   for (auto &elem : indep->elements) {
     const Array *arr = elem.first;
@@ -475,49 +764,47 @@ void ConstraintManager::IndepElementSetIndexer::erase(IndependentElementSet *ind
     assert(wholeObj_index.count(arr) == 0 &&
            "Removing invalid indep elemset: whole object is conflict with "
            "existing sparse elements.");
-    auto it = elements_index.find(arr);
-    if (it != elements_index.end()) {
-      for (unsigned index : index_set) {
-        it->second[index] = nullptr;
-      }
+    for (unsigned index : index_set) {
+      elements_index = elements_index.remove(std::make_pair(arr, index));
     }
   }
-  factors.erase(indep);
+  // the factor may be destroyed here
+  if (factors.count(indep)) {
+    factors = factors.remove(indep);
+    --numFactors;
+  }
 }
 
 void ConstraintManager::IndepElementSetIndexer::getIntersection(const IndependentElementSet *indep, IndepElemSetPtrSet_ty &out_intersected) const {
   // check wholeObject intersection
   for (const Array *arr : indep->wholeObjects) {
-    auto wholeObj_it = wholeObj_index.find(arr);
-    auto elem_it = elements_index.find(arr);
-    if (wholeObj_it != wholeObj_index.end()) {
+    auto wholeObj_it = wholeObj_index.lookup(arr);
+    if (wholeObj_it) {
       // wholeObject intersects with wholeObject
-      assert(elem_it == elements_index.end());
+      assert(!hasElements(arr));
       out_intersected.insert(wholeObj_it->second);
-    } else if (elem_it != elements_index.end()) {
+    } else {
       // wholeObject intersects with elements
-      for (IndependentElementSet *p : elem_it->second) {
-        if (p) {
-          out_intersected.insert(p);
-        }
+      for (auto it = elements_index.lower_bound(std::make_pair(arr, 0u)),
+                ie = elements_index.end();
+           it != ie && (*it).first.first == arr; ++it) {
+        out_intersected.insert((*it).second);
       }
     }
   }
   for (auto &item : indep->elements) {
     const Array *arr = item.first;
     const DenseSet<unsigned> &index_set = item.second;
-    auto wholeObj_it = wholeObj_index.find(arr);
-    auto elem_it = elements_index.find(arr);
-    if (wholeObj_it != wholeObj_index.end()) {
+    auto wholeObj_it = wholeObj_index.lookup(arr);
+    if (wholeObj_it) {
       // elements intersects with wholeObject
-      assert(elem_it == elements_index.end());
+      assert(!hasElements(arr));
       out_intersected.insert(wholeObj_it->second);
-    } else if (elem_it != elements_index.end()) {
+    } else {
       // elements intersects with elements
       for (unsigned index : index_set) {
-        IndependentElementSet *p = elem_it->second[index];
-        if (p) {
-          out_intersected.insert(p);
+        if (auto p = elements_index.lookup(std::make_pair(arr, index))) {
+          out_intersected.insert(p->second);
         }
       }
     }
@@ -535,21 +822,21 @@ void ConstraintManager::IndepElementSetIndexer::redirect(
     //
     // In the case of multiple old sets converted to a new set:
     // Those old independent sets are always erased first (i.e. the expensive
-    // case in `UpdateIndependentSetAdd`) but an all-zero elements_index[arr]
-    // was not reclaimed.
+    // case in `UpdateIndependentSetAdd`), which already dropped
+    // elements_index[arr].
     //
     // As for the second case, a single old independent set (tracks elements)
     // should be updated to include a new independent set (tracks wholeObject).
     // This is the lucky and cheap case in `UpdateIndependentSetAdd`, where the
     // new independent set (param src is combined into the old one (param. dst).
-    // In this case, elements_index[arr] is not all-zero, but should still be
+    // In this case, elements_index[arr] is not empty, but should still be
     // erased.
-    elements_index.erase(arr);
-    wholeObj_index[arr] = dst;
+    eraseElements(arr);
+    wholeObj_index = wholeObj_index.replace(std::make_pair(arr, dst));
   }
-  for (auto elem : src->elements) {
+  for (auto &elem : src->elements) {
     const Array *arr = elem.first;
-    DenseSet<unsigned> &index_set = elem.second;
+    const DenseSet<unsigned> &index_set = elem.second;
     // It is possible that an array is accessed via independent elements but is
     // accessed symbolically (i.e. wholeObjects) in existing constraints.
     // In this scenario, there could only be one intersected independent set,
@@ -558,23 +845,39 @@ void ConstraintManager::IndepElementSetIndexer::redirect(
     // independent set from the new constraint (src), we will find some
     // src->elements may already tracked in wholeObj_index.
     // In that case, we should only update wholeObj_index.
-    auto wholeObj_it = wholeObj_index.find(arr);
-    if (wholeObj_it != wholeObj_index.end()) {
-      wholeObj_it->second = dst;
+    if (wholeObj_index.count(arr)) {
+      wholeObj_index = wholeObj_index.replace(std::make_pair(arr, dst));
     } else {
-      auto it = elements_index.emplace(std::make_pair(
-          arr,
-          std::move(std::vector<IndependentElementSet *>(arr->size, nullptr))));
       for (unsigned index : index_set) {
-        it.first->second[index] = dst;
+        elements_index =
+            elements_index.replace(std::make_pair(std::make_pair(arr, index), dst));
       }
     }
   }
 }
 
+bool ConstraintManager::IndepElementSetIndexer::hasElements(
+    const Array *arr) const {
+  auto it = elements_index.lower_bound(std::make_pair(arr, 0u));
+  return it != elements_index.end() && (*it).first.first == arr;
+}
+
+void ConstraintManager::IndepElementSetIndexer::eraseElements(
+    const Array *arr) {
+  std::vector<Element_ty> victims;
+  for (auto it = elements_index.lower_bound(std::make_pair(arr, 0u)),
+            ie = elements_index.end();
+       it != ie && (*it).first.first == arr; ++it) {
+    victims.push_back((*it).first);
+  }
+  for (const Element_ty &e : victims) {
+    elements_index = elements_index.remove(e);
+  }
+}
+
 void ConstraintManager::IndepElementSetIndexer::checkExprsSum(size_t NExprs) {
   size_t n = 0;
-  for (const IndependentElementSet *e : factors) {
+  for (const ref<IndependentElementSet> &e : factors) {
     n += e->exprs.size();
   }
   assert(n == NExprs);
@@ -601,12 +904,6 @@ void ConstraintManager::dumpEqualities(const char *filename) {
  * Template instantiation for embedding useful debugging helpers
  * Avoid "cannot evaluate" problems in gdb
  */
-// for representative
-template class std::unordered_map<ref<klee::Expr>, klee::IndependentElementSet *, klee::util::RefHash<klee::Expr>, klee::util::RefCmp<klee::Expr> >;
-// for factors
+// for intersection results
 template class std::unordered_set<IndependentElementSet*>;
-// for elements_index
-template class std::unordered_map<const Array *, std::vector<IndependentElementSet*>>;
-// for wholeObj_index
-template class std::unordered_map<const Array *, IndependentElementSet*>;
 
@@ -23,7 +23,9 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
 #include <sstream>
+#include <unordered_map>
 
 using namespace klee;
 using llvm::APInt;
@@ -36,6 +38,14 @@ cl::OptionCategory
 }
 
 namespace {
+cl::opt<bool, true> HashConsExprs(
+    "hash-cons-exprs", cl::location(Expr::hashConsing),
+    cl::desc("Share structurally equal expressions through a global unique "
+             "table, so that equal expressions compare by pointer. Shared "
+             "nodes keep a single instruction binding (see -kinst-binding) "
+             "(default=false)"),
+    cl::cat(klee::ExprCat));
+
 cl::opt<bool> ConstArrayOpt(
     "const-array-opt", cl::init(false),
     cl::desc(
@@ -68,6 +78,47 @@ cl::opt<Expr::KInstBindingPolicy> KInstBinding(
 /***/
 
 unsigned Expr::count = 0;
+bool Expr::hashConsing = false;
+
+namespace {
+/// The global unique table: hash -> hash-consed nodes with that hash.
+/// Nodes are compared structurally when looked up and by address when
+/// erased, which is done from ~Expr after the subclass has been destroyed.
+typedef std::unordered_multimap<unsigned, Expr *> UniqueTable;
+
+UniqueTable &getUniqueTable() {
+  // never destroyed, expressions may outlive static destructors
+  static UniqueTable *table = new UniqueTable();
+  return *table;
+}
+} // namespace
+
+ref<Expr> Expr::hashCons(const ref<Expr> &e) {
+  if (e->isHashConsed() || isa<ConstantExpr>(e))
+    return e;
+  UniqueTable &table = getUniqueTable();
+  auto range = table.equal_range(e->hashValue);
+  for (auto it = range.first; it != range.second; ++it)
+    if (it->second->compare(*e) == 0)
+      return it->second;
+  e->flags |= FLAG_HASHCONSED;
+  table.insert(std::make_pair(e->hashValue, e.get()));
+  return e;
+}
+
+void Expr::eraseHashConsed() {
+  UniqueTable &table = getUniqueTable();
+  auto range = table.equal_range(hashValue);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (it->second == this) {
+      table.erase(it);
+      return;
+    }
+  }
+}
+
+size_t Expr::getNumHashConsed() { return getUniqueTable().size(); }
+
 const char *Expr::getKindStr(enum Expr::Kind k) {
   switch (k) {
     case Expr::Constant: return "Constant";
@@ -154,7 +205,7 @@ std::string klee::getKInstDbgInfoOrNull(const KInstruction *ki) {
     if (info) {
       return info->file + ":" +
         std::to_string(info->line) + "," + std::to_string(info->column) +
-        " [asm " + std::to_string(info->assemblyLine) + "]";
+        " [asm " + std::to_string(info->getAssemblyLine()) + "]";
     }
     else {
       return "N/A";
@@ -256,7 +307,10 @@ int Expr::compare_internal(const Expr &b) const {
   if (ak == bk && ak == Expr::Constant) {
     return compareContents(b);
   }
-  if (equivs.count(std::make_pair(ref<const Expr>(ap), ref<const Expr>(bp))))
+  // distinct hash-consed nodes are never equal, the cache can only miss
+  bool uncached = isHashConsed() && b.isHashConsed();
+  if (!uncached &&
+      equivs.count(std::make_pair(ref<const Expr>(ap), ref<const Expr>(bp))))
     return 0;
 
   if (ak!=bk)
@@ -273,7 +327,8 @@ int Expr::compare_internal(const Expr &b) const {
     if (int res = getKid(i)->compare_internal(*b.getKid(i)))
       return res;
 
-  equivs.insert(std::make_pair(ref<const Expr>(ap), ref<const Expr>(bp)));
+  if (!uncached)
+    equivs.insert(std::make_pair(ref<const Expr>(ap), ref<const Expr>(bp)));
   return 0;
 }
 
@@ -460,11 +515,11 @@ void Expr::printWidth(llvm::raw_ostream &os, Width width) {
   }
 }
 
-ref<Expr> Expr::createImplies(ref<Expr> hyp, ref<Expr> conc) {
+ref<Expr> Expr::createImplies(const ref<Expr> &hyp, const ref<Expr> &conc) {
   return OrExpr::create(Expr::createIsZero(hyp), conc);
 }
 
-ref<Expr> Expr::createIsZero(ref<Expr> e) {
+ref<Expr> Expr::createIsZero(const ref<Expr> &e) {
   return EqExpr::create(e, ConstantExpr::create(0, e->getWidth()));
 }
 
@@ -517,8 +572,15 @@ void ConstantExpr::toString(std::string &Res, unsigned radix) const {
   Res = value.toString(radix, false);
 }
 
+// Constants of at most 64 bits are folded on their uint64_t values (see
+// IntEvaluation.h), avoiding the APInt temporaries of the generic path.
+
 ref<ConstantExpr> ConstantExpr::Concat(const ref<ConstantExpr> &RHS) {
   Expr::Width W = getWidth() + RHS->getWidth();
+  if (W <= 64)
+    return ConstantExpr::alloc(
+        (value.getZExtValue() << RHS->getWidth()) | RHS->value.getZExtValue(),
+        W);
   APInt Tmp(value);
   Tmp=Tmp.zext(W);
   Tmp <<= RHS->getWidth();
@@ -528,30 +590,56 @@ ref<ConstantExpr> ConstantExpr::Concat(const ref<ConstantExpr> &RHS) {
 }
 
 ref<ConstantExpr> ConstantExpr::Extract(unsigned Offset, Width W) {
+  Width width = getWidth();
+  if (width <= 64 && W <= width && Offset < width) {
+    int64_t v = ints::sext(value.getZExtValue(), 64, width);
+    return ConstantExpr::alloc(bits64::truncateToNBits(v >> Offset, W), W);
+  }
   return ConstantExpr::alloc(APInt(value.ashr(Offset)).zextOrTrunc(W));
 }
 
 ref<ConstantExpr> ConstantExpr::ZExt(Width W) {
+  if (getWidth() <= 64 && W <= 64)
+    return ConstantExpr::alloc(
+        bits64::truncateToNBits(value.getZExtValue(), W), W);
   return ConstantExpr::alloc(APInt(value).zextOrTrunc(W));
 }
 
 ref<ConstantExpr> ConstantExpr::SExt(Width W) {
+  if (getWidth() <= 64 && W <= 64)
+    return ConstantExpr::alloc(ints::sext(value.getZExtValue(), W, getWidth()),
+                               W);
   return ConstantExpr::alloc(APInt(value).sextOrTrunc(W));
 }
 
 ref<ConstantExpr> ConstantExpr::Add(const ref<ConstantExpr> &RHS) {
+  Width W = getWidth();
+  if (W <= 64)
+    return ConstantExpr::alloc(
+        ints::add(value.getZExtValue(), RHS->value.getZExtValue(), W), W);
   return ConstantExpr::alloc(value + RHS->value);
 }
 
 ref<ConstantExpr> ConstantExpr::Neg() {
+  Width W = getWidth();
+  if (W <= 64)
+    return ConstantExpr::alloc(ints::sub(0, value.getZExtValue(), W), W);
   return ConstantExpr::alloc(-value);
 }
 
 ref<ConstantExpr> ConstantExpr::Sub(const ref<ConstantExpr> &RHS) {
+  Width W = getWidth();
+  if (W <= 64)
+    return ConstantExpr::alloc(
+        ints::sub(value.getZExtValue(), RHS->value.getZExtValue(), W), W);
   return ConstantExpr::alloc(value - RHS->value);
 }
 
 ref<ConstantExpr> ConstantExpr::Mul(const ref<ConstantExpr> &RHS) {
+  Width W = getWidth();
+  if (W <= 64)
+    return ConstantExpr::alloc(
+        ints::mul(value.getZExtValue(), RHS->value.getZExtValue(), W), W);
   return ConstantExpr::alloc(value * RHS->value);
 }
 
@@ -572,30 +660,65 @@ ref<ConstantExpr> ConstantExpr::SRem(const ref<ConstantExpr> &RHS) {
 }
 
 ref<ConstantExpr> ConstantExpr::And(const ref<ConstantExpr> &RHS) {
+  Width W = getWidth();
+  if (W <= 64)
+    return ConstantExpr::alloc(
+        value.getZExtValue() & RHS->value.getZExtValue(), W);
   return ConstantExpr::alloc(value & RHS->value);
 }
 
 ref<ConstantExpr> ConstantExpr::Or(const ref<ConstantExpr> &RHS) {
+  Width W = getWidth();
+  if (W <= 64)
+    return ConstantExpr::alloc(
+        value.getZExtValue() | RHS->value.getZExtValue(), W);
   return ConstantExpr::alloc(value | RHS->value);
 }
 
 ref<ConstantExpr> ConstantExpr::Xor(const ref<ConstantExpr> &RHS) {
+  Width W = getWidth();
+  if (W <= 64)
+    return ConstantExpr::alloc(
+        value.getZExtValue() ^ RHS->value.getZExtValue(), W);
   return ConstantExpr::alloc(value ^ RHS->value);
 }
 
+// Shifts by the width or more give 0 (or the sign bits), as with APInt.
+
 ref<ConstantExpr> ConstantExpr::Shl(const ref<ConstantExpr> &RHS) {
+  Width W = getWidth();
+  if (W <= 64) {
+    uint64_t shift = RHS->value.getLimitedValue(W);
+    return ConstantExpr::alloc(
+        shift >= W ? 0 : ints::shl(value.getZExtValue(), shift, W), W);
+  }
   return ConstantExpr::alloc(value.shl(RHS->value));
 }
 
 ref<ConstantExpr> ConstantExpr::LShr(const ref<ConstantExpr> &RHS) {
+  Width W = getWidth();
+  if (W <= 64) {
+    uint64_t shift = RHS->value.getLimitedValue(W);
+    return ConstantExpr::alloc(
+        shift >= W ? 0 : ints::lshr(value.getZExtValue(), shift, W), W);
+  }
   return ConstantExpr::alloc(value.lshr(RHS->value));
 }
 
 ref<ConstantExpr> ConstantExpr::AShr(const ref<ConstantExpr> &RHS) {
+  Width W = getWidth();
+  if (W <= 64) {
+    uint64_t shift = std::min<uint64_t>(RHS->value.getLimitedValue(W), W - 1);
+    return ConstantExpr::alloc(ints::ashr(value.getZExtValue(), shift, W), W);
+  }
   return ConstantExpr::alloc(value.ashr(RHS->value));
 }
 
 ref<ConstantExpr> ConstantExpr::Not() {
+  Width W = getWidth();
+  if (W <= 64)
+    return ConstantExpr::alloc(
+        bits64::truncateToNBits(~value.getZExtValue(), W), W);
   return ConstantExpr::alloc(~value);
 }
 
@@ -641,7 +764,7 @@ ref<ConstantExpr> ConstantExpr::Sge(const ref<ConstantExpr> &RHS) {
 
 /***/
 
-ref<Expr>  NotOptimizedExpr::create(ref<Expr> src) {
+ref<Expr>  NotOptimizedExpr::create(const ref<Expr> &src) {
   return NotOptimizedExpr::alloc(src);
 }
 
@@ -678,7 +801,7 @@ unsigned Array::computeHash() {
 }
 /***/
 
-ref<Expr> ReadExpr::create(const UpdateList &ul, ref<Expr> index) {
+ref<Expr> ReadExpr::create(const UpdateList &ul, const ref<Expr> &index) {
   // rollback update nodes if possible
 
   // Iterate through the update list from the most recent to the
@@ -687,6 +810,15 @@ ref<Expr> ReadExpr::create(const UpdateList &ul, ref<Expr> index) {
   // array element has been updated
   auto un = ul.head.get();
   bool updateListHasSymbolicWrites = false;
+  ConstantExpr *CI = dyn_cast<ConstantExpr>(index);
+  if (CI && un && un->getSize() >= UpdateNode::MinIndexedSize &&
+      CI->getWidth() <= 64) {
+    // look the concrete writes up instead of walking them
+    const UpdateNode::ConcreteWrites &writes = un->getConcreteWrites();
+    if (const auto *w = writes.latest.lookup(CI->getZExtValue()))
+      return w->second->value;
+    un = writes.rest;
+  }
   for (; un; un = un->next.get()) {
     ref<Expr> cond = EqExpr::create(index, un->index);
     if (ConstantExpr *CE = dyn_cast<ConstantExpr>(cond)) {
@@ -732,7 +864,8 @@ int ReadExpr::compareContents(const Expr &b) const {
   return updates.compare(static_cast<const ReadExpr&>(b).updates);
 }
 
-ref<Expr> SelectExpr::create(ref<Expr> c, ref<Expr> t, ref<Expr> f) {
+ref<Expr> SelectExpr::create(const ref<Expr> &c, const ref<Expr> &t,
+                             const ref<Expr> &f) {
   Expr::Width kt = t->getWidth();
 
   assert(c->getWidth()==Bool && "type mismatch");
@@ -822,7 +955,7 @@ ref<Expr> ConcatExpr::create8(const ref<Expr> &kid1, const ref<Expr> &kid2,
 
 /***/
 
-ref<Expr> ExtractExpr::create(ref<Expr> expr, unsigned off, Width w) {
+ref<Expr> ExtractExpr::create(const ref<Expr> &expr, unsigned off, Width w) {
   unsigned kw = expr->getWidth();
   assert(w > 0 && off + w <= kw && "invalid extract");
   
@@ -0,0 +1,107 @@
+//===-- ExprArena.cpp -----------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Expr/ExprArena.h"
+
+#include "klee/Internal/System/MemoryUsage.h"
+
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <unordered_set>
+
+using namespace klee;
+
+/// Header at the start of every chunk.
+struct ExprArena::Chunk {
+  /// nodes allocated in the chunk and not freed yet
+  size_t live = 0;
+  /// set once the owning arena is gone
+  bool retired = false;
+};
+
+namespace {
+const size_t Alignment = alignof(std::max_align_t);
+
+/// Addresses of all chunks not released yet.
+std::unordered_set<uintptr_t> &getChunks() {
+  // never destroyed, nodes may be freed by static destructors
+  static std::unordered_set<uintptr_t> *chunks =
+      new std::unordered_set<uintptr_t>();
+  return *chunks;
+}
+} // namespace
+
+ExprArena *ExprArena::current = nullptr;
+
+static void releaseChunk(void *chunk) {
+  getChunks().erase((uintptr_t)chunk);
+  std::free(chunk);
+}
+
+ExprArena::ExprArena() : parent(current) { current = this; }
+
+ExprArena::~ExprArena() {
+  assert(current == this && "ExprArenas must be destroyed in reverse order");
+  current = parent;
+  for (Chunk *chunk : chunks) {
+    if (chunk->live == 0)
+      releaseChunk(chunk);
+    else
+      chunk->retired = true;
+  }
+}
+
+void *ExprArena::allocateInArena(size_t size) {
+  const size_t headerSize = (sizeof(Chunk) + Alignment - 1) & ~(Alignment - 1);
+  size = (size + Alignment - 1) & ~(Alignment - 1);
+  if (size > ChunkSize - headerSize)
+    return nullptr;
+  if ((size_t)(end - cur) < size) {
+    void *memory;
+    if (posix_memalign(&memory, ChunkSize, ChunkSize) != 0)
+      return nullptr;
+    chunks.push_back(new (memory) Chunk());
+    getChunks().insert((uintptr_t)memory);
+    cur = (char *)memory + headerSize;
+    end = (char *)memory + ChunkSize;
+  }
+  ++chunks.back()->live;
+  void *p = cur;
+  cur += size;
+  return p;
+}
+
+void *ExprArena::allocate(size_t size) {
+  util::TrackMemory(util::MemoryTag::Expr, size);
+  if (current)
+    if (void *p = current->allocateInArena(size))
+      return p;
+  return ::operator new(size);
+}
+
+void ExprArena::deallocate(void *p, size_t size) {
+  util::TrackMemory(util::MemoryTag::Expr, -(int64_t)size);
+  std::unordered_set<uintptr_t> &all = getChunks();
+  if (!all.empty()) {
+    // heap memory never lies inside a chunk
+    uintptr_t base = (uintptr_t)p & ~(uintptr_t)(ChunkSize - 1);
+    if (all.count(base)) {
+      Chunk *chunk = (Chunk *)base;
+      assert(chunk->live && "double free in ExprArena");
+      if (--chunk->live == 0 && chunk->retired)
+        releaseChunk(chunk);
+      return;
+    }
+  }
+  ::operator delete(p);
+}
+
+size_t ExprArena::getNumChunks() { return getChunks().size(); }
@@ -1052,6 +1052,549 @@ namespace {
 
   typedef ConstantSpecializedExprBuilder<SimplifyingBuilder>
     SimplifyingExprBuilder;
+
+  /// HashConsingExprBuilder - Expression builder which shares structurally
+  /// equal expressions through the global unique table. Hash consing is
+  /// turned on for the lifetime of the builder, so the expressions made by
+  /// the base builder and by the Expr::create factories it calls are shared
+  /// as well.
+  class HashConsingExprBuilder : public ExprBuilder {
+    ExprBuilder *Base;
+    bool WasHashConsing;
+
+  public:
+    HashConsingExprBuilder(ExprBuilder *_Base)
+      : Base(_Base), WasHashConsing(Expr::hashConsing) {
+      Expr::hashConsing = true;
+    }
+    ~HashConsingExprBuilder() {
+      Expr::hashConsing = WasHashConsing;
+      delete Base;
+    }
+
+    virtual ref<Expr> Constant(const llvm::APInt &Value) {
+      return Base->Constant(Value);
+    }
+
+    virtual ref<Expr> NotOptimized(const ref<Expr> &Index) {
+      return Expr::hashCons(Base->NotOptimized(Index));
+    }
+
+    virtual ref<Expr> Read(const UpdateList &Updates,
+                           const ref<Expr> &Index) {
+      return Expr::hashCons(Base->Read(Updates, Index));
+    }
+
+    virtual ref<Expr> Select(const ref<Expr> &Cond,
+                             const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Expr::hashCons(Base->Select(Cond, LHS, RHS));
+    }
+
+    virtual ref<Expr> Concat(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Expr::hashCons(Base->Concat(LHS, RHS));
+    }
+
+    virtual ref<Expr> Extract(const ref<Expr> &LHS,
+                              unsigned Offset, Expr::Width W) {
+      return Expr::hashCons(Base->Extract(LHS, Offset, W));
+    }
+
+    virtual ref<Expr> ZExt(const ref<Expr> &LHS, Expr::Width W) {
+      return Expr::hashCons(Base->ZExt(LHS, W));
+    }
+
+    virtual ref<Expr> SExt(const ref<Expr> &LHS, Expr::Width W) {
+      return Expr::hashCons(Base->SExt(LHS, W));
+    }
+
+    virtual ref<Expr> Add(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Expr::hashCons(Base->Add(LHS, RHS));
+    }
+
+    virtual ref<Expr> Sub(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Expr::hashCons(Base->Sub(LHS, RHS));
+    }
+
+    virtual ref<Expr> Mul(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Expr::hashCons(Base->Mul(LHS, RHS));
+    }
+
+    virtual ref<Expr> UDiv(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Expr::hashCons(Base->UDiv(LHS, RHS));
+    }
+
+    virtual ref<Expr> SDiv(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Expr::hashCons(Base->SDiv(LHS, RHS));
+    }
+
+    virtual ref<Expr> URem(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Expr::hashCons(Base->URem(LHS, RHS));
+    }
+
+    virtual ref<Expr> SRem(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Expr::hashCons(Base->SRem(LHS, RHS));
+    }
+
+    virtual ref<Expr> Not(const ref<Expr> &LHS) {
+      return Expr::hashCons(Base->Not(LHS));
+    }
+
+    virtual ref<Expr> And(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Expr::hashCons(Base->And(LHS, RHS));
+    }
+
+    virtual ref<Expr> Or(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Expr::hashCons(Base->Or(LHS, RHS));
+    }
+
+    virtual ref<Expr> Xor(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Expr::hashCons(Base->Xor(LHS, RHS));
+    }
+
+    virtual ref<Expr> Shl(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Expr::hashCons(Base->Shl(LHS, RHS));
+    }
+
+    virtual ref<Expr> LShr(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Expr::hashCons(Base->LShr(LHS, RHS));
+    }
+
+    virtual ref<Expr> AShr(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Expr::hashCons(Base->AShr(LHS, RHS));
+    }
+
+    virtual ref<Expr> Eq(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Expr::hashCons(Base->Eq(LHS, RHS));
+    }
+
+    virtual ref<Expr> Ne(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Expr::hashCons(Base->Ne(LHS, RHS));
+    }
+
+    virtual ref<Expr> Ult(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Expr::hashCons(Base->Ult(LHS, RHS));
+    }
+
+    virtual ref<Expr> Ule(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Expr::hashCons(Base->Ule(LHS, RHS));
+    }
+
+    virtual ref<Expr> Ugt(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Expr::hashCons(Base->Ugt(LHS, RHS));
+    }
+
+    virtual ref<Expr> Uge(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Expr::hashCons(Base->Uge(LHS, RHS));
+    }
+
+    virtual ref<Expr> Slt(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Expr::hashCons(Base->Slt(LHS, RHS));
+    }
+
+    virtual ref<Expr> Sle(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Expr::hashCons(Base->Sle(LHS, RHS));
+    }
+
+    virtual ref<Expr> Sgt(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Expr::hashCons(Base->Sgt(LHS, RHS));
+    }
+
+    virtual ref<Expr> Sge(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Expr::hashCons(Base->Sge(LHS, RHS));
+    }
+  };
+
+  /// AlgebraicExprBuilder - Expression builder which rewrites bit-level
+  /// arithmetic into byte-granular Concat/Extract form. Shifts, divisions and
+  /// remainders by constants become Extract/ZExt/Concat, masks become
+  /// Extracts and bitwise operations on disjoint bits become Concats, using
+  /// the bits known to be zero in the operands. The rewrites are themselves
+  /// built by this builder, the remaining nodes by the base builder.
+  class AlgebraicExprBuilder : public ExprBuilder {
+    ExprBuilder *Base;
+
+    /// Bits of e known to be zero, looking at most MaxDepth levels down.
+    static llvm::APInt knownZero(const ref<Expr> &e, unsigned depth = 0) {
+      static const unsigned MaxDepth = 8;
+      Expr::Width w = e->getWidth();
+      if (const ConstantExpr *CE = dyn_cast<ConstantExpr>(e))
+        return ~CE->getAPValue();
+      if (depth == MaxDepth)
+        return llvm::APInt(w, 0);
+      switch (e->getKind()) {
+      case Expr::ZExt: {
+        const ref<Expr> &src = cast<ZExtExpr>(e)->src;
+        return knownZero(src, depth + 1).zext(w) |
+               llvm::APInt::getHighBitsSet(w, w - src->getWidth());
+      }
+      case Expr::Concat: {
+        const ConcatExpr *ce = cast<ConcatExpr>(e);
+        Expr::Width rw = ce->getRight()->getWidth();
+        return knownZero(ce->getLeft(), depth + 1).zext(w).shl(rw) |
+               knownZero(ce->getRight(), depth + 1).zext(w);
+      }
+      case Expr::Extract: {
+        const ExtractExpr *ee = cast<ExtractExpr>(e);
+        return knownZero(ee->expr, depth + 1).lshr(ee->offset).trunc(w);
+      }
+      case Expr::And:
+        return knownZero(e->getKid(0), depth + 1) |
+               knownZero(e->getKid(1), depth + 1);
+      case Expr::Or:
+      case Expr::Xor:
+        return knownZero(e->getKid(0), depth + 1) &
+               knownZero(e->getKid(1), depth + 1);
+      case Expr::Select:
+        return knownZero(e->getKid(1), depth + 1) &
+               knownZero(e->getKid(2), depth + 1);
+      default:
+        return llvm::APInt(w, 0);
+      }
+    }
+
+    /// The shift amount of a shift by a constant smaller than the width, 0
+    /// if there is none.
+    static unsigned constantShift(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      const ConstantExpr *CE = dyn_cast<ConstantExpr>(RHS);
+      if (!CE || LHS->getWidth() == Expr::Bool ||
+          CE->getAPValue().uge(LHS->getWidth()))
+        return 0;
+      return (unsigned)CE->getZExtValue();
+    }
+
+    ref<Expr> Zero(Expr::Width W) { return Base->Constant(llvm::APInt(W, 0)); }
+
+    /// a | b, a ^ b or a + b of operands without common non-zero bits, as
+    /// the concatenation of the high bits of one with the low bits of the
+    /// other, or null if their bits are not split that way.
+    ref<Expr> disjointConcat(const ref<Expr> &a, const ref<Expr> &b) {
+      Expr::Width w = a->getWidth();
+      if (w == Expr::Bool)
+        return nullptr;
+      llvm::APInt za = knownZero(a), zb = knownZero(b);
+      if (za.isAllOnesValue())
+        return b;
+      if (zb.isAllOnesValue())
+        return a;
+      for (int swap = 0; swap != 2; ++swap) {
+        const ref<Expr> &hi = swap ? b : a, &lo = swap ? a : b;
+        const llvm::APInt &zhi = swap ? zb : za, &zlo = swap ? za : zb;
+        // hi is zero below k and lo from k up, for k in [w - lz, tz]
+        unsigned tz = zhi.countTrailingOnes(), lz = zlo.countLeadingOnes();
+        if (tz == 0 || lz == 0 || tz + lz < w)
+          continue;
+        // split at a byte boundary when there is one
+        unsigned k = tz - tz % 8;
+        if (k < w - lz || k == 0)
+          k = tz;
+        return Concat(Extract(hi, k, w - k), Extract(lo, 0, k));
+      }
+      return nullptr;
+    }
+
+    /// Op(Extract(LHS), Extract(RHS)) of the bits of a binary node, if the
+    /// extraction simplifies one of the kids, otherwise null.
+    ref<Expr> distributeExtract(const BinaryExpr *be, unsigned Offset,
+                                Expr::Width W) {
+      ref<Expr> l = Extract(be->left, Offset, W);
+      ref<Expr> r = Extract(be->right, Offset, W);
+      auto unchanged = [](const ref<Expr> &x, const ref<Expr> &kid) {
+        const ExtractExpr *ee = dyn_cast<ExtractExpr>(x);
+        return ee && ee->expr == kid;
+      };
+      if (unchanged(l, be->left) && unchanged(r, be->right))
+        return nullptr;
+      switch (be->getKind()) {
+      case Expr::And: return And(l, r);
+      case Expr::Or: return Or(l, r);
+      case Expr::Xor: return Xor(l, r);
+      case Expr::Add: return Add(l, r);
+      case Expr::Sub: return Sub(l, r);
+      case Expr::Mul: return Mul(l, r);
+      default: llvm_unreachable("not a distributive operation");
+      }
+    }
+
+  public:
+    AlgebraicExprBuilder(ExprBuilder *_Base) : Base(_Base) {}
+    ~AlgebraicExprBuilder() { delete Base; }
+
+    virtual ref<Expr> Constant(const llvm::APInt &Value) {
+      return Base->Constant(Value);
+    }
+
+    virtual ref<Expr> NotOptimized(const ref<Expr> &Index) {
+      return Base->NotOptimized(Index);
+    }
+
+    virtual ref<Expr> Read(const UpdateList &Updates,
+                           const ref<Expr> &Index) {
+      return Base->Read(Updates, Index);
+    }
+
+    virtual ref<Expr> Select(const ref<Expr> &Cond,
+                             const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Base->Select(Cond, LHS, RHS);
+    }
+
+    virtual ref<Expr> Concat(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Base->Concat(LHS, RHS);
+    }
+
+    virtual ref<Expr> Extract(const ref<Expr> &LHS,
+                              unsigned Offset, Expr::Width W) {
+      if (W == LHS->getWidth())
+        return LHS;
+      // Extract of bits known to be zero ==> 0
+      if (knownZero(LHS).lshr(Offset).trunc(W).isAllOnesValue())
+        return Zero(W);
+      ref<Expr> res;
+      switch (LHS->getKind()) {
+      case Expr::Concat: {
+        const ConcatExpr *ce = cast<ConcatExpr>(LHS);
+        Expr::Width rw = ce->getRight()->getWidth();
+        if (Offset >= rw)
+          return Extract(ce->getLeft(), Offset - rw, W);
+        if (Offset + W <= rw)
+          return Extract(ce->getRight(), Offset, W);
+        return Concat(Extract(ce->getLeft(), 0, Offset + W - rw),
+                      Extract(ce->getRight(), Offset, rw - Offset));
+      }
+      case Expr::ZExt:
+      case Expr::SExt: {
+        const ref<Expr> &src = cast<CastExpr>(LHS)->src;
+        Expr::Width sw = src->getWidth();
+        if (Offset + W <= sw)
+          return Extract(src, Offset, W);
+        // Extract(ZExt(x)) straddling the width of x ==> ZExt(Extract(x))
+        if (LHS->getKind() == Expr::ZExt && Offset < sw)
+          return ZExt(Extract(src, Offset, sw - Offset), W);
+        break;
+      }
+      case Expr::Extract: {
+        const ExtractExpr *ee = cast<ExtractExpr>(LHS);
+        return Extract(ee->expr, ee->offset + Offset, W);
+      }
+      case Expr::And:
+      case Expr::Or:
+      case Expr::Xor:
+        res = distributeExtract(cast<BinaryExpr>(LHS), Offset, W);
+        if (!res.isNull())
+          return res;
+        break;
+      case Expr::Add:
+      case Expr::Sub:
+      case Expr::Mul:
+        // the low bits only depend on the low bits of the operands
+        if (Offset == 0) {
+          res = distributeExtract(cast<BinaryExpr>(LHS), Offset, W);
+          if (!res.isNull())
+            return res;
+        }
+        break;
+      default:
+        break;
+      }
+      return Base->Extract(LHS, Offset, W);
+    }
+
+    virtual ref<Expr> ZExt(const ref<Expr> &LHS, Expr::Width W) {
+      // ZExt(ZExt(x)) ==> ZExt(x)
+      if (const ZExtExpr *ze = dyn_cast<ZExtExpr>(LHS))
+        return ZExt(ze->src, W);
+      return Base->ZExt(LHS, W);
+    }
+
+    virtual ref<Expr> SExt(const ref<Expr> &LHS, Expr::Width W) {
+      return Base->SExt(LHS, W);
+    }
+
+    virtual ref<Expr> Add(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      // disjoint operands do not carry, the constant of a linear formula
+      // stays on the left
+      if (!isa<ConstantExpr>(LHS) && !isa<ConstantExpr>(RHS)) {
+        ref<Expr> res = disjointConcat(LHS, RHS);
+        if (!res.isNull())
+          return res;
+      }
+      return Base->Add(LHS, RHS);
+    }
+
+    virtual ref<Expr> Sub(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Base->Sub(LHS, RHS);
+    }
+
+    virtual ref<Expr> Mul(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Base->Mul(LHS, RHS);
+    }
+
+    virtual ref<Expr> UDiv(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      // X u/ 2^k ==> X >> k
+      if (const ConstantExpr *CE = dyn_cast<ConstantExpr>(RHS))
+        if (LHS->getWidth() != Expr::Bool && CE->getAPValue().isPowerOf2())
+          return LShr(LHS, Base->Constant(llvm::APInt(
+                               LHS->getWidth(), CE->getAPValue().logBase2())));
+      return Base->UDiv(LHS, RHS);
+    }
+
+    virtual ref<Expr> SDiv(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Base->SDiv(LHS, RHS);
+    }
+
+    virtual ref<Expr> URem(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      // X u% 2^k ==> ZExt(Extract(X, 0, k))
+      if (const ConstantExpr *CE = dyn_cast<ConstantExpr>(RHS)) {
+        Expr::Width w = LHS->getWidth();
+        if (w != Expr::Bool && CE->getAPValue().isPowerOf2()) {
+          unsigned k = CE->getAPValue().logBase2();
+          return k == 0 ? Zero(w) : ZExt(Extract(LHS, 0, k), w);
+        }
+      }
+      return Base->URem(LHS, RHS);
+    }
+
+    virtual ref<Expr> SRem(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Base->SRem(LHS, RHS);
+    }
+
+    virtual ref<Expr> Not(const ref<Expr> &LHS) {
+      return Base->Not(LHS);
+    }
+
+    virtual ref<Expr> And(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      const ConstantExpr *CE = dyn_cast<ConstantExpr>(LHS);
+      const ref<Expr> &X = CE ? RHS : LHS;
+      if (!CE)
+        CE = dyn_cast<ConstantExpr>(RHS);
+      Expr::Width w = X->getWidth();
+      if (CE && !isa<ConstantExpr>(X) && w != Expr::Bool) {
+        const llvm::APInt &mask = CE->getAPValue();
+        llvm::APInt zero = knownZero(X);
+        // the mask only clears bits already zero
+        if ((mask | zero).isAllOnesValue())
+          return X;
+        if ((mask & ~zero).isNullValue())
+          return Zero(w);
+        // a byte-aligned mask of contiguous bits ==> Extract
+        if (mask.isShiftedMask()) {
+          unsigned lo = mask.countTrailingZeros();
+          unsigned hi = w - mask.countLeadingZeros();
+          if (lo == 0 || (lo % 8 == 0 && hi % 8 == 0)) {
+            ref<Expr> bits = Extract(X, lo, hi - lo);
+            if (lo)
+              bits = Concat(bits, Zero(lo));
+            return ZExt(bits, w);
+          }
+        }
+      }
+      return Base->And(LHS, RHS);
+    }
+
+    virtual ref<Expr> Or(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      if (!isa<ConstantExpr>(LHS) || !isa<ConstantExpr>(RHS)) {
+        ref<Expr> res = disjointConcat(LHS, RHS);
+        if (!res.isNull())
+          return res;
+      }
+      return Base->Or(LHS, RHS);
+    }
+
+    virtual ref<Expr> Xor(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      if (!isa<ConstantExpr>(LHS) || !isa<ConstantExpr>(RHS)) {
+        ref<Expr> res = disjointConcat(LHS, RHS);
+        if (!res.isNull())
+          return res;
+      }
+      return Base->Xor(LHS, RHS);
+    }
+
+    virtual ref<Expr> Shl(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      // X << k ==> Concat(Extract(X, 0, w - k), 0)
+      if (unsigned k = constantShift(LHS, RHS)) {
+        Expr::Width w = LHS->getWidth();
+        return Concat(Extract(LHS, 0, w - k), Zero(k));
+      }
+      return Base->Shl(LHS, RHS);
+    }
+
+    virtual ref<Expr> LShr(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      // X >> k ==> ZExt(Extract(X, k, w - k))
+      if (unsigned k = constantShift(LHS, RHS)) {
+        Expr::Width w = LHS->getWidth();
+        return ZExt(Extract(LHS, k, w - k), w);
+      }
+      return Base->LShr(LHS, RHS);
+    }
+
+    virtual ref<Expr> AShr(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      // X >>a k ==> SExt(Extract(X, k, w - k))
+      if (unsigned k = constantShift(LHS, RHS)) {
+        Expr::Width w = LHS->getWidth();
+        return SExt(Extract(LHS, k, w - k), w);
+      }
+      return Base->AShr(LHS, RHS);
+    }
+
+    virtual ref<Expr> Eq(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      if (const ConstantExpr *CE = dyn_cast<ConstantExpr>(LHS)) {
+        if (CE->getWidth() != Expr::Bool && !isa<ConstantExpr>(RHS)) {
+          // a set bit of C known to be zero in X ==> false
+          if ((CE->getAPValue() & knownZero(RHS)).getBoolValue())
+            return Base->Constant(llvm::APInt(1, 0));
+          // C == ZExt(x) ==> Extract(C) == x, the high bits of C are zero
+          if (const ZExtExpr *ze = dyn_cast<ZExtExpr>(RHS))
+            return Eq(Base->Constant(
+                          CE->getAPValue().trunc(ze->src->getWidth())),
+                      ze->src);
+          // C == Concat(a, b) ==> C_hi == a && C_lo == b
+          if (const ConcatExpr *ce = dyn_cast<ConcatExpr>(RHS)) {
+            Expr::Width rw = ce->getRight()->getWidth();
+            const llvm::APInt &v = CE->getAPValue();
+            return And(Eq(Base->Constant(v.lshr(rw).trunc(v.getBitWidth() - rw)),
+                          ce->getLeft()),
+                       Eq(Base->Constant(v.trunc(rw)), ce->getRight()));
+          }
+        }
+      }
+      return Base->Eq(LHS, RHS);
+    }
+
+    virtual ref<Expr> Ne(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Base->Ne(LHS, RHS);
+    }
+
+    virtual ref<Expr> Ult(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Base->Ult(LHS, RHS);
+    }
+
+    virtual ref<Expr> Ule(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Base->Ule(LHS, RHS);
+    }
+
+    virtual ref<Expr> Ugt(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Base->Ugt(LHS, RHS);
+    }
+
+    virtual ref<Expr> Uge(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Base->Uge(LHS, RHS);
+    }
+
+    virtual ref<Expr> Slt(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Base->Slt(LHS, RHS);
+    }
+
+    virtual ref<Expr> Sle(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Base->Sle(LHS, RHS);
+    }
+
+    virtual ref<Expr> Sgt(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Base->Sgt(LHS, RHS);
+    }
+
+    virtual ref<Expr> Sge(const ref<Expr> &LHS, const ref<Expr> &RHS) {
+      return Base->Sge(LHS, RHS);
+    }
+  };
 }
 
 ExprBuilder *klee::createDefaultExprBuilder() {
@@ -1065,3 +1608,11 @@ ExprBuilder *klee::createConstantFoldingExprBuilder(ExprBuilder *Base) {
 ExprBuilder *klee::createSimplifyingExprBuilder(ExprBuilder *Base) {
   return new SimplifyingExprBuilder(Base);
 }
+
+ExprBuilder *klee::createHashConsingExprBuilder(ExprBuilder *Base) {
+  return new HashConsingExprBuilder(Base);
+}
+
+ExprBuilder *klee::createAlgebraicExprBuilder(ExprBuilder *Base) {
+  return new AlgebraicExprBuilder(Base);
+}
@@ -1,14 +1,127 @@
 #include "klee/util/ExprConcretizer.h"
 #include "klee/Internal/Support/ErrorHandling.h"
 
+#include <atomic>
+#include <thread>
+
 using namespace llvm;
 using namespace klee;
 
 void ExprConcretizer::cleanUp() {
+  visited.clear();
   additionalConstraints.clear();
   foundExprs.clear();
   old2new.clear();
+  for (auto &it : farthestUpdates)
+    delete it.second;
   farthestUpdates.clear();
+  evaluatedConstraints.clear();
+  newInputArrays.clear();
+  newExprs.clear();
+}
+
+void ExprConcretizer::invalidate(const Constraints_ty &constraints) {
+  // whether the rewrite of a node of the constraints may change
+  std::unordered_map<const Expr *, bool> affected;
+  // and of an update node, with the array of its list
+  std::unordered_map<const UpdateNode *, std::pair<bool, const Array *>>
+      affectedUpdates;
+  auto isAffected = [&](const ref<Expr> &e) {
+    return !isa<ConstantExpr>(e) && affected.at(e.get());
+  };
+  // arrays whose reads are affected. visitRead reads through the farthest
+  // list of the array whatever the list of the read, so once an update of an
+  // array is affected, so are all the reads of the array, which may affect
+  // the updates of other arrays in turn.
+  std::set<std::string> arrays = newInputArrays;
+
+  for (bool grown = true; grown;) {
+    affected.clear();
+    affectedUpdates.clear();
+    // post order, with an explicit stack for deep constraints
+    std::vector<std::pair<ref<Expr>, bool>> stack;
+    for (const ref<Expr> &c : constraints)
+      stack.push_back({c, false});
+    while (!stack.empty()) {
+      ref<Expr> e = stack.back().first;
+      if (isa<ConstantExpr>(e) || affected.count(e.get())) {
+        stack.pop_back();
+        continue;
+      }
+      const ReadExpr *re = dyn_cast<ReadExpr>(e);
+      if (!stack.back().second) {
+        stack.back().second = true;
+        if (re) {
+          stack.push_back({re->index, false});
+          for (const UpdateNode *un = re->updates.head.get();
+               un && !affectedUpdates.count(un); un = un->next.get()) {
+            stack.push_back({un->index, false});
+            stack.push_back({un->value, false});
+          }
+        } else {
+          for (unsigned i = 0; i < e->getNumKids(); ++i)
+            stack.push_back({e->getKid(i), false});
+        }
+        continue;
+      }
+      stack.pop_back();
+
+      bool a = false;
+      if (!newExprs.empty()) {
+        visited_ty::iterator it = visited.find(e);
+        for (const ref<Expr> &ne : newExprs)
+          a |= e == ne || (it != visited.end() && it->second == ne);
+      }
+      if (re) {
+        a |= arrays.count(re->updates.root->name) || isAffected(re->index);
+        // the updates not seen yet, the oldest last
+        std::vector<const UpdateNode *> updates;
+        const UpdateNode *un = re->updates.head.get();
+        for (; un && !affectedUpdates.count(un); un = un->next.get())
+          updates.push_back(un);
+        bool next = un && affectedUpdates[un].first;
+        for (auto it = updates.rbegin(); it != updates.rend(); ++it) {
+          next |= isAffected((*it)->index) || isAffected((*it)->value);
+          affectedUpdates[*it] = {next, re->updates.root};
+        }
+        a |= next;
+      } else {
+        for (unsigned i = 0; i < e->getNumKids(); ++i)
+          a |= isAffected(e->getKid(i));
+      }
+      affected[e.get()] = a;
+    }
+
+    grown = false;
+    for (auto &it : affectedUpdates)
+      if (it.second.first)
+        grown |= arrays.insert(it.second.second->name).second;
+  }
+
+  for (auto &it : affected)
+    if (it.second)
+      visited.erase(ref<Expr>(const_cast<Expr *>(it.first)));
+  for (auto &it : affectedUpdates) {
+    const UpdateNode *un = it.first;
+    if (!it.second.first || !old2new.erase(un))
+      continue;
+    // the reconstructed list of the array goes back to the reconstruction
+    // of its unaffected part, which the affected updates are redone on
+    const UpdateNode *next = un->next.get();
+    if (next && affectedUpdates[next].first)
+      continue;
+    const Array *root = it.second.second;
+    auto farthest = farthestUpdates.find(root->name);
+    if (farthest == farthestUpdates.end())
+      continue;
+    auto newNext = next ? old2new.find(next) : old2new.end();
+    *farthest->second = UpdateList(
+        root, newNext == old2new.end()
+                  ? nullptr
+                  : const_cast<UpdateNode *>(newNext->second));
+  }
+  newInputArrays.clear();
+  newExprs.clear();
 }
 
 ref<Expr> ExprConcretizer::getInitialValue
@@ -19,7 +132,7 @@ ref<Expr> ExprConcretizer::getInitialValue
                           klee::ConstantExpr::alloc(index, mo.getDomain()));
     ref<Expr> cval = OracleEvaluator::getInitialValue(mo, index);
     ref<Expr> eq = klee::EqExpr::create(rd, cval);
-    additionalConstraints.push_back(eq);
+    additionalConstraints.insert(eq);
     return cval;
   }
   else {
@@ -151,12 +264,13 @@ ExprVisitor::Action ExprConcretizer::visitExprPost(const Expr &e) {
 
 void ExprConcretizer::addConcretizedInputValue
                             (std::string arrayName, unsigned index) {
-  if (arrayname2idx.find(arrayName) == arrayname2idx.end()) {
+  if (!findObject(arrayName)) {
     klee_warning("Trying to concretize non-exist symbolic obj: %s", arrayName.c_str());
   }
   std::pair<std::string, unsigned> k = {arrayName, index};
   assert(concretizedInputs.find(k) == concretizedInputs.end());
   concretizedInputs.insert(k);
+  newInputArrays.insert(arrayName);
 }
 
 void ExprConcretizer::addConcretizedExprValue
@@ -165,6 +279,7 @@ void ExprConcretizer::addConcretizedExprValue
   assert(foundExprs.find(e) == foundExprs.end());
   concretizedExprs.insert({e, val});
   foundExprs.insert({e, false});
+  newExprs.push_back(e);
 }
 
 Constraints_ty ExprConcretizer::doEvaluate(
@@ -200,116 +315,156 @@ Constraints_ty ExprConcretizer::doEvaluate(
     }
   }
 
-  cleanUp();
-
   return newCm;
 }
 
 Constraints_ty ExprConcretizer::evaluate(const Constraints_ty &constraints) {
+  if (constraints != evaluatedConstraints) {
+    cleanUp();
+    evaluatedConstraints = constraints;
+  } else if (!newInputArrays.empty() || !newExprs.empty()) {
+    invalidate(constraints);
+  }
   return doEvaluate(constraints.begin(), constraints.end());
 }
 
 /*
  * IndirectReadDepthCalculator
  */
-int IndirectReadDepthCalculator::getLevel(const ref<Expr> &e) {
-  auto it = depthStore.find(e.get());
-
-  if (it == depthStore.end()) {
-    depthStore.insert(std::make_pair(e.get(), -1));
-    return -1;
+namespace {
+/// Run f(begin, end, thread) on jobs slices of [0, n).
+template <class F> void parallelFor(unsigned jobs, size_t n, F f) {
+  if (jobs <= 1 || n < 2 * jobs) {
+    f(0, n, 0);
+    return;
   }
-  else {
-    return it->second;
+  std::vector<std::thread> threads;
+  size_t slice = (n + jobs - 1) / jobs;
+  for (unsigned t = 0; t < jobs; ++t) {
+    size_t begin = std::min(n, t * slice), end = std::min(n, begin + slice);
+    threads.emplace_back(f, begin, end, t);
   }
+  for (std::thread &t : threads)
+    t.join();
 }
-
-void IndirectReadDepthCalculator::putLevel(const ref<Expr> &e, int level) {
-  auto it = depthStore.find(e.get());
-  assert(it != depthStore.end());
-
-  it->second = level;
-}
-
-int IndirectReadDepthCalculator::assignDepth(const ref<Expr> &e, int readLevel) {
-  int initialLevel = getLevel(e);
-
-  if (initialLevel >= readLevel) {
-    return initialLevel;
-  }
-  putLevel(e, readLevel);
-
-  // m means the maximum indirect depth which is maintained recursively
-  int m = readLevel;
-  if (ReadExpr *RE = dyn_cast<ReadExpr>(e)) {
-    updateMaxLevelfromKid(RE->index, readLevel + 1, m);
-    const UpdateNode *un = RE->updates.head.get();
-    std::vector<const UpdateNode *> un_vec;
-    while (un) {
-      un_vec.push_back(un);
-      updateMaxLevelfromKid(un->index, readLevel + 1, m);
-      updateMaxLevelfromKid(un->value, readLevel, m);
-      /*
-       * Indirect depth of an UpdateNode depends on its parent ReadExpr
-       */
-      auto insert_pair = depthStoreUNode.insert(std::make_pair(un, readLevel));
-      if (insert_pair.second) {
-        // insert successfully, meaning see this UNode first time
-        // do nothing
-        ;
-      }
-      else {
-        decltype(depthStoreUNode)::iterator &existed = insert_pair.first;
-        if (readLevel > existed->second) {
-          existed->second = readLevel;
-        }
-      }
-      un = un->next.get();
+} // namespace
+
+template <class Range>
+void IndirectReadDepthCalculator::calculate(const Range &roots,
+                                            unsigned jobs) {
+  if (jobs == 0)
+    jobs = std::max(1u, std::thread::hardware_concurrency());
+
+  // Number the nodes. A read uses its index and the head of its updates, an
+  // update node its index, value and the next node; the edges to an index
+  // count one.
+  struct Edge {
+    uint32_t from, to;
+    bool isIndex;
+  };
+  std::vector<Edge> edges;
+  std::vector<std::pair<const void *, bool>> nodes; // is an update node
+  auto add = [&](const void *p, bool isUpdate) {
+    auto it = ids.insert(std::make_pair(p, (uint32_t)nodes.size()));
+    if (it.second)
+      nodes.push_back(std::make_pair(p, isUpdate));
+    return it.first->second;
+  };
+  for (const ref<Expr> &e : roots)
+    add(e.get(), false);
+  for (uint32_t id = 0; id < nodes.size(); ++id) {
+    auto edge = [&](const void *p, bool isUpdate, bool isIndex) {
+      if (p)
+        edges.push_back({id, add(p, isUpdate), isIndex});
+    };
+    if (nodes[id].second) {
+      const UpdateNode *un = static_cast<const UpdateNode *>(nodes[id].first);
+      edge(un->index.get(), false, true);
+      edge(un->value.get(), false, false);
+      edge(un->next.get(), true, false);
+    } else if (const ReadExpr *RE = dyn_cast<ReadExpr>(
+                   static_cast<const Expr *>(nodes[id].first))) {
+      edge(RE->index.get(), false, true);
+      edge(RE->updates.head.get(), true, false);
+      if (isa<ConstantExpr>(RE->index) && RE->updates.head.isNull())
+        lastLevelReads.insert(const_cast<ReadExpr *>(RE));
+    } else {
+      const Expr *e = static_cast<const Expr *>(nodes[id].first);
+      for (unsigned i = 0; i < e->getNumKids(); ++i)
+        edge(e->getKid(i).get(), false, false);
     }
-
-    if (!RE->index.isNull() && (RE->index->getKind() == Expr::Constant) &&
-        RE->updates.head.isNull()) {
-      lastLevelReads.insert(RE);
+  }
+  const size_t n = nodes.size();
+  std::vector<std::pair<const void *, bool>>().swap(nodes);
+
+  // CSR of the out-edges
+  std::vector<uint64_t> offsets(n + 1, 0);
+  std::vector<std::atomic<uint32_t>> pending(n);
+  for (const Edge &e : edges) {
+    ++offsets[e.from + 1];
+    ++pending[e.to];
+  }
+  for (size_t i = 0; i < n; ++i)
+    offsets[i + 1] += offsets[i];
+  std::vector<uint32_t> targets(edges.size());
+  std::vector<uint8_t> isIndex(edges.size());
+  {
+    std::vector<uint64_t> out(offsets.begin(), offsets.end() - 1);
+    for (const Edge &e : edges) {
+      uint64_t k = out[e.from]++;
+      targets[k] = e.to;
+      isIndex[k] = e.isIndex;
     }
   }
-  else {
-    for (unsigned int i=0; i < e->getNumKids(); ++i) {
-      updateMaxLevelfromKid(e->getKid(i), readLevel, m);
+  std::vector<Edge>().swap(edges);
+
+  // Waves of the nodes whose users are all done, starting from the unused
+  // ones at depth 0
+  std::vector<std::atomic<int>> depth(n);
+  std::vector<uint32_t> wave;
+  for (size_t i = 0; i < n; ++i)
+    if (!pending[i])
+      wave.push_back(i);
+  std::vector<std::vector<uint32_t>> next(jobs);
+  while (!wave.empty()) {
+    parallelFor(jobs, wave.size(), [&](size_t begin, size_t end, unsigned t) {
+      for (size_t i = begin; i < end; ++i) {
+        uint32_t u = wave[i];
+        int d = depth[u];
+        for (uint64_t k = offsets[u]; k < offsets[u + 1]; ++k) {
+          uint32_t v = targets[k];
+          int dv = d + isIndex[k];
+          int old = depth[v];
+          while (old < dv && !depth[v].compare_exchange_weak(old, dv))
+            ;
+          if (--pending[v] == 0)
+            next[t].push_back(v);
+        }
+      }
+    });
+    wave.clear();
+    for (std::vector<uint32_t> &w : next) {
+      wave.insert(wave.end(), w.begin(), w.end());
+      w.clear();
     }
   }
-  return m;
-}
 
-IndirectReadDepthCalculator::IndirectReadDepthCalculator(
-    const Constraints_ty &constraints) {
+  levels.resize(n);
   maxLevel = 0;
-  for (const ref<Expr> &e: constraints) {
-    int m = assignDepth(e, 0);
-    if (m > maxLevel) maxLevel = m;
+  for (size_t i = 0; i < n; ++i) {
+    levels[i] = depth[i];
+    maxLevel = std::max(maxLevel, levels[i]);
   }
 }
 
 IndirectReadDepthCalculator::IndirectReadDepthCalculator(
-    const expr::QueryCommand &QC) {
-  maxLevel = 0;
-  for (const ref<Expr> &e: QC.Constraints) {
-    int m = assignDepth(e, 0);
-    if (m > maxLevel) maxLevel = m;
-  }
-  for (const ref<Expr> &e: QC.Values) {
-    int m = assignDepth(e, 0);
-    if (m > maxLevel) maxLevel = m;
-  }
+    const Constraints_ty &constraints, unsigned jobs) {
+  calculate(constraints, jobs);
 }
 
-
-int IndirectReadDepthCalculator::query(const Expr *e) const {
-  auto it = depthStore.find(e);
-  if (it == depthStore.end()) {
-    return -1;
-  }
-  else {
-    return it->second;
-  }
+IndirectReadDepthCalculator::IndirectReadDepthCalculator(
+    const expr::QueryCommand &QC, unsigned jobs) {
+  std::vector<ref<Expr>> roots(QC.Constraints.begin(), QC.Constraints.end());
+  roots.insert(roots.end(), QC.Values.begin(), QC.Values.end());
+  calculate(roots, jobs);
 }
-
@@ -13,7 +13,14 @@ using namespace klee;
 
 ExprVisitor::Action ExprEvaluator::evalRead(const UpdateList &ul,
                                             unsigned index) {
-  for (auto un = ul.head; !un.isNull(); un = un->next) {
+  ref<UpdateNode> un = ul.head;
+  if (!un.isNull() && un->getSize() >= UpdateNode::MinIndexedSize) {
+    const UpdateNode::ConcreteWrites &writes = un->getConcreteWrites();
+    if (const auto *w = writes.latest.lookup(index))
+      return Action::changeTo(visit(w->second->value));
+    un = writes.rest;
+  }
+  for (; !un.isNull(); un = un->next) {
     ref<Expr> ui = visit(un->index);
     
     if (ConstantExpr *CE = dyn_cast<ConstantExpr>(ui)) {
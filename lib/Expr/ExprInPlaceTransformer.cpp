@@ -0,0 +1,166 @@
+//===-- ExprInPlaceTransformer.cpp ----------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Expr/ExprInPlaceTransformer.h"
+
+#include <cassert>
+
+using namespace klee;
+
+// Each entry of the worklist is seen twice. The first time its kids are
+// pushed above it. The second time, once they are all done, their
+// transformations are on top of results, in the order the kids were pushed
+// (the last pushed first), and the entry replaces them with its own. A read
+// pushes its index and then the head of its updates, an update node its
+// index, value and next node.
+
+Expr *ExprInPlaceTransformer::transform(Expr *e) {
+  worklist.push_back(e);
+  pending.push_back(false);
+  while (!worklist.empty()) {
+    Entry entry = worklist.back();
+    if (entry.isUpdate)
+      visitUpdate(entry.un);
+    else
+      visitExpr(entry.e);
+  }
+  Expr *result = popExpr();
+  assert(results.empty() && "unbalanced transformation");
+  return result;
+}
+
+Expr *ExprInPlaceTransformer::popExpr() {
+  assert(!results.back().isUpdate && "expected an expression");
+  Expr *e = results.back().e;
+  results.pop_back();
+  return e;
+}
+
+UpdateNode *ExprInPlaceTransformer::popUpdate() {
+  assert(results.back().isUpdate && "expected an update node");
+  UpdateNode *un = results.back().un;
+  results.pop_back();
+  return un;
+}
+
+void ExprInPlaceTransformer::visitExpr(Expr *e) {
+  if (ConstantExpr *CE = dyn_cast<ConstantExpr>(e)) {
+    results.push_back(transformConstant(CE));
+    worklist.pop_back();
+    pending.pop_back();
+    return;
+  }
+
+  if (!pending.back()) {
+    auto it = visited.find(e);
+    if (it != visited.end()) {
+      results.push_back(it->second);
+      worklist.pop_back();
+      pending.pop_back();
+      return;
+    }
+    visited.insert(std::make_pair(e, e));
+    retained.push_back(e);
+    pending.back() = true;
+    for (unsigned i = 0; i < e->getNumKids(); ++i) {
+      worklist.push_back(e->getKid(i).get());
+      pending.push_back(false);
+    }
+    if (ReadExpr *RE = dyn_cast<ReadExpr>(e)) {
+      worklist.push_back(const_cast<UpdateNode *>(RE->updates.head.get()));
+      pending.push_back(false);
+    }
+    return;
+  }
+
+  // the kids are done
+  ref<Expr> kids[8];
+  for (unsigned i = 0, n = e->getNumKids(); i < n; ++i)
+    kids[i] = popExpr();
+  Expr *result;
+  if (ReadExpr *RE = dyn_cast<ReadExpr>(e))
+    result = transformRead(RE, kids, popUpdate());
+  else
+    result = transformNode(e, kids);
+  // the kids are referenced by the result now, or dropped
+  if (result)
+    retained.push_back(result);
+  visited[e] = result;
+  results.push_back(result);
+  worklist.pop_back();
+  pending.pop_back();
+}
+
+void ExprInPlaceTransformer::visitUpdate(UpdateNode *un) {
+  if (!un) {
+    results.push_back(static_cast<UpdateNode *>(nullptr));
+    worklist.pop_back();
+    pending.pop_back();
+    return;
+  }
+
+  if (!pending.back()) {
+    auto it = visitedUpdates.find(un);
+    if (it != visitedUpdates.end()) {
+      results.push_back(it->second);
+      worklist.pop_back();
+      pending.pop_back();
+      return;
+    }
+    visitedUpdates.insert(std::make_pair(un, un));
+    retainedUpdates.push_back(un);
+    pending.back() = true;
+    worklist.push_back(un->index.get());
+    pending.push_back(false);
+    worklist.push_back(un->value.get());
+    pending.push_back(false);
+    worklist.push_back(const_cast<UpdateNode *>(un->next.get()));
+    pending.push_back(false);
+    return;
+  }
+
+  Expr *index = popExpr();
+  Expr *value = popExpr();
+  UpdateNode *next = popUpdate();
+  UpdateNode *result = transformUpdate(un, index, value, next);
+  if (result)
+    retainedUpdates.push_back(result);
+  visitedUpdates[un] = result;
+  results.push_back(result);
+  worklist.pop_back();
+  pending.pop_back();
+}
+
+Expr *ExprInPlaceTransformer::transformNode(Expr *e, ref<Expr> kids[]) {
+  for (unsigned i = 0, n = e->getNumKids(); i < n; ++i) {
+    if (kids[i] != e->getKid(i)) {
+      e->rebuildInPlace(kids);
+      break;
+    }
+  }
+  return e;
+}
+
+Expr *ExprInPlaceTransformer::transformRead(ReadExpr *re, ref<Expr> kids[],
+                                            UpdateNode *head) {
+  if (head != re->updates.head.get())
+    re->resetUpdateNode(head);
+  if (kids[0] != re->index)
+    re->rebuildInPlace(kids);
+  return re;
+}
+
+UpdateNode *ExprInPlaceTransformer::transformUpdate(UpdateNode *un,
+                                                    Expr *index, Expr *value,
+                                                    UpdateNode *next) {
+  if (index == un->index.get() && value == un->value.get() &&
+      next == un->next.get())
+    return un;
+  return new UpdateNode(next, index, value, un->flags, un->kinst);
+}
@@ -0,0 +1,146 @@
+//===-- ExprMetadata.cpp --------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Expr/Expr.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+
+using namespace klee;
+
+namespace {
+typedef std::shared_ptr<const std::vector<const Array *> > ArraySet;
+
+const ArraySet &getEmptyArraySet() {
+  // never destroyed, metadata may be freed by static destructors
+  static ArraySet *empty =
+      new ArraySet(std::make_shared<std::vector<const Array *> >());
+  return *empty;
+}
+
+/// Union of two array sets. Reuses one of them whenever it contains the
+/// other, so that the nodes of an expression mostly share the same set.
+ArraySet unite(const ArraySet &a, const ArraySet &b) {
+  if (a == b || b->empty() ||
+      std::includes(a->begin(), a->end(), b->begin(), b->end(), ArrayIdLess()))
+    return a;
+  if (a->empty() ||
+      std::includes(b->begin(), b->end(), a->begin(), a->end(), ArrayIdLess()))
+    return b;
+  auto result = std::make_shared<std::vector<const Array *> >();
+  result->reserve(a->size() + b->size());
+  std::set_union(a->begin(), a->end(), b->begin(), b->end(),
+                 std::back_inserter(*result), ArrayIdLess());
+  return result;
+}
+
+uint64_t addSizes(uint64_t a, uint64_t b) {
+  return a > UINT64_MAX - b ? UINT64_MAX : a + b;
+}
+
+/// Add the metadata of a kid to the metadata of its parent.
+void addKid(ExprMetadata &md, const ExprMetadata &kid) {
+  md.size = addSizes(md.size, kid.size);
+  md.depth = std::max(md.depth, kid.depth + 1);
+  md.indirectReadDepth = std::max(md.indirectReadDepth, kid.indirectReadDepth);
+  md.maxUpdates = std::max(md.maxUpdates, kid.maxUpdates);
+  md.arrays = unite(md.arrays, kid.arrays);
+}
+} // namespace
+
+void Expr::computeMetadata(const Expr *root, const UpdateNode *rootUN) {
+  // Nodes are finished bottom-up with an explicit stack, as expressions and
+  // update lists can be too deep to recurse on. A node stays on the stack
+  // until everything it depends on is finished.
+  struct Item {
+    const Expr *e;
+    const UpdateNode *un;
+  };
+  std::vector<Item> stack;
+  stack.push_back({root, rootUN});
+  while (!stack.empty()) {
+    Item item = stack.back();
+    if (item.e ? item.e->metadata : item.un->metadata) {
+      stack.pop_back();
+      continue;
+    }
+
+    size_t pending = stack.size();
+    auto require = [&stack](const Expr *e) {
+      if (e && !e->metadata)
+        stack.push_back({e, nullptr});
+    };
+    auto requireUN = [&stack](const UpdateNode *un) {
+      if (un && !un->metadata)
+        stack.push_back({nullptr, un});
+    };
+    const ReadExpr *re = item.e ? dyn_cast<ReadExpr>(item.e) : nullptr;
+    if (re) {
+      require(re->index.get());
+      requireUN(re->updates.head.get());
+    } else if (item.e) {
+      for (unsigned i = 0, n = item.e->getNumKids(); i != n; ++i)
+        require(item.e->getKid(i).get());
+    } else {
+      require(item.un->index.get());
+      require(item.un->value.get());
+      requireUN(item.un->next.get());
+    }
+    if (stack.size() != pending)
+      continue;
+    stack.pop_back();
+
+    ExprMetadata *md = new ExprMetadata();
+    md->size = 1;
+    md->depth = 1;
+    md->arrays = getEmptyArraySet();
+    if (re) {
+      const ExprMetadata &index = re->index->getMetadata();
+      addKid(*md, index);
+      unsigned readDepth = index.indirectReadDepth + 1;
+      if (const UpdateNode *head = re->updates.head.get()) {
+        addKid(*md, head->getMetadata());
+        readDepth = std::max(readDepth, md->indirectReadDepth);
+        md->maxUpdates = std::max(md->maxUpdates, head->getSize());
+      }
+      md->indirectReadDepth = readDepth;
+      ArraySet root = std::make_shared<std::vector<const Array *> >(
+          1, re->updates.root);
+      md->arrays = unite(md->arrays, root);
+      re->metadata.reset(md);
+    } else if (item.e) {
+      for (unsigned i = 0, n = item.e->getNumKids(); i != n; ++i) {
+        ref<Expr> kid = item.e->getKid(i);
+        if (!kid.isNull())
+          addKid(*md, kid->getMetadata());
+      }
+      item.e->metadata.reset(md);
+    } else {
+      const UpdateNode *un = item.un;
+      addKid(*md, un->index->getMetadata());
+      addKid(*md, un->value->getMetadata());
+      // a read of the list nests the index one level deeper
+      md->indirectReadDepth =
+          std::max(un->index->getMetadata().indirectReadDepth + 1,
+                   un->value->getMetadata().indirectReadDepth);
+      if (const UpdateNode *next = un->next.get()) {
+        const ExprMetadata &rest = next->getMetadata();
+        // the updates form a list, not a nesting
+        md->size = addSizes(md->size, rest.size);
+        md->depth = std::max(md->depth, rest.depth);
+        md->indirectReadDepth =
+            std::max(md->indirectReadDepth, rest.indirectReadDepth);
+        md->maxUpdates = std::max(md->maxUpdates, rest.maxUpdates);
+        md->arrays = unite(md->arrays, rest.arrays);
+      }
+      un->metadata.reset(md);
+    }
+  }
+}
@@ -13,6 +13,7 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/ErrorHandling.h"
 
+#include <algorithm>
 #include <stack>
 
 namespace ExprSMTLIBOptions {
@@ -179,7 +180,7 @@ void ExprSMTLIBPrinter::printExpression(
     break;
 
   case ABBR_LET: {
-    BindingMap::iterator i = bindings.find(e);
+    ExprHashMap<int>::iterator i = bindings.find(e);
     if (i != bindings.end()) {
       *p << "?B" << i->second;
       return;
@@ -188,7 +189,7 @@ void ExprSMTLIBPrinter::printExpression(
   }
 
   case ABBR_NAMED: {
-    BindingMap::iterator i = bindings.find(e);
+    ExprHashMap<int>::iterator i = bindings.find(e);
     if (i != bindings.end()) {
       if (i->second > 0) {
         *p << "(! ";
@@ -517,12 +518,36 @@ void ExprSMTLIBPrinter::scanAll() {
     scanBindingExprDeps();
 }
 
+namespace {
+/// Buffers an unbuffered stream (e.g. a raw_string_ostream) while a query is
+/// printed, so that the many small writes of the printer are copied to it in
+/// large blocks. The stream is flushed and unbuffered again afterwards.
+class BufferedOutput {
+  llvm::raw_ostream &os;
+  bool buffered;
+
+public:
+  explicit BufferedOutput(llvm::raw_ostream &_os)
+      : os(_os), buffered(_os.GetBufferSize() == 0) {
+    if (buffered)
+      os.SetBufferSize(1 << 16);
+  }
+  ~BufferedOutput() {
+    if (buffered) {
+      os.flush();
+      os.SetUnbuffered();
+    }
+  }
+};
+} // namespace
+
 void ExprSMTLIBPrinter::generateOutput() {
   if (p == NULL || query == NULL || o == NULL) {
     llvm::errs() << "ExprSMTLIBPrinter::generateOutput() Can't print SMTLIBv2. "
                     "Output or query bad!\n";
     return;
   }
+  BufferedOutput buffer(*o);
 
   if (humanReadable)
     printNotice();
@@ -539,6 +564,37 @@ void ExprSMTLIBPrinter::generateOutput() {
   printExit();
 }
 
+void ExprSMTLIBPrinter::printIncrementalAssert(
+    const ref<Expr> &e, const std::set<const Array *> &declared,
+    std::vector<const Array *> &newArrays) {
+  assert(p && o && "output not set");
+  BufferedOutput buffer(*o);
+  bindings.clear();
+  orderedBindings.clear();
+  seenExprs.clear();
+  usedArrays.clear();
+  haveConstantArray = false;
+
+  scan(e);
+  if (abbrMode == ABBR_LET)
+    scanBindingExprDeps();
+
+  // only declare what the solver has not seen yet
+  std::set<const Array *> arrays;
+  arrays.swap(usedArrays);
+  haveConstantArray = false;
+  for (const Array *array : arrays) {
+    if (declared.count(array))
+      continue;
+    usedArrays.insert(array);
+    newArrays.push_back(array);
+    if (array->isConstantArray())
+      haveConstantArray = true;
+  }
+  printArrayDeclarations();
+  printAssert(e);
+}
+
 void ExprSMTLIBPrinter::printSetLogic() {
   *o << "(set-logic ";
   switch (logicToUse) {
@@ -694,17 +750,31 @@ void ExprSMTLIBPrinter::printAction() {
   }
 }
 
-void ExprSMTLIBPrinter::scan(const ref<Expr> &e) {
-  assert(!(e.isNull()) && "found NULL expression");
-
-  if (isa<ConstantExpr>(e))
-    return; // we don't need to scan simple constants
+void ExprSMTLIBPrinter::scan(const ref<Expr> &root) {
+  assert(!(root.isNull()) && "found NULL expression");
+
+  // The expressions are visited in the order the recursive scan would call
+  // itself on them, so bindings are numbered the same: the updates of the
+  // first read of an array, then the kids.
+  std::vector<ref<Expr> > stack(1, root);
+  std::vector<ref<Expr> > next;
+  while (!stack.empty()) {
+    ref<Expr> e = stack.back();
+    stack.pop_back();
+
+    if (isa<ConstantExpr>(e))
+      continue; // we don't need to scan simple constants
+
+    if (!seenExprs.insert(e).second) {
+      // Add the expression to the binding map. Like std::map::insert, it
+      // will not be inserted twice.
+      bindings.insert(std::make_pair(e, (int)bindings.size() + 1));
+      continue;
+    }
 
-  if (seenExprs.insert(e).second) {
     // We've not seen this expression before
-
+    next.clear();
     if (const ReadExpr *re = dyn_cast<ReadExpr>(e)) {
-
       if (usedArrays.insert(re->updates.root).second) {
         // Array was not recorded before
 
@@ -713,18 +783,19 @@ void ExprSMTLIBPrinter::scan(const ref<Expr> &e) {
           haveConstantArray = true;
 
         // scan the update list
-        scanUpdates(re->updates.head.get());
+        for (const UpdateNode *un = re->updates.head.get(); un;
+             un = un->next.get()) {
+          next.push_back(un->index);
+          next.push_back(un->value);
+        }
       }
     }
 
-    // recurse into the children
+    // then the children
     Expr *ep = e.get();
     for (unsigned int i = 0; i < ep->getNumKids(); i++)
-      scan(ep->getKid(i));
-  } else {
-    // Add the expression to the binding map. The semantics of std::map::insert
-    // are such that it will not be inserted twice.
-    bindings.insert(std::make_pair(e, bindings.size()+1));
+      next.push_back(ep->getKid(i));
+    stack.insert(stack.end(), next.rbegin(), next.rend());
   }
 }
 
@@ -732,8 +803,9 @@ void ExprSMTLIBPrinter::scanBindingExprDeps() {
   if (!bindings.size())
     return;
 
-  // Mutual dependency storage
-  typedef std::map<const ref<Expr>, std::set<ref<Expr> > > ExprDepMap;
+  // Mutual dependency storage. The sets stay ordered: the bindings are
+  // numbered in the order they are taken out of them.
+  typedef ExprHashMap<std::set<ref<Expr> > > ExprDepMap;
 
   // A map from binding Expr (need abbreviating) "e" to the set of binding Expr
   // that are sub expressions of "e" (i.e. "e" uses these sub expressions).
@@ -754,11 +826,15 @@ void ExprSMTLIBPrinter::scanBindingExprDeps() {
   // Working queue holding expressions with no dependencies
   std::vector<ref<Expr> > nonDepBindings;
 
-  // Iterate over bindings and collect dependencies
-  for (BindingMap::const_iterator it = bindings.begin();
-       it != bindings.end(); ++it) {
+  // Iterate over bindings, in expression order, and collect dependencies
+  std::vector<ref<Expr> > sortedBindings;
+  sortedBindings.reserve(bindings.size());
+  for (const auto &binding : bindings)
+    sortedBindings.push_back(binding.first);
+  std::sort(sortedBindings.begin(), sortedBindings.end());
+  for (const ref<Expr> &binding : sortedBindings) {
     std::stack<ref<Expr> > childQueue;
-    childQueue.push(it->first);
+    childQueue.push(binding);
     // Non-recursive expression parsing
     while (childQueue.size()) {
       Expr *ep = childQueue.top().get();
@@ -769,16 +845,16 @@ void ExprSMTLIBPrinter::scanBindingExprDeps() {
           continue;
         // Are there any dependencies in the bindings?
         if (bindings.count(e)) {
-          usesSubExprMap[it->first].insert(e);
-          subExprOfMap[e].insert(it->first);
+          usesSubExprMap[binding].insert(e);
+          subExprOfMap[e].insert(binding);
         } else {
           childQueue.push(e);
         }
       }
     }
     // Store expressions with zero deps
-    if (!usesSubExprMap.count(it->first))
-      nonDepBindings.push_back(it->first);
+    if (!usesSubExprMap.count(binding))
+      nonDepBindings.push_back(binding);
   }
   assert(nonDepBindings.size() && "there must be expr bindings with no deps");
 
@@ -788,8 +864,8 @@ void ExprSMTLIBPrinter::scanBindingExprDeps() {
   // nonDepBindings always holds expressions with no dependencies
   while (nonDepBindings.size()) {
     BindingMap levelExprs;
-    std::vector<ref<Expr> > tmp(nonDepBindings);
-    nonDepBindings.clear();
+    std::vector<ref<Expr> > tmp;
+    tmp.swap(nonDepBindings);
     for (std::vector<ref<Expr> >::const_iterator nonDepExprIt = tmp.begin();
          nonDepExprIt != tmp.end(); ++nonDepExprIt) {
       // Save to the level expression bindings
@@ -820,14 +896,6 @@ void ExprSMTLIBPrinter::scanBindingExprDeps() {
   }
 }
 
-void ExprSMTLIBPrinter::scanUpdates(const UpdateNode *un) {
-  while (un != NULL) {
-    scan(un->index);
-    scan(un->value);
-    un = un->next.get();
-  }
-}
-
 void ExprSMTLIBPrinter::printExit() { *o << "(exit)\n"; }
 
 bool ExprSMTLIBPrinter::setLogic(SMTLIBv2Logic l) {
@@ -881,7 +949,7 @@ void ExprSMTLIBPrinter::printAssert(const ref<Expr> &e) {
 
     // Print each binding on its level
     for (unsigned i = 0; i < orderedBindings.size(); ++i) {
-      BindingMap levelBindings = orderedBindings[i];
+      const BindingMap &levelBindings = orderedBindings[i];
       for (BindingMap::const_iterator j = levelBindings.begin();
            j != levelBindings.end(); ++j) {
         printSeperator();
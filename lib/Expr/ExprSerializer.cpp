@@ -0,0 +1,447 @@
+//===-- ExprSerializer.cpp ------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Expr/ExprSerializer.h"
+
+#include "klee/Expr/ArrayCache.h"
+
+#include <cstring>
+
+using namespace klee;
+
+const char ExprImage::Magic[8] = {'K', 'L', 'E', 'E', 'E', 'X', 'P', '1'};
+
+namespace {
+void writeConstant(std::string &out, const llvm::APInt &v) {
+  for (unsigned i = 0, n = v.getNumWords(); i != n; ++i)
+    ExprSerializer::writeNumber(out, v.getRawData()[i]);
+}
+
+bool isBinaryKind(Expr::Kind k) {
+  return k >= Expr::BinaryKindFirst && k <= Expr::BinaryKindLast;
+}
+} // namespace
+
+void ExprSerializer::writeNumber(std::string &out, uint64_t v) {
+  do {
+    unsigned char byte = v & 0x7f;
+    v >>= 7;
+    if (v)
+      byte |= 0x80;
+    out += (char)byte;
+  } while (v);
+}
+
+uint64_t ExprSerializer::writeArray(const Array *array, std::string &out) {
+  auto it = arrayIds.find(array);
+  if (it != arrayIds.end())
+    return it->second;
+
+  out += 'A';
+  writeNumber(out, array->name.size());
+  out += array->name;
+  writeNumber(out, array->size);
+  writeNumber(out, array->domain);
+  writeNumber(out, array->range);
+  writeNumber(out, array->constantValues.size());
+  for (const ref<ConstantExpr> &v : array->constantValues)
+    writeConstant(out, v->getAPValue());
+
+  uint64_t id = arrayIds.size() + 1;
+  arrayIds[array] = id;
+  return id;
+}
+
+uint64_t ExprSerializer::writeUpdates(const ref<UpdateNode> &head,
+                                      std::string &out) {
+  if (head.isNull())
+    return 0;
+  auto it = updateIds.find(head.get());
+  if (it != updateIds.end())
+    return it->second.id;
+
+  // update lists can be long, write the ones not written yet oldest first
+  std::vector<UpdateNode *> unwritten;
+  uint64_t next = 0;
+  for (UpdateNode *un = head.get(); un; un = un->next.get()) {
+    auto written = updateIds.find(un);
+    if (written != updateIds.end()) {
+      next = written->second.id;
+      break;
+    }
+    unwritten.push_back(un);
+  }
+  for (auto it = unwritten.rbegin(), ie = unwritten.rend(); it != ie;
+       ++it) {
+    UpdateNode *un = *it;
+    uint64_t index = writeExpr(un->index, out);
+    uint64_t value = writeExpr(un->value, out);
+    out += 'U';
+    writeNumber(out, next);
+    writeNumber(out, index);
+    writeNumber(out, value);
+    next = updateIds.size() + 1;
+    updateIds[un] = WrittenUpdate{un, next};
+  }
+  return next;
+}
+
+uint64_t ExprSerializer::writeExpr(const ref<Expr> &e, std::string &out) {
+  auto it = exprIds.find(e);
+  if (it != exprIds.end())
+    return it->second;
+
+  std::vector<uint64_t> fields;
+  switch (e->getKind()) {
+  case Expr::Constant: {
+    const ConstantExpr *ce = cast<ConstantExpr>(e);
+    out += 'E';
+    writeNumber(out, Expr::Constant);
+    writeNumber(out, ce->getWidth());
+    writeConstant(out, ce->getAPValue());
+    uint64_t id = exprIds.size() + 1;
+    exprIds[e] = id;
+    return id;
+  }
+  case Expr::Read: {
+    const ReadExpr *re = cast<ReadExpr>(e);
+    fields.push_back(writeArray(re->updates.root, out));
+    fields.push_back(writeUpdates(re->updates.head, out));
+    fields.push_back(writeExpr(re->index, out));
+    break;
+  }
+  case Expr::Extract: {
+    const ExtractExpr *ee = cast<ExtractExpr>(e);
+    fields.push_back(writeExpr(ee->expr, out));
+    fields.push_back(ee->offset);
+    fields.push_back(ee->width);
+    break;
+  }
+  case Expr::ZExt:
+  case Expr::SExt:
+    fields.push_back(writeExpr(e->getKid(0), out));
+    fields.push_back(e->getWidth());
+    break;
+  default:
+    for (unsigned i = 0, n = e->getNumKids(); i != n; ++i)
+      fields.push_back(writeExpr(e->getKid(i), out));
+    break;
+  }
+
+  out += 'E';
+  writeNumber(out, e->getKind());
+  for (uint64_t f : fields)
+    writeNumber(out, f);
+  uint64_t id = exprIds.size() + 1;
+  exprIds[e] = id;
+  return id;
+}
+
+void ExprSerializer::reset() {
+  exprIds.clear();
+  updateIds.clear();
+}
+
+ExprDeserializer::ExprDeserializer(ArrayCache &_arrayCache, const char *begin,
+                                   const char *end)
+    : arrayCache(_arrayCache), cur(begin), end(end) {}
+
+bool ExprDeserializer::fail(const std::string &message) {
+  error = message;
+  cur = end;
+  return false;
+}
+
+bool ExprDeserializer::readTag(char &tag) {
+  if (cur == end)
+    return false;
+  tag = *cur++;
+  return true;
+}
+
+bool ExprDeserializer::readBytes(size_t n, const char *&bytes) {
+  if ((size_t)(end - cur) < n)
+    return fail("truncated record");
+  bytes = cur;
+  cur += n;
+  return true;
+}
+
+bool ExprDeserializer::readNumber(uint64_t &v) {
+  v = 0;
+  for (unsigned shift = 0; shift < 64; shift += 7) {
+    if (cur == end)
+      return fail("truncated record");
+    unsigned char byte = *cur++;
+    v |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
+  return fail("malformed number");
+}
+
+bool ExprDeserializer::readArray(const Array *&array) {
+  uint64_t id;
+  if (!readNumber(id))
+    return false;
+  if (id == 0 || id > arrays.size())
+    return fail("reference to an undeclared array");
+  array = arrays[id - 1];
+  return true;
+}
+
+bool ExprDeserializer::readExpr(ref<Expr> &e, bool allowNull) {
+  uint64_t id;
+  if (!readNumber(id))
+    return false;
+  if (id == 0 && allowNull) {
+    e = nullptr;
+    return true;
+  }
+  if (id == 0 || id > exprs.size())
+    return fail("reference to an undeclared expression");
+  e = exprs[id - 1];
+  return true;
+}
+
+bool ExprDeserializer::readConstant(unsigned width,
+                                        ref<ConstantExpr> &e) {
+  if (width == 0)
+    return fail("constant of width 0");
+  std::vector<uint64_t> words((width + 63) / 64);
+  for (uint64_t &w : words)
+    if (!readNumber(w))
+      return false;
+  e = ConstantExpr::alloc(llvm::APInt(width, words));
+  return true;
+}
+
+bool ExprDeserializer::readArrayRecord() {
+  uint64_t length;
+  if (!readNumber(length))
+    return false;
+  if ((uint64_t)(end - cur) < length)
+    return fail("truncated record");
+  std::string name(cur, length);
+  cur += length;
+
+  uint64_t size, domain, range, numValues;
+  if (!readNumber(size) || !readNumber(domain) || !readNumber(range) ||
+      !readNumber(numValues))
+    return false;
+  if (numValues && numValues != size)
+    return fail("constant array " + name + " of the wrong size");
+  std::vector<ref<ConstantExpr>> values(numValues);
+  for (ref<ConstantExpr> &v : values)
+    if (!readConstant(range, v))
+      return false;
+  arrays.push_back(
+      numValues ? arrayCache.CreateArray(name, size, &values[0],
+                                         &values[0] + numValues, domain, range)
+                : arrayCache.CreateArray(name, size, 0, 0, domain, range));
+  return true;
+}
+
+bool ExprDeserializer::readExprRecord() {
+  uint64_t kind;
+  if (!readNumber(kind))
+    return false;
+  Expr::Kind k = (Expr::Kind)kind;
+  ref<Expr> e;
+  switch (k) {
+  case Expr::Constant: {
+    uint64_t width;
+    ref<ConstantExpr> ce;
+    if (!readNumber(width) || !readConstant(width, ce))
+      return false;
+    e = ce;
+    break;
+  }
+  case Expr::Read: {
+    uint64_t updateId;
+    const Array *array;
+    ref<Expr> index;
+    if (!readArray(array) || !readNumber(updateId) || !readExpr(index))
+      return false;
+    if (updateId > updates.size())
+      return fail("reference to an undeclared update node");
+    ref<UpdateNode> head;
+    if (updateId)
+      head = updates[updateId - 1];
+    e = ReadExpr::alloc(UpdateList(array, head), index);
+    break;
+  }
+  case Expr::Extract: {
+    ref<Expr> kid;
+    uint64_t offset, width;
+    if (!readExpr(kid) || !readNumber(offset) || !readNumber(width))
+      return false;
+    e = ExtractExpr::alloc(kid, offset, width);
+    break;
+  }
+  case Expr::ZExt:
+  case Expr::SExt: {
+    ref<Expr> kid;
+    uint64_t width;
+    if (!readExpr(kid) || !readNumber(width))
+      return false;
+    e = k == Expr::ZExt ? ZExtExpr::alloc(kid, width)
+                        : SExtExpr::alloc(kid, width);
+    break;
+  }
+  case Expr::NotOptimized:
+  case Expr::Not: {
+    ref<Expr> kid;
+    if (!readExpr(kid))
+      return false;
+    e = k == Expr::Not ? NotExpr::alloc(kid) : NotOptimizedExpr::alloc(kid);
+    break;
+  }
+  case Expr::Select: {
+    ref<Expr> c, t, f;
+    if (!readExpr(c) || !readExpr(t) || !readExpr(f))
+      return false;
+    e = SelectExpr::alloc(c, t, f);
+    break;
+  }
+  case Expr::Concat: {
+    ref<Expr> l, r;
+    if (!readExpr(l) || !readExpr(r))
+      return false;
+    e = ConcatExpr::alloc(l, r);
+    break;
+  }
+  default: {
+    if (!isBinaryKind(k))
+      return fail("unknown expression kind " + std::to_string(kind));
+    ref<Expr> l, r;
+    if (!readExpr(l) || !readExpr(r))
+      return false;
+    switch (k) {
+#define BINARY_EXPR_CASE(T)                                                    \
+  case Expr::T:                                                                \
+    e = T##Expr::alloc(l, r);                                                  \
+    break;
+      BINARY_EXPR_CASE(Add)
+      BINARY_EXPR_CASE(Sub)
+      BINARY_EXPR_CASE(Mul)
+      BINARY_EXPR_CASE(UDiv)
+      BINARY_EXPR_CASE(SDiv)
+      BINARY_EXPR_CASE(URem)
+      BINARY_EXPR_CASE(SRem)
+      BINARY_EXPR_CASE(And)
+      BINARY_EXPR_CASE(Or)
+      BINARY_EXPR_CASE(Xor)
+      BINARY_EXPR_CASE(Shl)
+      BINARY_EXPR_CASE(LShr)
+      BINARY_EXPR_CASE(AShr)
+      BINARY_EXPR_CASE(Eq)
+      BINARY_EXPR_CASE(Ne)
+      BINARY_EXPR_CASE(Ult)
+      BINARY_EXPR_CASE(Ule)
+      BINARY_EXPR_CASE(Ugt)
+      BINARY_EXPR_CASE(Uge)
+      BINARY_EXPR_CASE(Slt)
+      BINARY_EXPR_CASE(Sle)
+      BINARY_EXPR_CASE(Sgt)
+      BINARY_EXPR_CASE(Sge)
+#undef BINARY_EXPR_CASE
+    default:
+      return fail("unknown expression kind " + std::to_string(kind));
+    }
+    break;
+  }
+  }
+  exprs.push_back(e);
+  return true;
+}
+
+bool ExprDeserializer::readUpdateRecord() {
+  uint64_t next;
+  ref<Expr> index, value;
+  if (!readNumber(next) || !readExpr(index) || !readExpr(value))
+    return false;
+  if (next > updates.size())
+    return fail("reference to an undeclared update node");
+  ref<UpdateNode> nextUN;
+  if (next)
+    nextUN = updates[next - 1];
+  updates.push_back(new UpdateNode(nextUN, index, value));
+  return true;
+}
+
+bool ExprDeserializer::readRecord(char tag) {
+  switch (tag) {
+  case 'A':
+    return readArrayRecord();
+  case 'E':
+    return readExprRecord();
+  case 'U':
+    return readUpdateRecord();
+  default:
+    return fail(std::string("unknown record '") + tag + "'");
+  }
+}
+
+void ExprDeserializer::reset() {
+  exprs.clear();
+  updates.clear();
+}
+
+void ExprImage::write(const std::vector<ref<Expr>> &roots, std::string &out) {
+  out.append(Magic, sizeof(Magic));
+  ExprSerializer serializer;
+  std::vector<uint64_t> ids;
+  ids.reserve(roots.size());
+  for (const ref<Expr> &e : roots)
+    ids.push_back(serializer.writeExpr(e, out));
+  out += 'R';
+  ExprSerializer::writeNumber(out, ids.size());
+  for (uint64_t id : ids)
+    ExprSerializer::writeNumber(out, id);
+}
+
+bool ExprImage::read(ArrayCache &arrayCache, const char *begin,
+                     const char *end, std::vector<ref<Expr>> &roots,
+                     std::string &error) {
+  if ((size_t)(end - begin) < sizeof(Magic) ||
+      memcmp(begin, Magic, sizeof(Magic))) {
+    error = "not an expression image";
+    return false;
+  }
+  ExprDeserializer reader(arrayCache, begin + sizeof(Magic), end);
+  char tag = 0;
+  while (reader.readTag(tag) && tag != 'R') {
+    if (!reader.readRecord(tag)) {
+      error = reader.getError();
+      return false;
+    }
+    tag = 0;
+  }
+  if (tag != 'R') {
+    error = "missing roots";
+    return false;
+  }
+
+  uint64_t n;
+  bool ok = reader.readNumber(n);
+  roots.clear();
+  for (uint64_t i = 0; ok && i < n; ++i) {
+    ref<Expr> e;
+    ok = reader.readExpr(e);
+    roots.push_back(e);
+  }
+  if (ok && !reader.atEnd())
+    ok = reader.fail("data after the roots");
+  if (!ok) {
+    error = reader.getError();
+    roots.clear();
+  }
+  return ok;
+}
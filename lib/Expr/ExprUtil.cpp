@@ -12,11 +12,13 @@
 #include "klee/Expr/ExprHashMap.h"
 #include "klee/Expr/ExprVisitor.h"
 
+#include <algorithm>
 #include <set>
+#include <unordered_set>
 
 using namespace klee;
 
-void klee::findReads(ref<Expr> e, 
+void klee::findReads(const ref<Expr> &e, 
                      bool visitUpdates,
                      std::vector< ref<ReadExpr> > &results) {
   // Invariant: \forall_{i \in stack} !i.isConstant() && i \in visited 
@@ -65,7 +67,8 @@ void klee::findReads(ref<Expr> e,
       Expr *e = top.get();
       for (unsigned i=0; i<e->getNumKids(); i++) {
         ref<Expr> k = e->getKid(i);
-        if (!isa<ConstantExpr>(k) &&
+        // subexpressions reading no array hold no reads
+        if (!isa<ConstantExpr>(k) && !k->getMetadata().arrays->empty() &&
             visited.insert(k).second)
           stack.push_back(k);
       }
@@ -77,32 +80,6 @@ void klee::findReads(ref<Expr> e,
 
 namespace klee {
 
-class SymbolicObjectFinder : public ExprVisitor {
-protected:
-  Action visitRead(const ReadExpr &re) {
-    const UpdateList &ul = re.updates;
-
-    // XXX should we memo better than what ExprVisitor is doing for us?
-    for (const auto *un = ul.head.get(); un; un = un->next.get()) {
-      visit(un->index);
-      visit(un->value);
-    }
-
-    if (ul.root->isSymbolicArray())
-      if (results.insert(ul.root).second)
-        objects.push_back(ul.root);
-
-    return Action::doChildren();
-  }
-
-public:
-  std::set<const Array*> results;
-  std::vector<const Array*> &objects;
-  
-  SymbolicObjectFinder(std::vector<const Array*> &_objects)
-    : objects(_objects) {}
-};
-
 ExprVisitor::Action ConstantArrayFinder::visitRead(const ReadExpr &re) {
   const UpdateList &ul = re.updates;
 
@@ -124,9 +101,23 @@ template<typename InputIterator>
 void klee::findSymbolicObjects(InputIterator begin, 
                                InputIterator end,
                                std::vector<const Array*> &results) {
-  SymbolicObjectFinder of(results);
-  for (; begin!=end; ++begin)
-    of.visit(*begin);
+  // the arrays read below a node, updates included, are in its metadata
+  std::unordered_set<const Array *> found;
+  std::unordered_set<const std::vector<const Array *> *> seen;
+  size_t first = results.size();
+  for (; begin!=end; ++begin) {
+    const auto &arrays = (*begin)->getMetadata().arrays;
+    // the nodes of an expression mostly share the same set
+    if (!seen.insert(arrays.get()).second)
+      continue;
+    for (const Array *a : *arrays)
+      if (a->isSymbolicArray() && found.insert(a).second)
+        results.push_back(a);
+  }
+  // each set is sorted by id, the arrays of several expressions are too so
+  // that the order is the same in every run
+  if (seen.size() > 1)
+    std::sort(results.begin() + first, results.end(), ArrayIdLess());
 }
 
 void klee::findSymbolicObjects(ref<Expr> e,
@@ -13,6 +13,8 @@
 
 #include "llvm/Support/CommandLine.h"
 
+#include <vector>
+
 namespace {
 llvm::cl::opt<bool> UseVisitorHash(
     "use-visitor-hash",
@@ -23,133 +25,221 @@ llvm::cl::opt<bool> UseVisitorHash(
 
 using namespace klee;
 
-ref<Expr> ExprVisitor::visit(const ref<Expr> &e) {
+namespace {
+/// A node whose children are being visited by ExprVisitor::visit.
+struct VisitFrame {
+  enum Phase {
+    Enter,    // nothing done yet
+    Kids,     // visiting kids[next]
+    ReadIndex, // visiting the index of a ReadExpr
+    Revisit,  // visiting the rebuilt node again (recursive visitors)
+  };
+
+  ref<Expr> e;
+  Phase phase;
+  unsigned next;
+  bool rebuild;
+  ref<Expr> kids[8];
+  ref<Expr> rebuilt;
+
+  explicit VisitFrame(const ref<Expr> &_e)
+      : e(_e), phase(Enter), next(0), rebuild(false) {}
+};
+} // namespace
+
+// The traversal keeps its own stack instead of recursing over the kids, so
+// that deep expressions do not overflow the native stack. Every node is
+// memoized in visited (unless -use-visitor-hash=false), shared subtrees are
+// visited once.
+ref<Expr> ExprVisitor::visit(const ref<Expr> &root) {
   // TODO: In recursive mode, should I repeatedly search visited Exprs, so that
   // chains of replacement can resolved quicker.
-  if (!UseVisitorHash || isa<ConstantExpr>(e)) {
-    return visitActual(e);
-  } else {
-    visited_ty::iterator it = visited.find(e);
-
-    if (it!=visited.end()) {
-      return it->second;
-    } else {
-      ref<Expr> res = visitActual(e);
-      visited.insert(std::make_pair(e, res));
-      return res;
-    }
-  }
-}
-
-ref<Expr> ExprVisitor::visitActual(const ref<Expr> &e) {
-  if (isa<ConstantExpr>(e)) {    
-    return e;
-  } else {
-    Expr &ep = *e.get();
-
-    Action res = visitExpr(ep);
-    switch(res.kind) {
-    case Action::DoChildren:
-      // continue with normal action
-      break;
-    case Action::SkipChildren:
-      return e;
-    case Action::ChangeTo:
-      return res.argument;
+  std::vector<VisitFrame> stack;
+  stack.emplace_back(root);
+  // result of the last finished frame
+  ref<Expr> result;
+
+  while (!stack.empty()) {
+    VisitFrame &f = stack.back();
+    const ref<Expr> e = f.e;
+    switch (f.phase) {
+    case VisitFrame::Enter: {
+      if (isa<ConstantExpr>(e)) {
+        result = e;
+        stack.pop_back();
+        continue;
+      }
+      if (UseVisitorHash) {
+        visited_ty::iterator it = visited.find(e);
+        if (it != visited.end()) {
+          result = it->second;
+          stack.pop_back();
+          continue;
+        }
+      }
+      if (visitPre(e, result)) {
+        finish(e, result);
+        stack.pop_back();
+        continue;
+      }
+      if (ReadExpr *RE = dyn_cast<ReadExpr>(e)) {
+        f.phase = VisitFrame::ReadIndex;
+        stack.emplace_back(RE->index);
+      } else {
+        f.phase = VisitFrame::Kids;
+        if (e->getNumKids())
+          stack.emplace_back(e->getKid(0));
+      }
+      continue;
     }
 
-    switch(ep.getKind()) {
-    case Expr::NotOptimized: res = visitNotOptimized(static_cast<NotOptimizedExpr&>(ep)); break;
-    case Expr::Read: res = visitRead(static_cast<ReadExpr&>(ep)); break;
-    case Expr::Select: res = visitSelect(static_cast<SelectExpr&>(ep)); break;
-    case Expr::Concat: res = visitConcat(static_cast<ConcatExpr&>(ep)); break;
-    case Expr::Extract: res = visitExtract(static_cast<ExtractExpr&>(ep)); break;
-    case Expr::ZExt: res = visitZExt(static_cast<ZExtExpr&>(ep)); break;
-    case Expr::SExt: res = visitSExt(static_cast<SExtExpr&>(ep)); break;
-    case Expr::Add: res = visitAdd(static_cast<AddExpr&>(ep)); break;
-    case Expr::Sub: res = visitSub(static_cast<SubExpr&>(ep)); break;
-    case Expr::Mul: res = visitMul(static_cast<MulExpr&>(ep)); break;
-    case Expr::UDiv: res = visitUDiv(static_cast<UDivExpr&>(ep)); break;
-    case Expr::SDiv: res = visitSDiv(static_cast<SDivExpr&>(ep)); break;
-    case Expr::URem: res = visitURem(static_cast<URemExpr&>(ep)); break;
-    case Expr::SRem: res = visitSRem(static_cast<SRemExpr&>(ep)); break;
-    case Expr::Not: res = visitNot(static_cast<NotExpr&>(ep)); break;
-    case Expr::And: res = visitAnd(static_cast<AndExpr&>(ep)); break;
-    case Expr::Or: res = visitOr(static_cast<OrExpr&>(ep)); break;
-    case Expr::Xor: res = visitXor(static_cast<XorExpr&>(ep)); break;
-    case Expr::Shl: res = visitShl(static_cast<ShlExpr&>(ep)); break;
-    case Expr::LShr: res = visitLShr(static_cast<LShrExpr&>(ep)); break;
-    case Expr::AShr: res = visitAShr(static_cast<AShrExpr&>(ep)); break;
-    case Expr::Eq: res = visitEq(static_cast<EqExpr&>(ep)); break;
-    case Expr::Ne: res = visitNe(static_cast<NeExpr&>(ep)); break;
-    case Expr::Ult: res = visitUlt(static_cast<UltExpr&>(ep)); break;
-    case Expr::Ule: res = visitUle(static_cast<UleExpr&>(ep)); break;
-    case Expr::Ugt: res = visitUgt(static_cast<UgtExpr&>(ep)); break;
-    case Expr::Uge: res = visitUge(static_cast<UgeExpr&>(ep)); break;
-    case Expr::Slt: res = visitSlt(static_cast<SltExpr&>(ep)); break;
-    case Expr::Sle: res = visitSle(static_cast<SleExpr&>(ep)); break;
-    case Expr::Sgt: res = visitSgt(static_cast<SgtExpr&>(ep)); break;
-    case Expr::Sge: res = visitSge(static_cast<SgeExpr&>(ep)); break;
-    case Expr::Constant:
-    default:
-      assert(0 && "invalid expression kind");
+    case VisitFrame::ReadIndex: {
+      ReadExpr *RE = cast<ReadExpr>(e);
+      if (result != RE->index)
+        f.rebuild = true;
+      UpdateList ul(RE->updates);
+      if (!ul.head.isNull()) {
+        ul.head = visitUpdateNode(ul.head);
+      }
+      if (ul.head.get() != RE->updates.head.get())
+        f.rebuild = true;
+      if (f.rebuild) {
+        f.rebuilt = RE->rebuild(ul, result);
+        break;
+      }
+      result = visitPost(e, e);
+      finish(e, result);
+      stack.pop_back();
+      continue;
     }
 
-    switch(res.kind) {
-    default:
-      assert(0 && "invalid kind");
-    case Action::DoChildren: {  
-      bool rebuild = false;
-      ref<Expr> e_ret(e);
-      if (ReadExpr *RE = dyn_cast<ReadExpr>(e)) {
-        ref<Expr> index;
-        index = visit(RE->index);
-        if (index != RE->index)
-          rebuild = true;
-        UpdateList ul(RE->updates);
-        if (!ul.head.isNull()) {
-          ul.head = visitUpdateNode(ul.head);
-        }
-        if (ul.head.get() != RE->updates.head.get())
-          rebuild = true;
-        if (rebuild) {
-          e_ret = RE->rebuild(ul, index);
-          if (recursive)
-            e_ret = visit(e_ret);
-        }
-      }
-      else {
-        ref<Expr> kids[8];
-        unsigned count = ep.getNumKids();
-        for (unsigned i=0; i<count; i++) {
-          ref<Expr> kid = ep.getKid(i);
-          kids[i] = visit(kid);
-          if (kids[i] != kid)
-            rebuild = true;
-        }
-        if (rebuild) {
-          e_ret = ep.rebuild(kids);
-          if (recursive)
-            e_ret = visit(e_ret);
+    case VisitFrame::Kids: {
+      unsigned count = e->getNumKids();
+      if (f.next < count) {
+        ref<Expr> kid = e->getKid(f.next);
+        f.kids[f.next] = result;
+        if (result != kid)
+          f.rebuild = true;
+        if (++f.next < count) {
+          stack.emplace_back(e->getKid(f.next));
+          continue;
         }
       }
-      if (!isa<ConstantExpr>(e_ret)) {
-        res = visitExprPost(*e_ret.get());
-        if (res.kind==Action::ChangeTo)
-          e_ret = res.argument;
+      if (f.rebuild) {
+        f.rebuilt = e->rebuild(f.kids);
+        break;
       }
-      if (e_ret.get() != e.get()) {
-        e_ret->updateKInst(e->getKInst());
-      }
-      return e_ret;
+      result = visitPost(e, e);
+      finish(e, result);
+      stack.pop_back();
+      continue;
     }
-    case Action::SkipChildren:
-      return e;
-    case Action::ChangeTo:
-      res.argument->updateKInst(e->getKInst());
-      return res.argument;
+
+    case VisitFrame::Revisit:
+      result = visitPost(e, result);
+      finish(e, result);
+      stack.pop_back();
+      continue;
     }
+
+    // the node was rebuilt from changed kids
+    if (recursive) {
+      f.phase = VisitFrame::Revisit;
+      ref<Expr> rebuilt = f.rebuilt;
+      f.rebuilt = nullptr;
+      stack.emplace_back(rebuilt);
+      continue;
+    }
+    result = visitPost(e, f.rebuilt);
+    finish(e, result);
+    stack.pop_back();
+  }
+  return result;
+}
+
+void ExprVisitor::finish(const ref<Expr> &e, const ref<Expr> &result) {
+  if (UseVisitorHash)
+    visited.insert(std::make_pair(e, result));
+}
+
+bool ExprVisitor::visitPre(const ref<Expr> &e, ref<Expr> &result) {
+  Expr &ep = *e.get();
+
+  Action res = visitExpr(ep);
+  switch(res.kind) {
+  case Action::DoChildren:
+    // continue with normal action
+    break;
+  case Action::SkipChildren:
+    result = e;
+    return true;
+  case Action::ChangeTo:
+    result = res.argument;
+    return true;
+  }
+
+  switch(ep.getKind()) {
+  case Expr::NotOptimized: res = visitNotOptimized(static_cast<NotOptimizedExpr&>(ep)); break;
+  case Expr::Read: res = visitRead(static_cast<ReadExpr&>(ep)); break;
+  case Expr::Select: res = visitSelect(static_cast<SelectExpr&>(ep)); break;
+  case Expr::Concat: res = visitConcat(static_cast<ConcatExpr&>(ep)); break;
+  case Expr::Extract: res = visitExtract(static_cast<ExtractExpr&>(ep)); break;
+  case Expr::ZExt: res = visitZExt(static_cast<ZExtExpr&>(ep)); break;
+  case Expr::SExt: res = visitSExt(static_cast<SExtExpr&>(ep)); break;
+  case Expr::Add: res = visitAdd(static_cast<AddExpr&>(ep)); break;
+  case Expr::Sub: res = visitSub(static_cast<SubExpr&>(ep)); break;
+  case Expr::Mul: res = visitMul(static_cast<MulExpr&>(ep)); break;
+  case Expr::UDiv: res = visitUDiv(static_cast<UDivExpr&>(ep)); break;
+  case Expr::SDiv: res = visitSDiv(static_cast<SDivExpr&>(ep)); break;
+  case Expr::URem: res = visitURem(static_cast<URemExpr&>(ep)); break;
+  case Expr::SRem: res = visitSRem(static_cast<SRemExpr&>(ep)); break;
+  case Expr::Not: res = visitNot(static_cast<NotExpr&>(ep)); break;
+  case Expr::And: res = visitAnd(static_cast<AndExpr&>(ep)); break;
+  case Expr::Or: res = visitOr(static_cast<OrExpr&>(ep)); break;
+  case Expr::Xor: res = visitXor(static_cast<XorExpr&>(ep)); break;
+  case Expr::Shl: res = visitShl(static_cast<ShlExpr&>(ep)); break;
+  case Expr::LShr: res = visitLShr(static_cast<LShrExpr&>(ep)); break;
+  case Expr::AShr: res = visitAShr(static_cast<AShrExpr&>(ep)); break;
+  case Expr::Eq: res = visitEq(static_cast<EqExpr&>(ep)); break;
+  case Expr::Ne: res = visitNe(static_cast<NeExpr&>(ep)); break;
+  case Expr::Ult: res = visitUlt(static_cast<UltExpr&>(ep)); break;
+  case Expr::Ule: res = visitUle(static_cast<UleExpr&>(ep)); break;
+  case Expr::Ugt: res = visitUgt(static_cast<UgtExpr&>(ep)); break;
+  case Expr::Uge: res = visitUge(static_cast<UgeExpr&>(ep)); break;
+  case Expr::Slt: res = visitSlt(static_cast<SltExpr&>(ep)); break;
+  case Expr::Sle: res = visitSle(static_cast<SleExpr&>(ep)); break;
+  case Expr::Sgt: res = visitSgt(static_cast<SgtExpr&>(ep)); break;
+  case Expr::Sge: res = visitSge(static_cast<SgeExpr&>(ep)); break;
+  case Expr::Constant:
+  default:
+    assert(0 && "invalid expression kind");
+  }
+
+  switch(res.kind) {
+  default:
+    assert(0 && "invalid kind");
+  case Action::DoChildren:
+    return false;
+  case Action::SkipChildren:
+    result = e;
+    return true;
+  case Action::ChangeTo:
+    res.argument->updateKInst(e->getKInst());
+    result = res.argument;
+    return true;
+  }
+}
+
+ref<Expr> ExprVisitor::visitPost(const ref<Expr> &e, ref<Expr> e_ret) {
+  if (!isa<ConstantExpr>(e_ret)) {
+    Action res = visitExprPost(*e_ret.get());
+    if (res.kind==Action::ChangeTo)
+      e_ret = res.argument;
+  }
+  if (e_ret.get() != e.get()) {
+    e_ret->updateKInst(e->getKInst());
   }
+  return e_ret;
 }
 
 ref<UpdateNode> ExprVisitor::visitUpdateNode(const ref<UpdateNode> &un) {
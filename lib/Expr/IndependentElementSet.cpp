@@ -2,6 +2,9 @@
 using namespace klee;
 IndependentElementSet::IndependentElementSet(ref<Expr> e) {
   exprs.insert(e);
+  fingerprint = constraintFingerprint(e);
+  if (e->getMetadata().arrays->empty())
+    return;
   // Track all reads in the program.  Determines whether reads are
   // concrete or symbolic.  If they are symbolic, "collapses" array
   // by adding it to wholeObjects.  Otherwise, creates a mapping of
@@ -36,7 +39,7 @@ IndependentElementSet::IndependentElementSet(ref<Expr> e) {
 void IndependentElementSet::print(llvm::raw_ostream &os) const {
   os << "{";
   bool first = true;
-  for (std::set<const Array*>::iterator it = wholeObjects.begin(), 
+  for (wholeObjects_ty::const_iterator it = wholeObjects.begin(), 
       ie = wholeObjects.end(); it != ie; ++it) {
     const Array *array = *it;
 
@@ -67,8 +70,8 @@ void IndependentElementSet::print(llvm::raw_ostream &os) const {
 // more efficient when this is the smaller set
 bool IndependentElementSet::intersects(const IndependentElementSet &b) const {
   // If there are any symbolic arrays in our query that b accesses
-  const std::set<const Array*> *smallerWholeObjects = nullptr;
-  const std::set<const Array*> *largerWholeObjects = nullptr;
+  const wholeObjects_ty *smallerWholeObjects = nullptr;
+  const wholeObjects_ty *largerWholeObjects = nullptr;
   const elements_ty *elementsWithlargerWholeObjects = nullptr;
   if (wholeObjects.size() < b.wholeObjects.size()) {
     smallerWholeObjects = &wholeObjects;
@@ -89,7 +92,7 @@ bool IndependentElementSet::intersects(const IndependentElementSet &b) const {
   // check whether concrete array accesses overlap
   const elements_ty *smallerElements = nullptr;
   const elements_ty *largerElements = nullptr;
-  const std::set<const Array*> *wholeObjectsWithlargerElements = nullptr;
+  const wholeObjects_ty *wholeObjectsWithlargerElements = nullptr;
   if (elements.size() < b.elements.size()) {
     smallerElements = &elements;
     largerElements = &(b.elements);
@@ -116,10 +119,12 @@ bool IndependentElementSet::intersects(const IndependentElementSet &b) const {
 
 // returns true iff set is changed by addition
 bool IndependentElementSet::add(const IndependentElementSet &b) {
-  exprs.insert(b.exprs.begin(), b.exprs.end());
+  for (const ref<Expr> &e : b.exprs)
+    if (exprs.insert(e).second)
+      fingerprint += constraintFingerprint(e);
 
   bool modified = false;
-  for (std::set<const Array*>::const_iterator it = b.wholeObjects.begin(), 
+  for (wholeObjects_ty::const_iterator it = b.wholeObjects.begin(), 
       ie = b.wholeObjects.end(); it != ie; ++it) {
     const Array *array = *it;
     elements_ty::iterator it2 = elements.find(array);
@@ -3,6 +3,8 @@
 #include "klee/Solver/SolverImpl.h"
 #include "klee/OptionCategories.h"
 
+#include <algorithm>
+
 using namespace llvm;
 
 namespace klee {
@@ -11,30 +13,285 @@ namespace klee {
 } // namespace klee
 
 ref<Expr> OracleEvaluator::getInitialValue(const Array &array, unsigned index) {
-    // it.first == array name, it.second == index at ktest->objects
-    arrayname2idx_ty::const_iterator it = arrayname2idx.find(array.name);
-    if (it == arrayname2idx.end()) {
+    const KTestObject *kobj = findObject(array.name);
+    if (!kobj) {
         klee_message("Cannot find symbolic array %s in KTest", array.name.c_str());
         return ReadExpr::create(UpdateList(&array, 0),
             ConstantExpr::alloc(index, array.getDomain()));
     }
-    KTestObject &kobj = ktest->objects[it->second];
-    if (index >= kobj.numBytes) {
+    if (index >= kobj->numBytes) {
         // FIXME: klee does not support symbolic malloc and symbolic file size,
         // and memcpy is not recorded. It is possible that an "invalid" position
         // is referenced here. However, the program won't use it.
         return ConstantExpr::alloc(0, array.getRange());
     }
     assert(array.getRange() == Expr::Int8 && "Current implementation only supports byte array");
-    return ConstantExpr::alloc(kobj.bytes[index], array.getRange());
+    return ConstantExpr::alloc(kobj->bytes[index], array.getRange());
 }
 OracleEvaluator::OracleEvaluator(std::string KTestPath, bool silent) {
-    ktest = kTest_fromFile(KTestPath.c_str());
+    // the objects are looked up in the mapped file when they are first read
+    ktest = kTest_map(KTestPath.c_str());
     assert(ktest && "Open KTestFile error");
-    for (unsigned int i=0; i < ktest->numObjects; ++i) {
-        if (!silent) {
-            klee_message("Loading %s from OracleKTest", ktest->objects[i].name);
+    if (!silent)
+        klee_message("Loading %s as OracleKTest", KTestPath.c_str());
+}
+
+OracleEvaluator::~OracleEvaluator() { kTest_unmap(ktest); }
+
+const KTestObject *OracleEvaluator::findObject(const std::string &name) {
+    return kTest_mapFind(ktest, name.c_str());
+}
+
+const size_t OracleEvaluator::MaxCachedValues;
+
+namespace {
+inline uint64_t widthMask(unsigned w) { return ~0ULL >> (64 - w); }
+
+inline int64_t signExtend(uint64_t v, unsigned w) {
+  return (int64_t)(v << (64 - w)) >> (64 - w);
+}
+} // namespace
+
+const KTestObject *OracleEvaluator::getObject(const Array *array) {
+  if (const KTestObject *const *known = objects.lookup(array))
+    return *known;
+  const KTestObject *obj = nullptr;
+  if (array->getRange() == Expr::Int8)
+    obj = findObject(array->name);
+  objects[array] = obj;
+  return obj;
+}
+
+int OracleEvaluator::lookup(const ref<Expr> &e, uint64_t &value) const {
+  if (const ConstantExpr *CE = dyn_cast<ConstantExpr>(e)) {
+    if (CE->getWidth() > 64)
+      return 0;
+    value = CE->getZExtValue();
+    return 1;
+  }
+  auto it = values.find(e.get());
+  if (it == values.end())
+    return -1;
+  value = it->second.value;
+  return it->second.known;
+}
+
+bool OracleEvaluator::step(EvalFrame &f, ref<Expr> &kid, bool &known,
+                           uint64_t &value) {
+  const Expr &e = *f.e;
+  known = false;
+  if (e.getWidth() > 64)
+    return true;
+
+  if (const ReadExpr *RE = dyn_cast<ReadExpr>(&e)) {
+    // walks the updates the way ExprEvaluator::evalRead does
+    uint64_t v;
+    if (f.next == 0) {
+      int state = lookup(RE->index, v);
+      if (state < 0) {
+        kid = RE->index;
+        return false;
+      }
+      if (!state)
+        return true;
+      f.kids[0] = (unsigned)v;
+      f.next = 1;
+      f.un = RE->updates.head.get();
+      if (f.un && f.un->getSize() >= UpdateNode::MinIndexedSize) {
+        const UpdateNode::ConcreteWrites &writes = f.un->getConcreteWrites();
+        if (const auto *w = writes.latest.lookup(f.kids[0])) {
+          f.un = w->second;
+          f.next = 2;
+        } else {
+          f.un = writes.rest;
         }
-        arrayname2idx[ktest->objects[i].name] = i;
+      }
+    }
+    for (; f.next == 1 && f.un; f.un = f.un->next.get()) {
+      int state = lookup(f.un->index, v);
+      if (state < 0) {
+        kid = f.un->index;
+        return false;
+      }
+      if (!state)
+        return true;
+      if (v == f.kids[0]) {
+        f.next = 2;
+        break;
+      }
+    }
+    if (f.next == 2) {
+      int state = lookup(f.un->value, v);
+      if (state < 0) {
+        kid = f.un->value;
+        return false;
+      }
+      known = state;
+      value = v;
+      return true;
+    }
+
+    const Array *root = RE->updates.root;
+    uint64_t index = f.kids[0];
+    if (root->isConstantArray()) {
+      if (index >= root->size || root->getRange() > 64)
+        return true;
+      value = root->constantValues[index]->getZExtValue();
+    } else {
+      const KTestObject *obj = getObject(root);
+      if (!obj)
+        return true;
+      value = index < obj->numBytes ? obj->bytes[index] : 0;
+    }
+    known = true;
+    return true;
+  }
+
+  for (unsigned n = e.getNumKids(); f.next < n; ++f.next) {
+    int state = lookup(e.getKid(f.next), f.kids[f.next]);
+    if (state < 0) {
+      kid = e.getKid(f.next);
+      return false;
     }
+    if (!state)
+      return true;
+  }
+
+  const unsigned w = e.getWidth();
+  const uint64_t mask = widthMask(w);
+  const uint64_t x = f.kids[0], y = f.kids[1];
+  const unsigned kw = e.getNumKids() ? e.getKid(0)->getWidth() : 0;
+  switch (e.getKind()) {
+  case Expr::NotOptimized:
+  case Expr::ZExt:
+    value = x;
+    break;
+  case Expr::Select:
+    value = x ? y : f.kids[2];
+    break;
+  case Expr::Concat:
+    value = ((x << e.getKid(1)->getWidth()) | y) & mask;
+    break;
+  case Expr::Extract:
+    value = (x >> cast<ExtractExpr>(e).offset) & mask;
+    break;
+  case Expr::SExt:
+    value = (uint64_t)signExtend(x, kw) & mask;
+    break;
+  case Expr::Not:
+    value = ~x & mask;
+    break;
+  case Expr::Add:
+    value = (x + y) & mask;
+    break;
+  case Expr::Sub:
+    value = (x - y) & mask;
+    break;
+  case Expr::Mul:
+    value = (x * y) & mask;
+    break;
+  case Expr::UDiv:
+  case Expr::URem:
+  case Expr::SDiv:
+  case Expr::SRem: {
+    // ExprEvaluator leaves divisions by zero symbolic
+    if (y == 0)
+      return true;
+    int64_t a = signExtend(x, w), b = signExtend(y, w);
+    if (e.getKind() == Expr::UDiv)
+      value = x / y;
+    else if (e.getKind() == Expr::URem)
+      value = x % y;
+    // INT64_MIN / -1 wraps around like APInt::sdiv
+    else if (e.getKind() == Expr::SDiv)
+      value = (b == -1 ? 0 - (uint64_t)a : (uint64_t)(a / b)) & mask;
+    else
+      value = (b == -1 ? 0 : (uint64_t)(a % b)) & mask;
+    break;
+  }
+  case Expr::And:
+    value = x & y;
+    break;
+  case Expr::Or:
+    value = x | y;
+    break;
+  case Expr::Xor:
+    value = x ^ y;
+    break;
+  case Expr::Shl:
+    value = y >= w ? 0 : (x << y) & mask;
+    break;
+  case Expr::LShr:
+    value = y >= w ? 0 : x >> y;
+    break;
+  case Expr::AShr:
+    value = (uint64_t)(signExtend(x, w) >> std::min<uint64_t>(y, 63)) & mask;
+    break;
+  case Expr::Eq:
+    value = x == y;
+    break;
+  case Expr::Ne:
+    value = x != y;
+    break;
+  case Expr::Ult:
+    value = x < y;
+    break;
+  case Expr::Ule:
+    value = x <= y;
+    break;
+  case Expr::Ugt:
+    value = x > y;
+    break;
+  case Expr::Uge:
+    value = x >= y;
+    break;
+  case Expr::Slt:
+    value = signExtend(x, kw) < signExtend(y, kw);
+    break;
+  case Expr::Sle:
+    value = signExtend(x, kw) <= signExtend(y, kw);
+    break;
+  case Expr::Sgt:
+    value = signExtend(x, kw) > signExtend(y, kw);
+    break;
+  case Expr::Sge:
+    value = signExtend(x, kw) >= signExtend(y, kw);
+    break;
+  default:
+    return true;
+  }
+  known = true;
+  return true;
+}
+
+bool OracleEvaluator::evaluateConcrete(const ref<Expr> &e, uint64_t &value) {
+  int state = lookup(e, value);
+  if (state >= 0)
+    return state;
+  if (values.size() >= MaxCachedValues)
+    values.clear();
+
+  // an explicit stack, deep expressions must not overflow the native one
+  stack.clear();
+  stack.push_back(EvalFrame{e, 0, {0, 0, 0}, nullptr});
+  while (!stack.empty()) {
+    ref<Expr> kid;
+    bool known;
+    uint64_t v = 0;
+    if (!step(stack.back(), kid, known, v)) {
+      stack.push_back(EvalFrame{kid, 0, {0, 0, 0}, nullptr});
+      continue;
+    }
+    ref<Expr> done = stack.back().e;
+    values[done.get()] = CachedValue{done, v, known};
+    stack.pop_back();
+  }
+  return lookup(e, value) > 0;
+}
+
+ref<Expr> OracleEvaluator::evaluate(const ref<Expr> &e) {
+  uint64_t value;
+  if (evaluateConcrete(e, value))
+    return ConstantExpr::alloc(value, e->getWidth());
+  return visit(e);
 }
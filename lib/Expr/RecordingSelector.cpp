@@ -0,0 +1,146 @@
+//===-- RecordingSelector.cpp ---------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/util/RecordingSelector.h"
+
+#include "klee/Internal/Module/KInstruction.h"
+#include "klee/util/ExprConcretizer.h"
+
+#include "llvm/IR/Instruction.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+using namespace klee;
+
+namespace {
+const unsigned NoNode = ~0u;
+}
+
+RecordingSelector::RecordingSelector(const std::vector<ref<Expr>> &exprs) {
+  Constraints_ty all(exprs.begin(), exprs.end());
+  IndirectReadDepthCalculator depths(all);
+
+  for (const ref<Expr> &e : exprs)
+    addNode(e);
+  // nodes are appended while their operands are added
+  for (unsigned n = 0; n < nodes.size(); ++n) {
+    const Expr *e = nodes[n];
+    weight[n] = e->getWidth() / 8.0 * (1 + std::max(0, depths.query(e)));
+    if (const ReadExpr *re = dyn_cast<ReadExpr>(e)) {
+      derivable[n] = re->updates.root->isConstantArray();
+      addOperand(n, re->index);
+      for (const UpdateNode *un = re->updates.head.get(); un;
+           un = un->next.get()) {
+        addOperand(n, un->index);
+        addOperand(n, un->value);
+      }
+    } else {
+      for (unsigned i = 0; i < e->getNumKids(); ++i)
+        addOperand(n, e->getKid(i));
+    }
+
+    const KInstruction *ki = e->getKInst();
+    if (!ki || !ki->inst->hasName() || ki->inst->getType()->isVoidTy() ||
+        ki->inst->getType()->isPointerTy())
+      continue;
+    auto &kiNodes = kinstNodes[ki];
+    if (kiNodes.empty())
+      kinsts.push_back(ki);
+    kiNodes.push_back(n);
+  }
+}
+
+unsigned RecordingSelector::addNode(const ref<Expr> &e) {
+  if (isa<ConstantExpr>(e))
+    return NoNode;
+  auto it = nodeIndex.insert(std::make_pair(e.get(), (unsigned)nodes.size()));
+  if (it.second) {
+    nodes.push_back(e.get());
+    parents.emplace_back();
+    unknownKids.push_back(0);
+    derivable.push_back(true);
+    known.push_back(false);
+    weight.push_back(0);
+  }
+  return it.first->second;
+}
+
+void RecordingSelector::addOperand(unsigned node, const ref<Expr> &kid) {
+  if (kid.isNull())
+    return;
+  unsigned k = addNode(kid);
+  if (k == NoNode)
+    return;
+  parents[k].push_back(node);
+  ++unknownKids[node];
+}
+
+std::vector<unsigned>
+RecordingSelector::evaluate(const KInstruction *ki, double &score) const {
+  std::vector<unsigned> concretized;
+  std::unordered_set<unsigned> seen;
+  // node -> operands concretized by ki
+  std::unordered_map<unsigned, unsigned> resolved;
+  for (unsigned n : kinstNodes.at(ki))
+    if (!known[n] && seen.insert(n).second)
+      concretized.push_back(n);
+  score = 0;
+  for (size_t i = 0; i < concretized.size(); ++i) {
+    unsigned n = concretized[i];
+    score += weight[n];
+    for (unsigned p : parents[n]) {
+      if (known[p] || seen.count(p))
+        continue;
+      if (++resolved[p] == unknownKids[p] && derivable[p]) {
+        seen.insert(p);
+        concretized.push_back(p);
+      }
+    }
+  }
+  return concretized;
+}
+
+std::vector<RecordingSelector::Candidate> RecordingSelector::select(unsigned n) {
+  std::vector<Candidate> result;
+  std::unordered_set<const KInstruction *> picked;
+  while (result.size() < n) {
+    Candidate best = {nullptr, 0, 0, 0};
+    double bestRatio = 0;
+    std::vector<unsigned> bestNodes;
+    for (const KInstruction *ki : kinsts) {
+      if (picked.count(ki))
+        continue;
+      double score;
+      std::vector<unsigned> concretized = evaluate(ki, score);
+      if (concretized.empty())
+        continue;
+      // a value wider than 64 bits takes several ptwrites, and a missing
+      // frequency counts as one execution
+      uint64_t parts = (nodes[kinstNodes.at(ki).front()]->getWidth() + 63) / 64;
+      uint64_t bytes = 8 * parts * std::max(ki->getLoadedFreq(), 1u);
+      double ratio = score / bytes;
+      if (ratio > bestRatio) {
+        bestRatio = ratio;
+        best = {ki, (unsigned)concretized.size(), score, bytes};
+        bestNodes.swap(concretized);
+      }
+    }
+    if (!best.ki)
+      break;
+    picked.insert(best.ki);
+    for (unsigned c : bestNodes)
+      known[c] = true;
+    for (unsigned c : bestNodes)
+      for (unsigned p : parents[c])
+        --unknownKids[p];
+    result.push_back(best);
+  }
+  return result;
+}
@@ -11,6 +11,7 @@
 //#include "klee/Internal/Module/KInstruction.h"
 
 #include <cassert>
+#include <vector>
 
 using namespace klee;
 
@@ -36,6 +37,33 @@ UpdateNode::UpdateNode(const ref<UpdateNode> &_next, const ref<Expr> &_index,
   size = next.isNull() ? 1 : 1 + next->size;
 }
 
+const UpdateNode::ConcreteWrites &UpdateNode::getConcreteWrites() {
+  if (concreteWrites)
+    return *concreteWrites;
+
+  ConcreteWrites *writes = new ConcreteWrites();
+  std::vector<UpdateNode *> run;
+  for (UpdateNode *un = this; un; un = un->next.get()) {
+    if (un->concreteWrites) {
+      *writes = *un->concreteWrites;
+      break;
+    }
+    ConstantExpr *CE = dyn_cast<ConstantExpr>(un->index);
+    if (!CE || CE->getWidth() > 64) {
+      writes->rest = un;
+      break;
+    }
+    run.push_back(un);
+  }
+  // oldest first, so that later writes replace earlier ones
+  for (auto it = run.rbegin(), ie = run.rend(); it != ie; ++it) {
+    uint64_t index = cast<ConstantExpr>((*it)->index)->getZExtValue();
+    writes->latest = writes->latest.replace(std::make_pair(index, *it));
+  }
+  concreteWrites.reset(writes);
+  return *writes;
+}
+
 extern "C" void vc_DeleteExpr(void*);
 
 int UpdateNode::compare(const UpdateNode &b) const {
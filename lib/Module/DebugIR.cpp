@@ -1,5 +1,8 @@
+#include "klee/Internal/Module/KInstruction.h"
 #include "klee/Internal/Module/Passes.h"
 #include "klee/Internal/Support/Debug.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+#include "klee/Internal/Support/WorkQueue.h"
 
 #include "llvm/Pass.h"
 #include "llvm/IR/AssemblyAnnotationWriter.h"
@@ -18,7 +21,11 @@
 #include "llvm/Support/ToolOutputFile.h"
 #include "llvm/Transforms/Instrumentation.h"
 #include "llvm/Transforms/Utils/Cloning.h"
+
+#include <algorithm>
 #include <string>
+#include <thread>
+#include <vector>
 
 #define STR_HELPER(x) #x
 #define STR(x) STR_HELPER(x)
@@ -51,6 +58,12 @@ public:
     M->print(ThrowAway, this);
   }
 
+  /// Takes the lines of Values printed elsewhere.
+  ValueToLineMap(const std::vector<std::pair<const Value *, unsigned>> &Entries) {
+    for (auto &E : Entries)
+      Lines.insert(E);
+  }
+
   // This function is called after an Instruction, GlobalValue, or GlobalAlias
   // is printed.
   void printInfoComment(const Value &V, formatted_raw_ostream &Out) override {
@@ -132,6 +145,17 @@ public:
     visit(&M);
   }
 
+  /// Update the functions of M whose lines are in Entries, M is printed
+  /// elsewhere.
+  DIUpdater(Module &M, StringRef Filename, StringRef Directory,
+            const std::vector<std::pair<const Value *, unsigned>> &Entries)
+      : Builder(M), Layout(&M), LineTable(Entries), VMap(nullptr), Finder(),
+        Filename(Filename), Directory(Directory), FileNode(nullptr),
+        LexicalBlockFileNode(nullptr), M(M) {
+    Finder.processModule(M);
+    visit(&M);
+  }
+
   ~DIUpdater() { Builder.finalize(); }
 
 #if 1
@@ -439,6 +463,40 @@ private:
   }
 };
 
+/// The text of a function printed on its own, and the lines of the function
+/// and its instructions in it.
+class FunctionText : public AssemblyAnnotationWriter {
+public:
+  std::string Text;
+  unsigned NumLines = 0;
+  std::vector<std::pair<const Value *, unsigned>> Lines;
+
+  void print(const Function &F, bool KeepText) {
+    raw_string_ostream OS(Text);
+    F.print(OS, this);
+    OS.flush();
+    NumLines = std::count(Text.begin(), Text.end(), '\n');
+    if (!KeepText)
+      std::string().swap(Text);
+  }
+
+  void printInfoComment(const Value &V, formatted_raw_ostream &Out) override {
+    if (isa<Instruction>(V))
+      addEntry(&V, Out);
+  }
+
+  void emitFunctionAnnot(const Function *F,
+                         formatted_raw_ostream &Out) override {
+    addEntry(F, Out);
+  }
+
+private:
+  void addEntry(const Value *V, formatted_raw_ostream &Out) {
+    Out.flush();
+    Lines.push_back(std::make_pair(V, Out.getLine() + 1));
+  }
+};
+
 /// Sets Filename/Directory from the Module identifier and returns true, or
 /// false if source information is not present.
 bool getSourceInfoFromModule(const Module &M, std::string &Directory,
@@ -476,7 +534,7 @@ bool getSourceInfoFromDI(const Module &M, std::string &Directory,
 DebugIR::DebugIR(bool HideDebugIntrinsics, bool HideDebugMetadata,
                  llvm::StringRef Directory, llvm::StringRef Filename)
     : ModulePass(ID), WriteSourceToDisk(true),
-      HideDebugIntrinsics(HideDebugIntrinsics),
+      PerFunction(false), HideDebugIntrinsics(HideDebugIntrinsics),
       HideDebugMetadata(HideDebugMetadata), Directory(Directory),
       Filename(Filename), GeneratedPath(false), ParsedPath(false) {
 }
@@ -484,8 +542,17 @@ DebugIR::DebugIR(bool HideDebugIntrinsics, bool HideDebugMetadata,
 /// Modify input in-place; do not generate additional files, and do not hide
 /// any debug intrinsics/metadata that might be present.
 DebugIR::DebugIR()
-    : ModulePass(ID), WriteSourceToDisk(false), HideDebugIntrinsics(false),
-      HideDebugMetadata(false), GeneratedPath(false), ParsedPath(false) {
+    : ModulePass(ID), WriteSourceToDisk(false), PerFunction(false),
+      HideDebugIntrinsics(false), HideDebugMetadata(false),
+      GeneratedPath(false), ParsedPath(false) {
+}
+
+DebugIR::DebugIR(llvm::StringRef Directory, llvm::StringRef Filename,
+                 const DebugIRScope &Scope)
+    : ModulePass(ID), WriteSourceToDisk(true), PerFunction(true),
+      Scope(Scope), HideDebugIntrinsics(false), HideDebugMetadata(false),
+      Directory(Directory), Filename(Filename), GeneratedPath(false),
+      ParsedPath(false) {
 }
 
 bool DebugIR::getSourceInfo(const Module &M) {
@@ -564,6 +631,9 @@ void DebugIR::createDebugInfo(Module &M, std::unique_ptr<Module> &DisplayM) {
 bool DebugIR::isMissingPath() { return Filename.empty() || Directory.empty(); }
 
 bool DebugIR::runOnModule(Module &M) {
+  if (PerFunction)
+    return runPerFunction(M);
+
   std::unique_ptr<int> fd;
 
   if (isMissingPath() && !getSourceInfo(M)) {
@@ -608,3 +678,74 @@ bool DebugIR::runOnModule(Module &M, std::string &Path) {
   return result;
 }
 
+
+bool DebugIR::runPerFunction(Module &M) {
+  if (isMissingPath() && !getSourceInfo(M)) {
+    klee_warning("DebugIR unable to determine file name in input");
+    return false;
+  }
+  updateExtension(".debug-ll");
+
+  std::vector<const Function *> Functions;
+  for (const Function &F : M)
+    if (!F.isDeclaration() &&
+        (Scope.functions.empty() || Scope.functions.count(F.getName().str())))
+      Functions.push_back(&F);
+
+  StripDebugInfo(M);
+
+  // printing only reads the module, the functions are laid out one after
+  // another in module order once all are printed
+  std::vector<FunctionText> Texts(Functions.size());
+  unsigned Jobs = Scope.jobs ? Scope.jobs
+                             : std::max(1u, std::thread::hardware_concurrency());
+  {
+    WorkQueue Queue(Jobs, 4 * Jobs);
+    for (size_t i = 0; i < Functions.size(); ++i)
+      Queue.submit([&, i]() {
+        Texts[i].print(*Functions[i], !Scope.lineIndexOnly);
+      });
+    Queue.drain();
+  }
+
+  std::vector<std::pair<const Value *, unsigned>> Lines;
+  unsigned Offset = 0;
+  for (FunctionText &T : Texts) {
+    for (auto &E : T.Lines)
+      Lines.push_back(std::make_pair(E.first, E.second + Offset));
+    Offset += T.NumLines;
+  }
+
+  DIUpdater R(M, Filename, Directory, Lines);
+
+  std::string Path = getPath();
+  if (Scope.lineIndexOnly)
+    Path += ".idx";
+  std::error_code EC;
+  raw_fd_ostream Out(Path, EC, sys::fs::F_Text);
+  if (EC) {
+    klee_warning("DebugIR unable to open %s: %s", Path.c_str(),
+                 EC.message().c_str());
+    return true;
+  }
+  if (!Scope.lineIndexOnly) {
+    for (const FunctionText &T : Texts)
+      Out << T.Text;
+    return true;
+  }
+
+  // the line of every function and of the first instruction of every block
+  // in the file the locations refer to, which is not written
+  Out << "# " << getPath() << '\n';
+  for (auto &E : Lines) {
+    if (const Function *F = dyn_cast<Function>(E.first)) {
+      Out << E.second << ' ' << KInstruction::getUniqueID(F) << '\n';
+      continue;
+    }
+    const Instruction *I = cast<Instruction>(E.first);
+    if (I == &I->getParent()->front())
+      Out << E.second << ' ' << KInstruction::getUniqueID(I->getParent())
+          << '\n';
+  }
+  return true;
+}
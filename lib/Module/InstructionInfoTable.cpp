@@ -29,6 +29,7 @@
 #include <cstdint>
 #include <map>
 #include <string>
+#include <unordered_map>
 
 using namespace klee;
 
@@ -81,37 +82,47 @@ buildInstructionToLineMap(const llvm::Module &m) {
   return mapping;
 }
 
+namespace klee {
 class DebugInfoExtractor {
   std::vector<std::unique_ptr<std::string>> &internedStrings;
+  std::unordered_map<std::string, std::string *> internedIndex;
   std::map<uintptr_t, uint64_t> lineTable;
+  bool hasLineTable = false;
 
   const llvm::Module &module;
+  const InstructionInfoTable &table;
 
 public:
   DebugInfoExtractor(
       std::vector<std::unique_ptr<std::string>> &_internedStrings,
-      const llvm::Module &_module)
-      : internedStrings(_internedStrings), module(_module) {
-    lineTable = buildInstructionToLineMap(module);
-  }
+      const llvm::Module &_module, const InstructionInfoTable &_table)
+      : internedStrings(_internedStrings), module(_module), table(_table) {}
 
   std::string &getInternedString(const std::string &s) {
-    auto found = std::find_if(internedStrings.begin(), internedStrings.end(),
-                              [&s](const std::unique_ptr<std::string> &item) {
-                                return *item.get() == s;
-                              });
-    if (found != internedStrings.end())
-      return *found->get();
+    auto found = internedIndex.find(s);
+    if (found != internedIndex.end())
+      return *found->second;
 
     auto newItem = std::unique_ptr<std::string>(new std::string(s));
     auto result = newItem.get();
 
     internedStrings.emplace_back(std::move(newItem));
+    internedIndex.insert(std::make_pair(s, result));
     return *result;
   }
 
-  std::unique_ptr<FunctionInfo> getFunctionInfo(const llvm::Function &Func) {
-    auto asmLine = lineTable.at(reinterpret_cast<std::uintptr_t>(&Func));
+  /// The line of value in the printed module. The module is printed on the
+  /// first call.
+  uint64_t getAssemblyLine(const void *value) {
+    if (!hasLineTable) {
+      lineTable = buildInstructionToLineMap(module);
+      hasLineTable = true;
+    }
+    return lineTable.at(reinterpret_cast<std::uintptr_t>(value));
+  }
+
+  std::unique_ptr<FunctionInfo> getFunctionInfo(const llvm::Function &Func,
+                                                unsigned id, uint64_t asmLine) {
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 9)
     auto dsub = Func.getSubprogram();
 #else
@@ -119,19 +130,19 @@ public:
 #endif
     if (dsub != nullptr) {
       auto path = dsub->getFilename();
-      return std::unique_ptr<FunctionInfo>(new FunctionInfo(
-          0, getInternedString(path), dsub->getLine(), asmLine));
+      return std::unique_ptr<FunctionInfo>(
+          new FunctionInfo(id, getInternedString(path), dsub->getLine(),
+                           asmLine, &Func, &table));
     }
 
     // Fallback: Mark as unknown
-    return std::unique_ptr<FunctionInfo>(
-        new FunctionInfo(0, getInternedString(""), 0, asmLine));
+    return std::unique_ptr<FunctionInfo>(new FunctionInfo(
+        id, getInternedString(""), 0, asmLine, &Func, &table));
   }
 
   std::unique_ptr<InstructionInfo>
-  getInstructionInfo(const llvm::Instruction &Inst, const FunctionInfo *f) {
-    auto asmLine = lineTable.at(reinterpret_cast<std::uintptr_t>(&Inst));
-
+  getInstructionInfo(const llvm::Instruction &Inst, const FunctionInfo *f,
+                     unsigned id, uint64_t asmLine) {
     // Retrieve debug information associated with instruction
     auto dl = Inst.getDebugLoc();
 
@@ -150,32 +161,50 @@ public:
           column = LexicalBlock->getColumn();
         }
       }
-      return std::unique_ptr<InstructionInfo>(new InstructionInfo(
-          0, getInternedString(full_path), line, column, asmLine));
+      return std::unique_ptr<InstructionInfo>(
+          new InstructionInfo(id, getInternedString(full_path), line, column,
+                              asmLine, &Inst, &table));
     }
 
     if (f != nullptr)
       // If nothing found, use the surrounding function
-      return std::unique_ptr<InstructionInfo>(
-          new InstructionInfo(0, f->file, f->line, 0, asmLine));
+      return std::unique_ptr<InstructionInfo>(new InstructionInfo(
+          id, f->file, f->line, 0, asmLine, &Inst, &table));
     // If nothing found, use the surrounding function
-    return std::unique_ptr<InstructionInfo>(
-        new InstructionInfo(0, getInternedString(""), 0, 0, asmLine));
+    return std::unique_ptr<InstructionInfo>(new InstructionInfo(
+        id, getInternedString(""), 0, 0, asmLine, &Inst, &table));
   }
 };
+} // namespace klee
+
+InstructionInfoTable::InstructionInfoTable(const llvm::Module &m, bool lazy) {
+  if (lazy) {
+    // only count what there is, IDs are handed out by the lookups
+    size_t count = 0;
+    for (const auto &Func : m) {
+      ++count;
+      for (const auto &BB : Func)
+        count += BB.size();
+    }
+    maxID = count;
+    extractor = std::unique_ptr<DebugInfoExtractor>(
+        new DebugInfoExtractor(internedStrings, m, *this));
+    return;
+  }
 
-InstructionInfoTable::InstructionInfoTable(const llvm::Module &m) {
   // Generate all debug instruction information
-  DebugInfoExtractor DI(internedStrings, m);
+  DebugInfoExtractor DI(internedStrings, m, *this);
   for (const auto &Func : m) {
-    auto F = DI.getFunctionInfo(Func);
+    auto F = DI.getFunctionInfo(Func, 0, DI.getAssemblyLine(&Func));
     auto FR = F.get();
     functionInfos.insert(std::make_pair(&Func, std::move(F)));
 
     for (auto it = llvm::inst_begin(Func), ie = llvm::inst_end(Func); it != ie;
          ++it) {
       auto instr = &*it;
-      infos.insert(std::make_pair(instr, DI.getInstructionInfo(*instr, FR)));
+      infos.insert(std::make_pair(
+          instr, DI.getInstructionInfo(*instr, FR, 0,
+                                       DI.getAssemblyLine(instr))));
     }
   }
 
@@ -185,27 +214,51 @@ InstructionInfoTable::InstructionInfoTable(const llvm::Module &m) {
     item.second->id = idCounter++;
   for (auto &item : functionInfos)
     item.second->id = idCounter++;
+  maxID = idCounter;
 }
 
-unsigned InstructionInfoTable::getMaxID() const {
-  return infos.size() + functionInfos.size();
+InstructionInfoTable::~InstructionInfoTable() = default;
+
+unsigned InstructionInfoTable::getMaxID() const { return maxID; }
+
+uint64_t InstructionInfoTable::getAssemblyLine(const void *value) const {
+  return extractor->getAssemblyLine(value);
+}
+
+uint64_t InstructionInfo::getAssemblyLine() const {
+  if (!assemblyLine)
+    assemblyLine = table->getAssemblyLine(inst);
+  return assemblyLine;
+}
+
+uint64_t FunctionInfo::getAssemblyLine() const {
+  if (!assemblyLine)
+    assemblyLine = table->getAssemblyLine(function);
+  return assemblyLine;
 }
 
 const InstructionInfo &
 InstructionInfoTable::getInfo(const llvm::Instruction &inst) const {
   auto it = infos.find(&inst);
-  if (it == infos.end())
+  if (it != infos.end())
+    return *it->second.get();
+  if (!extractor || inst.getModule() == nullptr)
     llvm::report_fatal_error("invalid instruction, not present in "
                              "initial module!");
-  return *it->second.get();
+  const FunctionInfo &f = getFunctionInfo(*inst.getFunction());
+  auto info = extractor->getInstructionInfo(inst, &f, nextID++, 0);
+  return *infos.insert(std::make_pair(&inst, std::move(info))).first->second;
 }
 
 const FunctionInfo &
 InstructionInfoTable::getFunctionInfo(const llvm::Function &f) const {
   auto found = functionInfos.find(&f);
-  if (found == functionInfos.end())
+  if (found != functionInfos.end())
+    return *found->second.get();
+  if (!extractor)
     llvm::report_fatal_error("invalid instruction, not present in "
                              "initial module!");
-
-  return *found->second.get();
+  auto info = extractor->getFunctionInfo(f, nextID++, 0);
+  return *functionInfos.insert(std::make_pair(&f, std::move(info)))
+              .first->second;
 }
@@ -50,7 +50,10 @@
 #include "llvm/Transforms/Utils.h"
 #endif
 
+#include <algorithm>
+#include <atomic>
 #include <sstream>
+#include <thread>
 
 using namespace llvm;
 using namespace klee;
@@ -65,7 +68,8 @@ namespace {
   enum SwitchImplType {
     eSwitchTypeSimple,
     eSwitchTypeLLVM,
-    eSwitchTypeInternal
+    eSwitchTypeInternal,
+    eSwitchTypeTable
   };
 
   cl::opt<bool>
@@ -87,7 +91,12 @@ namespace {
                         clEnumValN(eSwitchTypeLLVM, "llvm", 
                                    "lower using LLVM"),
                         clEnumValN(eSwitchTypeInternal, "internal", 
-                                   "execute switch internally")
+                                   "execute switch internally"),
+                        clEnumValN(eSwitchTypeTable, "table",
+                                   "execute switch internally, dense "
+                                   "concrete switches through a jump table "
+                                   "and symbolic ones along a decision tree "
+                                   "over the ranges of case values")
                         KLEE_LLVM_CL_VAL_END),
              cl::init(eSwitchTypeInternal),
 	     cl::cat(ModuleCat));
@@ -103,11 +112,55 @@ namespace {
              cl::desc("Do not verify the module integrity (default=false)"),
              cl::init(false), cl::cat(klee::ModuleCat));
 
+  cl::opt<bool>
+  LazyInfoTable("lazy-instruction-info",
+                cl::desc("Extract the debug information of an instruction "
+                         "when it is first needed instead of for the whole "
+                         "module at startup. IDs of instructions then depend "
+                         "on the lookup order (default=false)"),
+                cl::init(false), cl::cat(ModuleCat));
+
+  cl::opt<unsigned>
+  PrepareJobs("prepare-jobs",
+              cl::desc("Build the shadow structures of the functions on this "
+                       "many threads, 0 for one per core (default=1)"),
+              cl::init(1), cl::cat(ModuleCat));
+
   cl::opt<bool>
   OptimiseKLEECall("klee-call-optimisation",
                              cl::desc("Allow optimization of functions that "
                                       "contain KLEE calls (default=true)"),
                              cl::init(true), cl::cat(ModuleCat));
+
+  cl::opt<bool>
+  TracePreservingOptimize("trace-preserving-optimize",
+                          cl::desc("Optimize the code before execution with "
+                                   "only the optimizations that keep its "
+                                   "branches and recorded instructions, so "
+                                   "that traces recorded against it still "
+                                   "replay (default=false)"),
+                          cl::init(false), cl::cat(ModuleCat));
+
+  cl::opt<bool>
+  ConcreteTaintAnalysis("concrete-taint-analysis",
+                        cl::desc("Find the basic blocks that can only handle "
+                                 "concrete values with a static taint "
+                                 "analysis from the symbolic sources, and "
+                                 "execute their memory accesses on a fast "
+                                 "path (default=false)"),
+                        cl::init(false), cl::cat(ModuleCat));
+
+  cl::opt<bool>
+  NativePureCalls("native-pure-calls",
+                  cl::desc("Find the functions whose effects are bounded by "
+                           "the memory they reach from their arguments and "
+                           "globals, and JIT and run the calls of the "
+                           "allowlisted ones natively while their arguments "
+                           "and that memory are concrete and the path is not "
+                           "recorded. The checks of the interpreter, e.g. "
+                           "for overshifts, do not apply to them "
+                           "(default=false)"),
+                  cl::init(false), cl::cat(ModuleCat));
 }
 
 /***/
@@ -253,6 +306,13 @@ void KModule::instrument(const Interpreter::ModuleOptions &opts) {
   pm.run(*module);
 }
 
+void KModule::addCheckFunctions(const Interpreter::ModuleOptions &opts) {
+  if (opts.CheckDivZero)
+    addInternalFunction("klee_div_zero_check");
+  if (opts.CheckOvershift)
+    addInternalFunction("klee_overshift_check");
+}
+
 void KModule::optimiseAndPrepare(
     const Interpreter::ModuleOptions &opts,
     llvm::ArrayRef<const char *> preservedFunctions) {
@@ -269,10 +329,7 @@ void KModule::optimiseAndPrepare(
 
   // Add internal functions which are not used to check if instructions
   // have been already visited
-  if (opts.CheckDivZero)
-    addInternalFunction("klee_div_zero_check");
-  if (opts.CheckOvershift)
-    addInternalFunction("klee_overshift_check");
+  addCheckFunctions(opts);
 
   // Needs to happen after linking (since ctors/dtors can be modified)
   // and optimization (since global optimization can rewrite lists).
@@ -287,6 +344,7 @@ void KModule::optimiseAndPrepare(
   pm3.add(createCFGSimplificationPass());
   switch(SwitchType) {
   case eSwitchTypeInternal: break;
+  case eSwitchTypeTable: break;
   case eSwitchTypeSimple: pm3.add(new LowerSwitchPass()); break;
   case eSwitchTypeLLVM:  pm3.add(createLowerSwitchPass()); break;
   default: klee_error("invalid --switch-type");
@@ -295,6 +353,28 @@ void KModule::optimiseAndPrepare(
   pm3.add(new PhiCleanerPass());
   pm3.add(new FunctionAliasPass());
   pm3.run(*module);
+
+  // after the passes above, which recorded traces also went through, and
+  // followed by the cleanups of what instcombine may have introduced
+  if (TracePreservingOptimize) {
+    legacy::PassManager pm4;
+    pm4.add(new TracePreservingOptimizePass());
+    pm4.add(new IntrinsicCleanerPass(*targetData));
+    pm4.add(new PhiCleanerPass());
+    pm4.run(*module);
+  }
+
+  // on the final code, which the instructions are built from
+  if (ConcreteTaintAnalysis) {
+    legacy::PassManager pm5;
+    pm5.add(new SymbolicTaintPass());
+    pm5.run(*module);
+  }
+  if (NativePureCalls) {
+    legacy::PassManager pm6;
+    pm6.add(new NativeCallPass());
+    pm6.run(*module);
+  }
   klee::stripDebugInfo(*module);
 }
 
@@ -317,21 +397,53 @@ void KModule::manifest(InterpreterHandler *ih, bool forceSourceOutput) {
   /* Build shadow structures */
 
   infos = std::unique_ptr<InstructionInfoTable>(
-      new InstructionInfoTable(*module.get()));
+      new InstructionInfoTable(*module.get(), LazyInfoTable));
 
   std::vector<Function *> declarations;
+  std::vector<Function *> definitions;
 
   for (auto &Function : *module) {
-    if (Function.isDeclaration()) {
+    if (Function.isDeclaration())
       declarations.push_back(&Function);
-      continue;
-    }
+    else
+      definitions.push_back(&Function);
+  }
 
-    auto kf = std::unique_ptr<KFunction>(new KFunction(&Function, this));
+  std::vector<std::unique_ptr<KFunction>> built(definitions.size());
+  unsigned jobs =
+      PrepareJobs ? PrepareJobs : std::thread::hardware_concurrency();
+  if (jobs <= 1 || definitions.size() <= 1) {
+    for (size_t i = 0; i != definitions.size(); ++i)
+      built[i].reset(new KFunction(definitions[i], this));
+  } else {
+    // KFunctions only read the IR of their function, the constants are
+    // numbered afterwards in the order the serial build meets them
+    std::vector<std::vector<KConstantOperand>> constantOperands(
+        definitions.size());
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+      for (size_t i; (i = next++) < definitions.size();)
+        built[i].reset(new KFunction(definitions[i], constantOperands[i]));
+    };
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < jobs; ++t)
+      threads.emplace_back(worker);
+    worker();
+    for (auto &thread : threads)
+      thread.join();
+
+    for (auto &operands : constantOperands)
+      for (auto &op : operands)
+        op.ki->operands[op.index] = -(getConstantID(op.c, op.ki) + 2);
+  }
 
+  for (auto &kf : built) {
+    llvm::Function &Function = *kf->function;
     for (unsigned i=0; i<kf->numInstructions; ++i) {
       KInstruction *ki = kf->instructions[i];
-      ki->info = &infos->getInfo(*ki->inst);
+      ki->info = LazyInstructionInfo(*infos, *ki->inst);
+      ki->dataRecID = dataRecInstructions.size();
+      dataRecInstructions.push_back(ki);
     }
 
     functionMap.insert(std::make_pair(&Function, kf.get()));
@@ -403,10 +515,21 @@ void KModule::assignDebugIR(llvm::Module *M, std::string &directory, std::string
   pm.run(*M);
 }
 
+void KModule::assignDebugIR(llvm::Module *M, const std::string &directory,
+                            const std::string &filename,
+                            const DebugIRScope &scope) {
+  legacy::PassManager pm;
+  pm.add(new DebugIR(directory, filename, scope));
+  pm.run(*M);
+}
+
 void KModule::addPTWrite(llvm::Module *M, const std::string &instcfg,
-                         const std::string &funccfg) {
+                         const std::string &funccfg, bool optimizePlacement,
+                         PTWriteMode mode, unsigned samplePeriod,
+                         const PTWriteBudget &budget) {
   legacy::PassManager pm;
-  pm.add(new PTWritePass(instcfg, funccfg));
+  pm.add(new PTWritePass(instcfg, funccfg, optimizePlacement, mode,
+                         samplePeriod, budget));
   pm.run(*M);
 }
 
@@ -423,20 +546,24 @@ void KModule::addTag(llvm::Module *M, std::string &cfg, bool useDbgInfo) {
 }
 
 KInstruction* KModule::getKInstruction(llvm::Instruction *I) {
-  auto it = instructionMapCache.find(I);
-  if (it != instructionMapCache.end())
-    return it->second;
-
   llvm::Function *f = I->getParent()->getParent();
   assert(f);
-  KFunction *kf = functionMap[f];
-  KInstruction *target = kf->getKInstruction(I);
+  auto it = functionMap.find(f);
+  assert(it != functionMap.end() && "instruction of an unknown function");
+  KInstruction *target = it->second->getKInstruction(I);
   assert(target);
-
-  instructionMapCache.insert(std::make_pair(I, target));
   return target;
 }
 
+KInstruction *KModule::getKInstructionByUniqueID(const std::string &uniqueID) {
+  if (uniqueIDMapCache.empty()) {
+    for (KInstruction *ki : dataRecInstructions)
+      uniqueIDMapCache.insert(std::make_pair(ki->getUniqueID(), ki));
+  }
+  auto it = uniqueIDMapCache.find(uniqueID);
+  return it == uniqueIDMapCache.end() ? nullptr : it->second;
+}
+
 void KModule::saveCntToMDNode() {
   llvm::LLVMContext &C = module->getContext();
   for (auto &kf_ptr: functions) {
@@ -482,12 +609,14 @@ KConstant::KConstant(llvm::Constant* _ct, unsigned _id, KInstruction* _ki) {
 
 /***/
 
-static int getOperandNum(Value *v,
-                         std::map<Instruction*, unsigned> &registerMap,
-                         KModule *km,
-                         KInstruction *ki) {
+/// The value number of operand index of ki. Without km, constants are
+/// appended to constantOperands and numbered later.
+static int getOperandNum(Value *v, const KFunction &kf, KModule *km,
+                         KInstruction *ki, unsigned index,
+                         std::vector<KConstantOperand> *constantOperands) {
   if (Instruction *inst = dyn_cast<Instruction>(v)) {
-    return registerMap[inst];
+    // the first arg_size() registers are reserved for formals
+    return kf.numArgs + kf.instructionIndex.lookup(inst);
   } else if (Argument *a = dyn_cast<Argument>(v)) {
     return a->getArgNo();
   } else if (isa<BasicBlock>(v) || isa<InlineAsm>(v) ||
@@ -496,16 +625,166 @@ static int getOperandNum(Value *v,
   } else {
     assert(isa<Constant>(v));
     Constant *c = cast<Constant>(v);
+    if (!km) {
+      constantOperands->push_back(KConstantOperand{ki, index, c});
+      return -1;
+    }
     return -(km->getConstantID(c, ki) + 2);
   }
 }
 
+/// The jump table and the segments of -switch-type=table
+static void buildSwitchTables(SwitchInst *si, KSwitchInstruction *ki) {
+  unsigned width = si->getCondition()->getType()->getIntegerBitWidth();
+  if (width > 64)
+    return;
+  uint64_t max = width == 64 ? UINT64_MAX : (UINT64_C(1) << width) - 1;
+
+  // (case value, successor index of its case), by case value
+  std::vector<std::pair<uint64_t, unsigned> > values;
+  for (auto c : si->cases())
+    values.push_back(std::make_pair(c.getCaseValue()->getZExtValue(),
+                                    c.getSuccessorIndex()));
+  std::sort(values.begin(), values.end());
+
+  unsigned defaultSuccessor = ki->successorIndex[si->getDefaultDest()];
+  uint64_t next = 0;
+  bool complete = false;
+  for (auto &v : values) {
+    if (v.first != next)
+      ki->segments.push_back(KSwitchInstruction::Segment{
+          next, v.first - 1, defaultSuccessor, true});
+    unsigned successor = ki->successorIndex[si->getSuccessor(v.second)];
+    KSwitchInstruction::Segment *last =
+        ki->segments.empty() ? nullptr : &ki->segments.back();
+    if (last && !last->isDefault && last->successor == successor &&
+        last->high + 1 == v.first)
+      last->high = v.first;
+    else
+      ki->segments.push_back(
+          KSwitchInstruction::Segment{v.first, v.first, successor, false});
+    complete = v.first == max;
+    next = v.first + 1;
+  }
+  if (!complete)
+    ki->segments.push_back(
+        KSwitchInstruction::Segment{next, max, defaultSuccessor, true});
+
+  // a table is worth it while at most three in four entries take the default
+  if (!values.empty()) {
+    uint64_t span = values.back().first - values.front().first;
+    if (span < 4 * values.size() && span < (UINT64_C(1) << 20)) {
+      ki->tableBase = values.front().first;
+      ki->jumpTable.assign(span + 1, 0);
+      for (auto &v : values)
+        ki->jumpTable[v.first - ki->tableBase] = v.second;
+    }
+  }
+}
+
+static KInstruction *createKSwitchInstruction(SwitchInst *si) {
+  KSwitchInstruction *ki = new KSwitchInstruction();
+  // cases() does not include the default destination
+  for (auto c : si->cases()) {
+    BasicBlock *succ = c.getCaseSuccessor();
+    if (ki->successorIndex.insert(std::make_pair(succ, ki->successors.size()))
+            .second)
+      ki->successors.push_back(succ);
+    // wider conditions are looked up with findCaseValue
+    if (c.getCaseValue()->getBitWidth() <= 64)
+      ki->caseIndex[c.getCaseValue()->getZExtValue()] = c.getSuccessorIndex();
+  }
+  BasicBlock *defaultDest = si->getDefaultDest();
+  if (ki->successorIndex
+          .insert(std::make_pair(defaultDest, ki->successors.size()))
+          .second)
+    ki->successors.push_back(defaultDest);
+  if (SwitchType == eSwitchTypeTable)
+    buildSwitchTables(si, ki);
+  return ki;
+}
+
+static KInstruction *createKIndirectBrInstruction(IndirectBrInst *bi) {
+  KIndirectBrInstruction *ki = new KIndirectBrInstruction();
+  for (unsigned k = 0, e = bi->getNumDestinations(); k != e; ++k) {
+    BasicBlock *d = bi->getDestination(k);
+    if (ki->destinationIndex
+            .insert(std::make_pair(reinterpret_cast<std::uint64_t>(d),
+                                   ki->destinations.size()))
+            .second)
+      ki->destinations.push_back(d);
+  }
+  return ki;
+}
+
+/// The fast operation of inst and the width of its result, None if inst
+/// is not an integer instruction of at most 64 bits.
+static KFastOp decodeFastOp(const Instruction *inst, uint8_t &width) {
+  auto intWidth = [](const Type *t) -> unsigned {
+    return t->isIntegerTy() && t->getIntegerBitWidth() <= 64
+               ? t->getIntegerBitWidth()
+               : 0;
+  };
+  unsigned w = intWidth(inst->getType());
+  if (!w)
+    return KFastOp::None;
+  width = w;
+  switch (inst->getOpcode()) {
+  case Instruction::Add: return KFastOp::Add;
+  case Instruction::Sub: return KFastOp::Sub;
+  case Instruction::Mul: return KFastOp::Mul;
+  case Instruction::And: return KFastOp::And;
+  case Instruction::Or: return KFastOp::Or;
+  case Instruction::Xor: return KFastOp::Xor;
+  case Instruction::Shl: return KFastOp::Shl;
+  case Instruction::LShr: return KFastOp::LShr;
+  case Instruction::AShr: return KFastOp::AShr;
+  case Instruction::ZExt: return KFastOp::ZExt;
+  case Instruction::SExt: return KFastOp::SExt;
+  case Instruction::Trunc: return KFastOp::Trunc;
+  case Instruction::Select:
+    return inst->getOperand(0)->getType()->isIntegerTy(1) ? KFastOp::Select
+                                                          : KFastOp::None;
+  case Instruction::ICmp: {
+    // pointers are compared as integers of the pointer width
+    const Type *t = inst->getOperand(0)->getType();
+    if (!intWidth(t) && !t->isPointerTy())
+      return KFastOp::None;
+    switch (cast<ICmpInst>(inst)->getPredicate()) {
+    case ICmpInst::ICMP_EQ: return KFastOp::Eq;
+    case ICmpInst::ICMP_NE: return KFastOp::Ne;
+    case ICmpInst::ICMP_UGT: return KFastOp::Ugt;
+    case ICmpInst::ICMP_UGE: return KFastOp::Uge;
+    case ICmpInst::ICMP_ULT: return KFastOp::Ult;
+    case ICmpInst::ICMP_ULE: return KFastOp::Ule;
+    case ICmpInst::ICMP_SGT: return KFastOp::Sgt;
+    case ICmpInst::ICMP_SGE: return KFastOp::Sge;
+    case ICmpInst::ICMP_SLT: return KFastOp::Slt;
+    case ICmpInst::ICMP_SLE: return KFastOp::Sle;
+    default: return KFastOp::None;
+    }
+  }
+  default:
+    return KFastOp::None;
+  }
+}
+
+KFunction::KFunction(llvm::Function *_function, KModule *km)
+    : KFunction(_function, km, nullptr) {}
+
 KFunction::KFunction(llvm::Function *_function,
-                     KModule *km) 
+                     std::vector<KConstantOperand> &constantOperands)
+    : KFunction(_function, nullptr, &constantOperands) {}
+
+KFunction::KFunction(llvm::Function *_function, KModule *km,
+                     std::vector<KConstantOperand> *constantOperands)
   : function(_function),
     numArgs(function->arg_size()),
     numInstructions(0),
-    trackCoverage(true) {
+    trackCoverage(true),
+    native(function->hasFnAttribute(NativeCallPass::nativeAttribute)),
+    inPOSIX(function->hasFnAttribute(TAGPOSIX)),
+    inLIBC(function->hasFnAttribute(TAGLIBC)) {
   // Assign unique instruction IDs to each basic block
   for (auto &BasicBlock : *function) {
     basicBlockEntry[&BasicBlock] = numInstructions;
@@ -514,21 +793,20 @@ KFunction::KFunction(llvm::Function *_function,
 
   instructions = new KInstruction*[numInstructions];
 
-  std::map<Instruction*, unsigned> registerMap;
-
-  // The first arg_size() registers are reserved for formals.
-  unsigned rnum = numArgs;
-  for (llvm::Function::iterator bbit = function->begin(), 
-         bbie = function->end(); bbit != bbie; ++bbit) {
-    for (llvm::BasicBlock::iterator it = bbit->begin(), ie = bbit->end();
-         it != ie; ++it)
-      registerMap[&*it] = rnum++;
-  }
-  numRegisters = rnum;
+  // The first arg_size() registers are reserved for formals, then every
+  // instruction gets the register numArgs + its index.
+  instructionIndex.reserve(numInstructions);
+  unsigned index = 0;
+  for (auto &BasicBlock : *function)
+    for (auto &Instruction : BasicBlock)
+      instructionIndex[&Instruction] = index++;
+  numRegisters = numArgs + numInstructions;
   
   unsigned i = 0;
   for (llvm::Function::iterator bbit = function->begin(), 
          bbie = function->end(); bbit != bbie; ++bbit) {
+    bool concrete = bbit->getTerminator()->getMetadata(
+        SymbolicTaintPass::concreteMetadata);
     for (llvm::BasicBlock::iterator it = bbit->begin(), ie = bbit->end();
          it != ie; ++it) {
       KInstruction *ki;
@@ -538,30 +816,43 @@ KFunction::KFunction(llvm::Function *_function,
       case Instruction::InsertValue:
       case Instruction::ExtractValue:
         ki = new KGEPInstruction(); break;
+      case Instruction::Switch:
+        ki = createKSwitchInstruction(cast<SwitchInst>(&*it));
+        break;
+      case Instruction::IndirectBr:
+        ki = createKIndirectBrInstruction(cast<IndirectBrInst>(&*it));
+        break;
+      case Instruction::Call:
+      case Instruction::Invoke:
+        ki = new KCallInstruction(); break;
       default:
         ki = new KInstruction(); break;
       }
 
       Instruction *inst = &*it;
       ki->inst = inst;
-      ki->dest = registerMap[inst];
+      ki->dest = numArgs + i;
+      ki->concrete = concrete;
+      ki->fastOp = decodeFastOp(inst, ki->fastWidth);
 
       if (isa<CallInst>(it) || isa<InvokeInst>(it)) {
         CallSite cs(inst);
         unsigned numArgs = cs.arg_size();
         ki->operands = new int[numArgs+1];
-        ki->operands[0] = getOperandNum(cs.getCalledValue(), registerMap, km,
-                                        ki);
+        ki->operands[0] = getOperandNum(cs.getCalledValue(), *this, km, ki, 0,
+                                        constantOperands);
         for (unsigned j=0; j<numArgs; j++) {
           Value *v = cs.getArgument(j);
-          ki->operands[j+1] = getOperandNum(v, registerMap, km, ki);
+          ki->operands[j+1] = getOperandNum(v, *this, km, ki, j + 1,
+                                            constantOperands);
         }
       } else {
         unsigned numOperands = it->getNumOperands();
         ki->operands = new int[numOperands];
         for (unsigned j=0; j<numOperands; j++) {
           Value *v = it->getOperand(j);
-          ki->operands[j] = getOperandNum(v, registerMap, km, ki);
+          ki->operands[j] = getOperandNum(v, *this, km, ki, j,
+                                          constantOperands);
         }
       }
 
@@ -577,11 +868,7 @@ KFunction::~KFunction() {
 }
 
 KInstruction *KFunction::getKInstruction(llvm::Instruction *inst) {
-  for (unsigned i = 0; i < numInstructions; i++) {
-    if (instructions[i]->inst == inst) {
-      return instructions[i];
-    }
-  }
-  return nullptr;
+  auto it = instructionIndex.find(inst);
+  return it == instructionIndex.end() ? nullptr : instructions[it->second];
 }
 
@@ -0,0 +1,145 @@
+//===-- NativeCallPass.cpp ------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Finds the functions whose effects are bounded by the memory reachable from
+// their arguments and the globals they refer to, so that the executor can
+// JIT them and run a call with concrete arguments and concrete memory
+// natively. Such a function only calls functions of the same kind and side
+// effect free intrinsics, and does not compute pointers from integers. It
+// does not contain inline assembly either, in particular no ptwrite, so that
+// the data recordings of an instrumented function are always loaded by the
+// interpreter. The functions found get the nativeAttribute.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Internal/Module/Passes.h"
+
+#include "klee/Config/Version.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+
+/// Intrinsics that have effects outside of the memory of the call or trap
+bool isUnboundedIntrinsic(Intrinsic::ID id) {
+  switch (id) {
+  case Intrinsic::vastart:
+  case Intrinsic::vaend:
+  case Intrinsic::vacopy:
+  case Intrinsic::trap:
+  case Intrinsic::debugtrap:
+    return true;
+  default:
+    return false;
+  }
+}
+
+/// Check the instructions of f, collecting its direct callees.
+/// \return false if f cannot run natively whatever its callees
+bool isLocallyBounded(const Function &f, std::set<const Function *> &callees) {
+  if (f.isDeclaration() || f.isVarArg() || f.hasPersonalityFn())
+    return false;
+  for (const BasicBlock &b : f) {
+    for (const Instruction &i : b) {
+      switch (i.getOpcode()) {
+      // a native run has no interpreter to report these to
+      case Instruction::Unreachable:
+      case Instruction::VAArg:
+      case Instruction::IntToPtr:
+      case Instruction::Invoke:
+      case Instruction::Resume:
+        return false;
+      case Instruction::Call: {
+        const CallInst *ci = cast<CallInst>(&i);
+        if (isa<InlineAsm>(ci->getCalledValue()))
+          return false;
+        const Function *callee = ci->getCalledFunction();
+        if (!callee || callee->arg_size() != ci->getNumArgOperands())
+          return false;
+        if (Intrinsic::ID id = callee->getIntrinsicID()) {
+          if (isUnboundedIntrinsic(id))
+            return false;
+        } else {
+          callees.insert(callee);
+        }
+        break;
+      }
+      default:
+        break;
+      }
+      // the native code calls its copies of functions, which the address of
+      // a function as a value has to stay unaware of
+      ImmutableCallSite cs(&i);
+      for (const Use &op : i.operands()) {
+        if (isa<Function>(op.get()) && !(cs && cs.isCallee(&op)))
+          return false;
+        if (const GlobalVariable *gv = dyn_cast<GlobalVariable>(op.get()))
+          if (gv->isThreadLocal())
+            return false;
+      }
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+namespace klee {
+
+char NativeCallPass::ID = 0;
+const char *const NativeCallPass::nativeAttribute = "klee.native";
+
+bool NativeCallPass::runOnModule(Module &M) {
+  std::map<const Function *, std::set<const Function *> > candidates;
+  for (const Function &f : M) {
+    std::set<const Function *> callees;
+    if (isLocallyBounded(f, callees))
+      candidates.insert(std::make_pair(&f, callees));
+  }
+
+  // drop the candidates calling functions that are not, until none does
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto it = candidates.begin(); it != candidates.end();) {
+      bool bounded = true;
+      for (const Function *callee : it->second)
+        if (!candidates.count(callee))
+          bounded = false;
+      if (bounded) {
+        ++it;
+      } else {
+        it = candidates.erase(it);
+        changed = true;
+      }
+    }
+  }
+
+  for (Function &f : M)
+    if (candidates.count(&f))
+      f.addFnAttr(nativeAttribute);
+
+  klee_message("NativeCallPass: %zu functions can run natively",
+               candidates.size());
+  return !candidates.empty();
+}
+
+} // namespace klee
@@ -40,9 +40,27 @@ using namespace klee;
 
 char PTWritePass::ID;
 const std::string PTWritePass::castPrefix("ptwritecast");
+const char *const PTWritePass::partMetadata = "klee.ptwrite.part";
 
-PTWritePass::PTWritePass(const std::string &instcfg, const std::string &funccfg)
-    : ModulePass(ID) {
+static unsigned getPartOperand(const llvm::MDNode *part, unsigned i) {
+  return mdconst::extract<ConstantInt>(part->getOperand(i))->getZExtValue();
+}
+
+unsigned PTWritePass::getPartIndex(const llvm::MDNode *part) {
+  return getPartOperand(part, 0);
+}
+
+unsigned PTWritePass::getPartCount(const llvm::MDNode *part) {
+  return getPartOperand(part, 1);
+}
+
+PTWritePass::PTWritePass(const std::string &instcfg, const std::string &funccfg,
+                         bool _optimizePlacement, PTWriteMode _mode,
+                         unsigned _samplePeriod,
+                         const PTWriteBudget &_budget)
+    : ModulePass(ID), optimizePlacement(_optimizePlacement), mode(_mode),
+      samplePeriod(_samplePeriod), budget(_budget) {
+      assert(samplePeriod && "sample period must be positive");
       setupInstCFG(instcfg);
       setupFuncCFG(funccfg);
 }
@@ -117,6 +135,9 @@ public:
 private:
   llvm::LLVMContext &C;
   const llvm::DataLayout &DL;
+  llvm::Module &M;
+  PTWriteMode mode;
+  unsigned samplePeriod;
   // `iasm` represents the type of inline assembly function. It will be
   // constructed at the beginning of runOnModule, according to the module
   // context. It will be consumed during ptwrite instrumentation, where CallInst
@@ -132,8 +153,10 @@ private:
   TyInstSet instrumented_insts;
 
 public:
-  InstrumentationManager(llvm::Module &M)
-      : C(M.getContext()), DL(M.getDataLayout()) {
+  InstrumentationManager(llvm::Module &_M, PTWriteMode _mode,
+                         unsigned _samplePeriod)
+      : C(_M.getContext()), DL(_M.getDataLayout()), M(_M), mode(_mode),
+        samplePeriod(_samplePeriod) {
     // init inline asm function type
     std::vector<llvm::Type *> argTypes;
     TyInt64 = Type::getInt64Ty(C);
@@ -143,7 +166,28 @@ public:
     iasm = llvm::InlineAsm::get(FTy, "ptwrite $0",
                                 "r,~{dirflag},~{fpsr},~{flags}", true, false);
   }
+  /// Guard the scalar ptwrites instrumented from now on as _mode says.
+  void setMode(PTWriteMode _mode, unsigned _samplePeriod) {
+    mode = _mode;
+    samplePeriod = _samplePeriod;
+  }
   void InstrumentPTWrite(llvm::Instruction *inst);
+  /// Record a vector, aggregate or wider than 64 bits value as an integer,
+  /// split into i64 parts if needed.
+  /// \return false if the value cannot be recorded
+  bool InstrumentWidePTWrite(llvm::Instruction *inst);
+
+private:
+  /// Move the ptwrite of the i64 value into a block of its own that runs
+  /// only when mode says so. The condition is ordinary IR, so a replay
+  /// follows it like any other branch.
+  void guardPTWrite(llvm::Instruction *ptwrite, llvm::Value *value);
+  /// The bits of v as one integer, built with builder.
+  llvm::Value *toInteger(llvm::IRBuilder<> &builder, llvm::Value *v);
+  /// True if toInteger keeps every bit of a value of type t.
+  bool hasNoPadding(llvm::Type *t) const;
+
+public:
   const TyInstSet &getAllInstrumentedInsts() const {
     return instrumented_insts;
   }
@@ -168,9 +212,11 @@ void InstrumentationManager::InstrumentPTWrite(llvm::Instruction *inst) {
       castI->insertAfter(inst);
       insertAfterI = castI;
     } else if (w > 64) {
-      // TODO handle large interger, need split then multiple ptwrites
-      llvm::errs() << "ptwrite for large integers is not implemented\n";
-      llvm::errs() << "Inst: " << *inst;
+      if (InstrumentWidePTWrite(inst)) {
+        auto ret = instrumented_insts.insert(inst);
+        assert(ret.second && "Should not instrument the same inst twice");
+      }
+      return;
     } // else Int64, no special care is needed
   } else if (itype->isDoubleTy()) {
     CastInst *castI = CastInst::CreateFPCast(inst, TyInt64, getCastName());
@@ -183,7 +229,11 @@ void InstrumentationManager::InstrumentPTWrite(llvm::Instruction *inst) {
     castI2->insertAfter(castI1);
     insertAfterI = castI2;
   } else {
-    // TODO handle Vector of Integer type
+    if (InstrumentWidePTWrite(inst)) {
+      auto ret = instrumented_insts.insert(inst);
+      assert(ret.second && "Should not instrument the same inst twice");
+      return;
+    }
     llvm::errs() << "The instruction you want to recorded is not an integer\n";
     llvm::errs() << "Inst: " << *inst << '\n';
     return;
@@ -191,13 +241,249 @@ void InstrumentationManager::InstrumentPTWrite(llvm::Instruction *inst) {
   args.push_back(insertAfterI);
   Instruction *CI = llvm::CallInst::Create(iasm, args, "");
   CI->insertAfter(insertAfterI);
+  if (mode != PTWriteMode::Always)
+    guardPTWrite(CI, insertAfterI);
   auto ret = instrumented_insts.insert(inst);
   assert(ret.second && "Should not instrument the same inst twice");
 }
 
+void InstrumentationManager::guardPTWrite(llvm::Instruction *ptwrite,
+                                          llvm::Value *value) {
+  // one variable per site. Threads share it, KLEE has no thread-local
+  // storage to replay a per-thread copy.
+  GlobalVariable *state = new GlobalVariable(
+      M, TyInt64, false, GlobalValue::InternalLinkage,
+      ConstantInt::get(TyInt64, 0),
+      mode == PTWriteMode::Changed ? "ptwrite.last" : "ptwrite.count");
+  IRBuilder<> builder(ptwrite);
+  Value *old = builder.CreateLoad(TyInt64, state, getCastName());
+  Value *cond;
+  if (mode == PTWriteMode::Changed) {
+    cond = builder.CreateICmpNE(value, old, getCastName());
+  } else {
+    Value *count = builder.CreateAdd(old, builder.getInt64(1), getCastName());
+    builder.CreateStore(count, state);
+    Value *rem = builder.CreateURem(count, builder.getInt64(samplePeriod),
+                                    getCastName());
+    cond = builder.CreateICmpEQ(rem, builder.getInt64(0), getCastName());
+  }
+  BasicBlock *head = ptwrite->getParent();
+  std::string name = head->getName().str();
+  auto *term = SplitBlockAndInsertIfThen(cond, ptwrite, false);
+  term->getParent()->setName(name + ".ptwrite");
+  ptwrite->getParent()->setName(name + ".ptwrite.cont");
+  ptwrite->moveBefore(term);
+  if (mode == PTWriteMode::Changed) {
+    // stored after the ptwrite, which makes value concrete in a replay
+    builder.SetInsertPoint(term);
+    builder.CreateStore(value, state);
+  }
+}
+
+/// True if InstrumentPTWrite can record the value of inst.
+static bool isRecordable(const llvm::Instruction *inst) {
+  llvm::Type *itype = inst->getType();
+  // nothing may be inserted between the phis of a block, nor after a
+  // terminator
+  if (isa<PHINode>(inst) || inst->isTerminator() || inst->isEHPad())
+    return false;
+  return itype->isPointerTy() ||
+         (itype->isIntegerTy() && itype->getIntegerBitWidth() <= 64) ||
+         itype->isDoubleTy() || itype->isFloatTy();
+}
+
+/// The instruction inst is computed from by an invertible operation whose
+/// other operands are constants, or nullptr. Knowing its value determines
+/// the value of inst.
+static llvm::Instruction *getDeterminingOperand(llvm::Instruction *inst) {
+  llvm::Value *src = nullptr;
+  switch (inst->getOpcode()) {
+  case Instruction::ZExt:
+  case Instruction::SExt:
+    src = inst->getOperand(0);
+    break;
+  case Instruction::BitCast:
+    // a value of another type is recorded as another value
+    if (inst->getType()->isPointerTy() &&
+        inst->getOperand(0)->getType()->isPointerTy())
+      src = inst->getOperand(0);
+    break;
+  case Instruction::Add:
+  case Instruction::Sub:
+  case Instruction::Xor:
+    if (isa<ConstantInt>(inst->getOperand(1)))
+      src = inst->getOperand(0);
+    else if (isa<ConstantInt>(inst->getOperand(0)))
+      src = inst->getOperand(1);
+    break;
+  case Instruction::GetElementPtr:
+    if (cast<GetElementPtrInst>(inst)->hasAllConstantIndices())
+      src = cast<GetElementPtrInst>(inst)->getPointerOperand();
+    break;
+  default:
+    break;
+  }
+  return dyn_cast_or_null<llvm::Instruction>(src);
+}
+
+/// The least frequently executed instruction that determines inst: inst
+/// itself or one of the instructions it is computed from through
+/// getDeterminingOperand. An operand dominates its use, so it executes
+/// before every execution of inst, possibly outside of the loop inst is in.
+static llvm::Instruction *getRecordingPoint(llvm::Instruction *inst) {
+  llvm::Instruction *best = inst;
+  unsigned bestFreq = KInstruction::getLoadedFreq(inst);
+  for (llvm::Instruction *cur = getDeterminingOperand(inst); cur;
+       cur = getDeterminingOperand(cur)) {
+    unsigned freq = KInstruction::getLoadedFreq(cur);
+    if (freq < bestFreq && isRecordable(cur)) {
+      best = cur;
+      bestFreq = freq;
+    }
+  }
+  return best;
+}
+
+bool InstrumentationManager::hasNoPadding(llvm::Type *t) const {
+  if (t->isIntegerTy() || t->isPointerTy() || t->isFloatingPointTy() ||
+      t->isVectorTy())
+    return true;
+  if (llvm::StructType *st = dyn_cast<llvm::StructType>(t)) {
+    uint64_t bits = 0;
+    for (llvm::Type *et : st->elements()) {
+      if (!hasNoPadding(et))
+        return false;
+      bits += DL.getTypeSizeInBits(et);
+    }
+    return bits && bits == DL.getTypeSizeInBits(st);
+  }
+  if (llvm::ArrayType *at = dyn_cast<llvm::ArrayType>(t)) {
+    llvm::Type *et = at->getElementType();
+    return at->getNumElements() && hasNoPadding(et) &&
+           DL.getTypeSizeInBits(et) == DL.getTypeAllocSizeInBits(et);
+  }
+  return false;
+}
+
+llvm::Value *InstrumentationManager::toInteger(llvm::IRBuilder<> &builder,
+                                               llvm::Value *v) {
+  llvm::Type *t = v->getType();
+  if (t->isIntegerTy())
+    return v;
+  // the bits of a pointer (vector) are those of its integer
+  if (t->isPtrOrPtrVectorTy()) {
+    v = builder.CreatePtrToInt(v, DL.getIntPtrType(t), getCastName());
+    t = v->getType();
+    if (t->isIntegerTy())
+      return v;
+  }
+  llvm::IntegerType *ity = builder.getIntNTy(DL.getTypeSizeInBits(t));
+  if (t->isFloatingPointTy() || t->isVectorTy())
+    return builder.CreateBitCast(v, ity, getCastName());
+
+  // aggregates are laid out like in memory, the first byte lowest
+  llvm::StructType *st = dyn_cast<llvm::StructType>(t);
+  unsigned numElements = st ? st->getNumElements()
+                            : cast<llvm::ArrayType>(t)->getNumElements();
+  llvm::Value *result = nullptr;
+  for (unsigned i = 0; i != numElements; ++i) {
+    uint64_t offset =
+        st ? DL.getStructLayout(st)->getElementOffsetInBits(i)
+           : i * DL.getTypeAllocSizeInBits(
+                     cast<llvm::ArrayType>(t)->getElementType());
+    llvm::Value *e =
+        toInteger(builder, builder.CreateExtractValue(v, i, getCastName()));
+    e = builder.CreateZExt(e, ity, getCastName());
+    if (offset)
+      e = builder.CreateShl(e, offset, getCastName());
+    result = result ? builder.CreateOr(result, e, getCastName()) : e;
+  }
+  return result;
+}
+
+bool InstrumentationManager::InstrumentWidePTWrite(llvm::Instruction *inst) {
+  if (isa<PHINode>(inst) || inst->isTerminator() ||
+      !hasNoPadding(inst->getType()))
+    return false;
+
+  llvm::IRBuilder<> builder(inst->getNextNode());
+  llvm::Value *whole = toInteger(builder, inst);
+  unsigned width = whole->getType()->getIntegerBitWidth();
+  if (width <= 64) {
+    llvm::Value *v = builder.CreateZExt(whole, TyInt64, getCastName());
+    builder.CreateCall(iasm, {v});
+    return true;
+  }
+
+  // one ptwrite per 64 bits, the lowest first
+  unsigned count = (width + 63) / 64;
+  for (unsigned i = 0; i != count; ++i) {
+    llvm::Value *part = whole;
+    if (i)
+      part = builder.CreateLShr(whole, 64 * i, getCastName());
+    part = builder.CreateTrunc(part, TyInt64, getCastName());
+    llvm::Metadata *ops[] = {
+        ConstantAsMetadata::get(builder.getInt32(i)),
+        ConstantAsMetadata::get(builder.getInt32(count))};
+    cast<Instruction>(part)->setMetadata(PTWritePass::partMetadata,
+                                          MDNode::get(C, ops));
+    builder.CreateCall(iasm, {part});
+  }
+  return true;
+}
+
+/// Bytes of the PTW packet of one ptwrite, a 2-byte header and the 64-bit
+/// payload.
+static const double PTWPacketBytes = 10;
+/// Bytes of the FUP packet PT emits after a PTW packet with FUPonPTW, a
+/// header and an IP compressed to at most 6 bytes. The TIP.PGE and TIP.PGD
+/// packets come with tracing being enabled and disabled, not with ptwrites.
+static const double FUPPacketBytes = 7;
+/// A guarded ptwrite adds a conditional branch, one bit of a short TNT
+/// packet that holds up to 6 of them.
+static const double GuardBranchBytes = 1.0 / 6;
+
+/// A recording point and the trace it is estimated to produce
+struct PTWriteSite {
+  llvm::Instruction *point;
+  /// ptwrites per execution, more than one for values wider than 64 bits
+  unsigned parts;
+  PTWriteMode mode;
+  unsigned samplePeriod;
+
+  /// Whether mode applies: the ptwrites of wide values are not guarded.
+  bool isGuardable() const { return parts == 1; }
+
+  /// Trace bytes of the executions of the profile
+  double getBytes(double packetBytes) const {
+    double executions = KInstruction::getLoadedFreq(point);
+    double ptwrites = executions * parts;
+    if (!isGuardable() || mode == PTWriteMode::Always)
+      return ptwrites * packetBytes;
+    if (mode == PTWriteMode::Sampled)
+      ptwrites /= samplePeriod;
+    // a changed value may change on every execution
+    return ptwrites * packetBytes + executions * GuardBranchBytes;
+  }
+};
+
+/// The number of ptwrites InstrumentationManager emits for inst.
+static unsigned getPTWriteParts(const llvm::DataLayout &DL,
+                                llvm::Instruction *inst) {
+  llvm::Type *t = inst->getType();
+  if (t->isPointerTy() || t->isDoubleTy() || t->isFloatTy() ||
+      (t->isIntegerTy() && t->getIntegerBitWidth() <= 64))
+    return 1;
+  return std::max<uint64_t>(1, (DL.getTypeSizeInBits(t) + 63) / 64);
+}
+
 bool PTWritePass::runOnModule(Module &M) {
   const llvm::DataLayout &DL = M.getDataLayout();
-  InstrumentationManager mgr(M);
+  InstrumentationManager mgr(M, mode, samplePeriod);
+  // instructions to record, in the order they were found
+  std::vector<llvm::Instruction *> points;
+  std::unordered_set<llvm::Instruction *> pointSet;
+  unsigned int configured_freq = 0;
 
   for (Module::iterator f = M.begin(), fe = M.end(); f != fe; ++f) {
     const std::string fname = KInstruction::getUniqueID(&(*f));
@@ -208,9 +494,9 @@ bool PTWritePass::runOnModule(Module &M) {
         for (auto &I : b) {
           llvm::Instruction *inst = &I;
           if (isa<llvm::LoadInst>(inst)) {
-            // TODO InstrumentPTWrite will modify the same BB, should do a two
-            // pass and decouple the modification from iteration
-            mgr.InstrumentPTWrite(inst);
+            configured_freq += KInstruction::getLoadedFreq(inst);
+            if (pointSet.insert(inst).second)
+              points.push_back(inst);
           }
         }
       }
@@ -239,11 +525,74 @@ bool PTWritePass::runOnModule(Module &M) {
             llvm::errs() << "Warning: pointer recording at " << iname
                          << " may not work due to undeterministic malloc\n";
           }
-          mgr.InstrumentPTWrite(inst);
+          configured_freq += freq;
+          llvm::Instruction *point =
+              optimizePlacement ? getRecordingPoint(inst) : inst;
+          if (point != inst) {
+            llvm::errs() << "Recording " << iname << " through "
+                         << KInstruction::getUniqueID(point) << " freq "
+                         << KInstruction::getLoadedFreq(point) << '\n';
+          }
+          if (pointSet.insert(point).second)
+            points.push_back(point);
         }
       }
     }
   }
+  std::vector<PTWriteSite> sites;
+  sites.reserve(points.size());
+  for (llvm::Instruction *point : points)
+    sites.push_back({point, getPTWriteParts(DL, point), mode, samplePeriod});
+  double packetBytes =
+      PTWPacketBytes + (budget.fupOnPTW ? FUPPacketBytes : 0);
+  double estimatedBytes = 0;
+  for (PTWriteSite &site : sites)
+    estimatedBytes += site.getBytes(packetBytes);
+
+  if (budget.bytesPerSecond && !estimatedBytes) {
+    llvm::errs() << "Warning: the ptwrite budget needs an input bitcode "
+                    "with frequency info, ignored\n";
+  } else if (budget.bytesPerSecond) {
+    double budgetBytes = budget.bytesPerSecond * budget.profileSeconds;
+    // sample the sites producing the most trace first: their values are
+    // the most repeated ones, so sampling them loses the least per byte
+    std::vector<PTWriteSite *> order;
+    for (PTWriteSite &site : sites)
+      if (site.isGuardable())
+        order.push_back(&site);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](const PTWriteSite *a, const PTWriteSite *b) {
+                       return a->getBytes(packetBytes) >
+                              b->getBytes(packetBytes);
+                     });
+    for (PTWriteSite *site : order) {
+      if (estimatedBytes <= budgetBytes)
+        break;
+      double before = site->getBytes(packetBytes);
+      PTWriteSite sampled = *site;
+      sampled.mode = PTWriteMode::Sampled;
+      double after = sampled.getBytes(packetBytes);
+      if (after >= before)
+        continue;
+      *site = sampled;
+      estimatedBytes -= before - after;
+      llvm::errs() << "Sampling " << KInstruction::getUniqueID(site->point)
+                   << " every " << site->samplePeriod
+                   << " executions to stay within the ptwrite budget\n";
+    }
+    if (estimatedBytes > budgetBytes)
+      llvm::errs() << "Warning: estimated "
+                   << uint64_t(estimatedBytes / budget.profileSeconds)
+                   << " trace bytes per second exceed the ptwrite budget of "
+                   << budget.bytesPerSecond << '\n';
+  }
+
+  // instrumented after the walk, so that no block changes while it is
+  // walked
+  for (PTWriteSite &site : sites) {
+    mgr.setMode(site.mode, site.samplePeriod);
+    mgr.InstrumentPTWrite(site.point);
+  }
 
   unsigned int actual_bytes = 0;
   unsigned int ptwrite_freq = 0;
@@ -270,6 +619,12 @@ bool PTWritePass::runOnModule(Module &M) {
     llvm::errs() << "PTWrite executed: " << ptwrite_freq << '\n';
     llvm::errs() << "PTWrite Recorded: "
                  << ptwrite_freq * DL.getPointerSizeInBits() / 8 << '\n';
+    llvm::errs() << "PT packet bytes estimated: " << uint64_t(estimatedBytes)
+                 << " (" << uint64_t(estimatedBytes / budget.profileSeconds)
+                 << " per second)\n";
+    if (optimizePlacement)
+      llvm::errs() << "PTWrite executed without placement: " << configured_freq
+                   << '\n';
     std::sort(instinfo.begin(), instinfo.end(),
               [](auto &a, auto &b) { return a.freq >= b.freq; });
     for (InstInfo &ii : instinfo) {
@@ -0,0 +1,525 @@
+//===-- SymbolicTaintPass.cpp ---------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A whole-program, flow-insensitive taint analysis from the places symbolic
+// data comes from: klee_make_symbolic and the other special functions that
+// write symbolic memory (through which the POSIX runtime also models symbolic
+// files and sockets) and the results of the special functions. Symbolic
+// execution forks on symbolic conditions and continues with concrete values,
+// so only data flows carry taint, through registers, calls and memory.
+//
+// Memory is tracked per allocation site (allocas, globals and calls to the
+// allocation functions) while the address of a site does not escape, that
+// is, is not stored to memory, converted to an integer or passed to an
+// external or indirect call. All other memory is one untracked object. A
+// basic block whose instructions have no tainted operand and no tainted
+// result can only handle concrete values, and its terminator is marked with
+// concreteMetadata.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Internal/Module/Passes.h"
+
+#include "klee/Config/Version.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
+
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace llvm;
+
+namespace {
+
+/// An allocation site, nullptr standing for the untracked memory
+typedef const Value *Object;
+typedef std::set<Object> PointsTo;
+
+/// Beyond this many objects a pointer points to the untracked memory
+const unsigned MaxPointsTo = 16;
+
+const char *const allocationFunctions[] = {
+    "malloc", "calloc", "realloc", "memalign", "valloc",
+    "_Znwj",  "_Znwm",  "_Znaj",   "_Znam"};
+
+/// The special functions that write symbolic memory
+const char *const symbolicMemoryFunctions[] = {
+    "klee_make_symbolic", "klee_make_symbolic_batch", "klee_copy_memory",
+    "klee_map_file"};
+
+/// The functions that do not keep the pointers they get
+const char *const nonCapturingFunctions[] = {
+    "free",
+    "klee_assume",
+    "klee_check_memory_access",
+    "klee_get_obj_size",
+    "klee_make_symbolic",
+    "klee_mustnotbe_symbolic",
+    "klee_mustnotbe_symbolic_str",
+    "klee_posix_prefer_cex",
+    "klee_prefer_cex",
+    "klee_print_expr",
+    "klee_print_range",
+    "klee_warning",
+    "klee_warning_once"};
+
+/// The special functions that return concrete values
+const char *const concreteResultFunctions[] = {
+    "klee_get_valuef",   "klee_get_valued",    "klee_get_valuel",
+    "klee_get_valuell",  "klee_get_value_i32", "klee_get_value_i64",
+    "klee_get_obj_size", "klee_is_symbolic"};
+
+template <size_t N> bool isOneOf(StringRef name, const char *const (&names)[N]) {
+  for (const char *n : names)
+    if (name == n)
+      return true;
+  return false;
+}
+
+/// The allocation site a pointer points into, or the pointer
+const Value *getBase(const Value *v) {
+  for (;;) {
+    if (const GEPOperator *gep = dyn_cast<GEPOperator>(v))
+      v = gep->getPointerOperand();
+    else if (const BitCastOperator *bc = dyn_cast<BitCastOperator>(v))
+      v = bc->getOperand(0);
+    else
+      return v;
+  }
+}
+
+class TaintAnalysis {
+  Module &module;
+  std::unordered_set<const Value *> taintedValues;
+  std::unordered_map<const Value *, PointsTo> pointsTo;
+  std::unordered_set<Object> taintedObjects;
+  std::unordered_set<Object> escaped;
+  std::unordered_set<const Function *> taintedReturns;
+  std::unordered_map<const Function *, PointsTo> returnPointsTo;
+  /// of the arguments and results of indirect calls
+  bool indirectArgumentTaint = false, indirectReturnTaint = false;
+  bool changed = false;
+
+  bool isTainted(const Value *v) const { return taintedValues.count(v); }
+  void taint(const Value *v) { changed |= taintedValues.insert(v).second; }
+
+  bool isObjectTainted(Object o) const {
+    if (!o || escaped.count(o))
+      return taintedObjects.count(nullptr);
+    return taintedObjects.count(o);
+  }
+  void taintObject(Object o) {
+    if (o && escaped.count(o))
+      o = nullptr;
+    changed |= taintedObjects.insert(o).second;
+  }
+  void escape(Object o) {
+    // nothing can write a constant
+    const GlobalVariable *gv = dyn_cast_or_null<GlobalVariable>(o);
+    if (!o || (gv && gv->isConstant()) || !escaped.insert(o).second)
+      return;
+    changed = true;
+    if (taintedObjects.count(o))
+      taintedObjects.insert(nullptr);
+  }
+
+  void addConstantPointsTo(const Constant *c, PointsTo &out) const;
+  PointsTo getPointsTo(const Value *v) const;
+  void addPointsTo(const Value *v, const PointsTo &objects);
+
+  bool anyObjectTainted(const PointsTo &objects) const {
+    for (Object o : objects)
+      if (isObjectTainted(o))
+        return true;
+    return false;
+  }
+  void taintObjects(const PointsTo &objects) {
+    for (Object o : objects)
+      taintObject(o);
+  }
+  void escapeObjects(const PointsTo &objects) {
+    for (Object o : objects)
+      escape(o);
+  }
+
+  void visitCall(const Instruction &i);
+  void visit(const Instruction &i);
+
+public:
+  explicit TaintAnalysis(Module &m) : module(m) {}
+
+  /// Propagate taint until nothing changes.
+  void run();
+
+  /// Whether all values of b are concrete
+  bool isConcrete(const BasicBlock &b) const;
+};
+
+void TaintAnalysis::addConstantPointsTo(const Constant *c,
+                                        PointsTo &out) const {
+  const Value *base = getBase(c);
+  if (isa<GlobalVariable>(base)) {
+    out.insert(escaped.count(base) ? nullptr : base);
+  } else if (isa<GlobalAlias>(base)) {
+    out.insert(nullptr);
+  } else if (const ConstantExpr *ce = dyn_cast<ConstantExpr>(base)) {
+    if (ce->getOpcode() == Instruction::IntToPtr)
+      out.insert(nullptr);
+    else
+      for (const Use &u : ce->operands())
+        addConstantPointsTo(cast<Constant>(u), out);
+  } else if (!isa<GlobalValue>(base)) {
+    // aggregates
+    for (const Use &u : cast<Constant>(base)->operands())
+      if (const Constant *element = dyn_cast<Constant>(u))
+        addConstantPointsTo(element, out);
+  }
+}
+
+PointsTo TaintAnalysis::getPointsTo(const Value *v) const {
+  PointsTo result;
+  if (const Constant *c = dyn_cast<Constant>(v)) {
+    addConstantPointsTo(c, result);
+    return result;
+  }
+  auto it = pointsTo.find(v);
+  if (it == pointsTo.end())
+    return result;
+  for (Object o : it->second)
+    result.insert(o && escaped.count(o) ? nullptr : o);
+  return result;
+}
+
+void TaintAnalysis::addPointsTo(const Value *v, const PointsTo &objects) {
+  if (objects.empty())
+    return;
+  PointsTo &pts = pointsTo[v];
+  if (pts.size() == 1 && pts.count(nullptr))
+    return;
+  for (Object o : objects)
+    changed |= pts.insert(o).second;
+  if (pts.size() > MaxPointsTo) {
+    escapeObjects(pts);
+    pts.clear();
+    pts.insert(nullptr);
+  }
+}
+
+void TaintAnalysis::visitCall(const Instruction &i) {
+  ImmutableCallSite cs(&i);
+  const Value *called = cs.getCalledValue();
+  const Function *f = dyn_cast<Function>(called->stripPointerCasts());
+
+  bool anyArgumentTainted = false;
+  PointsTo argumentObjects;
+  for (const Use &arg : cs.args()) {
+    anyArgumentTainted |= isTainted(arg);
+    PointsTo pts = getPointsTo(arg);
+    argumentObjects.insert(pts.begin(), pts.end());
+  }
+
+  if (isa<InlineAsm>(called)) {
+    escapeObjects(argumentObjects);
+    if (!i.getType()->isVoidTy())
+      taint(&i);
+    return;
+  }
+
+  if (!f) {
+    // any of the address taken functions
+    if (anyArgumentTainted && !indirectArgumentTaint) {
+      indirectArgumentTaint = true;
+      changed = true;
+    }
+    escapeObjects(argumentObjects);
+    if (indirectReturnTaint)
+      taint(&i);
+    addPointsTo(&i, PointsTo{nullptr});
+    return;
+  }
+
+  if (f->isIntrinsic()) {
+    switch (f->getIntrinsicID()) {
+    case Intrinsic::dbg_declare:
+    case Intrinsic::dbg_value:
+    case Intrinsic::lifetime_start:
+    case Intrinsic::lifetime_end:
+    case Intrinsic::vaend:
+      return;
+    case Intrinsic::memcpy:
+    case Intrinsic::memmove:
+      if (anyArgumentTainted || anyObjectTainted(getPointsTo(cs.getArgument(1))))
+        taintObjects(getPointsTo(cs.getArgument(0)));
+      return;
+    case Intrinsic::memset:
+      if (anyArgumentTainted)
+        taintObjects(getPointsTo(cs.getArgument(0)));
+      return;
+    case Intrinsic::vastart:
+    case Intrinsic::vacopy:
+      // the va_list then points to the arguments, which are untracked
+      escapeObjects(argumentObjects);
+      return;
+    default:
+      if (anyArgumentTainted)
+        taint(&i);
+      addPointsTo(&i, argumentObjects);
+      return;
+    }
+  }
+
+  if (f->isDeclaration()) {
+    StringRef name = f->getName();
+    if (isOneOf(name, allocationFunctions)) {
+      addPointsTo(&i, PointsTo{&i});
+      if (name == "realloc" &&
+          anyObjectTainted(getPointsTo(cs.getArgument(0))))
+        taintObject(&i);
+      return;
+    }
+    if (name == "klee_make_symbolic") {
+      taintObjects(getPointsTo(cs.getArgument(0)));
+    } else if (isOneOf(name, symbolicMemoryFunctions)) {
+      // which may also write what the memory they get points to
+      taintObjects(argumentObjects);
+      taintObject(nullptr);
+    }
+    // external calls get concrete arguments and return concrete values,
+    // but may keep the pointers they get
+    if (!isOneOf(name, nonCapturingFunctions))
+      escapeObjects(argumentObjects);
+    if (name.startswith("klee_") && !isOneOf(name, concreteResultFunctions))
+      taint(&i);
+    addPointsTo(&i, PointsTo{nullptr});
+    return;
+  }
+
+  unsigned index = 0;
+  for (const Argument &param : f->args()) {
+    if (index == cs.arg_size())
+      break;
+    const Value *arg = cs.getArgument(index++);
+    if (isTainted(arg))
+      taint(&param);
+    addPointsTo(&param, getPointsTo(arg));
+  }
+  // the variadic arguments are read through the untracked memory
+  for (unsigned e = cs.arg_size(); index < e; ++index) {
+    const Value *arg = cs.getArgument(index);
+    if (isTainted(arg))
+      taintObject(nullptr);
+    escapeObjects(getPointsTo(arg));
+  }
+  if (taintedReturns.count(f))
+    taint(&i);
+  auto it = returnPointsTo.find(f);
+  if (it != returnPointsTo.end())
+    addPointsTo(&i, PointsTo(it->second));
+}
+
+void TaintAnalysis::visit(const Instruction &i) {
+  switch (i.getOpcode()) {
+  case Instruction::Call:
+  case Instruction::Invoke:
+    visitCall(i);
+    return;
+
+  case Instruction::Alloca:
+    addPointsTo(&i, PointsTo{&i});
+    return;
+
+  case Instruction::Load: {
+    const Value *ptr = i.getOperand(0);
+    if (isTainted(ptr) || anyObjectTainted(getPointsTo(ptr)))
+      taint(&i);
+    addPointsTo(&i, PointsTo{nullptr});
+    return;
+  }
+
+  case Instruction::Store: {
+    const Value *value = i.getOperand(0), *ptr = i.getOperand(1);
+    // a symbolic address makes the objects it may point to symbolic
+    if (isTainted(value) || isTainted(ptr))
+      taintObjects(getPointsTo(ptr));
+    escapeObjects(getPointsTo(value));
+    return;
+  }
+
+  case Instruction::AtomicRMW:
+  case Instruction::AtomicCmpXchg: {
+    const Value *ptr = i.getOperand(0);
+    PointsTo objects = getPointsTo(ptr);
+    bool anyTainted = false;
+    for (const Use &op : i.operands()) {
+      anyTainted |= isTainted(op);
+      if (op.get() != ptr)
+        escapeObjects(getPointsTo(op));
+    }
+    if (anyTainted)
+      taintObjects(objects);
+    if (anyTainted || anyObjectTainted(objects))
+      taint(&i);
+    addPointsTo(&i, PointsTo{nullptr});
+    return;
+  }
+
+  case Instruction::VAArg:
+    if (isObjectTainted(nullptr))
+      taint(&i);
+    addPointsTo(&i, PointsTo{nullptr});
+    return;
+
+  case Instruction::PtrToInt:
+    escapeObjects(getPointsTo(i.getOperand(0)));
+    if (isTainted(i.getOperand(0)))
+      taint(&i);
+    return;
+
+  case Instruction::IntToPtr:
+    if (isTainted(i.getOperand(0)))
+      taint(&i);
+    addPointsTo(&i, PointsTo{nullptr});
+    return;
+
+  case Instruction::Ret: {
+    if (i.getNumOperands() == 0)
+      return;
+    const Function *f = i.getParent()->getParent();
+    const Value *value = i.getOperand(0);
+    PointsTo pts = getPointsTo(value);
+    if (isTainted(value)) {
+      changed |= taintedReturns.insert(f).second;
+      if (f->hasAddressTaken() && !indirectReturnTaint) {
+        indirectReturnTaint = true;
+        changed = true;
+      }
+    }
+    if (f->hasAddressTaken())
+      escapeObjects(pts);
+    if (!pts.empty()) {
+      PointsTo &ret = returnPointsTo[f];
+      for (Object o : pts)
+        changed |= ret.insert(o).second;
+    }
+    return;
+  }
+
+  default: {
+    bool anyTainted = false;
+    PointsTo objects;
+    for (const Use &op : i.operands()) {
+      anyTainted |= isTainted(op);
+      if (!isa<BasicBlock>(op)) {
+        PointsTo pts = getPointsTo(op);
+        objects.insert(pts.begin(), pts.end());
+      }
+    }
+    if (anyTainted)
+      taint(&i);
+    addPointsTo(&i, objects);
+    return;
+  }
+  }
+}
+
+void TaintAnalysis::run() {
+  // what initializers point to is stored in memory
+  for (const GlobalVariable &gv : module.globals()) {
+    if (!gv.hasInitializer())
+      continue;
+    PointsTo pts;
+    addConstantPointsTo(gv.getInitializer(), pts);
+    escapeObjects(pts);
+  }
+  // functions called by KLEE or through pointers get untracked memory
+  for (const Function &f : module) {
+    bool directlyCalled = false;
+    for (const User *u : f.users()) {
+      ImmutableCallSite cs(u);
+      if (cs && cs.getCalledValue() == &f)
+        directlyCalled = true;
+    }
+    if (!directlyCalled || f.hasAddressTaken())
+      for (const Argument &param : f.args())
+        addPointsTo(&param, PointsTo{nullptr});
+  }
+
+  do {
+    changed = false;
+    if (indirectArgumentTaint)
+      for (const Function &f : module)
+        if (f.hasAddressTaken())
+          for (const Argument &param : f.args())
+            taint(&param);
+    for (const Function &f : module)
+      for (const BasicBlock &b : f)
+        for (const Instruction &i : b)
+          visit(i);
+  } while (changed);
+}
+
+bool TaintAnalysis::isConcrete(const BasicBlock &b) const {
+  for (const Instruction &i : b) {
+    if (isTainted(&i))
+      return false;
+    for (const Use &op : i.operands())
+      if (isTainted(op))
+        return false;
+  }
+  return true;
+}
+
+} // namespace
+
+namespace klee {
+
+char SymbolicTaintPass::ID = 0;
+const char *const SymbolicTaintPass::concreteMetadata = "klee.concrete";
+
+bool SymbolicTaintPass::runOnModule(Module &M) {
+  TaintAnalysis analysis(M);
+  analysis.run();
+
+  MDNode *concrete = MDNode::get(M.getContext(), {});
+  unsigned blocks = 0, concreteBlocks = 0, functions = 0,
+           concreteFunctions = 0;
+  for (Function &f : M) {
+    if (f.isDeclaration())
+      continue;
+    bool allConcrete = true;
+    for (BasicBlock &b : f) {
+      ++blocks;
+      if (analysis.isConcrete(b)) {
+        b.getTerminator()->setMetadata(concreteMetadata, concrete);
+        ++concreteBlocks;
+      } else {
+        allConcrete = false;
+      }
+    }
+    ++functions;
+    concreteFunctions += allConcrete;
+  }
+
+  klee_message("SymbolicTaintPass: %u of %u functions and %u of %u basic "
+               "blocks only handle concrete values",
+               concreteFunctions, functions, concreteBlocks, blocks);
+  return concreteBlocks != 0;
+}
+
+} // namespace klee
@@ -0,0 +1,284 @@
+//===-- TracePreservingOptimize.cpp ---------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The -optimize pipeline cannot be used on the bitcode a trace was recorded
+// against: the entries of a .path file follow its branches, switches and
+// indirect branches, and the data recordings name the instructions that
+// AssignIDPass named and PTWritePass recorded. This pass only runs SROA,
+// mem2reg, instcombine and dead store elimination, which keep the control
+// flow graph, but instcombine may still canonicalize a branch condition to
+// a constant or fold a recorded instruction away. So every function is
+// optimized in a copy, with the recorded loads and the allocas they read
+// pinned, and the copy replaces the function only if its blocks, their
+// terminators and its record points are the same as before.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Internal/Module/Passes.h"
+
+#include "klee/Config/Version.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/Transforms/Scalar.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#if LLVM_VERSION_CODE >= LLVM_VERSION(7, 0)
+#include "llvm/Transforms/InstCombine/InstCombine.h"
+#include "llvm/Transforms/Utils.h"
+#endif
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+
+/// What recorded traces refer to in a function
+struct TraceShape {
+  struct Block {
+    unsigned opcode;
+    /// as indices of blocks
+    std::vector<unsigned> successors;
+    /// of a switch, constants being unique in a context
+    std::vector<const Value *> cases;
+    bool constantCondition = false;
+
+    bool operator==(const Block &b) const {
+      return opcode == b.opcode && successors == b.successors &&
+             cases == b.cases && constantCondition == b.constantCondition;
+    }
+  };
+  /// A ptwrite and the instruction it records
+  struct Record {
+    unsigned block;
+    std::string name;
+    unsigned opcode;
+    /// the instruction a recorded cast casts
+    std::string inner;
+    bool part;
+
+    bool operator==(const Record &r) const {
+      return block == r.block && name == r.name && opcode == r.opcode &&
+             inner == r.inner && part == r.part;
+    }
+  };
+
+  std::vector<Block> blocks;
+  std::vector<Record> records;
+
+  bool operator==(const TraceShape &s) const {
+    return blocks == s.blocks && records == s.records;
+  }
+};
+
+bool isPTWrite(const Instruction &i) {
+  const CallInst *ci = dyn_cast<CallInst>(&i);
+  if (!ci)
+    return false;
+  const InlineAsm *ia = dyn_cast<InlineAsm>(ci->getCalledValue());
+  return ia && ia->getAsmString() == "ptwrite $0";
+}
+
+/// The instruction a recorded cast casts, which replay concretizes too
+Instruction *getCastRecord(Value *v) {
+  CastInst *ci = dyn_cast<CastInst>(v);
+  return ci ? dyn_cast<Instruction>(ci->getOperand(0)) : nullptr;
+}
+
+TraceShape getShape(Function &f) {
+  TraceShape shape;
+  std::map<const BasicBlock *, unsigned> index;
+  for (BasicBlock &b : f)
+    index.insert(std::make_pair(&b, index.size()));
+
+  for (BasicBlock &b : f) {
+    const Instruction *t = b.getTerminator();
+    TraceShape::Block block;
+    block.opcode = t->getOpcode();
+    for (unsigned i = 0, e = t->getNumSuccessors(); i != e; ++i)
+      block.successors.push_back(index[t->getSuccessor(i)]);
+    if (const BranchInst *bi = dyn_cast<BranchInst>(t)) {
+      if (bi->isConditional())
+        block.constantCondition = isa<Constant>(bi->getCondition());
+    } else if (const SwitchInst *si = dyn_cast<SwitchInst>(t)) {
+      block.constantCondition = isa<Constant>(si->getCondition());
+      for (auto c : si->cases())
+        block.cases.push_back(c.getCaseValue());
+    } else if (const IndirectBrInst *ii = dyn_cast<IndirectBrInst>(t)) {
+      block.constantCondition = isa<Constant>(ii->getAddress());
+    }
+    shape.blocks.push_back(block);
+
+    for (Instruction &i : b) {
+      if (!isPTWrite(i))
+        continue;
+      Value *v = i.getOperand(0);
+      TraceShape::Record record;
+      record.block = index[&b];
+      record.name = v->getName().str();
+      Instruction *recI = dyn_cast<Instruction>(v);
+      record.opcode = recI ? recI->getOpcode() : 0;
+      Instruction *inner = getCastRecord(v);
+      record.inner = inner ? inner->getName().str() : "";
+      record.part =
+          recI && recI->getMetadata(klee::PTWritePass::partMetadata);
+      shape.records.push_back(record);
+    }
+  }
+  return shape;
+}
+
+/// The object a pointer points into
+Value *getBase(Value *v) {
+  for (;;) {
+    if (GEPOperator *gep = dyn_cast<GEPOperator>(v))
+      v = gep->getPointerOperand();
+    else if (BitCastOperator *bc = dyn_cast<BitCastOperator>(v))
+      v = bc->getOperand(0);
+    else
+      return v;
+  }
+}
+
+/// Keep the recorded loads and where they load from: the loads become
+/// volatile, so that instcombine does not forward stores to them, and the
+/// allocas they read escape to pin, so that mem2reg and SROA leave them.
+/// \return the names of the loads made volatile
+std::set<std::string> pinRecords(Function &f, Function *pin) {
+  std::set<std::string> pinned;
+  std::set<AllocaInst *> allocas;
+  for (BasicBlock &b : f) {
+    for (Instruction &i : b) {
+      if (!isPTWrite(i))
+        continue;
+      Value *recorded[] = {i.getOperand(0), getCastRecord(i.getOperand(0))};
+      for (Value *v : recorded) {
+        LoadInst *li = dyn_cast_or_null<LoadInst>(v);
+        if (!li)
+          continue;
+        if (!li->isVolatile()) {
+          li->setVolatile(true);
+          pinned.insert(li->getName().str());
+        }
+        Value *base = getBase(li->getPointerOperand());
+        if (AllocaInst *ai = dyn_cast<AllocaInst>(base))
+          allocas.insert(ai);
+      }
+    }
+  }
+  for (AllocaInst *ai : allocas)
+    CallInst::Create(pin, {ai}, "", ai->getNextNode());
+  return pinned;
+}
+
+void unpinRecords(Function &f, Function *pin,
+                  const std::set<std::string> &pinned) {
+  for (BasicBlock &b : f)
+    for (Instruction &i : b)
+      if (LoadInst *li = dyn_cast<LoadInst>(&i))
+        if (pinned.count(li->getName().str()))
+          li->setVolatile(false);
+  std::vector<CallInst *> calls;
+  for (User *u : pin->users())
+    if (CallInst *ci = dyn_cast<CallInst>(u))
+      if (ci->getParent()->getParent() == &f)
+        calls.push_back(ci);
+  for (CallInst *ci : calls)
+    ci->eraseFromParent();
+}
+
+bool hasAddressTakenBlock(const Function &f) {
+  for (const BasicBlock &b : f)
+    if (b.hasAddressTaken())
+      return true;
+  return false;
+}
+
+/// Move the body of copy, a clone of f, into f.
+void replaceBody(Function &f, Function &copy) {
+  // no block is address taken, so only f refers to them
+  for (BasicBlock &b : f)
+    b.dropAllReferences();
+  while (!f.empty())
+    f.begin()->eraseFromParent();
+  f.getBasicBlockList().splice(f.end(), copy.getBasicBlockList());
+  for (auto a = f.arg_begin(), ca = copy.arg_begin(), ae = f.arg_end();
+       a != ae; ++a, ++ca)
+    ca->replaceAllUsesWith(&*a);
+  // the debug locations of the body refer to the subprogram of the clone
+  if (DISubprogram *sp = copy.getSubprogram())
+    f.setSubprogram(sp);
+  copy.eraseFromParent();
+}
+
+} // namespace
+
+namespace klee {
+
+char TracePreservingOptimizePass::ID = 0;
+
+bool TracePreservingOptimizePass::runOnModule(Module &M) {
+  std::vector<Function *> functions;
+  for (Function &f : M)
+    if (!f.isDeclaration() && !hasAddressTakenBlock(f))
+      functions.push_back(&f);
+  if (functions.empty())
+    return false;
+
+  Function *pin = Function::Create(
+      FunctionType::get(Type::getVoidTy(M.getContext()), true),
+      GlobalValue::ExternalLinkage, "klee.trace.pin", &M);
+
+  legacy::FunctionPassManager fpm(&M);
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3, 9)
+  fpm.add(createSROAPass());
+#else
+  fpm.add(createScalarReplAggregatesPass());
+#endif
+  fpm.add(createPromoteMemoryToRegisterPass());
+  fpm.add(createInstructionCombiningPass());
+  fpm.add(createDeadStoreEliminationPass());
+  fpm.doInitialization();
+
+  unsigned optimized = 0;
+  for (Function *f : functions) {
+    TraceShape shape = getShape(*f);
+    ValueToValueMapTy VMap;
+    Function *copy = CloneFunction(f, VMap);
+    std::set<std::string> pinned = pinRecords(*copy, pin);
+    fpm.run(*copy);
+    unpinRecords(*copy, pin, pinned);
+
+    if (getShape(*copy) == shape) {
+      replaceBody(*f, *copy);
+      ++optimized;
+    } else {
+      copy->eraseFromParent();
+    }
+  }
+  fpm.doFinalization();
+  pin->eraseFromParent();
+
+  klee_message("TracePreservingOptimizePass: optimized %u of %zu functions, "
+               "kept the others to preserve their traces",
+               optimized, functions.size());
+  return optimized != 0;
+}
+
+} // namespace klee
@@ -0,0 +1,259 @@
+//===-- AdaptiveSolver.cpp - Pick a solver chain per class of queries -----===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Which of the optional layers of the solver chain pay off depends on the
+// queries: the counterexample cache wins on many small similar queries but
+// its subset searches cost more than they save on large ones, and the
+// equality simplifier (with its array optimization) and the fast
+// counterexample solver only help some shapes. This solver builds the chain
+// configured by the command line and the chains that differ from it in one
+// of these layers, all over the same underlying solver, and learns for each
+// class of queries which of them answers fastest.
+//
+// Queries are classified by the logarithms of their node count and of the
+// longest update list they read, by the number of arrays they read and by
+// the number of independent factors of the constraints of their state, all
+// of which the metadata of the expressions or the constraint manager already
+// hold. Each chain is first tried MinTrials times in a class, after which the
+// class uses the chain with the lowest mean solving time, except for one
+// query in ExploreEvery that goes to the least tried chain.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/Expr.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+#include "klee/Internal/System/Time.h"
+#include "klee/Solver/Solver.h"
+#include "klee/Solver/SolverCmdLine.h"
+#include "klee/Solver/SolverImpl.h"
+#include "klee/Solver/SolverStats.h"
+
+#include "llvm/Support/MathExtras.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+const unsigned MinTrials = 4;
+const unsigned ExploreEvery = 32;
+
+/// Forwards to a solver it does not own, so that the chains can share it.
+class SharedSolver : public SolverImpl {
+  Solver *solver;
+
+public:
+  SharedSolver(Solver *_solver) : solver(_solver) {}
+
+  bool computeValidity(const Query &query, Solver::Validity &result) {
+    return solver->impl->computeValidity(query, result);
+  }
+  bool computeTruth(const Query &query, bool &isValid) {
+    return solver->impl->computeTruth(query, isValid);
+  }
+  bool computeValue(const Query &query, ref<Expr> &result) {
+    return solver->impl->computeValue(query, result);
+  }
+  bool computeInitialValues(const Query &query,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution) {
+    return solver->impl->computeInitialValues(query, objects, values,
+                                              hasSolution);
+  }
+  SolverRunStatus getOperationStatusCode() {
+    return solver->impl->getOperationStatusCode();
+  }
+  char *getConstraintLog(const Query &query) {
+    return solver->impl->getConstraintLog(query);
+  }
+  void setCoreSolverTimeout(time::Span timeout) {
+    solver->impl->setCoreSolverTimeout(timeout);
+  }
+};
+
+class AdaptiveSolver : public SolverImpl {
+  struct Chain {
+    Solver *solver;
+    /// the queries the chain answered
+    Statistic *queries;
+  };
+  struct Trials {
+    unsigned count = 0;
+    double seconds = 0;
+  };
+  struct Class {
+    unsigned queries = 0;
+    /// by chain
+    std::vector<Trials> trials;
+  };
+
+  Solver *solver;
+  std::vector<Chain> chains;
+  std::unordered_map<uint32_t, Class> classes;
+  /// the chain that answered the last query
+  unsigned last = 0;
+
+  static uint32_t classify(const Query &query);
+  unsigned choose(Class &c);
+
+  /// Answer query with the chain chosen for its class.
+  template <class F> bool solve(const Query &query, F f);
+
+public:
+  AdaptiveSolver(Solver *s);
+  ~AdaptiveSolver();
+
+  bool computeValidity(const Query &, Solver::Validity &result);
+  bool computeTruth(const Query &, bool &isValid);
+  bool computeValue(const Query &, ref<Expr> &result);
+  bool computeInitialValues(const Query &,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution);
+  SolverRunStatus getOperationStatusCode() {
+    return chains[last].solver->impl->getOperationStatusCode();
+  }
+  char *getConstraintLog(const Query &query) {
+    return solver->impl->getConstraintLog(query);
+  }
+  void setCoreSolverTimeout(time::Span timeout) {
+    for (const Chain &chain : chains)
+      chain.solver->impl->setCoreSolverTimeout(timeout);
+  }
+};
+
+/// Build the chain of the given optional layers over s.
+static Solver *buildChain(Solver *s, bool equalitySimplifier, bool fastCex,
+                          bool cexCache) {
+  Solver *solver = new Solver(new SharedSolver(s));
+  if (equalitySimplifier)
+    solver = createEqualitySimplifyingSolver(solver);
+  if (fastCex)
+    solver = createFastCexSolver(solver);
+  if (cexCache)
+    solver = createCexCachingSolver(solver);
+  return solver;
+}
+
+AdaptiveSolver::AdaptiveSolver(Solver *s) : solver(s) {
+  bool eq = UseEqualitySimplifier, fast = UseFastCexSolver, cex = UseCexCache;
+  chains.push_back({buildChain(s, eq, fast, cex), &stats::adaptiveDefaultChain});
+  chains.push_back(
+      {buildChain(s, eq, fast, !cex), &stats::adaptiveCexCacheToggled});
+  chains.push_back({buildChain(s, !eq, fast, cex),
+                    &stats::adaptiveEqualitySimplifierToggled});
+  chains.push_back(
+      {buildChain(s, eq, !fast, cex), &stats::adaptiveFastCexToggled});
+}
+
+AdaptiveSolver::~AdaptiveSolver() {
+  for (const Chain &chain : chains)
+    delete chain.solver;
+  delete solver;
+}
+
+uint32_t AdaptiveSolver::classify(const Query &query) {
+  uint64_t nodes = 0;
+  unsigned maxUpdates = 0;
+  std::vector<const Array *> arrays;
+  auto add = [&](const ref<Expr> &e) {
+    const ExprMetadata &md = e->getMetadata();
+    nodes = nodes > UINT64_MAX - md.size ? UINT64_MAX : nodes + md.size;
+    maxUpdates = std::max(maxUpdates, md.maxUpdates);
+    if (arrays.size() < 8)
+      arrays.insert(arrays.end(), md.arrays->begin(), md.arrays->end());
+  };
+  for (const ref<Expr> &c : query.constraints)
+    add(c);
+  add(query.expr);
+  std::sort(arrays.begin(), arrays.end());
+  unsigned numArrays =
+      std::unique(arrays.begin(), arrays.end()) - arrays.begin();
+
+  // a bucket of a few bits for each feature
+  uint32_t nodeBucket = std::min(llvm::Log2_64(nodes | 1) / 2, 15u);
+  uint32_t updateBucket = std::min(llvm::Log2_32(maxUpdates | 1), 7u);
+  uint32_t arrayBucket =
+      numArrays ? std::min(llvm::Log2_32(numArrays) + 1, 3u) : 0;
+  uint32_t factorBucket = std::min<uint32_t>(
+      llvm::Log2_64(query.constraintMgr.factor_size() | 1), 3u);
+  return nodeBucket | updateBucket << 4 | arrayBucket << 7 |
+         factorBucket << 9;
+}
+
+unsigned AdaptiveSolver::choose(Class &c) {
+  if (c.trials.empty())
+    c.trials.resize(chains.size());
+  ++c.queries;
+  auto leastTried =
+      std::min_element(c.trials.begin(), c.trials.end(),
+                       [](const Trials &a, const Trials &b) {
+                         return a.count < b.count;
+                       });
+  if (leastTried->count < MinTrials || c.queries % ExploreEvery == 0) {
+    ++stats::adaptiveExplorations;
+    return leastTried - c.trials.begin();
+  }
+  auto fastest = std::min_element(
+      c.trials.begin(), c.trials.end(), [](const Trials &a, const Trials &b) {
+        return a.seconds / a.count < b.seconds / b.count;
+      });
+  return fastest - c.trials.begin();
+}
+
+template <class F> bool AdaptiveSolver::solve(const Query &query, F f) {
+  Class &c = classes[classify(query)];
+  last = choose(c);
+  ++*chains[last].queries;
+
+  time::Point start = time::getWallTime();
+  bool success = f(*chains[last].solver);
+  double seconds = (time::getWallTime() - start).toSeconds();
+  // a failure, typically a timeout, counts twice its time
+  Trials &t = c.trials[last];
+  ++t.count;
+  t.seconds += success ? seconds : 2 * seconds;
+  return success;
+}
+
+bool AdaptiveSolver::computeValidity(const Query &query,
+                                     Solver::Validity &result) {
+  return solve(query, [&](Solver &s) {
+    return s.impl->computeValidity(query, result);
+  });
+}
+
+bool AdaptiveSolver::computeTruth(const Query &query, bool &isValid) {
+  return solve(query,
+               [&](Solver &s) { return s.impl->computeTruth(query, isValid); });
+}
+
+bool AdaptiveSolver::computeValue(const Query &query, ref<Expr> &result) {
+  return solve(query,
+               [&](Solver &s) { return s.impl->computeValue(query, result); });
+}
+
+bool AdaptiveSolver::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution) {
+  return solve(query, [&](Solver &s) {
+    return s.impl->computeInitialValues(query, objects, values, hasSolution);
+  });
+}
+
+} // namespace
+
+Solver *klee::createAdaptiveSolver(Solver *s) {
+  return new Solver(new AdaptiveSolver(s));
+}
@@ -0,0 +1,164 @@
+//===-- BinaryQueryLoggingSolver.cpp --------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Expr/BinaryQueryLog.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+#include "klee/Internal/Support/FileHandling.h"
+#include "klee/Internal/System/Time.h"
+#include "klee/Solver/Solver.h"
+#include "klee/Solver/SolverImpl.h"
+#include "klee/Statistics.h"
+
+#include "llvm/Support/raw_ostream.h"
+
+#include <memory>
+
+using namespace klee;
+
+namespace {
+/// Logs queries in the binary format of BinaryQueryLogWriter, which
+/// `kleaver -print-query-log` turns back into KQuery text. Like
+/// QueryLoggingSolver, it only logs queries taking longer than
+/// minQueryTimeToLog, and timed out queries if logTimedOut is set. Queries
+/// are serialized after they are solved, the ones not logged cost nothing.
+class BinaryQueryLoggingSolver : public SolverImpl {
+  Solver *solver;
+  std::unique_ptr<llvm::raw_fd_ostream> os;
+  BinaryQueryLogWriter writer;
+  std::string buffer;
+  time::Span minQueryTimeToLog;
+  bool logTimedOutQueries;
+  time::Point startTime;
+
+  void startQuery(LoggedQuery &q, LoggedQuery::Kind kind);
+  /// Log q if the query took long enough, filling in the parts of q taken
+  /// from the query only then.
+  void finishQuery(
+      LoggedQuery &q, const Query &query, bool success,
+      const std::vector<std::vector<unsigned char> > *values = nullptr);
+
+public:
+  BinaryQueryLoggingSolver(Solver *_solver, const std::string &path,
+                           time::Span queryTimeToLog, bool logTimedOut);
+  ~BinaryQueryLoggingSolver() { delete solver; }
+
+  bool computeTruth(const Query &query, bool &isValid);
+  bool computeValidity(const Query &query, Solver::Validity &result);
+  bool computeValue(const Query &query, ref<Expr> &result);
+  bool computeInitialValues(const Query &query,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution);
+  SolverRunStatus getOperationStatusCode() {
+    return solver->impl->getOperationStatusCode();
+  }
+  char *getConstraintLog(const Query &query) {
+    return solver->impl->getConstraintLog(query);
+  }
+  void setCoreSolverTimeout(time::Span timeout) {
+    solver->impl->setCoreSolverTimeout(timeout);
+  }
+};
+} // namespace
+
+BinaryQueryLoggingSolver::BinaryQueryLoggingSolver(Solver *_solver,
+                                                   const std::string &path,
+                                                   time::Span queryTimeToLog,
+                                                   bool logTimedOut)
+    : solver(_solver), minQueryTimeToLog(queryTimeToLog),
+      logTimedOutQueries(logTimedOut) {
+  std::string error;
+  os = klee_open_output_file(path, error);
+  if (!os)
+    klee_error("Could not open file %s : %s", path.c_str(), error.c_str());
+  os->write(BinaryQueryLog::Magic, sizeof(BinaryQueryLog::Magic));
+  assert(0 != solver);
+}
+
+void BinaryQueryLoggingSolver::startQuery(LoggedQuery &q,
+                                          LoggedQuery::Kind kind) {
+  Statistic *S = theStatisticManager->getStatisticByName("Instructions");
+  q.kind = kind;
+  q.instructions = S ? S->getValue() : 0;
+  startTime = time::getWallTime();
+}
+
+void BinaryQueryLoggingSolver::finishQuery(
+    LoggedQuery &q, const Query &query, bool success,
+    const std::vector<std::vector<unsigned char> > *values) {
+  time::Span duration = time::getWallTime() - startTime;
+  SolverRunStatus status = solver->impl->getOperationStatusCode();
+  bool writeToFile =
+      (!minQueryTimeToLog) || (duration > minQueryTimeToLog) ||
+      (logTimedOutQueries && SOLVER_RUN_STATUS_TIMEOUT == status);
+  if (!writeToFile)
+    return;
+
+  q.constraints.assign(query.constraints.begin(), query.constraints.end());
+  q.expr = query.expr;
+  if (values && success && q.hasSolution)
+    q.values = *values;
+  q.success = success;
+  q.status = status;
+  q.elapsedMicroseconds = duration.toMicroseconds();
+  writer.write(q, buffer);
+  os->write(buffer.data(), buffer.size());
+  buffer.clear();
+}
+
+bool BinaryQueryLoggingSolver::computeTruth(const Query &query,
+                                             bool &isValid) {
+  LoggedQuery q;
+  startQuery(q, LoggedQuery::Truth);
+  bool success = solver->impl->computeTruth(query, isValid);
+  q.isValid = isValid;
+  finishQuery(q, query, success);
+  return success;
+}
+
+bool BinaryQueryLoggingSolver::computeValidity(const Query &query,
+                                                Solver::Validity &result) {
+  LoggedQuery q;
+  startQuery(q, LoggedQuery::Validity);
+  bool success = solver->impl->computeValidity(query, result);
+  q.validity = result;
+  finishQuery(q, query, success);
+  return success;
+}
+
+bool BinaryQueryLoggingSolver::computeValue(const Query &query,
+                                             ref<Expr> &result) {
+  LoggedQuery q;
+  startQuery(q, LoggedQuery::Value);
+  bool success = solver->impl->computeValue(query, result);
+  q.value = result;
+  finishQuery(q, query, success);
+  return success;
+}
+
+bool BinaryQueryLoggingSolver::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution) {
+  LoggedQuery q;
+  startQuery(q, LoggedQuery::InitialValues);
+  bool success =
+      solver->impl->computeInitialValues(query, objects, values, hasSolution);
+  q.hasSolution = hasSolution;
+  q.objects = objects;
+  finishQuery(q, query, success, &values);
+  return success;
+}
+
+Solver *klee::createBinaryQueryLoggingSolver(Solver *_solver, std::string path,
+                                             time::Span minQueryTimeToLog,
+                                             bool logTimedOut) {
+  return new Solver(new BinaryQueryLoggingSolver(_solver, path,
+                                                 minQueryTimeToLog,
+                                                 logTimedOut));
+}
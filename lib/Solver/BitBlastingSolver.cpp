@@ -0,0 +1,728 @@
+//===-- BitBlastingSolver.cpp - Solve bit-level queries with CaDiCaL ------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Answers the queries that need no array theory with a SAT solver. Queries of
+// parsers mostly read single bytes of an input at concrete indices and combine
+// them with bitwise operations, comparisons and small constants; they are
+// bit-blasted into an and-inverter graph, in which equal gates are shared and
+// gates with constant or complementary inputs are folded away, and the graph
+// is encoded into CNF with the Plaisted-Greenbaum encoding, which only emits
+// the clauses of the polarity a gate is used with. CaDiCaL then simplifies the
+// CNF further while it solves it. Queries with a symbolic read index, a
+// division, or a graph larger than MaxNodes are passed to the underlying
+// solver unchanged.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Config/config.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+#include "klee/Solver/Solver.h"
+
+#ifdef ENABLE_CADICAL
+
+#include "klee/Expr/Assignment.h"
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/Expr.h"
+#include "klee/Expr/ExprHashMap.h"
+#include "klee/Expr/ExprUtil.h"
+#include "klee/Internal/System/Time.h"
+#include "klee/Solver/SolverImpl.h"
+#include "klee/Solver/SolverStats.h"
+
+#include "cadical.hpp"
+
+#include <cassert>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+/// A literal of an and-inverter graph: twice the index of its node, plus one
+/// if it is negated. Node 0 is the constant false.
+typedef uint32_t AigLit;
+const AigLit AigFalse = 0, AigTrue = 1;
+
+/// The bits of an expression, least significant first
+typedef std::vector<AigLit> Bits;
+
+/// Larger graphs are left to the underlying solver, which copes better with
+/// wide arithmetic.
+const size_t MaxNodes = 1u << 22;
+
+class AndInverterGraph {
+  struct Node {
+    /// the inputs of an and gate, both AigFalse for a primary input
+    AigLit left, right;
+  };
+  std::vector<Node> nodes;
+  /// the and gates by their inputs, so that each is built once
+  std::unordered_map<uint64_t, AigLit> gates;
+
+public:
+  AndInverterGraph() : nodes(1, Node{AigFalse, AigFalse}) {}
+
+  size_t size() const { return nodes.size(); }
+  bool isGate(uint32_t node) const { return nodes[node].left != AigFalse; }
+  AigLit getLeft(uint32_t node) const { return nodes[node].left; }
+  AigLit getRight(uint32_t node) const { return nodes[node].right; }
+
+  AigLit mkInput() {
+    nodes.push_back(Node{AigFalse, AigFalse});
+    return 2 * (nodes.size() - 1);
+  }
+
+  AigLit mkAnd(AigLit a, AigLit b) {
+    if (a > b)
+      std::swap(a, b);
+    if (a == AigFalse || a == (b ^ 1))
+      return AigFalse;
+    if (a == AigTrue || a == b)
+      return b;
+    auto res = gates.emplace((uint64_t(a) << 32) | b, 0);
+    if (res.second) {
+      nodes.push_back(Node{a, b});
+      res.first->second = 2 * (nodes.size() - 1);
+    }
+    return res.first->second;
+  }
+
+  AigLit mkOr(AigLit a, AigLit b) { return mkAnd(a ^ 1, b ^ 1) ^ 1; }
+
+  AigLit mkXor(AigLit a, AigLit b) {
+    return mkOr(mkAnd(a, b ^ 1), mkAnd(a ^ 1, b));
+  }
+
+  AigLit mkIte(AigLit c, AigLit t, AigLit e) {
+    if (t == e)
+      return t;
+    return mkOr(mkAnd(c, t), mkAnd(c ^ 1, e));
+  }
+};
+
+/// Translates expressions into the bits of an and-inverter graph.
+class BitBlaster {
+  AndInverterGraph &aig;
+  ExprHashMap<Bits> cache;
+  /// the bits of the bytes of the symbolic arrays, created as they are read
+  std::unordered_map<const Array *, std::vector<Bits> > arrays;
+
+  bool blastRead(const ReadExpr *re, Bits &out);
+  void add(const Bits &a, const Bits &b, AigLit carry, Bits &out);
+  void mul(const Bits &a, const Bits &b, Bits &out);
+  void shift(const Bits &a, const Bits &amount, Expr::Kind kind, Bits &out);
+  AigLit eq(const Bits &a, const Bits &b);
+  AigLit ult(const Bits &a, const Bits &b, bool orEqual);
+  AigLit slt(const Bits &a, const Bits &b, bool orEqual);
+
+public:
+  BitBlaster(AndInverterGraph &_aig) : aig(_aig) {}
+
+  /// \return the bits of e, or nullptr if e cannot be blasted
+  const Bits *blast(const ref<Expr> &e);
+
+  /// \return the bits of a byte of a symbolic array, or nullptr if no
+  /// blasted expression reads it
+  const Bits *getInput(const Array *array, unsigned index) const;
+};
+
+const Bits *BitBlaster::getInput(const Array *array, unsigned index) const {
+  auto it = arrays.find(array);
+  if (it == arrays.end() || it->second[index].empty())
+    return nullptr;
+  return &it->second[index];
+}
+
+bool BitBlaster::blastRead(const ReadExpr *re, Bits &out) {
+  const ConstantExpr *index = dyn_cast<ConstantExpr>(re->index);
+  const Array *root = re->updates.root;
+  if (!index || index->getZExtValue() >= root->size)
+    return false;
+  uint64_t i = index->getZExtValue();
+
+  // the updates that may write the byte, from the latest
+  std::vector<std::pair<AigLit, const Bits *> > writes;
+  const Bits *base = nullptr;
+  for (const UpdateNode *un = re->updates.head.get(); un; un = un->next.get()) {
+    const Bits *value = blast(un->value);
+    if (!value)
+      return false;
+    if (const ConstantExpr *ui = dyn_cast<ConstantExpr>(un->index)) {
+      if (ui->getZExtValue() == i) {
+        base = value;
+        break;
+      }
+      continue;
+    }
+    const Bits *ui = blast(un->index);
+    if (!ui)
+      return false;
+    Bits bi;
+    for (unsigned b = 0; b < ui->size(); ++b)
+      bi.push_back((i >> b) & 1 ? AigTrue : AigFalse);
+    writes.emplace_back(eq(*ui, bi), value);
+  }
+
+  if (!base) {
+    if (root->isConstantArray()) {
+      Bits value;
+      const llvm::APInt &v = root->constantValues[i]->getAPValue();
+      for (unsigned b = 0; b < root->getRange(); ++b)
+        value.push_back(v[b] ? AigTrue : AigFalse);
+      out = value;
+    } else {
+      std::vector<Bits> &bytes = arrays[root];
+      bytes.resize(root->size);
+      if (bytes[i].empty())
+        for (unsigned b = 0; b < root->getRange(); ++b)
+          bytes[i].push_back(aig.mkInput());
+      out = bytes[i];
+    }
+  } else {
+    out = *base;
+  }
+  for (auto it = writes.rbegin(), ie = writes.rend(); it != ie; ++it)
+    for (unsigned b = 0; b < out.size(); ++b)
+      out[b] = aig.mkIte(it->first, (*it->second)[b], out[b]);
+  return true;
+}
+
+void BitBlaster::add(const Bits &a, const Bits &b, AigLit carry, Bits &out) {
+  out.resize(a.size());
+  for (unsigned i = 0; i < a.size(); ++i) {
+    AigLit x = aig.mkXor(a[i], b[i]);
+    out[i] = aig.mkXor(x, carry);
+    carry = aig.mkOr(aig.mkAnd(a[i], b[i]), aig.mkAnd(x, carry));
+  }
+}
+
+void BitBlaster::mul(const Bits &a, const Bits &b, Bits &out) {
+  out.assign(a.size(), AigFalse);
+  for (unsigned i = 0; i < b.size(); ++i) {
+    if (b[i] == AigFalse)
+      continue;
+    Bits partial(a.size(), AigFalse);
+    for (unsigned j = 0; i + j < a.size(); ++j)
+      partial[i + j] = aig.mkAnd(a[j], b[i]);
+    Bits sum;
+    add(out, partial, AigFalse, sum);
+    out.swap(sum);
+  }
+}
+
+void BitBlaster::shift(const Bits &a, const Bits &amount, Expr::Kind kind,
+                       Bits &out) {
+  unsigned width = a.size();
+  AigLit fill = kind == Expr::AShr ? a.back() : AigFalse;
+  out = a;
+  // a barrel shifter over the bits of the amount below the width, as amounts
+  // of at least the width shift all the bits out
+  AigLit tooLarge = AigFalse;
+  for (unsigned s = 0; s < amount.size(); ++s) {
+    if (s >= 32 || (1ull << s) >= width) {
+      tooLarge = aig.mkOr(tooLarge, amount[s]);
+      continue;
+    }
+    unsigned by = 1u << s;
+    Bits shifted(width);
+    for (unsigned i = 0; i < width; ++i) {
+      AigLit moved;
+      if (kind == Expr::Shl)
+        moved = i >= by ? out[i - by] : AigFalse;
+      else
+        moved = i + by < width ? out[i + by] : fill;
+      shifted[i] = aig.mkIte(amount[s], moved, out[i]);
+    }
+    out.swap(shifted);
+  }
+  for (unsigned i = 0; i < width; ++i)
+    out[i] = aig.mkIte(tooLarge, fill, out[i]);
+}
+
+AigLit BitBlaster::eq(const Bits &a, const Bits &b) {
+  AigLit res = AigTrue;
+  for (unsigned i = 0; i < a.size(); ++i)
+    res = aig.mkAnd(res, aig.mkXor(a[i], b[i]) ^ 1);
+  return res;
+}
+
+AigLit BitBlaster::ult(const Bits &a, const Bits &b, bool orEqual) {
+  // from the least significant bit up, whether the low bits of a are less
+  // than (or equal to) those of b
+  AigLit res = orEqual ? AigTrue : AigFalse;
+  for (unsigned i = 0; i < a.size(); ++i) {
+    AigLit differ = aig.mkXor(a[i], b[i]);
+    res = aig.mkIte(differ, b[i], res);
+  }
+  return res;
+}
+
+AigLit BitBlaster::slt(const Bits &a, const Bits &b, bool orEqual) {
+  // a signed comparison is the unsigned one with the sign bits flipped
+  Bits fa = a, fb = b;
+  fa.back() ^= 1;
+  fb.back() ^= 1;
+  return ult(fa, fb, orEqual);
+}
+
+const Bits *BitBlaster::blast(const ref<Expr> &e) {
+  auto it = cache.find(e);
+  if (it != cache.end())
+    return &it->second;
+  if (aig.size() > MaxNodes)
+    return nullptr;
+
+  Bits out;
+  Expr::Width width = e->getWidth();
+  switch (e->getKind()) {
+  case Expr::Constant: {
+    const llvm::APInt &v = cast<ConstantExpr>(e)->getAPValue();
+    for (unsigned i = 0; i < width; ++i)
+      out.push_back(v[i] ? AigTrue : AigFalse);
+    break;
+  }
+  case Expr::Read:
+    if (!blastRead(cast<ReadExpr>(e), out))
+      return nullptr;
+    break;
+  case Expr::Select: {
+    const SelectExpr *se = cast<SelectExpr>(e);
+    const Bits *c = blast(se->cond), *t = blast(se->trueExpr),
+               *f = blast(se->falseExpr);
+    if (!c || !t || !f)
+      return nullptr;
+    for (unsigned i = 0; i < width; ++i)
+      out.push_back(aig.mkIte((*c)[0], (*t)[i], (*f)[i]));
+    break;
+  }
+  case Expr::Extract: {
+    const ExtractExpr *ee = cast<ExtractExpr>(e);
+    const Bits *src = blast(ee->expr);
+    if (!src)
+      return nullptr;
+    out.assign(src->begin() + ee->offset, src->begin() + ee->offset + width);
+    break;
+  }
+  case Expr::ZExt:
+  case Expr::SExt: {
+    const Bits *src = blast(cast<CastExpr>(e)->src);
+    if (!src)
+      return nullptr;
+    out = *src;
+    out.resize(width, e->getKind() == Expr::SExt ? src->back() : AigFalse);
+    break;
+  }
+  case Expr::NotOptimized: {
+    const Bits *src = blast(cast<NotOptimizedExpr>(e)->src);
+    if (!src)
+      return nullptr;
+    out = *src;
+    break;
+  }
+  case Expr::Not: {
+    const Bits *src = blast(cast<NotExpr>(e)->expr);
+    if (!src)
+      return nullptr;
+    for (AigLit b : *src)
+      out.push_back(b ^ 1);
+    break;
+  }
+  case Expr::Concat:
+  case Expr::And:
+  case Expr::Or:
+  case Expr::Xor:
+  case Expr::Add:
+  case Expr::Sub:
+  case Expr::Mul:
+  case Expr::Shl:
+  case Expr::LShr:
+  case Expr::AShr:
+  case Expr::Eq:
+  case Expr::Ne:
+  case Expr::Ult:
+  case Expr::Ule:
+  case Expr::Ugt:
+  case Expr::Uge:
+  case Expr::Slt:
+  case Expr::Sle:
+  case Expr::Sgt:
+  case Expr::Sge: {
+    const Bits *left = blast(e->getKid(0));
+    const Bits *right = left ? blast(e->getKid(1)) : nullptr;
+    if (!right)
+      return nullptr;
+    const Bits &a = *left, &b = *right;
+    switch (e->getKind()) {
+    case Expr::Concat:
+      // the left kid holds the most significant bits
+      out = b;
+      out.insert(out.end(), a.begin(), a.end());
+      break;
+    case Expr::And:
+    case Expr::Or:
+    case Expr::Xor:
+      for (unsigned i = 0; i < width; ++i)
+        out.push_back(e->getKind() == Expr::And  ? aig.mkAnd(a[i], b[i])
+                      : e->getKind() == Expr::Or ? aig.mkOr(a[i], b[i])
+                                                 : aig.mkXor(a[i], b[i]));
+      break;
+    case Expr::Add:
+      add(a, b, AigFalse, out);
+      break;
+    case Expr::Sub: {
+      Bits nb;
+      for (AigLit l : b)
+        nb.push_back(l ^ 1);
+      add(a, nb, AigTrue, out);
+      break;
+    }
+    case Expr::Mul:
+      mul(a, b, out);
+      break;
+    case Expr::Shl:
+    case Expr::LShr:
+    case Expr::AShr:
+      shift(a, b, e->getKind(), out);
+      break;
+    case Expr::Eq:
+      out.push_back(eq(a, b));
+      break;
+    case Expr::Ne:
+      out.push_back(eq(a, b) ^ 1);
+      break;
+    case Expr::Ult:
+      out.push_back(ult(a, b, false));
+      break;
+    case Expr::Ule:
+      out.push_back(ult(a, b, true));
+      break;
+    case Expr::Ugt:
+      out.push_back(ult(b, a, false));
+      break;
+    case Expr::Uge:
+      out.push_back(ult(b, a, true));
+      break;
+    case Expr::Slt:
+      out.push_back(slt(a, b, false));
+      break;
+    case Expr::Sle:
+      out.push_back(slt(a, b, true));
+      break;
+    case Expr::Sgt:
+      out.push_back(slt(b, a, false));
+      break;
+    case Expr::Sge:
+      out.push_back(slt(b, a, true));
+      break;
+    default:
+      assert(0 && "unhandled binary expression");
+    }
+    break;
+  }
+  default:
+    // divisions and remainders
+    return nullptr;
+  }
+  assert(out.size() == width && "blasted to the wrong width");
+  return &cache.emplace(e, std::move(out)).first->second;
+}
+
+/// Stops CaDiCaL once the core solver timeout has passed.
+class Deadline : public CaDiCaL::Terminator {
+  time::Point end;
+
+public:
+  Deadline(time::Span timeout)
+      : end(timeout ? time::getWallTime() + timeout : time::Point()) {}
+  bool terminate() { return end != time::Point() && time::getWallTime() >= end; }
+};
+
+/// The CNF of the constraints of one query.
+class BlastedQuery {
+  AndInverterGraph aig;
+  BitBlaster blaster;
+  CaDiCaL::Solver sat;
+  /// bit 0: the node is encoded as implying its inputs, bit 1: as implied by
+  /// them
+  std::vector<uint8_t> polarities;
+  /// whether a constraint is false
+  bool inconsistent = false;
+
+  static int toDimacs(AigLit l) {
+    int var = l >> 1;
+    return l & 1 ? -var : var;
+  }
+  void encode(AigLit l);
+
+public:
+  BlastedQuery() : blaster(aig) {}
+
+  /// \return false if a constraint cannot be blasted
+  bool addConstraints(const Constraints_ty &constraints);
+  /// \return the literal of the boolean e, encoded with both polarities, or
+  /// false if e cannot be blasted
+  bool addExpr(const ref<Expr> &e, AigLit &lit);
+
+  /// Solve the constraints, assuming lit if it is not AigTrue.
+  /// \return false on a timeout
+  bool solve(AigLit assumption, time::Span timeout, bool &hasSolution);
+
+  /// Read the value of array from the last model.
+  std::vector<unsigned char> getValues(const Array *array);
+};
+
+void BlastedQuery::encode(AigLit root) {
+  std::vector<AigLit> stack(1, root);
+  while (!stack.empty()) {
+    AigLit l = stack.back();
+    stack.pop_back();
+    uint32_t node = l >> 1;
+    uint8_t polarity = l & 1 ? 2 : 1;
+    if (node >= polarities.size())
+      polarities.resize(aig.size());
+    if (polarities[node] & polarity)
+      continue;
+    polarities[node] |= polarity;
+    if (!aig.isGate(node))
+      continue;
+    AigLit left = aig.getLeft(node), right = aig.getRight(node);
+    if (polarity == 1) {
+      // node -> left & right
+      sat.add(-toDimacs(l));
+      sat.add(toDimacs(left));
+      sat.add(0);
+      sat.add(-toDimacs(l));
+      sat.add(toDimacs(right));
+      sat.add(0);
+      stack.push_back(left);
+      stack.push_back(right);
+    } else {
+      // left & right -> node
+      sat.add(toDimacs(l ^ 1));
+      sat.add(-toDimacs(left));
+      sat.add(-toDimacs(right));
+      sat.add(0);
+      stack.push_back(left ^ 1);
+      stack.push_back(right ^ 1);
+    }
+  }
+}
+
+bool BlastedQuery::addConstraints(const Constraints_ty &constraints) {
+  for (const ref<Expr> &c : constraints) {
+    const Bits *bits = blaster.blast(c);
+    if (!bits)
+      return false;
+    AigLit l = (*bits)[0];
+    if (l == AigTrue)
+      continue;
+    if (l == AigFalse) {
+      inconsistent = true;
+      continue;
+    }
+    encode(l);
+    sat.add(toDimacs(l));
+    sat.add(0);
+  }
+  return true;
+}
+
+bool BlastedQuery::addExpr(const ref<Expr> &e, AigLit &lit) {
+  const Bits *bits = blaster.blast(e);
+  if (!bits)
+    return false;
+  lit = (*bits)[0];
+  if (lit != AigTrue && lit != AigFalse) {
+    encode(lit);
+    encode(lit ^ 1);
+  }
+  return true;
+}
+
+bool BlastedQuery::solve(AigLit assumption, time::Span timeout,
+                         bool &hasSolution) {
+  if (inconsistent || assumption == AigFalse) {
+    hasSolution = false;
+    return true;
+  }
+  if (assumption != AigTrue)
+    sat.assume(toDimacs(assumption));
+  Deadline deadline(timeout);
+  sat.connect_terminator(&deadline);
+  int res = sat.solve();
+  sat.disconnect_terminator();
+  hasSolution = res == 10;
+  return res != 0;
+}
+
+std::vector<unsigned char> BlastedQuery::getValues(const Array *array) {
+  std::vector<unsigned char> values(array->size, 0);
+  for (unsigned i = 0; i < array->size; ++i) {
+    const Bits *bits = blaster.getInput(array, i);
+    if (!bits)
+      continue;
+    for (unsigned b = 0; b < bits->size() && b < 8; ++b) {
+      uint32_t node = (*bits)[b] >> 1;
+      // inputs outside the encoded cone take any value
+      if (node < polarities.size() && polarities[node] &&
+          sat.val(toDimacs((*bits)[b])) > 0)
+        values[i] |= 1 << b;
+    }
+  }
+  return values;
+}
+
+class BitBlastingSolver : public SolverImpl {
+  Solver *solver;
+  time::Span timeout;
+  SolverRunStatus runStatusCode = SOLVER_RUN_STATUS_FAILURE;
+  /// whether the last query was answered by CaDiCaL
+  bool answered = false;
+
+  /// Blast the constraints of query and e, which may be null.
+  /// \return false if the query is left to the underlying solver
+  bool blast(const Query &query, const ref<Expr> &e, BlastedQuery &bq,
+             AigLit &lit);
+  bool solve(BlastedQuery &bq, AigLit assumption, bool &hasSolution);
+
+public:
+  BitBlastingSolver(Solver *_solver) : solver(_solver) {}
+  ~BitBlastingSolver() { delete solver; }
+
+  bool computeValidity(const Query &, Solver::Validity &result);
+  bool computeTruth(const Query &, bool &isValid);
+  bool computeValue(const Query &, ref<Expr> &result);
+  bool computeInitialValues(const Query &,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution);
+  SolverRunStatus getOperationStatusCode() {
+    return answered ? runStatusCode : solver->impl->getOperationStatusCode();
+  }
+  char *getConstraintLog(const Query &query) {
+    return solver->impl->getConstraintLog(query);
+  }
+  void setCoreSolverTimeout(time::Span _timeout) {
+    timeout = _timeout;
+    solver->impl->setCoreSolverTimeout(_timeout);
+  }
+};
+
+bool BitBlastingSolver::blast(const Query &query, const ref<Expr> &e,
+                              BlastedQuery &bq, AigLit &lit) {
+  answered = false;
+  lit = AigTrue;
+  if (!bq.addConstraints(query.constraints) || (!e.isNull() && !bq.addExpr(e, lit)))
+    return false;
+  answered = true;
+  ++stats::queriesBitBlasted;
+  return true;
+}
+
+bool BitBlastingSolver::solve(BlastedQuery &bq, AigLit assumption,
+                              bool &hasSolution) {
+  if (!bq.solve(assumption, timeout, hasSolution)) {
+    runStatusCode = SOLVER_RUN_STATUS_TIMEOUT;
+    return false;
+  }
+  runStatusCode = hasSolution ? SOLVER_RUN_STATUS_SUCCESS_SOLVABLE
+                              : SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE;
+  return true;
+}
+
+bool BitBlastingSolver::computeValidity(const Query &query,
+                                        Solver::Validity &result) {
+  BlastedQuery bq;
+  AigLit lit;
+  if (!blast(query, query.expr, bq, lit))
+    return solver->impl->computeValidity(query, result);
+  bool canBeFalse, canBeTrue;
+  if (!solve(bq, lit ^ 1, canBeFalse))
+    return false;
+  if (!canBeFalse) {
+    result = Solver::True;
+    return true;
+  }
+  if (!solve(bq, lit, canBeTrue))
+    return false;
+  result = canBeTrue ? Solver::Unknown : Solver::False;
+  return true;
+}
+
+bool BitBlastingSolver::computeTruth(const Query &query, bool &isValid) {
+  BlastedQuery bq;
+  AigLit lit;
+  if (!blast(query, query.expr, bq, lit))
+    return solver->impl->computeTruth(query, isValid);
+  bool canBeFalse;
+  if (!solve(bq, lit ^ 1, canBeFalse))
+    return false;
+  isValid = !canBeFalse;
+  return true;
+}
+
+bool BitBlastingSolver::computeValue(const Query &query, ref<Expr> &result) {
+  // only the constraints are blasted, the expression is evaluated in a model
+  BlastedQuery bq;
+  AigLit lit;
+  if (!blast(query, ref<Expr>(), bq, lit))
+    return solver->impl->computeValue(query, result);
+  bool hasSolution;
+  if (!solve(bq, AigTrue, hasSolution))
+    return false;
+  if (!hasSolution) {
+    // mirrors the core solvers, which are only asked for values of
+    // satisfiable constraints
+    runStatusCode = SOLVER_RUN_STATUS_FAILURE;
+    return false;
+  }
+  std::vector<const Array *> objects;
+  findSymbolicObjects(query.expr, objects);
+  std::vector<std::vector<unsigned char> > values;
+  for (const Array *array : objects)
+    values.push_back(bq.getValues(array));
+  result = Assignment(objects, values).evaluate(query.expr);
+  return true;
+}
+
+bool BitBlastingSolver::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution) {
+  BlastedQuery bq;
+  AigLit lit;
+  if (!blast(query, query.expr, bq, lit))
+    return solver->impl->computeInitialValues(query, objects, values,
+                                              hasSolution);
+  if (!solve(bq, lit ^ 1, hasSolution))
+    return false;
+  if (hasSolution)
+    for (const Array *array : objects)
+      values.push_back(bq.getValues(array));
+  return true;
+}
+
+} // namespace
+
+Solver *klee::createBitBlastingSolver(Solver *s) {
+  return new Solver(new BitBlastingSolver(s));
+}
+
+#else
+
+using namespace klee;
+
+Solver *klee::createBitBlastingSolver(Solver *s) {
+  klee_warning("Not compiled with CaDiCaL support, ignoring "
+               "-use-sat-bitblaster");
+  return s;
+}
+
+#endif // ENABLE_CADICAL
@@ -31,35 +31,32 @@ private:
   bool cacheLookup(const Query& query,
                    IncompleteSolver::PartialValidity &result);
   
-  struct CacheEntry {
-    CacheEntry(const Constraints_ty &c, ref<Expr> q)
-      : constraints(c), query(q) {}
-
-    CacheEntry(const CacheEntry &ce)
-      : constraints(ce.constraints), query(ce.query) {}
-    
-    Constraints_ty constraints;
+  /// Found without visiting the constraints of the query: they are only
+  /// compared with those of the entries of the same key.
+  struct CacheKey {
+    uint64_t fingerprint;
+    size_t numConstraints;
     ref<Expr> query;
 
-    bool operator==(const CacheEntry &b) const {
-      return constraints==b.constraints && *query.get()==*b.query.get();
+    bool operator==(const CacheKey &b) const {
+      return fingerprint == b.fingerprint &&
+             numConstraints == b.numConstraints &&
+             *query.get() == *b.query.get();
     }
   };
 
-  struct CacheEntryHash {
-    unsigned operator()(const CacheEntry &ce) const {
-      unsigned result = ce.query->hash();
-
-      for (auto const &constraint : ce.constraints) {
-        result ^= constraint->hash();
-      }
-
-      return result;
+  struct CacheKeyHash {
+    size_t operator()(const CacheKey &key) const {
+      return key.fingerprint ^ (key.query->hash() * 0x9e3779b97f4a7c15ULL);
     }
   };
 
-  typedef std::unordered_map<CacheEntry, IncompleteSolver::PartialValidity,
-                             CacheEntryHash>
+  struct CacheEntry {
+    Constraints_ty constraints;
+    IncompleteSolver::PartialValidity result;
+  };
+
+  typedef std::unordered_multimap<CacheKey, CacheEntry, CacheKeyHash>
       cache_map;
 
   Solver *solver;
@@ -71,6 +68,9 @@ public:
 
   bool computeValidity(const Query&, Solver::Validity &result);
   bool computeTruth(const Query&, bool &isValid);
+  bool computeTruthBatch(const Query &query,
+                         const std::vector<ref<Expr> > &exprs,
+                         std::vector<bool> &isValid);
   bool computeValue(const Query& query, ref<Expr> &result) {
     ++stats::queryCacheMisses;
     return solver->impl->computeValue(query, result);
@@ -112,13 +112,15 @@ bool CachingSolver::cacheLookup(const Query& query,
   bool negationUsed;
   ref<Expr> canonicalQuery = canonicalizeQuery(query.expr, negationUsed);
 
-  CacheEntry ce(query.constraints, canonicalQuery);
-  cache_map::iterator it = cache.find(ce);
-  
-  if (it != cache.end()) {
+  CacheKey key{query.getFingerprint(), query.constraints.size(),
+               canonicalQuery};
+  auto range = cache.equal_range(key);
+  for (cache_map::iterator it = range.first; it != range.second; ++it) {
+    if (it->second.constraints != query.constraints)
+      continue;
     result = (negationUsed ?
-              IncompleteSolver::negatePartialValidity(it->second) :
-              it->second);
+              IncompleteSolver::negatePartialValidity(it->second.result) :
+              it->second.result);
     return true;
   }
   
@@ -131,11 +133,12 @@ void CachingSolver::cacheInsert(const Query& query,
   bool negationUsed;
   ref<Expr> canonicalQuery = canonicalizeQuery(query.expr, negationUsed);
 
-  CacheEntry ce(query.constraints, canonicalQuery);
+  CacheKey key{query.getFingerprint(), query.constraints.size(),
+               canonicalQuery};
   IncompleteSolver::PartialValidity cachedResult = 
     (negationUsed ? IncompleteSolver::negatePartialValidity(result) : result);
   
-  cache.insert(std::make_pair(ce, cachedResult));
+  cache.emplace(std::move(key), CacheEntry{query.constraints, cachedResult});
 }
 
 bool CachingSolver::computeValidity(const Query& query,
@@ -241,6 +244,50 @@ bool CachingSolver::computeTruth(const Query& query,
   return true;
 }
 
+bool CachingSolver::computeTruthBatch(const Query &query,
+                                      const std::vector<ref<Expr> > &exprs,
+                                      std::vector<bool> &isValid) {
+  isValid.assign(exprs.size(), false);
+  std::vector<ref<Expr> > missed;
+  std::vector<unsigned> positions;
+  std::vector<bool> hits;
+  for (unsigned i = 0; i < exprs.size(); ++i) {
+    IncompleteSolver::PartialValidity cachedResult;
+    bool cacheHit = cacheLookup(query.withExpr(exprs[i]), cachedResult);
+    if (cacheHit && cachedResult != IncompleteSolver::MayBeTrue) {
+      ++stats::queryCacheHits;
+      isValid[i] = (cachedResult == IncompleteSolver::MustBeTrue);
+      continue;
+    }
+    ++stats::queryCacheMisses;
+    missed.push_back(exprs[i]);
+    positions.push_back(i);
+    hits.push_back(cacheHit);
+  }
+  if (missed.empty())
+    return true;
+
+  // the cache misses go to the solver together
+  std::vector<bool> missedIsValid;
+  if (!solver->impl->computeTruthBatch(query, missed, missedIsValid))
+    return false;
+
+  for (unsigned i = 0; i < missed.size(); ++i) {
+    IncompleteSolver::PartialValidity cachedResult;
+    if (missedIsValid[i]) {
+      cachedResult = IncompleteSolver::MustBeTrue;
+    } else if (hits[i]) {
+      // as in computeTruth, a cached MayBeTrue becomes TrueOrFalse
+      cachedResult = IncompleteSolver::TrueOrFalse;
+    } else {
+      cachedResult = IncompleteSolver::MayBeFalse;
+    }
+    cacheInsert(query.withExpr(missed[i]), cachedResult);
+    isValid[positions[i]] = missedIsValid[i];
+  }
+  return true;
+}
+
 SolverImpl::SolverRunStatus CachingSolver::getOperationStatusCode() {
   return solver->impl->getOperationStatusCode();
 }
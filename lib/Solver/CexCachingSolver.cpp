@@ -9,13 +9,16 @@
 
 #include "klee/Solver/Solver.h"
 
+#include "klee/Config/Version.h"
 #include "klee/Expr/Assignment.h"
 #include "klee/Expr/Constraints.h"
 #include "klee/Expr/Expr.h"
 #include "klee/Expr/ExprUtil.h"
 #include "klee/Expr/ExprVisitor.h"
 #include "klee/Internal/ADT/MapOfSets.h"
+#include "klee/Internal/ADT/SignatureSetIndex.h"
 #include "klee/Internal/Support/ErrorHandling.h"
+#include "klee/Internal/System/MemoryUsage.h"
 #include "klee/OptionCategories.h"
 #include "klee/Solver/SolverImpl.h"
 #include "klee/Solver/SolverStats.h"
@@ -23,6 +26,8 @@
 
 #include "llvm/Support/CommandLine.h"
 
+#include <deque>
+
 using namespace klee;
 namespace cl=llvm::cl;
 
@@ -50,12 +55,44 @@ cl::opt<bool> CexCacheExperimental(
     cl::desc("Optimization for validity queries (default=false)"),
     cl::cat(SolvingCat));
 
+enum class CexCacheIndexKind { UBTree, Signature };
+
+cl::opt<CexCacheIndexKind> CexCacheIndex(
+    "cex-cache-index",
+    cl::desc("Index used to find cached subsets and supersets of a query "
+             "(default=ubtree)"),
+    cl::values(clEnumValN(CexCacheIndexKind::UBTree, "ubtree",
+                          "Prefix tree over the sorted constraints, exact "
+                          "but may visit large parts of the cache"),
+               clEnumValN(CexCacheIndexKind::Signature, "signature",
+                          "Bloom signature per entry checked before the "
+                          "sets, scans at most -cex-cache-max-probes "
+                          "recent entries")
+                   KLEE_LLVM_CL_VAL_END),
+    cl::init(CexCacheIndexKind::UBTree), cl::cat(SolvingCat));
+
+cl::opt<unsigned> CexCacheMaxProbes(
+    "cex-cache-max-probes", cl::init(4096),
+    cl::desc("Entries the signature index scans per subset or superset "
+             "lookup, 0 for no limit (default=4096)"),
+    cl::cat(SolvingCat));
+
+cl::opt<unsigned> CexCacheMaxEntries(
+    "cex-cache-max-entries", cl::init(0),
+    cl::desc("Evict the oldest counterexample cache entries beyond this "
+             "number, 0 for no limit (default=0)"),
+    cl::cat(SolvingCat));
+
 } // namespace
 
 ///
 
 typedef std::set< ref<Expr> > KeyType;
 
+struct ExprHashFn {
+  size_t operator()(const ref<Expr> &e) const { return e->hash(); }
+};
+
 struct AssignmentLessThan {
   bool operator()(const Assignment *a, const Assignment *b) const {
     return a->bindings < b->bindings;
@@ -69,8 +106,34 @@ class CexCachingSolver : public SolverImpl {
   Solver *solver;
   
   MapOfSets<ref<Expr>, Assignment*> cache;
+  SignatureSetIndex<ref<Expr>, Assignment*, ExprHashFn> signatureCache;
   // memo table
   assignmentsTable_ty assignmentsTable;
+  // with a bounded cache: keys in insertion order and the number of cache
+  // entries referring to each assignment
+  std::deque<KeyType> insertionOrder;
+  std::unordered_map<Assignment*, unsigned> assignmentUses;
+
+  Assignment **cacheLookup(const KeyType &key) {
+    if (CexCacheIndex == CexCacheIndexKind::Signature)
+      return signatureCache.lookup(key);
+    return cache.lookup(key);
+  }
+  template<class Predicate>
+  Assignment **cacheFindSuperset(const KeyType &key, const Predicate &p) {
+    if (CexCacheIndex == CexCacheIndexKind::Signature)
+      return signatureCache.findSuperset(key, p);
+    return cache.findSuperset(key, p);
+  }
+  template<class Predicate>
+  Assignment **cacheFindSubset(const KeyType &key, const Predicate &p) {
+    if (CexCacheIndex == CexCacheIndexKind::Signature)
+      return signatureCache.findSubset(key, p);
+    return cache.findSubset(key, p);
+  }
+  void cacheInsert(const KeyType &key, Assignment *binding);
+  /// Drop a use of a, freeing it with the last cache entry using it.
+  void releaseAssignment(Assignment *a);
 
   bool searchForAssignment(KeyType &key, 
                            Assignment *&result);
@@ -85,10 +148,14 @@ class CexCachingSolver : public SolverImpl {
   bool getAssignment(const Query& query, Assignment *&result);
   
 public:
-  CexCachingSolver(Solver *_solver) : solver(_solver) {}
+  CexCachingSolver(Solver *_solver)
+      : solver(_solver), signatureCache(CexCacheMaxProbes) {}
   ~CexCachingSolver();
   
   bool computeTruth(const Query&, bool &isValid);
+  bool computeTruthBatch(const Query &query,
+                         const std::vector<ref<Expr> > &exprs,
+                         std::vector<bool> &isValid);
   bool computeValidity(const Query&, Solver::Validity &result);
   bool computeValue(const Query&, ref<Expr> &result);
   bool computeInitialValues(const Query&,
@@ -127,9 +194,18 @@ struct NullOrSatisfyingAssignment {
 /// either a satisfying assignment (for a satisfiable query), or 0 (for an
 /// unsatisfiable query).
 /// \return - True if a cached result was found.
+/// The bytes of a cached assignment counted as util::MemoryTag::CexCache:
+/// the object, an entry per array and the bytes of its values
+static int64_t assignmentBytes(const Assignment *a) {
+  int64_t bytes = sizeof(Assignment);
+  for (const auto &b : a->bindings)
+    bytes += sizeof(b) + b.second.capacity();
+  return bytes;
+}
+
 bool CexCachingSolver::searchForAssignment(KeyType &key, Assignment *&result) {
   CompareCacheSemaphoreHolder CCSH;
-  Assignment * const *lookup = cache.lookup(key);
+  Assignment * const *lookup = cacheLookup(key);
   if (lookup) {
     result = *lookup;
     return true;
@@ -140,11 +216,11 @@ bool CexCachingSolver::searchForAssignment(KeyType &key, Assignment *&result) {
     // assignment for any subset.
     Assignment **lookup = 0;
     if (CexCacheSuperSet)
-      lookup = cache.findSuperset(key, NonNullAssignment());
+      lookup = cacheFindSuperset(key, NonNullAssignment());
 
     // Otherwise, look for a subset which is unsatisfiable, see below.
     if (!lookup) 
-      lookup = cache.findSubset(key, NullAssignment());
+      lookup = cacheFindSubset(key, NullAssignment());
 
     // If either lookup succeeded, then we have a cached solution.
     if (lookup) {
@@ -169,7 +245,7 @@ bool CexCachingSolver::searchForAssignment(KeyType &key, Assignment *&result) {
     // assignment for any subset.
     Assignment **lookup = 0;
     if (CexCacheSuperSet)
-      lookup = cache.findSuperset(key, NonNullAssignment());
+      lookup = cacheFindSuperset(key, NonNullAssignment());
 
     // Otherwise, look for a subset which is unsatisfiable -- if the subset is
     // unsatisfiable then no additional constraints can produce a valid
@@ -177,7 +253,7 @@ bool CexCachingSolver::searchForAssignment(KeyType &key, Assignment *&result) {
     // satisfiable subsets to see if they solve the current query and return
     // them if so. This is cheap and frequently succeeds.
     if (!lookup) 
-      lookup = cache.findSubset(key, NullOrSatisfyingAssignment(key));
+      lookup = cacheFindSubset(key, NullOrSatisfyingAssignment(key));
 
     // If either lookup succeeded, then we have a cached solution.
     if (lookup) {
@@ -236,7 +312,7 @@ bool CexCachingSolver::getAssignment(const Query& query, Assignment *&result) {
     
   Assignment *binding;
   if (hasSolution) {
-    binding = new Assignment(objects, values);
+    binding = new Assignment(objects, std::move(values));
 
     // Memoize the result.
     std::pair<assignmentsTable_ty::iterator, bool>
@@ -244,6 +320,8 @@ bool CexCachingSolver::getAssignment(const Query& query, Assignment *&result) {
     if (!res.second) {
       delete binding;
       binding = *res.first;
+    } else {
+      util::TrackMemory(util::MemoryTag::CexCache, assignmentBytes(binding));
     }
     
     if (DebugCexCacheCheckBinding)
@@ -257,19 +335,63 @@ bool CexCachingSolver::getAssignment(const Query& query, Assignment *&result) {
   }
   
   result = binding;
-  cache.insert(key, binding);
+  cacheInsert(key, binding);
 
   return true;
 }
 
+void CexCachingSolver::releaseAssignment(Assignment *a) {
+  // the assignment is freed with the last entry using it
+  if (a && --assignmentUses[a] == 0) {
+    assignmentUses.erase(a);
+    assignmentsTable.erase(a);
+    util::TrackMemory(util::MemoryTag::CexCache, -assignmentBytes(a));
+    delete a;
+  }
+}
+
+void CexCachingSolver::cacheInsert(const KeyType &key, Assignment *binding) {
+  Assignment **old = CexCacheMaxEntries ? cacheLookup(key) : nullptr;
+  Assignment *replaced = old ? *old : nullptr;
+  if (CexCacheIndex == CexCacheIndexKind::Signature)
+    signatureCache.insert(key, binding);
+  else
+    cache.insert(key, binding);
+  if (!CexCacheMaxEntries)
+    return;
+
+  // a cached key keeps its place in the eviction order
+  if (!old)
+    insertionOrder.push_back(key);
+  if (binding)
+    ++assignmentUses[binding];
+  releaseAssignment(replaced);
+  while (insertionOrder.size() > CexCacheMaxEntries) {
+    const KeyType &victim = insertionOrder.front();
+    Assignment **a = cacheLookup(victim);
+    assert(a && "evicting a key which is not cached");
+    Assignment *evicted = *a;
+    if (CexCacheIndex == CexCacheIndexKind::Signature)
+      signatureCache.erase(victim);
+    else
+      cache.erase(victim);
+    insertionOrder.pop_front();
+    ++stats::queryCexCacheEvictions;
+    releaseAssignment(evicted);
+  }
+}
+
 ///
 
 CexCachingSolver::~CexCachingSolver() {
   cache.clear();
+  signatureCache.clear();
   delete solver;
   for (assignmentsTable_ty::iterator it = assignmentsTable.begin(), 
-         ie = assignmentsTable.end(); it != ie; ++it)
+         ie = assignmentsTable.end(); it != ie; ++it) {
+    util::TrackMemory(util::MemoryTag::CexCache, -assignmentBytes(*it));
     delete *it;
+  }
 }
 
 bool CexCachingSolver::computeValidity(const Query& query,
@@ -323,6 +445,50 @@ bool CexCachingSolver::computeTruth(const Query& query,
   return true;
 }
 
+bool CexCachingSolver::computeTruthBatch(const Query &query,
+                                         const std::vector<ref<Expr> > &exprs,
+                                         std::vector<bool> &isValid) {
+  TimerStatIncrementer t(stats::cexCacheTime);
+  isValid.assign(exprs.size(), false);
+  std::vector<ref<Expr> > missed;
+  std::vector<unsigned> positions;
+  std::vector<KeyType> keys;
+  for (unsigned i = 0; i < exprs.size(); ++i) {
+    KeyType key;
+    Assignment *a;
+    if (lookupAssignment(query.withExpr(exprs[i]), key, a)) {
+      isValid[i] = !a;
+      continue;
+    }
+    missed.push_back(exprs[i]);
+    positions.push_back(i);
+    keys.push_back(std::move(key));
+  }
+  if (missed.empty())
+    return true;
+
+  // A single miss is solved for an assignment, as computeTruth does. Several
+  // go to the solver together, which tells validity but gives no
+  // assignments, so only the valid ones are cached.
+  if (missed.size() == 1) {
+    Assignment *a;
+    if (!getAssignment(query.withExpr(missed[0]), a))
+      return false;
+    isValid[positions[0]] = !a;
+    return true;
+  }
+
+  std::vector<bool> missedIsValid;
+  if (!solver->impl->computeTruthBatch(query, missed, missedIsValid))
+    return false;
+  for (unsigned i = 0; i < missed.size(); ++i) {
+    if (missedIsValid[i])
+      cacheInsert(keys[i], (Assignment *)0);
+    isValid[positions[i]] = missedIsValid[i];
+  }
+  return true;
+}
+
 bool CexCachingSolver::computeValue(const Query& query,
                                     ref<Expr> &result) {
   TimerStatIncrementer t(stats::cexCacheTime);
@@ -24,7 +24,9 @@ Solver *constructSolverChain(Solver *coreSolver,
                              std::string querySMT2LogPath,
                              std::string baseSolverQuerySMT2LogPath,
                              std::string queryKQueryLogPath,
-                             std::string baseSolverQueryKQueryLogPath) {
+                             std::string baseSolverQueryKQueryLogPath,
+                             std::string queryKQLogPath,
+                             std::string baseSolverQueryKQLogPath) {
   Solver *solver = coreSolver;
   const time::Span minQueryTimeToLog(MinQueryTimeToLog);
 
@@ -40,14 +42,45 @@ Solver *constructSolverChain(Solver *coreSolver,
                  baseSolverQuerySMT2LogPath.c_str());
   }
 
+  if (QueryLoggingOptions.isSet(SOLVER_KQLOG)) {
+    solver = createBinaryQueryLoggingSolver(solver, baseSolverQueryKQLogPath,
+                                            minQueryTimeToLog,
+                                            LogTimedOutQueries);
+    klee_message("Logging queries that reach solver in .kqlog format to %s\n",
+                 baseSolverQueryKQLogPath.c_str());
+  }
+
+  if (UseSATBitBlaster)
+    solver = createBitBlastingSolver(solver);
+
   if (UseAssignmentValidatingSolver)
     solver = createAssignmentValidatingSolver(solver);
 
-  if (UseFastCexSolver)
-    solver = createFastCexSolver(solver);
+  if (UseAdaptiveSolverChain) {
+    // the layers the adaptive solver toggles go above the ones it shares
+    if (!SolverHints.empty())
+      solver = createWarmStartSolver(solver, SolverHints);
+
+    if (!SolverCacheFile.empty())
+      solver = createPersistentCachingSolver(solver, SolverCacheFile);
+
+    solver = createAdaptiveSolver(solver);
+  } else {
+    if (UseEqualitySimplifier)
+      solver = createEqualitySimplifyingSolver(solver);
+
+    if (UseFastCexSolver)
+      solver = createFastCexSolver(solver);
 
-  if (UseCexCache)
-    solver = createCexCachingSolver(solver);
+    if (!SolverHints.empty())
+      solver = createWarmStartSolver(solver, SolverHints);
+
+    if (!SolverCacheFile.empty())
+      solver = createPersistentCachingSolver(solver, SolverCacheFile);
+
+    if (UseCexCache)
+      solver = createCexCachingSolver(solver);
+  }
 
   if (UseBranchCache)
     solver = createCachingSolver(solver);
@@ -69,6 +102,14 @@ Solver *constructSolverChain(Solver *coreSolver,
     klee_message("Logging all queries in .smt2 format to %s\n",
                  querySMT2LogPath.c_str());
   }
+
+  if (QueryLoggingOptions.isSet(ALL_KQLOG)) {
+    solver = createBinaryQueryLoggingSolver(solver, queryKQLogPath,
+                                            minQueryTimeToLog,
+                                            LogTimedOutQueries);
+    klee_message("Logging all queries in .kqlog format to %s\n",
+                 queryKQLogPath.c_str());
+  }
   if (DebugCrossCheckCoreSolverWith != NO_SOLVER) {
     Solver *oracleSolver = createCoreSolver(DebugCrossCheckCoreSolverWith);
     solver = createValidatingSolver(/*s=*/solver, /*oracle=*/oracleSolver);
@@ -50,6 +50,35 @@ Solver *createCoreSolver(CoreSolverType cst) {
     klee_message("Not compiled with Z3 support");
     return NULL;
 #endif
+  case SMTLIB_SOLVER:
+    klee_message("Using SMT-LIBv2 solver processes");
+    return createSMTLIBProcessSolver();
+  case PORTFOLIO_SOLVER: {
+    std::vector<CoreSolverType> types(PortfolioSolvers.begin(),
+                                      PortfolioSolvers.end());
+    if (types.empty()) {
+#ifdef ENABLE_STP
+      types.push_back(STP_SOLVER);
+#endif
+#ifdef ENABLE_METASMT
+      types.push_back(METASMT_SOLVER);
+#endif
+#ifdef ENABLE_Z3
+      types.push_back(Z3_SOLVER);
+#endif
+    }
+    std::vector<std::pair<CoreSolverType, Solver *> > members;
+    for (CoreSolverType type : types) {
+      if (Solver *s = createCoreSolver(type))
+        members.emplace_back(type, s);
+    }
+    if (members.empty())
+      return NULL;
+    if (members.size() == 1)
+      return members.front().second;
+    klee_message("Using portfolio of %zu solver backends", members.size());
+    return createPortfolioSolver(members);
+  }
   case NO_SOLVER:
     klee_message("Invalid solver");
     return NULL;
@@ -0,0 +1,215 @@
+//===-- EqualitySimplifyingSolver.cpp -------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Propagates the (Eq constant expr) constraints of a query into the rest of
+// the query before it reaches the underlying solver. Values recorded during
+// replay are added as equalities over whole (multi-byte) loads, so they are
+// first split into the equalities of the bytes they are made of. Reads whose
+// index becomes known are then folded by ReadExpr::create, which also drops
+// the unrelated updates of their update lists. Writes at indices that become
+// known are pruned from the update lists of the reads that are still
+// symbolic as well (ExprOptimizer::optimizeUpdates).
+//
+//===----------------------------------------------------------------------===//
+
+#include "../Expr/ArrayExprOptimizer.h"
+
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/ExprReplaceVisitor.h"
+#include "klee/Solver/Solver.h"
+#include "klee/Solver/SolverImpl.h"
+#include "klee/Solver/SolverStats.h"
+
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+class EqualitySimplifyingSolver : public SolverImpl {
+private:
+  Solver *solver;
+  ExprOptimizer optimizer;
+
+  /// Rewrite the constraints and the expression of query with its
+  /// equalities.
+  /// \return false if nothing changed
+  bool simplify(const Query &query, Constraints_ty &constraints,
+                ref<Expr> &expr);
+
+public:
+  EqualitySimplifyingSolver(Solver *_solver) : solver(_solver) {}
+  ~EqualitySimplifyingSolver() { delete solver; }
+
+  bool computeValidity(const Query &, Solver::Validity &result);
+  bool computeTruth(const Query &, bool &isValid);
+  bool computeValue(const Query &, ref<Expr> &result);
+  bool computeInitialValues(const Query &,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution);
+  SolverRunStatus getOperationStatusCode() {
+    return solver->impl->getOperationStatusCode();
+  }
+  char *getConstraintLog(const Query &query) {
+    return solver->impl->getConstraintLog(query);
+  }
+  void setCoreSolverTimeout(time::Span timeout) {
+    solver->impl->setCoreSolverTimeout(timeout);
+  }
+};
+
+/// Add e == value to equalities, together with the equalities of the parts
+/// of e that value determines.
+static void addEquality(const ref<Expr> &e, const ref<ConstantExpr> &value,
+                        ExprHashMap<ref<Expr> > &equalities) {
+  if (isa<ConstantExpr>(e))
+    return;
+  equalities.insert(std::make_pair(e, value));
+  switch (e->getKind()) {
+  case Expr::Concat: {
+    ConcatExpr *ce = cast<ConcatExpr>(e);
+    Expr::Width rightWidth = ce->getRight()->getWidth();
+    addEquality(ce->getLeft(),
+                value->Extract(rightWidth, ce->getLeft()->getWidth()),
+                equalities);
+    addEquality(ce->getRight(), value->Extract(0, rightWidth), equalities);
+    break;
+  }
+  case Expr::ZExt: {
+    ref<Expr> src = cast<CastExpr>(e)->src;
+    ref<ConstantExpr> low = value->Extract(0, src->getWidth());
+    // otherwise the equality is false and the query is answered anyway
+    if (low->ZExt(value->getWidth())->Eq(value)->isTrue())
+      addEquality(src, low, equalities);
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+bool EqualitySimplifyingSolver::simplify(const Query &query,
+                                         Constraints_ty &constraints,
+                                         ref<Expr> &expr) {
+  ExprHashMap<ref<Expr> > equalities;
+  // the equalities themselves are kept, so that assignments still satisfy
+  // them
+  Constraints_ty sources;
+  for (const ref<Expr> &c : query.constraints) {
+    EqExpr *ee = dyn_cast<EqExpr>(c);
+    if (!ee)
+      continue;
+    ConstantExpr *ce = dyn_cast<ConstantExpr>(ee->left);
+    if (!ce || (ce->getWidth() == Expr::Bool && ce->isFalse()))
+      continue;
+    addEquality(ee->right, ce, equalities);
+    sources.insert(c);
+  }
+  if (equalities.empty())
+    return false;
+
+  UNMap_ty replacedUN, visitedUN;
+  ExprReplaceVisitorMulti visitor(replacedUN, visitedUN, equalities);
+  bool changed = false;
+  constraints.reserve(query.constraints.size());
+  for (const ref<Expr> &c : query.constraints) {
+    if (sources.count(c)) {
+      constraints.insert(c);
+      continue;
+    }
+    ref<Expr> simplified = optimizer.optimizeExpr(
+        optimizer.optimizeUpdates(visitor.replace(c)), false);
+    if (simplified != c) {
+      changed = true;
+      ++stats::equalitySimplifiedConstraints;
+    }
+    // a constraint implied by the equalities
+    if (ConstantExpr *ce = dyn_cast<ConstantExpr>(simplified))
+      if (ce->isTrue())
+        continue;
+    constraints.insert(simplified);
+  }
+  if (!isa<ConstantExpr>(query.expr)) {
+    ref<Expr> simplified = optimizer.optimizeExpr(
+        optimizer.optimizeUpdates(visitor.replace(query.expr)), false);
+    changed |= simplified != query.expr;
+    expr = simplified;
+  } else {
+    expr = query.expr;
+  }
+  return changed;
+}
+
+bool EqualitySimplifyingSolver::computeValidity(const Query &query,
+                                                Solver::Validity &result) {
+  Constraints_ty constraints;
+  ref<Expr> expr;
+  if (!simplify(query, constraints, expr))
+    return solver->impl->computeValidity(query, result);
+  if (ConstantExpr *ce = dyn_cast<ConstantExpr>(expr)) {
+    ++stats::equalitySimplifiedQueries;
+    result = ce->isTrue() ? Solver::True : Solver::False;
+    return true;
+  }
+  return solver->impl->computeValidity(
+      Query(query.constraintMgr, constraints, expr, query.indep_elemset),
+      result);
+}
+
+bool EqualitySimplifyingSolver::computeTruth(const Query &query,
+                                             bool &isValid) {
+  Constraints_ty constraints;
+  ref<Expr> expr;
+  if (!simplify(query, constraints, expr))
+    return solver->impl->computeTruth(query, isValid);
+  if (ConstantExpr *ce = dyn_cast<ConstantExpr>(expr)) {
+    ++stats::equalitySimplifiedQueries;
+    isValid = ce->isTrue();
+    return true;
+  }
+  return solver->impl->computeTruth(
+      Query(query.constraintMgr, constraints, expr, query.indep_elemset),
+      isValid);
+}
+
+bool EqualitySimplifyingSolver::computeValue(const Query &query,
+                                             ref<Expr> &result) {
+  Constraints_ty constraints;
+  ref<Expr> expr;
+  if (!simplify(query, constraints, expr))
+    return solver->impl->computeValue(query, result);
+  if (isa<ConstantExpr>(expr)) {
+    ++stats::equalitySimplifiedQueries;
+    result = expr;
+    return true;
+  }
+  return solver->impl->computeValue(
+      Query(query.constraintMgr, constraints, expr, query.indep_elemset),
+      result);
+}
+
+bool EqualitySimplifyingSolver::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution) {
+  Constraints_ty constraints;
+  ref<Expr> expr;
+  if (!simplify(query, constraints, expr))
+    return solver->impl->computeInitialValues(query, objects, values,
+                                              hasSolution);
+  return solver->impl->computeInitialValues(
+      Query(query.constraintMgr, constraints, expr, query.indep_elemset),
+      objects, values, hasSolution);
+}
+
+} // namespace
+
+Solver *klee::createEqualitySimplifyingSolver(Solver *s) {
+  return new Solver(new EqualitySimplifyingSolver(s));
+}
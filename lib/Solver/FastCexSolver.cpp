@@ -13,6 +13,7 @@
 #include "klee/Expr/Constraints.h"
 #include "klee/Expr/Expr.h"
 #include "klee/Expr/ExprEvaluator.h"
+#include "klee/Expr/ExprHashMap.h"
 #include "klee/Expr/ExprRangeEvaluator.h"
 #include "klee/Expr/ExprVisitor.h"
 #include "klee/Solver/IncompleteSolver.h"
@@ -299,6 +300,75 @@ inline llvm::raw_ostream &operator<<(llvm::raw_ostream &os,
   return os;
 }
 
+/// Bits known to be 0 or 1 in every value of a set of values of some
+/// width. Bits above the width are not known. The set is empty if a bit is
+/// known to be both.
+class KnownBits {
+public:
+  std::uint64_t zeros = 0, ones = 0;
+
+  KnownBits() = default;
+  KnownBits(std::uint64_t _zeros, std::uint64_t _ones)
+      : zeros(_zeros), ones(_ones) {}
+
+  static KnownBits constant(std::uint64_t value, unsigned width) {
+    std::uint64_t mask = bits64::maxValueOfNBits(width);
+    return KnownBits(~value & mask, value & mask);
+  }
+
+  /// The bits above the highest one in which the bounds of range differ
+  static KnownBits fromRange(const ValueRange &range, unsigned width) {
+    if (range.isEmpty())
+      return KnownBits();
+    std::uint64_t diff = range.min() ^ range.max();
+    unsigned varying = 0;
+    while (diff) {
+      diff >>= 1;
+      ++varying;
+    }
+    std::uint64_t high =
+        bits64::maxValueOfNBits(width) & ~bits64::maxValueOfNBits(varying);
+    return KnownBits(high & ~range.min(), high & range.min());
+  }
+
+  bool isEmpty() const { return zeros & ones; }
+  std::uint64_t known() const { return zeros | ones; }
+  bool isFixed(unsigned width) const {
+    return (known() & bits64::maxValueOfNBits(width)) ==
+           bits64::maxValueOfNBits(width);
+  }
+  bool contains(std::uint64_t value) const {
+    return !(value & zeros) && (value & ones) == ones;
+  }
+
+  /// The values in both sets
+  KnownBits meet(const KnownBits &b) const {
+    return KnownBits(zeros | b.zeros, ones | b.ones);
+  }
+  /// The values in either set
+  KnownBits join(const KnownBits &b) const {
+    return KnownBits(zeros & b.zeros, ones & b.ones);
+  }
+
+  bool operator==(const KnownBits &b) const {
+    return zeros == b.zeros && ones == b.ones;
+  }
+  bool operator!=(const KnownBits &b) const { return !(*this == b); }
+};
+
+/// The values of a byte range that have the given bits, as a range
+static ValueRange narrowByteRange(const ValueRange &range,
+                                  const KnownBits &bits) {
+  if (range.isEmpty() || bits.isEmpty())
+    return ValueRange(1, 0);
+  std::uint64_t lo = range.min(), hi = range.max();
+  while (lo <= hi && !bits.contains(lo))
+    ++lo;
+  while (hi > lo && !bits.contains(hi))
+    --hi;
+  return lo <= hi ? ValueRange(lo, hi) : ValueRange(1, 0);
+}
+
 // XXX waste of space, rather have ByteValueRange
 typedef ValueRange CexValueData;
 
@@ -315,11 +385,15 @@ class CexObjectData {
   /// for each array location.
   std::vector<CexValueData> exactContents;
 
+  /// exactBits - The bits known in every value of exactContents.
+  std::vector<KnownBits> exactBits;
+
   CexObjectData(const CexObjectData&); // DO NOT IMPLEMENT
   void operator=(const CexObjectData&); // DO NOT IMPLEMENT
 
 public:
-  CexObjectData(uint64_t size) : possibleContents(size), exactContents(size) {
+  CexObjectData(uint64_t size)
+      : possibleContents(size), exactContents(size), exactBits(size) {
     for (uint64_t i = 0; i != size; ++i) {
       possibleContents[i] = ValueRange(0, 255);
       exactContents[i] = ValueRange(0, 255);
@@ -343,10 +417,25 @@ public:
     exactContents[index] = values;
   }
 
-  /// getPossibleValue - Return some possible value.
+  const KnownBits &getExactBits(size_t index) const {
+    return exactBits[index];
+  }
+  void setExactBits(size_t index, const KnownBits &bits) {
+    exactBits[index] = bits;
+  }
+
+  /// getPossibleValue - Return some possible value, one the exact values
+  /// allow if there is one.
   unsigned char getPossibleValue(size_t index) const {
     const CexValueData &cvd = possibleContents[index];
-    return cvd.min() + (cvd.max() - cvd.min()) / 2;
+    unsigned char value = cvd.min() + (cvd.max() - cvd.min()) / 2;
+    const KnownBits &bits = exactBits[index];
+    ValueRange allowed = narrowByteRange(
+        cvd.set_intersection(exactContents[index]), bits);
+    if (allowed.isEmpty())
+      return value;
+    unsigned char fixed = (value & ~bits.zeros) | bits.ones;
+    return allowed.contains(fixed) ? fixed : allowed.min();
   }
 };
 
@@ -420,6 +509,18 @@ class CexData {
 public:
   std::map<const Array*, CexObjectData*> objects;
 
+  /// Whether the exact values changed since this was last cleared
+  bool changed = false;
+  /// Whether the exact values of some byte became empty: the constraints
+  /// they were propagated from cannot hold together.
+  bool conflict = false;
+
+private:
+  /// Known bits of the expressions evaluated since the exact values last
+  /// changed
+  ExprHashMap<KnownBits> bitsCache;
+
+public:
   CexData(const CexData&); // DO NOT IMPLEMENT
   void operator=(const CexData&); // DO NOT IMPLEMENT
 
@@ -824,17 +925,8 @@ public:
           // Verify the range.
           propogateExactValues(array->constantValues[index.min()],
                                range);
-        } else {
-          CexValueData cvd = cod.getExactValues(index.min());
-          if (range.min() > cvd.min()) {
-            assert(range.min() <= cvd.max());
-            cvd = CexValueData(range.min(), cvd.max());
-          }
-          if (range.max() < cvd.max()) {
-            assert(range.max() >= cvd.min());
-            cvd = CexValueData(cvd.min(), range.max());
-          }
-          cod.setExactValues(index.min(), cvd);
+        } else if (index.min() < array->size) {
+          narrowExactByte(cod, index.min(), range, KnownBits());
         }
       }
       break;
@@ -928,6 +1020,455 @@ public:
     }
   }
 
+  /// Narrow the exact values of a byte to those in range with bits.
+  void narrowExactByte(CexObjectData &cod, size_t index,
+                       const ValueRange &range, const KnownBits &bits) {
+    ValueRange oldRange = cod.getExactValues(index);
+    KnownBits oldBits = cod.getExactBits(index);
+    ValueRange newRange = narrowByteRange(oldRange.set_intersection(range),
+                                          oldBits.meet(bits));
+    if (newRange.isEmpty()) {
+      conflict = true;
+      return;
+    }
+    KnownBits newBits = oldBits.meet(bits)
+                            .meet(KnownBits::fromRange(newRange, 8));
+    newBits = KnownBits(newBits.zeros & 0xFF, newBits.ones & 0xFF);
+    if (newRange == oldRange && newBits == oldBits)
+      return;
+    cod.setExactValues(index, newRange);
+    cod.setExactBits(index, newBits);
+    changed = true;
+    bitsCache.clear();
+  }
+
+  /// The initial byte a read surely reads, if it reads one at a fixed index,
+  /// otherwise the write it surely reads, if any.
+  /// \return whether either was found
+  bool resolveRead(const ReadExpr *re, const UpdateNode *&write,
+                   uint64_t &index) {
+    write = nullptr;
+    CexValueData indexRange = evalRangeForExpr(re->index);
+    for (const auto *un = re->updates.head.get(); un; un = un->next.get()) {
+      CexValueData ui = evalRangeForExpr(un->index);
+      if (!ui.mayEqual(indexRange))
+        continue;
+      if (ui.mustEqual(indexRange) || re->index == un->index) {
+        write = un;
+        return true;
+      }
+      return false;
+    }
+    if (!indexRange.isFixed() || indexRange.min() >= re->updates.root->size ||
+        re->updates.root->getRange() != Expr::Int8)
+      return false;
+    index = indexRange.min();
+    return true;
+  }
+
+  /// The bits known in every value e can take given the exact values.
+  KnownBits evalBits(const ref<Expr> &e) {
+    unsigned width = e->getWidth();
+    if (width > 64)
+      return KnownBits();
+    auto it = bitsCache.find(e);
+    if (it != bitsCache.end())
+      return it->second;
+    KnownBits bits = computeBits(e);
+    std::uint64_t mask = bits64::maxValueOfNBits(width);
+    bits = KnownBits(bits.zeros & mask, bits.ones & mask);
+    bitsCache.insert(std::make_pair(e, bits));
+    return bits;
+  }
+
+  KnownBits computeBits(const ref<Expr> &e) {
+    unsigned width = e->getWidth();
+    std::uint64_t mask = bits64::maxValueOfNBits(width);
+
+    switch (e->getKind()) {
+    case Expr::Constant:
+      return KnownBits::constant(cast<ConstantExpr>(e)->getZExtValue(), width);
+
+    case Expr::Read: {
+      ReadExpr *re = cast<ReadExpr>(e);
+      const UpdateNode *write;
+      uint64_t index;
+      if (!resolveRead(re, write, index))
+        return KnownBits();
+      if (write)
+        return evalBits(write->value);
+      const Array *array = re->updates.root;
+      if (array->isConstantArray())
+        return KnownBits::constant(
+            array->constantValues[index]->getZExtValue(8), 8);
+      auto it = objects.find(array);
+      if (it == objects.end())
+        return KnownBits();
+      return it->second->getExactBits(index).meet(
+          KnownBits::fromRange(it->second->getExactValues(index), 8));
+    }
+
+    case Expr::Select: {
+      SelectExpr *se = cast<SelectExpr>(e);
+      KnownBits cond = evalBits(se->cond);
+      if (cond.ones & 1)
+        return evalBits(se->trueExpr);
+      if (cond.zeros & 1)
+        return evalBits(se->falseExpr);
+      return evalBits(se->trueExpr).join(evalBits(se->falseExpr));
+    }
+
+    case Expr::Concat: {
+      ConcatExpr *ce = cast<ConcatExpr>(e);
+      unsigned rw = ce->getRight()->getWidth();
+      KnownBits l = evalBits(ce->getLeft()), r = evalBits(ce->getRight());
+      return KnownBits((l.zeros << rw) | r.zeros, (l.ones << rw) | r.ones);
+    }
+
+    case Expr::Extract: {
+      ExtractExpr *ee = cast<ExtractExpr>(e);
+      KnownBits kid = evalBits(ee->expr);
+      return KnownBits(kid.zeros >> ee->offset, kid.ones >> ee->offset);
+    }
+
+    case Expr::ZExt: {
+      CastExpr *ce = cast<CastExpr>(e);
+      KnownBits kid = evalBits(ce->src);
+      return KnownBits(
+          kid.zeros | (mask & ~bits64::maxValueOfNBits(ce->src->getWidth())),
+          kid.ones);
+    }
+
+    case Expr::SExt: {
+      CastExpr *ce = cast<CastExpr>(e);
+      unsigned kw = ce->src->getWidth();
+      KnownBits kid = evalBits(ce->src);
+      std::uint64_t high = mask & ~bits64::maxValueOfNBits(kw);
+      std::uint64_t sign = UINT64_C(1) << (kw - 1);
+      return KnownBits(kid.zeros | ((kid.zeros & sign) ? high : 0),
+                       kid.ones | ((kid.ones & sign) ? high : 0));
+    }
+
+    case Expr::Not: {
+      KnownBits kid = evalBits(e->getKid(0));
+      return KnownBits(kid.ones, kid.zeros);
+    }
+
+    case Expr::And: {
+      KnownBits l = evalBits(e->getKid(0)), r = evalBits(e->getKid(1));
+      return KnownBits(l.zeros | r.zeros, l.ones & r.ones);
+    }
+
+    case Expr::Or: {
+      KnownBits l = evalBits(e->getKid(0)), r = evalBits(e->getKid(1));
+      return KnownBits(l.zeros & r.zeros, l.ones | r.ones);
+    }
+
+    case Expr::Xor: {
+      KnownBits l = evalBits(e->getKid(0)), r = evalBits(e->getKid(1));
+      std::uint64_t known = l.known() & r.known();
+      std::uint64_t ones = (l.ones ^ r.ones) & known;
+      return KnownBits(known & ~ones, ones);
+    }
+
+    case Expr::Add:
+    case Expr::Sub: {
+      // the low bits known on both sides, carries only go upwards
+      KnownBits l = evalBits(e->getKid(0)), r = evalBits(e->getKid(1));
+      std::uint64_t known = l.known() & r.known() & mask;
+      std::uint64_t low = ~known ? (known & ~(known + 1)) : known;
+      std::uint64_t value = e->getKind() == Expr::Add ? l.ones + r.ones
+                                                      : l.ones - r.ones;
+      return KnownBits(~value & low, value & low);
+    }
+
+    case Expr::Shl:
+    case Expr::LShr:
+    case Expr::AShr: {
+      ConstantExpr *CE = dyn_cast<ConstantExpr>(e->getKid(1));
+      if (!CE || CE->getZExtValue() >= width)
+        return KnownBits();
+      unsigned shift = CE->getZExtValue();
+      KnownBits kid = evalBits(e->getKid(0));
+      if (e->getKind() == Expr::Shl)
+        return KnownBits((kid.zeros << shift) |
+                             bits64::maxValueOfNBits(shift),
+                         kid.ones << shift);
+      std::uint64_t high = mask & ~(mask >> shift);
+      std::uint64_t sign = UINT64_C(1) << (width - 1);
+      if (e->getKind() == Expr::LShr || (kid.zeros & sign))
+        return KnownBits((kid.zeros >> shift) | high, kid.ones >> shift);
+      if (kid.ones & sign)
+        return KnownBits(kid.zeros >> shift, (kid.ones >> shift) | high);
+      return KnownBits(kid.zeros >> shift, kid.ones >> shift);
+    }
+
+    case Expr::Eq: {
+      KnownBits l = evalBits(e->getKid(0)), r = evalBits(e->getKid(1));
+      unsigned kw = e->getKid(0)->getWidth();
+      if ((l.zeros & r.ones) || (l.ones & r.zeros))
+        return KnownBits::constant(0, Expr::Bool);
+      if (kw <= 64 && l.isFixed(kw) && r.isFixed(kw))
+        return KnownBits::constant(1, Expr::Bool);
+      return KnownBits();
+    }
+
+    case Expr::Ult:
+    case Expr::Ule: {
+      unsigned kw = e->getKid(0)->getWidth();
+      if (kw > 64)
+        return KnownBits();
+      std::uint64_t kmask = bits64::maxValueOfNBits(kw);
+      KnownBits l = evalBits(e->getKid(0)), r = evalBits(e->getKid(1));
+      std::uint64_t lmin = l.ones, lmax = ~l.zeros & kmask;
+      std::uint64_t rmin = r.ones, rmax = ~r.zeros & kmask;
+      bool strict = e->getKind() == Expr::Ult;
+      if (strict ? lmax < rmin : lmax <= rmin)
+        return KnownBits::constant(1, Expr::Bool);
+      if (strict ? lmin >= rmax : lmin > rmax)
+        return KnownBits::constant(0, Expr::Bool);
+      return KnownBits();
+    }
+
+    default:
+      return KnownBits();
+    }
+  }
+
+  /// Narrow the exact values so that e has the given bits in every
+  /// assignment that satisfies the constraints propagated so far.
+  void propogateExactBits(const ref<Expr> &e, KnownBits bits) {
+    unsigned width = e->getWidth();
+    if (width > 64 || conflict)
+      return;
+    std::uint64_t mask = bits64::maxValueOfNBits(width);
+    bits = KnownBits(bits.zeros & mask, bits.ones & mask);
+    if (!bits.known())
+      return;
+    if (bits.isEmpty()) {
+      conflict = true;
+      return;
+    }
+    KnownBits current = evalBits(e);
+    if ((current.zeros & bits.ones) || (current.ones & bits.zeros)) {
+      conflict = true;
+      return;
+    }
+    // nothing new to learn
+    if ((current.known() & bits.known()) == bits.known())
+      return;
+
+    switch (e->getKind()) {
+    case Expr::Read: {
+      ReadExpr *re = cast<ReadExpr>(e);
+      const UpdateNode *write;
+      uint64_t index;
+      if (!resolveRead(re, write, index))
+        break;
+      if (write)
+        propogateExactBits(write->value, bits);
+      else if (!re->updates.root->isConstantArray())
+        narrowExactByte(getObjectData(re->updates.root), index,
+                        ValueRange(0, 255), bits);
+      break;
+    }
+
+    case Expr::Select: {
+      SelectExpr *se = cast<SelectExpr>(e);
+      KnownBits cond = evalBits(se->cond);
+      if (cond.ones & 1)
+        propogateExactBits(se->trueExpr, bits);
+      else if (cond.zeros & 1)
+        propogateExactBits(se->falseExpr, bits);
+      break;
+    }
+
+    case Expr::Concat: {
+      ConcatExpr *ce = cast<ConcatExpr>(e);
+      unsigned rw = ce->getRight()->getWidth();
+      propogateExactBits(ce->getRight(), bits);
+      propogateExactBits(ce->getLeft(),
+                         KnownBits(bits.zeros >> rw, bits.ones >> rw));
+      break;
+    }
+
+    case Expr::Extract: {
+      ExtractExpr *ee = cast<ExtractExpr>(e);
+      propogateExactBits(ee->expr, KnownBits(bits.zeros << ee->offset,
+                                             bits.ones << ee->offset));
+      break;
+    }
+
+    case Expr::ZExt:
+    case Expr::SExt:
+      // the evaluation above checked the high bits of a ZExt
+      propogateExactBits(cast<CastExpr>(e)->src, bits);
+      break;
+
+    case Expr::Not:
+      propogateExactBits(e->getKid(0), KnownBits(bits.ones, bits.zeros));
+      break;
+
+    case Expr::And:
+    case Expr::Or: {
+      // And: a one needs ones on both sides, a zero needs a zero on the
+      // side whose other side is one; dually for Or
+      bool isAnd = e->getKind() == Expr::And;
+      const ref<Expr> &l = e->getKid(0), &r = e->getKid(1);
+      KnownBits lb = evalBits(l), rb = evalBits(r);
+      std::uint64_t forced = isAnd ? bits.ones : bits.zeros;
+      std::uint64_t other = isAnd ? bits.zeros : bits.ones;
+      std::uint64_t lAbsorbs = isAnd ? lb.ones : lb.zeros;
+      std::uint64_t rAbsorbs = isAnd ? rb.ones : rb.zeros;
+      std::uint64_t toL = forced | (other & rAbsorbs);
+      std::uint64_t toR = forced | (other & lAbsorbs);
+      propogateExactBits(l, KnownBits(bits.zeros & toL, bits.ones & toL));
+      propogateExactBits(r, KnownBits(bits.zeros & toR, bits.ones & toR));
+      break;
+    }
+
+    case Expr::Xor: {
+      const ref<Expr> &l = e->getKid(0), &r = e->getKid(1);
+      KnownBits lb = evalBits(l), rb = evalBits(r);
+      std::uint64_t toL = bits.known() & rb.known();
+      std::uint64_t lOnes = (bits.ones ^ rb.ones) & toL;
+      propogateExactBits(l, KnownBits(toL & ~lOnes, lOnes));
+      std::uint64_t toR = bits.known() & lb.known();
+      std::uint64_t rOnes = (bits.ones ^ lb.ones) & toR;
+      propogateExactBits(r, KnownBits(toR & ~rOnes, rOnes));
+      break;
+    }
+
+    case Expr::Add: {
+      // C + X: the low bits of X follow from the low bits of the sum
+      ConstantExpr *CE = dyn_cast<ConstantExpr>(e->getKid(0));
+      if (!CE)
+        break;
+      std::uint64_t known = bits.known();
+      std::uint64_t low = ~known ? (known & ~(known + 1)) : known;
+      std::uint64_t value = bits.ones - CE->getZExtValue();
+      propogateExactBits(e->getKid(1), KnownBits(~value & low, value & low));
+      break;
+    }
+
+    case Expr::Shl:
+    case Expr::LShr: {
+      ConstantExpr *CE = dyn_cast<ConstantExpr>(e->getKid(1));
+      if (!CE || CE->getZExtValue() >= width)
+        break;
+      unsigned shift = CE->getZExtValue();
+      if (e->getKind() == Expr::Shl)
+        propogateExactBits(e->getKid(0), KnownBits(bits.zeros >> shift,
+                                                   bits.ones >> shift));
+      else
+        propogateExactBits(e->getKid(0), KnownBits(bits.zeros << shift,
+                                                   bits.ones << shift));
+      break;
+    }
+
+    case Expr::Eq: {
+      const ref<Expr> &l = e->getKid(0), &r = e->getKid(1);
+      if (bits.ones & 1) {
+        propogateExactBits(r, evalBits(l));
+        propogateExactBits(l, evalBits(r));
+      } else if (l->getWidth() == Expr::Bool) {
+        KnownBits lb = evalBits(l), rb = evalBits(r);
+        propogateExactBits(r, KnownBits(lb.ones, lb.zeros));
+        propogateExactBits(l, KnownBits(rb.ones, rb.zeros));
+      }
+      break;
+    }
+
+    case Expr::Ult:
+    case Expr::Ule: {
+      // a comparison with a constant bounds the other side
+      const ref<Expr> &l = e->getKid(0), &r = e->getKid(1);
+      unsigned kw = l->getWidth();
+      if (kw > 64)
+        break;
+      std::uint64_t kmax = bits64::maxValueOfNBits(kw);
+      bool holds = bits.ones & 1;
+      bool strict = e->getKind() == Expr::Ult;
+      if (ConstantExpr *CE = dyn_cast<ConstantExpr>(r)) {
+        std::uint64_t c = CE->getZExtValue();
+        // l < c, l <= c, or their negations c <= l, c < l
+        if (holds == strict) {
+          if (holds ? c == 0 : c == kmax) {
+            conflict = true;
+            break;
+          }
+          propogateExactRange(l, holds ? ValueRange(0, c - 1)
+                                       : ValueRange(c + 1, kmax));
+        } else {
+          propogateExactRange(l, holds ? ValueRange(0, c)
+                                       : ValueRange(c, kmax));
+        }
+      } else if (ConstantExpr *CE = dyn_cast<ConstantExpr>(l)) {
+        std::uint64_t c = CE->getZExtValue();
+        // c < r, c <= r, or their negations r <= c, r < c
+        if (holds == strict) {
+          if (holds ? c == kmax : c == 0) {
+            conflict = true;
+            break;
+          }
+          propogateExactRange(r, holds ? ValueRange(c + 1, kmax)
+                                       : ValueRange(0, c - 1));
+        } else {
+          propogateExactRange(r, holds ? ValueRange(c, kmax)
+                                       : ValueRange(0, c));
+        }
+      }
+      break;
+    }
+
+    default:
+      break;
+    }
+  }
+
+  /// Narrow the exact values so that e is in range.
+  void propogateExactRange(const ref<Expr> &e, const ValueRange &range) {
+    unsigned width = e->getWidth();
+    if (width > 64 || conflict)
+      return;
+    switch (e->getKind()) {
+    case Expr::Read: {
+      ReadExpr *re = cast<ReadExpr>(e);
+      const UpdateNode *write;
+      uint64_t index;
+      if (resolveRead(re, write, index) && !write &&
+          !re->updates.root->isConstantArray()) {
+        narrowExactByte(getObjectData(re->updates.root), index, range,
+                        KnownBits());
+        return;
+      }
+      break;
+    }
+    case Expr::ZExt: {
+      CastExpr *ce = cast<CastExpr>(e);
+      unsigned kw = ce->src->getWidth();
+      ValueRange src =
+          range.set_intersection(ValueRange(0, bits64::maxValueOfNBits(kw)));
+      if (src.isEmpty())
+        conflict = true;
+      else
+        propogateExactRange(ce->src, src);
+      return;
+    }
+    case Expr::Concat: {
+      // the high part is bounded by the bounds of the whole
+      ConcatExpr *ce = cast<ConcatExpr>(e);
+      unsigned rw = ce->getRight()->getWidth();
+      propogateExactRange(ce->getLeft(),
+                          ValueRange(range.min() >> rw, range.max() >> rw));
+      break;
+    }
+    default:
+      break;
+    }
+    propogateExactBits(e, KnownBits::fromRange(range, width));
+  }
+
   ValueRange evalRangeForExpr(const ref<Expr> &e) {
     CexRangeEvaluator ce(objects);
     return ce.evaluate(e);
@@ -991,6 +1532,10 @@ FastCexSolver::FastCexSolver() { }
 
 FastCexSolver::~FastCexSolver() { }
 
+/// The number of times the constraints are propagated at most, each time
+/// with the exact values narrowed by the time before
+static const unsigned MaxExactRounds = 8;
+
 /// propogateValues - Propogate value ranges for the given query and return the
 /// propogation results.
 ///
@@ -1017,7 +1562,29 @@ static bool propogateValues(const Query& query, CexData &cd,
     cd.propogateExactValue(query.expr, 0);
   }
 
+  // Propagate known bits and bounds until they stop changing, a byte
+  // narrowed by one constraint can narrow others through it.
+  KnownBits isTrue = KnownBits::constant(1, Expr::Bool);
+  KnownBits isFalse = KnownBits::constant(0, Expr::Bool);
+  for (unsigned round = 0; round != MaxExactRounds && !cd.conflict; ++round) {
+    cd.changed = false;
+    for (ConstraintManager::const_iterator it = query.constraints.begin(),
+           ie = query.constraints.end(); it != ie; ++it)
+      cd.propogateExactBits(*it, isTrue);
+    if (checkExpr)
+      cd.propogateExactBits(query.expr, isFalse);
+    if (!cd.changed)
+      break;
+  }
+
   KLEE_DEBUG(cd.dump());
+
+  // The exact values of some byte are empty, the constraints (with the
+  // negated query expression) cannot hold.
+  if (cd.conflict) {
+    isValid = true;
+    return true;
+  }
   
   // Check the result.
   bool hasSatisfyingAssignment = true;
@@ -1026,7 +1593,8 @@ static bool propogateValues(const Query& query, CexData &cd,
       hasSatisfyingAssignment = false;
 
     // If the query is known to be true, then we have proved validity.
-    if (cd.evaluateExact(query.expr)->isTrue()) {
+    if (cd.evaluateExact(query.expr)->isTrue() ||
+        cd.evalBits(query.expr) == isTrue) {
       isValid = true;
       return true;
     }
@@ -1039,7 +1607,7 @@ static bool propogateValues(const Query& query, CexData &cd,
 
     // If this constraint is known to be false, then we can prove anything, so
     // the query is valid.
-    if (cd.evaluateExact(*it)->isFalse()) {
+    if (cd.evaluateExact(*it)->isFalse() || cd.evalBits(*it) == isFalse) {
       isValid = true;
       return true;
     }
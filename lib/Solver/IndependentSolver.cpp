@@ -13,6 +13,7 @@
 #include "klee/Expr/Assignment.h"
 #include "klee/Expr/Constraints.h"
 #include "klee/Expr/Expr.h"
+#include "klee/Expr/ExprHashMap.h"
 #include "klee/Expr/ExprUtil.h"
 #include "klee/Internal/Support/Debug.h"
 #include "klee/Internal/Support/ErrorHandling.h"
@@ -23,9 +24,19 @@
 
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
 #include <list>
 #include <map>
+#include <new>
 #include <ostream>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #include <vector>
 
 #undef INDEPENDENT_DEBUG
@@ -47,9 +58,30 @@ using llvm::errs;
  * @param[out] eltsClosure - An IndependentElementSet structure containing the
  *     query expr and all related constraints expr
  */
+// Collect the factors of the constraints in query.
+static void getQueryFactors(const Query &query,
+                            std::vector<IndependentElementSet *> &factors) {
+  if (&query.constraints == &query.constraintMgr.getAllConstraints()) {
+    // the query contains all constraints managed by the ConstraintManager
+    factors.reserve(query.constraintMgr.factor_size());
+    for (auto it = query.constraintMgr.factor_begin(),
+              ie = query.constraintMgr.factor_end();
+         it != ie; ++it)
+      factors.push_back(*it);
+  } else {
+    // the query only contains a subset of constraints
+    IndepElemSetPtrSet_ty related;
+    query.constraintMgr.getRelatedIndependentElementSets(query.constraints,
+                                                         related);
+    factors.assign(related.begin(), related.end());
+  }
+}
+
+/// \param[out] fingerprint - fingerprintConstraints(result)
 static void getIndependentConstraints(const Query &query,
                                       Constraints_ty &result,
-                                      IndependentElementSet &eltsClosure) {
+                                      IndependentElementSet &eltsClosure,
+                                      uint64_t &fingerprint) {
 
   eltsClosure = IndependentElementSet(query.expr);
 
@@ -80,8 +112,11 @@ static void getIndependentConstraints(const Query &query,
     eltsClosure.add(*indep);
   }
   result.reserve(eltsClosure.exprs.size());
+  // the factors have no constraint in common
+  fingerprint = 0;
   for (IndependentElementSet *indep : indep_elemsets) {
     result.insert(indep->exprs.begin(), indep->exprs.end());
+    fingerprint += indep->fingerprint;
   }
 
   // **********************************************************
@@ -110,26 +145,94 @@ static void getIndependentConstraints(const Query &query,
 static
 void calculateArrayReferences(const IndependentElementSet & ie,
                               std::unordered_set<const Array *> &returnSet){
-  for(std::map<const Array*, DenseSet<unsigned> >::const_iterator it = ie.elements.begin();
+  for(IndependentElementSet::elements_ty::const_iterator it = ie.elements.begin();
       it != ie.elements.end(); it ++){
     returnSet.insert(it->first);
   }
-  for(std::set<const Array *>::iterator it = ie.wholeObjects.begin();
+  for(IndependentElementSet::wholeObjects_ty::const_iterator it = ie.wholeObjects.begin();
       it != ie.wholeObjects.end(); it ++){
     returnSet.insert(*it);
   }
 }
 
+namespace {
+/// A single computeInitialValues call on a factor or a batch of factors
+struct FactorQuery {
+  const Constraints_ty *constraints;
+  const IndependentElementSet *elements;
+  std::vector<const Array *> arrays;
+};
+typedef std::vector<std::vector<unsigned char> > FactorValues;
+
+FactorQuery getFactorQuery(const IndependentElementSet *indep) {
+  std::unordered_set<const Array *> arrays;
+  calculateArrayReferences(*indep, arrays);
+  return FactorQuery{&indep->exprs, indep,
+                     std::vector<const Array *>(arrays.begin(), arrays.end())};
+}
+} // namespace
+
 class IndependentSolver : public SolverImpl {
 private:
   Solver *solver;
+  /// cleared if workers cannot be set up, factors are then solved in-process
+  bool forkWorkers;
+
+  /// Solve every factor query, on IndependentSolverJobs forked workers if
+  /// there is more than one. results[i] is only meaningful if all factor
+  /// queries are satisfiable.
+  /// \return false if a solver call failed
+  bool solveFactors(const Query &query, const std::vector<FactorQuery> &parts,
+                    std::vector<FactorValues> &results, bool &hasSolution);
+  bool solveFactorsForked(const Query &query,
+                          const std::vector<FactorQuery> &parts,
+                          std::vector<FactorValues> &results,
+                          bool &hasSolution);
+
+  /// The values of each array in the last model found for the constraints
+  /// of its factor, which fill in the bytes that a slice leaves open
+  std::unordered_map<const Array *, std::vector<unsigned char> > lastModel;
+
+  /// The solutions of the factors of recent initial values queries, by the
+  /// fingerprint of their constraints. The states terminating on sibling
+  /// paths share most of their factors, e.g. those on the argv arrays.
+  struct FactorSolution {
+    ExprHashSet constraints;
+    std::vector<const Array *> arrays;
+    FactorValues values;
+    std::list<uint64_t>::iterator lru;
+  };
+  std::unordered_map<uint64_t, FactorSolution> factorSolutions;
+  /// keys of factorSolutions, most recently used first
+  std::list<uint64_t> factorSolutionsLRU;
+
+  /// Set values to the cached solution of the arrays of part.
+  /// \return false if the constraints of part were not solved recently
+  bool lookupFactorSolution(const FactorQuery &part, FactorValues &values);
+  void storeFactorSolution(const FactorQuery &part,
+                           const FactorValues &values);
+
+  /// Whether the query should be solved by slicing its constraints
+  static bool shouldSlice(const Constraints_ty &required) {
+    return IndependentSlicingThreshold &&
+           required.size() >= IndependentSlicingThreshold;
+  }
+  /// Decide whether the constraints of query and the negation of its
+  /// expression have a solution, starting with the constraints that read a
+  /// byte the expression reads and adding those that the models found for
+  /// the slice violate.
+  /// \return false if a solver call failed
+  bool solveSliced(const Query &query, bool &hasSolution);
 
 public:
   IndependentSolver(Solver *_solver) 
-    : solver(_solver) {}
+    : solver(_solver), forkWorkers(true) {}
   ~IndependentSolver() { delete solver; }
 
   bool computeTruth(const Query&, bool &isValid);
+  bool computeTruthBatch(const Query &query,
+                         const std::vector<ref<Expr> > &exprs,
+                         std::vector<bool> &isValid);
   bool computeValidity(const Query&, Solver::Validity &result);
   bool computeValue(const Query&, ref<Expr> &result);
   bool computeInitialValues(const Query& query,
@@ -164,27 +267,186 @@ bool IndependentSolver::computeValidity(const Query& query,
   TimerStatIncrementer t(stats::independentTime);
   Constraints_ty required;
   IndependentElementSet eltsClosure;
-  getIndependentConstraints(query, required, eltsClosure);
-  return solver->impl->computeValidity(
-      Query(query.constraintMgr, required, query.expr, &eltsClosure), result);
+  Query independent(query.constraintMgr, required, query.expr, &eltsClosure);
+  getIndependentConstraints(query, required, eltsClosure,
+                            independent.fingerprint);
+  if (shouldSlice(required)) {
+    bool hasSolution;
+    if (!solveSliced(independent, hasSolution))
+      return false;
+    if (!hasSolution) {
+      result = Solver::True;
+      return true;
+    }
+    if (!solveSliced(independent.negateExpr(), hasSolution))
+      return false;
+    result = hasSolution ? Solver::Unknown : Solver::False;
+    return true;
+  }
+  return solver->impl->computeValidity(independent, result);
 }
 
 bool IndependentSolver::computeTruth(const Query& query, bool &isValid) {
   TimerStatIncrementer t(stats::independentTime);
   Constraints_ty required;
   IndependentElementSet eltsClosure;
-  getIndependentConstraints(query, required, eltsClosure);
-  return solver->impl->computeTruth(
-      Query(query.constraintMgr, required, query.expr, &eltsClosure), isValid);
+  Query independent(query.constraintMgr, required, query.expr, &eltsClosure);
+  getIndependentConstraints(query, required, eltsClosure,
+                            independent.fingerprint);
+  if (shouldSlice(required)) {
+    bool hasSolution;
+    if (!solveSliced(independent, hasSolution))
+      return false;
+    isValid = !hasSolution;
+    return true;
+  }
+  return solver->impl->computeTruth(independent, isValid);
+}
+
+bool IndependentSolver::solveSliced(const Query &query, bool &hasSolution) {
+  // rounds of refinement before the remaining constraints are all added
+  const unsigned MaxSliceRounds = 8;
+  ++stats::independentSlicedQueries;
+
+  // the slice starts with the constraints that read a byte the expression
+  // reads, the others wait with the bytes they read
+  IndependentElementSet exprElements(query.expr);
+  IndependentElementSet sliceElements(exprElements);
+  Constraints_ty slice;
+  std::vector<std::pair<ref<Expr>, IndependentElementSet> > rest;
+  for (const ref<Expr> &constraint : query.constraints) {
+    IndependentElementSet elements(constraint);
+    if (elements.intersects(exprElements)) {
+      slice.insert(constraint);
+      sliceElements.add(elements);
+    } else {
+      rest.emplace_back(constraint, std::move(elements));
+    }
+  }
+
+  std::vector<ref<Expr> > all(query.constraints.begin(),
+                              query.constraints.end());
+  all.push_back(query.expr);
+  std::vector<const Array *> objects;
+  findSymbolicObjects(all.begin(), all.end(), objects);
+
+  for (unsigned round = 0;; ++round) {
+    bool complete = rest.empty() || round == MaxSliceRounds;
+    if (complete) {
+      for (const auto &constraint : rest)
+        slice.insert(constraint.first);
+      rest.clear();
+    }
+    std::vector<std::vector<unsigned char> > values;
+    if (!solver->impl->computeInitialValues(
+            Query(query.constraintMgr, slice, query.expr), objects, values,
+            hasSolution))
+      return false;
+    if (!hasSolution)
+      return true;
+
+    // the bytes the slice does not read keep their values of the last model
+    for (unsigned i = 0; i < objects.size() && !complete; ++i) {
+      auto last = lastModel.find(objects[i]);
+      if (last == lastModel.end() || last->second.size() != values[i].size() ||
+          sliceElements.wholeObjects.count(objects[i]))
+        continue;
+      std::vector<unsigned char> merged = last->second;
+      auto read = sliceElements.elements.find(objects[i]);
+      if (read != sliceElements.elements.end())
+        for (unsigned index : read->second)
+          merged[index] = values[i][index];
+      values[i].swap(merged);
+    }
+
+    Assignment model(objects, std::move(values));
+    AssignmentEvaluator evaluator(model);
+    auto violated = std::partition(
+        rest.begin(), rest.end(),
+        [&evaluator](const std::pair<ref<Expr>, IndependentElementSet> &c) {
+          return cast<ConstantExpr>(evaluator.visit(c.first))->isTrue();
+        });
+    if (violated == rest.end()) {
+      // a model of all the constraints
+      if (lastModel.size() > 65536)
+        lastModel.clear();
+      for (const auto &binding : model.bindings)
+        lastModel[binding.first] = binding.second;
+      return true;
+    }
+    ++stats::independentSliceRefinements;
+    for (auto it = violated; it != rest.end(); ++it) {
+      slice.insert(it->first);
+      sliceElements.add(it->second);
+    }
+    rest.erase(violated, rest.end());
+  }
+}
+
+bool IndependentSolver::computeTruthBatch(const Query &query,
+                                          const std::vector<ref<Expr> > &exprs,
+                                          std::vector<bool> &isValid) {
+  TimerStatIncrementer t(stats::independentTime);
+  // the expressions that need the same constraints are solved together
+  struct Group {
+    Constraints_ty required;
+    IndependentElementSet eltsClosure;
+    uint64_t fingerprint;
+    std::vector<ref<Expr> > exprs;
+    std::vector<unsigned> positions;
+  };
+  std::vector<Group> groups;
+  for (unsigned i = 0; i < exprs.size(); ++i) {
+    Constraints_ty required;
+    IndependentElementSet eltsClosure;
+    uint64_t fingerprint;
+    getIndependentConstraints(query.withExpr(exprs[i]), required, eltsClosure,
+                              fingerprint);
+    auto it = std::find_if(groups.begin(), groups.end(), [&](const Group &g) {
+      return g.fingerprint == fingerprint && g.required == required;
+    });
+    if (it == groups.end()) {
+      groups.push_back({std::move(required), std::move(eltsClosure),
+                        fingerprint, {}, {}});
+      it = groups.end() - 1;
+    } else {
+      it->eltsClosure.add(eltsClosure);
+    }
+    it->exprs.push_back(exprs[i]);
+    it->positions.push_back(i);
+  }
+
+  isValid.assign(exprs.size(), false);
+  for (const Group &g : groups) {
+    Query independent(query.constraintMgr, g.required, g.exprs[0],
+                      &g.eltsClosure);
+    independent.fingerprint = g.fingerprint;
+    std::vector<bool> groupIsValid;
+    if (shouldSlice(g.required)) {
+      for (const ref<Expr> &e : g.exprs) {
+        bool hasSolution;
+        if (!solveSliced(independent.withExpr(e), hasSolution))
+          return false;
+        groupIsValid.push_back(!hasSolution);
+      }
+    } else if (!solver->impl->computeTruthBatch(independent, g.exprs,
+                                                groupIsValid)) {
+      return false;
+    }
+    for (unsigned i = 0; i < g.positions.size(); ++i)
+      isValid[g.positions[i]] = groupIsValid[i];
+  }
+  return true;
 }
 
 bool IndependentSolver::computeValue(const Query& query, ref<Expr> &result) {
   TimerStatIncrementer t(stats::independentTime);
   Constraints_ty required;
   IndependentElementSet eltsClosure;
-  getIndependentConstraints(query, required, eltsClosure);
-  return solver->impl->computeValue(
-      Query(query.constraintMgr, required, query.expr, &eltsClosure), result);
+  Query independent(query.constraintMgr, required, query.expr, &eltsClosure);
+  getIndependentConstraints(query, required, eltsClosure,
+                            independent.fingerprint);
+  return solver->impl->computeValue(independent, result);
 }
 
 // Helper function used only for assertions to make sure point created
@@ -242,32 +504,16 @@ bool IndependentSolver::computeInitialValuesPerFactor(
   // This is important in case we don't have any constraints but
   // we need initial values for requested array objects.
   hasSolution = true;
-  IndepElemSetPtrSet_ty::const_iterator factors_begin;
-  IndepElemSetPtrSet_ty::const_iterator factors_end;
-  // factors is only used if the query only contains a subset of constraints
-  IndepElemSetPtrSet_ty factors;
-  size_t factors_size __attribute__((unused));
-  if (&query.constraints == &query.constraintMgr.getAllConstraints()) {
-    // the query contains all constraints managed by the ConstraintManager
-    factors_begin = query.constraintMgr.factor_begin();
-    factors_end = query.constraintMgr.factor_end();
-    factors_size = query.constraintMgr.factor_size();
-  } else {
-    // the query only contains a subset of constraints
-    query.constraintMgr.getRelatedIndependentElementSets(query.constraints,
-                                                         factors);
-    factors_begin = factors.begin();
-    factors_end = factors.end();
-    factors_size = factors.size();
-  }
+  std::vector<IndependentElementSet *> factors;
+  getQueryFactors(query, factors);
 
   //Used to rearrange all of the answers into the correct order
   std::unordered_map<const Array*, std::vector<unsigned char> > retMap;
 #ifdef INDEPENDENT_DEBUG
   unsigned int id = 0;
 #endif
-  for (IndepElemSetPtrSet_ty::const_iterator it = factors_begin;
-       it != factors_end; ++it) {
+  std::vector<FactorQuery> parts;
+  for (auto it = factors.begin(), ie = factors.end(); it != ie; ++it) {
     const IndependentElementSet *indep = *it;
     std::unordered_set<const Array*> arraysInFactorSet;
     calculateArrayReferences(*indep, arraysInFactorSet);
@@ -280,63 +526,83 @@ bool IndependentSolver::computeInitialValuesPerFactor(
     }
 #ifdef INDEPENDENT_DEBUG
     /* IndependentSolver performance debugging */
-    llvm::errs() << "independent set " << id << " / " << factors_size
+    llvm::errs() << "independent set " << id << " / " << factors.size()
                  << " #array: " << arraysInFactor.size()
-                 << " #expr: " << indep->exprs.size() << ' ';
+                 << " #expr: " << indep->exprs.size() << '\n';
 #ifdef INDEPENDENT_DEBUG_DUMPCONSTRAINTS
     char dumpfilename[128];
     snprintf(dumpfilename, sizeof(dumpfilename), "independentQuery_%05u.kquery",
              id);
-    ++id;
     debugDumpConstraintsImpl(indep->exprs, arraysInFactor, dumpfilename);
 #endif
-    const WallTimer solver_timer;
+    ++id;
 #endif
-    std::vector<std::vector<unsigned char> > tempValues;
-    if (!solver->impl->computeInitialValues(
-            Query(query.constraintMgr, indep->exprs,
-                  ConstantExpr::alloc(0, Expr::Bool), indep),
-            arraysInFactor, tempValues, hasSolution)) {
-      values.clear();
-      return false;
-    } else if (!hasSolution) {
-      values.clear();
-      return true;
-    } else {
+    parts.push_back(FactorQuery{&indep->exprs, indep, arraysInFactor});
+  }
+
 #ifdef INDEPENDENT_DEBUG
-      time::Span solver_time = solver_timer.delta();
-      const WallTimer result_timer;
+  const WallTimer solver_timer;
 #endif
-      assert(tempValues.size() == arraysInFactor.size() &&
-             "Should be equal number arrays and answers");
-      for (unsigned i = 0; i < tempValues.size(); i++){
-        if (retMap.count(arraysInFactor[i])){
-          // We already have an array with some partially correct answers,
-          // so we need to place the answers to the new query into the right
-          // spot while avoiding the undetermined values also in the array
-          std::vector<unsigned char> * tempPtr = &retMap[arraysInFactor[i]];
-          assert(tempPtr->size() == tempValues[i].size() &&
-                 "we're talking about the same array here");
-          auto find_it = indep->elements.find(arraysInFactor[i]);
-          assert(find_it != indep->elements.end());
-          const DenseSet<unsigned> * ds = &(find_it->second);
-          for (auto it2 = ds->begin(); it2 != ds->end(); it2++){
-            unsigned index = * it2;
-            (* tempPtr)[index] = tempValues[i][index];
-          }
-        } else {
-          // Dump all the new values into the array
-          retMap[arraysInFactor[i]] = tempValues[i];
-        }
-      }
+  // only the factors not solved by a recent query are solved
+  std::vector<FactorValues> partValues(parts.size());
+  std::vector<FactorQuery> unsolved;
+  std::vector<unsigned> unsolvedParts;
+  for (unsigned p = 0; p < parts.size(); ++p) {
+    if (!lookupFactorSolution(parts[p], partValues[p])) {
+      unsolved.push_back(parts[p]);
+      unsolvedParts.push_back(p);
+    }
+  }
+  std::vector<FactorValues> unsolvedValues;
+  if (!solveFactors(query, unsolved, unsolvedValues, hasSolution)) {
+    values.clear();
+    return false;
+  } else if (!hasSolution) {
+    values.clear();
+    return true;
+  }
+  for (unsigned i = 0; i < unsolved.size(); ++i) {
+    storeFactorSolution(unsolved[i], unsolvedValues[i]);
+    partValues[unsolvedParts[i]].swap(unsolvedValues[i]);
+  }
 #ifdef INDEPENDENT_DEBUG
-      time::Span result_time = result_timer.delta();
-      llvm::errs() << "solver_time(us): " << solver_time.toMicroseconds()
-                   << " result_time(us): " << result_time.toMicroseconds()
-                   << "\n";
+  time::Span solver_time = solver_timer.delta();
+  const WallTimer result_timer;
 #endif
+
+  for (unsigned p = 0; p < parts.size(); ++p) {
+    const IndependentElementSet *indep = parts[p].elements;
+    const std::vector<const Array *> &arraysInFactor = parts[p].arrays;
+    FactorValues &tempValues = partValues[p];
+    assert(tempValues.size() == arraysInFactor.size() &&
+           "Should be equal number arrays and answers");
+    for (unsigned i = 0; i < tempValues.size(); i++){
+      if (retMap.count(arraysInFactor[i])){
+        // We already have an array with some partially correct answers,
+        // so we need to place the answers to the new query into the right
+        // spot while avoiding the undetermined values also in the array
+        std::vector<unsigned char> * tempPtr = &retMap[arraysInFactor[i]];
+        assert(tempPtr->size() == tempValues[i].size() &&
+               "we're talking about the same array here");
+        auto find_it = indep->elements.find(arraysInFactor[i]);
+        assert(find_it != indep->elements.end());
+        const DenseSet<unsigned> * ds = &(find_it->second);
+        for (auto it2 = ds->begin(); it2 != ds->end(); it2++){
+          unsigned index = * it2;
+          (* tempPtr)[index] = tempValues[i][index];
+        }
+      } else {
+        // Dump all the new values into the array
+        retMap[arraysInFactor[i]].swap(tempValues[i]);
+      }
     }
   }
+#ifdef INDEPENDENT_DEBUG
+  time::Span result_time = result_timer.delta();
+  llvm::errs() << "solver_time(us): " << solver_time.toMicroseconds()
+               << " result_time(us): " << result_time.toMicroseconds()
+               << "\n";
+#endif
   for (std::vector<const Array *>::const_iterator it = objects.begin();
        it != objects.end(); it++){
     const Array * arr = * it;
@@ -366,6 +632,236 @@ void IndependentSolver::setCoreSolverTimeout(time::Span timeout) {
   solver->impl->setCoreSolverTimeout(timeout);
 }
 
+bool IndependentSolver::lookupFactorSolution(const FactorQuery &part,
+                                             FactorValues &values) {
+  auto it = factorSolutions.find(part.elements->fingerprint);
+  if (it == factorSolutions.end())
+    return false;
+  const FactorSolution &solution = it->second;
+  // the fingerprint could collide
+  if (solution.constraints.size() != part.constraints->size())
+    return false;
+  for (const ref<Expr> &e : *part.constraints)
+    if (!solution.constraints.count(e))
+      return false;
+
+  values.clear();
+  values.reserve(part.arrays.size());
+  for (const Array *array : part.arrays) {
+    auto pos = std::find(solution.arrays.begin(), solution.arrays.end(), array);
+    if (pos == solution.arrays.end())
+      return false;
+    values.push_back(solution.values[pos - solution.arrays.begin()]);
+  }
+  factorSolutionsLRU.splice(factorSolutionsLRU.begin(), factorSolutionsLRU,
+                            solution.lru);
+  ++stats::independentFactorCacheHits;
+  return true;
+}
+
+void IndependentSolver::storeFactorSolution(const FactorQuery &part,
+                                            const FactorValues &values) {
+  if (!IndependentSolutionCacheSize)
+    return;
+  uint64_t key = part.elements->fingerprint;
+  auto it = factorSolutions.find(key);
+  if (it == factorSolutions.end()) {
+    factorSolutionsLRU.push_front(key);
+    it = factorSolutions.emplace(key, FactorSolution()).first;
+    it->second.lru = factorSolutionsLRU.begin();
+  } else {
+    factorSolutionsLRU.splice(factorSolutionsLRU.begin(), factorSolutionsLRU,
+                              it->second.lru);
+  }
+  FactorSolution &solution = it->second;
+  solution.constraints =
+      ExprHashSet(part.constraints->begin(), part.constraints->end());
+  solution.arrays = part.arrays;
+  solution.values = values;
+
+  while (factorSolutions.size() > IndependentSolutionCacheSize) {
+    factorSolutions.erase(factorSolutionsLRU.back());
+    factorSolutionsLRU.pop_back();
+  }
+}
+
+bool IndependentSolver::solveFactors(const Query &query,
+                                     const std::vector<FactorQuery> &parts,
+                                     std::vector<FactorValues> &results,
+                                     bool &hasSolution) {
+  hasSolution = true;
+  results.assign(parts.size(), FactorValues());
+  if (forkWorkers && IndependentSolverJobs > 1 && parts.size() > 1)
+    return solveFactorsForked(query, parts, results, hasSolution);
+
+  for (unsigned i = 0; i < parts.size(); ++i) {
+    if (!solver->impl->computeInitialValues(
+            Query(query.constraintMgr, *parts[i].constraints,
+                  ConstantExpr::alloc(0, Expr::Bool), parts[i].elements),
+            parts[i].arrays, results[i], hasSolution))
+      return false;
+    if (!hasSolution)
+      return true;
+  }
+  return true;
+}
+
+static bool writeAll(int fd, const std::string &data) {
+  for (size_t done = 0; done < data.size();) {
+    ssize_t n = ::write(fd, data.data() + done, data.size() - done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    done += n;
+  }
+  return true;
+}
+
+// Workers are forked rather than threads, expressions and the solvers below
+// are not thread-safe. Each worker owns a copy-on-write image of the solver
+// chain, factor queries are handed out through a counter in shared memory,
+// and every result is sent back as
+//   uint32 factor, uint8 status (0 failed, 1 unsatisfiable, 2 satisfiable),
+//   then for satisfiable factors the bytes of each array of the factor.
+bool IndependentSolver::solveFactorsForked(
+    const Query &query, const std::vector<FactorQuery> &parts,
+    std::vector<FactorValues> &results, bool &hasSolution) {
+  struct Shared {
+    std::atomic<uint32_t> next;
+    std::atomic<bool> stop;
+  };
+  void *mem = ::mmap(nullptr, sizeof(Shared), PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    klee_warning("cannot map shared memory for factor workers, solving "
+                 "sequentially");
+    forkWorkers = false;
+    return solveFactors(query, parts, results, hasSolution);
+  }
+  Shared *shared = new (mem) Shared();
+  shared->next = 0;
+  shared->stop = false;
+
+  unsigned jobs = std::min<size_t>(IndependentSolverJobs, parts.size());
+  std::vector<pid_t> pids;
+  std::vector<int> fds;
+  std::vector<std::string> buffers;
+  fflush(stdout);
+  fflush(stderr);
+  for (unsigned w = 0; w < jobs; ++w) {
+    int pipefd[2];
+    if (::pipe(pipefd) != 0)
+      break;
+    pid_t pid = ::fork();
+    if (pid == 0) {
+      ::close(pipefd[0]);
+      for (int fd : fds)
+        ::close(fd);
+      for (uint32_t i; !shared->stop && (i = shared->next++) < parts.size();) {
+        FactorValues v;
+        bool solvable;
+        bool ok = solver->impl->computeInitialValues(
+            Query(query.constraintMgr, *parts[i].constraints,
+                  ConstantExpr::alloc(0, Expr::Bool), parts[i].elements),
+            parts[i].arrays, v, solvable);
+        std::string record((const char *)&i, sizeof(i));
+        record += (char)(!ok ? 0 : solvable ? 2 : 1);
+        if (ok && solvable)
+          for (auto &bytes : v)
+            record.append(bytes.begin(), bytes.end());
+        else
+          shared->stop = true;
+        if (!writeAll(pipefd[1], record))
+          break;
+      }
+      _exit(0);
+    }
+    ::close(pipefd[1]);
+    if (pid < 0) {
+      ::close(pipefd[0]);
+      break;
+    }
+    pids.push_back(pid);
+    fds.push_back(pipefd[0]);
+  }
+  buffers.resize(fds.size());
+
+  for (unsigned open = fds.size(); open;) {
+    std::vector<pollfd> pfds;
+    // poll ignores the negative descriptors of closed pipes
+    for (int fd : fds)
+      pfds.push_back(pollfd{fd, POLLIN, 0});
+    if (::poll(pfds.data(), pfds.size(), -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    for (unsigned w = 0; w < fds.size(); ++w) {
+      if (fds[w] < 0 || !pfds[w].revents)
+        continue;
+      char buf[1 << 16];
+      ssize_t n = ::read(fds[w], buf, sizeof(buf));
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n > 0) {
+        buffers[w].append(buf, n);
+      } else {
+        ::close(fds[w]);
+        fds[w] = -1;
+        --open;
+      }
+    }
+  }
+  for (int fd : fds)
+    if (fd >= 0)
+      ::close(fd);
+  for (pid_t pid : pids) {
+    int status;
+    while (::waitpid(pid, &status, 0) < 0 && errno == EINTR)
+      ;
+  }
+  shared->~Shared();
+  ::munmap(mem, sizeof(Shared));
+
+  std::vector<bool> solved(parts.size(), false);
+  bool failed = false;
+  for (const std::string &buffer : buffers) {
+    size_t pos = 0;
+    while (buffer.size() - pos >= sizeof(uint32_t) + 1) {
+      uint32_t i;
+      memcpy(&i, buffer.data() + pos, sizeof(i));
+      char status = buffer[pos + sizeof(i)];
+      pos += sizeof(i) + 1;
+      if (i >= parts.size())
+        break;
+      if (status == 0) {
+        failed = true;
+        continue;
+      }
+      if (status == 1) {
+        hasSolution = false;
+        continue;
+      }
+      FactorValues &v = results[i];
+      for (const Array *array : parts[i].arrays) {
+        if (buffer.size() - pos < array->size)
+          break;
+        v.emplace_back(buffer.begin() + pos, buffer.begin() + pos + array->size);
+        pos += array->size;
+      }
+      solved[i] = v.size() == parts[i].arrays.size();
+    }
+  }
+
+  // one unsatisfiable factor decides the query even if others failed
+  if (!hasSolution)
+    return true;
+  if (failed || std::find(solved.begin(), solved.end(), false) != solved.end())
+    return false;
+  return true;
+}
+
 Solver *klee::createIndependentSolver(Solver *s) {
   return new Solver(new IndependentSolver(s));
 }
@@ -382,21 +878,8 @@ bool IndependentSolver::computeInitialValuesBatch(const Query& query,
   // This is important in case we don't have any constraints but
   // we need initial values for requested array objects.
   hasSolution = true;
-  IndepElemSetPtrSet_ty::const_iterator factors_begin;
-  IndepElemSetPtrSet_ty::const_iterator factors_end;
-  // factors is only used if the query only contains a subset of constraints
-  IndepElemSetPtrSet_ty factors;
-  if (&query.constraints == &query.constraintMgr.getAllConstraints()) {
-    // the query contains all constraints managed by the ConstraintManager
-    factors_begin = query.constraintMgr.factor_begin();
-    factors_end = query.constraintMgr.factor_end();
-  } else {
-    // the query only contains a subset of constraints
-    query.constraintMgr.getRelatedIndependentElementSets(query.constraints,
-                                                         factors);
-    factors_begin = factors.begin();
-    factors_end = factors.end();
-  }
+  std::vector<IndependentElementSet *> factors;
+  getQueryFactors(query, factors);
 
   //Used to rearrange all of the answers into the correct order
   std::unordered_map<const Array*, std::vector<unsigned char> > retMap;
@@ -405,10 +888,27 @@ bool IndependentSolver::computeInitialValuesBatch(const Query& query,
 #ifdef INDEPENDENT_DEBUG
   unsigned int id = 0;
 #endif
+  // the factors solved by a recent query keep their solution
+  std::vector<FactorQuery> cachedParts;
+  std::vector<FactorValues> cachedValues;
+  if (IndependentSolutionCacheSize) {
+    std::vector<IndependentElementSet *> unsolved;
+    for (IndependentElementSet *indep : factors) {
+      FactorQuery part = getFactorQuery(indep);
+      FactorValues factorValues;
+      if (lookupFactorSolution(part, factorValues)) {
+        cachedParts.push_back(std::move(part));
+        cachedValues.push_back(std::move(factorValues));
+      } else {
+        unsolved.push_back(indep);
+      }
+    }
+    factors.swap(unsolved);
+  }
+
   unsigned int acc_expr_cnt = 0;
   unsigned int acc_factor_cnt = 0;
-  for (IndepElemSetPtrSet_ty::const_iterator it = factors_begin;
-       it != factors_end; ++it) {
+  for (auto it = factors.begin(), ie = factors.end(); it != ie; ++it) {
     IndependentElementSet *indep = *it;
     assert(indep->exprs.size() >= 1 && "No null/empty factors");
     if (acc_expr_cnt >= ExprNumThreshold) {
@@ -438,11 +938,15 @@ bool IndependentSolver::computeInitialValuesBatch(const Query& query,
 #else
   }
 #endif
-  for (const IndEleSetPart_t &p : part_container) {
-    Constraints_ty constraints;
+  std::vector<Constraints_ty> partConstraints(part_container.size());
+  std::vector<IndependentElementSet> partElements(part_container.size());
+  std::vector<FactorQuery> parts;
+  for (unsigned n = 0; n < part_container.size(); ++n) {
+    const IndEleSetPart_t &p = part_container[n];
+    Constraints_ty &constraints = partConstraints[n];
     std::unordered_set<const Array *> arraysInFactorSet;
     std::vector<const Array *> arraysInFactor;
-    IndependentElementSet combined;
+    IndependentElementSet &combined = partElements[n];
     for (IndependentElementSet *indep : p) {
       calculateArrayReferences(*indep, arraysInFactorSet);
       // Going to use this as the "fresh" expression for the Query() invocation
@@ -458,63 +962,96 @@ bool IndependentSolver::computeInitialValuesBatch(const Query& query,
     /* IndependentSolver performance debugging */
     llvm::errs() << "independent set part" << id
                  << " #array: " << arraysInFactor.size()
-                 << " #expr: " << constraints.size() << ' ';
+                 << " #expr: " << constraints.size() << '\n';
     char dumpfilename[128];
     snprintf(dumpfilename, sizeof(dumpfilename), "independentQuery_%05u.kquery",
              id);
     ++id;
     debugDumpConstraintsImpl(constraints, arraysInFactor, dumpfilename);
-    const WallTimer solver_timer;
 #endif
-    std::vector<std::vector<unsigned char>> tempValues;
-    if (!solver->impl->computeInitialValues(
-            Query(query.constraintMgr, constraints,
-                  ConstantExpr::alloc(0, Expr::Bool), &combined),
-            arraysInFactor, tempValues, hasSolution)) {
-      values.clear();
-      return false;
-    } else if (!hasSolution) {
-      values.clear();
-      return true;
-    } else {
+    parts.push_back(FactorQuery{&constraints, &combined, arraysInFactor});
+  }
+
+#ifdef INDEPENDENT_DEBUG
+  const WallTimer solver_timer;
+#endif
+  std::vector<FactorValues> partValues;
+  if (!solveFactors(query, parts, partValues, hasSolution)) {
+    values.clear();
+    return false;
+  } else if (!hasSolution) {
+    values.clear();
+    return true;
+  }
+  // the solution of a batch is one of each of its factors
+  for (unsigned n = 0; IndependentSolutionCacheSize && n < parts.size(); ++n) {
+    for (IndependentElementSet *indep : part_container[n]) {
+      FactorQuery part = getFactorQuery(indep);
+      FactorValues factorValues;
+      for (const Array *array : part.arrays) {
+        auto pos = std::find(parts[n].arrays.begin(), parts[n].arrays.end(),
+                             array);
+        factorValues.push_back(partValues[n][pos - parts[n].arrays.begin()]);
+      }
+      storeFactorSolution(part, factorValues);
+    }
+  }
 #ifdef INDEPENDENT_DEBUG
-      time::Span solver_time = solver_timer.delta();
-      const WallTimer result_timer;
+  time::Span solver_time = solver_timer.delta();
+  const WallTimer result_timer;
 #endif
-      assert(tempValues.size() == arraysInFactor.size() &&
-             "Should be equal number arrays and answers");
-      for (unsigned i = 0; i < tempValues.size(); i++) {
-        if (retMap.count(arraysInFactor[i])) {
-          // We already have an array with some partially correct answers,
-          // so we need to place the answers to the new query into the right
-          // spot while avoiding the undetermined values also in the array
-          std::vector<unsigned char> *tempPtr = &retMap[arraysInFactor[i]];
-          assert(tempPtr->size() == tempValues[i].size() &&
-                 "we're talking about the same array here");
-          for (IndependentElementSet *it : p) {
-            auto find_it = it->elements.find(arraysInFactor[i]);
-            // assert(find_it != it->elements.end() &&
-            //       "Array found in IndependentElementSet is now gone");
-            if (find_it != it->elements.end()) {
-              const DenseSet<unsigned> &ds = find_it->second;
-              for (auto index : ds) {
-                (*tempPtr)[index] = tempValues[i][index];
-              }
+
+  for (unsigned n = 0; n < part_container.size(); ++n) {
+    const IndEleSetPart_t &p = part_container[n];
+    const std::vector<const Array *> &arraysInFactor = parts[n].arrays;
+    FactorValues &tempValues = partValues[n];
+    assert(tempValues.size() == arraysInFactor.size() &&
+           "Should be equal number arrays and answers");
+    for (unsigned i = 0; i < tempValues.size(); i++) {
+      if (retMap.count(arraysInFactor[i])) {
+        // We already have an array with some partially correct answers,
+        // so we need to place the answers to the new query into the right
+        // spot while avoiding the undetermined values also in the array
+        std::vector<unsigned char> *tempPtr = &retMap[arraysInFactor[i]];
+        assert(tempPtr->size() == tempValues[i].size() &&
+               "we're talking about the same array here");
+        for (IndependentElementSet *it : p) {
+          auto find_it = it->elements.find(arraysInFactor[i]);
+          // assert(find_it != it->elements.end() &&
+          //       "Array found in IndependentElementSet is now gone");
+          if (find_it != it->elements.end()) {
+            const DenseSet<unsigned> &ds = find_it->second;
+            for (auto index : ds) {
+              (*tempPtr)[index] = tempValues[i][index];
             }
           }
-        } else {
-          // Dump all the new values into the array
-          retMap[arraysInFactor[i]] = tempValues[i];
         }
+      } else {
+        // Dump all the new values into the array
+        retMap[arraysInFactor[i]].swap(tempValues[i]);
       }
-#ifdef INDEPENDENT_DEBUG
-      time::Span result_time = result_timer.delta();
-      llvm::errs() << "solver_time(us): " << solver_time.toMicroseconds()
-                   << " result_time(us): " << result_time.toMicroseconds()
-                   << "\n";
-#endif
     }
   }
+  for (unsigned n = 0; n < cachedParts.size(); ++n) {
+    const std::vector<const Array *> &arraysInFactor = cachedParts[n].arrays;
+    for (unsigned i = 0; i < arraysInFactor.size(); i++) {
+      auto found = retMap.find(arraysInFactor[i]);
+      if (found == retMap.end()) {
+        retMap[arraysInFactor[i]].swap(cachedValues[n][i]);
+        continue;
+      }
+      auto find_it = cachedParts[n].elements->elements.find(arraysInFactor[i]);
+      if (find_it != cachedParts[n].elements->elements.end())
+        for (auto index : find_it->second)
+          found->second[index] = cachedValues[n][i][index];
+    }
+  }
+#ifdef INDEPENDENT_DEBUG
+  time::Span result_time = result_timer.delta();
+  llvm::errs() << "solver_time(us): " << solver_time.toMicroseconds()
+               << " result_time(us): " << result_time.toMicroseconds()
+               << "\n";
+#endif
   for (std::vector<const Array *>::const_iterator it = objects.begin();
        it != objects.end(); it++){
     const Array * arr = * it;
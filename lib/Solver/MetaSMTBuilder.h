@@ -22,6 +22,8 @@
 
 #include "llvm/Support/CommandLine.h"
 
+#include <list>
+
 #include <metaSMT/frontend/Logic.hpp>
 #include <metaSMT/frontend/QF_BV.hpp>
 #include <metaSMT/frontend/Array.hpp>
@@ -36,6 +38,12 @@ llvm::cl::opt<bool> UseConstructHashMetaSMT(
     "use-construct-hash-metasmt",
     llvm::cl::desc("Use hash-consing during metaSMT query construction."),
     llvm::cl::init(true));
+
+llvm::cl::opt<unsigned> MetaSMTConstructCacheSize(
+    "metasmt-construct-cache-size", llvm::cl::init(0),
+    llvm::cl::desc("Keep the metaSMT translations of up to N expressions "
+                   "across queries, evicting the least recently used ones "
+                   "(default=0, i.e. clear the cache after every query)"));
 }
 
 namespace klee {
@@ -62,10 +70,15 @@ public:
 template <typename SolverContext> class MetaSMTBuilder {
 public:
   MetaSMTBuilder(SolverContext &solver, bool optimizeDivides)
-      : _solver(solver), _optimizeDivides(optimizeDivides){};
+      : _solver(solver), _optimizeDivides(optimizeDivides),
+        _constructCacheCapacity(MetaSMTConstructCacheSize){};
   virtual ~MetaSMTBuilder(){};
 
-  typename SolverContext::result_type construct(ref<Expr> e);
+  typename SolverContext::result_type construct(const ref<Expr> &e);
+
+  /// Evict least recently used translations down to
+  /// -metasmt-construct-cache-size. Called after every query.
+  void trimConstructCache();
 
   typename SolverContext::result_type getInitialRead(const Array *root,
                                                      unsigned index);
@@ -129,8 +142,12 @@ public:
   MetaSMTArray buildArray(unsigned elem_width, unsigned index_width);
 
 private:
-  typedef ExprHashMap<std::pair<typename SolverContext::result_type, unsigned> >
-      MetaSMTExprHashMap;
+  struct ConstructedEntry {
+    typename SolverContext::result_type res;
+    unsigned width;
+    typename std::list<ref<Expr> >::iterator lru;
+  };
+  typedef ExprHashMap<ConstructedEntry> MetaSMTExprHashMap;
   typedef typename MetaSMTExprHashMap::iterator MetaSMTExprHashMapIter;
   typedef typename MetaSMTExprHashMap::const_iterator
       MetaSMTExprHashMapConstIter;
@@ -139,10 +156,13 @@ private:
   bool _optimizeDivides;
   MetaSMTArrayExprHash<SolverContext> _arr_hash;
   MetaSMTExprHashMap _constructed;
+  /// keys of _constructed, most recently used first
+  std::list<ref<Expr> > _constructedLRU;
+  size_t _constructCacheCapacity;
 
-  typename SolverContext::result_type constructActual(ref<Expr> e,
+  typename SolverContext::result_type constructActual(const ref<Expr> &e,
                                                       int *width_out);
-  typename SolverContext::result_type construct(ref<Expr> e, int *width_out);
+  typename SolverContext::result_type construct(const ref<Expr> &e, int *width_out);
 
   typename SolverContext::result_type
   bvBoolExtract(typename SolverContext::result_type expr, int bit);
@@ -577,34 +597,50 @@ MetaSMTBuilder<SolverContext>::bvVarArithRightShift(
 
 template <typename SolverContext>
 typename SolverContext::result_type
-MetaSMTBuilder<SolverContext>::construct(ref<Expr> e) {
-  typename SolverContext::result_type res = construct(e, 0);
-  _constructed.clear();
-  return res;
+MetaSMTBuilder<SolverContext>::construct(const ref<Expr> &e) {
+  return construct(e, 0);
+}
+
+template <typename SolverContext>
+void MetaSMTBuilder<SolverContext>::trimConstructCache() {
+  if (!_constructCacheCapacity) {
+    _constructed.clear();
+    _constructedLRU.clear();
+    return;
+  }
+  while (_constructed.size() > _constructCacheCapacity) {
+    _constructed.erase(_constructedLRU.back());
+    _constructedLRU.pop_back();
+  }
 }
 
 /** if *width_out!=1 then result is a bitvector,
     otherwise it is a bool */
 template <typename SolverContext>
 typename SolverContext::result_type
-MetaSMTBuilder<SolverContext>::construct(ref<Expr> e, int *width_out) {
+MetaSMTBuilder<SolverContext>::construct(const ref<Expr> &e, int *width_out) {
 
   if (!UseConstructHashMetaSMT || isa<ConstantExpr>(e)) {
     return (constructActual(e, width_out));
   } else {
     MetaSMTExprHashMapIter it = _constructed.find(e);
     if (it != _constructed.end()) {
+      _constructedLRU.splice(_constructedLRU.begin(), _constructedLRU,
+                             it->second.lru);
       if (width_out) {
-        *width_out = it->second.second;
+        *width_out = it->second.width;
       }
-      return it->second.first;
+      return it->second.res;
     } else {
       int width = 0;
       if (!width_out) {
         width_out = &width;
       }
       typename SolverContext::result_type res = constructActual(e, width_out);
-      _constructed.insert(std::make_pair(e, std::make_pair(res, *width_out)));
+      _constructedLRU.push_front(e);
+      _constructed.insert(std::make_pair(
+          e, ConstructedEntry{res, (unsigned)*width_out,
+                              _constructedLRU.begin()}));
       return res;
     }
   }
@@ -612,7 +648,7 @@ MetaSMTBuilder<SolverContext>::construct(ref<Expr> e, int *width_out) {
 
 template <typename SolverContext>
 typename SolverContext::result_type
-MetaSMTBuilder<SolverContext>::constructActual(ref<Expr> e, int *width_out) {
+MetaSMTBuilder<SolverContext>::constructActual(const ref<Expr> &e, int *width_out) {
 
   typename SolverContext::result_type res;
 
@@ -207,6 +207,7 @@ bool MetaSMTSolverImpl<SolverContext>::computeInitialValues(
     _runStatusCode = runAndGetCex(query, objects, values, hasSolution);
     success = true;
   }
+  _builder->trimConstructCache();
 
   if (success) {
     if (hasSolution) {
@@ -0,0 +1,525 @@
+//===-- PersistentCachingSolver.cpp - On-disk query cache -----------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A caching layer whose entries survive the process. Queries are keyed on a
+// 128-bit structural hash of the canonicalized query (array names, sizes and
+// contents, expression structure, the set of constraints), so the same query
+// built by another run over the same bitcode hits the cache.
+//
+// The cache file is a header followed by append-only records:
+//   uint32 kind, uint32 payload length, uint64 key[2], payload
+// Kinds are PartialValidity results (int8 payload) and initial values
+// (uint8 hasSolution, uint32 numObjects, then uint32 size and bytes per
+// object). The file is mapped when the solver is created; records of this run
+// are appended with a single write each, so parallel runs can share a file.
+// On a miss the records appended since by the other runs are mapped as well,
+// so e.g. the workers of kleaver -query-jobs see each other's results. A
+// truncated trailing record is ignored.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Solver/Solver.h"
+
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/Expr.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+#include "klee/Solver/IncompleteSolver.h"
+#include "klee/Solver/SolverImpl.h"
+#include "klee/Solver/SolverStats.h"
+
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <memory>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+struct QueryKey {
+  uint64_t a, b;
+  bool operator==(const QueryKey &o) const { return a == o.a && b == o.b; }
+  bool operator<(const QueryKey &o) const {
+    return a < o.a || (a == o.a && b < o.b);
+  }
+};
+
+struct QueryKeyHash {
+  size_t operator()(const QueryKey &k) const { return k.a; }
+};
+
+/// Two independent 64-bit lanes over the structure of expressions. Unlike
+/// Expr::hash() the result does not depend on pointers and is wide enough to
+/// be trusted without comparing the queries themselves.
+class StructuralHasher {
+  std::unordered_map<const Expr *, QueryKey> exprs;
+  std::unordered_map<const UpdateNode *, QueryKey> updateLists;
+  std::unordered_map<const Array *, QueryKey> arrays;
+
+public:
+  static QueryKey seed(uint64_t v) {
+    QueryKey k = {0xcbf29ce484222325ULL, 0x84222325cbf29ce4ULL};
+    mix(k, v);
+    return k;
+  }
+  static void mix(QueryKey &k, uint64_t v) {
+    k.a = (k.a ^ v) * 0x100000001b3ULL;
+    k.b = (k.b + v) * 0x9e3779b97f4a7c15ULL;
+    k.b ^= k.b >> 29;
+  }
+  static void mix(QueryKey &k, const QueryKey &o) {
+    mix(k, o.a);
+    mix(k, o.b);
+  }
+  static void mix(QueryKey &k, const std::string &s) {
+    mix(k, s.size());
+    for (unsigned char c : s)
+      mix(k, c);
+  }
+  static void mix(QueryKey &k, const llvm::APInt &v) {
+    mix(k, v.getBitWidth());
+    for (unsigned i = 0, e = v.getNumWords(); i != e; ++i)
+      mix(k, v.getRawData()[i]);
+  }
+
+  QueryKey hash(const Array *array) {
+    auto it = arrays.find(array);
+    if (it != arrays.end())
+      return it->second;
+    QueryKey k = seed(1);
+    mix(k, array->name);
+    mix(k, array->size);
+    mix(k, array->domain);
+    mix(k, array->range);
+    for (const ref<ConstantExpr> &v : array->constantValues)
+      mix(k, v->getAPValue());
+    return arrays[array] = k;
+  }
+
+  QueryKey hash(const UpdateList &ul) {
+    QueryKey k = hash(ul.root);
+    if (ul.head.isNull())
+      return k;
+    auto it = updateLists.find(ul.head.get());
+    if (it != updateLists.end()) {
+      mix(k, it->second);
+      return k;
+    }
+    QueryKey nodes = seed(2);
+    for (const UpdateNode *un = ul.head.get(); un; un = un->next.get()) {
+      mix(nodes, hash(un->index));
+      mix(nodes, hash(un->value));
+    }
+    updateLists[ul.head.get()] = nodes;
+    mix(k, nodes);
+    return k;
+  }
+
+  QueryKey hash(const ref<Expr> &e) {
+    auto it = exprs.find(e.get());
+    if (it != exprs.end())
+      return it->second;
+    QueryKey k = seed(3);
+    mix(k, e->getKind());
+    mix(k, e->getWidth());
+    if (const ConstantExpr *ce = dyn_cast<ConstantExpr>(e)) {
+      mix(k, ce->getAPValue());
+    } else if (const ReadExpr *re = dyn_cast<ReadExpr>(e)) {
+      mix(k, hash(re->updates));
+      mix(k, hash(re->index));
+    } else {
+      if (const ExtractExpr *ee = dyn_cast<ExtractExpr>(e))
+        mix(k, ee->offset);
+      for (unsigned i = 0, n = e->getNumKids(); i != n; ++i)
+        mix(k, hash(e->getKid(i)));
+    }
+    return exprs[e.get()] = k;
+  }
+};
+
+enum RecordKind : uint32_t { ValidityRecord = 1, InitialValuesRecord = 2 };
+
+static const char CacheMagic[8] = {'K', 'L', 'E', 'E', 'Q', 'C', '0', '1'};
+
+struct RecordHeader {
+  uint32_t kind;
+  uint32_t length;
+  uint64_t key[2];
+};
+
+class PersistentCachingSolver : public SolverImpl {
+  struct Entry {
+    const char *payload;
+    uint32_t length;
+  };
+
+  Solver *solver;
+  std::string path;
+  int fd;
+  /// the file when the solver was created, then the parts mapped since
+  std::vector<std::unique_ptr<llvm::MemoryBuffer>> mapped;
+  /// the length of the well-formed prefix of the file mapped so far
+  size_t mappedLength;
+  /// payloads of records added by this run
+  std::deque<std::string> added;
+  std::unordered_map<QueryKey, Entry, QueryKeyHash> index;
+
+  /// Index the records in [begin, end).
+  /// \return the length of the complete ones
+  size_t indexRecords(const char *begin, const char *end, size_t &records);
+  /// \return the length of the well-formed prefix of the file
+  size_t load();
+  /// Map the records appended to the file by other runs.
+  /// \return true if there were any
+  bool refresh();
+  /// Look key up, in the records of other runs too on a miss.
+  const Entry *find(const QueryKey &key);
+  void append(uint32_t kind, const QueryKey &key, const std::string &payload);
+  QueryKey makeKey(uint32_t kind, const Query &query, const ref<Expr> &expr,
+                   const std::vector<const Array *> *objects);
+
+  bool lookupValidity(const Query &query, bool &negationUsed,
+                      IncompleteSolver::PartialValidity &result);
+  void insertValidity(const Query &query,
+                      IncompleteSolver::PartialValidity result);
+
+public:
+  PersistentCachingSolver(Solver *s, const std::string &_path);
+  ~PersistentCachingSolver();
+
+  bool computeValidity(const Query &, Solver::Validity &result);
+  bool computeTruth(const Query &, bool &isValid);
+  bool computeValue(const Query &query, ref<Expr> &result) {
+    return solver->impl->computeValue(query, result);
+  }
+  bool computeInitialValues(const Query &query,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution);
+  SolverRunStatus getOperationStatusCode() {
+    return solver->impl->getOperationStatusCode();
+  }
+  char *getConstraintLog(const Query &query) {
+    return solver->impl->getConstraintLog(query);
+  }
+  void setCoreSolverTimeout(time::Span timeout) {
+    solver->impl->setCoreSolverTimeout(timeout);
+  }
+};
+
+PersistentCachingSolver::PersistentCachingSolver(Solver *s,
+                                                 const std::string &_path)
+    : solver(s), path(_path), fd(-1), mappedLength(0) {
+  // parallel runs may start together, the lock orders their header check,
+  // truncation and appends
+  fd = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+  if (fd >= 0 && ::flock(fd, LOCK_EX) != 0) {
+    ::close(fd);
+    fd = -1;
+  }
+  struct stat st;
+  if (fd >= 0 && ::fstat(fd, &st) == 0 && st.st_size == 0 &&
+      ::write(fd, CacheMagic, sizeof(CacheMagic)) !=
+          (ssize_t)sizeof(CacheMagic)) {
+    ::close(fd);
+    fd = -1;
+  }
+
+  size_t validLength = load();
+  // not a cache file, or a record cut short by a crashed run that appending
+  // after would misalign everything that follows
+  if (fd >= 0 &&
+      (mapped.empty() || (validLength < mapped[0]->getBufferSize() &&
+                          ::ftruncate(fd, validLength) != 0))) {
+    ::close(fd);
+    fd = -1;
+  }
+  if (fd >= 0)
+    ::flock(fd, LOCK_UN);
+  else
+    klee_warning("solver cache %s is read-only for this run", path.c_str());
+}
+
+PersistentCachingSolver::~PersistentCachingSolver() {
+  if (fd >= 0)
+    ::close(fd);
+  delete solver;
+}
+
+size_t PersistentCachingSolver::indexRecords(const char *begin,
+                                             const char *end,
+                                             size_t &records) {
+  const char *cur = begin;
+  while ((size_t)(end - cur) >= sizeof(RecordHeader)) {
+    RecordHeader header;
+    memcpy(&header, cur, sizeof(header));
+    const char *payload = cur + sizeof(header);
+    if ((size_t)(end - payload) < header.length)
+      break;
+    QueryKey key = {header.key[0], header.key[1]};
+    // later records refine earlier ones
+    if (header.kind == ValidityRecord || header.kind == InitialValuesRecord)
+      index[key] = Entry{payload, header.length};
+    cur = payload + header.length;
+    ++records;
+  }
+  return cur - begin;
+}
+
+size_t PersistentCachingSolver::load() {
+  auto bufOrErr = llvm::MemoryBuffer::getFile(path, -1, false);
+  if (!bufOrErr)
+    return 0;
+  std::unique_ptr<llvm::MemoryBuffer> buf = std::move(bufOrErr.get());
+  const char *cur = buf->getBufferStart(), *end = buf->getBufferEnd();
+  if ((size_t)(end - cur) < sizeof(CacheMagic) ||
+      memcmp(cur, CacheMagic, sizeof(CacheMagic))) {
+    klee_warning("ignoring solver cache %s: unknown format", path.c_str());
+    return 0;
+  }
+
+  size_t records = 0;
+  mappedLength =
+      sizeof(CacheMagic) +
+      indexRecords(cur + sizeof(CacheMagic), end, records);
+  mapped.push_back(std::move(buf));
+  klee_message("loaded %lu solver cache records from %s", records,
+               path.c_str());
+  return mappedLength;
+}
+
+bool PersistentCachingSolver::refresh() {
+  struct stat st;
+  if (mapped.empty() || ::stat(path.c_str(), &st) != 0 ||
+      (uint64_t)st.st_size <= mappedLength)
+    return false;
+  auto bufOrErr = llvm::MemoryBuffer::getFileSlice(
+      path, st.st_size - mappedLength, mappedLength);
+  if (!bufOrErr)
+    return false;
+  std::unique_ptr<llvm::MemoryBuffer> buf = std::move(bufOrErr.get());
+  size_t records = 0;
+  // a record still being written is read again on the next miss
+  size_t length =
+      indexRecords(buf->getBufferStart(), buf->getBufferEnd(), records);
+  if (!records)
+    return false;
+  mappedLength += length;
+  mapped.push_back(std::move(buf));
+  return true;
+}
+
+const PersistentCachingSolver::Entry *
+PersistentCachingSolver::find(const QueryKey &key) {
+  auto it = index.find(key);
+  if (it == index.end() && refresh())
+    it = index.find(key);
+  return it == index.end() ? nullptr : &it->second;
+}
+
+void PersistentCachingSolver::append(uint32_t kind, const QueryKey &key,
+                                     const std::string &payload) {
+  added.push_back(payload);
+  index[key] = Entry{added.back().data(), (uint32_t)added.back().size()};
+  if (fd < 0)
+    return;
+
+  RecordHeader header = {kind, (uint32_t)payload.size(), {key.a, key.b}};
+  std::string record((const char *)&header, sizeof(header));
+  record += payload;
+  // one write per record keeps records of concurrent runs intact, the lock
+  // keeps a starting run from taking one being written for a torn one
+  ::flock(fd, LOCK_EX);
+  ssize_t written = ::write(fd, record.data(), record.size());
+  ::flock(fd, LOCK_UN);
+  if (written != (ssize_t)record.size()) {
+    klee_warning("cannot append to solver cache %s, disabling writes",
+                 path.c_str());
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+QueryKey PersistentCachingSolver::makeKey(
+    uint32_t kind, const Query &query, const ref<Expr> &expr,
+    const std::vector<const Array *> *objects) {
+  StructuralHasher hasher;
+  std::vector<QueryKey> constraints;
+  constraints.reserve(query.constraints.size());
+  for (const ref<Expr> &c : query.constraints)
+    constraints.push_back(hasher.hash(c));
+  // constraint sets are unordered
+  std::sort(constraints.begin(), constraints.end());
+
+  QueryKey key = StructuralHasher::seed(kind);
+  StructuralHasher::mix(key, constraints.size());
+  for (const QueryKey &c : constraints)
+    StructuralHasher::mix(key, c);
+  StructuralHasher::mix(key, hasher.hash(expr));
+  if (objects) {
+    StructuralHasher::mix(key, objects->size());
+    for (const Array *array : *objects)
+      StructuralHasher::mix(key, hasher.hash(array));
+  }
+  return key;
+}
+
+bool PersistentCachingSolver::lookupValidity(
+    const Query &query, bool &negationUsed,
+    IncompleteSolver::PartialValidity &result) {
+  // same canonical form as CachingSolver
+  ref<Expr> negated = Expr::createIsZero(query.expr);
+  negationUsed = !(query.expr.compare(negated) < 0);
+  QueryKey key = makeKey(ValidityRecord, query,
+                         negationUsed ? negated : query.expr, nullptr);
+  const Entry *entry = find(key);
+  if (!entry || entry->length != 1)
+    return false;
+  result = (IncompleteSolver::PartialValidity)(int8_t)entry->payload[0];
+  if (negationUsed)
+    result = IncompleteSolver::negatePartialValidity(result);
+  return true;
+}
+
+void PersistentCachingSolver::insertValidity(
+    const Query &query, IncompleteSolver::PartialValidity result) {
+  ref<Expr> negated = Expr::createIsZero(query.expr);
+  bool negationUsed = !(query.expr.compare(negated) < 0);
+  QueryKey key = makeKey(ValidityRecord, query,
+                         negationUsed ? negated : query.expr, nullptr);
+  if (negationUsed)
+    result = IncompleteSolver::negatePartialValidity(result);
+  append(ValidityRecord, key, std::string(1, (char)(int8_t)result));
+}
+
+bool PersistentCachingSolver::computeValidity(const Query &query,
+                                              Solver::Validity &result) {
+  IncompleteSolver::PartialValidity cached;
+  bool negationUsed;
+  if (lookupValidity(query, negationUsed, cached)) {
+    switch (cached) {
+    case IncompleteSolver::MustBeTrue:
+      ++stats::queryPersistentCacheHits;
+      result = Solver::True;
+      return true;
+    case IncompleteSolver::MustBeFalse:
+      ++stats::queryPersistentCacheHits;
+      result = Solver::False;
+      return true;
+    case IncompleteSolver::TrueOrFalse:
+      ++stats::queryPersistentCacheHits;
+      result = Solver::Unknown;
+      return true;
+    default:
+      break;
+    }
+  }
+
+  ++stats::queryPersistentCacheMisses;
+  if (!solver->impl->computeValidity(query, result))
+    return false;
+  insertValidity(query, result == Solver::True
+                            ? IncompleteSolver::MustBeTrue
+                            : result == Solver::False
+                                  ? IncompleteSolver::MustBeFalse
+                                  : IncompleteSolver::TrueOrFalse);
+  return true;
+}
+
+bool PersistentCachingSolver::computeTruth(const Query &query,
+                                           bool &isValid) {
+  IncompleteSolver::PartialValidity cached;
+  bool negationUsed;
+  bool hit = lookupValidity(query, negationUsed, cached);
+  if (hit && cached != IncompleteSolver::MayBeTrue &&
+      cached != IncompleteSolver::None) {
+    ++stats::queryPersistentCacheHits;
+    isValid = (cached == IncompleteSolver::MustBeTrue);
+    return true;
+  }
+
+  ++stats::queryPersistentCacheMisses;
+  if (!solver->impl->computeTruth(query, isValid))
+    return false;
+  if (isValid)
+    insertValidity(query, IncompleteSolver::MustBeTrue);
+  else
+    insertValidity(query, (hit && cached == IncompleteSolver::MayBeTrue)
+                              ? IncompleteSolver::TrueOrFalse
+                              : IncompleteSolver::MayBeFalse);
+  return true;
+}
+
+bool PersistentCachingSolver::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution) {
+  QueryKey key = makeKey(InitialValuesRecord, query, query.expr, &objects);
+  if (const Entry *entry = find(key)) {
+    const char *cur = entry->payload, *end = cur + entry->length;
+    uint8_t solvable;
+    uint32_t n;
+    bool ok = (size_t)(end - cur) >= 5;
+    if (ok) {
+      solvable = cur[0];
+      memcpy(&n, cur + 1, sizeof(n));
+      cur += 5;
+      ok = solvable ? n == objects.size() : n == 0;
+    }
+    std::vector<std::vector<unsigned char> > cachedValues;
+    for (uint32_t i = 0; ok && i < n; ++i) {
+      uint32_t size;
+      ok = (size_t)(end - cur) >= sizeof(size);
+      if (!ok)
+        break;
+      memcpy(&size, cur, sizeof(size));
+      cur += sizeof(size);
+      ok = (size_t)(end - cur) >= size && size == objects[i]->size;
+      if (ok) {
+        cachedValues.emplace_back(cur, cur + size);
+        cur += size;
+      }
+    }
+    if (ok) {
+      ++stats::queryPersistentCacheHits;
+      hasSolution = solvable;
+      values.swap(cachedValues);
+      return true;
+    }
+  }
+
+  ++stats::queryPersistentCacheMisses;
+  if (!solver->impl->computeInitialValues(query, objects, values, hasSolution))
+    return false;
+
+  std::string payload(1, (char)hasSolution);
+  uint32_t n = hasSolution ? values.size() : 0;
+  payload.append((const char *)&n, sizeof(n));
+  for (uint32_t i = 0; i < n; ++i) {
+    uint32_t size = values[i].size();
+    payload.append((const char *)&size, sizeof(size));
+    payload.append((const char *)values[i].data(), size);
+  }
+  append(InitialValuesRecord, key, payload);
+  return true;
+}
+
+} // namespace
+
+Solver *klee::createPersistentCachingSolver(Solver *s,
+                                            const std::string &path) {
+  return new Solver(new PersistentCachingSolver(s, path));
+}
@@ -0,0 +1,341 @@
+//===-- PortfolioSolver.cpp -----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Races several core solvers on the same query. Every backend runs in its
+// own forked process (expressions are not safe to share between threads),
+// the first one to produce an answer wins and the others are killed.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Expr/Assignment.h"
+#include "klee/Expr/ExprUtil.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+#include "klee/Solver/Solver.h"
+#include "klee/Solver/SolverImpl.h"
+#include "klee/Solver/SolverStats.h"
+
+#include "llvm/Support/Errno.h"
+#include "llvm/Support/ErrorHandling.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <functional>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace klee;
+
+namespace {
+
+/// Computes the answer of one backend, serialized into the string.
+typedef std::function<bool(Solver &, std::string &)> Job;
+
+class PortfolioSolverImpl : public SolverImpl {
+public:
+  struct Member {
+    const char *name;
+    Solver *solver;
+    Statistic *wins;
+    Statistic *losses;
+  };
+
+private:
+  std::vector<Member> members;
+  time::Span timeout;
+  SolverRunStatus runStatusCode;
+
+  bool race(const Job &job, std::string &answer);
+
+public:
+  PortfolioSolverImpl(const std::vector<Member> &_members)
+      : members(_members), runStatusCode(SOLVER_RUN_STATUS_FAILURE) {}
+  ~PortfolioSolverImpl() {
+    for (auto &m : members)
+      delete m.solver;
+  }
+
+  bool computeTruth(const Query &, bool &isValid);
+  bool computeValidity(const Query &, Solver::Validity &result);
+  bool computeValue(const Query &, ref<Expr> &result);
+  bool computeInitialValues(const Query &query,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution);
+  SolverRunStatus getOperationStatusCode() { return runStatusCode; }
+  char *getConstraintLog(const Query &query) {
+    return members.front().solver->getConstraintLog(query);
+  }
+  void setCoreSolverTimeout(time::Span _timeout) {
+    timeout = _timeout;
+    for (auto &m : members)
+      m.solver->setCoreSolverTimeout(timeout);
+  }
+};
+
+/// Message a backend process writes to its pipe: the uint8 SolverRunStatus
+/// of the backend, a uint8 success flag, then the serialized answer.
+static void runMember(Solver &solver, const Job &job, int fd) {
+  std::string answer;
+  bool success = job(solver, answer);
+  std::string msg(1, (char)solver.impl->getOperationStatusCode());
+  msg += (char)success;
+  msg += answer;
+  for (size_t done = 0; done < msg.size();) {
+    ssize_t n = ::write(fd, msg.data() + done, msg.size() - done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    done += n;
+  }
+}
+
+bool PortfolioSolverImpl::race(const Job &job, std::string &answer) {
+  struct Runner {
+    pid_t pid;
+    int fd;
+    std::string msg;
+  };
+  std::vector<Runner> runners(members.size(), Runner{-1, -1, ""});
+
+  fflush(stdout);
+  fflush(stderr);
+  unsigned running = 0;
+  for (unsigned i = 0; i < members.size(); ++i) {
+    int fds[2];
+    if (::pipe(fds) != 0)
+      continue;
+    pid_t pid = ::fork();
+    if (pid == 0) {
+      // own process group, so that a backend forking itself (STP) is killed
+      // together with its children
+      ::setpgid(0, 0);
+      ::close(fds[0]);
+      for (unsigned j = 0; j < i; ++j)
+        if (runners[j].fd >= 0)
+          ::close(runners[j].fd);
+      runMember(*members[i].solver, job, fds[1]);
+      _exit(0);
+    }
+    ::close(fds[1]);
+    if (pid < 0) {
+      klee_warning("fork failed (for %s) - %s", members[i].name,
+                   llvm::sys::StrError(errno).c_str());
+      ::close(fds[0]);
+      continue;
+    }
+    ::setpgid(pid, pid);
+    runners[i].pid = pid;
+    runners[i].fd = fds[0];
+    ++running;
+  }
+
+  if (!running) {
+    runStatusCode = SOLVER_RUN_STATUS_FORK_FAILED;
+    return false;
+  }
+
+  // backends enforce the timeout themselves, the deadline only catches
+  // processes that do not
+  time::Point deadline =
+      timeout ? time::getWallTime() + timeout + time::seconds(1) : time::Point();
+  int winner = -1;
+  SolverRunStatus lastFailure = SOLVER_RUN_STATUS_FAILURE;
+  while (running && winner < 0) {
+    std::vector<pollfd> fds;
+    std::vector<unsigned> owners;
+    for (unsigned i = 0; i < runners.size(); ++i) {
+      if (runners[i].fd < 0)
+        continue;
+      fds.push_back(pollfd{runners[i].fd, POLLIN, 0});
+      owners.push_back(i);
+    }
+    int wait = -1;
+    if (timeout) {
+      time::Span left = deadline - time::getWallTime();
+      if (left <= time::Span()) {
+        lastFailure = SOLVER_RUN_STATUS_TIMEOUT;
+        break;
+      }
+      wait = std::max<int64_t>(1, left.toMicroseconds() / 1000);
+    }
+    int ready = ::poll(fds.data(), fds.size(), wait);
+    if (ready < 0 && errno != EINTR)
+      break;
+    for (unsigned k = 0; ready > 0 && k < fds.size() && winner < 0; ++k) {
+      if (!fds[k].revents)
+        continue;
+      Runner &r = runners[owners[k]];
+      char buf[4096];
+      ssize_t n = ::read(r.fd, buf, sizeof(buf));
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n > 0) {
+        r.msg.append(buf, n);
+        continue;
+      }
+      // end of message
+      ::close(r.fd);
+      r.fd = -1;
+      --running;
+      if (r.msg.size() >= 2 && r.msg[1]) {
+        winner = owners[k];
+      } else if (r.msg.size() >= 2) {
+        lastFailure = (SolverRunStatus)(unsigned char)r.msg[0];
+      } else {
+        klee_warning("%s did not return successfully", members[owners[k]].name);
+        lastFailure = SOLVER_RUN_STATUS_INTERRUPTED;
+      }
+    }
+  }
+
+  for (unsigned i = 0; i < runners.size(); ++i) {
+    Runner &r = runners[i];
+    if (r.pid < 0)
+      continue;
+    if (r.fd >= 0) {
+      ::kill(-r.pid, SIGKILL);
+      ::close(r.fd);
+    }
+    int status;
+    while (::waitpid(r.pid, &status, 0) < 0 && errno == EINTR)
+      ;
+    if ((int)i == winner)
+      ++*members[i].wins;
+    else
+      ++*members[i].losses;
+  }
+
+  if (winner < 0) {
+    runStatusCode = lastFailure;
+    return false;
+  }
+  runStatusCode = (SolverRunStatus)(unsigned char)runners[winner].msg[0];
+  answer = runners[winner].msg.substr(2);
+  return true;
+}
+
+bool PortfolioSolverImpl::computeTruth(const Query &query, bool &isValid) {
+  std::string answer;
+  if (!race(
+          [&](Solver &s, std::string &out) {
+            bool v;
+            if (!s.impl->computeTruth(query, v))
+              return false;
+            out = std::string(1, (char)v);
+            return true;
+          },
+          answer) ||
+      answer.size() != 1)
+    return false;
+  isValid = answer[0];
+  return true;
+}
+
+bool PortfolioSolverImpl::computeValidity(const Query &query,
+                                          Solver::Validity &result) {
+  std::string answer;
+  if (!race(
+          [&](Solver &s, std::string &out) {
+            Solver::Validity v;
+            if (!s.impl->computeValidity(query, v))
+              return false;
+            out = std::string(1, (char)v);
+            return true;
+          },
+          answer) ||
+      answer.size() != 1)
+    return false;
+  result = (Solver::Validity)(signed char)answer[0];
+  return true;
+}
+
+bool PortfolioSolverImpl::computeValue(const Query &query,
+                                       ref<Expr> &result) {
+  std::vector<const Array *> objects;
+  std::vector<std::vector<unsigned char> > values;
+  bool hasSolution;
+
+  // Find the object used in the expression, and compute an assignment
+  // for them.
+  findSymbolicObjects(query.expr, objects);
+  if (!computeInitialValues(query.withFalse(), objects, values, hasSolution))
+    return false;
+  assert(hasSolution && "state has invalid constraint set");
+
+  // Evaluate the expression with the computed assignment.
+  Assignment a(objects, values);
+  result = a.evaluate(query.expr);
+
+  return true;
+}
+
+bool PortfolioSolverImpl::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution) {
+  std::string answer;
+  if (!race(
+          [&](Solver &s, std::string &out) {
+            std::vector<std::vector<unsigned char> > v;
+            bool solvable;
+            if (!s.impl->computeInitialValues(query, objects, v, solvable))
+              return false;
+            out = std::string(1, (char)solvable);
+            if (solvable)
+              for (auto &bytes : v)
+                out.append(bytes.begin(), bytes.end());
+            return true;
+          },
+          answer) ||
+      answer.empty())
+    return false;
+
+  hasSolution = answer[0];
+  if (!hasSolution)
+    return true;
+  size_t pos = 1;
+  values.reserve(objects.size());
+  for (const Array *object : objects) {
+    if (answer.size() - pos < object->size)
+      return false;
+    values.emplace_back(answer.begin() + pos,
+                        answer.begin() + pos + object->size);
+    pos += object->size;
+  }
+  return true;
+}
+
+} // namespace
+
+Solver *klee::createPortfolioSolver(
+    const std::vector<std::pair<CoreSolverType, Solver *> > &solvers) {
+  std::vector<PortfolioSolverImpl::Member> members;
+  for (auto &s : solvers) {
+    switch (s.first) {
+    case STP_SOLVER:
+      members.push_back({"STP", s.second, &stats::portfolioSTPWins,
+                         &stats::portfolioSTPLosses});
+      break;
+    case METASMT_SOLVER:
+      members.push_back({"metaSMT", s.second, &stats::portfolioMetaSMTWins,
+                         &stats::portfolioMetaSMTLosses});
+      break;
+    case Z3_SOLVER:
+      members.push_back({"Z3", s.second, &stats::portfolioZ3Wins,
+                         &stats::portfolioZ3Losses});
+      break;
+    default:
+      llvm_unreachable("Unsupported portfolio member");
+    }
+  }
+  assert(!members.empty() && "empty portfolio");
+  return new Solver(new PortfolioSolverImpl(members));
+}
@@ -0,0 +1,555 @@
+//===-- SMTLIBProcessSolver.cpp -------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Core solver talking SMT-LIBv2 to external solver processes over pipes.
+// The processes are started once and kept alive across queries. Every
+// constraint is asserted in its own (push) scope, so a query only pops the
+// constraints it does not share with the previous query on that process and
+// pushes the new ones.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Expr/Assignment.h"
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/ExprSMTLIBPrinter.h"
+#include "klee/Expr/ExprUtil.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+#include "klee/OptionCategories.h"
+#include "klee/Solver/Solver.h"
+#include "klee/Solver/SolverImpl.h"
+#include "klee/Solver/SolverStats.h"
+#include "klee/TimerStatIncrementer.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Errno.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace klee;
+
+namespace {
+llvm::cl::opt<std::string> SMTLIBSolverCommand(
+    "smtlib-solver-command", llvm::cl::init("z3 -in -smt2"),
+    llvm::cl::desc("Shell command starting an SMT-LIBv2 solver which reads "
+                   "commands on stdin, used by --solver-backend=smtlib. "
+                   "E.g. \"z3 -in -smt2\", \"cvc5 --lang=smt2 "
+                   "--incremental\", \"bitwuzla --lang smt2\", "
+                   "\"yices-smt2 --incremental\" (default=z3 -in -smt2)"),
+    llvm::cl::cat(klee::SolvingCat));
+
+llvm::cl::opt<unsigned> SMTLIBSolverProcesses(
+    "smtlib-solver-processes", llvm::cl::init(2),
+    llvm::cl::desc("Number of solver processes kept alive. Each query goes "
+                   "to the one sharing most asserted constraints with it "
+                   "(default=2)"),
+    llvm::cl::cat(klee::SolvingCat));
+
+llvm::cl::opt<bool> SMTLIBSolverIncremental(
+    "smtlib-solver-incremental", llvm::cl::init(true),
+    llvm::cl::desc("Keep the constraints shared between queries asserted in "
+                   "the solver processes using (push) and (pop). Otherwise "
+                   "every query is asserted from scratch (default=true)"),
+    llvm::cl::cat(klee::SolvingCat));
+
+/// A long running solver process, talking SMT-LIBv2 over a socket connected
+/// to its stdin and stdout.
+class SolverProcess {
+public:
+  /// One (push) scope, holding one constraint and the arrays declared in it
+  struct Frame {
+    ref<Expr> constraint;
+    std::vector<const Array *> arrays;
+  };
+
+  pid_t pid = -1;
+  int fd = -1;
+  /// output read but not consumed yet
+  std::string buffer;
+  std::vector<Frame> frames;
+  std::set<const Array *> declared;
+  uint64_t lastUse = 0;
+
+  ~SolverProcess() { stop(); }
+
+  bool running() const { return pid > 0; }
+  bool start(const std::string &command);
+  /// Kill the process and forget its state.
+  void stop();
+  /// Forget the process without killing it, it belongs to our parent.
+  void detach();
+
+  bool send(const std::string &commands);
+  /// Read one s-expression or atom of the output.
+  /// \return false on end of file, error or once deadline passed.
+  bool read(std::string &sexpr, time::Point deadline, bool &timedOut);
+  /// Pop the frames beyond the first keep ones.
+  void popTo(size_t keep, llvm::raw_ostream &os);
+};
+
+bool SolverProcess::start(const std::string &command) {
+  int fds[2];
+  if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+    klee_warning("socketpair failed - %s", llvm::sys::StrError(errno).c_str());
+    return false;
+  }
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_adddup2(&actions, fds[1], STDIN_FILENO);
+  posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+  posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null",
+                                   O_WRONLY, 0);
+  // spawn instead of fork, KLEE may be large
+  std::string shellCommand = "exec " + command;
+  const char *argv[] = {"/bin/sh", "-c", shellCommand.c_str(), nullptr};
+  pid_t child;
+  int err = posix_spawn(&child, "/bin/sh", &actions, nullptr,
+                        const_cast<char *const *>(argv), environ);
+  posix_spawn_file_actions_destroy(&actions);
+  ::close(fds[1]);
+  if (err != 0) {
+    klee_warning("cannot start \"%s\" - %s", command.c_str(),
+                 llvm::sys::StrError(err).c_str());
+    ::close(fds[0]);
+    return false;
+  }
+  pid = child;
+  fd = fds[0];
+  buffer.clear();
+  frames.clear();
+  declared.clear();
+  return send("(set-option :print-success false)\n"
+              "(set-option :produce-models true)\n"
+              "(set-logic QF_AUFBV)\n");
+}
+
+void SolverProcess::stop() {
+  if (!running())
+    return;
+  ::close(fd);
+  ::kill(pid, SIGKILL);
+  int status;
+  while (::waitpid(pid, &status, 0) < 0 && errno == EINTR)
+    ;
+  pid = -1;
+  fd = -1;
+  buffer.clear();
+  frames.clear();
+  declared.clear();
+}
+
+void SolverProcess::detach() {
+  if (fd >= 0)
+    ::close(fd);
+  pid = -1;
+  fd = -1;
+  buffer.clear();
+  frames.clear();
+  declared.clear();
+}
+
+bool SolverProcess::send(const std::string &commands) {
+  for (size_t done = 0; done < commands.size();) {
+    // no SIGPIPE if the solver died
+    ssize_t n = ::send(fd, commands.data() + done, commands.size() - done,
+                       MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    done += n;
+  }
+  return true;
+}
+
+bool SolverProcess::read(std::string &sexpr, time::Point deadline,
+                         bool &timedOut) {
+  timedOut = false;
+  for (;;) {
+    // scan the buffer for a complete s-expression
+    size_t begin = buffer.find_first_not_of(" \t\r\n");
+    if (begin != std::string::npos) {
+      size_t end = std::string::npos;
+      if (buffer[begin] == '(') {
+        int depth = 0;
+        bool inString = false, inQuoted = false;
+        for (size_t i = begin; i < buffer.size(); ++i) {
+          char c = buffer[i];
+          if (inString) {
+            inString = c != '"';
+          } else if (inQuoted) {
+            inQuoted = c != '|';
+          } else if (c == '"') {
+            inString = true;
+          } else if (c == '|') {
+            inQuoted = true;
+          } else if (c == '(') {
+            ++depth;
+          } else if (c == ')' && --depth == 0) {
+            end = i + 1;
+            break;
+          }
+        }
+      } else {
+        end = buffer.find_first_of(" \t\r\n()", begin);
+      }
+      if (end != std::string::npos) {
+        sexpr = buffer.substr(begin, end - begin);
+        buffer.erase(0, end);
+        return true;
+      }
+    }
+
+    int wait = -1;
+    if (deadline != time::Point()) {
+      time::Span left = deadline - time::getWallTime();
+      if (left <= time::Span()) {
+        timedOut = true;
+        return false;
+      }
+      wait = std::max<int64_t>(1, left.toMicroseconds() / 1000);
+    }
+    pollfd pfd{fd, POLLIN, 0};
+    int ready = ::poll(&pfd, 1, wait);
+    if (ready < 0 && errno != EINTR)
+      return false;
+    if (ready <= 0)
+      continue;
+    char chunk[4096];
+    ssize_t n = ::read(fd, chunk, sizeof(chunk));
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    buffer.append(chunk, n);
+  }
+}
+
+void SolverProcess::popTo(size_t keep, llvm::raw_ostream &os) {
+  if (keep >= frames.size())
+    return;
+  os << "(pop " << frames.size() - keep << ")\n";
+  for (size_t i = keep; i < frames.size(); ++i)
+    for (const Array *array : frames[i].arrays)
+      declared.erase(array);
+  frames.resize(keep);
+}
+
+/// Split an s-expression list into its elements.
+static std::vector<std::string> splitList(const std::string &list) {
+  std::vector<std::string> elements;
+  if (list.size() < 2 || list.front() != '(')
+    return elements;
+  size_t i = 1, e = list.size() - 1;
+  while (i < e) {
+    if (isspace((unsigned char) list[i])) {
+      ++i;
+      continue;
+    }
+    size_t begin = i;
+    if (list[i] == '(') {
+      int depth = 0;
+      for (; i < e; ++i) {
+        if (list[i] == '(')
+          ++depth;
+        else if (list[i] == ')' && --depth == 0)
+          break;
+      }
+      ++i;
+    } else {
+      while (i < e && !isspace((unsigned char) list[i]) && list[i] != '(')
+        ++i;
+    }
+    elements.push_back(list.substr(begin, i - begin));
+  }
+  return elements;
+}
+
+/// Parse a bit-vector value printed as #x.., #b.. or (_ bvN w).
+static bool parseBitVector(const std::string &value, uint64_t &result) {
+  const char *digits;
+  int base;
+  if (value.compare(0, 2, "#x") == 0) {
+    digits = value.c_str() + 2;
+    base = 16;
+  } else if (value.compare(0, 2, "#b") == 0) {
+    digits = value.c_str() + 2;
+    base = 2;
+  } else if (value.compare(0, 5, "(_ bv") == 0) {
+    digits = value.c_str() + 5;
+    base = 10;
+  } else {
+    return false;
+  }
+  char *end;
+  errno = 0;
+  result = strtoull(digits, &end, base);
+  return errno == 0 && end != digits;
+}
+
+class SMTLIBProcessSolverImpl : public SolverImpl {
+  std::string command;
+  std::vector<std::unique_ptr<SolverProcess> > processes;
+  /// processes started by another process (before a fork) are not ours
+  pid_t owner;
+  uint64_t clock = 0;
+  ExprSMTLIBPrinter printer;
+  time::Span timeout;
+  SolverRunStatus runStatusCode;
+
+  SolverProcess *getProcess(const Query &query, size_t &keep);
+  bool internalRunSolver(const Query &query,
+                         const std::vector<const Array *> *objects,
+                         std::vector<std::vector<unsigned char> > *values,
+                         bool &hasSolution);
+
+public:
+  explicit SMTLIBProcessSolverImpl(const std::string &_command)
+      : command(_command), owner(::getpid()),
+        runStatusCode(SOLVER_RUN_STATUS_FAILURE) {
+    printer.setHumanReadable(false);
+    // :named abbreviations are global in the solver, which breaks once the
+    // constraints are asserted separately
+    printer.setAbbreviationMode(ExprSMTLIBPrinter::ABBR_LET);
+    for (unsigned i = 0; i < std::max(1u, (unsigned) SMTLIBSolverProcesses); ++i)
+      processes.emplace_back(new SolverProcess());
+  }
+
+  bool computeTruth(const Query &, bool &isValid);
+  bool computeValue(const Query &, ref<Expr> &result);
+  bool computeInitialValues(const Query &query,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution) {
+    return internalRunSolver(query, &objects, &values, hasSolution);
+  }
+  SolverRunStatus getOperationStatusCode() { return runStatusCode; }
+  char *getConstraintLog(const Query &query);
+  void setCoreSolverTimeout(time::Span _timeout) { timeout = _timeout; }
+};
+
+SolverProcess *SMTLIBProcessSolverImpl::getProcess(const Query &query,
+                                                   size_t &keep) {
+  if (owner != ::getpid()) {
+    // forked, the parent keeps talking to the processes
+    for (auto &p : processes)
+      p->detach();
+    owner = ::getpid();
+  }
+
+  // the process whose scopes match most of the query, or the least recently
+  // used one
+  SolverProcess *best = nullptr;
+  keep = 0;
+  for (auto &p : processes) {
+    size_t matching = 0;
+    if (SMTLIBSolverIncremental && p->running()) {
+      while (matching < p->frames.size() &&
+             query.constraints.count(p->frames[matching].constraint))
+        ++matching;
+    }
+    if (!best || matching > keep ||
+        (matching == keep && p->lastUse < best->lastUse)) {
+      best = p.get();
+      keep = matching;
+    }
+  }
+  if (!best->running() && !best->start(command))
+    return nullptr;
+  best->lastUse = ++clock;
+  return best;
+}
+
+bool SMTLIBProcessSolverImpl::internalRunSolver(
+    const Query &query, const std::vector<const Array *> *objects,
+    std::vector<std::vector<unsigned char> > *values, bool &hasSolution) {
+  TimerStatIncrementerWithMax t(stats::queryTime, stats::queryTimeMaxOnce);
+  ++stats::queries;
+  if (objects)
+    ++stats::queryCounterexamples;
+  runStatusCode = SOLVER_RUN_STATUS_FAILURE;
+
+  size_t keep;
+  SolverProcess *p = getProcess(query, keep);
+  if (!p)
+    return false;
+
+  std::string commands;
+  llvm::raw_string_ostream os(commands);
+  printer.setOutput(os);
+  p->popTo(keep, os);
+
+  std::vector<const Array *> newArrays;
+  Constraints_ty asserted;
+  for (size_t i = 0; i < keep; ++i)
+    asserted.insert(p->frames[i].constraint);
+  if (!SMTLIBSolverIncremental)
+    os << "(push 1)\n";
+  for (const ref<Expr> &constraint : query.constraints) {
+    if (asserted.count(constraint))
+      continue;
+    newArrays.clear();
+    if (SMTLIBSolverIncremental)
+      os << "(push 1)\n";
+    printer.printIncrementalAssert(constraint, p->declared, newArrays);
+    p->declared.insert(newArrays.begin(), newArrays.end());
+    if (SMTLIBSolverIncremental)
+      p->frames.push_back(SolverProcess::Frame{constraint, newArrays});
+  }
+
+  // the query itself is scoped to this call
+  std::vector<const Array *> queryArrays;
+  if (SMTLIBSolverIncremental)
+    os << "(push 1)\n";
+  printer.printIncrementalAssert(Expr::createIsZero(query.expr), p->declared,
+                                 queryArrays);
+  std::set<const Array *> visible(p->declared);
+  visible.insert(queryArrays.begin(), queryArrays.end());
+  if (objects) {
+    for (const Array *array : *objects) {
+      if (visible.count(array))
+        continue;
+      os << "(declare-fun " << array->name << " () (Array (_ BitVec "
+         << array->getDomain() << ") (_ BitVec " << array->getRange()
+         << ") ) )\n";
+    }
+  }
+  os << "(check-sat)\n";
+  os.flush();
+
+  time::Point deadline =
+      timeout ? time::getWallTime() + timeout : time::Point();
+  std::string answer;
+  bool timedOut = false;
+  bool ok = p->send(commands);
+  while (ok) {
+    ok = p->read(answer, deadline, timedOut);
+    if (!ok || answer == "sat" || answer == "unsat" || answer == "unknown")
+      break;
+    if (answer.compare(0, 6, "(error") == 0) {
+      klee_warning("SMT-LIBv2 solver error: %s", answer.c_str());
+      ok = false;
+    }
+    // anything else (e.g. "success") is ignored
+  }
+
+  if (ok && answer == "sat" && objects) {
+    values->clear();
+    values->reserve(objects->size());
+    for (const Array *array : *objects) {
+      std::vector<unsigned char> data;
+      data.reserve(array->size);
+      if (array->size) {
+        std::string request = "(get-value (";
+        for (unsigned i = 0; i < array->size; ++i)
+          request += "(select " + array->name + " (_ bv" + std::to_string(i) +
+                     " " + std::to_string(array->getDomain()) + ") ) ";
+        request += "))\n";
+        std::string response;
+        ok = p->send(request) && p->read(response, deadline, timedOut);
+        std::vector<std::string> pairs;
+        if (ok)
+          pairs = splitList(response);
+        if (pairs.size() != array->size)
+          ok = false;
+        for (unsigned i = 0; ok && i < array->size; ++i) {
+          std::vector<std::string> pair = splitList(pairs[i]);
+          uint64_t byte = 0;
+          ok = pair.size() == 2 && parseBitVector(pair[1], byte);
+          if (ok)
+            data.push_back((unsigned char) byte);
+        }
+      }
+      if (!ok)
+        break;
+      values->push_back(std::move(data));
+    }
+  }
+
+  // drops the query, or everything when not incremental
+  if (ok)
+    ok = p->send("(pop 1)\n");
+  if (ok && !SMTLIBSolverIncremental)
+    p->declared.clear();
+
+  if (!ok) {
+    // the state of the process is unknown, start over
+    if (timedOut)
+      runStatusCode = SOLVER_RUN_STATUS_TIMEOUT;
+    else if (p->running())
+      klee_warning("SMT-LIBv2 solver process failed, restarting it");
+    p->stop();
+    return false;
+  }
+
+  if (answer == "unknown")
+    return false;
+  hasSolution = answer == "sat";
+  runStatusCode = hasSolution ? SOLVER_RUN_STATUS_SUCCESS_SOLVABLE
+                              : SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE;
+  if (hasSolution)
+    ++stats::queriesInvalid;
+  else
+    ++stats::queriesValid;
+  return true;
+}
+
+bool SMTLIBProcessSolverImpl::computeTruth(const Query &query, bool &isValid) {
+  bool hasSolution = false;
+  bool status =
+      internalRunSolver(query, /*objects=*/NULL, /*values=*/NULL, hasSolution);
+  isValid = !hasSolution;
+  return status;
+}
+
+bool SMTLIBProcessSolverImpl::computeValue(const Query &query,
+                                           ref<Expr> &result) {
+  std::vector<const Array *> objects;
+  std::vector<std::vector<unsigned char> > values;
+  bool hasSolution;
+
+  // Find the object used in the expression, and compute an assignment
+  // for them.
+  findSymbolicObjects(query.expr, objects);
+  if (!computeInitialValues(query.withFalse(), objects, values, hasSolution))
+    return false;
+  assert(hasSolution && "state has invalid constraint set");
+
+  // Evaluate the expression with the computed assignment.
+  Assignment a(objects, values);
+  result = a.evaluate(query.expr);
+
+  return true;
+}
+
+char *SMTLIBProcessSolverImpl::getConstraintLog(const Query &query) {
+  std::string log;
+  llvm::raw_string_ostream os(log);
+  ExprSMTLIBPrinter logPrinter;
+  logPrinter.setOutput(os);
+  logPrinter.setQuery(query);
+  logPrinter.generateOutput();
+  os.flush();
+  return strdup(log.c_str());
+}
+
+} // namespace
+
+Solver *klee::createSMTLIBProcessSolver() {
+  return new Solver(new SMTLIBProcessSolverImpl(SMTLIBSolverCommand));
+}
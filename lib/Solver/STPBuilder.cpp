@@ -76,7 +76,8 @@ STPArrayExprHash::~STPArrayExprHash() {
 /***/
 
 STPBuilder::STPBuilder(::VC _vc, bool _optimizeDivides)
-  : vc(_vc), optimizeDivides(_optimizeDivides) {
+  : vc(_vc), constructCacheCapacity(0), updateTranslationsSwept(0),
+    optimizeDivides(_optimizeDivides) {
 
 }
 
@@ -469,45 +470,95 @@ ExprHandle STPBuilder::getInitialRead(const Array *root, unsigned index) {
   return vc_readExpr(vc, getInitialArray(root), bvConst32(32, index));
 }
 
-::VCExpr STPBuilder::getArrayForUpdate(const Array *root, 
+::VCExpr STPBuilder::getArrayForUpdate(const Array *root,
                                        const UpdateNode *un) {
-  if (!un) {
-      return getInitialArray(root);
+  // the updates since the most recent translated one, most recent first
+  std::vector<const UpdateNode *> pending;
+  ::VCExpr un_expr = nullptr;
+  for (; un; un = un->next.get()) {
+    auto it = updateTranslations.find(un);
+    if (it != updateTranslations.end()) {
+      un_expr = it->second.handle;
+      break;
+    }
+    pending.push_back(un);
   }
-  else {
-      // FIXME: This really needs to be non-recursive.
-      ::VCExpr un_expr;
-      bool hashed = _arr_hash.lookupUpdateNodeExpr(un, un_expr);
-      
-      if (!hashed) {
-        un_expr =
-            vc_writeExpr(vc, getArrayForUpdate(root, un->next.get()),
-                         construct(un->index, 0), construct(un->value, 0));
+  if (!un)
+    un_expr = getInitialArray(root);
 
-        _arr_hash.hashUpdateNodeExpr(un, un_expr);
-      }
-      
-      return un_expr;
+  for (auto it = pending.rbegin(), ie = pending.rend(); it != ie; ++it) {
+    un_expr = vc_writeExpr(vc, un_expr, construct((*it)->index, 0),
+                           construct((*it)->value, 0));
+    updateTranslations.emplace(
+        *it, UpdateEntry{const_cast<UpdateNode *>(*it), ExprHandle(un_expr)});
+  }
+  return un_expr;
+}
+
+void STPBuilder::sweepUpdateTranslations() {
+  std::vector<ref<UpdateNode> > dead;
+  for (auto it = updateTranslations.begin(); it != updateTranslations.end();) {
+    if (it->second.un->_refCount.getCount() == 1) {
+      dead.push_back(std::move(it->second.un));
+      it = updateTranslations.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  // freeing a list may leave the updates below it to the builder alone
+  for (ref<UpdateNode> &un : dead) {
+    while (un->_refCount.getCount() == 1 && !un->next.isNull()) {
+      ref<UpdateNode> next = un->next;
+      un = nullptr;
+      auto it = updateTranslations.find(next.get());
+      if (it == updateTranslations.end() ||
+          next->_refCount.getCount() != 2)
+        break;
+      updateTranslations.erase(it);
+      un = std::move(next);
+    }
+  }
+  updateTranslationsSwept = updateTranslations.size();
+}
+
+void STPBuilder::trimConstructCache() {
+  // sweep when the cache doubled, which keeps the sweeps amortized constant
+  // time per translated update
+  if (updateTranslations.size() >= 1024 &&
+      updateTranslations.size() >= 2 * updateTranslationsSwept)
+    sweepUpdateTranslations();
+  if (!constructCacheCapacity) {
+    constructed.clear();
+    constructedLRU.clear();
+    return;
+  }
+  while (constructed.size() > constructCacheCapacity) {
+    constructed.erase(constructedLRU.back());
+    constructedLRU.pop_back();
   }
 }
 
 /** if *width_out!=1 then result is a bitvector,
     otherwise it is a bool */
-ExprHandle STPBuilder::construct(ref<Expr> e, int *width_out) {
+ExprHandle STPBuilder::construct(const ref<Expr> &e, int *width_out) {
   if (!UseConstructHash || isa<ConstantExpr>(e)) {
     return constructActual(e, width_out);
   } else {
-    ExprHashMap< std::pair<ExprHandle, unsigned> >::iterator it = 
-      constructed.find(e);
-    if (it!=constructed.end()) {
+    ExprHashMap<ConstructedEntry>::iterator it = constructed.find(e);
+    if (it != constructed.end()) {
+      constructedLRU.splice(constructedLRU.begin(), constructedLRU,
+                            it->second.lru);
       if (width_out)
-        *width_out = it->second.second;
-      return it->second.first;
+        *width_out = it->second.width;
+      return it->second.handle;
     } else {
       int width;
       if (!width_out) width_out = &width;
       ExprHandle res = constructActual(e, width_out);
-      constructed.insert(std::make_pair(e, std::make_pair(res, *width_out)));
+      constructedLRU.push_front(e);
+      constructed.insert(std::make_pair(
+          e, ConstructedEntry{res, (unsigned)*width_out,
+                              constructedLRU.begin()}));
       return res;
     }
   }
@@ -516,7 +567,7 @@ ExprHandle STPBuilder::construct(ref<Expr> e, int *width_out) {
 
 /** if *width_out!=1 then result is a bitvector,
     otherwise it is a bool */
-ExprHandle STPBuilder::constructActual(ref<Expr> e, int *width_out) {
+ExprHandle STPBuilder::constructActual(const ref<Expr> &e, int *width_out) {
   int width;
   if (!width_out) width_out = &width;
 
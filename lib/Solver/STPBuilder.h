@@ -14,6 +14,8 @@
 #include "klee/Expr/ArrayExprHash.h"
 #include "klee/Expr/ExprHashMap.h"
 
+#include <list>
+#include <unordered_map>
 #include <vector>
 
 #define Expr VCExpr
@@ -62,9 +64,39 @@ namespace klee {
     virtual ~STPArrayExprHash();
   };
 
+/// Translates KLEE expressions into STP expressions of one validity checker.
+///
+/// Translations are kept across queries: the array expressions for as long
+/// as the builder lives, the update list expressions for as long as their
+/// updates are alive outside the builder, and the expression cache up to the
+/// capacity given to setConstructCacheCapacity(), evicting the least
+/// recently used expressions first.
 class STPBuilder {
   ::VC vc;
-  ExprHashMap< std::pair<ExprHandle, unsigned> > constructed;
+
+  struct ConstructedEntry {
+    ExprHandle handle;
+    unsigned width;
+    std::list<ref<Expr> >::iterator lru;
+  };
+  ExprHashMap<ConstructedEntry> constructed;
+  /// keys of constructed, most recently used first
+  std::list<ref<Expr> > constructedLRU;
+  size_t constructCacheCapacity;
+
+  /// The translation of an update list, by its most recent update. Holding
+  /// the update keeps the list from being freed, so its address is not
+  /// reused for another list while the translation is cached.
+  struct UpdateEntry {
+    ref<UpdateNode> un;
+    ExprHandle handle;
+  };
+  std::unordered_map<const UpdateNode *, UpdateEntry> updateTranslations;
+  /// size of updateTranslations after its last sweep
+  size_t updateTranslationsSwept;
+
+  /// Drop the translations of the updates only the builder holds.
+  void sweepUpdateTranslations();
 
   /// optimizeDivides - Rewrite division and reminders by constants
   /// into multiplies and shifts. STP should probably handle this for
@@ -105,8 +137,8 @@ private:
   ::VCExpr getInitialArray(const Array *os);
   ::VCExpr getArrayForUpdate(const Array *root, const UpdateNode *un);
 
-  ExprHandle constructActual(ref<Expr> e, int *width_out);
-  ExprHandle construct(ref<Expr> e, int *width_out);
+  ExprHandle constructActual(const ref<Expr> &e, int *width_out);
+  ExprHandle construct(const ref<Expr> &e, int *width_out);
   
   ::VCExpr buildVar(const char *name, unsigned width);
   ::VCExpr buildArray(const char *name, unsigned indexWidth, unsigned valueWidth);
@@ -119,11 +151,18 @@ public:
   ExprHandle getFalse();
   ExprHandle getInitialRead(const Array *os, unsigned index);
 
-  ExprHandle construct(ref<Expr> e) { 
-    ExprHandle res = construct(e, 0);
-    constructed.clear();
-    return res;
+  ExprHandle construct(const ref<Expr> &e) { return construct(e, 0); }
+
+  /// Number of expression translations trimConstructCache() keeps, 0 keeps
+  /// none.
+  void setConstructCacheCapacity(size_t capacity) {
+    constructCacheCapacity = capacity;
   }
+
+  /// Evict least recently used translations down to the capacity, and the
+  /// translations of update lists that are no longer used. Called after
+  /// every query.
+  void trimConstructCache();
 };
 
 }
@@ -38,6 +38,13 @@ llvm::cl::opt<bool> DebugDumpSTPQueries(
     llvm::cl::desc("Dump every STP query to stderr (default=false)"),
     llvm::cl::cat(klee::SolvingCat));
 
+llvm::cl::opt<unsigned> STPConstructCacheSize(
+    "stp-construct-cache-size", llvm::cl::init(0),
+    llvm::cl::desc("Keep the STP translations of up to N expressions across "
+                   "queries, evicting the least recently used ones "
+                   "(default=0, i.e. clear the cache after every query)"),
+    llvm::cl::cat(klee::SolvingCat));
+
 llvm::cl::opt<bool> IgnoreSolverFailures(
     "ignore-solver-failures", llvm::cl::init(false),
     llvm::cl::desc("Ignore any STP solver failures (default=false)"),
@@ -96,6 +103,7 @@ STPSolverImpl::STPSolverImpl(bool useForkedSTP, bool optimizeDivides)
       useForkedSTP(useForkedSTP), runStatusCode(SOLVER_RUN_STATUS_FAILURE) {
   assert(vc && "unable to create validity checker");
   assert(builder && "unable to create STPBuilder");
+  builder->setConstructCacheCapacity(STPConstructCacheSize);
 
   // In newer versions of STP, a memory management mechanism has been
   // introduced that automatically invalidates certain C interface
@@ -147,6 +155,7 @@ char *STPSolverImpl::getConstraintLog(const Query &query) {
   unsigned long length;
   vc_printQueryStateToBuffer(vc, builder->getFalse(), &buffer, &length, false);
   vc_pop(vc);
+  builder->trimConstructCache();
 
   return buffer;
 }
@@ -383,6 +392,7 @@ bool STPSolverImpl::computeInitialValues(
   }
 
   vc_pop(vc);
+  builder->trimConstructCache();
 
   return success;
 }
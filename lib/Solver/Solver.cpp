@@ -70,6 +70,46 @@ bool Solver::mayBeTrue(const Query& query, bool &result) {
   return true;
 }
 
+bool Solver::mustBeTrue(const Query &query,
+                        const std::vector<ref<Expr> > &exprs,
+                        std::vector<bool> &results) {
+  results.assign(exprs.size(), false);
+  // Maintain invariants implementations expect.
+  std::vector<ref<Expr> > symbolic;
+  std::vector<unsigned> positions;
+  for (unsigned i = 0; i < exprs.size(); ++i) {
+    assert(exprs[i]->getWidth() == Expr::Bool && "Invalid expression type!");
+    if (ConstantExpr *CE = dyn_cast<ConstantExpr>(exprs[i])) {
+      results[i] = CE->isTrue();
+    } else {
+      symbolic.push_back(exprs[i]);
+      positions.push_back(i);
+    }
+  }
+  if (symbolic.empty())
+    return true;
+
+  std::vector<bool> isValid;
+  if (!impl->computeTruthBatch(query, symbolic, isValid))
+    return false;
+  for (unsigned i = 0; i < positions.size(); ++i)
+    results[positions[i]] = isValid[i];
+  return true;
+}
+
+bool Solver::mayBeTrue(const Query &query,
+                       const std::vector<ref<Expr> > &exprs,
+                       std::vector<bool> &results) {
+  std::vector<ref<Expr> > negated;
+  negated.reserve(exprs.size());
+  for (const ref<Expr> &e : exprs)
+    negated.push_back(Expr::createIsZero(e));
+  if (!mustBeTrue(query, negated, results))
+    return false;
+  results.flip();
+  return true;
+}
+
 bool Solver::mayBeFalse(const Query& query, bool &result) {
   bool res;
   if (!mustBeTrue(query, res))
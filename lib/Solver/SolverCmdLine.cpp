@@ -46,14 +46,50 @@ cl::opt<bool> UseFastCexSolver(
     cl::desc("Enable an experimental range-based solver (default=false)"),
     cl::cat(SolvingCat));
 
+cl::opt<bool> UseSATBitBlaster(
+    "use-sat-bitblaster", cl::init(false),
+    cl::desc("Bit-blast the queries that read arrays only at concrete "
+             "indices and solve them with CaDiCaL instead of the core solver "
+             "(default=false)"),
+    cl::cat(SolvingCat));
+
+cl::opt<bool> UseEqualitySimplifier(
+    "use-equality-simplifier", cl::init(false),
+    cl::desc("Propagate the equalities with constants of a query into its "
+             "other constraints and array reads before solving it "
+             "(default=false)"),
+    cl::cat(SolvingCat));
+
 cl::opt<bool> UseCexCache("use-cex-cache", cl::init(true),
                           cl::desc("Use the counterexample cache (default=true)"),
                           cl::cat(SolvingCat));
 
+cl::opt<bool> UseAdaptiveSolverChain(
+    "adaptive-solver-chain", cl::init(false),
+    cl::desc("Learn for each class of queries whether toggling the "
+             "counterexample cache, the equality simplifier or the fast "
+             "counterexample solver makes solving it faster. Which chain "
+             "answers a query depends on timing, and so may the test cases "
+             "(default=false)"),
+    cl::cat(SolvingCat));
+
 cl::opt<bool> UseBranchCache("use-branch-cache", cl::init(true),
                              cl::desc("Use the branch cache (default=true)"),
                              cl::cat(SolvingCat));
 
+cl::opt<std::string> SolverCacheFile(
+    "solver-cache-file", cl::init(""),
+    cl::desc("Persist solver query results and counterexamples in the given "
+             "file and reuse them across runs (default=off)"),
+    cl::cat(SolvingCat));
+
+cl::list<std::string> SolverHints(
+    "solver-hint",
+    cl::desc("Try the values of the given KTest, or of all the KTests in the "
+             "given directory, as a model of each query before solving it. "
+             "Can be specified multiple times (default=off)"),
+    cl::value_desc("ktest file or directory"), cl::cat(SolvingCat));
+
 cl::opt<bool>
     UseIndependentSolver("use-independent-solver", cl::init(true),
                          cl::desc("Use constraint independence (default=true)"),
@@ -89,6 +125,26 @@ cl::opt<unsigned int> ExprNumThreshold(
         "Max number of exprs should IndependentSolver split (default=500)"),
     cl::cat(SolvingCat));
 
+cl::opt<unsigned> IndependentSolverJobs(
+    "independent-solver-jobs", cl::init(1),
+    cl::desc("Solve the independent factors of an initial values query on "
+             "this many forked workers (default=1)"),
+    cl::cat(SolvingCat));
+
+cl::opt<unsigned> IndependentSolutionCacheSize(
+    "independent-solution-cache-size", cl::init(1024),
+    cl::desc("Keep the solutions of up to N independent factors of initial "
+             "values queries, which the test cases of later states reuse "
+             "when they share the factor (default=1024, 0=off)"),
+    cl::cat(SolvingCat));
+
+cl::opt<unsigned> IndependentSlicingThreshold(
+    "independent-slicing-threshold", cl::init(0),
+    cl::desc("Solve a truth query whose independent constraints are at least "
+             "this many with the constraints that read the bytes it reads, "
+             "and add the others as a model violates them (default=0 (off))"),
+    cl::cat(SolvingCat));
+
 cl::opt<bool> DebugValidateSolver(
     "debug-validate-solver", cl::init(false),
     cl::desc("Crosscheck the results of the solver chain above the core solver "
@@ -137,7 +193,12 @@ cl::bits<QueryLoggingSolverType> QueryLoggingOptions(
             "All queries reaching the solver in .kquery (KQuery) format"),
         clEnumValN(
             SOLVER_SMTLIB, "solver:smt2",
-            "All queries reaching the solver in .smt2 (SMT-LIBv2) format")
+            "All queries reaching the solver in .smt2 (SMT-LIBv2) format"),
+        clEnumValN(ALL_KQLOG, "all:kqlog",
+                   "All queries in binary .kqlog format, see kleaver "
+                   "-print-query-log"),
+        clEnumValN(SOLVER_KQLOG, "solver:kqlog",
+                   "All queries reaching the solver in binary .kqlog format")
             KLEE_LLVM_CL_VAL_END),
     cl::CommaSeparated, cl::cat(SolvingCat));
 
@@ -228,10 +289,25 @@ cl::opt<CoreSolverType> CoreSolverToUse(
                clEnumValN(METASMT_SOLVER, "metasmt",
                           "metaSMT" METASMT_IS_DEFAULT_STR),
                clEnumValN(DUMMY_SOLVER, "dummy", "Dummy solver"),
-               clEnumValN(Z3_SOLVER, "z3", "Z3" Z3_IS_DEFAULT_STR)
+               clEnumValN(Z3_SOLVER, "z3", "Z3" Z3_IS_DEFAULT_STR),
+               clEnumValN(SMTLIB_SOLVER, "smtlib",
+                          "External SMT-LIBv2 solver processes, see "
+                          "-smtlib-solver-command"),
+               clEnumValN(PORTFOLIO_SOLVER, "portfolio",
+                          "Race the backends of -portfolio-solvers")
                    KLEE_LLVM_CL_VAL_END),
     cl::init(DEFAULT_CORE_SOLVER), cl::cat(SolvingCat));
 
+cl::list<CoreSolverType> PortfolioSolvers(
+    "portfolio-solvers", cl::CommaSeparated,
+    cl::desc("Backends raced by -solver-backend=portfolio, each query runs in "
+             "a forked process per backend (default=all available)"),
+    cl::values(clEnumValN(STP_SOLVER, "stp", "STP"),
+               clEnumValN(METASMT_SOLVER, "metasmt", "metaSMT"),
+               clEnumValN(Z3_SOLVER, "z3", "Z3")
+                   KLEE_LLVM_CL_VAL_END),
+    cl::cat(SolvingCat));
+
 cl::opt<CoreSolverType> DebugCrossCheckCoreSolverWith(
     "debug-crosscheck-core-solver",
     cl::desc(
@@ -18,11 +18,35 @@ Statistic stats::queryCacheHits("QueryCacheHits", "QChits") ;
 Statistic stats::queryCacheMisses("QueryCacheMisses", "QCmisses");
 Statistic stats::queryCexCacheHits("QueryCexCacheHits", "QCexHits") ;
 Statistic stats::queryCexCacheMisses("QueryCexCacheMisses", "QCexMisses");
+Statistic stats::queryCexCacheEvictions("QueryCexCacheEvictions", "QCexEvicts");
+Statistic stats::queryPersistentCacheHits("QueryPersistentCacheHits", "QPChits");
+Statistic stats::queryPersistentCacheMisses("QueryPersistentCacheMisses", "QPCmisses");
+Statistic stats::queryWarmStartHits("QueryWarmStartHits", "QWShits");
 Statistic stats::queryConstructTime("QueryConstructTime", "QBtime") ;
 Statistic stats::queryConstructs("QueriesConstructs", "QB");
 Statistic stats::queryCounterexamples("QueriesCEX", "Qcex");
+Statistic stats::portfolioSTPWins("PortfolioSTPWins", "PfSTPw");
+Statistic stats::portfolioSTPLosses("PortfolioSTPLosses", "PfSTPl");
+Statistic stats::portfolioMetaSMTWins("PortfolioMetaSMTWins", "PfMSw");
+Statistic stats::portfolioMetaSMTLosses("PortfolioMetaSMTLosses", "PfMSl");
+Statistic stats::portfolioZ3Wins("PortfolioZ3Wins", "PfZ3w");
+Statistic stats::portfolioZ3Losses("PortfolioZ3Losses", "PfZ3l");
+Statistic stats::queriesBitBlasted("QueriesBitBlasted", "QBB");
+Statistic stats::adaptiveDefaultChain("AdaptiveDefaultChain", "ADef");
+Statistic stats::adaptiveCexCacheToggled("AdaptiveCexCacheToggled", "ACexT");
+Statistic stats::adaptiveEqualitySimplifierToggled(
+    "AdaptiveEqualitySimplifierToggled", "AEqST");
+Statistic stats::adaptiveFastCexToggled("AdaptiveFastCexToggled", "AFCexT");
+Statistic stats::adaptiveExplorations("AdaptiveExplorations", "AExpl");
+Statistic stats::equalitySimplifiedQueries("EqualitySimplifiedQueries", "EqSQ");
+Statistic stats::equalitySimplifiedConstraints("EqualitySimplifiedConstraints", "EqSCons");
 Statistic stats::independentConstraints("IndepentConstraints", "ICons");
 Statistic stats::independentAllConstraints("IndependentAllConstraints", "IAllCons");
+Statistic stats::independentSlicedQueries("IndependentSlicedQueries", "ISlQ");
+Statistic stats::independentSliceRefinements("IndependentSliceRefinements",
+                                             "ISlRef");
+Statistic stats::independentFactorCacheHits("IndependentFactorCacheHits",
+                                            "IFCHits");
 Statistic stats::independentTime("IndependentTime", "Itime");
 Statistic stats::cexCacheTime("CexCacheTime", "CCtime");
 Statistic stats::queryTime("QueryTime", "Qtime");
@@ -0,0 +1,212 @@
+//===-- WarmStartSolver.cpp - Answer queries with known models ------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// An incomplete solver that tries externally provided models, e.g. the KTests
+// of an earlier run that followed a nearby path, before the solver below it.
+// A hint is a model of a query if it satisfies all of its constraints, with
+// the bytes it does not give read as 0. The hint that was a model last is
+// tried first, as consecutive queries of a path mostly share constraints.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Solver/Solver.h"
+
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/Expr.h"
+#include "klee/Expr/ExprEvaluator.h"
+#include "klee/Internal/ADT/KTest.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+#include "klee/Solver/IncompleteSolver.h"
+#include "klee/Solver/SolverStats.h"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/FileSystem.h"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+/// The bytes of a hint by object name
+typedef std::map<std::string, std::vector<unsigned char>> Hint;
+
+class HintEvaluator : public ExprEvaluator {
+  const Hint &hint;
+
+protected:
+  ref<Expr> getInitialValue(const Array &array, unsigned index) {
+    if (!array.isSymbolicArray() || array.getRange() != Expr::Int8)
+      return ReadExpr::create(UpdateList(&array, 0),
+                              ConstantExpr::alloc(index, array.getDomain()));
+    auto it = hint.find(array.name);
+    unsigned char value =
+        it != hint.end() && index < it->second.size() ? it->second[index] : 0;
+    return ConstantExpr::alloc(value, Expr::Int8);
+  }
+
+public:
+  HintEvaluator(const Hint &_hint) : hint(_hint) {}
+};
+
+class WarmStartSolver : public IncompleteSolver {
+  std::vector<Hint> hints;
+  /// the hint tried first
+  unsigned next = 0;
+
+  /// Call f(hint, value) with the value of the query expression under each
+  /// hint that is a model of the query constraints, until f returns true.
+  template <class F> bool forEachModel(const Query &query, F f);
+
+public:
+  WarmStartSolver(std::vector<Hint> _hints) : hints(std::move(_hints)) {}
+
+  IncompleteSolver::PartialValidity computeValidity(const Query &);
+  IncompleteSolver::PartialValidity computeTruth(const Query &);
+  bool computeValue(const Query &, ref<Expr> &result);
+  bool computeInitialValues(const Query &,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char>> &values,
+                            bool &hasSolution);
+};
+
+template <class F>
+bool WarmStartSolver::forEachModel(const Query &query, F f) {
+  for (unsigned i = 0, n = hints.size(); i != n; ++i) {
+    unsigned h = (next + i) % n;
+    HintEvaluator evaluator(hints[h]);
+    bool satisfies = true;
+    for (const ref<Expr> &constraint : query.constraints) {
+      ref<Expr> value = evaluator.visit(constraint);
+      if (!isa<ConstantExpr>(value) || !value->isTrue()) {
+        satisfies = false;
+        break;
+      }
+    }
+    if (!satisfies)
+      continue;
+    ref<Expr> value = evaluator.visit(query.expr);
+    if (ConstantExpr *ce = dyn_cast<ConstantExpr>(value)) {
+      next = h;
+      if (f(hints[h], ce))
+        return true;
+    }
+  }
+  return false;
+}
+
+IncompleteSolver::PartialValidity
+WarmStartSolver::computeValidity(const Query &query) {
+  bool sawTrue = false, sawFalse = false;
+  forEachModel(query, [&](const Hint &, ConstantExpr *value) {
+    (value->isTrue() ? sawTrue : sawFalse) = true;
+    return sawTrue && sawFalse;
+  });
+  if (sawTrue || sawFalse)
+    ++stats::queryWarmStartHits;
+  if (sawTrue && sawFalse)
+    return TrueOrFalse;
+  if (sawFalse)
+    return MayBeFalse;
+  if (sawTrue)
+    return MayBeTrue;
+  return None;
+}
+
+IncompleteSolver::PartialValidity
+WarmStartSolver::computeTruth(const Query &query) {
+  // only a counterexample decides
+  if (!forEachModel(query, [](const Hint &, ConstantExpr *value) {
+        return value->isFalse();
+      }))
+    return None;
+  ++stats::queryWarmStartHits;
+  return MayBeFalse;
+}
+
+bool WarmStartSolver::computeValue(const Query &query, ref<Expr> &result) {
+  if (!forEachModel(query, [&](const Hint &, ConstantExpr *value) {
+        result = value;
+        return true;
+      }))
+    return false;
+  ++stats::queryWarmStartHits;
+  return true;
+}
+
+bool WarmStartSolver::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char>> &values, bool &hasSolution) {
+  const Hint *model = nullptr;
+  if (!forEachModel(query, [&](const Hint &hint, ConstantExpr *value) {
+        model = &hint;
+        return value->isFalse();
+      }))
+    return false;
+
+  // the bytes the evaluation read, 0 where the hint has none
+  values.clear();
+  for (const Array *array : objects) {
+    std::vector<unsigned char> bytes(array->size, 0);
+    auto it = model->find(array->name);
+    if (it != model->end())
+      std::copy_n(it->second.begin(),
+                  std::min<size_t>(it->second.size(), array->size),
+                  bytes.begin());
+    values.push_back(std::move(bytes));
+  }
+  hasSolution = true;
+  ++stats::queryWarmStartHits;
+  return true;
+}
+
+void addHint(const std::string &path, std::vector<Hint> &hints) {
+  KTest *ktest = kTest_fromFile(path.c_str());
+  if (!ktest)
+    klee_error("Could not load the solver hint %s", path.c_str());
+  Hint hint;
+  for (unsigned i = 0; i < ktest->numObjects; ++i) {
+    const KTestObject &obj = ktest->objects[i];
+    hint[obj.name].assign(obj.bytes, obj.bytes + obj.numBytes);
+  }
+  kTest_free(ktest);
+  hints.push_back(std::move(hint));
+}
+
+} // namespace
+
+Solver *klee::createWarmStartSolver(Solver *s,
+                                    const std::vector<std::string> &paths) {
+  std::vector<Hint> hints;
+  for (const std::string &path : paths) {
+    if (!llvm::sys::fs::is_directory(path)) {
+      addHint(path, hints);
+      continue;
+    }
+    // the KTests of a directory, in name order
+    std::vector<std::string> files;
+    std::error_code ec;
+    for (llvm::sys::fs::directory_iterator it(path, ec), ie; it != ie && !ec;
+         it.increment(ec))
+      if (llvm::StringRef(it->path()).endswith(".ktest"))
+        files.push_back(it->path());
+    if (ec)
+      klee_error("Could not read the solver hints in %s: %s", path.c_str(),
+                 ec.message().c_str());
+    std::sort(files.begin(), files.end());
+    for (const std::string &file : files)
+      addHint(file, hints);
+  }
+  klee_message("Trying %zu solver hints before solving", hints.size());
+  return new Solver(
+      new StagedSolverImpl(new WarmStartSolver(std::move(hints)), s));
+}
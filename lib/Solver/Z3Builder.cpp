@@ -19,6 +19,8 @@
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/Support/CommandLine.h"
 
+#include <atomic>
+
 using namespace klee;
 
 namespace {
@@ -28,8 +30,8 @@ llvm::cl::opt<bool> UseConstructHashZ3(
     llvm::cl::init(true),
     llvm::cl::cat(klee::ExprCat));
 
-// FIXME: This should be std::atomic<bool>. Need C++11 for that.
-bool Z3InterationLogOpen = false;
+// Z3's interaction log is process wide, at most one builder may write it
+std::atomic<bool> Z3InterationLogOpen(false);
 }
 
 namespace klee {
@@ -75,15 +77,17 @@ void Z3ArrayExprHash::clear() {
 }
 
 Z3Builder::Z3Builder(bool autoClearConstructCache, const char* z3LogInteractionFileArg)
-    : autoClearConstructCache(autoClearConstructCache), z3LogInteractionFile("") {
+    : constructCacheCapacity(0), updateTranslationsSwept(0),
+      autoClearConstructCache(autoClearConstructCache), z3LogInteractionFile("") {
   if (z3LogInteractionFileArg)
     this->z3LogInteractionFile = std::string(z3LogInteractionFileArg);
   if (z3LogInteractionFile.length() > 0) {
     klee_message("Logging Z3 API interaction to \"%s\"",
                  z3LogInteractionFile.c_str());
-    assert(!Z3InterationLogOpen && "interaction log should not already be open");
+    bool wasOpen = Z3InterationLogOpen.exchange(true);
+    assert(!wasOpen && "interaction log should not already be open");
+    (void)wasOpen;
     Z3_open_log(z3LogInteractionFile.c_str());
-    Z3InterationLogOpen = true;
   }
   // FIXME: Should probably let the client pass in a Z3_config instead
   Z3_config cfg = Z3_mk_config();
@@ -101,6 +105,9 @@ Z3Builder::~Z3Builder() {
   // Clear caches so exprs/sorts gets freed before the destroying context
   // they aren associated with.
   clearConstructCache();
+  util::TrackMemory(util::MemoryTag::Z3Builder,
+                    -(int64_t)updateTranslations.size() * updateEntryBytes);
+  updateTranslations.clear();
   _arr_hash.clear();
   constant_array_assertions.clear();
   Z3_del_context(ctx);
@@ -431,44 +438,103 @@ Z3ASTHandle Z3Builder::getInitialRead(const Array *root, unsigned index) {
 
 Z3ASTHandle Z3Builder::getArrayForUpdate(const Array *root,
                                          const UpdateNode *un) {
-  if (!un) {
-    return (getInitialArray(root));
-  } else {
-    // FIXME: This really needs to be non-recursive.
-    Z3ASTHandle un_expr;
-    bool hashed = _arr_hash.lookupUpdateNodeExpr(un, un_expr);
+  // the updates since the most recent translated one, most recent first
+  std::vector<const UpdateNode *> pending;
+  Z3ASTHandle un_expr;
+  for (; un; un = un->next.get()) {
+    auto it = updateTranslations.find(un);
+    if (it != updateTranslations.end()) {
+      un_expr = it->second.ast;
+      break;
+    }
+    pending.push_back(un);
+  }
+  if (!un)
+    un_expr = getInitialArray(root);
 
-    if (!hashed) {
-      un_expr = writeExpr(getArrayForUpdate(root, un->next.get()),
-                          construct(un->index, 0), construct(un->value, 0));
+  for (auto it = pending.rbegin(), ie = pending.rend(); it != ie; ++it) {
+    un_expr = writeExpr(un_expr, construct((*it)->index, 0),
+                        construct((*it)->value, 0));
+    updateTranslations.emplace(
+        *it, UpdateEntry{const_cast<UpdateNode *>(*it), un_expr});
+  }
+  util::TrackMemory(util::MemoryTag::Z3Builder,
+                    (int64_t)pending.size() * updateEntryBytes);
+  return un_expr;
+}
 
-      _arr_hash.hashUpdateNodeExpr(un, un_expr);
+void Z3Builder::sweepUpdateTranslations() {
+  size_t before = updateTranslations.size();
+  std::vector<ref<UpdateNode> > dead;
+  for (auto it = updateTranslations.begin(); it != updateTranslations.end();) {
+    if (it->second.un->_refCount.getCount() == 1) {
+      dead.push_back(std::move(it->second.un));
+      it = updateTranslations.erase(it);
+    } else {
+      ++it;
     }
+  }
+  // freeing a list may leave the updates below it to the builder alone
+  for (ref<UpdateNode> &un : dead) {
+    while (un->_refCount.getCount() == 1 && !un->next.isNull()) {
+      ref<UpdateNode> next = un->next;
+      un = nullptr;
+      auto it = updateTranslations.find(next.get());
+      if (it == updateTranslations.end() ||
+          next->_refCount.getCount() != 2)
+        break;
+      updateTranslations.erase(it);
+      un = std::move(next);
+    }
+  }
+  util::TrackMemory(util::MemoryTag::Z3Builder,
+                    -(int64_t)(before - updateTranslations.size()) *
+                        updateEntryBytes);
+  updateTranslationsSwept = updateTranslations.size();
+}
 
-    return (un_expr);
+void Z3Builder::trimConstructCache() {
+  // sweep when the cache doubled, which keeps the sweeps amortized constant
+  // time per translated update
+  if (updateTranslations.size() >= 1024 &&
+      updateTranslations.size() >= 2 * updateTranslationsSwept)
+    sweepUpdateTranslations();
+  if (!constructCacheCapacity) {
+    clearConstructCache();
+    return;
+  }
+  while (constructed.size() > constructCacheCapacity) {
+    constructed.erase(constructedLRU.back());
+    constructedLRU.pop_back();
+    util::TrackMemory(util::MemoryTag::Z3Builder, -constructedEntryBytes);
   }
 }
 
 /** if *width_out!=1 then result is a bitvector,
     otherwise it is a bool */
-Z3ASTHandle Z3Builder::construct(ref<Expr> e, int *width_out) {
+Z3ASTHandle Z3Builder::construct(const ref<Expr> &e, int *width_out) {
   // TODO: We could potentially use Z3_simplify() here
   // to store simpler expressions.
   if (!UseConstructHashZ3 || isa<ConstantExpr>(e)) {
     return constructActual(e, width_out);
   } else {
-    ExprHashMap<std::pair<Z3ASTHandle, unsigned> >::iterator it =
-        constructed.find(e);
+    ExprHashMap<ConstructedEntry>::iterator it = constructed.find(e);
     if (it != constructed.end()) {
+      constructedLRU.splice(constructedLRU.begin(), constructedLRU,
+                            it->second.lru);
       if (width_out)
-        *width_out = it->second.second;
-      return it->second.first;
+        *width_out = it->second.width;
+      return it->second.ast;
     } else {
       int width;
       if (!width_out)
         width_out = &width;
       Z3ASTHandle res = constructActual(e, width_out);
-      constructed.insert(std::make_pair(e, std::make_pair(res, *width_out)));
+      constructedLRU.push_front(e);
+      constructed.insert(std::make_pair(
+          e, ConstructedEntry{res, (unsigned)*width_out,
+                              constructedLRU.begin()}));
+      util::TrackMemory(util::MemoryTag::Z3Builder, constructedEntryBytes);
       return res;
     }
   }
@@ -476,7 +542,7 @@ Z3ASTHandle Z3Builder::construct(ref<Expr> e, int *width_out) {
 
 /** if *width_out!=1 then result is a bitvector,
     otherwise it is a bool */
-Z3ASTHandle Z3Builder::constructActual(ref<Expr> e, int *width_out) {
+Z3ASTHandle Z3Builder::constructActual(const ref<Expr> &e, int *width_out) {
   int width;
   if (!width_out)
     width_out = &width;
@@ -13,7 +13,9 @@
 #include "klee/Config/config.h"
 #include "klee/Expr/ArrayExprHash.h"
 #include "klee/Expr/ExprHashMap.h"
+#include "klee/Internal/System/MemoryUsage.h"
 
+#include <list>
 #include <unordered_map>
 #include <z3.h>
 
@@ -101,10 +103,50 @@ public:
   void clear();
 };
 
+/// Translates KLEE expressions into terms of the builder's own Z3 context.
+///
+/// A builder and everything it constructed belong to one context, so a
+/// builder must only be used by one thread at a time; parallel solving uses
+/// one builder per worker. Translations are kept across queries: the array
+/// terms for as long as the builder lives, the update list terms for as long
+/// as their updates are alive outside the builder, and the expression cache
+/// up to the capacity given to setConstructCacheCapacity(), evicting the
+/// least recently used expressions first.
 class Z3Builder {
-  ExprHashMap<std::pair<Z3ASTHandle, unsigned> > constructed;
+  struct ConstructedEntry {
+    Z3ASTHandle ast;
+    unsigned width;
+    std::list<ref<Expr> >::iterator lru;
+  };
+  ExprHashMap<ConstructedEntry> constructed;
+  /// keys of constructed, most recently used first
+  std::list<ref<Expr> > constructedLRU;
+  size_t constructCacheCapacity;
   Z3ArrayExprHash _arr_hash;
 
+  /// Estimated bytes of a translation of the expression cache, counted as
+  /// util::MemoryTag::Z3Builder: the entry, its hash and LRU nodes. The Z3
+  /// terms themselves live in Z3's own allocator.
+  static constexpr int64_t constructedEntryBytes =
+      sizeof(ConstructedEntry) + 2 * sizeof(ref<Expr>) + 6 * sizeof(void *);
+
+  /// The translation of an update list, by its most recent update. Holding
+  /// the update keeps the list from being freed, so its address is not
+  /// reused for another list while the translation is cached. A query then
+  /// only translates the updates added since an earlier query.
+  struct UpdateEntry {
+    ref<UpdateNode> un;
+    Z3ASTHandle ast;
+  };
+  std::unordered_map<const UpdateNode *, UpdateEntry> updateTranslations;
+  /// size of updateTranslations after its last sweep
+  size_t updateTranslationsSwept;
+  static constexpr int64_t updateEntryBytes =
+      sizeof(UpdateEntry) + 4 * sizeof(void *);
+
+  /// Drop the translations of the updates only the builder holds.
+  void sweepUpdateTranslations();
+
 private:
   Z3ASTHandle bvOne(unsigned width);
   Z3ASTHandle bvZero(unsigned width);
@@ -155,11 +197,10 @@ private:
   Z3ASTHandle constructAShrByConstant(Z3ASTHandle expr, unsigned shift,
                                       Z3ASTHandle isSigned);
 
-  Z3ASTHandle getInitialArray(const Array *os);
   Z3ASTHandle getArrayForUpdate(const Array *root, const UpdateNode *un);
 
-  Z3ASTHandle constructActual(ref<Expr> e, int *width_out);
-  Z3ASTHandle construct(ref<Expr> e, int *width_out);
+  Z3ASTHandle constructActual(const ref<Expr> &e, int *width_out);
+  Z3ASTHandle construct(const ref<Expr> &e, int *width_out);
 
   Z3ASTHandle buildArray(const char *name, unsigned indexWidth,
                          unsigned valueWidth);
@@ -179,15 +220,31 @@ public:
   Z3ASTHandle getTrue();
   Z3ASTHandle getFalse();
   Z3ASTHandle getInitialRead(const Array *os, unsigned index);
+  Z3ASTHandle getInitialArray(const Array *os);
 
-  Z3ASTHandle construct(ref<Expr> e) {
+  Z3ASTHandle construct(const ref<Expr> &e) {
     Z3ASTHandle res = construct(e, 0);
     if (autoClearConstructCache)
       clearConstructCache();
     return res;
   }
 
-  void clearConstructCache() { constructed.clear(); }
+  void clearConstructCache() {
+    util::TrackMemory(util::MemoryTag::Z3Builder,
+                      -(int64_t)constructed.size() * constructedEntryBytes);
+    constructed.clear();
+    constructedLRU.clear();
+  }
+
+  /// Number of expression translations trimConstructCache() keeps, 0 keeps
+  /// none.
+  void setConstructCacheCapacity(size_t capacity) {
+    constructCacheCapacity = capacity;
+  }
+
+  /// Evict least recently used translations down to the capacity, and the
+  /// translations of update lists that are no longer used.
+  void trimConstructCache();
 };
 }
 
@@ -11,6 +11,7 @@
 #include "klee/Internal/Support/ErrorHandling.h"
 #include "klee/Internal/Support/FileHandling.h"
 #include "klee/Internal/Support/MiscCmdLine.h"
+#include "klee/Internal/System/Time.h"
 #include "klee/OptionCategories.h"
 
 #ifdef ENABLE_Z3
@@ -51,6 +52,53 @@ llvm::cl::opt<bool> Z3ValidateModels(
     llvm::cl::desc("When generating Z3 models validate these against the query"),
     llvm::cl::cat(klee::SolvingCat));
 
+llvm::cl::opt<unsigned> Z3IncrementalContexts(
+    "z3-incremental-contexts", llvm::cl::init(0),
+    llvm::cl::desc("Keep up to N incremental Z3 solvers. A query reuses the "
+                   "one whose asserted constraints are the largest subset of "
+                   "its own, asserts only the missing constraints and checks "
+                   "the query expression inside a push/pop scope "
+                   "(default=0, i.e. a fresh solver per query)"),
+    llvm::cl::cat(klee::SolvingCat));
+
+llvm::cl::opt<unsigned> Z3IncrementalScopes(
+    "z3-incremental-scopes", llvm::cl::init(32),
+    llvm::cl::desc("Assert the constraints each query adds to an incremental "
+                   "context in a scope of their own, up to N scopes deep. A "
+                   "sibling state, e.g. of a memory fork, pops the scopes of "
+                   "the constraints it does not share instead of taking "
+                   "another context, if it keeps at least half of the "
+                   "asserted constraints (default=32, 0=disabled)"),
+    llvm::cl::cat(klee::SolvingCat));
+
+llvm::cl::opt<unsigned> Z3ConstructCacheSize(
+    "z3-construct-cache-size", llvm::cl::init(0),
+    llvm::cl::desc("Keep the Z3 translations of up to N expressions across "
+                   "queries, evicting the least recently used ones "
+                   "(default=0, i.e. clear the cache after every query)"),
+    llvm::cl::cat(klee::SolvingCat));
+
+llvm::cl::opt<std::string> Z3Tactic(
+    "z3-tactic", llvm::cl::init("default"),
+    llvm::cl::desc("Solve queries with this Z3 tactic: a preset (default, "
+                   "qfbv, qfabv) or a tactic expression as accepted by "
+                   "check-sat-using, e.g. \"(then simplify solve-eqs smt)\". "
+                   "Queries on which the tactic fails fall back to Z3's smt "
+                   "tactic (default=default, i.e. Z3's default solver)"),
+    llvm::cl::cat(klee::SolvingCat));
+
+llvm::cl::opt<std::string> Z3TacticConcreteReads(
+    "z3-tactic-concrete-reads", llvm::cl::init(""),
+    llvm::cl::desc("Z3 tactic for queries that read arrays at concrete "
+                   "indices only and have no updates (default=-z3-tactic)"),
+    llvm::cl::cat(klee::SolvingCat));
+
+llvm::cl::opt<std::string> Z3TacticSymbolicReads(
+    "z3-tactic-symbolic-reads", llvm::cl::init(""),
+    llvm::cl::desc("Z3 tactic for queries that read arrays at symbolic "
+                   "indices or through updates (default=-z3-tactic)"),
+    llvm::cl::cat(klee::SolvingCat));
+
 llvm::cl::opt<unsigned>
     Z3VerbosityLevel("debug-z3-verbosity", llvm::cl::init(0),
                      llvm::cl::desc("Z3 verbosity level (default=0)"),
@@ -59,6 +107,149 @@ llvm::cl::opt<unsigned>
 
 #include "llvm/Support/ErrorHandling.h"
 
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <set>
+
+namespace {
+/// The named tactics of -z3-tactic.
+const struct {
+  const char *name;
+  /// null for Z3's default solver
+  const char *tactic;
+} Z3TacticPresets[] = {
+    {"default", nullptr},
+    // arrays read at concrete indices become bit-vectors, then bit-blasting
+    {"qfbv", "(then simplify propagate-values solve-eqs bvarray2uf "
+             "ackermannize_bv simplify bit-blast sat)"},
+    // word-level preprocessing in front of the SMT core
+    {"qfabv", "(then simplify propagate-values solve-eqs elim-uncnstr smt)"},
+};
+
+/// Builds a Z3 tactic from the tactic expressions of check-sat-using: a
+/// tactic name, (then t...), (or-else t...), (par-or t...), (try-for t ms)
+/// or (repeat t [max]).
+class Z3TacticParser {
+  ::Z3_context ctx;
+  const std::string &text;
+  size_t pos;
+  std::set<std::string> names;
+
+  std::string token() {
+    while (pos < text.size() && isspace(text[pos]))
+      ++pos;
+    if (pos == text.size())
+      return "";
+    if (text[pos] == '(' || text[pos] == ')')
+      return std::string(1, text[pos++]);
+    size_t start = pos;
+    while (pos < text.size() && !isspace(text[pos]) && text[pos] != '(' &&
+           text[pos] != ')')
+      ++pos;
+    return text.substr(start, pos - start);
+  }
+
+  static bool parseUnsigned(const std::string &s, unsigned &value) {
+    if (s.empty() || s.size() > 9 ||
+        !std::all_of(s.begin(), s.end(), [](char c) { return isdigit(c); }))
+      return false;
+    value = std::stoul(s);
+    return true;
+  }
+
+  /// \return a referenced tactic, or null with error set
+  ::Z3_tactic parse(std::string &error) {
+    std::string t = token();
+    if (t.empty() || t == ")") {
+      error = "expected a tactic";
+      return nullptr;
+    }
+    if (t != "(") {
+      if (!names.count(t)) {
+        error = "unknown tactic " + t;
+        return nullptr;
+      }
+      ::Z3_tactic tactic = Z3_mk_tactic(ctx, t.c_str());
+      Z3_tactic_inc_ref(ctx, tactic);
+      return tactic;
+    }
+
+    std::string combinator = token();
+    ::Z3_tactic result = parse(error);
+    if (!result)
+      return nullptr;
+    auto replace = [&](::Z3_tactic tactic) {
+      Z3_tactic_inc_ref(ctx, tactic);
+      Z3_tactic_dec_ref(ctx, result);
+      result = tactic;
+    };
+    if (combinator == "then" || combinator == "and-then" ||
+        combinator == "or-else" || combinator == "par-or") {
+      size_t next;
+      while (next = pos, token() != ")") {
+        pos = next;
+        ::Z3_tactic t = parse(error);
+        if (!t) {
+          Z3_tactic_dec_ref(ctx, result);
+          return nullptr;
+        }
+        if (combinator == "or-else") {
+          replace(Z3_tactic_or_else(ctx, result, t));
+        } else if (combinator == "par-or") {
+          ::Z3_tactic ts[] = {result, t};
+          replace(Z3_tactic_par_or(ctx, 2, ts));
+        } else {
+          replace(Z3_tactic_and_then(ctx, result, t));
+        }
+        Z3_tactic_dec_ref(ctx, t);
+      }
+      return result;
+    }
+    if (combinator == "try-for" || combinator == "repeat") {
+      std::string arg = token();
+      unsigned value = UINT_MAX;
+      if (arg != ")") {
+        if (!parseUnsigned(arg, value) || token() != ")") {
+          error = "expected a number and ) after " + combinator;
+          Z3_tactic_dec_ref(ctx, result);
+          return nullptr;
+        }
+      } else if (combinator == "try-for") {
+        error = "try-for needs a time in milliseconds";
+        Z3_tactic_dec_ref(ctx, result);
+        return nullptr;
+      }
+      replace(combinator == "repeat"
+                  ? Z3_tactic_repeat(ctx, result, value)
+                  : Z3_tactic_try_for(ctx, result, value));
+      return result;
+    }
+    error = "unknown combinator " + combinator;
+    Z3_tactic_dec_ref(ctx, result);
+    return nullptr;
+  }
+
+public:
+  Z3TacticParser(::Z3_context _ctx, const std::string &_text)
+      : ctx(_ctx), text(_text), pos(0) {
+    for (unsigned i = 0, n = Z3_get_num_tactics(ctx); i != n; ++i)
+      names.insert(Z3_get_tactic_name(ctx, i));
+  }
+
+  /// \return a referenced tactic, or null with error set
+  ::Z3_tactic parseAll(std::string &error) {
+    ::Z3_tactic tactic = parse(error);
+    if (tactic && !token().empty()) {
+      error = "trailing text";
+      Z3_tactic_dec_ref(ctx, tactic);
+      return nullptr;
+    }
+    return tactic;
+  }
+};
+} // namespace
+
 namespace klee {
 
 class Z3SolverImpl : public SolverImpl {
@@ -71,12 +262,83 @@ private:
   // Parameter symbols
   ::Z3_symbol timeoutParamStrSymbol;
 
+  /// The queries that are solved with the same tactic.
+  enum QueryClass { ConcreteReads, SymbolicReads, NumQueryClasses };
+  struct ClassTactic {
+    std::string name;
+    /// null for Z3's default solver
+    ::Z3_tactic tactic;
+    uint64_t queries;
+    time::Span time;
+  };
+  ClassTactic tactics[NumQueryClasses];
+
+  static QueryClass classify(const Query &query);
+  void initTactic(ClassTactic &tactic, const std::string &option);
+  ::Z3_solver makeSolver(QueryClass queryClass);
+
+  /// What one push scope of an incremental context asserted
+  struct IncrementalScope {
+    std::vector<ref<Expr>> constraints;
+    std::vector<const Array *> constantArrays;
+  };
+
+  /// A solver kept across queries, with what is asserted in its scopes.
+  /// Constraints only grow along a path (and per independent factor), so a
+  /// later query usually just adds a few constraints to an existing context.
+  /// Siblings share the constraints of their common ancestor, the scopes
+  /// asserted for that ancestor stay and only those of the other sibling
+  /// are popped.
+  struct IncrementalContext {
+    ::Z3_solver solver;
+    ExprHashSet asserted;
+    std::set<const Array *> constantArrays;
+    /// the base scope first, never empty
+    std::vector<IncrementalScope> scopes;
+    uint64_t lastUse;
+    QueryClass queryClass;
+
+    /// Record that the top scope asserted e.
+    /// \return false if e is asserted already
+    bool assertConstraint(const ref<Expr> &e) {
+      if (!asserted.insert(e).second)
+        return false;
+      scopes.back().constraints.push_back(e);
+      return true;
+    }
+    bool assertConstantArray(const Array *array) {
+      if (!constantArrays.insert(array).second)
+        return false;
+      scopes.back().constantArrays.push_back(array);
+      return true;
+    }
+  };
+  std::vector<IncrementalContext> incrementalContexts;
+  uint64_t incrementalClock;
+
+  /// The context sharing the most constraints with query, with the scopes
+  /// of those it does not share popped and a scope pushed for the query's
+  /// own constraints.
+  IncrementalContext &getIncrementalContext(const Query &query,
+                                            QueryClass queryClass);
+  void popScopes(IncrementalContext &ic, unsigned n);
+
   bool internalRunSolver(const Query &,
                          const std::vector<const Array *> *objects,
                          std::vector<std::vector<unsigned char> > *values,
                          bool &hasSolution);
+  /// Check theSolver with the tactic of queryClass, dumping the query and
+  /// accounting its time to the tactic.
+  ::Z3_lbool check(::Z3_solver theSolver, QueryClass queryClass);
   int Z3GetInitialRead(const Array *array, ::Z3_model &theModel,
                        unsigned offset);
+  /// Read all the bytes of array from the model value of the array at
+  /// once: an as-array function interpretation or a chain of stores over a
+  /// constant array.
+  /// \return false, leaving bytes in an unspecified state, if the model
+  /// value has another form
+  bool Z3GetInitialArray(const Array *array, ::Z3_model &theModel,
+                         std::vector<unsigned char> &bytes);
   bool validateZ3Model(::Z3_solver &theSolver, ::Z3_model &theModel);
 
 public:
@@ -95,6 +357,8 @@ public:
   }
 
   bool computeTruth(const Query &, bool &isValid);
+  bool computeTruthBatch(const Query &, const std::vector<ref<Expr> > &exprs,
+                         std::vector<bool> &isValid);
   bool computeValue(const Query &, ref<Expr> &result);
   bool computeInitialValues(const Query &,
                             const std::vector<const Array *> &objects,
@@ -115,12 +379,19 @@ Z3SolverImpl::Z3SolverImpl()
           /*z3LogInteractionFileArg=*/Z3LogInteractionFile.size() > 0
               ? Z3LogInteractionFile.c_str()
               : NULL)),
-      runStatusCode(SOLVER_RUN_STATUS_FAILURE) {
+      runStatusCode(SOLVER_RUN_STATUS_FAILURE), incrementalClock(0) {
   assert(builder && "unable to create Z3Builder");
+  builder->setConstructCacheCapacity(Z3ConstructCacheSize);
   solverParameters = Z3_mk_params(builder->ctx);
   Z3_params_inc_ref(builder->ctx, solverParameters);
   timeoutParamStrSymbol = Z3_mk_string_symbol(builder->ctx, "timeout");
   setCoreSolverTimeout(timeout);
+  initTactic(tactics[ConcreteReads], Z3TacticConcreteReads.empty()
+                                         ? Z3Tactic
+                                         : Z3TacticConcreteReads);
+  initTactic(tactics[SymbolicReads], Z3TacticSymbolicReads.empty()
+                                         ? Z3Tactic
+                                         : Z3TacticSymbolicReads);
 
   if (!Z3QueryDumpFile.empty()) {
     std::string error;
@@ -143,6 +414,18 @@ Z3SolverImpl::Z3SolverImpl()
 }
 
 Z3SolverImpl::~Z3SolverImpl() {
+  if (dumpedQueriesFile && Z3QueryStats) {
+    const char *classNames[] = {"concrete reads", "symbolic reads"};
+    for (unsigned i = 0; i != NumQueryClasses; ++i)
+      *dumpedQueriesFile << "; " << classNames[i] << ": " << tactics[i].queries
+                         << " queries in " << tactics[i].time.toSeconds()
+                         << " s with tactic " << tactics[i].name << "\n";
+  }
+  for (auto &ic : incrementalContexts)
+    Z3_solver_dec_ref(builder->ctx, ic.solver);
+  for (ClassTactic &tactic : tactics)
+    if (tactic.tactic)
+      Z3_tactic_dec_ref(builder->ctx, tactic.tactic);
   Z3_params_dec_ref(builder->ctx, solverParameters);
   delete builder;
 }
@@ -222,6 +505,13 @@ char *Z3SolverImpl::getConstraintLog(const Query &query) {
   return strdup(result);
 }
 
+/// Whether e only reads arrays without updates at constant indices
+static bool readsConcretely(const ref<Expr> &e) {
+  // reads of read-free indices are reads of constant indices
+  const ExprMetadata &md = e->getMetadata();
+  return md.indirectReadDepth <= 1 && md.maxUpdates == 0;
+}
+
 bool Z3SolverImpl::computeTruth(const Query &query, bool &isValid) {
   bool hasSolution = false; // to remove compiler warning
   bool status =
@@ -230,6 +520,82 @@ bool Z3SolverImpl::computeTruth(const Query &query, bool &isValid) {
   return status;
 }
 
+bool Z3SolverImpl::computeTruthBatch(const Query &query,
+                                     const std::vector<ref<Expr> > &exprs,
+                                     std::vector<bool> &isValid) {
+  TimerStatIncrementer t(stats::queryTime);
+  // the constraints are asserted once, each expression is checked in a
+  // scope of its own
+  QueryClass queryClass = classify(query.withExpr(exprs[0]));
+  for (const auto &e : exprs)
+    if (!readsConcretely(e))
+      queryClass = SymbolicReads;
+  IncrementalContext *inc = Z3IncrementalContexts
+                                ? &getIncrementalContext(query, queryClass)
+                                : nullptr;
+  Z3_solver theSolver = inc ? inc->solver : makeSolver(queryClass);
+  Z3_solver_set_params(builder->ctx, theSolver, solverParameters);
+
+  runStatusCode = SOLVER_RUN_STATUS_FAILURE;
+
+  ConstantArrayFinder constant_arrays_in_query;
+  for (auto const &constraint : query.constraints) {
+    if (inc && !inc->assertConstraint(constraint))
+      continue;
+    Z3_solver_assert(builder->ctx, theSolver, builder->construct(constraint));
+    constant_arrays_in_query.visit(constraint);
+  }
+
+  std::vector<Z3ASTHandle> z3Exprs;
+  z3Exprs.reserve(exprs.size());
+  for (auto const &e : exprs) {
+    z3Exprs.push_back(Z3ASTHandle(builder->construct(e), builder->ctx));
+    constant_arrays_in_query.visit(e);
+  }
+
+  for (auto const &constant_array : constant_arrays_in_query.results) {
+    assert(builder->constant_array_assertions.count(constant_array) == 1 &&
+           "Constant array found in query, but not handled by Z3Builder");
+    if (inc && !inc->assertConstantArray(constant_array))
+      continue;
+    for (auto const &arrayIndexValueExpr :
+         builder->constant_array_assertions[constant_array]) {
+      Z3_solver_assert(builder->ctx, theSolver, arrayIndexValueExpr);
+    }
+  }
+
+  isValid.assign(exprs.size(), false);
+  for (unsigned i = 0; i < z3Exprs.size(); ++i) {
+    ++stats::queries;
+    Z3_solver_push(builder->ctx, theSolver);
+    Z3_solver_assert(
+        builder->ctx, theSolver,
+        Z3ASTHandle(Z3_mk_not(builder->ctx, z3Exprs[i]), builder->ctx));
+    ::Z3_lbool satisfiable = check(theSolver, queryClass);
+    bool hasSolution = false;
+    runStatusCode = handleSolverResponse(theSolver, satisfiable, nullptr,
+                                         nullptr, nullptr, hasSolution);
+    Z3_solver_pop(builder->ctx, theSolver, 1);
+    if (runStatusCode != SOLVER_RUN_STATUS_SUCCESS_SOLVABLE &&
+        runStatusCode != SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE)
+      break;
+    if (hasSolution) {
+      ++stats::queriesInvalid;
+    } else {
+      ++stats::queriesValid;
+    }
+    isValid[i] = !hasSolution;
+  }
+
+  z3Exprs.clear();
+  if (!inc)
+    Z3_solver_dec_ref(builder->ctx, theSolver);
+  builder->trimConstructCache();
+
+  return runStatusCode == SOLVER_RUN_STATUS_SUCCESS_SOLVABLE ||
+         runStatusCode == SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE;
+}
+
 bool Z3SolverImpl::computeValue(const Query &query, ref<Expr> &result) {
   std::vector<const Array *> objects;
   std::vector<std::vector<unsigned char> > values;
@@ -255,6 +621,181 @@ bool Z3SolverImpl::computeInitialValues(
   return internalRunSolver(query, &objects, &values, hasSolution);
 }
 
+void Z3SolverImpl::initTactic(ClassTactic &tactic, const std::string &option) {
+  tactic.name = option;
+  tactic.tactic = nullptr;
+  tactic.queries = 0;
+  const char *text = option.c_str();
+  for (const auto &preset : Z3TacticPresets) {
+    if (option == preset.name) {
+      if (!preset.tactic)
+        return;
+      text = preset.tactic;
+    }
+  }
+
+  std::string error;
+  ::Z3_tactic parsed = Z3TacticParser(builder->ctx, text).parseAll(error);
+  if (!parsed)
+    klee_error("Invalid Z3 tactic \"%s\": %s", option.c_str(), error.c_str());
+  // an undecided goal fails, so that the smt tactic takes over
+  ::Z3_tactic failUndecided = Z3_mk_tactic(builder->ctx, "fail-if-undecided");
+  Z3_tactic_inc_ref(builder->ctx, failUndecided);
+  ::Z3_tactic strict = Z3_tactic_and_then(builder->ctx, parsed, failUndecided);
+  Z3_tactic_inc_ref(builder->ctx, strict);
+  ::Z3_tactic smt = Z3_mk_tactic(builder->ctx, "smt");
+  Z3_tactic_inc_ref(builder->ctx, smt);
+  tactic.tactic = Z3_tactic_or_else(builder->ctx, strict, smt);
+  Z3_tactic_inc_ref(builder->ctx, tactic.tactic);
+  Z3_tactic_dec_ref(builder->ctx, smt);
+  Z3_tactic_dec_ref(builder->ctx, strict);
+  Z3_tactic_dec_ref(builder->ctx, failUndecided);
+  Z3_tactic_dec_ref(builder->ctx, parsed);
+}
+
+Z3SolverImpl::QueryClass Z3SolverImpl::classify(const Query &query) {
+  if (!readsConcretely(query.expr))
+    return SymbolicReads;
+  for (const auto &constraint : query.constraints)
+    if (!readsConcretely(constraint))
+      return SymbolicReads;
+  return ConcreteReads;
+}
+
+::Z3_solver Z3SolverImpl::makeSolver(QueryClass queryClass) {
+  ::Z3_solver solver =
+      tactics[queryClass].tactic
+          ? Z3_mk_solver_from_tactic(builder->ctx, tactics[queryClass].tactic)
+          : Z3_mk_solver(builder->ctx);
+  Z3_solver_inc_ref(builder->ctx, solver);
+  return solver;
+}
+
+Z3SolverImpl::IncrementalContext &
+Z3SolverImpl::getIncrementalContext(const Query &query,
+                                    QueryClass queryClass) {
+  IncrementalContext *best = nullptr;
+  size_t bestKept = 0;
+  unsigned bestScopes = 0;
+  for (auto &ic : incrementalContexts) {
+    if (ic.queryClass != queryClass)
+      continue;
+    // the scopes from the base up whose constraints query has too
+    size_t kept = 0;
+    unsigned scopes = 0;
+    for (const IncrementalScope &scope : ic.scopes) {
+      if (!std::all_of(scope.constraints.begin(), scope.constraints.end(),
+                       [&query](const ref<Expr> &e) {
+                         return query.constraints.count(e) != 0;
+                       }))
+        break;
+      kept += scope.constraints.size();
+      ++scopes;
+    }
+    // a sibling that diverged too much leaves the context to the others
+    if (scopes < ic.scopes.size() &&
+        (!scopes || !Z3IncrementalScopes || 2 * kept < ic.asserted.size()))
+      continue;
+    if (best && kept <= bestKept)
+      continue;
+    best = &ic;
+    bestKept = kept;
+    bestScopes = scopes;
+  }
+
+  if (best) {
+    popScopes(*best, best->scopes.size() - bestScopes);
+  } else {
+    if (incrementalContexts.size() < Z3IncrementalContexts) {
+      incrementalContexts.emplace_back();
+      best = &incrementalContexts.back();
+      best->solver = makeSolver(queryClass);
+      best->queryClass = queryClass;
+    } else {
+      // recycle the least recently used context
+      best = &*std::min_element(
+          incrementalContexts.begin(), incrementalContexts.end(),
+          [](const IncrementalContext &a, const IncrementalContext &b) {
+            return a.lastUse < b.lastUse;
+          });
+      if (best->queryClass == queryClass) {
+        Z3_solver_reset(builder->ctx, best->solver);
+      } else {
+        Z3_solver_dec_ref(builder->ctx, best->solver);
+        best->solver = makeSolver(queryClass);
+        best->queryClass = queryClass;
+      }
+      best->asserted.clear();
+      best->constantArrays.clear();
+    }
+    best->scopes.assign(1, IncrementalScope());
+  }
+
+  // the constraints the query adds get a scope of their own, unless the
+  // context is empty or as deep as allowed
+  if (!best->asserted.empty() && bestKept < query.constraints.size() &&
+      best->scopes.size() <= Z3IncrementalScopes) {
+    Z3_solver_push(builder->ctx, best->solver);
+    best->scopes.emplace_back();
+  }
+  best->lastUse = ++incrementalClock;
+  return *best;
+}
+
+void Z3SolverImpl::popScopes(IncrementalContext &ic, unsigned n) {
+  if (!n)
+    return;
+  assert(n < ic.scopes.size() && "cannot pop the base scope");
+  for (unsigned i = 0; i != n; ++i) {
+    IncrementalScope &scope = ic.scopes.back();
+    for (const ref<Expr> &e : scope.constraints)
+      ic.asserted.erase(e);
+    for (const Array *array : scope.constantArrays)
+      ic.constantArrays.erase(array);
+    ic.scopes.pop_back();
+  }
+  Z3_solver_pop(builder->ctx, ic.solver, n);
+}
+
+::Z3_lbool Z3SolverImpl::check(::Z3_solver theSolver, QueryClass queryClass) {
+  if (dumpedQueriesFile) {
+    *dumpedQueriesFile << "; start Z3 query\n";
+    *dumpedQueriesFile << Z3_solver_to_string(builder->ctx, theSolver);
+    *dumpedQueriesFile << "(check-sat)\n";
+    if (Z3QueryStats) {
+      *dumpedQueriesFile << "(get-info :all-statistics)\n";
+    }
+    *dumpedQueriesFile << "(reset)\n";
+    *dumpedQueriesFile << "; end Z3 query\n\n";
+    dumpedQueriesFile->flush();
+  }
+
+  time::Point checkStart = time::getWallTime();
+  ::Z3_lbool satisfiable = Z3_solver_check(builder->ctx, theSolver);
+  time::Span checkTime = time::getWallTime() - checkStart;
+  ClassTactic &tactic = tactics[queryClass];
+  ++tactic.queries;
+  tactic.time += checkTime;
+  if (dumpedQueriesFile && Z3QueryStats) {
+    *dumpedQueriesFile << "; tactic " << tactic.name << ": "
+                       << checkTime.toSeconds() << " s\n";
+    ::Z3_stats stats = Z3_solver_get_statistics(builder->ctx, theSolver);
+    Z3_stats_inc_ref(builder->ctx, stats);
+    for (unsigned i = 0, n = Z3_stats_size(builder->ctx, stats); i != n; ++i) {
+      *dumpedQueriesFile << "; " << Z3_stats_get_key(builder->ctx, stats, i)
+                         << " ";
+      if (Z3_stats_is_uint(builder->ctx, stats, i))
+        *dumpedQueriesFile << Z3_stats_get_uint_value(builder->ctx, stats, i);
+      else
+        *dumpedQueriesFile << Z3_stats_get_double_value(builder->ctx, stats, i);
+      *dumpedQueriesFile << "\n";
+    }
+    Z3_stats_dec_ref(builder->ctx, stats);
+    dumpedQueriesFile->flush();
+  }
+  return satisfiable;
+}
+
 bool Z3SolverImpl::internalRunSolver(
     const Query &query, const std::vector<const Array *> *objects,
     std::vector<std::vector<unsigned char> > *values, bool &hasSolution) {
@@ -262,18 +803,26 @@ bool Z3SolverImpl::internalRunSolver(
   TimerStatIncrementerWithMax t(stats::queryTime, stats::queryTimeMaxOnce);
   // NOTE: Z3 will switch to using a slower solver internally if push/pop are
   // used so for now it is likely that creating a new solver each time is the
-  // right way to go until Z3 changes its behaviour.
+  // right way to go until Z3 changes its behaviour. Incremental contexts are
+  // opt-in (-z3-incremental-contexts) for long single-path replays where
+  // re-asserting the whole constraint set dominates.
   //
-  // TODO: Investigate using a custom tactic as described in
+  // The solver runs the tactic of the class of the query (-z3-tactic), see
   // https://github.com/klee/klee/issues/653
-  Z3_solver theSolver = Z3_mk_solver(builder->ctx);
-  Z3_solver_inc_ref(builder->ctx, theSolver);
+  QueryClass queryClass = classify(query);
+  IncrementalContext *inc = Z3IncrementalContexts
+                                ? &getIncrementalContext(query, queryClass)
+                                : nullptr;
+  Z3_solver theSolver =
+      inc ? inc->solver : makeSolver(queryClass);
   Z3_solver_set_params(builder->ctx, theSolver, solverParameters);
 
   runStatusCode = SOLVER_RUN_STATUS_FAILURE;
 
   ConstantArrayFinder constant_arrays_in_query;
   for (auto const &constraint : query.constraints) {
+    if (inc && !inc->assertConstraint(constraint))
+      continue;
     Z3_solver_assert(builder->ctx, theSolver, builder->construct(constraint));
     constant_arrays_in_query.visit(constraint);
   }
@@ -288,12 +837,19 @@ bool Z3SolverImpl::internalRunSolver(
   for (auto const &constant_array : constant_arrays_in_query.results) {
     assert(builder->constant_array_assertions.count(constant_array) == 1 &&
            "Constant array found in query, but not handled by Z3Builder");
+    if (inc && !inc->assertConstantArray(constant_array))
+      continue;
     for (auto const &arrayIndexValueExpr :
          builder->constant_array_assertions[constant_array]) {
       Z3_solver_assert(builder->ctx, theSolver, arrayIndexValueExpr);
     }
   }
 
+  // everything above stays asserted in an incremental context, the query
+  // expression itself is scoped to this query
+  if (inc)
+    Z3_solver_push(builder->ctx, theSolver);
+
   // KLEE Queries are validity queries i.e.
   // ∀ X Constraints(X) → query(X)
   // but Z3 works in terms of satisfiability so instead we ask the
@@ -303,30 +859,21 @@ bool Z3SolverImpl::internalRunSolver(
       builder->ctx, theSolver,
       Z3ASTHandle(Z3_mk_not(builder->ctx, z3QueryExpr), builder->ctx));
 
-  if (dumpedQueriesFile) {
-    *dumpedQueriesFile << "; start Z3 query\n";
-    *dumpedQueriesFile << Z3_solver_to_string(builder->ctx, theSolver);
-    *dumpedQueriesFile << "(check-sat)\n";
-    if (Z3QueryStats) {
-      *dumpedQueriesFile << "(get-info :all-statistics)\n";
-    }
-    *dumpedQueriesFile << "(reset)\n";
-    *dumpedQueriesFile << "; end Z3 query\n\n";
-    dumpedQueriesFile->flush();
-  }
-
-  ::Z3_lbool satisfiable = Z3_solver_check(builder->ctx, theSolver);
+  ::Z3_lbool satisfiable = check(theSolver, queryClass);
   runStatusCode =
       handleSolverResponse(theSolver, satisfiable, query.indep_elemset, objects,
                            values, hasSolution);
 
-  Z3_solver_dec_ref(builder->ctx, theSolver);
-  // Clear the builder's cache to prevent memory usage exploding.
-  // By using ``autoClearConstructCache=false`` and clearning now
+  if (inc)
+    Z3_solver_pop(builder->ctx, theSolver, 1);
+  else
+    Z3_solver_dec_ref(builder->ctx, theSolver);
+  // Trim the builder's cache to prevent memory usage exploding.
+  // By using ``autoClearConstructCache=false`` and trimming now
   // we allow Z3_ast expressions to be shared from an entire
   // ``Query`` rather than only sharing within a single call to
   // ``builder->construct()``.
-  builder->clearConstructCache();
+  builder->trimConstructCache();
 
   time::Span queryTimeOnce = t.check();
   if (t.isMaxUpdated() && DebugDumpKQuery) {
@@ -377,6 +924,77 @@ inline int Z3SolverImpl::Z3GetInitialRead(const Array *array,
   return arrayElementValue;
 }
 
+/// The value of numeral ast in value, false if ast is not a numeral
+static bool getNumeral(::Z3_context ctx, ::Z3_ast ast, unsigned &value) {
+  return ast && Z3_get_ast_kind(ctx, ast) == Z3_NUMERAL_AST &&
+         Z3_get_numeral_uint(ctx, ast, &value);
+}
+
+bool Z3SolverImpl::Z3GetInitialArray(const Array *array,
+                                     ::Z3_model &theModel,
+                                     std::vector<unsigned char> &bytes) {
+  ::Z3_context ctx = builder->ctx;
+  ::Z3_ast rawValue;
+  if (!Z3_model_eval(ctx, theModel, builder->getInitialArray(array),
+                     /*model_completion=*/Z3_TRUE, &rawValue))
+    return false;
+  Z3ASTHandle value(rawValue, ctx);
+  unsigned index, byte;
+
+  if (Z3_is_as_array(ctx, value)) {
+    ::Z3_func_interp interp = Z3_model_get_func_interp(
+        ctx, theModel, Z3_get_as_array_func_decl(ctx, value));
+    if (!interp)
+      return false;
+    Z3_func_interp_inc_ref(ctx, interp);
+    bool success = getNumeral(ctx, Z3_func_interp_get_else(ctx, interp), byte);
+    if (success)
+      std::fill(bytes.begin(), bytes.end(), byte);
+    for (unsigned i = 0, e = Z3_func_interp_get_num_entries(ctx, interp);
+         success && i != e; ++i) {
+      ::Z3_func_entry entry = Z3_func_interp_get_entry(ctx, interp, i);
+      Z3_func_entry_inc_ref(ctx, entry);
+      success = Z3_func_entry_get_num_args(ctx, entry) == 1 &&
+                getNumeral(ctx, Z3_func_entry_get_arg(ctx, entry, 0), index) &&
+                getNumeral(ctx, Z3_func_entry_get_value(ctx, entry), byte);
+      if (success && index < bytes.size())
+        bytes[index] = byte;
+      Z3_func_entry_dec_ref(ctx, entry);
+    }
+    Z3_func_interp_dec_ref(ctx, interp);
+    return success;
+  }
+
+  // (store (store ((as const) default) i v) j w), the outer stores win
+  std::vector<bool> stored(bytes.size());
+  ::Z3_ast ast = value;
+  while (Z3_get_ast_kind(ctx, ast) == Z3_APP_AST) {
+    ::Z3_app app = Z3_to_app(ctx, ast);
+    switch (Z3_get_decl_kind(ctx, Z3_get_app_decl(ctx, app))) {
+    case Z3_OP_STORE:
+      if (!getNumeral(ctx, Z3_get_app_arg(ctx, app, 1), index) ||
+          !getNumeral(ctx, Z3_get_app_arg(ctx, app, 2), byte))
+        return false;
+      if (index < bytes.size() && !stored[index]) {
+        bytes[index] = byte;
+        stored[index] = true;
+      }
+      ast = Z3_get_app_arg(ctx, app, 0);
+      break;
+    case Z3_OP_CONST_ARRAY:
+      if (!getNumeral(ctx, Z3_get_app_arg(ctx, app, 0), byte))
+        return false;
+      for (unsigned i = 0, e = bytes.size(); i != e; ++i)
+        if (!stored[i])
+          bytes[i] = byte;
+      return true;
+    default:
+      return false;
+    }
+  }
+  return false;
+}
+
 SolverImpl::SolverRunStatus Z3SolverImpl::handleSolverResponse(
     ::Z3_solver theSolver, ::Z3_lbool satisfiable,
     const IndependentElementSet *indep_elemset,
@@ -401,17 +1019,23 @@ SolverImpl::SolverRunStatus Z3SolverImpl::handleSolverResponse(
       const Array *array = *it;
       IndependentElementSet::elements_ty::const_iterator indep_ele_it;
       std::vector<unsigned char> data(array->size, 0);
-      if (indep_elemset && ((indep_ele_it = indep_elemset->elements.find(
-                                 array)) != indep_elemset->elements.end())) {
-        for (auto offset : indep_ele_it->second) {
-          int arrayElementValue = Z3GetInitialRead(array, theModel, offset);
-          data[offset] = arrayElementValue;
+      bool independent =
+          indep_elemset && ((indep_ele_it = indep_elemset->elements.find(
+                                 array)) != indep_elemset->elements.end());
+      std::vector<unsigned char> model(array->size);
+      if (Z3GetInitialArray(array, theModel, model)) {
+        if (independent) {
+          for (auto offset : indep_ele_it->second)
+            data[offset] = model[offset];
+        } else {
+          data.swap(model);
         }
+      } else if (independent) {
+        for (auto offset : indep_ele_it->second)
+          data[offset] = Z3GetInitialRead(array, theModel, offset);
       } else {
-        for (unsigned offset = 0; offset < array->size; offset++) {
-          int arrayElementValue = Z3GetInitialRead(array, theModel, offset);
-          data[offset] = arrayElementValue;
-        }
+        for (unsigned offset = 0; offset < array->size; offset++)
+          data[offset] = Z3GetInitialRead(array, theModel, offset);
       }
       values->push_back(std::move(data));
     }
@@ -0,0 +1,245 @@
+//===-- BlockCompression.cpp ----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Internal/Support/BlockCompression.h"
+
+#include "klee/Config/config.h"
+
+#ifdef HAVE_ZLIB_H
+#include "zlib.h"
+#endif
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace klee;
+
+static const char BlockMagic[8] = {'K', 'L', 'E', 'E', 'Z', 'B', 'L', 'K'};
+static const uint32_t BlockVersion = 1;
+/// Uncompressed size of each block but the last
+static const size_t BlockSize = 1024 * 1024;
+
+namespace {
+struct BlockHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t numBlocks;
+  uint64_t size;
+};
+
+struct BlockIndexEntry {
+  uint64_t offset;
+  uint32_t compressedSize;
+  uint32_t size;
+};
+} // namespace
+
+bool klee::isBlockCompressed(const char *data, size_t size) {
+  return size >= sizeof(BlockHeader) &&
+         !memcmp(data, BlockMagic, sizeof(BlockMagic));
+}
+
+#ifdef HAVE_ZLIB_H
+void klee::compressBlocks(const std::string &data, std::string &out) {
+  uint32_t numBlocks = (data.size() + BlockSize - 1) / BlockSize;
+  BlockHeader hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, BlockMagic, sizeof(hdr.magic));
+  hdr.version = BlockVersion;
+  hdr.numBlocks = numBlocks;
+  hdr.size = data.size();
+
+  size_t start = out.size();
+  out.append(reinterpret_cast<const char *>(&hdr), sizeof(hdr));
+  size_t indexStart = out.size();
+  out.resize(indexStart + numBlocks * sizeof(BlockIndexEntry));
+
+  for (uint32_t i = 0; i < numBlocks; ++i) {
+    size_t begin = i * BlockSize;
+    size_t size = std::min(BlockSize, data.size() - begin);
+    uLongf compressedSize = compressBound(size);
+    size_t offset = out.size();
+    out.resize(offset + compressedSize);
+    int res = compress2(reinterpret_cast<Bytef *>(&out[offset]),
+                        &compressedSize,
+                        reinterpret_cast<const Bytef *>(data.data() + begin),
+                        size, Z_BEST_SPEED);
+    (void)res;
+    assert(res == Z_OK && "a block larger than its bound");
+    out.resize(offset + compressedSize);
+
+    BlockIndexEntry entry;
+    entry.offset = offset - start;
+    entry.compressedSize = compressedSize;
+    entry.size = size;
+    memcpy(&out[indexStart + i * sizeof(entry)], &entry, sizeof(entry));
+  }
+}
+#endif
+
+std::unique_ptr<BlockDecompressor>
+BlockDecompressor::open(std::unique_ptr<llvm::MemoryBuffer> image,
+                        std::string &error, size_t window) {
+  const char *data = image->getBufferStart();
+  size_t size = image->getBufferSize();
+  if (!isBlockCompressed(data, size)) {
+    error = "not a block compressed file";
+    return nullptr;
+  }
+#ifndef HAVE_ZLIB_H
+  error = "compressed file, but KLEE was built without zlib";
+  return nullptr;
+#endif
+  BlockHeader hdr;
+  memcpy(&hdr, data, sizeof(hdr));
+  if (hdr.version != BlockVersion) {
+    error = "unsupported block compression version " +
+            std::to_string(hdr.version);
+    return nullptr;
+  }
+  if ((size - sizeof(hdr)) / sizeof(BlockIndexEntry) < hdr.numBlocks) {
+    error = "truncated block index";
+    return nullptr;
+  }
+
+  std::unique_ptr<BlockDecompressor> bd(new BlockDecompressor());
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < hdr.numBlocks; ++i) {
+    BlockIndexEntry entry;
+    memcpy(&entry, data + sizeof(hdr) + i * sizeof(entry), sizeof(entry));
+    if (entry.offset > size || entry.compressedSize > size - entry.offset) {
+      error = "truncated compressed block";
+      return nullptr;
+    }
+    bd->blocks.push_back({entry.offset, entry.compressedSize, entry.size});
+    total += entry.size;
+  }
+  if (total != hdr.size) {
+    error = "block sizes do not add up to the file size";
+    return nullptr;
+  }
+
+  void *buffer = mmap(nullptr, std::max<uint64_t>(hdr.size, 1),
+                      PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                      -1, 0);
+  if (buffer == MAP_FAILED) {
+    error = "cannot allocate " + std::to_string(hdr.size) +
+            " bytes for the decompressed file";
+    return nullptr;
+  }
+  bd->image = std::move(image);
+  bd->buffer = static_cast<char *>(buffer);
+  bd->bufferSize = hdr.size;
+  bd->window = window;
+  bd->thread = std::thread(&BlockDecompressor::run, bd.get());
+  return bd;
+}
+
+BlockDecompressor::~BlockDecompressor() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stop = true;
+  }
+  cond.notify_all();
+  if (thread.joinable())
+    thread.join();
+  if (buffer)
+    munmap(buffer, std::max<size_t>(bufferSize, 1));
+}
+
+bool BlockDecompressor::decompress(const Block &block, char *dst) const {
+#ifdef HAVE_ZLIB_H
+  uLongf size = block.size;
+  return uncompress(reinterpret_cast<Bytef *>(dst), &size,
+                    reinterpret_cast<const Bytef *>(image->getBufferStart() +
+                                                    block.offset),
+                    block.compressedSize) == Z_OK &&
+         size == block.size;
+#else
+  (void)block;
+  (void)dst;
+  return false;
+#endif
+}
+
+void BlockDecompressor::run() {
+  size_t done = 0;
+  for (const Block &block : blocks) {
+    if (window) {
+      std::unique_lock<std::mutex> lock(mutex);
+      cond.wait(lock, [&] { return stop || done < consumed + window; });
+    }
+    if (stop)
+      break;
+    if (!decompress(block, buffer + done)) {
+      failed = true;
+      break;
+    }
+    done += block.size;
+    ready.store(done, std::memory_order_release);
+    // the lock orders the notification after a waiter checked ready
+    std::lock_guard<std::mutex> lock(mutex);
+    cond.notify_all();
+  }
+  // the compressed image is not needed any more, unless to reload
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!failed && !window)
+    image.reset();
+  else
+    cond.notify_all();
+}
+
+bool BlockDecompressor::waitFor(size_t end) {
+  end = std::min(end, bufferSize);
+  if (window) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (end > consumed) {
+      consumed = end;
+      cond.notify_all();
+    }
+  }
+  if (getReady() >= end)
+    return true;
+  std::unique_lock<std::mutex> lock(mutex);
+  cond.wait(lock, [&] { return getReady() >= end || failed; });
+  return getReady() >= end;
+}
+
+void BlockDecompressor::release(size_t end) {
+  size_t page = getpagesize();
+  size_t begin = released / page * page;
+  end = std::min(end, getReady()) / page * page;
+  if (end <= begin)
+    return;
+  madvise(buffer + begin, end - begin, MADV_DONTNEED);
+  released = end;
+}
+
+bool BlockDecompressor::reload(size_t begin) {
+  if (begin >= released)
+    return true;
+  assert(window && "the compressed image is gone");
+  size_t offset = 0, first = released;
+  for (const Block &block : blocks) {
+    if (offset >= released)
+      break;
+    if (offset + block.size > begin) {
+      if (!decompress(block, buffer + offset))
+        return false;
+      first = std::min(first, offset);
+    }
+    offset += block.size;
+  }
+  released = first;
+  return true;
+}
@@ -0,0 +1,178 @@
+//===-- ColumnarStats.cpp -------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Internal/Support/ColumnarStats.h"
+
+#include "klee/Config/config.h"
+
+#include "llvm/Support/MemoryBuffer.h"
+
+#ifdef HAVE_ZLIB_H
+#include "zlib.h"
+#endif
+
+#include <cassert>
+
+using namespace klee;
+
+static const char ColumnarMagic[] = "KLEESTC1";
+
+static void writeU32(llvm::raw_ostream &out, uint32_t v) {
+  char b[4] = {char(v), char(v >> 8), char(v >> 16), char(v >> 24)};
+  out.write(b, 4);
+}
+
+ColumnarStatsWriter::ColumnarStatsWriter(
+    std::unique_ptr<llvm::raw_fd_ostream> _os,
+    const std::vector<std::string> &names)
+    : os(std::move(_os)), columns(names.size()) {
+  *os << ColumnarMagic;
+  writeU32(*os, names.size());
+  for (const std::string &name : names) {
+    writeU32(*os, name.size());
+    *os << name;
+  }
+  os->flush();
+}
+
+void ColumnarStatsWriter::append(const std::vector<int64_t> &row) {
+  assert(row.size() == columns.size());
+  for (unsigned i = 0; i < row.size(); ++i)
+    columns[i].push_back(row[i]);
+}
+
+void ColumnarStatsWriter::flush() {
+  uint32_t rows = columns.empty() ? 0 : columns[0].size();
+  if (!rows)
+    return;
+
+  std::string raw;
+  for (std::vector<int64_t> &column : columns) {
+    int64_t prev = 0;
+    for (int64_t v : column) {
+      uint64_t zz = ((uint64_t)(v - prev) << 1) ^ (uint64_t)((v - prev) >> 63);
+      prev = v;
+      do {
+        raw.push_back(char((zz & 0x7f) | (zz >= 0x80 ? 0x80 : 0)));
+        zz >>= 7;
+      } while (zz);
+    }
+    column.clear();
+  }
+
+  uint8_t codec = 0;
+  std::string stored;
+#ifdef HAVE_ZLIB_H
+  uLongf size = compressBound(raw.size());
+  stored.resize(size);
+  if (compress2(reinterpret_cast<Bytef *>(&stored[0]), &size,
+                reinterpret_cast<const Bytef *>(raw.data()), raw.size(),
+                Z_DEFAULT_COMPRESSION) == Z_OK) {
+    stored.resize(size);
+    codec = 1;
+  }
+#endif
+  const std::string &payload = codec ? stored : raw;
+
+  writeU32(*os, rows);
+  *os << char(codec);
+  writeU32(*os, payload.size());
+  writeU32(*os, raw.size());
+  *os << payload;
+  // the block is complete on disk, readers can pick it up
+  os->flush();
+}
+
+static uint32_t readU32(const unsigned char *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+bool klee::readColumnarStats(const std::string &path,
+                             std::vector<std::string> &names,
+                             std::vector<std::vector<int64_t>> &rows,
+                             std::string &error) {
+  auto buffer = llvm::MemoryBuffer::getFile(path, -1, false);
+  if (!buffer) {
+    error = path + ": " + buffer.getError().message();
+    return false;
+  }
+  const unsigned char *p =
+      reinterpret_cast<const unsigned char *>((*buffer)->getBufferStart());
+  const unsigned char *end = p + (*buffer)->getBufferSize();
+  const size_t magicSize = sizeof(ColumnarMagic) - 1;
+  if (end - p < (ptrdiff_t)magicSize + 4 ||
+      std::string((const char *)p, magicSize) != ColumnarMagic) {
+    error = path + ": not a columnar stats file";
+    return false;
+  }
+  p += magicSize;
+  uint32_t ncols = readU32(p);
+  p += 4;
+  names.clear();
+  for (uint32_t i = 0; i < ncols; ++i) {
+    if (end - p < 4 || end - p - 4 < readU32(p)) {
+      error = path + ": truncated header";
+      return false;
+    }
+    uint32_t n = readU32(p);
+    names.emplace_back((const char *)p + 4, n);
+    p += 4 + n;
+  }
+
+  rows.clear();
+  std::string raw;
+  while (end - p >= 13) {
+    uint32_t nrows = readU32(p), stored = readU32(p + 5),
+             rawSize = readU32(p + 9);
+    uint8_t codec = p[4];
+    if (end - p - 13 < stored)
+      break;
+    const unsigned char *payload = p + 13;
+    p += 13 + stored;
+    if (codec == 1) {
+#ifdef HAVE_ZLIB_H
+      raw.resize(rawSize);
+      uLongf size = rawSize;
+      if (uncompress(reinterpret_cast<Bytef *>(&raw[0]), &size, payload,
+                     stored) != Z_OK || size != rawSize) {
+        error = path + ": corrupt block";
+        return false;
+      }
+#else
+      error = path + ": compressed block, but klee was built without zlib";
+      return false;
+#endif
+    } else {
+      raw.assign((const char *)payload, stored);
+    }
+
+    size_t first = rows.size();
+    rows.resize(first + nrows, std::vector<int64_t>(ncols));
+    size_t i = 0;
+    for (uint32_t c = 0; c < ncols; ++c) {
+      int64_t prev = 0;
+      for (uint32_t r = 0; r < nrows; ++r) {
+        uint64_t zz = 0;
+        for (unsigned shift = 0;; shift += 7) {
+          if (i == raw.size()) {
+            error = path + ": corrupt block";
+            return false;
+          }
+          unsigned char b = raw[i++];
+          zz |= (uint64_t)(b & 0x7f) << shift;
+          if (b < 0x80)
+            break;
+        }
+        prev += (int64_t)(zz >> 1) ^ -(int64_t)(zz & 1);
+        rows[first + r][c] = prev;
+      }
+    }
+  }
+  return true;
+}
@@ -12,7 +12,11 @@
 #include "klee/Config/config.h"
 #include "klee/Internal/Support/ErrorHandling.h"
 
+#include "llvm/ADT/StringRef.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <algorithm>
 
 #ifdef HAVE_ZLIB_H
 #include "klee/Internal/Support/CompressionStream.h"
@@ -45,4 +49,39 @@ klee_open_compressed_output_file(const std::string &path, std::string &error) {
   return f;
 }
 #endif
+
+bool klee_read_input_list(const std::string &path, const std::string &suffix,
+                          std::vector<std::string> &inputs,
+                          std::string &error) {
+  error = "";
+  if (llvm::sys::fs::is_directory(path)) {
+    std::error_code ec;
+    for (llvm::sys::fs::directory_iterator i(path, ec), e; i != e && !ec;
+         i.increment(ec)) {
+      if (llvm::StringRef(i->path()).endswith(suffix) &&
+          !llvm::sys::fs::is_directory(i->path()))
+        inputs.push_back(i->path());
+    }
+    if (ec) {
+      error = ec.message();
+      return false;
+    }
+    std::sort(inputs.begin(), inputs.end());
+    return true;
+  }
+
+  auto buffer = llvm::MemoryBuffer::getFile(path);
+  if (!buffer) {
+    error = buffer.getError().message();
+    return false;
+  }
+  llvm::SmallVector<llvm::StringRef, 64> lines;
+  (*buffer)->getBuffer().split(lines, '\n', -1, false);
+  for (llvm::StringRef line : lines) {
+    line = line.trim();
+    if (!line.empty())
+      inputs.push_back(line.str());
+  }
+  return true;
+}
 }
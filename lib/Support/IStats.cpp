@@ -0,0 +1,249 @@
+//===-- IStats.cpp --------------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Internal/Support/IStats.h"
+
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace klee;
+
+namespace {
+/// Splits a buffer into lines without copying them
+class LineReader {
+  const char *pos, *end;
+
+public:
+  unsigned number = 0;
+
+  LineReader(const char *begin, const char *end) : pos(begin), end(end) {}
+
+  bool next(const char *&line, size_t &length) {
+    if (pos == end)
+      return false;
+    const char *eol = static_cast<const char *>(memchr(pos, '\n', end - pos));
+    if (!eol)
+      eol = end;
+    line = pos;
+    length = eol - pos;
+    pos = eol == end ? end : eol + 1;
+    ++number;
+    return true;
+  }
+};
+} // namespace
+
+static bool startsWith(const char *line, size_t length, const char *prefix) {
+  size_t n = strlen(prefix);
+  return length >= n && !memcmp(line, prefix, n);
+}
+
+/// Parse the space separated numbers of a line, at least min of them.
+static bool parseNumbers(const char *p, const char *end, size_t min,
+                         std::vector<uint64_t> &numbers) {
+  numbers.clear();
+  while (true) {
+    while (p != end && *p == ' ')
+      ++p;
+    if (p == end || *p == '\r')
+      break;
+    if (*p < '0' || *p > '9')
+      return false;
+    uint64_t v = 0;
+    for (; p != end && *p >= '0' && *p <= '9'; ++p)
+      v = v * 10 + (*p - '0');
+    numbers.push_back(v);
+  }
+  return numbers.size() >= min;
+}
+
+bool IStatsFile::read(const std::string &path, std::string &error) {
+  auto buffer = llvm::MemoryBuffer::getFile(path, -1, false);
+  if (!buffer) {
+    error = path + ": " + buffer.getError().message();
+    return false;
+  }
+  LineReader lines((*buffer)->getBufferStart(), (*buffer)->getBufferEnd());
+  auto fail = [&](const char *what) {
+    error = path + ":" + std::to_string(lines.number) + ": " + what;
+    return false;
+  };
+
+  header.clear();
+  events.clear();
+  records.clear();
+  values.clear();
+  const char *line;
+  size_t length;
+  bool sawObject = false;
+  while (lines.next(line, length)) {
+    if (startsWith(line, length, "ob=")) {
+      object.assign(line + 3, length - 3);
+      sawObject = true;
+      break;
+    }
+    if (startsWith(line, length, "positions:") &&
+        std::string(line, length) != "positions: instr line")
+      return fail("unexpected 'positions' directive");
+    if (startsWith(line, length, "events:")) {
+      const char *p = line + 7, *e = line + length;
+      while (p != e) {
+        while (p != e && *p == ' ')
+          ++p;
+        const char *word = p;
+        while (p != e && *p != ' ')
+          ++p;
+        if (p != word)
+          events.emplace_back(word, p - word);
+      }
+    }
+    header.append(line, length);
+    header += '\n';
+  }
+  if (!sawObject)
+    return fail("missing ob= directive");
+  if (events.empty())
+    return fail("missing events directive");
+
+  const size_t numEvents = events.size();
+  std::string context, callFile, callFunction;
+  std::vector<uint64_t> numbers;
+  while (lines.next(line, length)) {
+    const char *end = line + length;
+    if (!length || *line == '\r')
+      continue;
+    if (startsWith(line, length, "fl=") || startsWith(line, length, "fn=")) {
+      context.append(line, length);
+      context += '\n';
+    } else if (startsWith(line, length, "cfl=")) {
+      callFile.assign(line + 4, length - 4);
+    } else if (startsWith(line, length, "cfn=")) {
+      callFunction.assign(line + 4, length - 4);
+      if (records.empty())
+        return fail("call outside of an instruction");
+      Call call;
+      call.file.swap(callFile);
+      call.function.swap(callFunction);
+      if (!lines.next(line, length) || !startsWith(line, length, "calls="))
+        return fail("cfn directive without calls");
+      const char *p = line + 6;
+      end = line + length;
+      call.count = 0;
+      for (; p != end && *p >= '0' && *p <= '9'; ++p)
+        call.count = call.count * 10 + (*p - '0');
+      while (p != end && *p == ' ')
+        ++p;
+      call.target.assign(p, end - p);
+      if (!lines.next(line, length) ||
+          !parseNumbers(line, line + length, numEvents + 2, numbers) ||
+          numbers.size() != numEvents + 2)
+        return fail("malformed call statistics");
+      call.values.assign(numbers.begin() + 2, numbers.end());
+      records.back().calls.push_back(std::move(call));
+    } else {
+      if (!parseNumbers(line, end, numEvents + 2, numbers) ||
+          numbers.size() != numEvents + 2)
+        return fail("malformed instruction statistics");
+      records.emplace_back();
+      Record &record = records.back();
+      record.instr = numbers[0];
+      record.line = numbers[1];
+      record.context.swap(context);
+      values.insert(values.end(), numbers.begin() + 2, numbers.end());
+    }
+  }
+  return true;
+}
+
+static void writeValues(llvm::raw_ostream &os, const uint64_t *values,
+                        size_t n) {
+  for (size_t i = 0; i < n; ++i)
+    os << values[i] << ' ';
+  os << '\n';
+}
+
+void IStatsFile::write(llvm::raw_ostream &os) const {
+  const size_t numEvents = events.size();
+  os << header << "ob=" << object << '\n';
+  for (size_t r = 0; r < records.size(); ++r) {
+    const Record &record = records[r];
+    os << record.context << record.instr << ' ' << record.line << ' ';
+    writeValues(os, &values[r * numEvents], numEvents);
+    for (const Call &call : record.calls) {
+      if (!call.file.empty())
+        os << "cfl=" << call.file << '\n';
+      os << "cfn=" << call.function << '\n';
+      os << "calls=" << call.count << ' ' << call.target << '\n';
+      os << record.instr << ' ' << record.line << ' ';
+      writeValues(os, call.values.data(), call.values.size());
+    }
+  }
+}
+
+bool IStatsFile::merge(const IStatsFile &other, std::string &error) {
+  if (events != other.events) {
+    error = "the events differ";
+    return false;
+  }
+  if (object != other.object || records.size() != other.records.size()) {
+    error = "the modules differ";
+    return false;
+  }
+  const size_t numEvents = events.size();
+  // 0: sum, 1: covered if any is (Icov), 2: uncovered if all are (Iuncov)
+  std::vector<char> kinds(numEvents, 0);
+  for (size_t i = 0; i < numEvents; ++i)
+    kinds[i] = events[i] == "Icov" ? 1 : events[i] == "Iuncov" ? 2 : 0;
+  auto combine = [&](uint64_t *into, const uint64_t *from) {
+    for (size_t i = 0; i < numEvents; ++i) {
+      if (kinds[i] == 1)
+        into[i] = std::max(into[i], from[i]);
+      else if (kinds[i] == 2)
+        into[i] = std::min(into[i], from[i]);
+      else
+        into[i] += from[i];
+    }
+  };
+
+  for (size_t r = 0; r < records.size(); ++r) {
+    Record &record = records[r];
+    const Record &theirs = other.records[r];
+    if (record.instr != theirs.instr || record.line != theirs.line ||
+        record.context != theirs.context) {
+      error = "the instructions differ at assembly line " +
+              std::to_string(record.instr);
+      return false;
+    }
+    combine(&values[r * numEvents], &other.values[r * numEvents]);
+    for (const Call &call : theirs.calls) {
+      auto it = std::find_if(record.calls.begin(), record.calls.end(),
+                             [&](const Call &c) {
+                               return c.function == call.function &&
+                                      c.target == call.target;
+                             });
+      if (it == record.calls.end()) {
+        record.calls.push_back(call);
+      } else {
+        it->count += call.count;
+        combine(it->values.data(), call.values.data());
+      }
+    }
+  }
+  return true;
+}
+
+std::vector<uint64_t> IStatsFile::totals() const {
+  const size_t numEvents = events.size();
+  std::vector<uint64_t> sums(numEvents, 0);
+  for (size_t i = 0; i < values.size(); ++i)
+    sums[i % numEvents] += values[i];
+  return sums;
+}
@@ -22,6 +22,16 @@
 #include <malloc/malloc.h>
 #endif
 
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+
 // ASan Support
 //
 // When building with ASan the `mallinfo()` function is intercepted and always
@@ -83,6 +93,24 @@
 
 using namespace klee;
 
+std::atomic<int64_t> util::TaggedMemoryUsage[util::NumMemoryTags];
+
+const char *util::GetMemoryTagName(MemoryTag tag) {
+  switch (tag) {
+  case MemoryTag::Expr:
+    return "Expr";
+  case MemoryTag::ObjectState:
+    return "ObjectState";
+  case MemoryTag::Constraints:
+    return "Constraints";
+  case MemoryTag::CexCache:
+    return "CexCache";
+  case MemoryTag::Z3Builder:
+    return "Z3Builder";
+  }
+  return "unknown";
+}
+
 size_t util::GetTotalMallocUsage() {
 #ifdef KLEE_ASAN_BUILD
   // When building with ASan on Linux `mallinfo()` just returns 0 so use ASan runtime
@@ -120,3 +148,56 @@ size_t util::GetTotalMallocUsage() {
 
 #endif
 }
+
+static std::string numaNodePath(unsigned node) {
+  return "/sys/devices/system/node/node" + std::to_string(node);
+}
+
+unsigned util::GetNumNumaNodes() {
+  unsigned nodes = 0;
+  struct stat st;
+  while (stat(numaNodePath(nodes).c_str(), &st) == 0)
+    ++nodes;
+  return nodes ? nodes : 1;
+}
+
+bool util::BindToNumaNode(unsigned node, std::string &error) {
+#ifdef __linux__
+  // e.g. "0-3,8-11"
+  std::ifstream in(numaNodePath(node) + "/cpulist");
+  std::string list;
+  if (!std::getline(in, list)) {
+    error = "no CPU list for node " + std::to_string(node);
+    return false;
+  }
+
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  std::istringstream ranges(list);
+  std::string range;
+  while (std::getline(ranges, range, ',')) {
+    unsigned first, last;
+    char dash;
+    std::istringstream bounds(range);
+    if (!(bounds >> first))
+      continue;
+    if (!(bounds >> dash >> last))
+      last = first;
+    for (unsigned cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu)
+      CPU_SET(cpu, &cpus);
+  }
+  if (!CPU_COUNT(&cpus)) {
+    error = "node " + std::to_string(node) + " has no CPUs";
+    return false;
+  }
+  // the memory is then allocated on the node when first touched
+  if (sched_setaffinity(0, sizeof(cpus), &cpus) < 0) {
+    error = strerror(errno);
+    return false;
+  }
+  return true;
+#else
+  error = "not supported on this platform";
+  return false;
+#endif
+}
@@ -0,0 +1,680 @@
+//===-- PathBuffer.cpp ----------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Internal/Support/PathBuffer.h"
+#include "klee/Internal/Support/BlockCompression.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+#include "klee/Internal/Support/Serialize.h"
+
+#include <cassert>
+#include <sstream>
+#include <type_traits>
+#include <unordered_map>
+
+using namespace klee;
+
+static_assert(std::is_trivially_copyable<PathEntry>::value,
+              "PathEntry has to be mappable from its on-disk bytes");
+
+static const char PathFileV2Magic[8] = {'K', 'L', 'E', 'E',
+                                        'P', 'A', 'T', 'H'};
+
+namespace {
+struct PathFileV2Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t numEntries;
+  uint64_t streamBytes;
+  uint64_t numDataRec;
+};
+} // namespace
+
+static bool hasV2Magic(const char *data, size_t size) {
+  return size >= sizeof(PathFileV2Header) &&
+         memcmp(data, PathFileV2Magic, sizeof(PathFileV2Magic)) == 0;
+}
+
+static void encodePathV2(const std::vector<PathEntry> &entries,
+                         std::ostringstream &stream, std::string &column) {
+  for (size_t i = 0, e = entries.size(); i < e;) {
+    const PathEntry &pe = entries[i];
+    stream.put(static_cast<char>(pe.t));
+    switch (pe.t) {
+    case PathEntry::FORK: {
+      size_t run = 1;
+      while (i + run < e && entries[i + run].t == PathEntry::FORK)
+        ++run;
+      serializeVarint(stream, run);
+      for (size_t b = 0; b < run; b += 8) {
+        unsigned char bits = 0;
+        for (size_t k = 0; k < 8 && b + k < run; ++k)
+          bits |= (entries[i + b + k].body.br ? 1 : 0) << k;
+        stream.put(static_cast<char>(bits));
+      }
+      i += run;
+      continue;
+    }
+    case PathEntry::SWITCH_EXPIDX:
+    case PathEntry::SWITCH_BBIDX:
+      serializeVarint(stream, pe.body.switchIndex);
+      break;
+    case PathEntry::INDIRECTBR:
+      serializeVarint(stream, pe.body.indirectbrIndex);
+      break;
+    case PathEntry::SCHEDULE:
+      serializeVarint(stream, pe.body.tgtid);
+      break;
+    case PathEntry::DATAREC:
+      column.push_back(static_cast<char>(pe.body.drec.IDlen));
+      column.push_back(static_cast<char>(pe.body.drec.width));
+      break;
+    default:
+      assert(0 && "unknown PathEntry_t");
+    }
+    ++i;
+  }
+}
+
+void klee::encodePathFile(const std::vector<PathEntry> &entries,
+                          PathFileVersion version, std::string &out) {
+  if (version == PathFileV1) {
+    for (const auto &pe : entries)
+      out.append(reinterpret_cast<const char *>(&pe), sizeof(pe));
+    return;
+  }
+  std::ostringstream stream;
+  std::string column;
+  encodePathV2(entries, stream, column);
+  std::string body = stream.str();
+
+  PathFileV2Header hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, PathFileV2Magic, sizeof(hdr.magic));
+  hdr.version = PathFileV2;
+  hdr.numEntries = entries.size();
+  hdr.streamBytes = body.size();
+  hdr.numDataRec = column.size() / 2;
+  out.append(reinterpret_cast<const char *>(&hdr), sizeof(hdr));
+  out.append(body);
+  out.append(column);
+}
+
+static bool decodePathV2(const char *data, size_t size,
+                         std::vector<PathEntry> &entries, std::string &error) {
+  PathFileV2Header hdr;
+  memcpy(&hdr, data, sizeof(hdr));
+  if (hdr.version != PathFileV2) {
+    error = "unsupported path file version " + std::to_string(hdr.version);
+    return false;
+  }
+  const char *stream = data + sizeof(hdr);
+  size_t avail = size - sizeof(hdr);
+  if (hdr.streamBytes > avail || (avail - hdr.streamBytes) / 2 < hdr.numDataRec) {
+    error = "truncated path file";
+    return false;
+  }
+  const unsigned char *column =
+      reinterpret_cast<const unsigned char *>(stream + hdr.streamBytes);
+  uint64_t nextDataRec = 0;
+
+  entries.reserve(entries.size() + hdr.numEntries);
+  MemoryIStream is(stream, stream + hdr.streamBytes);
+  while (is.peek() != EOF) {
+    char tag;
+    uint64_t v = 0;
+    is.get(tag);
+    PathEntry pe;
+    memset(&pe, 0, sizeof(pe));
+    pe.t = static_cast<PathEntry::PathEntry_t>(tag);
+    if (pe.t != PathEntry::DATAREC && !deserializeVarint(is, v)) {
+      error = "truncated path entry stream";
+      return false;
+    }
+    switch (pe.t) {
+    case PathEntry::FORK: {
+      for (uint64_t b = 0; b < v; b += 8) {
+        char bits;
+        is.get(bits);
+        if (is.fail()) {
+          error = "truncated FORK run";
+          return false;
+        }
+        for (uint64_t k = 0; k < 8 && b + k < v; ++k) {
+          pe.body.br = (bits >> k) & 1;
+          entries.push_back(pe);
+        }
+      }
+      continue;
+    }
+    case PathEntry::SWITCH_EXPIDX:
+    case PathEntry::SWITCH_BBIDX:
+      pe.body.switchIndex = v;
+      break;
+    case PathEntry::INDIRECTBR:
+      pe.body.indirectbrIndex = v;
+      break;
+    case PathEntry::SCHEDULE:
+      pe.body.tgtid = v;
+      break;
+    case PathEntry::DATAREC:
+      if (nextDataRec >= hdr.numDataRec) {
+        error = "DATAREC column exhausts too early";
+        return false;
+      }
+      pe.body.drec.IDlen = column[2 * nextDataRec];
+      pe.body.drec.width = column[2 * nextDataRec + 1];
+      ++nextDataRec;
+      break;
+    default:
+      error = "unknown PathEntry_t " + std::to_string((unsigned)tag);
+      return false;
+    }
+    entries.push_back(pe);
+  }
+  if (entries.size() != hdr.numEntries) {
+    error = "path entry count mismatch";
+    return false;
+  }
+  return true;
+}
+
+bool klee::decodePathFile(const char *data, size_t size,
+                          std::vector<PathEntry> &entries, std::string &error) {
+  if (hasV2Magic(data, size))
+    return decodePathV2(data, size, entries, error);
+  if (size % sizeof(PathEntry)) {
+    error = "truncated path file (size is not a multiple of PathEntry)";
+    return false;
+  }
+  const PathEntry *begin = reinterpret_cast<const PathEntry *>(data);
+  entries.insert(entries.end(), begin, begin + size / sizeof(PathEntry));
+  return true;
+}
+
+/// Map a whole file read-only. MemoryBuffer falls back to reading the file
+/// when it is too small to be worth mapping.
+static std::unique_ptr<llvm::MemoryBuffer> mapFile(const std::string &path,
+                                                   std::string &error) {
+  auto mbOrErr = llvm::MemoryBuffer::getFile(path, /*FileSize=*/-1,
+                                             /*RequiresNullTerminator=*/false);
+  if (!mbOrErr) {
+    error = mbOrErr.getError().message();
+    return nullptr;
+  }
+  return std::move(mbOrErr.get());
+}
+
+PathEntryBuffer::PathEntryBuffer()
+    : entries(nullptr), numEntries(0), numReady(0), numReleased(0), window(0),
+      version(PathFileV1) {}
+
+PathEntryBuffer::PathEntryBuffer(std::vector<PathEntry> &&_owned,
+                                 PathFileVersion _version)
+    : owned(std::move(_owned)), entries(owned.data()),
+      numEntries(owned.size()), numReady(numEntries), numReleased(0),
+      window(0), version(_version) {}
+
+PathEntryBuffer::~PathEntryBuffer() {}
+
+/// Make record i of size recordSize at offset in the decompressed image
+/// readable, and drop what is more than window bytes behind it.
+/// \return the number of records from the one at offset on that can be read
+/// without calling this again, and set released to the number of records
+/// that may have been dropped.
+static size_t fetchRecord(BlockDecompressor &bd, size_t offset,
+                          size_t recordSize, size_t i, size_t window,
+                          size_t &released, const char *what) {
+  size_t begin = offset + i * recordSize;
+  if (i < released && !bd.reload(begin))
+    klee_error("cannot decompress the %s file: corrupted block", what);
+  if (!bd.waitFor(begin + recordSize))
+    klee_error("cannot decompress the %s file: corrupted block", what);
+  size_t ready = (bd.getReady() - offset) / recordSize;
+  if (window) {
+    size_t behind = window / recordSize;
+    if (i > behind)
+      bd.release(offset + (i - behind) * recordSize);
+    size_t dropped = bd.getReleased();
+    released = dropped > offset
+                   ? (dropped - offset + recordSize - 1) / recordSize
+                   : 0;
+    // come back every half window to drop what was left behind
+    ready = std::min(ready, i + 1 + behind / 2);
+  }
+  return ready;
+}
+
+void PathEntryBuffer::fetch(size_t i) const {
+  if (!decompressor)
+    return;
+  numReady = fetchRecord(*decompressor, 0, sizeof(PathEntry), i, window,
+                         numReleased, "path");
+}
+
+std::unique_ptr<PathEntryBuffer> PathEntryBuffer::open(const std::string &path,
+                                                       std::string &error,
+                                                       size_t window) {
+  error = "";
+  std::unique_ptr<llvm::MemoryBuffer> mb = mapFile(path, error);
+  if (!mb)
+    return nullptr;
+  if (isBlockCompressed(mb->getBufferStart(), mb->getBufferSize())) {
+    std::unique_ptr<BlockDecompressor> bd =
+        BlockDecompressor::open(std::move(mb), error, window);
+    if (!bd)
+      return nullptr;
+    if (!bd->waitFor(sizeof(PathFileV2Header))) {
+      error = "corrupted compressed block";
+      return nullptr;
+    }
+    if (hasV2Magic(bd->data(), bd->getReady())) {
+      std::vector<PathEntry> entries;
+      if (!bd->waitFor(bd->size())) {
+        error = "corrupted compressed block";
+        return nullptr;
+      }
+      if (!decodePathV2(bd->data(), bd->size(), entries, error))
+        return nullptr;
+      return std::unique_ptr<PathEntryBuffer>(
+          new PathEntryBuffer(std::move(entries), PathFileV2));
+    }
+    if (bd->size() % sizeof(PathEntry)) {
+      error = "truncated path file (size is not a multiple of PathEntry)";
+      return nullptr;
+    }
+    std::unique_ptr<PathEntryBuffer> pb(new PathEntryBuffer());
+    pb->entries = reinterpret_cast<const PathEntry *>(bd->data());
+    pb->numEntries = bd->size() / sizeof(PathEntry);
+    pb->numReady = window ? 0 : bd->getReady() / sizeof(PathEntry);
+    pb->window = window;
+    pb->decompressor = std::move(bd);
+    return pb;
+  }
+  if (hasV2Magic(mb->getBufferStart(), mb->getBufferSize())) {
+    std::vector<PathEntry> entries;
+    if (!decodePathV2(mb->getBufferStart(), mb->getBufferSize(), entries,
+                      error))
+      return nullptr;
+    return std::unique_ptr<PathEntryBuffer>(
+        new PathEntryBuffer(std::move(entries), PathFileV2));
+  }
+  if (mb->getBufferSize() % sizeof(PathEntry)) {
+    error = "truncated path file (size is not a multiple of PathEntry)";
+    return nullptr;
+  }
+  if (reinterpret_cast<uintptr_t>(mb->getBufferStart()) % alignof(PathEntry)) {
+    error = "misaligned path file mapping";
+    return nullptr;
+  }
+  std::unique_ptr<PathEntryBuffer> pb(new PathEntryBuffer());
+  pb->entries = reinterpret_cast<const PathEntry *>(mb->getBufferStart());
+  pb->numEntries = mb->getBufferSize() / sizeof(PathEntry);
+  pb->numReady = pb->numEntries;
+  pb->mapped = std::move(mb);
+  return pb;
+}
+
+static const char DataRecFileV2Magic[8] = {'K', 'L', 'E', 'E',
+                                           'D', 'R', 'E', 'C'};
+
+namespace {
+struct DataRecFileV2Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t numIDs;
+  uint64_t numEntries;
+};
+} // namespace
+
+/// Size of one v2 record: uint64 data + uint32 dictionary index
+static const size_t DataRecV2RecordSize = sizeof(uint64_t) + sizeof(uint32_t);
+
+void klee::encodeDataRecFile(const std::vector<DataRecEntry> &entries,
+                             const std::function<std::string(uint32_t)> &idName,
+                             std::string &out) {
+  std::unordered_map<uint32_t, uint32_t> localIDs;
+  std::ostringstream dict, recs;
+  for (const auto &dre : entries) {
+    auto res = localIDs.insert(std::make_pair(dre.instID, localIDs.size()));
+    if (res.second)
+      serialize(dict, idName(dre.instID));
+    serialize(recs, dre.data);
+    serialize(recs, res.first->second);
+  }
+
+  DataRecFileV2Header hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, DataRecFileV2Magic, sizeof(hdr.magic));
+  hdr.version = DataRecFileV2;
+  hdr.numIDs = localIDs.size();
+  hdr.numEntries = entries.size();
+  out.append(reinterpret_cast<const char *>(&hdr), sizeof(hdr));
+  out.append(dict.str());
+  out.append(recs.str());
+}
+
+/// deserialize() of a length prefixed string, except that a length running
+/// past the end of the stream fails it instead of being allocated.
+/// \return false if the stream failed
+static bool readString(MemoryIStream &is, std::string &str) {
+  std::string::size_type size = 0;
+  deserialize(is, size);
+  if (is.fail() || size > is.remaining())
+    return false;
+  str.resize(size);
+  is.read(&str[0], size);
+  return is.good();
+}
+
+/// Legacy files carry the unique ID string in every entry; intern them.
+static bool decodeDataRecV1(const char *data, size_t size,
+                            std::vector<DataRecEntry> &entries,
+                            std::vector<std::string> &idTable,
+                            std::string &error) {
+  std::unordered_map<std::string, uint32_t> ids;
+  MemoryIStream is(data, data + size);
+  while (is.peek() != EOF) {
+    DataRecEntry dre;
+    std::string uniqueID;
+    deserialize(is, dre.data);
+    if (is.fail() || !readString(is, uniqueID)) {
+      error = "truncated .path_datarec entry";
+      return false;
+    }
+    auto res = ids.insert(std::make_pair(uniqueID, idTable.size()));
+    if (res.second)
+      idTable.push_back(std::move(uniqueID));
+    dre.instID = res.first->second;
+    entries.push_back(dre);
+  }
+  return true;
+}
+
+DataRecBuffer::DataRecBuffer()
+    : records(nullptr), numEntries(0), numReady(0), numReleased(0), window(0) {}
+
+DataRecBuffer::DataRecBuffer(std::vector<DataRecEntry> &&_owned,
+                             std::vector<std::string> &&_idTable)
+    : owned(std::move(_owned)), idTable(std::move(_idTable)), records(nullptr),
+      numEntries(owned.size()), numReady(numEntries), numReleased(0),
+      window(0) {}
+
+DataRecBuffer::~DataRecBuffer() {}
+
+/// Parse the header and the dictionary of a v2 image of which the first
+/// ready bytes are available.
+/// \return the offset of the records, 0 if ready is too short
+static size_t parseDataRecV2(const char *data, size_t ready,
+                             DataRecFileV2Header &hdr,
+                             std::vector<std::string> &idTable) {
+  if (ready < sizeof(hdr))
+    return 0;
+  memcpy(&hdr, data, sizeof(hdr));
+  MemoryIStream is(data + sizeof(hdr), data + ready);
+  idTable.clear();
+  if (hdr.version != DataRecFileV2)
+    return sizeof(hdr);
+  // the IDs are appended as read, a corrupt count only runs out of bytes
+  for (uint64_t i = 0; i != hdr.numIDs; ++i) {
+    std::string id;
+    if (!readString(is, id))
+      return 0;
+    idTable.push_back(std::move(id));
+  }
+  return sizeof(hdr) + is.tellg();
+}
+
+std::unique_ptr<DataRecBuffer> DataRecBuffer::open(const std::string &path,
+                                                   std::string &error,
+                                                   size_t window) {
+  error = "";
+  std::unique_ptr<llvm::MemoryBuffer> mb = mapFile(path, error);
+  if (!mb)
+    return nullptr;
+  const char *data = mb->getBufferStart();
+  size_t size = mb->getBufferSize();
+  // the bytes of data that can be read
+  size_t ready = size;
+
+  std::unique_ptr<BlockDecompressor> bd;
+  if (isBlockCompressed(data, size)) {
+    bd = BlockDecompressor::open(std::move(mb), error, window);
+    if (!bd)
+      return nullptr;
+    data = bd->data();
+    size = bd->size();
+    if (!bd->waitFor(sizeof(DataRecFileV2Header))) {
+      error = "corrupted compressed block";
+      return nullptr;
+    }
+    ready = bd->getReady();
+  }
+
+  if (size < sizeof(DataRecFileV2Header) ||
+      memcmp(data, DataRecFileV2Magic, sizeof(DataRecFileV2Magic))) {
+    if (bd && !bd->waitFor(size)) {
+      error = "corrupted compressed block";
+      return nullptr;
+    }
+    std::vector<DataRecEntry> entries;
+    std::vector<std::string> idTable;
+    if (!decodeDataRecV1(data, size, entries, idTable, error))
+      return nullptr;
+    return std::unique_ptr<DataRecBuffer>(
+        new DataRecBuffer(std::move(entries), std::move(idTable)));
+  }
+
+  DataRecFileV2Header hdr;
+  std::unique_ptr<DataRecBuffer> db(new DataRecBuffer());
+  size_t recordsOffset = parseDataRecV2(data, ready, hdr, db->idTable);
+  // the dictionary of a compressed file may span several blocks
+  while (!recordsOffset && bd && ready < size) {
+    if (!bd->waitFor(ready + 1)) {
+      error = "corrupted compressed block";
+      return nullptr;
+    }
+    ready = bd->getReady();
+    recordsOffset = parseDataRecV2(data, ready, hdr, db->idTable);
+  }
+  if (hdr.version != DataRecFileV2) {
+    error = "unsupported .path_datarec version " + std::to_string(hdr.version);
+    return nullptr;
+  }
+  if (!recordsOffset ||
+      (size - recordsOffset) / DataRecV2RecordSize < hdr.numEntries) {
+    error = "truncated .path_datarec file";
+    return nullptr;
+  }
+  db->records = data + recordsOffset;
+  db->numEntries = hdr.numEntries;
+  db->window = bd ? window : 0;
+  db->numReady =
+      db->window ? 0 : (ready - recordsOffset) / DataRecV2RecordSize;
+  db->mapped = std::move(mb);
+  db->decompressor = std::move(bd);
+  return db;
+}
+
+void DataRecBuffer::fetch(size_t i) const {
+  if (!decompressor)
+    return;
+  numReady = fetchRecord(*decompressor, records - decompressor->data(),
+                         DataRecV2RecordSize, i, window, numReleased,
+                         ".path_datarec");
+}
+
+DataRecEntry DataRecBuffer::operator[](size_t i) const {
+  if (!records)
+    return owned[i];
+  if (i >= numReady || i < numReleased)
+    fetch(i);
+  DataRecEntry dre;
+  const char *rec = records + i * DataRecV2RecordSize;
+  memcpy(&dre.data, rec, sizeof(dre.data));
+  memcpy(&dre.instID, rec + sizeof(dre.data), sizeof(dre.instID));
+  return dre;
+}
+
+namespace {
+/// A DATAREC entry of one segment, instID already in the merged ID table
+struct SegmentRecord {
+  PathEntry pe;
+  DataRecEntry dre;
+};
+} // namespace
+
+static bool sameDecision(const PathEntry &a, const PathEntry &b) {
+  if (a.t != b.t)
+    return false;
+  switch (a.t) {
+  case PathEntry::FORK:
+    return a.body.br == b.body.br;
+  case PathEntry::SWITCH_EXPIDX:
+  case PathEntry::SWITCH_BBIDX:
+    return a.body.switchIndex == b.body.switchIndex;
+  case PathEntry::INDIRECTBR:
+    return a.body.indirectbrIndex == b.body.indirectbrIndex;
+  case PathEntry::SCHEDULE:
+    return a.body.tgtid == b.body.tgtid;
+  default:
+    return true;
+  }
+}
+
+/// Key of the occurrence-th instance of instID within a segment
+static uint64_t instanceKey(uint32_t instID, uint32_t occurrence) {
+  return (uint64_t)instID << 32 | occurrence;
+}
+
+/// Merge the DATAREC entries that one trace recorded between two control
+/// entries into those of the traces before it.
+static bool mergeSegment(std::vector<SegmentRecord> &merged,
+                         const std::vector<SegmentRecord> &other,
+                         TraceMergeStats &stats) {
+  std::unordered_map<uint64_t, size_t> index;
+  std::unordered_map<uint32_t, uint32_t> occurrences;
+  for (size_t i = 0; i < merged.size(); ++i)
+    index[instanceKey(merged[i].dre.instID,
+                      occurrences[merged[i].dre.instID]++)] = i;
+  occurrences.clear();
+
+  std::vector<SegmentRecord> out;
+  out.reserve(merged.size() + other.size());
+  size_t next = 0, pendingBegin = 0;
+  for (size_t i = 0; i < other.size(); ++i) {
+    const SegmentRecord &r = other[i];
+    auto it = index.find(instanceKey(r.dre.instID,
+                                     occurrences[r.dre.instID]++));
+    if (it == index.end())
+      continue;
+    if (it->second < next)
+      return false;
+    out.insert(out.end(), merged.begin() + next, merged.begin() + it->second);
+    for (; pendingBegin < i; ++pendingBegin) {
+      out.push_back(other[pendingBegin]);
+      ++stats.added;
+    }
+    const SegmentRecord &m = merged[it->second];
+    ++stats.shared;
+    if (m.dre.data != r.dre.data || m.pe.body.drec.width != r.pe.body.drec.width)
+      ++stats.conflicts;
+    out.push_back(m);
+    next = it->second + 1;
+    pendingBegin = i + 1;
+  }
+  out.insert(out.end(), merged.begin() + next, merged.end());
+  for (; pendingBegin < other.size(); ++pendingBegin) {
+    out.push_back(other[pendingBegin]);
+    ++stats.added;
+  }
+  merged.swap(out);
+  return true;
+}
+
+bool klee::mergeReplayTraces(const std::vector<ReplayTrace> &traces,
+                             std::vector<PathEntry> &path,
+                             std::vector<DataRecEntry> &dataRec,
+                             std::vector<std::string> &idTable,
+                             TraceMergeStats &stats, std::string &error) {
+  path.clear();
+  dataRec.clear();
+  idTable.clear();
+  if (traces.empty())
+    return true;
+
+  // translate the ID table of every trace into the merged one
+  std::unordered_map<std::string, uint32_t> ids;
+  std::vector<std::vector<uint32_t>> idMaps(traces.size());
+  for (size_t t = 0; t < traces.size(); ++t) {
+    for (const std::string &id : traces[t].dataRec->getIDTable()) {
+      auto res = ids.emplace(id, idTable.size());
+      if (res.second)
+        idTable.push_back(id);
+      idMaps[t].push_back(res.first->second);
+    }
+  }
+
+  std::vector<size_t> pathPos(traces.size(), 0), dataRecPos(traces.size(), 0);
+  std::vector<SegmentRecord> merged, segment;
+  const PathEntryBuffer &first = *traces[0].path;
+  while (true) {
+    merged.clear();
+    bool atEnd = true;
+    PathEntry control = PathEntry();
+    for (size_t t = 0; t < traces.size(); ++t) {
+      const PathEntryBuffer &p = *traces[t].path;
+      const DataRecBuffer &d = *traces[t].dataRec;
+      std::vector<SegmentRecord> &records = t ? segment : merged;
+      records.clear();
+      size_t &i = pathPos[t];
+      for (; i < p.size() && p[i].t == PathEntry::DATAREC; ++i) {
+        if (dataRecPos[t] >= d.size()) {
+          error = "trace " + std::to_string(t) +
+                  ": DATAREC entries exhaust too early";
+          return false;
+        }
+        SegmentRecord r{p[i], d[dataRecPos[t]++]};
+        if (r.dre.instID >= idMaps[t].size()) {
+          error = "trace " + std::to_string(t) +
+                  ": DATAREC entry refers to an unknown instruction";
+          return false;
+        }
+        r.dre.instID = idMaps[t][r.dre.instID];
+        records.push_back(r);
+      }
+      if (t && !mergeSegment(merged, segment, stats)) {
+        error = "trace " + std::to_string(t) +
+                " records DATAREC entries in another order before its "
+                "path entry " + std::to_string(i);
+        return false;
+      }
+      bool ended = i >= p.size();
+      if (!t) {
+        atEnd = ended;
+        if (!ended)
+          control = first[i];
+      } else if (ended != atEnd || (!ended && !sameDecision(control, p[i]))) {
+        error = "trace " + std::to_string(t) +
+                " takes another path than the first one at its path entry " +
+                std::to_string(i);
+        return false;
+      }
+      ++i;
+    }
+    for (const SegmentRecord &r : merged) {
+      path.push_back(r.pe);
+      dataRec.push_back(r.dre);
+    }
+    if (atEnd)
+      break;
+    path.push_back(control);
+  }
+  return true;
+}
@@ -9,13 +9,19 @@
 
 #include "klee/Internal/ADT/TreeStream.h"
 
+#include "klee/Config/config.h"
+
+#include <algorithm>
 #include <cassert>
+#include <cerrno>
 #include <iomanip>
 #include <iostream>
 #include <fstream>
 #include <iterator>
 
+#include <fcntl.h>
 #include <string.h>
+#include <unistd.h>
 
 using namespace klee;
 
@@ -24,26 +30,67 @@ using namespace klee;
 TreeStreamWriter::TreeStreamWriter(const std::string &_path) 
   : lastID(0),
     lastLen(0),
-    lastLen_off(std::iostream::pos_type(0)),
     isWritten(false),
-    lastLen_dirty(false),
+    submittedBytes(0),
+    index(1),
     path(_path),
     output(new std::ofstream(path.c_str(), 
                              std::ios::out | std::ios::binary)),
-    ids(1) {
+    ids(1),
+    ioBusy(false),
+    ioStop(false),
+    ioFailed(false) {
   if (!output->good()) {
     delete output;
     output = 0;
+    return;
   }
+  io.reset(new IOThread);
+  io->thread = std::thread(&TreeStreamWriter::ioLoop, this);
 }
 
 TreeStreamWriter::~TreeStreamWriter() {
+  if (!output)
+    return;
   flush();
+  {
+    std::lock_guard<std::mutex> lock(io->mutex);
+    ioStop = true;
+  }
+  io->cond.notify_all();
+  io->thread.join();
   delete output;
 }
 
+bool TreeStreamWriter::reopenInChild(const std::string &_path) {
+  assert(output && ioQueue.empty() && !ioBusy &&
+         "the writer was not flushed before the fork");
+  // The I/O thread of the parent does not exist in this process, and its
+  // mutex may have been held when the process forked.
+  io.release();
+  delete output;
+  output = 0;
+
+  std::ifstream is(path.c_str(), std::ios::in | std::ios::binary);
+  std::ofstream *os =
+      new std::ofstream(_path.c_str(), std::ios::out | std::ios::binary);
+  if (!is.good() || !os->good()) {
+    delete os;
+    return false;
+  }
+  *os << is.rdbuf();
+  path = _path;
+  output = os;
+  io.reset(new IOThread);
+  io->thread = std::thread(&TreeStreamWriter::ioLoop, this);
+  return true;
+}
+
 bool TreeStreamWriter::good() {
-  return !!output;
+  if (!output)
+    return false;
+  std::lock_guard<std::mutex> lock(io->mutex);
+  return !ioFailed;
 }
 
 TreeOStream TreeStreamWriter::open() {
@@ -52,39 +99,173 @@ TreeOStream TreeStreamWriter::open() {
 
 TreeOStream TreeStreamWriter::open(const TreeOStream &os) {
   assert(output && os.writer==this);
-  flush_lastLen();
-  isWritten = false;
+  flush_segment();
   unsigned id = ids++;
-  output->write(reinterpret_cast<const char*>(&os.id), 4);
-  unsigned tag = id | (1<<31);
-  output->write(reinterpret_cast<const char*>(&tag), 4);
+  appendRecord(os.id, id | (1<<31));
+  StreamIndex si;
+  si.parent = os.id;
+  si.parentSegments = index[os.id].segments.size();
+  index.push_back(std::move(si));
   return TreeOStream(*this, id, os.cnt);
 }
 
-void TreeStreamWriter::flush_lastLen() {
-  if (lastLen_dirty) {
-    std::iostream::pos_type save_pos = output->tellp();
-    output->seekp(lastLen_off);
-    output->write(reinterpret_cast<const char*>(&lastLen), sizeof(lastLen));
-    output->seekp(save_pos);
-    lastLen_dirty = false;
-  }
+void TreeStreamWriter::appendRecord(unsigned id, unsigned tag) {
+  block.append(reinterpret_cast<const char*>(&id), sizeof(id));
+  block.append(reinterpret_cast<const char*>(&tag), sizeof(tag));
 }
+
 void TreeStreamWriter::write_metadata(TreeOStream &os) {
-  if (isWritten) {
-    flush_lastLen();
-  }
-  output->write(reinterpret_cast<const char*>(&os.id), sizeof(os.id));
-  lastLen_off = output->tellp();
+  flush_segment();
   lastLen = 0;
   lastID = os.id;
-  output->write(reinterpret_cast<const char*>(&lastLen), sizeof(lastLen));
   isWritten = true;
 }
 
+void TreeStreamWriter::flush_segment() {
+  if (isWritten && lastLen) {
+    appendRecord(lastID, lastLen);
+    index[lastID].segments.push_back(
+        std::make_pair(submittedBytes + block.size(), lastLen));
+    block.append(segment.data);
+  }
+  segment.data.clear();
+  lastLen = 0;
+  isWritten = false;
+  if (block.size() >= BlockSize)
+    submit_block();
+}
+
+void TreeStreamWriter::submit_block() {
+  if (block.empty())
+    return;
+  std::unique_lock<std::mutex> lock(io->mutex);
+  io->cond.wait(lock, [this] { return ioQueue.size() < MaxQueuedBlocks; });
+  submittedBytes += block.size();
+  ioQueue.push_back(std::move(block));
+  block.clear();
+  lock.unlock();
+  io->cond.notify_all();
+}
+
+void TreeStreamWriter::ioLoop() {
+  std::unique_lock<std::mutex> lock(io->mutex);
+  for (;;) {
+    io->cond.wait(lock, [this] { return ioStop || !ioQueue.empty(); });
+    if (ioQueue.empty())
+      break;
+    std::string data = std::move(ioQueue.front());
+    ioQueue.pop_front();
+    ioBusy = true;
+    lock.unlock();
+    io->cond.notify_all();
+    output->write(data.data(), data.size());
+    lock.lock();
+    if (!output->good())
+      ioFailed = true;
+    ioBusy = false;
+    io->cond.notify_all();
+  }
+}
+
 void TreeStreamWriter::flush() {
-  flush_lastLen();
+  flush_segment();
+  submit_block();
+  std::unique_lock<std::mutex> lock(io->mutex);
+  io->cond.wait(lock, [this] { return ioQueue.empty() && !ioBusy; });
+  // the I/O thread is idle until the next submit_block
   output->flush();
+  if (!output->good())
+    ioFailed = true;
+}
+
+void TreeStreamWriter::getSegments(
+    TreeStreamID streamID,
+    std::vector<std::pair<uint64_t, unsigned>> &segments) {
+  KLEE_DEBUG(llvm::errs() << "finding chain for: " << streamID << "\n");
+
+  // (stream, number of its segments visible to streamID), leaf first
+  std::vector<std::pair<unsigned, size_t>> chain;
+  size_t visible = index[streamID].segments.size();
+  for (unsigned id = streamID; id; id = index[id].parent) {
+    chain.push_back(std::make_pair(id, visible));
+    visible = index[id].parentSegments;
+  }
+  KLEE_DEBUG({
+    llvm::errs() << "roots: ";
+    for (size_t i = 0, e = chain.size(); i < e; ++i) {
+      llvm::errs() << chain[i].first << " ";
+    }
+    llvm::errs() << "\n";
+  });
+  for (auto it = chain.rbegin(), ie = chain.rend(); it != ie; ++it) {
+    const StreamIndex &si = index[it->first];
+    segments.insert(segments.end(), si.segments.begin(),
+                    si.segments.begin() + it->second);
+  }
+}
+
+/// Copy length bytes at offset of in to the current position of out
+static bool copyRange(int in, uint64_t offset, uint64_t length, int out) {
+#ifdef HAVE_COPY_FILE_RANGE
+  // fails with e.g. EXDEV or ENOSYS where the kernel cannot copy
+  while (length) {
+    loff_t off = offset;
+    ssize_t n = copy_file_range(in, &off, out, nullptr, length, 0);
+    if (n <= 0)
+      break;
+    offset += n;
+    length -= n;
+  }
+#endif
+  char buffer[64 * 1024];
+  while (length) {
+    ssize_t n = pread(in, buffer, std::min<uint64_t>(length, sizeof(buffer)),
+                      offset);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    for (ssize_t written = 0; written < n;) {
+      ssize_t w = write(out, buffer + written, n - written);
+      if (w < 0 && errno == EINTR)
+        continue;
+      if (w < 0)
+        return false;
+      written += w;
+    }
+    offset += n;
+    length -= n;
+  }
+  return true;
+}
+
+bool TreeStreamWriter::copyStream(TreeStreamID streamID, size_t entrySize,
+                                  int fd) {
+  assert(streamID > 0 && streamID < ids);
+  flush();
+
+  std::vector<std::pair<uint64_t, unsigned>> segments;
+  getSegments(streamID, segments);
+  // byte ranges, the ones that follow each other in the file merged
+  std::vector<std::pair<uint64_t, uint64_t>> ranges;
+  for (const auto &segment : segments) {
+    uint64_t length = uint64_t(segment.second) * entrySize;
+    if (!ranges.empty() &&
+        ranges.back().first + ranges.back().second == segment.first)
+      ranges.back().second += length;
+    else
+      ranges.push_back(std::make_pair(segment.first, length));
+  }
+
+  int in = ::open(path.c_str(), O_RDONLY);
+  if (in < 0)
+    return false;
+  bool ok = true;
+  for (const auto &range : ranges)
+    if (!(ok = copyRange(in, range.first, range.second, fd)))
+      break;
+  ::close(in);
+  return ok;
 }
 
 TreeOStream::TreeOStream()
@@ -0,0 +1,87 @@
+//===-- WorkQueue.cpp -----------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Internal/Support/WorkQueue.h"
+
+#include <algorithm>
+#include <cassert>
+
+using namespace klee;
+
+WorkQueue::WorkQueue(unsigned _numThreads, unsigned _capacity)
+    : numThreads(_numThreads), capacity(std::max(_capacity, 1u)) {
+  start();
+}
+
+WorkQueue::~WorkQueue() {
+  if (!pool)
+    return;
+  {
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    stop = true;
+  }
+  pool->cond.notify_all();
+  for (std::thread &t : pool->threads)
+    t.join();
+}
+
+void WorkQueue::start() {
+  if (!numThreads)
+    return;
+  pool.reset(new Pool);
+  for (unsigned i = 0; i < numThreads; ++i)
+    pool->threads.emplace_back(&WorkQueue::work, this);
+}
+
+void WorkQueue::work() {
+  std::unique_lock<std::mutex> lock(pool->mutex);
+  for (;;) {
+    pool->cond.wait(lock, [this] { return stop || !jobs.empty(); });
+    if (jobs.empty())
+      break;
+    std::function<void()> job = std::move(jobs.front());
+    jobs.pop_front();
+    ++running;
+    lock.unlock();
+    pool->cond.notify_all();
+    job();
+    lock.lock();
+    --running;
+    pool->cond.notify_all();
+  }
+}
+
+void WorkQueue::submit(std::function<void()> job) {
+  if (!pool) {
+    job();
+    return;
+  }
+  std::unique_lock<std::mutex> lock(pool->mutex);
+  pool->cond.wait(lock, [this] { return jobs.size() < capacity; });
+  jobs.push_back(std::move(job));
+  lock.unlock();
+  pool->cond.notify_all();
+}
+
+void WorkQueue::drain() {
+  if (!pool)
+    return;
+  std::unique_lock<std::mutex> lock(pool->mutex);
+  pool->cond.wait(lock, [this] { return jobs.empty() && !running; });
+}
+
+void WorkQueue::restartInChild() {
+  if (!pool)
+    return;
+  assert(jobs.empty() && !running && "the queue was not drained before the fork");
+  // The mutex may have been held by a thread of the parent when the process
+  // forked, and the threads cannot be joined.
+  pool.release();
+  start();
+}
@@ -40,6 +40,17 @@
 #include <stdio.h>
 #include <klee/klee.h>
 
+////////////////////////////////////////////////////////////////////////////////
+// Buffer Copies
+////////////////////////////////////////////////////////////////////////////////
+
+/* Copies the bytes in the executor when it can and with memcpy otherwise.
+ * There is no branch on which one copied, so the recorded path is the same
+ * either way. */
+static void __buffer_copy(void *dest, const void *src, size_t count) {
+  memcpy(dest, src, klee_copy_memory(dest, src, count));
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Event Queue Utility
 ////////////////////////////////////////////////////////////////////////////////
@@ -195,11 +206,11 @@ ssize_t _stream_readv(stream_buffer_t *buff, const struct iovec *iov, int iovcnt
     if (offset + cur_count > buff->max_size) {
       size_t overflow = (offset + cur_count) % buff->max_size;
 
-      memcpy(iov[i].iov_base, &buff->contents[offset], cur_count - overflow);
-      memcpy(&((char*)iov[i].iov_base)[cur_count-overflow], &buff->contents[0], overflow);
+      __buffer_copy(iov[i].iov_base, &buff->contents[offset], cur_count - overflow);
+      __buffer_copy(&((char*)iov[i].iov_base)[cur_count-overflow], &buff->contents[0], overflow);
       offset = overflow;
     } else {
-      memcpy(iov[i].iov_base, &buff->contents[offset], cur_count);
+      __buffer_copy(iov[i].iov_base, &buff->contents[offset], cur_count);
       offset += cur_count;
     }
     remaining -= cur_count;
@@ -257,11 +268,11 @@ ssize_t _stream_writev(stream_buffer_t *buff, const struct iovec *iov, int iovcn
     if (offset + cur_count > buff->max_size) {
       size_t overflow = (offset + cur_count) % buff->max_size;
 
-      memcpy(&buff->contents[offset], iov[i].iov_base, cur_count - overflow);
-      memcpy(&buff->contents[0], &((char*)iov[i].iov_base)[cur_count-overflow], overflow);
+      __buffer_copy(&buff->contents[offset], iov[i].iov_base, cur_count - overflow);
+      __buffer_copy(&buff->contents[0], &((char*)iov[i].iov_base)[cur_count-overflow], overflow);
       offset = overflow;
     } else {
-      memcpy(&buff->contents[offset], iov[i].iov_base, cur_count);
+      __buffer_copy(&buff->contents[offset], iov[i].iov_base, cur_count);
       offset += cur_count;
     }
     remaining -= cur_count;
@@ -330,7 +341,7 @@ ssize_t _block_readv(block_buffer_t *buff, const struct iovec *iov, int iovcnt,
       break;
 
     size_t cur_count = (remaining < iov[i].iov_len) ? remaining : iov[i].iov_len;
-    memcpy(iov[i].iov_base, &buff->contents[offset+(count-remaining)], cur_count);
+    __buffer_copy(iov[i].iov_base, &buff->contents[offset+(count-remaining)], cur_count);
     remaining -= cur_count;
   }
 
@@ -358,7 +369,7 @@ ssize_t _block_writev(block_buffer_t *buff, const struct iovec *iov, int iovcnt,
       break;
 
     size_t cur_count = (remaining < iov[i].iov_len) ? remaining : iov[i].iov_len;
-    memcpy(&buff->contents[offset+(count-remaining)], iov[i].iov_base, cur_count);
+    __buffer_copy(&buff->contents[offset+(count-remaining)], iov[i].iov_base, cur_count);
     remaining -= cur_count;
   }
 
@@ -64,12 +64,3 @@ int execv(const char *path, char *const argv[]) { return __bad_exec(); }
 int execvp(const char *file, char *const argv[]) { return __bad_exec(); }
 int execve(const char *file, char *const argv[], char *const envp[]) { return __bad_exec(); }
 
-pid_t fork(void) {
-  klee_warning("ignoring (ENOMEM)");
-  errno = ENOMEM;
-  return -1;
-}
-
-pid_t vfork(void) {
-  return fork();
-}
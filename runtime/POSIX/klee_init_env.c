@@ -139,6 +139,7 @@ void klee_init_env(int *argcPtr, char ***argvPtr) {
   useSymbolicgettimeofday = 0;
 
   const char *sock_handler_name = NULL;
+  const char *sock_handler_arg = NULL;
 
   sym_arg_name[5] = '\0';
 
@@ -171,6 +172,8 @@ usage: (klee_init_env) [options] [program arguments]\n\
   -fd-fail                  - Shortcut for '-max-fail 1'\n\
   -posix-debug              - Enable debug message in POSIX runtime\n\
   -sock-handler <NAME>      - Use predefined socket handler\n\
+  -sock-handler-arg <ARG>   - Pass ARG to the socket handler, e.g. <PORT>:<FILE>\n\
+                              for packet-replay\n\
   -symbolic-sock-handler    - Inform socket handler that it is used during a\n\
                               symbolic replay. (default=false)\n\
   -symbolic-urandom <size>  - Specify the size (>0) of a symbolic /dev/urandom\n\
@@ -339,6 +342,12 @@ usage: (klee_init_env) [options] [program arguments]\n\
                __streq(argv[k], "-sock-handler")) {
       k++;
       sock_handler_name = argv[k++];
+    } else if (__streq(argv[k], "--sock-handler-arg") ||
+               __streq(argv[k], "-sock-handler-arg")) {
+      const char *msg = "--sock-handler-arg expects an argument";
+      if (++k == argc)
+        __emit_error(msg);
+      sock_handler_arg = argv[k++];
     } else if (__streq(argv[k], "--symbolic-sock-handler") ||
                __streq(argv[k], "-symbolic-sock-handler")) {
       k++;
@@ -391,6 +400,7 @@ usage: (klee_init_env) [options] [program arguments]\n\
   klee_init_threads();
 
   if (sock_handler_name) {
+    __sock_simulator.handler_arg = sock_handler_arg;
     register_predefined_socket_handler(sock_handler_name);
   }
 }
@@ -0,0 +1,254 @@
+#include "sockets_simulator.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+
+// packet-replay handler
+//
+// Replays the client side of a recorded session against the server socket
+// bound to <PORT>, with "-sock-handler packet-replay -sock-handler-arg
+// <PORT>:<FILE>". <FILE> is a pcap capture; its packets are read from the
+// host one at a time, right before they are written to the connection, so a
+// long capture is never held in memory (or made symbolic) as a whole. As the
+// client writes block on a full stream buffer, the next packet is only read
+// once the server has consumed the previous ones.
+//
+// Captures with link type USER0 (147) hold the bare payloads. For Ethernet
+// (1), Linux cooked (113) and raw IP (101) captures, the TCP payloads of the
+// IPv4 packets sent to <PORT> are replayed and all other packets skipped.
+
+#define PCAP_MAGIC 0xa1b2c3d4
+#define PCAP_MAGIC_NSEC 0xa1b23c4d
+#define PCAP_LINKTYPE_ETHERNET 1
+#define PCAP_LINKTYPE_RAW 101
+#define PCAP_LINKTYPE_LINUX_SLL 113
+#define PCAP_LINKTYPE_USER0 147
+#define PCAP_MAX_RECORD (1 << 18)
+
+typedef struct {
+  uint32_t magic;
+  uint16_t version_major;
+  uint16_t version_minor;
+  int32_t thiszone;
+  uint32_t sigfigs;
+  uint32_t snaplen;
+  uint32_t linktype;
+} pcap_file_header_t;
+
+typedef struct {
+  uint32_t ts_sec;
+  uint32_t ts_usec;
+  uint32_t incl_len;
+  uint32_t orig_len;
+} pcap_record_header_t;
+
+static uint32_t __swap32(uint32_t v) {
+  return (v >> 24) | ((v >> 8) & 0xff00) | ((v << 8) & 0xff0000) | (v << 24);
+}
+
+static uint16_t __get16(const unsigned char *p) { return (p[0] << 8) | p[1]; }
+
+// Read exactly count bytes from the host file
+// @return 1 on success, 0 on end of file or error
+static int __read_host(int fd, void *buf, size_t count) {
+  size_t done = 0;
+  while (done < count) {
+    ssize_t res = CALL_UNDERLYING(read, fd, (char *)buf + done, count - done);
+    if (res <= 0)
+      return 0;
+    done += res;
+  }
+  return 1;
+}
+
+// Locate the TCP payload sent to port in an IPv4 packet
+// @return the payload length, 0 if the packet is not replayed
+static size_t __tcp_payload(const unsigned char *ip, size_t len,
+                            unsigned short port, size_t *offset) {
+  if (len < 20 || (ip[0] >> 4) != 4 || ip[9] != IPPROTO_TCP)
+    return 0;
+  size_t ip_len = (ip[0] & 0xf) * 4;
+  size_t total = __get16(ip + 2);
+  if (total < len)
+    len = total;
+  if (ip_len < 20 || len < ip_len + 20)
+    return 0;
+  const unsigned char *tcp = ip + ip_len;
+  if (__get16(tcp + 2) != port)
+    return 0;
+  size_t tcp_len = (tcp[12] >> 4) * 4;
+  if (tcp_len < 20 || len < ip_len + tcp_len)
+    return 0;
+  *offset += ip_len + tcp_len;
+  return len - ip_len - tcp_len;
+}
+
+// Locate the application payload of a captured packet
+// @return the payload length, 0 if the packet is not replayed
+static size_t __packet_payload(uint32_t linktype, const unsigned char *data,
+                               size_t len, unsigned short port,
+                               size_t *offset) {
+  *offset = 0;
+  switch (linktype) {
+  case PCAP_LINKTYPE_USER0:
+    return len;
+  case PCAP_LINKTYPE_RAW:
+    return __tcp_payload(data, len, port, offset);
+  case PCAP_LINKTYPE_ETHERNET:
+    if (len < 14 || __get16(data + 12) != 0x0800)
+      return 0;
+    *offset = 14;
+    return __tcp_payload(data + 14, len - 14, port, offset);
+  case PCAP_LINKTYPE_LINUX_SLL:
+    if (len < 16 || __get16(data + 14) != 0x0800)
+      return 0;
+    *offset = 16;
+    return __tcp_payload(data + 16, len - 16, port, offset);
+  default:
+    return 0;
+  }
+}
+
+static void __replay_payload(socket_t *sock, const unsigned char *payload,
+                             size_t len) {
+  unsigned char *buf = (unsigned char *)payload;
+  if (useSymbolicHandler) {
+    buf = malloc(len);
+    klee_make_symbolic(buf, len, "packet_replay_payload");
+  }
+  size_t done = 0;
+  while (done < len) {
+    ssize_t res = _write_socket(sock, buf + done, len - done);
+    if (res <= 0) {
+      posix_debug_msg("packet_replay payload write result %d\n", (int)res);
+      break;
+    }
+    done += res;
+  }
+  if (buf != payload)
+    free(buf);
+}
+
+static void __replay_capture(packet_replay_handler_t *self_hdl, int fd) {
+  pcap_file_header_t header;
+  if (!__read_host(fd, &header, sizeof(header))) {
+    klee_warning("packet_replay: truncated capture header");
+    return;
+  }
+  int swapped = 0;
+  if (header.magic == __swap32(PCAP_MAGIC) ||
+      header.magic == __swap32(PCAP_MAGIC_NSEC)) {
+    swapped = 1;
+    header.linktype = __swap32(header.linktype);
+  } else if (header.magic != PCAP_MAGIC && header.magic != PCAP_MAGIC_NSEC) {
+    klee_warning("packet_replay: not a pcap capture");
+    return;
+  }
+
+  unsigned count = 0;
+  pcap_record_header_t record;
+  while (__read_host(fd, &record, sizeof(record))) {
+    size_t len = swapped ? __swap32(record.incl_len) : record.incl_len;
+    if (len > PCAP_MAX_RECORD) {
+      klee_warning("packet_replay: oversized capture record");
+      break;
+    }
+    unsigned char *data = malloc(len ? len : 1);
+    if (!__read_host(fd, data, len)) {
+      free(data);
+      klee_warning("packet_replay: truncated capture record");
+      break;
+    }
+    size_t offset;
+    size_t payload = __packet_payload(header.linktype, data, len,
+                                      self_hdl->port, &offset);
+    if (payload) {
+      __replay_payload(self_hdl->__client.client_sock, data + offset, payload);
+      ++count;
+    }
+    free(data);
+  }
+  posix_debug_msg("packet_replay replayed %u packets\n", count);
+}
+
+void packet_replay_handler_init(void *self) {
+  packet_replay_handler_t *self_hdl = (packet_replay_handler_t *)self;
+  self_hdl->port = 0;
+  self_hdl->path = NULL;
+
+  const char *arg = __sock_simulator.handler_arg;
+  unsigned port = 0;
+  const char *p = arg;
+  while (p && *p >= '0' && *p <= '9' && port <= 0xffff)
+    port = port * 10 + (*p++ - '0');
+  if (!p || p == arg || *p != ':' || !p[1] || port == 0 || port > 0xffff) {
+    klee_warning("packet_replay expects -sock-handler-arg <PORT>:<FILE>");
+    return;
+  }
+  self_hdl->port = port;
+  self_hdl->path = p + 1;
+  self_hdl->__client.client_sock = _create_socket(AF_INET, SOCK_STREAM, 0);
+}
+
+void packet_replay_handler_post_bind(void *self, socket_t *sock,
+                                     const struct sockaddr *addr,
+                                     socklen_t addrlen) {
+  packet_replay_handler_t *self_hdl = (packet_replay_handler_t *)self;
+  // I am only interested in socket bind to DEFAULT_ADDR:port
+  if (!self_hdl->path || sock->domain != AF_INET) {
+    return;
+  }
+  const struct sockaddr_in *inetaddr = (struct sockaddr_in *)addr;
+  if (inetaddr->sin_addr.s_addr != __net.net_addr.s_addr) {
+    return;
+  }
+  if (inetaddr->sin_port != htons(self_hdl->port)) {
+    return;
+  }
+  self_hdl->__client.server_sock = sock;
+  posix_debug_msg("packet_replay bind handler catch the server socket\n");
+}
+
+static void *packet_replay_handler_post_listen_newthread(void *_arg) {
+  packet_replay_handler_t *self_hdl = (packet_replay_handler_t *)_arg;
+  struct sockaddr_in server_addr;
+  server_addr.sin_family = AF_INET;
+  server_addr.sin_addr = __net.net_addr;
+  server_addr.sin_port = htons(self_hdl->port);
+  int ret = _stream_connect(self_hdl->__client.client_sock,
+                            (const struct sockaddr *)&server_addr,
+                            sizeof(server_addr));
+  assert(ret == 0 && "packet_replay listen handler fails to connect to "
+                     "the server socket");
+
+  int fd = CALL_UNDERLYING(open, self_hdl->path, O_RDONLY);
+  if (fd < 0) {
+    klee_warning("packet_replay could not open the capture");
+  } else {
+    __replay_capture(self_hdl, fd);
+    CALL_UNDERLYING(close, fd);
+  }
+  // the end of the capture is the end of the session
+  _close_socket(self_hdl->__client.client_sock);
+  return NULL;
+}
+
+void packet_replay_handler_post_listen(void *self, socket_t *sock,
+                                       __attribute__((unused)) int backlog) {
+  packet_replay_handler_t *self_hdl = (packet_replay_handler_t *)self;
+  if (self_hdl->__client.server_sock &&
+      self_hdl->__client.server_sock == sock) {
+    pthread_t th;
+    int ret = pthread_create(&th, NULL,
+                             packet_replay_handler_post_listen_newthread,
+                             self_hdl);
+    if (ret != 0) {
+      posix_debug_msg(
+          "packet_replay listen handler pthread failed with ret %d\n", ret);
+    }
+  }
+}
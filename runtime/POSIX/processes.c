@@ -33,6 +33,7 @@
 #include "multiprocess.h"
 #include "fd.h"
 
+#include <sys/resource.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -56,3 +57,68 @@ pid_t getpid(void) {
 
   return pid;
 }
+
+pid_t fork(void) {
+  int res = klee_process_fork(-1);
+  if (res < 0) {
+    errno = EAGAIN;
+    return -1;
+  }
+
+  if (res == 0) {
+    // The child only runs the thread that forked
+    uint64_t tid;
+    klee_get_context(&tid, 0);
+    STATIC_LIST_INIT(__tsync.threads);
+    thread_data_t *tdata = &__tsync.threads[tid];
+    tdata->allocated = 1;
+    tdata->terminated = 0;
+    tdata->ret_value = 0;
+    tdata->joinable = 1;
+    tdata->wlist = klee_get_wlist();
+  }
+
+  return res;
+}
+
+/*
+ * The child gets a copy of the memory rather than borrowing it until exec,
+ * which is all a correct program can tell.
+ */
+pid_t vfork(void) {
+  return fork();
+}
+
+pid_t waitpid(pid_t pid, int *status, int options) {
+  // Process groups are not modeled, all the children are in ours
+  if (pid < -1 || pid == 0)
+    pid = -1;
+
+  int32_t code;
+  int res;
+  while ((res = klee_process_wait(pid, &code, !(options & WNOHANG))) == 0 &&
+         !(options & WNOHANG))
+    ;
+
+  if (res < 0) {
+    errno = ECHILD;
+    return -1;
+  }
+  if (res > 0 && status)
+    *status = (code & 0xff) << 8;
+  return res;
+}
+
+pid_t wait(int *status) {
+  return waitpid(-1, status, 0);
+}
+
+pid_t wait4(pid_t pid, int *status, int options, struct rusage *rusage) {
+  if (rusage)
+    memset(rusage, 0, sizeof(*rusage));
+  return waitpid(pid, status, options);
+}
+
+pid_t wait3(int *status, int options, struct rusage *rusage) {
+  return wait4(-1, status, options, rusage);
+}
@@ -6,9 +6,27 @@ static socket_event_handler_t *all_handlers[];
 
 socket_simulator_t __sock_simulator;
 
+// handlers added by plugins through klee_add_socket_handler
+static socket_event_handler_t *plugin_handlers[MAX_SOCK_EVT_HANDLE];
+static unsigned int plugin_cnt;
+
 void klee_init_sockets_simulator() {
   __sock_simulator.registered_cnt = 0;
   memset(__sock_simulator.handlers, 0, sizeof(__sock_simulator.handlers));
+  __sock_simulator.handler_arg = NULL;
+
+  plugin_cnt = 0;
+  if (klee_register_socket_handlers)
+    klee_register_socket_handlers();
+}
+
+int klee_add_socket_handler(socket_event_handler_t *hdl) {
+  if (plugin_cnt == MAX_SOCK_EVT_HANDLE) {
+    posix_debug_msg("Too many socket handlers, ignore %s\n", hdl->name);
+    return 0;
+  }
+  plugin_handlers[plugin_cnt++] = hdl;
+  return 1;
 }
 
 /*
@@ -36,18 +54,46 @@ static apache_60324_handler_t apache_60324_handler = {
     .server_sock = NULL,
 };
 
+static packet_replay_handler_t packet_replay_handler = {
+    .__client = {
+        .__base = {
+            .name = "packet-replay",
+            .init = packet_replay_handler_init,
+            .post_bind = packet_replay_handler_post_bind,
+            .post_listen = packet_replay_handler_post_listen,
+        },
+        .client_sock = NULL,
+        .server_sock = NULL,
+    },
+    .port = 0,
+    .path = NULL,
+};
+
 static socket_event_handler_t *all_handlers[] = {
     (socket_event_handler_t *)(&memcached_1_5_13_handler),
-    (socket_event_handler_t *)(&apache_60324_handler)
+    (socket_event_handler_t *)(&apache_60324_handler),
+    (socket_event_handler_t *)(&packet_replay_handler)
 };
 
+static void __register_socket_handler(socket_event_handler_t *hdl) {
+  __sock_simulator.handlers[__sock_simulator.registered_cnt++] = hdl;
+  if (hdl->init)
+    hdl->init(hdl);
+}
+
 void register_predefined_socket_handler(const char *handler_name) {
   int i;
   for (i = 0; i < sizeof(all_handlers) / sizeof(all_handlers[0]); ++i) {
     socket_event_handler_t *hdl = all_handlers[i];
     if (strcmp(handler_name, hdl->name) == 0) {
-      __sock_simulator.handlers[__sock_simulator.registered_cnt++] = hdl;
-      hdl->init(hdl);
+      __register_socket_handler(hdl);
+      return;
+    }
+  }
+  for (i = 0; i < plugin_cnt; ++i) {
+    socket_event_handler_t *hdl = plugin_handlers[i];
+    if (strcmp(handler_name, hdl->name) == 0) {
+      __register_socket_handler(hdl);
       return;
     }
   }
@@ -24,12 +24,30 @@ typedef struct {
 typedef struct {
   unsigned int registered_cnt;
   socket_event_handler_t  *handlers[MAX_SOCK_EVT_HANDLE];
+  // The argument of the selected handler
+  // Configurable in klee_init_env (option "-sock-handler-arg")
+  const char *handler_arg;
 } socket_simulator_t;
 extern socket_simulator_t __sock_simulator;
 void klee_init_sockets_simulator();
 // @return 1 if register successfully, 0 if not
 void register_predefined_socket_handler(const char *handler_name);
 
+/*
+ * Plugin interface
+ *
+ * A simulator can live in its own bitcode module, compiled against this
+ * header and handed to klee with "--link-llvm-lib=<module.bc>". The module
+ * defines klee_register_socket_handlers(), which calls
+ * klee_add_socket_handler() once for every handler it provides; "-sock-handler
+ * <NAME>" then selects among the predefined and the added handlers alike.
+ * The hook is declared weak, so that the linker pulls in the module defining
+ * it and runtimes without plugins still link.
+ */
+void klee_register_socket_handlers(void) __attribute__((weak));
+// @return 1 if the handler is added, 0 if there is no room for it
+int klee_add_socket_handler(socket_event_handler_t *hdl);
+
 #define TRIGGER_SOCKET_HANDLER(handle, ...)                                    \
   do {                                                                         \
     int i;                                                                     \
@@ -56,4 +74,12 @@ DECLARE_SOCKET_HANDLER_FUNC(memcached_1_5_13);
 // apache-60324
 typedef client_socket_handler_t apache_60324_handler_t;
 DECLARE_SOCKET_HANDLER_FUNC(apache_60324);
+// packet-replay: streams the payloads of a recorded capture to a server port
+// The handler argument is "<PORT>:<FILE>", see packet_replay_simulator.c
+typedef struct {
+  client_socket_handler_t __client;
+  unsigned short port;
+  const char *path;
+} packet_replay_handler_t;
+DECLARE_SOCKET_HANDLER_FUNC(packet_replay);
 #endif // SOCKETS_SIMULATOR_H_
@@ -318,34 +318,6 @@ int getloadavg(double loadavg[], int nelem) {
   return -1;
 }
 
-pid_t wait(int *status) __attribute__((weak));
-pid_t wait(int *status) {
-  klee_warning("ignoring (ECHILD)");
-  errno = ECHILD;
-  return -1;
-}
-
-pid_t wait3(int *status, int options, struct rusage *rusage) __attribute__((weak));
-pid_t wait3(int *status, int options, struct rusage *rusage) {
-  klee_warning("ignoring (ECHILD)");
-  errno = ECHILD;
-  return -1;
-}
-
-pid_t wait4(pid_t pid, int *status, int options, struct rusage *rusage) __attribute__((weak));
-pid_t wait4(pid_t pid, int *status, int options, struct rusage *rusage) {
-  klee_warning("ignoring (ECHILD)");
-  errno = ECHILD;
-  return -1;
-}
-
-pid_t waitpid(pid_t pid, int *status, int options) __attribute__((weak));
-pid_t waitpid(pid_t pid, int *status, int options) {
-  klee_warning("ignoring (ECHILD)");
-  errno = ECHILD;
-  return -1;
-}
-
 pid_t waitid(idtype_t idtype, id_t id, siginfo_t *infop, int options) __attribute__((weak));
 pid_t waitid(idtype_t idtype, id_t id, siginfo_t *infop, int options) {
   klee_warning("ignoring (ECHILD)");
@@ -258,7 +258,10 @@ static void _init_concrete_buffer(disk_file_t *dfile, const char *origpath,
   block_buffer_t *buff = &dfile->bbuf;
   _block_init(buff, size);
   buff->size = size;
-  _read_file_contents(origpath, size, buff->contents);
+  // The executor reads the file lazily if it can, we read what it leaves
+  // (without a branch on which, so the recorded path is the same).
+  _read_file_contents(origpath, klee_map_file(buff->contents, size, origpath),
+                      buff->contents);
 }
 
 // NOTE: the SYMBOLIC file has the same file name as the given file (origpath)
@@ -428,11 +431,18 @@ void klee_init_symfs(fs_init_descriptor_t *fid) {
     __sym_fs.ftruncate_fail = malloc(sizeof(*__sym_fs.ftruncate_fail));
     __sym_fs.getcwd_fail = malloc(sizeof(*__sym_fs.getcwd_fail));
 
-    klee_make_symbolic(__sym_fs.read_fail, sizeof(*__sym_fs.read_fail), "read_fail");
-    klee_make_symbolic(__sym_fs.write_fail, sizeof(*__sym_fs.write_fail), "write_fail");
-    klee_make_symbolic(__sym_fs.close_fail, sizeof(*__sym_fs.close_fail), "close_fail");
-    klee_make_symbolic(__sym_fs.ftruncate_fail, sizeof(*__sym_fs.ftruncate_fail), "ftruncate_fail");
-    klee_make_symbolic(__sym_fs.getcwd_fail, sizeof(*__sym_fs.getcwd_fail), "getcwd_fail");
+    // one symbolic array for all the counters
+    void *const fail_addrs[] = {__sym_fs.read_fail, __sym_fs.write_fail,
+                                __sym_fs.close_fail, __sym_fs.ftruncate_fail,
+                                __sym_fs.getcwd_fail};
+    const size_t fail_sizes[] = {
+        sizeof(*__sym_fs.read_fail), sizeof(*__sym_fs.write_fail),
+        sizeof(*__sym_fs.close_fail), sizeof(*__sym_fs.ftruncate_fail),
+        sizeof(*__sym_fs.getcwd_fail)};
+    const char *const fail_names[] = {"read_fail", "write_fail", "close_fail",
+                                      "ftruncate_fail", "getcwd_fail"};
+    klee_make_symbolic_batch(fail_addrs, fail_sizes, fail_names,
+                             sizeof(fail_addrs) / sizeof(fail_addrs[0]));
   }
 
   /* setting symbolic stdout */
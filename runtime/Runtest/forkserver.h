@@ -0,0 +1,38 @@
+//===-- forkserver.h --------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The protocol between klee-replay --forkserver and a program linked against
+// libkleeRuntest. klee-replay runs the program once with the environment
+// variable KLEE_REPLAY_FORKSERVER_FD set to one end of a Unix socket pair.
+// Before main, the program then sends KLEE_REPLAY_FORKSERVER_HELLO and
+// serves requests until the socket is closed:
+//   - klee-replay sends a struct klee_forkserver_request, together with the
+//     stdin, stdout and stderr of the run as SCM_RIGHTS
+//   - the forkserver forks a child that takes over these descriptors, changes
+//     to the directory cwd, sets KTEST_FILE and continues into main
+//   - the forkserver replies with the int32_t pid of the child and, once the
+//     child has terminated, with its int32_t wait status
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_FORKSERVER_H
+#define KLEE_FORKSERVER_H
+
+#include <limits.h>
+
+#define KLEE_REPLAY_FORKSERVER_ENV "KLEE_REPLAY_FORKSERVER_FD"
+#define KLEE_REPLAY_FORKSERVER_HELLO 0x4b524653u /* "KRFS" */
+#define KLEE_REPLAY_FORKSERVER_NUM_FDS 3
+
+struct klee_forkserver_request {
+  char ktest_file[PATH_MAX];
+  char cwd[PATH_MAX];
+};
+
+#endif /* KLEE_FORKSERVER_H */
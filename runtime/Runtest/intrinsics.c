@@ -10,18 +10,25 @@
 /* Straight C for linking simplicity */
 
 #include <assert.h>
+#include <errno.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/wait.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "klee/klee.h"
 
 #include "klee/Internal/ADT/KTest.h"
 
+#include "forkserver.h"
+
 static KTest *testData = 0;
 static unsigned testPosition = 0;
 
@@ -49,6 +56,120 @@ static void report_internal_error(const char *msg, ...) {
   }
 }
 
+static int write_all(int fd, const void *buf, size_t size) {
+  const char *p = buf;
+  while (size) {
+    ssize_t res = write(fd, p, size);
+    if (res < 0 && errno == EINTR)
+      continue;
+    if (res <= 0)
+      return -1;
+    p += res;
+    size -= res;
+  }
+  return 0;
+}
+
+/* Receive a request and its descriptors, return -1 once klee-replay
+   closed the socket. */
+static int receive_request(int fd, struct klee_forkserver_request *req,
+                           int *fds) {
+  union {
+    char buf[CMSG_SPACE(sizeof(int) * KLEE_REPLAY_FORKSERVER_NUM_FDS)];
+    struct cmsghdr align;
+  } control;
+  struct iovec iov = {req, sizeof *req};
+  struct msghdr msg;
+  memset(&msg, 0, sizeof msg);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof control.buf;
+
+  ssize_t res;
+  do {
+    res = recvmsg(fd, &msg, 0);
+  } while (res < 0 && errno == EINTR);
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (res <= 0 || !cmsg || cmsg->cmsg_type != SCM_RIGHTS ||
+      cmsg->cmsg_len != CMSG_LEN(sizeof(int) * KLEE_REPLAY_FORKSERVER_NUM_FDS))
+    return -1;
+  memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * KLEE_REPLAY_FORKSERVER_NUM_FDS);
+
+  /* the descriptors come with the first byte, the rest may follow later */
+  char *p = (char *)req + res;
+  size_t left = sizeof *req - res;
+  while (left) {
+    res = read(fd, p, left);
+    if (res < 0 && errno == EINTR)
+      continue;
+    if (res <= 0)
+      return -1;
+    p += res;
+    left -= res;
+  }
+  return 0;
+}
+
+/* Run as a forkserver for klee-replay --forkserver, see forkserver.h. The
+   program is loaded once, and each test case runs in a child forked before
+   main instead of in a process of its own. */
+__attribute__((constructor)) static void klee_replay_forkserver(void) {
+  const char *fd_str = getenv(KLEE_REPLAY_FORKSERVER_ENV);
+  if (!fd_str)
+    return;
+  int fd = atoi(fd_str);
+  unsetenv(KLEE_REPLAY_FORKSERVER_ENV);
+
+  uint32_t hello = KLEE_REPLAY_FORKSERVER_HELLO;
+  if (write_all(fd, &hello, sizeof hello))
+    _exit(1);
+
+  for (;;) {
+    struct klee_forkserver_request req;
+    int fds[KLEE_REPLAY_FORKSERVER_NUM_FDS];
+    unsigned i;
+    if (receive_request(fd, &req, fds))
+      _exit(0);
+    req.ktest_file[sizeof req.ktest_file - 1] = '\0';
+    req.cwd[sizeof req.cwd - 1] = '\0';
+
+    pid_t pid = fork();
+    if (pid < 0)
+      _exit(1);
+    if (pid == 0) {
+      /* a process group of its own, which klee-replay kills on a timeout */
+      setpgid(0, 0);
+      close(fd);
+      for (i = 0; i != KLEE_REPLAY_FORKSERVER_NUM_FDS; ++i) {
+        if (fds[i] != (int)i) {
+          dup2(fds[i], i);
+          close(fds[i]);
+        }
+      }
+      if (chdir(req.cwd) != 0) {
+        perror("KLEE-RUNTIME: forkserver: chdir");
+        _exit(66);
+      }
+      setenv("KTEST_FILE", req.ktest_file, 1);
+      return;
+    }
+
+    for (i = 0; i != KLEE_REPLAY_FORKSERVER_NUM_FDS; ++i)
+      close(fds[i]);
+    int32_t reply = pid;
+    if (write_all(fd, &reply, sizeof reply))
+      _exit(1);
+    int status, res;
+    do {
+      res = waitpid(pid, &status, 0);
+    } while (res < 0 && errno == EINTR);
+    reply = res < 0 ? 0 : status;
+    if (write_all(fd, &reply, sizeof reply))
+      _exit(1);
+  }
+}
+
 void klee_make_symbolic(void *array, size_t nbytes, const char *name) {
 
   if (!name)
@@ -134,6 +255,13 @@ void klee_make_symbolic(void *array, size_t nbytes, const char *name) {
   }
 }
 
+void klee_make_symbolic_batch(void *const *addrs, const size_t *sizes,
+                              const char *const *names, unsigned count) {
+  unsigned i;
+  for (i = 0; i < count; ++i)
+    klee_make_symbolic(addrs[i], sizes[i], names[i]);
+}
+
 void klee_silent_exit(int x) {
   exit(x);
 }
@@ -0,0 +1,24 @@
+// REQUIRES: zlib
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --search=dfs --write-paths --compress-paths %t1.bc > %t.good
+// RUN: FileCheck --check-prefix=CHECK-MAGIC --input-file=%t.klee-out/test000002.path %s
+// RUN: rm -rf %t.klee-out-2
+// RUN: %klee --output-dir=%t.klee-out-2 --replay-path %t.klee-out/test000002.path %t1.bc | FileCheck %s
+
+// CHECK-MAGIC: KLEEZBLK
+
+#include "klee/klee.h"
+
+#include <stdio.h>
+
+int main() {
+  int x;
+  klee_make_symbolic(&x, sizeof x, "x");
+  if (x & 1)
+    printf("odd\n");
+  else
+    printf("even\n");
+  // CHECK: {{odd|even}}
+  return 0;
+}
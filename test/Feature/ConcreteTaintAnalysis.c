@@ -0,0 +1,35 @@
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --concrete-taint-analysis %t.bc > %t.log 2>&1
+// RUN: FileCheck %s --input-file=%t.log
+// RUN: ls %t.klee-out | FileCheck --check-prefix=CHECK-ERR %s
+
+// CHECK: SymbolicTaintPass: {{[1-9][0-9]*}} of {{[0-9]+}} functions
+// CHECK-DAG: count: 3
+// CHECK-DAG: memory error: out of bound pointer
+// CHECK-ERR: .ptr.err
+
+#include <stdio.h>
+
+static int counts[4];
+
+// never sees the symbolic input
+static void count(int i) {
+  counts[i]++;
+}
+
+int main() {
+  int x;
+  klee_make_symbolic(&x, sizeof x, "x");
+
+  for (int i = 0; i < 3; ++i)
+    count(0);
+  printf("count: %d\n", counts[0]);
+
+  if (x > 10)
+    return 1;
+
+  // the concrete path leaves out of bounds accesses to the general one
+  count(4);
+  return 0;
+}
@@ -0,0 +1,30 @@
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t1.bc
+// RUN: rm -rf %t.klee-out %t.klee-out-2
+// RUN: %klee --output-dir=%t.klee-out --search=dfs --write-paths %t1.bc
+// RUN: %klee --output-dir=%t.klee-out-2 --search=dfs --write-paths --copy-path-files=false %t1.bc
+// RUN: diff %t.klee-out/test000001.path %t.klee-out-2/test000001.path
+// RUN: diff %t.klee-out/test000003.path %t.klee-out-2/test000003.path
+// RUN: diff %t.klee-out/test000003.path_datarec %t.klee-out-2/test000003.path_datarec
+// RUN: rm -rf %t.klee-out-3
+// RUN: %klee --output-dir=%t.klee-out-3 --replay-path %t.klee-out/test000003.path %t1.bc | FileCheck %s
+
+#include "klee/klee.h"
+
+#include <stdio.h>
+
+int main() {
+  int x;
+  klee_make_symbolic(&x, sizeof x, "x");
+
+  // the paths fork after some of their entries are in the file
+  for (int i = 0; i < 100; ++i)
+    x += i;
+  if (x & 1)
+    printf("odd\n");
+  else
+    printf("even\n");
+  if (x & 2)
+    printf("two\n");
+  // CHECK: {{odd|even}}
+  return 0;
+}
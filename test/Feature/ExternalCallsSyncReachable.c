@@ -0,0 +1,29 @@
+// RUN: %clang %s -emit-llvm -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --exit-on-error --external-calls-sync-reachable %t1.bc | FileCheck %s
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --exit-on-error %t1.bc | FileCheck %s
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+
+int main() {
+  // the buffers are only reachable through the iovecs
+  char a[] = "hello ", b[] = "world\n";
+  struct iovec iov[2] = {{a, 6}, {b, 6}};
+  // CHECK: hello world
+  writev(1, iov, 2);
+  // another call site with the same signature shares its dispatcher
+  b[0] = 'W';
+  // CHECK-NEXT: hello World
+  writev(1, iov, 2);
+
+  // the external writes a pointer into an object of the program
+  char *end;
+  long v = strtol("42abc", &end, 10);
+  assert(v == 42 && end[0] == 'a' && end[1] == 'b');
+
+  return 0;
+}
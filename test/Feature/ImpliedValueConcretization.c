@@ -0,0 +1,32 @@
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --implied-value-concretization %t1.bc 2>&1 | FileCheck %s
+
+#include "klee/klee.h"
+
+#include <stdio.h>
+
+int main() {
+  unsigned x, y;
+  klee_make_symbolic(&x, sizeof(x), "x");
+  klee_make_symbolic(&y, sizeof(y), "y");
+
+  // two bounds leave a single value
+  if (x > 41 && x < 43) {
+    // CHECK: x concrete: 42
+    if (!klee_is_symbolic(x))
+      printf("x concrete: %u\n", x);
+  }
+
+  // a mask fixes the second byte only
+  if ((y & 0xff00) == 0x1200) {
+    unsigned char *bytes = (unsigned char *)&y;
+    // CHECK: y[1] concrete: 18
+    if (!klee_is_symbolic(bytes[1]))
+      printf("y[1] concrete: %u\n", bytes[1]);
+    // CHECK: y[0] symbolic
+    if (klee_is_symbolic(bytes[0]))
+      printf("y[0] symbolic\n");
+  }
+  return 0;
+}
@@ -0,0 +1,33 @@
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --write-stack-paths --write-cons-paths --path-dump-format=interned %t.bc
+// RUN: cat %t.klee-out/test00000*.cons.path | FileCheck --check-prefix=CONS %s
+// RUN: cat %t.klee-out/test00000*.stack.path | FileCheck --check-prefix=STACK %s
+// RUN: FileCheck --check-prefix=EXPRS %s < %t.klee-out/expr-table.0000.txt
+// RUN: FileCheck --check-prefix=STACKS %s < %t.klee-out/stack-table.0000.txt
+
+// CONS: New: N{{[0-9]+}}
+// STACK: Instr: {{[0-9]+}}
+// STACK-NEXT: S{{[0-9]+}}
+
+// EXPRS: # first 0
+// EXPRS: N{{[0-9]+}} Read w8 x - N{{[0-9]+}}
+
+// STACKS: # first 0
+// STACKS-DAG: F{{[0-9]+}} Thread 0, Process 0, enabled
+// STACKS-DAG: F{{[0-9]+}} {{[0-9]+}} in main ()
+// STACKS-DAG: S0 0 F{{[0-9]+}} F{{[0-9]+}}
+
+int main() {
+  int x;
+  klee_make_symbolic(&x, sizeof x, "x");
+
+  // the constraints of the branches share the reads of x
+  if (x & 1)
+    x += 1;
+  if (x & 2)
+    x += 2;
+  if (x & 4)
+    x += 4;
+  return 0;
+}
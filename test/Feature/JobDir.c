@@ -0,0 +1,26 @@
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t1.bc
+// RUN: rm -rf %t.klee-out %t.klee-out2 %t.jobs
+// RUN: %klee --output-dir=%t.klee-out --job-dir=%t.jobs --job-dir-seed --export-frontier-states=1 %t1.bc 2>&1 | FileCheck %s
+// RUN: find %t.klee-out -name '*.ktest' | wc -l | FileCheck --check-prefix=CHECK-TESTS %s
+// RUN: ls %t.jobs/queue %t.jobs/running | not grep path
+// A process that joins late finds no job left.
+// RUN: %klee --output-dir=%t.klee-out2 --job-dir=%t.jobs %t1.bc 2>&1 | FileCheck --check-prefix=CHECK-LATE %s
+
+#include "klee/klee.h"
+
+int main() {
+  unsigned char x;
+  klee_make_symbolic(&x, sizeof(x), "x");
+  // 16 paths, most of them explored as jobs
+  for (int i = 0; i < 4; ++i)
+    if (x & (1 << i))
+      x ^= 0x80;
+  return 0;
+}
+
+// CHECK-NOT: ERROR
+// CHECK: exported {{[0-9]+}} of {{[0-9]+}} states as jobs
+// CHECK: exploring job: {{.*}}running{{.*}}.path
+// CHECK: KLEE: done: completed paths = 16
+// CHECK-TESTS: 16
+// CHECK-LATE: KLEE: done: completed paths = 0
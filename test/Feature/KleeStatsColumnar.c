@@ -0,0 +1,22 @@
+// RUN: %clang %s -emit-llvm -g %O0opt -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --stats-format=columnar %t.bc 2> %t.log
+// RUN: test -f %t.klee-out/run.stats.col
+// RUN: not test -f %t.klee-out/run.stats
+// RUN: klee-stats --print-more %t.klee-out > %t.stats
+// RUN: FileCheck -check-prefix=CHECK-STATS -input-file=%t.stats %s
+// RUN: klee-stats --to-csv %t.klee-out > %t.csv
+// RUN: FileCheck -check-prefix=CHECK-CSV -input-file=%t.csv %s
+#include "klee/klee.h"
+#include <stdlib.h>
+int main(){
+  int a;
+  klee_make_symbolic (&a, sizeof(int), "a");
+  if (a) {
+    abort();
+  }
+  return 0;
+}
+// CHECK-STATS: | Path | Instrs| Time(s)| ICov(%)| BCov(%)| ICount| TSolver(%)|
+// CHECK-STATS: {{.*\.klee-out\|[ ]*[1-9]+\|[ ]*0\.([0-9]+)\|[ ]*100\.00}}
+// CHECK-CSV: Instructions,FullBranches,PartialBranches,NumBranches,UserTime,NumStates
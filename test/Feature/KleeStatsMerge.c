@@ -0,0 +1,24 @@
+// RUN: %clang %s -emit-llvm -g %O0opt -c -o %t.bc
+// RUN: rm -rf %t.klee-out-1 %t.klee-out-2 %t.merged
+// RUN: %klee --output-dir=%t.klee-out-1 --stats-format=columnar %t.bc 2> %t.log
+// RUN: %klee --output-dir=%t.klee-out-2 %t.bc 2> %t.log
+// RUN: klee-stats-merge -o %t.merged %t.klee-out-1 %t.klee-out-2 | FileCheck -check-prefix=CHECK-MERGE %s
+// RUN: test -f %t.merged/run.istats
+// RUN: klee-stats-merge -sum-istats %t.klee-out-1 %t.klee-out-2 %t.merged | FileCheck -check-prefix=CHECK-SUM %s
+// RUN: klee-stats-merge -sum-stats -o %t.merged %t.klee-out-1 %t.klee-out-2 | FileCheck -check-prefix=CHECK-STATS %s
+// RUN: klee-stats --print-more %t.merged | FileCheck -check-prefix=CHECK-TABLE %s
+#include "klee/klee.h"
+#include <stdlib.h>
+int main(){
+  int a;
+  klee_make_symbolic (&a, sizeof(int), "a");
+  if (a) {
+    abort();
+  }
+  return 0;
+}
+// CHECK-MERGE: Merged 2 runs into
+// CHECK-SUM: -- totals --
+// CHECK-SUM: Forks{{ *}}: {{ *}}{{[0-9]+}} (in 3 files
+// CHECK-STATS: Summed 2 runs into
+// CHECK-TABLE: | Path | Instrs| Time(s)| ICov(%)| BCov(%)| ICount| TSolver(%)|
@@ -3,6 +3,11 @@
 // RUN: %klee --output-dir=%t.klee-out --exit-on-error --external-calls=all --switch-type=internal %t.bc
 // RUN: not test -f %t.klee-out/test000010.ktest
 
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --exit-on-error --external-calls=all --switch-type=table %t.bc
+// RUN: test -f %t.klee-out/test000008.ktest
+// RUN: not test -f %t.klee-out/test000009.ktest
+
 // RUN: rm -rf %t.klee-out
 // RUN: %klee --output-dir=%t.klee-out --exit-on-error --switch-type=simple %t.bc
 // RUN: test -f %t.klee-out/test000010.ktest
@@ -0,0 +1,41 @@
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --exit-on-error %t1.bc 2>&1 | FileCheck %s
+// RUN: ktest-tool %t.klee-out/test000001.ktest | FileCheck --check-prefix=CHECK-KTEST %s
+// RUN: rm -rf %t.replay-out
+// RUN: %klee --output-dir=%t.replay-out --replay-ktest-file=%t.klee-out/test000003.ktest --exit-on-error %t1.bc 2>&1 | FileCheck --check-prefix=CHECK-REPLAY %s
+
+#include "klee/klee.h"
+
+#include <stdio.h>
+
+int main() {
+  char a;
+  short b;
+  int c[2];
+  void *const addrs[] = {&a, &b, c};
+  const size_t sizes[] = {sizeof(a), sizeof(b), sizeof(c)};
+  const char *const names[] = {"a", "b", "c"};
+  klee_make_symbolic_batch(addrs, sizes, names, 3);
+
+  // the objects are distinct, though they share one array
+  if (a == 1 && b == 2 && c[0] == 3 && c[1] == 4) {
+    printf("all\n");
+    return 0;
+  }
+  if (b == 7)
+    printf("b\n");
+  return 0;
+}
+
+// CHECK: KLEE: done: completed paths = 7
+
+// CHECK-KTEST: num objects: 3
+// CHECK-KTEST: object 0: name: 'a'
+// CHECK-KTEST: object 0: size: 1
+// CHECK-KTEST: object 1: name: 'b'
+// CHECK-KTEST: object 1: size: 2
+// CHECK-KTEST: object 2: name: 'c'
+// CHECK-KTEST: object 2: size: 8
+
+// CHECK-REPLAY: KLEE: done: completed paths = 1
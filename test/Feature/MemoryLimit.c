@@ -6,18 +6,25 @@
 
 // RUN: %clang -emit-llvm -DLITTLE_ALLOC -g -c %s -o %t.little.bc
 // RUN: rm -rf %t.klee-out
-// RUN: %klee --output-dir=%t.klee-out --max-memory=20 %t.little.bc > %t.little.log
+// RUN: %klee --output-dir=%t.klee-out --max-memory=20 --max-memory-action=kill %t.little.bc > %t.little.log
 // RUN: not grep -q "MALLOC FAILED" %t.little.log
 // RUN: not grep -q "DONE" %t.little.log
 // RUN: grep "WARNING: killing 1 states (over memory cap)" %t.klee-out/warnings.txt
 
 // RUN: %clang -emit-llvm -g -c %s -o %t.big.bc
 // RUN: rm -rf %t.klee-out
-// RUN: %klee --output-dir=%t.klee-out --max-memory=20 %t.big.bc > %t.big.log 2> %t.big.err
+// RUN: %klee --output-dir=%t.klee-out --max-memory=20 --max-memory-action=kill %t.big.bc > %t.big.log 2> %t.big.err
 // RUN: not grep -q "MALLOC FAILED" %t.big.log
 // RUN: not grep -q "DONE" %t.big.log
 // RUN: grep "WARNING: killing 1 states (over memory cap)" %t.klee-out/warnings.txt
 
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --max-memory=20 --max-memory-action=spill --only-output-states-covering-new %t.little.bc > %t.spill.log
+// RUN: not grep -q "DONE" %t.spill.log
+// RUN: grep "WARNING: spilling 1 states (over memory cap)" %t.klee-out/warnings.txt
+// RUN: grep "Memory limit exceeded (spilled)" %t.klee-out/test000001.spill
+// RUN: test -f %t.klee-out/test000001.ktest
+
 #include <stdlib.h>
 #include <stdio.h>
 
@@ -0,0 +1,45 @@
+// RUN: %clang -emit-llvm -g -c -o %t.bc %s
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --libc=klee --exit-on-error --pathrec-entry-point=not_called %t.bc > %t.native.log 2>&1
+// RUN: FileCheck -input-file=%t.native.log %s
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --libc=klee --exit-on-error --pathrec-entry-point=not_called --native-libc-functions=false %t.bc > %t.interpreted.log 2>&1
+// RUN: FileCheck -input-file=%t.interpreted.log %s
+
+#include "klee/klee.h"
+
+#include <assert.h>
+#include <string.h>
+
+void not_called(void) {}
+
+int main() {
+  char buf[32], copy[32];
+  char sym;
+  klee_make_symbolic(&sym, sizeof(sym), "sym");
+
+  memset(buf, 'a', sizeof(buf));
+  buf[31] = 0;
+  assert(strlen(buf) == 31);
+
+  strcpy(buf, "hello");
+  memcpy(copy, buf, sizeof(buf));
+  assert(strcmp(copy, "hello") == 0);
+  assert(strcmp(copy, "help") < 0);
+
+  // overlapping ranges of one object
+  memmove(buf + 1, buf, 5);
+  assert(memcmp(buf, "hhello", 6) == 0);
+
+  // symbolic bytes are copied as their expressions
+  memset(buf, sym, 4);
+  memcpy(copy + 8, buf, 4);
+  if (copy[10] == 'x')
+    assert(sym == 'x');
+  else
+    assert(sym != 'x');
+
+  return 0;
+}
+
+// CHECK: KLEE: done: completed paths = 2
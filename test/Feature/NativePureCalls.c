@@ -0,0 +1,58 @@
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --native-pure-calls --native-call=divide --pathrec-entry-point=not_called %t.bc > %t.log 2>&1
+// RUN: FileCheck %s --input-file=%t.log
+// RUN: ls %t.klee-out | FileCheck --check-prefix=CHECK-ERR %s
+
+// CHECK: NativeCallPass: {{[1-9][0-9]*}} functions can run natively
+// CHECK-DAG: crc: 222957957 0
+// CHECK-DAG: calls: 3
+// CHECK-DAG: divide by zero
+// CHECK-ERR: .div.err
+
+#include "klee/klee.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+static unsigned table[256];
+static unsigned calls;
+
+void not_called(void) {}
+
+static void make_table(void) {
+  for (unsigned n = 0; n < 256; ++n) {
+    unsigned c = n;
+    for (int k = 0; k < 8; ++k)
+      c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+    table[n] = c;
+  }
+}
+
+// allowlisted, reads a global and writes another one
+unsigned crc32(const unsigned char *buf, unsigned len) {
+  unsigned c = 0xffffffffu;
+  ++calls;
+  for (unsigned i = 0; i < len; ++i)
+    c = table[(c ^ buf[i]) & 0xff] ^ (c >> 8);
+  return c ^ 0xffffffffu;
+}
+
+int divide(int a, int b) { return a / b; }
+
+int main() {
+  unsigned char sym;
+  klee_make_symbolic(&sym, sizeof(sym), "sym");
+
+  make_table();
+  printf("crc: %u %u\n", crc32((const unsigned char *)"hello world", 11),
+         crc32((const unsigned char *)"", 0));
+
+  // symbolic memory is left to the interpreter
+  assert(crc32(&sym, 1) == (table[(0xffu ^ sym) & 0xff] ^ 0xffffffu) ^
+                               0xffffffffu);
+  printf("calls: %u\n", calls);
+
+  // the interpreter reports the fault of the native call
+  return divide(1, (int)calls - 3);
+}
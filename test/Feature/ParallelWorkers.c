@@ -0,0 +1,23 @@
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --parallel-workers=4 --parallel-split-states=2 --write-paths %t1.bc 2>&1 | FileCheck %s
+// RUN: test -d %t.klee-out/worker2
+// RUN: find %t.klee-out -name '*.ktest' | wc -l | FileCheck --check-prefix=CHECK-TESTS %s
+// RUN: find %t.klee-out -name '*.path' | wc -l | FileCheck --check-prefix=CHECK-TESTS %s
+// RUN: grep -h "exploring" %t.klee-out/worker*/messages.txt | FileCheck --check-prefix=CHECK-WORKER %s
+
+#include "klee/klee.h"
+
+int main() {
+  unsigned char x;
+  klee_make_symbolic(&x, sizeof(x), "x");
+  // 16 paths, split between at most 4 processes
+  for (int i = 0; i < 4; ++i)
+    if (x & (1 << i))
+      x ^= 0x80;
+  return 0;
+}
+
+// CHECK-NOT: ERROR
+// CHECK-TESTS: 16
+// CHECK-WORKER: worker {{[123]}}: exploring
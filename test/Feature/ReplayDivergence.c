@@ -0,0 +1,42 @@
+// RUN: %clang %s -emit-llvm %O0opt -DFLIP -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --write-paths %t1.bc
+
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t2.bc
+// RUN: rm -rf %t.klee-out-2
+// RUN: %klee --output-dir=%t.klee-out-2 --replay-path %t.klee-out/test000001.path %t2.bc 2>&1 | FileCheck %s
+// RUN: FileCheck --check-prefix=REPORT %s < %t.klee-out-2/replay-divergence.jsonl
+
+// RUN: rm -rf %t.klee-out-3
+// RUN: %klee --output-dir=%t.klee-out-3 --replay-continue-after-divergence --replay-path %t.klee-out/test000001.path %t2.bc
+// RUN: FileCheck --check-prefix=SUFFIX %s < %t.klee-out-3/replay-divergence.jsonl
+
+// CHECK: replay: 1/{{[0-9]+}} recorded branch contradicts the concrete condition, recorded: FORK 1, runtime: FORK 0
+
+// REPORT: {"type":"divergence","index":0,"reason":"recorded branch contradicts the concrete condition","position":1,
+// REPORT-SAME: "expected":"FORK 1","actual":"FORK 0"
+// REPORT-SAME: "continued":false
+// REPORT-SAME: "stack":[{"function":"main"
+// REPORT-SAME: "history":[{"position":0,"entry":"FORK 1"}]
+
+// SUFFIX: {"type":"divergence"{{.*}}"continued":true
+// SUFFIX: {"type":"suffix","first_position":1,"divergences":1,
+
+int main() {
+  int x, res = 0;
+  klee_make_symbolic(&x, sizeof x, "x");
+  klee_assume(x > 0);
+
+  if (x > 0)
+    res = 1;
+
+#ifdef FLIP
+  int flip = 1;
+#else
+  int flip = 0;
+#endif
+  if (flip)
+    res += 2;
+
+  return res;
+}
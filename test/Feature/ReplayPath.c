@@ -6,6 +6,12 @@
 // RUN: rm -rf %t.klee-out-2
 // RUN: %klee --output-dir=%t.klee-out-2 --replay-path %t.klee-out/test000001.path %t2.bc > %t3.log
 // RUN: diff %t3.log %t3.good
+// RUN: rm -rf %t.klee-out-3
+// RUN: %klee --output-dir=%t.klee-out-3 --search=replay-progress --replay-path %t.klee-out/test000001.path %t2.bc > %t3.log
+// RUN: diff %t3.log %t3.good
+// RUN: rm -rf %t.klee-out-4
+// RUN: %klee --output-dir=%t.klee-out-4 --replay-batch-branches=2 --replay-background-checks --replay-path %t.klee-out/test000001.path %t2.bc > %t3.log
+// RUN: diff %t3.log %t3.good
 
 #include <unistd.h>
 #include <stdio.h>
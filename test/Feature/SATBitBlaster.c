@@ -0,0 +1,25 @@
+// REQUIRES: cadical
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --use-sat-bitblaster --debug-validate-solver %t1.bc 2>&1 | FileCheck %s
+
+#include "klee/klee.h"
+
+int main() {
+  unsigned char header[4];
+  klee_make_symbolic(header, sizeof(header), "header");
+  // a checksum over the bytes of a header, as parsers compute them
+  if ((header[0] ^ 0x5a) != 0x30)
+    return 0;
+  if ((header[1] & 0xf0) != 0x40)
+    return 1;
+  unsigned char sum = (header[0] + (header[1] << 1) + header[2]) & 0xff;
+  if (sum == header[3])
+    return 2;
+  // a symbolic index is left to the core solver
+  if (header[header[2] & 3] == 7)
+    return 3;
+  return 4;
+}
+
+// CHECK: KLEE: done: completed paths = 5
@@ -0,0 +1,32 @@
+// RUN: %clang -emit-llvm -c -g %s -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out %t.bc
+// RUN: test -f %t.klee-out/test000003.ktest
+
+// Every seed is replayed by a batch of its own
+// RUN: rm -rf %t.klee-out-2
+// RUN: %klee --output-dir=%t.klee-out-2 --only-replay-seeds --seed-batch-size=1 --seed-dir=%t.klee-out %t.bc > %t.log 2>&1
+// RUN: FileCheck --input-file=%t.log %s
+// RUN: test -f %t.klee-out-2/test000003.ktest
+// RUN: not test -f %t.klee-out-2/test000004.ktest
+// CHECK: using 3 seeds
+// CHECK-DAG: negative
+// CHECK-DAG: zero
+// CHECK-DAG: positive
+// CHECK: seeding done
+
+#include "klee/klee.h"
+
+#include <stdio.h>
+
+int main() {
+  int x;
+  klee_make_symbolic(&x, sizeof x, "x");
+  if (x < 0)
+    printf("negative\n");
+  else if (x == 0)
+    printf("zero\n");
+  else
+    printf("positive\n");
+  return 0;
+}
@@ -0,0 +1,31 @@
+// RUN: %clang -emit-llvm -c -g %s -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out %t.bc
+// RUN: test -f %t.klee-out/test000002.ktest
+
+// .ktest files can be concatenated into a stream of seeds
+// RUN: cat %t.klee-out/test000001.ktest %t.klee-out/test000002.ktest > %t.stream
+// RUN: rm -rf %t.klee-out-2
+// RUN: %klee --output-dir=%t.klee-out-2 --only-replay-seeds --seed-stream=%t.stream %t.bc > %t.log 2>&1
+// RUN: FileCheck --input-file=%t.log %s
+// CHECK: using 0 seeds and 1 seed streams
+// CHECK-DAG: forty-two
+// CHECK-DAG: other
+
+// RUN: rm -rf %t.klee-out-3
+// RUN: not %klee --output-dir=%t.klee-out-3 --seed-stream=%t.bc %t.bc 2>&1 | FileCheck --check-prefix=CHECK-INVALID %s
+// CHECK-INVALID: invalid .ktest 1 in seed stream
+
+#include "klee/klee.h"
+
+#include <stdio.h>
+
+int main() {
+  int x;
+  klee_make_symbolic(&x, sizeof x, "x");
+  if (x == 42)
+    printf("forty-two\n");
+  else
+    printf("other\n");
+  return 0;
+}
@@ -0,0 +1,31 @@
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out %t1.bc 2>&1 | FileCheck %s
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --share-constant-globals=false %t1.bc 2>&1 | FileCheck %s
+
+#include "klee/klee.h"
+
+#include <stdio.h>
+
+static const char table[4] = {1, 2, 3, 4};
+static char counter;
+
+int main() {
+  unsigned i;
+  klee_make_symbolic(&i, sizeof(i), "i");
+  klee_assume(i < 4);
+
+  // a symbolic pointer into a constant global
+  if (table[i] == 3)
+    ++counter;
+
+  // constant strings reach the external call as they are
+  // CHECK-DAG: shared constant
+  puts("shared constant");
+
+  // CHECK-DAG: memory error: object read only
+  if (i == 1)
+    *(char *)&table[i] = 0;
+  return 0;
+}
@@ -0,0 +1,32 @@
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t1.bc
+// RUN: rm -rf %t.klee-out %t.full-out
+// RUN: %klee --output-dir=%t.klee-out --slice-test-inputs %t1.bc 2>&1 | FileCheck %s
+// RUN: ktest-tool %t.klee-out/test000001.ktest | FileCheck --check-prefix=CHECK-SLICED %s
+// RUN: %klee --output-dir=%t.full-out %t1.bc 2>&1 | FileCheck %s
+// RUN: ktest-tool %t.full-out/test000001.ktest | FileCheck --check-prefix=CHECK-FULL %s
+
+#include "klee/klee.h"
+
+#include <assert.h>
+
+static void check(int a) {
+  // CHECK: ASSERTION FAIL
+  assert(a <= 1000);
+}
+
+int main() {
+  int a, b;
+  klee_make_symbolic(&a, sizeof(a), "a");
+  klee_make_symbolic(&b, sizeof(b), "b");
+  klee_assume(a > 1000);
+  klee_assume(b == 77);
+  // the failure only depends on a, b is not solved for
+  check(a);
+  return 0;
+}
+
+// CHECK-SLICED: object 1: name: 'b'
+// CHECK-SLICED: object 1: int : 0
+
+// CHECK-FULL: object 1: name: 'b'
+// CHECK-FULL: object 1: int : 77
@@ -0,0 +1,27 @@
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t1.bc
+// RUN: rm -rf %t.klee-out %t.hinted-out %t.single-out
+// RUN: %klee --output-dir=%t.klee-out %t1.bc 2>&1 | FileCheck %s
+// RUN: %klee --output-dir=%t.hinted-out --solver-hint=%t.klee-out %t1.bc 2>&1 | FileCheck --check-prefix=CHECK-HINT %s
+// RUN: %klee --output-dir=%t.single-out --solver-hint=%t.klee-out/test000001.ktest %t1.bc 2>&1 | FileCheck --check-prefix=CHECK-SINGLE %s
+
+#include "klee/klee.h"
+
+int main() {
+  int x;
+  klee_make_symbolic(&x, sizeof(x), "x");
+  if (x > 10) {
+    if (x < 100)
+      return 1;
+    return 2;
+  }
+  return 0;
+}
+
+// CHECK: KLEE: done: completed paths = 3
+
+// the hints give the same paths
+// CHECK-HINT: KLEE: Trying 3 solver hints before solving
+// CHECK-HINT: KLEE: done: completed paths = 3
+
+// CHECK-SINGLE: KLEE: Trying 1 solver hints before solving
+// CHECK-SINGLE: KLEE: done: completed paths = 3
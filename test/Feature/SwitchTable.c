@@ -0,0 +1,46 @@
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --exit-on-error --switch-type=table %t.bc > %t.log 2>&1
+// RUN: FileCheck %s --input-file=%t.log
+
+// CHECK: sum: 250
+// CHECK: KLEE: done: completed paths = 3
+
+#include "klee/klee.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+// dense, dispatched through a jump table when concrete
+static int classify(unsigned char c) {
+  switch (c) {
+  case 1: case 2: case 3: case 4: case 5: case 6: case 7: case 8:
+    return 1;
+  case 10: case 11: case 12:
+    return 2;
+  case 13:
+    return 1;
+  case 14: case 15: case 16:
+    return 3;
+  default:
+    return 0;
+  }
+}
+
+int main() {
+  int sum = 0;
+  for (unsigned v = 0; v < 256; ++v)
+    sum += classify(v) * (int)v;
+  printf("sum: %d\n", sum);
+
+  // one fork per feasible successor: 1 to 8, 10 to 12 and the default
+  unsigned char c = klee_range(0, 13, "c");
+  int k = classify(c);
+  if (k == 1)
+    assert((c >= 1 && c <= 8) || c == 13);
+  else if (k == 2)
+    assert(c >= 10 && c <= 12);
+  else
+    assert(k == 0 && (c == 0 || c == 9));
+  return 0;
+}
@@ -0,0 +1,26 @@
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --test-writer-threads=2 --write-kqueries --write-cov %t1.bc 2>&1 | FileCheck %s
+// RUN: ktest-tool %t.klee-out/test000004.ktest | FileCheck --check-prefix=CHECK-KTEST %s
+
+#include "klee/klee.h"
+
+#include <assert.h>
+
+int main() {
+  int x;
+  klee_make_symbolic(&x, sizeof(x), "x");
+  if (x == 1)
+    return 1;
+  if (x == 2)
+    return 2;
+  if (x == 3)
+    return 3;
+  // CHECK: ASSERTION FAIL
+  assert(x != 4);
+  return 0;
+}
+
+// CHECK: KLEE: done: generated tests = 5
+
+// CHECK-KTEST: object 0: name: 'x'
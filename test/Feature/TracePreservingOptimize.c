@@ -0,0 +1,35 @@
+// RUN: %clang %s -emit-llvm %O0opt -DCOND_EXIT -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --write-paths %t1.bc > %t3.good
+
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t2.bc
+// RUN: rm -rf %t.klee-out-2
+// RUN: %klee --output-dir=%t.klee-out-2 --trace-preserving-optimize --replay-path %t.klee-out/test000001.path %t2.bc > %t3.log 2> %t3.err
+// RUN: diff %t3.log %t3.good
+// RUN: FileCheck %s --input-file=%t3.err
+
+// the locals live in allocas at -O0, which are promoted without changing
+// the branches the path follows
+// CHECK: TracePreservingOptimizePass: optimized {{[1-9][0-9]*}} of
+
+#include <stdio.h>
+
+void cond_exit() {
+#ifdef COND_EXIT
+  klee_silent_exit(0);
+#endif
+}
+
+int main() {
+  int res = 1;
+  int x;
+
+  klee_make_symbolic(&x, sizeof x, "x");
+
+  if (x&1) res *= 2; else cond_exit();
+  if (x&2) res *= 3; else cond_exit();
+  if (x&4) res *= 5; else cond_exit();
+  printf("res: %d\n", res);
+
+  return 0;
+}
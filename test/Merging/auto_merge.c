@@ -0,0 +1,30 @@
+// RUN: %clang -emit-llvm -g -c -o %t.bc %s
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --auto-merge --search=dfs %t.bc 2>&1 | FileCheck --check-prefix=CHECK-MERGED %s
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --auto-merge %t.bc 2>&1 | FileCheck --check-prefix=CHECK-MERGED %s
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --auto-merge --auto-merge-max-constraints=0 %t.bc 2>&1 | FileCheck --check-prefix=CHECK-SPLIT %s
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out %t.bc 2>&1 | FileCheck --check-prefix=CHECK-SPLIT %s
+
+// CHECK-MERGED: generated tests = 1{{$}}
+// CHECK-SPLIT: generated tests = 4{{$}}
+
+#include "klee/klee.h"
+
+int main(int argc, char **args) {
+  int x;
+  int y;
+  klee_make_symbolic(&x, sizeof(x), "x");
+
+  // both diamonds reconverge without loops or calls
+  if (x > 10)
+    y = 1;
+  else
+    y = 2;
+  if (x & 1)
+    y += 4;
+
+  return y;
+}
@@ -0,0 +1,37 @@
+// RUN: %clang %s -emit-llvm -g %O0opt -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --search=dfs %t.bc
+// RUN: %cc %s %libkleeruntest -Wl,-rpath %libkleeruntestdir -o %t_runner
+
+// Replay each test case in a process of its own
+// RUN: rm -f %t.exec.report
+// RUN: %klee-replay --batch-report=%t.exec.report %t_runner %t.klee-out/test000001.ktest %t.klee-out/test000002.ktest %t.klee-out/test000003.ktest 2> %t.exec.log
+// RUN: FileCheck --input-file=%t.exec.report %s
+
+// Replay all of them in children of a single forkserver
+// RUN: rm -f %t.fork.report
+// RUN: %klee-replay --forkserver --batch-report=%t.fork.report %t_runner %t.klee-out/test000001.ktest %t.klee-out/test000002.ktest %t.klee-out/test000003.ktest 2> %t.fork.log
+// RUN: FileCheck --input-file=%t.fork.report %s
+// RUN: FileCheck --input-file=%t.fork.log --check-prefix=CHECK-LOG %s
+
+// CHECK-DAG: {"ktest": "{{.*}}.ktest", "status": "NORMAL", "code": 0, "time": {{[0-9.]+}}}
+// CHECK-DAG: {"ktest": "{{.*}}.ktest", "status": "ABNORMAL", "code": 3, "time": {{[0-9.]+}}}
+// CHECK-DAG: {"ktest": "{{.*}}.ktest", "status": "CRASHED", "code": 6, "time": {{[0-9.]+}}}
+
+// CHECK-LOG: EXIT STATUS: {{NORMAL|ABNORMAL 3|CRASHED signal 6}}
+// CHECK-LOG: EXIT STATUS: {{NORMAL|ABNORMAL 3|CRASHED signal 6}}
+// CHECK-LOG: EXIT STATUS: {{NORMAL|ABNORMAL 3|CRASHED signal 6}}
+
+#include "klee/klee.h"
+
+#include <stdlib.h>
+
+int main(int argc, char **argv) {
+  int x;
+  klee_make_symbolic(&x, sizeof(x), "x");
+  if (x == 0)
+    return 0;
+  if (x == 1)
+    return 3;
+  abort();
+}
@@ -6,6 +6,16 @@
 // RUN: FileCheck --input-file=%t.out %s
 // CHECK: KLEE-REPLAY: NOTE: EXIT STATUS: NORMAL
 //
+// -- Batch generation
+// RUN: rm -rf %t.seeds
+// RUN: %gen-random-bout 100 -sym-arg 4 -sym-stdin 8 --count 10 --jobs 2 --output-dir %t.seeds
+// RUN: %klee-replay %t %t.seeds/random000009.ktest 2> %t.batch.out
+// RUN: FileCheck --input-file=%t.batch.out %s
+// RUN: not test -f %t.seeds/random000010.ktest
+// RUN: not %gen-random-bout 100 --count 10 2> %t5
+// RUN: FileCheck -check-prefix=CHECK-BATCH -input-file=%t5 %s
+// CHECK-BATCH: --count requires one of --output-dir and --stream
+//
 // -- Option error handling tests
 // RUN: not %gen-random-bout 2> %t1
 // RUN: FileCheck -check-prefix=CHECK-USAGE -input-file=%t1 %s
@@ -0,0 +1,34 @@
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t2.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --libc=klee --posix-runtime --exit-on-error %t2.bc 2>&1 | FileCheck %s
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+int counter = 1;
+
+int main(int argc, char **argv) {
+  pid_t parent = getpid();
+  pid_t child = fork();
+  assert(child >= 0);
+
+  if (child == 0) {
+    // the child writes its own copy of the memory
+    assert(getpid() != parent);
+    counter = 42;
+    exit(3);
+  }
+
+  int status;
+  // CHECK: Forking process 1
+  // CHECK: Terminating process 1
+  assert(waitpid(child, &status, 0) == child);
+  assert(WIFEXITED(status) && WEXITSTATUS(status) == 3);
+  assert(counter == 1);
+  assert(waitpid(-1, &status, WNOHANG) == -1);
+  printf("parent done\n");
+  return 0;
+}
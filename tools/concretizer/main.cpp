@@ -1,14 +1,22 @@
 #include "klee/Internal/ADT/KTest.h"
+#include "klee/Internal/Support/FileHandling.h"
 #include "klee/Internal/Support/PrintVersion.h"
+#include "klee/Internal/Support/WorkQueue.h"
 
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/Signals.h"
 
 #include <iostream>
 #include <fstream>
 #include <cstring>
+#include <mutex>
+#include <set>
 #include <sstream>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
 using namespace llvm;
 using namespace klee;
@@ -28,28 +36,67 @@ static cl::opt<std::string> OutputFile(
     cl::Positional,
     cl::Required);
 
-int main(int argc, char **argv) {
-  sys::PrintStackTraceOnErrorSignal(argv[0]);
-  cl::SetVersionPrinter(klee::printVersion);
-  StringMap<cl::Option *> &map = cl::getRegisteredOptions();
-  for (auto &elem : map) {
-      if (elem.second->Category == &llvm::cl::GeneralCategory) {
-          elem.second->setHiddenFlag(cl::Hidden);
-      }
-  }
-  cl::ParseCommandLineOptions(argc, argv);
+static cl::opt<bool> Batch(
+    "batch",
+    cl::desc("Treat input_ktest_file as a directory of .ktest files, or a "
+             "file that lists a KTest file and optionally the template to "
+             "use instead of input_template_file per line, and "
+             "output_concretize_cfg as the directory that the configuration "
+             "of each KTest is written to, as <KTest name>.cfg, along with a "
+             "manifest that lists the KTest, template, configuration and 'ok' "
+             "or the error of each (default=false)"),
+    cl::init(false));
 
-  std::ifstream inTemp(InputTemplateFile);
-  assert(inTemp.good() && "Cannot open input template file");
-  std::ofstream outFile(OutputFile);
-  assert(outFile.good() && "Cannot open output file");
+static cl::opt<unsigned> Threads(
+    "batch-threads",
+    cl::desc("Number of KTests to concretize in parallel with -batch "
+             "(default=number of cores)"),
+    cl::init(0));
 
-  KTest *ktest = kTest_fromFile(InputKTestFile.c_str());
-  if (!ktest) {
-    llvm::errs() << "Invalid KTest file at " << InputKTestFile << "\n";
-    abort();
+namespace {
+/// The offsets that a template asks for, per object
+typedef std::vector<std::pair<std::string, unsigned>> Template;
+
+/// Files loaded so far. In a batch, the inputs that refer to the same KTest
+/// or template share it.
+template <typename T> class LoadCache {
+  struct Entry {
+    std::once_flag once;
+    std::shared_ptr<T> value;
+  };
+  std::mutex mutex;
+  std::unordered_map<std::string, std::unique_ptr<Entry>> entries;
+
+public:
+  /// \return nullptr if load fails for path
+  const T *get(const std::string &path,
+               std::shared_ptr<T> (*load)(const std::string &)) {
+    Entry *entry;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      std::unique_ptr<Entry> &e = entries[path];
+      if (!e)
+        e.reset(new Entry);
+      entry = e.get();
+    }
+    std::call_once(entry->once, [&] { entry->value = load(path); });
+    return entry->value.get();
   }
+};
+} // namespace
+
+static std::shared_ptr<KTest> loadKTest(const std::string &path) {
+  KTest *ktest = kTest_fromFile(path.c_str());
+  if (!ktest)
+    return nullptr;
+  return std::shared_ptr<KTest>(ktest, kTest_free);
+}
 
+static std::shared_ptr<Template> loadTemplate(const std::string &path) {
+  std::ifstream inTemp(path);
+  if (!inTemp.good())
+    return nullptr;
+  std::shared_ptr<Template> t = std::make_shared<Template>();
   while (1) {
     std::istringstream line;
     std::string linestr, object;
@@ -63,20 +110,147 @@ int main(int argc, char **argv) {
       line.str(linestr);
       line >> object >> offset;
     }
+    t->emplace_back(object, offset);
+  }
+  return t;
+}
 
+/// Write the bytes of ktest at the offsets asked for by templ to outFile.
+/// \return false and set error if an offset is not in its object
+static bool concretize(const KTest *ktest, const Template &templ,
+                       std::ostream &outFile, std::string &error) {
+  for (const auto &entry : templ) {
+    const std::string &object = entry.first;
+    unsigned offset = entry.second;
     for (unsigned i = 0; i < ktest->numObjects; i++) {
       std::string name(ktest->objects[i].name);
       if (name == object) {
+        if (offset >= ktest->objects[i].numBytes) {
+          error = "offset " + std::to_string(offset) + " is not in " + name;
+          return false;
+        }
         outFile << name << " " << offset << " " << (int)ktest->objects[i].bytes[offset] << "\n";
       }
     }
   }
+  return true;
+}
 
-  inTemp.close();
-  outFile.close();
+/// Concretize the KTests listed by InputKTestFile into the directory
+/// OutputFile on a pool of Threads threads.
+static int concretizeBatch() {
+  std::vector<std::string> lines;
+  std::string error;
+  if (!klee_read_input_list(InputKTestFile, ".ktest", lines, error)) {
+    llvm::errs() << "Cannot read KTests from " << InputKTestFile << ": "
+                 << error << "\n";
+    return 1;
+  }
+  if (std::error_code ec = sys::fs::create_directories(OutputFile.getValue())) {
+    llvm::errs() << "Cannot create output directory " << OutputFile << ": "
+                 << ec.message() << "\n";
+    return 1;
+  }
 
-  return 0;
+  // name each configuration after its KTest, telling apart KTests of the
+  // same name in different directories by a number
+  std::vector<std::string> ktests, templates, outputs;
+  std::set<std::string> names;
+  for (const std::string &l : lines) {
+    std::istringstream line(l);
+    std::string ktest, templ;
+    line >> ktest >> templ;
+    ktests.push_back(ktest);
+    templates.push_back(templ.empty() ? InputTemplateFile.getValue() : templ);
+
+    std::string stem = sys::path::stem(ktest).str(), name = stem;
+    for (unsigned i = 1; !names.insert(name).second; ++i)
+      name = stem + "-" + std::to_string(i);
+    SmallString<128> output(OutputFile.getValue());
+    sys::path::append(output, name + ".cfg");
+    outputs.push_back(output.str().str());
+  }
+
+  unsigned threads = Threads ? Threads.getValue()
+                             : std::max(1u, std::thread::hardware_concurrency());
+  LoadCache<KTest> ktestCache;
+  LoadCache<Template> templateCache;
+  std::vector<std::string> status(ktests.size());
+  {
+    WorkQueue pool(threads, 4 * threads);
+    for (unsigned i = 0; i < ktests.size(); ++i) {
+      pool.submit([&, i] {
+        const KTest *ktest = ktestCache.get(ktests[i], loadKTest);
+        const Template *templ = templateCache.get(templates[i], loadTemplate);
+        std::string error;
+        if (!ktest) {
+          status[i] = "Invalid KTest file at " + ktests[i];
+        } else if (!templ) {
+          status[i] = "Cannot open input template file " + templates[i];
+        } else {
+          std::ofstream outFile(outputs[i]);
+          if (!outFile.good())
+            status[i] = "Cannot open output file " + outputs[i];
+          else if (!concretize(ktest, *templ, outFile, error))
+            status[i] = error;
+          else
+            status[i] = "ok";
+        }
+      });
+    }
+    pool.drain();
+  }
+
+  SmallString<128> manifestPath(OutputFile.getValue());
+  sys::path::append(manifestPath, "manifest");
+  std::ofstream manifest(manifestPath.c_str());
+  unsigned failed = 0;
+  for (unsigned i = 0; i < ktests.size(); ++i) {
+    manifest << ktests[i] << "\t" << templates[i] << "\t" << outputs[i] << "\t"
+             << status[i] << "\n";
+    if (status[i] != "ok") {
+      llvm::errs() << ktests[i] << ": " << status[i] << "\n";
+      ++failed;
+    }
+  }
+  if (!manifest.good()) {
+    llvm::errs() << "Cannot write manifest " << manifestPath << "\n";
+    return 1;
+  }
+  return failed ? 1 : 0;
 }
 
+int main(int argc, char **argv) {
+  sys::PrintStackTraceOnErrorSignal(argv[0]);
+  cl::SetVersionPrinter(klee::printVersion);
+  StringMap<cl::Option *> &map = cl::getRegisteredOptions();
+  for (auto &elem : map) {
+      if (elem.second->Category == &llvm::cl::GeneralCategory) {
+          elem.second->setHiddenFlag(cl::Hidden);
+      }
+  }
+  cl::ParseCommandLineOptions(argc, argv);
+
+  if (Batch)
+    return concretizeBatch();
+
+  std::shared_ptr<Template> templ = loadTemplate(InputTemplateFile);
+  assert(templ && "Cannot open input template file");
+  std::ofstream outFile(OutputFile);
+  assert(outFile.good() && "Cannot open output file");
+
+  std::shared_ptr<KTest> ktest = loadKTest(InputKTestFile);
+  if (!ktest) {
+    llvm::errs() << "Invalid KTest file at " << InputKTestFile << "\n";
+    abort();
+  }
 
+  std::string error;
+  if (!concretize(ktest.get(), *templ, outFile, error)) {
+    llvm::errs() << error << "\n";
+    return 1;
+  }
+  outFile.close();
 
+  return 0;
+}
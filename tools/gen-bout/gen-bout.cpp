@@ -16,6 +16,14 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include "klee/Internal/ADT/KTest.h"
 
 #if defined(__FreeBSD__) || defined(__minix)
@@ -56,33 +64,39 @@ void print_usage_and_exit(char *program_name) {
     "       --sym-stdin <filename>      - Specifying a file that is the content of stdin (only once).\n"
     "       --sym-stdout <filename>     - Specifying a file that is the content of stdout (only once).\n"
     "       --sym-file <filename>       - Specifying a file that is the content of a file named A provided for the program (only once).\n"
-    "   Ex: %s -o -p -q file1 --sym-stdin file2 --sym-file file3 --sym-stdout file4\n",
-    program_name, program_name, program_name);
+    "   Ex: %s -o -p -q file1 --sym-stdin file2 --sym-file file3 --sym-stdout file4\n"
+    "\n"
+    "Usage: %s --batch <list-file> [--jobs <n>] [--stream]\n"
+    "       Generate a ktest file for each line of <list-file>, which holds the <arguments> above,\n"
+    "       separated by white space, including a --bout-file.\n"
+    "       --jobs <n>                  - Generating n ktest files in parallel (default: 1).\n"
+    "       --stream                    - Writing the ktest files to stdout one after the other instead,\n"
+    "                                     e.g. into klee -seed-stream=-.\n",
+    program_name, program_name, program_name, program_name);
   exit(1);
 }
 
-int main(int argc, char *argv[]) {
+/* Build the KTest of the arguments argv[1..argc-1] into b, and set
+   bout_file to the --bout-file among them or NULL. */
+static void build_ktest(KTest *b, int argc, char *argv[], char **bout_file) {
   unsigned i, argv_copy_idx;
   unsigned file_counter = 0;
+  int total_args = 0;
   char *stdout_content_filename = NULL;
   char *stdin_content_filename = NULL;
   char *content_filenames_list[1024];
   char **argv_copy;
-  char *bout_file = NULL;
 
-  if (argc < 2)
-    print_usage_and_exit(argv[0]);
+  *bout_file = NULL;
+  b->symArgvs = 0;
+  b->symArgvLen = 0;
 
-  KTest b;
-  b.symArgvs = 0;
-  b.symArgvLen = 0;
-
-  b.numObjects = 0;
-  b.objects = (KTestObject *)malloc(MAX * sizeof *b.objects);
+  b->numObjects = 0;
+  b->objects = (KTestObject *)malloc(MAX * sizeof *b->objects);
 
   if ((argv_copy = (char **)malloc(sizeof(char *) * argc * 2)) == NULL) {
     fprintf(stderr, "Could not allocate more memory\n");
-    return 1;
+    exit(1);
   }
 
   argv_copy[0] = (char *)malloc(strlen(argv[0]) + 1);
@@ -120,14 +134,13 @@ int main(int argc, char *argv[]) {
       if (++i == (unsigned)argc)
         print_usage_and_exit(argv[0]);
 
-      bout_file = argv[i];
+      *bout_file = argv[i];
     } else {
       long nbytes = strlen(argv[i]) + 1;
-      static int total_args = 0;
 
       char arg[1024];
       snprintf(arg, sizeof(arg), "arg%02d", total_args++);
-      push_obj(&b, (const char *)arg, nbytes, (unsigned char *)argv[i]);
+      push_obj(b, (const char *)arg, nbytes, (unsigned char *)argv[i]);
 
       char *buf1 = (char *)malloc(1024);
       char *buf2 = (char *)malloc(1024);
@@ -166,8 +179,8 @@ int main(int argc, char *argv[]) {
       fptr++;
     }
 
-    push_obj(&b, filename, nbytes, file_content);
-    push_obj(&b, statname, sizeof(struct stat64), (unsigned char *)&file_stat);
+    push_obj(b, filename, nbytes, file_content);
+    push_obj(b, statname, sizeof(struct stat64), (unsigned char *)&file_stat);
 
     free(file_content);
 
@@ -207,8 +220,8 @@ int main(int argc, char *argv[]) {
       fptr++;
     }
 
-    push_obj(&b, filename, file_stat.st_size, file_content);
-    push_obj(&b, statname, sizeof(struct stat64), (unsigned char *)&file_stat);
+    push_obj(b, filename, file_stat.st_size, file_content);
+    push_obj(b, statname, sizeof(struct stat64), (unsigned char *)&file_stat);
 
     free(file_content);
 
@@ -245,8 +258,8 @@ int main(int argc, char *argv[]) {
 
     file_stat.st_size = 1024;
 
-    push_obj(&b, filename, 1024, file_content);
-    push_obj(&b, statname, sizeof(struct stat64), (unsigned char *)&file_stat);
+    push_obj(b, filename, 1024, file_content);
+    push_obj(b, statname, sizeof(struct stat64), (unsigned char *)&file_stat);
 
     char *buf = (char *)malloc(1024);
     snprintf(buf, 1024, "-sym-stdout");
@@ -255,24 +268,127 @@ int main(int argc, char *argv[]) {
 
   argv_copy[argv_copy_idx] = 0;
 
-  b.numArgs = argv_copy_idx;
-  b.args = argv_copy;
+  b->numArgs = argv_copy_idx;
+  b->args = argv_copy;
 
-  push_range(&b, "model_version", 1);
+  push_range(b, "model_version", 1);
+}
 
-  if (!kTest_toFile(&b, bout_file ? bout_file : "file.bout"))
-    assert(0);
+static void free_ktest(KTest *b) {
+  for (int i = 0; i < (int)b->numObjects; ++i) {
+    free(b->objects[i].name);
+    free(b->objects[i].bytes);
+  }
+  free(b->objects);
 
-  for (int i = 0; i < (int)b.numObjects; ++i) {
-    free(b.objects[i].name);
-    free(b.objects[i].bytes);
+  for (int i = 0; i < (int)b->numArgs; ++i) {
+    free(b->args[i]);
   }
-  free(b.objects);
+  free(b->args);
+}
 
-  for (int i = 0; i < (int)argv_copy_idx; ++i) {
-    free(argv_copy[i]);
+/* Generate the KTest of each line of list_file on jobs threads, see the
+   usage. */
+static int run_batch(char *program_name, const char *list_file, unsigned jobs,
+                     bool stream) {
+  std::ifstream list(list_file);
+  if (!list.good()) {
+    fprintf(stderr, "Failure opening %s\n", list_file);
+    print_usage_and_exit(program_name);
   }
-  free(argv_copy);
+  std::vector<std::vector<std::string>> lines;
+  for (std::string line; std::getline(list, line);) {
+    std::istringstream words(line);
+    std::vector<std::string> args(1, program_name);
+    for (std::string word; words >> word;)
+      args.push_back(word);
+    if (args.size() > 1)
+      lines.push_back(args);
+  }
+
+  std::mutex stream_mutex;
+  std::atomic<unsigned> next(0);
+  std::atomic<bool> failed(false);
+  auto work = [&] {
+    for (unsigned index; (index = next++) < lines.size();) {
+      std::vector<char *> argv;
+      for (std::string &arg : lines[index])
+        argv.push_back(&arg[0]);
+      argv.push_back(NULL);
+
+      KTest b;
+      char *bout_file;
+      build_ktest(&b, argv.size() - 1, argv.data(), &bout_file);
+      bool ok;
+      if (stream) {
+        std::lock_guard<std::mutex> lock(stream_mutex);
+        ok = kTest_toStream(&b, stdout);
+      } else if (!bout_file) {
+        fprintf(stderr, "Line %u of %s has no --bout-file\n", index + 1,
+                list_file);
+        ok = false;
+      } else {
+        FILE *f = fopen(bout_file, "wb");
+        // most ktest files fit the buffer and are written at once
+        ok = f && !setvbuf(f, NULL, _IOFBF, 1 << 16) && kTest_toStream(&b, f);
+        if (f && fclose(f))
+          ok = false;
+        if (!ok)
+          fprintf(stderr, "Failure writing %s\n", bout_file);
+      }
+      if (!ok)
+        failed = true;
+      free_ktest(&b);
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (unsigned i = 0; i < (jobs ? jobs : 1); ++i)
+    workers.emplace_back(work);
+  for (std::thread &t : workers)
+    t.join();
+
+  if (stream && fflush(stdout))
+    failed = true;
+  return failed ? 1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+  char *bout_file;
+
+  if (argc < 2)
+    print_usage_and_exit(argv[0]);
+
+  if (strcmp(argv[1], "--batch") == 0 || strcmp(argv[1], "-batch") == 0) {
+    const char *list_file = NULL;
+    unsigned jobs = 1;
+    bool stream = false;
+    for (int i = 2; i < argc; ++i) {
+      if (strcmp(argv[i], "--jobs") == 0 || strcmp(argv[i], "-jobs") == 0) {
+        if (++i == argc)
+          print_usage_and_exit(argv[0]);
+        jobs = atoi(argv[i]);
+      } else if (strcmp(argv[i], "--stream") == 0 ||
+                 strcmp(argv[i], "-stream") == 0) {
+        stream = true;
+      } else if (!list_file) {
+        list_file = argv[i];
+      } else {
+        print_usage_and_exit(argv[0]);
+      }
+    }
+    if (!list_file)
+      print_usage_and_exit(argv[0]);
+    return run_batch(argv[0], list_file, jobs, stream);
+  }
+
+  KTest b;
+  build_ktest(&b, argc, argv, &bout_file);
+
+  if (!kTest_toFile(&b, bout_file ? bout_file : "file.bout"))
+    assert(0);
+
+  free_ktest(&b);
 
   return 0;
 }
@@ -8,6 +8,7 @@
 //===----------------------------------------------------------------------===//
 
 #include <assert.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
 #include <stdarg.h>
@@ -19,6 +20,14 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
 #include "klee/Internal/ADT/KTest.h"
 
 #if defined(__FreeBSD__) || defined(__minix)
@@ -53,9 +62,23 @@ static unsigned get_unsigned(char *i) {
   return (unsigned)n;
 }
 
+/* The random numbers of a KTest. A single KTest uses random(), so that a
+   seed keeps giving the KTest it gave before. In a batch, each KTest has a
+   generator of its own seeded from its index, so that KTests can be built in
+   parallel and a seed always gives the same random bytes. */
+struct Random {
+  bool batch;
+  std::mt19937 engine;
+
+  explicit Random(unsigned seed) : batch(true), engine(seed) {}
+  Random() : batch(false) {}
+
+  long next() { return batch ? (long)(engine() & 0x7fffffff) : random(); }
+};
+
 #define MAX 64
-static void push_random_obj(KTest *b, const char *name, unsigned non_zero_bytes,
-                            unsigned total_bytes) {
+static void push_random_obj(KTest *b, Random &rnd, const char *name,
+                            unsigned non_zero_bytes, unsigned total_bytes) {
   KTestObject *o = &b->objects[b->numObjects++];
   assert(b->numObjects < MAX);
 
@@ -69,7 +92,7 @@ static void push_random_obj(KTest *b, const char *name, unsigned non_zero_bytes,
 
   unsigned i;
   for (i = 0; i < non_zero_bytes; i++) {
-    o->bytes[i] = random() % 255 + 1;
+    o->bytes[i] = rnd.next() % 255 + 1;
   }
 
   for (i = non_zero_bytes; i < total_bytes; i++)
@@ -95,7 +118,7 @@ static void push_range(KTest *b, const char *name, unsigned value) {
   push_obj(b, name, 4, (unsigned char *)&value);
 }
 
-void create_stat(size_t size, struct stat64 *s) {
+static void create_stat(size_t size, struct stat64 *s) {
   char filename_template[] = "/tmp/klee-gen-random-bout-XXXXXX";
   char *filename;
   int fd;
@@ -130,59 +153,56 @@ void create_stat(size_t size, struct stat64 *s) {
   free(buf);
 }
 
-int main(int argc, char *argv[]) {
+/* The KTests of a batch share the stat of each file size, instead of each
+   creating a file of its own. */
+static bool share_stats = false;
+static std::mutex stat_mutex;
+static std::map<size_t, struct stat64> stats;
+
+static void get_stat(size_t size, struct stat64 *s) {
+  if (!share_stats) {
+    create_stat(size, s);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(stat_mutex);
+  auto it = stats.find(size);
+  if (it == stats.end()) {
+    create_stat(size, s);
+    stats[size] = *s;
+  } else {
+    *s = it->second;
+  }
+}
+
+/* Build the KTest of the <argument-types> in argv[1..argc-1] into b. The
+   options are checked before any KTest of a batch is built in parallel, so
+   that errors in them exit from the main thread. */
+static void build_ktest(KTest *b, int argc, char **argv, Random &rnd) {
   unsigned i, narg;
   unsigned sym_stdout = 0;
   unsigned stdin_size = 0;
   int total_args = 0;
   unsigned total_files = 0;
   unsigned file_sizes[MAX_FILE_SIZES];
-  char **argv_copy;
-  char *bout_file = NULL;
-
-  if (argc < 2) {
-    error_exit(
-        "Usage: %s <random-seed> <argument-types>\n"
-        "       If <random-seed> is 0, time(NULL)*getpid() is used as a seed\n"
-        "       <argument-types> are the ones accepted by KLEE: --sym-args, "
-        "--sym-files etc. and --bout-file <filename> for the output file (default: random.bout).\n"
-        "   Ex: %s 100 --sym-args 0 2 2 --sym-files 1 8\n",
-        argv[0], argv[0]);
-  }
 
-  unsigned seed = atoi(argv[1]);
-  if (seed)
-    srandom(seed);
-  else
-    srandom(time(NULL) * getpid());
-
-  if ((argv_copy = (char **) malloc((argc - 1) * sizeof(char *))) == NULL) {
-    error_exit("%s:%d: malloc() failure\n", __FILE__, __LINE__);
-  }
-  argv_copy[0] = argv[0];
-  for (i = 2; i < (unsigned)argc; ++i) {
-    argv_copy[i - 1] = argv[i];
-  }
-
-  KTest b;
-  b.numArgs = argc - 1;
-  b.args = argv_copy;
-  b.symArgvs = 0;
-  b.symArgvLen = 0;
+  b->numArgs = argc;
+  b->args = argv;
+  b->symArgvs = 0;
+  b->symArgvLen = 0;
 
-  b.numObjects = 0;
-  b.objects = (KTestObject *)malloc(MAX * sizeof *b.objects);
+  b->numObjects = 0;
+  b->objects = (KTestObject *)malloc(MAX * sizeof *b->objects);
 
-  for (i = 2; i < (unsigned)argc; i++) {
+  for (i = 1; i < (unsigned)argc; i++) {
     if (strcmp(argv[i], "--sym-arg") == 0 || strcmp(argv[i], "-sym-arg") == 0) {
       unsigned nbytes = get_unsigned(argv[++i]);
 
       // A little different than how klee does it but more natural for random.
       char arg[SMALL_BUFFER_SIZE];
-      unsigned x = random() % (nbytes + 1);
+      unsigned x = rnd.next() % (nbytes + 1);
 
       snprintf(arg, SMALL_BUFFER_SIZE, "arg%d", total_args++);
-      push_random_obj(&b, arg, x, nbytes + 1);
+      push_random_obj(b, rnd, arg, x, nbytes + 1);
     } else if (strcmp(argv[i], "--sym-args") == 0 ||
                strcmp(argv[i], "-sym-args") == 0) {
       unsigned lb = get_unsigned(argv[++i]);
@@ -194,18 +214,18 @@ int main(int argc, char *argv[]) {
                    "second argument\n");
       }
 
-      narg = random() % (ub - lb + 1) + lb;
-      push_range(&b, "n_args", narg);
+      narg = rnd.next() % (ub - lb + 1) + lb;
+      push_range(b, "n_args", narg);
 
       while (narg-- > 0) {
-        unsigned x = random() % (nbytes + 1);
+        unsigned x = rnd.next() % (nbytes + 1);
 
         // A little different than how klee does it but more natural
         // for random.
         char arg[SMALL_BUFFER_SIZE];
 
         snprintf(arg, SMALL_BUFFER_SIZE, "arg%d", total_args++);
-        push_random_obj(&b, arg, x, nbytes + 1);
+        push_random_obj(b, rnd, arg, x, nbytes + 1);
       }
     } else if (strcmp(argv[i], "--sym-stdout") == 0 ||
                strcmp(argv[i], "-sym-stdout") == 0) {
@@ -231,8 +251,6 @@ int main(int argc, char *argv[]) {
                strcmp(argv[i], "-bout-file") == 0) {
       if ((unsigned)argc == ++i)
         error_exit("Missing file name for --bout-file");
-
-      bout_file = argv[i];
     } else {
       error_exit("Unexpected option <%s>\n", argv[i]);
     }
@@ -254,44 +272,177 @@ int main(int argc, char *argv[]) {
     filename[0] += i;
     file_stat[0] += i;
 
-    create_stat(nbytes, &s);
+    get_stat(nbytes, &s);
 
-    push_random_obj(&b, filename, nbytes, nbytes);
-    push_obj(&b, file_stat, sizeof(struct stat64), (unsigned char *)&s);
+    push_random_obj(b, rnd, filename, nbytes, nbytes);
+    push_obj(b, file_stat, sizeof(struct stat64), (unsigned char *)&s);
   }
 
   if (stdin_size) {
     struct stat64 s;
 
     // Using disk file works well with klee-replay.
-    create_stat(stdin_size, &s);
+    get_stat(stdin_size, &s);
 
-    push_random_obj(&b, "stdin", stdin_size, stdin_size);
-    push_obj(&b, "stdin-stat", sizeof(struct stat64), (unsigned char *)&s);
+    push_random_obj(b, rnd, "stdin", stdin_size, stdin_size);
+    push_obj(b, "stdin-stat", sizeof(struct stat64), (unsigned char *)&s);
   }
   if (sym_stdout) {
     struct stat64 s;
 
     // Using disk file works well with klee-replay.
-    create_stat(1024, &s);
+    get_stat(1024, &s);
 
-    push_random_obj(&b, "stdout", 1024, 1024);
-    push_obj(&b, "stdout-stat", sizeof(struct stat64), (unsigned char *)&s);
+    push_random_obj(b, rnd, "stdout", 1024, 1024);
+    push_obj(b, "stdout-stat", sizeof(struct stat64), (unsigned char *)&s);
   }
-  push_range(&b, "model_version", 1);
+  push_range(b, "model_version", 1);
+}
 
-  if (!kTest_toFile(&b, bout_file ? bout_file : "random.bout")) {
-    error_exit("Error in storing data into random.bout\n");
+static void free_ktest(KTest *b) {
+  unsigned i;
+  for (i = 0; i < b->numObjects; ++i) {
+    free(b->objects[i].name);
+    free(b->objects[i].bytes);
   }
 
-  for (i = 0; i < b.numObjects; ++i) {
-    free(b.objects[i].name);
-    free(b.objects[i].bytes);
+  free(b->objects);
+}
+
+/* The options of a batch, see the usage */
+static unsigned batch_count = 0;
+static unsigned batch_jobs = 1;
+static const char *batch_dir = NULL;
+static bool batch_stream = false;
+
+static std::mutex stream_mutex;
+
+/* Write the KTest of a batch to batch_dir or to the stream on stdout. */
+static void write_batch_ktest(KTest *b, unsigned index) {
+  if (batch_stream) {
+    std::lock_guard<std::mutex> lock(stream_mutex);
+    if (!kTest_toStream(b, stdout))
+      error_exit("Error in writing KTest %u to stdout\n", index);
+    return;
   }
 
-  free(b.objects);
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/random%06u.ktest", batch_dir, index);
+  FILE *f = fopen(path, "wb");
+  // most KTests fit the buffer and are written at once
+  if (!f || setvbuf(f, NULL, _IOFBF, 1 << 16) || !kTest_toStream(b, f) ||
+      fclose(f))
+    error_exit("Error in storing data into %s\n", path);
+}
+
+static void build_batch_ktest(unsigned seed, unsigned index, int argc,
+                              char **argv) {
+  KTest b;
+  Random rnd(seed + index);
+  build_ktest(&b, argc, argv, rnd);
+  write_batch_ktest(&b, index);
+  free_ktest(&b);
+}
+
+int main(int argc, char *argv[]) {
+  unsigned i;
+  int argc_copy;
+  char **argv_copy;
+
+  if (argc < 2) {
+    error_exit(
+        "Usage: %s <random-seed> <argument-types> [<batch-options>]\n"
+        "       If <random-seed> is 0, time(NULL)*getpid() is used as a seed\n"
+        "       <argument-types> are the ones accepted by KLEE: --sym-args, "
+        "--sym-files etc. and --bout-file <filename> for the output file (default: random.bout).\n"
+        "       <batch-options> generate many KTests in one run:\n"
+        "         --count <n>        generate n KTests, seeded from <random-seed> and their index\n"
+        "         --output-dir <dir> write them to <dir>/random<index>.ktest\n"
+        "         --stream           write them to stdout one after the other instead, e.g.\n"
+        "                            into klee -seed-stream=-\n"
+        "         --jobs <n>         build n KTests in parallel (default: 1)\n"
+        "   Ex: %s 100 --sym-args 0 2 2 --sym-files 1 8\n"
+        "       %s 100 --sym-args 0 2 2 --count 10000 --jobs 8 --output-dir seeds\n",
+        argv[0], argv[0], argv[0]);
+  }
+
+  unsigned seed = atoi(argv[1]);
+  if (!seed)
+    seed = time(NULL) * getpid();
+
+  // the batch options are not arguments of the KTests
+  if ((argv_copy = (char **) malloc(argc * sizeof(char *))) == NULL) {
+    error_exit("%s:%d: malloc() failure\n", __FILE__, __LINE__);
+  }
+  argv_copy[0] = argv[0];
+  argc_copy = 1;
+  for (i = 2; i < (unsigned)argc; ++i) {
+    if (strcmp(argv[i], "--count") == 0 || strcmp(argv[i], "-count") == 0) {
+      batch_count = get_unsigned(argv[++i]);
+    } else if (strcmp(argv[i], "--jobs") == 0 ||
+               strcmp(argv[i], "-jobs") == 0) {
+      batch_jobs = get_unsigned(argv[++i]);
+    } else if (strcmp(argv[i], "--output-dir") == 0 ||
+               strcmp(argv[i], "-output-dir") == 0) {
+      if ((unsigned)argc == ++i)
+        error_exit("Missing directory name for --output-dir");
+      batch_dir = argv[i];
+    } else if (strcmp(argv[i], "--stream") == 0 ||
+               strcmp(argv[i], "-stream") == 0) {
+      batch_stream = true;
+    } else {
+      argv_copy[argc_copy++] = argv[i];
+    }
+  }
+  argv_copy[argc_copy] = NULL;
+
+  if (!batch_count) {
+    if (batch_dir || batch_stream)
+      error_exit("--output-dir and --stream require --count\n");
+
+    char *bout_file = NULL;
+    for (i = 1; i + 1 < (unsigned)argc_copy; ++i)
+      if (strcmp(argv_copy[i], "--bout-file") == 0 ||
+          strcmp(argv_copy[i], "-bout-file") == 0)
+        bout_file = argv_copy[i + 1];
+
+    srandom(seed);
+    KTest b;
+    Random rnd;
+    build_ktest(&b, argc_copy, argv_copy, rnd);
+
+    if (!kTest_toFile(&b, bout_file ? bout_file : "random.bout")) {
+      error_exit("Error in storing data into random.bout\n");
+    }
+
+    free_ktest(&b);
+    free(argv_copy);
+    return 0;
+  }
+
+  if (!batch_dir == !batch_stream)
+    error_exit("--count requires one of --output-dir and --stream\n");
+  if (batch_dir && mkdir(batch_dir, 0775) < 0 && errno != EEXIST)
+    error_exit("Cannot create directory %s: %s\n", batch_dir, strerror(errno));
+  share_stats = true;
+
+  // an error in the options exits before the other KTests are started
+  build_batch_ktest(seed, 0, argc_copy, argv_copy);
+
+  std::atomic<unsigned> next(1);
+  std::vector<std::thread> workers;
+  for (i = 0; i < std::max(batch_jobs, 1u); ++i) {
+    workers.emplace_back([&] {
+      for (unsigned index; (index = next++) < batch_count;)
+        build_batch_ktest(seed, index, argc_copy, argv_copy);
+    });
+  }
+  for (std::thread &t : workers)
+    t.join();
+
+  if (batch_stream && fflush(stdout))
+    error_exit("Error in writing to stdout\n");
 
   free(argv_copy);
   return 0;
 }
-
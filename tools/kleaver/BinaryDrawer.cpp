@@ -0,0 +1,228 @@
+#include "BinaryDrawer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <thread>
+
+namespace {
+/// Run f(begin, end, thread) on jobs slices of [0, n).
+template <class F> void parallelFor(unsigned jobs, size_t n, F f) {
+  if (jobs <= 1 || n < 2 * jobs) {
+    f(0, n, 0);
+    return;
+  }
+  std::vector<std::thread> threads;
+  size_t slice = (n + jobs - 1) / jobs;
+  for (unsigned t = 0; t < jobs; ++t) {
+    size_t begin = std::min(n, t * slice), end = std::min(n, begin + slice);
+    threads.emplace_back(f, begin, end, t);
+  }
+  for (std::thread &t : threads)
+    t.join();
+}
+
+template <class T> void writeColumn(std::ostream &os, const std::vector<T> &v) {
+  os.write(reinterpret_cast<const char *>(v.data()), v.size() * sizeof(T));
+}
+
+void writeWord(std::ostream &os, uint64_t w) {
+  os.write(reinterpret_cast<const char *>(&w), sizeof(w));
+}
+} // namespace
+
+uint32_t BinaryDrawer::intern(const std::string &s) {
+  auto it = stringIndex.insert(std::make_pair(s, (uint32_t)strings.size()));
+  if (it.second) {
+    strings += s;
+    strings += '\0';
+  }
+  return it.first->second;
+}
+
+uint32_t BinaryDrawer::getNode(const void *p) {
+  auto it = nodeIndex.find(p);
+  assert(it != nodeIndex.end() && "edge to an undeclared node");
+  return it->second;
+}
+
+void BinaryDrawer::addNode(const void *p, int32_t _kind, uint32_t _width,
+                           const char *_category, bool _isPointer,
+                           uint32_t _freq, const std::string &_label,
+                           const std::string &_kinst,
+                           const std::string &_root) {
+  nodeIndex.insert(std::make_pair(p, (uint32_t)kind.size()));
+  kind.push_back(_kind);
+  width.push_back(_width);
+  category.push_back(_category[0]);
+  isPointer.push_back(_isPointer);
+  freq.push_back(_freq);
+  label.push_back(intern(_label));
+  kinst.push_back(intern(_kinst));
+  root.push_back(intern(_root));
+}
+
+void BinaryDrawer::declareExpr(const Expr *e, const char *category) {
+  std::string label;
+  if (const ConstantExpr *CE = dyn_cast<ConstantExpr>(e)) {
+    label = std::to_string(CE->getZExtValue());
+  } else {
+    label = e->getKindStr();
+  }
+  std::string root;
+  if (const ReadExpr *RE = dyn_cast<ReadExpr>(e))
+    root = getArrWithSize(RE->updates.root);
+  addNode(e, e->getKind(), e->getWidth(), category,
+          e->getKInstIsPtrType() == "true", e->getKInstLoadedFreq(), label,
+          e->getKInstUniqueID(), root);
+}
+
+void BinaryDrawer::declareLastLevelRead(const ReadExpr *RE,
+                                        const char *category) {
+  const ConstantExpr *CE = dyn_cast<ConstantExpr>(RE->index);
+  std::string label =
+      RE->updates.root->name + "[" + std::to_string(CE->getZExtValue()) + "]";
+  sources.push_back(kind.size());
+  addNode(RE, RE->getKind(), RE->getWidth(), category,
+          RE->getKInstIsPtrType() == "true", RE->getKInstLoadedFreq(), label,
+          RE->getKInstUniqueID(), getArrWithSize(RE->updates.root));
+}
+
+void BinaryDrawer::declareUpdateNode(const UpdateNode *un, const Array *root,
+                                     const char *category) {
+  addNode(un, -1, 8, category, false, un->getKInstLoadedFreq(), "UN",
+          un->getKInstUniqueID(), getArrWithSize(root));
+}
+
+void BinaryDrawer::declareArray(const Array *arr) {
+  sources.push_back(kind.size());
+  addNode(arr, -2, 0, "A", false, 0, arr->name, "", getArrWithSize(arr));
+}
+
+void BinaryDrawer::drawEdge(const void *from, const void *to, double weight) {
+  // Drawer weighs the edges to an index 1.5 and all others 1.0
+  edgeList.push_back({getNode(from), getNode(to), weight > 1.0});
+}
+
+void BinaryDrawer::draw() {
+  Drawer::draw();
+  if (jobs == 0)
+    jobs = std::max(1u, std::thread::hardware_concurrency());
+  const size_t n = kind.size(), m = edgeList.size();
+
+  // CSR of the out-edges and of the in-edges
+  std::vector<uint64_t> offsets(n + 1, 0), inOffsets(n + 1, 0);
+  for (const Edge &e : edgeList) {
+    ++offsets[e.from + 1];
+    ++inOffsets[e.to + 1];
+  }
+  for (size_t i = 0; i < n; ++i) {
+    offsets[i + 1] += offsets[i];
+    inOffsets[i + 1] += inOffsets[i];
+  }
+  std::vector<uint32_t> targets(m), sourcesOf(m);
+  std::vector<uint8_t> isIndex(m);
+  {
+    std::vector<uint64_t> out(offsets.begin(), offsets.end() - 1);
+    std::vector<uint64_t> in(inOffsets.begin(), inOffsets.end() - 1);
+    for (const Edge &e : edgeList) {
+      uint64_t k = out[e.from]++;
+      targets[k] = e.to;
+      isIndex[k] = e.isIndex;
+      sourcesOf[in[e.to]++] = e.from;
+    }
+  }
+  std::vector<Edge>().swap(edgeList);
+
+  std::vector<uint32_t> fanIn(n);
+  parallelFor(jobs, n, [&](size_t begin, size_t end, unsigned) {
+    for (size_t i = begin; i < end; ++i)
+      fanIn[i] = inOffsets[i + 1] - inOffsets[i];
+  });
+
+  // Indirect depth, the longest path from a top-level node where an edge
+  // to an index counts one (see IndirectReadDepthCalculator). Nodes are
+  // visited in waves, a node once all the nodes using it are done.
+  std::vector<std::atomic<int32_t>> depth(n);
+  std::vector<std::atomic<uint32_t>> pending(n);
+  std::vector<uint32_t> wave;
+  for (size_t i = 0; i < n; ++i) {
+    pending[i] = fanIn[i];
+    if (!fanIn[i])
+      wave.push_back(i);
+  }
+  std::vector<std::vector<uint32_t>> next(jobs);
+  while (!wave.empty()) {
+    parallelFor(jobs, wave.size(), [&](size_t begin, size_t end, unsigned t) {
+      for (size_t i = begin; i < end; ++i) {
+        uint32_t u = wave[i];
+        int32_t d = depth[u];
+        for (uint64_t k = offsets[u]; k < offsets[u + 1]; ++k) {
+          uint32_t v = targets[k];
+          int32_t dv = d + isIndex[k];
+          int32_t old = depth[v];
+          while (old < dv && !depth[v].compare_exchange_weak(old, dv))
+            ;
+          if (--pending[v] == 0)
+            next[t].push_back(v);
+        }
+      }
+    });
+    wave.clear();
+    for (std::vector<uint32_t> &w : next) {
+      wave.insert(wave.end(), w.begin(), w.end());
+      w.clear();
+    }
+  }
+
+  // Nodes depending on symbolic input, found backwards from the sources
+  std::vector<std::atomic<uint8_t>> symbolic(n);
+  for (uint32_t s : sources)
+    symbolic[s] = 1;
+  wave = sources;
+  while (!wave.empty()) {
+    parallelFor(jobs, wave.size(), [&](size_t begin, size_t end, unsigned t) {
+      for (size_t i = begin; i < end; ++i) {
+        uint32_t v = wave[i];
+        for (uint64_t k = inOffsets[v]; k < inOffsets[v + 1]; ++k) {
+          uint32_t u = sourcesOf[k];
+          if (!symbolic[u].exchange(1))
+            next[t].push_back(u);
+        }
+      }
+    });
+    wave.clear();
+    for (std::vector<uint32_t> &w : next) {
+      wave.insert(wave.end(), w.begin(), w.end());
+      w.clear();
+    }
+  }
+
+  std::vector<int32_t> idep(n);
+  std::vector<uint8_t> symbolicColumn(n);
+  for (size_t i = 0; i < n; ++i) {
+    idep[i] = depth[i];
+    symbolicColumn[i] = symbolic[i];
+  }
+
+  os.write("KGRAPH01", 8);
+  writeWord(os, n);
+  writeWord(os, m);
+  writeWord(os, strings.size());
+  writeColumn(os, offsets);
+  writeColumn(os, targets);
+  writeColumn(os, isIndex);
+  writeColumn(os, kind);
+  writeColumn(os, width);
+  writeColumn(os, category);
+  writeColumn(os, isPointer);
+  writeColumn(os, freq);
+  writeColumn(os, label);
+  writeColumn(os, kinst);
+  writeColumn(os, root);
+  writeColumn(os, idep);
+  writeColumn(os, fanIn);
+  writeColumn(os, symbolicColumn);
+  os.write(strings.data(), strings.size());
+  os.flush();
+}
@@ -0,0 +1,86 @@
+#ifndef KLEAVER_BINARYDRAWER_H
+#define KLEAVER_BINARYDRAWER_H
+#include "Drawer.h"
+
+#include <cstdint>
+#include <unordered_map>
+using namespace klee;
+
+/// Draws the graph into a compact binary file: a CSR adjacency list and one
+/// column per node attribute. Besides the attributes the other drawers
+/// print, it stores metrics computed on the graph on several threads: the
+/// indirect depth, the fan-in, and whether a node depends on a last-level
+/// read or a symbolic array.
+///
+/// Layout, in host byte order:
+///   char magic[8]             "KGRAPH01"
+///   uint64 nodes, edges, stringBytes
+///   uint64 offsets[nodes + 1] out-edges of node i are [offsets[i],
+///                             offsets[i + 1])
+///   uint32 targets[edges]
+///   uint8 isIndex[edges]      1 for an edge to a read or update index
+///   int32 kind[nodes]         Expr::Kind, -1 for UN, -2 for Array
+///   uint32 width[nodes]
+///   uint8 category[nodes]     'C', 'Q', 'N', or 'A' for Array
+///   uint8 isPointer[nodes]
+///   uint32 freq[nodes]
+///   uint32 label[nodes], kinst[nodes], root[nodes]
+///                             offsets into the string table
+///   int32 idep[nodes]
+///   uint32 fanIn[nodes]
+///   uint8 symbolic[nodes]
+///   char strings[stringBytes] NUL terminated, "" at offset 0
+class BinaryDrawer : public Drawer {
+protected:
+  std::ostream &os;
+  unsigned jobs;
+
+  std::unordered_map<const void *, uint32_t> nodeIndex;
+  std::vector<int32_t> kind;
+  std::vector<uint32_t> width;
+  std::vector<uint8_t> category;
+  std::vector<uint8_t> isPointer;
+  std::vector<uint32_t> freq;
+  std::vector<uint32_t> label, kinst, root;
+  /// last-level reads and arrays, where symbolic values come from
+  std::vector<uint32_t> sources;
+
+  struct Edge {
+    uint32_t from, to;
+    bool isIndex;
+  };
+  std::vector<Edge> edgeList;
+
+  std::unordered_map<std::string, uint32_t> stringIndex;
+  std::string strings;
+
+  uint32_t intern(const std::string &s);
+  uint32_t getNode(const void *p);
+  void addNode(const void *p, int32_t kind, uint32_t width,
+               const char *category, bool isPointer, uint32_t freq,
+               const std::string &label, const std::string &kinst,
+               const std::string &root);
+
+  virtual void declareExpr(const Expr *e, const char *category) override;
+  virtual void declareLastLevelRead(const ReadExpr *RE,
+                                    const char *category) override;
+  virtual void declareUpdateNode(const UpdateNode *un, const Array *root,
+                                 const char *category = "N") override;
+  virtual void declareArray(const Array *arr) override;
+
+  virtual void drawEdge(const void *from, const void *to,
+                        double weight) override;
+
+public:
+  /// jobs is the number of threads computing the metrics, 0 for one per
+  /// core
+  BinaryDrawer(std::ostream &_os, const klee::expr::QueryCommand &QC,
+               unsigned _jobs)
+      : Drawer(QC), os(_os), jobs(_jobs) {
+    intern("");
+  }
+  // declareXXX only fill in the columns, the file is written at the end of
+  // BinaryDrawer::draw()
+  void draw();
+};
+#endif // KLEAVER_BINARYDRAWER_H
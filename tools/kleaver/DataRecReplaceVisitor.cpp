@@ -26,7 +26,7 @@ ExprVisitor::Action DataRecReplaceVisitor::visitExprPost(const Expr &e) {
     ref<Expr> e_ref = ref<Expr>(const_cast<Expr*>(&e));
     if (dataRecInstSet.count(e.getKInstUniqueID())) {
         // match kinst in datarec.cfg, should be substituted
-        ref<Expr> eval_val = oracle_eval.visit(e_ref);
+        ref<Expr> eval_val = oracle_eval.evaluate(e_ref);
         if (isa<ConstantExpr>(eval_val)) {
           new_constraints.insert(EqExpr::create(eval_val, e_ref));
           return Action::changeTo(eval_val);
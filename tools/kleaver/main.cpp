@@ -9,8 +9,11 @@
 
 #include "klee/Common.h"
 #include "klee/Config/Version.h"
+#include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/BinaryQueryLog.h"
 #include "klee/Expr/Constraints.h"
 #include "klee/Expr/Expr.h"
+#include "klee/Expr/ExprArena.h"
 #include "klee/Expr/ExprBuilder.h"
 #include "klee/Expr/ExprPPrinter.h"
 #include "klee/Expr/ExprSMTLIBPrinter.h"
@@ -20,27 +23,39 @@
 #include "klee/Expr/ExprDebugHelper.h"
 #include "klee/Internal/Support/PrintVersion.h"
 #include "klee/Internal/Support/ErrorHandling.h"
+#include "klee/Internal/Support/FileHandling.h"
+#include "klee/Internal/System/Time.h"
 #include "klee/OptionCategories.h"
 #include "klee/Solver/Solver.h"
 #include "klee/Solver/SolverCmdLine.h"
 #include "klee/Solver/SolverImpl.h"
 #include "klee/Statistics.h"
+#include "klee/util/BatchEvaluator.h"
 #include "klee/util/ExprConcretizer.h"
+#include "klee/util/RecordingSelector.h"
 
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
 #include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/raw_ostream.h"
 
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <unistd.h>
+#include <algorithm>
+#include <cerrno>
 #include <ctime>
 #include <cstdlib>
+#include <memory>
+#include <thread>
 
 
 #include "llvm/Support/Signals.h"
 
+#include "BinaryDrawer.h"
 #include "GraphvizDOTDrawer.h"
 #include "JsonDrawer.h"
 #include "ExprInPlaceTransformation.h"
@@ -92,10 +107,18 @@ llvm::cl::opt<std::string>
                                  "(only useful in datarec-replace mode)"),
                   llvm::cl::cat(klee::HASECat));
 
+llvm::cl::list<std::string> BatchKTests(
+    "batch-ktests", llvm::cl::CommaSeparated,
+    llvm::cl::desc("KTests, or directories of *.ktest files, KTestEval "
+                   "checks the constraints against all at once instead of "
+                   "-oracle-KTest"),
+    llvm::cl::cat(klee::HASECat));
+
 enum class DrawFormats {
   GraphVizDOT = 0x1 << 0,
   JSON = 0x1 << 1,
-  ALL = GraphVizDOT | JSON
+  Binary = 0x1 << 2,
+  ALL = GraphVizDOT | JSON | Binary
 };
 enableEnumClassBitmask(DrawFormats);
 static llvm::cl::opt<DrawFormats> DrawFormat(
@@ -105,11 +128,36 @@ static llvm::cl::opt<DrawFormats> DrawFormat(
         clEnumValN(DrawFormats::GraphVizDOT, "dot",
                    "Output to GraphVizDOT format, *.dot (default)"),
         clEnumValN(DrawFormats::JSON, "json", "Output to JSON format, *.json"),
+        clEnumValN(DrawFormats::Binary, "binary",
+                   "Output to a compact binary format with graph metrics, "
+                   "*.graph (see BinaryDrawer.h)"),
         clEnumValN(DrawFormats::ALL, "all", "Output to all possible formats")
             KLEE_LLVM_CL_VAL_END),
     llvm::cl::cat(klee::HASECat));
 
-enum ToolActions { PrintTokens, PrintAST, PrintSMTLIBv2, Evaluate, Analyze, Draw, KTestEval, DataRecReplace};
+static llvm::cl::opt<unsigned> DrawJobs(
+    "draw-jobs",
+    llvm::cl::desc("Threads computing the graph metrics of -binary drawings, "
+                   "0 for one per core (default=0)"),
+    llvm::cl::init(0), llvm::cl::cat(klee::HASECat));
+
+static llvm::cl::opt<unsigned> AnalyzeJobs(
+    "analyze-jobs",
+    llvm::cl::desc("Threads computing the indirect read depths of -analyze, "
+                   "0 for one per core (default=0)"),
+    llvm::cl::init(0), llvm::cl::cat(klee::HASECat));
+
+static llvm::cl::opt<unsigned> SelectRecording(
+    "select-recording",
+    llvm::cl::desc("With -analyze, also pick up to N instructions whose "
+                   "recorded values would simplify each query most per "
+                   "recorded byte, and write them to <input>.ptwrite-cfg for "
+                   "prepass --ptwrite-cfg. The instructions are those of "
+                   "the #!N annotations, so -bitcode has to be given "
+                   "(default=0, off)"),
+    llvm::cl::init(0), llvm::cl::cat(klee::HASECat));
+
+enum ToolActions { PrintTokens, PrintAST, PrintSMTLIBv2, Evaluate, Analyze, Draw, KTestEval, DataRecReplace, PrintQueryLog};
 
 static llvm::cl::opt<ToolActions> ToolAction(
     llvm::cl::desc("Tool actions:"), llvm::cl::init(Evaluate),
@@ -130,14 +178,18 @@ static llvm::cl::opt<ToolActions> ToolAction(
                    "constraints will be reported."),
         clEnumValN(
             DataRecReplace, "datarec-replace",
-            "Use oracle-ktest and datarec.cfg to simplify existing queries")
+            "Use oracle-ktest and datarec.cfg to simplify existing queries"),
+        clEnumValN(PrintQueryLog, "print-query-log",
+                   "Print a binary query log (*.kqlog) like the .kquery logs")
         KLEE_LLVM_CL_VAL_END),
     llvm::cl::cat(klee::SolvingCat));
 
 enum BuilderKinds {
   DefaultBuilder,
   ConstantFoldingBuilder,
-  SimplifyingBuilder
+  SimplifyingBuilder,
+  HashConsingBuilder,
+  AlgebraicBuilder
 };
 
 static llvm::cl::opt<BuilderKinds> BuilderKind(
@@ -148,10 +200,23 @@ static llvm::cl::opt<BuilderKinds> BuilderKind(
                      clEnumValN(ConstantFoldingBuilder, "constant-folding",
                                 "Fold constant expressions."),
                      clEnumValN(SimplifyingBuilder, "simplify",
-                                "Fold constants and simplify expressions.")
+                                "Fold constants and simplify expressions."),
+                     clEnumValN(HashConsingBuilder, "hash-consing",
+                                "Default expression construction, sharing "
+                                "structurally equal expressions."),
+                     clEnumValN(AlgebraicBuilder, "algebraic",
+                                "Simplify expressions and rewrite shifts, "
+                                "masks and disjoint bitwise operations into "
+                                "Concat and Extract.")
                          KLEE_LLVM_CL_VAL_END),
     llvm::cl::cat(klee::ExprCat));
 
+static llvm::cl::opt<bool> UseExprArena(
+    "expr-arena",
+    llvm::cl::desc("Allocate the expressions of an input file in a region "
+                   "that is freed at once after processing it (default=true)"),
+    llvm::cl::init(true), llvm::cl::cat(klee::ExprCat));
+
 llvm::cl::opt<std::string> DirectoryToWriteQueryLogs(
     "query-log-dir",
     llvm::cl::desc(
@@ -163,6 +228,43 @@ llvm::cl::opt<bool> ClearArrayAfterQuery(
     llvm::cl::desc("Discard the previous array declarations after a query "
                    "is performed (default=false)"),
     llvm::cl::init(false), llvm::cl::cat(klee::ExprCat));
+
+llvm::cl::opt<bool> StreamQueries(
+    "stream",
+    llvm::cl::desc("With -evaluate, parse and evaluate one query at a time, "
+                   "freeing each once evaluated, instead of parsing the "
+                   "whole input first (default=false)"),
+    llvm::cl::init(false), llvm::cl::cat(klee::ExprCat));
+
+llvm::cl::opt<unsigned> QueryJobs(
+    "query-jobs",
+    llvm::cl::desc("With -evaluate, evaluate the queries on this many worker "
+                   "processes, each with its own solver, 0 for one per core. "
+                   "Implies -stream. Solver statistics are not printed with "
+                   "more than one worker (default=1)"),
+    llvm::cl::init(1), llvm::cl::cat(klee::ExprCat));
+
+llvm::cl::alias QueryJobsAlias("j", llvm::cl::desc("Alias for -query-jobs"),
+                               llvm::cl::aliasopt(QueryJobs));
+
+llvm::cl::opt<std::string> QueryTimes(
+    "query-times",
+    llvm::cl::desc("With -evaluate, write the result and solver time of each "
+                   "query to this CSV file, in query order"),
+    llvm::cl::init(""), llvm::cl::cat(klee::ExprCat));
+
+llvm::cl::opt<std::string> QueryTimesLabel(
+    "query-times-label",
+    llvm::cl::desc("The config column of -query-times, to tell apart the "
+                   "solver configurations of concatenated files (default=\"\")"),
+    llvm::cl::init(""), llvm::cl::cat(klee::ExprCat));
+
+llvm::cl::opt<std::string> QueryStats(
+    "query-stats",
+    llvm::cl::desc("With -evaluate, write the value of each statistic, "
+                   "times in nanoseconds, to this CSV file at the end. Not "
+                   "available with more than one worker"),
+    llvm::cl::init(""), llvm::cl::cat(klee::ExprCat));
 } // namespace
 
 static std::string getQueryLogPath(const char filename[])
@@ -225,11 +327,15 @@ static void PrintInputTokens(const MemoryBuffer *MB) {
 }
 
 class InputAST {
+  // declared first, so that it outlives everything else
+  std::unique_ptr<ExprArena> Arena;
   Parser *P;
   std::vector<Decl*> Decls;
   bool valid;
   public:
   InputAST(const char *Filename, const MemoryBuffer *MB, ExprBuilder *Builder) {
+    if (UseExprArena)
+      Arena.reset(new ExprArena());
     P = Parser::Create(Filename, MB, Builder, ClearArrayAfterQuery, BitcodePath);
     P->SetMaxErrors(20);
     while (Decl *D = P->ParseTopLevelDecl()) {
@@ -267,53 +373,251 @@ static bool PrintInputAST(const char *Filename,
   return ast.isValid();
 }
 
+typedef std::set<std::pair<std::string, unsigned>> ConcretizedInputs;
+
+/// Pick AdditionalConcreteValuesRandomRatio percent of the bytes of a
+/// symbolic array to concretize.
+static void addRandomConcreteValues(const Array *root,
+                                    ConcretizedInputs &concretizedInputs,
+                                    bool print = true) {
+  if (!root->isSymbolicArray())
+    return;
+  unsigned ratio = AdditionalConcreteValuesRandomRatio;
+  for (unsigned i = 0; i < root->size; i++) {
+    unsigned r = rand() % 100;
+    if (r < ratio) {
+      concretizedInputs.insert({root->name, i});
+      if (print)
+        llvm::errs() << root->name << "[" << i << "]" << "\n";
+    }
+  }
+}
+
+static void readConcreteValuesConfig(ConcretizedInputs &concretizedInputs) {
+  std::string Filename = AdditionalConcreteValuesConfig;
+  if (Filename == "")
+    return;
+
+  std::ifstream ifs(Filename);
+  if (!ifs.is_open()) {
+    klee_error("cannot open %s", Filename.c_str());
+    exit(1);
+  }
+
+  while (ifs) {
+    std::string arr;
+    unsigned off;
+    ifs >> arr >> off;
+    if (ifs) {
+      std::pair<std::string, unsigned> k = {arr, off};
+      concretizedInputs.insert(k);
+    }
+  }
+
+  ifs.close();
+}
+
 static void getAdditionalConcreteValues(std::vector<Decl*> &Decls,
-        std::set<std::pair<std::string, unsigned>> &concretizedInputs) {
+                                        ConcretizedInputs &concretizedInputs) {
   if (AdditionalConcreteValuesRandom) {
-    unsigned ratio = AdditionalConcreteValuesRandomRatio;
-
     srand(std::time(NULL));
     for (auto it = Decls.begin(), ie = Decls.end(); it != ie; it++) {
-      Decl *D = *it;
-      if (ArrayDecl *AD = dyn_cast<ArrayDecl>(D)) {
-        const Array *root = AD->Root;
-        if (root->isSymbolicArray()) {
-          for (unsigned i = 0; i < root->size; i++) {
-            unsigned r = rand() % 100;
-            if (r < ratio) {
-              concretizedInputs.insert({root->name, i});
-              llvm::errs() << root->name << "[" << i << "]" << "\n";
-            }
-          }
-        }
+      if (ArrayDecl *AD = dyn_cast<ArrayDecl>(*it))
+        addRandomConcreteValues(AD->Root, concretizedInputs);
+    }
+  }
+  else {
+    readConcreteValuesConfig(concretizedInputs);
+  }
+}
+
+static Solver *createEvaluationSolver() {
+  Solver *coreSolver = klee::createCoreSolver(CoreSolverToUse);
+
+  if (CoreSolverToUse != DUMMY_SOLVER) {
+    const time::Span maxCoreSolverTime(MaxCoreSolverTime);
+    if (maxCoreSolverTime) {
+      coreSolver->setCoreSolverTimeout(maxCoreSolverTime);
+    }
+  }
+  return constructSolverChain(coreSolver,
+                              getQueryLogPath(ALL_QUERIES_SMT2_FILE_NAME),
+                              getQueryLogPath(SOLVER_QUERIES_SMT2_FILE_NAME),
+                              getQueryLogPath(ALL_QUERIES_KQUERY_FILE_NAME),
+                              getQueryLogPath(SOLVER_QUERIES_KQUERY_FILE_NAME),
+                              getQueryLogPath(ALL_QUERIES_KQLOG_FILE_NAME),
+                              getQueryLogPath(SOLVER_QUERIES_KQLOG_FILE_NAME));
+}
+
+/// Open the -query-times file and write its header.
+/// \return false if it cannot be opened
+static bool openQueryTimes(std::unique_ptr<llvm::raw_fd_ostream> &times) {
+  if (QueryTimes.empty())
+    return true;
+  std::string error;
+  times = klee_open_output_file(QueryTimes, error);
+  if (!times) {
+    llvm::errs() << "error: cannot open " << QueryTimes << ": " << error
+                 << "\n";
+    return false;
+  }
+  *times << "query,config,result,seconds\n";
+  return true;
+}
+
+/// Evaluate query number Index and print the result to os. If times is
+/// given, append the -query-times row of the query to it.
+static void EvaluateQuery(QueryCommand *QC, unsigned Index, Solver *S,
+                          const ConcretizedInputs &concretizedInputs,
+                          llvm::raw_ostream &os,
+                          std::string *times = nullptr) {
+  /* replace some inputs with concrete value */
+  Constraints_ty constraints;
+  if (!concretizedInputs.empty()) {
+    ExprConcretizer ec(OracleKTest);
+    for (auto ciit = concretizedInputs.begin(), ciie = concretizedInputs.end();
+                ciit != ciie; ciit++) {
+      ec.addConcretizedInputValue(ciit->first, ciit->second);
+    }
+    constraints = ec.evaluate(QC->Constraints);
+    IndirectReadDepthCalculator ic(constraints);
+    os << "Concretized Depth: " << ic.getMax() << "\n";
+
+    if (DumpConcretizedConstraints != "") {
+      std::string str;
+      llvm::raw_string_ostream dump(str);
+      std::ofstream ofs(DumpConcretizedConstraints);
+      if (ofs.good()) {
+        ExprPPrinter::printQuery(dump, constraints, ConstantExpr::alloc(false, Expr::Bool),
+                0, 0, 0, 0, true);
+        ofs << dump.str();
+        ofs.close();
       }
     }
   }
   else {
-    std::string Filename = AdditionalConcreteValuesConfig;
-    if (Filename == "")
-      return;
-
-    std::ifstream ifs(Filename);
-    if (!ifs.is_open()) {
-      klee_error("cannot open %s", Filename.c_str());
-      exit(1);
-    }
-
-    while (ifs) {
-      std::string arr;
-      unsigned off;
-      ifs >> arr >> off;
-      if (ifs) {
-        std::pair<std::string, unsigned> k = {arr, off};
-        concretizedInputs.insert(k);
+    constraints = QC->Constraints;
+  }
+
+  os << "Query " << Index << ":\t";
+
+  // the solver time only, not the concretization above
+  const char *status = "FAIL";
+  time::Point start = time::getWallTime();
+  assert("FIXME: Support counterexample query commands!");
+  if (QC->Values.empty() && QC->Objects.empty()) {
+    bool result;
+    if (S->mustBeTrue(Query(ConstraintManager(constraints), QC->Query),
+                      result)) {
+      status = result ? "VALID" : "INVALID";
+      os << status;
+    } else {
+      os << "FAIL (reason: "
+         << SolverImpl::getOperationStatusString(
+                S->impl->getOperationStatusCode())
+         << ")";
+    }
+  } else if (!QC->Values.empty()) {
+    assert(QC->Objects.empty() && 
+           "FIXME: Support counterexamples for values and objects!");
+    assert(QC->Values.size() == 1 &&
+           "FIXME: Support counterexamples for multiple values!");
+    assert(QC->Query->isFalse() &&
+           "FIXME: Support counterexamples with non-trivial query!");
+    ref<ConstantExpr> result;
+    if (S->getValue(Query(ConstraintManager(constraints), 
+                          QC->Values[0]),
+                    result)) {
+      status = "INVALID";
+      os << "INVALID\n";
+      os << "\tExpr 0:\t" << result;
+    } else {
+      os << "FAIL (reason: "
+         << SolverImpl::getOperationStatusString(
+                S->impl->getOperationStatusCode())
+         << ")";
+    }
+  } else {
+    std::vector< std::vector<unsigned char> > result;
+    
+    if (S->getInitialValues(Query(ConstraintManager(constraints), 
+                                  QC->Query),
+                            QC->Objects, result)) {
+      status = "INVALID";
+      os << "INVALID\n";
+
+      for (unsigned i = 0, e = result.size(); i != e; ++i) {
+        os << "\tArray " << i << ":\t" << QC->Objects[i]->name << "[";
+        for (unsigned j = 0; j != QC->Objects[i]->size; ++j) {
+          os << (unsigned) result[i][j];
+          if (j + 1 != QC->Objects[i]->size)
+            os << ", ";
+        }
+        os << "]";
+        if (i + 1 != e)
+          os << "\n";
+      }
+    } else {
+      SolverImpl::SolverRunStatus retCode = S->impl->getOperationStatusCode();
+      if (SolverImpl::SOLVER_RUN_STATUS_TIMEOUT == retCode) {
+        os << " FAIL (reason: "
+           << SolverImpl::getOperationStatusString(retCode) << ")";
+      }           
+      else {
+        status = "VALID";
+        os << "VALID (counterexample request ignored)";
       }
     }
+  }
+
+  os << "\n";
 
-    ifs.close();
+  if (times) {
+    std::string row;
+    llvm::raw_string_ostream rs(row);
+    rs << Index << "," << QueryTimesLabel << "," << status << ","
+       << llvm::format("%.6f", (time::getWallTime() - start).toSeconds())
+       << "\n";
+    *times += rs.str();
   }
 }
 
+static void printQueryStatistics() {
+  if (uint64_t queries = *theStatisticManager->getStatisticByName("Queries")) {
+    llvm::outs()
+      << "--\n"
+      << "total queries = " << queries << "\n"
+      << "total queries constructs = " 
+      << *theStatisticManager->getStatisticByName("QueriesConstructs") << "\n"
+      << "valid queries = " 
+      << *theStatisticManager->getStatisticByName("QueriesValid") << "\n"
+      << "invalid queries = " 
+      << *theStatisticManager->getStatisticByName("QueriesInvalid") << "\n"
+      << "query cex = " 
+      << *theStatisticManager->getStatisticByName("QueriesCEX") << "\n";
+  }
+}
+
+/// Write the -query-stats file.
+static bool writeQueryStatistics() {
+  if (QueryStats.empty())
+    return true;
+  std::string error;
+  std::unique_ptr<llvm::raw_fd_ostream> os =
+      klee_open_output_file(QueryStats, error);
+  if (!os) {
+    llvm::errs() << "error: cannot open " << QueryStats << ": " << error
+                 << "\n";
+    return false;
+  }
+  *os << "statistic,value\n";
+  for (unsigned i = 0; i < theStatisticManager->getNumStatistics(); ++i) {
+    Statistic &s = theStatisticManager->getStatistic(i);
+    *os << s.getName() << "," << s.getValue() << "\n";
+  }
+  return true;
+}
+
 static bool EvaluateInputAST(const char *Filename,
                              const MemoryBuffer *MB,
                              ExprBuilder *Builder) {
@@ -323,143 +627,220 @@ static bool EvaluateInputAST(const char *Filename,
     return false;
 
   std::vector<Decl *> &Decls = ast.getDecls();
-  Solver *coreSolver = klee::createCoreSolver(CoreSolverToUse);
-
-  if (CoreSolverToUse != DUMMY_SOLVER) {
-    const time::Span maxCoreSolverTime(MaxCoreSolverTime);
-    if (maxCoreSolverTime) {
-      coreSolver->setCoreSolverTimeout(maxCoreSolverTime);
-    }
-  }
-  Solver *S = constructSolverChain(coreSolver,
-                                   getQueryLogPath(ALL_QUERIES_SMT2_FILE_NAME),
-                                   getQueryLogPath(SOLVER_QUERIES_SMT2_FILE_NAME),
-                                   getQueryLogPath(ALL_QUERIES_KQUERY_FILE_NAME),
-                                   getQueryLogPath(SOLVER_QUERIES_KQUERY_FILE_NAME));
+  std::unique_ptr<llvm::raw_fd_ostream> times;
+  if (!openQueryTimes(times))
+    return false;
+  Solver *S = createEvaluationSolver();
 
-  std::set<std::pair<std::string, unsigned>> concretizedInputs;
+  ConcretizedInputs concretizedInputs;
   getAdditionalConcreteValues(Decls, concretizedInputs);
 
   unsigned Index = 0;
+  std::string row;
   for (std::vector<Decl*>::iterator it = Decls.begin(),
          ie = Decls.end(); it != ie; ++it) {
     Decl *D = *it;
     if (QueryCommand *QC = dyn_cast<QueryCommand>(D)) {
-      /* replace some inputs with concrete value */
-      Constraints_ty constraints;
-      if (!concretizedInputs.empty()) {
-        ExprConcretizer ec(OracleKTest);
-        for (auto ciit = concretizedInputs.begin(), ciie = concretizedInputs.end();
-                    ciit != ciie; ciit++) {
-          ec.addConcretizedInputValue(ciit->first, ciit->second);
-        }
-        constraints = ec.evaluate(QC->Constraints);
-        IndirectReadDepthCalculator ic(constraints);
-        llvm::outs() << "Concretized Depth: " << ic.getMax() << "\n";
-
-        if (DumpConcretizedConstraints != "") {
-          std::string str;
-          llvm::raw_string_ostream os(str);
-          std::ofstream ofs(DumpConcretizedConstraints);
-          if (ofs.good()) {
-            ExprPPrinter::printQuery(os, constraints, ConstantExpr::alloc(false, Expr::Bool),
-                    0, 0, 0, 0, true);
-            ofs << os.str();
-            ofs.close();
-          }
-        }
-      }
-      else {
-        constraints = QC->Constraints;
-      }
+      row.clear();
+      EvaluateQuery(QC, Index, S, concretizedInputs, llvm::outs(),
+                    times ? &row : nullptr);
+      if (times)
+        *times << row;
+      ++Index;
+    }
+  }
 
-      llvm::outs() << "Query " << Index << ":\t";
+  delete S;
 
-      assert("FIXME: Support counterexample query commands!");
-      if (QC->Values.empty() && QC->Objects.empty()) {
-        bool result;
-        if (S->mustBeTrue(Query(ConstraintManager(constraints), QC->Query),
-                          result)) {
-          llvm::outs() << (result ? "VALID" : "INVALID");
-        } else {
-          llvm::outs() << "FAIL (reason: "
-                    << SolverImpl::getOperationStatusString(S->impl->getOperationStatusCode())
-                    << ")";
-        }
-      } else if (!QC->Values.empty()) {
-        assert(QC->Objects.empty() && 
-               "FIXME: Support counterexamples for values and objects!");
-        assert(QC->Values.size() == 1 &&
-               "FIXME: Support counterexamples for multiple values!");
-        assert(QC->Query->isFalse() &&
-               "FIXME: Support counterexamples with non-trivial query!");
-        ref<ConstantExpr> result;
-        if (S->getValue(Query(ConstraintManager(constraints), 
-                              QC->Values[0]),
-                        result)) {
-          llvm::outs() << "INVALID\n";
-          llvm::outs() << "\tExpr 0:\t" << result;
-        } else {
-          llvm::outs() << "FAIL (reason: "
-                    << SolverImpl::getOperationStatusString(S->impl->getOperationStatusCode())
-                    << ")";
-        }
-      } else {
-        std::vector< std::vector<unsigned char> > result;
-        
-        if (S->getInitialValues(Query(ConstraintManager(constraints), 
-                                      QC->Query),
-                                QC->Objects, result)) {
-          llvm::outs() << "INVALID\n";
-
-          for (unsigned i = 0, e = result.size(); i != e; ++i) {
-            llvm::outs() << "\tArray " << i << ":\t"
-                       << QC->Objects[i]->name
-                       << "[";
-            for (unsigned j = 0; j != QC->Objects[i]->size; ++j) {
-              llvm::outs() << (unsigned) result[i][j];
-              if (j + 1 != QC->Objects[i]->size)
-                llvm::outs() << ", ";
-            }
-            llvm::outs() << "]";
-            if (i + 1 != e)
-              llvm::outs() << "\n";
-          }
+  printQueryStatistics();
+
+  return writeQueryStatistics();
+}
+
+/// Write a block of output for the parent of a -query-jobs worker.
+static bool writeBlock(int fd, const std::string &text) {
+  uint64_t size = text.size();
+  std::string block(reinterpret_cast<const char *>(&size), sizeof(size));
+  block += text;
+  for (size_t done = 0; done < block.size();) {
+    ssize_t n = write(fd, block.data() + done, block.size() - done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    done += n;
+  }
+  return true;
+}
+
+/// Read a block written by writeBlock.
+/// \return false at the end of the output
+static bool readBlock(int fd, std::string &text) {
+  uint64_t size;
+  char *buf = reinterpret_cast<char *>(&size);
+  for (size_t done = 0; done < sizeof(size) + text.size();) {
+    char *dest = done < sizeof(size) ? buf + done
+                                     : &text[done - sizeof(size)];
+    size_t want = done < sizeof(size) ? sizeof(size) - done
+                                      : sizeof(size) + text.size() - done;
+    ssize_t n = read(fd, dest, want);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    done += n;
+    if (done == sizeof(size))
+      text.assign(size, '\0');
+  }
+  return true;
+}
+
+/// Parse the input one declaration at a time, and evaluate the queries
+/// whose number is worker modulo workers. Each query is freed once
+/// evaluated, array declarations are kept for the queries using them. The
+/// results go to llvm::outs() and their -query-times rows to times, or to
+/// fd as one block per query, followed by a block with its row with
+/// -query-times, if fd is not negative.
+static bool EvaluateQueryStream(const char *Filename, const MemoryBuffer *MB,
+                                ExprBuilder *Builder, unsigned worker,
+                                unsigned workers, int fd,
+                                llvm::raw_ostream *times) {
+  std::unique_ptr<Parser> P(Parser::Create(
+      Filename, MB, Builder, ClearArrayAfterQuery, BitcodePath));
+  P->SetMaxErrors(20);
+  Solver *S = createEvaluationSolver();
+
+  ConcretizedInputs concretizedInputs;
+  if (!AdditionalConcreteValuesRandom)
+    readConcreteValuesConfig(concretizedInputs);
+
+  std::vector<std::unique_ptr<Decl>> arrays;
+  unsigned Index = 0;
+  bool ok = true;
+  while (ok) {
+    // the nodes of a query are released with it, the ones still referenced
+    // (array constants, solver caches) when they are freed
+    std::unique_ptr<ExprArena> Arena;
+    if (UseExprArena)
+      Arena.reset(new ExprArena());
+    std::unique_ptr<Decl> D(P->ParseTopLevelDecl());
+    if (!D)
+      break;
+    if (ArrayDecl *AD = dyn_cast<ArrayDecl>(D.get())) {
+      if (AdditionalConcreteValuesRandom)
+        addRandomConcreteValues(AD->Root, concretizedInputs, worker == 0);
+      // the parser refers to the declaration until the end
+      arrays.push_back(std::move(D));
+    } else if (QueryCommand *QC = dyn_cast<QueryCommand>(D.get())) {
+      if (Index % workers == worker) {
+        bool timed = !QueryTimes.empty();
+        std::string row;
+        if (fd < 0) {
+          EvaluateQuery(QC, Index, S, concretizedInputs, llvm::outs(),
+                        timed ? &row : nullptr);
+          if (times)
+            *times << row;
         } else {
-          SolverImpl::SolverRunStatus retCode = S->impl->getOperationStatusCode();
-          if (SolverImpl::SOLVER_RUN_STATUS_TIMEOUT == retCode) {
-            llvm::outs() << " FAIL (reason: "
-                      << SolverImpl::getOperationStatusString(retCode)
-                      << ")";
-          }           
-          else {
-            llvm::outs() << "VALID (counterexample request ignored)";
-          }
+          std::string text;
+          llvm::raw_string_ostream os(text);
+          EvaluateQuery(QC, Index, S, concretizedInputs, os,
+                        timed ? &row : nullptr);
+          ok = writeBlock(fd, os.str()) && (!timed || writeBlock(fd, row));
         }
       }
-
-      llvm::outs() << "\n";
       ++Index;
     }
   }
 
   delete S;
 
-  if (uint64_t queries = *theStatisticManager->getStatisticByName("Queries")) {
-    llvm::outs()
-      << "--\n"
-      << "total queries = " << queries << "\n"
-      << "total queries constructs = " 
-      << *theStatisticManager->getStatisticByName("QueriesConstructs") << "\n"
-      << "valid queries = " 
-      << *theStatisticManager->getStatisticByName("QueriesValid") << "\n"
-      << "invalid queries = " 
-      << *theStatisticManager->getStatisticByName("QueriesInvalid") << "\n"
-      << "query cex = " 
-      << *theStatisticManager->getStatisticByName("QueriesCEX") << "\n";
+  if (unsigned N = P->GetNumErrors()) {
+    llvm::errs() << Filename << ": parse failure: " << N << " errors.\n";
+    return false;
   }
+  return ok;
+}
 
-  return true;
+/// EvaluateQueryStream on QueryJobs worker processes, printing the results
+/// and the -query-times rows in query order. The solvers are not shared,
+/// nor their statistics, only the records of a -solver-cache-file.
+static bool EvaluateInputStream(const char *Filename, const MemoryBuffer *MB,
+                                ExprBuilder *Builder) {
+  unsigned workers = QueryJobs;
+  if (workers == 0)
+    workers = std::max(1u, std::thread::hardware_concurrency());
+  std::unique_ptr<llvm::raw_fd_ostream> times;
+  if (!openQueryTimes(times))
+    return false;
+  if (workers == 1) {
+    bool success =
+        EvaluateQueryStream(Filename, MB, Builder, 0, 1, -1, times.get());
+    printQueryStatistics();
+    return writeQueryStatistics() && success;
+  }
+  if (!QueryStats.empty()) {
+    llvm::errs() << "error: -query-stats needs a single worker\n";
+    return false;
+  }
+
+  // the workers must pick the same random values
+  if (AdditionalConcreteValuesRandom)
+    srand(std::time(NULL));
+  llvm::outs().flush();
+  llvm::errs().flush();
+  std::vector<pid_t> pids;
+  std::vector<int> fds;
+  for (unsigned worker = 0; worker < workers; ++worker) {
+    int pipefd[2];
+    if (pipe(pipefd) != 0) {
+      llvm::errs() << "error: cannot create a pipe for the workers\n";
+      break;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+      close(pipefd[0]);
+      close(pipefd[1]);
+      llvm::errs() << "error: cannot fork a worker\n";
+      break;
+    }
+    if (pid == 0) {
+      close(pipefd[0]);
+      for (int fd : fds)
+        close(fd);
+      bool success =
+          EvaluateQueryStream(Filename, MB, Builder, worker, workers,
+                              pipefd[1], nullptr);
+      close(pipefd[1]);
+      llvm::errs().flush();
+      _exit(success ? 0 : 1);
+    }
+    close(pipefd[1]);
+    pids.push_back(pid);
+    fds.push_back(pipefd[0]);
+  }
+
+  bool success = pids.size() == workers;
+  // query i comes from worker i % workers, the first one to run out
+  // marks the end
+  std::string text, row;
+  for (unsigned i = 0; success && readBlock(fds[i % workers], text); ++i) {
+    llvm::outs() << text;
+    if (times) {
+      if (!readBlock(fds[i % workers], row))
+        break;
+      *times << row;
+    }
+  }
+  llvm::outs().flush();
+  for (int fd : fds)
+    close(fd);
+  for (pid_t pid : pids) {
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0)
+      success = false;
+  }
+  return success;
 }
 
 static bool AnalyzeInputAST(const char *Filename,
@@ -472,10 +853,37 @@ static bool AnalyzeInputAST(const char *Filename,
 
   std::vector<Decl*> &Decls = ast.getDecls();
 
+  std::unique_ptr<llvm::raw_fd_ostream> cfg;
+  if (SelectRecording) {
+    if (BitcodePath.empty())
+      klee_warning("-select-recording without -bitcode: the queries carry "
+                   "no instructions to record");
+    std::string error;
+    cfg = klee_open_output_file(std::string(Filename) + ".ptwrite-cfg", error);
+    if (!cfg) {
+      llvm::errs() << "error: " << error << '\n';
+      return false;
+    }
+  }
+
   llvm::raw_ostream &os = llvm::errs();
   for (Decl *D: Decls) {
     if (QueryCommand *QC = dyn_cast<QueryCommand>(D)) {
-      IndirectReadDepthCalculator IDCalc(QC->Constraints);
+      if (cfg) {
+        std::vector<ref<Expr>> exprs(QC->Constraints.begin(),
+                                     QC->Constraints.end());
+        exprs.push_back(QC->Query);
+        exprs.insert(exprs.end(), QC->Values.begin(), QC->Values.end());
+        RecordingSelector selector(exprs);
+        for (const RecordingSelector::Candidate &c :
+             selector.select(SelectRecording)) {
+          *cfg << c.ki->getUniqueID() << '\n';
+          os << "record " << c.ki->getUniqueID() << ": " << c.nodes
+             << " nodes, score " << c.score << ", " << c.bytes
+             << " bytes\n";
+        }
+      }
+      IndirectReadDepthCalculator IDCalc(QC->Constraints, AnalyzeJobs);
       std::set<ref<ReadExpr>> &lastLevelReads = IDCalc.getLastLevelReads();
       std::vector<ref<ReadExpr>> tosort(lastLevelReads.begin(), lastLevelReads.end());
       std::sort(tosort.begin(), tosort.end(),
@@ -523,10 +931,15 @@ static bool DrawInputAST(const char *Filename,
         GraphvizDOTDrawer drawer(of, *QC);
         drawer.draw();
       }
+      if (DrawFormat.getValue() & DrawFormats::Binary) {
+        std::ofstream of(output_prefix + ".graph", std::ios::binary);
+        BinaryDrawer drawer(of, *QC, DrawJobs);
+        drawer.draw();
+      }
       // Simplify dependency graphs by omitting constant nodes and transforming
       // "A->B->C" to "A->C"
-      // Note that this ExprInPlaceTransformer is destructive
-      ExprInPlaceTransformer simplified_QC(*QC);
+      // Note that this ConstantOmittingTransformer is destructive
+      ConstantOmittingTransformer simplified_QC(*QC);
       if (DrawFormat.getValue() & DrawFormats::JSON) {
         std::ofstream of_simplify(output_prefix + ".simplify.json");
         JsonDrawer drawer_simplify(of_simplify, *simplified_QC.getNewQCptr());
@@ -538,6 +951,13 @@ static bool DrawInputAST(const char *Filename,
                                           *simplified_QC.getNewQCptr());
         drawer_simplify.draw();
       }
+      if (DrawFormat.getValue() & DrawFormats::Binary) {
+        std::ofstream of_simplify(output_prefix + ".simplify.graph",
+                                  std::ios::binary);
+        BinaryDrawer drawer_simplify(of_simplify, *simplified_QC.getNewQCptr(),
+                                     DrawJobs);
+        drawer_simplify.draw();
+      }
       // Assuming there will only be one QueryComamnd
       break;
     }
@@ -546,6 +966,81 @@ static bool DrawInputAST(const char *Filename,
   return true;
 }
 
+/// Check the constraints against every KTest of -batch-ktests and report,
+/// for each KTest, the constraints it violates.
+static bool BatchKTestEval(const Constraints_ty &constraintSet) {
+  std::vector<ref<Expr>> constraints(constraintSet.begin(),
+                                     constraintSet.end());
+  std::vector<std::string> paths;
+  for (const std::string &entry : BatchKTests) {
+    if (!llvm::sys::fs::is_directory(entry)) {
+      paths.push_back(entry);
+      continue;
+    }
+    std::vector<std::string> found;
+    std::error_code ec;
+    for (llvm::sys::fs::directory_iterator it(entry, ec), ie; it != ie && !ec;
+         it.increment(ec))
+      if (llvm::StringRef(it->path()).endswith(".ktest"))
+        found.push_back(it->path());
+    std::sort(found.begin(), found.end());
+    paths.insert(paths.end(), found.begin(), found.end());
+  }
+
+  std::vector<const KTest *> ktests;
+  for (const std::string &path : paths) {
+    KTest *ktest = kTest_fromFile(path.c_str());
+    if (!ktest) {
+      klee_warning("cannot read KTest %s", path.c_str());
+      for (const KTest *k : ktests)
+        kTest_free(const_cast<KTest *>(k));
+      return false;
+    }
+    ktests.push_back(ktest);
+  }
+
+  BatchEvaluator evaluator(constraints);
+  klee_message("compiled %u constraints into %u instructions, %u evaluated "
+               "one KTest at a time",
+               evaluator.getNumConstraints(), evaluator.getProgramSize(),
+               evaluator.getNumUncompiled());
+  std::vector<BatchEvaluator::Result> results;
+  evaluator.evaluate(ktests, results);
+
+  const size_t n = constraints.size();
+  unsigned passing = 0, failing = 0;
+  for (size_t k = 0; k < ktests.size(); ++k) {
+    unsigned failed = 0, unknown = 0;
+    size_t first = 0;
+    for (size_t c = 0; c < n; ++c) {
+      BatchEvaluator::Result r = results[k * n + c];
+      if (r == BatchEvaluator::Fail && !failed++)
+        first = c;
+      unknown += r == BatchEvaluator::Unknown;
+    }
+    llvm::outs() << paths[k] << ": ";
+    if (failed) {
+      ++failing;
+      llvm::outs() << "FAIL, " << failed << " of " << n
+                   << " constraints, first (kinst "
+                   << constraints[first]->getKInstUniqueID() << ") ";
+      constraints[first]->print(llvm::outs());
+    } else {
+      ++passing;
+      llvm::outs() << "PASS";
+    }
+    if (unknown)
+      llvm::outs() << ", " << unknown << " not evaluated";
+    llvm::outs() << "\n";
+  }
+  llvm::outs() << ktests.size() << " KTests, " << passing << " pass, "
+               << failing << " fail\n";
+
+  for (const KTest *k : ktests)
+    kTest_free(const_cast<KTest *>(k));
+  return true;
+}
+
 static bool KTestEvalInputAST(const char *Filename,
                          const MemoryBuffer *MB,
                          ExprBuilder *Builder) {
@@ -553,13 +1048,20 @@ static bool KTestEvalInputAST(const char *Filename,
   if (!ast.isValid())
     return false;
 
+  if (!BatchKTests.empty()) {
+    for (Decl *D : ast.getDecls())
+      if (QueryCommand *QC = dyn_cast<QueryCommand>(D))
+        return BatchKTestEval(QC->Constraints);
+    return true;
+  }
+
   OracleEvaluator oracle_eval(OracleKTest);
   std::vector<Decl*> &Decls = ast.getDecls();
   std::ofstream of(std::string(Filename) + ".dot");
   for (Decl *D: Decls) {
     if (QueryCommand *QC = dyn_cast<QueryCommand>(D)) {
       for (const ref<Expr> &constraint : QC->Constraints) {
-        ref<Expr> result = oracle_eval.visit(constraint);
+        ref<Expr> result = oracle_eval.evaluate(constraint);
         if (ConstantExpr *CE=dyn_cast<ConstantExpr>(result)) {
           if (CE->isFalse()) {
             std::string constraint_str;
@@ -675,6 +1177,72 @@ static bool printInputAsSMTLIBv2(const char *Filename,
 	return true;
 }
 
+/// Print the queries of a binary query log the way the .kquery query
+/// logging solver prints them.
+static bool printBinaryQueryLog(const char *Filename, const MemoryBuffer *MB) {
+  static const char *kindNames[] = {"Truth", "Validity", "Value",
+                                    "InitialValues"};
+  ArrayCache arrayCache;
+  BinaryQueryLogReader reader(arrayCache, MB->getBufferStart(),
+                              MB->getBufferEnd());
+  llvm::raw_ostream &os = llvm::outs();
+  LoggedQuery q;
+  for (unsigned queryCount = 0; reader.next(q); ++queryCount) {
+    os << "# Query " << queryCount << " -- "
+       << "Type: " << kindNames[q.kind] << ", "
+       << "Instructions: " << q.instructions << "\n";
+
+    Constraints_ty constraints(q.constraints.begin(), q.constraints.end());
+    if (q.kind == LoggedQuery::Value) {
+      ExprPPrinter::printQuery(os, constraints,
+                               ConstantExpr::alloc(0, Expr::Bool), &q.expr,
+                               &q.expr + 1);
+    } else if (q.kind == LoggedQuery::InitialValues && !q.objects.empty()) {
+      ExprPPrinter::printQuery(os, constraints, q.expr, 0, 0, &q.objects[0],
+                               &q.objects[0] + q.objects.size());
+    } else {
+      ExprPPrinter::printQuery(os, constraints, q.expr);
+    }
+
+    os << "#   " << (q.success ? "OK" : "FAIL") << " -- "
+       << "Elapsed: " << time::microseconds(q.elapsedMicroseconds) << "\n";
+    if (!q.success) {
+      os << "#   Failure reason: "
+         << SolverImpl::getOperationStatusString(
+                (SolverImpl::SolverRunStatus)q.status)
+         << "\n\n";
+      continue;
+    }
+    switch (q.kind) {
+    case LoggedQuery::Truth:
+      os << "#   Is Valid: " << (q.isValid ? "true" : "false") << "\n";
+      break;
+    case LoggedQuery::Validity:
+      os << "#   Validity: " << q.validity << "\n";
+      break;
+    case LoggedQuery::Value:
+      os << "#   Result: " << q.value << "\n";
+      break;
+    case LoggedQuery::InitialValues:
+      os << "#   Solvable: " << (q.hasSolution ? "true" : "false") << "\n";
+      for (unsigned i = 0; i < q.values.size(); ++i) {
+        os << "#     " << q.objects[i]->name << " = [";
+        for (unsigned j = 0; j < q.values[i].size(); ++j)
+          os << (j ? "," : "") << (int)q.values[i][j];
+        os << "]\n";
+      }
+      break;
+    }
+    os << "\n";
+  }
+
+  if (!reader.getError().empty()) {
+    llvm::errs() << Filename << ": error: " << reader.getError() << "\n";
+    return false;
+  }
+  return true;
+}
+
 int main(int argc, char **argv) {
 
   KCommandLine::HideOptions(llvm::cl::GeneralCategory);
@@ -713,6 +1281,23 @@ int main(int argc, char **argv) {
     Builder = createConstantFoldingExprBuilder(Builder);
     Builder = createSimplifyingExprBuilder(Builder);
     break;
+  case AlgebraicBuilder:
+    Builder = createDefaultExprBuilder();
+    Builder = createConstantFoldingExprBuilder(Builder);
+    Builder = createSimplifyingExprBuilder(Builder);
+    Builder = createAlgebraicExprBuilder(Builder);
+    break;
+  case HashConsingBuilder:
+    if (ToolAction == Draw) {
+      // the simplified drawing rewrites expressions in place
+      llvm::errs() << argv[0]
+                   << ": error: -builder=hash-consing cannot be used with "
+                      "-draw\n";
+      return 1;
+    }
+    Builder = createDefaultExprBuilder();
+    Builder = createHashConsingExprBuilder(Builder);
+    break;
   }
 
   switch (ToolAction) {
@@ -724,8 +1309,12 @@ int main(int argc, char **argv) {
                             Builder);
     break;
   case Evaluate:
-    success = EvaluateInputAST(InputFile=="-" ? "<stdin>" : InputFile.c_str(),
-                               MB.get(), Builder);
+    if (StreamQueries || QueryJobs != 1)
+      success = EvaluateInputStream(
+          InputFile == "-" ? "<stdin>" : InputFile.c_str(), MB.get(), Builder);
+    else
+      success = EvaluateInputAST(
+          InputFile == "-" ? "<stdin>" : InputFile.c_str(), MB.get(), Builder);
     break;
   case PrintSMTLIBv2:
     success = printInputAsSMTLIBv2(InputFile=="-"? "<stdin>" : InputFile.c_str(), MB.get(),Builder);
@@ -746,6 +1335,10 @@ int main(int argc, char **argv) {
     success = DataRecReplaceInputAST(InputFile=="-"? "<stdin>" : InputFile.c_str(),
         MB.get(), Builder);
     break;
+  case PrintQueryLog:
+    success = printBinaryQueryLog(
+        InputFile == "-" ? "<stdin>" : InputFile.c_str(), MB.get());
+    break;
   default:
     llvm::errs() << argv[0] << ": error: Unknown program action!\n";
   }
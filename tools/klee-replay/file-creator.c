@@ -7,6 +7,8 @@
 //
 //===----------------------------------------------------------------------===//
 
+// for memfd_create()
+#define _GNU_SOURCE
 #include "klee-replay.h"
 
 #include <assert.h>
@@ -22,6 +24,10 @@
 #include <sys/stat.h>
 #include <sys/wait.h>
 
+#ifdef HAVE_MEMFD_CREATE
+#include <sys/mman.h>
+#endif
+
 #ifdef HAVE_PTY_H
 #include <pty.h>
 #elif defined(HAVE_UTIL_H)
@@ -286,25 +292,18 @@ static int create_pipe(const char *fname, exe_disk_file_t *dfile,
 }
 
 
-static int create_reg_file(const char *fname, exe_disk_file_t *dfile,
-                           const char *tmpdir) {
-  struct stat64 *s = dfile->stat;
-  char* contents = dfile->contents;
-  unsigned flen = dfile->size;
-  unsigned mode = s->st_mode & 0777;
-
-  fprintf(stderr, "KLEE-REPLAY: NOTE: Creating file %s of length %d\n", fname, flen);
-
-  // Open in RDWR just in case we have to end up using this fd.
+static unsigned reg_file_mode(exe_disk_file_t *dfile) {
+  unsigned mode = dfile->stat->st_mode & 0777;
   if (__exe_env.version == 0 && mode == 0)
     mode = 0644;
+  return mode;
+}
 
-  int fd = open(fname, O_CREAT | O_RDWR, mode);
-  //    int fd = open(fname, O_CREAT | O_WRONLY, s->st_mode&0777);
-  if (fd < 0) {
-    fprintf(stderr, "KLEE-REPLAY: ERROR: Cannot create file %s\n", fname);
-    exit(1);
-  }
+/* Write the contents and times of dfile to the new file fd. */
+static void fill_reg_file(int fd, const char *fname, exe_disk_file_t *dfile) {
+  struct stat64 *s = dfile->stat;
+  char* contents = dfile->contents;
+  unsigned flen = dfile->size;
 
   ssize_t r = write(fd, contents, flen);
   if (r < 0 || (unsigned) r != flen) {
@@ -322,9 +321,42 @@ static int create_reg_file(const char *fname, exe_disk_file_t *dfile,
   // XXX: Now what we should do is reopen a new fd with the correct modes
   // as they were given to the process.
   lseek(fd, 0, SEEK_SET);
+}
 
+static int create_reg_file(const char *fname, exe_disk_file_t *dfile,
+                           const char *tmpdir) {
+  fprintf(stderr, "KLEE-REPLAY: NOTE: Creating file %s of length %d\n", fname,
+          dfile->size);
+
+  // Open in RDWR just in case we have to end up using this fd.
+  int fd = open(fname, O_CREAT | O_RDWR, reg_file_mode(dfile));
+  //    int fd = open(fname, O_CREAT | O_WRONLY, s->st_mode&0777);
+  if (fd < 0) {
+    fprintf(stderr, "KLEE-REPLAY: ERROR: Cannot create file %s\n", fname);
+    exit(1);
+  }
+
+  fill_reg_file(fd, fname, dfile);
+  return fd;
+}
+
+#ifdef HAVE_MEMFD_CREATE
+/* Create a regular file that is only reached through its descriptor, such as
+   stdin, in memory instead of in the replay directory. */
+static int create_mem_file(const char *fname, exe_disk_file_t *dfile) {
+  fprintf(stderr, "KLEE-REPLAY: NOTE: Creating in-memory file %s of length %d\n",
+          fname, dfile->size);
+
+  int fd = memfd_create(fname, 0);
+  if (fd < 0 || fchmod(fd, reg_file_mode(dfile)) < 0) {
+    fprintf(stderr, "KLEE-REPLAY: ERROR: Cannot create file %s\n", fname);
+    exit(1);
+  }
+
+  fill_reg_file(fd, fname, dfile);
   return fd;
 }
+#endif
 
 static void create_file(int target_fd,
                         const char *target_name,
@@ -360,6 +392,12 @@ static void create_file(int target_fd,
            (target_fd==0 && (s->st_mode & S_IFMT) == 0)) { // XXX hack
     fd = create_pipe(target, dfile, tmpdir);
   }
+#ifdef HAVE_MEMFD_CREATE
+  // keep files that may be inspected after the run in the replay directory
+  else if (target_fd != -1 && !keep_temps) {
+    fd = create_mem_file(target, dfile);
+  }
+#endif
   else {
     fd = create_reg_file(target, dfile, tmpdir);
   }
@@ -13,11 +13,13 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
@@ -42,11 +44,26 @@ static unsigned obj_index;
 static const char *progname = 0;
 static unsigned monitored_pid = 0;
 static unsigned monitored_timeout;
+static volatile sig_atomic_t timed_out = 0;
+static volatile sig_atomic_t interrupted = 0;
+
+/* --batch-report */
+static int report_fd = -1;
+static const char *current_ktest = 0;
+
+/* --forkserver */
+static int use_forkserver = 0;
+static int forkserver_fd = -1;
+static int forkserver_pid = 0;
+/* the arguments the running forkserver was started with */
+static char **forkserver_argv = 0;
 
 static char *rootdir = NULL;
 static struct option long_options[] = {
   {"create-files-only", required_argument, 0, 'f'},
+  {"batch-report", required_argument, 0, 'b'},
   {"chroot-to-dir", required_argument, 0, 'r'},
+  {"forkserver", no_argument, 0, 's'},
   {"help", no_argument, 0, 'h'},
   {"keep-replay-dir", no_argument, 0, 'k'},
   {0, 0, 0, 0},
@@ -101,6 +118,7 @@ static void stop_monitored(int process) {
 static void int_handler(int signal) {
   fprintf(stderr, "KLEE-REPLAY: NOTE: %s: Received signal %d.  Killing monitored process(es)\n",
           progname, signal);
+  interrupted = 1;
   if (monitored_pid) {
     stop_monitored(monitored_pid);
     /* Kill the process group of monitored_pid.  Since we called
@@ -115,6 +133,7 @@ static void int_handler(int signal) {
 static void timeout_handler(int signal) {
   fprintf(stderr, "KLEE-REPLAY: NOTE: EXIT STATUS: TIMED OUT (%d seconds)\n",
           monitored_timeout);
+  timed_out = 1;
   if (monitored_pid) {
     stop_monitored(monitored_pid);
     /* Kill the process group of monitored_pid.  Since we called
@@ -126,13 +145,15 @@ static void timeout_handler(int signal) {
   }
 }
 
-void process_status(int status, time_t elapsed, const char *pfx) {
+/* Print the exit status of a monitored process and return the exit code
+   that stands for it. */
+static int describe_status(int status, time_t elapsed, const char *pfx) {
   if (pfx)
     fprintf(stderr, "KLEE-REPLAY: NOTE: %s: ", pfx);
   if (WIFSIGNALED(status)) {
     fprintf(stderr, "KLEE-REPLAY: NOTE: EXIT STATUS: CRASHED signal %d (%d seconds)\n",
             WTERMSIG(status), (int) elapsed);
-    _exit(77);
+    return 77;
   } else if (WIFEXITED(status)) {
     int rc = WEXITSTATUS(status);
 
@@ -143,11 +164,68 @@ void process_status(int status, time_t elapsed, const char *pfx) {
       snprintf(msg, sizeof(msg), "ABNORMAL %d", rc);
     }
     fprintf(stderr, "KLEE-REPLAY: NOTE: EXIT STATUS: %s (%d seconds)\n", msg, (int) elapsed);
-    _exit(rc);
+    return rc;
   } else {
     fprintf(stderr, "KLEE-REPLAY: NOTE: EXIT STATUS: NONE (%d seconds)\n", (int) elapsed);
-    _exit(0);
+    return 0;
+  }
+}
+
+void process_status(int status, time_t elapsed, const char *pfx) {
+  _exit(describe_status(status, elapsed, pfx));
+}
+
+/* Append s to out as the contents of a JSON string, return its length. */
+static size_t json_escape(char *out, size_t size, const char *s) {
+  size_t n = 0;
+  for (; *s; ++s) {
+    unsigned char c = *s;
+    char esc[8];
+    if (c == '"' || c == '\\')
+      snprintf(esc, sizeof(esc), "\\%c", c);
+    else if (c < 0x20)
+      snprintf(esc, sizeof(esc), "\\u%04x", c);
+    else
+      esc[0] = c, esc[1] = '\0';
+    size_t len = strlen(esc);
+    if (n + len >= size)
+      break;
+    memcpy(out + n, esc, len);
+    n += len;
   }
+  out[n] = '\0';
+  return n;
+}
+
+/* Write the record of the current test case to the --batch-report file.
+   Each record is a single write to a file opened with O_APPEND, so the
+   processes that replay test cases do not interleave their records. */
+static void report_test(int status, double elapsed) {
+  if (report_fd < 0)
+    return;
+
+  const char *kind;
+  int code = 0;
+  if (timed_out) {
+    kind = "TIMEOUT";
+  } else if (WIFSIGNALED(status)) {
+    kind = "CRASHED";
+    code = WTERMSIG(status);
+  } else if (WIFEXITED(status)) {
+    code = WEXITSTATUS(status);
+    kind = code ? "ABNORMAL" : "NORMAL";
+  } else {
+    kind = "NONE";
+  }
+
+  char line[2 * PATH_MAX];
+  size_t n = snprintf(line, sizeof(line), "{\"ktest\": \"");
+  n += json_escape(line + n, sizeof(line) - n - 128, current_ktest);
+  n += snprintf(line + n, sizeof(line) - n,
+                "\", \"status\": \"%s\", \"code\": %d, \"time\": %.6f}\n",
+                kind, code, elapsed);
+  if (write(report_fd, line, n) != (ssize_t) n)
+    perror("KLEE-REPLAY: WARNING: batch report");
 }
 
 /* This function assumes that executable is a path pointing to some existing
@@ -157,8 +235,7 @@ static inline char *strip_root_dir(char *executable, char *rootdir) {
   return executable + strlen(rootdir);
 }
 
-static void run_monitored(char *executable, int argc, char **argv) {
-  int pid;
+static void setup_monitoring(void) {
   const char *t = getenv("KLEE_REPLAY_TIMEOUT");
   if (!t)
     t = "10000000";
@@ -174,6 +251,11 @@ static void run_monitored(char *executable, int argc, char **argv) {
   signal(SIGTERM, int_handler);
 
   signal(SIGALRM, timeout_handler);
+}
+
+static void run_monitored(char *executable, int argc, char **argv) {
+  int pid;
+  setup_monitoring();
   pid = fork();
   if (pid < 0) {
     perror("fork");
@@ -217,6 +299,7 @@ static void run_monitored(char *executable, int argc, char **argv) {
     /* Parent process which monitors the child. */
     int res, status;
     time_t start = time(0);
+    double start_time = getTime();
     sigset_t masked;
 
     sigemptyset(&masked);
@@ -236,10 +319,161 @@ static void run_monitored(char *executable, int argc, char **argv) {
     /* Just in case, kill the process group of pid.  Since we called setpgrp()
        for pid, this will not kill us, or any of our ancestors */
     kill(-pid, SIGKILL);
+    report_test(status, getTime() - start_time);
     process_status(status, time(0) - start, 0);
   }
 }
 
+static int same_args(char **a, char **b) {
+  for (; *a && *b; ++a, ++b)
+    if (strcmp(*a, *b) != 0)
+      return 0;
+  return !*a && !*b;
+}
+
+static void stop_forkserver(void) {
+  if (forkserver_fd < 0)
+    return;
+  /* the forkserver exits once the socket is closed */
+  close(forkserver_fd);
+  forkserver_fd = -1;
+  int res, status;
+  do {
+    res = waitpid(forkserver_pid, &status, 0);
+  } while (res < 0 && errno == EINTR);
+
+  char **arg;
+  for (arg = forkserver_argv; *arg; ++arg)
+    free(*arg);
+  free(forkserver_argv);
+  forkserver_argv = 0;
+}
+
+static int read_all(int fd, void *buf, size_t size) {
+  char *p = buf;
+  while (size) {
+    ssize_t res = read(fd, p, size);
+    if (res < 0 && errno == EINTR)
+      continue;
+    if (res <= 0)
+      return -1;
+    p += res;
+    size -= res;
+  }
+  return 0;
+}
+
+/* Run executable with argv as a forkserver, see runtime/Runtest/forkserver.h */
+static void start_forkserver(const char *executable, int argc, char **argv) {
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+    perror("socketpair");
+    _exit(66);
+  }
+
+  int pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    _exit(66);
+  } else if (pid == 0) {
+    char fd_str[16];
+    close(fds[0]);
+    snprintf(fd_str, sizeof(fd_str), "%d", fds[1]);
+    setenv(KLEE_REPLAY_FORKSERVER_ENV, fd_str, 1);
+    execv(executable, argv);
+    perror("execv");
+    _exit(66);
+  }
+
+  close(fds[1]);
+  fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+  forkserver_fd = fds[0];
+  forkserver_pid = pid;
+  uint32_t hello;
+  if (read_all(forkserver_fd, &hello, sizeof(hello)) ||
+      hello != KLEE_REPLAY_FORKSERVER_HELLO) {
+    fprintf(stderr, "KLEE-REPLAY: ERROR: %s did not start a forkserver, "
+                    "is it linked against libkleeRuntest?\n", executable);
+    exit(1);
+  }
+
+  int i;
+  forkserver_argv = calloc(argc + 1, sizeof(*forkserver_argv));
+  for (i = 0; i != argc; ++i)
+    forkserver_argv[i] = strdup(argv[i]);
+}
+
+/* Replay the current test case in a child of the forkserver. The forkserver
+   is reused as long as the test cases have the same arguments, which are
+   those of the process it was started as. */
+static void run_forkserver(char *executable, int argc, char **argv) {
+  if (forkserver_fd >= 0 && !same_args(forkserver_argv, argv))
+    stop_forkserver();
+  if (forkserver_fd < 0)
+    start_forkserver(executable, argc, argv);
+
+  struct klee_forkserver_request req;
+  memset(&req, 0, sizeof(req));
+  if (!realpath(current_ktest, req.ktest_file)) {
+    perror("realpath");
+    _exit(66);
+  }
+  snprintf(req.cwd, sizeof(req.cwd), "%s", replay_dir);
+
+  /* the child replays with our stdin, stdout and stderr, which
+     replay_create_files() has set up for this test case */
+  int fds[KLEE_REPLAY_FORKSERVER_NUM_FDS] = {0, 1, 2};
+  union {
+    char buf[CMSG_SPACE(sizeof(fds))];
+    struct cmsghdr align;
+  } control;
+  struct iovec iov = {&req, sizeof(req)};
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+  ssize_t sent;
+  do {
+    sent = sendmsg(forkserver_fd, &msg, 0);
+  } while (sent < 0 && errno == EINTR);
+  int32_t pid, status;
+  if (sent < 0 ||
+      ((size_t) sent < sizeof(req) &&
+       write(forkserver_fd, (char *) &req + sent, sizeof(req) - sent) !=
+           (ssize_t) (sizeof(req) - sent)) ||
+      read_all(forkserver_fd, &pid, sizeof(pid))) {
+    fputs("KLEE-REPLAY: ERROR: lost the forkserver\n", stderr);
+    _exit(66);
+  }
+
+  time_t start = time(0);
+  double start_time = getTime();
+  timed_out = 0;
+  monitored_pid = pid;
+  alarm(monitored_timeout);
+  if (read_all(forkserver_fd, &status, sizeof(status))) {
+    fputs("KLEE-REPLAY: ERROR: lost the forkserver\n", stderr);
+    _exit(66);
+  }
+  alarm(0);
+  monitored_pid = 0;
+
+  /* Just in case, kill the process group of pid, like run_monitored */
+  kill(-pid, SIGKILL);
+  report_test(status, getTime() - start_time);
+  describe_status(status, time(0) - start, 0);
+  if (interrupted)
+    _exit(99);
+}
+
 #ifdef HAVE_SYS_CAPABILITY_H
 /* ensure this process has CAP_SYS_CHROOT capability. */
 void ensure_capsyschroot(const char *executable) {
@@ -264,7 +498,11 @@ static void usage(void) {
     "Usage: %s [option]... <executable> <ktest-file>...\n"
     "   or: %s --create-files-only <ktest-file>\n"
     "\n"
+    "-b, --batch-report=FILE  append the status and run time of each test case\n"
+    "                         to FILE, one JSON object per line\n"
     "-r, --chroot-to-dir=DIR  use chroot jail, requires CAP_SYS_CHROOT\n"
+    "-s, --forkserver         load the executable once and fork it for each test\n"
+    "                         case, requires linking it against libkleeRuntest\n"
     "-k, --keep-replay-dir    do not delete replay directory\n"
     "-h, --help               display this help and exit\n"
     "\n"
@@ -286,7 +524,7 @@ int main(int argc, char** argv) {
     usage();
 
   int c, opt_index;
-  while ((c = getopt_long(argc, argv, "f:r:k", long_options, &opt_index)) != -1) {
+  while ((c = getopt_long(argc, argv, "f:b:r:sk", long_options, &opt_index)) != -1) {
     switch (c) {
     case 'f': {
       /* Special case hack for only creating files and not actually executing
@@ -311,10 +549,23 @@ int main(int argc, char** argv) {
       return 0;
     }
 
+    case 'b':
+      report_fd = open(optarg, O_WRONLY | O_CREAT | O_APPEND, 0644);
+      if (report_fd < 0) {
+        fprintf(stderr, "KLEE-REPLAY: ERROR: cannot open batch report %s: %s\n",
+                optarg, strerror(errno));
+        exit(1);
+      }
+      break;
+
     case 'r':
       rootdir = optarg;
       break;
 
+    case 's':
+      use_forkserver = 1;
+      break;
+
     case 'k':
       keep_temps = 1;
       break;
@@ -338,6 +589,11 @@ int main(int argc, char** argv) {
     ensure_capsyschroot(progname);
 #endif
 
+  if (rootdir && use_forkserver) {
+    fputs("KLEE-REPLAY: ERROR: --forkserver does not support --chroot-to-dir\n", stderr);
+    exit(1);
+  }
+
   /* rootdir should be a prefix of executable's path. */
   if (rootdir && strstr(executable, rootdir) != executable) {
     fputs("KLEE-REPLAY: ERROR: chroot: root dir should be a parent dir of executable.\n", stderr);
@@ -361,6 +617,7 @@ int main(int argc, char** argv) {
     prg_argv = input->args;
     prg_argv[0] = argv[optind];
     klee_init_env(&prg_argc, &prg_argv);
+    current_ktest = input_fname;
     if (idx > 2)
       fputc('\n', stderr);
     fprintf(stderr, "KLEE-REPLAY: NOTE: Test file: %s\n"
@@ -375,6 +632,14 @@ int main(int argc, char** argv) {
     /* Create the input files, pipes, etc. */
     replay_create_files(&__exe_fs);
 
+    if (use_forkserver) {
+      if (!monitored_timeout)
+        setup_monitoring();
+      run_forkserver(executable, prg_argc, prg_argv);
+      replay_delete_files();
+      continue;
+    }
+
     /* Run the test case machinery in a subprocess, eventually this parent
        process should be a script or something which shells out to the actual
        execution tool. */
@@ -404,6 +669,7 @@ int main(int argc, char** argv) {
     }
   }
 
+  stop_forkserver();
   return 0;
 }
 
@@ -478,6 +744,13 @@ void klee_make_symbolic(void *addr, size_t nbytes, const char *name) {
   }
 }
 
+void klee_make_symbolic_batch(void *const *addrs, const size_t *sizes,
+                              const char *const *names, unsigned count) {
+  unsigned i;
+  for (i = 0; i < count; ++i)
+    klee_make_symbolic(addrs[i], sizes[i], names[i]);
+}
+
 /* Redefined here so that we can check the value read. */
 int klee_range(int start, int end, const char* name) {
   int r;
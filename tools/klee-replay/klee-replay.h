@@ -16,6 +16,7 @@
 #include "klee/Config/config.h"
 // FIXME: This is a hack.
 #include "../../runtime/POSIX/fd.h"
+#include "../../runtime/Runtest/forkserver.h"
 #include <sys/time.h>
 
 // temporary directory used for replay
@@ -27,6 +28,8 @@ extern int keep_temps;
 void replay_create_files(exe_file_system_t *exe_fs);
 void replay_delete_files();
 
+double getTime();
+
 void process_status(int status,
 		    time_t elapsed,
 		    const char *pfx)
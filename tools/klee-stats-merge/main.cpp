@@ -0,0 +1,371 @@
+//===-- main.cpp ------------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Aggregates the statistics of many klee runs: merges or sums their
+// run.istats like scripts/IStatsMerge.py and scripts/IStatsSum.py, and
+// sums their run.stats into one time series that klee-stats, and its
+// grafana server, can show like a single run.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Internal/Support/ColumnarStats.h"
+#include "klee/Internal/Support/IStats.h"
+#include "klee/Internal/Support/PrintVersion.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <sqlite3.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+
+using namespace llvm;
+using namespace klee;
+
+namespace {
+cl::OptionCategory MergeCat("klee-stats-merge options");
+
+enum ToolActions { Merge, Sum, Stats };
+cl::opt<ToolActions> ToolAction(
+    cl::desc("Tool actions:"), cl::init(Merge),
+    cl::values(
+        clEnumValN(Merge, "merge-istats",
+                   "Merge the run.istats of the runs into -o (default)"),
+        clEnumValN(Sum, "sum-istats",
+                   "Print the total of every run.istats event"),
+        clEnumValN(Stats, "sum-stats",
+                   "Sum the run.stats of the runs into -o/run.stats.col")),
+    cl::cat(MergeCat));
+
+cl::opt<std::string> OutputDir("o", cl::desc("Output directory"),
+                               cl::cat(MergeCat));
+
+cl::opt<unsigned> Jobs("j",
+                       cl::desc("Number of runs read at the same time "
+                                "(default: number of cores)"),
+                       cl::init(0), cl::cat(MergeCat));
+
+cl::opt<unsigned> Interval("interval",
+                           cl::desc("Seconds between the rows of the summed "
+                                    "run.stats (default=60)"),
+                           cl::init(60), cl::cat(MergeCat));
+
+cl::list<std::string> Directories(cl::Positional, cl::OneOrMore,
+                                  cl::desc("<klee output directories>"),
+                                  cl::cat(MergeCat));
+
+std::mutex errorLock;
+bool failed = false;
+
+void reportError(const std::string &message) {
+  std::lock_guard<std::mutex> guard(errorLock);
+  errs() << "klee-stats-merge: error: " << message << '\n';
+  failed = true;
+}
+
+/// Run fn(i) for every directory on up to -j threads, each thread calling
+/// it with the same worker number.
+void forEachDirectory(const std::function<void(size_t, unsigned)> &fn,
+                      unsigned &numWorkers) {
+  unsigned jobs = Jobs ? Jobs : std::thread::hardware_concurrency();
+  numWorkers = std::max(1u, std::min<unsigned>(jobs, Directories.size()));
+  std::atomic<size_t> next(0);
+  auto worker = [&](unsigned w) {
+    for (size_t i; (i = next++) < Directories.size() && !failed;)
+      fn(i, w);
+  };
+  std::vector<std::thread> threads;
+  for (unsigned w = 1; w < numWorkers; ++w)
+    threads.emplace_back(worker, w);
+  worker(0);
+  for (auto &t : threads)
+    t.join();
+}
+
+std::string istatsPath(size_t i) {
+  SmallString<128> path(Directories[i]);
+  sys::path::append(path, "run.istats");
+  return path.str().str();
+}
+
+bool createOutputDir() {
+  if (OutputDir.empty()) {
+    reportError("no output directory, see -o");
+    return false;
+  }
+  if (std::error_code ec = sys::fs::create_directories(OutputDir)) {
+    reportError(OutputDir + ": " + ec.message());
+    return false;
+  }
+  return true;
+}
+
+int mergeIStats() {
+  if (!createOutputDir())
+    return 1;
+
+  // every worker merges the runs it reads into its own partial result
+  std::vector<IStatsFile> partials(Directories.size());
+  std::vector<char> used(Directories.size(), false);
+  unsigned numWorkers;
+  forEachDirectory(
+      [&](size_t i, unsigned w) {
+        std::string error;
+        IStatsFile file;
+        if (!file.read(istatsPath(i), error))
+          return reportError(error);
+        if (!used[w]) {
+          partials[w] = std::move(file);
+          used[w] = true;
+        } else if (!partials[w].merge(file, error)) {
+          reportError(Directories[i] + ": " + error);
+        }
+      },
+      numWorkers);
+  if (failed)
+    return 1;
+
+  IStatsFile &merged = partials[0];
+  for (unsigned w = 1; w < numWorkers; ++w) {
+    std::string error;
+    if (used[w] && !merged.merge(partials[w], error)) {
+      reportError(error);
+      return 1;
+    }
+  }
+
+  SmallString<128> path(OutputDir);
+  sys::path::append(path, "run.istats");
+  std::error_code ec;
+  raw_fd_ostream os(path, ec, sys::fs::F_None);
+  if (ec) {
+    reportError(path.str().str() + ": " + ec.message());
+    return 1;
+  }
+  merged.write(os);
+
+  // kcachegrind shows the instructions of the assembly next to the stats
+  SmallString<128> assembly(Directories[0]), copy(OutputDir);
+  sys::path::append(assembly, merged.object);
+  sys::path::append(copy, merged.object);
+  if (sys::fs::exists(assembly) && (ec = sys::fs::copy_file(assembly, copy)))
+    reportError(copy.str().str() + ": " + ec.message());
+  outs() << "Merged " << Directories.size() << " runs into " << path << '\n';
+  return failed;
+}
+
+int sumIStats() {
+  std::vector<std::vector<std::string>> events(Directories.size());
+  std::vector<std::vector<uint64_t>> sums(Directories.size());
+  unsigned numWorkers;
+  forEachDirectory(
+      [&](size_t i, unsigned) {
+        std::string error;
+        IStatsFile file;
+        if (!file.read(istatsPath(i), error))
+          return reportError(error);
+        sums[i] = file.totals();
+        events[i] = std::move(file.events);
+      },
+      numWorkers);
+  if (failed)
+    return 1;
+
+  // event -> (sum, number of files)
+  std::map<std::string, std::pair<uint64_t, uint64_t>> totals;
+  for (size_t i = 0; i < Directories.size(); ++i) {
+    outs() << "-- " << istatsPath(i) << " --\n";
+    std::map<std::string, uint64_t> sorted;
+    for (size_t e = 0; e < events[i].size(); ++e) {
+      sorted[events[i][e]] = sums[i][e];
+      auto &total = totals[events[i][e]];
+      total.first += sums[i][e];
+      ++total.second;
+    }
+    for (auto &event : sorted)
+      outs() << event.first << ": " << event.second << '\n';
+  }
+
+  outs() << "-- totals --\n";
+  size_t widths[4] = {0, 0, 0, 0};
+  std::vector<std::vector<std::string>> table;
+  for (auto &total : totals) {
+    table.push_back({total.first, std::to_string(total.second.first),
+                     std::to_string(total.second.second),
+                     std::to_string(total.second.first / total.second.second)});
+    for (unsigned c = 0; c < 4; ++c)
+      widths[c] = std::max(widths[c], table.back()[c].size());
+  }
+  for (auto &row : table)
+    outs() << left_justify(row[0], widths[0]) << ": "
+           << right_justify(row[1], widths[1]) << " (in "
+           << right_justify(row[2], widths[2]) << " files, avg: "
+           << right_justify(row[3], widths[3]) << ")\n";
+  return 0;
+}
+
+bool readSQLiteStats(const std::string &path, std::vector<std::string> &names,
+                     std::vector<std::vector<int64_t>> &rows,
+                     std::string &error) {
+  sqlite3 *db;
+  if (sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) !=
+      SQLITE_OK) {
+    error = path + ": " + sqlite3_errmsg(db);
+    sqlite3_close(db);
+    return false;
+  }
+  sqlite3_stmt *stmt;
+  if (sqlite3_prepare_v2(db, "SELECT * FROM stats ORDER BY rowid", -1, &stmt,
+                         nullptr) != SQLITE_OK) {
+    error = path + ": " + sqlite3_errmsg(db);
+    sqlite3_close(db);
+    return false;
+  }
+  names.clear();
+  for (int c = 0, n = sqlite3_column_count(stmt); c < n; ++c)
+    names.push_back(sqlite3_column_name(stmt, c));
+  rows.clear();
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    rows.emplace_back(names.size());
+    for (unsigned c = 0; c < names.size(); ++c)
+      rows.back()[c] = sqlite3_column_int64(stmt, c);
+  }
+  sqlite3_finalize(stmt);
+  sqlite3_close(db);
+  return true;
+}
+
+/// Columns of a run's state rather than counters, which a finished run no
+/// longer adds to
+bool isGauge(const std::string &name) {
+  return name == "NumStates" || name == "MallocUsage" ||
+         StringRef(name).endswith("Memory");
+}
+
+int sumStats() {
+  if (!createOutputDir())
+    return 1;
+
+  std::vector<std::vector<std::string>> names(Directories.size());
+  std::vector<std::vector<std::vector<int64_t>>> runs(Directories.size());
+  unsigned numWorkers;
+  forEachDirectory(
+      [&](size_t i, unsigned) {
+        SmallString<128> path(Directories[i]);
+        sys::path::append(path, "run.stats");
+        std::string stats = path.str().str(), error;
+        bool ok = sys::fs::exists(stats + ".col")
+                      ? readColumnarStats(stats + ".col", names[i], runs[i],
+                                          error)
+                      : readSQLiteStats(stats, names[i], runs[i], error);
+        if (!ok)
+          reportError(error);
+      },
+      numWorkers);
+  if (failed)
+    return 1;
+
+  const std::vector<std::string> &columns = names[0];
+  auto wallTime = std::find(columns.begin(), columns.end(), "WallTime");
+  if (wallTime == columns.end()) {
+    reportError(Directories[0] + ": no WallTime column");
+    return 1;
+  }
+  const size_t timeColumn = wallTime - columns.begin();
+  // run.stats and run.stats.col do not order the columns the same way
+  std::vector<std::vector<size_t>> positions(Directories.size());
+  int64_t end = 0;
+  for (size_t i = 0; i < Directories.size(); ++i) {
+    for (const std::string &column : columns) {
+      auto it = std::find(names[i].begin(), names[i].end(), column);
+      if (it == names[i].end()) {
+        reportError(Directories[i] + ": no " + column + " column");
+        return 1;
+      }
+      positions[i].push_back(it - names[i].begin());
+    }
+    if (!runs[i].empty())
+      end = std::max(end, runs[i].back()[positions[i][timeColumn]]);
+  }
+
+  SmallString<128> path(OutputDir);
+  sys::path::append(path, "run.stats.col");
+  std::error_code ec;
+  auto os = std::make_unique<raw_fd_ostream>(path, ec, sys::fs::F_None);
+  if (ec) {
+    reportError(path.str().str() + ": " + ec.message());
+    return 1;
+  }
+  ColumnarStatsWriter writer(std::move(os), columns);
+
+  // The runs are sampled every -interval, the time being their WallTime
+  // (microseconds since each started): a row sums the last row of every
+  // run at that time.
+  const int64_t step = std::max(1u, Interval.getValue()) * 1000000LL;
+  std::vector<size_t> next(Directories.size(), 0);
+  std::vector<int64_t> row(columns.size());
+  size_t numRows = 0;
+  for (int64_t t = 0;; t += step) {
+    t = std::min(t, end);
+    std::fill(row.begin(), row.end(), 0);
+    for (size_t i = 0; i < runs.size(); ++i) {
+      const std::vector<std::vector<int64_t>> &rows = runs[i];
+      const std::vector<size_t> &at = positions[i];
+      while (next[i] < rows.size() && rows[next[i]][at[timeColumn]] <= t)
+        ++next[i];
+      if (!next[i])
+        continue;
+      bool finished =
+          next[i] == rows.size() && rows.back()[at[timeColumn]] < t;
+      const std::vector<int64_t> &last = rows[next[i] - 1];
+      for (size_t c = 0; c < columns.size(); ++c)
+        if (!finished || !isGauge(columns[c]))
+          row[c] += last[at[c]];
+    }
+    row[timeColumn] = t;
+    writer.append(row);
+    ++numRows;
+    if (t == end)
+      break;
+  }
+  writer.flush();
+  outs() << "Summed " << Directories.size() << " runs into " << numRows
+         << " rows of " << path << '\n';
+  return 0;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  sys::PrintStackTraceOnErrorSignal(argv[0]);
+  cl::SetVersionPrinter(klee::printVersion);
+  cl::HideUnrelatedOptions(MergeCat);
+  cl::ParseCommandLineOptions(
+      argc, argv,
+      "Aggregate the statistics of klee runs\n\n"
+      "  The summed run.stats.col is shown by klee-stats, e.g. with its "
+      "--grafana server.\n");
+
+  switch (ToolAction) {
+  case Merge:
+    return mergeIStats();
+  case Sum:
+    return sumIStats();
+  case Stats:
+    return sumStats();
+  }
+  return 1;
+}
@@ -10,16 +10,20 @@
 //===----------------------------------------------------------------------===//
 
 #include "klee/Config/Version.h"
+#include "klee/Config/config.h"
 #include "klee/ExecutionState.h"
 #include "klee/ExecutorCmdLine.h"
 #include "klee/Expr/Expr.h"
 #include "klee/Internal/ADT/KTest.h"
 #include "klee/Internal/ADT/TreeStream.h"
+#include "klee/Internal/Support/BlockCompression.h"
 #include "klee/Internal/Support/Debug.h"
 #include "klee/Internal/Support/ErrorHandling.h"
 #include "klee/Internal/Support/FileHandling.h"
 #include "klee/Internal/Support/ModuleUtil.h"
+#include "klee/Internal/Support/PathBuffer.h"
 #include "klee/Internal/Support/PrintVersion.h"
+#include "klee/Internal/Support/WorkQueue.h"
 #include "klee/Internal/System/Time.h"
 #include "klee/Interpreter.h"
 #include "klee/OptionCategories.h"
@@ -37,6 +41,7 @@
 #include "llvm/Support/Errno.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MD5.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/raw_ostream.h"
@@ -52,14 +57,18 @@
 #endif
 
 #include <dirent.h>
+#include <fcntl.h>
 #include <signal.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cerrno>
 #include <ctime>
 #include <fstream>
+#include <iostream>
 #include <iomanip>
 #include <iterator>
 #include <sstream>
@@ -125,12 +134,42 @@ namespace {
                 cl::init(false),
                 cl::cat(TestCaseCat));
 
+  cl::opt<unsigned>
+  TestWriterThreads("test-writer-threads",
+                    cl::desc("Number of threads that format and write the test case files, so that the interpreter does not wait for them (default=0, i.e. the interpreter writes them)"),
+                    cl::init(0),
+                    cl::cat(TestCaseCat));
+
   cl::opt<bool>
   WritePaths("write-paths",
              cl::desc("Write .path files for each test case (default=false)"),
              cl::init(false),
              cl::cat(TestCaseCat));
 
+  cl::opt<PathFileVersion>
+  PathFormat("path-format",
+             cl::desc("On-disk format of written .path files (default=v1)"),
+             cl::values(clEnumValN(PathFileV1, "v1",
+                                   "Raw PathEntry array (no header)"),
+                        clEnumValN(PathFileV2, "v2",
+                                   "Versioned, bit-packed/varint encoding")),
+             cl::init(PathFileV1),
+             cl::cat(TestCaseCat));
+
+  cl::opt<bool>
+  CopyPathFiles("copy-path-files",
+                cl::desc("Write v1 .path files by copying the recorded bytes within the kernel instead of reading the path into memory (default=true)"),
+                cl::init(true),
+                cl::cat(TestCaseCat));
+
+#ifdef HAVE_ZLIB_H
+  cl::opt<bool>
+  CompressPaths("compress-paths",
+                cl::desc("Write .path and .path_datarec files, also those of -job-dir, as seekable blocks compressed with zlib; replay reads them either way (default=false)"),
+                cl::init(false),
+                cl::cat(TestCaseCat));
+#endif
+
   cl::opt<bool>
   WriteSymPaths("write-sym-paths",
                 cl::desc("Write .sym.path files for each test case (default=false)"),
@@ -155,6 +194,16 @@ namespace {
               cl::init(false),
               cl::cat(StartCat));
 
+  cl::opt<std::string>
+  ModuleCacheDir("module-cache-dir",
+                 cl::desc("Keep the linked and prepared module in this "
+                          "directory, keyed by the input bitcode, the runtime "
+                          "libraries and the options that shape the module, "
+                          "and load it from there instead of preparing it "
+                          "again on later runs (default=off)"),
+                 cl::value_desc("directory"),
+                 cl::cat(StartCat));
+
   cl::opt<std::string>
   RunInDir("run-in-dir",
            cl::desc("Change to the given directory before starting execution (default=location of tested file)."),
@@ -275,6 +324,76 @@ namespace {
                  cl::value_desc("path file"),
                  cl::cat(ReplayCat));
 
+  cl::list<std::string>
+  ReplayConsensusPath("replay-consensus-path",
+                      cl::desc("Further path files recorded for the same "
+                               "failure along the same control flow. Their "
+                               "DATAREC entries are merged with those of "
+                               "-replay-path, so that the values recorded by "
+                               "all of them are used in one replay. Where "
+                               "traces recorded the same instance, the value "
+                               "of the first one given is used. Can be "
+                               "specified multiple times"),
+                      cl::value_desc("path file"),
+                      cl::cat(ReplayCat));
+
+  cl::opt<unsigned>
+  ReplayWindow("replay-window",
+               cl::desc("Keep only about this many MB of a block compressed "
+                        "path file decompressed on each side of the replay "
+                        "position, so that very long traces replay in "
+                        "bounded memory. Entries that are read again later, "
+                        "e.g. for divergence reports, are decompressed "
+                        "again. 0 keeps the whole trace (default=0)"),
+               cl::init(0),
+               cl::cat(ReplayCat));
+
+  cl::opt<bool>
+  ReplayServe("replay-serve",
+              cl::desc("After replaying -replay-path, read further path files "
+                       "from stdin (one per line) and replay them in the same "
+                       "process, resuming from -replay-checkpoint-interval "
+                       "snapshots where the traces share a prefix. The "
+                       "module is loaded and prepared once for all of them. "
+                       "See -replay-serve-workers to replay several at a "
+                       "time (default=false)"),
+              cl::init(false),
+              cl::cat(ReplayCat));
+
+  cl::opt<unsigned>
+  ReplayServeWorkers("replay-serve-workers",
+                     cl::desc("With -replay-serve, replay each path file read "
+                              "from stdin in a worker process forked off the "
+                              "prepared one, up to this many at a time. Each "
+                              "worker has its own solver, statistics and "
+                              "output in a worker<N> subdirectory of the "
+                              "output directory, and starts from the "
+                              "checkpoints of the first replay only "
+                              "(default=1, replay in this process)"),
+                     cl::init(1),
+                     cl::cat(ReplayCat));
+
+  cl::opt<std::string>
+  JobDir("job-dir",
+         cl::desc("Share the exploration between the processes, e.g. on "
+                  "several nodes, that use the same directory DIR on a "
+                  "shared file system. Each one claims .path jobs from "
+                  "DIR/queue, explores past them with -replay-path-prefix "
+                  "and exports the states beyond -export-frontier-states "
+                  "(default=16 here) as new jobs, until no job is left "
+                  "queued or running. One process has to be started with "
+                  "-job-dir-seed. Implies -write-paths"),
+         cl::value_desc("directory"),
+         cl::cat(ReplayCat));
+
+  cl::opt<bool>
+  JobDirSeed("job-dir-seed",
+             cl::desc("Create the -job-dir queue and explore the program "
+                      "(or -replay-path) first, then claim jobs like the "
+                      "other processes (default=false)"),
+             cl::init(false),
+             cl::cat(ReplayCat));
+
 
 
   cl::list<std::string>
@@ -287,6 +406,13 @@ namespace {
              cl::desc("Directory with .ktest files to be used as seeds"),
              cl::cat(SeedingCat));
 
+  cl::list<std::string>
+  SeedStream("seed-stream",
+             cl::desc("File or FIFO with .ktest files one after the other, "
+                      "as written by gen-random-bout --stream, to be used "
+                      "as seeds ('-' for stdin)"),
+             cl::cat(SeedingCat));
+
   cl::opt<std::string>
   SaveFinalModulePath("save-final-module-path",
                       cl::desc("Path to save the linked module"),
@@ -357,8 +483,18 @@ private:
   SmallString<128> m_outputDirectory;
 
   unsigned m_numTotalTests;     // Number of tests received from the interpreter
-  unsigned m_numGeneratedTests; // Number of tests successfully generated
+  std::atomic<unsigned> m_numGeneratedTests; // Number of tests successfully generated
   unsigned m_pathsExplored; // number of paths explored so far
+  bool m_isWorker; // whether this is a -parallel-workers process forked off
+  unsigned m_numExportedJobs; // number of jobs written to -job-dir
+  std::unique_ptr<WorkQueue> m_testWriter; // writes the test case files
+
+  /// Open the file of test case id and call write on it, on a writer thread
+  /// if -test-writer-threads is set. write may only use what it owns.
+  void writeTestFile(const std::string &suffix, unsigned id,
+                     std::function<void(llvm::raw_ostream &)> write);
+  void writeStatsPaths(unsigned id, int64_t total_queryCost_us,
+                       std::vector<ExecutionStats> &statsPaths);
 
   // used for writing .ktest files
   int m_argc;
@@ -379,6 +515,8 @@ public:
 
   void processTestCase(const ExecutionState &state, bool getSymbolicSolution,
                        const char *errorMessage, const char *errorSuffix);
+  /// Wait until the files of all the test cases so far are written
+  void flushTestCases() { m_testWriter->drain(); }
   void setStartTime(std::time_t t) { start_time = t; }
   std::time_t getStartTime() const { return start_time; }
   void reportInEngineTime() const {
@@ -386,15 +524,50 @@ public:
     klee_message("In-engine time:%lu\n", endTime - start_time);
   }
 
+  void prepareWorkerFork();
+  void startWorker(unsigned id);
+  bool isWorker() const { return m_isWorker; }
+
+  bool exportJob(const ExecutionState &state);
+  /// Move a queued job of -job-dir to its running jobs.
+  /// \return the path file of the claimed job, empty if none is queued
+  static std::string claimJob();
+  static void finishJob(const std::string &pathFile);
+  /// Whether -job-dir is seeded and no job is queued or running any more
+  static bool jobsDone();
+
+  /// Encode the .path and .path_datarec files of the trace of state
+  void encodePaths(const ExecutionState &state, std::string &path,
+                   std::string &dataRec);
+  void encodeDataRec(const ExecutionState &state, std::string &dataRec);
+  /// Whether .path files are copied from paths.ts rather than encoded
+  bool copiesPaths() const {
+    return CopyPathFiles && PathFormat == PathFileV1 && !compressesPaths();
+  }
+  static bool compressesPaths() {
+#ifdef HAVE_ZLIB_H
+    return CompressPaths;
+#else
+    return false;
+#endif
+  }
+  /// Write the .path file of the trace of state to fd, see copiesPaths
+  bool copyPath(const ExecutionState &state, int fd);
+
   std::string getOutputFilename(const std::string &filename);
   std::unique_ptr<llvm::raw_fd_ostream> openOutputFile(const std::string &filename);
   std::string getTestFilename(const std::string &suffix, unsigned id);
   std::unique_ptr<llvm::raw_fd_ostream> openTestFile(const std::string &suffix, unsigned id);
 
-  // load a .path file
+  // load a .path file (and its optional .path_datarec)
   static void loadPathFile(std::string name,
-                           std::vector<PathEntry> &buffer,
-                           std::vector<DataRecEntry> &dataRecEntries);
+                           std::unique_ptr<PathEntryBuffer> &buffer,
+                           std::unique_ptr<DataRecBuffer> &dataRecEntries);
+  /// Replace the loaded trace by its merge with the given path files of the
+  /// same failure, see mergeReplayTraces
+  static void mergePathFiles(const std::vector<std::string> &names,
+                             std::unique_ptr<PathEntryBuffer> &buffer,
+                             std::unique_ptr<DataRecBuffer> &dataRecEntries);
 
   static void getKTestFilesInDir(std::string directoryPath,
                                  std::vector<std::string> &results);
@@ -406,7 +579,9 @@ KleeHandler::KleeHandler(int argc, char **argv)
     : m_interpreter(0), m_pathWriter(0), m_pathDataRecWriter(0), m_symPathWriter(0),
       m_stackPathWriter(0), m_consPathWriter(0), m_statsPathWriter(0),
       m_outputDirectory(), m_numTotalTests(0), m_numGeneratedTests(0),
-      m_pathsExplored(0), m_argc(argc), m_argv(argv) {
+      m_pathsExplored(0), m_isWorker(false), m_numExportedJobs(0),
+      m_testWriter(new WorkQueue(TestWriterThreads, 16 * TestWriterThreads)),
+      m_argc(argc), m_argv(argv) {
 
   // create output directory (OutputDir or "klee-out-<i>")
   bool dir_given = OutputDir != "";
@@ -474,6 +649,7 @@ KleeHandler::KleeHandler(int argc, char **argv)
 }
 
 KleeHandler::~KleeHandler() {
+  m_testWriter.reset();
   delete m_pathWriter;
   delete m_pathDataRecWriter;
   delete m_symPathWriter;
@@ -521,6 +697,54 @@ void KleeHandler::setInterpreter(Interpreter *i) {
   }
 }
 
+void KleeHandler::prepareWorkerFork() {
+  m_testWriter->drain();
+  for (TreeStreamWriter *w : {m_pathWriter, m_pathDataRecWriter, m_symPathWriter,
+                              m_stackPathWriter, m_consPathWriter,
+                              m_statsPathWriter})
+    if (w)
+      w->flush();
+  m_infoFile->flush();
+  llvm::outs().flush();
+  fflush(stdout);
+  fflush(klee_warning_file);
+  fflush(klee_message_file);
+}
+
+void KleeHandler::startWorker(unsigned id) {
+  SmallString<128> directory = m_outputDirectory;
+  llvm::sys::path::append(directory, "worker" + std::to_string(id));
+  if (mkdir(directory.c_str(), 0775) < 0)
+    klee_error("cannot create \"%s\": %s", directory.c_str(), strerror(errno));
+  SmallString<128> parent = m_outputDirectory;
+  m_outputDirectory = directory;
+  m_isWorker = true;
+  m_testWriter->restartInChild();
+
+  // the streams opened by the states of the parent have to stay readable
+  const std::pair<TreeStreamWriter *, const char *> writers[] = {
+      {m_pathWriter, "paths.ts"},
+      {m_pathDataRecWriter, "paths_datarec.ts"},
+      {m_symPathWriter, "symPaths.ts"},
+      {m_stackPathWriter, "stackPaths.ts"},
+      {m_consPathWriter, "consPaths.ts"},
+      {m_statsPathWriter, "statsPaths.ts"}};
+  for (const auto &w : writers)
+    if (w.first && !w.first->reopenInChild(getOutputFilename(w.second)))
+      klee_error("cannot copy \"%s\" for worker %u", w.second, id);
+
+  fclose(klee_warning_file);
+  fclose(klee_message_file);
+  std::string file_path = getOutputFilename("warnings.txt");
+  if ((klee_warning_file = fopen(file_path.c_str(), "w")) == NULL)
+    klee_error("cannot open file \"%s\": %s", file_path.c_str(), strerror(errno));
+  file_path = getOutputFilename("messages.txt");
+  if ((klee_message_file = fopen(file_path.c_str(), "w")) == NULL)
+    klee_error("cannot open file \"%s\": %s", file_path.c_str(), strerror(errno));
+  m_infoFile = openOutputFile("info");
+  *m_infoFile << "Worker " << id << " of " << parent << '\n';
+}
+
 std::string KleeHandler::getOutputFilename(const std::string &filename) {
   SmallString<128> path = m_outputDirectory;
   llvm::sys::path::append(path,filename);
@@ -555,7 +779,7 @@ KleeHandler::openTestFile(const std::string &suffix, unsigned id) {
 
 #define FMT_BUF_SIZE 512
 static const char *get_fmt_buf(const char *fmt, ...) {
-  static char buf[FMT_BUF_SIZE];
+  static thread_local char buf[FMT_BUF_SIZE];
   va_list args;
   va_start(args, fmt);
   std::vsnprintf(buf, sizeof(buf), fmt, args);
@@ -567,6 +791,154 @@ static inline const char *double2percent(double f) {
   return get_fmt_buf("%0.2f%%", f*100);
 }
 
+void KleeHandler::encodePaths(const ExecutionState &state, std::string &path,
+                              std::string &dataRec) {
+  std::vector<PathEntry> concreteBranches;
+  m_pathWriter->readStream(m_interpreter->getPathStreamID(state),
+                           concreteBranches);
+  encodePathFile(concreteBranches, PathFormat, path);
+#ifdef HAVE_ZLIB_H
+  if (CompressPaths) {
+    std::string compressed;
+    compressBlocks(path, compressed);
+    path.swap(compressed);
+  }
+#endif
+  encodeDataRec(state, dataRec);
+}
+
+void KleeHandler::encodeDataRec(const ExecutionState &state,
+                                std::string &dataRec) {
+  std::vector<DataRecEntry> dataRecEntries;
+  m_pathDataRecWriter->readStream(m_interpreter->getPathDataRecStreamID(state),
+                                  dataRecEntries);
+  encodeDataRecFile(dataRecEntries,
+                    [this](uint32_t dataRecID) {
+                      return m_interpreter->getDataRecUniqueID(dataRecID);
+                    },
+                    dataRec);
+#ifdef HAVE_ZLIB_H
+  if (CompressPaths) {
+    std::string compressed;
+    compressBlocks(dataRec, compressed);
+    dataRec.swap(compressed);
+  }
+#endif
+}
+
+bool KleeHandler::copyPath(const ExecutionState &state, int fd) {
+  // a v1 .path is the raw PathEntry array, as in the tree stream
+  return m_pathWriter->copyStream(m_interpreter->getPathStreamID(state),
+                                  sizeof(PathEntry), fd);
+}
+
+static std::string getJobDirPath(const std::string &name) {
+  SmallString<128> path(JobDir);
+  llvm::sys::path::append(path, name);
+  return path.str();
+}
+
+// Write path through a temporary file, so that no other process ever sees
+// the file partially written.
+static bool writeJobFile(const std::string &path,
+                         const std::function<bool(int fd)> &write) {
+  int fd;
+  SmallString<128> tmpPath;
+  if (auto EC = llvm::sys::fs::createUniqueFile(
+          getJobDirPath("tmp-%%%%%%%%"), fd, tmpPath)) {
+    klee_warning("unable to export job %s: %s", path.c_str(),
+                 EC.message().c_str());
+    return false;
+  }
+  bool written = write(fd);
+  if (close(fd) < 0 || !written) {
+    klee_warning("unable to export job %s: %s", path.c_str(), strerror(errno));
+    llvm::sys::fs::remove(tmpPath);
+    return false;
+  }
+  if (auto EC = llvm::sys::fs::rename(tmpPath, path)) {
+    klee_warning("unable to export job %s: %s", path.c_str(),
+                 EC.message().c_str());
+    llvm::sys::fs::remove(tmpPath);
+    return false;
+  }
+  return true;
+}
+
+bool KleeHandler::exportJob(const ExecutionState &state) {
+  if (JobDir.empty() || !m_pathWriter)
+    return false;
+  std::string path, dataRec;
+  if (copiesPaths())
+    encodeDataRec(state, dataRec);
+  else
+    encodePaths(state, path, dataRec);
+
+  char hostname[256];
+  if (gethostname(hostname, sizeof(hostname)) < 0)
+    strcpy(hostname, "localhost");
+  hostname[sizeof(hostname) - 1] = '\0';
+  SmallString<128> name(getJobDirPath("queue"));
+  llvm::sys::path::append(name, hostname + ("-" + std::to_string(getpid())) +
+                                    "-" + std::to_string(++m_numExportedJobs) +
+                                    ".path");
+  // the .path_datarec is in place once the .path can be claimed
+  auto writeData = [](const std::string &data) {
+    return [&data](int fd) {
+      llvm::raw_fd_ostream fs(fd, /*shouldClose=*/false);
+      fs << data;
+      fs.flush();
+      return !fs.has_error();
+    };
+  };
+  if (!writeJobFile((name + "_datarec").str(), writeData(dataRec)))
+    return false;
+  if (copiesPaths())
+    return writeJobFile(name.str(),
+                        [&](int fd) { return copyPath(state, fd); });
+  return writeJobFile(name.str(), writeData(path));
+}
+
+std::string KleeHandler::claimJob() {
+  std::vector<std::string> queued;
+  std::error_code ec;
+  for (llvm::sys::fs::directory_iterator i(getJobDirPath("queue"), ec), e;
+       i != e && !ec; i.increment(ec))
+    if (llvm::sys::path::extension(i->path()) == ".path")
+      queued.push_back(i->path());
+  // the oldest jobs of a process first
+  std::sort(queued.begin(), queued.end());
+
+  for (const std::string &job : queued) {
+    SmallString<128> running(getJobDirPath("running"));
+    llvm::sys::path::append(running, std::to_string(getpid()) + "-" +
+                                         llvm::sys::path::filename(job).str());
+    // only one of the processes racing for the job can rename it
+    if (llvm::sys::fs::rename(job, running))
+      continue;
+    llvm::sys::fs::rename(job + "_datarec", running + "_datarec");
+    return running.str();
+  }
+  return "";
+}
+
+void KleeHandler::finishJob(const std::string &pathFile) {
+  llvm::sys::fs::remove(pathFile);
+  llvm::sys::fs::remove(pathFile + "_datarec");
+}
+
+bool KleeHandler::jobsDone() {
+  // Jobs are only queued by running ones, so with nothing running, nothing
+  // can be queued after the queue is found empty.
+  std::error_code ec;
+  for (const char *dir : {"running", "queue"}) {
+    llvm::sys::fs::directory_iterator i(getJobDirPath(dir), ec), e;
+    if (ec || i != e)
+      return false;
+  }
+  return true;
+}
+
 /* Outputs all files (.ktest, .kquery, .cov etc.) describing a test case */
 void KleeHandler::processTestCase(const ExecutionState &state,
                                   bool getSymbolicSolution,
@@ -576,6 +948,8 @@ void KleeHandler::processTestCase(const ExecutionState &state,
   if (!WriteNone) {
     unsigned id = ++m_numTotalTests;
     const auto start_time = time::getWallTime();
+    // Everything that needs the state, the solver or the tree streams is
+    // gathered here; the writer threads only get copies.
     if (getSymbolicSolution) {
       std::vector<std::pair<std::string, std::vector<unsigned char>>> out;
       bool success = m_interpreter->getSymbolicSolution(state, out);
@@ -583,72 +957,78 @@ void KleeHandler::processTestCase(const ExecutionState &state,
       if (!success)
         klee_warning("unable to get symbolic solution, losing test case");
       else {
-        KTest b;
-        b.numArgs = m_argc;
-        b.args = m_argv;
-        b.symArgvs = 0;
-        b.symArgvLen = 0;
-        b.numObjects = out.size();
-        b.objects = new KTestObject[b.numObjects];
-        assert(b.objects);
-        for (unsigned i = 0; i < b.numObjects; i++) {
-          KTestObject *o = &b.objects[i];
-          o->name = const_cast<char *>(out[i].first.c_str());
-          o->numBytes = out[i].second.size();
-          o->bytes = new unsigned char[o->numBytes];
-          assert(o->bytes);
-          std::copy(out[i].second.begin(), out[i].second.end(), o->bytes);
-        }
+        // counted when handed off, so that -max-tests halts in time
+        ++m_numGeneratedTests;
+        m_testWriter->submit([this, id, out] {
+          KTest b;
+          b.numArgs = m_argc;
+          b.args = m_argv;
+          b.symArgvs = 0;
+          b.symArgvLen = 0;
+          b.numObjects = out.size();
+          b.objects = new KTestObject[b.numObjects];
+          assert(b.objects);
+          for (unsigned i = 0; i < b.numObjects; i++) {
+            KTestObject *o = &b.objects[i];
+            o->name = const_cast<char *>(out[i].first.c_str());
+            o->numBytes = out[i].second.size();
+            o->bytes = new unsigned char[o->numBytes];
+            assert(o->bytes);
+            std::copy(out[i].second.begin(), out[i].second.end(), o->bytes);
+          }
 
-        if (!kTest_toFile(
-                &b, getOutputFilename(getTestFilename("ktest", id)).c_str())) {
-          klee_warning("unable to write output test case, losing it");
-        } else {
-          ++m_numGeneratedTests;
-        }
+          if (!kTest_toFile(
+                  &b, getOutputFilename(getTestFilename("ktest", id)).c_str())) {
+            klee_warning("unable to write output test case, losing it");
+            --m_numGeneratedTests;
+          }
 
-        for (unsigned i = 0; i < b.numObjects; i++)
-          delete[] b.objects[i].bytes;
-        delete[] b.objects;
+          for (unsigned i = 0; i < b.numObjects; i++)
+            delete[] b.objects[i].bytes;
+          delete[] b.objects;
+        });
       }
     }
 
     if (errorMessage) {
-      auto f = openTestFile(errorSuffix, id);
-      if (f)
-        *f << errorMessage;
+      std::string message = errorMessage;
+      writeTestFile(errorSuffix, id,
+                    [message](llvm::raw_ostream &f) { f << message; });
     }
 
     if (m_pathWriter) {
-      std::vector<PathEntry> concreteBranches;
-      m_pathWriter->readStream(m_interpreter->getPathStreamID(state),
-                               concreteBranches);
-      auto f = openTestFile("path", id);
-      if (f) {
-        for (const auto &pe : concreteBranches) {
-          serialize(*f, pe);
-        }
+      if (!m_pathWriter->good() || !m_pathDataRecWriter->good())
+        klee_warning_once(m_pathWriter,
+                          "writing paths.ts or paths_datarec.ts failed, "
+                          "the .path and .path_datarec files are truncated");
+      std::string path, dataRec;
+      if (copiesPaths()) {
+        // the tree stream is only read on this thread
+        std::string file = getOutputFilename(getTestFilename("path", id));
+        int fd = open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (fd < 0 || !copyPath(state, fd))
+          klee_warning("unable to write %s: %s", file.c_str(),
+                       strerror(errno));
+        if (fd >= 0)
+          close(fd);
+        encodeDataRec(state, dataRec);
+      } else {
+        encodePaths(state, path, dataRec);
+        writeTestFile("path", id, [path](llvm::raw_ostream &f) { f << path; });
       }
-      f->close();
       // data recording
-      std::vector<DataRecEntry> dataRecEntries;
-      m_pathDataRecWriter->readStream(m_interpreter->getPathDataRecStreamID(state),
-                                      dataRecEntries);
-      auto data_f = openTestFile("path_datarec", id);
-      if (data_f) {
-        for (const auto &dre: dataRecEntries) {
-          serialize(*data_f, dre);
-        }
-      }
-      data_f->close();
+      writeTestFile("path_datarec", id,
+                    [dataRec](llvm::raw_ostream &f) { f << dataRec; });
     }
 
+    // Expressions are reference counted without synchronization, so the
+    // constraints are printed on this thread.
     if (errorMessage || WriteKQueries) {
       std::string constraints;
       m_interpreter->getConstraintLog(state, constraints,Interpreter::KQUERY);
-      auto f = openTestFile("kquery", id);
-      if (f)
-        *f << constraints;
+      writeTestFile("kquery", id, [constraints](llvm::raw_ostream &f) {
+        f << constraints;
+      });
     }
 
     if (WriteCVCs) {
@@ -656,177 +1036,87 @@ void KleeHandler::processTestCase(const ExecutionState &state,
       // SMT-LIBv2 not CVC which is a bit confusing
       std::string constraints;
       m_interpreter->getConstraintLog(state, constraints, Interpreter::STP);
-      auto f = openTestFile("cvc", id);
-      if (f)
-        *f << constraints;
+      writeTestFile("cvc", id, [constraints](llvm::raw_ostream &f) {
+        f << constraints;
+      });
     }
 
     if (WriteSMT2s) {
       std::string constraints;
-        m_interpreter->getConstraintLog(state, constraints, Interpreter::SMTLIB2);
-        auto f = openTestFile("smt2", id);
-        if (f)
-          *f << constraints;
+      m_interpreter->getConstraintLog(state, constraints, Interpreter::SMTLIB2);
+      writeTestFile("smt2", id, [constraints](llvm::raw_ostream &f) {
+        f << constraints;
+      });
     }
 
     if (m_symPathWriter) {
       std::vector<char> symbolicBranches;
       m_symPathWriter->readStream(m_interpreter->getSymbolicPathStreamID(state),
                                   symbolicBranches);
-      auto f = openTestFile("sym.path", id);
-      if (f) {
+      writeTestFile("sym.path", id, [symbolicBranches](llvm::raw_ostream &f) {
         for (const auto &branch : symbolicBranches) {
-          *f << branch << '\n';
+          f << branch << '\n';
         }
-      }
+      });
     }
     
     if (m_stackPathWriter) {
       std::vector<StringInstStats> stackPaths;
       m_stackPathWriter->readStream(m_interpreter->getStackPathStreamID(state), stackPaths);
-      auto f = openTestFile("stack.path", id);
-      if (f) {
+      writeTestFile("stack.path", id, [stackPaths](llvm::raw_ostream &f) {
         unsigned i = 0;
         for (const auto s : stackPaths) {
-          *f << i++ << " Instr: " << s.instcnt << '\n'
-             << s.str << '\n';
+          f << i++ << " Instr: " << s.instcnt << '\n'
+            << s.str << '\n';
         }
-      }
+      });
     }
     
     if (m_consPathWriter) {
       std::vector<StringInstStats> consPaths;
       m_consPathWriter->readStream(m_interpreter->getConsPathStreamID(state), 
                                     consPaths);
-      auto f = openTestFile("cons.path", id);
-      if (f) {
+      writeTestFile("cons.path", id, [consPaths](llvm::raw_ostream &f) {
         for (const auto cs : consPaths) {
-          *f << "Instr: " << cs.instcnt << '\n'
-             << "New: " << cs.str << '\n';
+          f << "Instr: " << cs.instcnt << '\n'
+            << "New: " << cs.str << '\n';
         }
-      }
+      });
     }
 
-    // summary file
-    auto summary_f = openTestFile("summary", id);
-    int64_t fork_queryCost_us = state.fork_queryCost.toMicroseconds();
-    *summary_f <<
-      "Fork/Total queryCost: " << get_fmt_buf("%d / %d (%0.2f%%)\n", fork_queryCost_us, total_queryCost_us, (double)(fork_queryCost_us)/total_queryCost_us*100);
-    dumpStatisticsToLLVMrawos(*summary_f);
+    // summary file, of the statistics as of now
+    std::string summary;
+    {
+      llvm::raw_string_ostream summary_f(summary);
+      int64_t fork_queryCost_us = state.fork_queryCost.toMicroseconds();
+      summary_f <<
+        "Fork/Total queryCost: " << get_fmt_buf("%d / %d (%0.2f%%)\n", fork_queryCost_us, total_queryCost_us, (double)(fork_queryCost_us)/total_queryCost_us*100);
+      dumpStatisticsToLLVMrawos(summary_f);
+    }
+    writeTestFile("summary", id,
+                  [summary](llvm::raw_ostream &f) { f << summary; });
 
     if (m_statsPathWriter) {
-      
-      typedef struct queryCostSum {
-        std::vector<uint64_t> instr_cnt;
-        std::string llvmIR;
-        uint64_t hit_time = 0;
-        int64_t query_cost_sum = 0;
-        int64_t query_increment_cost_sum = 0;
-        double queryCost_percent_sum = 0;
-        double queryCost_increment_percent_sum = 0;
-      } queryCostSum;
-      
-      std::map<std::string, queryCostSum> fileLoc_queryCost_map;
-      
       std::vector<struct ExecutionStats> statsPaths;
       m_statsPathWriter->readStream(m_interpreter->getStatsPathStreamID(state), 
                                     statsPaths);
-      auto f = openTestFile("stats.path", id);
-      auto f_sum = openTestFile("sum.stats.path", id);
-      auto f_sum_increment = openTestFile("sum.increment.stats.path", id);
-      auto cdf_f = openTestFile("cdf", id);
-      *cdf_f << "# query_increment accumulated to 1.00\n";
-      if (f) {
-        auto last_inst_iter = max_element(statsPaths.begin(), statsPaths.end(), [](auto a, auto b){return a.instructions_cnt < b.instructions_cnt;});
-        int64_t final_queryCost = (last_inst_iter == statsPaths.end())? 0 : last_inst_iter->queryCost_us;
-        sort(statsPaths.begin(), statsPaths.end(), [](auto a, auto b){return a.queryCost_increment_us > b.queryCost_increment_us;});
-        double queryCost_acc = 0.0;
-        for (const auto exs : statsPaths) {
-          double queryCost_percent = ((double)(exs.queryCost_us)/total_queryCost_us);
-          double queryCost_increment_percent = ((double)(exs.queryCost_increment_us)/final_queryCost);
-          *f << "Instr " << exs.instructions_cnt << '\n'
-             << "llvm_ir: " << exs.llvm_inst_str << '\n'
-             << "file_loc: " << exs.file_loc << '\n'
-             << "queryCost: " << exs.queryCost_us<< " / " << total_queryCost_us
-             << " (" << double2percent(queryCost_percent) << ")\n"
-             << "queryCostIncrement: " << exs.queryCost_increment_us<< " / " << final_queryCost
-             << " (" << double2percent(queryCost_increment_percent) << ")\n\n";
-          queryCost_acc += queryCost_increment_percent;
-          *cdf_f << get_fmt_buf("%f", queryCost_acc) << '\n';
-          
-          queryCostSum* costSum = &fileLoc_queryCost_map[exs.file_loc];
-          if (costSum->hit_time == 0)
-            costSum->llvmIR = exs.llvm_inst_str;
-          costSum->instr_cnt.push_back(exs.instructions_cnt);
-          costSum->hit_time++;
-          costSum->query_cost_sum += exs.queryCost_us;
-          costSum->query_increment_cost_sum += exs.queryCost_increment_us;
-          costSum->queryCost_percent_sum += queryCost_percent;
-          costSum->queryCost_increment_percent_sum += queryCost_increment_percent;
-        }
-        
-        if (f_sum) {
-          typedef std::function<bool(std::pair<std::string, queryCostSum>, std::pair<std::string, queryCostSum>)> ComparatorCost;
-          ComparatorCost compFunctor =
-        			[](std::pair<std::string, queryCostSum> elem1 ,std::pair<std::string, queryCostSum> elem2)
-        			{
-        				return elem1.second.query_cost_sum > elem2.second.query_cost_sum;
-        			};
-          
-          std::set<std::pair<std::string, queryCostSum>, ComparatorCost> setOfCost(
-    			fileLoc_queryCost_map.begin(), fileLoc_queryCost_map.end(), compFunctor);
-          
-          for (auto element : setOfCost) {
-            *f_sum << "Instr: ";
-            for (auto cnt: element.second.instr_cnt)
-              *f_sum << cnt << " ";
-            *f_sum << '\n' << "hit_time: " << element.second.hit_time << '\n'
-               << "llvm_ir: " << element.second.llvmIR << '\n'
-               << "file_loc: " << element.first << '\n'
-               << "queryCost: " << element.second.query_cost_sum << " / " << total_queryCost_us
-               << " (" << double2percent(element.second.queryCost_percent_sum) << ")\n"
-               << "queryCostIncrement: " << element.second.query_increment_cost_sum << " / " << final_queryCost
-               << " (" << double2percent(element.second.queryCost_increment_percent_sum) << ")\n\n";
-          }
-        }
-        if (f_sum_increment) {
-          typedef std::function<bool(std::pair<std::string, queryCostSum>, std::pair<std::string, queryCostSum>)> ComparatorCost;
-          ComparatorCost compFunctor =
-              [](std::pair<std::string, queryCostSum> elem1 ,std::pair<std::string, queryCostSum> elem2)
-              {
-                return elem1.second.query_increment_cost_sum > elem2.second.query_increment_cost_sum;
-              };
-          
-          std::set<std::pair<std::string, queryCostSum>, ComparatorCost> setOfCost(
-          fileLoc_queryCost_map.begin(), fileLoc_queryCost_map.end(), compFunctor);
-          
-          for (auto element : setOfCost) {
-            *f_sum_increment << "Instr: ";
-            for (auto cnt: element.second.instr_cnt)
-              *f_sum_increment << cnt << " ";
-            *f_sum_increment << '\n' << "hit_time: " << element.second.hit_time << '\n'
-               << "llvm_ir: " << element.second.llvmIR << '\n'
-               << "file_loc: " << element.first << '\n'
-               << "queryCost: " << element.second.query_cost_sum << " / " << total_queryCost_us
-               << " (" << double2percent(element.second.queryCost_percent_sum) << ")\n"
-               << "queryCostIncrement: " << element.second.query_increment_cost_sum << " / " << final_queryCost
-               << " (" << double2percent(element.second.queryCost_increment_percent_sum) << ")\n\n";
-          }
-        }
-      }
+      m_testWriter->submit([this, id, total_queryCost_us, statsPaths]() mutable {
+        writeStatsPaths(id, total_queryCost_us, statsPaths);
+      });
     }
 
     if (WriteCov) {
+      // the file names are owned by the interpreter, which outlives the
+      // writer threads
       std::map<const std::string*, std::set<unsigned> > cov;
       m_interpreter->getCoveredLines(state, cov);
-      auto f = openTestFile("cov", id);
-      if (f) {
+      writeTestFile("cov", id, [cov](llvm::raw_ostream &f) {
         for (const auto &entry : cov) {
           for (const auto &line : entry.second) {
-            *f << *entry.first << ':' << line << '\n';
+            f << *entry.first << ':' << line << '\n';
           }
         }
-      }
+      });
     }
 
     if (m_numGeneratedTests == MaxTests)
@@ -834,65 +1124,193 @@ void KleeHandler::processTestCase(const ExecutionState &state,
 
     if (WriteTestInfo) {
       time::Span elapsed_time(time::getWallTime() - start_time);
-      auto f = openTestFile("info", id);
-      if (f)
-        *f << "Time to generate test case: " << elapsed_time << '\n';
+      writeTestFile("info", id, [elapsed_time](llvm::raw_ostream &f) {
+        f << "Time to generate test case: " << elapsed_time << '\n';
+      });
     }
 
     // Dump Suffix Function List
     if (DumpFunctionListSuffixLen > 0 && !state.func_inst_map.empty()) {
-      auto f = openTestFile("suffix_func_list.txt", id);
-      if (f) {
-        for (auto &e : state.func_inst_map) {
-          const std::string &funcname = e.first;
-          const unsigned int &inst = e.second;
-          // FIXME: the DumpFunctionListSuffixLen specifies the number of
-          // instructions from all component (libc, POSIX, app)
-          // I can refactor (track number of executed instructions per frame)
-          // the instruction counting stats to filter the suffix by component as
-          // well.
-          if (inst + DumpFunctionListSuffixLen >= state.steppedInstructions)
-            *f << funcname << '\n';
-        }
+      std::vector<std::string> suffix;
+      for (auto &e : state.func_inst_map) {
+        const std::string &funcname = e.first;
+        const unsigned int &inst = e.second;
+        // FIXME: the DumpFunctionListSuffixLen specifies the number of
+        // instructions from all component (libc, POSIX, app)
+        // I can refactor (track number of executed instructions per frame)
+        // the instruction counting stats to filter the suffix by component as
+        // well.
+        if (inst + DumpFunctionListSuffixLen >= state.steppedInstructions)
+          suffix.push_back(funcname);
       }
+      writeTestFile("suffix_func_list.txt", id,
+                    [suffix](llvm::raw_ostream &f) {
+                      for (const std::string &funcname : suffix)
+                        f << funcname << '\n';
+                    });
     }
   } // if (!WriteNone)
 
   if (errorMessage && OptExitOnError) {
+    flushTestCases();
     m_interpreter->prepareForEarlyExit();
     klee_error("EXITING ON ERROR:\n%s\n", errorMessage);
   }
 }
 
+void KleeHandler::writeTestFile(const std::string &suffix, unsigned id,
+                                std::function<void(llvm::raw_ostream &)> write) {
+  m_testWriter->submit([this, suffix, id, write] {
+    if (auto f = openTestFile(suffix, id))
+      write(*f);
+  });
+}
+
+void KleeHandler::writeStatsPaths(unsigned id, int64_t total_queryCost_us,
+                                  std::vector<ExecutionStats> &statsPaths) {
+  typedef struct queryCostSum {
+    std::vector<uint64_t> instr_cnt;
+    std::string llvmIR;
+    uint64_t hit_time = 0;
+    int64_t query_cost_sum = 0;
+    int64_t query_increment_cost_sum = 0;
+    double queryCost_percent_sum = 0;
+    double queryCost_increment_percent_sum = 0;
+  } queryCostSum;
+
+  std::map<std::string, queryCostSum> fileLoc_queryCost_map;
+
+  auto f = openTestFile("stats.path", id);
+  auto f_sum = openTestFile("sum.stats.path", id);
+  auto f_sum_increment = openTestFile("sum.increment.stats.path", id);
+  auto cdf_f = openTestFile("cdf", id);
+  *cdf_f << "# query_increment accumulated to 1.00\n";
+  if (f) {
+    auto last_inst_iter = max_element(statsPaths.begin(), statsPaths.end(), [](auto a, auto b){return a.instructions_cnt < b.instructions_cnt;});
+    int64_t final_queryCost = (last_inst_iter == statsPaths.end())? 0 : last_inst_iter->queryCost_us;
+    sort(statsPaths.begin(), statsPaths.end(), [](auto a, auto b){return a.queryCost_increment_us > b.queryCost_increment_us;});
+    double queryCost_acc = 0.0;
+    for (const auto exs : statsPaths) {
+      double queryCost_percent = ((double)(exs.queryCost_us)/total_queryCost_us);
+      double queryCost_increment_percent = ((double)(exs.queryCost_increment_us)/final_queryCost);
+      *f << "Instr " << exs.instructions_cnt << '\n'
+         << "llvm_ir: " << exs.llvm_inst_str << '\n'
+         << "file_loc: " << exs.file_loc << '\n'
+         << "queryCost: " << exs.queryCost_us<< " / " << total_queryCost_us
+         << " (" << double2percent(queryCost_percent) << ")\n"
+         << "queryCostIncrement: " << exs.queryCost_increment_us<< " / " << final_queryCost
+         << " (" << double2percent(queryCost_increment_percent) << ")\n\n";
+      queryCost_acc += queryCost_increment_percent;
+      *cdf_f << get_fmt_buf("%f", queryCost_acc) << '\n';
+      
+      queryCostSum* costSum = &fileLoc_queryCost_map[exs.file_loc];
+      if (costSum->hit_time == 0)
+        costSum->llvmIR = exs.llvm_inst_str;
+      costSum->instr_cnt.push_back(exs.instructions_cnt);
+      costSum->hit_time++;
+      costSum->query_cost_sum += exs.queryCost_us;
+      costSum->query_increment_cost_sum += exs.queryCost_increment_us;
+      costSum->queryCost_percent_sum += queryCost_percent;
+      costSum->queryCost_increment_percent_sum += queryCost_increment_percent;
+    }
+    
+    if (f_sum) {
+      typedef std::function<bool(std::pair<std::string, queryCostSum>, std::pair<std::string, queryCostSum>)> ComparatorCost;
+      ComparatorCost compFunctor =
+    			[](std::pair<std::string, queryCostSum> elem1 ,std::pair<std::string, queryCostSum> elem2)
+    			{
+    				return elem1.second.query_cost_sum > elem2.second.query_cost_sum;
+    			};
+      
+      std::set<std::pair<std::string, queryCostSum>, ComparatorCost> setOfCost(
+			fileLoc_queryCost_map.begin(), fileLoc_queryCost_map.end(), compFunctor);
+      
+      for (auto element : setOfCost) {
+        *f_sum << "Instr: ";
+        for (auto cnt: element.second.instr_cnt)
+          *f_sum << cnt << " ";
+        *f_sum << '\n' << "hit_time: " << element.second.hit_time << '\n'
+           << "llvm_ir: " << element.second.llvmIR << '\n'
+           << "file_loc: " << element.first << '\n'
+           << "queryCost: " << element.second.query_cost_sum << " / " << total_queryCost_us
+           << " (" << double2percent(element.second.queryCost_percent_sum) << ")\n"
+           << "queryCostIncrement: " << element.second.query_increment_cost_sum << " / " << final_queryCost
+           << " (" << double2percent(element.second.queryCost_increment_percent_sum) << ")\n\n";
+      }
+    }
+    if (f_sum_increment) {
+      typedef std::function<bool(std::pair<std::string, queryCostSum>, std::pair<std::string, queryCostSum>)> ComparatorCost;
+      ComparatorCost compFunctor =
+          [](std::pair<std::string, queryCostSum> elem1 ,std::pair<std::string, queryCostSum> elem2)
+          {
+            return elem1.second.query_increment_cost_sum > elem2.second.query_increment_cost_sum;
+          };
+      
+      std::set<std::pair<std::string, queryCostSum>, ComparatorCost> setOfCost(
+      fileLoc_queryCost_map.begin(), fileLoc_queryCost_map.end(), compFunctor);
+      
+      for (auto element : setOfCost) {
+        *f_sum_increment << "Instr: ";
+        for (auto cnt: element.second.instr_cnt)
+          *f_sum_increment << cnt << " ";
+        *f_sum_increment << '\n' << "hit_time: " << element.second.hit_time << '\n'
+           << "llvm_ir: " << element.second.llvmIR << '\n'
+           << "file_loc: " << element.first << '\n'
+           << "queryCost: " << element.second.query_cost_sum << " / " << total_queryCost_us
+           << " (" << double2percent(element.second.queryCost_percent_sum) << ")\n"
+           << "queryCostIncrement: " << element.second.query_increment_cost_sum << " / " << final_queryCost
+           << " (" << double2percent(element.second.queryCost_increment_percent_sum) << ")\n\n";
+      }
+    }
+  }
+}
+
 // load a .path file
+// Both files are memory-mapped, entries are decoded lazily during replay.
 void KleeHandler::loadPathFile(std::string name,
-                               std::vector<PathEntry> &buffer,
-                               std::vector<DataRecEntry> &dataRecEntries) {
-  std::ifstream f(name.c_str(), std::ios::in | std::ios::binary);
+                               std::unique_ptr<PathEntryBuffer> &buffer,
+                               std::unique_ptr<DataRecBuffer> &dataRecEntries) {
+  std::string error;
+  size_t window = (size_t)ReplayWindow << 20;
+  buffer = PathEntryBuffer::open(name, error, window);
+  if (!buffer)
+    klee_error("unable to open path file %s: %s", name.c_str(), error.c_str());
 
-  if (!f.good())
-    assert(0 && "unable to open path file");
+  // .path_datarec is optional. if the correponding .path has "DATAREC" record 
+  // but no .path_datarec provided here, Executor will complain later
+  dataRecEntries = DataRecBuffer::open(name + "_datarec", error, window);
+  if (!dataRecEntries)
+    dataRecEntries.reset(new DataRecBuffer());
+}
 
-  while (1) {
-    f.peek();
-    if (!f.good()) break;
-    PathEntry pe;
-    deserialize(f, pe);
-    buffer.push_back(pe);
+// merge further .path files of the same failure into the loaded one
+void KleeHandler::mergePathFiles(const std::vector<std::string> &names,
+                                 std::unique_ptr<PathEntryBuffer> &buffer,
+                                 std::unique_ptr<DataRecBuffer> &dataRecEntries) {
+  std::vector<std::unique_ptr<PathEntryBuffer>> paths;
+  std::vector<std::unique_ptr<DataRecBuffer>> dataRecs;
+  std::vector<ReplayTrace> traces{{buffer.get(), dataRecEntries.get()}};
+  for (const std::string &name : names) {
+    paths.emplace_back();
+    dataRecs.emplace_back();
+    loadPathFile(name, paths.back(), dataRecs.back());
+    traces.push_back({paths.back().get(), dataRecs.back().get()});
   }
-  f.close();
 
-  std::ifstream data_f((name + "_datarec").c_str(), std::ios::in | std::ios::binary);
-  // .path_datarec is optional. if the correponding .path has "DATAREC" record 
-  // but no .path_datarec provided here, Executor will complain later
-  while (1) {
-    data_f.peek();
-    if (!data_f.good()) break;
-    DataRecEntry dre;
-    deserialize(data_f, dre);
-    dataRecEntries.push_back(dre);
-  }
-  data_f.close();
+  std::vector<PathEntry> path;
+  std::vector<DataRecEntry> dataRec;
+  std::vector<std::string> idTable;
+  TraceMergeStats stats;
+  std::string error;
+  if (!mergeReplayTraces(traces, path, dataRec, idTable, stats, error))
+    klee_error("unable to merge path files: %s", error.c_str());
+  klee_message("merged %zu path files: %zu DATAREC entries added, %zu "
+               "shared, %zu of them with conflicting values",
+               traces.size(), stats.added, stats.shared, stats.conflicts);
+
+  buffer.reset(new PathEntryBuffer(std::move(path)));
+  dataRecEntries.reset(
+      new DataRecBuffer(std::move(dataRec), std::move(idTable)));
 }
 
 void KleeHandler::getKTestFilesInDir(std::string directoryPath,
@@ -955,6 +1373,73 @@ std::string KleeHandler::getRunTimeLibraryPath(const char *argv0) {
   return libDir.str();
 }
 
+/// Reads the seeds of -seed-file, -seed-dir and -seed-stream, in this
+/// order, only when the executor asks for them.
+class KTestSeedSource : public SeedSource {
+  std::vector<std::string> files;
+  size_t nextFile = 0;
+  /// The stream being read, SeedStream[nextStream]
+  FILE *stream = nullptr;
+  size_t nextStream = 0;
+  unsigned numStreamSeeds = 0;
+
+public:
+  explicit KTestSeedSource(std::vector<std::string> _files)
+      : files(std::move(_files)) {}
+  ~KTestSeedSource() override {
+    if (stream && stream != stdin)
+      fclose(stream);
+  }
+
+  size_t getNumFiles() const { return files.size(); }
+
+  void rewind() override {
+    if (nextStream || stream)
+      klee_warning("seed streams are only read by the first run");
+    nextFile = 0;
+  }
+
+  KTest *next() override {
+    if (nextFile < files.size()) {
+      const std::string &path = files[nextFile++];
+      KTest *out = kTest_fromFile(path.c_str());
+      if (!out) {
+        klee_error("unable to open: %s\n", path.c_str());
+      }
+      return out;
+    }
+    while (stream || nextStream < SeedStream.size()) {
+      const std::string &path = SeedStream[nextStream];
+      if (!stream) {
+        stream = path == "-" ? stdin : fopen(path.c_str(), "rb");
+        if (!stream) {
+          klee_error("unable to open: %s\n", path.c_str());
+        }
+        numStreamSeeds = 0;
+      }
+      int c = getc(stream);
+      if (c != EOF) {
+        ungetc(c, stream);
+        KTest *out = kTest_fromStream(stream);
+        if (!out) {
+          klee_error("invalid .ktest %u in seed stream: %s\n",
+                     numStreamSeeds + 1, path.c_str());
+        }
+        ++numStreamSeeds;
+        return out;
+      }
+      if (stream != stdin)
+        fclose(stream);
+      stream = nullptr;
+      ++nextStream;
+      if (!numStreamSeeds) {
+        klee_error("seed stream is empty: %s\n", path.c_str());
+      }
+    }
+    return nullptr;
+  }
+};
+
 //===----------------------------------------------------------------------===//
 // main Driver function
 //
@@ -1048,6 +1533,7 @@ static const char *modelledExternals[] = {
   "klee_get_obj_size",
   "klee_is_symbolic",
   "klee_make_symbolic",
+  "klee_make_symbolic_batch",
   "klee_mark_global",
   "klee_open_merge",
   "klee_close_merge",
@@ -1091,6 +1577,8 @@ static const char *modelledExternals[] = {
   "klee_make_shared",
   "klee_get_time",
   "klee_set_time",
+  "klee_copy_memory",
+  "klee_map_file",
 };
 
 
@@ -1345,6 +1833,29 @@ static void halt_via_gdb(int pid) {
     perror("system");
 }
 
+/// Wait for one of the -replay-serve-workers processes to exit and remove
+/// it from workers.
+static void waitForReplayWorker(std::vector<pid_t> &workers) {
+  int status;
+  pid_t pid;
+  while ((pid = waitpid(-1, &status, 0)) < 0) {
+    if (errno != EINTR) {
+      klee_warning("unable to wait for replay workers: %s", strerror(errno));
+      workers.clear();
+      return;
+    }
+  }
+  auto it = std::find(workers.begin(), workers.end(), pid);
+  if (it != workers.end())
+    workers.erase(it);
+  if (WIFEXITED(status) && WEXITSTATUS(status))
+    klee_warning("replay worker %d exited with status %d", pid,
+                 WEXITSTATUS(status));
+  else if (WIFSIGNALED(status))
+    klee_warning("replay worker %d was killed by signal %d", pid,
+                 WTERMSIG(status));
+}
+
 #ifndef SUPPORT_KLEE_UCLIBC
 static void
 linkWithUclibc(llvm::StringRef libDir,
@@ -1497,6 +2008,123 @@ trySaveFinalModuleToFile(llvm::Module *M, const std::string &suffix_msg) {
   llvm::errs() << "Final module saved to " << SaveFinalModulePath << suffix_msg << "\n";
 }
 
+/// Options that change the module handed to the Executor. They are part of
+/// the key of a cached module.
+static const char *const ModuleShapingOptions[] = {
+    "entry-point",     "libc",           "posix-runtime",
+    "libcxx",          "link-llvm-lib",  "optimize",
+    "check-div-zero",  "check-overshift", "switch-type",
+    "klee-call-optimisation", "function-alias", "disable-inlining",
+    "strip-all",       "strip-debug",    "disable-verify"};
+
+static void hashFileStatus(llvm::MD5 &hash, const std::string &path) {
+  llvm::sys::fs::file_status status;
+  hash.update(path);
+  if (llvm::sys::fs::status(path, status))
+    return;
+  uint64_t size = status.getSize();
+  int64_t mtime = status.getLastModificationTime().time_since_epoch().count();
+  hash.update(llvm::ArrayRef<uint8_t>((const uint8_t *)&size, sizeof(size)));
+  hash.update(llvm::ArrayRef<uint8_t>((const uint8_t *)&mtime, sizeof(mtime)));
+}
+
+static void hashFileContents(llvm::MD5 &hash, const std::string &path) {
+  auto buffer = llvm::MemoryBuffer::getFile(path);
+  if (!buffer)
+    klee_error("error loading program '%s': %s", path.c_str(),
+               buffer.getError().message().c_str());
+  hash.update(path);
+  hash.update((*buffer)->getBuffer());
+}
+
+/// Path of the cached module for the input file and the command line, or ""
+/// if modules are not cached.
+static std::string getModuleCachePath(int argc, char **argv,
+                                      const std::string &libraryDir) {
+  if (ModuleCacheDir.empty() || MonolithicModule)
+    return "";
+
+  llvm::MD5 hash;
+  hashFileContents(hash, InputFile);
+  for (const auto &library : LinkLibraries)
+    hashFileContents(hash, library);
+
+  // a rebuilt klee or runtime may prepare the module differently
+  hashFileStatus(hash, llvm::sys::fs::getMainExecutable(
+                           argv[0], (void *)(intptr_t)getModuleCachePath));
+  std::vector<std::string> runtimeFiles;
+  std::error_code EC;
+  for (llvm::sys::fs::directory_iterator it(libraryDir, EC), ie;
+       it != ie && !EC; it.increment(EC))
+    runtimeFiles.push_back(it->path());
+  std::sort(runtimeFiles.begin(), runtimeFiles.end());
+  for (const auto &file : runtimeFiles)
+    hashFileStatus(hash, file);
+
+  // the options before the input file belong to klee, the rest to the program
+  for (int i = 1; i < argc && InputFile != argv[i]; ++i) {
+    llvm::StringRef arg(argv[i]);
+    llvm::StringRef name = arg.ltrim('-').split('=').first;
+    if (!arg.startswith("-") ||
+        std::find_if(std::begin(ModuleShapingOptions),
+                     std::end(ModuleShapingOptions),
+                     [&](const char *o) { return name == o; }) ==
+            std::end(ModuleShapingOptions))
+      continue;
+    hash.update(arg);
+    hash.update(llvm::StringRef("", 1));
+    // the value of "-option value"
+    if (!arg.contains('=') && i + 1 < argc && argv[i + 1][0] != '-' &&
+        InputFile != argv[i + 1]) {
+      hash.update(argv[++i]);
+      hash.update(llvm::StringRef("", 1));
+    }
+  }
+
+  llvm::MD5::MD5Result result;
+  hash.final(result);
+  llvm::SmallString<32> digest;
+  llvm::MD5::stringifyResult(result, digest);
+
+  llvm::SmallString<128> path(ModuleCacheDir);
+  llvm::sys::path::append(path, llvm::sys::path::stem(InputFile.getValue()) +
+                                    "-" + digest + ".bc");
+  return path.str().str();
+}
+
+/// Store the prepared module at path. The module is written to a temporary
+/// file first, so concurrent runs never load a partial module.
+static void saveModuleToCache(llvm::Module *M, const std::string &path) {
+  if (auto EC = llvm::sys::fs::create_directories(ModuleCacheDir)) {
+    klee_warning("unable to create module cache directory %s: %s",
+                 ModuleCacheDir.c_str(), EC.message().c_str());
+    return;
+  }
+  int fd;
+  llvm::SmallString<128> tmpPath;
+  if (auto EC = llvm::sys::fs::createUniqueFile(path + ".tmp-%%%%%%", fd,
+                                                tmpPath)) {
+    klee_warning("unable to cache module in %s: %s", path.c_str(),
+                 EC.message().c_str());
+    return;
+  }
+  {
+    llvm::raw_fd_ostream fs(fd, /*shouldClose=*/true);
+#if LLVM_VERSION_CODE >= LLVM_VERSION(7, 0)
+    llvm::WriteBitcodeToFile(*M, fs);
+#else
+    llvm::WriteBitcodeToFile(M, fs);
+#endif
+  }
+  if (auto EC = llvm::sys::fs::rename(tmpPath, path)) {
+    klee_warning("unable to cache module in %s: %s", path.c_str(),
+                 EC.message().c_str());
+    llvm::sys::fs::remove(tmpPath);
+    return;
+  }
+  klee_message("NOTE: Cached prepared module: %s", path.c_str());
+}
+
 /*
  * Preprocess the given input bitcode
  * \param[in] Opts
@@ -1593,6 +2221,12 @@ int main(int argc, char **argv, char **envp) {
   llvm::InitializeNativeTarget();
 
   parseArguments(argc, argv);
+  if (!JobDir.empty()) {
+    WritePaths = true;
+    ReplayPathPrefix = true;
+    if (!ExportFrontierStates.getNumOccurrences())
+      ExportFrontierStates = 16;
+  }
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 9)
   sys::PrintStackTraceOnErrorSignal(argv[0]);
 #else
@@ -1673,18 +2307,34 @@ int main(int argc, char **argv, char **envp) {
   std::string errorMsg;
   llvm::LLVMContext ctx;
   std::vector<std::unique_ptr<llvm::Module>> loadedModules;
-  if (!klee::loadFile(InputFile, ctx, loadedModules, errorMsg)) {
+  std::string LibraryDir = KleeHandler::getRunTimeLibraryPath(argv[0]);
+  std::string moduleCachePath = getModuleCachePath(argc, argv, LibraryDir);
+  bool useCachedModule = false;
+  if (!moduleCachePath.empty() && llvm::sys::fs::exists(moduleCachePath)) {
+    useCachedModule =
+        klee::loadFile(moduleCachePath, ctx, loadedModules, errorMsg);
+    if (useCachedModule) {
+      klee_message("NOTE: Using cached module: %s", moduleCachePath.c_str());
+    } else {
+      klee_warning("ignoring cached module %s: %s", moduleCachePath.c_str(),
+                   errorMsg.c_str());
+      loadedModules.clear();
+    }
+  }
+  if (!useCachedModule &&
+      !klee::loadFile(InputFile, ctx, loadedModules, errorMsg)) {
     klee_error("error loading program '%s': %s", InputFile.c_str(),
                errorMsg.c_str());
   }
 
-  std::string LibraryDir = KleeHandler::getRunTimeLibraryPath(argv[0]);
+  // a cached module is already linked and prepared
   Interpreter::ModuleOptions Opts(LibraryDir, EntryPoint,
                                   /*Optimize=*/OptimizeModule,
                                   /*CheckDivZero=*/CheckDivZero,
                                   /*CheckOvershift=*/CheckOvershift,
-                                  /*MonolithicModule=*/MonolithicModule);
-  if (!MonolithicModule) {
+                                  /*MonolithicModule=*/MonolithicModule ||
+                                      useCachedModule);
+  if (!Opts.MonolithicModule) {
     linkExternalModules(Opts, loadedModules);
   }
   // FIXME: Change me to std types.
@@ -1744,6 +2394,8 @@ int main(int argc, char **argv, char **envp) {
 
   auto finalModule = interpreter->setModule(loadedModules, Opts);
   trySaveFinalModuleToFile(finalModule, "(without Freq)");
+  if (!moduleCachePath.empty() && !useCachedModule)
+    saveModuleToCache(finalModule, moduleCachePath);
 
   Function *mainFn = finalModule->getFunction(EntryPoint);
   if (!mainFn) {
@@ -1753,13 +2405,16 @@ int main(int argc, char **argv, char **envp) {
   externalsAndGlobalsCheck(finalModule);
 
   // load replayPath
-  std::vector<PathEntry> replayPath;
-  std::vector<DataRecEntry> dataRecEntries;
+  std::unique_ptr<PathEntryBuffer> replayPath;
+  std::unique_ptr<DataRecBuffer> dataRecEntries;
 
   if (ReplayPathFile != "") {
     KleeHandler::loadPathFile(ReplayPathFile, replayPath, dataRecEntries);
-    interpreter->setReplayPath(&replayPath);
-    interpreter->setReplayDataRecEntries(&dataRecEntries);
+    if (!ReplayConsensusPath.empty())
+      KleeHandler::mergePathFiles(ReplayConsensusPath, replayPath,
+                                  dataRecEntries);
+    interpreter->setReplayPath(replayPath.get());
+    interpreter->setReplayDataRecEntries(dataRecEntries.get());
   }
 
   auto startTime = std::time(nullptr);
@@ -1775,6 +2430,7 @@ int main(int argc, char **argv, char **envp) {
   if (!ReplayKTestDir.empty() || !ReplayKTestFile.empty()) {
     assert(SeedOutFile.empty());
     assert(SeedOutDir.empty());
+    assert(SeedStream.empty());
 
     std::vector<std::string> kTestFiles = ReplayKTestFile;
     for (std::vector<std::string>::iterator
@@ -1812,7 +2468,8 @@ int main(int argc, char **argv, char **envp) {
                    << " (" << ++i << "/" << kTestFiles.size() << ")\n";
       // XXX should put envp in .ktest ?
       interpreter->runFunctionAsMain(mainFn, out->numArgs, out->args, pEnvp);
-      if (interrupted) break;
+      // the other test cases are replayed by the parent of a worker
+      if (interrupted || handler->isWorker()) break;
     }
     interpreter->setReplayKTest(0);
     while (!kTests.empty()) {
@@ -1820,37 +2477,26 @@ int main(int argc, char **argv, char **envp) {
       kTests.pop_back();
     }
   } else {
-    std::vector<KTest *> seeds;
-    for (std::vector<std::string>::iterator
-           it = SeedOutFile.begin(), ie = SeedOutFile.end();
-         it != ie; ++it) {
-      KTest *out = kTest_fromFile(it->c_str());
-      if (!out) {
-        klee_error("unable to open: %s\n", (*it).c_str());
-      }
-      seeds.push_back(out);
-    }
+    // Only the paths of the seed files are collected up front, the seeds
+    // themselves are read as the executor gets to them.
+    std::vector<std::string> seedFiles(SeedOutFile.begin(), SeedOutFile.end());
     for (std::vector<std::string>::iterator
            it = SeedOutDir.begin(), ie = SeedOutDir.end();
          it != ie; ++it) {
-      std::vector<std::string> kTestFiles;
-      KleeHandler::getKTestFilesInDir(*it, kTestFiles);
-      for (std::vector<std::string>::iterator
-             it2 = kTestFiles.begin(), ie = kTestFiles.end();
-           it2 != ie; ++it2) {
-        KTest *out = kTest_fromFile(it2->c_str());
-        if (!out) {
-          klee_error("unable to open: %s\n", (*it2).c_str());
-        }
-        seeds.push_back(out);
-      }
-      if (kTestFiles.empty()) {
+      size_t numFiles = seedFiles.size();
+      KleeHandler::getKTestFilesInDir(*it, seedFiles);
+      if (seedFiles.size() == numFiles) {
         klee_error("seeds directory is empty: %s\n", (*it).c_str());
       }
     }
-
-    if (!seeds.empty()) {
-      klee_message("KLEE: using %lu seeds\n", seeds.size());
+    KTestSeedSource seeds(std::move(seedFiles));
+
+    if (seeds.getNumFiles() || !SeedStream.empty()) {
+      if (SeedStream.empty())
+        klee_message("KLEE: using %lu seeds\n", seeds.getNumFiles());
+      else
+        klee_message("KLEE: using %lu seeds and %lu seed streams\n",
+                     seeds.getNumFiles(), SeedStream.size());
       interpreter->useSeeds(&seeds);
     }
     if (RunInDir != "") {
@@ -1860,14 +2506,77 @@ int main(int argc, char **argv, char **envp) {
                    sys::StrError(errno).c_str());
       }
     }
-    interpreter->runFunctionAsMain(mainFn, pArgc, pArgv, pEnvp);
+    std::string seedMarker;
+    if (!JobDir.empty() && JobDirSeed) {
+      // The seed exploration counts as a running job, before the other
+      // processes find the queue.
+      for (const char *dir : {"running", "queue"}) {
+        std::string path = getJobDirPath(dir);
+        if (auto EC = llvm::sys::fs::create_directories(path))
+          klee_error("unable to create %s: %s", path.c_str(),
+                     EC.message().c_str());
+        if (seedMarker.empty()) {
+          seedMarker = getJobDirPath("running/seed-" + std::to_string(getpid()));
+          std::ofstream(seedMarker.c_str());
+        }
+      }
+    }
+    if (JobDir.empty() || JobDirSeed)
+      interpreter->runFunctionAsMain(mainFn, pArgc, pArgv, pEnvp);
+    if (!seedMarker.empty() && !handler->isWorker())
+      llvm::sys::fs::remove(seedMarker);
+
+    while (!JobDir.empty() && !interrupted && !handler->isWorker()) {
+      std::string job = KleeHandler::claimJob();
+      if (job.empty()) {
+        if (KleeHandler::jobsDone())
+          break;
+        sleep(1);
+        continue;
+      }
+      KleeHandler::loadPathFile(job, replayPath, dataRecEntries);
+      interpreter->setReplayPath(replayPath.get());
+      interpreter->setReplayDataRecEntries(dataRecEntries.get());
+      klee_message("exploring job: %s", job.c_str());
+      interpreter->runFunctionAsMain(mainFn, pArgc, pArgv, pEnvp);
+      if (handler->isWorker())
+        break;
+      KleeHandler::finishJob(job);
+    }
 
-    while (!seeds.empty()) {
-      kTest_free(seeds.back());
-      seeds.pop_back();
+    std::string nextPathFile;
+    std::vector<pid_t> replayWorkers;
+    while (ReplayServe && !ReplayPathFile.empty() && !interrupted &&
+           !handler->isWorker() &&
+           std::getline(std::cin, nextPathFile) && !nextPathFile.empty()) {
+      if (ReplayServeWorkers > 1) {
+        if (replayWorkers.size() >= ReplayServeWorkers)
+          waitForReplayWorker(replayWorkers);
+        int pid = interpreter->forkRunWorker();
+        if (pid > 0) {
+          klee_message("replaying in worker %d: %s", pid,
+                       nextPathFile.c_str());
+          replayWorkers.push_back(pid);
+          continue;
+        }
+        // a worker replays this path file and exits, its siblings are not
+        // its children; if the fork failed, the file is replayed here
+        if (!pid)
+          replayWorkers.clear();
+      }
+      KleeHandler::loadPathFile(nextPathFile, replayPath, dataRecEntries);
+      interpreter->setReplayPath(replayPath.get());
+      interpreter->setReplayDataRecEntries(dataRecEntries.get());
+      klee_message("replaying: %s", nextPathFile.c_str());
+      interpreter->runFunctionAsMain(mainFn, pArgc, pArgv, pEnvp);
     }
+    while (!replayWorkers.empty())
+      waitForReplayWorker(replayWorkers);
+
+    interpreter->useSeeds(nullptr);
   }
 
+  handler->flushTestCases();
   auto endTime = std::time(nullptr);
   { // output end and elapsed time
     klee_message("In-engine time:%lu\n", endTime - handler->getStartTime());
@@ -1,14 +1,22 @@
 #include "klee/Internal/ADT/KTest.h"
+#include "klee/Internal/Support/FileHandling.h"
 #include "klee/Internal/Support/PrintVersion.h"
+#include "klee/Internal/Support/WorkQueue.h"
 
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/Signals.h"
 
 #include <iostream>
 #include <fstream>
 #include <cstring>
+#include <mutex>
+#include <set>
 #include <sstream>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
 using namespace llvm;
 using namespace klee;
@@ -23,11 +31,60 @@ static cl::extrahelp inputFormatHelp(
         "    KTEST /tmp/1.ktest A-obj B-obj\n"
         "    KTEST a.ktest *\n"
         "    PLAIN 2.bin C-obj\n"
+        "With -batch, input_template_file is a directory of templates or a file "
+        "that lists one per line, and output_file is the directory that the "
+        "KTest of each template is written to, as <template name>.ktest, along "
+        "with a manifest that lists the template, its KTest and 'ok' or the "
+        "error of each template\n"
         );
 
-KTest output_KTest;
-std::unordered_map<std::string, KTest *> ktest_cache;
-std::unordered_map<std::string, KTestObject> ktest_objs;
+static cl::opt<bool> Batch(
+    "batch",
+    cl::desc("Build the KTests of many templates, see below (default=false)"),
+    cl::init(false));
+
+static cl::opt<unsigned> Threads(
+    "batch-threads",
+    cl::desc("Number of templates to build in parallel with -batch "
+             "(default=number of cores)"),
+    cl::init(0));
+
+/// The KTest files opened so far. In a batch, templates that refer to the
+/// same KTest file share it.
+class KTestCache {
+    struct Entry {
+        std::once_flag once;
+        KTest *ktest = nullptr;
+    };
+    std::mutex mutex;
+    std::unordered_map<std::string, std::unique_ptr<Entry>> entries;
+
+public:
+    ~KTestCache() {
+        for (auto &entry : entries)
+            if (entry.second->ktest)
+                kTest_free(entry.second->ktest);
+    }
+
+    /// \return nullptr if path is not a valid KTest file
+    KTest *get(const std::string &path) {
+        Entry *entry;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::unique_ptr<Entry> &e = entries[path];
+            if (!e)
+                e.reset(new Entry);
+            entry = e.get();
+        }
+        std::call_once(entry->once, [&] {
+            entry->ktest = kTest_fromFile(path.c_str());
+        });
+        return entry->ktest;
+    }
+};
+
+/// Serializes the messages of the templates built in parallel
+static std::mutex output_mutex;
 
 static KTestObject *GetObjFromKTestByName(KTest *ktest, std::string &name) {
     for (unsigned i = 0; i < ktest->numObjects; ++i) {
@@ -38,60 +95,33 @@ static KTestObject *GetObjFromKTestByName(KTest *ktest, std::string &name) {
     return NULL;
 }
 
-static void AddObject(std::string &name, KTestObject obj) {
+static void AddObject(std::unordered_map<std::string, KTestObject> &ktest_objs,
+                      std::string &name, KTestObject obj) {
     std::pair<std::unordered_map<std::string, KTestObject>::iterator, bool> ret =
         ktest_objs.insert(std::make_pair(name, obj));
     if (!ret.second) {
+        std::lock_guard<std::mutex> lock(output_mutex);
         std::cout << "OverWritting " << name << std::endl;
     }
     auto iter = ret.first;
     iter->second = obj;
 }
 
-static KTest *GetKTest(std::string &path) {
-    auto it = ktest_cache.find(path);
-    KTest *ktest;
-    if (it != ktest_cache.end()) {
-        // found already opened KTest File
-        ktest = it->second;
-    }
-    else {
-        // open new KTest File
-        ktest = kTest_fromFile(path.c_str());
-        if (!ktest) {
-            std::cout << "Invalid KTest file at " << path << std::endl;
-            abort();
-        }
-        else {
-            // add just opened KTest File to cache
-            ktest_cache.insert(std::make_pair(path, ktest));
-        }
-    }
-    return ktest;
-}
-
-static void HideOptions(cl::OptionCategory &Category) {
-    StringMap<cl::Option *> &map = cl::getRegisteredOptions();
-    for (auto &elem : map) {
-        if (elem.second->Category == &Category) {
-            elem.second->setHiddenFlag(cl::Hidden);
-        }
+/// Build the KTest described by the template templatePath and write it to
+/// outputPath.
+/// \return false and set error if that fails
+static bool BuildKTest(const std::string &templatePath,
+                       const std::string &outputPath, KTestCache &cache,
+                       std::string &error) {
+    std::ifstream inFile(templatePath);
+    if (!inFile.good()) {
+        error = "Cannot open input file " + templatePath;
+        return false;
     }
-}
-
-int main(int argc, char **argv) {
-    sys::PrintStackTraceOnErrorSignal(argv[0]);
-    HideOptions(llvm::cl::GeneralCategory);
-    cl::SetVersionPrinter(klee::printVersion);
-    cl::ParseCommandLineOptions(argc, argv);
-
-    // init output_KTest
-    std::memset(&output_KTest, 0, sizeof(output_KTest));
-    output_KTest.version = kTest_getCurrentVersion();
-
-    std::ifstream inFile(InputFile);
-    assert(inFile.good() && "Cannot open input file");
 
+    std::unordered_map<std::string, KTestObject> ktest_objs;
+    // the names and bytes of the PLAIN objects
+    std::vector<std::unique_ptr<char[]>> storage;
     while (1) {
         std::istringstream line;
         std::string linestr, format, path, objname;
@@ -104,55 +134,158 @@ int main(int argc, char **argv) {
             line >> format >> path;
         }
         if (format == "KTEST") {
-            KTest *ktest = GetKTest(path);
+            KTest *ktest = cache.get(path);
+            if (!ktest) {
+                error = "Invalid KTest file at " + path;
+                return false;
+            }
             while (line.good()) {
                 line >> objname;
                 if (objname == "*") {
                     for (unsigned i = 0; i < ktest->numObjects; ++i) {
                         std::string name(ktest->objects[i].name);
-                        AddObject(name, ktest->objects[i]);
+                        AddObject(ktest_objs, name, ktest->objects[i]);
                     }
                     // when having star, all objects from this KTest has already been included
                     break;
                 }
                 else {
                     KTestObject *kobj = GetObjFromKTestByName(ktest, objname);
-                    AddObject(objname, *kobj);
+                    if (!kobj) {
+                        error = "No object " + objname + " in " + path;
+                        return false;
+                    }
+                    AddObject(ktest_objs, objname, *kobj);
                 }
             }
         }
         else if (format == "PLAIN") {
             std::ifstream plainfile(path, std::ios::binary);
-            assert(line.good() && "objname is required for PLAIN file");
+            if (!line.good()) {
+                error = "objname is required for PLAIN file " + path;
+                return false;
+            }
             line >> objname;
             KTestObject kobj;
             if (!plainfile.good()) {
-                std::cout << "Cannot open plain file " << path << std::endl;
-                abort();
+                error = "Cannot open plain file " + path;
+                return false;
             }
             plainfile.seekg(0, std::ios::end);
-            kobj.name = new char[objname.size() + 1];
+            storage.emplace_back(new char[objname.size() + 1]);
+            kobj.name = storage.back().get();
             std::memcpy(kobj.name, objname.c_str(), objname.size() + 1);
             kobj.numBytes = plainfile.tellg();
             plainfile.seekg(0);
-            kobj.bytes = new unsigned char[kobj.numBytes];
+            storage.emplace_back(new char[kobj.numBytes]);
+            kobj.bytes = reinterpret_cast<unsigned char *>(storage.back().get());
             plainfile.read(reinterpret_cast<char*>(kobj.bytes), kobj.numBytes);
-            AddObject(objname, kobj);
+            AddObject(ktest_objs, objname, kobj);
         }
     }
 
-    output_KTest.numObjects = ktest_objs.size();
-    output_KTest.objects = new KTestObject[output_KTest.numObjects];
-    KTestObject *kobj = output_KTest.objects;
+    KTest output_KTest;
+    std::memset(&output_KTest, 0, sizeof(output_KTest));
+    output_KTest.version = kTest_getCurrentVersion();
+    std::vector<KTestObject> objects;
     for (auto mit: ktest_objs) {
-        *kobj = mit.second;
-        ++kobj;
+        objects.push_back(mit.second);
+    }
+    output_KTest.numObjects = objects.size();
+    output_KTest.objects = objects.data();
+
+    if (!kTest_toFile(&output_KTest, outputPath.c_str())) {
+        error = "Cannot write KTest file " + outputPath;
+        return false;
+    }
+    return true;
+}
+
+/// Build the KTests of the templates listed by InputFile into the directory
+/// OutputFile on a pool of Threads threads.
+static int BuildBatch() {
+    std::vector<std::string> templates;
+    std::string error;
+    if (!klee_read_input_list(InputFile, "", templates, error)) {
+        llvm::errs() << "Cannot read templates from " << InputFile << ": "
+                     << error << "\n";
+        return 1;
+    }
+    if (std::error_code ec = sys::fs::create_directories(OutputFile.getValue())) {
+        llvm::errs() << "Cannot create output directory " << OutputFile << ": "
+                     << ec.message() << "\n";
+        return 1;
+    }
+
+    // name each KTest after its template, telling apart templates of the
+    // same name in different directories by a number
+    std::vector<std::string> outputs;
+    std::set<std::string> names;
+    for (const std::string &path : templates) {
+        std::string stem = sys::path::stem(path).str(), name = stem;
+        for (unsigned i = 1; !names.insert(name).second; ++i)
+            name = stem + "-" + std::to_string(i);
+        SmallString<128> output(OutputFile.getValue());
+        sys::path::append(output, name + ".ktest");
+        outputs.push_back(output.str().str());
+    }
+
+    unsigned threads = Threads ? Threads.getValue()
+                               : std::max(1u, std::thread::hardware_concurrency());
+    KTestCache cache;
+    std::vector<std::string> status(templates.size());
+    {
+        WorkQueue pool(threads, 4 * threads);
+        for (unsigned i = 0; i < templates.size(); ++i) {
+            pool.submit([&, i] {
+                std::string error;
+                status[i] = BuildKTest(templates[i], outputs[i], cache, error)
+                                ? "ok" : error;
+            });
+        }
+        pool.drain();
+    }
+
+    SmallString<128> manifestPath(OutputFile.getValue());
+    sys::path::append(manifestPath, "manifest");
+    std::ofstream manifest(manifestPath.c_str());
+    unsigned failed = 0;
+    for (unsigned i = 0; i < templates.size(); ++i) {
+        manifest << templates[i] << "\t" << outputs[i] << "\t" << status[i] << "\n";
+        if (status[i] != "ok") {
+            llvm::errs() << templates[i] << ": " << status[i] << "\n";
+            ++failed;
+        }
+    }
+    if (!manifest.good()) {
+        llvm::errs() << "Cannot write manifest " << manifestPath << "\n";
+        return 1;
     }
+    return failed ? 1 : 0;
+}
+
+static void HideOptions(cl::OptionCategory &Category) {
+    StringMap<cl::Option *> &map = cl::getRegisteredOptions();
+    for (auto &elem : map) {
+        if (elem.second->Category == &Category) {
+            elem.second->setHiddenFlag(cl::Hidden);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    sys::PrintStackTraceOnErrorSignal(argv[0]);
+    HideOptions(llvm::cl::GeneralCategory);
+    cl::SetVersionPrinter(klee::printVersion);
+    cl::ParseCommandLineOptions(argc, argv);
 
-    kTest_toFile(&output_KTest, OutputFile.c_str());
+    if (Batch)
+        return BuildBatch();
 
-    delete [] output_KTest.objects;
-    for (auto cit: ktest_cache) {
-        kTest_free(cit.second);
+    KTestCache cache;
+    std::string error;
+    if (!BuildKTest(InputFile, OutputFile, cache, error)) {
+        std::cout << error << std::endl;
+        abort();
     }
 }
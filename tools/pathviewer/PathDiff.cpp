@@ -0,0 +1,107 @@
+//===-- PathDiff.cpp ------------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PathDiff.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+using namespace klee;
+
+static const uint64_t HashBase = 0x100000001b3ULL;
+
+size_t PathDiff::commonPrefix(size_t i, size_t j) const {
+  const size_t C = PathIndex::ChunkEntries;
+  size_t start = i;
+  while (i < a.size() && j < b.size()) {
+    if (i % C == 0 && j % C == 0 && i + C <= a.size() && j + C <= b.size() &&
+        indexA.chunkHash(i / C) == indexB.chunkHash(j / C)) {
+      i += C;
+      j += C;
+      continue;
+    }
+    if (getEntryKey(a[i]) != getEntryKey(b[j]))
+      break;
+    ++i;
+    ++j;
+  }
+  return i - start;
+}
+
+bool PathDiff::resync(size_t i, size_t j, size_t &syncA,
+                      size_t &syncB) const {
+  const size_t W = SyncEntries;
+  size_t endA = std::min(a.size(), i + horizon);
+  size_t endB = std::min(b.size(), j + horizon);
+  if (endA - i < W || endB - j < W)
+    return false;
+
+  auto windowHash = [](const PathEntryBuffer &entries, size_t pos) {
+    uint64_t h = 0;
+    for (size_t k = pos; k < pos + W; ++k)
+      h = h * HashBase + getEntryKey(entries[k]);
+    return h;
+  };
+
+  // the first window of each hash in the first trace
+  std::unordered_map<uint64_t, size_t> windows;
+  for (size_t pos = i; pos + W <= endA; pos += W)
+    windows.emplace(windowHash(a, pos), pos);
+
+  // HashBase^(W - 1), the weight of the entry leaving the window
+  uint64_t top = 1;
+  for (size_t k = 1; k < W; ++k)
+    top *= HashBase;
+
+  uint64_t h = windowHash(b, j);
+  for (size_t pos = j;; ++pos) {
+    auto found = windows.find(h);
+    if (found != windows.end()) {
+      size_t pa = found->second, pb = pos;
+      size_t k = 0;
+      while (k < W && getEntryKey(a[pa + k]) == getEntryKey(b[pb + k]))
+        ++k;
+      if (k == W) {
+        // the windows of the first trace only start every W entries
+        while (pa > i && pb > j &&
+               getEntryKey(a[pa - 1]) == getEntryKey(b[pb - 1])) {
+          --pa;
+          --pb;
+        }
+        syncA = pa;
+        syncB = pb;
+        return true;
+      }
+    }
+    if (pos + W >= endB)
+      return false;
+    h = (h - getEntryKey(b[pos]) * top) * HashBase + getEntryKey(b[pos + W]);
+  }
+}
+
+std::vector<PathDivergence> PathDiff::diff(size_t max) const {
+  std::vector<PathDivergence> divergences;
+  size_t i = 0, j = 0;
+  while (divergences.size() < max) {
+    size_t n = commonPrefix(i, j);
+    i += n;
+    j += n;
+    if (i == a.size() && j == b.size())
+      break;
+    size_t syncA, syncB;
+    if (i == a.size() || j == b.size() || !resync(i, j, syncA, syncB)) {
+      divergences.push_back({i, j, a.size() - i, b.size() - j});
+      break;
+    }
+    divergences.push_back({i, j, syncA - i, syncB - j});
+    i = syncA;
+    j = syncB;
+  }
+  return divergences;
+}
@@ -0,0 +1,70 @@
+//===-- PathDiff.h ----------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Comparison of two recorded .path files, used by pathviewer to find their
+// common prefix and where they diverge.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_PATHDIFF_H
+#define KLEE_PATHDIFF_H
+
+#include "PathIndex.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace klee {
+
+  /// A region where two traces differ: entries [a, a + lenA) of the first
+  /// one against [b, b + lenB) of the second one.
+  struct PathDivergence {
+    size_t a, b;
+    size_t lenA, lenB;
+  };
+
+  /// Compares two traces given their indexes.
+  ///
+  /// Identical regions starting at the same chunk offset in both traces are
+  /// skipped by comparing the chunk fingerprints of the indexes, so the
+  /// common prefix of two traces is found reading one chunk of each. After
+  /// a divergence both traces are resynchronized as rsync does: the first
+  /// trace is fingerprinted in windows of SyncEntries entries, the second
+  /// one searched with a rolling hash of the same width.
+  class PathDiff {
+  public:
+    static const size_t SyncEntries = 32;
+
+  private:
+    const PathEntryBuffer &a, &b;
+    const PathIndex &indexA, &indexB;
+    /// How far past a divergence to look for the traces to agree again
+    size_t horizon;
+
+    bool resync(size_t i, size_t j, size_t &syncA, size_t &syncB) const;
+
+  public:
+    PathDiff(const PathEntryBuffer &a, const PathIndex &indexA,
+             const PathEntryBuffer &b, const PathIndex &indexB,
+             size_t horizon)
+        : a(a), b(b), indexA(indexA), indexB(indexB), horizon(horizon) {}
+
+    /// Number of equal entries from entry i of the first trace and entry j
+    /// of the second one on.
+    size_t commonPrefix(size_t i, size_t j) const;
+
+    /// The divergences in trace order, at most max of them. A trace that
+    /// is a prefix of the other one diverges where it ends, and the last
+    /// divergence runs to the ends if the traces do not agree again
+    /// within the horizon.
+    std::vector<PathDivergence> diff(size_t max) const;
+  };
+} // namespace klee
+
+#endif /* KLEE_PATHDIFF_H */
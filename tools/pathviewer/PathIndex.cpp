@@ -0,0 +1,201 @@
+//===-- PathIndex.cpp -----------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PathIndex.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+using namespace klee;
+
+// Cache layout: magic, uint32 version, uint32 ChunkEntries, uint64 stamp,
+// uint64 numEntries, uint64 numChunks, the raw Chunk array, uint64 number
+// of histogram buckets and (uint32 tgtid, uint64 count) per bucket.
+static const char IndexMagic[8] = {'K', 'L', 'E', 'E', 'P', 'I', 'D', 'X'};
+static const uint32_t IndexVersion = 2;
+
+void klee::forEachChunk(size_t numChunks, unsigned jobs,
+                        const std::function<void(size_t)> &fn) {
+  jobs = std::max(1u, std::min<unsigned>(jobs, numChunks));
+  std::atomic<size_t> next(0);
+  auto worker = [&]() {
+    for (size_t c; (c = next++) < numChunks;)
+      fn(c);
+  };
+  std::vector<std::thread> threads;
+  for (unsigned i = 1; i < jobs; ++i)
+    threads.emplace_back(worker);
+  worker();
+  for (auto &t : threads)
+    t.join();
+}
+
+void PathIndex::build(unsigned jobs) {
+  size_t numChunks = (entries.size() + ChunkEntries - 1) / ChunkEntries;
+  chunks.assign(numChunks, Chunk());
+  std::vector<std::map<PathEntry::thread_t, uint64_t>> hists(numChunks);
+
+  forEachChunk(numChunks, jobs, [&](size_t c) {
+    Chunk &chunk = chunks[c];
+    memset(&chunk, 0, sizeof(chunk));
+    const PathEntry *it = entries.begin() + c * ChunkEntries;
+    const PathEntry *ie = std::min(entries.end(), it + ChunkEntries);
+    // FNV-1a over the keys
+    chunk.hash = 0xcbf29ce484222325ULL;
+    for (; it != ie; ++it) {
+      chunk.hash = (chunk.hash ^ getEntryKey(*it)) * 0x100000001b3ULL;
+      if (it->t >= PathEntry::NUM_PATHENTRY_T)
+        continue;
+      ++chunk.typeCount[it->t];
+      if (it->t == PathEntry::DATAREC)
+        chunk.dataRecBytes += it->body.drec.width / 8;
+      else if (it->t == PathEntry::SCHEDULE)
+        ++hists[c][it->body.tgtid];
+    }
+  });
+
+  uint64_t before = 0;
+  scheduleHist.clear();
+  for (size_t c = 0; c < numChunks; ++c) {
+    chunks[c].dataRecBefore = before;
+    before += chunks[c].typeCount[PathEntry::DATAREC];
+    for (auto &bucket : hists[c])
+      scheduleHist[bucket.first] += bucket.second;
+  }
+}
+
+bool PathIndex::load(const std::string &file, uint64_t stamp) {
+  std::ifstream is(file.c_str(), std::ios::in | std::ios::binary);
+  if (!is.good())
+    return false;
+
+  char magic[sizeof(IndexMagic)];
+  uint32_t version, chunkEntries;
+  uint64_t fileStamp, numEntries, numChunks;
+  is.read(magic, sizeof(magic));
+  is.read((char *)&version, sizeof(version));
+  is.read((char *)&chunkEntries, sizeof(chunkEntries));
+  is.read((char *)&fileStamp, sizeof(fileStamp));
+  is.read((char *)&numEntries, sizeof(numEntries));
+  is.read((char *)&numChunks, sizeof(numChunks));
+  if (is.fail() || memcmp(magic, IndexMagic, sizeof(magic)) ||
+      version != IndexVersion || chunkEntries != ChunkEntries ||
+      fileStamp != stamp || numEntries != entries.size() ||
+      numChunks != (numEntries + ChunkEntries - 1) / ChunkEntries)
+    return false;
+
+  std::vector<Chunk> loaded(numChunks);
+  is.read((char *)loaded.data(), numChunks * sizeof(Chunk));
+  uint64_t buckets;
+  is.read((char *)&buckets, sizeof(buckets));
+  if (is.fail())
+    return false;
+  std::map<PathEntry::thread_t, uint64_t> hist;
+  for (uint64_t i = 0; i < buckets; ++i) {
+    uint32_t tgtid;
+    uint64_t count;
+    is.read((char *)&tgtid, sizeof(tgtid));
+    is.read((char *)&count, sizeof(count));
+    hist[tgtid] = count;
+  }
+  if (is.fail())
+    return false;
+
+  chunks.swap(loaded);
+  scheduleHist.swap(hist);
+  return true;
+}
+
+bool PathIndex::save(const std::string &file, uint64_t stamp,
+                     std::string &error) const {
+  std::ofstream os(file.c_str(),
+                   std::ios::out | std::ios::binary | std::ios::trunc);
+  uint64_t numEntries = entries.size(), numChunks = chunks.size();
+  uint64_t buckets = scheduleHist.size();
+  os.write(IndexMagic, sizeof(IndexMagic));
+  os.write((const char *)&IndexVersion, sizeof(IndexVersion));
+  uint32_t chunkEntries = ChunkEntries;
+  os.write((const char *)&chunkEntries, sizeof(chunkEntries));
+  os.write((const char *)&stamp, sizeof(stamp));
+  os.write((const char *)&numEntries, sizeof(numEntries));
+  os.write((const char *)&numChunks, sizeof(numChunks));
+  os.write((const char *)chunks.data(), numChunks * sizeof(Chunk));
+  os.write((const char *)&buckets, sizeof(buckets));
+  for (auto &bucket : scheduleHist) {
+    uint32_t tgtid = bucket.first;
+    os.write((const char *)&tgtid, sizeof(tgtid));
+    os.write((const char *)&bucket.second, sizeof(bucket.second));
+  }
+  os.flush();
+  if (os.fail()) {
+    error = "cannot write " + file;
+    return false;
+  }
+  return true;
+}
+
+PathIndex::Chunk PathIndex::totals() const {
+  Chunk sum;
+  memset(&sum, 0, sizeof(sum));
+  for (auto &chunk : chunks) {
+    for (unsigned i = 0; i < PathEntry::NUM_PATHENTRY_T; ++i)
+      sum.typeCount[i] += chunk.typeCount[i];
+    sum.dataRecBytes += chunk.dataRecBytes;
+  }
+  return sum;
+}
+
+uint64_t PathIndex::dataRecBefore(size_t pos) const {
+  pos = std::min(pos, entries.size());
+  size_t c = pos / ChunkEntries;
+  if (c == chunks.size())
+    return chunks.empty() ? 0
+                          : chunks.back().dataRecBefore +
+                                chunks.back().typeCount[PathEntry::DATAREC];
+  uint64_t n = chunks[c].dataRecBefore;
+  for (size_t i = c * ChunkEntries; i < pos; ++i)
+    if (entries[i].t == PathEntry::DATAREC)
+      ++n;
+  return n;
+}
+
+size_t PathIndex::entryOfDataRec(uint64_t record) const {
+  // last chunk starting with at most record DATAREC entries before it
+  auto it = std::upper_bound(chunks.begin(), chunks.end(), record,
+                             [](uint64_t r, const Chunk &chunk) {
+                               return r < chunk.dataRecBefore;
+                             });
+  if (it == chunks.begin())
+    return entries.size();
+  --it;
+  uint64_t n = it->dataRecBefore;
+  size_t i = (it - chunks.begin()) * ChunkEntries;
+  for (size_t e = entries.size(); i < e; ++i) {
+    if (entries[i].t == PathEntry::DATAREC && n++ == record)
+      return i;
+  }
+  return entries.size();
+}
+
+size_t PathIndex::lastOfType(size_t pos, PathEntry::PathEntry_t t) const {
+  pos = std::min(pos, entries.size());
+  // the chunks without such entries are skipped
+  for (size_t c = (pos + ChunkEntries - 1) / ChunkEntries; c-- > 0;) {
+    if (!chunks[c].typeCount[t])
+      continue;
+    size_t begin = c * ChunkEntries;
+    for (size_t i = std::min(pos, begin + ChunkEntries); i-- > begin;)
+      if (entries[i].t == t)
+        return i;
+  }
+  return entries.size();
+}
@@ -0,0 +1,114 @@
+//===-- PathIndex.h ---------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Chunk index over a recorded .path, used by pathviewer to answer counting
+// and range queries on large traces without decoding everything.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_PATHINDEX_H
+#define KLEE_PATHINDEX_H
+
+#include "klee/Internal/Support/PathBuffer.h"
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace klee {
+
+  /// Run fn(chunk) for every chunk in [0, numChunks) on up to jobs threads.
+  /// Chunks are handed out dynamically, fn must only touch per-chunk state.
+  void forEachChunk(size_t numChunks, unsigned jobs,
+                    const std::function<void(size_t)> &fn);
+
+  /// Canonical value of an entry. The bytes of a PathEntry are not one, as
+  /// they include padding and the unused members of its body.
+  inline uint32_t getEntryKey(const PathEntry &pe) {
+    uint32_t payload = 0;
+    switch (pe.t) {
+    case PathEntry::FORK: payload = pe.body.br; break;
+    case PathEntry::SWITCH_EXPIDX:
+    case PathEntry::SWITCH_BBIDX: payload = pe.body.switchIndex; break;
+    case PathEntry::INDIRECTBR: payload = pe.body.indirectbrIndex; break;
+    case PathEntry::DATAREC: payload = pe.body.drec.width; break;
+    case PathEntry::SCHEDULE: payload = pe.body.tgtid; break;
+    default: break;
+    }
+    return ((uint32_t)pe.t << 16) | payload;
+  }
+
+  /// Per-chunk summary of a .path file.
+  ///
+  /// The trace is cut into chunks of ChunkEntries entries. For each chunk the
+  /// index keeps the entry type counts, the DATAREC payload bytes and the
+  /// number of DATAREC entries before it, which is what locating the
+  /// .path_datarec record of an arbitrary entry needs, and a fingerprint of
+  /// the entries with which two traces are compared chunk by chunk. The
+  /// index is built with one parallel pass and can be cached next to the
+  /// trace.
+  class PathIndex {
+  public:
+    static const size_t ChunkEntries = 1 << 16;
+
+    struct Chunk {
+      uint64_t typeCount[PathEntry::NUM_PATHENTRY_T];
+      uint64_t dataRecBytes;
+      /// DATAREC entries preceding this chunk
+      uint64_t dataRecBefore;
+      /// Of the keys of the entries (see getEntryKey)
+      uint64_t hash;
+    };
+
+  private:
+    const PathEntryBuffer &entries;
+    std::vector<Chunk> chunks;
+    /// SCHEDULE target thread -> number of entries
+    std::map<PathEntry::thread_t, uint64_t> scheduleHist;
+
+  public:
+    explicit PathIndex(const PathEntryBuffer &_entries) : entries(_entries) {}
+
+    /// Scan the whole trace using up to jobs threads.
+    void build(unsigned jobs);
+
+    /// Load a cached index, stamp identifies the trace it was built from.
+    /// \return false if the cache is missing, malformed or stale.
+    bool load(const std::string &file, uint64_t stamp);
+
+    /// \return false and set error if the cache cannot be written.
+    bool save(const std::string &file, uint64_t stamp,
+              std::string &error) const;
+
+    /// Sum over all chunks
+    Chunk totals() const;
+
+    const std::map<PathEntry::thread_t, uint64_t> &getScheduleHistogram() const {
+      return scheduleHist;
+    }
+
+    /// Number of DATAREC entries before entry pos, i.e. the .path_datarec
+    /// record of entry pos if it is a DATAREC itself.
+    uint64_t dataRecBefore(size_t pos) const;
+
+    /// Position in the trace of the given DATAREC record.
+    size_t entryOfDataRec(uint64_t record) const;
+
+    /// Fingerprint of the entries of chunk c
+    uint64_t chunkHash(size_t c) const { return chunks[c].hash; }
+
+    /// Position of the last entry of type t before entry pos, the size of
+    /// the trace if there is none.
+    size_t lastOfType(size_t pos, PathEntry::PathEntry_t t) const;
+  };
+} // namespace klee
+
+#endif /* KLEE_PATHINDEX_H */
@@ -1,23 +1,34 @@
+#include "PathDiff.h"
+#include "PathIndex.h"
+
+#include "klee/Internal/Support/PathBuffer.h"
 #include "klee/Internal/Support/PrintVersion.h"
 #include "klee/Internal/Support/Serialize.h"
 
 #include "llvm/ADT/APInt.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Signals.h"
 
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
+#include <thread>
 
 using namespace llvm;
 using namespace klee;
 
 cl::OptionCategory PathViewerCmdOpt("pathviewer", "pathviewer commandline options");
-enum ToolActions { GetInfo, Dump };
+enum ToolActions { GetInfo, Dump, Schedule, Diff, Align };
 static cl::opt<ToolActions> ToolAction(
     cl::desc("Tool actions:"), cl::init(GetInfo),
     cl::values(
       clEnumValN(GetInfo, "info", "Get summarized info of a recorded execution path (default)"),
-      clEnumValN(Dump, "dump", "Dump a recorded exectuion path (binary) to text format")
+      clEnumValN(Dump, "dump", "Dump a recorded exectuion path (binary) to text format"),
+      clEnumValN(Schedule, "schedule", "Print a histogram of SCHEDULE target threads"),
+      clEnumValN(Diff, "diff", "Print where the path diverges from the one given with -with"),
+      clEnumValN(Align, "align", "Print the common prefix of the path and the ones given with -with")
       ),
     cl::cat(PathViewerCmdOpt)
     );
@@ -29,6 +40,52 @@ static cl::opt<bool> DumpDataRec(
       "If this is true, \"*.path_datarec\" is needed."),
     cl::init(false), cl::cat(PathViewerCmdOpt)
     );
+static cl::opt<std::string> EntryRange(
+    "range",
+    cl::desc("Only dump entries N..M (0-based, M exclusive, either may be "
+      "omitted)"),
+    cl::init(""), cl::cat(PathViewerCmdOpt)
+    );
+static cl::opt<std::string> DataRecInst(
+    "inst",
+    cl::desc("Only dump the DATAREC entries of the instruction with the given "
+      "unique ID, prefixed with their entry number (implies -dumpdata)"),
+    cl::init(""), cl::cat(PathViewerCmdOpt)
+    );
+static cl::opt<unsigned> Jobs(
+    "j",
+    cl::desc("Number of threads used to scan the trace (default: number of "
+      "cores)"),
+    cl::init(0), cl::cat(PathViewerCmdOpt)
+    );
+static cl::opt<bool> IndexCache(
+    "index-cache",
+    cl::desc("Reuse or create \"*.path.idx\" next to the trace, so later "
+      "queries skip the full scan (default=false)"),
+    cl::init(false), cl::cat(PathViewerCmdOpt)
+    );
+static cl::list<std::string> WithPaths(
+    "with",
+    cl::desc("The *.path files to compare with (diff: one, align: any number, "
+      "comma separated)"),
+    cl::CommaSeparated, cl::cat(PathViewerCmdOpt)
+    );
+static cl::opt<unsigned> DiffContext(
+    "context",
+    cl::desc("Entries printed before and in each divergence (default=3)"),
+    cl::init(3), cl::cat(PathViewerCmdOpt)
+    );
+static cl::opt<unsigned> MaxDivergences(
+    "max-divergences",
+    cl::desc("Stop diff after this many divergences (default=10)"),
+    cl::init(10), cl::cat(PathViewerCmdOpt)
+    );
+static cl::opt<unsigned> ResyncWindow(
+    "resync-window",
+    cl::desc("Entries past a divergence searched for the paths to agree "
+      "again (default=1048576)"),
+    cl::init(1 << 20), cl::cat(PathViewerCmdOpt)
+    );
 static cl::opt<std::string> PathFile(cl::desc("*.path"),
     cl::Positional, cl::Required, cl::cat(PathViewerCmdOpt));
 
@@ -41,6 +98,9 @@ static void HideOptions(cl::OptionCategory &Category) {
     }
 }
 
+// associated *.path_datarec, only loaded with DumpDataRec
+static std::unique_ptr<DataRecBuffer> dataentries;
+
 static const char *PathEntry_t_str[] = {
   "FORK", "SWITCH_EXPIDX", "SWITCH_BBIDX", "INDIRECTBR", "DATAREC", "SCHEDULE"
 };
@@ -63,7 +123,9 @@ static std::ostream &operator<<(std::ostream &os, PathEntry pe) {
       // do not print anything about DATAREC without DumpDataRec
       break;
     case PathEntry::SCHEDULE:
-      os << "SCHEDULE TGTID " << pe.body.tgtid;
+      os << "SCHEDULE TGTID " << pe.scheduleTid();
+      if (pe.schedulePid())
+        os << " PID " << pe.schedulePid();
       break;
     default:
       os << "Unknown PathEntry";
@@ -76,8 +138,10 @@ static std::ostream &operator<<(std::ostream &os, std::pair<PathEntry, DataRecEn
   DataRecEntry &drec = entry_pair.second;
   if (pe.t == PathEntry::DATAREC) {
     APInt var((unsigned int)(pe.body.drec.width), drec.data);
+    const std::vector<std::string> &ids = dataentries->getIDTable();
     os << "DATAREC w" << std::dec << (unsigned int)(pe.body.drec.width)
-      << " (" << drec.instUniqueID << "): 0x" << std::hex << var.getLimitedValue();
+      << " (" << (drec.instID < ids.size() ? ids[drec.instID] : "?")
+      << "): 0x" << std::hex << var.getLimitedValue();
   }
   else {
     os << "only DATAREC can be printed with recorded data";
@@ -85,71 +149,269 @@ static std::ostream &operator<<(std::ostream &os, std::pair<PathEntry, DataRecEn
   return os;
 }
 
+// identifies the trace a cached index was built from
+static uint64_t getPathStamp(const std::string &path) {
+  sys::fs::file_status st;
+  if (sys::fs::status(path, st))
+    return 0;
+  uint64_t mtime = st.getLastModificationTime().time_since_epoch().count();
+  return mtime ^ (st.getSize() * 0x9e3779b97f4a7c15ULL);
+}
+
+// uses the cached index of the trace if any, see -index-cache
+static void loadIndex(PathIndex &index, const std::string &path,
+                      unsigned jobs) {
+  std::string error;
+  std::string index_file = path + ".idx";
+  uint64_t stamp = getPathStamp(path);
+  if (!IndexCache || !stamp || !index.load(index_file, stamp)) {
+    index.build(jobs);
+    if (IndexCache && stamp && !index.save(index_file, stamp, error))
+      std::cerr << "Warning: " << error << '\n';
+  }
+}
+
+// the thread running at entry pos, the SCHEDULE entry before it
+static void printThread(const PathEntryBuffer &entries,
+                        const PathIndex &index, size_t pos) {
+  size_t sched = index.lastOfType(pos, PathEntry::SCHEDULE);
+  if (sched == entries.size())
+    std::cout << "  thread: main\n";
+  else
+    std::cout << "  thread: " << entries[sched] << " (entry " << sched
+              << ")\n";
+}
+
+static void printEntries(const PathEntryBuffer &entries, size_t begin,
+                         size_t end, const char *prefix) {
+  for (size_t i = begin; i < end; ++i) {
+    const PathEntry &pe = entries[i];
+    std::cout << prefix << i << ": ";
+    if (pe.t == PathEntry::DATAREC)
+      std::cout << "DATAREC w" << (unsigned)pe.body.drec.width;
+    else
+      std::cout << pe;
+    std::cout << '\n';
+  }
+}
+
+static std::unique_ptr<PathEntryBuffer> openWith(const std::string &path) {
+  std::string error;
+  std::unique_ptr<PathEntryBuffer> entries =
+      PathEntryBuffer::open(path, error);
+  if (!entries)
+    std::cerr << "Cannot open " << path << ": " << error << '\n';
+  return entries;
+}
+
+static int diffPaths(const PathEntryBuffer &a, const PathIndex &indexA,
+                     unsigned jobs) {
+  if (WithPaths.size() != 1) {
+    std::cerr << "diff needs one -with path\n";
+    return 1;
+  }
+  std::unique_ptr<PathEntryBuffer> b = openWith(WithPaths[0]);
+  if (!b)
+    return 1;
+  PathIndex indexB(*b);
+  loadIndex(indexB, WithPaths[0], jobs);
+
+  PathDiff diff(a, indexA, *b, indexB, ResyncWindow);
+  std::vector<PathDivergence> divergences = diff.diff(MaxDivergences);
+  if (divergences.empty()) {
+    std::cout << "Identical: " << a.size() << " entries\n";
+    return 0;
+  }
+  std::cout << "Common prefix: " << divergences[0].a << " entries\n";
+  for (const PathDivergence &d : divergences) {
+    std::cout << "Divergence at " << d.a << " / " << d.b << ": " << d.lenA
+              << " / " << d.lenB << " entries\n";
+    printThread(a, indexA, d.a);
+    printEntries(a, d.a - std::min<size_t>(d.a, DiffContext), d.a, "  ");
+    printEntries(a, d.a, d.a + std::min<size_t>(d.lenA, DiffContext), "- ");
+    printEntries(*b, d.b, d.b + std::min<size_t>(d.lenB, DiffContext), "+ ");
+  }
+  return 0;
+}
+
+static int alignPaths(const PathEntryBuffer &a, const PathIndex &indexA,
+                      unsigned jobs) {
+  if (WithPaths.empty()) {
+    std::cerr << "align needs -with paths\n";
+    return 1;
+  }
+  std::vector<std::unique_ptr<PathEntryBuffer>> others;
+  std::vector<std::unique_ptr<PathIndex>> indexes;
+  size_t common = a.size();
+  for (const std::string &path : WithPaths) {
+    others.push_back(openWith(path));
+    if (!others.back())
+      return 1;
+    indexes.push_back(std::make_unique<PathIndex>(*others.back()));
+    loadIndex(*indexes.back(), path, jobs);
+    PathDiff diff(a, indexA, *others.back(), *indexes.back(), ResyncWindow);
+    common = std::min(common, diff.commonPrefix(0, 0));
+  }
+
+  // resuming at the end of the prefix needs as many recorded data
+  std::cout << "Common prefix: " << common << " entries, "
+            << indexA.dataRecBefore(common) << " DATAREC\n";
+  printThread(a, indexA, common);
+  auto printNext = [&](const std::string &path,
+                       const PathEntryBuffer &entries) {
+    std::cout << path << ": " << entries.size() << " entries";
+    if (common < entries.size())
+      printEntries(entries, common, common + 1, ", next ");
+    else
+      std::cout << ", ends\n";
+  };
+  printNext(PathFile, a);
+  for (size_t i = 0; i < others.size(); ++i)
+    printNext(WithPaths[i], *others[i]);
+  return 0;
+}
+
+static bool parseRange(const std::string &range, size_t &begin, size_t &end) {
+  size_t sep = range.find("..");
+  if (sep == std::string::npos)
+    return false;
+  std::string lo = range.substr(0, sep), hi = range.substr(sep + 2);
+  char *rest;
+  if (!lo.empty()) {
+    begin = strtoull(lo.c_str(), &rest, 10);
+    if (*rest)
+      return false;
+  }
+  if (!hi.empty()) {
+    end = strtoull(hi.c_str(), &rest, 10);
+    if (*rest)
+      return false;
+  }
+  return begin <= end;
+}
+
+static void dumpEntry(const PathEntry &pe, uint64_t drec_idx) {
+  if (DumpDataRec && (pe.t == PathEntry::DATAREC)) {
+    assert(drec_idx < dataentries->size() && ".path_datarec exhausts too early");
+    std::cout << std::make_pair(pe, (*dataentries)[drec_idx]) << '\n';
+  }
+  else if (DumpDataRec || (pe.t != PathEntry::DATAREC)){
+    // do not print an DATAREC entry here without DumpDataRec
+    std::cout << pe << '\n';
+  }
+}
+
+// all DATAREC entries of one instruction, found by a parallel scan of the
+// .path_datarec records
+static int dumpInstruction(const PathEntryBuffer &pathentries,
+                           const PathIndex &index, unsigned jobs) {
+  const std::vector<std::string> &ids = dataentries->getIDTable();
+  auto found = std::find(ids.begin(), ids.end(), DataRecInst);
+  if (found == ids.end()) {
+    std::cerr << "No DATAREC recorded for instruction " << DataRecInst << '\n';
+    return 1;
+  }
+  uint32_t instID = found - ids.begin();
+
+  size_t numChunks = (dataentries->size() + PathIndex::ChunkEntries - 1) /
+                     PathIndex::ChunkEntries;
+  std::vector<std::vector<uint64_t>> matches(numChunks);
+  forEachChunk(numChunks, jobs, [&](size_t c) {
+    size_t i = c * PathIndex::ChunkEntries;
+    size_t e = std::min(dataentries->size(), i + PathIndex::ChunkEntries);
+    for (; i < e; ++i)
+      if ((*dataentries)[i].instID == instID)
+        matches[c].push_back(i);
+  });
+
+  for (auto &chunk : matches) {
+    for (uint64_t record : chunk) {
+      size_t pos = index.entryOfDataRec(record);
+      if (pos == pathentries.size()) {
+        std::cerr << ".path has fewer DATAREC entries than .path_datarec\n";
+        return 1;
+      }
+      std::cout << std::dec << pos << ": "
+                << std::make_pair(pathentries[pos], (*dataentries)[record])
+                << '\n';
+    }
+  }
+  return 0;
+}
+
 int main(int argc, char **argv) {
     sys::PrintStackTraceOnErrorSignal(argv[0]);
     HideOptions(llvm::cl::GeneralCategory);
     cl::SetVersionPrinter(klee::printVersion);
     cl::ParseCommandLineOptions(argc, argv);
 
-    // load given *.path
-    std::vector<PathEntry> pathentries;
-    std::ifstream fpath(PathFile);
-    assert(fpath.good() && "Cannot open input .path file");
-    while (fpath.good()) {
-      PathEntry pe;
-      deserialize(fpath, pe);
-      fpath.peek();
-      pathentries.push_back(pe);
+    // load given *.path (either v1 or v2)
+    std::string error;
+    std::unique_ptr<PathEntryBuffer> pathentries =
+        PathEntryBuffer::open(PathFile, error);
+    if (!pathentries) {
+      std::cerr << "Cannot open input .path file: " << error << '\n';
+      return 1;
+    }
+
+    size_t range_begin = 0, range_end = pathentries->size();
+    if (!EntryRange.empty() &&
+        !parseRange(EntryRange, range_begin, range_end)) {
+      std::cerr << "Malformed -range, expected N..M\n";
+      return 1;
     }
-    fpath.close();
+    range_end = std::min(range_end, pathentries->size());
+    range_begin = std::min(range_begin, range_end);
+    if (!DataRecInst.empty())
+      DumpDataRec = true;
 
     // load associated *.path_datarec if necessary
-    std::vector<DataRecEntry> dataentries;
     if (DumpDataRec) {
-      std::ifstream fdpath(PathFile + "_datarec");
-      assert(fdpath.good() && "Cannot open associated .path_datarec file");
-      while (fdpath.good()) {
-        DataRecEntry drec;
-        deserialize(fdpath, drec);
-        fdpath.peek();
-        dataentries.push_back(drec);
+      dataentries = DataRecBuffer::open(PathFile + "_datarec", error);
+      if (!dataentries) {
+        std::cerr << "Cannot open associated .path_datarec file: " << error
+                  << '\n';
+        return 1;
       }
-      fdpath.close();
     }
 
-    uint32_t type_cnt[PathEntry::NUM_PATHENTRY_T] = {0};
-    uint32_t datarec_bytes = 0;
+    unsigned jobs = Jobs ? Jobs : std::thread::hardware_concurrency();
+    PathIndex index(*pathentries);
+    loadIndex(index, PathFile, jobs);
+
     switch (ToolAction) {
       case Dump:
+        if (!DataRecInst.empty())
+          return dumpInstruction(*pathentries, index, jobs);
         {
-          auto drec_it = dataentries.begin();
-          for (auto &pe: pathentries) {
-            if (DumpDataRec && (pe.t == PathEntry::DATAREC)) {
-              assert(drec_it != dataentries.end() && ".path_datarec exhausts too early");
-              std::cout << std::make_pair(pe, *drec_it) << '\n';
-              ++drec_it;
-            }
-            else if (DumpDataRec || (pe.t != PathEntry::DATAREC)){
-              // do not print an DATAREC entry here without DumpDataRec
-              std::cout << pe << '\n';
-            }
+          uint64_t drec_idx = DumpDataRec ? index.dataRecBefore(range_begin) : 0;
+          for (size_t i = range_begin; i < range_end; ++i) {
+            const PathEntry &pe = (*pathentries)[i];
+            dumpEntry(pe, drec_idx);
+            if (pe.t == PathEntry::DATAREC)
+              ++drec_idx;
           }
         }
         break;
       case GetInfo:
-        for (auto &pe: pathentries) {
-          if (pe.t < PathEntry::NUM_PATHENTRY_T) {
-            if (pe.t == PathEntry::DATAREC) {
-              datarec_bytes += pe.body.drec.width / 8;
-            }
-            ++type_cnt[pe.t];
+        {
+          std::cout << "Format: v" << pathentries->getVersion() << '\n';
+          PathIndex::Chunk totals = index.totals();
+          for (unsigned int i=0; i < PathEntry::NUM_PATHENTRY_T; ++i) {
+            std::cout << PathEntry_t_str[i] << ": " << totals.typeCount[i] << '\n';
           }
+          std::cout << "DataRecBytes: " << totals.dataRecBytes << std::endl;
         }
-        for (unsigned int i=0; i < PathEntry::NUM_PATHENTRY_T; ++i) {
-          std::cout << PathEntry_t_str[i] << ": " << type_cnt[i] << '\n';
+        break;
+      case Schedule:
+        for (auto &bucket : index.getScheduleHistogram()) {
+          std::cout << "TGTID " << bucket.first << ": " << bucket.second << '\n';
         }
-        std::cout << "DataRecBytes: " << datarec_bytes << std::endl;
         break;
+      case Diff:
+        return diffPaths(*pathentries, index, jobs);
+      case Align:
+        return alignPaths(*pathentries, index, jobs);
       default:
         ;
     }
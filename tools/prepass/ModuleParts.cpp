@@ -0,0 +1,268 @@
+//===-- ModuleParts.cpp ---------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ModuleParts.h"
+
+#include "klee/Config/Version.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+
+#if LLVM_VERSION_CODE >= LLVM_VERSION(4, 0)
+#include "llvm/Bitcode/BitcodeWriter.h"
+#else
+#include "llvm/Bitcode/ReaderWriter.h"
+#endif
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalAlias.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+
+const char *const ManifestName = "manifest.txt";
+const char *const GlobalsPartName = "globals.bc";
+
+std::string getDigest(StringRef data) {
+  MD5 hash;
+  hash.update(data);
+  MD5::MD5Result result;
+  hash.final(result);
+  SmallString<32> digest;
+  MD5::stringifyResult(result, digest);
+  return digest.str().str();
+}
+
+/// The file of the part holding the function of the given name, named after
+/// the function so that it stays the same while other functions change
+std::string getFunctionPartName(StringRef name) {
+  return "f" + getDigest(name).substr(0, 16) + ".bc";
+}
+
+/// Make the local symbols of M hidden external ones, named if they were not.
+void externalizeLocals(Module &M) {
+  auto externalize = [](GlobalValue &gv) {
+    if (!gv.hasLocalLinkage())
+      return;
+    if (!gv.hasName())
+      gv.setName("__prepass_anon");
+    gv.setLinkage(GlobalValue::ExternalLinkage);
+    gv.setVisibility(GlobalValue::HiddenVisibility);
+  };
+  for (Function &f : M)
+    externalize(f);
+  for (GlobalVariable &gv : M.globals())
+    externalize(gv);
+  for (GlobalAlias &ga : M.aliases())
+    externalize(ga);
+}
+
+/// Collect the globals referred to by the constant c.
+void collectGlobals(const Constant *c, std::set<const Constant *> &visited,
+                    std::vector<GlobalValue *> &globals) {
+  if (!visited.insert(c).second)
+    return;
+  if (const GlobalValue *gv = dyn_cast<GlobalValue>(c)) {
+    globals.push_back(const_cast<GlobalValue *>(gv));
+    return;
+  }
+  for (const Use &op : c->operands())
+    collectGlobals(cast<Constant>(op.get()), visited, globals);
+}
+
+/// A declaration in part of gv, which is defined in another part
+GlobalValue *declare(GlobalValue *gv, Module &part) {
+  GlobalValue *decl;
+  if (FunctionType *ft = dyn_cast<FunctionType>(gv->getValueType())) {
+    Function *f = Function::Create(ft, GlobalValue::ExternalLinkage,
+                                   gv->getName(), &part);
+    if (Function *original = dyn_cast<Function>(gv))
+      f->setAttributes(original->getAttributes());
+    decl = f;
+  } else {
+    GlobalVariable *original = dyn_cast<GlobalVariable>(gv);
+    decl = new GlobalVariable(
+        part, gv->getValueType(), original && original->isConstant(),
+        GlobalValue::ExternalLinkage, nullptr, gv->getName(), nullptr,
+        gv->getThreadLocalMode(), gv->getType()->getAddressSpace());
+  }
+  decl->setVisibility(gv->getVisibility());
+  return decl;
+}
+
+/// The part holding the definition of f, with declarations of the globals
+/// it refers to. The compile unit and the subprogram of f are shared with
+/// M, which is in the same context.
+std::unique_ptr<Module> extractFunction(Function &f) {
+  Module &M = *f.getParent();
+  std::unique_ptr<Module> part(new Module(f.getName(), M.getContext()));
+  part->setDataLayout(M.getDataLayout());
+  part->setTargetTriple(M.getTargetTriple());
+  SmallVector<Module::ModuleFlagEntry, 8> flags;
+  M.getModuleFlagsMetadata(flags);
+  for (const Module::ModuleFlagEntry &flag : flags)
+    part->addModuleFlag(flag.Behavior, flag.Key->getString(), flag.Val);
+
+  std::set<const Constant *> visited;
+  std::vector<GlobalValue *> globals;
+  if (f.hasPersonalityFn())
+    collectGlobals(f.getPersonalityFn(), visited, globals);
+  for (BasicBlock &b : f)
+    for (Instruction &i : b)
+      for (Value *op : i.operands()) {
+        if (MetadataAsValue *mav = dyn_cast<MetadataAsValue>(op))
+          if (ConstantAsMetadata *cam =
+                  dyn_cast<ConstantAsMetadata>(mav->getMetadata()))
+            op = cam->getValue();
+        if (Constant *c = dyn_cast<Constant>(op))
+          collectGlobals(c, visited, globals);
+      }
+
+  ValueToValueMapTy VMap;
+  Function *copy = Function::Create(f.getFunctionType(), f.getLinkage(),
+                                    f.getName(), part.get());
+  VMap[&f] = copy;
+  for (GlobalValue *gv : globals)
+    if (gv != &f)
+      VMap[gv] = declare(gv, *part);
+  Function::arg_iterator ca = copy->arg_begin();
+  for (Argument &a : f.args()) {
+    ca->setName(a.getName());
+    VMap[&a] = &*ca++;
+  }
+  SmallVector<ReturnInst *, 8> returns;
+  CloneFunctionInto(copy, &f, VMap, /*ModuleLevelChanges=*/true, returns);
+  copy->setLinkage(f.getLinkage());
+  copy->setVisibility(f.getVisibility());
+  copy->setComdat(nullptr);
+
+  if (DISubprogram *sp = copy->getSubprogram())
+    if (DICompileUnit *cu = sp->getUnit())
+      part->getOrInsertNamedMetadata("llvm.dbg.cu")->addOperand(cu);
+  return part;
+}
+
+/// The part holding the global variables and aliases of M
+std::unique_ptr<Module> extractGlobals(Module &M) {
+  ValueToValueMapTy VMap;
+  auto isData = [](const GlobalValue *gv) { return !isa<Function>(gv); };
+#if LLVM_VERSION_CODE >= LLVM_VERSION(7, 0)
+  std::unique_ptr<Module> part = CloneModule(M, VMap, isData);
+#else
+  std::unique_ptr<Module> part = CloneModule(&M, VMap, isData);
+#endif
+  std::vector<Function *> unused;
+  for (Function &f : *part)
+    if (f.use_empty())
+      unused.push_back(&f);
+  for (Function *f : unused)
+    f->eraseFromParent();
+  return part;
+}
+
+std::map<std::string, std::string> readManifest(const std::string &path) {
+  std::map<std::string, std::string> digests;
+  auto buffer = MemoryBuffer::getFile(path);
+  if (!buffer)
+    return digests;
+  SmallVector<StringRef, 0> lines;
+  (*buffer)->getBuffer().split(lines, '\n', -1, false);
+  for (StringRef line : lines) {
+    std::pair<StringRef, StringRef> fields = line.split(' ');
+    digests[fields.second.split(' ').first.str()] = fields.first.str();
+  }
+  return digests;
+}
+
+} // namespace
+
+unsigned klee::writeModuleParts(Module &M, const std::string &dir,
+                                unsigned &total) {
+  if (auto EC = sys::fs::create_directories(dir))
+    klee_error("cannot create directory %s: %s", dir.c_str(),
+               EC.message().c_str());
+  SmallString<128> manifestPath(dir);
+  sys::path::append(manifestPath, ManifestName);
+  std::map<std::string, std::string> previous =
+      readManifest(manifestPath.str().str());
+
+  externalizeLocals(M);
+
+  std::string manifest;
+  raw_string_ostream manifestOS(manifest);
+  unsigned written = 0;
+  total = 0;
+  auto writePart = [&](Module &part, const std::string &file,
+                       StringRef name) {
+    SmallVector<char, 0> bitcode;
+    raw_svector_ostream os(bitcode);
+#if LLVM_VERSION_CODE >= LLVM_VERSION(7, 0)
+    WriteBitcodeToFile(part, os);
+#else
+    WriteBitcodeToFile(&part, os);
+#endif
+    std::string digest = getDigest(StringRef(bitcode.data(), bitcode.size()));
+    manifestOS << digest << " " << file << " " << name << "\n";
+    ++total;
+
+    SmallString<128> path(dir);
+    sys::path::append(path, file);
+    auto it = previous.find(file);
+    bool unchanged = it != previous.end() && it->second == digest &&
+                     sys::fs::exists(path);
+    if (it != previous.end())
+      previous.erase(it);
+    if (unchanged)
+      return;
+
+    std::error_code EC;
+    raw_fd_ostream fs(path, EC, sys::fs::F_None);
+    if (EC)
+      klee_error("error opening %s: %s", path.c_str(), EC.message().c_str());
+    fs.write(bitcode.data(), bitcode.size());
+    ++written;
+  };
+
+  std::unique_ptr<Module> globals = extractGlobals(M);
+  writePart(*globals, GlobalsPartName, "");
+  for (Function &f : M) {
+    if (f.isDeclaration())
+      continue;
+    std::unique_ptr<Module> part = extractFunction(f);
+    writePart(*part, getFunctionPartName(f.getName()), f.getName());
+  }
+
+  // the parts of the functions that are gone
+  for (auto &p : previous) {
+    SmallString<128> path(dir);
+    sys::path::append(path, p.first);
+    sys::fs::remove(path);
+  }
+
+  std::error_code EC;
+  raw_fd_ostream fs(manifestPath, EC, sys::fs::F_None);
+  if (EC)
+    klee_error("error opening %s: %s", manifestPath.c_str(),
+               EC.message().c_str());
+  fs << manifestOS.str();
+  return written;
+}
@@ -0,0 +1,38 @@
+//===-- ModuleParts.h -------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Incremental output of prepass: the instrumented module split into one
+// bitcode file per defined function and one holding the global variables,
+// so that a build only recompiles the parts a changed -ptwrite-cfg affected.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_MODULEPARTS_H
+#define KLEE_MODULEPARTS_H
+
+#include <string>
+
+namespace llvm {
+class Module;
+}
+
+namespace klee {
+
+  /// Write M in parts to dir, next to a manifest with the digest of every
+  /// part. A part whose digest is the one in the manifest of the last run
+  /// is left untouched, the files of parts that no longer exist are
+  /// removed. The local symbols of M become hidden external ones, so that
+  /// the parts link with each other.
+  /// \return the number of parts written, of total
+  unsigned writeModuleParts(llvm::Module &M, const std::string &dir,
+                            unsigned &total);
+
+}
+
+#endif /* KLEE_MODULEPARTS_H */
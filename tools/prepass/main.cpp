@@ -3,6 +3,7 @@
 #include "klee/Internal/Module/InstructionInfoTable.h"
 #include "klee/Internal/Module/KInstruction.h"
 #include "klee/Internal/Module/KModule.h"
+#include "klee/Internal/Module/Passes.h"
 #include "klee/Internal/Support/Debug.h"
 #include "klee/Internal/Support/ErrorHandling.h"
 #include "klee/Internal/Support/ModuleUtil.h"
@@ -10,6 +11,8 @@
 #include "klee/OptionCategories.h"
 #include "klee/Internal/Support/PrintVersion.h"
 
+#include "ModuleParts.h"
+
 #if LLVM_VERSION_CODE >= LLVM_VERSION(4, 0)
 #include "llvm/Bitcode/BitcodeWriter.h"
 #else
@@ -101,6 +104,51 @@ llvm::cl::opt<std::string> PTWriteWholeFunCFG(
     llvm::cl::desc(
         "A list of function names, whose entire body should be instrumented"),
     llvm::cl::init(""), llvm::cl::cat(klee::HASEPrePassCat));
+llvm::cl::opt<bool> PTWriteOptimize(
+    "ptwrite-optimize",
+    llvm::cl::desc("Record an instruction of -ptwrite-cfg through a less "
+                   "frequently executed value it is computed from (e.g. a "
+                   "loop-invariant base), according to the frequency info "
+                   "of the input bitcode. (default=false)"),
+    llvm::cl::init(false), llvm::cl::cat(klee::HASEPrePassCat));
+llvm::cl::opt<klee::PTWriteMode> PTWriteGuard(
+    "ptwrite-mode",
+    llvm::cl::desc("When an instrumented scalar value emits its ptwrite. "
+                   "Values wider than 64 bits are always recorded."),
+    llvm::cl::values(
+        clEnumValN(klee::PTWriteMode::Always, "always",
+                   "On every execution (default)"),
+        clEnumValN(klee::PTWriteMode::Changed, "changed",
+                   "When the value differs from the value last recorded "
+                   "at the same place"),
+        clEnumValN(klee::PTWriteMode::Sampled, "sampled",
+                   "On every -ptwrite-sample-period-th execution")
+            KLEE_LLVM_CL_VAL_END),
+    llvm::cl::init(klee::PTWriteMode::Always),
+    llvm::cl::cat(klee::HASEPrePassCat));
+llvm::cl::opt<unsigned> PTWriteSamplePeriod(
+    "ptwrite-sample-period",
+    llvm::cl::desc("Executions per ptwrite with -ptwrite-mode=sampled, or "
+                   "of the sites sampled to stay within -ptwrite-budget. "
+                   "(default=64)"),
+    llvm::cl::init(64), llvm::cl::cat(klee::HASEPrePassCat));
+llvm::cl::opt<uint64_t> PTWriteBudgetBytes(
+    "ptwrite-budget",
+    llvm::cl::desc("Intel PT bandwidth in bytes per second the ptwrites may "
+                   "use, estimated from the frequency info of the input "
+                   "bitcode. The sites producing the most trace are sampled "
+                   "until the estimate fits. (default=0, no limit)"),
+    llvm::cl::init(0), llvm::cl::cat(klee::HASEPrePassCat));
+llvm::cl::opt<double> PTWriteProfileSeconds(
+    "ptwrite-profile-seconds",
+    llvm::cl::desc("Length in seconds of the profiled run the frequency info "
+                   "comes from (default=1)"),
+    llvm::cl::init(1), llvm::cl::cat(klee::HASEPrePassCat));
+llvm::cl::opt<bool> PTWriteFUP(
+    "ptwrite-fup",
+    llvm::cl::desc("Account for the FUP packet PT emits with each ptwrite "
+                   "when configured with FUPonPTW (default=false)"),
+    llvm::cl::init(false), llvm::cl::cat(klee::HASEPrePassCat));
 llvm::cl::opt<bool>
     InsertTag("insert-tag",
               llvm::cl::desc("Insert tags to specific places. (default=false)"),
@@ -116,6 +164,14 @@ llvm::cl::opt<std::string>
                           "One instruction unique ID per line."),
            llvm::cl::init(""), llvm::cl::cat(klee::HASEPrePassCat));
 
+llvm::cl::opt<std::string> IncrementalDir(
+    "incremental-dir",
+    llvm::cl::desc("Also write the output in parts to this directory, one "
+                   "bitcode file per function, rewriting only the parts "
+                   "that differ from its last contents (e.g. those whose "
+                   "-ptwrite-cfg sites changed)"),
+    llvm::cl::init(""), llvm::cl::cat(klee::HASEPrePassCat));
+
 static llvm::cl::extrahelp extrahelp(
     "\n"
     "NOTE: You need an input bitcode containing frequency info to see "
@@ -127,6 +183,44 @@ llvm::cl::opt<bool> AssignDebugIR(
     llvm::cl::init(false),
     llvm::cl::cat(klee::HASEPrePassCat));
 
+llvm::cl::opt<bool> DebugIRLazy(
+    "debugir-lazy",
+    llvm::cl::desc("With -debugir, only give locations to the functions with "
+                   "an instruction in -ptwrite-cfg or -tag-cfg or listed in "
+                   "-ptwrite-func-cfg, the others are left without any. The "
+                   "DebugIR file only holds these functions"),
+    llvm::cl::init(false), llvm::cl::cat(klee::HASEPrePassCat));
+
+llvm::cl::opt<bool> DebugIRIndex(
+    "debugir-index",
+    llvm::cl::desc("With -debugir, write the line of every function and "
+                   "block in the DebugIR file to a .debug-ll.idx index "
+                   "instead of writing the file"),
+    llvm::cl::init(false), llvm::cl::cat(klee::HASEPrePassCat));
+
+llvm::cl::opt<unsigned> DebugIRJobs(
+    "debugir-jobs",
+    llvm::cl::desc("Number of threads printing functions for -debugir-lazy "
+                   "and -debugir-index (default=number of cores)"),
+    llvm::cl::init(0), llvm::cl::cat(klee::HASEPrePassCat));
+
+/// Add the functions of the instruction IDs of cfg, or its lines if they
+/// are function names, to functions
+static void addCFGFunctions(const std::string &cfg, bool functionNames,
+                            std::set<std::string> &functions) {
+  if (cfg.empty())
+    return;
+  std::ifstream f(cfg);
+  if (!f)
+    klee_error("cannot open %s", cfg.c_str());
+  std::string line;
+  while (std::getline(f, line)) {
+    if (line.empty() || line[0] == '#')
+      continue;
+    functions.insert(functionNames ? line : line.substr(0, line.find(':')));
+  }
+}
+
 static void HideOptions() {
     StringMap<cl::Option *> &map = cl::getRegisteredOptions();
     for (auto &elem : map) {
@@ -174,8 +268,18 @@ int main(int argc, char **argv) {
     }
 
     if (InsertPTWrite) {
+      if (PTWriteSamplePeriod == 0)
+        klee_error("-ptwrite-sample-period must be positive");
+      if (PTWriteProfileSeconds <= 0)
+        klee_error("-ptwrite-profile-seconds must be positive");
+      klee::PTWriteBudget budget;
+      budget.bytesPerSecond = PTWriteBudgetBytes;
+      budget.profileSeconds = PTWriteProfileSeconds;
+      budget.fupOnPTW = PTWriteFUP;
       if (!PTWriteInstCFG.empty() || !PTWriteWholeFunCFG.empty())
-        KModule::addPTWrite(M, PTWriteInstCFG, PTWriteWholeFunCFG);
+        KModule::addPTWrite(M, PTWriteInstCFG, PTWriteWholeFunCFG,
+                            PTWriteOptimize, PTWriteGuard,
+                            PTWriteSamplePeriod, budget);
     }
 
     if (InsertTagLoc) {
@@ -198,7 +302,22 @@ int main(int argc, char **argv) {
       llvm::sys::path::system_temp_directory(true, tempdir);
       std::string directory = tempdir.str().str();
       std::string filename = M->getName().str();
-      KModule::assignDebugIR(M, directory, filename);
+      if (DebugIRLazy || DebugIRIndex) {
+        klee::DebugIRScope scope;
+        if (DebugIRLazy) {
+          addCFGFunctions(PTWriteInstCFG, false, scope.functions);
+          addCFGFunctions(PTWriteWholeFunCFG, true, scope.functions);
+          addCFGFunctions(TagCFG, false, scope.functions);
+          if (scope.functions.empty())
+            klee_error("-debugir-lazy needs -ptwrite-cfg, -ptwrite-func-cfg "
+                       "or -tag-cfg");
+        }
+        scope.lineIndexOnly = DebugIRIndex;
+        scope.jobs = DebugIRJobs;
+        KModule::assignDebugIR(M, directory, filename, scope);
+      } else {
+        KModule::assignDebugIR(M, directory, filename);
+      }
     }
 
 #if LLVM_VERSION_CODE >= LLVM_VERSION(7, 0)
@@ -209,6 +328,13 @@ int main(int argc, char **argv) {
     fs.close();
     llvm::outs() << "Module saved to " << OutputFile << "\n";
 
+    if (!IncrementalDir.empty()) {
+      unsigned total;
+      unsigned written = klee::writeModuleParts(*M, IncrementalDir, total);
+      llvm::outs() << "Wrote " << written << " of " << total
+                   << " module parts to " << IncrementalDir << "\n";
+    }
+
     M = nullptr;
     loadedModules.clear();
 
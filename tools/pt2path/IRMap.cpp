@@ -0,0 +1,149 @@
+//===-- IRMap.cpp ---------------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "IRMap.h"
+
+#include "klee/Config/Version.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/DebugInfo/DWARF/DWARFContext.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Support/Path.h"
+
+#include <algorithm>
+
+using namespace llvm;
+using namespace klee;
+
+namespace {
+typedef DenseMap<unsigned, const Instruction *> LineMap;
+
+std::string getPath(StringRef directory, StringRef filename) {
+  if (sys::path::is_absolute(filename))
+    return filename.str();
+  SmallString<128> path(directory);
+  sys::path::append(path, filename);
+  return path.str().str();
+}
+} // namespace
+
+bool IRMap::load(const Module &M, const std::string &binary,
+                 uint64_t loadBias, std::string &error) {
+  // the instruction of every line of every file of the module. phis and
+  // debug intrinsics have no code of their own.
+  StringMap<LineMap> lines;
+  for (const Function &f : M) {
+    for (const BasicBlock &b : f) {
+      for (const Instruction &i : b) {
+        if (isa<PHINode>(i) || isa<DbgInfoIntrinsic>(i))
+          continue;
+        const DebugLoc &loc = i.getDebugLoc();
+        if (!loc || !loc.getLine())
+          continue;
+        const DIScope *scope = cast<DIScope>(loc.getScope());
+        LineMap &map =
+            lines[getPath(scope->getDirectory(), scope->getFilename())];
+        if (!map.insert(std::make_pair(loc.getLine(), &i)).second)
+          ++ambiguousLines;
+      }
+    }
+  }
+
+  auto binOrErr = object::ObjectFile::createObjectFile(binary);
+  if (!binOrErr) {
+    error = toString(binOrErr.takeError());
+    return false;
+  }
+  const object::ObjectFile &obj = *binOrErr->getBinary();
+
+  for (const object::SectionRef &s : obj.sections()) {
+    if (!s.isText() || s.isVirtual() || !s.getSize())
+      continue;
+#if LLVM_VERSION_CODE >= LLVM_VERSION(9, 0)
+    Expected<StringRef> contents = s.getContents();
+    if (!contents) {
+      error = toString(contents.takeError());
+      return false;
+    }
+    const char *data = contents->data();
+#else
+    StringRef contents;
+    if (std::error_code EC = s.getContents(contents)) {
+      error = EC.message();
+      return false;
+    }
+    const char *data = contents.data();
+#endif
+    sections.push_back({uint64_t(data - obj.getData().data()), s.getSize(),
+                        s.getAddress() + loadBias});
+  }
+
+  std::unique_ptr<DWARFContext> ctx = DWARFContext::create(obj);
+  for (const auto &cu : ctx->compile_units()) {
+    const DWARFDebugLine::LineTable *lt = ctx->getLineTableForUnit(cu.get());
+    if (!lt)
+      continue;
+    const char *compDir = cu->getCompilationDir();
+    DenseMap<uint64_t, const LineMap *> files;
+    for (const DWARFDebugLine::Row &row : lt->Rows) {
+#if LLVM_VERSION_CODE >= LLVM_VERSION(9, 0)
+      uint64_t address = row.Address.Address + loadBias;
+#else
+      uint64_t address = row.Address + loadBias;
+#endif
+      const Instruction *inst = nullptr;
+      if (!row.EndSequence) {
+        auto file = files.find(row.File);
+        if (file == files.end()) {
+          std::string name;
+          const LineMap *map = nullptr;
+          if (lt->getFileNameByIndex(
+                  row.File, compDir ? compDir : "",
+                  DILineInfoSpecifier::FileLineInfoKind::AbsoluteFilePath,
+                  name)) {
+            auto it = lines.find(name);
+            if (it != lines.end())
+              map = &it->second;
+          }
+          file = files.insert(std::make_pair(row.File, map)).first;
+        }
+        if (file->second) {
+          auto it = file->second->find(row.Line);
+          if (it != file->second->end())
+            inst = it->second;
+        }
+      }
+      rows.push_back(std::make_pair(address, inst));
+    }
+  }
+  // a sequence may start where another one ends
+  std::stable_sort(rows.begin(), rows.end(),
+                   [](const std::pair<uint64_t, const Instruction *> &a,
+                      const std::pair<uint64_t, const Instruction *> &b) {
+                     return a.first < b.first ||
+                            (a.first == b.first && !a.second && b.second);
+                   });
+  return true;
+}
+
+const Instruction *IRMap::lookup(uint64_t ip) const {
+  auto it = std::upper_bound(
+      rows.begin(), rows.end(), ip,
+      [](uint64_t ip, const std::pair<uint64_t, const Instruction *> &row) {
+        return ip < row.first;
+      });
+  if (it == rows.begin())
+    return nullptr;
+  return std::prev(it)->second;
+}
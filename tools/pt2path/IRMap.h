@@ -0,0 +1,66 @@
+//===-- IRMap.h -------------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Maps the instruction addresses of a binary compiled from a prepass
+// -debugir module back to the LLVM IR instructions of that module, through
+// the DWARF line table: with -debugir, the line of every IR instruction is
+// its line in the textual module, so a line identifies one instruction.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_IRMAP_H
+#define KLEE_IRMAP_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace llvm {
+class Instruction;
+class Module;
+}
+
+namespace klee {
+
+  class IRMap {
+  public:
+    /// An executable section of the binary, in its file and in memory
+    struct Section {
+      uint64_t fileOffset;
+      uint64_t size;
+      uint64_t address;
+    };
+
+  private:
+    /// (start address, instruction) of every line table row in order. The
+    /// instruction is nullptr for rows that end a sequence or whose line is
+    /// not one of the module.
+    std::vector<std::pair<uint64_t, const llvm::Instruction *>> rows;
+    std::vector<Section> sections;
+    /// lines that several instructions of the module share
+    unsigned ambiguousLines = 0;
+
+  public:
+    /// Read the line table of binary, loaded loadBias bytes above the
+    /// addresses it was linked at, for the instructions of M.
+    /// \return false and set error if the binary cannot be read
+    bool load(const llvm::Module &M, const std::string &binary,
+              uint64_t loadBias, std::string &error);
+
+    /// The instruction the code at ip was generated for, or nullptr
+    const llvm::Instruction *lookup(uint64_t ip) const;
+
+    const std::vector<Section> &getSections() const { return sections; }
+    unsigned getAmbiguousLines() const { return ambiguousLines; }
+  };
+
+} // namespace klee
+
+#endif /* KLEE_IRMAP_H */
@@ -0,0 +1,170 @@
+//===-- PathBuilder.cpp ---------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PathBuilder.h"
+
+#include "klee/Internal/Module/KInstruction.h"
+
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/Instructions.h"
+
+#include <algorithm>
+
+using namespace llvm;
+using namespace klee;
+
+void PathBuilder::add(const std::vector<TraceEvent> &events) {
+  for (const TraceEvent &event : events) {
+    if (finished)
+      return;
+    switch (event.kind) {
+    case TraceEvent::Block:
+      enter(event.inst->getParent(), event.reentry);
+      break;
+    case TraceEvent::Call:
+      stack.push_back({nullptr, false});
+      break;
+    case TraceEvent::Return:
+      // a return out of the frame the trace started in
+      if (stack.empty())
+        break;
+      if (isRecording() && stack.size() == (size_t)base + 1)
+        finished = true;
+      if (stack.back().isIgnored)
+        --ignoredFrames;
+      stack.pop_back();
+      break;
+    case TraceEvent::PTWrite:
+      if (isRecording())
+        recordData(event.inst, event.payload);
+      break;
+    case TraceEvent::Gap:
+      // the blocks the frames were in are unknown from here on
+      ++stats.gaps;
+      for (Frame &frame : stack)
+        frame.bb = nullptr;
+      break;
+    }
+  }
+}
+
+void PathBuilder::enter(const BasicBlock *bb, bool reentry) {
+  if (stack.empty())
+    stack.push_back({nullptr, false});
+  Frame &top = stack.back();
+  if (base < 0 && !top.bb && bb == &entryPoint->getEntryBlock())
+    base = stack.size() - 1;
+  PathEntry pe;
+  if (top.bb && isRecording() && top.bb->getParent() == bb->getParent() &&
+      (top.bb != bb || reentry) && transfer(top.bb, bb, pe)) {
+    if (ignoredFrames)
+      ++stats.ignoredEntries;
+    else
+      entries.push_back(pe);
+  }
+  if (!top.bb || top.bb->getParent() != bb->getParent()) {
+    if (top.isIgnored)
+      --ignoredFrames;
+    top.isIgnored = ignored.count(bb->getParent());
+    if (top.isIgnored)
+      ++ignoredFrames;
+  }
+  top.bb = bb;
+}
+
+bool PathBuilder::transfer(const BasicBlock *from, const BasicBlock *to,
+                           PathEntry &pe) {
+  const Instruction *term = from->getTerminator();
+  if (const BranchInst *bi = dyn_cast<BranchInst>(term)) {
+    if (bi->isUnconditional()) {
+      if (bi->getSuccessor(0) != to)
+        ++stats.unexpectedBlocks;
+      return false;
+    }
+    pe.t = PathEntry::FORK;
+    if (bi->getSuccessor(0) == to) {
+      pe.body.br = true;
+    } else if (bi->getSuccessor(1) == to) {
+      pe.body.br = false;
+    } else {
+      ++stats.unexpectedBlocks;
+      return false;
+    }
+  } else if (const SwitchInst *si = dyn_cast<SwitchInst>(term)) {
+    // the executor records the successor of the case the value matched,
+    // the trace only has the block
+    unsigned index = 0, matches = 0;
+    for (unsigned i = 0, e = si->getNumSuccessors(); i != e; ++i)
+      if (si->getSuccessor(i) == to && !matches++)
+        index = i;
+    if (!matches) {
+      ++stats.unexpectedBlocks;
+      return false;
+    }
+    if (matches > 1)
+      ++stats.ambiguousSwitches;
+    pe.t = PathEntry::SWITCH_EXPIDX;
+    pe.body.switchIndex = index;
+  } else if (const IndirectBrInst *ibi = dyn_cast<IndirectBrInst>(term)) {
+    // numbered like KIndirectBrInstruction::destinations, without repeats
+    std::vector<const BasicBlock *> destinations;
+    for (unsigned k = 0, e = ibi->getNumDestinations(); k != e; ++k) {
+      const BasicBlock *d = ibi->getDestination(k);
+      if (std::find(destinations.begin(), destinations.end(), d) ==
+          destinations.end())
+        destinations.push_back(d);
+    }
+    auto it = std::find(destinations.begin(), destinations.end(), to);
+    if (it == destinations.end()) {
+      ++stats.unexpectedBlocks;
+      return false;
+    }
+    pe.t = PathEntry::INDIRECTBR;
+    pe.body.indirectbrIndex = it - destinations.begin();
+  } else {
+    for (unsigned i = 0, e = term->getNumSuccessors(); i != e; ++i)
+      if (term->getSuccessor(i) == to)
+        return false;
+    ++stats.unexpectedBlocks;
+    return false;
+  }
+  return true;
+}
+
+void PathBuilder::recordData(const Instruction *ptwrite, uint64_t payload) {
+  const CallInst *ci = dyn_cast_or_null<CallInst>(ptwrite);
+  const InlineAsm *ia =
+      ci ? dyn_cast<InlineAsm>(ci->getCalledValue()) : nullptr;
+  const Instruction *recI =
+      ia && ia->getAsmString() == "ptwrite $0"
+          ? dyn_cast<Instruction>(ci->getArgOperand(0))
+          : nullptr;
+  if (!recI) {
+    ++stats.unmappedPTWrites;
+    return;
+  }
+
+  PathEntry pe;
+  pe.t = PathEntry::DATAREC;
+  pe.body.drec.IDlen = 0;
+  pe.body.drec.width = DL.getTypeSizeInBits(recI->getType());
+  entries.push_back(pe);
+
+  auto it = recordedIDs.find(recI);
+  if (it == recordedIDs.end()) {
+    it = recordedIDs.insert(std::make_pair(recI, idNames.size())).first;
+    idNames.push_back(KInstruction::getUniqueID(recI));
+  }
+  DataRecEntry dre;
+  dre.instID = it->second;
+  dre.data = payload;
+  dataRecs.push_back(dre);
+}
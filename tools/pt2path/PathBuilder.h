@@ -0,0 +1,105 @@
+//===-- PathBuilder.h -------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Turns the TraceEvent streams of consecutive trace segments into the
+// PathEntry and DataRecEntry streams KLEE records and replays. It follows
+// the block taken after every terminator of the module the way the executor
+// would record it: a FORK per conditional branch, a SWITCH_EXPIDX per switch
+// and an INDIRECTBR per indirectbr, and a DATAREC per ptwrite. Like klee
+// -ignore-posix-path, it can leave out the branches taken while a function
+// of the POSIX runtime is on the stack, which the replay does not follow.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_PATHBUILDER_H
+#define KLEE_PATHBUILDER_H
+
+#include "TraceDecoder.h"
+
+#include "klee/Internal/Support/SerializableTypes.h"
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace llvm {
+class BasicBlock;
+class DataLayout;
+class Function;
+}
+
+namespace klee {
+
+  class PathBuilder {
+  public:
+    struct Stats {
+      uint64_t gaps = 0;
+      /// blocks entered that are no successor of the block before
+      uint64_t unexpectedBlocks = 0;
+      /// switches whose target is the successor of several cases
+      uint64_t ambiguousSwitches = 0;
+      /// ptwrites whose address maps to no ptwrite of the module
+      uint64_t unmappedPTWrites = 0;
+      /// entries left out inside ignored functions
+      uint64_t ignoredEntries = 0;
+    };
+
+  private:
+    const llvm::DataLayout &DL;
+    const llvm::Function *entryPoint;
+    const std::set<const llvm::Function *> &ignored;
+    struct Frame {
+      /// the block running, nullptr while it is unknown or outside of the
+      /// module
+      const llvm::BasicBlock *bb;
+      /// whether the function of bb is one of ignored
+      bool isIgnored;
+    };
+    std::vector<Frame> stack;
+    /// frames of ignored functions on the stack
+    unsigned ignoredFrames = 0;
+    /// frames below the one of entryPoint, -1 before it is entered
+    int base = -1;
+    bool finished = false;
+    std::vector<PathEntry> entries;
+    std::vector<DataRecEntry> dataRecs;
+    std::map<const llvm::Instruction *, uint32_t> recordedIDs;
+    std::vector<std::string> idNames;
+    Stats stats;
+
+    bool isRecording() const { return base >= 0 && !finished; }
+    void enter(const llvm::BasicBlock *bb, bool reentry);
+    /// The entry recording that from was left for to.
+    /// \return false if the executor records nothing for it
+    bool transfer(const llvm::BasicBlock *from, const llvm::BasicBlock *to,
+                  PathEntry &pe);
+    void recordData(const llvm::Instruction *ptwrite, uint64_t payload);
+
+  public:
+    /// Record from the first call of _entryPoint until it returns, except
+    /// for the branches taken while a function of _ignored runs.
+    PathBuilder(const llvm::DataLayout &_DL,
+                const llvm::Function *_entryPoint,
+                const std::set<const llvm::Function *> &_ignored)
+        : DL(_DL), entryPoint(_entryPoint), ignored(_ignored) {}
+
+    void add(const std::vector<TraceEvent> &events);
+
+    const std::vector<PathEntry> &getEntries() const { return entries; }
+    /// DataRecEntry::instID indexes getIDName()
+    const std::vector<DataRecEntry> &getDataRecs() const { return dataRecs; }
+    const std::string &getIDName(uint32_t id) const { return idNames[id]; }
+    const Stats &getStats() const { return stats; }
+    bool hasStarted() const { return base >= 0; }
+  };
+
+} // namespace klee
+
+#endif /* KLEE_PATHBUILDER_H */
@@ -0,0 +1,159 @@
+//===-- PathValidator.cpp -------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "PathValidator.h"
+
+#include "klee/Internal/Module/KInstruction.h"
+
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+
+#include <algorithm>
+
+using namespace llvm;
+using namespace klee;
+
+namespace {
+const char *getTypeName(PathEntry::PathEntry_t t) {
+  static const char *names[] = {"FORK",    "SWITCH_EXPIDX", "SWITCH_BBIDX",
+                                "INDIRECTBR", "DATAREC",    "SCHEDULE"};
+  return t < PathEntry::NUM_PATHENTRY_T ? names[t] : "invalid";
+}
+} // namespace
+
+size_t klee::validatePath(const Function *entryPoint,
+                          const std::set<const Function *> &ignored,
+                          const std::vector<PathEntry> &entries,
+                          std::string &problem) {
+  // the next instruction of every frame
+  std::vector<BasicBlock::const_iterator> stack;
+  stack.push_back(entryPoint->getEntryBlock().begin());
+  size_t pos = 0;
+  // a loop without conditional branches would never end
+  uint64_t steps = 0, maxSteps = (entries.size() + 1) << 20;
+
+  auto expect = [&](PathEntry::PathEntry_t t, const Instruction *i) {
+    const char *got = pos < entries.size() ? getTypeName(entries[pos].t)
+                                           : "the end of the path";
+    if (pos < entries.size() && entries[pos].t == t)
+      return true;
+    problem = std::string("the replay asks for a ") + getTypeName(t) +
+              " at " + KInstruction::getUniqueID(i) + " but gets " + got;
+    return false;
+  };
+  auto jump = [&](const BasicBlock *bb) { stack.back() = bb->begin(); };
+
+  while (!stack.empty()) {
+    if (++steps > maxSteps) {
+      problem = "the walk does not end";
+      return pos;
+    }
+    const Instruction *i = &*stack.back()++;
+    if (isa<DbgInfoIntrinsic>(i))
+      continue;
+
+    if (isa<CallInst>(i) || isa<InvokeInst>(i)) {
+      ImmutableCallSite cs(i);
+      const Value *callee = cs.getCalledValue()->stripPointerCasts();
+      if (const InlineAsm *ia = dyn_cast<InlineAsm>(callee)) {
+        // PathBuilder drops the ptwrites of no instruction, the replay
+        // cannot load them either
+        if (ia->getAsmString() == "ptwrite $0" &&
+            isa<Instruction>(cs.getArgument(0))) {
+          if (!expect(PathEntry::DATAREC, i))
+            return pos;
+          ++pos;
+        }
+      } else if (const Function *f = dyn_cast<Function>(callee)) {
+        if (!f->isDeclaration() && !ignored.count(f)) {
+          if (isa<InvokeInst>(i)) {
+            problem = "the walk does not follow unwinding, at invoke " +
+                      KInstruction::getUniqueID(i);
+            return pos;
+          }
+          stack.push_back(f->getEntryBlock().begin());
+          continue;
+        }
+      } else {
+        problem = "the walk cannot follow the indirect call at " +
+                  KInstruction::getUniqueID(i);
+        return pos;
+      }
+      if (const InvokeInst *ii = dyn_cast<InvokeInst>(i))
+        jump(ii->getNormalDest());
+      continue;
+    }
+
+    switch (i->getOpcode()) {
+    case Instruction::Ret:
+      stack.pop_back();
+      break;
+    case Instruction::Br: {
+      const BranchInst *bi = cast<BranchInst>(i);
+      if (bi->isUnconditional()) {
+        jump(bi->getSuccessor(0));
+        break;
+      }
+      if (!expect(PathEntry::FORK, i))
+        return pos;
+      jump(bi->getSuccessor(entries[pos++].body.br ? 0 : 1));
+      break;
+    }
+    case Instruction::Switch: {
+      const SwitchInst *si = cast<SwitchInst>(i);
+      if (!expect(PathEntry::SWITCH_EXPIDX, i))
+        return pos;
+      unsigned index = entries[pos].body.switchIndex;
+      if (index >= si->getNumSuccessors()) {
+        problem = "invalid successor index at " + KInstruction::getUniqueID(i);
+        return pos;
+      }
+      ++pos;
+      jump(si->getSuccessor(index));
+      break;
+    }
+    case Instruction::IndirectBr: {
+      const IndirectBrInst *ibi = cast<IndirectBrInst>(i);
+      if (!expect(PathEntry::INDIRECTBR, i))
+        return pos;
+      std::vector<const BasicBlock *> destinations;
+      for (unsigned k = 0, e = ibi->getNumDestinations(); k != e; ++k) {
+        const BasicBlock *d = ibi->getDestination(k);
+        if (std::find(destinations.begin(), destinations.end(), d) ==
+            destinations.end())
+          destinations.push_back(d);
+      }
+      unsigned index = entries[pos].body.indirectbrIndex;
+      if (index >= destinations.size()) {
+        problem =
+            "invalid destination index at " + KInstruction::getUniqueID(i);
+        return pos;
+      }
+      ++pos;
+      jump(destinations[index]);
+      break;
+    }
+    default:
+      if (i->isTerminator()) {
+        problem = std::string("the walk stops at the ") + i->getOpcodeName() +
+                  " " + KInstruction::getUniqueID(i);
+        return pos;
+      }
+      break;
+    }
+  }
+
+  if (pos < entries.size())
+    problem = std::to_string(entries.size() - pos) +
+              " entries are left when the entry point returns";
+  return pos;
+}
@@ -0,0 +1,44 @@
+//===-- PathValidator.h -----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Checks a converted path against the module before it is shipped: walks the
+// module from the entry point the way a replay does, taking the branch every
+// entry says, and asks for the entries in the order and of the types
+// Executor::getNextPathEntry would be asked for them.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_PATHVALIDATOR_H
+#define KLEE_PATHVALIDATOR_H
+
+#include "klee/Internal/Support/SerializableTypes.h"
+
+#include <set>
+#include <string>
+#include <vector>
+
+namespace llvm {
+class Function;
+}
+
+namespace klee {
+
+  /// Walk entryPoint along entries. Calls of functions of ignored are
+  /// stepped over, as the replay does not follow the branches they take.
+  /// \return the number of entries the walk consumed. problem is empty if
+  /// the walk consumed all the entries by the time entryPoint returned,
+  /// otherwise it says where the walk stopped and why.
+  size_t validatePath(const llvm::Function *entryPoint,
+                      const std::set<const llvm::Function *> &ignored,
+                      const std::vector<PathEntry> &entries,
+                      std::string &problem);
+
+} // namespace klee
+
+#endif /* KLEE_PATHVALIDATOR_H */
@@ -0,0 +1,192 @@
+//===-- TraceDecoder.cpp --------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "TraceDecoder.h"
+
+#include "IRMap.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/Instruction.h"
+
+#include <intel-pt.h>
+
+using namespace llvm;
+using namespace klee;
+
+void TraceDecoder::initConfig(struct pt_config &config) const {
+  pt_config_init(&config);
+  config.begin = const_cast<uint8_t *>(begin);
+  config.end = const_cast<uint8_t *>(end);
+  if (family) {
+    config.cpu.vendor = pcv_intel;
+    config.cpu.family = family;
+    config.cpu.model = model;
+    config.cpu.stepping = stepping;
+    pt_cpu_errata(&config.errata, &config.cpu);
+  }
+}
+
+TraceDecoder::TraceDecoder(const IRMap &_map, const char *_begin,
+                           const char *_end)
+    : map(_map), begin(reinterpret_cast<const uint8_t *>(_begin)),
+      end(reinterpret_cast<const uint8_t *>(_end)),
+      iscache(pt_iscache_alloc("pt2path")) {}
+
+TraceDecoder::~TraceDecoder() { pt_iscache_free(iscache); }
+
+bool TraceDecoder::loadImage(const std::string &binary, std::string &error) {
+  if (!iscache) {
+    error = "cannot allocate the image section cache";
+    return false;
+  }
+  for (const IRMap::Section &s : map.getSections()) {
+    int isid = pt_iscache_add_file(iscache, binary.c_str(), s.fileOffset,
+                                   s.size, s.address);
+    if (isid < 0) {
+      error = std::string("cannot add a section of ") + binary + ": " +
+              pt_errstr(pt_errcode(isid));
+      return false;
+    }
+    sectionIDs.push_back(isid);
+  }
+  return true;
+}
+
+std::vector<uint64_t> TraceDecoder::findSegments() const {
+  std::vector<uint64_t> offsets;
+  struct pt_config config;
+  initConfig(config);
+  struct pt_packet_decoder *decoder = pt_pkt_alloc_decoder(&config);
+  if (!decoder)
+    return offsets;
+  uint64_t offset;
+  while (pt_pkt_sync_forward(decoder) >= 0 &&
+         pt_pkt_get_sync_offset(decoder, &offset) >= 0)
+    offsets.push_back(offset);
+  pt_pkt_free_decoder(decoder);
+  return offsets;
+}
+
+bool TraceDecoder::decode(uint64_t from, uint64_t to,
+                          std::vector<TraceEvent> &events,
+                          std::string &error) const {
+  struct pt_config config;
+  initConfig(config);
+  struct pt_insn_decoder *decoder = pt_insn_alloc_decoder(&config);
+  if (!decoder) {
+    error = "cannot allocate an instruction flow decoder";
+    return false;
+  }
+  struct pt_image *image = pt_insn_get_image(decoder);
+  for (int isid : sectionIDs) {
+    int status = pt_image_add_cached(image, iscache, isid, nullptr);
+    if (status < 0) {
+      error = std::string("cannot set up the image: ") +
+              pt_errstr(pt_errcode(status));
+      pt_insn_free_decoder(decoder);
+      return false;
+    }
+  }
+
+  // the same addresses are looked up over and over in loops
+  DenseMap<uint64_t, const Instruction *> cache;
+  auto lookup = [&](uint64_t ip) {
+    auto it = cache.find(ip);
+    if (it == cache.end())
+      it = cache.insert(std::make_pair(ip, map.lookup(ip))).first;
+    return it->second;
+  };
+
+  // the block of the last instruction that maps to one, nullptr after a
+  // call or a return so that the next block is always reported
+  const llvm::BasicBlock *last = nullptr;
+  const Instruction *lastInst = nullptr;
+  // address after the last jump, if the last instruction was one
+  uint64_t jumpIP = 0, fallthrough = 0;
+  int status = pt_insn_sync_set(decoder, from);
+  for (;;) {
+    if (status < 0) {
+      if (status == -pte_eos)
+        break;
+      if (status != -pte_nosync)
+        events.push_back({TraceEvent::Gap, false, nullptr, 0});
+      last = nullptr;
+      lastInst = nullptr;
+      fallthrough = 0;
+      status = pt_insn_sync_forward(decoder);
+      uint64_t offset;
+      if (status < 0 || pt_insn_get_sync_offset(decoder, &offset) < 0 ||
+          offset >= to)
+        break;
+      continue;
+    }
+
+    while (status & pts_event_pending) {
+      struct pt_event event;
+      status = pt_insn_event(decoder, &event, sizeof(event));
+      if (status < 0)
+        break;
+      if (event.type == ptev_ptwrite) {
+        const Instruction *inst = event.ip_suppressed
+                                      ? lastInst
+                                      : lookup(event.variant.ptwrite.ip);
+        events.push_back({TraceEvent::PTWrite, false, inst,
+                          event.variant.ptwrite.payload});
+      } else if (event.type == ptev_overflow) {
+        events.push_back({TraceEvent::Gap, false, nullptr, 0});
+        last = nullptr;
+      }
+    }
+    if (status < 0)
+      continue;
+    if (status & pts_eos)
+      break;
+
+    uint64_t offset;
+    if (pt_insn_get_offset(decoder, &offset) < 0 || offset >= to)
+      break;
+    struct pt_insn insn;
+    status = pt_insn_next(decoder, &insn, sizeof(insn));
+    if (status < 0)
+      continue;
+
+    bool jumpedBack = fallthrough && insn.ip != fallthrough &&
+                      insn.ip <= jumpIP;
+    const Instruction *inst = lookup(insn.ip);
+    if (inst) {
+      const llvm::BasicBlock *bb = inst->getParent();
+      bool reentry = bb == last && jumpedBack;
+      if (bb != last || reentry)
+        events.push_back({TraceEvent::Block, reentry, inst, 0});
+      last = bb;
+    }
+    lastInst = inst;
+    fallthrough = 0;
+
+    switch (insn.iclass) {
+    case ptic_call:
+      events.push_back({TraceEvent::Call, false, inst, 0});
+      last = nullptr;
+      break;
+    case ptic_return:
+      events.push_back({TraceEvent::Return, false, inst, 0});
+      last = nullptr;
+      break;
+    case ptic_jump:
+    case ptic_cond_jump:
+      jumpIP = insn.ip;
+      fallthrough = insn.ip + insn.size;
+      break;
+    default:
+      break;
+    }
+  }
+  pt_insn_free_decoder(decoder);
+  return true;
+}
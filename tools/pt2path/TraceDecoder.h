@@ -0,0 +1,93 @@
+//===-- TraceDecoder.h ------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Decodes the segments of an Intel PT trace between two PSB packets with the
+// libipt instruction flow decoder. Each segment is decoded on its own, into
+// a compact stream of TraceEvent that PathBuilder turns into path entries,
+// so that the segments can be decoded in parallel.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_TRACEDECODER_H
+#define KLEE_TRACEDECODER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct pt_config;
+struct pt_image_section_cache;
+
+namespace llvm {
+class Instruction;
+}
+
+namespace klee {
+  class IRMap;
+
+  struct TraceEvent {
+    enum Kind : uint8_t {
+      /// code of the block of inst runs after code of another block, or
+      /// after a jump back to the start of the same block with reentry
+      Block,
+      Call,
+      Return,
+      /// a ptwrite of payload, inst is the instruction its address maps to
+      PTWrite,
+      /// the decoder lost track of the trace and resynchronized
+      Gap
+    };
+    Kind kind;
+    bool reentry;
+    const llvm::Instruction *inst;
+    uint64_t payload;
+  };
+
+  class TraceDecoder {
+    const IRMap &map;
+    const uint8_t *begin, *end;
+    struct pt_image_section_cache *iscache;
+    std::vector<int> sectionIDs;
+    /// the processor the trace was recorded on, family 0 if unknown
+    unsigned family = 0, model = 0, stepping = 0;
+
+    void initConfig(struct pt_config &config) const;
+
+  public:
+    /// A decoder of the trace in [_begin, _end), whose addresses _map maps
+    /// to the module.
+    TraceDecoder(const IRMap &_map, const char *_begin, const char *_end);
+    ~TraceDecoder();
+    TraceDecoder(const TraceDecoder &) = delete;
+    TraceDecoder &operator=(const TraceDecoder &) = delete;
+
+    /// Work around the errata of the given processor while decoding.
+    void setCPU(unsigned _family, unsigned _model, unsigned _stepping) {
+      family = _family;
+      model = _model;
+      stepping = _stepping;
+    }
+
+    /// Add the executable sections of binary to the image of the trace.
+    /// \return false and set error if libipt cannot read them
+    bool loadImage(const std::string &binary, std::string &error);
+
+    /// The offsets of the PSB packets of the trace, in increasing order
+    std::vector<uint64_t> findSegments() const;
+
+    /// Append the events of the segment starting at the PSB at offset from
+    /// and ending at offset to. Thread-safe.
+    /// \return false and set error if no decoder can be set up
+    bool decode(uint64_t from, uint64_t to, std::vector<TraceEvent> &events,
+                std::string &error) const;
+  };
+
+} // namespace klee
+
+#endif /* KLEE_TRACEDECODER_H */
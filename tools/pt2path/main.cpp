@@ -0,0 +1,263 @@
+//===-- main.cpp ----------------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// pt2path converts an Intel PT trace of a binary compiled from a prepass
+// -debugir module into the v2 .path and .path_datarec files klee
+// -replay-path follows. The trace is the raw PT buffer, e.g. the AUX area
+// of a perf.data file, of a user space only recording with ptwrite enabled.
+//
+//===----------------------------------------------------------------------===//
+
+#include "IRMap.h"
+#include "PathBuilder.h"
+#include "PathValidator.h"
+#include "TraceDecoder.h"
+
+#include "klee/Internal/Support/ErrorHandling.h"
+#include "klee/Internal/Support/ModuleUtil.h"
+#include "klee/Internal/Support/PathBuffer.h"
+#include "klee/Internal/Support/PrintVersion.h"
+#include "klee/Internal/Support/WorkQueue.h"
+
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <set>
+#include <thread>
+
+using namespace llvm;
+using namespace klee;
+
+static cl::opt<std::string> TraceFile(cl::desc("<raw PT trace>"),
+                                      cl::Positional, cl::Required);
+
+static cl::opt<std::string>
+    BinaryFile("binary", cl::desc("The traced binary, with its line table"),
+               cl::Required);
+
+static cl::opt<std::string> ModuleFile(
+    "module",
+    cl::desc("The bitcode the binary was compiled from and klee replays, "
+             "instrumented and given debug locations by prepass -debugir"),
+    cl::Required);
+
+static cl::opt<uint64_t> LoadBias(
+    "load-bias",
+    cl::desc("Bytes the binary was loaded above the addresses it was linked "
+             "at, for position independent executables (default=0)"),
+    cl::init(0));
+
+static cl::opt<std::string> EntryPoint(
+    "entry-point",
+    cl::desc("Function whose first call starts the path, which ends when it "
+             "returns (default=main)"),
+    cl::init("main"));
+
+static cl::opt<std::string> OutputFile(
+    "o", cl::desc("The .path file to write, the data recordings go to its "
+                  "_datarec"),
+    cl::Required);
+
+static cl::opt<std::string> CPU(
+    "cpu",
+    cl::desc("Family/model[/stepping] of the processor the trace was "
+             "recorded on, to work around its errata (default: none)"),
+    cl::init(""));
+
+static cl::opt<unsigned> Jobs(
+    "j",
+    cl::desc("Number of threads decoding trace segments (default=number of "
+             "cores)"),
+    cl::init(0));
+
+static cl::opt<bool> IgnorePOSIXPath(
+    "ignore-posix-path",
+    cl::desc("Leave out the branches taken inside the POSIX runtime, for a "
+             "replay with -ignore-posix-path (default=false)"),
+    cl::init(false));
+
+static cl::opt<std::string> POSIXLib(
+    "posix-lib",
+    cl::desc("Bitcode or archive of the POSIX runtime klee links, whose "
+             "functions are left out with -ignore-posix-path as well as the "
+             "ones tagged as POSIX in the module"),
+    cl::init(""));
+
+static cl::opt<bool> Validate(
+    "validate",
+    cl::desc("Walk the module along the path written, checking that the "
+             "replay asks for its entries in order (default=true)"),
+    cl::init(true));
+
+static void writeFile(const std::string &path, const std::string &data) {
+  std::error_code EC;
+  raw_fd_ostream os(path, EC, sys::fs::F_None);
+  if (EC)
+    klee_error("error opening %s: %s", path.c_str(), EC.message().c_str());
+  os << data;
+}
+
+int main(int argc, char **argv) {
+  sys::PrintStackTraceOnErrorSignal(argv[0]);
+  cl::SetVersionPrinter(klee::printVersion);
+  StringMap<cl::Option *> &map = cl::getRegisteredOptions();
+  for (auto &elem : map) {
+    if (elem.second->Category == &llvm::cl::GeneralCategory)
+      elem.second->setHiddenFlag(cl::Hidden);
+  }
+  cl::ParseCommandLineOptions(argc, argv);
+
+  LLVMContext ctx;
+  std::vector<std::unique_ptr<Module>> modules;
+  std::string error;
+  if (!klee::loadFile(ModuleFile, ctx, modules, error))
+    klee_error("error loading %s: %s", ModuleFile.c_str(), error.c_str());
+  if (modules.size() != 1)
+    klee_error("%s should contain one module", ModuleFile.c_str());
+  Module &M = *modules[0];
+  const Function *entry = M.getFunction(EntryPoint);
+  if (!entry || entry->isDeclaration())
+    klee_error("entry point %s is not defined in %s", EntryPoint.c_str(),
+               ModuleFile.c_str());
+
+  // the functions whose branches the replay does not ask for
+  std::set<const Function *> ignored;
+  if (IgnorePOSIXPath) {
+    std::set<std::string> posixNames;
+    if (!POSIXLib.empty()) {
+      std::vector<std::unique_ptr<Module>> posixModules;
+      if (!klee::loadFile(POSIXLib, ctx, posixModules, error))
+        klee_error("error loading %s: %s", POSIXLib.c_str(), error.c_str());
+      for (const std::unique_ptr<Module> &posix : posixModules)
+        for (const Function &f : *posix)
+          if (!f.isDeclaration())
+            posixNames.insert(f.getName().str());
+    }
+    for (const Function &f : M)
+      if (f.hasFnAttribute(TAGPOSIX) || posixNames.count(f.getName().str()))
+        ignored.insert(&f);
+    if (ignored.count(entry))
+      klee_error("entry point %s is a POSIX function", EntryPoint.c_str());
+  } else if (!POSIXLib.empty()) {
+    klee_warning("-posix-lib is ignored without -ignore-posix-path");
+  }
+
+  IRMap irMap;
+  if (!irMap.load(M, BinaryFile, LoadBias, error))
+    klee_error("error reading %s: %s", BinaryFile.c_str(), error.c_str());
+  if (irMap.getAmbiguousLines())
+    klee_warning("%u lines have several instructions, the module should "
+                 "come out of prepass -debugir",
+                 irMap.getAmbiguousLines());
+
+  auto traceOrErr = MemoryBuffer::getFile(TraceFile, /*FileSize=*/-1,
+                                          /*RequiresNullTerminator=*/false);
+  if (!traceOrErr)
+    klee_error("error opening %s: %s", TraceFile.c_str(),
+               traceOrErr.getError().message().c_str());
+  const MemoryBuffer &trace = **traceOrErr;
+  TraceDecoder decoder(irMap, trace.getBufferStart(), trace.getBufferEnd());
+  if (!CPU.empty()) {
+    unsigned family, model, stepping = 0;
+    if (sscanf(CPU.c_str(), "%u/%u/%u", &family, &model, &stepping) < 2)
+      klee_error("malformed -cpu, expected family/model[/stepping]");
+    decoder.setCPU(family, model, stepping);
+  }
+  if (!decoder.loadImage(BinaryFile, error))
+    klee_error("%s", error.c_str());
+  std::vector<uint64_t> segments = decoder.findSegments();
+  if (segments.empty())
+    klee_error("%s contains no PSB packet", TraceFile.c_str());
+  segments.push_back(trace.getBufferSize());
+
+  // segments are decoded in parallel a batch at a time, and their events
+  // added in order once the whole batch is done
+  unsigned jobs =
+      Jobs ? Jobs : std::max(1u, std::thread::hardware_concurrency());
+  size_t numSegments = segments.size() - 1;
+  size_t batchSize = 4 * jobs;
+  WorkQueue queue(jobs, batchSize);
+  PathBuilder builder(M.getDataLayout(), entry, ignored);
+  std::mutex errorMutex;
+  std::string decodeError;
+  for (size_t first = 0; first < numSegments; first += batchSize) {
+    size_t count = std::min(batchSize, numSegments - first);
+    std::vector<std::vector<TraceEvent>> events(count);
+    for (size_t i = 0; i < count; ++i) {
+      queue.submit([&, i]() {
+        std::string error;
+        if (!decoder.decode(segments[first + i], segments[first + i + 1],
+                            events[i], error)) {
+          std::lock_guard<std::mutex> lock(errorMutex);
+          decodeError = error;
+        }
+      });
+    }
+    queue.drain();
+    if (!decodeError.empty())
+      klee_error("%s", decodeError.c_str());
+    for (const std::vector<TraceEvent> &segment : events)
+      builder.add(segment);
+  }
+
+  if (!builder.hasStarted())
+    klee_error("the trace never enters %s", EntryPoint.c_str());
+
+  std::string path;
+  encodePathFile(builder.getEntries(), PathFileV2, path);
+  writeFile(OutputFile, path);
+  std::string dataRec;
+  encodeDataRecFile(builder.getDataRecs(),
+                    [&](uint32_t id) { return builder.getIDName(id); },
+                    dataRec);
+  writeFile(OutputFile + "_datarec", dataRec);
+
+  if (Validate) {
+    std::string problem;
+    size_t valid =
+        validatePath(entry, ignored, builder.getEntries(), problem);
+    if (problem.empty())
+      klee_message("validated %zu of %zu path entries", valid,
+                   builder.getEntries().size());
+    else
+      klee_warning("the path does not replay past entry %zu of %zu: %s",
+                   valid, builder.getEntries().size(), problem.c_str());
+  }
+
+  const PathBuilder::Stats &stats = builder.getStats();
+  klee_message("%zu segments decoded, %zu path entries, %zu data recordings",
+               numSegments, builder.getEntries().size(),
+               builder.getDataRecs().size());
+  if (stats.gaps)
+    klee_warning("the decoder lost track of the trace %llu times, the path "
+                 "misses the branches in between",
+                 (unsigned long long)stats.gaps);
+  if (stats.unexpectedBlocks)
+    klee_warning("%llu blocks entered are no successor of the block before",
+                 (unsigned long long)stats.unexpectedBlocks);
+  if (stats.ambiguousSwitches)
+    klee_warning("%llu switches went to a block of several cases, recorded "
+                 "as the first one",
+                 (unsigned long long)stats.ambiguousSwitches);
+  if (stats.unmappedPTWrites)
+    klee_warning("%llu ptwrites do not map to a ptwrite of the module",
+                 (unsigned long long)stats.unmappedPTWrites);
+  if (stats.ignoredEntries)
+    klee_message("%llu path entries inside POSIX functions left out",
+                 (unsigned long long)stats.ignoredEntries);
+  return 0;
+}
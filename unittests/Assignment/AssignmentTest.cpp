@@ -35,3 +35,61 @@ TEST(AssignmentTest, FoldNotOptimized)
   ASSERT_TRUE(asConstant != NULL);
   ASSERT_EQ(asConstant->getZExtValue(), (unsigned) 128);
 }
+
+TEST(AssignmentTest, BindingsKeepFirstValues)
+{
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("a", /*size=*/ 2);
+  const Array *b = ac.CreateArray("b", /*size=*/ 2);
+  const Array *c = ac.CreateArray("c", /*size=*/ 2);
+  std::vector<const Array*> objects = {c, a, c, b};
+  std::vector< std::vector<unsigned char> > values = {
+      {1, 2}, {3, 4}, {5, 6}, {7, 8}};
+  Assignment assignment(objects, std::move(values));
+
+  ASSERT_EQ(3u, assignment.bindings.size());
+  ASSERT_EQ(std::vector<unsigned char>({1, 2}),
+            assignment.bindings.find(c)->second);
+  ASSERT_EQ(std::vector<unsigned char>({3, 4}),
+            assignment.bindings.find(a)->second);
+  // the entries stay sorted by array, as in a map
+  for (auto it = assignment.bindings.begin(), next = std::next(it);
+       next != assignment.bindings.end(); it = next++)
+    ASSERT_LT(it->first, next->first);
+
+  // an insertion does not replace values, operator[] returns them
+  ASSERT_FALSE(assignment.bindings.insert(
+      std::make_pair(b, std::vector<unsigned char>{9})).second);
+  ASSERT_EQ(7, assignment.bindings[b][0]);
+  const Array *d = ac.CreateArray("d", /*size=*/ 1);
+  ASSERT_EQ(0u, assignment.bindings.count(d));
+  assignment.bindings[d].push_back(10);
+  ASSERT_EQ(1u, assignment.bindings.count(d));
+  ASSERT_EQ(4u, assignment.bindings.size());
+}
+
+TEST(AssignmentTest, EvaluateReadsOfSeveralArrays)
+{
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("a", /*size=*/ 2);
+  const Array *b = ac.CreateArray("b", /*size=*/ 2);
+  const Array *unbound = ac.CreateArray("unbound", /*size=*/ 1);
+  std::vector<const Array*> objects = {a, b};
+  std::vector< std::vector<unsigned char> > values = {{1, 2}, {3}};
+  Assignment assignment(objects, values);
+
+  auto read = [](const Array *array, unsigned index) {
+    return ReadExpr::create(UpdateList(array, nullptr),
+                            ConstantExpr::alloc(index, Expr::Int32));
+  };
+  // the reads of a and b alternate, and the last one is beyond the values
+  // of b
+  ref<Expr> e = AddExpr::create(
+      AddExpr::create(read(a, 0), read(b, 0)),
+      AddExpr::create(AddExpr::create(read(a, 1), read(unbound, 0)),
+                      read(b, 1)));
+  ref<Expr> evaluated = assignment.evaluate(e);
+  const ConstantExpr *asConstant = dyn_cast<ConstantExpr>(evaluated);
+  ASSERT_TRUE(asConstant != NULL);
+  ASSERT_EQ(1u + 3u + 2u, asConstant->getZExtValue());
+}
@@ -0,0 +1,62 @@
+#include "klee/util/BitArray.h"
+#include "gtest/gtest.h"
+
+#include <cstdlib>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+TEST(BitArrayTest, Ranges) {
+  unsigned size = 100;
+  BitArray a(size);
+  a.setRange(3, 70);
+  for (unsigned i = 0; i != size; ++i)
+    ASSERT_EQ(i >= 3 && i < 70, a.get(i)) << i;
+  ASSERT_TRUE(a.isAllSet(3, 70));
+  ASSERT_FALSE(a.isAllSet(2, 70));
+  ASSERT_TRUE(a.isAllUnset(70, size));
+  ASSERT_EQ(3u, a.findFirstSet(0, size));
+  ASSERT_EQ(70u, a.findFirstUnset(3, size));
+
+  a.unsetRange(31, 33);
+  ASSERT_EQ(31u, a.findFirstUnset(3, size));
+  ASSERT_EQ(33u, a.findFirstSet(31, size));
+  // empty ranges
+  a.setRange(80, 80);
+  ASSERT_EQ(80u, a.findFirstSet(80, 80));
+  ASSERT_TRUE(a.isAllSet(80, 80));
+  ASSERT_EQ(size, a.findFirstSet(70, size));
+}
+
+TEST(BitArrayTest, RandomRanges) {
+  unsigned size = 300;
+  BitArray a(size, true);
+  std::vector<bool> ref(size, true);
+  srand(1);
+  for (unsigned n = 0; n != 2000; ++n) {
+    unsigned begin = rand() % (size + 1);
+    unsigned end = begin + rand() % (size + 1 - begin);
+    bool value = rand() % 2;
+    if (value)
+      a.setRange(begin, end);
+    else
+      a.unsetRange(begin, end);
+    for (unsigned i = begin; i != end; ++i)
+      ref[i] = value;
+
+    begin = rand() % (size + 1);
+    end = begin + rand() % (size + 1 - begin);
+    unsigned set = begin, unset = begin;
+    while (set != end && !ref[set])
+      ++set;
+    while (unset != end && ref[unset])
+      ++unset;
+    ASSERT_EQ(set, a.findFirstSet(begin, end));
+    ASSERT_EQ(unset, a.findFirstUnset(begin, end));
+  }
+  for (unsigned i = 0; i != size; ++i)
+    ASSERT_EQ(ref[i], a.get(i)) << i;
+}
+}
@@ -0,0 +1,78 @@
+#include "../../lib/Core/DeterministicArena.h"
+#include "gtest/gtest.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+const uint64_t Base = 0x7ff30000000;
+const uint64_t Capacity = 1ULL << 32;
+
+TEST(DeterministicArenaTest, SizeClasses) {
+  DeterministicArena arena(Base, Capacity);
+  uint64_t a = arena.allocate(1, 1);
+  uint64_t b = arena.allocate(16, 8);
+  uint64_t c = arena.allocate(17, 8);
+  ASSERT_EQ(Base, a);
+  ASSERT_EQ(Base + 16, b);
+  // another class, from another slab
+  ASSERT_EQ(Base + DeterministicArena::SlabSize, c);
+  ASSERT_EQ(0u, c % 32);
+  ASSERT_EQ(16u + 16 + 32, arena.getUsedSize());
+
+  uint64_t d = arena.allocate(100, 256);
+  ASSERT_EQ(0u, d % 256);
+  uint64_t e = arena.allocate(3 * DeterministicArena::SlabSize, 8);
+  ASSERT_EQ(0u, e % DeterministicArena::PageSize);
+
+  // the memory is usable
+  memset(reinterpret_cast<void *>(e), 1, 3 * DeterministicArena::SlabSize);
+}
+
+TEST(DeterministicArenaTest, Reuse) {
+  DeterministicArena arena(Base, Capacity);
+  uint64_t a = arena.allocate(8, 8);
+  uint64_t b = arena.allocate(8, 8);
+  uint64_t large = arena.allocate(DeterministicArena::SlabSize + 1, 8);
+  arena.free(a);
+  arena.free(b);
+  arena.free(large);
+  ASSERT_EQ(0u, arena.getUsedSize());
+  // last in, first out
+  ASSERT_EQ(b, arena.allocate(1, 1));
+  ASSERT_EQ(a, arena.allocate(1, 1));
+  ASSERT_EQ(large, arena.allocate(DeterministicArena::SlabSize + 100, 8));
+  // unknown addresses are ignored
+  arena.free(a + 1);
+  ASSERT_EQ(DeterministicArena::MinBlockSize * 2 +
+                DeterministicArena::SlabSize + DeterministicArena::PageSize,
+            arena.getUsedSize());
+}
+
+TEST(DeterministicArenaTest, Restore) {
+  DeterministicArena arena(Base, Capacity);
+  uint64_t kept = arena.allocate(24, 8);
+  arena.free(arena.allocate(24, 8));
+  DeterministicArena::Layout snapshot = arena.snapshot();
+
+  std::vector<uint64_t> first;
+  for (unsigned i = 0; i < 1000; ++i)
+    first.push_back(arena.allocate(i * 37 % 5000, 8));
+  for (unsigned i = 0; i < first.size(); i += 3)
+    arena.free(first[i]);
+  uint64_t last = arena.allocate(64, 64);
+
+  arena.restore(snapshot);
+  for (unsigned i = 0; i < 1000; ++i)
+    ASSERT_EQ(first[i], arena.allocate(i * 37 % 5000, 8));
+  for (unsigned i = 0; i < first.size(); i += 3)
+    arena.free(first[i]);
+  ASSERT_EQ(last, arena.allocate(64, 64));
+  ASSERT_NE(kept, last);
+}
+
+} // namespace
@@ -56,3 +56,21 @@ TEST(DiscretePDFTest, Rotatation) {
   ASSERT_EQ(1, testTree.getWeight(1));
   ASSERT_EQ(2, testTree.getWeight(2));
 }
+
+TEST(DiscretePDFTest, UpdateAll) {
+  DiscretePDF<int> testTree;
+  for (auto i = 0; i < 20; ++i)
+    testTree.insert(i, 1);
+
+  // all the weight on the last item
+  testTree.updateAll([](int item) { return item == 19 ? 1. : 0.; });
+  for (auto i = 0; i < 19; ++i)
+    ASSERT_EQ(0, testTree.getWeight(i));
+  ASSERT_EQ(19, testTree.choose(0));
+  ASSERT_EQ(19, testTree.choose(0.9999999));
+
+  // the sums stay consistent with later updates
+  testTree.update(3, 1);
+  ASSERT_EQ(3, testTree.choose(0.25));
+  ASSERT_EQ(19, testTree.choose(0.75));
+}
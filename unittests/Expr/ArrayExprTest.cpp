@@ -19,6 +19,7 @@
 using namespace klee;
 namespace klee {
 extern llvm::cl::opt<ArrayOptimizationType> OptimizeArray;
+extern llvm::cl::opt<unsigned> ArrayUpdatesSelectLimit;
 }
 
 namespace {
@@ -72,4 +73,55 @@ TEST(ArrayExprTest, HashCollisions) {
   EXPECT_EQ(a->evaluate(oUpdatedRead), getConstant(42, Expr::Int8));
   EXPECT_EQ(a->evaluate(oFirstRead), getConstant(5, Expr::Int8));
 }
+
+TEST(ArrayExprTest, UpdateListPruning) {
+  const Array *data = ac.CreateArray("data", 16);
+  const Array *idxArray = ac.CreateArray("idx", 2);
+  ref<Expr> j = ReadExpr::create(UpdateList(idxArray, 0),
+                                 getConstant(0, Expr::Int32));
+  ref<Expr> k = ReadExpr::create(UpdateList(idxArray, 0),
+                                 getConstant(1, Expr::Int32));
+  j = ZExtExpr::create(j, Expr::Int32);
+  k = ZExtExpr::create(k, Expr::Int32);
+  UpdateList ul(data, 0);
+  ul.extend(getConstant(3, Expr::Int32), getConstant(1, Expr::Int8));
+  ul.extend(j, getConstant(2, Expr::Int8));
+  ul.extend(getConstant(3, Expr::Int32), getConstant(3, Expr::Int8));
+  ul.extend(getConstant(5, Expr::Int32), getConstant(4, Expr::Int8));
+  ref<Expr> read = ReadExpr::create(ul, k);
+  ref<Expr> readAt4 = ReadExpr::create(ul, getConstant(4, Expr::Int32));
+
+  // the first write to 3 is shadowed
+  ExprOptimizer opt;
+  ref<Expr> oRead = opt.optimizeUpdates(read);
+  EXPECT_TRUE(isa<SelectExpr>(oRead));
+  // only the write to j may be read at 4
+  ref<Expr> oReadAt4 = opt.optimizeUpdates(readAt4);
+  ASSERT_TRUE(isa<SelectExpr>(oReadAt4));
+  EXPECT_EQ(EqExpr::create(j, getConstant(4, Expr::Int32)),
+            cast<SelectExpr>(oReadAt4)->cond);
+
+  // above the limit the update list is rebuilt without the shadowed write
+  unsigned limit = ArrayUpdatesSelectLimit;
+  ArrayUpdatesSelectLimit = 0;
+  ExprOptimizer listOpt;
+  ref<Expr> oList = listOpt.optimizeUpdates(read);
+  ArrayUpdatesSelectLimit = limit;
+  ASSERT_TRUE(isa<ReadExpr>(oList));
+  EXPECT_EQ(3u, cast<ReadExpr>(oList)->updates.getSize());
+
+  std::vector<const Array *> arrays = {data, idxArray};
+  for (unsigned jv = 2; jv < 7; ++jv) {
+    for (unsigned kv = 2; kv < 7; ++kv) {
+      std::vector<unsigned char> dataValues(16, 9);
+      std::vector<std::vector<unsigned char>> values = {
+          dataValues, {static_cast<unsigned char>(jv),
+                       static_cast<unsigned char>(kv)}};
+      Assignment a(arrays, values);
+      EXPECT_EQ(a.evaluate(read), a.evaluate(oRead));
+      EXPECT_EQ(a.evaluate(read), a.evaluate(oList));
+      EXPECT_EQ(a.evaluate(readAt4), a.evaluate(oReadAt4));
+    }
+  }
+}
 }
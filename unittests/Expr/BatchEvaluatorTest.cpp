@@ -0,0 +1,231 @@
+//===-- BatchEvaluatorTest.cpp --------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/ExprEvaluator.h"
+#include "klee/util/BatchEvaluator.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+using namespace klee;
+
+namespace {
+
+/// One KTest at a time, the way OracleEvaluator evaluates.
+class ReferenceEvaluator : public ExprEvaluator {
+  const KTest *ktest;
+
+protected:
+  ref<Expr> getInitialValue(const Array &array, unsigned index) {
+    for (unsigned i = 0; i < ktest->numObjects; ++i) {
+      const KTestObject &obj = ktest->objects[i];
+      if (array.name == obj.name)
+        return ConstantExpr::alloc(index < obj.numBytes ? obj.bytes[index] : 0,
+                                   Expr::Int8);
+    }
+    return ReadExpr::create(UpdateList(&array, 0),
+                            ConstantExpr::alloc(index, array.getDomain()));
+  }
+
+public:
+  ReferenceEvaluator(const KTest *_ktest) : ktest(_ktest) {}
+};
+
+/// KTests with objects a and b of random bytes, only a in the first
+/// missing ones.
+struct KTests {
+  std::vector<KTest> ktests;
+  std::vector<std::vector<KTestObject>> objects;
+  std::vector<std::vector<unsigned char>> bytes;
+
+  KTests(unsigned n, unsigned missing = 0)
+      : ktests(n), objects(n), bytes(2 * n) {
+    srand(42);
+    for (unsigned k = 0; k < n; ++k) {
+      unsigned numObjects = k < missing ? 1 : 2;
+      for (unsigned o = 0; o < numObjects; ++o) {
+        std::vector<unsigned char> &b = bytes[2 * k + o];
+        for (unsigned i = 0; i < 8; ++i)
+          // small values make equalities and zero divisors likely
+          b.push_back(rand() % (k % 2 ? 4 : 256));
+        objects[k].push_back(KTestObject{const_cast<char *>(o ? "b" : "a"),
+                                         (unsigned)b.size(), b.data()});
+      }
+      memset(&ktests[k], 0, sizeof(KTest));
+      ktests[k].numObjects = numObjects;
+      ktests[k].objects = objects[k].data();
+    }
+  }
+
+  std::vector<const KTest *> get() const {
+    std::vector<const KTest *> result;
+    for (const KTest &k : ktests)
+      result.push_back(&k);
+    return result;
+  }
+};
+
+ref<Expr> read(const Array *array, unsigned index, Expr::Width w = Expr::Int8) {
+  ref<Expr> bytes = ReadExpr::alloc(UpdateList(array, 0),
+                                    ConstantExpr::alloc(index, Expr::Int32));
+  for (unsigned i = 1; i < w / 8; ++i)
+    bytes = ConcatExpr::alloc(
+        ReadExpr::alloc(UpdateList(array, 0),
+                        ConstantExpr::alloc(index + i, Expr::Int32)),
+        bytes);
+  return bytes;
+}
+
+TEST(BatchEvaluatorTest, MatchesExprEvaluator) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("a", 8);
+  const Array *b = ac.CreateArray("b", 8);
+  ref<ConstantExpr> table[4] = {
+      ConstantExpr::alloc(7, Expr::Int8), ConstantExpr::alloc(1, Expr::Int8),
+      ConstantExpr::alloc(200, Expr::Int8), ConstantExpr::alloc(3, Expr::Int8)};
+  const Array *c = ac.CreateArray("c", 4, table, table + 4);
+
+  ref<Expr> a8 = read(a, 0), b8 = read(b, 1);
+  ref<Expr> a16 = read(a, 2, Expr::Int16), a32 = read(a, 0, Expr::Int32);
+  ref<Expr> b32 = read(b, 4, Expr::Int32), a64 = read(a, 0, Expr::Int64);
+  ref<Expr> c3 = ConstantExpr::alloc(3, Expr::Int8);
+  ref<Expr> c32 = ConstantExpr::alloc(64, Expr::Int32);
+
+  // a with a[a[1]] = b[1] and then a[2] = 5, read at index a[3]
+  ref<UpdateNode> un = new UpdateNode(
+      ref<UpdateNode>(), ZExtExpr::alloc(read(a, 1), Expr::Int32), b8);
+  un = new UpdateNode(un, ConstantExpr::alloc(2, Expr::Int32),
+                      ConstantExpr::alloc(5, Expr::Int8));
+  ref<Expr> updated = ReadExpr::alloc(
+      UpdateList(a, un), ZExtExpr::alloc(read(a, 3), Expr::Int32));
+
+  std::vector<ref<Expr>> constraints = {
+      UltExpr::alloc(AddExpr::alloc(a8, b8), c3),
+      EqExpr::alloc(SubExpr::alloc(a16, MulExpr::alloc(a16, a16)),
+                    ZExtExpr::alloc(b8, Expr::Int16)),
+      SltExpr::alloc(SExtExpr::alloc(a8, Expr::Int32), b32),
+      SgeExpr::alloc(a64, SExtExpr::alloc(b32, Expr::Int64)),
+      NeExpr::alloc(UDivExpr::alloc(a32, b32), c32),
+      EqExpr::alloc(SRemExpr::alloc(a8, b8), SDivExpr::alloc(b8, a8)),
+      UleExpr::alloc(URemExpr::alloc(a16, ZExtExpr::alloc(b8, Expr::Int16)),
+                     ZExtExpr::alloc(a8, Expr::Int16)),
+      EqExpr::alloc(
+          OrExpr::alloc(ShlExpr::alloc(a8, b8), LShrExpr::alloc(a8, b8)),
+          XorExpr::alloc(AShrExpr::alloc(a8, b8), NotExpr::alloc(b8))),
+      UgtExpr::alloc(ExtractExpr::alloc(a32, 5, Expr::Int16),
+                     ExtractExpr::alloc(b32, 9, Expr::Int16)),
+      EqExpr::alloc(SelectExpr::alloc(UgeExpr::alloc(a8, b8), a8, b8),
+                    updated),
+      SleExpr::alloc(
+          ReadExpr::alloc(UpdateList(c, 0), ZExtExpr::alloc(b8, Expr::Int32)),
+          NotOptimizedExpr::alloc(a8)),
+      SgtExpr::alloc(a8, read(a, 6)),
+      // wider than 64 bits, evaluated one KTest at a time
+      EqExpr::alloc(ConcatExpr::alloc(a64, read(b, 0, Expr::Int64)),
+                    ConcatExpr::alloc(read(b, 0, Expr::Int64), a64)),
+  };
+
+  BatchEvaluator evaluator(constraints);
+  EXPECT_EQ(constraints.size(), evaluator.getNumConstraints());
+  EXPECT_EQ(1u, evaluator.getNumUncompiled());
+
+  // several blocks, the last one partial
+  KTests ktests(2 * BatchEvaluator::BlockSize + 5);
+  std::vector<BatchEvaluator::Result> results;
+  evaluator.evaluate(ktests.get(), results);
+  ASSERT_EQ(ktests.ktests.size() * constraints.size(), results.size());
+
+  unsigned unknown = 0;
+  for (unsigned k = 0; k < ktests.ktests.size(); ++k) {
+    ReferenceEvaluator reference(&ktests.ktests[k]);
+    for (unsigned i = 0; i < constraints.size(); ++i) {
+      ref<Expr> r = reference.visit(constraints[i]);
+      BatchEvaluator::Result expected = BatchEvaluator::Unknown;
+      if (ConstantExpr *ce = dyn_cast<ConstantExpr>(r))
+        expected = ce->isTrue() ? BatchEvaluator::Pass : BatchEvaluator::Fail;
+      unknown += expected == BatchEvaluator::Unknown;
+      EXPECT_EQ(expected, results[k * constraints.size() + i])
+          << "constraint " << i << ", KTest " << k;
+    }
+  }
+  // zero divisors and out of bounds reads were exercised
+  EXPECT_LT(0u, unknown);
+}
+
+TEST(BatchEvaluatorTest, MissingObject) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("a", 8);
+  const Array *b = ac.CreateArray("b", 8);
+  std::vector<ref<Expr>> constraints = {
+      EqExpr::alloc(read(a, 0), read(a, 0)),
+      EqExpr::alloc(read(a, 0), read(b, 0)),
+      UleExpr::alloc(read(a, 0), ConstantExpr::alloc(255, Expr::Int8))};
+
+  BatchEvaluator evaluator(constraints);
+  KTests ktests(3, 2);
+  std::vector<BatchEvaluator::Result> results;
+  evaluator.evaluate(ktests.get(), results);
+  for (unsigned k = 0; k < 3; ++k) {
+    EXPECT_EQ(BatchEvaluator::Pass, results[k * 3]);
+    EXPECT_EQ(k < 2, results[k * 3 + 1] == BatchEvaluator::Unknown);
+    EXPECT_EQ(BatchEvaluator::Pass, results[k * 3 + 2]);
+  }
+}
+
+TEST(BatchEvaluatorTest, Assignments) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("a", 8);
+  const Array *b = ac.CreateArray("b", 8);
+  std::vector<ref<Expr>> constraints = {
+      UltExpr::alloc(read(a, 0), read(b, 1)),
+      EqExpr::alloc(read(a, 6, Expr::Int16),
+                    ConstantExpr::alloc(0, Expr::Int16)),
+      EqExpr::alloc(ConcatExpr::alloc(read(a, 0, Expr::Int64),
+                                      read(b, 0, Expr::Int64)),
+                    ConcatExpr::alloc(read(b, 0, Expr::Int64),
+                                      read(a, 0, Expr::Int64)))};
+
+  // a bound to 6 bytes and b unbound, with and without free values
+  std::vector<Assignment> assignments;
+  srand(42);
+  for (unsigned k = 0; k < BatchEvaluator::BlockSize + 3; ++k) {
+    Assignment assignment(k % 3 == 0);
+    std::vector<unsigned char> bytes;
+    for (unsigned i = 0; i < 8; ++i)
+      bytes.push_back(rand() % 4);
+    if (k % 2)
+      assignment.bindings[b] = bytes;
+    bytes.resize(6);
+    assignment.bindings[a] = bytes;
+    assignments.push_back(assignment);
+  }
+  std::vector<const Assignment *> pointers;
+  for (const Assignment &assignment : assignments)
+    pointers.push_back(&assignment);
+
+  BatchEvaluator evaluator(constraints);
+  std::vector<BatchEvaluator::Result> results;
+  evaluator.evaluate(pointers, results);
+  ASSERT_EQ(assignments.size() * constraints.size(), results.size());
+  for (unsigned k = 0; k < assignments.size(); ++k) {
+    for (unsigned i = 0; i < constraints.size(); ++i) {
+      ref<Expr> r = assignments[k].evaluate(constraints[i]);
+      BatchEvaluator::Result expected = BatchEvaluator::Unknown;
+      if (ConstantExpr *ce = dyn_cast<ConstantExpr>(r))
+        expected = ce->isTrue() ? BatchEvaluator::Pass : BatchEvaluator::Fail;
+      EXPECT_EQ(expected, results[k * constraints.size() + i])
+          << "constraint " << i << ", assignment " << k;
+    }
+  }
+}
+} // namespace
@@ -0,0 +1,72 @@
+//===-- ConstraintsTest.cpp -----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/Expr.h"
+
+using namespace klee;
+
+namespace {
+
+static ArrayCache ac;
+
+ref<Expr> readByte(const Array *array, unsigned index) {
+  UpdateList ul(array, 0);
+  return ReadExpr::create(ul, ConstantExpr::create(index, Expr::Int32));
+}
+
+ref<Expr> c8(uint64_t value) { return ConstantExpr::create(value, Expr::Int8); }
+
+TEST(ConstraintsTest, CompactBounds) {
+  const Array *array = ac.CreateArray("compact_bounds", 4);
+  ref<Expr> x = readByte(array, 0), y = readByte(array, 1);
+
+  ConstraintManager cm;
+  ASSERT_TRUE(cm.addConstraint(UltExpr::create(c8(3), x)));
+  ASSERT_TRUE(cm.addConstraint(UleExpr::create(c8(5), x)));
+  ASSERT_TRUE(cm.addConstraint(Expr::createIsZero(UleExpr::create(c8(100), x))));
+  ASSERT_TRUE(cm.addConstraint(UltExpr::create(x, c8(50))));
+  ASSERT_TRUE(cm.addConstraint(UltExpr::create(y, c8(10))));
+  ASSERT_EQ(5u, cm.size());
+
+  // x gets one bound per side, the single bound on y is kept
+  ASSERT_EQ(2u, cm.compact());
+  ASSERT_EQ(3u, cm.size());
+  ASSERT_EQ(3u, cm.getCompactedSize());
+  std::set<ref<Expr>> expected{UleExpr::create(c8(5), x),
+                               UleExpr::create(x, c8(49)),
+                               UltExpr::create(y, c8(10))};
+  std::set<ref<Expr>> actual(cm.begin(), cm.end());
+  ASSERT_EQ(expected, actual);
+
+  // nothing left to merge
+  ASSERT_EQ(0u, cm.compact());
+  ASSERT_EQ(3u, cm.size());
+}
+
+TEST(ConstraintsTest, CompactPinnedValue) {
+  const Array *array = ac.CreateArray("compact_pinned", 4);
+  ref<Expr> x = readByte(array, 0), y = readByte(array, 1);
+
+  ConstraintManager cm;
+  ASSERT_TRUE(cm.addConstraint(UleExpr::create(c8(7), x)));
+  ASSERT_TRUE(cm.addConstraint(UltExpr::create(y, AddExpr::create(x, c8(1)))));
+  ASSERT_TRUE(cm.addConstraint(UleExpr::create(x, c8(7))));
+
+  // x is pinned to 7, which is substituted into the bound on y
+  cm.compact();
+  std::set<ref<Expr>> expected{EqExpr::create(c8(7), x),
+                               UltExpr::create(y, c8(8))};
+  std::set<ref<Expr>> actual(cm.begin(), cm.end());
+  ASSERT_EQ(expected, actual);
+}
+} // namespace
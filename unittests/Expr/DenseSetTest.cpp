@@ -0,0 +1,74 @@
+//===-- DenseSetTest.cpp --------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Internal/Support/IndependentElementSet.h"
+
+#include <set>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+std::vector<unsigned> elements(const DenseSet<unsigned> &s) {
+  return std::vector<unsigned>(s.begin(), s.end());
+}
+
+TEST(DenseSetTest, AddAndIterate) {
+  DenseSet<unsigned> s;
+  EXPECT_TRUE(s.empty());
+  std::set<unsigned> expected = {0, 5, 63, 64, 200, 65535, 4000000000u};
+  for (unsigned x : {200u, 0u, 65535u, 63u, 5u, 4000000000u, 64u, 5u})
+    s.add(x);
+  EXPECT_EQ(std::vector<unsigned>(expected.begin(), expected.end()),
+            elements(s));
+}
+
+TEST(DenseSetTest, AddRange) {
+  DenseSet<unsigned> s;
+  s.add(60, 130);
+  std::vector<unsigned> expected;
+  for (unsigned i = 60; i < 130; ++i)
+    expected.push_back(i);
+  EXPECT_EQ(expected, elements(s));
+
+  DenseSet<unsigned> whole;
+  whole.add(0, 65536);
+  EXPECT_EQ(65536u, elements(whole).size());
+}
+
+TEST(DenseSetTest, Union) {
+  DenseSet<unsigned> a, b;
+  a.add(1);
+  a.add(100);
+  b.add(100);
+  EXPECT_FALSE(a.add(b));
+  b.add(7);
+  b.add(1000);
+  EXPECT_TRUE(a.add(b));
+  EXPECT_EQ(std::vector<unsigned>({1, 7, 100, 1000}), elements(a));
+  EXPECT_FALSE(a.add(DenseSet<unsigned>()));
+}
+
+TEST(DenseSetTest, Intersects) {
+  DenseSet<unsigned> a, b;
+  a.add(0, 64);
+  b.add(64);
+  EXPECT_FALSE(a.intersects(b));
+  EXPECT_FALSE(b.intersects(a));
+  b.add(1000, 70000);
+  EXPECT_FALSE(a.intersects(b));
+  a.add(69999);
+  EXPECT_TRUE(a.intersects(b));
+  EXPECT_TRUE(b.intersects(a));
+  EXPECT_FALSE(a.intersects(DenseSet<unsigned>()));
+}
+} // namespace
@@ -0,0 +1,82 @@
+#include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/Expr.h"
+#include "klee/Expr/ExprArena.h"
+#include "klee/Internal/System/MemoryUsage.h"
+#include "gtest/gtest.h"
+
+using namespace klee;
+
+namespace {
+
+TEST(ExprArenaTest, ReleaseWithArena) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arena_a", 4);
+  size_t before = ExprArena::getNumChunks();
+  {
+    ExprArena arena;
+    ref<Expr> e = Expr::createTempRead(array, 32);
+    for (unsigned i = 0; i < 10000; ++i)
+      e = AddExpr::create(e, Expr::createTempRead(array, 32));
+    EXPECT_LT(before + 1, ExprArena::getNumChunks());
+  }
+  EXPECT_EQ(before, ExprArena::getNumChunks());
+}
+
+TEST(ExprArenaTest, OutliveArena) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arena_b", 4);
+  size_t before = ExprArena::getNumChunks();
+  ref<Expr> kept;
+  {
+    ExprArena arena;
+    UpdateList ul(array, 0);
+    ul.extend(ConstantExpr::create(1, Expr::Int32),
+              ConstantExpr::create(2, Expr::Int8));
+    kept = ReadExpr::create(ul, Expr::createTempRead(array, 32));
+    ref<Expr> dropped = Expr::createTempRead(array, 32);
+  }
+  // the chunk holding kept survives the arena
+  EXPECT_EQ(before + 1, ExprArena::getNumChunks());
+  EXPECT_EQ(Expr::Read, kept->getKind());
+  EXPECT_EQ(1u, cast<ReadExpr>(kept)->updates.getSize());
+
+  // nodes made without an arena come from the heap
+  ref<Expr> heap = AddExpr::create(kept, kept);
+  kept = nullptr;
+  EXPECT_EQ(before + 1, ExprArena::getNumChunks());
+  heap = nullptr;
+  EXPECT_EQ(before, ExprArena::getNumChunks());
+}
+
+TEST(ExprArenaTest, Nested) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arena_c", 4);
+  size_t before = ExprArena::getNumChunks();
+  {
+    ExprArena outer;
+    ref<Expr> a = Expr::createTempRead(array, 8);
+    {
+      ExprArena inner;
+      ref<Expr> b = Expr::createTempRead(array, 16);
+      EXPECT_EQ(before + 2, ExprArena::getNumChunks());
+    }
+    EXPECT_EQ(before + 1, ExprArena::getNumChunks());
+  }
+  EXPECT_EQ(before, ExprArena::getNumChunks());
+}
+
+TEST(ExprArenaTest, TrackedMemory) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arena_d", 4);
+  size_t before = util::GetTaggedMemoryUsage(util::MemoryTag::Expr);
+  {
+    ref<Expr> e = Expr::createTempRead(array, 32);
+    for (unsigned i = 0; i < 100; ++i)
+      e = AddExpr::create(e, Expr::createTempRead(array, 32));
+    EXPECT_LE(before + 100 * sizeof(AddExpr),
+              util::GetTaggedMemoryUsage(util::MemoryTag::Expr));
+  }
+  EXPECT_EQ(before, util::GetTaggedMemoryUsage(util::MemoryTag::Expr));
+}
+
+} // namespace
@@ -0,0 +1,87 @@
+#include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/BinaryQueryLog.h"
+#include "klee/Expr/Expr.h"
+#include "klee/Expr/ExprSerializer.h"
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+/* An image reads back equal expressions, keeps the nodes shared between
+   roots shared, and finds its arrays in the cache. */
+TEST(ExprSerializerTest, ImageRoundTrip) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("ser_a", 8);
+  ref<ConstantExpr> init[2] = {ConstantExpr::create(3, Expr::Int8),
+                               ConstantExpr::create(4, Expr::Int8)};
+  const Array *c = ac.CreateArray("ser_c", 2, init, init + 2);
+  UpdateList ul(a, 0);
+  ul.extend(ConstantExpr::create(1, Expr::Int32),
+            ConstantExpr::create(2, Expr::Int8));
+  ref<Expr> x = ReadExpr::create(ul, Expr::createTempRead(a, 32));
+  ref<Expr> shared = AddExpr::create(ZExtExpr::create(x, Expr::Int32),
+                                     ConstantExpr::create(7, Expr::Int32));
+  std::vector<ref<Expr>> roots = {
+      UltExpr::create(shared, ConstantExpr::create(100, Expr::Int32)),
+      EqExpr::create(ExtractExpr::create(shared, 0, Expr::Int8), x),
+      ReadExpr::create(UpdateList(c, 0), Expr::createTempRead(a, 32))};
+
+  std::string image;
+  ExprImage::write(roots, image);
+  std::vector<ref<Expr>> read;
+  std::string error;
+  ASSERT_TRUE(ExprImage::read(ac, image.data(), image.data() + image.size(),
+                              read, error))
+      << error;
+  ASSERT_EQ(roots.size(), read.size());
+  ASSERT_EQ(0, roots[0]->compare(*read[0]));
+  ASSERT_EQ(0, roots[1]->compare(*read[1]));
+  ASSERT_EQ(read[0]->getKid(0).get(),
+            read[1]->getKid(0)->getKid(0).get());
+  ASSERT_EQ(a, cast<ReadExpr>(read[1]->getKid(1))->updates.root);
+  // constant arrays are never cached, they come back as copies
+  const Array *readC = cast<ReadExpr>(read[2])->updates.root;
+  ASSERT_TRUE(readC->isConstantArray());
+  ASSERT_EQ(2u, readC->constantValues.size());
+  ASSERT_EQ(4u, readC->constantValues[1]->getZExtValue());
+
+  // a truncated image is refused instead of misread
+  ASSERT_FALSE(ExprImage::read(ac, image.data(),
+                               image.data() + image.size() - 1, read, error));
+  ASSERT_FALSE(error.empty());
+}
+
+/* The query log written on top of the serializer reads back. */
+TEST(ExprSerializerTest, QueryLogRoundTrip) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("ser_q", 4);
+  LoggedQuery q;
+  q.kind = LoggedQuery::InitialValues;
+  q.constraints.push_back(UgtExpr::create(
+      Expr::createTempRead(a, 32), ConstantExpr::create(5, Expr::Int32)));
+  q.objects.push_back(a);
+  q.success = true;
+  q.hasSolution = true;
+  q.values.push_back({6, 0, 0, 0});
+
+  std::string log(BinaryQueryLog::Magic, sizeof(BinaryQueryLog::Magic));
+  BinaryQueryLogWriter writer;
+  writer.write(q, log);
+  writer.write(q, log);
+  BinaryQueryLogReader reader(ac, log.data(), log.data() + log.size());
+  LoggedQuery r;
+  for (unsigned i = 0; i < 2; ++i) {
+    ASSERT_TRUE(reader.next(r)) << reader.getError();
+    ASSERT_EQ(1u, r.constraints.size());
+    ASSERT_EQ(0, q.constraints[0]->compare(*r.constraints[0]));
+    ASSERT_EQ(q.values, r.values);
+  }
+  ASSERT_FALSE(reader.next(r));
+  ASSERT_TRUE(reader.getError().empty());
+}
+
+} // namespace
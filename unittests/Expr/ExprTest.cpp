@@ -7,11 +7,17 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <algorithm>
 #include <iostream>
 #include "gtest/gtest.h"
 
 #include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/ArrayIdMap.h"
 #include "klee/Expr/Expr.h"
+#include "klee/Expr/ExprBuilder.h"
+#include "klee/Expr/ExprInPlaceTransformer.h"
+#include "klee/Expr/ExprReplaceVisitor.h"
+#include "klee/Expr/ExprUtil.h"
 
 using namespace klee;
 
@@ -113,6 +119,35 @@ TEST(ExprTest, ExtractConcat) {
   EXPECT_EQ(Expr::Extract, concat2->getKid(1)->getKind());
 }
 
+TEST(ExprTest, ConstantFolding) {
+  // the uint64_t paths must agree with APInt, including at the edges
+  for (Expr::Width w : {1u, 8u, 33u, 64u}) {
+    llvm::APInt a = llvm::APInt::getSignedMinValue(w) + 1;
+    llvm::APInt b(w, std::min(3u, w - 1));
+    ref<ConstantExpr> ca = ConstantExpr::alloc(a), cb = ConstantExpr::alloc(b);
+    EXPECT_EQ(a * a, ca->Mul(ca)->getAPValue());
+    EXPECT_EQ(a - b, ca->Sub(cb)->getAPValue());
+    EXPECT_EQ(a.ashr(b), ca->AShr(cb)->getAPValue());
+    EXPECT_EQ(~a, ca->Not()->getAPValue());
+    EXPECT_EQ(a.sext(w + 1), ca->SExt(w + 1)->getAPValue());
+    EXPECT_EQ(a.zext(w + 1), ca->ZExt(w + 1)->getAPValue());
+
+    // shifting by the width or more
+    if (w > 1) {
+      ref<ConstantExpr> overshift = ConstantExpr::alloc(w, w);
+      EXPECT_TRUE(ca->Shl(overshift)->isZero());
+      EXPECT_TRUE(ca->LShr(overshift)->isZero());
+      EXPECT_EQ(a.ashr(w - 1), ca->AShr(overshift)->getAPValue());
+    }
+  }
+
+  ref<ConstantExpr> c = ConstantExpr::alloc(0x8001, Expr::Int16);
+  EXPECT_EQ(UINT64_C(0x80), c->Extract(8, Expr::Int8)->getZExtValue());
+  EXPECT_EQ(UINT64_C(0x80018001), c->Concat(c)->getZExtValue());
+  // extracting past the top bit gives zeros, not sign bits
+  EXPECT_EQ(UINT64_C(0x8001), c->Extract(0, Expr::Int32)->getZExtValue());
+}
+
 TEST(ExprTest, ReadExprFoldingBasic) {
   unsigned size = 5;
 
@@ -264,4 +299,284 @@ TEST(ExprTest, ReadExprFoldingSymbolicIndexUpdate) {
     EXPECT_EQ(Expr::Read, read.get()->getKind());
   }
 }
+
+TEST(ExprTest, ReadExprFoldingIndexedUpdates) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr", 256);
+  const Array *array2 = ac.CreateArray("arr2", 256);
+
+  // a symbolic write below a long run of concrete ones
+  UpdateList ul(array, 0);
+  ref<Expr> updateIndex = ReadExpr::createTempRead(array2, Expr::Int32);
+  ul.extend(updateIndex, ConstantExpr::create(12, Expr::Int8));
+  for (unsigned i = 0; i < 4 * UpdateNode::MinIndexedSize; ++i)
+    ul.extend(ConstantExpr::create(i % 32, Expr::Int32),
+              ConstantExpr::create(i, Expr::Int8));
+
+  // the latest write to index 5
+  ref<Expr> read = ReadExpr::create(ul, ConstantExpr::create(5, Expr::Int32));
+  ASSERT_EQ(Expr::Constant, read->getKind());
+  EXPECT_EQ(UINT64_C(37), cast<ConstantExpr>(read)->getZExtValue());
+
+  // index 40 is not written concretely, so the read starts at the symbolic
+  // write
+  read = ReadExpr::create(ul, ConstantExpr::create(40, Expr::Int32));
+  ASSERT_EQ(Expr::Read, read->getKind());
+  EXPECT_EQ(1u, cast<ReadExpr>(read)->updates.getSize());
+
+  const UpdateNode::ConcreteWrites &writes = ul.head->getConcreteWrites();
+  EXPECT_EQ(32u, writes.latest.size());
+  EXPECT_EQ(updateIndex, writes.rest->index);
+}
+
+TEST(ExprTest, HashConsing) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("hc", 4);
+  size_t before = Expr::getNumHashConsed();
+  {
+    ExprBuilder *builder = createHashConsingExprBuilder(
+        createDefaultExprBuilder());
+    UpdateList ul(array, 0);
+    ref<Expr> idx = builder->Constant(1, Expr::Int32);
+    ref<Expr> a = builder->Add(builder->Read(ul, idx),
+                               builder->Read(ul, idx));
+    ref<Expr> b = builder->Add(builder->Read(ul, idx),
+                               builder->Read(ul, idx));
+    EXPECT_EQ(a.get(), b.get());
+    EXPECT_TRUE(a->isHashConsed());
+    EXPECT_EQ(a->getKid(0).get(), a->getKid(1).get());
+    // one Read, one Add
+    EXPECT_EQ(before + 2, Expr::getNumHashConsed());
+
+    // factories share nodes while the builder is alive
+    ref<Expr> c = AddExpr::alloc(ReadExpr::alloc(ul, idx),
+                                 ReadExpr::alloc(ul, idx));
+    EXPECT_EQ(a.get(), c.get());
+    // constants are not shared
+    EXPECT_FALSE(builder->Constant(1, Expr::Int32)->isHashConsed());
+    delete builder;
+  }
+  // freed nodes leave the table
+  EXPECT_EQ(before, Expr::getNumHashConsed());
+  EXPECT_FALSE(Expr::hashConsing);
+  ref<Expr> d = Expr::createTempRead(array, 8);
+  EXPECT_FALSE(d->isHashConsed());
+}
+
+TEST(ExprTest, DeepVisit) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("deep", 4);
+  ref<Expr> x = Expr::createTempRead(array, 32);
+  // deep enough to overflow the stack of a recursive traversal
+  ref<Expr> e = x;
+  for (unsigned i = 0; i < 20000; ++i)
+    e = AddExpr::alloc(e, ConstantExpr::create(i, Expr::Int32));
+
+  ExprHashMap<ref<Expr> > replacements;
+  replacements[x] = ConstantExpr::create(5, Expr::Int32);
+  UNMap_ty replacedUN, visitedUN;
+  ExprReplaceVisitorMulti visitor(replacedUN, visitedUN, replacements);
+  ref<Expr> res = visitor.replace(e);
+  ASSERT_TRUE(isa<ConstantExpr>(res));
+  EXPECT_EQ(5u + 20000u * 19999u / 2, cast<ConstantExpr>(res)->getZExtValue());
+}
+
+TEST(ExprTest, Metadata) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("mda", 256);
+  const Array *b = ac.CreateArray("mdb", 256);
+
+  ref<Expr> x = ReadExpr::create(UpdateList(a, nullptr),
+                                 ConstantExpr::create(0, Expr::Int32));
+  const ExprMetadata &xmd = x->getMetadata();
+  EXPECT_EQ(2u, xmd.size);
+  EXPECT_EQ(2u, xmd.depth);
+  EXPECT_EQ(1u, xmd.indirectReadDepth);
+  EXPECT_EQ(0u, xmd.maxUpdates);
+  EXPECT_EQ(std::vector<const Array *>{a}, *xmd.arrays);
+
+  ref<Expr> index = ZExtExpr::create(x, Expr::Int32);
+  EXPECT_EQ(3u, index->getMetadata().size);
+  // kids reading the same arrays share the set
+  EXPECT_EQ(xmd.arrays, index->getMetadata().arrays);
+
+  UpdateList ul(b, nullptr);
+  ul.extend(ConstantExpr::create(1, Expr::Int32),
+            ConstantExpr::create(7, Expr::Int8));
+  ref<Expr> y = ReadExpr::create(ul, index);
+  ASSERT_TRUE(isa<ReadExpr>(y));
+  const ExprMetadata &ymd = y->getMetadata();
+  EXPECT_EQ(7u, ymd.size);
+  EXPECT_EQ(4u, ymd.depth);
+  EXPECT_EQ(2u, ymd.indirectReadDepth);
+  EXPECT_EQ(1u, ymd.maxUpdates);
+  // sorted by id, that is in creation order
+  EXPECT_LT(a->getId(), b->getId());
+  EXPECT_EQ((std::vector<const Array *>{a, b}), *ymd.arrays);
+
+  EXPECT_TRUE(ConstantExpr::create(3, Expr::Int8)->getMetadata().arrays->empty());
+}
+
+TEST(ExprTest, FindFromMetadata) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("fma", 4);
+  const Array *b = ac.CreateArray("fmb", 4);
+  ref<ConstantExpr> values[4] = {
+      ConstantExpr::create(1, Expr::Int8), ConstantExpr::create(2, Expr::Int8),
+      ConstantExpr::create(3, Expr::Int8), ConstantExpr::create(4, Expr::Int8)};
+  const Array *c = ac.CreateArray("fmc", 4, values, values + 4);
+
+  ref<Expr> x = ReadExpr::create(UpdateList(a, nullptr),
+                                 ConstantExpr::create(0, Expr::Int32));
+  // b is only read in the value of an update of c
+  UpdateList ul(c, nullptr);
+  ul.extend(ConstantExpr::create(1, Expr::Int32),
+            ReadExpr::create(UpdateList(b, nullptr),
+                             ConstantExpr::create(2, Expr::Int32)));
+  ref<Expr> y = ReadExpr::create(ul, ZExtExpr::create(x, Expr::Int32));
+  ref<Expr> e = AddExpr::create(ZExtExpr::create(y, Expr::Int32),
+                                ConstantExpr::create(5, Expr::Int32));
+
+  std::vector<const Array *> objects;
+  findSymbolicObjects(e, objects);
+  EXPECT_EQ((std::vector<const Array *>{a, b}), objects);
+
+  std::vector<ref<Expr> > exprs{x, e, x};
+  objects.clear();
+  findSymbolicObjects(exprs.begin(), exprs.end(), objects);
+  EXPECT_EQ(2u, objects.size());
+
+  // the arrays of several expressions are ordered by id as well
+  ref<Expr> z = ReadExpr::create(UpdateList(b, nullptr),
+                                 ConstantExpr::create(0, Expr::Int32));
+  std::vector<ref<Expr> > reversed{z, x};
+  objects.clear();
+  findSymbolicObjects(reversed.begin(), reversed.end(), objects);
+  EXPECT_EQ((std::vector<const Array *>{a, b}), objects);
+
+  std::vector<ref<ReadExpr> > reads;
+  findReads(e, false, reads);
+  EXPECT_EQ(2u, reads.size());
+  reads.clear();
+  findReads(e, true, reads);
+  EXPECT_EQ(3u, reads.size());
+}
+
+TEST(ExprTest, ArrayIds) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("ida", 4);
+  const Array *b = ac.CreateArray("idb", 4);
+  // a cache hit is the array kept, with its id
+  EXPECT_EQ(a, ac.CreateArray("ida", 4));
+  EXPECT_EQ(a->getId() + 1, b->getId());
+  EXPECT_EQ(b->getId() + 1, ac.CreateArray("idc", 4)->getId());
+
+  ArrayIdMap<unsigned> m;
+  EXPECT_TRUE(m.empty());
+  EXPECT_EQ(nullptr, m.lookup(a));
+  m[b] = 7;
+  EXPECT_FALSE(m.count(a));
+  ASSERT_NE(nullptr, m.lookup(b));
+  EXPECT_EQ(7u, *m.lookup(b));
+  m[a] += 2;
+  EXPECT_EQ(2u, *m.lookup(a));
+  EXPECT_EQ(2u, m.size());
+}
+
+TEST(ExprTest, AlgebraicBuilder) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("alg", 8);
+  ExprBuilder *b = createAlgebraicExprBuilder(createSimplifyingExprBuilder(
+      createConstantFoldingExprBuilder(createDefaultExprBuilder())));
+  UpdateList ul(array, 0);
+  ref<Expr> x = b->Concat(
+      b->Concat(b->Read(ul, b->Constant(3, Expr::Int32)),
+                b->Read(ul, b->Constant(2, Expr::Int32))),
+      b->Concat(b->Read(ul, b->Constant(1, Expr::Int32)),
+                b->Read(ul, b->Constant(0, Expr::Int32))));
+  ref<Expr> y = b->Read(ul, b->Constant(4, Expr::Int32));
+
+  // ((x << 8) | zext(y)) >> 8 ==> zext(Extract(x, 0, 24))
+  ref<Expr> e = b->LShr(
+      b->Or(b->Shl(x, b->Constant(8, Expr::Int32)), b->ZExt(y, Expr::Int32)),
+      b->Constant(8, Expr::Int32));
+  EXPECT_EQ(b->ZExt(b->Extract(x, 0, 24), Expr::Int32), e);
+  // the low byte of the same disjoint Or is y
+  EXPECT_EQ(y, b->Extract(b->Or(b->Shl(x, b->Constant(8, Expr::Int32)),
+                                b->ZExt(y, Expr::Int32)),
+                          0, 8));
+
+  // masks, divisions and remainders by powers of two
+  EXPECT_EQ(b->ZExt(b->Extract(x, 0, 8), Expr::Int32),
+            b->And(x, b->Constant(0xff, Expr::Int32)));
+  EXPECT_EQ(b->ZExt(b->Extract(x, 0, 8), Expr::Int32),
+            b->URem(x, b->Constant(256, Expr::Int32)));
+  EXPECT_EQ(b->ZExt(b->Extract(x, 16, 16), Expr::Int32),
+            b->UDiv(x, b->Constant(1 << 16, Expr::Int32)));
+  ref<Expr> zy = b->ZExt(y, Expr::Int32);
+  EXPECT_EQ(zy, b->And(zy, b->Constant(0xffff, Expr::Int32)));
+  EXPECT_EQ(b->Constant(0, Expr::Int32),
+            b->And(zy, b->Constant(0xff00, Expr::Int32)));
+
+  // comparisons against bits known to be zero
+  EXPECT_EQ(b->Constant(0, Expr::Bool),
+            b->Eq(b->Constant(0x100, Expr::Int32), zy));
+  EXPECT_EQ(b->Eq(b->Constant(0x12, Expr::Int8), y),
+            b->Eq(b->Constant(0x12, Expr::Int32), zy));
+
+  // shifts by the width or more are left alone
+  ref<Expr> big = b->Shl(x, b->Constant(32, Expr::Int32));
+  EXPECT_EQ(Expr::Shl, big->getKind());
+  delete b;
+}
+
+/// Drops the additions of zero, counting the nodes it is asked about.
+struct AddZeroRemover : public ExprInPlaceTransformer {
+  unsigned nodes = 0;
+  Expr *transformNode(Expr *e, ref<Expr> kids[]) override {
+    ++nodes;
+    if (e->getKind() == Expr::Add && kids[0]->isZero())
+      return kids[1].get();
+    return ExprInPlaceTransformer::transformNode(e, kids);
+  }
+};
+
+TEST(ExprTest, InPlaceTransformer) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("ipa", 4), *b = ac.CreateArray("ipb", 4),
+              *c = ac.CreateArray("ipc", 4);
+  ref<Expr> r = ReadExpr::alloc(UpdateList(a, 0),
+                                ConstantExpr::alloc(0, Expr::Int32));
+  ref<Expr> s = AddExpr::alloc(ConstantExpr::alloc(0, Expr::Int8), r);
+  ref<Expr> zs = ZExtExpr::alloc(s, Expr::Int32);
+  UpdateList changed(b, 0), unchanged(c, 0);
+  changed.extend(zs, r);
+  unchanged.extend(ConstantExpr::alloc(1, Expr::Int32), r);
+  const UpdateNode *unchangedHead = unchanged.head.get();
+  ref<Expr> e = EqExpr::alloc(
+      MulExpr::alloc(s, ReadExpr::alloc(changed, zs)),
+      ReadExpr::alloc(unchanged, ConstantExpr::alloc(0, Expr::Int32)));
+
+  AddZeroRemover t;
+  ref<Expr> res = t.transform(e.get());
+  // rebuilt in place, the shared addition is looked at once
+  EXPECT_EQ(e.get(), res.get());
+  EXPECT_EQ(4u, t.nodes); // Eq, Mul, Add and ZExt
+  ref<Expr> mul = res->getKid(0);
+  EXPECT_EQ(r, mul->getKid(0));
+  const ReadExpr *rb = cast<ReadExpr>(mul->getKid(1));
+  EXPECT_EQ(r, cast<ZExtExpr>(rb->index)->src);
+  EXPECT_EQ(r, cast<ZExtExpr>(rb->updates.head->index)->src);
+  // only the changed list gets a new node
+  EXPECT_EQ(unchangedHead, cast<ReadExpr>(res->getKid(1))->updates.head.get());
+
+  // no recursion over the depth of the expression
+  ref<Expr> deep = r;
+  for (unsigned i = 0; i < 10000; ++i)
+    deep = AddExpr::alloc(ConstantExpr::alloc(0, Expr::Int8),
+                          NotExpr::alloc(deep));
+  AddZeroRemover d;
+  Expr *stripped = d.transform(deep.get());
+  EXPECT_EQ(Expr::Not, stripped->getKind());
+}
 }
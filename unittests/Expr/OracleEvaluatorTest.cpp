@@ -0,0 +1,198 @@
+//===-- OracleEvaluatorTest.cpp -------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Expr/ArrayCache.h"
+#include "klee/util/ExprConcretizer.h"
+#include "klee/util/OracleEvaluator.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+using namespace klee;
+
+namespace {
+
+/// Writes a ktest with object a of the given bytes and, unless they are
+/// empty, object b, and removes it when done.
+struct KTestFile {
+  llvm::SmallString<128> path;
+
+  KTestFile(std::vector<unsigned char> a, std::vector<unsigned char> b) {
+    int fd;
+    EXPECT_FALSE(llvm::sys::fs::createTemporaryFile("oracle", "ktest", fd,
+                                                    path));
+    close(fd);
+    KTestObject objects[2] = {
+        KTestObject{const_cast<char *>("a"), (unsigned)a.size(), a.data()},
+        KTestObject{const_cast<char *>("b"), (unsigned)b.size(), b.data()}};
+    KTest ktest;
+    memset(&ktest, 0, sizeof(ktest));
+    ktest.numObjects = b.empty() ? 1 : 2;
+    ktest.objects = objects;
+    EXPECT_TRUE(kTest_toFile(&ktest, path.c_str()));
+  }
+  ~KTestFile() { llvm::sys::fs::remove(path); }
+};
+
+ref<Expr> read(const Array *array, unsigned index, Expr::Width w = Expr::Int8) {
+  ref<Expr> bytes = ReadExpr::alloc(UpdateList(array, 0),
+                                    ConstantExpr::alloc(index, Expr::Int32));
+  for (unsigned i = 1; i < w / 8; ++i)
+    bytes = ConcatExpr::alloc(
+        ReadExpr::alloc(UpdateList(array, 0),
+                        ConstantExpr::alloc(index + i, Expr::Int32)),
+        bytes);
+  return bytes;
+}
+
+TEST(OracleEvaluatorTest, EvaluateMatchesVisit) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("a", 8);
+  const Array *b = ac.CreateArray("b", 8);
+  ref<ConstantExpr> table[2] = {ConstantExpr::alloc(7, Expr::Int8),
+                                ConstantExpr::alloc(200, Expr::Int8)};
+  const Array *c = ac.CreateArray("c", 2, table, table + 2);
+
+  ref<Expr> a8 = read(a, 0), b8 = read(b, 1), a32 = read(a, 0, Expr::Int32);
+  ref<Expr> b32 = read(b, 4, Expr::Int32), a64 = read(a, 0, Expr::Int64);
+
+  // a with a[a[1]] = b[1] and then 20 writes at constant indices, enough for
+  // the read to go through UpdateNode::getConcreteWrites
+  ref<UpdateNode> un = new UpdateNode(
+      ref<UpdateNode>(), ZExtExpr::alloc(read(a, 1), Expr::Int32), b8);
+  for (unsigned i = 0; i < 20; ++i)
+    un = new UpdateNode(un, ConstantExpr::alloc(2 + i % 3, Expr::Int32),
+                        ConstantExpr::alloc(i, Expr::Int8));
+  ref<Expr> updated = ReadExpr::alloc(
+      UpdateList(a, un), ZExtExpr::alloc(read(a, 3), Expr::Int32));
+
+  std::vector<ref<Expr>> exprs = {
+      UltExpr::alloc(AddExpr::alloc(a8, b8), ConstantExpr::alloc(3, 8)),
+      SltExpr::alloc(SExtExpr::alloc(a8, Expr::Int32), b32),
+      SgeExpr::alloc(a64, SExtExpr::alloc(b32, Expr::Int64)),
+      UDivExpr::alloc(a32, b32),
+      SRemExpr::alloc(a8, b8),
+      SDivExpr::alloc(b8, a8),
+      OrExpr::alloc(ShlExpr::alloc(a8, b8), LShrExpr::alloc(a8, b8)),
+      XorExpr::alloc(AShrExpr::alloc(a8, b8), NotExpr::alloc(b8)),
+      ExtractExpr::alloc(MulExpr::alloc(a32, b32), 5, Expr::Int16),
+      SelectExpr::alloc(UgeExpr::alloc(a8, b8), a8, updated),
+      EqExpr::alloc(updated, SubExpr::alloc(read(a, 7), b8)),
+      ReadExpr::alloc(UpdateList(c, 0), ZExtExpr::alloc(b8, Expr::Int32)),
+      NotOptimizedExpr::alloc(read(b, 7)),
+      // wider than 64 bits, left to visit()
+      ConcatExpr::alloc(a64, read(b, 0, Expr::Int64)),
+  };
+
+  std::vector<std::vector<unsigned char>> inputs = {
+      {0, 1, 2, 3, 4, 5, 6, 7},   {255, 0, 255, 0, 128, 1, 2, 3},
+      {1, 1, 1, 1, 1, 1, 1, 1},   {0, 0, 0, 0, 0, 0, 0, 0},
+      {3, 2, 9, 1, 255, 255, 255, 255}};
+  for (unsigned i = 0; i < inputs.size(); ++i) {
+    for (unsigned j = 0; j <= inputs.size(); ++j) {
+      // j == inputs.size() leaves b out of the ktest
+      KTestFile file(inputs[i], j < inputs.size()
+                                    ? inputs[j]
+                                    : std::vector<unsigned char>());
+      OracleEvaluator evaluator(file.path.str().str(), true);
+      OracleEvaluator reference(file.path.str().str(), true);
+      // twice, the second time from the cache
+      for (unsigned round = 0; round < 2; ++round)
+        for (unsigned k = 0; k < exprs.size(); ++k)
+          EXPECT_EQ(reference.visit(exprs[k]), evaluator.evaluate(exprs[k]))
+              << "expression " << k << ", inputs " << i << ", " << j;
+    }
+  }
+}
+
+TEST(OracleEvaluatorTest, IncrementalConcretization) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("a", 8);
+  const Array *b = ac.CreateArray("b", 8);
+
+  // a with a[b[0]] = a[1] + b[2] and then a[4] = b[3], read at a[5] and b[1]
+  ref<UpdateNode> un = new UpdateNode(
+      ref<UpdateNode>(), ZExtExpr::alloc(read(b, 0), Expr::Int32),
+      AddExpr::alloc(read(a, 1), read(b, 2)));
+  un = new UpdateNode(un, ConstantExpr::alloc(4, Expr::Int32), read(b, 3));
+  ref<Expr> older = ReadExpr::alloc(UpdateList(a, un->next),
+                                    ZExtExpr::alloc(read(a, 5), Expr::Int32));
+  ref<Expr> newer = ReadExpr::alloc(UpdateList(a, un),
+                                    ZExtExpr::alloc(read(b, 1), Expr::Int32));
+  Constraints_ty constraints = {
+      UltExpr::alloc(older, newer),
+      EqExpr::alloc(AddExpr::alloc(read(a, 0), read(b, 1)), read(a, 6)),
+      NeExpr::alloc(newer, ConstantExpr::alloc(3, Expr::Int8))};
+
+  KTestFile file({7, 1, 2, 3, 4, 0, 6, 7}, {5, 4, 9, 8, 0, 0, 0, 0});
+  std::vector<std::pair<std::string, unsigned>> inputs = {
+      {"a", 5}, {"b", 1}, {"b", 0}, {"a", 0}, {"a", 1},
+      {"b", 2}, {"b", 3}, {"a", 6}, {"a", 4}};
+  // the inputs added one at a time, starting from each of them in turn
+  for (unsigned r = 0; r < inputs.size(); ++r) {
+    std::rotate(inputs.begin(), inputs.begin() + 1, inputs.end());
+    ExprConcretizer incremental(file.path.str().str());
+    for (unsigned i = 0; i < inputs.size(); ++i) {
+      incremental.addConcretizedInputValue(inputs[i].first, inputs[i].second);
+      ExprConcretizer fresh(file.path.str().str());
+      for (unsigned j = 0; j <= i; ++j)
+        fresh.addConcretizedInputValue(inputs[j].first, inputs[j].second);
+      EXPECT_EQ(fresh.evaluate(constraints),
+                incremental.evaluate(constraints))
+          << "after " << inputs[i].first << "[" << inputs[i].second << "]";
+    }
+  }
+}
+
+TEST(OracleEvaluatorTest, IndirectReadDepth) {
+  ArrayCache ac;
+  const Array *A = ac.CreateArray("A", 4), *B = ac.CreateArray("B", 4),
+              *C = ac.CreateArray("C", 4), *D = ac.CreateArray("D", 4);
+  auto read = [](const Array *array, unsigned index) {
+    return ReadExpr::alloc(UpdateList(array, 0),
+                           ConstantExpr::alloc(index, Expr::Int32));
+  };
+  // Eq(Add(Read([ZExt(B[1]) = C[1]] @ D, ZExt(A[A[1]])), A[2]), 0): a read
+  // is at the level of its user, its index and the indices of its updates
+  // one level deeper
+  ref<Expr> c1 = read(C, 1), a1 = read(A, 1);
+  UpdateList ul(D, 0);
+  ul.extend(ZExtExpr::alloc(read(B, 1), Expr::Int32), c1);
+  ref<Expr> inner = ReadExpr::alloc(UpdateList(A, 0),
+                                    ZExtExpr::alloc(a1, Expr::Int32));
+  ref<Expr> outer =
+      ReadExpr::alloc(ul, ZExtExpr::alloc(inner, Expr::Int32));
+  ref<Expr> add = AddExpr::alloc(outer, read(A, 2));
+  ref<Expr> eq = EqExpr::alloc(add, ConstantExpr::alloc(0, Expr::Int8));
+  Constraints_ty constraints{eq, EqExpr::alloc(read(A, 3), c1)};
+
+  IndirectReadDepthCalculator serial(constraints), parallel(constraints, 4);
+  for (IndirectReadDepthCalculator *c : {&serial, &parallel}) {
+    EXPECT_EQ(0, c->query(eq));
+    EXPECT_EQ(0, c->query(outer));
+    EXPECT_EQ(1, c->query(inner));
+    EXPECT_EQ(2, c->query(a1));
+    EXPECT_EQ(0, c->query(ul.head.get()));
+    EXPECT_EQ(1, c->query(ul.head->index));
+    // shared by both constraints, numbered once
+    EXPECT_EQ(0, c->query(c1));
+    EXPECT_EQ(-1, c->query(read(D, 0)));
+    // the constant index of A[1]
+    EXPECT_EQ(3, c->getMax());
+    // A[1], A[2], A[3], B[1], C[1]
+    EXPECT_EQ(5u, c->getLastLevelReads().size());
+  }
+}
+} // namespace
@@ -0,0 +1,180 @@
+#include "klee/Internal/ADT/KTest.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+std::string bytes(const KTestObject *o) {
+  return std::string(reinterpret_cast<const char *>(o->bytes), o->numBytes);
+}
+
+void putUint32(std::string &out, unsigned v) {
+  for (int shift = 24; shift >= 0; shift -= 8)
+    out.push_back(static_cast<char>(v >> shift));
+}
+
+void putString(std::string &out, const std::string &s) {
+  putUint32(out, s.size());
+  out += s;
+}
+
+/* A version 3 file, which has no object directory */
+void writeVersion3(const char *path) {
+  std::string out = "KTEST";
+  putUint32(out, 3);
+  putUint32(out, 1);
+  putString(out, "prog");
+  putUint32(out, 0);
+  putUint32(out, 0);
+  putUint32(out, 2);
+  putString(out, "x");
+  putString(out, "abcd");
+  putString(out, "model_version");
+  putString(out, std::string("\1\0\0\0", 4));
+  FILE *f = fopen(path, "wb");
+  ASSERT_NE(nullptr, f);
+  fwrite(out.data(), out.size(), 1, f);
+  fclose(f);
+}
+
+} // namespace
+
+/* The objects of a written file are found in its directory, and the
+   sequential reader skips the directory. */
+TEST(KTestTest, MapFindsObjects) {
+  const char *path = "ktest1.ktest";
+  std::vector<std::string> names, data;
+  for (unsigned i = 0; i < 100; ++i) {
+    names.push_back("obj" + std::to_string(i));
+    data.push_back(std::string(i + 1, static_cast<char>(i)));
+  }
+  std::vector<KTestObject> objects(names.size());
+  for (unsigned i = 0; i < names.size(); ++i) {
+    objects[i].name = const_cast<char *>(names[i].c_str());
+    objects[i].numBytes = data[i].size();
+    objects[i].bytes =
+        reinterpret_cast<unsigned char *>(const_cast<char *>(data[i].data()));
+  }
+  KTest ktest;
+  memset(&ktest, 0, sizeof(ktest));
+  ktest.numObjects = objects.size();
+  ktest.objects = objects.data();
+  ASSERT_TRUE(kTest_toFile(&ktest, path));
+  ASSERT_TRUE(kTest_isKTestFile(path));
+
+  KTestMap *map = kTest_map(path);
+  ASSERT_NE(nullptr, map);
+  for (unsigned i = 0; i < names.size(); ++i) {
+    const KTestObject *o = kTest_mapFind(map, names[i].c_str());
+    ASSERT_NE(nullptr, o);
+    ASSERT_STREQ(names[i].c_str(), o->name);
+    ASSERT_EQ(data[i], bytes(o));
+    // found objects stay the same
+    ASSERT_EQ(o, kTest_mapFind(map, names[i].c_str()));
+  }
+  ASSERT_EQ(nullptr, kTest_mapFind(map, "obj100"));
+  ASSERT_EQ(nullptr, kTest_mapFind(map, "obj"));
+  kTest_unmap(map);
+
+  KTest *read = kTest_fromFile(path);
+  ASSERT_NE(nullptr, read);
+  ASSERT_EQ(kTest_getCurrentVersion(), read->version);
+  ASSERT_EQ(names.size(), read->numObjects);
+  for (unsigned i = 0; i < names.size(); ++i) {
+    ASSERT_STREQ(names[i].c_str(), read->objects[i].name);
+    ASSERT_EQ(data[i], bytes(&read->objects[i]));
+  }
+  kTest_free(read);
+  remove(path);
+}
+
+/* Files of earlier versions are indexed when they are mapped. */
+TEST(KTestTest, MapReadsVersion3) {
+  const char *path = "ktest2.ktest";
+  writeVersion3(path);
+
+  KTestMap *map = kTest_map(path);
+  ASSERT_NE(nullptr, map);
+  const KTestObject *x = kTest_mapFind(map, "x");
+  ASSERT_NE(nullptr, x);
+  ASSERT_EQ("abcd", bytes(x));
+  const KTestObject *version = kTest_mapFind(map, "model_version");
+  ASSERT_NE(nullptr, version);
+  ASSERT_EQ(4u, version->numBytes);
+  ASSERT_EQ(nullptr, kTest_mapFind(map, "y"));
+  kTest_unmap(map);
+
+  KTest *read = kTest_fromFile(path);
+  ASSERT_NE(nullptr, read);
+  ASSERT_EQ(3u, read->version);
+  ASSERT_EQ(2u, read->numObjects);
+  kTest_free(read);
+  remove(path);
+}
+
+/* KTests written one after the other to a stream are read back in order. */
+TEST(KTestTest, StreamRoundTrip) {
+  FILE *f = tmpfile();
+  ASSERT_NE(nullptr, f);
+  char arg0[] = "prog", arg1[] = "--sym-arg";
+  char *args[] = {arg0, arg1};
+  std::vector<std::string> names, data;
+  for (unsigned i = 0; i < 3; ++i) {
+    names.push_back("obj" + std::to_string(i));
+    data.push_back(std::string(10 * (i + 1), static_cast<char>('a' + i)));
+  }
+  for (unsigned n = 1; n <= 3; ++n) {
+    std::vector<KTestObject> objects(n);
+    for (unsigned i = 0; i < n; ++i) {
+      objects[i].name = const_cast<char *>(names[i].c_str());
+      objects[i].numBytes = data[i].size();
+      objects[i].bytes =
+          reinterpret_cast<unsigned char *>(const_cast<char *>(data[i].data()));
+    }
+    KTest ktest;
+    memset(&ktest, 0, sizeof(ktest));
+    ktest.numArgs = n < 3 ? n : 2;
+    ktest.args = args;
+    ktest.numObjects = n;
+    ktest.objects = objects.data();
+    ASSERT_TRUE(kTest_toStream(&ktest, f));
+  }
+
+  rewind(f);
+  for (unsigned n = 1; n <= 3; ++n) {
+    KTest *read = kTest_fromStream(f);
+    ASSERT_NE(nullptr, read);
+    ASSERT_EQ(n < 3 ? n : 2, read->numArgs);
+    ASSERT_STREQ("prog", read->args[0]);
+    ASSERT_EQ(n, read->numObjects);
+    for (unsigned i = 0; i < n; ++i) {
+      ASSERT_STREQ(names[i].c_str(), read->objects[i].name);
+      ASSERT_EQ(data[i], bytes(&read->objects[i]));
+    }
+    kTest_free(read);
+  }
+  ASSERT_EQ(EOF, getc(f));
+  fclose(f);
+}
+
+/* A file cut short is rejected instead of read past its end. */
+TEST(KTestTest, MapRejectsTruncatedFiles) {
+  const char *path = "ktest3.ktest";
+  writeVersion3(path);
+  FILE *f = fopen(path, "rb");
+  ASSERT_NE(nullptr, f);
+  std::string contents(1024, '\0');
+  contents.resize(fread(&contents[0], 1, contents.size(), f));
+  fclose(f);
+  f = fopen(path, "wb");
+  fwrite(contents.data(), contents.size() - 2, 1, f);
+  fclose(f);
+
+  ASSERT_EQ(nullptr, kTest_map(path));
+  remove(path);
+}
@@ -0,0 +1,78 @@
+#include "klee/Internal/ADT/MapOfSets.h"
+#include "klee/Internal/ADT/SignatureSetIndex.h"
+#include "gtest/gtest.h"
+
+#include <functional>
+#include <set>
+
+using namespace klee;
+
+namespace {
+
+typedef std::set<int> S;
+
+struct Any {
+  bool operator()(int) const { return true; }
+};
+
+struct Odd {
+  bool operator()(int v) const { return v & 1; }
+};
+
+TEST(MapOfSetsTest, Erase) {
+  MapOfSets<int, int> m;
+  m.insert(S{1, 2}, 1);
+  m.insert(S{1, 2, 3}, 2);
+  m.insert(S{4}, 3);
+
+  ASSERT_TRUE(m.erase(S{1, 2}));
+  ASSERT_FALSE(m.erase(S{1, 2}));
+  ASSERT_FALSE(m.erase(S{1}));
+  ASSERT_EQ(nullptr, m.lookup(S{1, 2}));
+  ASSERT_EQ(2, *m.lookup(S{1, 2, 3}));
+
+  ASSERT_TRUE(m.erase(S{1, 2, 3}));
+  ASSERT_EQ(nullptr, m.findSuperset(S{1}, Any()));
+  ASSERT_EQ(3, *m.findSubset(S{1, 4, 5}, Any()));
+}
+
+TEST(SignatureSetIndexTest, Lookup) {
+  SignatureSetIndex<int, int, std::hash<int>> m;
+  m.insert(S{1, 2}, 1);
+  m.insert(S{1, 2, 3}, 2);
+  m.insert(S{}, 4);
+  m.insert(S{1, 2}, 5);
+  ASSERT_EQ(3u, m.size());
+
+  ASSERT_EQ(5, *m.lookup(S{1, 2}));
+  ASSERT_EQ(4, *m.lookup(S{}));
+  ASSERT_EQ(nullptr, m.lookup(S{2}));
+
+  ASSERT_EQ(2, *m.findSuperset(S{3}, Any()));
+  ASSERT_EQ(5, *m.findSuperset(S{1, 2}, Odd()));
+  ASSERT_EQ(nullptr, m.findSuperset(S{4}, Any()));
+  ASSERT_EQ(5, *m.findSubset(S{1, 2, 7}, Odd()));
+  ASSERT_EQ(4, *m.findSubset(S{7}, Any()));
+
+  ASSERT_TRUE(m.erase(S{}));
+  ASSERT_FALSE(m.erase(S{}));
+  ASSERT_EQ(nullptr, m.findSubset(S{7}, Any()));
+}
+
+TEST(SignatureSetIndexTest, ProbeLimit) {
+  SignatureSetIndex<int, int, std::hash<int>> m(2);
+  m.insert(S{1}, 1);
+  m.insert(S{2}, 2);
+  m.insert(S{3}, 3);
+
+  // only the two most recent entries are scanned
+  ASSERT_EQ(nullptr, m.findSubset(S{1, 5}, Any()));
+  ASSERT_EQ(2, *m.findSubset(S{1, 2}, Any()));
+  // exact lookups are not limited
+  ASSERT_EQ(1, *m.lookup(S{1}));
+
+  m.setMaxProbes(0);
+  ASSERT_EQ(1, *m.findSubset(S{1, 5}, Any()));
+}
+
+} // namespace
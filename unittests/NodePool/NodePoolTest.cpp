@@ -0,0 +1,65 @@
+#include "klee/Internal/ADT/ImmutableMap.h"
+#include "klee/Internal/ADT/NodePool.h"
+#include "gtest/gtest.h"
+
+#include <thread>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+struct Slot {
+  char bytes[40];
+};
+typedef NodePool<sizeof(Slot), alignof(Slot)> Pool;
+
+TEST(NodePoolTest, Reuse) {
+  void *a = Pool::allocate();
+  void *b = Pool::allocate();
+  ASSERT_NE(a, b);
+  ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(a) % alignof(Slot));
+  Pool::deallocate(a);
+  // the thread's last freed node is handed out first
+  ASSERT_EQ(a, Pool::allocate());
+  Pool::deallocate(a);
+  Pool::deallocate(b);
+}
+
+TEST(NodePoolTest, FreeOnOtherThread) {
+  size_t n = 4 * Pool::SlabSize / Pool::SlotSize;
+  std::vector<void *> nodes;
+  for (size_t i = 0; i < n; ++i)
+    nodes.push_back(Pool::allocate());
+  size_t slabs = Pool::getNumSlabs();
+
+  std::thread t([&]() {
+    for (void *p : nodes)
+      Pool::deallocate(p);
+  });
+  t.join();
+
+  // the exited thread gave its nodes back, no new slab is needed
+  nodes.clear();
+  for (size_t i = 0; i < n; ++i)
+    nodes.push_back(Pool::allocate());
+  ASSERT_EQ(slabs, Pool::getNumSlabs());
+  for (void *p : nodes)
+    Pool::deallocate(p);
+}
+
+TEST(NodePoolTest, ImmutableMap) {
+  typedef ImmutableMap<int, int> Map;
+  Map m;
+  for (int i = 0; i < 1000; ++i)
+    m = m.insert(std::make_pair(i, 2 * i));
+  Map copy = m;
+  for (int i = 0; i < 1000; i += 2)
+    m = m.remove(i);
+  ASSERT_EQ(500u, m.size());
+  ASSERT_EQ(1000u, copy.size());
+  ASSERT_EQ(6, copy.lookup(3)->second);
+  ASSERT_EQ(nullptr, m.lookup(4));
+}
+
+} // namespace
@@ -0,0 +1,51 @@
+#include "klee/Internal/ADT/PagedArray.h"
+#include "gtest/gtest.h"
+
+#include <cstdint>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+typedef PagedArray<uint8_t> Bytes;
+
+TEST(PagedArrayTest, CopyOnWrite) {
+  unsigned size = 3 * Bytes::PageSize + 5;
+  Bytes a(size, 7);
+  a.set(1, 1);
+
+  Bytes b(a);
+  ASSERT_EQ(4u, b.getNumSharedPages());
+  b.set(Bytes::PageSize + 2, 9);
+  // only the written page is copied
+  ASSERT_EQ(3u, b.getNumSharedPages());
+  ASSERT_EQ(7, a[Bytes::PageSize + 2]);
+  ASSERT_EQ(9, b[Bytes::PageSize + 2]);
+  ASSERT_EQ(1, b[1]);
+
+  b.fill(0);
+  ASSERT_EQ(0u, b.getNumSharedPages());
+  ASSERT_EQ(0u, a.getNumSharedPages());
+  ASSERT_EQ(7, a[size - 1]);
+  ASSERT_EQ(0, b[size - 1]);
+}
+
+TEST(PagedArrayTest, Copies) {
+  unsigned size = 2 * Bytes::PageSize + 1;
+  Bytes a(size, 3);
+  std::vector<uint8_t> out(size);
+  a.copyTo(out.data());
+  ASSERT_TRUE(a.equals(out.data()));
+
+  Bytes b(a);
+  out[size - 1] = 4;
+  ASSERT_FALSE(b.equals(out.data()));
+  b.copyFrom(out.data());
+  ASSERT_TRUE(b.equals(out.data()));
+  // unchanged pages stay shared
+  ASSERT_EQ(2u, b.getNumSharedPages());
+  ASSERT_EQ(3, a[size - 1]);
+}
+
+} // namespace
@@ -0,0 +1,371 @@
+#include "klee/Config/config.h"
+#include "klee/Internal/Support/BlockCompression.h"
+#include "klee/Internal/Support/PathBuffer.h"
+#include "klee/Internal/Support/Serialize.h"
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+using namespace klee;
+
+namespace {
+
+PathEntry makeFork(bool br) {
+  PathEntry pe;
+  pe.t = PathEntry::FORK;
+  pe.body.br = br;
+  return pe;
+}
+
+/* Entries written with serialize() can be read back through the mapping */
+TEST(PathBufferTest, MapPathFile) {
+  {
+    std::ofstream f("pb1.path", std::ios::out | std::ios::binary);
+    for (unsigned i = 0; i < 1000; ++i)
+      serialize(f, makeFork(i % 3 == 0));
+  }
+  std::string error;
+  std::unique_ptr<PathEntryBuffer> pb = PathEntryBuffer::open("pb1.path", error);
+  ASSERT_TRUE(pb != nullptr) << error;
+  ASSERT_EQ(1000u, pb->size());
+  for (unsigned i = 0; i < 1000; ++i) {
+    ASSERT_EQ(PathEntry::FORK, (*pb)[i].t);
+    ASSERT_EQ(i % 3 == 0, (*pb)[i].body.br);
+  }
+}
+
+TEST(PathBufferTest, MissingFile) {
+  std::string error;
+  ASSERT_TRUE(PathEntryBuffer::open("does-not-exist.path", error) == nullptr);
+  ASSERT_FALSE(error.empty());
+}
+
+/* v2 round trips every entry type and is smaller than v1 for fork runs */
+TEST(PathBufferTest, V2RoundTrip) {
+  std::vector<PathEntry> entries;
+  for (unsigned i = 0; i < 77; ++i)
+    entries.push_back(makeFork(i & 1));
+  PathEntry pe;
+  pe.t = PathEntry::SWITCH_EXPIDX;
+  pe.body.switchIndex = 300;
+  entries.push_back(pe);
+  pe.t = PathEntry::DATAREC;
+  pe.body.drec.IDlen = 12;
+  pe.body.drec.width = 32;
+  entries.push_back(pe);
+  pe.t = PathEntry::INDIRECTBR;
+  pe.body.indirectbrIndex = 3;
+  entries.push_back(pe);
+  pe.t = PathEntry::SCHEDULE;
+  pe.body.tgtid = 513;
+  entries.push_back(pe);
+  entries.push_back(makeFork(true));
+
+  std::string v1, v2;
+  encodePathFile(entries, PathFileV1, v1);
+  encodePathFile(entries, PathFileV2, v2);
+  ASSERT_LT(v2.size(), v1.size());
+  {
+    std::ofstream f("pb3.path", std::ios::out | std::ios::binary);
+    f << v2;
+  }
+  std::string error;
+  std::unique_ptr<PathEntryBuffer> pb = PathEntryBuffer::open("pb3.path", error);
+  ASSERT_TRUE(pb != nullptr) << error;
+  ASSERT_EQ(PathFileV2, pb->getVersion());
+  ASSERT_EQ(entries.size(), pb->size());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    const PathEntry &got = (*pb)[i];
+    ASSERT_EQ(entries[i].t, got.t);
+    switch (got.t) {
+    case PathEntry::FORK:
+      ASSERT_EQ(entries[i].body.br, got.body.br);
+      break;
+    case PathEntry::SWITCH_EXPIDX:
+      ASSERT_EQ(300u, got.body.switchIndex);
+      break;
+    case PathEntry::DATAREC:
+      ASSERT_EQ(12u, got.body.drec.IDlen);
+      ASSERT_EQ(32u, got.body.drec.width);
+      break;
+    case PathEntry::INDIRECTBR:
+      ASSERT_EQ(3u, got.body.indirectbrIndex);
+      break;
+    case PathEntry::SCHEDULE:
+      ASSERT_EQ(513u, got.body.tgtid);
+      break;
+    default:
+      FAIL();
+    }
+  }
+
+  // truncated images are rejected instead of misread
+  std::vector<PathEntry> decoded;
+  ASSERT_FALSE(decodePathFile(v2.data(), v2.size() - 3, decoded, error));
+}
+
+/* v2 .path_datarec stores a dictionary once and an index per entry */
+TEST(PathBufferTest, DataRecDictionary) {
+  std::vector<DataRecEntry> entries;
+  for (unsigned i = 0; i < 100; ++i)
+    entries.push_back(DataRecEntry{1000 + i % 4, i * 7u});
+  std::string encoded;
+  encodeDataRecFile(entries,
+                    [](uint32_t id) { return "f:bb:i" + std::to_string(id); },
+                    encoded);
+  {
+    std::ofstream f("pb2.path_datarec", std::ios::out | std::ios::binary);
+    f << encoded;
+  }
+  std::string error;
+  std::unique_ptr<DataRecBuffer> db =
+      DataRecBuffer::open("pb2.path_datarec", error);
+  ASSERT_TRUE(db != nullptr) << error;
+  ASSERT_EQ(entries.size(), db->size());
+  ASSERT_EQ(4u, db->getIDTable().size());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    DataRecEntry dre = (*db)[i];
+    ASSERT_EQ(entries[i].data, dre.data);
+    ASSERT_EQ("f:bb:i" + std::to_string(entries[i].instID),
+              db->getIDTable()[dre.instID]);
+  }
+}
+
+/* a corrupt length in the dictionary is a decode error, not an allocation */
+TEST(PathBufferTest, DataRecDictionaryBadLength) {
+  std::vector<DataRecEntry> entries{DataRecEntry{1, 0}};
+  std::string encoded;
+  encodeDataRecFile(entries, [](uint32_t) { return "f:bb:i0"; }, encoded);
+  size_t at = encoded.find("f:bb:i0");
+  ASSERT_NE(std::string::npos, at);
+  uint64_t length = uint64_t(1) << 60;
+  encoded.replace(at - sizeof(length), sizeof(length),
+                  reinterpret_cast<const char *>(&length), sizeof(length));
+  {
+    std::ofstream f("pb2b.path_datarec", std::ios::out | std::ios::binary);
+    f << encoded;
+  }
+  std::string error;
+  std::unique_ptr<DataRecBuffer> db =
+      DataRecBuffer::open("pb2b.path_datarec", error);
+  ASSERT_TRUE(db == nullptr);
+  ASSERT_EQ("truncated .path_datarec file", error);
+}
+
+/* legacy files carrying the unique ID string per entry are still readable */
+TEST(PathBufferTest, DataRecV1) {
+  {
+    std::ofstream f("pb3.path_datarec", std::ios::out | std::ios::binary);
+    for (unsigned i = 0; i < 10; ++i) {
+      serialize(f, uint64_t(i));
+      serialize(f, std::string(i % 2 ? "odd" : "even"));
+    }
+  }
+  std::string error;
+  std::unique_ptr<DataRecBuffer> db =
+      DataRecBuffer::open("pb3.path_datarec", error);
+  ASSERT_TRUE(db != nullptr) << error;
+  ASSERT_EQ(10u, db->size());
+  ASSERT_EQ(2u, db->getIDTable().size());
+  for (unsigned i = 0; i < 10; ++i) {
+    ASSERT_EQ(i, (*db)[i].data);
+    ASSERT_EQ(i % 2 ? "odd" : "even", db->getIDTable()[(*db)[i].instID]);
+  }
+}
+
+/* a corrupt length prefix is a decode error, not an allocation */
+TEST(PathBufferTest, DataRecV1BadLength) {
+  {
+    std::ofstream f("pb3b.path_datarec", std::ios::out | std::ios::binary);
+    serialize(f, uint64_t(1));
+    serialize(f, std::string("first"));
+    serialize(f, uint64_t(2));
+    serialize(f, uint64_t(1) << 60);
+    f << "short";
+  }
+  std::string error;
+  std::unique_ptr<DataRecBuffer> db =
+      DataRecBuffer::open("pb3b.path_datarec", error);
+  ASSERT_TRUE(db == nullptr);
+  ASSERT_EQ("truncated .path_datarec entry", error);
+}
+
+#ifdef HAVE_ZLIB_H
+/* A block compressed v1 .path spanning several blocks reads like the
+   uncompressed one, and fork runs compress well */
+TEST(PathBufferTest, CompressedPathFile) {
+  std::vector<PathEntry> entries;
+  for (unsigned i = 0; i < 300000; ++i)
+    entries.push_back(makeFork(i % 5 == 0));
+  std::string v1, compressed;
+  encodePathFile(entries, PathFileV1, v1);
+  compressBlocks(v1, compressed);
+  ASSERT_LT(compressed.size() * 10, v1.size());
+  {
+    std::ofstream f("pb4.path", std::ios::out | std::ios::binary);
+    f << compressed;
+  }
+  std::string error;
+  std::unique_ptr<PathEntryBuffer> pb = PathEntryBuffer::open("pb4.path", error);
+  ASSERT_TRUE(pb != nullptr) << error;
+  ASSERT_EQ(PathFileV1, pb->getVersion());
+  ASSERT_EQ(entries.size(), pb->size());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    ASSERT_EQ(PathEntry::FORK, (*pb)[i].t);
+    ASSERT_EQ(i % 5 == 0, (*pb)[i].body.br);
+  }
+
+  // a compressed v2 file is decoded when it is opened
+  std::string v2;
+  encodePathFile(entries, PathFileV2, v2);
+  compressed.clear();
+  compressBlocks(v2, compressed);
+  {
+    std::ofstream f("pb5.path", std::ios::out | std::ios::binary);
+    f << compressed;
+  }
+  pb = PathEntryBuffer::open("pb5.path", error);
+  ASSERT_TRUE(pb != nullptr) << error;
+  ASSERT_EQ(PathFileV2, pb->getVersion());
+  ASSERT_EQ(entries.size(), pb->size());
+  ASSERT_EQ(true, (*pb)[entries.size() - 5].body.br);
+
+  // the index is checked against the file size
+  {
+    std::ofstream f("pb6.path", std::ios::out | std::ios::binary);
+    f << compressed.substr(0, compressed.size() - 1);
+  }
+  ASSERT_TRUE(PathEntryBuffer::open("pb6.path", error) == nullptr);
+  ASSERT_FALSE(error.empty());
+}
+
+TEST(PathBufferTest, CompressedDataRec) {
+  std::vector<DataRecEntry> entries;
+  for (unsigned i = 0; i < 200000; ++i)
+    entries.push_back(DataRecEntry{i % 3, i});
+  std::string encoded, compressed;
+  encodeDataRecFile(entries,
+                    [](uint32_t id) { return "f:bb:i" + std::to_string(id); },
+                    encoded);
+  compressBlocks(encoded, compressed);
+  {
+    std::ofstream f("pb4.path_datarec", std::ios::out | std::ios::binary);
+    f << compressed;
+  }
+  std::string error;
+  std::unique_ptr<DataRecBuffer> db =
+      DataRecBuffer::open("pb4.path_datarec", error);
+  ASSERT_TRUE(db != nullptr) << error;
+  ASSERT_EQ(entries.size(), db->size());
+  ASSERT_EQ(3u, db->getIDTable().size());
+  for (size_t i = entries.size(); i-- > 0;) {
+    DataRecEntry dre = (*db)[i];
+    ASSERT_EQ(entries[i].data, dre.data);
+    ASSERT_EQ("f:bb:i" + std::to_string(i % 3), db->getIDTable()[dre.instID]);
+  }
+}
+
+TEST(PathBufferTest, WindowedPathFile) {
+  std::vector<PathEntry> entries;
+  for (unsigned i = 0; i < 1000000; ++i) {
+    PathEntry pe;
+    memset(&pe, 0, sizeof(pe));
+    pe.t = PathEntry::SWITCH_BBIDX;
+    pe.body.switchIndex = i;
+    entries.push_back(pe);
+  }
+  std::string v1, compressed;
+  encodePathFile(entries, PathFileV1, v1);
+  compressBlocks(v1, compressed);
+  {
+    std::ofstream f("pb7.path", std::ios::out | std::ios::binary);
+    f << compressed;
+  }
+  std::string error;
+  const size_t window = 256 * 1024;
+  ASSERT_LT(window * 4, v1.size());
+  std::unique_ptr<PathEntryBuffer> pb =
+      PathEntryBuffer::open("pb7.path", error, window);
+  ASSERT_TRUE(pb != nullptr) << error;
+  ASSERT_EQ(entries.size(), pb->size());
+  for (size_t i = 0; i < entries.size(); ++i)
+    ASSERT_EQ((PathEntry::switchIndex_t)i, (*pb)[i].body.switchIndex);
+  // entries left behind are decompressed again
+  for (size_t i : {0ul, 1ul, 500000ul, 499999ul, 999999ul, 12345ul})
+    ASSERT_EQ((PathEntry::switchIndex_t)i, (*pb)[i].body.switchIndex);
+
+  std::vector<DataRecEntry> recs;
+  for (unsigned i = 0; i < 500000; ++i)
+    recs.push_back(DataRecEntry{i % 3, i});
+  std::string encoded;
+  encodeDataRecFile(recs,
+                    [](uint32_t id) { return "f:bb:i" + std::to_string(id); },
+                    encoded);
+  compressed.clear();
+  compressBlocks(encoded, compressed);
+  {
+    std::ofstream f("pb7.path_datarec", std::ios::out | std::ios::binary);
+    f << compressed;
+  }
+  std::unique_ptr<DataRecBuffer> db =
+      DataRecBuffer::open("pb7.path_datarec", error, window);
+  ASSERT_TRUE(db != nullptr) << error;
+  ASSERT_EQ(recs.size(), db->size());
+  for (size_t i = 0; i < recs.size(); ++i)
+    ASSERT_EQ(i, (*db)[i].data);
+  for (size_t i = recs.size(); i-- > 0;)
+    ASSERT_EQ(i, (*db)[i].data);
+}
+#endif
+
+PathEntry makeDataRec() {
+  PathEntry pe;
+  pe.t = PathEntry::DATAREC;
+  pe.body.drec.IDlen = 1;
+  pe.body.drec.width = 64;
+  return pe;
+}
+
+/* Traces of the same path are merged into the union of their DATAREC
+   entries, and traces of different paths are refused */
+TEST(PathBufferTest, MergeTraces) {
+  // a: fork x fork y, b: fork x x' fork z y
+  PathEntryBuffer aPath({makeFork(true), makeDataRec(), makeFork(false),
+                         makeDataRec()});
+  DataRecBuffer aData({{0, 1}, {1, 2}}, {"x", "y"});
+  PathEntryBuffer bPath({makeFork(true), makeDataRec(), makeDataRec(),
+                         makeFork(false), makeDataRec(), makeDataRec()});
+  DataRecBuffer bData({{1, 1}, {1, 5}, {0, 3}, {2, 7}}, {"z", "x", "y"});
+  std::vector<PathEntry> path;
+  std::vector<DataRecEntry> dataRec;
+  std::vector<std::string> ids;
+  TraceMergeStats stats;
+  std::string error;
+  ASSERT_TRUE(mergeReplayTraces({{&aPath, &aData}, {&bPath, &bData}}, path,
+                                dataRec, ids, stats, error))
+      << error;
+  ASSERT_EQ(6u, path.size());
+  ASSERT_EQ(PathEntry::FORK, path[3].t);
+  ASSERT_EQ(4u, dataRec.size());
+  // x x' then z before the shared y, which keeps the value of a
+  const char *expectedIDs[] = {"x", "x", "z", "y"};
+  uint64_t expectedData[] = {1, 5, 3, 2};
+  for (unsigned i = 0; i < 4; ++i) {
+    ASSERT_EQ(expectedIDs[i], ids[dataRec[i].instID]);
+    ASSERT_EQ(expectedData[i], dataRec[i].data);
+  }
+  ASSERT_EQ(2u, stats.added);
+  ASSERT_EQ(2u, stats.shared);
+  ASSERT_EQ(1u, stats.conflicts);
+
+  PathEntryBuffer cPath({makeFork(false)});
+  DataRecBuffer cData;
+  ASSERT_FALSE(mergeReplayTraces({{&aPath, &aData}, {&cPath, &cData}}, path,
+                                 dataRec, ids, stats, error));
+  ASSERT_FALSE(error.empty());
+}
+
+} // namespace
@@ -0,0 +1,71 @@
+#include "../../lib/Core/QueryCostPredictor.h"
+#include "gtest/gtest.h"
+
+#include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/Constraints.h"
+
+#include <cmath>
+
+using namespace klee;
+
+namespace {
+
+QueryCostPredictor::Features features(double nodes, double constraints) {
+  return QueryCostPredictor::Features{{1., nodes, constraints, 0., 1., 1.}};
+}
+
+/* the time of the synthetic queries, doubling with the logarithm of their
+   nodes and quadrupling with the one of their constraints */
+double seconds(double nodes, double constraints) {
+  return std::exp2(nodes + 2 * constraints - 20);
+}
+
+/* A fit of the times of small queries extrapolates to larger ones, and
+   nothing is predicted before enough queries were seen. */
+TEST(QueryCostPredictorTest, Extrapolates) {
+  QueryCostPredictor predictor;
+  double predicted;
+  for (unsigned i = 0; i < QueryCostPredictor::MinSamples - 1; ++i) {
+    double n = 2 + i % 5, c = 1 + i % 3;
+    predictor.observe(features(n, c), seconds(n, c));
+  }
+  ASSERT_FALSE(predictor.predict(features(3, 2), predicted));
+
+  for (unsigned i = 0; i < 3 * QueryCostPredictor::RefitEvery; ++i) {
+    double n = 2 + i % 7, c = 1 + i % 4;
+    predictor.observe(features(n, c), seconds(n, c));
+  }
+  ASSERT_TRUE(predictor.predict(features(3, 2), predicted));
+  ASSERT_NEAR(std::log2(seconds(3, 2)), std::log2(predicted), 0.5);
+  // twice the largest sizes seen
+  ASSERT_TRUE(predictor.predict(features(16, 8), predicted));
+  ASSERT_NEAR(std::log2(seconds(16, 8)), std::log2(predicted), 1.);
+}
+
+/* Only the constraints sharing arrays with the condition are features of
+   its query. */
+TEST(QueryCostPredictorTest, RelatedConstraints) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("qcp_a", 4);
+  const Array *b = ac.CreateArray("qcp_b", 4);
+  auto read = [](const Array *array, unsigned index) {
+    return ReadExpr::create(UpdateList(array, 0),
+                            ConstantExpr::create(index, Expr::Int32));
+  };
+  ConstraintManager cm;
+  for (unsigned i = 0; i < 3; ++i)
+    cm.addConstraint(UltExpr::create(read(a, i), read(a, i + 1)));
+  cm.addConstraint(
+      UltExpr::create(read(b, 0), ConstantExpr::create(7, Expr::Int8)));
+
+  QueryCostPredictor::Features f = QueryCostPredictor::getFeatures(
+      cm, EqExpr::create(read(b, 0), ConstantExpr::create(3, Expr::Int8)));
+  if (cm.factor_size()) {
+    ASSERT_EQ(std::log2(2.), f[2]);
+    ASSERT_EQ(std::log2(2.), f[5]);
+  } else {
+    ASSERT_EQ(std::log2(5.), f[2]);
+  }
+}
+
+} // namespace
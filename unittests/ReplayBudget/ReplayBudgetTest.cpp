@@ -0,0 +1,60 @@
+#include "../../lib/Core/ReplayBudget.h"
+#include "gtest/gtest.h"
+
+#include "llvm/Support/raw_ostream.h"
+
+#include <string>
+
+using namespace klee;
+
+namespace {
+
+/* Without progress a query gets a quarter of a segment, halfway through an
+   instant replay it gets the rest of the budget, within the cap. */
+TEST(ReplayBudgetTest, TimeoutFromSlack) {
+  ReplayBudget budget(time::seconds(1000), 100, 10, nullptr);
+  ASSERT_NEAR(25., budget.getTimeout(0, time::Span()).toSeconds(), 1.);
+  ASSERT_NEAR(1000., budget.getTimeout(50, time::Span()).toSeconds(), 1.);
+  ASSERT_EQ(time::seconds(10), budget.getTimeout(50, time::seconds(10)));
+  ASSERT_EQ(time::seconds(500), budget.getTarget(50));
+}
+
+/* The timeout never drops below a few times the slow queries seen. */
+TEST(ReplayBudgetTest, PercentileFloor) {
+  ReplayBudget budget(time::seconds(1000), 100, 10, nullptr);
+  ASSERT_EQ(time::Span(), budget.getQueryPercentile90());
+  for (unsigned i = 0; i < 90; ++i)
+    budget.observeQuery(time::milliseconds(1));
+  for (unsigned i = 0; i < 10; ++i)
+    budget.observeQuery(time::seconds(1));
+  ASSERT_LE(time::milliseconds(1), budget.getQueryPercentile90());
+  ASSERT_GT(time::milliseconds(3), budget.getQueryPercentile90());
+
+  for (unsigned i = 0; i < 100; ++i)
+    budget.observeQuery(time::seconds(20));
+  ASSERT_LE(time::seconds(20), budget.getQueryPercentile90());
+  ASSERT_LE(ReplayBudget::PercentileFactor * time::seconds(20),
+            budget.getTimeout(0, time::Span()));
+}
+
+/* A line per completed segment, and one for the segment the replay ends
+   in. */
+TEST(ReplayBudgetTest, SegmentLog) {
+  std::string log;
+  llvm::raw_string_ostream os(log);
+  ReplayBudget budget(time::seconds(1000), 100, 10, &os);
+  budget.advance(5);
+  budget.advance(35);
+  budget.finish(42, true);
+  os.flush();
+  unsigned lines = 0;
+  for (char c : log)
+    lines += c == '\n';
+  ASSERT_EQ(6u, lines);
+  ASSERT_NE(std::string::npos, log.find("\ton time\n"));
+  ASSERT_NE(std::string::npos, log.find("3\t30\t40\t"));
+  ASSERT_NE(std::string::npos, log.find("4\t40\t50\t"));
+  ASSERT_NE(std::string::npos, log.find("\texhausted\n"));
+}
+
+} // namespace
@@ -0,0 +1,66 @@
+#include "klee/Internal/ADT/RunArray.h"
+#include "gtest/gtest.h"
+
+#include <cstdlib>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+TEST(RunArrayTest, Runs) {
+  RunArray<int> a(100, 7);
+  ASSERT_EQ(1u, a.getNumRuns());
+
+  a.set(10, 20, 1);
+  ASSERT_EQ(3u, a.getNumRuns());
+  ASSERT_EQ(7, a[9]);
+  ASSERT_EQ(1, a[10]);
+  ASSERT_EQ(1, a[19]);
+  ASSERT_EQ(7, a[20]);
+
+  // consecutive writes of one value extend its run
+  for (unsigned i = 20; i != 30; ++i)
+    a.set(i, 1);
+  ASSERT_EQ(3u, a.getNumRuns());
+  ASSERT_EQ(1, a[29]);
+  ASSERT_EQ(7, a[30]);
+
+  // splitting a run and joining it back
+  a.set(15, 2);
+  ASSERT_EQ(5u, a.getNumRuns());
+  a.set(15, 1);
+  ASSERT_EQ(3u, a.getNumRuns());
+
+  a.set(0, 100, 7);
+  ASSERT_EQ(1u, a.getNumRuns());
+
+  a.set(99, 3);
+  a.set(0, 3);
+  ASSERT_EQ(3u, a.getNumRuns());
+  a.fill(0);
+  ASSERT_EQ(1u, a.getNumRuns());
+  ASSERT_EQ(0, a[99]);
+}
+
+TEST(RunArrayTest, MatchesPlainArray) {
+  const unsigned size = 257;
+  RunArray<int> a(size);
+  std::vector<int> b(size);
+  srand(1);
+  for (unsigned n = 0; n != 10000; ++n) {
+    unsigned begin = rand() % size;
+    unsigned end = begin + rand() % (size - begin + 1);
+    int value = rand() % 3;
+    a.set(begin, end, value);
+    std::fill(b.begin() + begin, b.begin() + end, value);
+    unsigned runs = 1;
+    for (unsigned i = 0; i != size; ++i) {
+      ASSERT_EQ(b[i], a[i]);
+      runs += i && b[i] != b[i - 1];
+    }
+    ASSERT_EQ(runs, a.getNumRuns());
+  }
+}
+
+} // namespace
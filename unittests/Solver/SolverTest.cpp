@@ -9,11 +9,13 @@
 
 #include "gtest/gtest.h"
 
+#include "klee/Config/config.h"
 #include "klee/Expr/ArrayCache.h"
 #include "klee/Expr/Constraints.h"
 #include "klee/Expr/Expr.h"
 #include "klee/Solver/Solver.h"
 #include "klee/Solver/SolverCmdLine.h"
+#include "klee/Solver/SolverStats.h"
 
 #include "llvm/ADT/StringExtras.h"
 
@@ -168,4 +170,438 @@ TEST(SolverTest, Evaluation) {
   delete solver;
 }
 
+TEST(SolverTest, EqualitySimplifier) {
+  Solver *solver = klee::createCoreSolver(CoreSolverToUse);
+  solver = createEqualitySimplifyingSolver(solver);
+
+  const Array *u = ac.CreateArray("eq_u", 4);
+  const Array *m = ac.CreateArray("eq_m", 8);
+  const Array *x = ac.CreateArray("eq_x", 1);
+  UpdateList ul(u, 0);
+  ref<Expr> x0 = ReadExpr::create(UpdateList(x, 0),
+                                  ConstantExpr::create(0, Expr::Int32));
+
+  // u = 0x00000204, recorded as a single 32 bit load
+  ConstraintManager cm;
+  cm.addConstraint(EqExpr::create(ConstantExpr::create(0x204, Expr::Int32),
+                                  Expr::createTempRead(u, Expr::Int32)));
+  cm.addConstraint(UltExpr::create(
+      x0, ReadExpr::create(ul, ConstantExpr::create(1, Expr::Int32))));
+
+  // m[u[0]] = 7; m[1] = x[0]; then read m[4]
+  UpdateList mu(m, 0);
+  mu.extend(ZExtExpr::create(
+                ReadExpr::create(ul, ConstantExpr::create(0, Expr::Int32)),
+                Expr::Int32),
+            ConstantExpr::create(7, Expr::Int8));
+  mu.extend(ConstantExpr::create(1, Expr::Int32), x0);
+  ref<Expr> read = ReadExpr::create(mu, ConstantExpr::create(4, Expr::Int32));
+
+  bool result;
+  ASSERT_TRUE(solver->mustBeTrue(
+      Query(cm, EqExpr::create(read, ConstantExpr::create(7, Expr::Int8))),
+      result));
+  ASSERT_TRUE(result);
+
+  ref<ConstantExpr> value;
+  ASSERT_TRUE(solver->getValue(Query(cm, read), value));
+  ASSERT_EQ(7u, value->getZExtValue());
+
+  // the assignment still satisfies the equality it was simplified with
+  std::vector<const Array *> objects{u, x};
+  std::vector<std::vector<unsigned char> > values;
+  ASSERT_TRUE(solver->getInitialValues(
+      Query(cm, ConstantExpr::alloc(0, Expr::Bool)), objects, values));
+  ASSERT_EQ(4u, values[0][0]);
+  ASSERT_EQ(2u, values[0][1]);
+  ASSERT_GT(2u, values[1][0]);
+
+  delete solver;
+}
+
+/* The fingerprint kept by a ConstraintManager stays that of its
+   constraints as equalities rewrite them, and its factors add up to it. */
+TEST(SolverTest, ConstraintFingerprint) {
+  const Array *a = ac.CreateArray("fp_a", 2);
+  const Array *b = ac.CreateArray("fp_b", 1);
+  auto read = [](const Array *array, unsigned index) {
+    return ReadExpr::create(UpdateList(array, 0),
+                            ConstantExpr::create(index, Expr::Int32));
+  };
+
+  ConstraintManager cm;
+  ASSERT_EQ(0u, cm.getFingerprint());
+  cm.addConstraint(UltExpr::create(read(a, 0), read(a, 1)));
+  cm.addConstraint(
+      UltExpr::create(read(b, 0), ConstantExpr::create(9, Expr::Int8)));
+  cm.addConstraint(UltExpr::create(read(a, 0), read(a, 1)));
+  ASSERT_EQ(fingerprintConstraints(cm.getAllConstraints()),
+            cm.getFingerprint());
+
+  // rewrites the first constraint
+  ConstraintManager copy(cm);
+  cm.addConstraint(
+      EqExpr::create(ConstantExpr::create(3, Expr::Int8), read(a, 0)));
+  ASSERT_EQ(fingerprintConstraints(cm.getAllConstraints()),
+            cm.getFingerprint());
+  ASSERT_EQ(fingerprintConstraints(copy.getAllConstraints()),
+            copy.getFingerprint());
+  ASSERT_NE(copy.getFingerprint(), cm.getFingerprint());
+
+  uint64_t factors = 0;
+  for (auto it = cm.factor_begin(), ie = cm.factor_end(); it != ie; ++it)
+    factors += (*it)->fingerprint;
+  if (cm.factor_size())
+    ASSERT_EQ(cm.getFingerprint(), factors);
+
+  Query query(cm, ConstantExpr::alloc(0, Expr::Bool));
+  ASSERT_EQ(cm.getFingerprint(), query.getFingerprint());
+  ASSERT_EQ(cm.getFingerprint(), query.withFalse().getFingerprint());
+}
+
+/* An equality with a constant rewrites the constraints containing its
+   expression, also in the updates they read, and only those. */
+TEST(SolverTest, EqualityRewritesOccurrences) {
+  const Array *a = ac.CreateArray("occ_a", 4);
+  const Array *b = ac.CreateArray("occ_b", 4);
+  const Array *c = ac.CreateArray("occ_c", 4);
+  auto read = [](const Array *array, unsigned index) {
+    return ReadExpr::create(UpdateList(array, 0),
+                            ConstantExpr::create(index, Expr::Int32));
+  };
+  ref<Expr> five = ConstantExpr::create(5, Expr::Int8);
+
+  ConstraintManager cm;
+  cm.addConstraint(UltExpr::create(read(a, 0), read(a, 1)));
+  cm.addConstraint(UltExpr::create(read(a, 1), read(a, 2)));
+  UpdateList cu(c, 0);
+  cu.extend(ConstantExpr::create(1, Expr::Int32),
+            AddExpr::create(read(a, 0), read(b, 1)));
+  ref<Expr> index = ZExtExpr::create(read(b, 2), Expr::Int32);
+  cm.addConstraint(UltExpr::create(ReadExpr::create(cu, index), five));
+  ConstraintManager copy(cm);
+
+  ref<Expr> three = ConstantExpr::create(3, Expr::Int8);
+  cm.addConstraint(EqExpr::create(three, read(a, 0)));
+  ASSERT_EQ(4u, cm.size());
+  const Constraints_ty &all = cm.getAllConstraints();
+  ASSERT_EQ(1u, all.count(UltExpr::create(three, read(a, 1))));
+  ASSERT_EQ(1u, all.count(UltExpr::create(read(a, 1), read(a, 2))));
+  UpdateList rewritten(c, 0);
+  rewritten.extend(ConstantExpr::create(1, Expr::Int32),
+                   AddExpr::create(three, read(b, 1)));
+  ASSERT_EQ(1u,
+            all.count(UltExpr::create(ReadExpr::create(rewritten, index), five)));
+  ASSERT_EQ(fingerprintConstraints(all), cm.getFingerprint());
+
+  // the copy keeps its constraints, and rewrites them on its own
+  ASSERT_EQ(3u, copy.size());
+  ASSERT_EQ(1u, copy.getAllConstraints().count(
+                    UltExpr::create(read(a, 0), read(a, 1))));
+  ref<Expr> four = ConstantExpr::create(4, Expr::Int8);
+  copy.addConstraint(EqExpr::create(four, read(a, 1)));
+  ASSERT_EQ(1u, copy.getAllConstraints().count(
+                    UltExpr::create(read(a, 0), four)));
+  ASSERT_EQ(1u, copy.getAllConstraints().count(
+                    UltExpr::create(four, read(a, 2))));
+}
+
+/* Memoized simplifications follow the equalities added after them. */
+TEST(SolverTest, SimplifyExprCache) {
+  const Array *a = ac.CreateArray("simp_a", 4);
+  auto read = [a](unsigned index) {
+    return ReadExpr::create(UpdateList(a, 0),
+                            ConstantExpr::create(index, Expr::Int32));
+  };
+  ref<Expr> sum = AddExpr::create(read(0), read(1));
+
+  ConstraintManager cm;
+  cm.addConstraint(UltExpr::create(read(2), read(3)));
+  ASSERT_EQ(sum, cm.simplifyExpr(sum));
+  ASSERT_EQ(sum, cm.simplifyExpr(sum));
+
+  cm.addConstraint(EqExpr::create(ConstantExpr::create(3, Expr::Int8), read(0)));
+  ref<Expr> half = AddExpr::create(ConstantExpr::create(3, Expr::Int8), read(1));
+  ASSERT_EQ(half, cm.simplifyExpr(sum));
+  ASSERT_EQ(half, cm.simplifyExpr(sum));
+
+  cm.addConstraint(EqExpr::create(ConstantExpr::create(4, Expr::Int8), read(1)));
+  ASSERT_EQ(ConstantExpr::create(7, Expr::Int8), cm.simplifyExpr(sum));
+}
+
+/* Every chain of the adaptive solver is tried on a class of queries before
+   it settles on one, and all of them give the same answers. */
+TEST(SolverTest, AdaptiveChain) {
+  Solver *solver = createAdaptiveSolver(createCoreSolver(CoreSolverToUse));
+  const Array *x = ac.CreateArray("ad_x", 1);
+  ref<Expr> x0 = ReadExpr::create(UpdateList(x, 0),
+                                  ConstantExpr::create(0, Expr::Int32));
+
+  Statistic *chains[] = {&stats::adaptiveDefaultChain,
+                         &stats::adaptiveCexCacheToggled,
+                         &stats::adaptiveEqualitySimplifierToggled,
+                         &stats::adaptiveFastCexToggled};
+  std::vector<uint64_t> before;
+  for (Statistic *s : chains)
+    before.push_back(*s);
+
+  const unsigned numQueries = 40;
+  for (unsigned i = 0; i < numQueries; ++i) {
+    ConstraintManager cm;
+    cm.addConstraint(
+        UltExpr::create(x0, ConstantExpr::create(100 + i, Expr::Int8)));
+    bool result;
+    ASSERT_TRUE(solver->mustBeTrue(
+        Query(cm, UltExpr::create(x0, ConstantExpr::create(200, Expr::Int8))),
+        result));
+    ASSERT_TRUE(result);
+    ref<ConstantExpr> value;
+    ASSERT_TRUE(solver->getValue(Query(cm, x0), value));
+    ASSERT_GT(100 + i, value->getZExtValue());
+  }
+
+  uint64_t total = 0;
+  for (unsigned i = 0; i < 4; ++i) {
+    uint64_t answered = *chains[i] - before[i];
+    ASSERT_LE(4u, answered);
+    total += answered;
+  }
+  ASSERT_EQ(2 * numQueries, total);
+  delete solver;
+}
+
+/* A batch of truth queries over the same constraints gets the answers of
+   the single queries, through the caches and across independent factors. */
+TEST(SolverTest, BatchQueries) {
+  Solver *solver = createCoreSolver(CoreSolverToUse);
+  solver = createCexCachingSolver(solver);
+  solver = createCachingSolver(solver);
+  solver = createIndependentSolver(solver);
+  const Array *x = ac.CreateArray("batch_x", 1);
+  const Array *y = ac.CreateArray("batch_y", 1);
+  ref<Expr> x0 = ReadExpr::create(UpdateList(x, 0),
+                                  ConstantExpr::create(0, Expr::Int32));
+  ref<Expr> y0 = ReadExpr::create(UpdateList(y, 0),
+                                  ConstantExpr::create(0, Expr::Int32));
+  auto c8 = [](uint64_t v) { return ConstantExpr::create(v, Expr::Int8); };
+
+  ConstraintManager cm;
+  cm.addConstraint(UltExpr::create(x0, c8(10)));
+  cm.addConstraint(UltExpr::create(c8(4), y0));
+  std::vector<ref<Expr> > exprs = {
+      UltExpr::create(x0, c8(20)),
+      EqExpr::create(x0, c8(3)),
+      EqExpr::create(x0, c8(12)),
+      UltExpr::create(c8(2), y0),
+      EqExpr::create(y0, c8(4)),
+      ConstantExpr::alloc(1, Expr::Bool),
+      AndExpr::create(UltExpr::create(x0, c8(10)), UltExpr::create(c8(3), y0)),
+      EqExpr::create(x0, y0)};
+  const bool mustBeTrue[] = {true, false, false, true,
+                             false, true, true, false};
+  const bool mayBeTrue[] = {true, true, false, true,
+                            false, true, true, true};
+
+  Query query(cm, ConstantExpr::alloc(0, Expr::Bool));
+  for (unsigned round = 0; round < 2; ++round) {
+    std::vector<bool> results;
+    ASSERT_TRUE(solver->mustBeTrue(query, exprs, results));
+    ASSERT_EQ(exprs.size(), results.size());
+    for (unsigned i = 0; i < exprs.size(); ++i) {
+      ASSERT_EQ(mustBeTrue[i], results[i]);
+      bool single;
+      ASSERT_TRUE(solver->mustBeTrue(query.withExpr(exprs[i]), single));
+      ASSERT_EQ(mustBeTrue[i], single);
+    }
+    ASSERT_TRUE(solver->mayBeTrue(query, exprs, results));
+    for (unsigned i = 0; i < exprs.size(); ++i)
+      ASSERT_EQ(mayBeTrue[i], results[i]);
+  }
+  delete solver;
+}
+
+/* A query sliced out of one large factor gets the answer of the whole
+   factor: a slice that misses constraints the answer needs is refined by
+   the constraints its models violate. */
+TEST(SolverTest, IndependentSlicing) {
+  unsigned threshold = IndependentSlicingThreshold;
+  IndependentSlicingThreshold = 4;
+  Solver *solver = createCoreSolver(CoreSolverToUse);
+  solver = createCexCachingSolver(solver);
+  solver = createCachingSolver(solver);
+  solver = createIndependentSolver(solver);
+  const Array *a = ac.CreateArray("slice_a", 16);
+  auto read = [a](unsigned index) {
+    return ReadExpr::create(UpdateList(a, 0),
+                            ConstantExpr::create(index, Expr::Int32));
+  };
+  auto c8 = [](uint64_t v) { return ConstantExpr::create(v, Expr::Int8); };
+
+  // a single factor which orders all the bytes of a
+  ConstraintManager cm;
+  for (unsigned i = 0; i + 1 < 16; ++i)
+    cm.addConstraint(UltExpr::create(read(i), read(i + 1)));
+
+  uint64_t sliced = stats::independentSlicedQueries;
+  uint64_t refinements = stats::independentSliceRefinements;
+  bool result;
+  ASSERT_TRUE(solver->mustBeTrue(Query(cm, UleExpr::create(read(0), c8(240))),
+                                 result));
+  ASSERT_TRUE(result);
+  ASSERT_TRUE(solver->mustBeTrue(Query(cm, UltExpr::create(read(0), c8(240))),
+                                 result));
+  ASSERT_FALSE(result);
+  ASSERT_TRUE(solver->mayBeTrue(Query(cm, EqExpr::create(read(7), c8(7))),
+                                result));
+  ASSERT_TRUE(result);
+  ASSERT_TRUE(solver->mayBeTrue(Query(cm, EqExpr::create(read(7), c8(6))),
+                                result));
+  ASSERT_FALSE(result);
+  Solver::Validity validity;
+  ASSERT_TRUE(solver->evaluate(Query(cm, UleExpr::create(c8(15), read(15))),
+                               validity));
+  ASSERT_EQ(Solver::True, validity);
+  ASSERT_TRUE(solver->evaluate(Query(cm, EqExpr::create(read(15), c8(14))),
+                               validity));
+  ASSERT_EQ(Solver::False, validity);
+  ASSERT_LT(sliced, stats::independentSlicedQueries);
+  ASSERT_LT(refinements, stats::independentSliceRefinements);
+
+  delete solver;
+  IndependentSlicingThreshold = threshold;
+}
+
+#ifdef ENABLE_Z3
+/* Z3 keeps the translations of update lists across queries. A list that
+   grows reuses the translation of its older updates, and a list built after
+   another one was freed is not mistaken for it. */
+TEST(SolverTest, Z3UpdateListsAcrossQueries) {
+  Solver *solver = createCoreSolver(Z3_SOLVER);
+  const Array *m = ac.CreateArray("z3ul_m", 16);
+  const Array *k = ac.CreateArray("z3ul_k", 1);
+  ref<Expr> index = ZExtExpr::create(
+      ReadExpr::create(UpdateList(k, 0), ConstantExpr::create(0, Expr::Int32)),
+      Expr::Int32);
+  ConstraintManager cm;
+  cm.addConstraint(EqExpr::create(ConstantExpr::create(3, Expr::Int32), index));
+  auto valueAt3 = [&](const UpdateList &ul) {
+    ref<ConstantExpr> value;
+    EXPECT_TRUE(solver->getValue(Query(cm, ReadExpr::create(ul, index)), value));
+    return value->getZExtValue();
+  };
+
+  for (unsigned round = 0; round < 3; ++round) {
+    UpdateList ul(m, 0);
+    for (unsigned i = 0; i < 2000; ++i)
+      ul.extend(ConstantExpr::create(i % 16, Expr::Int32),
+                ConstantExpr::create((i + round) % 251, Expr::Int8));
+    // the last write to 3 is the one of 1987
+    ASSERT_EQ((1987 + round) % 251, valueAt3(ul));
+    ul.extend(ConstantExpr::create(3, Expr::Int32),
+              ConstantExpr::create(200 + round, Expr::Int8));
+    ASSERT_EQ(200 + round, valueAt3(ul));
+  }
+  delete solver;
+}
+
+/* The values of a large array are read from its model at once, both the
+   bytes read at constant offsets and the one read at a symbolic index. */
+TEST(SolverTest, Z3InitialValuesOfLargeArray) {
+  Solver *solver = createCoreSolver(Z3_SOLVER);
+  const unsigned size = 65536;
+  const Array *buf = ac.CreateArray("z3iv_buf", size);
+  const Array *k = ac.CreateArray("z3iv_k", 1);
+  UpdateList ul(buf, 0);
+  auto byteAt = [&](ref<Expr> index) { return ReadExpr::create(ul, index); };
+  ref<Expr> index = ZExtExpr::create(
+      ReadExpr::create(UpdateList(k, 0), ConstantExpr::create(0, Expr::Int32)),
+      Expr::Int32);
+  ConstraintManager cm;
+  cm.addConstraint(EqExpr::create(
+      byteAt(ConstantExpr::create(0, Expr::Int32)),
+      ConstantExpr::create(5, Expr::Int8)));
+  cm.addConstraint(EqExpr::create(
+      byteAt(ConstantExpr::create(size - 1, Expr::Int32)),
+      ConstantExpr::create(9, Expr::Int8)));
+  cm.addConstraint(UltExpr::create(
+      ConstantExpr::create(200, Expr::Int8),
+      byteAt(ConstantExpr::create(3000, Expr::Int32))));
+  cm.addConstraint(EqExpr::create(ConstantExpr::create(17, Expr::Int32), index));
+  cm.addConstraint(
+      EqExpr::create(byteAt(index), ConstantExpr::create(42, Expr::Int8)));
+
+  std::vector<const Array *> objects = {buf, k};
+  std::vector<std::vector<unsigned char> > values;
+  ASSERT_TRUE(solver->getInitialValues(
+      Query(cm, ConstantExpr::alloc(0, Expr::Bool)), objects, values));
+  ASSERT_EQ(size, values[0].size());
+  ASSERT_EQ(5, values[0][0]);
+  ASSERT_EQ(9, values[0][size - 1]);
+  ASSERT_LT(200, values[0][3000]);
+  ASSERT_EQ(17, values[1][0]);
+  ASSERT_EQ(42, values[0][17]);
+  delete solver;
+}
+#endif
+
+#ifdef ENABLE_CADICAL
+/* Queries reading bytes at concrete indices are answered by the bit-blaster
+   alone, while the others reach the solver below it. */
+TEST(SolverTest, BitBlaster) {
+  Solver *solver = createBitBlastingSolver(createDummySolver());
+  const Array *x = ac.CreateArray("bb_x", 4);
+  auto read = [&](unsigned index) {
+    return ReadExpr::create(UpdateList(x, 0),
+                            ConstantExpr::create(index, Expr::Int32));
+  };
+  auto byte = [](uint64_t value) {
+    return ConstantExpr::create(value, Expr::Int8);
+  };
+
+  // x[0] ^ 0x5a == 0x30, x[1] & 0xf0 == 0x40, ((x[2] << 1) + x[1]) s< 0
+  ConstraintManager cm;
+  cm.addConstraint(
+      EqExpr::create(byte(0x30), XorExpr::create(read(0), byte(0x5a))));
+  cm.addConstraint(
+      EqExpr::create(byte(0x40), AndExpr::create(read(1), byte(0xf0))));
+  cm.addConstraint(SltExpr::create(
+      AddExpr::create(ShlExpr::create(read(2), byte(1)), read(1)), byte(0)));
+
+  bool result;
+  ASSERT_TRUE(solver->mustBeTrue(Query(cm, EqExpr::create(read(0), byte(0x6a))),
+                                 result));
+  ASSERT_TRUE(result);
+  ASSERT_TRUE(solver->mustBeFalse(
+      Query(cm, UltExpr::create(read(1), byte(0x40))), result));
+  ASSERT_TRUE(result);
+  Solver::Validity validity;
+  ASSERT_TRUE(solver->evaluate(
+      Query(cm, EqExpr::create(read(1), byte(0x41))), validity));
+  ASSERT_EQ(Solver::Unknown, validity);
+
+  ref<Expr> word = ConcatExpr::create(read(1), read(0));
+  ref<ConstantExpr> value;
+  ASSERT_TRUE(solver->getValue(
+      Query(cm, AndExpr::create(word, ConstantExpr::create(0xff, Expr::Int16))),
+      value));
+  ASSERT_EQ(0x6au, value->getZExtValue());
+
+  std::vector<const Array *> objects{x};
+  std::vector<std::vector<unsigned char> > values;
+  ASSERT_TRUE(solver->getInitialValues(
+      Query(cm, ConstantExpr::alloc(0, Expr::Bool)), objects, values));
+  ASSERT_EQ(0x6au, values[0][0]);
+  ASSERT_EQ(0x40u, values[0][1] & 0xf0);
+  ASSERT_TRUE(((values[0][2] << 1) + values[0][1]) & 0x80);
+
+  // a symbolic index is left to the dummy solver, which fails
+  ref<Expr> symbolic = ReadExpr::create(
+      UpdateList(x, 0), ZExtExpr::create(read(3), Expr::Int32));
+  ASSERT_FALSE(
+      solver->mustBeTrue(Query(cm, EqExpr::create(symbolic, byte(0))), result));
+
+  delete solver;
+}
+#endif
+
 }
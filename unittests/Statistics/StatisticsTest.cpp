@@ -0,0 +1,54 @@
+#include "klee/Statistics.h"
+
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+using namespace klee;
+
+namespace {
+
+Statistic counter("TestCounter", "TCnt");
+Statistic other("TestOther", "TOth");
+
+TEST(StatisticsTest, Unsharded) {
+  counter.setValue(0);
+  ++counter;
+  counter += 41;
+  EXPECT_EQ(42u, counter.getValue());
+  EXPECT_EQ(42u, *theStatisticManager->getStatisticByName("TestCounter"));
+}
+
+TEST(StatisticsTest, ThreadShards) {
+  counter.setValue(5);
+  other.setValue(0);
+  const unsigned threads = 4, increments = 100000;
+  for (unsigned round = 0; round < 2; ++round) {
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t)
+      workers.emplace_back([&]() {
+        StatisticManager::ThreadScope scope;
+        for (unsigned i = 0; i < increments; ++i)
+          ++counter;
+      });
+    // the interpreting thread keeps counting on the shared counters
+    for (unsigned i = 0; i < increments; ++i)
+      ++counter;
+    for (auto &w : workers)
+      w.join();
+  }
+  EXPECT_EQ(5u + 2 * (threads + 1) * increments, counter.getValue());
+  EXPECT_EQ(0u, other.getValue());
+
+  counter.setValue(7);
+  EXPECT_EQ(7u, counter.getValue());
+  std::thread([]() {
+    StatisticManager::ThreadScope scope;
+    StatisticManager::ThreadScope nested;
+    counter += 3;
+  }).join();
+  EXPECT_EQ(10u, counter.getValue());
+}
+
+} // namespace
@@ -1,6 +1,9 @@
 #include "klee/Internal/ADT/TreeStream.h"
 #include <vector>
+#include <cstdio>
 #include <cstring>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include "gtest/gtest.h"
 
@@ -46,3 +49,141 @@ TEST(TreeStreamTest, WriteLargerThanBufferSize) {
   for (unsigned i=0; i<NBYTES; i++)
     ASSERT_EQ('A', out[0][i]);
 }
+
+/* Interleaved writes to forked streams spanning many I/O blocks: each stream
+   has to read back its parent's prefix followed by its own entries. */
+TEST(TreeStreamTest, ForkedStreamsAcrossBlocks) {
+  TreeStreamWriter tsw("tsw3.out");
+  ASSERT_TRUE(tsw.good());
+
+  TreeOStream parent = tsw.open();
+  for (uint64_t i = 0; i < 1000; ++i)
+    parent << i;
+  TreeOStream left = parent.branch();
+  TreeOStream right = parent.branch();
+  const uint64_t N = 3 * TreeStreamWriter::BlockSize / sizeof(uint64_t);
+  for (uint64_t i = 0; i < N; ++i) {
+    left << (1000 + i);
+    right << (2 * N + i);
+  }
+
+  std::vector<uint64_t> out;
+  tsw.readStream(left.getID(), out);
+  ASSERT_EQ(1000 + N, out.size());
+  for (uint64_t i = 0; i < out.size(); ++i)
+    ASSERT_EQ(i, out[i]);
+
+  out.clear();
+  tsw.readStream(right.getID(), out);
+  ASSERT_EQ(1000 + N, out.size());
+  for (uint64_t i = 0; i < 1000; ++i)
+    ASSERT_EQ(i, out[i]);
+  for (uint64_t i = 0; i < N; ++i)
+    ASSERT_EQ(2 * N + i, out[1000 + i]);
+}
+
+/* Entries the parent writes after a fork must not show up in the child, even
+   when the chain is several forks deep. */
+TEST(TreeStreamTest, ChainStopsAtForkPoint) {
+  TreeStreamWriter tsw("tsw4.out");
+  ASSERT_TRUE(tsw.good());
+
+  TreeOStream root = tsw.open();
+  root << 'a';
+  TreeOStream mid = root.branch();
+  root << 'x';
+  mid << 'b';
+  TreeOStream leaf = mid.branch();
+  mid << 'y';
+  leaf << 'c';
+  root << 'z';
+
+  std::vector<char> out;
+  tsw.readStream(leaf.getID(), out);
+  ASSERT_EQ(std::vector<char>({'a', 'b', 'c'}), out);
+
+  out.clear();
+  tsw.readStream(mid.getID(), out);
+  ASSERT_EQ(std::vector<char>({'a', 'b', 'y'}), out);
+
+  out.clear();
+  tsw.readStream(root.getID(), out);
+  ASSERT_EQ(std::vector<char>({'a', 'x', 'z'}), out);
+}
+
+/* A forked process continues the streams of its parent in a copy of the
+   file, while the parent keeps writing to its own. */
+TEST(TreeStreamTest, ReopenInChild) {
+  TreeStreamWriter tsw("tsw4.out");
+  ASSERT_TRUE(tsw.good());
+
+  TreeOStream tos = tsw.open();
+  tos << 'a' << 'b';
+  tsw.flush();
+  pid_t pid = fork();
+  ASSERT_NE(-1, pid);
+  if (pid == 0) {
+    if (!tsw.reopenInChild("tsw4-child.out"))
+      _exit(1);
+    tos << 'c';
+    tos.flush();
+    std::vector<char> out;
+    tsw.readStream(tos.getID(), out);
+    _exit(out == std::vector<char>{'a', 'b', 'c'} ? 0 : 2);
+  }
+  tos << 'x' << 'y';
+  tos.flush();
+  int status;
+  ASSERT_EQ(pid, waitpid(pid, &status, 0));
+  ASSERT_TRUE(WIFEXITED(status));
+  ASSERT_EQ(0, WEXITSTATUS(status));
+
+  std::vector<char> out;
+  tsw.readStream(tos.getID(), out);
+  ASSERT_EQ((std::vector<char>{'a', 'b', 'x', 'y'}), out);
+}
+
+/* Copying a stream of fixed-size entries gives the bytes readStream decodes,
+   across the segments of its parent and of several blocks. */
+TEST(TreeStreamTest, CopyStream) {
+  TreeStreamWriter tsw("tsw5.out");
+  ASSERT_TRUE(tsw.good());
+
+  TreeOStream parent = tsw.open();
+  for (uint64_t i = 0; i < 1000; ++i)
+    parent << i;
+  TreeOStream child = parent.branch();
+  TreeOStream other = parent.branch();
+  const uint64_t N = 3 * TreeStreamWriter::BlockSize / sizeof(uint64_t);
+  for (uint64_t i = 0; i < N; ++i) {
+    child << (1000 + i);
+    other << uint64_t(0);
+  }
+
+  FILE *f = fopen("tsw5-copy.out", "w+b");
+  ASSERT_NE(nullptr, f);
+  ASSERT_TRUE(tsw.copyStream(child.getID(), sizeof(uint64_t), fileno(f)));
+  std::vector<uint64_t> copy(1000 + N + 1);
+  rewind(f);
+  ASSERT_EQ(1000 + N, fread(copy.data(), sizeof(uint64_t), copy.size(), f));
+  fclose(f);
+  copy.pop_back();
+
+  std::vector<uint64_t> out;
+  tsw.readStream(child.getID(), out);
+  ASSERT_EQ(out, copy);
+}
+
+/* A write the file does not take, here to a full device, is reported by
+   good() once the writer is flushed. */
+TEST(TreeStreamTest, WriteFailure) {
+  if (access("/dev/full", W_OK))
+    return;
+  TreeStreamWriter tsw("/dev/full");
+  ASSERT_TRUE(tsw.good());
+
+  TreeOStream tos = tsw.open();
+  tos << std::string(2 * TreeStreamWriter::BlockSize, 'A');
+  tos.flush();
+  ASSERT_FALSE(tsw.good());
+}
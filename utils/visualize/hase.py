@@ -168,6 +168,67 @@ def isKInstValid(node):
             (len(node.kinst) > 0) and \
             node.kinst != 'N/A'
 
+"""
+Load a graph drawn by kleaver (*.json, or *.graph from -binary, see
+tools/kleaver/BinaryDrawer.h) into the dict layout of the json graph
+"""
+def loadGraph(path):
+    if not path.endswith(".graph"):
+        return json.load(open(path))
+    import array
+    import struct
+    data = open(path, "rb").read()
+    if data[:8] != b"KGRAPH01":
+        raise RuntimeError("%s is not a kleaver binary graph" % path)
+    n, m, nstrings = struct.unpack_from("=QQQ", data, 8)
+    pos = [32]
+    def column(typecode, count):
+        a = array.array(typecode)
+        a.frombytes(data[pos[0]:pos[0] + count * a.itemsize])
+        pos[0] += count * a.itemsize
+        return a
+    offsets = column("Q", n + 1)
+    targets = column("I", m)
+    isindex = column("B", m)
+    kind = column("i", n)
+    width = column("I", n)
+    category = column("B", n)
+    ispointer = column("B", n)
+    freq = column("I", n)
+    label = column("I", n)
+    kinst = column("I", n)
+    root = column("I", n)
+    idep = column("i", n)
+    column("I", n) # fan-in
+    column("B", n) # symbolic
+    strings = data[pos[0]:pos[0] + nstrings]
+    def string(offset):
+        return strings[offset:strings.index(b"\0", offset)].decode()
+    nodes = {}
+    for i in range(n):
+        kinststr = string(kinst[i])
+        node = {
+            "label": string(label[i]),
+            "Kind": {-1: "UN", -2: "Array"}.get(kind[i], kind[i]),
+            "Width": width[i],
+            "Category": "Array" if category[i] == ord("A") \
+                    else chr(category[i]),
+            "KInst": kinststr if kinststr else "N/A",
+            "DbgInfo": "N/A",
+            "IsPointer": "true" if ispointer[i] else "false",
+            "Freq": freq[i],
+            "IDep": idep[i],
+        }
+        if root[i]:
+            node["Root"] = string(root[i])
+        nodes[str(i)] = node
+    edges = []
+    for i in range(n):
+        for k in range(offsets[i], offsets[i + 1]):
+            edges.append({"source": str(i), "target": str(targets[k]),
+                "weight": 1.5 if isindex[k] else 1.0})
+    return {"nodes": nodes, "edges": edges}
+
 """
 !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
 !!!!!!!!!!!!!!!!!!!!!!!!!!!!!IMPORTANT!!!!!!!!!!!!!!!!!!!!!!!!!!!
@@ -1193,7 +1254,8 @@ if __name__ == "__main__":
     parser.add_argument("--noptwrite", action="store_true",
             help="Do not assume the minimum data entry to record is 8B")
     parser.add_argument("graph_json", type=str, action="store",
-            help="the json file describing the cosntraint graph")
+            help="the json (or binary *.graph) file describing the "
+            "cosntraint graph")
     parser.add_argument("selected_kinst", nargs='*', type=str,
             help="kinst already chosen to be recorded")
     args = parser.parse_args()
@@ -1210,7 +1272,7 @@ if __name__ == "__main__":
             changed = False
             for graph_path in UN_constraints:
                 print("Optimizing on %s" % (graph_path))
-                constraint_graph = json.load(open(graph_path))
+                constraint_graph = loadGraph(graph_path)
                 PyG = PyGraph.buildFromPyDict(constraint_graph)
                 new_recinsts, new_PyG = PyG.recursiveOptimizeRecKInstL(\
                         PreOptimizedUNKinstset)
@@ -1230,7 +1292,7 @@ if __name__ == "__main__":
             f.write("%s\n" % '\n'.join(kinst_sorted))
             f.close()
         sys.exit(0)
-    graph = json.load(open(args.graph_json))
+    graph = loadGraph(args.graph_json)
     h = PyGraph.buildFromPyDict(graph)
     print("%d nodes, %d edges, max idep %d" % (len(h.gynodes),
         len(h.gyedges), h.max_idep()))